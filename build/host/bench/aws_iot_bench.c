@@ -0,0 +1,361 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Host benchmark of the MQTT packet code, the topic trie and the JSON code of
+ * the shadow, built by build/host/host_bench.mk.
+ *
+ * Every case is run until it took at least HB_MIN_NSEC and is reported in
+ * nanoseconds and in bytes taken from the heap per operation. The heap is
+ * counted by wrapping malloc(), calloc() and realloc() at link time.
+ *
+ * Usage: aws_iot_bench [substring of the case names to run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MQTTPacket.h"
+#include "MQTTTopicTrie.h"
+#include "aws_iot_json_stream.h"
+#include "aws_iot_shadow_json_data.h"
+#include <json_writer.h>
+#include <fast_float.h>
+
+#define HB_MIN_NSEC 200000000ULL
+#define HB_MAX_FIELDS 32
+#define HB_MAX_FILTERS 64
+#define HB_TRIE_NODES (HB_MAX_FILTERS * 6)
+#define HB_BUF_SIZE 4096
+
+/* Referred to by the client token of the shadow documents */
+char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES] = "bench-client";
+
+static unsigned long long hb_heap_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	hb_heap_bytes += size;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	hb_heap_bytes += n * size;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	hb_heap_bytes += size;
+	return __real_realloc(p, size);
+}
+
+static unsigned long long hb_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Keeps the compiler from dropping work whose result is not used */
+static volatile unsigned long hb_sink;
+
+static const char *hb_filter;
+
+static void hb_run(const char *name, int size, void (*fn)(int size))
+{
+	unsigned long long start, elapsed, heap, iters = 1, i;
+
+	if (hb_filter && !strstr(name, hb_filter))
+		return;
+
+	/* Once to warm the caches */
+	fn(size);
+
+	for (;;) {
+		heap = hb_heap_bytes;
+		start = hb_now();
+		for (i = 0; i < iters; i++)
+			fn(size);
+		elapsed = hb_now() - start;
+		if (elapsed >= HB_MIN_NSEC)
+			break;
+		iters *= 2;
+	}
+
+	printf("%-28s %6d %12.1f %10.1f\n", name, size,
+	       (double)elapsed / iters,
+	       (double)(hb_heap_bytes - heap) / iters);
+}
+
+/* MQTT publish packets */
+
+static const char hb_topic[] = "$aws/things/bench-thing/shadow/update";
+static unsigned char hb_payload[HB_BUF_SIZE];
+static unsigned char hb_packet[HB_BUF_SIZE + 128];
+static uint32_t hb_packet_len;
+
+static void hb_publish_serialize(int size)
+{
+	MQTTString topic = MQTTString_initializer;
+
+	topic.cstring = (char *)hb_topic;
+	MQTTSerialize_publish(hb_packet, sizeof(hb_packet), 0, QOS1, 0, 1,
+			      topic, hb_payload, size, &hb_packet_len);
+	hb_sink += hb_packet_len;
+}
+
+static void hb_publish_deserialize(int size)
+{
+	MQTTString topic = MQTTString_initializer;
+	unsigned char dup, retained;
+	unsigned char *payload;
+	uint32_t payload_len;
+	uint16_t id;
+	QoS qos;
+
+	MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topic, &payload,
+				&payload_len, hb_packet, hb_packet_len);
+	hb_sink += payload_len;
+}
+
+static void hb_publish_setup(int size)
+{
+	memset(hb_payload, 'x', size);
+	hb_publish_serialize(size);
+}
+
+/* Topic filters, the topic matched is the one of the last subscription */
+
+static TopicTrieNode hb_trie_nodes[HB_TRIE_NODES];
+static TopicTrie hb_trie;
+static char hb_filters[HB_MAX_FILTERS][64];
+static char hb_match_topic[64];
+
+static void hb_trie_setup(int filters)
+{
+	int i;
+
+	MQTTTopicTrieInit(&hb_trie, hb_trie_nodes, HB_TRIE_NODES);
+	for (i = 0; i < filters; i++) {
+		if (i % 2)
+			snprintf(hb_filters[i], sizeof(hb_filters[i]),
+				 "$aws/things/thing-%d/shadow/+/accepted", i);
+		else
+			snprintf(hb_filters[i], sizeof(hb_filters[i]),
+				 "devices/%d/#", i);
+		MQTTTopicTrieInsert(&hb_trie, hb_filters[i], i);
+	}
+	snprintf(hb_match_topic, sizeof(hb_match_topic),
+		 "$aws/things/thing-%d/shadow/update/accepted",
+		 (filters - 1) | 1);
+}
+
+static void hb_topic_match(int filters)
+{
+	hb_sink += MQTTTopicTrieMatch(&hb_trie, hb_match_topic,
+				      strlen(hb_match_topic));
+}
+
+/* Shadow documents of a number of fields of the usual types */
+
+static char hb_keys[HB_MAX_FIELDS][16];
+static int32_t hb_ints[HB_MAX_FIELDS];
+static float hb_floats[HB_MAX_FIELDS];
+static bool hb_bools[HB_MAX_FIELDS];
+static jsonStruct_t hb_fields[HB_MAX_FIELDS];
+static jsonStruct_t *hb_field_ptrs[HB_MAX_FIELDS];
+static char hb_doc[HB_BUF_SIZE];
+static int hb_doc_len;
+
+static void hb_fields_setup(int fields)
+{
+	int i;
+
+	for (i = 0; i < fields; i++) {
+		snprintf(hb_keys[i], sizeof(hb_keys[i]), "field%d", i);
+		hb_fields[i].pKey = hb_keys[i];
+		hb_fields[i].cb = NULL;
+		switch (i % 3) {
+		case 0:
+			hb_ints[i] = i * 1000 - 7;
+			hb_fields[i].pData = &hb_ints[i];
+			hb_fields[i].type = SHADOW_JSON_INT32;
+			break;
+		case 1:
+			hb_floats[i] = i * 1.25f - 3.5f;
+			hb_fields[i].pData = &hb_floats[i];
+			hb_fields[i].type = SHADOW_JSON_FLOAT;
+			break;
+		default:
+			hb_bools[i] = i & 1;
+			hb_fields[i].pData = &hb_bools[i];
+			hb_fields[i].type = SHADOW_JSON_BOOL;
+			break;
+		}
+		hb_field_ptrs[i] = &hb_fields[i];
+	}
+}
+
+static void hb_shadow_build(int fields)
+{
+	jsonBuilder_t builder;
+
+	aws_iot_shadow_json_builder_init(&builder, hb_doc, sizeof(hb_doc));
+	aws_iot_shadow_json_builder_add_reported_array(&builder, fields,
+						       hb_field_ptrs);
+	aws_iot_shadow_json_builder_finalize(&builder);
+	hb_sink += builder.length;
+}
+
+static void hb_json_writer_build(int fields)
+{
+	struct json_writer w;
+	int i;
+
+	json_writer_init(&w, hb_doc, sizeof(hb_doc), NULL, NULL);
+	json_writer_start_object(&w, NULL);
+	json_writer_start_object(&w, "state");
+	json_writer_start_object(&w, "reported");
+	for (i = 0; i < fields; i++) {
+		switch (hb_fields[i].type) {
+		case SHADOW_JSON_INT32:
+			json_writer_add_int(&w, hb_keys[i], hb_ints[i]);
+			break;
+		case SHADOW_JSON_FLOAT:
+			json_writer_add_float(&w, hb_keys[i], hb_floats[i], 6);
+			break;
+		default:
+			json_writer_add_bool(&w, hb_keys[i], hb_bools[i]);
+			break;
+		}
+	}
+	json_writer_end_object(&w);
+	json_writer_end_object(&w);
+	json_writer_end_object(&w);
+	hb_sink += json_writer_finish(&w);
+}
+
+/* A delta document as the shadow sends it */
+static void hb_delta_setup(int fields)
+{
+	int i;
+
+	hb_fields_setup(fields);
+	hb_doc_len = snprintf(hb_doc, sizeof(hb_doc),
+			      "{\"version\":1234,\"timestamp\":1460000000,"
+			      "\"state\":{");
+	for (i = 0; i < fields; i++)
+		hb_doc_len += snprintf(hb_doc + hb_doc_len,
+				       sizeof(hb_doc) - hb_doc_len,
+				       "%s\"%s\":%s", i ? "," : "", hb_keys[i],
+				       i % 3 == 0 ? "-4242" :
+				       i % 3 == 1 ? "21.75" : "true");
+	hb_doc_len += snprintf(hb_doc + hb_doc_len, sizeof(hb_doc) - hb_doc_len,
+			       "},\"metadata\":{}}");
+}
+
+static bool hb_stream_element(const JsonStreamEvent_t *ev, void *ctx)
+{
+	float f;
+
+	(*(unsigned long *)ctx)++;
+	if (ev->type == JSON_STREAM_PRIMITIVE)
+		fast_strtof(ev->pValue, ev->valueLength, &f);
+	return true;
+}
+
+static void hb_stream_feed(int chunk)
+{
+	static JsonStream_t stream;
+	unsigned long elements = 0;
+	int off, n;
+
+	aws_iot_json_stream_init(&stream, hb_stream_element, &elements);
+	for (off = 0; off < hb_doc_len; off += n) {
+		n = hb_doc_len - off < chunk ? hb_doc_len - off : chunk;
+		aws_iot_json_stream_feed(&stream, hb_doc + off, n);
+	}
+	aws_iot_json_stream_finish(&stream);
+	hb_sink += elements;
+}
+
+static void hb_stream_parse(int fields)
+{
+	hb_stream_feed(hb_doc_len);
+}
+
+static void hb_stream_parse_chunked(int fields)
+{
+	hb_stream_feed(64);
+}
+
+/* Numbers */
+
+static void hb_ftoa(int decimals)
+{
+	char num[48];
+
+	hb_sink += fast_ftoa(-1013.25f, decimals, num, sizeof(num));
+}
+
+static void hb_strtof(int len)
+{
+	static const char num[] = "-1013.25";
+	float f;
+
+	hb_sink += fast_strtof(num, len, &f);
+}
+
+int main(int argc, char **argv)
+{
+	static const int payloads[] = { 16, 256, 2048 };
+	static const int filters[] = { 4, 16, 64 };
+	static const int fields[] = { 2, 8, 32 };
+	int i;
+
+	if (argc > 1)
+		hb_filter = argv[1];
+
+	printf("%-28s %6s %12s %10s\n", "case", "size", "ns/op", "bytes/op");
+
+	for (i = 0; i < 3; i++) {
+		hb_publish_setup(payloads[i]);
+		hb_run("publish_serialize", payloads[i], hb_publish_serialize);
+		hb_run("publish_deserialize", payloads[i],
+		       hb_publish_deserialize);
+	}
+
+	for (i = 0; i < 3; i++) {
+		hb_trie_setup(filters[i]);
+		hb_run("topic_match", filters[i], hb_topic_match);
+	}
+
+	for (i = 0; i < 3; i++) {
+		hb_fields_setup(fields[i]);
+		hb_run("shadow_build", fields[i], hb_shadow_build);
+		hb_run("json_writer_build", fields[i], hb_json_writer_build);
+	}
+
+	for (i = 0; i < 3; i++) {
+		hb_delta_setup(fields[i]);
+		hb_run("delta_stream_parse", fields[i], hb_stream_parse);
+		hb_run("delta_stream_parse_64b", fields[i],
+		       hb_stream_parse_chunked);
+	}
+
+	hb_run("fast_ftoa", 2, hb_ftoa);
+	hb_run("fast_strtof", 8, hb_strtof);
+
+	return 0;
+}
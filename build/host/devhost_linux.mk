@@ -7,3 +7,6 @@ os_dir := Linux
 define b-abspath
 $(abspath $(1))
 endef
+
+# Host benchmark of the AWS IoT code: make host-bench [BENCH=<case>]
+include build/host/host_bench.mk
@@ -0,0 +1,61 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+#
+# Description:
+# ------------
+# Builds the pure C parts of the AWS IoT code for the development host and
+# runs a benchmark of them, see build/host/bench/aws_iot_bench.c:
+#
+#	$ make host-bench
+#
+# The file needs nothing from the rest of the build, so the benchmark also
+# runs without the ARM toolchain:
+#
+#	$ make -f build/host/host_bench.mk host-bench
+#
+# jsmn only comes prebuilt for the target in libwmsdk.a. The jsmn parse of
+# the shadow documents is left out, the delta documents are parsed with the
+# streaming tokenizer instead. The functions of aws_iot_shadow_json.c that
+# call jsmn are dropped at link time.
+
+HOST_CC ?= gcc
+
+hb-aws-dir := sdk/external/aws_iot
+hb-output-dir := bin/host_bench
+
+hb-srcs := \
+	build/host/bench/aws_iot_bench.c \
+	$(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTPacket.c \
+	$(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTSerializePublish.c \
+	$(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTDeserializePublish.c \
+	$(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTClient-C/src/MQTTTopicTrie.c \
+	$(hb-aws-dir)/aws_iot_src/utils/aws_iot_json_stream.c \
+	$(hb-aws-dir)/aws_iot_src/shadow/aws_iot_shadow_json.c \
+	sdk/src/core/util/json_writer/json_writer.c \
+	sdk/src/core/util/fast_float/fast_float.c
+
+hb-cflags := -O2 -g -Wall -ffunction-sections -fdata-sections \
+	-I sdk/src/incl/sdk \
+	-I $(hb-aws-dir)/aws_iot_src/protocol/mqtt \
+	-I $(hb-aws-dir)/aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper \
+	-I $(hb-aws-dir)/aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk \
+	-I $(hb-aws-dir)/aws_iot_src/shadow \
+	-I $(hb-aws-dir)/aws_iot_src/utils \
+	-I $(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTPacket/src \
+	-I $(hb-aws-dir)/aws_mqtt_embedded_client_lib/MQTTClient-C/src
+
+hb-ldflags := -Wl,--gc-sections \
+	-Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+
+$(hb-output-dir)/aws_iot_bench: $(hb-srcs) build/host/host_bench.mk
+	@mkdir -p $(@D)
+	$(AT)$(HOST_CC) $(hb-cflags) -o $@ $(hb-srcs) $(hb-ldflags)
+	@echo " [host] $@"
+
+host-bench: $(hb-output-dir)/aws_iot_bench
+	$(AT)$< $(BENCH)
+
+host-bench.clean:
+	$(AT)rm -rf $(hb-output-dir)
+
+.PHONY: host-bench host-bench.clean
@@ -22,6 +22,21 @@ endef
 $(foreach l, $(b-libs-y), $(if $(findstring $(l), $(disable-lto-for)),,$(eval $(call append_lto_flags,$(l)))))
 $(foreach e, $(b-exec-y), $(if $(findstring $(e), $(disable-lto-for)),,$(eval $(call append_lto_flags,$(e)))))
 
+#--------------------------------------------------------------#
+# Perf build profile: the libraries of PERF_LIBS are optimized for speed,
+# and built with LTO unless they are in disable-lto-for
+
+PERF_LIBS ?= libaws_iot liblwip libfreertos
+
+define append_perf_flags
+	$(1)-optflags-y := $(tc-perf-optflags)
+	$(if $(lto-cflags-y)$(findstring $(1), $(disable-lto-for)),,$(1)-cflags-y += -flto -ffat-lto-objects)
+endef
+
+ifeq ($(b-perf-y),y)
+$(foreach l, $(filter $(PERF_LIBS), $(b-libs-y)), $(eval $(call append_perf_flags,$(l))))
+endif
+
 
 #--------------------------------------------------------------#
 # Rules to handle $(1)-select-libs-y
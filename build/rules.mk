@@ -104,6 +104,8 @@ $(foreach l,$(b-exec-y),$(eval $($(l)-objs-y): b-trgt-cflags-y := $($(l)-cflags-
 # variable. This allows configuration flags specific only to certain
 # libraries/programs. Only that may be dangerous.
 $(foreach l,$(b-libs-y),$(eval $($(l)-objs-y): b-trgt-cflags-y := $($(l)-cflags-y)))
+# The optimization of the libraries of the perf build profile
+$(foreach l,$(b-libs-y),$(eval $($(l)-objs-y): b-trgt-optflags-y := $($(l)-optflags-y)))
 
 # Rules for output directory creation for all the objects
 $(foreach d,$(sort $(b-object-dir-y)),$(eval $(call create_dir,$(d))))
@@ -188,6 +190,13 @@ define b-cmd-disppath-mapfile
   @echo " [map] $(call b-abspath,$(1:%.axf=%.map))"
 endef
 
+# The image over budget is removed, so that the next build checks it again
+ifeq ($(SIZE_REPORT),y)
+define b-cmd-size-report
+  $(AT)$(t_python) $(t_sizerep) $(if $(FLASH_BUDGET),-f $(FLASH_BUDGET)) $(if $(SRAM_BUDGET),-r $(SRAM_BUDGET)) $(1:%.axf=%.map) || { $(t_rm) -f $(1); exit 1; }
+endef
+endif
+
 define create_prog
 
 # $(1)-dir-y is created in build/post-subdir.mk
@@ -205,9 +214,10 @@ endif
 # Following dependency rule only checks existence of $(1)-output-dir-y, not its timestamp
   $($(1)-output-dir-y)/$(1).axf: | $($(1)-output-dir-y)
 
-  $($(1)-output-dir-y)/$(1).axf: $$($(1)-objs-y) $$($(1)-libs-paths-y) $$($(1)-linkerscript-y) $$(global-prebuilt-libs-y)
+  $($(1)-output-dir-y)/$(1).axf: $$($(1)-objs-y) $$($(1)-libs-paths-y) $$($(1)-linkerscript-y) $$(tc-linkerscript-deps-y) $$(global-prebuilt-libs-y)
 	$$(call b-cmd-axf,$(1),$$@)
 	$$(call b-cmd-disppath-mapfile,$$@)
+	$$(call b-cmd-size-report,$$@)
 
   .PHONY: $(1).app.clean
   clean: $(1).app.clean
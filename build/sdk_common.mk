@@ -18,6 +18,16 @@ tc-cortex-m3-$(CONFIG_CPU_MC200) := y
 tc-cortex-m4-$(CONFIG_CPU_MW300) := y
 tc-lto-$(CONFIG_ENABLE_LTO) := y
 
+# Build profile: size (the default) builds everything for size, perf builds
+# the libraries of PERF_LIBS for speed and with LTO (see build/refine.mk)
+# and reports the image size against FLASH_BUDGET and SRAM_BUDGET
+BUILD_PROFILE ?= size
+ifeq ($(BUILD_PROFILE),perf)
+  b-perf-y := y
+  tc-lto-y := y
+endif
+SIZE_REPORT ?= $(b-perf-y)
+
 ######## Default variables
 board_name-$(CONFIG_CPU_MC200) := mc200_8801
 board_name-$(CONFIG_CPU_MW300) := mw300_rd
@@ -64,6 +74,7 @@ t_kconf  := sdk/tools/bin/$(os_dir)/conf$(file_ext)
 t_mconf  := sdk/tools/bin/$(os_dir)/mconf$(file_ext)
 t_axf2fw := sdk/tools/bin/$(os_dir)/axf2firmware$(file_ext)
 t_mkftfs := sdk/tools/bin/flash_pack.py
+t_sizerep := sdk/tools/bin/size_report.py
 
 ######## Secure Boot Handling ####
 sec_archs:= mw300
@@ -42,6 +42,12 @@ tc-install-dir-$(use_extd_libc) := for_extd
 # define disable-lto-for empty
 disable-lto-for :=
 
+# Optimization of the libraries of the perf build profile. It comes after
+# global-cflags-y on the command lines, so that it overrides -Os. With LTO
+# the code is generated at link time, with the flags of the link.
+tc-perf-optflags := -O2
+tc-perf-lflags-$(b-perf-y) := $(tc-perf-optflags)
+
 # file include option
 tc-include-opt := -include
 
@@ -71,6 +77,15 @@ tc-lflags-$(tc-cortex-m4-y) += \
 		-mfpu=fpv4-sp-d16 \
 		-D__FPU_PRESENT
 
+# Function layout of XIP images, the fragments mw300-xip.ld includes. The
+# default ones are empty, sdk/tools/bin/xip_layout.py makes them from a
+# profile.
+ifeq ($(XIP), 1)
+  XIP_LAYOUT ?= build/toolchains/GNU/xip_layout
+  tc-lflags-y += -Xlinker -L -Xlinker $(XIP_LAYOUT)
+  tc-linkerscript-deps-y := $(XIP_LAYOUT)/hot_text.ld $(XIP_LAYOUT)/ram_text.ld
+endif
+
 tc-lflags-$(tc-cortex-m3-y) += -mcpu=cortex-m3
 tc-lflags-$(tc-cortex-m4-y) += -mcpu=cortex-m4
 
@@ -111,19 +126,19 @@ global-c-cflags-y := -fgnu89-inline
 #
 define b-cmd-c-to-o
   @echo " [cc] $(1)"
-  $(AT)$(CC) $(b-trgt-cflags-y) $(global-cflags-y) $(global-c-cflags-y) -o $(2) -c $(1) -MMD
+  $(AT)$(CC) $(b-trgt-cflags-y) $(global-cflags-y) $(global-c-cflags-y) $(b-trgt-optflags-y) -o $(2) -c $(1) -MMD
 endef
 
 ifneq ($(CONFIG_ENABLE_CPP_SUPPORT),)
 define b-cmd-cpp-to-o
   @echo " [cpp] $@"
-  $(AT)$(CPP) $(b-trgt-cflags-y) $(global-cflags-y) $(global-cpp-cflags-y) -o $(2) -c $(1) -MMD
+  $(AT)$(CPP) $(b-trgt-cflags-y) $(global-cflags-y) $(global-cpp-cflags-y) $(b-trgt-optflags-y) -o $(2) -c $(1) -MMD
 endef
 endif
 
 define b-cmd-axf
   @echo " [axf] $(call b-abspath,$(2))"
-  $(AT)$($(1)-LD) -o $(2) $($(1)-objs-y) $($(1)-lflags-y) $($(1)-cflags-y) -Xlinker --start-group $($(1)-prebuilt-libs-y) $($(1)-libs-paths-y) $(global-prebuilt-libs-y) -Xlinker --end-group -T $($(1)-linkerscript-y) -Xlinker -M -Xlinker -Map -Xlinker $(2:%.axf=%.map) $(tc-lflags-y) $(global-cflags-y)
+  $(AT)$($(1)-LD) -o $(2) $($(1)-objs-y) $($(1)-lflags-y) $($(1)-cflags-y) -Xlinker --start-group $($(1)-prebuilt-libs-y) $($(1)-libs-paths-y) $(global-prebuilt-libs-y) -Xlinker --end-group -T $($(1)-linkerscript-y) -Xlinker -M -Xlinker -Map -Xlinker $(2:%.axf=%.map) $(tc-lflags-y) $(global-cflags-y) $(tc-perf-lflags-y)
 endef
 
 define b-cmd-archive
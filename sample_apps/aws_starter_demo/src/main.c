@@ -30,8 +30,17 @@
 #include <board.h>
 #include <push_button.h>
 #include <aws_iot_mqtt_interface.h>
+#include <network_interface.h>
 #include <aws_iot_shadow_interface.h>
 #include <aws_utils.h>
+#include <flash.h>
+#include <kv_store.h>
+#include <cred_store.h>
+#include <xip.h>
+#include <aws_iot_log_deferred.h>
+#include <boot_stage.h>
+#include <health_mon.h>
+#include <wlan_roam.h>
 /* configuration parameters */
 #include <aws_iot_config.h>
 
@@ -47,11 +56,8 @@ enum state {
 
 /* These hold each pushbutton's count, updated in the callback ISR */
 static volatile uint32_t pushbutton_a_count;
-static volatile uint32_t pushbutton_a_count_prev = -1;
 static volatile uint32_t pushbutton_b_count;
-static volatile uint32_t pushbutton_b_count_prev = -1;
 static volatile uint32_t led_1_state;
-static volatile uint32_t led_1_state_prev = -1;
 
 static output_gpio_cfg_t led_1;
 static MQTTClient_t mqtt_client;
@@ -71,12 +77,46 @@ static char url[128];
 #define VAR_BUTTON_A_PROPERTY   "pb"
 #define VAR_BUTTON_B_PROPERTY   "pb_lambda"
 #define RESET_TO_FACTORY_TIMEOUT 5000
-#define BUFSIZE                  128
 #define MAX_MAC_BYTES            6
+/* The buttons are initialized after the first publish, or after this
+ * long if the device does not get to publish */
+#define BOOT_DEFER_TIMEOUT_MS    30000
+/* The watchdog resets the device when the cloud thread does not go round
+ * its loop for this long, a TLS reconnect can take tens of seconds */
+#define HEALTH_CHECK_MS          1000
+#define HEALTH_CLOUD_DEADLINE_MS 120000
+
+/* Internal flash partition of the key value store holding a copy of the
+ * configuration from the persistent memory, e.g. built with
+ * -DAPPCONFIG_KV_STORE_START=0x1fc000 -DAPPCONFIG_KV_STORE_SIZE=0x2000.
+ * Without it the configuration is read from the persistent memory. */
+#ifndef APPCONFIG_KV_STORE_SIZE
+#define APPCONFIG_KV_STORE_START 0
+#define APPCONFIG_KV_STORE_SIZE  0
+#endif
+
+/* Internal flash partition of the certificate and the key, which an XIP
+ * image hands to TLS in place instead of keeping copies in RAM, e.g. built
+ * with -DAPPCONFIG_CRED_STORE_START=0x1fb000 -DAPPCONFIG_CRED_STORE_SIZE=0x1000.
+ * Without it they are read into static buffers. */
+#ifndef APPCONFIG_CRED_STORE_SIZE
+#define APPCONFIG_CRED_STORE_START 0
+#define APPCONFIG_CRED_STORE_SIZE  0
+#endif
+
+/* How the flash is read in an XIP image, XIP_READ_FAST if the board flash
+ * has trouble with the quad modes */
+#ifndef APPCONFIG_XIP_READ_MODE
+#define APPCONFIG_XIP_READ_MODE XIP_READ_QUAD_IO_CONT
+#endif
+
+static bool kv_store_ready;
 
 /* callback function invoked on reset to factory */
 static void device_reset_to_factory_cb()
 {
+	if (kv_store_ready)
+		kv_store_erase_all();
 	/* Clears device configuration settings from persistent memory
 	 * and reboots the device.
 	 */
@@ -100,22 +140,19 @@ static void configure_reset_to_factory()
 /* callback function invoked when pushbutton_a is pressed */
 static void pushbutton_a_cb()
 {
-	if (pushbutton_a_count_prev == pushbutton_a_count)
-		pushbutton_a_count++;
+	pushbutton_a_count++;
 }
 
 /* callback function invoked when pushbutton_b is pressed */
 static void pushbutton_b_cb()
 {
-	if (pushbutton_b_count_prev == pushbutton_b_count)
-		pushbutton_b_count++;
+	pushbutton_b_count++;
 }
 
-/* Configure led and pushbuttons with callback functions */
-static void configure_led_and_button()
+/* Configure pushbuttons with callback functions */
+static void configure_buttons()
 {
-	/* respective GPIO pins for pushbuttons and leds are defined in
-	 * board file.
+	/* respective GPIO pins for pushbuttons are defined in board file.
 	 */
 	input_gpio_cfg_t pushbutton_a = {
 		.gpio = board_button_1(),
@@ -126,8 +163,6 @@ static void configure_led_and_button()
 		.type = GPIO_ACTIVE_LOW
 	};
 
-	led_1 = board_led_1();
-
 	push_button_set_cb(pushbutton_a,
 			   pushbutton_a_cb,
 			   100, 0, NULL);
@@ -136,12 +171,104 @@ static void configure_led_and_button()
 			   100, 0, NULL);
 }
 
+#if !APPCONFIG_CRED_STORE_SIZE
 static char client_cert_buffer[AWS_PUB_CERT_SIZE];
 static char private_key_buffer[AWS_PRIV_KEY_SIZE];
+#endif
 #define THING_LEN 126
 #define REGION_LEN 16
 static char thing_name[THING_LEN];
 static char client_id[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
+/* Opens the key value store, its index is built once and reading the
+ * configuration is then a memory lookup instead of a psm read */
+static void aws_config_store_init()
+{
+	flash_desc_t fl = {
+		.fl_dev = FL_INT,
+		.fl_start = APPCONFIG_KV_STORE_START,
+		.fl_size = APPCONFIG_KV_STORE_SIZE,
+	};
+
+	if (APPCONFIG_KV_STORE_SIZE && kv_store_init(&fl) == WM_SUCCESS)
+		kv_store_ready = true;
+}
+
+/* Reads a configuration string from the key value store. The first time
+ * it is read from the persistent memory and copied to the store. */
+static int aws_config_read(const char *key, char *buf, unsigned len,
+			   int (*psm_read)(char *, unsigned))
+{
+	int ret;
+
+	if (kv_store_ready && kv_store_get(key, buf, len) > 0)
+		return WM_SUCCESS;
+
+	ret = psm_read(buf, len);
+	if (ret == WM_SUCCESS && kv_store_ready) {
+		buf[len - 1] = 0;
+		kv_store_set(key, buf, strlen(buf) + 1);
+	}
+	return ret;
+}
+
+#if APPCONFIG_CRED_STORE_SIZE
+/* Gets the certificate and the key from their partition. The first time
+ * they are copied there from the persistent memory, through a buffer freed
+ * once they are written. */
+static int aws_config_read_credentials(ShadowParameters_t *sp)
+{
+	flash_desc_t fl = {
+		.fl_dev = FL_INT,
+		.fl_start = APPCONFIG_CRED_STORE_START,
+		.fl_size = APPCONFIG_CRED_STORE_SIZE,
+	};
+	const char *cert, *key;
+	char *buf;
+	int ret;
+
+	ret = cred_store_get(&fl, &cert, &key);
+	if (ret == -WM_E_NOENT) {
+		buf = os_mem_alloc(AWS_PUB_CERT_SIZE + AWS_PRIV_KEY_SIZE);
+		if (!buf)
+			return -WM_E_NOMEM;
+		ret = read_aws_certificate(buf, AWS_PUB_CERT_SIZE);
+		if (ret == WM_SUCCESS)
+			ret = read_aws_key(buf + AWS_PUB_CERT_SIZE,
+					   AWS_PRIV_KEY_SIZE);
+		if (ret == WM_SUCCESS) {
+			buf[AWS_PUB_CERT_SIZE - 1] = 0;
+			buf[AWS_PUB_CERT_SIZE + AWS_PRIV_KEY_SIZE - 1] = 0;
+			ret = cred_store_write(&fl, buf, strlen(buf),
+					buf + AWS_PUB_CERT_SIZE,
+					strlen(buf + AWS_PUB_CERT_SIZE));
+		}
+		os_mem_free(buf);
+		if (ret == WM_SUCCESS)
+			ret = cred_store_get(&fl, &cert, &key);
+	}
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	sp->pClientCRT = (char *) cert;
+	sp->pClientKey = (char *) key;
+	return WM_SUCCESS;
+}
+#endif
+
+static int aws_config_read_mac(uint8_t *device_mac)
+{
+	int ret;
+
+	if (kv_store_ready &&
+	    kv_store_get("mac", device_mac, MAX_MAC_BYTES) == MAX_MAC_BYTES)
+		return WM_SUCCESS;
+
+	ret = read_aws_device_mac(device_mac);
+	if (ret == WM_SUCCESS && kv_store_ready)
+		kv_store_set("mac", device_mac, MAX_MAC_BYTES);
+	return ret;
+}
+
 /* populate aws shadow configuration details */
 static int aws_starter_load_configuration(ShadowParameters_t *sp)
 {
@@ -151,7 +278,8 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	memset(region, 0, sizeof(region));
 
 	/* read configured thing name from the persistent memory */
-	ret = read_aws_thing(thing_name, THING_LEN);
+	ret = aws_config_read("thing", thing_name, THING_LEN,
+			      read_aws_thing);
 	if (ret != WM_SUCCESS) {
 		wmprintf("Failed to configure thing. Returning!\r\n");
 		return -WM_FAIL;
@@ -159,7 +287,7 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	sp->pMyThingName = thing_name;
 
 	/* read device MAC address */
-	ret = read_aws_device_mac(device_mac);
+	ret = aws_config_read_mac(device_mac);
 	if (ret != WM_SUCCESS) {
 		wmprintf("Failed to read device mac address. Returning!\r\n");
 		return -WM_FAIL;
@@ -172,7 +300,8 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	sp->pMqttClientId = client_id;
 
 	/* read configured region name from the persistent memory */
-	ret = read_aws_region(region, REGION_LEN);
+	ret = aws_config_read("region", region, REGION_LEN,
+			      read_aws_region);
 	if (ret == WM_SUCCESS) {
 		snprintf(url, sizeof(url), "data.iot.%s.amazonaws.com",
 			 region);
@@ -184,8 +313,16 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	sp->port = AWS_IOT_MQTT_PORT;
 	sp->pRootCA = rootCA;
 
+#if APPCONFIG_CRED_STORE_SIZE
+	ret = aws_config_read_credentials(sp);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to configure credentials. Returning!\r\n");
+		return -WM_FAIL;
+	}
+#else
 	/* read configured certificate from the persistent memory */
-	ret = read_aws_certificate(client_cert_buffer, AWS_PUB_CERT_SIZE);
+	ret = aws_config_read("cert", client_cert_buffer,
+			      AWS_PUB_CERT_SIZE, read_aws_certificate);
 	if (ret != WM_SUCCESS) {
 		wmprintf("Failed to configure certificate. Returning!\r\n");
 		return -WM_FAIL;
@@ -193,30 +330,18 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	sp->pClientCRT = client_cert_buffer;
 
 	/* read configured private key from the persistent memory */
-	ret = read_aws_key(private_key_buffer, AWS_PRIV_KEY_SIZE);
+	ret = aws_config_read("key", private_key_buffer,
+			      AWS_PRIV_KEY_SIZE, read_aws_key);
 	if (ret != WM_SUCCESS) {
 		wmprintf("Failed to configure key. Returning!\r\n");
 		return -WM_FAIL;
 	}
 	sp->pClientKey = private_key_buffer;
+#endif
 
 	return ret;
 }
 
-void shadow_update_status_cb(const char *pThingName, ShadowActions_t action,
-			     Shadow_Ack_Status_t status,
-			     const char *pReceivedJsonDocument,
-			     void *pContextData) {
-
-	if (status == SHADOW_ACK_TIMEOUT) {
-		wmprintf("Shadow publish state change timeout occurred\r\n");
-	} else if (status == SHADOW_ACK_REJECTED) {
-		wmprintf("Shadow publish state change rejected\r\n");
-	} else if (status == SHADOW_ACK_ACCEPTED) {
-		wmprintf("Shadow publish state change accepted\r\n");
-	}
-}
-
 /* This function will get invoked when led state change request is received */
 void led_indicator_cb(const char *p_json_string,
 		      uint32_t json_string_datalen,
@@ -234,71 +359,67 @@ void led_indicator_cb(const char *p_json_string,
 	}
 }
 
-/* Publish thing state to shadow */
-int aws_publish_property_state(ShadowParameters_t *sp)
-{
-	char buf_out[BUFSIZE];
-	char state[BUFSIZE];
-	char *ptr = state;
-	int ret = WM_SUCCESS;
+/* Reported properties of the thing, sent by the shadow reported cache */
+static jsonStruct_t button_a_reported = {
+	.pKey = VAR_BUTTON_A_PROPERTY,
+	.pData = (void *)&pushbutton_a_count,
+	.type = SHADOW_JSON_UINT32,
+};
+static jsonStruct_t button_b_reported = {
+	.pKey = VAR_BUTTON_B_PROPERTY,
+	.pData = (void *)&pushbutton_b_count,
+	.type = SHADOW_JSON_UINT32,
+};
+static jsonStruct_t led_1_reported = {
+	.pKey = VAR_LED_1_PROPERTY,
+	.pData = (void *)&led_1_state,
+	.type = SHADOW_JSON_UINT32,
+};
 
-	memset(state, 0, BUFSIZE);
-	if (pushbutton_a_count_prev != pushbutton_a_count) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%lu", VAR_BUTTON_A_PROPERTY,
-			 pushbutton_a_count);
-		strcat(state, buf_out);
-		pushbutton_a_count_prev = pushbutton_a_count;
-	}
-	if (pushbutton_b_count_prev != pushbutton_b_count) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%lu", VAR_BUTTON_B_PROPERTY,
-			 pushbutton_b_count);
-		strcat(state, buf_out);
-		pushbutton_b_count_prev = pushbutton_b_count;
-	}
-	/* On receiving led state change notification from cloud, change
-	 * the state of the led on the board in callback function and
-	 * publish updated state on configured topic.
-	 */
-	if (led_1_state_prev != led_1_state) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%lu", VAR_LED_1_PROPERTY,
-			 led_1_state);
-		strcat(state, buf_out);
-		led_1_state_prev = led_1_state;
-	}
+/* Registers the reported properties, has to be done again after
+ * aws_iot_shadow_init() */
+static int aws_register_reported_properties()
+{
+	int ret;
 
-	if (*ptr == ',')
-		ptr++;
-	if (strlen(state)) {
-		snprintf(buf_out, BUFSIZE, "{\"state\": {\"reported\":{%s}}}",
-			 ptr);
-		wmprintf("Publishing '%s' to AWS\r\n", buf_out);
-
-		/* publish incremented value on pushbutton press on
-		 * configured thing */
-		ret = aws_iot_shadow_update(&mqtt_client,
-					    sp->pMyThingName,
-					    buf_out,
-					    shadow_update_status_cb,
-					    NULL,
-					    10, true);
-	}
+	ret = aws_iot_shadow_reported_register(&button_a_reported);
+	if (ret == NONE_ERROR)
+		ret = aws_iot_shadow_reported_register(&button_b_reported);
+	if (ret == NONE_ERROR)
+		ret = aws_iot_shadow_reported_register(&led_1_reported);
 	return ret;
 }
 
+/* Publish thing state to shadow. The shadow reported cache finds the
+ * properties that changed since they were last sent and the yield sends them
+ * merged in a single update */
+int aws_publish_property_state(ShadowParameters_t *sp)
+{
+	/* On receiving led state change notification from cloud, the led
+	 * on the board is changed in the callback function and its new state
+	 * is sent with the others.
+	 */
+	return aws_iot_shadow_reported_set_changed();
+}
+
 /* application thread */
 static void aws_starter_demo(os_thread_arg_t data)
 {
 	int led_state = 0, ret;
+	bool update_set = false, booted = false;
 	jsonStruct_t led_indicator;
-	ShadowParameters_t sp;
+	ShadowParameters_t sp = ShadowParametersDefault;
+	int health = health_mon_register("cloud", HEALTH_CLOUD_DEADLINE_MS);
 
 	aws_iot_mqtt_init(&mqtt_client);
 
+	aws_config_store_init();
 	ret = aws_starter_load_configuration(&sp);
 	if (ret != WM_SUCCESS) {
 		wmprintf("aws shadow configuration failed : %d\r\n", ret);
 		goto out;
 	}
+	boot_stage("configuration");
 
 	ret = aws_iot_shadow_init(&mqtt_client);
 	if (ret != WM_SUCCESS) {
@@ -311,6 +432,7 @@ static void aws_starter_demo(os_thread_arg_t data)
 		wmprintf("aws shadow connect failed : %d\r\n", ret);
 		goto out;
 	}
+	boot_stage("cloud connect");
 
 	/* indication that device is connected and cloud is started */
 	led_on(board_led_2());
@@ -329,8 +451,16 @@ static void aws_starter_demo(os_thread_arg_t data)
 		goto out;
 	}
 
+	ret = aws_register_reported_properties();
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to register reported properties %d\r\n",
+			 ret);
+		goto out;
+	}
+
 	while (1) {
 		/* Implement application logic here */
+		health_mon_checkin(health);
 
 		if (device_state == AWS_RECONNECTED) {
 			ret = aws_iot_shadow_init(&mqtt_client);
@@ -349,14 +479,34 @@ static void aws_starter_demo(os_thread_arg_t data)
 				led_on(board_led_2());
 				ret = aws_iot_shadow_register_delta(
 					&mqtt_client, &led_indicator);
+				aws_register_reported_properties();
 				wmprintf("Reconnected to cloud\r\n");
 			}
 		}
-		aws_iot_shadow_yield(&mqtt_client, 10);
+		/* Sleeps until a message arrives or 100ms passed, deltas
+		 * are handled as soon as they are received */
+		ret = aws_iot_shadow_yield_until_event(&mqtt_client, 100);
+		if (ret == RECONNECT_SUCCESSFUL) {
+			device_state = AWS_CONNECTED;
+			led_on(board_led_2());
+			wmprintf("Reconnected to cloud\r\n");
+		} else if (ret == NETWORK_RECONNECT_TIMED_OUT) {
+			/* The client gave up reconnecting, the connection is
+			 * set up anew */
+			device_state = AWS_RECONNECTED;
+		}
+		/* The state set in the previous round was sent by the yield,
+		 * the rest of the initialization can run */
+		if (update_set && !booted) {
+			boot_stage("first publish");
+			boot_defer_release();
+			booted = true;
+		}
 		ret = aws_publish_property_state(&sp);
 		if (ret != WM_SUCCESS)
 			wmprintf("Sending property failed\r\n");
-		os_thread_sleep(100);
+		else
+			update_set = true;
 	}
 
 	ret = aws_iot_shadow_disconnect(&mqtt_client);
@@ -365,21 +515,28 @@ static void aws_starter_demo(os_thread_arg_t data)
 	}
 
 out:
+	health_mon_unregister(health);
 	os_thread_self_complete(NULL);
 	return;
 }
 
+/* The connection is left to the auto reconnect of the MQTT client. It waits
+ * for the network and connects again at a random time, so that the devices
+ * of a network that comes back do not all connect at once. A roam to
+ * another access point keeps the address, the connection is not lost */
 void wlan_event_normal_link_lost(void *data)
 {
+	if (wlan_roam_in_progress())
+		return;
+	/* The MQTT yield notices it at once rather than by a missed ping */
+	iot_tls_link_event(0);
 	/* led indication to indicate link loss */
-	aws_iot_shadow_disconnect(&mqtt_client);
 	device_state = AWS_DISCONNECTED;
 }
 
 void wlan_event_normal_connect_failed(void *data)
 {
 	/* led indication to indicate connect failed */
-	aws_iot_shadow_disconnect(&mqtt_client);
 	device_state = AWS_DISCONNECTED;
 }
 
@@ -393,8 +550,10 @@ void wlan_event_normal_connected(void *data)
 	time_t time = 1459468800;
 
 	wmprintf("Connected successfully to the configured network\r\n");
+	iot_tls_link_event(1);
 
 	if (!device_state) {
+		boot_stage("wlan connect");
 		/* set system time */
 		wmtime_time_set_posix(time);
 
@@ -420,30 +579,62 @@ void wlan_event_normal_connected(void *data)
 
 	if (!device_state)
 		device_state = AWS_CONNECTED;
-	else if (device_state == AWS_DISCONNECTED)
-		device_state = AWS_RECONNECTED;
+
+	/* Associates again, normally with a stronger access point of the
+	 * network, before the link to this one is lost */
+	if (wlan_roam_start(NULL) != WM_SUCCESS)
+		wmprintf("Failed to start roaming\r\n");
 }
 
 int main()
 {
+	xip_config_t xip_cfg = {
+		.read_mode = APPCONFIG_XIP_READ_MODE,
+		.cache = true,
+	};
+	char stalled[HEALTH_MON_NAME_LEN];
+	uint32_t late_ms;
+
 	/* initialize the standard input output facility over uart */
 	if (wmstdio_init(UART0_ID, 0) != WM_SUCCESS) {
 		return -WM_FAIL;
 	}
+	/* Before the threads start running from the flash */
+	if (xip_flash_config(&xip_cfg) != WM_SUCCESS)
+		wmprintf("Quad read not supported by the flash\r\n");
+	boot_stage("stdio and xip");
+	/* Console output is written by a low priority task so that printing
+	 * does not hold up the cloud thread */
+	aws_iot_log_deferred_start();
 
 	/* initialize gpio driver */
 	if (gpio_drv_init() != WM_SUCCESS) {
 		wmprintf("gpio_drv_init failed\r\n");
 		return -WM_FAIL;
 	}
+	boot_stage("drivers");
 
 	wmprintf("Build Time: " __DATE__ " " __TIME__ "\r\n");
 	wmprintf("\r\n#### AWS STARTER DEMO ####\r\n\r\n");
 
-	/* configure pushbutton on device to perform reset to factory */
-	configure_reset_to_factory();
-	/* configure led and pushbutton to communicate with cloud */
-	configure_led_and_button();
+	if (health_mon_start(HEALTH_CHECK_MS) != WM_SUCCESS)
+		wmprintf("Failed to start the health monitor\r\n");
+	else if (health_mon_last_stall(stalled, sizeof(stalled), &late_ms))
+		wmprintf("Watchdog reset, %s stalled for %u ms\r\n",
+			 stalled, late_ms);
+
+	/* The led is set by the shadow delta, which may come before the first
+	 * publish */
+	led_1 = board_led_1();
+	/* Pushbuttons to perform reset to factory and to communicate with
+	 * cloud. They are not needed to send the first message, they are
+	 * configured after it so that the device publishes sooner. */
+	boot_defer("reset to factory", configure_reset_to_factory);
+	boot_defer("buttons", configure_buttons);
+	if (boot_defer_start(BOOT_DEFER_TIMEOUT_MS) != WM_SUCCESS) {
+		configure_reset_to_factory();
+		configure_buttons();
+	}
 
 	/* This api adds aws iot configuration support in web application.
 	 * Configuration details are then stored in persistent memory.
@@ -455,5 +646,6 @@ int main()
 	 * wlan_event_normal_connected() is invoked on successful connection.
 	 */
 	wm_wlan_start(MICRO_AP_SSID, MICRO_AP_PASSPHRASE);
+	boot_stage("wlan start");
 	return 0;
 }
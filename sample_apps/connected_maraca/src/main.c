@@ -24,6 +24,10 @@
 #include <aws_iot_mqtt_interface.h>
 #include <aws_iot_shadow_interface.h>
 #include <aws_utils.h>
+#include <flash.h>
+#include <cred_store.h>
+#include <aws_iot_log_deferred.h>
+#include <boot_stage.h>
 #include <mdev_gpio.h>
 #include <mdev_pinmux.h>
 #include <lowlevel_drivers.h>
@@ -31,6 +35,8 @@
 #include <mdev_i2c.h>
 #include <push_button.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <ts_codec.h>
 
 /* configuration parameters */
 #include <aws_iot_config.h>
@@ -60,10 +66,12 @@ static char url[128];
 #define MICRO_AP_PASSPHRASE          "marvellwm"
 #define AMAZON_ACTION_BUF_SIZE  100
 #define RESET_TO_FACTORY_TIMEOUT 5000
-#define BUFSIZE                  200
 #define THRESHOLD_ACC            2
 #define DEVICE_ID                "<INSERT_YOUR_DEVICE_ID>"
 #define MAX_MAC_BYTES            6
+/* The reset to factory button is initialized after the first publish, or
+ * after this long if the device does not get to publish */
+#define BOOT_DEFER_TIMEOUT_MS    30000
 
 /* callback function invoked on reset to factory */
 static void device_reset_to_factory_cb()
@@ -90,8 +98,61 @@ static void configure_reset_to_factory()
 
 
 
+/* Internal flash partition of the certificate and the key, which an XIP
+ * image hands to TLS in place instead of keeping copies in RAM, e.g. built
+ * with -DAPPCONFIG_CRED_STORE_START=0x1fb000 -DAPPCONFIG_CRED_STORE_SIZE=0x1000.
+ * Without it they are read into static buffers. */
+#ifndef APPCONFIG_CRED_STORE_SIZE
+#define APPCONFIG_CRED_STORE_START 0
+#define APPCONFIG_CRED_STORE_SIZE  0
+#endif
+
+#if APPCONFIG_CRED_STORE_SIZE
+/* Gets the certificate and the key from their partition. The first time
+ * they are copied there from the persistent memory, through a buffer freed
+ * once they are written. */
+static int aws_config_read_credentials(ShadowParameters_t *sp)
+{
+	flash_desc_t fl = {
+		.fl_dev = FL_INT,
+		.fl_start = APPCONFIG_CRED_STORE_START,
+		.fl_size = APPCONFIG_CRED_STORE_SIZE,
+	};
+	const char *cert, *key;
+	char *buf;
+	int ret;
+
+	ret = cred_store_get(&fl, &cert, &key);
+	if (ret == -WM_E_NOENT) {
+		buf = os_mem_alloc(AWS_PUB_CERT_SIZE + AWS_PRIV_KEY_SIZE);
+		if (!buf)
+			return -WM_E_NOMEM;
+		ret = read_aws_certificate(buf, AWS_PUB_CERT_SIZE);
+		if (ret == WM_SUCCESS)
+			ret = read_aws_key(buf + AWS_PUB_CERT_SIZE,
+					   AWS_PRIV_KEY_SIZE);
+		if (ret == WM_SUCCESS) {
+			buf[AWS_PUB_CERT_SIZE - 1] = 0;
+			buf[AWS_PUB_CERT_SIZE + AWS_PRIV_KEY_SIZE - 1] = 0;
+			ret = cred_store_write(&fl, buf, strlen(buf),
+					buf + AWS_PUB_CERT_SIZE,
+					strlen(buf + AWS_PUB_CERT_SIZE));
+		}
+		os_mem_free(buf);
+		if (ret == WM_SUCCESS)
+			ret = cred_store_get(&fl, &cert, &key);
+	}
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	sp->pClientCRT = (char *) cert;
+	sp->pClientKey = (char *) key;
+	return WM_SUCCESS;
+}
+#else
 static char client_cert_buffer[AWS_PUB_CERT_SIZE];
 static char private_key_buffer[AWS_PRIV_KEY_SIZE];
+#endif
 #define THING_LEN 126
 #define REGION_LEN 16
 static char thing_name[THING_LEN];
@@ -138,6 +199,13 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 	sp->port = AWS_IOT_MQTT_PORT;
 	sp->pRootCA = rootCA;
 
+#if APPCONFIG_CRED_STORE_SIZE
+	ret = aws_config_read_credentials(sp);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to configure credentials. Returning!\r\n");
+		return -WM_FAIL;
+	}
+#else
 	/* read configured certificate from the persistent memory */
 	ret = read_aws_certificate(client_cert_buffer, AWS_PUB_CERT_SIZE);
 	if (ret != WM_SUCCESS) {
@@ -153,6 +221,7 @@ static int aws_starter_load_configuration(ShadowParameters_t *sp)
 		return -WM_FAIL;
 	}
 	sp->pClientKey = private_key_buffer;
+#endif
 
 	return ret;
 }
@@ -172,25 +241,210 @@ void shadow_update_status_cb(const char *pThingName, ShadowActions_t action,
 }
 
 
-/* Publish thing state to shadow */
-int aws_publish_property_state(ShadowParameters_t *sp, int8_t x, int8_t y,
-			       int8_t z)
+/* Samples sent in one telemetry document. The sensor samples at 120 Hz so
+ * the default batch holds one second of motion */
+#ifndef BATCH_SAMPLES
+#define BATCH_SAMPLES            120
+#endif
+/* A batch which is not full is sent once it is this old */
+#ifndef BATCH_MS
+#define BATCH_MS                 1000
+#endif
+/* 1 to send a batch as a ts_codec blob, 0 for a JSON document */
+#ifndef BATCH_TS_CODEC
+#define BATCH_TS_CODEC           1
+#endif
+#if BATCH_TS_CODEC
+/* A sample takes 4 bytes, its time and the deltas of the 6 bit axes one
+ * byte each, unless samples were dropped before it. It has to stay below
+ * AWS_IOT_MQTT_TX_BUF_LEN together with the topic */
+#define BATCH_BUFSIZE            (TS_CODEC_HEADER_LEN + 8 * BATCH_SAMPLES)
+#else
+/* The samples are 6 bit so a delta takes at most 4 characters with its
+ * comma, this leaves room for the header. It has to stay below
+ * AWS_IOT_MQTT_TX_BUF_LEN together with the topic */
+#define BATCH_BUFSIZE            (3 * 4 * BATCH_SAMPLES + 160)
+#endif
+
+/* Define BATCH_INGEST_RULE as the name of an AWS IoT rule to send the batches
+ * to through Basic Ingest, past the broker. Subscribers to the telemetry
+ * topic no longer see them then */
+
+/* Accelerometer samples collected for one publish */
+struct acc_batch {
+	struct MMA7660_SAMPLE s[BATCH_SAMPLES];
+	/* Sequence numbers of the samples, in sample periods */
+	uint32_t t[BATCH_SAMPLES];
+	int n;
+	/* Largest change of an axis between two consecutive samples */
+	int peak;
+	/* Time of the first sample of the batch */
+	unsigned long start_ms;
+	/* last holds a sample, kept across batches */
+	struct MMA7660_SAMPLE last;
+	bool primed;
+	/* Sequence number of the next sample, it skips the dropped ones */
+	uint32_t seq;
+	/* Samples the driver had dropped when seq was last moved on */
+	uint32_t dropped;
+};
+
+static void acc_batch_reset(struct acc_batch *b)
 {
-	char buf_out[BUFSIZE];
-	int ret = WM_SUCCESS;
+	b->n = 0;
+	b->peak = 0;
+}
 
-	MQTTPublishParams cmaraca;
-	snprintf(buf_out, BUFSIZE, "{\"device_id\": \"%s\",\"time\":\"\",\"device\":\"marvelliot\",\"sensors\":[{\"telemetryData\": {\"xval\": %d,\"yval\":%d,\"zval\":%d}}]}",DEVICE_ID, x, y, z);
-	
-	memset(&cmaraca, 0, sizeof(cmaraca));   
-	cmaraca.pTopic = "connected-maraca";
-	cmaraca.MessageParams.pPayload = buf_out;
-	cmaraca.MessageParams.PayloadLen = strlen(buf_out);
-	aws_iot_mqtt_publish(&cmaraca);
-	
-	wmprintf("\r\n%s", buf_out);
-	
-	return ret;
+/* Returns true when the batch is full */
+static bool acc_batch_add(struct acc_batch *b, const struct MMA7660_SAMPLE *s)
+{
+	int d;
+
+	if (!b->primed) {
+		b->last = *s;
+		b->primed = true;
+	}
+	if (b->n == 0)
+		b->start_ms = os_ticks_to_msec(os_ticks_get());
+
+	d = abs(s->x - b->last.x);
+	if (abs(s->y - b->last.y) > d)
+		d = abs(s->y - b->last.y);
+	if (abs(s->z - b->last.z) > d)
+		d = abs(s->z - b->last.z);
+	if (d > b->peak)
+		b->peak = d;
+
+	b->last = *s;
+	b->t[b->n] = b->seq++;
+	b->s[b->n++] = *s;
+	return b->n == BATCH_SAMPLES;
+}
+
+/* The driver drops the samples that come while its ring is full, those
+ * came after the ones read from it. Their sequence numbers are skipped */
+static void acc_batch_skip_dropped(struct acc_batch *b)
+{
+	uint32_t dropped = MMA7660_dropped_samples();
+
+	b->seq += dropped - b->dropped;
+	b->dropped = dropped;
+}
+
+#if BATCH_TS_CODEC
+/* The telemetry topic, serialized at compile time */
+AWS_IOT_MQTT_PREPARED_PUBLISH(cmaraca_topic, "connected-maraca/ts/" DEVICE_ID,
+			      QOS_0, false);
+
+/* Publish a batch of samples as a ts_codec blob of 3 channels, x, y and z,
+ * timestamped with their sequence numbers. The sampling rate is 120 Hz, a
+ * gap in the sequence numbers is samples that were dropped */
+int aws_publish_property_state(ShadowParameters_t *sp,
+			       const struct acc_batch *b)
+{
+	static uint8_t buf_out[BATCH_BUFSIZE];
+	MQTTMessageParams cmaraca;
+	struct ts_enc enc;
+	int32_t v[3];
+	int i;
+
+	ts_enc_init(&enc, buf_out, sizeof(buf_out), 3);
+	for (i = 0; i < b->n; i++) {
+		v[0] = b->s[i].x;
+		v[1] = b->s[i].y;
+		v[2] = b->s[i].z;
+		if (ts_enc_add(&enc, b->t[i], v) != WM_SUCCESS) {
+			wmprintf("Sending %d of %d samples\r\n", i, b->n);
+			break;
+		}
+	}
+
+	memset(&cmaraca, 0, sizeof(cmaraca));
+	cmaraca.pPayload = buf_out;
+	cmaraca.PayloadLen = ts_enc_finish(&enc);
+	if (aws_iot_mqtt_publish_prepared(&cmaraca_topic, &cmaraca) !=
+	    NONE_ERROR)
+		return -WM_FAIL;
+
+	return WM_SUCCESS;
+}
+#else
+/* Append one axis as "name":[first sample,delta,delta...] */
+static int batch_encode_axis(char *buf, int size, int len, const char *name,
+			     const struct acc_batch *b, size_t offset)
+{
+	int i, prev = 0, v;
+
+	len += snprintf(buf + len, len < size ? size - len : 0,
+			",\"%s\":[", name);
+	for (i = 0; i < b->n; i++) {
+		v = *((const int8_t *) &b->s[i] + offset);
+		len += snprintf(buf + len, len < size ? size - len : 0,
+				i ? ",%d" : "%d", v - prev);
+		prev = v;
+	}
+	len += snprintf(buf + len, len < size ? size - len : 0, "]");
+	return len;
+}
+
+/* The telemetry topic, serialized at compile time */
+AWS_IOT_MQTT_PREPARED_PUBLISH(cmaraca_topic, "connected-maraca", QOS_0, false);
+
+/* Publish a batch of samples as one telemetry document. Each axis is sent
+ * as its first sample followed by the difference to the previous sample,
+ * a sample of a resting maraca then takes two characters */
+int aws_publish_property_state(ShadowParameters_t *sp,
+			       const struct acc_batch *b)
+{
+	static char buf_out[BATCH_BUFSIZE];
+	int len;
+
+	MQTTMessageParams cmaraca;
+	len = snprintf(buf_out, sizeof(buf_out), "{\"device_id\":\"%s\",\"device\":\"marvelliot\",\"rate\":120,\"n\":%d,\"peak\":%d", DEVICE_ID, b->n, b->peak);
+	len = batch_encode_axis(buf_out, sizeof(buf_out), len, "x", b,
+				offsetof(struct MMA7660_SAMPLE, x));
+	len = batch_encode_axis(buf_out, sizeof(buf_out), len, "y", b,
+				offsetof(struct MMA7660_SAMPLE, y));
+	len = batch_encode_axis(buf_out, sizeof(buf_out), len, "z", b,
+				offsetof(struct MMA7660_SAMPLE, z));
+	len += snprintf(buf_out + len,
+			len < sizeof(buf_out) ? sizeof(buf_out) - len : 0, "}");
+	if (len >= sizeof(buf_out)) {
+		wmprintf("Batch of %d samples does not fit\r\n", b->n);
+		return -WM_FAIL;
+	}
+
+	memset(&cmaraca, 0, sizeof(cmaraca));
+	cmaraca.pPayload = buf_out;
+	cmaraca.PayloadLen = len;
+	if (aws_iot_mqtt_publish_prepared(&cmaraca_topic, &cmaraca) !=
+	    NONE_ERROR)
+		return -WM_FAIL;
+
+	return WM_SUCCESS;
+}
+#endif /* BATCH_TS_CODEC */
+
+/* Sends the batch if the maraca was shaken during it and starts a new one */
+static void acc_batch_flush(ShadowParameters_t *sp, struct acc_batch *b)
+{
+	static bool booted;
+	int ret;
+
+	if (b->peak > THRESHOLD_ACC) {
+		ret = aws_publish_property_state(sp, b);
+		wmprintf("\r\n%d, %d, %d peak %d over %d samples\r\n",
+			 b->last.x, b->last.y, b->last.z, b->peak, b->n);
+		if (ret != WM_SUCCESS)
+			wmprintf("Sending property failed\r\n");
+		else if (!booted) {
+			/* The rest of the initialization can run */
+			boot_stage("first publish");
+			boot_defer_release();
+			booted = true;
+		}
+	}
+	acc_batch_reset(b);
 }
 
 /* application thread */
@@ -198,7 +452,7 @@ static void connected_maraca(os_thread_arg_t data)
 {
         int ret;
 
-	ShadowParameters_t sp;
+	ShadowParameters_t sp = ShadowParametersDefault;
 
 	aws_iot_mqtt_init(&mqtt_client);
 
@@ -207,6 +461,7 @@ static void connected_maraca(os_thread_arg_t data)
 		wmprintf("aws shadow configuration failed : %d\r\n", ret);
 		goto out;
 	}
+	boot_stage("configuration");
 
 	ret = aws_iot_shadow_init(&mqtt_client);
 	if (ret != WM_SUCCESS) {
@@ -219,8 +474,20 @@ static void connected_maraca(os_thread_arg_t data)
 		wmprintf("aws shadow connect failed : %d\r\n", ret);
 		goto out;
 	}
+	boot_stage("cloud connect");
 
 	wmprintf("Cloud Started\r\n");
+#ifdef BATCH_INGEST_RULE
+	aws_iot_mqtt_ingest_route_set("connected-maraca", BATCH_INGEST_RULE);
+#endif
+
+	static struct acc_batch batch;
+	struct MMA7660_SAMPLE samples[16];
+	uint32_t i, n;
+
+	batch.primed = false;
+	batch.dropped = MMA7660_dropped_samples();
+	acc_batch_reset(&batch);
 
 	while (1) {
 		/* Implement application logic here */
@@ -243,23 +510,29 @@ static void connected_maraca(os_thread_arg_t data)
 			}
 		}
 
-		aws_iot_shadow_yield(&mqtt_client, 10);
-
-		int8_t x, y, z;
-		static int8_t prev_x, prev_y, prev_z;
-		MMA7660_getXYZ(&x, &y, &z);
-		if( abs(prev_x-x) > THRESHOLD_ACC || abs(prev_y-y)> THRESHOLD_ACC || abs(prev_z-z)> THRESHOLD_ACC) {
-			ret = aws_publish_property_state(&sp, x, y, z);
-			wmprintf("\r\n%d, %d, %d\r\n",x,y,z);
-			if (ret != WM_SUCCESS)
-				wmprintf("Sending property failed\r\n");
-			prev_x=x;
-			prev_y=y;
-			prev_z=z;
+		/* Sleeps until a message arrives or a second passed */
+		ret = aws_iot_shadow_yield_until_event(&mqtt_client, 1000);
+		if (ret == RECONNECT_SUCCESSFUL) {
+			device_state = AWS_CONNECTED;
+			wmprintf("Reconnected to cloud\r\n");
+		} else if (ret == NETWORK_RECONNECT_TIMED_OUT) {
+			/* The client gave up reconnecting, the connection is
+			 * set up anew */
+			device_state = AWS_RECONNECTED;
 		}
 
-
-		os_thread_sleep(1000);
+		/* The sensor driver sampled at full rate meanwhile, every
+		 * sample goes into the batch */
+		while ((n = MMA7660_read_samples(samples,
+				sizeof(samples) / sizeof(samples[0]))))
+			for (i = 0; i < n; i++)
+				if (acc_batch_add(&batch, &samples[i]))
+					acc_batch_flush(&sp, &batch);
+		acc_batch_skip_dropped(&batch);
+
+		if (batch.n && os_ticks_to_msec(os_ticks_get()) -
+		    batch.start_ms >= BATCH_MS)
+			acc_batch_flush(&sp, &batch);
 	}
 	
 	ret = aws_iot_shadow_disconnect(&mqtt_client);
@@ -272,17 +545,18 @@ out:
 	return;
 }
 
+/* The connection is left to the auto reconnect of the MQTT client. It waits
+ * for the network and connects again at a random time, so that the devices
+ * of a network that comes back do not all connect at once */
 void wlan_event_normal_link_lost(void *data)
 {
 	/* led indication to indicate link loss */
-	aws_iot_shadow_disconnect(&mqtt_client);
 	device_state = AWS_DISCONNECTED;
 }
 
 void wlan_event_normal_connect_failed(void *data)
 {
 	/* led indication to indicate connect failed */
-	aws_iot_shadow_disconnect(&mqtt_client);
 	device_state = AWS_DISCONNECTED;
 }
 
@@ -298,6 +572,7 @@ void wlan_event_normal_connected(void *data)
 	wmprintf("Connected successfully to the configured network\r\n");
 
 	if (!device_state) {
+		boot_stage("wlan connect");
 		/* set system time */
 		wmtime_time_set_posix(time);
 
@@ -323,8 +598,6 @@ void wlan_event_normal_connected(void *data)
 
 	if (!device_state)
 		device_state = AWS_CONNECTED;
-	else if (device_state == AWS_DISCONNECTED)
-		device_state = AWS_RECONNECTED;
 }
 
 int main()
@@ -333,6 +606,10 @@ int main()
 	if (wmstdio_init(UART0_ID, 0) != WM_SUCCESS) {
 		return -WM_FAIL;
 	}
+	boot_stage("stdio");
+	/* Console output is written by a low priority task so that printing
+	 * does not hold up the cloud thread */
+	aws_iot_log_deferred_start();
 
 	wmprintf("Build Time: " __DATE__ " " __TIME__ "\r\n");
 	wmprintf("\r\n#### CONNECTED MARACA DEMO ####\r\n\r\n");
@@ -344,11 +621,18 @@ int main()
 	}
 
 	i2c_drv_init(I2C0_PORT);
+	i2c_drv_xfer_mode(I2C0_PORT, I2C_DMA_ENABLE);
 	mdev_t *i2c0 = i2c_drv_open(I2C0_PORT, I2C_SLAVEADR(MMA7660_ADDR));
 	MMA7660_init(i2c0);
+	if (MMA7660_start_sampling(MMA7660_INT_GPIO, true) != WM_SUCCESS)
+		wmprintf("Accelerometer sampling start failed\r\n");
+	boot_stage("drivers and sensor");
 
-	/* configure pushbutton on device to perform reset to factory */
-	configure_reset_to_factory();
+	/* configure pushbutton on device to perform reset to factory, it is
+	 * not needed to send the first message so it is done after it */
+	boot_defer("reset to factory", configure_reset_to_factory);
+	if (boot_defer_start(BOOT_DEFER_TIMEOUT_MS) != WM_SUCCESS)
+		configure_reset_to_factory();
 
 	/* This api adds aws iot configuration support in web application.
 	 * Configuration details are then stored in persistent memory.
@@ -360,5 +644,6 @@ int main()
 	 * wlan_event_normal_connected() is invoked on successful connection.
 	 */
 	wm_wlan_start(MICRO_AP_SSID, MICRO_AP_PASSPHRASE);
+	boot_stage("wlan start");
 	return 0;
 }
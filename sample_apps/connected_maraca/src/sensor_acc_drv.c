@@ -45,11 +45,15 @@
 
 #include <wm_os.h>
 #include <mdev_i2c.h>
+#include <i2c_xfer.h>
 
 /*------------------Macro Definitions ------------------*/
 #define BUF_LEN		16
 #define I2X_WR_DLY	50
 #define MMA7660TIMEOUT	500	/* us */
+/* Fetch anyway after this long without interrupt; the INT pin stays
+ * asserted until the sensor is read so a lost edge would stop sampling */
+#define MMA7660_SAMPLE_TIMEOUT	100	/* ms */
 
 /*------------------Global Variables -------------------*/
 static mdev_t *i2c0;
@@ -59,6 +63,17 @@ static struct MMA7660_LOOKUP accLookup[64];
 int8_t prev_x=0;
 int8_t prev_y=0;
 int8_t prev_z=0;
+
+static bool i2c_xact;
+static os_semaphore_t xact_sem;
+static i2c_xfer_t xact;
+static int xact_result;
+static os_semaphore_t sample_sem;
+static os_thread_t sample_thread;
+static os_thread_stack_define(sample_stack, 512);
+static os_ringbuf_t sample_ring;
+static struct MMA7660_SAMPLE sample_ring_data[MMA7660_RING_SIZE];
+static uint32_t dropped_samples;
 /*
  *********************************************************
  **** Accelerometer Sensor H/W Specific code
@@ -87,15 +102,42 @@ void MMA7660_From(uint8_t _register)
 	i2c_drv_write(i2c0, write_data, 1);
 }
 
+static void MMA7660_xact_done(int result, void *arg)
+{
+	xact_result = result;
+	os_semaphore_put(&xact_sem);
+}
+
+/*Function: Reads registers from _register on. Once MMA7660_start_sampling()
+  has set up DMA this is one transaction, with a repeated start between the
+  register byte and the read */
+static int MMA7660_regs(uint8_t _register, uint8_t *buf, uint32_t len)
+{
+	if (!i2c_xact) {
+		MMA7660_From(_register);
+		return i2c_drv_read(i2c0, buf, len);
+	}
+
+	write_data[0] = _register;
+	xact.addr = MMA7660_ADDR;
+	xact.wr = write_data;
+	xact.wr_len = 1;
+	xact.rd = buf;
+	xact.rd_len = len;
+	xact.cb = MMA7660_xact_done;
+	if (i2c_xfer_submit(I2C0_PORT, &xact) != WM_SUCCESS)
+		return -WM_FAIL;
+	os_semaphore_get(&xact_sem, OS_WAIT_FOREVER);
+	return xact_result == WM_SUCCESS ? len : -WM_FAIL;
+}
+
 /*Function: Read a byte from the regitster of the MMA7660*/
 uint8_t MMA7660_read(uint8_t _register)
 {
 	if (!i2c0)
 		return 0;
 
-	write_data[0] = _register;
-	i2c_drv_write(i2c0, write_data, 1);
-	i2c_drv_read(i2c0, read_data, 1);
+	MMA7660_regs(_register, read_data, 1);
 	return read_data[0];
 }
 
@@ -161,14 +203,19 @@ void MMA7660_init(mdev_t *i2c_handle)
 */
 bool MMA7660_getXYZ(int8_t *x,int8_t *y,int8_t *z)
 {
-	int8_t val[3];
-	val[0] = val[1] = val[2] = 64;
+	/* TILT is read along so the interrupt of the sample is cleared */
+	int8_t val[4];
+	int retry = 3;
 
 	if (!i2c0)
 		return 0;
 
-	MMA7660_From(0);
-	i2c_drv_read(i2c0, (uint8_t *)val, 3);
+	do {
+		val[0] = val[1] = val[2] = 64;
+		MMA7660_regs(0, (uint8_t *)val, 4);
+	} while (((val[0] | val[1] | val[2]) & MMA7660_ALERT) && --retry);
+	if (!retry)
+		return 0;
 
 	/* Abstracting signed int8_t value from 6bit signed read
 		value from device, range of input value is -31 to +31 */
@@ -187,3 +234,96 @@ bool MMA7660_getXYZ(int8_t *x,int8_t *y,int8_t *z)
 	return 1;
 }
 
+
+/*
+ *********************************************************
+ **** Interrupt driven sampling
+ **********************************************************
+ */
+
+static void MMA7660_int_cb(int pin, void *data)
+{
+	os_semaphore_put(&sample_sem);
+}
+
+static void MMA7660_sampling(os_thread_arg_t data)
+{
+	struct MMA7660_SAMPLE s;
+
+	while (1) {
+		os_semaphore_get(&sample_sem,
+				 os_msec_to_ticks(MMA7660_SAMPLE_TIMEOUT));
+		if (!MMA7660_getXYZ(&s.x, &s.y, &s.z))
+			continue;
+		if (!os_ringbuf_write(&sample_ring, &s, 1))
+			dropped_samples++;
+	}
+}
+
+int MMA7660_start_sampling(int gpio, bool dma)
+{
+	mdev_t *pinmux_dev, *gpio_dev;
+	int ret;
+
+	if (!i2c0)
+		return -WM_FAIL;
+
+	/* The sensor is on I2C0, see main.c */
+	if (dma) {
+		ret = os_semaphore_create(&xact_sem, "acc_xact");
+		if (ret != WM_SUCCESS)
+			return ret;
+		/* Binary semaphores are created available */
+		os_semaphore_get(&xact_sem, OS_NO_WAIT);
+		ret = i2c_xfer_init(i2c0, I2C0_PORT);
+		if (ret != WM_SUCCESS)
+			return ret;
+		i2c_xact = true;
+	}
+
+	os_ringbuf_init(&sample_ring, sample_ring_data,
+			sizeof(struct MMA7660_SAMPLE), MMA7660_RING_SIZE);
+	ret = os_semaphore_create(&sample_sem, "acc_sample");
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	/* INT is open drain, active low */
+	pinmux_dev = pinmux_drv_open("MDEV_PINMUX");
+	gpio_dev = gpio_drv_open("MDEV_GPIO");
+	if (!pinmux_dev || !gpio_dev)
+		return -WM_FAIL;
+	pinmux_drv_setfunc(pinmux_dev, gpio, pinmux_drv_get_gpio_func(gpio));
+	GPIO_PinModeConfig(gpio, PINMODE_PULLUP);
+	gpio_drv_setdir(gpio_dev, gpio, GPIO_INPUT);
+	ret = gpio_drv_set_cb(gpio_dev, gpio, GPIO_INT_FALLING_EDGE, NULL,
+			      MMA7660_int_cb);
+	pinmux_drv_close(pinmux_dev);
+	gpio_drv_close(gpio_dev);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	ret = os_thread_create(&sample_thread, "acc_sample",
+			       MMA7660_sampling, NULL, &sample_stack,
+			       OS_PRIO_2);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	/* Interrupt after every measurement at the full rate, the sensor
+	 * registers can only be written in standby */
+	MMA7660_setMode(MMA7660_STAND_BY);
+	MMA7660_setSampleRate(AUTO_SLEEP_120);
+	MMA7660_write(MMA7660_INTSU, MMA7660_GINT);
+	MMA7660_setMode(MMA7660_ACTIVE);
+
+	return WM_SUCCESS;
+}
+
+uint32_t MMA7660_read_samples(struct MMA7660_SAMPLE *samples, uint32_t max)
+{
+	return os_ringbuf_read(&sample_ring, samples, max);
+}
+
+uint32_t MMA7660_dropped_samples(void)
+{
+	return dropped_samples;
+}
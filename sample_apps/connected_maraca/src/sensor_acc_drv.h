@@ -36,6 +36,7 @@
 #define MMA7660_ADDR	0x4c
 
 #define MMA7660_X	0x00
+#define MMA7660_ALERT	0x40	/* register was being updated, read again */
 #define MMA7660_Y	0x01
 #define MMA7660_Z	0x02
 #define MMA7660_TILT	0x03
@@ -53,6 +54,8 @@
 #define MMA7660_MODE	0x07
 #define MMA7660_STAND_BY	0x00
 #define MMA7660_ACTIVE	0x01
+#define MMA7660_IPP	0x40	/* interrupt pin push-pull, open drain if clear */
+#define MMA7660_IAH	0x80	/* interrupt pin active high */
 #define MMA7660_SR	0x08	/* sample rate register */
 #define AUTO_SLEEP_120	0X00	/* 120 sample per second */
 #define AUTO_SLEEP_64	0X01
@@ -65,6 +68,13 @@
 #define MMA7660_PDET	0x09
 #define MMA7660_PD	0x0A
 
+/* GPIO the INT pin of the sensor is wired to */
+#ifndef MMA7660_INT_GPIO
+#define MMA7660_INT_GPIO	GPIO_16
+#endif
+/* Samples buffered between two reads, must be a power of two */
+#define MMA7660_RING_SIZE	256
+
 struct MMA7660_DATA {
 	uint8_t X;
 	uint8_t Y;
@@ -91,7 +101,29 @@ struct MMA7660_ACC_DATA {
 	struct MMA7660_LOOKUP z;
 };
 
+struct MMA7660_SAMPLE {
+	int8_t x;
+	int8_t y;
+	int8_t z;
+};
+
 void MMA7660_init(mdev_t *mdev_handle);
 bool MMA7660_getXYZ(int8_t *x,int8_t *y,int8_t *z);
 
+/* Sample at the full sensor rate on the INT pin of the sensor
+ *
+ * The sensor raises its interrupt after every measurement (120 per
+ * second), a driver thread then fetches the sample and queues it for
+ * MMA7660_read_samples(). Without an edge for 100 ms the thread reads the
+ * sensor anyway, so with INT not wired it samples 10 times per second.
+ * If dma is set the register reads are single i2c_xfer transactions, the
+ * register byte and the read with a repeated start, fed by DMA. */
+int MMA7660_start_sampling(int gpio, bool dma);
+
+/* Take up to max buffered samples, oldest first, returns the number taken */
+uint32_t MMA7660_read_samples(struct MMA7660_SAMPLE *samples, uint32_t max);
+
+/* Number of samples lost because they were not read in time */
+uint32_t MMA7660_dropped_samples(void);
+
 #endif /* __SENSOR_ACC_DRV_H__ */
@@ -2,6 +2,6 @@
 # All Rights Reserved.
 
 exec-y += adc_demo
-adc_demo-objs-y :=  src/main.c
+adc_demo-objs-y :=  src/main.c src/adc_stream.c
 # Applications could also define custom board files if required using following:
 #adc_demo-board-y := /path/to/boardfile
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <mdev_dma.h>
+#include <lowlevel_drivers.h>
+
+#include "adc_stream.h"
+
+static struct {
+	mdev_t *dma_dev;
+	dma_config_t dma;
+	uint16_t *buf[2];
+	/* Block the DMA is filling */
+	int filling;
+	int num;
+	adc_stream_cb_t cb;
+	void *arg;
+	/* Block is held by the application */
+	volatile bool held[2];
+	uint32_t overruns;
+	bool running;
+} stream;
+
+static void adc_stream_dma_cb(DMA_Channel_Type channel,
+			      dma_transfer_status_t status, void *data)
+{
+	int full = stream.filling;
+	int next = full ^ 1;
+
+	if (!stream.running)
+		return;
+
+	/* Re-arm first, the ADC keeps converting meanwhile */
+	if (stream.held[next])
+		stream.overruns++;
+	stream.dma.dma_cfg.destDmaAddr = (uint32_t) stream.buf[next];
+	DMA_Disable(channel);
+	DMA_ChannelInit(channel, &stream.dma.dma_cfg);
+	DMA_SetPeripheralType(channel, stream.dma.perDmaInter);
+	DMA_IntClr(channel, INT_CH_ALL);
+	DMA_IntMask(channel, INT_DMA_TRANS_COMPLETE, UNMASK);
+	DMA_Enable(channel);
+	stream.filling = next;
+
+	if (status != DMA_SUCCESS)
+		return;
+
+	stream.held[full] = true;
+	stream.cb(stream.buf[full], stream.num, stream.arg);
+}
+
+int adc_stream_start(mdev_t *adc_dev, uint16_t *buf0, uint16_t *buf1,
+		     int num, adc_stream_cb_t cb, void *arg)
+{
+	if (!adc_dev || !buf0 || !buf1 || !cb || num <= 0 ||
+	    num > ADC_STREAM_MAX_BLOCK || stream.running)
+		return -WM_E_INVAL;
+
+	if (dma_drv_init() != WM_SUCCESS)
+		return -WM_FAIL;
+	stream.dma_dev = dma_drv_open();
+	if (!stream.dma_dev)
+		return -WM_FAIL;
+
+	stream.buf[0] = buf0;
+	stream.buf[1] = buf1;
+	stream.held[0] = false;
+	stream.held[1] = false;
+	stream.filling = 0;
+	stream.num = num;
+	stream.cb = cb;
+	stream.arg = arg;
+	stream.overruns = 0;
+
+	stream.dma.dma_cfg.srcDmaAddr = (uint32_t) &ADC0->RESULT.WORDVAL;
+	stream.dma.dma_cfg.destDmaAddr = (uint32_t) buf0;
+	stream.dma.dma_cfg.transfType = DMA_PER_TO_MEM;
+	stream.dma.dma_cfg.burstLength = DMA_ITEM_1;
+	stream.dma.dma_cfg.srcAddrInc = DMA_ADDR_NOCHANGE;
+	stream.dma.dma_cfg.destAddrInc = DMA_ADDR_INC;
+	stream.dma.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_16;
+	stream.dma.dma_cfg.transfLength = num * sizeof(uint16_t);
+	stream.dma.perDmaInter = DMA_PER24_ADC0;
+
+	ADC_ConversionModeSelect(ADC0_ID, ADC_CONVERSION_CONTINUOUS);
+	ADC_ResultWidthConfig(ADC0_ID, ADC_RESULT_WIDTH_16);
+	ADC_DmaThresholdSel(ADC0_ID, ADC_DMA_THRESHOLD_1);
+	ADC_DmaCmd(ADC0_ID, ENABLE);
+
+	stream.running = true;
+	if (dma_drv_set_cb(stream.dma_dev, adc_stream_dma_cb, NULL)
+	    != WM_SUCCESS ||
+	    dma_drv_transfer(stream.dma_dev, &stream.dma) != WM_SUCCESS) {
+		stream.running = false;
+		ADC_DmaCmd(ADC0_ID, DISABLE);
+		dma_drv_close(stream.dma_dev);
+		return -WM_FAIL;
+	}
+
+	ADC_ConversionStart(ADC0_ID);
+	return WM_SUCCESS;
+}
+
+void adc_stream_release(uint16_t *block)
+{
+	if (block == stream.buf[0])
+		stream.held[0] = false;
+	else if (block == stream.buf[1])
+		stream.held[1] = false;
+}
+
+uint32_t adc_stream_overruns(void)
+{
+	return stream.overruns;
+}
+
+void adc_stream_stop(void)
+{
+	if (!stream.running)
+		return;
+
+	stream.running = false;
+	ADC_ConversionStop(ADC0_ID);
+	ADC_DmaCmd(ADC0_ID, DISABLE);
+	dma_drv_close(stream.dma_dev);
+	stream.dma_dev = NULL;
+}
@@ -0,0 +1,47 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Continuous ADC sampling with DMA double buffering
+ *
+ * The ADC runs in continuous conversion mode and the DMA fills two
+ * blocks in turn. When one block is full the DMA channel is immediately
+ * re-armed on the other one, from the DMA interrupt, so capture goes on
+ * while the application processes the full block. The ADC FIFO holds the
+ * samples converted during the re-arm, no sample is lost between blocks.
+ */
+
+#ifndef _ADC_STREAM_H_
+#define _ADC_STREAM_H_
+
+#include <mdev_adc.h>
+
+/* DMA can move at most 8191 bytes per transfer */
+#define ADC_STREAM_MAX_BLOCK	4095
+
+/* Called from the DMA interrupt with a full block. The block belongs to
+ * the application until it is given back with adc_stream_release(), it
+ * has to be processed before the other block fills up. */
+typedef void (*adc_stream_cb_t) (uint16_t *block, int num, void *arg);
+
+/* Start continuous sampling on an ADC opened with adc_drv_open()
+ *
+ * buf0 and buf1 are the two blocks of num samples each, num must not
+ * exceed ADC_STREAM_MAX_BLOCK. Returns WM_SUCCESS, -WM_E_INVAL on invalid
+ * arguments or if a stream is already running, -WM_FAIL if no DMA channel
+ * could be set up. */
+int adc_stream_start(mdev_t *adc_dev, uint16_t *buf0, uint16_t *buf1,
+		     int num, adc_stream_cb_t cb, void *arg);
+
+/* Give a block passed to the callback back to the stream */
+void adc_stream_release(uint16_t *block);
+
+/* Number of blocks refilled while the application still held them */
+uint32_t adc_stream_overruns(void);
+
+/* Stop sampling and release the DMA channel */
+void adc_stream_stop(void);
+
+#endif /* _ADC_STREAM_H_ */
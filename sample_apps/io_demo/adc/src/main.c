@@ -10,6 +10,9 @@
 #include <mdev_pinmux.h>
 #include <lowlevel_drivers.h>
 
+#include "adc_stream.h"
+#include <sig_feat.h>
+
 /*
  * Simple Application which uses ADC driver.
  *
@@ -22,6 +25,11 @@
  * Self calibration is also performed before conversion.
  *
  * DMA and well as non DMA mode is provided. Default is non-DMA.
+ * A continuous mode (ADC_CONTINUOUS) samples without gaps into two DMA
+ * blocks and prints the average of each block while the other one fills.
+ * It also pushes the blocks through a sig_feat pipeline, decimated by 2 to
+ * 1.95KHz, and prints the RMS, the peak frequency and the energy of three
+ * bands for each 256 sample frame.
  *
  * Description:
  *
@@ -47,6 +55,15 @@
 #define VMAX_IN_mV	1200	/* Max input voltage in milliVolts */
 /* Default is IO mode, DMA mode can be enabled as per the requirement */
 /*#define ADC_DMA*/
+/* Continuous DMA mode with double buffering */
+/*#define ADC_CONTINUOUS*/
+#define CONTINUOUS_BLOCKS	20
+/* Frame length and decimation of the feature pipeline */
+#define FEAT_FFT_LEN	256
+#define FEAT_DECIM	2
+#define FEAT_TAPS	16
+/* Sample rate after the decimation, in Hz */
+#define FEAT_RATE	(3900 / FEAT_DECIM)
 
 
 /*------------------Global Variable Definitions ---------*/
@@ -54,6 +71,59 @@
 uint16_t buffer[SAMPLES];
 mdev_t *adc_dev;
 
+#ifdef ADC_CONTINUOUS
+uint16_t buffer2[SAMPLES];
+static os_queue_t block_queue;
+static os_queue_pool_define(block_queue_data, 2 * sizeof(uint16_t *));
+
+/* Runs in the DMA interrupt, hand the block over to main */
+static void block_full(uint16_t *block, int num, void *arg)
+{
+	os_queue_send(&block_queue, &block, OS_NO_WAIT);
+}
+
+static int16_t feat_twiddle[FEAT_FFT_LEN], feat_window[FEAT_FFT_LEN / 2];
+static int16_t feat_frame[FEAT_FFT_LEN], feat_work[2 * FEAT_FFT_LEN];
+static uint32_t feat_power[FEAT_FFT_LEN / 2];
+static int16_t feat_coeffs[FEAT_TAPS], feat_state[2 * FEAT_TAPS];
+/* Below 50Hz, 50Hz to 200Hz and 200Hz up, the DC bin left out */
+static const uint16_t feat_edges[] = {1, 7, 26, FEAT_FFT_LEN / 2};
+static sig_feat_fft_t feat_fft;
+static sig_feat_decim_t feat_decim;
+static sig_feat_pipe_t feat_pipe;
+
+static void frame_features(const sig_feat_result_t *r, void *arg)
+{
+	wmprintf("Frame: rms %d peak %d Hz bands %u %u %u\r\n",
+		 r->stats.rms, r->peak_bin * FEAT_RATE / FEAT_FFT_LEN,
+		 r->band[0], r->band[1], r->band[2]);
+}
+
+static int features_init(void)
+{
+	sig_feat_pipe_cfg_t cfg = {
+		.fft = &feat_fft,
+		.decim = &feat_decim,
+		.frame = feat_frame,
+		.work = feat_work,
+		.power = feat_power,
+		.edges = feat_edges,
+		.nbands = 3,
+		.hop = FEAT_FFT_LEN,
+		.cb = frame_features,
+	};
+
+	if (sig_feat_fft_init(&feat_fft, FEAT_FFT_LEN, feat_twiddle,
+			      feat_window) != WM_SUCCESS ||
+	    sig_feat_lowpass(feat_coeffs, FEAT_TAPS, FEAT_DECIM) !=
+	    WM_SUCCESS ||
+	    sig_feat_decim_init(&feat_decim, feat_coeffs, FEAT_TAPS,
+				FEAT_DECIM, feat_state) != WM_SUCCESS)
+		return -WM_FAIL;
+	return sig_feat_pipe_init(&feat_pipe, &cfg);
+}
+#endif
+
 /* This is an entry point for the application.
    All application specific initialization is performed here. */
 int main(void)
@@ -97,7 +167,44 @@ int main(void)
 
 	adc_dev = adc_drv_open(ADC0_ID, ADC_CH0);
 
-#ifdef ADC_DMA
+#if defined(ADC_CONTINUOUS)
+	uint16_t *block;
+	uint32_t sum;
+
+	if (features_init() != WM_SUCCESS) {
+		wmprintf("Error: Cannot set up the features\r\n");
+		return -1;
+	}
+	os_queue_create(&block_queue, "adc_blocks", sizeof(uint16_t *),
+			&block_queue_data);
+	if (adc_stream_start(adc_dev, buffer, buffer2, samples,
+			     block_full, NULL) != WM_SUCCESS) {
+		wmprintf("Error: Cannot start ADC stream\r\n");
+		return -1;
+	}
+
+	for (i = 0; i < CONTINUOUS_BLOCKS; i++) {
+		int j;
+
+		os_queue_recv(&block_queue, &block, OS_WAIT_FOREVER);
+		for (sum = 0, j = 0; j < samples; j++)
+			sum += block[j];
+		/* 16 bit results are below 32768, they fit the signed samples */
+		sig_feat_pipe_push(&feat_pipe, (const int16_t *)block, samples);
+		adc_stream_release(block);
+
+		result = ((float)(sum / samples) / BIT_RESOLUTION_FACTOR) *
+		VMAX_IN_mV * ((float)1/(float)(config.adcGainSel != 0 ?
+		config.adcGainSel : 0.5));
+		wmprintf("Block %d: average %d.%d mV\r\n", i,
+					wm_int_part_of(result),
+					wm_frac_part_of(result, 2));
+	}
+
+	adc_stream_stop();
+	wmprintf("Overruns: %u\r\n", adc_stream_overruns());
+	os_queue_delete(&block_queue);
+#elif defined(ADC_DMA)
 	adc_drv_get_samples(adc_dev, buffer, samples);
 	for (i = 0; i < samples; i++) {
 		result = ((float)buffer[i] / BIT_RESOLUTION_FACTOR) *
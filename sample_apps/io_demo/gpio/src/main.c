@@ -7,6 +7,7 @@
 #include <wm_os.h>
 #include <mdev_gpio.h>
 #include <mdev_pinmux.h>
+#include <mdev_cache.h>
 #include <board.h>
 
 /*
@@ -44,24 +45,26 @@ static unsigned int gpio_led;
 static unsigned int gpio_pushbutton;
 /* This indicates the state of LED on or off */
 static unsigned int gpio_led_state;
+/* ID of the GPIO device, its handle stays open between toggles */
+static int gpio_id;
 
 /* This function turns on the LED*/
 static void gpio_led_on(void)
 {
-	mdev_t *gpio_dev = gpio_drv_open("MDEV_GPIO");
+	mdev_t *gpio_dev = mdev_cache_get(gpio_id);
 	/* Turn on LED by writing  0 in GPIO register */
 	gpio_drv_write(gpio_dev, gpio_led, 0);
-	gpio_drv_close(gpio_dev);
+	mdev_cache_put(gpio_id);
 	gpio_led_state = 1;
 }
 
 /* This function turns off the LED*/
 static void gpio_led_off(void)
 {
-	mdev_t *gpio_dev = gpio_drv_open("MDEV_GPIO");
+	mdev_t *gpio_dev = mdev_cache_get(gpio_id);
 	/* Turn off LED by writing  1 in GPIO register */
 	gpio_drv_write(gpio_dev, gpio_led, 1);
-	gpio_drv_close(gpio_dev);
+	mdev_cache_put(gpio_id);
 	gpio_led_state = 0;
 }
 
@@ -88,8 +91,10 @@ static void configure_gpios()
 	/* Initialize GPIO driver */
 	gpio_drv_init();
 
-	/* Open GPIO driver */
-	gpio_dev = gpio_drv_open("MDEV_GPIO");
+	/* Open GPIO driver, kept open for the toggles from the push button
+	 * interrupt */
+	gpio_id = mdev_cache_id("MDEV_GPIO", gpio_drv_open, gpio_drv_close);
+	gpio_dev = mdev_cache_get(gpio_id);
 
 	/* Configure GPIO pin function for GPIO connected to LED */
 	pinmux_drv_setfunc(pinmux_dev, gpio_led, GPIO_LED_FN);
@@ -112,7 +117,7 @@ static void configure_gpios()
 
 	/* Close drivers */
 	pinmux_drv_close(pinmux_dev);
-	gpio_drv_close(gpio_dev);
+	mdev_cache_put(gpio_id);
 }
 
 /* This is an entry point for the application.
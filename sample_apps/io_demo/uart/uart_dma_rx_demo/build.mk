@@ -0,0 +1,7 @@
+# Copyright (C) 2008-2015, Marvell International Ltd.
+# All Rights Reserved.
+
+exec-y += uart_dma_rx_demo
+uart_dma_rx_demo-objs-y :=  src/main.c src/uart_dma_rx.c
+# Applications could also define custom board files if required using following:
+#uart_dma_rx_demo-board-y := /path/to/boardfile
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ *
+ * Summary:
+ * Application receiving a continuous stream on UART with DMA.
+ *
+ * Description:
+ * UART1 is opened at 921600 baud and receives into a DMA ring buffer that
+ * never stops. Each time the line goes idle the bytes received are handed
+ * over to the application in place and echoed back on UART1. The number of
+ * bytes received and of ring overruns is printed on UART0 every second.
+ */
+
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <mdev_uart.h>
+
+#include "uart_dma_rx.h"
+
+#define BAUD_RATE	921600
+/* Room for 35 ms of data at full rate */
+#define RING_SIZE	4096
+#define MAX_CHUNKS	16
+
+struct chunk {
+	const uint8_t *data;
+	uint32_t len;
+};
+
+static uint8_t ring[RING_SIZE];
+static os_queue_t chunk_queue;
+static os_queue_pool_define(chunk_queue_data, MAX_CHUNKS * sizeof(struct chunk));
+
+/* Runs in interrupt or timer context, hand the bytes over to main */
+static void received(const uint8_t *data, uint32_t len, void *arg)
+{
+	struct chunk c = { data, len };
+
+	/* A full queue is an overrun as well, the ring goes on over the
+	 * bytes that were not handed over */
+	if (os_queue_send(&chunk_queue, &c, OS_NO_WAIT) != WM_SUCCESS)
+		uart_dma_rx_release(len);
+}
+
+/* This is an entry point for the application.
+   All application specific initializations are performed here. */
+int main(void)
+{
+	struct chunk c;
+	uint32_t total = 0;
+	unsigned long last;
+	mdev_t *dev;
+
+	/* Initialize wmstdio console on UART0 */
+	wmstdio_init(UART0_ID, 0);
+
+	wmprintf("uart_dma_rx_demo app started, receiving on UART1 at %d\r\n",
+		 BAUD_RATE);
+
+	uart_drv_init(UART1_ID, UART_8BIT);
+	dev = uart_drv_open(UART1_ID, BAUD_RATE);
+	if (!dev) {
+		wmprintf("Error: Cannot open UART1\r\n");
+		return -1;
+	}
+
+	os_queue_create(&chunk_queue, "uart_chunks", sizeof(struct chunk),
+			&chunk_queue_data);
+	if (uart_dma_rx_start(UART1_ID, ring, sizeof(ring), received, NULL)
+	    != WM_SUCCESS) {
+		wmprintf("Error: Cannot start UART DMA receive\r\n");
+		return -1;
+	}
+
+	last = os_ticks_get();
+	while (1) {
+		if (os_queue_recv(&chunk_queue, &c, os_msec_to_ticks(100))
+		    == WM_SUCCESS) {
+			/* Process the bytes where the DMA put them */
+			uart_drv_write(dev, c.data, c.len);
+			total += c.len;
+			uart_dma_rx_release(c.len);
+		}
+
+		if (os_ticks_to_msec(os_ticks_get() - last) >= 1000) {
+			wmprintf("Received %u bytes, %u overruns\r\n", total,
+				 uart_dma_rx_overruns());
+			last = os_ticks_get();
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <mdev_dma.h>
+#include <lowlevel_drivers.h>
+
+#include "uart_dma_rx.h"
+
+static struct {
+	UART_ID_Type port_id;
+	uart_reg_t *uart;
+	mdev_t *dma_dev;
+	DMA_Channel_Type channel;
+	dma_config_t dma;
+	uint8_t *ring;
+	uint32_t size;
+	/* Part of the ring the DMA is filling */
+	uint32_t seg_start;
+	uint32_t seg_len;
+	/* Bytes before this offset were given to the application */
+	uint32_t reported;
+	/* DMA position seen by the previous idle check */
+	uint32_t idle_pos;
+	/* Running totals, their difference is the part of the ring held by
+	 * the application */
+	uint32_t received;
+	volatile uint32_t released;
+	uint32_t overruns;
+	uart_dma_rx_cb_t cb;
+	void *arg;
+	os_timer_t idle_timer;
+	volatile bool running;
+} rx;
+
+static const DMA_PerMapping_Type uart_dma_rx_per[] = {
+	DMA_PER14_UART0_RX, DMA_PER16_UART1_RX, DMA_PER42_UART2_RX,
+};
+
+/* Point the DMA at the ring from offset pos, up to its end */
+static void uart_dma_rx_arm(uint32_t pos)
+{
+	uint32_t len;
+
+	if (pos == rx.size)
+		pos = 0;
+	len = rx.size - pos;
+	if (len > UART_DMA_RX_MAX_SEG)
+		len = UART_DMA_RX_MAX_SEG;
+	if (rx.received - rx.released + len > rx.size)
+		rx.overruns++;
+
+	rx.dma.dma_cfg.destDmaAddr = (uint32_t) (rx.ring + pos);
+	rx.dma.dma_cfg.transfLength = len;
+	DMA_Disable(rx.channel);
+	DMA_ChannelInit(rx.channel, &rx.dma.dma_cfg);
+	DMA_SetPeripheralType(rx.channel, rx.dma.perDmaInter);
+	DMA_IntClr(rx.channel, INT_CH_ALL);
+	DMA_IntMask(rx.channel, INT_DMA_TRANS_COMPLETE, UNMASK);
+	DMA_Enable(rx.channel);
+	rx.seg_start = pos;
+	rx.seg_len = len;
+	rx.idle_pos = pos;
+}
+
+/* Give the bytes up to offset pos to the application, pos is never behind
+ * the reported offset, it is the ring size when the end was reached */
+static void uart_dma_rx_deliver(uint32_t pos)
+{
+	if (pos > rx.reported) {
+		rx.cb(rx.ring + rx.reported, pos - rx.reported, rx.arg);
+		rx.received += pos - rx.reported;
+	}
+	rx.reported = (pos == rx.size) ? 0 : pos;
+}
+
+/* Offset the DMA will write the next byte to */
+static uint32_t uart_dma_rx_dma_pos(void)
+{
+	return DMA->CHANNEL[rx.channel].TADR.WORDVAL - (uint32_t) rx.ring;
+}
+
+static void uart_dma_rx_dma_cb(DMA_Channel_Type channel,
+			       dma_transfer_status_t status, void *data)
+{
+	uint32_t mask, end;
+
+	/* The receive time-out may have re-armed the channel already */
+	if (!rx.running ||
+	    DMA_GetChannelEnableStatus(rx.channel) == SET)
+		return;
+
+	mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	end = rx.seg_start + rx.seg_len;
+	uart_dma_rx_arm(end);
+	uart_dma_rx_deliver(end);
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* Fewer bytes than the DMA burst are left in the FIFO and the line is idle */
+static void uart_dma_rx_timeout_cb(void)
+{
+	uint32_t mask, pos;
+
+	if (!rx.running)
+		return;
+
+	mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	DMA_Disable(rx.channel);
+	if (DMA_GetChannelIntStatus(rx.channel, INT_DMA_TRANS_COMPLETE)
+	    == SET) {
+		pos = rx.seg_start + rx.seg_len;
+		DMA_IntClr(rx.channel, INT_CH_ALL);
+	} else {
+		pos = uart_dma_rx_dma_pos();
+	}
+
+	while (UART_GetLineStatus(rx.port_id, UART_LINESTATUS_DR) == SET) {
+		if (pos == rx.size) {
+			uart_dma_rx_deliver(pos);
+			pos = 0;
+		}
+		rx.ring[pos++] = (uint8_t) UART_ReceiveData(rx.port_id);
+	}
+
+	uart_dma_rx_arm(pos);
+	uart_dma_rx_deliver(pos);
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/* A message ending on a multiple of the DMA burst leaves nothing in the FIFO
+ * and raises no receive time-out, the DMA position not moving between two
+ * checks means the line is idle */
+static void uart_dma_rx_idle_cb(os_timer_arg_t handle)
+{
+	unsigned long state;
+	uint32_t pos;
+
+	state = os_enter_critical_section();
+	if (rx.running && DMA_GetChannelEnableStatus(rx.channel) == SET) {
+		pos = uart_dma_rx_dma_pos();
+		if (pos == rx.idle_pos && pos != rx.reported)
+			uart_dma_rx_deliver(pos);
+		rx.idle_pos = pos;
+	}
+	os_exit_critical_section(state);
+}
+
+int uart_dma_rx_start(UART_ID_Type port_id, uint8_t *ring, uint32_t size,
+		      uart_dma_rx_cb_t cb, void *arg)
+{
+	UART_FifoCfg_Type fifo;
+	uint32_t len;
+
+	if (port_id > UART2_ID || !ring || size < 16 || !cb || rx.running)
+		return -WM_E_INVAL;
+
+	if (dma_drv_init() != WM_SUCCESS)
+		return -WM_FAIL;
+	rx.dma_dev = dma_drv_open();
+	if (!rx.dma_dev)
+		return -WM_FAIL;
+
+	rx.port_id = port_id;
+	rx.uart = (port_id == UART0_ID) ? UART0 :
+		(port_id == UART1_ID) ? UART1 : UART2;
+	rx.channel = (DMA_Channel_Type) (uint32_t) rx.dma_dev;
+	rx.ring = ring;
+	rx.size = size;
+	rx.reported = 0;
+	rx.received = 0;
+	rx.released = 0;
+	rx.overruns = 0;
+	rx.cb = cb;
+	rx.arg = arg;
+
+	len = (size > UART_DMA_RX_MAX_SEG) ? UART_DMA_RX_MAX_SEG : size;
+	rx.seg_start = 0;
+	rx.seg_len = len;
+	rx.idle_pos = 0;
+
+	rx.dma.dma_cfg.srcDmaAddr = (uint32_t) &rx.uart->RBR_THR_DLL.WORDVAL;
+	rx.dma.dma_cfg.destDmaAddr = (uint32_t) ring;
+	rx.dma.dma_cfg.transfType = DMA_PER_TO_MEM;
+	rx.dma.dma_cfg.burstLength = DMA_ITEM_8;
+	rx.dma.dma_cfg.srcAddrInc = DMA_ADDR_NOCHANGE;
+	rx.dma.dma_cfg.destAddrInc = DMA_ADDR_INC;
+	rx.dma.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_8;
+	rx.dma.dma_cfg.transfLength = len;
+	rx.dma.perDmaInter = uart_dma_rx_per[port_id];
+
+	if (os_timer_create(&rx.idle_timer, "uart-dma-rx",
+			    os_msec_to_ticks(UART_DMA_RX_IDLE_MS),
+			    uart_dma_rx_idle_cb, NULL, OS_TIMER_PERIODIC,
+			    OS_TIMER_NO_ACTIVATE) != WM_SUCCESS) {
+		dma_drv_close(rx.dma_dev);
+		return -WM_FAIL;
+	}
+
+	rx.running = true;
+	if (dma_drv_set_cb(rx.dma_dev, uart_dma_rx_dma_cb, NULL)
+	    != WM_SUCCESS ||
+	    dma_drv_transfer(rx.dma_dev, &rx.dma) != WM_SUCCESS) {
+		rx.running = false;
+		os_timer_delete(&rx.idle_timer);
+		dma_drv_close(rx.dma_dev);
+		return -WM_FAIL;
+	}
+
+	/* The driver's receive interrupt would race the DMA for the FIFO, the
+	 * receive time-out is taken over for the bytes left below the burst */
+	UART_IntMask(port_id, UART_INT_RDA, MASK);
+	install_int_callback(INT_UART0 + port_id, UART_INT_RTO,
+			     uart_dma_rx_timeout_cb);
+
+	fifo.fifoEnable = ENABLE;
+	fifo.autoFlowControl = DISABLE;
+	fifo.rxFifoReset = DISABLE;
+	fifo.txFifoReset = DISABLE;
+	fifo.peripheralBusType = UART_PERIPHERAL_BITS_8;
+	fifo.fifoDmaEnable = ENABLE;
+	fifo.rxFifoLevel = UART_RXFIFO_BYTES_8;
+	fifo.txFifoLevel = UART_TXFIFO_HALF_EMPTY;
+	UART_FifoConfig(port_id, &fifo);
+	UART_DmaCmd(port_id, ENABLE);
+	UART_IntMask(port_id, UART_INT_RTO, UNMASK);
+
+	os_timer_activate(&rx.idle_timer);
+	return WM_SUCCESS;
+}
+
+void uart_dma_rx_release(uint32_t len)
+{
+	rx.released += len;
+}
+
+uint32_t uart_dma_rx_overruns(void)
+{
+	return rx.overruns;
+}
+
+void uart_dma_rx_stop(void)
+{
+	if (!rx.running)
+		return;
+
+	rx.running = false;
+	os_timer_delete(&rx.idle_timer);
+	UART_IntMask(rx.port_id, UART_INT_RTO, MASK);
+	UART_DmaCmd(rx.port_id, DISABLE);
+	DMA_Disable(rx.channel);
+	dma_drv_close(rx.dma_dev);
+	rx.dma_dev = NULL;
+}
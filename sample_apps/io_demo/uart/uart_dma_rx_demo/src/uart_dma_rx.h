@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Continuous UART receive into a DMA ring buffer
+ *
+ * The DMA writes the received bytes straight into a ring buffer owned by
+ * the application and is re-armed on the next part of the ring from the
+ * DMA interrupt, so reception never stops. The receive FIFO keeps the
+ * bytes arriving during the re-arm.
+ *
+ * In DMA mode the UART only requests a transfer once 8 bytes are in its
+ * FIFO. When the line goes idle with fewer bytes left, the receive
+ * time-out interrupt fires after 4 character times and these bytes are
+ * moved into the ring by the CPU. A message that ends on a multiple of 8
+ * bytes leaves the FIFO empty and raises no time-out, a timer checking the
+ * DMA position every UART_DMA_RX_IDLE_MS covers that case.
+ *
+ * Every time the line goes idle or a part of the ring is complete the
+ * bytes received since the previous call are given to the application,
+ * in place in the ring.
+ */
+
+#ifndef _UART_DMA_RX_H_
+#define _UART_DMA_RX_H_
+
+#include <mdev_uart.h>
+
+/* Period of the idle check for messages not raising a receive time-out */
+#ifndef UART_DMA_RX_IDLE_MS
+#define UART_DMA_RX_IDLE_MS	2
+#endif
+
+/* DMA can move at most 8191 bytes per transfer */
+#define UART_DMA_RX_MAX_SEG	8191
+
+/* Called from interrupt or timer context with received bytes. data points
+ * into the ring, len is never zero. Bytes following a wrap of the ring are
+ * passed in a second call. The bytes belong to the application until they
+ * are given back with uart_dma_rx_release(), the callback must not block. */
+typedef void (*uart_dma_rx_cb_t) (const uint8_t *data, uint32_t len,
+				  void *arg);
+
+/* Start continuous reception on a UART opened with uart_drv_open() in the
+ * default, non DMA, transfer mode. uart_drv_read() must not be used on the
+ * port while reception runs. After uart_dma_rx_stop() the port has to be
+ * closed and opened again before uart_drv_read() is used.
+ *
+ * ring is size bytes, size has to be at least 16. Returns WM_SUCCESS,
+ * -WM_E_INVAL on invalid arguments or if reception is already running,
+ * -WM_FAIL if the DMA channel or the idle timer could not be set up. */
+int uart_dma_rx_start(UART_ID_Type port_id, uint8_t *ring, uint32_t size,
+		      uart_dma_rx_cb_t cb, void *arg);
+
+/* Give len bytes passed to the callback back to the ring, in the order they
+ * were received */
+void uart_dma_rx_release(uint32_t len);
+
+/* Number of times the DMA went on into bytes not released yet */
+uint32_t uart_dma_rx_overruns(void);
+
+/* Stop reception and release the DMA channel */
+void uart_dma_rx_stop(void);
+
+#endif /* _UART_DMA_RX_H_ */
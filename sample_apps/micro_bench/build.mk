@@ -0,0 +1,25 @@
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+#
+
+exec-y += micro_bench
+micro_bench-objs-y := src/main.c
+micro_bench-cflags-y := -I$(d)/src
+
+# The run is set up from the make command line, e.g.
+# make APP=sample_apps/micro_bench APPCONFIG_BENCH_TAG=v1.2 APPCONFIG_BENCH_SPI_HZ=10000000
+APPCONFIG_BENCH_TAG ?=
+APPCONFIG_BENCH_RUNS ?= 1000
+APPCONFIG_BENCH_UART_BAUD ?= 0
+APPCONFIG_BENCH_SPI_HZ ?= 0
+APPCONFIG_BENCH_I2C_ADDR ?= 0
+micro_bench-cflags-y += -DAPPCONFIG_BENCH_TAG=\"$(APPCONFIG_BENCH_TAG)\" \
+	-DAPPCONFIG_BENCH_RUNS=$(APPCONFIG_BENCH_RUNS) \
+	-DAPPCONFIG_BENCH_UART_BAUD=$(APPCONFIG_BENCH_UART_BAUD) \
+	-DAPPCONFIG_BENCH_SPI_HZ=$(APPCONFIG_BENCH_SPI_HZ) \
+	-DAPPCONFIG_BENCH_I2C_ADDR=$(APPCONFIG_BENCH_I2C_ADDR)
+
+# Applications could also define custom linker files if required using following:
+#micro_bench-linkerscript-y := /path/to/linkerscript
+# Applications could also define custom board files if required using following:
+#micro_bench-board-y := /path/to/boardfile
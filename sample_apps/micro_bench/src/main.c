@@ -0,0 +1,667 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+/*
+ * Micro Benchmark Application
+ *
+ * Summary:
+ *
+ * Measures the cost of the kernel and driver primitives on the chip, in
+ * cycles of the DWT cycle counter, so that a design can pick between them
+ * with numbers and a new SDK release can be compared with the last one:
+ * - the context switch and the time a higher priority thread takes to
+ *   wake up when it is given a semaphore, a queue item, a task
+ *   notification or a ring buffer element
+ * - the queue, semaphore, mutex, task notification and ring buffer calls
+ *   that do not block
+ * - os_mem_alloc() and os_mem_free() at several sizes
+ * - the entry of an interrupt, up to its driver callback
+ * - memcpy() against a memory to memory DMA copy
+ * - the UART, SPI and I2C transfers, polled or by interrupt against DMA,
+ *   when their port is set up in build.mk
+ *
+ * Every measure is repeated and reported with its minimum, average and
+ * maximum, one JSON object per line between a "bench begin" and a
+ * "bench end" line, see README.md.
+ *
+ * Nothing else runs: the Wi-Fi is not started.
+ *
+ * The serial console is set on UART-0.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <board.h>
+#include <lowlevel_drivers.h>
+#include <mdev_uart.h>
+#include <mdev_ssp.h>
+#include <mdev_i2c.h>
+#include <dma_svc.h>
+#include <ssp_dma.h>
+#include <i2c_xfer.h>
+
+/* Runs of every measure */
+#ifndef APPCONFIG_BENCH_RUNS
+#define APPCONFIG_BENCH_RUNS 1000
+#endif
+
+/* Label of the results, e.g. the SDK release */
+#ifndef APPCONFIG_BENCH_TAG
+#define APPCONFIG_BENCH_TAG ""
+#endif
+
+/* Baud rate of the UART1 run, 0 to skip it */
+#ifndef APPCONFIG_BENCH_UART_BAUD
+#define APPCONFIG_BENCH_UART_BAUD 0
+#endif
+
+/* Clock of the SSP1 master run, 0 to skip it */
+#ifndef APPCONFIG_BENCH_SPI_HZ
+#define APPCONFIG_BENCH_SPI_HZ 0
+#endif
+
+/* 7-bit address of a slave on I2C1 for the I2C run, 0 to skip it */
+#ifndef APPCONFIG_BENCH_I2C_ADDR
+#define APPCONFIG_BENCH_I2C_ADDR 0
+#endif
+
+/* Fewer runs for the transfers that take milliseconds */
+#define BENCH_XFER_RUNS 20
+#define BENCH_BUF_SIZE DMA_SVC_MAX_BLOCK
+#define BENCH_NELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+struct bench_stat {
+	uint32_t n;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+enum bench_wake {
+	BENCH_WAKE_SEM,
+	BENCH_WAKE_QUEUE,
+	BENCH_WAKE_NOTIFY,
+	BENCH_WAKE_RING,
+};
+
+static os_thread_t bench_thread;
+static os_thread_stack_define(bench_stack, 4096);
+static os_thread_t peer_thread;
+static os_thread_stack_define(peer_stack, 1024);
+
+/* Cycles of two reads of the counter in a row, taken off every measure */
+static uint32_t bench_overhead;
+
+static os_semaphore_t bench_sem;
+static os_mutex_t bench_mutex;
+static os_queue_t bench_queue;
+static os_queue_pool_define(bench_queue_data, 8 * 32);
+static os_ringbuf_t bench_ring;
+static uint32_t bench_ring_data[8];
+
+static volatile bool peer_run;
+static volatile uint32_t wake_start, wake_cycles;
+static volatile uint32_t irq_cycles;
+static volatile bool xfer_done;
+static volatile int xfer_result;
+
+static uint32_t src_buf[BENCH_BUF_SIZE / 4];
+static uint32_t dst_buf[BENCH_BUF_SIZE / 4];
+
+static inline uint32_t bench_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+static void stat_init(struct bench_stat *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->min = UINT32_MAX;
+}
+
+static void stat_add(struct bench_stat *s, uint32_t cycles)
+{
+	cycles = cycles > bench_overhead ? cycles - bench_overhead : 0;
+	s->n++;
+	s->sum += cycles;
+	if (cycles < s->min)
+		s->min = cycles;
+	if (cycles > s->max)
+		s->max = cycles;
+}
+
+/* One line per measure, arg is its size or rate, bytes the data one run
+ * moves, for the throughput */
+static void stat_print(const char *name, uint32_t arg, struct bench_stat *s,
+		       uint32_t bytes)
+{
+	uint32_t avg = s->n ? (uint32_t)(s->sum / s->n) : 0;
+
+	if (!s->n)
+		s->min = 0;
+	wmprintf("{\"name\":\"%s\",\"arg\":%u,\"n\":%u,\"min\":%u,\"avg\":%u,"
+		 "\"max\":%u", name, arg, s->n, s->min, avg, s->max);
+	if (bytes && avg)
+		wmprintf(",\"kbit_s\":%u", (uint32_t)((uint64_t)bytes * 8 *
+			 board_cpu_freq() / avg / 1000));
+	wmprintf("}\r\n");
+}
+
+static void stat_error(const char *name, uint32_t arg, int err)
+{
+	wmprintf("{\"name\":\"%s\",\"arg\":%u,\"error\":%d}\r\n", name, arg,
+		 err);
+}
+
+static void bench_calibrate(void)
+{
+	uint32_t t0, t1, min = UINT32_MAX;
+	int i;
+
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+	for (i = 0; i < 16; i++) {
+		t0 = bench_cycles();
+		t1 = bench_cycles();
+		if (t1 - t0 < min)
+			min = t1 - t0;
+	}
+	bench_overhead = min;
+}
+
+/*-------------------------- Kernel ----------------------------*/
+
+static void peer_yield(os_thread_arg_t arg)
+{
+	while (peer_run)
+		taskYIELD();
+	os_thread_self_complete(NULL);
+}
+
+/* A yield to a peer of the same priority that yields straight back is two
+ * switches */
+static void bench_ctx_switch(void)
+{
+	struct bench_stat s;
+	uint32_t t0;
+	int i;
+
+	peer_run = true;
+	if (os_thread_create(&peer_thread, "bench_peer", peer_yield, NULL,
+			     &peer_stack, OS_PRIO_2) != WM_SUCCESS) {
+		stat_error("ctx_switch", 0, -WM_FAIL);
+		return;
+	}
+	stat_init(&s);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		t0 = bench_cycles();
+		taskYIELD();
+		stat_add(&s, (bench_cycles() - t0) / 2);
+	}
+	peer_run = false;
+	taskYIELD();
+	os_thread_delete(&peer_thread);
+	stat_print("ctx_switch", 0, &s, 0);
+}
+
+static void peer_wait(os_thread_arg_t arg)
+{
+	enum bench_wake how = (enum bench_wake)arg;
+	uint32_t item;
+
+	while (1) {
+		switch (how) {
+		case BENCH_WAKE_SEM:
+			os_semaphore_get(&bench_sem, OS_WAIT_FOREVER);
+			break;
+		case BENCH_WAKE_QUEUE:
+			os_queue_recv(&bench_queue, &item, OS_WAIT_FOREVER);
+			break;
+		case BENCH_WAKE_NOTIFY:
+			os_task_notify_take(true, OS_WAIT_FOREVER);
+			break;
+		case BENCH_WAKE_RING:
+			os_ringbuf_wait(&bench_ring, OS_WAIT_FOREVER);
+			os_ringbuf_read(&bench_ring, &item, 1);
+			break;
+		}
+		wake_cycles = bench_cycles() - wake_start;
+	}
+}
+
+/* From the signal in this thread to the waiter of a higher priority
+ * running, which it does before the signal call returns */
+static void bench_wake(const char *name, enum bench_wake how)
+{
+	struct bench_stat s;
+	uint32_t item = 0;
+	int i;
+
+	if (os_thread_create(&peer_thread, "bench_peer", peer_wait,
+			     (void *)how, &peer_stack, OS_PRIO_1)
+	    != WM_SUCCESS) {
+		stat_error(name, 0, -WM_FAIL);
+		return;
+	}
+	stat_init(&s);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		wake_start = bench_cycles();
+		switch (how) {
+		case BENCH_WAKE_SEM:
+			os_semaphore_put(&bench_sem);
+			break;
+		case BENCH_WAKE_QUEUE:
+			os_queue_send(&bench_queue, &item, OS_NO_WAIT);
+			break;
+		case BENCH_WAKE_NOTIFY:
+			os_task_notify_give(peer_thread);
+			break;
+		case BENCH_WAKE_RING:
+			os_ringbuf_write(&bench_ring, &item, 1);
+			break;
+		}
+		stat_add(&s, wake_cycles);
+	}
+	os_thread_delete(&peer_thread);
+	stat_print(name, 0, &s, 0);
+}
+
+#define BENCH_CALL(s, call)				\
+	do {						\
+		uint32_t t0 = bench_cycles();		\
+		call;					\
+		stat_add(s, bench_cycles() - t0);	\
+	} while (0)
+
+static void bench_kernel_calls(void)
+{
+	struct bench_stat put, get;
+	uint32_t item[8] = {0};
+	int i;
+
+	stat_init(&put);
+	stat_init(&get);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		BENCH_CALL(&put, os_queue_send(&bench_queue, item,
+					       OS_NO_WAIT));
+		BENCH_CALL(&get, os_queue_recv(&bench_queue, item,
+					       OS_NO_WAIT));
+	}
+	stat_print("queue_send", sizeof(item), &put, 0);
+	stat_print("queue_recv", sizeof(item), &get, 0);
+
+	stat_init(&put);
+	stat_init(&get);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		BENCH_CALL(&put, os_semaphore_put(&bench_sem));
+		BENCH_CALL(&get, os_semaphore_get(&bench_sem, OS_NO_WAIT));
+	}
+	stat_print("sem_put", 0, &put, 0);
+	stat_print("sem_get", 0, &get, 0);
+
+	stat_init(&put);
+	stat_init(&get);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		BENCH_CALL(&get, os_mutex_get(&bench_mutex, OS_NO_WAIT));
+		BENCH_CALL(&put, os_mutex_put(&bench_mutex));
+	}
+	stat_print("mutex_get", 0, &get, 0);
+	stat_print("mutex_put", 0, &put, 0);
+
+	stat_init(&put);
+	stat_init(&get);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		BENCH_CALL(&put, os_task_notify_give(bench_thread));
+		BENCH_CALL(&get, os_task_notify_take(true, OS_NO_WAIT));
+	}
+	stat_print("notify_give", 0, &put, 0);
+	stat_print("notify_take", 0, &get, 0);
+
+	stat_init(&put);
+	stat_init(&get);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		BENCH_CALL(&put, os_ringbuf_write(&bench_ring, item, 1));
+		BENCH_CALL(&get, os_ringbuf_read(&bench_ring, item, 1));
+	}
+	stat_print("ring_write", sizeof(uint32_t), &put, 0);
+	stat_print("ring_read", sizeof(uint32_t), &get, 0);
+}
+
+static void bench_mem(void)
+{
+	static const uint32_t sizes[] = {16, 64, 256, 1024, 4096};
+	struct bench_stat a, f;
+	void *p;
+	int i, j;
+
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&a);
+		stat_init(&f);
+		for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+			BENCH_CALL(&a, p = os_mem_alloc(sizes[j]));
+			if (!p)
+				break;
+			BENCH_CALL(&f, os_mem_free(p));
+		}
+		stat_print("mem_alloc", sizes[j], &a, 0);
+		stat_print("mem_free", sizes[j], &f, 0);
+	}
+}
+
+/*-------------------------- Interrupt -------------------------*/
+
+static void bench_irq_cb(void)
+{
+	irq_cycles = bench_cycles();
+}
+
+/* ExtPin1 is pended by software, no pin is involved. Measured up to the
+ * callback its driver handler calls */
+static void bench_irq(void)
+{
+	struct bench_stat s;
+	uint32_t t0;
+	int i;
+
+	install_int_callback(INT_EXTPIN1, 0, bench_irq_cb);
+	NVIC_ClearPendingIRQ(ExtPin1_IRQn);
+	NVIC_EnableIRQ(ExtPin1_IRQn);
+	stat_init(&s);
+	for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+		irq_cycles = 0;
+		t0 = bench_cycles();
+		NVIC_SetPendingIRQ(ExtPin1_IRQn);
+		__DSB();
+		__ISB();
+		if (irq_cycles)
+			stat_add(&s, irq_cycles - t0);
+	}
+	NVIC_DisableIRQ(ExtPin1_IRQn);
+	install_int_callback(INT_EXTPIN1, 0, NULL);
+	stat_print("irq_entry", 0, &s, 0);
+}
+
+/*-------------------------- Copies ----------------------------*/
+
+static void bench_xfer_done(int result, void *arg)
+{
+	xfer_result = result;
+	xfer_done = true;
+}
+
+static void bench_copy(void)
+{
+	static const uint32_t sizes[] = {64, 256, 1024, 4096, BENCH_BUF_SIZE};
+	struct bench_stat cpu, dma;
+	dma_svc_desc_t desc;
+	dma_svc_req_t req = {
+		.desc = &desc,
+		.cb = bench_xfer_done,
+	};
+	uint32_t t0;
+	int i, j;
+
+	for (i = 0; i < BENCH_NELEMS(src_buf); i++)
+		src_buf[i] = i * 0x9e3779b9;
+	/* Two channels, for the SPI run */
+	if (dma_svc_init(2) != WM_SUCCESS) {
+		stat_error("dma_copy", 0, -WM_FAIL);
+		return;
+	}
+
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&cpu);
+		for (i = 0; i < APPCONFIG_BENCH_RUNS; i++)
+			BENCH_CALL(&cpu, memcpy(dst_buf, src_buf, sizes[j]));
+		stat_print("memcpy", sizes[j], &cpu, sizes[j]);
+
+		memset(dst_buf, 0, sizeof(dst_buf));
+		stat_init(&dma);
+		for (i = 0; i < APPCONFIG_BENCH_RUNS; i++) {
+			dma_svc_desc_mem(&desc, dst_buf, src_buf, sizes[j]);
+			xfer_done = false;
+			t0 = bench_cycles();
+			if (dma_svc_submit(&req) != WM_SUCCESS)
+				break;
+			while (!xfer_done)
+				;
+			stat_add(&dma, bench_cycles() - t0);
+			if (xfer_result != WM_SUCCESS)
+				break;
+		}
+		if (xfer_result != WM_SUCCESS ||
+		    memcmp(dst_buf, src_buf, sizes[j]))
+			stat_error("dma_copy", sizes[j], -WM_FAIL);
+		else
+			stat_print("dma_copy", sizes[j], &dma, sizes[j]);
+	}
+}
+
+/*-------------------------- Peripherals -----------------------*/
+
+static void bench_uart(void)
+{
+	static const uint32_t sizes[] = {64, 1024};
+	struct bench_stat s;
+	mdev_t *dev;
+	int i, j;
+
+	uart_drv_init(UART1_ID, UART_8BIT);
+	dev = uart_drv_open(UART1_ID, APPCONFIG_BENCH_UART_BAUD);
+	if (!dev) {
+		stat_error("uart_tx", APPCONFIG_BENCH_UART_BAUD, -WM_FAIL);
+		return;
+	}
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&s);
+		for (i = 0; i < BENCH_XFER_RUNS; i++) {
+			BENCH_CALL(&s, {
+				uart_drv_write(dev, (uint8_t *)src_buf,
+					       sizes[j]);
+				uart_drv_tx_flush(dev);
+			});
+		}
+		stat_print("uart_tx", sizes[j], &s, sizes[j]);
+	}
+	uart_drv_close(dev);
+	uart_drv_deinit(UART1_ID);
+}
+
+static void bench_spi(void)
+{
+	static const uint32_t sizes[] = {64, 1024, 4096};
+	ssp_dma_xfer_t xfer = {
+		.cb = bench_xfer_done,
+	};
+	struct bench_stat s;
+	mdev_t *dev;
+	int i, j;
+
+	ssp_drv_init(SSP1_ID);
+	ssp_drv_set_clk(SSP1_ID, APPCONFIG_BENCH_SPI_HZ);
+	dev = ssp_drv_open(SSP1_ID, SSP_FRAME_SPI, SSP_MASTER, DMA_DISABLE,
+			   -1, 0);
+	if (!dev) {
+		stat_error("spi_tx", APPCONFIG_BENCH_SPI_HZ, -WM_FAIL);
+		return;
+	}
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&s);
+		for (i = 0; i < BENCH_XFER_RUNS; i++)
+			BENCH_CALL(&s, ssp_drv_write(dev, (uint8_t *)src_buf,
+						     NULL, sizes[j], 0));
+		stat_print("spi_tx", sizes[j], &s, sizes[j]);
+	}
+	ssp_drv_close(dev);
+
+	/* The DMA run keeps the port */
+	dev = ssp_drv_open(SSP1_ID, SSP_FRAME_SPI, SSP_MASTER, DMA_ENABLE,
+			   -1, 0);
+	if (!dev || ssp_dma_init(dev, SSP1_ID) != WM_SUCCESS) {
+		stat_error("spi_dma_tx", APPCONFIG_BENCH_SPI_HZ, -WM_FAIL);
+		return;
+	}
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&s);
+		xfer.tx = (uint8_t *)src_buf;
+		xfer.len = sizes[j];
+		for (i = 0; i < BENCH_XFER_RUNS; i++) {
+			xfer_done = false;
+			BENCH_CALL(&s, {
+				if (ssp_dma_submit(SSP1_ID, &xfer) ==
+				    WM_SUCCESS)
+					while (!xfer_done)
+						;
+			});
+		}
+		stat_print("spi_dma_tx", sizes[j], &s, sizes[j]);
+	}
+}
+
+static void bench_i2c(void)
+{
+	static const uint32_t sizes[] = {16, 256};
+	i2c_xfer_t xfer = {
+		.addr = APPCONFIG_BENCH_I2C_ADDR,
+		.wr = (uint8_t *)src_buf,
+		.cb = bench_xfer_done,
+	};
+	struct bench_stat s;
+	mdev_t *dev;
+	int i, j, ret;
+
+	i2c_drv_init(I2C1_PORT);
+	dev = i2c_drv_open(I2C1_PORT, I2C_SLAVEADR(APPCONFIG_BENCH_I2C_ADDR) |
+			   I2C_CLK_400KHZ);
+	if (!dev) {
+		stat_error("i2c_tx", APPCONFIG_BENCH_I2C_ADDR, -WM_FAIL);
+		return;
+	}
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&s);
+		ret = WM_SUCCESS;
+		for (i = 0; i < BENCH_XFER_RUNS && ret == WM_SUCCESS; i++)
+			BENCH_CALL(&s, {
+				if (i2c_drv_write(dev, src_buf, sizes[j]) !=
+				    sizes[j])
+					ret = -WM_FAIL;
+				else
+					ret = i2c_drv_wait_till_inactivity(
+						dev, 100);
+			});
+		if (ret != WM_SUCCESS)
+			stat_error("i2c_tx", sizes[j], ret);
+		else
+			stat_print("i2c_tx", sizes[j], &s, sizes[j]);
+	}
+
+	if (i2c_xfer_init(dev, I2C1_PORT) != WM_SUCCESS) {
+		stat_error("i2c_dma_tx", APPCONFIG_BENCH_I2C_ADDR, -WM_FAIL);
+		return;
+	}
+	for (j = 0; j < BENCH_NELEMS(sizes); j++) {
+		stat_init(&s);
+		xfer.wr_len = sizes[j];
+		xfer_result = WM_SUCCESS;
+		for (i = 0; i < BENCH_XFER_RUNS &&
+			     xfer_result == WM_SUCCESS; i++) {
+			xfer_done = false;
+			BENCH_CALL(&s, {
+				if (i2c_xfer_submit(I2C1_PORT, &xfer) ==
+				    WM_SUCCESS)
+					while (!xfer_done)
+						;
+			});
+		}
+		if (xfer_result != WM_SUCCESS)
+			stat_error("i2c_dma_tx", sizes[j], xfer_result);
+		else
+			stat_print("i2c_dma_tx", sizes[j], &s, sizes[j]);
+	}
+}
+
+/*-------------------------- Main ------------------------------*/
+
+static void bench_main(os_thread_arg_t arg)
+{
+	int ret;
+
+	ret = os_semaphore_create_counting(&bench_sem, "bench_sem",
+					   APPCONFIG_BENCH_RUNS, 0);
+	if (ret == WM_SUCCESS)
+		ret = os_mutex_create(&bench_mutex, "bench_mutex",
+				      OS_MUTEX_INHERIT);
+	if (ret == WM_SUCCESS)
+		ret = os_queue_create(&bench_queue, "bench_queue",
+				      8 * sizeof(uint32_t), &bench_queue_data);
+	if (ret != WM_SUCCESS) {
+		wmprintf("bench aborted, kernel objects not created: %d\r\n",
+			 ret);
+		os_thread_self_complete(NULL);
+		return;
+	}
+	os_ringbuf_init(&bench_ring, bench_ring_data, sizeof(uint32_t),
+			BENCH_NELEMS(bench_ring_data));
+	bench_calibrate();
+
+	wmprintf("bench begin\r\n");
+	wmprintf("{\"tag\":\"%s\",\"built\":\"%s %s\",\"cpu_hz\":%u,"
+		 "\"overhead\":%u}\r\n", APPCONFIG_BENCH_TAG, __DATE__,
+		 __TIME__, board_cpu_freq(), bench_overhead);
+
+	bench_ctx_switch();
+	bench_wake("wake_sem", BENCH_WAKE_SEM);
+	bench_wake("wake_notify", BENCH_WAKE_NOTIFY);
+	bench_wake("wake_ring", BENCH_WAKE_RING);
+	/* The queue takes 4 bytes items for this one */
+	os_queue_delete(&bench_queue);
+	ret = os_queue_create(&bench_queue, "bench_queue", sizeof(uint32_t),
+			      &bench_queue_data);
+	if (ret == WM_SUCCESS) {
+		bench_wake("wake_queue", BENCH_WAKE_QUEUE);
+		os_queue_delete(&bench_queue);
+	} else {
+		stat_error("wake_queue", 0, ret);
+	}
+	ret = os_queue_create(&bench_queue, "bench_queue",
+			      8 * sizeof(uint32_t), &bench_queue_data);
+	if (ret != WM_SUCCESS) {
+		stat_error("queue", 0, ret);
+		wmprintf("bench end\r\n");
+		os_thread_self_complete(NULL);
+		return;
+	}
+
+	bench_kernel_calls();
+	bench_mem();
+	bench_irq();
+	bench_copy();
+	if (APPCONFIG_BENCH_UART_BAUD)
+		bench_uart();
+	if (APPCONFIG_BENCH_SPI_HZ)
+		bench_spi();
+	if (APPCONFIG_BENCH_I2C_ADDR)
+		bench_i2c();
+
+	wmprintf("bench end\r\n");
+	os_thread_self_complete(NULL);
+}
+
+int main(void)
+{
+	wmstdio_init(UART0_ID, 0);
+	wmprintf("micro_bench app started\r\n");
+
+	/* Above the system threads that are left, below the waiters of the
+	 * wake up measures */
+	if (os_thread_create(&bench_thread, "bench", bench_main, NULL,
+			     &bench_stack, OS_PRIO_2) != WM_SUCCESS)
+		wmprintf("Error: Cannot create the bench thread\r\n");
+	return 0;
+}
@@ -2,7 +2,7 @@
 # All Rights Reserved.
 
 exec-y += ntpc_demo
-ntpc_demo-objs-y := src/main.c src/ntpc.c
+ntpc_demo-objs-y := src/main.c
 
 # Applications could also define custom board files if required using following:
 #ntpc_demo-board-y := /path/to/boardfile
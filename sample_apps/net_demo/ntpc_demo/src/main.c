@@ -21,9 +21,11 @@
 #include <board.h>
 #include <push_button.h>
 #include <aws_utils.h>
+#include <ntpc.h>
+#include <clock_disc.h>
 
 /*-----------------------Global declarations----------------------*/
-#define SYNC_INTERVAL 60000
+#define SYNC_TIMEOUT 3000
 
 #define MICRO_AP_SSID                "aws_starter-ntpc"
 #define MICRO_AP_PASSPHRASE          "marvellwm"
@@ -36,7 +38,9 @@ static os_thread_t time_sync_thread;
 /* Buffer to be used as stack */
 static os_thread_stack_define(time_sync_stack, 4 * 1024);
 
-int ntpc_sync(const char *ntp_server, uint32_t max_num_pkt_xchange);
+static const char *ntp_servers[] = {
+	"0.pool.ntp.org", "1.pool.ntp.org", "2.pool.ntp.org",
+};
 
 static char *month_names[] = { "Jan", "Feb", "Mar",
 				     "Apr", "May", "Jun",
@@ -49,15 +53,25 @@ static char *day_names[] = { "Sun", "Mon", "Tue", "Wed",
 static void _time_sync()
 {
 	while (1) {
-		ntpc_sync("pool.ntp.org", 2);
+		struct clock_disc_status st;
 		struct tm c_time;
+
+		/* The clock is corrected between the syncs, which grow apart
+		 * as its frequency error is learnt */
+		if (clock_disc_sync(ntp_servers, 3, SYNC_TIMEOUT) ==
+		    WM_SUCCESS) {
+			clock_disc_get(&st);
+			wmprintf("ntp: offset %d ms, delay %u ms, correction "
+				 "%d ppb, next sync in %u s\r\n", st.offset_ms,
+				 st.delay_ms, st.ppb, st.interval_s);
+		}
 		wmtime_time_get(&c_time);
 		wmprintf("%s %d %s %.2d %.2d:%.2d:%.2d\r\n",
 			 day_names[c_time.tm_wday],
 			 c_time.tm_year + 1900, month_names[c_time.tm_mon],
 			 c_time.tm_mday, c_time.tm_hour,
 			 c_time.tm_min, c_time.tm_sec);
-		os_thread_sleep(os_msec_to_ticks(SYNC_INTERVAL));
+		os_thread_sleep(os_msec_to_ticks(clock_disc_next_sync_ms()));
 	}
 	os_thread_self_complete(NULL);
 	return;
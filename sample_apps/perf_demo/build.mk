@@ -0,0 +1,37 @@
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+#
+
+exec-y += perf_demo
+perf_demo-objs-y := src/main.c
+perf_demo-cflags-y := -I$(d)/src -DAPPCONFIG_DEBUG_ENABLE=1
+
+# The run is set up from the make command line, e.g.
+# make APP=sample_apps/perf_demo APPCONFIG_PERF_RATE=50 APPCONFIG_PERF_QOS=1
+APPCONFIG_PERF_RATE ?= 10
+APPCONFIG_PERF_SIZE ?= 128
+APPCONFIG_PERF_QOS ?= 0
+APPCONFIG_PERF_DURATION ?= 60
+APPCONFIG_PERF_REPORT_INTERVAL ?= 5
+perf_demo-cflags-y += -DAPPCONFIG_PERF_RATE=$(APPCONFIG_PERF_RATE) \
+	-DAPPCONFIG_PERF_SIZE=$(APPCONFIG_PERF_SIZE) \
+	-DAPPCONFIG_PERF_QOS=$(APPCONFIG_PERF_QOS) \
+	-DAPPCONFIG_PERF_DURATION=$(APPCONFIG_PERF_DURATION) \
+	-DAPPCONFIG_PERF_REPORT_INTERVAL=$(APPCONFIG_PERF_REPORT_INTERVAL)
+
+# Raw TCP throughput run before the MQTT one, skipped without a server, e.g.
+# make APP=sample_apps/perf_demo APPCONFIG_PERF_TCP_SERVER=192.168.1.10
+APPCONFIG_PERF_TCP_SERVER ?=
+APPCONFIG_PERF_TCP_PORT ?= 5001
+APPCONFIG_PERF_TCP_RX ?= 0
+APPCONFIG_PERF_TCP_DURATION ?= 20
+perf_demo-cflags-y += \
+	-DAPPCONFIG_PERF_TCP_SERVER=\"$(APPCONFIG_PERF_TCP_SERVER)\" \
+	-DAPPCONFIG_PERF_TCP_PORT=$(APPCONFIG_PERF_TCP_PORT) \
+	-DAPPCONFIG_PERF_TCP_RX=$(APPCONFIG_PERF_TCP_RX) \
+	-DAPPCONFIG_PERF_TCP_DURATION=$(APPCONFIG_PERF_TCP_DURATION)
+
+# Applications could also define custom linker files if required using following:
+#perf_demo-linkerscript-y := /path/to/linkerscript
+# Applications could also define custom board files if required using following:
+#perf_demo-board-y := /path/to/boardfile
@@ -0,0 +1,572 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+/*
+ * MQTT Performance Demo Application
+ *
+ * Summary:
+ *
+ * Device publishes messages of a configured size and QoS at a configured
+ * rate to a topic of its own and subscribes to that same topic, so that
+ * every message comes back through the AWS IoT broker. Every message carries
+ * its sequence number and the time it was sent.
+ *
+ * At every report interval the application prints the messages sent and
+ * received per second, the 50th and 99th percentile of the publish to
+ * receive latency, the CPU idle time and the heap usage, and a summary of
+ * the whole run at its end. The same build on the same network gives
+ * numbers that can be compared between SDK versions and configurations.
+ *
+ * The run is set up at build time, e.g.
+ * make APP=sample_apps/perf_demo APPCONFIG_PERF_RATE=20 APPCONFIG_PERF_SIZE=512
+ * see build.mk.
+ *
+ * The serial console is set on UART-0.
+ *
+ * A serial terminal program like HyperTerminal, putty, or
+ * minicom can be used to see the program output.
+ */
+
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmtime.h>
+#include <wmsdk.h>
+#include <board.h>
+#include <aws_iot_mqtt_interface.h>
+#include <aws_utils.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lwip/sockets.h>
+/* configuration parameters */
+#include <aws_iot_config.h>
+
+#include "aws_starter_root_ca_cert.h"
+
+/* Messages published per second, 0 to publish as fast as the link allows */
+#ifndef APPCONFIG_PERF_RATE
+#define APPCONFIG_PERF_RATE 10
+#endif
+
+/* Payload size in bytes, at least the header of the message */
+#ifndef APPCONFIG_PERF_SIZE
+#define APPCONFIG_PERF_SIZE 128
+#endif
+
+/* QoS of the publishes and of the subscription, 0 or 1 */
+#ifndef APPCONFIG_PERF_QOS
+#define APPCONFIG_PERF_QOS 0
+#endif
+
+/* Length of the run in seconds, 0 to run until reset */
+#ifndef APPCONFIG_PERF_DURATION
+#define APPCONFIG_PERF_DURATION 60
+#endif
+
+/* Seconds between two reports */
+#ifndef APPCONFIG_PERF_REPORT_INTERVAL
+#define APPCONFIG_PERF_REPORT_INTERVAL 5
+#endif
+
+/* Host of a TCP sink or source for the raw TCP throughput run that comes
+ * before the MQTT run, as a dotted quad, "" to skip it */
+#ifndef APPCONFIG_PERF_TCP_SERVER
+#define APPCONFIG_PERF_TCP_SERVER ""
+#endif
+
+#ifndef APPCONFIG_PERF_TCP_PORT
+#define APPCONFIG_PERF_TCP_PORT 5001
+#endif
+
+/* 0 to send to the server, 1 to receive from it */
+#ifndef APPCONFIG_PERF_TCP_RX
+#define APPCONFIG_PERF_TCP_RX 0
+#endif
+
+/* Length of the TCP run in seconds */
+#ifndef APPCONFIG_PERF_TCP_DURATION
+#define APPCONFIG_PERF_TCP_DURATION 20
+#endif
+
+#define MICRO_AP_SSID                "aws_perf_demo"
+#define MICRO_AP_PASSPHRASE          "marvellwm"
+#define MAX_MAC_BYTES                6
+#define REGION_LEN                   16
+#define PERF_TOPIC_LEN               64
+/* Latencies kept per report interval and for the whole run, the ones of the
+ * messages beyond are left out of the percentiles */
+#define PERF_MAX_SAMPLES             512
+
+/* Start of every payload, the rest is filler */
+struct perf_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t sent_us;	/* os_get_timestamp() when published */
+};
+
+#define PERF_MAGIC 0x70657266
+
+/* Bytes handed to the socket per call, a few segments so that lwIP can fill
+ * full sized segments and the Wi-Fi driver gets them back to back */
+#define PERF_TCP_CHUNK               (4 * 1460)
+
+struct perf_stats {
+	uint32_t sent;
+	uint32_t publish_failed;
+	uint32_t received;
+	uint32_t lost;		/* Gaps in the sequence numbers received */
+	uint32_t nsamples;
+	uint32_t samples[PERF_MAX_SAMPLES];	/* Latencies in us */
+	uint32_t idle_calls;
+	unsigned start_ms;
+};
+
+/*-----------------------Global declarations----------------------*/
+
+static MQTTClient_t mqtt_client;
+static bool device_connected;
+
+/* Thread handle */
+static os_thread_t perf_thread;
+/* Buffer to be used as stack */
+static os_thread_stack_define(perf_stack, 8 * 1024);
+/* aws iot url */
+static char url[128];
+static char client_id[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
+static char client_cert_buffer[AWS_PUB_CERT_SIZE];
+static char private_key_buffer[AWS_PRIV_KEY_SIZE];
+static char perf_topic[PERF_TOPIC_LEN];
+
+static uint8_t tcp_buf[PERF_TCP_CHUNK];
+static uint8_t payload[APPCONFIG_PERF_SIZE < sizeof(struct perf_header) ?
+		       sizeof(struct perf_header) : APPCONFIG_PERF_SIZE];
+
+static struct perf_stats interval_stats, run_stats;
+static uint32_t next_seq_expected;
+
+/* Idle hook calls per second of a CPU doing nothing else */
+static uint32_t idle_calls_per_sec;
+static volatile uint32_t idle_calls;
+
+/* The idle task calls the hook in a loop, the number of calls made in a
+ * period against the number made while nothing else ran gives the share of
+ * the CPU left idle */
+static void perf_idle_hook()
+{
+	idle_calls++;
+}
+
+static void perf_stats_reset(struct perf_stats *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->start_ms = os_ticks_to_msec(os_ticks_get());
+	s->idle_calls = idle_calls;
+}
+
+static void perf_stats_add_sample(struct perf_stats *s, uint32_t latency_us)
+{
+	s->received++;
+	if (s->nsamples < PERF_MAX_SAMPLES)
+		s->samples[s->nsamples++] = latency_us;
+}
+
+static int perf_cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* The samples are sorted in place */
+static uint32_t perf_percentile(struct perf_stats *s, unsigned pct)
+{
+	if (!s->nsamples)
+		return 0;
+	return s->samples[(s->nsamples - 1) * pct / 100];
+}
+
+/* Share of the CPU left idle since the idle count was idle_start */
+static unsigned perf_idle_pct(uint32_t idle_start, unsigned elapsed_ms)
+{
+	uint32_t idle = idle_calls - idle_start;
+	unsigned idle_pct = 0;
+
+	if (idle_calls_per_sec)
+		idle_pct = (uint64_t)idle * 100000 /
+			((uint64_t)idle_calls_per_sec * elapsed_ms);
+	return idle_pct > 100 ? 100 : idle_pct;
+}
+
+static void perf_stats_print(const char *what, struct perf_stats *s)
+{
+	unsigned elapsed_ms = os_ticks_to_msec(os_ticks_get()) - s->start_ms;
+	const heapAllocatorInfo_t *hI = getheapAllocInfo();
+	unsigned idle_pct;
+
+	if (!elapsed_ms)
+		elapsed_ms = 1;
+	idle_pct = perf_idle_pct(s->idle_calls, elapsed_ms);
+
+	qsort(s->samples, s->nsamples, sizeof(s->samples[0]), perf_cmp_u32);
+
+	wmprintf("[perf] %s %u.%03us: sent %u (%u msg/s, %u failed) "
+		 "received %u (%u msg/s, %u lost)\r\n", what,
+		 elapsed_ms / 1000, elapsed_ms % 1000,
+		 s->sent, s->sent * 1000 / elapsed_ms, s->publish_failed,
+		 s->received, s->received * 1000 / elapsed_ms, s->lost);
+	wmprintf("[perf] %s latency p50 %u us p99 %u us, cpu idle %u%%, "
+		 "heap peak %u of %u free now %u\r\n", what,
+		 perf_percentile(s, 50), perf_percentile(s, 99), idle_pct,
+		 hI->peakHeapUsage, hI->heapSize, hI->freeSize);
+}
+
+/* Runs in the yield of the perf thread */
+static int32_t perf_message_handler(MQTTCallbackParams params)
+{
+	struct perf_header h;
+	uint32_t latency;
+
+	if (params.MessageParams.PayloadLen < sizeof(h))
+		return 0;
+	memcpy(&h, params.MessageParams.pPayload, sizeof(h));
+	if (h.magic != PERF_MAGIC)
+		return 0;
+
+	latency = os_get_timestamp() - h.sent_us;
+	perf_stats_add_sample(&interval_stats, latency);
+	perf_stats_add_sample(&run_stats, latency);
+
+	/* Messages sent before a gap that arrive later are not counted back,
+	 * with QoS 0 over a single connection they are not reordered */
+	if (h.seq > next_seq_expected) {
+		interval_stats.lost += h.seq - next_seq_expected;
+		run_stats.lost += h.seq - next_seq_expected;
+	}
+	if (h.seq >= next_seq_expected)
+		next_seq_expected = h.seq + 1;
+	return 0;
+}
+
+static int perf_publish(uint32_t seq)
+{
+	MQTTPublishParams pp = MQTTPublishParamsDefault;
+	struct perf_header h = {
+		.magic = PERF_MAGIC,
+		.seq = seq,
+	};
+	IoT_Error_t rc;
+
+	h.sent_us = os_get_timestamp();
+	memcpy(payload, &h, sizeof(h));
+
+	pp.pTopic = perf_topic;
+	pp.MessageParams.qos = APPCONFIG_PERF_QOS ? QOS_1 : QOS_0;
+	pp.MessageParams.pPayload = payload;
+	pp.MessageParams.PayloadLen = sizeof(payload);
+	rc = aws_iot_mqtt_publish(&pp);
+
+	if (rc != NONE_ERROR) {
+		interval_stats.publish_failed++;
+		run_stats.publish_failed++;
+		return -WM_FAIL;
+	}
+	interval_stats.sent++;
+	run_stats.sent++;
+	return WM_SUCCESS;
+}
+
+/* Counts the idle hook calls of a second in which the perf thread sleeps
+ * and nothing is published yet */
+static void perf_calibrate_idle()
+{
+	uint32_t start = idle_calls;
+
+	os_thread_sleep(os_msec_to_ticks(1000));
+	idle_calls_per_sec = idle_calls - start;
+}
+
+static void perf_tcp_print(const char *what, uint64_t bytes,
+			   unsigned elapsed_ms, uint32_t idle_start)
+{
+	/* Kbit/s, bytes * 8 / ms */
+	unsigned kbps;
+
+	if (!elapsed_ms)
+		elapsed_ms = 1;
+	kbps = bytes * 8 / elapsed_ms;
+	wmprintf("[perf] tcp %s %s %u.%03us: %u bytes, %u.%03u Mbit/s, "
+		 "cpu idle %u%%\r\n", APPCONFIG_PERF_TCP_RX ? "rx" : "tx",
+		 what, elapsed_ms / 1000, elapsed_ms % 1000,
+		 (unsigned)bytes, kbps / 1000, kbps % 1000,
+		 perf_idle_pct(idle_start, elapsed_ms));
+}
+
+/* Sends to or receives from the server as fast as the link goes, the
+ * bytes are counted when the socket takes or gives them */
+static void perf_tcp_run()
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(APPCONFIG_PERF_TCP_PORT),
+	};
+	unsigned start, now, interval_start, end;
+	uint32_t idle_start, interval_idle;
+	uint64_t total = 0, interval = 0;
+	int sock, ret;
+
+	addr.sin_addr.s_addr = inet_addr(APPCONFIG_PERF_TCP_SERVER);
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0) {
+		wmprintf("[perf] tcp socket failed\r\n");
+		return;
+	}
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		wmprintf("[perf] tcp connect to %s:%d failed\r\n",
+			 APPCONFIG_PERF_TCP_SERVER, APPCONFIG_PERF_TCP_PORT);
+		close(sock);
+		return;
+	}
+
+	wmprintf("[perf] tcp %s %s:%d for %d s\r\n",
+		 APPCONFIG_PERF_TCP_RX ? "rx from" : "tx to",
+		 APPCONFIG_PERF_TCP_SERVER, APPCONFIG_PERF_TCP_PORT,
+		 APPCONFIG_PERF_TCP_DURATION);
+
+	start = os_ticks_to_msec(os_ticks_get());
+	now = interval_start = start;
+	idle_start = interval_idle = idle_calls;
+	end = start + APPCONFIG_PERF_TCP_DURATION * 1000;
+
+	while ((int)(end - now) > 0) {
+		if (APPCONFIG_PERF_TCP_RX)
+			ret = recv(sock, tcp_buf, sizeof(tcp_buf), 0);
+		else
+			ret = send(sock, tcp_buf, sizeof(tcp_buf), 0);
+		if (ret <= 0) {
+			wmprintf("[perf] tcp connection closed\r\n");
+			break;
+		}
+		total += ret;
+		interval += ret;
+
+		now = os_ticks_to_msec(os_ticks_get());
+		if (now - interval_start >=
+		    APPCONFIG_PERF_REPORT_INTERVAL * 1000) {
+			perf_tcp_print("interval", interval,
+				       now - interval_start, interval_idle);
+			interval = 0;
+			interval_idle = idle_calls;
+			interval_start = now;
+		}
+	}
+
+	perf_tcp_print("run", total, os_ticks_to_msec(os_ticks_get()) - start,
+		       idle_start);
+	close(sock);
+}
+
+static int perf_load_configuration(MQTTConnectParams *cp)
+{
+	int ret;
+	char region[REGION_LEN];
+	uint8_t device_mac[MAX_MAC_BYTES];
+
+	memset(region, 0, sizeof(region));
+
+	/* read device MAC address */
+	ret = read_aws_device_mac(device_mac);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to read device mac address. Returning!\r\n");
+		return -WM_FAIL;
+	}
+	/* Unique client ID in the format prefix-6 byte MAC address */
+	snprintf(client_id, MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES,
+		 "%s-%02x%02x%02x%02x%02x%02x", AWS_IOT_MQTT_CLIENT_ID,
+		 device_mac[0], device_mac[1], device_mac[2],
+		 device_mac[3], device_mac[4], device_mac[5]);
+	cp->pClientID = client_id;
+	snprintf(perf_topic, sizeof(perf_topic), "perf/%s/loopback",
+		 client_id);
+
+	/* read configured region name from the persistent memory */
+	ret = read_aws_region(region, REGION_LEN);
+	snprintf(url, sizeof(url), "data.iot.%s.amazonaws.com",
+		 ret == WM_SUCCESS ? region : AWS_IOT_MY_REGION_NAME);
+	cp->pHostURL = url;
+	cp->port = AWS_IOT_MQTT_PORT;
+	cp->pRootCALocation = rootCA;
+
+	/* read configured certificate from the persistent memory */
+	ret = read_aws_certificate(client_cert_buffer, AWS_PUB_CERT_SIZE);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to configure certificate. Returning!\r\n");
+		return -WM_FAIL;
+	}
+	cp->pDeviceCertLocation = client_cert_buffer;
+
+	/* read configured private key from the persistent memory */
+	ret = read_aws_key(private_key_buffer, AWS_PRIV_KEY_SIZE);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to configure key. Returning!\r\n");
+		return -WM_FAIL;
+	}
+	cp->pDevicePrivateKeyLocation = private_key_buffer;
+
+	return WM_SUCCESS;
+}
+
+/* application thread */
+static void perf_demo(os_thread_arg_t data)
+{
+	MQTTConnectParams cp = MQTTConnectParamsDefault;
+	MQTTSubscribeParams sub = MQTTSubscribeParamsDefault;
+	unsigned now, next_send, next_report, end;
+	uint32_t seq = 0;
+	int wait, ret;
+
+	if (os_setup_idle_function(perf_idle_hook) != WM_SUCCESS)
+		wmprintf("No idle hook left, cpu idle is not measured\r\n");
+	perf_calibrate_idle();
+
+	if (APPCONFIG_PERF_TCP_SERVER[0])
+		perf_tcp_run();
+
+	aws_iot_mqtt_init(&mqtt_client);
+
+	ret = perf_load_configuration(&cp);
+	if (ret != WM_SUCCESS) {
+		wmprintf("aws configuration failed : %d\r\n", ret);
+		goto out;
+	}
+
+	ret = aws_iot_mqtt_connect(&cp);
+	if (ret != NONE_ERROR) {
+		wmprintf("aws connect failed : %d\r\n", ret);
+		goto out;
+	}
+
+	sub.pTopic = perf_topic;
+	sub.qos = APPCONFIG_PERF_QOS ? QOS_1 : QOS_0;
+	sub.mHandler = perf_message_handler;
+	ret = aws_iot_mqtt_subscribe(&sub);
+	if (ret != NONE_ERROR) {
+		wmprintf("Failed to subscribe to %s: %d\r\n", perf_topic, ret);
+		goto out;
+	}
+
+	wmprintf("[perf] topic %s rate %d msg/s size %d qos %d for %d s\r\n",
+		 perf_topic, APPCONFIG_PERF_RATE, (int)sizeof(payload),
+		 APPCONFIG_PERF_QOS, APPCONFIG_PERF_DURATION);
+
+	perf_stats_reset(&interval_stats);
+	perf_stats_reset(&run_stats);
+	now = os_ticks_to_msec(os_ticks_get());
+	next_send = now;
+	next_report = now + APPCONFIG_PERF_REPORT_INTERVAL * 1000;
+	end = now + APPCONFIG_PERF_DURATION * 1000;
+
+	while (!APPCONFIG_PERF_DURATION || (int)(end - now) > 0) {
+		if (device_connected && (int)(next_send - now) <= 0) {
+			perf_publish(seq++);
+			/* Behind schedule after a stall the lost time is not
+			 * made up with a burst */
+			next_send += APPCONFIG_PERF_RATE ?
+				1000 / APPCONFIG_PERF_RATE : 0;
+			if ((int)(next_send - now) < 0)
+				next_send = now;
+		}
+
+		if ((int)(next_report - now) <= 0) {
+			perf_stats_print("interval", &interval_stats);
+			perf_stats_reset(&interval_stats);
+			next_report += APPCONFIG_PERF_REPORT_INTERVAL * 1000;
+		}
+
+		/* Receives until the next message is due */
+		wait = next_send - now;
+		if (wait < 1)
+			wait = 1;
+		if (wait > (int)(next_report - now))
+			wait = next_report - now;
+		if (wait < 1)
+			wait = 1;
+		aws_iot_mqtt_yield_until_event(wait);
+
+		now = os_ticks_to_msec(os_ticks_get());
+	}
+
+	/* Leaves the last messages time to come back */
+	aws_iot_mqtt_yield(1000);
+	perf_stats_print("run", &run_stats);
+
+	aws_iot_mqtt_unsubscribe(perf_topic);
+	ret = aws_iot_mqtt_disconnect();
+	if (NONE_ERROR != ret)
+		wmprintf("aws iot disconnect error %d\r\n", ret);
+
+out:
+	os_remove_idle_function(perf_idle_hook);
+	os_thread_self_complete(NULL);
+	return;
+}
+
+void wlan_event_normal_link_lost(void *data)
+{
+	device_connected = false;
+}
+
+void wlan_event_normal_connect_failed(void *data)
+{
+	device_connected = false;
+}
+
+/* This function gets invoked when station interface connects to home AP.
+ * Network dependent services can be started here.
+ */
+void wlan_event_normal_connected(void *data)
+{
+	static bool started;
+	int ret;
+	/* Default time set to 1 April 2016 */
+	time_t time = 1459468800;
+
+	wmprintf("Connected successfully to the configured network\r\n");
+	device_connected = true;
+
+	if (started)
+		return;
+
+	/* set system time */
+	wmtime_time_set_posix(time);
+
+	ret = os_thread_create(&perf_thread, "perfDemo", perf_demo, 0,
+			       &perf_stack, OS_PRIO_3);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to start perf thread: %d\r\n", ret);
+		return;
+	}
+	started = true;
+}
+
+int main()
+{
+	/* initialize the standard input output facility over uart */
+	if (wmstdio_init(UART0_ID, 0) != WM_SUCCESS) {
+		return -WM_FAIL;
+	}
+
+	wmprintf("Build Time: " __DATE__ " " __TIME__ "\r\n");
+	wmprintf("\r\n#### MQTT PERFORMANCE DEMO ####\r\n\r\n");
+
+	/* This api adds aws iot configuration support in web application.
+	 * Configuration details are then stored in persistent memory.
+	 */
+	enable_aws_config_support();
+
+	/* This api starts micro-AP if device is not configured, else connects
+	 * to configured network stored in persistent memory. Function
+	 * wlan_event_normal_connected() is invoked on successful connection.
+	 */
+	wm_wlan_start(MICRO_AP_SSID, MICRO_AP_PASSPHRASE);
+	return 0;
+}
@@ -5,9 +5,12 @@
 
 subdir-y                         += sample_apps/hello_world
 subdir-y                         += sample_apps/aws_starter_demo
+subdir-y                         += sample_apps/perf_demo
+subdir-y                         += sample_apps/micro_bench
 subdir-y			 += sample_apps/connected_maraca
 subdir-y                         += sample_apps/io_demo/adc
 subdir-y                         += sample_apps/io_demo/gpio
 subdir-y                         += sample_apps/io_demo/uart/uart_echo_demo
+subdir-y                         += sample_apps/io_demo/uart/uart_dma_rx_demo
 subdir-y                         += sample_apps/net_demo/ntpc_demo
 
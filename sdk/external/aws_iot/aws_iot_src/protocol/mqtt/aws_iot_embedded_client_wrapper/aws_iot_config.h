@@ -33,22 +33,143 @@
 // MQTT PubSub
 #define AWS_IOT_MQTT_TX_BUF_LEN 2048 ///< Any time a message is sent out through the MQTT layer. The message is copied into this buffer anytime a publish is done. This will also be used in the case of Thing Shadow
 #define AWS_IOT_MQTT_RX_BUF_LEN 2048 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped.
-#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow
+#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters a connection of the MQTT wrapper can handle at any given time, and of one subscribe call. This should be increased appropriately when using Thing Shadow. MQTTClient() itself takes handler storage of any size
+#define AWS_IOT_MQTT_NUM_TOPIC_TRIE_NODES (AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS * 6) ///< Number of topic levels the MQTT client can store for its subscriptions. Levels shared between topic filters are stored once, a Thing Shadow topic filter uses 6 levels
+#define AWS_IOT_MQTT_MAX_CONNECTIONS 1 ///< Number of MQTT connections that can be open at the same time, including the default connection used by the aws_iot_mqtt_* API. Every connection has its own TX and RX buffers
+#define AWS_IOT_TLS_CONNECTIONS (AWS_IOT_MQTT_MAX_CONNECTIONS + AWS_IOT_HTTP_POOL_CONNECTIONS) ///< TLS connections open at the same time, of the MQTT connections and the HTTP pool. Each has an entry in the caches of parsed certificates, TLS sessions and DNS answers
+#define AWS_IOT_TLS_RX_BUF_LEN 512 ///< Size of the receive buffer in the TLS network layer. Decrypted data is read from TLS in chunks of this size so that MQTT header parsing happens from memory
+#define AWS_IOT_TLS_TX_BUF_LEN 1024 ///< Size of the buffer the TLS network layer collects the writes of an MQTT batch in, e.g. a burst of acks, to encrypt them as one TLS record. At most 16384, the largest TLS record
+#define AWS_IOT_TLS_ARENA_LEN 16384 ///< Memory of a connection the TLS library takes its allocations of the session set up and the handshake from, the connection object, its record buffers, the handshake hashes and certificates. Given back at once on disconnect instead of as many blocks of the heap, so that reconnects do not fragment it. Allocations that do not fit go to the heap. 0 to take them all from the heap
+#define AWS_IOT_MQTT_LOW_MEMORY 0 ///< 1 to serialize MQTT packets straight into the TLS write buffer and parse them in place in the TLS read buffer, instead of the AWS_IOT_MQTT_TX_BUF_LEN and AWS_IOT_MQTT_RX_BUF_LEN buffers of every connection. A packet other than a publish payload then has to fit in AWS_IOT_TLS_TX_BUF_LEN, a received packet in AWS_IOT_TLS_RX_BUF_LEN - 1 unless it is streamed
+#define AWS_IOT_MQTT_LOW_MEMORY_TX_MIN 128 ///< In the low memory mode, writes collected in the TLS write buffer are sent before the next packet when fewer bytes are free behind them
+#define AWS_IOT_MQTT_LOW_MEMORY_RX_BUF_LEN 128 ///< In the low memory mode, the buffer of every connection that received packets too big for the TLS read buffer are streamed through or dropped with. The topic of a streamed publish has to fit
+#define AWS_IOT_RUNTIME_CONFIG 0 ///< 1 to size the MQTT buffers of the connections, the Thing Shadow ack and topic tables and the JSON tokens at run time, from memory the application gives to aws_iot_runtime_config_init(). AWS_IOT_MQTT_TX_BUF_LEN, AWS_IOT_MQTT_RX_BUF_LEN, MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME, MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME and MAX_JSON_TOKEN_EXPECTED are then only the defaults, see aws_iot_runtime_config.h
+#define AWS_IOT_TCP_CONNECT_TIMEOUT_MS 5000 ///< Time the TCP connects to the addresses of the MQTT host can take before the host is resolved again and new addresses are tried. The whole connect, TLS handshake included, is bounded by tlsHandshakeTimeout_ms
+#define AWS_IOT_DNS_CACHE_ENTRIES AWS_IOT_TLS_CONNECTIONS ///< Host names whose address is kept between connections, see dns_cache.h. Reconnects skip DNS while the TTL of the answer runs
+#define AWS_IOT_DNS_RESOLUTION_DELAY_MS 50 ///< With IPv6 (CONFIG_IPV6) the A and the AAAA record of the MQTT host are queried together. Once one of them is in, the other one is waited for this long before connecting without it
+#define AWS_IOT_CONNECTION_ATTEMPT_DELAY_MS 250 ///< Happy eyeballs: when the MQTT host has an IPv6 and an IPv4 address, the IPv6 connect gets this head start before the IPv4 connect runs alongside it. The first connection up is used
+#define AWS_IOT_TLS_SESSION_RESUME 1 ///< Offer the TLS session of the previous connection when reconnecting so that the server can skip the certificate exchange and the key agreement. The parsed certificates are kept between connections either way
+#define AWS_IOT_TLS_VERIFY_CACHE 0 ///< Keep the SHA-256 of the last server certificate chain verified against the root CA, with the end of its validity. A full handshake that is given the same chain again, e.g. by a server which does not resume sessions, skips the signature checks of the chain. The chain is compared once the handshake is done, before any data goes out, and a different one ends the connection and is verified in full on the next attempt. Needs a TLS library built with SESSION_CERTS, which the prebuilt one of the SDK is not
+#define AWS_IOT_TLS_VERIFY_CACHE_MAX_AGE_S 86400 ///< Time a verified chain stands in for its verification, within its validity
+#define AWS_IOT_TLS_CIPHER_LIST "AES128-SHA256:AES128-SHA:AES256-SHA256:AES256-SHA:DHE-RSA-AES128-SHA256:DHE-RSA-AES128-SHA:DHE-RSA-AES256-SHA256:DHE-RSA-AES256-SHA" ///< Cipher suites offered to the MQTT host. The records of AES suites are encrypted by the AES engine, the software ciphers (3DES, RC4, Rabbit) are left out. Undefine to offer every suite of the TLS library
+#define AWS_IOT_TLS_ECC 0 ///< Offer AWS_IOT_TLS_ECC_CIPHER_LIST ahead of AWS_IOT_TLS_CIPHER_LIST. Needs a TLS library built with HAVE_ECC and HAVE_SUPPORTED_CURVES, which the prebuilt one of the SDK is not
+#define AWS_IOT_TLS_ECC_CIPHER_LIST "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES128-SHA256:ECDHE-ECDSA-AES128-SHA:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-SHA256:ECDHE-RSA-AES128-SHA" ///< Cipher suites offered ahead of AWS_IOT_TLS_CIPHER_LIST, with P-256 as the only curve, when the TLS library is built with HAVE_ECC and HAVE_SUPPORTED_CURVES. Use an ECDSA P-256 device key with them, its signature takes a fraction of the time of an RSA one
+#define AWS_IOT_TLS_MAX_FRAGMENT_LEN 0 ///< Largest TLS record the MQTT host is asked to send, 512, 1024, 2048 or 4096, through the max_fragment_length extension. The TLS library grows its receive buffer to the largest record, 16384 bytes without it. 0 to leave the extension out. Needs a TLS library built with HAVE_MAX_FRAGMENT, which the prebuilt one of the SDK is not
+#define AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH 8 ///< Maximum number of asynchronous QoS1 and QoS2 publish messages that can be waiting for a PUBACK or PUBCOMP at any given time
+#define AWS_IOT_MQTT_THREAD_SAFE 1 ///< Let several threads publish, subscribe and yield on a connection at the same time. Writes are serialized, one thread reads and hands the replies to the threads waiting for them
+#define AWS_IOT_MQTT_MAX_ACK_WAITERS 4 ///< Number of blocking subscribes, unsubscribes and QoS1 publishes that can wait for their reply on a connection at the same time. One more waits for a slot within its command timeout
+#define AWS_IOT_MQTT_YIELD_DRAIN_MAX 16 ///< Packets already received and buffered by the TLS layer that the yield handles in a row, after the one it read, before it looks at its timers and the keepalive again. Bounds how late a ping can be under a flood of messages
+#define AWS_IOT_MQTT_MAX_QOS2_RECEIVED 8 ///< Number of received QoS2 messages whose PUBREL can be outstanding. Their ids are kept to drop retransmissions, a new message that finds no room is not acknowledged and arrives again after a reconnect
+#define AWS_IOT_MQTT_COMPRESS 0 ///< Compress the payloads of publishes with MessageParams.isCompressed set and expand the received payloads that were compressed. Every connection takes twice AWS_IOT_MQTT_COMPRESS_BUF_LEN and 512 bytes. The format is the one of lzss.h, only for subscribers which expand it themselves, a broker rule or another client cannot read it
+#define AWS_IOT_MQTT_COMPRESS_BUF_LEN 1024 ///< Largest compressed payload sent and largest expanded payload received, larger ones are sent and delivered as they are
+#define AWS_IOT_MQTT_COMPRESS_MIN_LEN 64 ///< Shorter payloads are sent as they are, the marker would take what compression saves
+#define AWS_IOT_MQTT_TOPIC_ALIASES 8 ///< Topics an MQTT 5 connection publishes to with a 2 byte alias after the first publish, as many as the broker takes. The least recently used one is reassigned, 0 sends every topic in full
+#define AWS_IOT_MQTT_TOPIC_ALIAS_MAX_LEN 96 ///< Longest topic that gets an alias, it is kept in the client
+#define AWS_IOT_MQTT_STATS 1 ///< Count the bytes and packets of every connection and keep histograms of PUBACK latency, send time and reconnect time, see MQTTGetStats(). About 500 bytes per connection
+#define AWS_IOT_MQTT_RATE_LIMIT 0 ///< Pace the publishes of every connection with token buckets, see aws_iot_mqtt_rate_class_set(), instead of having the broker throttle or drop the connection. Publishes beyond the rate then fail with PUBLISH_RATE_LIMITED and a held QoS0 publish is replaced by a newer one on its topic, so the application has to expect both
+#define AWS_IOT_MQTT_PUBLISH_RATE 100 ///< Publishes per second of a connection, the AWS IoT limit of a connection. 0 leaves the connection unlimited, the topic classes still apply
+#define AWS_IOT_MQTT_PUBLISH_BURST 20 ///< Publishes a connection can send at once after being idle
+#define AWS_IOT_MQTT_RATE_CLASSES 4 ///< Topic classes of a connection with a rate of their own, e.g. the shadow updates of a thing
+#define AWS_IOT_MQTT_RATE_HOLD_SLOTS 4 ///< QoS0 publishes of a connection held back by the rate limit until the yield sends them. A newer publish on the topic of a held one replaces it
+#define AWS_IOT_MQTT_RATE_HOLD_LEN 256 ///< Largest topic plus payload of a held publish, every slot takes this much memory. Larger QoS0 publishes wait for their token like QoS1 ones
+#define AWS_IOT_MQTT_DISPATCH 1 ///< Let subscriptions run their callback on a worker lane of work_svc.h instead of in the yielding thread, see MQTTDispatch. The lane threads are started by the first such subscription
+#define AWS_IOT_MQTT_DISPATCH_SLOTS 4 ///< Messages copied for the lanes and not handled yet, of all connections. Every slot takes AWS_IOT_MQTT_DISPATCH_MAX_LEN bytes
+#define AWS_IOT_MQTT_INGEST 1 ///< Map the publishes on the topics of an ingest route to the Basic Ingest topic of its rule, see aws_iot_mqtt_ingest_route_set(), so that they skip the broker
+#define AWS_IOT_MQTT_INGEST_ROUTES 4 ///< Ingest routes of a connection
+#define AWS_IOT_MQTT_INGEST_TOPIC_LEN 128 ///< Longest Basic Ingest topic, $aws/rules/, the rule name, a slash and the topic. Every mapped publish takes this much stack, longer ones go to the broker
+#define AWS_IOT_MQTT_DISPATCH_MAX_LEN 512 ///< Largest topic plus payload, with a NUL after each, copied for a lane. Larger messages run inline
+#define AWS_IOT_MQTT_RX_BUFFERS 1 ///< Read buffers of every connection, each of AWS_IOT_MQTT_RX_BUF_LEN bytes. With more than one, a message for a lane is handed over in the buffer it was read into, whatever its size, and the next packets are read into a free one while the handler runs. Its topic is then not NUL terminated, as for an inline handler. Not with AWS_IOT_MQTT_LOW_MEMORY or AWS_IOT_RUNTIME_CONFIG
+#define AWS_IOT_TCP_NODELAY 1 ///< Disable Nagle on the MQTT socket. Every MQTT packet is sent in one write, waiting for the ack of the previous segment only adds a round trip to the latency
+#define AWS_IOT_TCP_KEEPALIVE_IDLE_S 0 ///< Idle time in seconds before TCP keepalive probes are sent on the MQTT socket, 0 leaves keepalive off. A dead connection is noticed within IDLE + INTERVAL * COUNT seconds of silence, e.g. about 25 s with 15, instead of 1.5 MQTT keepalives. Each probe wakes the radio, keep it off on battery powered devices
+#define AWS_IOT_TCP_KEEPALIVE_INTERVAL_S 3 ///< Time in seconds between TCP keepalive probes
+#define AWS_IOT_TCP_KEEPALIVE_COUNT 3 ///< Number of unanswered TCP keepalive probes after which the connection is dropped
 
 // Thing Shadow specific configs
-#define SHADOW_MAX_SIZE_OF_RX_BUFFER AWS_IOT_MQTT_RX_BUF_LEN+1 ///< Maximum size of the SHADOW buffer to store the received Shadow message
 #define MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES 80  ///< Maximum size of the Unique Client Id. For More info on the Client Id refer \ref response "Acknowledgments"
 #define MAX_SIZE_CLIENT_ID_WITH_SEQUENCE MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES + 10 ///< This is size of the extra sequence number that will be appended to the Unique client Id
 #define MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE MAX_SIZE_CLIENT_ID_WITH_SEQUENCE + 20 ///< This is size of the the total clientToken key and value pair in the JSON
-#define MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME 10 ///< At Any given time we will wait for this many responses. This will correlate to the rate at which the shadow actions are requested
+#define MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME 10 ///< At Any given time we will wait for this many responses. This will correlate to the rate at which the shadow actions are requested. Matching an ack and checking timeouts do not scan the list, so it can be raised to hundreds (up to 65534)
 #define MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME 10 ///< We could perform shadow action on any thing Name and this is maximum Thing Names we can act on at any given time
-#define MAX_JSON_TOKEN_EXPECTED 120 ///< These are the max tokens that is expected to be in the Shadow JSON document. Include the metadata that gets published
+#define MAX_JSON_TOKEN_EXPECTED 120 ///< These are the max tokens that is expected to be in the Shadow JSON document. Include the metadata that gets published. A token takes 8 bytes, its offsets are 16 bit so documents are parsed up to 32767 bytes
+#define MAX_JSON_DELTA_KEY_HASH_BUCKETS 32 ///< Buckets of the hash used to find the registered delta keys of a received delta, has to be a power of two
 #define MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME 60 ///< All shadow actions have to be published or subscribed to a topic which is of the format $aws/things/{thingName}/shadow/update/accepted. This refers to the size of the topic without the Thing Name
 #define MAX_SIZE_OF_THING_NAME 30 ///< The Thing Name should not be bigger than this value. Modify this if the Thing Name needs to be bigger
 #define MAX_SHADOW_TOPIC_LENGTH_BYTES MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME + MAX_SIZE_OF_THING_NAME ///< This size includes the length of topic with Thing Name
+#define SHADOW_MAX_THINGS 64 ///< Maximum number of things whose deltas are handled with aws_iot_shadow_thing_add(), for a gateway the number of end nodes it acts for
+#define SHADOW_THINGS_HASH_BUCKETS 16 ///< Buckets of the hash used to find the thing of a received delta, has to be a power of two
+#define MAX_SHADOW_REPORTED_FIELDS 16 ///< Maximum number of fields that can be registered with aws_iot_shadow_reported_register()
+#define SHADOW_REPORTED_FLUSH_INTERVAL_MS 1000 ///< Changed reported fields are sent together in one update this long after the first change
+#define SHADOW_REPORTED_FLUSH_THRESHOLD 8 ///< Number of changed reported fields that get sent right away, without waiting for SHADOW_REPORTED_FLUSH_INTERVAL_MS
+#define SHADOW_REPORTED_MAX_SIZE_OF_DOCUMENT 512 ///< Size of the buffer the merged reported update is built in
+#define SHADOW_REPORTED_UPDATE_TIMEOUT_SEC 4 ///< Time the merged reported update waits for accepted/rejected before its fields are queued again
+#define SHADOW_REPORTED_MAX_VALUE_SIZE 16 ///< Values of reported fields up to this many bytes, strings with their NUL, are kept as last sent so that unchanged fields are left out of the update
+#define SHADOW_VERSIONED_UPDATE_RETRIES 2 ///< Times aws_iot_shadow_update_versioned() gets the shadow and sends the update again after a version conflict
+
+// Deferred console output, see aws_iot_log_deferred.h
+#define AWS_IOT_LOG_DEFERRED_BUF_LEN 2048 ///< Size of the ring buffer holding console output not written to the UART yet, has to be a power of two. Lines that do not fit are dropped
+#define AWS_IOT_LOG_DEFERRED_PRIO OS_PRIO_3 ///< Priority of the task writing the deferred console output, below every task that logs
+#define AWS_IOT_LOG_DEFERRED_DMA 1 ///< Have the DMA feed the console UART from the ring buffer while the task sleeps, instead of the task writing it a character at a time
+
+// Offline publish queue, see aws_iot_offline_queue.h
+#define AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE 4096 ///< Erase unit of the flash the queue partition is in
+#define AWS_IOT_OFFLINE_QUEUE_MAX_MSG_LEN 512 ///< Largest topic plus payload of a queued message. Has to fit in a sector with the 8 byte sector and the 12 byte record header
+#define AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE 20 ///< Queued messages sent per second after a reconnect, 0 for as fast as the PUBACKs come in
+#define AWS_IOT_OFFLINE_QUEUE_PIPELINE 4 ///< Queued QoS1 messages waiting for their PUBACK at the same time, at most AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH. The rest of the window is left to the application
+#define AWS_IOT_OFFLINE_QUEUE_PRE_ERASE 1 ///< Have the flash thread of flash_async.h erase the next sector of the queue while the current one fills, so that a put does not wait for an erase
+
+// Resumable JSON tokenizer, see aws_iot_json_stream.h
+#define AWS_IOT_JSON_STREAM_MAX_DEPTH 8 ///< Objects and arrays a document may nest, at most 32
+#define AWS_IOT_JSON_STREAM_MAX_KEY_LEN 32 ///< Size of the buffer of the current key, with its NUL
+#define AWS_IOT_JSON_STREAM_MAX_VALUE_LEN 128 ///< Size of the buffer of the current string or primitive value, with its NUL
+
+// AWS IoT Jobs client, see aws_iot_jobs.h
+#define AWS_IOT_JOBS_MAX_JOB_ID_LEN 65 ///< Size of the job id of an execution, with its NUL. AWS IoT job ids have up to 64 characters
+#define AWS_IOT_JOBS_TOPIC_LEN 160 ///< Longest Jobs topic, $aws/things/, the thing name, /jobs/, a job id and /update
+#define AWS_IOT_JOBS_UPDATE_SLOTS 4 ///< Status updates waiting to be sent or acknowledged
+#define AWS_IOT_JOBS_UPDATE_LEN 256 ///< Longest status update document, with the status details
+#define AWS_IOT_JOBS_PIPELINE 2 ///< Status updates waiting for their PUBACK at the same time, at most AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH
+
+// Datagram telemetry transport, see datagram_interface.h
+#define AWS_IOT_DGRAM_MAX_LEN 1024 ///< Largest datagram, with its 12 byte header and 8 byte MIC. At most 1472 to fit in one Ethernet frame, 1500 bytes of IP, without fragmentation
+#define AWS_IOT_DGRAM_BATCH 16 ///< Messages sent together in one datagram at most
+#define AWS_IOT_DGRAM_FLUSH_MS 1000 ///< A publish sends the batch when its first message waited this long
+
+// MQTT service task, see aws_iot_mqtt_service.h
+#define AWS_IOT_MQTT_SERVICE_QUEUE_LEN 16 ///< Messages the outbound queue holds, of all priorities. When it is full a message is dropped for a more urgent one
+#define AWS_IOT_MQTT_SERVICE_MAX_MSG_LEN 256 ///< Largest topic plus payload of a queued message, every queue entry takes this much memory
+#define AWS_IOT_MQTT_SERVICE_BULK_INFLIGHT 4 ///< Bulk QoS1 messages waiting for their PUBACK at the same time, less than AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH. The rest of the window is kept for commands and alarms
+#define AWS_IOT_MQTT_SERVICE_YIELD_MS 1000 ///< Longest the service task waits in the yield before it looks at the queue again. An enqueue wakes it up at once
+#define AWS_IOT_MQTT_SERVICE_STACK_SIZE 4096 ///< Stack of the service task, it runs the TLS layer and the message handlers
+#define AWS_IOT_MQTT_SERVICE_PRIO OS_PRIO_2 ///< Priority of the service task
+
+// HTTPS client pool, see aws_iot_http_pool.h
+#define AWS_IOT_HTTP_POOL_CONNECTIONS 2 ///< HTTPS connections kept open between requests, to one host or several. Each one takes a TCP socket, a Network of the TLS layer and AWS_IOT_TLS_ARENA_LEN while it is open. 0 leaves the pool out
+#define AWS_IOT_HTTP_POOL_IDLE_MS 30000 ///< A connection not used for this long is closed instead of reused, before the server drops it
+#define AWS_IOT_HTTP_POOL_HOST_LEN 64 ///< Longest host name of the pool, with its NUL
+#define AWS_IOT_HTTP_REQUEST_LEN 512 ///< Longest request, the request line with the path and the Host and Range headers. Every request takes this much stack
+#define AWS_IOT_HTTP_PIPELINE_DEPTH 4 ///< Range requests of a download sent on a connection ahead of their responses, so that the link does not idle a round trip per range
+#define AWS_IOT_HTTP_FLASH_BUFS 2 ///< Sector buffers a download to flash fills while the flash thread of flash_async.h writes the others, taken from the heap for the download
+#define AWS_IOT_HTTP_RETRIES 2 ///< New connections a request or download makes in a row after the network failed, a keep-alive connection the server closed in between included
+
+// Wi-Fi power save, see aws_iot_wifi_ps.h
+#define AWS_IOT_WIFI_PS_BEACON_WAKE_US 2000 ///< Time the radio is taken to be awake for a beacon, for the estimate of the awake share when the application passes no power save events
+#define AWS_IOT_WIFI_PS_TX_WAKE_MS 30 ///< Time the radio is taken to be awake for a send window and the replies to it, for the same estimate
+
+// Local MQTT gateway, see aws_iot_mqtt_gateway.h
+#define AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS 4 ///< Clients connected at once, each takes a TCP socket of CONFIG_MAX_SOCKETS_TCP and AWS_IOT_MQTT_GATEWAY_RX_BUF_LEN bytes
+#define AWS_IOT_MQTT_GATEWAY_RX_BUF_LEN 512 ///< Largest packet a client may send
+#define AWS_IOT_MQTT_GATEWAY_MAX_SUBS 4 ///< Topic filters a client may subscribe to
+#define AWS_IOT_MQTT_GATEWAY_MAX_FILTER_LEN 64 ///< Longest topic filter, with its NUL
+#define AWS_IOT_MQTT_GATEWAY_BATCH 8 ///< Forwarded messages queued upstream together, at most AWS_IOT_MQTT_SERVICE_QUEUE_LEN
+#define AWS_IOT_MQTT_GATEWAY_FLUSH_MS 200 ///< Longest a forwarded message waits for the others of its batch
+#define AWS_IOT_MQTT_GATEWAY_STAGE_LEN 1024 ///< Bytes of the forwarded messages waiting, topics and payloads
+#define AWS_IOT_MQTT_GATEWAY_SEND_TIMEOUT_MS 500 ///< A client whose socket takes longer to accept a packet is disconnected
+#define AWS_IOT_MQTT_GATEWAY_STACK_SIZE 2048 ///< Stack of the gateway task
+#define AWS_IOT_MQTT_GATEWAY_PRIO AWS_IOT_MQTT_SERVICE_PRIO ///< Priority of the gateway task. The same as the service task, so that a batch is all queued before the service task sends it
 
 // Auto Reconnect specific config
-#define AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL 1000 ///< Minimum time before the First reconnect attempt is made as part of the exponential back-off algorithm
-#define AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL 8000 ///< Maximum time interval after which exponential back-off will stop attempting to reconnect.
+#define AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL 1000 ///< Window of the first back-off attempt. Every attempt is made at a random time within its window, the window doubles after each failed attempt. While the network is down it is checked this often, without attempts
+#define AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL 8000 ///< Largest back-off window, the reconnect times out once the window would grow past it. A connection lost after being up this long is retried at once, see AWS_IOT_MQTT_FAST_RECONNECT_WINDOW
+#define AWS_IOT_MQTT_FAST_RECONNECT_WINDOW 200 ///< Window in milliseconds of the first attempt after a stable connection was lost with the network up, before the back-off starts. The addresses in the DNS cache and the TLS session are reused
 
 #endif /* SRC_SHADOW_IOT_SHADOW_CONFIG_H_ */
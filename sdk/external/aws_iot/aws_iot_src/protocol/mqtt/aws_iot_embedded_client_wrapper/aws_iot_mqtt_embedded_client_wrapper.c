@@ -13,17 +13,191 @@
  * permissions and limitations under the License.
  */
 
+#include <string.h>
+#include <wmstdio.h>
+
 #include "timer_interface.h"
+#include "threads_interface.h"
 #include "aws_iot_mqtt_interface.h"
 #include "MQTTClient.h"
 #include "aws_iot_config.h"
 
-static Client c;
+#if AWS_IOT_RUNTIME_CONFIG
+#include "aws_iot_runtime_config.h"
+#endif
+
+#if AWS_IOT_MQTT_DISPATCH
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <work_svc.h>
+#endif
+
+#if AWS_IOT_MQTT_COMPRESS
+#include <lzss.h>
+
+/* In front of a compressed payload: 0x1E, 'Z' and the length of the
+ * payload before compression, big endian */
+#define COMPRESS_MARKER_LEN 4
+#endif
+
+#if AWS_IOT_MQTT_INGEST
+#define INGEST_PREFIX "$aws/rules/"
+#define INGEST_PREFIX_LEN (sizeof(INGEST_PREFIX) - 1)
+
+typedef struct {
+	const char *pTopicPrefix;	/* NULL for a free route */
+	size_t prefixLen;
+	const char *pRuleName;
+} IngestRoute;
+#endif
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+#define RATE_CLASS_NONE 0xff
+
+enum {
+	RATE_HOLD_FREE,
+	RATE_HOLD_WAITING,
+	RATE_HOLD_SENDING,
+};
+
+/* Token bucket, counted in thousandths of a publish so that slow rates
+ * refill by the millisecond */
+typedef struct {
+	uint32_t rate;		/* publishes per second, 0 for no limit */
+	uint32_t burst;
+	uint32_t milliTokens;
+	unsigned long refillTick;
+} RateBucket;
+
+typedef struct {
+	const char *pTopicPrefix;	/* NULL for a free class */
+	size_t prefixLen;
+	RateBucket bucket;
+} RateClass;
+
+/* QoS0 publish held back by the limit: its topic, a NUL and its payload */
+typedef struct {
+	uint8_t state;
+	uint8_t rateClass;
+	bool isRetained;
+	uint16_t topicLen;
+	uint16_t payloadLen;
+	char data[AWS_IOT_MQTT_RATE_HOLD_LEN];
+} RateHeld;
+#endif
+
+#if AWS_IOT_MQTT_DISPATCH && 1 < AWS_IOT_MQTT_RX_BUFFERS
+#if AWS_IOT_MQTT_LOW_MEMORY || AWS_IOT_RUNTIME_CONFIG
+#error "AWS_IOT_MQTT_RX_BUFFERS needs the static read buffers of the connections"
+#endif
+#define MQTT_RX_SPARES (AWS_IOT_MQTT_RX_BUFFERS - 1)
+#else
+#define MQTT_RX_SPARES 0
+#endif
+
+#if AWS_IOT_MQTT_DISPATCH
+/* Message copied for a lane: params point into data, which holds its topic,
+ * a NUL, its payload and a NUL. Or, with pRxBuf set, into the read buffer of
+ * pConnection it was read into. Free while pHandler is NULL */
+typedef struct {
+	work_t work;
+	iot_message_handler pHandler;
+	MQTTCallbackParams params;
+#if MQTT_RX_SPARES
+	MQTTConnection_t *pConnection;
+	unsigned char *pRxBuf;
+#endif
+	char data[AWS_IOT_MQTT_DISPATCH_MAX_LEN];
+} DispatchSlot;
+
+/* Shared by the connections, claimed by their readers and freed by the lanes */
+static DispatchSlot dispatchSlots[AWS_IOT_MQTT_DISPATCH_SLOTS];
+static uint32_t dispatchUsed;
+static MQTTDispatchStats dispatchStats;
+#endif
 
-static iot_disconnect_handler clientDisconnectHandler;
+#if AWS_IOT_MQTT_LOW_MEMORY
+/* Packets are serialized and parsed in the buffers of the TLS layer, readbuf
+ * only takes packets too big for those */
+#define MQTT_TX_BUF(pConnection) NULL
+#define MQTT_TX_BUF_LEN(pConnection) 0
+#else
+#define MQTT_TX_BUF(pConnection) ((pConnection)->writebuf)
+#endif
+#if AWS_IOT_RUNTIME_CONFIG
+/* The buffers are taken from the arena of aws_iot_runtime_config.h the first
+ * time the connection connects */
+#if !AWS_IOT_MQTT_LOW_MEMORY
+#define MQTT_TX_BUF_LEN(pConnection) ((pConnection)->writebufLen)
+#endif
+#define MQTT_RX_BUF_LEN(pConnection) ((pConnection)->readbufLen)
+#elif AWS_IOT_MQTT_LOW_MEMORY
+#define MQTT_RX_BUF_LEN(pConnection) AWS_IOT_MQTT_LOW_MEMORY_RX_BUF_LEN
+#else
+#define MQTT_TX_BUF_LEN(pConnection) AWS_IOT_MQTT_TX_BUF_LEN
+#define MQTT_RX_BUF_LEN(pConnection) AWS_IOT_MQTT_RX_BUF_LEN
+#endif
+#if MQTT_RX_SPARES
+/* The client is set up again with the buffer it reads into, the others may be
+ * held by handlers */
+#define MQTT_RX_BUF(pConnection) \
+	(NULL != (pConnection)->c.readbuf ? (pConnection)->c.readbuf : (pConnection)->readbuf)
+#else
+#define MQTT_RX_BUF(pConnection) ((pConnection)->readbuf)
+#endif
 
-static unsigned char writebuf[AWS_IOT_MQTT_TX_BUF_LEN];
-static unsigned char readbuf[AWS_IOT_MQTT_RX_BUF_LEN];
+struct MQTTConnection {
+	Client c;	/* must stay the first member, see pahoDisconnectHandler() */
+	iot_disconnect_handler clientDisconnectHandler;
+	bool isClientInitialized;
+	bool isAllocated;
+#if AWS_IOT_RUNTIME_CONFIG
+#if !AWS_IOT_MQTT_LOW_MEMORY
+	unsigned char *writebuf;
+	uint32_t writebufLen;
+#endif
+	unsigned char *readbuf;
+	uint32_t readbufLen;
+#elif AWS_IOT_MQTT_LOW_MEMORY
+	unsigned char readbuf[AWS_IOT_MQTT_LOW_MEMORY_RX_BUF_LEN];
+#else
+	unsigned char writebuf[AWS_IOT_MQTT_TX_BUF_LEN];
+	unsigned char readbuf[AWS_IOT_MQTT_RX_BUF_LEN];
+#endif
+#if MQTT_RX_SPARES
+	bool isRxSparesInitialized;
+	unsigned char rxSpares[MQTT_RX_SPARES][AWS_IOT_MQTT_RX_BUF_LEN];
+	unsigned char *rxFree[MQTT_RX_SPARES];	/* read buffers neither read into nor held by a handler */
+	uint32_t rxFreeCount;
+#endif
+	MessageHandlers messageHandlers[AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS];
+	TopicTrieNode topicTrieNodes[AWS_IOT_MQTT_NUM_TOPIC_TRIE_NODES];
+#if AWS_IOT_MQTT_RATE_LIMIT
+	bool isRateInitialized;
+	Mutex rateLock;		/* held while the buckets and the held publishes change */
+	RateBucket rateBucket;
+	RateClass rateClasses[AWS_IOT_MQTT_RATE_CLASSES];
+	RateHeld rateHeld[AWS_IOT_MQTT_RATE_HOLD_SLOTS];
+	MQTTRateStats rateStats;
+#endif
+#if AWS_IOT_MQTT_COMPRESS
+	bool isCompressInitialized;
+	Mutex compressLock;	/* held while compressBuf holds the payload of a publish */
+	struct lzss_work compressWork;
+	unsigned char compressBuf[COMPRESS_MARKER_LEN + AWS_IOT_MQTT_COMPRESS_BUF_LEN];
+	char expandBuf[AWS_IOT_MQTT_COMPRESS_BUF_LEN + 1];	/* received payload, used by the reader only */
+	MQTTCompressStats compressStats;
+#endif
+#if AWS_IOT_MQTT_INGEST
+	bool isIngestInitialized;
+	Mutex ingestLock;	/* held while the routes change or are looked up */
+	IngestRoute ingestRoutes[AWS_IOT_MQTT_INGEST_ROUTES];
+#endif
+};
+
+/* Connection 0 is the default connection used by the aws_iot_mqtt_* API */
+static MQTTConnection_t connections[AWS_IOT_MQTT_MAX_CONNECTIONS];
+#define DEFAULT_CONNECTION (&connections[0])
 
 const MQTTConnectParams MQTTConnectParamsDefault = {
 		.enableAutoReconnect = 1,
@@ -43,22 +217,31 @@ const MQTTConnectParams MQTTConnectParamsDefault = {
 		.mqttCommandTimeout_ms = 30000,
 		.tlsHandshakeTimeout_ms = 60000,
 		.isSSLHostnameVerify = true,
-		.disconnectHandler = NULL
+		.disconnectHandler = NULL,
+		.isPingFixedInterval = false,
+		.trafficClass = TRAFFIC_CLASS_BE
 };
 
 const MQTTPublishParams MQTTPublishParamsDefault={
 		.pTopic = NULL,
-		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0}
+		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0, .isCompressed = false},
+		.local = MQTT_LOCAL_NONE
 };
 const MQTTSubscribeParams MQTTSubscribeParamsDefault={
 		.pTopic = NULL,
 		.qos = QOS_0,
-		.mHandler = NULL
+		.mHandler = NULL,
+		.isStreaming = false,
+		.dispatch = MQTT_DISPATCH_INLINE,
+		.isLocal = false
 };
 const MQTTCallbackParams MQTTCallbackParamsDefault={
 		.pTopicName = NULL,
 		.TopicNameLen = 0,
-		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0}
+		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0, .isCompressed = false},
+		.PayloadOffset = 0,
+		.TotalPayloadLen = 0,
+		.isLastChunk = true
 };
 const MQTTMessageParams MQTTMessageParamsDefault={
 		.qos = QOS_0,
@@ -66,7 +249,8 @@ const MQTTMessageParams MQTTMessageParamsDefault={
 		.isDuplicate = false,
 		.id = 0,
 		.pPayload = NULL,
-		.PayloadLen = 0
+		.PayloadLen = 0,
+		.isCompressed = false
 };
 const MQTTwillOptions MQTTwillOptionsDefault={
 		.pTopicName = NULL,
@@ -75,6 +259,273 @@ const MQTTwillOptions MQTTwillOptionsDefault={
 		.qos = QOS_0
 };
 
+#if AWS_IOT_MQTT_DISPATCH
+static void dispatchRun(work_t *w) {
+	DispatchSlot *pSlot = (DispatchSlot *)work_arg(w);
+	unsigned long state;
+
+	pSlot->pHandler(pSlot->params);
+
+	state = os_enter_critical_section();
+#if MQTT_RX_SPARES
+	if (NULL != pSlot->pRxBuf) {
+		pSlot->pConnection->rxFree[pSlot->pConnection->rxFreeCount++] = pSlot->pRxBuf;
+	}
+#endif
+	pSlot->pHandler = NULL;
+	dispatchUsed--;
+	os_exit_critical_section(state);
+}
+
+#if MQTT_RX_SPARES
+/* Once for the slot of the connection, the buffers held by handlers come back
+ * to it across reconnects and new allocations of the slot */
+static void rxSparesInit(MQTTConnection_t *pConnection) {
+	uint32_t i;
+
+	if (pConnection->isRxSparesInitialized) {
+		return;
+	}
+	for (i = 0; i < MQTT_RX_SPARES; i++) {
+		pConnection->rxFree[i] = pConnection->rxSpares[i];
+	}
+	pConnection->rxFreeCount = MQTT_RX_SPARES;
+	pConnection->isRxSparesInitialized = true;
+}
+
+/* A message of the broker, not a local or an expanded one */
+static bool isInReadBuffer(Client *c, const MQTTCallbackParams *pParams) {
+	const unsigned char *pPayload = (const unsigned char *)pParams->MessageParams.pPayload;
+
+	return NULL != c->readbuf && pPayload >= c->readbuf && pPayload < c->readbuf + c->readBufSize;
+}
+#endif
+
+/* Copy the message, or take the buffer it was read into, and hand it to the
+ * lane, false if it has to be handled inline. The read buffer is free for the
+ * next packet once this returns */
+static bool dispatchMessage(iot_message_handler pHandler, const MQTTCallbackParams *pParams, uint8_t dispatch,
+		MQTTConnection_t *pConnection) {
+	static const enum work_lane lanes[] = {WORK_LANE_HIGH, WORK_LANE_NORMAL, WORK_LANE_LOW};
+	DispatchSlot *pSlot = NULL;
+	unsigned char *pSpare = NULL;
+	unsigned long state;
+	uint32_t topicLen = pParams->TopicNameLen;
+	uint32_t payloadLen = pParams->MessageParams.PayloadLen;
+	uint32_t i;
+
+	if (MQTT_DISPATCH_HIGH > dispatch || MQTT_DISPATCH_LOW < dispatch) {
+		return false;
+	}
+
+	state = os_enter_critical_section();
+	for (i = 0; i < AWS_IOT_MQTT_DISPATCH_SLOTS; i++) {
+		if (NULL == dispatchSlots[i].pHandler) {
+			pSlot = &dispatchSlots[i];
+			break;
+		}
+	}
+#if MQTT_RX_SPARES
+	if (NULL != pSlot && NULL != pConnection && 0 < pConnection->rxFreeCount
+			&& isInReadBuffer(&(pConnection->c), pParams)) {
+		pSpare = pConnection->rxFree[--(pConnection->rxFreeCount)];
+		dispatchStats.handedOver++;
+	}
+#endif
+	if (NULL == pSpare && topicLen + payloadLen + 2 > AWS_IOT_MQTT_DISPATCH_MAX_LEN) {
+		pSlot = NULL;
+	}
+	if (NULL == pSlot) {
+		dispatchStats.inlined++;
+		os_exit_critical_section(state);
+		return false;
+	}
+	pSlot->pHandler = pHandler;
+	dispatchStats.queued++;
+	if (++dispatchUsed > dispatchStats.maxUsed) {
+		dispatchStats.maxUsed = dispatchUsed;
+	}
+	os_exit_critical_section(state);
+
+	pSlot->params = *pParams;
+#if MQTT_RX_SPARES
+	pSlot->pConnection = pConnection;
+	/* handlePublish() leaves the payload NUL terminated in a buffer taken */
+	pSlot->pRxBuf = (NULL != pSpare) ? MQTTTakeReadBuffer(&(pConnection->c), pSpare) : NULL;
+	if (NULL == pSlot->pRxBuf)
+#endif
+	{
+		pSlot->params.pTopicName = pSlot->data;
+		memcpy(pSlot->data, pParams->pTopicName, topicLen);
+		pSlot->data[topicLen] = '\0';
+		pSlot->params.MessageParams.pPayload = &(pSlot->data[topicLen + 1]);
+		memcpy(pSlot->params.MessageParams.pPayload, pParams->MessageParams.pPayload, payloadLen);
+		pSlot->data[topicLen + 1 + payloadLen] = '\0';
+	}
+
+	work_init(&(pSlot->work), dispatchRun, pSlot, lanes[dispatch - MQTT_DISPATCH_HIGH]);
+	work_submit(&(pSlot->work));
+	return true;
+}
+#endif
+
+#if AWS_IOT_MQTT_COMPRESS
+/* Point the payload of a publish at its compressed copy in compressBuf and
+ * take compressLock for it. False if compressing does not make it shorter,
+ * the payload is then sent as it is */
+static bool compressPayload(MQTTConnection_t *pConnection, MQTTMessageParams *pParams) {
+	uint32_t len = pParams->PayloadLen;
+	int n;
+
+	if (!pParams->isCompressed || AWS_IOT_MQTT_COMPRESS_MIN_LEN > len || LZSS_MAX_LEN < len
+			|| !pConnection->isCompressInitialized) {
+		return false;
+	}
+
+	mutex_lock(&(pConnection->compressLock), THREADS_WAIT_FOREVER);
+	n = lzss_compress(&(pConnection->compressWork), pParams->pPayload, len,
+			&(pConnection->compressBuf[COMPRESS_MARKER_LEN]), AWS_IOT_MQTT_COMPRESS_BUF_LEN);
+	if (0 >= n || len <= (uint32_t)n + COMPRESS_MARKER_LEN) {
+		pConnection->compressStats.skipped++;
+		mutex_unlock(&(pConnection->compressLock));
+		return false;
+	}
+
+	pConnection->compressBuf[0] = 0x1E;
+	pConnection->compressBuf[1] = 'Z';
+	pConnection->compressBuf[2] = (unsigned char)(len >> 8);
+	pConnection->compressBuf[3] = (unsigned char)len;
+	pParams->pPayload = pConnection->compressBuf;
+	pParams->PayloadLen = (uint32_t)n + COMPRESS_MARKER_LEN;
+
+	pConnection->compressStats.compressed++;
+	pConnection->compressStats.bytesIn += len;
+	pConnection->compressStats.bytesOut += pParams->PayloadLen;
+	return true;
+}
+
+/* Point a received payload that came compressed at its expanded copy in
+ * expandBuf, NUL terminated. Called by the reader of the connection. One
+ * that does not expand is delivered as it is */
+static void expandPayload(MQTTConnection_t *pConnection, MQTTCallbackParams *pParams) {
+	const unsigned char *pPayload = (const unsigned char *)pParams->MessageParams.pPayload;
+	uint32_t len = pParams->MessageParams.PayloadLen;
+	uint32_t rawLen;
+	int n;
+
+	pParams->MessageParams.isCompressed = false;
+	if (NULL == pConnection || !pParams->isLastChunk || 0 != pParams->PayloadOffset
+			|| COMPRESS_MARKER_LEN > len || 0x1E != pPayload[0] || 'Z' != pPayload[1]) {
+		return;
+	}
+
+	rawLen = ((uint32_t)pPayload[2] << 8) | pPayload[3];
+	if (AWS_IOT_MQTT_COMPRESS_BUF_LEN < rawLen) {
+		pConnection->compressStats.unexpanded++;
+		return;
+	}
+	n = lzss_decompress(&pPayload[COMPRESS_MARKER_LEN], len - COMPRESS_MARKER_LEN,
+			pConnection->expandBuf, rawLen);
+	if ((int)rawLen != n) {
+		pConnection->compressStats.unexpanded++;
+		return;
+	}
+
+	pConnection->expandBuf[n] = '\0';
+	pParams->MessageParams.pPayload = pConnection->expandBuf;
+	pParams->MessageParams.PayloadLen = rawLen;
+	pParams->TotalPayloadLen = rawLen;
+	pParams->MessageParams.isCompressed = true;
+	pConnection->compressStats.expanded++;
+}
+#endif
+
+#if AWS_IOT_MQTT_INGEST
+static IoT_Error_t ingestInit(MQTTConnection_t *pConnection) {
+	if (pConnection->isIngestInitialized) {
+		return NONE_ERROR;
+	}
+
+	if (0 != mutex_init(&(pConnection->ingestLock))) {
+		return GENERIC_ERROR;
+	}
+	memset(pConnection->ingestRoutes, 0, sizeof(pConnection->ingestRoutes));
+	pConnection->isIngestInitialized = true;
+
+	return NONE_ERROR;
+}
+
+/* Writes $aws/rules/<rule>/ and the topic to pBuf, of AWS_IOT_MQTT_INGEST_TOPIC_LEN + 1
+ * bytes, if the topic is on a route. Returns the length written, 0 if the publish goes
+ * to the topic itself */
+static size_t ingestMap(MQTTConnection_t *pConnection, const char *pTopic, size_t topicLen, char *pBuf) {
+	IngestRoute *pRoute = NULL;
+	size_t longest = 0, ruleLen, len = 0;
+	uint32_t i;
+
+	if (!pConnection->isIngestInitialized) {
+		return 0;
+	}
+
+	mutex_lock(&(pConnection->ingestLock), THREADS_WAIT_FOREVER);
+	for (i = 0; i < AWS_IOT_MQTT_INGEST_ROUTES; i++) {
+		IngestRoute *p = &(pConnection->ingestRoutes[i]);
+
+		if (NULL != p->pTopicPrefix && longest <= p->prefixLen && p->prefixLen <= topicLen &&
+				0 == memcmp(pTopic, p->pTopicPrefix, p->prefixLen)) {
+			pRoute = p;
+			longest = p->prefixLen;
+		}
+	}
+
+	if (NULL != pRoute) {
+		ruleLen = strlen(pRoute->pRuleName);
+		if (INGEST_PREFIX_LEN + ruleLen + 1 + topicLen <= AWS_IOT_MQTT_INGEST_TOPIC_LEN) {
+			memcpy(pBuf, INGEST_PREFIX, INGEST_PREFIX_LEN);
+			memcpy(pBuf + INGEST_PREFIX_LEN, pRoute->pRuleName, ruleLen);
+			len = INGEST_PREFIX_LEN + ruleLen;
+			pBuf[len++] = '/';
+			memcpy(pBuf + len, pTopic, topicLen);
+			len += topicLen;
+			pBuf[len] = '\0';
+		}
+	}
+	mutex_unlock(&(pConnection->ingestLock));
+
+	return len;
+}
+
+/* The topic a publish goes to, pBuf holds it if it is a Basic Ingest topic */
+static const char *ingestTopic(MQTTConnection_t *pConnection, const char *pTopic, bool isRetained, char *pBuf) {
+	if (NULL == pTopic || isRetained || 0 == ingestMap(pConnection, pTopic, strlen(pTopic), pBuf)) {
+		return pTopic;
+	}
+	return pBuf;
+}
+
+/* Points the template of a prepared publish on a route at its Basic Ingest topic,
+ * serialized in pBuf of AWS_IOT_MQTT_PREPARED_TOPIC_BUF_LEN(AWS_IOT_MQTT_INGEST_TOPIC_LEN)
+ * bytes. The fixed header byte is kept */
+static void ingestTemplate(MQTTConnection_t *pConnection, MQTTPublishTemplate *pTmpl, unsigned char *pBuf) {
+	size_t len;
+
+	if (pTmpl->header & 0x01) {
+		return;
+	}
+
+	/* The name follows the two length bytes */
+	len = ingestMap(pConnection, (const char *)pTmpl->topic + 2, pTmpl->topicLen, (char *)pBuf + 2);
+	if (0 == len) {
+		return;
+	}
+
+	pBuf[0] = (unsigned char)(len >> 8);
+	pBuf[1] = (unsigned char)(len & 0xff);
+	pTmpl->topicLen = (uint16_t)len;
+	pTmpl->topic = pBuf;
+}
+#endif
+
 #define GETLOWER4BYTES 0x0FFFFFFFF
 void pahoMessageCallback(MessageData* md) {
 	MQTTMessage* message = md->message;
@@ -97,26 +548,422 @@ void pahoMessageCallback(MessageData* md) {
 		params.MessageParams.isRetained = message->retained;
 		params.MessageParams.id = message->id;
 	}
+	params.PayloadOffset = md->payloadOffset;
+	params.TotalPayloadLen = md->totalPayloadLen;
+	params.isLastChunk = (bool)md->isLastChunk;
 
+#if AWS_IOT_MQTT_COMPRESS
+	/* The client is the first member of its connection */
+	expandPayload((MQTTConnection_t *)md->client, &params);
+#endif
+#if AWS_IOT_MQTT_DISPATCH
+	if (MQTT_DISPATCH_INLINE != md->dispatch
+			&& dispatchMessage((iot_message_handler)(md->applicationHandler), &params, md->dispatch,
+					(MQTTConnection_t *)md->client)) {
+		return;
+	}
+#endif
 	((iot_message_handler)(md->applicationHandler))(params);
 }
 
-void pahoDisconnectHandler(void) {
-	if(NULL != clientDisconnectHandler) {
-		clientDisconnectHandler();
+void pahoPublishCompleteCallback(PublishCompleteData *pd) {
+	IoT_Error_t status = NONE_ERROR;
+
+	if (pd->applicationHandler == NULL) {
+		return;
+	}
+
+	if (MQTT_PUBLISH_ACK_TIMEOUT_ERROR == pd->rc) {
+		status = PUBLISH_ACK_TIMEOUT;
+	} else if (MQTT_NETWORK_DISCONNECTED_ERROR == pd->rc) {
+		status = NETWORK_DISCONNECTED;
+	} else if (MQTT_SUCCESS != pd->rc) {
+		status = PUBLISH_ERROR;
 	}
+
+	((iot_publish_complete_handler)(pd->applicationHandler))(pd->packetId, status, pd->pContext);
 }
 
-static bool isPowerCycle = true;
+void pahoDisconnectHandler(Client *pClient) {
+	MQTTConnection_t *pConnection = (MQTTConnection_t *)pClient;
 
-IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
+	if(NULL != pConnection->clientDisconnectHandler) {
+		pConnection->clientDisconnectHandler();
+	}
+}
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+static void rateBucketInit(RateBucket *pBucket, uint32_t rate, uint32_t burst) {
+	pBucket->rate = rate;
+	pBucket->burst = (0 == burst) ? 1 : burst;
+	pBucket->milliTokens = pBucket->burst * 1000;
+	pBucket->refillTick = os_ticks_get();
+}
+
+static void rateBucketRefill(RateBucket *pBucket, unsigned long now) {
+	uint32_t full = pBucket->burst * 1000;
+	uint32_t ms;
+
+	if (0 == pBucket->rate || full <= pBucket->milliTokens) {
+		pBucket->refillTick = now;
+		return;
+	}
+
+	ms = os_ticks_to_msec(now - pBucket->refillTick);
+	if (full / pBucket->rate <= ms) {
+		pBucket->milliTokens = full;
+		pBucket->refillTick = now;
+		return;
+	}
+
+	pBucket->milliTokens += ms * pBucket->rate;
+	if (full < pBucket->milliTokens) {
+		pBucket->milliTokens = full;
+	}
+	pBucket->refillTick += os_msec_to_ticks(ms);
+}
+
+/* Milliseconds until the bucket has a token, 0 if it has one */
+static uint32_t rateBucketWait(RateBucket *pBucket) {
+	if (0 == pBucket->rate || 1000 <= pBucket->milliTokens) {
+		return 0;
+	}
+	return (1000 - pBucket->milliTokens + pBucket->rate - 1) / pBucket->rate;
+}
+
+static void rateBucketTake(RateBucket *pBucket) {
+	if (0 != pBucket->rate) {
+		pBucket->milliTokens -= 1000;
+	}
+}
+
+static IoT_Error_t rateInit(MQTTConnection_t *pConnection) {
+	if (pConnection->isRateInitialized) {
+		return NONE_ERROR;
+	}
+
+	if (0 != mutex_init(&(pConnection->rateLock))) {
+		return GENERIC_ERROR;
+	}
+	rateBucketInit(&(pConnection->rateBucket), AWS_IOT_MQTT_PUBLISH_RATE, AWS_IOT_MQTT_PUBLISH_BURST);
+	memset(pConnection->rateClasses, 0, sizeof(pConnection->rateClasses));
+	memset(pConnection->rateHeld, 0, sizeof(pConnection->rateHeld));
+	memset(&(pConnection->rateStats), 0, sizeof(pConnection->rateStats));
+	pConnection->isRateInitialized = true;
+
+	return NONE_ERROR;
+}
+
+/* The class with the longest prefix of the topic */
+static uint8_t rateClassOf(MQTTConnection_t *pConnection, const char *pTopic) {
+	uint8_t rateClass = RATE_CLASS_NONE;
+	size_t longest = 0;
+	uint32_t i;
+
+	for (i = 0; i < AWS_IOT_MQTT_RATE_CLASSES; i++) {
+		RateClass *pClass = &(pConnection->rateClasses[i]);
+
+		if (NULL != pClass->pTopicPrefix && longest <= pClass->prefixLen &&
+				0 == strncmp(pTopic, pClass->pTopicPrefix, pClass->prefixLen)) {
+			rateClass = (uint8_t) i;
+			longest = pClass->prefixLen;
+		}
+	}
+
+	return rateClass;
+}
+
+/* Takes a token of the connection and one of the class, with the lock held.
+ * Returns 0 once they are taken, else the milliseconds until both are there */
+static uint32_t rateTake(MQTTConnection_t *pConnection, uint8_t rateClass) {
+	RateBucket *pClassBucket = NULL;
+	unsigned long now = os_ticks_get();
+	uint32_t wait, classWait;
+
+	rateBucketRefill(&(pConnection->rateBucket), now);
+	wait = rateBucketWait(&(pConnection->rateBucket));
+	if (RATE_CLASS_NONE != rateClass) {
+		pClassBucket = &(pConnection->rateClasses[rateClass].bucket);
+		rateBucketRefill(pClassBucket, now);
+		classWait = rateBucketWait(pClassBucket);
+		if (wait < classWait) {
+			wait = classWait;
+		}
+	}
+
+	if (0 == wait) {
+		rateBucketTake(&(pConnection->rateBucket));
+		if (NULL != pClassBucket) {
+			rateBucketTake(pClassBucket);
+		}
+	}
+
+	return wait;
+}
+
+static RateHeld *rateFindHeld(MQTTConnection_t *pConnection, const char *pTopic, size_t topicLen) {
+	uint32_t i;
+
+	for (i = 0; i < AWS_IOT_MQTT_RATE_HOLD_SLOTS; i++) {
+		RateHeld *pHeld = &(pConnection->rateHeld[i]);
+
+		if (RATE_HOLD_WAITING == pHeld->state && topicLen == pHeld->topicLen &&
+				0 == memcmp(pHeld->data, pTopic, topicLen)) {
+			return pHeld;
+		}
+	}
+
+	return NULL;
+}
+
+static RateHeld *rateFreeHeld(MQTTConnection_t *pConnection) {
+	uint32_t i;
+
+	for (i = 0; i < AWS_IOT_MQTT_RATE_HOLD_SLOTS; i++) {
+		if (RATE_HOLD_FREE == pConnection->rateHeld[i].state) {
+			return &(pConnection->rateHeld[i]);
+		}
+	}
+
+	return NULL;
+}
+
+static void rateFillHeld(RateHeld *pHeld, MQTTPublishParams *pParams, size_t topicLen, uint8_t rateClass) {
+	pHeld->state = RATE_HOLD_WAITING;
+	pHeld->rateClass = rateClass;
+	pHeld->isRetained = pParams->MessageParams.isRetained;
+	pHeld->topicLen = (uint16_t) topicLen;
+	pHeld->payloadLen = (uint16_t) pParams->MessageParams.PayloadLen;
+	memcpy(pHeld->data, pParams->pTopic, topicLen + 1);
+	memcpy(pHeld->data + topicLen + 1, pParams->MessageParams.pPayload, pHeld->payloadLen);
+}
+
+/* Waits in the calling thread for the tokens of a publish that is not held
+ * back, for at most the command timeout */
+static IoT_Error_t rateWait(MQTTConnection_t *pConnection, uint8_t rateClass, uint32_t wait) {
+	Timer timer;
+	int left;
+
+	InitTimer(&timer);
+	countdown_ms(&timer, pConnection->c.commandTimeoutMs);
+	for (;;) {
+		left = left_ms(&timer);
+		if (left < 0 || (uint32_t) left < wait) {
+			mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+			pConnection->rateStats.dropped++;
+			mutex_unlock(&(pConnection->rateLock));
+			return PUBLISH_RATE_LIMITED;
+		}
+		os_thread_sleep(os_msec_to_ticks(wait));
+
+		mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+		wait = rateTake(pConnection, rateClass);
+		if (0 == wait) {
+			pConnection->rateStats.delayed++;
+		}
+		mutex_unlock(&(pConnection->rateLock));
+		if (0 == wait) {
+			return NONE_ERROR;
+		}
+	}
+}
+
+/* Takes the tokens of a publish. A QoS0 publish that finds none is held
+ * back, as is one on the topic of a held publish, so that the newer value
+ * does not go out first. Others wait. *pHeld tells if the caller is done */
+static IoT_Error_t ratePace(MQTTConnection_t *pConnection, MQTTPublishParams *pParams, bool canHold,
+		bool *pHeld) {
+	IoT_Error_t rc = NONE_ERROR;
+	RateHeld *pSlot;
+	uint8_t rateClass;
+	size_t topicLen = 0;
+	uint32_t wait;
+
+	*pHeld = false;
+	if (!pConnection->isRateInitialized || NULL == pParams->pTopic) {
+		return NONE_ERROR;
+	}
+
+	if (canHold && QOS_0 == pParams->MessageParams.qos) {
+		topicLen = strlen(pParams->pTopic);
+		if (AWS_IOT_MQTT_RATE_HOLD_LEN < topicLen + 1 + pParams->MessageParams.PayloadLen) {
+			canHold = false;
+		}
+	} else {
+		canHold = false;
+	}
+
+	rateClass = rateClassOf(pConnection, pParams->pTopic);
+
+	mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+	pSlot = canHold ? rateFindHeld(pConnection, pParams->pTopic, topicLen) : NULL;
+	if (NULL != pSlot) {
+		rateFillHeld(pSlot, pParams, topicLen, rateClass);
+		pConnection->rateStats.merged++;
+		*pHeld = true;
+		wait = 0;
+	} else {
+		wait = rateTake(pConnection, rateClass);
+		if (0 != wait && canHold) {
+			pSlot = rateFreeHeld(pConnection);
+			if (NULL != pSlot) {
+				rateFillHeld(pSlot, pParams, topicLen, rateClass);
+				pConnection->rateStats.delayed++;
+				*pHeld = true;
+			} else {
+				pConnection->rateStats.dropped++;
+				rc = PUBLISH_RATE_LIMITED;
+			}
+		}
+	}
+	mutex_unlock(&(pConnection->rateLock));
+
+	if (*pHeld) {
+		/* A thread waiting in the yield has to shorten its wait */
+		MQTTWakeup(&(pConnection->c));
+		return NONE_ERROR;
+	}
+	if (0 == wait || canHold) {
+		return rc;
+	}
+
+	return rateWait(pConnection, rateClass, wait);
+}
+
+/* Sends the held publishes whose tokens are there. Returns the milliseconds
+ * until the next one can go, UINT32_MAX if none is held */
+static uint32_t rateSendHeld(MQTTConnection_t *pConnection) {
+	MQTTMessage message;
+	const char *pTopic;
+	uint32_t i, wait, next = UINT32_MAX;
+#if AWS_IOT_MQTT_INGEST
+	char ingestBuf[AWS_IOT_MQTT_INGEST_TOPIC_LEN + 1];
+#endif
+
+	if (!pConnection->isRateInitialized || !MQTTIsConnected(&(pConnection->c))) {
+		return UINT32_MAX;
+	}
+
+	for (i = 0; i < AWS_IOT_MQTT_RATE_HOLD_SLOTS; i++) {
+		RateHeld *pHeld = &(pConnection->rateHeld[i]);
+
+		mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+		wait = UINT32_MAX;
+		if (RATE_HOLD_WAITING == pHeld->state) {
+			wait = rateTake(pConnection, pHeld->rateClass);
+			if (0 == wait) {
+				pHeld->state = RATE_HOLD_SENDING;
+			}
+		}
+		mutex_unlock(&(pConnection->rateLock));
+
+		if (0 != wait) {
+			if (wait < next) {
+				next = wait;
+			}
+			continue;
+		}
+
+		/* The slot is not merged into or taken while it is sent */
+		message.dup = 0;
+		message.id = 0;
+		message.qos = QOS0;
+		message.retained = pHeld->isRetained;
+		message.payload = pHeld->data + pHeld->topicLen + 1;
+		message.payloadlen = pHeld->payloadLen;
+		pTopic = pHeld->data;
+#if AWS_IOT_MQTT_INGEST
+		pTopic = ingestTopic(pConnection, pTopic, pHeld->isRetained, ingestBuf);
+#endif
+		if (0 != MQTTPublish(&(pConnection->c), pTopic, &message)) {
+			mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+			pConnection->rateStats.dropped++;
+			mutex_unlock(&(pConnection->rateLock));
+		}
+		pHeld->state = RATE_HOLD_FREE;
+	}
+
+	return next;
+}
+#endif
+
+/* Sends the held publishes that are due and shortens the yield to when the
+ * next one is */
+static int rateYieldTimeout(MQTTConnection_t *pConnection, int timeout) {
+#if AWS_IOT_MQTT_RATE_LIMIT
+	uint32_t next = rateSendHeld(pConnection);
+
+	if (UINT32_MAX != next && next < (uint32_t) timeout) {
+		timeout = (int) next;
+	}
+#endif
+	return timeout;
+}
+
+MQTTConnection_t *aws_iot_mqtt_connection_alloc(void) {
+	MQTTConnection_t *pConnection = NULL;
+	unsigned long state;
+	uint32_t i;
+
+	state = os_enter_critical_section();
+	for(i = 1; i < AWS_IOT_MQTT_MAX_CONNECTIONS; i++) {
+		if(!connections[i].isAllocated) {
+			connections[i].isAllocated = true;
+			connections[i].isClientInitialized = false;
+			connections[i].clientDisconnectHandler = NULL;
+			pConnection = &connections[i];
+			break;
+		}
+	}
+	os_exit_critical_section(state);
+
+	return pConnection;
+}
+
+void aws_iot_mqtt_connection_free(MQTTConnection_t *pConnection) {
+	if(NULL == pConnection || DEFAULT_CONNECTION == pConnection) {
+		return;
+	}
+
+	pConnection->isAllocated = false;
+}
+
+#if AWS_IOT_RUNTIME_CONFIG
+/* Kept by the slot of the connection for the connections after this one */
+static IoT_Error_t allocBuffers(MQTTConnection_t *pConnection) {
+	const AwsIotRuntimeConfig *pConfig = aws_iot_runtime_config();
+
+#if !AWS_IOT_MQTT_LOW_MEMORY
+	if(NULL == pConnection->writebuf) {
+		pConnection->writebuf = aws_iot_runtime_alloc(pConfig->mqttTxBufLen);
+		if(NULL == pConnection->writebuf) {
+			return GENERIC_ERROR;
+		}
+		pConnection->writebufLen = pConfig->mqttTxBufLen;
+	}
+#endif
+	if(NULL == pConnection->readbuf) {
+		pConnection->readbuf = aws_iot_runtime_alloc(pConfig->mqttRxBufLen);
+		if(NULL == pConnection->readbuf) {
+			return GENERIC_ERROR;
+		}
+		pConnection->readbufLen = pConfig->mqttRxBufLen;
+	}
+
+	return NONE_ERROR;
+}
+#endif
+
+IoT_Error_t aws_iot_mqtt_connect_ex(MQTTConnection_t *pConnection, MQTTConnectParams *pParams) {
 	IoT_Error_t rc = NONE_ERROR;
 	MQTTReturnCode pahoRc = MQTT_SUCCESS;
 
-	if(NULL == pParams || NULL == pParams->pClientID || NULL == pParams->pHostURL) {
+	if(NULL == pConnection || NULL == pParams || NULL == pParams->pClientID || NULL == pParams->pHostURL) {
 		return NULL_VALUE_ERROR;
 	}
 
+	Client *pClient = &(pConnection->c);
+
 	TLSConnectParams TLSParams;
 	TLSParams.DestinationPort = pParams->port;
 	TLSParams.pDestinationURL = pParams->pHostURL;
@@ -125,19 +972,50 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 	TLSParams.pRootCALocation = pParams->pRootCALocation;
 	TLSParams.timeout_ms = pParams->tlsHandshakeTimeout_ms;
 	TLSParams.ServerVerificationFlag = pParams->isSSLHostnameVerify;
+	TLSParams.trafficClass = (NetworkTrafficClass)pParams->trafficClass;
 
 	// This implementation assumes you are not going to switch between cleansession 1 to 0
 	// As we don't have a default subscription handler support in the MQTT client every time a device power cycles it has to re-subscribe to let the MQTT client to pass the message up to the application callback.
 	// The default message handler will be implemented in the future revisions.
-	if(pParams->isCleansession || isPowerCycle){
-		pahoRc = MQTTClient(&c, (unsigned int)(pParams->mqttCommandTimeout_ms), writebuf,
-				   AWS_IOT_MQTT_TX_BUF_LEN, readbuf, AWS_IOT_MQTT_RX_BUF_LEN,
+	if(pParams->isCleansession || !pConnection->isClientInitialized){
+#if AWS_IOT_RUNTIME_CONFIG
+		if(NONE_ERROR != allocBuffers(pConnection)) {
+			return CONNECTION_ERROR;
+		}
+#endif
+#if MQTT_RX_SPARES
+		rxSparesInit(pConnection);
+#endif
+		pahoRc = MQTTClient(pClient, (unsigned int)(pParams->mqttCommandTimeout_ms), MQTT_TX_BUF(pConnection),
+				   MQTT_TX_BUF_LEN(pConnection), MQTT_RX_BUF(pConnection), MQTT_RX_BUF_LEN(pConnection),
+				   pConnection->messageHandlers, AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS,
+				   pConnection->topicTrieNodes, AWS_IOT_MQTT_NUM_TOPIC_TRIE_NODES,
 				   pParams->enableAutoReconnect, iot_tls_init, &TLSParams);
 		if(MQTT_SUCCESS != pahoRc) {
 			return CONNECTION_ERROR;
 		}
-		isPowerCycle = false;
+		pConnection->isClientInitialized = true;
+	}
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	if(NONE_ERROR != rateInit(pConnection)) {
+		return CONNECTION_ERROR;
+	}
+#endif
+#if AWS_IOT_MQTT_COMPRESS
+	if(!pConnection->isCompressInitialized) {
+		if(0 != mutex_init(&(pConnection->compressLock))) {
+			return CONNECTION_ERROR;
+		}
+		memset(&(pConnection->compressStats), 0, sizeof(pConnection->compressStats));
+		pConnection->isCompressInitialized = true;
 	}
+#endif
+#if AWS_IOT_MQTT_INGEST
+	if(NONE_ERROR != ingestInit(pConnection)) {
+		return CONNECTION_ERROR;
+	}
+#endif
 
 	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
 
@@ -150,13 +1028,20 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 	case MQTT_3_1_1:
 		data.MQTTVersion = (unsigned char) (4);
 		break;
+	case MQTT_5:
+		data.MQTTVersion = (unsigned char) (5);
+		break;
 	default:
 		data.MQTTVersion = (unsigned char) (4); // default MQTT version = 3.1.1
 	}
 
+	setKeepAlivePolicy(pClient, pParams->isPingFixedInterval ? KEEPALIVE_FIXED_INTERVAL : KEEPALIVE_ON_IDLE);
+	// also when the client was not initialized again above
+	setTrafficClass(pClient, (NetworkTrafficClass)pParams->trafficClass);
+
 	// register our disconnect handler, save customer's handler
-	setDisconnectHandler(&c, pahoDisconnectHandler);
-	clientDisconnectHandler = pParams->disconnectHandler;
+	setDisconnectHandler(pClient, pahoDisconnectHandler);
+	pConnection->clientDisconnectHandler = pParams->disconnectHandler;
 
 	data.clientID.cstring = pParams->pClientID;
 	data.username.cstring = pParams->pUserName;
@@ -168,7 +1053,7 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 	data.keepAliveInterval = pParams->KeepAliveInterval_sec;
 	data.cleansession = pParams->isCleansession;
 
-	pahoRc = MQTTConnect(&c, &data);
+	pahoRc = MQTTConnect(pClient, &data);
 	if(MQTT_NETWORK_ALREADY_CONNECTED_ERROR == pahoRc) {
 		rc = NETWORK_ALREADY_CONNECTED;
 	} else if(MQTT_SUCCESS != pahoRc) {
@@ -178,54 +1063,382 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 	return rc;
 }
 
-IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams) {
-	IoT_Error_t rc = NONE_ERROR;
-
-	if (0 != MQTTSubscribe(&c, pParams->pTopic, (enum QoS)pParams->qos, pahoMessageCallback, (void (*)(void))(pParams->mHandler))) {
-			rc = SUBSCRIBE_ERROR;
+/* Dispatch of a subscription, the lanes are started for the first one that uses them */
+static IoT_Error_t subscriptionDispatch(const MQTTSubscribeParams *pParams, uint8_t *pDispatch) {
+	*pDispatch = MQTT_DISPATCH_INLINE;
+	if (pParams->isStreaming || MQTT_DISPATCH_INLINE == pParams->dispatch) {
+		return NONE_ERROR;
 	}
-	return rc;
+#if AWS_IOT_MQTT_DISPATCH
+	if (MQTT_DISPATCH_LOW < pParams->dispatch || WM_SUCCESS != work_svc_init()) {
+		return SUBSCRIBE_ERROR;
+	}
+	*pDispatch = (uint8_t)pParams->dispatch;
+#endif
+	return NONE_ERROR;
 }
 
-IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams) {
-	IoT_Error_t rc = NONE_ERROR;
+IoT_Error_t aws_iot_mqtt_subscribe_ex(MQTTConnection_t *pConnection, MQTTSubscribeParams *pParams) {
+	MQTTSubscription subscription;
 
-	MQTTMessage Message;
-	Message.dup = pParams->MessageParams.isDuplicate;
-	Message.id = pParams->MessageParams.id;
-	Message.payload = pParams->MessageParams.pPayload;
-	Message.payloadlen = pParams->MessageParams.PayloadLen;
-	Message.qos = (enum QoS)pParams->MessageParams.qos;
-	Message.retained = pParams->MessageParams.isRetained;
+	if (NULL == pConnection || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
 
-	if(0 != MQTTPublish(&c, pParams->pTopic, &Message)){
-		rc = PUBLISH_ERROR;
+	subscription.topicFilter = pParams->pTopic;
+	subscription.qos = (enum QoS)pParams->qos;
+	subscription.applicationHandler = (void (*)(void))(pParams->mHandler);
+	subscription.isStreaming = pParams->isStreaming ? 1 : 0;
+	subscription.isLocal = pParams->isLocal ? 1 : 0;
+	if (NONE_ERROR != subscriptionDispatch(pParams, &subscription.dispatch)) {
+		return SUBSCRIBE_ERROR;
 	}
 
-	return rc;
+	if (subscription.isLocal) {
+		if (0 != MQTTSubscribeLocal(&(pConnection->c), &subscription, pahoMessageCallback)) {
+			return SUBSCRIBE_ERROR;
+		}
+	} else if (0 != MQTTSubscribeMany(&(pConnection->c), &subscription, 1, pahoMessageCallback)) {
+		return SUBSCRIBE_ERROR;
+	}
+	return NONE_ERROR;
 }
 
-IoT_Error_t aws_iot_mqtt_unsubscribe(char *pTopic) {
+IoT_Error_t aws_iot_mqtt_subscribe_many_ex(MQTTConnection_t *pConnection, MQTTSubscribeParams *pParams,
+		uint32_t count) {
+	MQTTSubscription subscriptions[AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS];
+	uint32_t i;
+	uint32_t remote = 0;
+	uint32_t local = count;
+
+	if (NULL == pConnection || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (0 == count || AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS < count) {
+		return SUBSCRIBE_ERROR;
+	}
+
+	/* The broker subscriptions from the front, the local ones from the back */
+	for (i = 0; i < count; i++) {
+		MQTTSubscription *pSub = pParams[i].isLocal ? &subscriptions[--local] : &subscriptions[remote++];
+
+		pSub->topicFilter = pParams[i].pTopic;
+		pSub->qos = (enum QoS)pParams[i].qos;
+		pSub->applicationHandler = (void (*)(void))(pParams[i].mHandler);
+		pSub->isStreaming = pParams[i].isStreaming ? 1 : 0;
+		pSub->isLocal = pParams[i].isLocal ? 1 : 0;
+		if (NONE_ERROR != subscriptionDispatch(&pParams[i], &pSub->dispatch)) {
+			return SUBSCRIBE_ERROR;
+		}
+	}
+
+	if (0 < remote && 0 != MQTTSubscribeMany(&(pConnection->c), subscriptions, remote, pahoMessageCallback)) {
+		return SUBSCRIBE_ERROR;
+	}
+	for (i = local; i < count; i++) {
+		if (0 != MQTTSubscribeLocal(&(pConnection->c), &subscriptions[i], pahoMessageCallback)) {
+			return SUBSCRIBE_ERROR;
+		}
+	}
+	return NONE_ERROR;
+}
+
+/* Hand a publish to the subscriptions of the device, see MQTTLocalDelivery */
+static IoT_Error_t publishLocal(MQTTConnection_t *pConnection, MQTTPublishParams *pParams) {
+	MQTTMessage Message;
+
+	if (NULL == pConnection || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+	Message.dup = 0;
+	Message.id = 0;
+	Message.payload = pParams->MessageParams.pPayload;
+	Message.payloadlen = pParams->MessageParams.PayloadLen;
+	Message.qos = (enum QoS)pParams->MessageParams.qos;
+	Message.retained = pParams->MessageParams.isRetained;
+
+	/* No subscription on the topic is as good as delivered */
+	if (MQTT_NULL_VALUE_ERROR == MQTTPublishLocal(&(pConnection->c), pParams->pTopic, &Message)) {
+		return NULL_VALUE_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static IoT_Error_t publishEx(MQTTConnection_t *pConnection, MQTTPublishParams *pParams) {
+	IoT_Error_t rc = NONE_ERROR;
+	const char *pTopic;
+#if AWS_IOT_MQTT_INGEST
+	char ingestBuf[AWS_IOT_MQTT_INGEST_TOPIC_LEN + 1];
+#endif
+
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	bool isHeld;
+
+	rc = ratePace(pConnection, pParams, true, &isHeld);
+	if (NONE_ERROR != rc || isHeld) {
+		return rc;
+	}
+#endif
+
+	MQTTMessage Message;
+	Message.dup = pParams->MessageParams.isDuplicate;
+	Message.id = pParams->MessageParams.id;
+	Message.payload = pParams->MessageParams.pPayload;
+	Message.payloadlen = pParams->MessageParams.PayloadLen;
+	Message.qos = (enum QoS)pParams->MessageParams.qos;
+	Message.retained = pParams->MessageParams.isRetained;
+
+	pTopic = pParams->pTopic;
+#if AWS_IOT_MQTT_INGEST
+	pTopic = ingestTopic(pConnection, pTopic, pParams->MessageParams.isRetained, ingestBuf);
+#endif
+	if(0 != MQTTPublish(&(pConnection->c), pTopic, &Message)){
+		rc = PUBLISH_ERROR;
+	}
+
+	return rc;
+}
+
+static IoT_Error_t publishAsyncEx(MQTTConnection_t *pConnection, MQTTPublishParams *pParams,
+		iot_publish_complete_handler handler, void *pContext) {
+	IoT_Error_t rc = NONE_ERROR;
+	MQTTReturnCode pahoRc;
+	const char *pTopic;
+#if AWS_IOT_MQTT_INGEST
+	char ingestBuf[AWS_IOT_MQTT_INGEST_TOPIC_LEN + 1];
+#endif
+
+	if (NULL == pConnection || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	bool isHeld;
+
+	rc = ratePace(pConnection, pParams, false, &isHeld);
+	if (NONE_ERROR != rc) {
+		return rc;
+	}
+#endif
+
+	MQTTMessage Message;
+	Message.dup = pParams->MessageParams.isDuplicate;
+	Message.id = pParams->MessageParams.id;
+	Message.payload = pParams->MessageParams.pPayload;
+	Message.payloadlen = pParams->MessageParams.PayloadLen;
+	Message.qos = (enum QoS)pParams->MessageParams.qos;
+	Message.retained = pParams->MessageParams.isRetained;
+
+	pTopic = pParams->pTopic;
+#if AWS_IOT_MQTT_INGEST
+	pTopic = ingestTopic(pConnection, pTopic, pParams->MessageParams.isRetained, ingestBuf);
+#endif
+	pahoRc = MQTTPublishAsync(&(pConnection->c), pTopic, &Message, pahoPublishCompleteCallback,
+			(void (*)(void))handler, pContext);
+	if (MQTT_MAX_INFLIGHT_PUBLISH_REACHED_ERROR == pahoRc) {
+		rc = PUBLISH_INFLIGHT_WINDOW_FULL;
+	} else if (MQTT_NULL_VALUE_ERROR == pahoRc) {
+		rc = NULL_VALUE_ERROR;
+	} else if (MQTT_NETWORK_DISCONNECTED_ERROR == pahoRc) {
+		rc = NETWORK_DISCONNECTED;
+	} else if (MQTT_SUCCESS != pahoRc) {
+		rc = PUBLISH_ERROR;
+	}
+
+	pParams->MessageParams.id = Message.id;
+
+	return rc;
+}
+
+IoT_Error_t aws_iot_mqtt_publish_ex(MQTTConnection_t *pConnection, MQTTPublishParams *pParams) {
+	if (NULL != pParams && MQTT_LOCAL_NONE != pParams->local) {
+		IoT_Error_t localRc = publishLocal(pConnection, pParams);
+
+		if (NONE_ERROR != localRc || MQTT_LOCAL_ONLY == pParams->local) {
+			return localRc;
+		}
+	}
+#if AWS_IOT_MQTT_COMPRESS
+	MQTTPublishParams compressed;
+	IoT_Error_t rc;
+
+	if (NULL != pConnection && NULL != pParams) {
+		compressed = *pParams;
+		if (compressPayload(pConnection, &(compressed.MessageParams))) {
+			rc = publishEx(pConnection, &compressed);
+			mutex_unlock(&(pConnection->compressLock));
+			return rc;
+		}
+	}
+#endif
+	return publishEx(pConnection, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_publish_async_ex(MQTTConnection_t *pConnection, MQTTPublishParams *pParams,
+		iot_publish_complete_handler handler, void *pContext) {
+	if (NULL != pParams && MQTT_LOCAL_NONE != pParams->local) {
+		IoT_Error_t localRc = publishLocal(pConnection, pParams);
+
+		if (NONE_ERROR != localRc || MQTT_LOCAL_ONLY == pParams->local) {
+			/* Delivered already, a QoS 1 or 2 publish completes like an acked one */
+			pParams->MessageParams.id = 0;
+			if (NONE_ERROR == localRc && NULL != handler && QOS_0 != pParams->MessageParams.qos) {
+				handler(0, NONE_ERROR, pContext);
+			}
+			return localRc;
+		}
+	}
+#if AWS_IOT_MQTT_COMPRESS
+	MQTTPublishParams compressed;
+	IoT_Error_t rc;
+
+	if (NULL != pConnection && NULL != pParams) {
+		compressed = *pParams;
+		if (compressPayload(pConnection, &(compressed.MessageParams))) {
+			/* The payload is sent by the time the call returns */
+			rc = publishAsyncEx(pConnection, &compressed, handler, pContext);
+			mutex_unlock(&(pConnection->compressLock));
+			pParams->MessageParams.id = compressed.MessageParams.id;
+			return rc;
+		}
+	}
+#endif
+	return publishAsyncEx(pConnection, pParams, handler, pContext);
+}
+
+IoT_Error_t aws_iot_mqtt_prepare_publish(MQTTPreparedPublish *pPrepared, unsigned char *pBuf, size_t bufLen,
+		const char *pTopic, QoSLevel qos, bool isRetained) {
+	MQTTPublishTemplate tmpl;
+	MQTTString topic = MQTTString_initializer;
+
+	if (NULL == pPrepared || NULL == pBuf || NULL == pTopic) {
+		return NULL_VALUE_ERROR;
+	}
+
+	topic.cstring = (char *)pTopic;
+	if (MQTT_SUCCESS != MQTTSerialize_publishTemplate(pBuf, bufLen, (QoS)qos, isRetained, topic, &tmpl)) {
+		return GENERIC_ERROR;
+	}
+
+	pPrepared->header = tmpl.header;
+	pPrepared->topicLen = tmpl.topicLen;
+	pPrepared->pTopicBytes = tmpl.topic;
+
+	return NONE_ERROR;
+}
+
+static IoT_Error_t publishPreparedEx(MQTTConnection_t *pConnection, const MQTTPreparedPublish *pPrepared,
+		MQTTMessageParams *pParams) {
+	IoT_Error_t rc = NONE_ERROR;
+	MQTTPublishTemplate tmpl;
+
+	if (NULL == pConnection || NULL == pPrepared || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pParams->qos = (QoSLevel)((pPrepared->header >> 1) & 0x03);
+	pParams->isRetained = pPrepared->header & 0x01;
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	MQTTPublishParams publishParams;
+	bool isHeld;
+
+	/* The name follows the two length bytes, NUL terminated */
+	publishParams.pTopic = (char *)pPrepared->pTopicBytes + 2;
+	publishParams.MessageParams = *pParams;
+	rc = ratePace(pConnection, &publishParams, true, &isHeld);
+	if (NONE_ERROR != rc || isHeld) {
+		return rc;
+	}
+#endif
+
+	tmpl.header = pPrepared->header;
+	tmpl.topicLen = pPrepared->topicLen;
+	tmpl.topic = pPrepared->pTopicBytes;
+#if AWS_IOT_MQTT_INGEST
+	unsigned char ingestBuf[AWS_IOT_MQTT_PREPARED_TOPIC_BUF_LEN(AWS_IOT_MQTT_INGEST_TOPIC_LEN)];
+
+	ingestTemplate(pConnection, &tmpl, ingestBuf);
+#endif
+
+	MQTTMessage Message;
+	Message.dup = pParams->isDuplicate;
+	Message.id = pParams->id;
+	Message.payload = pParams->pPayload;
+	Message.payloadlen = pParams->PayloadLen;
+
+	if(0 != MQTTPublishTemplated(&(pConnection->c), &tmpl, &Message)){
+		rc = PUBLISH_ERROR;
+	}
+
+	return rc;
+}
+
+IoT_Error_t aws_iot_mqtt_publish_prepared_ex(MQTTConnection_t *pConnection, const MQTTPreparedPublish *pPrepared,
+		MQTTMessageParams *pParams) {
+#if AWS_IOT_MQTT_COMPRESS
+	MQTTMessageParams compressed;
+	IoT_Error_t rc;
+
+	if (NULL != pConnection && NULL != pPrepared && NULL != pParams) {
+		compressed = *pParams;
+		if (compressPayload(pConnection, &compressed)) {
+			rc = publishPreparedEx(pConnection, pPrepared, &compressed);
+			mutex_unlock(&(pConnection->compressLock));
+			pParams->qos = compressed.qos;
+			pParams->isRetained = compressed.isRetained;
+			return rc;
+		}
+	}
+#endif
+	return publishPreparedEx(pConnection, pPrepared, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_unsubscribe_ex(MQTTConnection_t *pConnection, char *pTopic) {
 	IoT_Error_t rc = NONE_ERROR;
 
-	if(0 != MQTTUnsubscribe(&c, pTopic)){
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if(0 != MQTTUnsubscribe(&(pConnection->c), pTopic)){
 		rc = UNSUBSCRIBE_ERROR;
 	}
 	return rc;
 }
 
-IoT_Error_t aws_iot_mqtt_disconnect() {
+IoT_Error_t aws_iot_mqtt_unsubscribe_many_ex(MQTTConnection_t *pConnection, char **pTopics, uint32_t count) {
+	if (NULL == pConnection || NULL == pTopics) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (0 != MQTTUnsubscribeMany(&(pConnection->c), (const char **)pTopics, count)) {
+		return UNSUBSCRIBE_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_disconnect_ex(MQTTConnection_t *pConnection) {
 	IoT_Error_t rc = NONE_ERROR;
 
-	if(0 != MQTTDisconnect(&c)){
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if(0 != MQTTDisconnect(&(pConnection->c))){
 		rc = DISCONNECT_ERROR;
 	}
 
 	return rc;
 }
 
-IoT_Error_t aws_iot_mqtt_yield(int timeout) {
-	MQTTReturnCode pahoRc = MQTTYield(&c, timeout);
+static IoT_Error_t parseYieldReturnCode(MQTTReturnCode pahoRc) {
 	IoT_Error_t rc = NONE_ERROR;
 	if(MQTT_NETWORK_RECONNECTED == pahoRc){
 		rc = RECONNECT_SUCCESSFUL;
@@ -250,8 +1463,94 @@ IoT_Error_t aws_iot_mqtt_yield(int timeout) {
 	return rc;
 }
 
-IoT_Error_t aws_iot_mqtt_attempt_reconnect() {
-	MQTTReturnCode pahoRc = MQTTAttemptReconnect(&c);
+IoT_Error_t aws_iot_mqtt_yield_ex(MQTTConnection_t *pConnection, int timeout) {
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	timeout = rateYieldTimeout(pConnection, timeout);
+
+	return parseYieldReturnCode(MQTTYield(&(pConnection->c), timeout));
+}
+
+IoT_Error_t aws_iot_mqtt_yield_until_event_ex(MQTTConnection_t *pConnection, int timeout) {
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	timeout = rateYieldTimeout(pConnection, timeout);
+
+	return parseYieldReturnCode(MQTTYieldUntilEvent(&(pConnection->c), timeout));
+}
+
+void aws_iot_mqtt_wakeup_ex(MQTTConnection_t *pConnection) {
+	if (NULL == pConnection) {
+		return;
+	}
+
+	MQTTWakeup(&(pConnection->c));
+}
+
+void aws_iot_mqtt_batch_begin_ex(MQTTConnection_t *pConnection) {
+	if (NULL == pConnection) {
+		return;
+	}
+
+	MQTTBatchBegin(&(pConnection->c));
+}
+
+IoT_Error_t aws_iot_mqtt_batch_end_ex(MQTTConnection_t *pConnection) {
+	MQTTReturnCode pahoRc;
+
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pahoRc = MQTTBatchEnd(&(pConnection->c));
+	if (MQTT_NULL_VALUE_ERROR == pahoRc) {
+		return NULL_VALUE_ERROR;
+	} else if (MQTT_SUCCESS != pahoRc) {
+		return SSL_WRITE_ERROR;
+	}
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_keepalive_early_ex(MQTTConnection_t *pConnection, uint32_t withinMs) {
+	MQTTReturnCode pahoRc;
+
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pahoRc = MQTTKeepaliveEarly(&(pConnection->c), withinMs);
+	if (MQTT_SUCCESS == pahoRc) {
+		return NONE_ERROR;
+	} else if (MQTT_NETWORK_DISCONNECTED_ERROR == pahoRc) {
+		return NETWORK_DISCONNECTED;
+	}
+
+	return SSL_WRITE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_set_traffic_class_ex(MQTTConnection_t *pConnection, TrafficClass trafficClass) {
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (MQTT_SUCCESS != setTrafficClass(&(pConnection->c), (NetworkTrafficClass)trafficClass)) {
+		return GENERIC_ERROR;
+	}
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_attempt_reconnect_ex(MQTTConnection_t *pConnection) {
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	MQTTReturnCode pahoRc = MQTTAttemptReconnect(&(pConnection->c));
 	IoT_Error_t rc = RECONNECT_SUCCESSFUL;
 	if(MQTT_NETWORK_RECONNECTED == pahoRc){
 		rc = RECONNECT_SUCCESSFUL;
@@ -270,8 +1569,12 @@ IoT_Error_t aws_iot_mqtt_attempt_reconnect() {
 	return rc;
 }
 
-IoT_Error_t aws_iot_mqtt_autoreconnect_set_status(bool value) {
-	MQTTReturnCode rc = setAutoReconnectEnabled(&c, (uint8_t) value);
+IoT_Error_t aws_iot_mqtt_autoreconnect_set_status_ex(MQTTConnection_t *pConnection, bool value) {
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	MQTTReturnCode rc = setAutoReconnectEnabled(&(pConnection->c), (uint8_t) value);
 
 	if(MQTT_NULL_VALUE_ERROR == rc) {
 		return NULL_VALUE_ERROR;
@@ -280,12 +1583,405 @@ IoT_Error_t aws_iot_mqtt_autoreconnect_set_status(bool value) {
 	return NONE_ERROR;
 }
 
+bool aws_iot_is_mqtt_connected_ex(MQTTConnection_t *pConnection) {
+	if (NULL == pConnection) {
+		return false;
+	}
+
+	return MQTTIsConnected(&(pConnection->c));
+}
+
+bool aws_iot_is_autoreconnect_enabled_ex(MQTTConnection_t *pConnection) {
+	if (NULL == pConnection) {
+		return false;
+	}
+
+	return MQTTIsAutoReconnectEnabled(&(pConnection->c));
+}
+
+/* wmprintf() has no 64 bit conversions */
+static void printBytes(const char *pName, uint64_t bytes) {
+	if (bytes > UINT32_MAX) {
+		wmprintf("%s %lu KB\n", pName, (unsigned long) (bytes >> 10));
+	} else {
+		wmprintf("%s %lu\n", pName, (unsigned long) bytes);
+	}
+}
+
+static void printHistogram(const char *pName, const MQTTHistogram *pHistogram) {
+	uint32_t i;
+
+	if (0 == pHistogram->count) {
+		wmprintf("%s: none\n", pName);
+		return;
+	}
+
+	wmprintf("%s: %lu, min %lu us, avg %lu us, max %lu us\n", pName, (unsigned long) pHistogram->count,
+			(unsigned long) pHistogram->minUs, (unsigned long) (pHistogram->sumUs / pHistogram->count),
+			(unsigned long) pHistogram->maxUs);
+	for (i = 0; i < MQTT_STATS_HISTOGRAM_BUCKETS; i++) {
+		if (0 != pHistogram->buckets[i]) {
+			if (MQTT_STATS_HISTOGRAM_BUCKETS - 1 == i) {
+				wmprintf("  >= %lu us: %lu\n", 1UL << i, (unsigned long) pHistogram->buckets[i]);
+			} else {
+				wmprintf("  < %lu us: %lu\n", 2UL << i, (unsigned long) pHistogram->buckets[i]);
+			}
+		}
+	}
+}
+
+IoT_Error_t aws_iot_mqtt_print_stats_ex(MQTTConnection_t *pConnection, bool reset) {
+	static const char *packetNames[MQTT_STATS_PACKET_TYPES] = {
+		NULL, "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+		"SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", NULL
+	};
+	MQTTStats stats;
+	uint32_t i;
+
+	if (NULL == pConnection) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (MQTT_SUCCESS != MQTTGetStats(&(pConnection->c), &stats)) {
+		return GENERIC_ERROR;
+	}
+	if (reset) {
+		MQTTResetStats(&(pConnection->c));
+	}
+
+	printBytes("bytes out", stats.bytesOut);
+	printBytes("bytes in", stats.bytesIn);
+	for (i = 0; i < MQTT_STATS_PACKET_TYPES; i++) {
+		if (0 != stats.packetsOut[i] || 0 != stats.packetsIn[i]) {
+			wmprintf("%s out %lu, in %lu\n", (NULL != packetNames[i]) ? packetNames[i] : "reserved",
+					(unsigned long) stats.packetsOut[i], (unsigned long) stats.packetsIn[i]);
+		}
+	}
+	wmprintf("oversized dropped %lu, rejected %lu\n", (unsigned long) stats.oversizedDropped,
+			(unsigned long) stats.oversizedRejected);
+	wmprintf("publish ack timeouts %lu, reconnects %lu\n", (unsigned long) stats.publishAckTimeouts,
+			(unsigned long) stats.reconnects);
+	wmprintf("qos2 duplicates %lu, refused %lu\n", (unsigned long) stats.qos2Duplicates,
+			(unsigned long) stats.qos2Refused);
+	printHistogram("puback latency", &stats.pubackLatency);
+	printHistogram("send time", &stats.sendDuration);
+	printHistogram("reconnect time", &stats.reconnectDuration);
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	MQTTRateStats rateStats;
+
+	if (NONE_ERROR == aws_iot_mqtt_get_rate_stats_ex(pConnection, &rateStats, reset)) {
+		wmprintf("rate delayed %lu, merged %lu, dropped %lu\n", (unsigned long) rateStats.delayed,
+				(unsigned long) rateStats.merged, (unsigned long) rateStats.dropped);
+	}
+#endif
+#if AWS_IOT_MQTT_COMPRESS
+	MQTTCompressStats compressCounts;
+
+	if (NONE_ERROR == aws_iot_mqtt_get_compress_stats_ex(pConnection, &compressCounts, reset)) {
+		wmprintf("compressed %lu, %lu to %lu bytes, not shorter %lu\n", (unsigned long) compressCounts.compressed,
+				(unsigned long) compressCounts.bytesIn, (unsigned long) compressCounts.bytesOut,
+				(unsigned long) compressCounts.skipped);
+		wmprintf("expanded %lu, not expanded %lu\n", (unsigned long) compressCounts.expanded,
+				(unsigned long) compressCounts.unexpanded);
+	}
+#endif
+#if AWS_IOT_MQTT_DISPATCH
+	MQTTDispatchStats dispatchCounts;
+
+	if (NONE_ERROR == aws_iot_mqtt_get_dispatch_stats(&dispatchCounts, reset)) {
+		wmprintf("dispatch queued %lu (%lu in place), inline %lu, max slots %lu\n",
+				(unsigned long) dispatchCounts.queued, (unsigned long) dispatchCounts.handedOver,
+				(unsigned long) dispatchCounts.inlined, (unsigned long) dispatchCounts.maxUsed);
+	}
+#endif
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_rate_class_set_ex(MQTTConnection_t *pConnection, const char *pTopicPrefix,
+		uint32_t ratePerSec, uint32_t burst) {
+#if AWS_IOT_MQTT_RATE_LIMIT
+	RateClass *pClass = NULL, *pFree = NULL;
+	size_t prefixLen;
+	uint32_t i;
+
+	if (NULL == pConnection || NULL == pTopicPrefix) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (NONE_ERROR != rateInit(pConnection)) {
+		return GENERIC_ERROR;
+	}
+
+	prefixLen = strlen(pTopicPrefix);
+	mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+	for (i = 0; i < AWS_IOT_MQTT_RATE_CLASSES; i++) {
+		RateClass *p = &(pConnection->rateClasses[i]);
+
+		if (NULL == p->pTopicPrefix) {
+			if (NULL == pFree) {
+				pFree = p;
+			}
+		} else if (prefixLen == p->prefixLen && 0 == memcmp(pTopicPrefix, p->pTopicPrefix, prefixLen)) {
+			pClass = p;
+			break;
+		}
+	}
+
+	if (NULL == pClass) {
+		if (0 == ratePerSec) {
+			mutex_unlock(&(pConnection->rateLock));
+			return NONE_ERROR;
+		}
+		if (NULL == pFree) {
+			mutex_unlock(&(pConnection->rateLock));
+			return GENERIC_ERROR;
+		}
+		pClass = pFree;
+		pClass->prefixLen = prefixLen;
+	}
+
+	pClass->pTopicPrefix = pTopicPrefix;
+	/* Publishes held for a class that is removed go out at the rate of
+	 * the connection */
+	rateBucketInit(&(pClass->bucket), ratePerSec, burst);
+	if (0 == ratePerSec) {
+		pClass->pTopicPrefix = NULL;
+	}
+	mutex_unlock(&(pConnection->rateLock));
+
+	return NONE_ERROR;
+#else
+	return GENERIC_ERROR;
+#endif
+}
+
+IoT_Error_t aws_iot_mqtt_ingest_route_set_ex(MQTTConnection_t *pConnection, const char *pTopicPrefix,
+		const char *pRuleName) {
+#if AWS_IOT_MQTT_INGEST
+	IngestRoute *pRoute = NULL, *pFree = NULL;
+	size_t prefixLen;
+	uint32_t i;
+
+	if (NULL == pConnection || NULL == pTopicPrefix) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (NONE_ERROR != ingestInit(pConnection)) {
+		return GENERIC_ERROR;
+	}
+
+	prefixLen = strlen(pTopicPrefix);
+	mutex_lock(&(pConnection->ingestLock), THREADS_WAIT_FOREVER);
+	for (i = 0; i < AWS_IOT_MQTT_INGEST_ROUTES; i++) {
+		IngestRoute *p = &(pConnection->ingestRoutes[i]);
+
+		if (NULL == p->pTopicPrefix) {
+			if (NULL == pFree) {
+				pFree = p;
+			}
+		} else if (prefixLen == p->prefixLen && 0 == memcmp(pTopicPrefix, p->pTopicPrefix, prefixLen)) {
+			pRoute = p;
+			break;
+		}
+	}
+
+	if (NULL == pRoute) {
+		if (NULL == pRuleName) {
+			mutex_unlock(&(pConnection->ingestLock));
+			return NONE_ERROR;
+		}
+		if (NULL == pFree) {
+			mutex_unlock(&(pConnection->ingestLock));
+			return GENERIC_ERROR;
+		}
+		pRoute = pFree;
+		pRoute->prefixLen = prefixLen;
+	}
+
+	pRoute->pTopicPrefix = (NULL != pRuleName) ? pTopicPrefix : NULL;
+	pRoute->pRuleName = pRuleName;
+	mutex_unlock(&(pConnection->ingestLock));
+
+	return NONE_ERROR;
+#else
+	return GENERIC_ERROR;
+#endif
+}
+
+IoT_Error_t aws_iot_mqtt_get_rate_stats_ex(MQTTConnection_t *pConnection, MQTTRateStats *pStats, bool reset) {
+	if (NULL == pConnection || NULL == pStats) {
+		return NULL_VALUE_ERROR;
+	}
+
+#if AWS_IOT_MQTT_RATE_LIMIT
+	if (!pConnection->isRateInitialized) {
+		memset(pStats, 0, sizeof(*pStats));
+		return NONE_ERROR;
+	}
+
+	mutex_lock(&(pConnection->rateLock), THREADS_WAIT_FOREVER);
+	*pStats = pConnection->rateStats;
+	if (reset) {
+		memset(&(pConnection->rateStats), 0, sizeof(pConnection->rateStats));
+	}
+	mutex_unlock(&(pConnection->rateLock));
+
+	return NONE_ERROR;
+#else
+	return GENERIC_ERROR;
+#endif
+}
+
+IoT_Error_t aws_iot_mqtt_get_compress_stats_ex(MQTTConnection_t *pConnection, MQTTCompressStats *pStats, bool reset) {
+	if (NULL == pConnection || NULL == pStats) {
+		return NULL_VALUE_ERROR;
+	}
+
+#if AWS_IOT_MQTT_COMPRESS
+	if (!pConnection->isCompressInitialized) {
+		memset(pStats, 0, sizeof(*pStats));
+		return NONE_ERROR;
+	}
+
+	/* The reader counts the expanded payloads without the lock, a reset
+	 * can miss one of them */
+	mutex_lock(&(pConnection->compressLock), THREADS_WAIT_FOREVER);
+	*pStats = pConnection->compressStats;
+	if (reset) {
+		memset(&(pConnection->compressStats), 0, sizeof(pConnection->compressStats));
+	}
+	mutex_unlock(&(pConnection->compressLock));
+
+	return NONE_ERROR;
+#else
+	return GENERIC_ERROR;
+#endif
+}
+
+IoT_Error_t aws_iot_mqtt_get_dispatch_stats(MQTTDispatchStats *pStats, bool reset) {
+	if (NULL == pStats) {
+		return NULL_VALUE_ERROR;
+	}
+
+#if AWS_IOT_MQTT_DISPATCH
+	unsigned long state = os_enter_critical_section();
+
+	*pStats = dispatchStats;
+	if (reset) {
+		memset(&dispatchStats, 0, sizeof(dispatchStats));
+		dispatchStats.maxUsed = dispatchUsed;
+	}
+	os_exit_critical_section(state);
+
+	return NONE_ERROR;
+#else
+	return GENERIC_ERROR;
+#endif
+}
+
+/* The aws_iot_mqtt_* API below works on the default connection */
+
+IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
+	return aws_iot_mqtt_connect_ex(DEFAULT_CONNECTION, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams) {
+	return aws_iot_mqtt_subscribe_ex(DEFAULT_CONNECTION, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_subscribe_many(MQTTSubscribeParams *pParams, uint32_t count) {
+	return aws_iot_mqtt_subscribe_many_ex(DEFAULT_CONNECTION, pParams, count);
+}
+
+IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams) {
+	return aws_iot_mqtt_publish_ex(DEFAULT_CONNECTION, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_publish_async(MQTTPublishParams *pParams, iot_publish_complete_handler handler,
+		void *pContext) {
+	return aws_iot_mqtt_publish_async_ex(DEFAULT_CONNECTION, pParams, handler, pContext);
+}
+
+IoT_Error_t aws_iot_mqtt_publish_prepared(const MQTTPreparedPublish *pPrepared, MQTTMessageParams *pParams) {
+	return aws_iot_mqtt_publish_prepared_ex(DEFAULT_CONNECTION, pPrepared, pParams);
+}
+
+IoT_Error_t aws_iot_mqtt_unsubscribe(char *pTopic) {
+	return aws_iot_mqtt_unsubscribe_ex(DEFAULT_CONNECTION, pTopic);
+}
+
+IoT_Error_t aws_iot_mqtt_unsubscribe_many(char **pTopics, uint32_t count) {
+	return aws_iot_mqtt_unsubscribe_many_ex(DEFAULT_CONNECTION, pTopics, count);
+}
+
+IoT_Error_t aws_iot_mqtt_disconnect() {
+	return aws_iot_mqtt_disconnect_ex(DEFAULT_CONNECTION);
+}
+
+IoT_Error_t aws_iot_mqtt_yield(int timeout) {
+	return aws_iot_mqtt_yield_ex(DEFAULT_CONNECTION, timeout);
+}
+
+IoT_Error_t aws_iot_mqtt_yield_until_event(int timeout) {
+	return aws_iot_mqtt_yield_until_event_ex(DEFAULT_CONNECTION, timeout);
+}
+
+void aws_iot_mqtt_wakeup(void) {
+	aws_iot_mqtt_wakeup_ex(DEFAULT_CONNECTION);
+}
+
+void aws_iot_mqtt_batch_begin(void) {
+	aws_iot_mqtt_batch_begin_ex(DEFAULT_CONNECTION);
+}
+
+IoT_Error_t aws_iot_mqtt_batch_end(void) {
+	return aws_iot_mqtt_batch_end_ex(DEFAULT_CONNECTION);
+}
+
+IoT_Error_t aws_iot_mqtt_keepalive_early(uint32_t withinMs) {
+	return aws_iot_mqtt_keepalive_early_ex(DEFAULT_CONNECTION, withinMs);
+}
+
+IoT_Error_t aws_iot_mqtt_set_traffic_class(TrafficClass trafficClass) {
+	return aws_iot_mqtt_set_traffic_class_ex(DEFAULT_CONNECTION, trafficClass);
+}
+
+IoT_Error_t aws_iot_mqtt_attempt_reconnect() {
+	return aws_iot_mqtt_attempt_reconnect_ex(DEFAULT_CONNECTION);
+}
+
+IoT_Error_t aws_iot_mqtt_autoreconnect_set_status(bool value) {
+	return aws_iot_mqtt_autoreconnect_set_status_ex(DEFAULT_CONNECTION, value);
+}
+
 bool aws_iot_is_mqtt_connected(void) {
-	return MQTTIsConnected(&c);
+	return aws_iot_is_mqtt_connected_ex(DEFAULT_CONNECTION);
 }
 
 bool aws_iot_is_autoreconnect_enabled(void) {
-	return MQTTIsAutoReconnectEnabled(&c);
+	return aws_iot_is_autoreconnect_enabled_ex(DEFAULT_CONNECTION);
+}
+
+IoT_Error_t aws_iot_mqtt_print_stats(bool reset) {
+	return aws_iot_mqtt_print_stats_ex(DEFAULT_CONNECTION, reset);
+}
+
+IoT_Error_t aws_iot_mqtt_rate_class_set(const char *pTopicPrefix, uint32_t ratePerSec, uint32_t burst) {
+	return aws_iot_mqtt_rate_class_set_ex(DEFAULT_CONNECTION, pTopicPrefix, ratePerSec, burst);
+}
+
+IoT_Error_t aws_iot_mqtt_ingest_route_set(const char *pTopicPrefix, const char *pRuleName) {
+	return aws_iot_mqtt_ingest_route_set_ex(DEFAULT_CONNECTION, pTopicPrefix, pRuleName);
+}
+
+IoT_Error_t aws_iot_mqtt_get_compress_stats(MQTTCompressStats *pStats, bool reset) {
+	return aws_iot_mqtt_get_compress_stats_ex(DEFAULT_CONNECTION, pStats, reset);
+}
+
+IoT_Error_t aws_iot_mqtt_get_rate_stats(MQTTRateStats *pStats, bool reset) {
+	return aws_iot_mqtt_get_rate_stats_ex(DEFAULT_CONNECTION, pStats, reset);
 }
 
 void aws_iot_mqtt_init(MQTTClient_t *pClient){
@@ -294,9 +1990,15 @@ void aws_iot_mqtt_init(MQTTClient_t *pClient){
 	pClient->isConnected = aws_iot_is_mqtt_connected;
 	pClient->reconnect = aws_iot_mqtt_attempt_reconnect;
 	pClient->publish = aws_iot_mqtt_publish;
+	pClient->publishAsync = aws_iot_mqtt_publish_async;
+	pClient->publishPrepared = aws_iot_mqtt_publish_prepared;
 	pClient->subscribe = aws_iot_mqtt_subscribe;
+	pClient->subscribeMany = aws_iot_mqtt_subscribe_many;
 	pClient->unsubscribe = aws_iot_mqtt_unsubscribe;
+	pClient->unsubscribeMany = aws_iot_mqtt_unsubscribe_many;
 	pClient->yield = aws_iot_mqtt_yield;
+	pClient->yieldUntilEvent = aws_iot_mqtt_yield_until_event;
+	pClient->wakeup = aws_iot_mqtt_wakeup;
 	pClient->isAutoReconnectEnabled = aws_iot_is_autoreconnect_enabled;
 	pClient->setAutoReconnectStatus = aws_iot_mqtt_autoreconnect_set_status;
 }
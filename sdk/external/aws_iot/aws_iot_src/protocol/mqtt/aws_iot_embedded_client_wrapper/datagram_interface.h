@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file datagram_interface.h
+ * @brief Datagram transport for QoS0 telemetry
+ *
+ * Sends loss tolerant telemetry as MQTT-SN style PUBLISH messages over UDP,
+ * without the TCP acknowledgements, retransmissions and head of line
+ * blocking of the TLS connection and without a TLS record per message.
+ * Messages carry a 16 bit topic id agreed with the receiver in advance, the
+ * MQTT-SN predefined topic id, instead of their topic name. They are batched:
+ * a datagram goes out once #AWS_IOT_DGRAM_BATCH messages wait, when the next
+ * message would not fit in #AWS_IOT_DGRAM_MAX_LEN, when the first message
+ * waited #AWS_IOT_DGRAM_FLUSH_MS at the next publish, or on iot_dgram_flush().
+ *
+ * Every datagram is encrypted and authenticated with a pre-shared AES-128 key
+ * in CCM mode, by the AES engine of the chip. It reads:
+ *
+ *     0   version, 1
+ *     1   key id
+ *     2   session, 6 random bytes picked at connect
+ *     8   sequence number of the datagram in the session, big endian
+ *     12  encrypted messages
+ *     n   MIC, 8 bytes
+ *
+ * The first 12 bytes are authenticated, not encrypted. The CCM nonce is
+ * those 12 bytes followed by a 0, it is not used twice with a key as long as
+ * a key id is given to one device only. The receiver drops datagrams whose
+ * session and sequence number it saw already. The messages are MQTT-SN
+ * PUBLISH messages with QoS -1, a predefined topic id and message id 0, one
+ * after the other.
+ *
+ * Nothing is acknowledged and nothing is retransmitted, the transport is
+ * meant for data the next sample replaces. Commands, alarms and anything
+ * else that has to arrive keep going over the MQTT connection.
+ */
+
+#ifndef __DATAGRAM_INTERFACE_H_
+#define __DATAGRAM_INTERFACE_H_
+
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+#include "threads_interface.h"
+// Add the platform specific includes to define the DatagramDataParams struct
+#include "network_platform.h"
+
+/**
+ * @brief Datagram Connection Parameters
+ */
+typedef struct {
+	char *pDestinationURL;			///< Host name or address of the receiver
+	int DestinationPort;			///< UDP port of the receiver
+	unsigned char keyId;			///< Id of the key, tells the receiver which key to check the datagrams with
+	const unsigned char *pKey;		///< Pre-shared AES-128 key, 16 bytes
+} DatagramConnectParams;
+
+/**
+ * @brief Datagram Counters
+ */
+typedef struct {
+	uint32_t messages;	///< Messages published
+	uint32_t datagrams;	///< Datagrams sent
+	uint32_t dropped;	///< Messages in datagrams that could not be encrypted or sent
+} DatagramStats;
+
+/**
+ * @brief Datagram Transport
+ */
+typedef struct {
+	Mutex lock;				///< Held while a message is added or the batch is sent
+	DatagramStats stats;			///< Counters since the connect
+	DatagramDataParams dgramDataParams;	///< Platform specific state of the transport
+} Datagram;
+
+/**
+ * @brief Open the transport
+ *
+ * Resolves the receiver, creates a UDP socket, one of CONFIG_MAX_SOCKETS_UDP,
+ * and starts a new session.
+ *
+ * @param pDgram - Transport to open
+ * @param pParams - Receiver and key, the key is copied
+ * @return NONE_ERROR, NULL_VALUE_ERROR, TCP_CONNECT_ERROR if the receiver
+ *         could not be resolved, or TCP_SETUP_ERROR if the socket could not
+ *         be created
+ */
+IoT_Error_t iot_dgram_connect(Datagram *pDgram, DatagramConnectParams *pParams);
+
+/**
+ * @brief Add a message to the batch
+ *
+ * Sends the batch first when the message does not fit in it any more, and
+ * after adding the message when the batch is due.
+ *
+ * @param pDgram - Open transport
+ * @param topicId - Predefined topic id of the message
+ * @param pPayload - Payload of the message
+ * @param payloadLen - Length of the payload
+ * @return NONE_ERROR, NULL_VALUE_ERROR, DATAGRAM_SEND_ERROR if the message
+ *         can never fit in a datagram or a batch sent could not be encrypted
+ *         or handed to the network. The message is in the batch unless it
+ *         does not fit.
+ */
+IoT_Error_t iot_dgram_publish(Datagram *pDgram, uint16_t topicId,
+			      const void *pPayload, uint32_t payloadLen);
+
+/**
+ * @brief Send the batch now
+ *
+ * @param pDgram - Open transport
+ * @return NONE_ERROR, NULL_VALUE_ERROR, or DATAGRAM_SEND_ERROR if the batch
+ *         could not be encrypted or handed to the network, its messages are
+ *         dropped
+ */
+IoT_Error_t iot_dgram_flush(Datagram *pDgram);
+
+/**
+ * @brief Send the batch and close the transport
+ *
+ * @param pDgram - Open transport
+ */
+void iot_dgram_disconnect(Datagram *pDgram);
+
+#endif /* __DATAGRAM_INTERFACE_H_ */
@@ -24,6 +24,9 @@
 #ifndef __NETWORK_INTERFACE_H_
 #define __NETWORK_INTERFACE_H_
 
+// Add the platform specific TLS includes to define the TLSDataParams struct
+#include "network_platform.h"
+
 /**
  * @brief Network Type
  *
@@ -31,6 +34,31 @@
  */
 typedef struct Network Network;
 
+/**
+ * @brief Network Wait Result
+ *
+ * Values returned by the mqttwait function of the network interface.
+ */
+typedef enum {
+	NETWORK_WAIT_TIMEOUT = 0,	///< Timeout expired without any data to read
+	NETWORK_WAIT_READABLE = 1,	///< Data arrived on the socket
+	NETWORK_WAIT_BUFFERED = 2,	///< Data is already held by the network layer, a read returns without waiting for the socket
+	NETWORK_WAIT_WOKEN = 3		///< The wait was interrupted by the mqttwakeup function
+} NetworkWaitResult;
+
+/**
+ * @brief Network Traffic Class
+ *
+ * Priority of the packets of a connection on the link.  On Wi-Fi with WMM each class is
+ * sent from its own access category queue, see the platform for the DSCP values used.
+ */
+typedef enum {
+	NETWORK_TC_BE = 0,	///< Best effort, the default
+	NETWORK_TC_BK = 1,	///< Background, bulk transfers that may wait, e.g. OTA or a backlog being drained
+	NETWORK_TC_VI = 2,	///< Video, traffic that is latency sensitive but heavier than commands
+	NETWORK_TC_VO = 3	///< Voice, small command and control traffic that has to get through first
+} NetworkTrafficClass;
+
 /**
  * @brief TLS Connection Parameters
  *
@@ -45,6 +73,7 @@ typedef struct{
 	int DestinationPort;				///< Integer defining the connection port of the MQTT service.
 	unsigned int timeout_ms;			///< Unsigned integer defining the TLS handshake timeout value in milliseconds.
 	unsigned char ServerVerificationFlag;	///< Boolean.  True = perform server certificate hostname validation.  False = skip validation \b NOT recommended.
+	NetworkTrafficClass trafficClass;	///< Priority of the packets of the connection.
 }TLSConnectParams;
 
 /**
@@ -57,9 +86,17 @@ struct Network{
 	int (*connect) (Network *, TLSConnectParams);
 	int (*mqttread) (Network*, unsigned char*, int, int);	///< Function pointer pointing to the network function to read from the network
 	int (*mqttwrite) (Network*, unsigned char*, int, int);	///< Function pointer pointing to the network function to write to the network
+	int (*mqttwait) (Network*, int);	///< Function pointer pointing to the network function to wait for data to read, NULL if not supported
+	void (*mqttwakeup) (Network*);	///< Function pointer pointing to the network function to interrupt a pending wait
+	void (*mqttcork) (Network*);	///< Function pointer pointing to the network function to start collecting writes, NULL if not supported
+	int (*mqttflush) (Network*, int);	///< Function pointer pointing to the network function to send the collected writes
+	unsigned char *(*mqttwritebuf) (Network*, int, int*);	///< Function pointer pointing to the network function to lend its write buffer for a packet to be serialized in place, NULL if not supported
+	int (*mqttpeek) (Network*, unsigned char**, int, int);	///< Function pointer pointing to the network function to make bytes readable in place in its read buffer, NULL if not supported
 	void (*disconnect) (Network*);		///< Function pointer pointing to the network function to disconnect from the network
 	int (*isConnected) (Network*);     ///< Function pointer pointing to the network function to check if physical layer is connected
+	int (*settrafficclass) (Network*, NetworkTrafficClass);	///< Function pointer pointing to the network function to change the priority of an open connection, NULL if not supported
 	int (*destroy) (Network*);		///< Function pointer pointing to the network function to destroy the network object
+	TLSDataParams tlsDataParams;	///< Platform specific TLS state of this connection
 };
 
 /**
@@ -85,6 +122,36 @@ int iot_tls_init(Network *pNetwork);
  */
 int iot_tls_connect(Network *pNetwork, TLSConnectParams TLSParams);
 
+/**
+ * @brief Parse the credentials of the following connections ahead of time
+ *
+ * The certificates and the key are parsed once, by the first connection using them or by
+ * this call, e.g. at boot while the link comes up, and kept parsed for the connections
+ * given the same buffers. The buffers have to stay in place.
+ *
+ * Each credential is a PEM string, or a single DER object, which spares decoding the
+ * base64 and is smaller to store, see iot_tls_pem_to_der().
+ *
+ * @param pRootCA - Root CA certificate
+ * @param pDeviceCert - Device certificate
+ * @param pDevicePrivateKey - Device private key
+ * @return integer - NONE_ERROR or SSL_CERT_ERROR
+ */
+int iot_tls_credentials_load(const char *pRootCA, const char *pDeviceCert, const char *pDevicePrivateKey);
+
+/**
+ * @brief Convert a PEM certificate or key to DER
+ *
+ * Decodes the first block of the PEM string, e.g. once when the credentials are provisioned
+ * so that they can be stored as DER.
+ *
+ * @param pPem - PEM string
+ * @param pDer - Buffer for the DER object, it can be the PEM string itself
+ * @param derLen - Size of the buffer
+ * @return integer - length of the DER object, -1 if the PEM is not valid or does not fit
+ */
+int iot_tls_pem_to_der(const char *pPem, unsigned char *pDer, int derLen);
+
 /**
  * @brief Write bytes to the network socket
  *
@@ -107,6 +174,88 @@ int iot_tls_write(Network*, unsigned char*, int, int);
  */
 int iot_tls_read(Network*, unsigned char*, int, int);
 
+/**
+ * @brief Wait for data to read from the network socket
+ *
+ * Blocks until data can be read, the timeout expires or iot_tls_wakeup() is called.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param integer - wait timeout value in milliseconds
+ * @return integer - one of the NETWORK_WAIT_* values, negative on error
+ */
+int iot_tls_wait(Network*, int);
+
+/**
+ * @brief Interrupt a pending iot_tls_wait()
+ *
+ * Can be called from any thread. If no wait is pending the next one returns immediately.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ */
+void iot_tls_wakeup(Network*);
+
+/**
+ * @brief Collect the following writes
+ *
+ * Writes are collected until iot_tls_flush() and sent together as one TLS record, or as few
+ * as possible when they do not fit in AWS_IOT_TLS_TX_BUF_LEN bytes, instead of a record each.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ */
+void iot_tls_cork(Network*);
+
+/**
+ * @brief Send the writes collected since iot_tls_cork()
+ *
+ * Following writes are sent right away again.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param integer - write timeout value in milliseconds
+ * @return integer - 0 or TLS error
+ */
+int iot_tls_flush(Network*, int);
+
+/**
+ * @brief Lend the free part of the write buffer
+ *
+ * A packet serialized there is written with iot_tls_write() as usual, from where it is,
+ * so that it is not copied.  The collected writes are sent first when fewer than the
+ * minimum bytes are free behind them.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param integer - minimum number of free bytes
+ * @param integer pointer - set to the number of free bytes
+ * @return unsigned char pointer - the free part of the write buffer
+ */
+unsigned char *iot_tls_write_buf(Network*, int, int*);
+
+/**
+ * @brief Make bytes readable in place
+ *
+ * Reads until the next bytes, as many as asked for, are in the read buffer, in one piece
+ * and with one byte of the buffer behind them, without taking them.  iot_tls_read() to
+ * where they are takes them without copying them.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param unsigned char double pointer - set to where the bytes are
+ * @param integer - number of bytes
+ * @param integer - read timeout value in milliseconds
+ * @return integer - the number of bytes, 0 if they did not arrive in time or on a TLS error,
+ *         negative if they never fit in the read buffer
+ */
+int iot_tls_peek(Network*, unsigned char**, int, int);
+
+/**
+ * @brief Change the priority of the packets of the connection
+ *
+ * Takes effect for the packets sent from then on, the connection stays open.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param NetworkTrafficClass - traffic class of the packets
+ * @return integer - 0 or TLS error
+ */
+int iot_tls_set_traffic_class(Network*, NetworkTrafficClass);
+
 /**
  * @brief Disconnect from network socket
  *
@@ -125,13 +274,30 @@ void iot_tls_disconnect(Network *pNetwork);
 int iot_tls_destroy(Network *pNetwork);
 
 /**
- * @brief Check if TLS layer is still connected
+ * @brief Check if the network under the TLS layer is up
  *
- * Called to check if the TLS layer is still connected or not.
+ * Called by the auto reconnect before an attempt. While the network is down no
+ * attempts are made and the back-off does not advance.
+ *
+ * While connected the socket is checked too: an error on it, a close by the peer,
+ * a failed write or the TCP keepalive giving up make the connection dead. The MQTT
+ * client checks this in each yield and starts the reconnect right away, instead of
+ * waiting for a missed PINGRESP.
  *
  * @param Network - Pointer to a Network struct defining the network interface.
  * @return int - integer indicating status of network physical layer connection
  */
 int iot_tls_is_connected(Network *pNetwork);
 
+/**
+ * @brief Tell the TLS layer the WLAN link went down or came back
+ *
+ * Called by the application from its WLAN event handler. While the link is down
+ * iot_tls_is_connected() returns 0, and the yields waiting on the connections are
+ * woken, so that they notice within one yield loop.
+ *
+ * @param integer - 1 when the link is up again, 0 when it is lost
+ */
+void iot_tls_link_event(int up);
+
 #endif //__NETWORK_INTERFACE_H_
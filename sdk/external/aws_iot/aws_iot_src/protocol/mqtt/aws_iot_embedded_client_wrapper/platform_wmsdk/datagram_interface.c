@@ -0,0 +1,286 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Datagram transport on lwIP UDP sockets and the AES engine of the MW300.
+ *
+ * The engine runs CCM over the header, the A string, and the messages, the
+ * M string, in one pass. It is driven a word at a time through its FIFOs,
+ * the ciphertext is written back over the messages, each output word is read
+ * after the input word it comes from has been fed. One engine serves all
+ * transports, its lock is taken around a datagram.
+ */
+
+#include <lwip/sockets.h>
+#include <string.h>
+#include <wm_os.h>
+#include <wm_utils.h>
+#include <mw300_aes.h>
+#include "aws_iot_config.h"
+#include "datagram_interface.h"
+#include "dns_cache.h"
+
+#define DGRAM_VERSION		1
+#define DGRAM_RESOLVE_TIMEOUT_MS	5000
+
+/* MQTT-SN PUBLISH, QoS -1 and a predefined topic id */
+#define MQTTSN_PUBLISH		0x0c
+#define MQTTSN_FLAGS_QOS_M1	0x60
+#define MQTTSN_FLAGS_PREDEFINED	0x01
+/* Length field, type, flags, topic id and message id */
+#define MQTTSN_PUBLISH_HDR_LEN	7
+#define MQTTSN_PUBLISH_HDR_LEN_LONG	9
+
+static Mutex dgram_aes_lock;
+static int dgram_aes_ready;
+
+static uint32_t dgram_now_ms(void)
+{
+	return os_ticks_to_msec(os_ticks_get());
+}
+
+/* A new session, so that the sequence numbers and with them the nonces
+ * start over without repeating one */
+static void dgram_new_session(DatagramDataParams *d)
+{
+	get_random_sequence(d->buf + 2, 6);
+	d->seq = 0;
+}
+
+static void dgram_start_batch(DatagramDataParams *d)
+{
+	d->buf[8] = (unsigned char)(d->seq >> 24);
+	d->buf[9] = (unsigned char)(d->seq >> 16);
+	d->buf[10] = (unsigned char)(d->seq >> 8);
+	d->buf[11] = (unsigned char)d->seq;
+	d->len = DGRAM_HEADER_LEN;
+	d->count = 0;
+}
+
+/* Encrypt buf[DGRAM_HEADER_LEN, len) in place and write the MIC behind it */
+static int dgram_ccm_encrypt(DatagramDataParams *d)
+{
+	AES_Config_Type cfg;
+	uint32_t *p = (uint32_t *) d->buf;
+	uint32_t mic[DGRAM_MIC_LEN / 4];
+	int a_words = DGRAM_HEADER_LEN / 4;
+	int in_words = a_words + (d->len - DGRAM_HEADER_LEN + 3) / 4;
+	int fed = 0, out = a_words;
+	int ret = 0;
+
+	/* The last word is fed whole, its padding is not part of the M string */
+	memset(d->buf + d->len, 0, (4 - (d->len & 3)) & 3);
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.mode = AES_MODE_CCM;
+	cfg.encDecSel = AES_MODE_ENCRYPTION;
+	memcpy(cfg.initVect, d->buf, DGRAM_HEADER_LEN);
+	cfg.keySize = AES_KEY_BYTES_16;
+	memcpy(cfg.key, d->key, sizeof(d->key));
+	cfg.aStrLen = DGRAM_HEADER_LEN;
+	cfg.mStrLen = d->len - DGRAM_HEADER_LEN;
+	cfg.micLen = AES_MIC_BYTES_8;
+	cfg.micEn = ENABLE;
+
+	mutex_lock(&dgram_aes_lock, THREADS_WAIT_FOREVER);
+
+	AES_Reset();
+	AES_Init(&cfg);
+	/* Only the M string comes out of the output FIFO */
+	AES_OutmsgCmd(DISABLE);
+	AES_Enable();
+
+	while (out < in_words) {
+		if (fed < in_words && !AES_GetStatus(AES_STATUS_INFIFO_FULL))
+			AES_FeedData(p[fed++]);
+		if (AES_GetStatus(AES_STATUS_OUTFIFO_RDY))
+			p[out++] = AES_ReadData();
+	}
+	while (!AES_GetStatus(AES_STATUS_DONE))
+		;
+	if (AES_GetStatus(AES_STATUS_ERROR_0) ||
+	    AES_GetStatus(AES_STATUS_ERROR_1))
+		ret = -1;
+	else
+		AES_ReadMIC(mic, DGRAM_MIC_LEN / 4);
+
+	AES_Disable();
+	AES_IntClr(AES_INT_ALL);
+
+	mutex_unlock(&dgram_aes_lock);
+
+	if (!ret) {
+		memcpy(d->buf + d->len, mic, DGRAM_MIC_LEN);
+		d->len += DGRAM_MIC_LEN;
+	}
+	memset(&cfg, 0, sizeof(cfg));
+	return ret;
+}
+
+static IoT_Error_t dgram_send_batch(Datagram *pDgram)
+{
+	DatagramDataParams *d = &pDgram->dgramDataParams;
+	IoT_Error_t rc = NONE_ERROR;
+
+	if (!d->count)
+		return NONE_ERROR;
+
+	if (dgram_ccm_encrypt(d) ||
+	    send(d->sock, d->buf, d->len, 0) != d->len) {
+		pDgram->stats.dropped += d->count;
+		rc = DATAGRAM_SEND_ERROR;
+	} else {
+		pDgram->stats.datagrams++;
+	}
+
+	/* A nonce is used once even when the send failed, the sequence
+	 * number moves on */
+	if (++d->seq == 0)
+		dgram_new_session(d);
+	dgram_start_batch(d);
+	return rc;
+}
+
+IoT_Error_t iot_dgram_connect(Datagram *pDgram, DatagramConnectParams *pParams)
+{
+	DatagramDataParams *d;
+	struct sockaddr_in addr;
+
+	if (NULL == pDgram || NULL == pParams ||
+	    NULL == pParams->pDestinationURL || NULL == pParams->pKey)
+		return NULL_VALUE_ERROR;
+
+	/* Transports are opened at start up, before they send */
+	if (!dgram_aes_ready) {
+		if (mutex_init(&dgram_aes_lock))
+			return GENERIC_ERROR;
+		dgram_aes_ready = 1;
+	}
+
+	memset(pDgram, 0, sizeof(*pDgram));
+	d = &pDgram->dgramDataParams;
+	d->sock = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(pParams->DestinationPort);
+	if (iot_dns_resolve(pParams->pDestinationURL, &addr.sin_addr,
+			    DGRAM_RESOLVE_TIMEOUT_MS) != NONE_ERROR)
+		return TCP_CONNECT_ERROR;
+
+	if (mutex_init(&pDgram->lock))
+		return GENERIC_ERROR;
+
+	d->sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (-1 == d->sock) {
+		mutex_destroy(&pDgram->lock);
+		return TCP_SETUP_ERROR;
+	}
+	/* Connected, so that send() is enough and datagrams from anyone
+	 * else are not queued on the socket */
+	if (connect(d->sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		close(d->sock);
+		d->sock = -1;
+		mutex_destroy(&pDgram->lock);
+		return TCP_SETUP_ERROR;
+	}
+
+	memcpy(d->key, pParams->pKey, sizeof(d->key));
+	d->buf[0] = DGRAM_VERSION;
+	d->buf[1] = pParams->keyId;
+	dgram_new_session(d);
+	dgram_start_batch(d);
+	return NONE_ERROR;
+}
+
+IoT_Error_t iot_dgram_publish(Datagram *pDgram, uint16_t topicId,
+			      const void *pPayload, uint32_t payloadLen)
+{
+	DatagramDataParams *d;
+	IoT_Error_t rc = NONE_ERROR;
+	uint32_t msgLen;
+	unsigned char *p;
+
+	if (NULL == pDgram || (NULL == pPayload && payloadLen))
+		return NULL_VALUE_ERROR;
+	d = &pDgram->dgramDataParams;
+	if (-1 == d->sock)
+		return NULL_VALUE_ERROR;
+
+	msgLen = MQTTSN_PUBLISH_HDR_LEN + payloadLen;
+	if (msgLen > 0xff)
+		msgLen += MQTTSN_PUBLISH_HDR_LEN_LONG - MQTTSN_PUBLISH_HDR_LEN;
+	if (msgLen > AWS_IOT_DGRAM_MAX_LEN - DGRAM_HEADER_LEN - DGRAM_MIC_LEN) {
+		pDgram->stats.dropped++;
+		return DATAGRAM_SEND_ERROR;
+	}
+
+	mutex_lock(&pDgram->lock, THREADS_WAIT_FOREVER);
+
+	if (d->len + msgLen > AWS_IOT_DGRAM_MAX_LEN - DGRAM_MIC_LEN)
+		rc = dgram_send_batch(pDgram);
+
+	p = d->buf + d->len;
+	if (msgLen > 0xff) {
+		*p++ = 0x01;
+		*p++ = (unsigned char)(msgLen >> 8);
+	}
+	*p++ = (unsigned char)msgLen;
+	*p++ = MQTTSN_PUBLISH;
+	*p++ = MQTTSN_FLAGS_QOS_M1 | MQTTSN_FLAGS_PREDEFINED;
+	*p++ = (unsigned char)(topicId >> 8);
+	*p++ = (unsigned char)topicId;
+	*p++ = 0;
+	*p++ = 0;
+	memcpy(p, pPayload, payloadLen);
+
+	if (!d->count)
+		d->first_ms = dgram_now_ms();
+	d->len += msgLen;
+	d->count++;
+	pDgram->stats.messages++;
+
+	if (d->count >= AWS_IOT_DGRAM_BATCH ||
+	    dgram_now_ms() - d->first_ms >= AWS_IOT_DGRAM_FLUSH_MS) {
+		IoT_Error_t sent = dgram_send_batch(pDgram);
+
+		if (NONE_ERROR == rc)
+			rc = sent;
+	}
+
+	mutex_unlock(&pDgram->lock);
+	return rc;
+}
+
+IoT_Error_t iot_dgram_flush(Datagram *pDgram)
+{
+	IoT_Error_t rc;
+
+	if (NULL == pDgram || -1 == pDgram->dgramDataParams.sock)
+		return NULL_VALUE_ERROR;
+
+	mutex_lock(&pDgram->lock, THREADS_WAIT_FOREVER);
+	rc = dgram_send_batch(pDgram);
+	mutex_unlock(&pDgram->lock);
+	return rc;
+}
+
+void iot_dgram_disconnect(Datagram *pDgram)
+{
+	DatagramDataParams *d;
+
+	if (NULL == pDgram || -1 == pDgram->dgramDataParams.sock)
+		return;
+	d = &pDgram->dgramDataParams;
+
+	iot_dgram_flush(pDgram);
+
+	mutex_lock(&pDgram->lock, THREADS_WAIT_FOREVER);
+	close(d->sock);
+	d->sock = -1;
+	memset(d->key, 0, sizeof(d->key));
+	mutex_unlock(&pDgram->lock);
+	mutex_destroy(&pDgram->lock);
+}
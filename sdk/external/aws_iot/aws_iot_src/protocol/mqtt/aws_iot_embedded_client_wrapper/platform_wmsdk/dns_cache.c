@@ -0,0 +1,458 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <lwip/tcpip.h>
+#include <lwip/dns.h>
+#include <warm_resume.h>
+
+#include "aws_iot_config.h"
+#include "dns_cache.h"
+
+/* Queries of a host, A and AAAA */
+#if LWIP_IPV6
+#define DNS_CACHE_QUERIES 2
+#else
+#define DNS_CACHE_QUERIES 1
+#endif
+
+typedef struct {
+	char host[DNS_MAX_NAME_LENGTH];
+	ip_addr_t addr;
+	/* addr holds an answer, possibly an expired one */
+	bool valid;
+#if LWIP_IPV6
+	ip6_addr_t addr6;
+	bool valid6;
+#endif
+	/* Queries for host running in the tcpip thread */
+	int pending;
+	/* One of the running queries got an answer, at tick answered_at */
+	bool answered;
+	unsigned long answered_at;
+	/* Tick the longest lived answer of the last queries expires at */
+	unsigned long expiry;
+	/* Tick of the last use, the entry unused for the longest time is
+	 * given to a new host */
+	unsigned long used;
+	/* Tasks waiting in iot_dns_resolve(), every one of them gets a put
+	 * of done when the query completes */
+	int waiters;
+	os_semaphore_t done;
+	iot_dns_cb_t cb;
+	void *arg;
+} dns_cache_entry_t;
+
+static dns_cache_entry_t dns_cache[AWS_IOT_DNS_CACHE_ENTRIES];
+static bool dns_cache_inited;
+
+static int dns_cache_init(void)
+{
+	int i;
+
+	if (dns_cache_inited)
+		return WM_SUCCESS;
+
+	for (i = 0; i < AWS_IOT_DNS_CACHE_ENTRIES; i++) {
+		if (!dns_cache[i].done &&
+		    os_semaphore_create_counting(&dns_cache[i].done,
+						 "dns-cache",
+						 AWS_IOT_TLS_CONNECTIONS,
+						 0) != WM_SUCCESS)
+			return -WM_FAIL;
+	}
+	dns_cache_inited = true;
+	return WM_SUCCESS;
+}
+
+static bool dns_cache_known(const dns_cache_entry_t *e)
+{
+#if LWIP_IPV6
+	if (e->valid6)
+		return true;
+#endif
+	return e->valid;
+}
+
+static bool dns_cache_fresh(const dns_cache_entry_t *e)
+{
+	return dns_cache_known(e) && (long) (e->expiry - os_ticks_get()) > 0;
+}
+
+/* Returns true if the caller has to start the queries. Called in a
+ * critical section */
+static bool dns_cache_claim_queries(dns_cache_entry_t *e)
+{
+	if (e->pending)
+		return false;
+	e->pending = DNS_CACHE_QUERIES;
+	e->answered = false;
+	return true;
+}
+
+/* Entry of pHost, if claim is set a new entry for it is taken when it is
+ * not cached. Called in a critical section */
+static dns_cache_entry_t *dns_cache_find(const char *pHost, bool claim)
+{
+	dns_cache_entry_t *e, *victim = NULL;
+	int i;
+
+	for (i = 0; i < AWS_IOT_DNS_CACHE_ENTRIES; i++) {
+		e = &dns_cache[i];
+		if (e->host[0] && strcmp(e->host, pHost) == 0) {
+			e->used = os_ticks_get();
+			return e;
+		}
+		if (e->pending || e->waiters)
+			continue;
+		if (!victim || !e->host[0] ||
+		    (victim->host[0] &&
+		     (long) (e->used - victim->used) < 0))
+			victim = e;
+	}
+
+	if (!claim || !victim)
+		return NULL;
+
+	strcpy(victim->host, pHost);
+	victim->valid = false;
+#if LWIP_IPV6
+	victim->valid6 = false;
+#endif
+	victim->cb = NULL;
+	victim->used = os_ticks_get();
+	return victim;
+}
+
+/* One query of e is done, ipaddr or ip6addr is its answer, both are NULL
+ * when it failed. The callback is called once the last query is done, the
+ * waiters are woken up by every query */
+static void dns_cache_complete(dns_cache_entry_t *e, const ip_addr_t *ipaddr,
+			       const void *ip6addr, u32_t ttl)
+{
+	unsigned long state, now, expiry;
+	iot_dns_cb_t cb = NULL;
+	void *arg = NULL;
+	int waiters;
+	bool valid;
+	struct in_addr addr;
+
+	state = os_enter_critical_section();
+	now = os_ticks_get();
+	if (ipaddr) {
+		e->addr = *ipaddr;
+		e->valid = true;
+	}
+#if LWIP_IPV6
+	if (ip6addr) {
+		ip6_addr_copy(e->addr6, *(const ip6_addr_t *) ip6addr);
+		e->valid6 = true;
+	}
+#endif
+	if (ipaddr || ip6addr) {
+		expiry = now + os_msec_to_ticks(ttl * 1000);
+		if (!e->answered || (long) (expiry - e->expiry) > 0)
+			e->expiry = expiry;
+		if (!e->answered) {
+			e->answered = true;
+			e->answered_at = now;
+		}
+	}
+	if (--e->pending == 0) {
+		cb = e->cb;
+		arg = e->arg;
+		e->cb = NULL;
+	}
+	waiters = e->waiters;
+	valid = e->valid;
+	addr.s_addr = ip4_addr_get_u32(&e->addr);
+	os_exit_critical_section(state);
+
+	if (cb)
+		cb(e->host, valid ? &addr : NULL, arg);
+	while (waiters-- > 0)
+		os_semaphore_put(&e->done);
+}
+
+/* Runs in the tcpip thread */
+static void dns_cache_found(const char *name, ip_addr_t *ipaddr, void *arg)
+{
+	dns_cache_complete((dns_cache_entry_t *) arg, ipaddr, NULL,
+			   ipaddr ? dns_lookup_ttl(name) : 0);
+}
+
+#if LWIP_IPV6
+/* Runs in the tcpip thread */
+static void dns_cache_found6(const char *name, ip6_addr_t *ip6addr, void *arg)
+{
+	dns_cache_complete((dns_cache_entry_t *) arg, NULL, ip6addr,
+			   ip6addr ? dns_lookup_ttl6(name) : 0);
+}
+#endif
+
+/* Runs in the tcpip thread */
+static void dns_cache_query(void *ctx)
+{
+	dns_cache_entry_t *e = (dns_cache_entry_t *) ctx;
+	ip_addr_t addr;
+	err_t err;
+#if LWIP_IPV6
+	ip6_addr_t addr6;
+
+	err = dns_gethostbyname6(e->host, &addr6, dns_cache_found6, e);
+	if (err == ERR_OK)
+		dns_cache_complete(e, NULL, &addr6, dns_lookup_ttl6(e->host));
+	else if (err != ERR_INPROGRESS)
+		dns_cache_complete(e, NULL, NULL, 0);
+#endif
+
+	err = dns_gethostbyname(e->host, &addr, dns_cache_found, e);
+	if (err == ERR_OK)
+		/* lwIP had the answer in its own table */
+		dns_cache_complete(e, &addr, NULL, dns_lookup_ttl(e->host));
+	else if (err != ERR_INPROGRESS)
+		dns_cache_complete(e, NULL, NULL, 0);
+}
+
+static void dns_cache_start(dns_cache_entry_t *e)
+{
+	int i;
+
+	if (tcpip_callback(dns_cache_query, e) != ERR_OK)
+		for (i = 0; i < DNS_CACHE_QUERIES; i++)
+			dns_cache_complete(e, NULL, NULL, 0);
+}
+
+/* Addresses of e, called in a critical section */
+static void dns_cache_addrs(const dns_cache_entry_t *e, iot_dns_addrs_t *pAddrs)
+{
+	pAddrs->hasV4 = e->valid;
+	pAddrs->v4.s_addr = ip4_addr_get_u32(&e->addr);
+	pAddrs->hasV6 = false;
+#if LWIP_IPV6
+	pAddrs->hasV6 = e->valid6;
+	inet6_addr_from_ip6addr(&pAddrs->v6, &e->addr6);
+#endif
+}
+
+IoT_Error_t iot_dns_resolve_addrs(const char *pHost, iot_dns_addrs_t *pAddrs,
+				  int timeout_ms)
+{
+	dns_cache_entry_t *e;
+	unsigned long state, deadline, end;
+	long left;
+	bool start, known;
+
+	memset(pAddrs, 0, sizeof(*pAddrs));
+	if (inet_aton(pHost, &pAddrs->v4)) {
+		pAddrs->hasV4 = true;
+		return NONE_ERROR;
+	}
+#if LWIP_IPV6
+	if (inet6_aton(pHost, &pAddrs->v6)) {
+		pAddrs->hasV6 = true;
+		return NONE_ERROR;
+	}
+#endif
+	if (strlen(pHost) >= DNS_MAX_NAME_LENGTH ||
+	    dns_cache_init() != WM_SUCCESS)
+		return TCP_CONNECT_ERROR;
+
+	state = os_enter_critical_section();
+	e = dns_cache_find(pHost, true);
+	if (!e) {
+		os_exit_critical_section(state);
+		return TCP_CONNECT_ERROR;
+	}
+	if (dns_cache_fresh(e)) {
+		dns_cache_addrs(e, pAddrs);
+		os_exit_critical_section(state);
+		return NONE_ERROR;
+	}
+	e->waiters++;
+	start = dns_cache_claim_queries(e);
+	os_exit_critical_section(state);
+
+	if (start)
+		dns_cache_start(e);
+
+	/* A put left over from a waiter that timed out only costs a turn of
+	 * the loop */
+	deadline = os_ticks_get() + os_msec_to_ticks(timeout_ms > 0 ?
+						     timeout_ms : 0);
+	while (e->pending) {
+		end = deadline;
+		/* The other family gets a little longer after the first
+		 * answer, then the connect goes ahead without it */
+		if (e->answered &&
+		    (long) (e->answered_at + os_msec_to_ticks(
+				AWS_IOT_DNS_RESOLUTION_DELAY_MS) - end) < 0)
+			end = e->answered_at +
+				os_msec_to_ticks(AWS_IOT_DNS_RESOLUTION_DELAY_MS);
+		left = (long) (end - os_ticks_get());
+		if (left <= 0)
+			break;
+		os_semaphore_get(&e->done, left);
+	}
+
+	state = os_enter_critical_section();
+	e->waiters--;
+	/* An expired answer beats no answer when the query failed */
+	known = dns_cache_known(e);
+	dns_cache_addrs(e, pAddrs);
+	os_exit_critical_section(state);
+
+	return known ? NONE_ERROR : TCP_CONNECT_ERROR;
+}
+
+IoT_Error_t iot_dns_resolve(const char *pHost, struct in_addr *pAddr,
+			    int timeout_ms)
+{
+	iot_dns_addrs_t addrs;
+
+	if (iot_dns_resolve_addrs(pHost, &addrs, timeout_ms) != NONE_ERROR ||
+	    !addrs.hasV4)
+		return TCP_CONNECT_ERROR;
+	*pAddr = addrs.v4;
+	return NONE_ERROR;
+}
+
+IoT_Error_t iot_dns_resolve_async(const char *pHost, iot_dns_cb_t cb,
+				  void *pArg)
+{
+	dns_cache_entry_t *e;
+	unsigned long state;
+	struct in_addr addr;
+	bool start, valid;
+
+	if (inet_aton(pHost, &addr)) {
+		if (cb)
+			cb(pHost, &addr, pArg);
+		return NONE_ERROR;
+	}
+	if (strlen(pHost) >= DNS_MAX_NAME_LENGTH ||
+	    dns_cache_init() != WM_SUCCESS)
+		return GENERIC_ERROR;
+
+	state = os_enter_critical_section();
+	e = dns_cache_find(pHost, true);
+	if (!e || (cb && e->cb)) {
+		os_exit_critical_section(state);
+		return GENERIC_ERROR;
+	}
+	if (dns_cache_fresh(e)) {
+		valid = e->valid;
+		addr.s_addr = ip4_addr_get_u32(&e->addr);
+		os_exit_critical_section(state);
+		if (cb)
+			cb(pHost, valid ? &addr : NULL, pArg);
+		return NONE_ERROR;
+	}
+	if (cb) {
+		e->cb = cb;
+		e->arg = pArg;
+	}
+	start = dns_cache_claim_queries(e);
+	os_exit_critical_section(state);
+
+	if (start)
+		dns_cache_start(e);
+	return NONE_ERROR;
+}
+
+void iot_dns_flush(const char *pHost)
+{
+	dns_cache_entry_t *e;
+	unsigned long state;
+
+	state = os_enter_critical_section();
+	e = dns_cache_find(pHost, false);
+	if (e)
+		e->expiry = os_ticks_get();
+	os_exit_critical_section(state);
+}
+
+/* An entry as kept across the sleeps */
+typedef struct {
+	char host[DNS_MAX_NAME_LENGTH];
+	/* TTL left at the save, 0 once expired */
+	uint32_t ttl_ms;
+	ip_addr_t addr;
+	bool valid;
+#if LWIP_IPV6
+	ip6_addr_t addr6;
+	bool valid6;
+#endif
+} dns_cache_saved_t;
+
+static int dns_cache_save(void *buf, size_t size)
+{
+	dns_cache_saved_t *s = (dns_cache_saved_t *) buf;
+	dns_cache_entry_t *e;
+	unsigned long state;
+	int i, n = 0;
+
+	state = os_enter_critical_section();
+	for (i = 0; i < AWS_IOT_DNS_CACHE_ENTRIES; i++) {
+		e = &dns_cache[i];
+		if (!e->host[0] || !dns_cache_known(e))
+			continue;
+		if ((n + 1) * sizeof(*s) > size)
+			break;
+		memset(&s[n], 0, sizeof(*s));
+		strcpy(s[n].host, e->host);
+		s[n].ttl_ms = dns_cache_fresh(e) ?
+			os_ticks_to_msec(e->expiry - os_ticks_get()) : 0;
+		s[n].addr = e->addr;
+		s[n].valid = e->valid;
+#if LWIP_IPV6
+		ip6_addr_copy(s[n].addr6, e->addr6);
+		s[n].valid6 = e->valid6;
+#endif
+		n++;
+	}
+	os_exit_critical_section(state);
+	return n * sizeof(*s);
+}
+
+static void dns_cache_restore(const void *data, size_t len, uint32_t since_ms)
+{
+	const dns_cache_saved_t *s = (const dns_cache_saved_t *) data;
+	dns_cache_entry_t *e;
+	unsigned long state;
+	size_t i;
+
+	state = os_enter_critical_section();
+	for (i = 0; i < len / sizeof(*s); i++) {
+		if (!memchr(s[i].host, 0, sizeof(s[i].host)) ||
+		    !(e = dns_cache_find(s[i].host, true)) || e->pending)
+			continue;
+		e->addr = s[i].addr;
+		e->valid = s[i].valid;
+#if LWIP_IPV6
+		ip6_addr_copy(e->addr6, s[i].addr6);
+		e->valid6 = s[i].valid6;
+#endif
+		/* The slept time counts against the TTL */
+		e->expiry = os_ticks_get() + os_msec_to_ticks(
+			s[i].ttl_ms > since_ms ? s[i].ttl_ms - since_ms : 0);
+	}
+	os_exit_critical_section(state);
+}
+
+static const struct warm_resume_client dns_cache_client = {
+	.tag = WARM_RESUME_TAG_DNS,
+	.save = dns_cache_save,
+	.restore = dns_cache_restore,
+};
+
+IoT_Error_t iot_dns_warm_resume(void)
+{
+	return warm_resume_register(&dns_cache_client) == WM_SUCCESS ?
+		NONE_ERROR : GENERIC_ERROR;
+}
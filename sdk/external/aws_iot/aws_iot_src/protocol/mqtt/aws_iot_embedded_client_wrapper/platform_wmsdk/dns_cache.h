@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file dns_cache.h
+ * @brief Addresses of the MQTT hosts kept between connections
+ *
+ * The lwIP DNS table only has a couple of entries shared with every other
+ * lookup of the device, and its answers go away with their TTL. The network
+ * layer keeps its own answers for #AWS_IOT_DNS_CACHE_ENTRIES host names:
+ * while the TTL of an answer runs a reconnect does not send any query, and
+ * when a query fails or times out the last answer is used anyway, the TCP
+ * connect tells whether the host is still there.
+ *
+ * With IPv6 (LWIP_IPV6) the A and the AAAA record are queried together and
+ * both addresses are kept. The wait for the answers ends
+ * #AWS_IOT_DNS_RESOLUTION_DELAY_MS after the first one, a slow AAAA answer
+ * does not hold up an IPv4 connect (RFC 8305).
+ *
+ * Queries run in the tcpip thread, none of these functions shares static
+ * storage between callers the way gethostbyname() does.
+ */
+
+#ifndef __DNS_CACHE_H_
+#define __DNS_CACHE_H_
+
+#include <stdbool.h>
+#include <lwip/sockets.h>
+
+#include "aws_iot_error.h"
+
+/**
+ * @brief Addresses of a host
+ */
+typedef struct {
+	bool hasV4;		///< v4 holds an address
+	bool hasV6;		///< v6 holds an address, never set without LWIP_IPV6
+	struct in_addr v4;	///< IPv4 address
+#if LWIP_IPV6
+	struct in6_addr v6;	///< IPv6 address
+#endif
+} iot_dns_addrs_t;
+
+/**
+ * @brief Result of iot_dns_resolve_async()
+ *
+ * @param pHost Host name that was resolved
+ * @param pAddr Its IPv4 address, NULL if it could not be resolved and no earlier answer is known
+ * @param pArg Argument given to iot_dns_resolve_async()
+ */
+typedef void (*iot_dns_cb_t)(const char *pHost, const struct in_addr *pAddr, void *pArg);
+
+/**
+ * @brief Resolve a host name, from the cache while its TTL runs
+ *
+ * @param pHost Host name or dotted address
+ * @param pAddr Set to the address of the host
+ * @param timeout_ms Time a query may take when the cached answer expired
+ * @return NONE_ERROR, or TCP_CONNECT_ERROR if the host is not known
+ */
+IoT_Error_t iot_dns_resolve(const char *pHost, struct in_addr *pAddr, int timeout_ms);
+
+/**
+ * @brief Resolve the IPv4 and the IPv6 address of a host, from the cache while its TTL runs
+ *
+ * @param pHost Host name or address, dotted or with LWIP_IPV6 in IPv6 notation
+ * @param pAddrs Set to the addresses of the host, a family without an answer is left out
+ * @param timeout_ms Time the queries may take when the cached answers expired
+ * @return NONE_ERROR, or TCP_CONNECT_ERROR if no address of the host is known
+ */
+IoT_Error_t iot_dns_resolve_addrs(const char *pHost, iot_dns_addrs_t *pAddrs, int timeout_ms);
+
+/**
+ * @brief Resolve a host name without waiting
+ *
+ * A cached answer still in its TTL is given to the callback before returning, otherwise
+ * a query is started and the callback is called from the tcpip thread once it is done, it
+ * must not block. With a NULL callback this refreshes the cache ahead of a connect, e.g.
+ * as soon as the link is up again.
+ *
+ * @param pHost Host name
+ * @param cb Callback, can be NULL
+ * @param pArg Passed to the callback
+ * @return NONE_ERROR, or GENERIC_ERROR if the cache is full of queries in flight or a query
+ * of the same host already has a callback
+ */
+IoT_Error_t iot_dns_resolve_async(const char *pHost, iot_dns_cb_t cb, void *pArg);
+
+/**
+ * @brief Expire the cached address of a host
+ *
+ * Called when the cached addresses did not accept a connection, the next resolve of the
+ * host sends queries. The addresses are still used if those queries fail.
+ *
+ * @param pHost Host name
+ */
+void iot_dns_flush(const char *pHost);
+
+/**
+ * @brief Keep the cached addresses across the PM4 sleeps, see warm_resume.h
+ *
+ * Called once after warm_resume_init(). After a warm boot the addresses are known again and
+ * their TTL runs on less the time slept, a connect resolves without a query while it runs.
+ *
+ * @return NONE_ERROR, or GENERIC_ERROR if the client could not be registered
+ */
+IoT_Error_t iot_dns_warm_resume(void);
+
+#endif /* __DNS_CACHE_H_ */
@@ -1,8 +1,20 @@
 #include <lwip/sockets.h>
 #include <lwip/netdb.h>
+#include <lwip/api.h>
+#include <lwip/netif.h>
 #include <string.h>
+#include <errno.h>
 #include "aws_iot_error.h"
+#include "aws_iot_log.h"
 #include "network_interface.h"
+#include "timer_interface.h"
+#include "dns_cache.h"
+#include <cycle_trace.h>
+#include <cpu_clk.h>
+#include <wm_os.h>
+#include <wm_utils.h>
+#include <wmtime.h>
+#include <sha256.h>
 
 #define NET_BLOCKING_OFF 1
 #define NET_BLOCKING_ON	0
@@ -12,89 +24,308 @@ static inline int net_socket_blocking(int sock, int state)
 	return lwip_ioctl(sock, FIONBIO, &state);
 }
 
-typedef int tls_handle_t;
+int tls_lib_init(void);
 
-typedef enum {
-	/* TLS server mode */
-	/* If this flag bit is zero client mode is assumed.*/
-	TLS_SERVER_MODE = 0x01,
-	TLS_CHECK_CLIENT_CERT = 0x02,
+/* wolfSSL, built into the SDK library. The wm-tls session calls create a
+ * new context and a full handshake for every connection, the client side
+ * is driven directly so the context and the TLS session survive a
+ * reconnect */
+typedef struct WOLFSSL_METHOD WOLFSSL_METHOD;
+typedef struct WOLFSSL_CTX WOLFSSL_CTX;
+typedef struct WOLFSSL WOLFSSL;
+typedef struct WOLFSSL_SESSION WOLFSSL_SESSION;
 
-	/* TLS Client mode */
-	TLS_CHECK_SERVER_CERT = 0x04,
-	/* This will be needed if server mandates client certificate. If
-	   this flag is enabled then client_cert and client_key from the
-	   client structure in the union tls (from tls_init_config_t)
-	   needs to be passed to tls_session_init() */
-	TLS_USE_CLIENT_CERT = 0x08,
-#ifdef CONFIG_WPA2_ENTP
-	TLS_WPA2_ENTP = 0x10,
-#endif
-	/* Set this bit if given client_cert (client mode) or server_cert
-	   (server mode) is a chained buffer */
-	TLS_CERT_BUFFER_CHAINED = 0x20,
-} tls_flags_t;
+#define SSL_SUCCESS		1
+#define SSL_FILETYPE_PEM	1
+#define SSL_FILETYPE_ASN1	2
+#define SSL_VERIFY_NONE		0
+#define SSL_VERIFY_PEER		1
+
+/* Return values of the IO callbacks */
+#define WOLFSSL_CBIO_ERR_GENERAL	-1
+#define WOLFSSL_CBIO_ERR_WANT_READ	-2
+#define WOLFSSL_CBIO_ERR_CONN_CLOSE	-5
 
+typedef int (*CallbackIORecv)(WOLFSSL *ssl, char *buf, int sz, void *ctx);
+
+WOLFSSL_METHOD *wolfSSLv23_client_method(void);
+WOLFSSL_CTX *wolfSSL_CTX_new(WOLFSSL_METHOD *method);
+void wolfSSL_CTX_free(WOLFSSL_CTX *ctx);
+int wolfSSL_CTX_load_verify_buffer(WOLFSSL_CTX *ctx, const unsigned char *in,
+				   long sz, int format);
+int wolfSSL_CTX_use_certificate_buffer(WOLFSSL_CTX *ctx,
+				       const unsigned char *in, long sz,
+				       int format);
+int wolfSSL_CTX_use_certificate_chain_buffer(WOLFSSL_CTX *ctx,
+					     const unsigned char *in, long sz);
+int wolfSSL_CTX_use_PrivateKey_buffer(WOLFSSL_CTX *ctx,
+				      const unsigned char *in, long sz,
+				      int format);
+void wolfSSL_CTX_set_verify(WOLFSSL_CTX *ctx, int mode, void *verify_cb);
+void wolfSSL_set_verify(WOLFSSL *ssl, int mode, void *verify_cb);
+int wolfSSL_CTX_set_cipher_list(WOLFSSL_CTX *ctx, const char *list);
+WOLFSSL *wolfSSL_new(WOLFSSL_CTX *ctx);
+void wolfSSL_free(WOLFSSL *ssl);
+int wolfSSL_set_fd(WOLFSSL *ssl, int fd);
+void wolfSSL_SetIORecv(WOLFSSL_CTX *ctx, CallbackIORecv recv);
+void wolfSSL_SetIOReadCtx(WOLFSSL *ssl, void *ctx);
+int wolfSSL_set_session(WOLFSSL *ssl, WOLFSSL_SESSION *session);
+WOLFSSL_SESSION *wolfSSL_get_session(WOLFSSL *ssl);
+int wolfSSL_session_reused(WOLFSSL *ssl);
+int wolfSSL_connect(WOLFSSL *ssl);
+int wolfSSL_shutdown(WOLFSSL *ssl);
+int wolfSSL_read(WOLFSSL *ssl, void *data, int sz);
+int wolfSSL_write(WOLFSSL *ssl, const void *data, int sz);
+/* Only in a library built with HAVE_MAX_FRAGMENT */
+int wolfSSL_CTX_UseMaxFragment(WOLFSSL_CTX *ctx, unsigned char mfl) WEAK;
+/* Only in a library built with HAVE_ECC and HAVE_SUPPORTED_CURVES */
+#define WOLFSSL_ECC_SECP256R1	0x17
+int wolfSSL_CTX_UseSupportedCurve(WOLFSSL_CTX *ctx, unsigned short name) WEAK;
+/* Only in a library built with SESSION_CERTS */
+typedef struct WOLFSSL_X509_CHAIN WOLFSSL_X509_CHAIN;
+WOLFSSL_X509_CHAIN *wolfSSL_get_peer_chain(WOLFSSL *ssl) WEAK;
+int wolfSSL_get_chain_count(WOLFSSL_X509_CHAIN *chain) WEAK;
+int wolfSSL_get_chain_length(WOLFSSL_X509_CHAIN *chain, int idx) WEAK;
+unsigned char *wolfSSL_get_chain_cert(WOLFSSL_X509_CHAIN *chain, int idx) WEAK;
+
+/* Client contexts, with the certificates already parsed, and the session
+ * of their last handshake. The sessions live in the wolfSSL session cache,
+ * a session the server does not know any more only costs a full handshake.
+ * Entries are matched on the certificate buffers, which stay in place for
+ * the life of the application, and on the host, whose session is only
+ * offered to that host. An entry loaded without a host takes the one of its
+ * first connection */
 typedef struct {
-	/** OR of flags defined in \ref tls_flags_t */
+	const unsigned char *ca_cert;
+	const unsigned char *client_cert;
+	const unsigned char *client_key;
 	int flags;
-	/** Either a client or a server can be configured at a time through
-	   tls_session_init(). Fill up appropriate structure from the
-	   below union depending on your requirement. */
-	union {
-		/** Structure for client TLS configuration */
-		struct {
-			/**
-			 * Needed if the RADIUS server mandates verification of
-			 * CA certificate. Otherwise set to NULL.*/
-			const unsigned char *ca_cert;
-			/** Size of CA_cert */
-			int ca_cert_size;
-			/**
-			 * Needed if the server mandates verification of
-			 * client certificate. Otherwise set to NULL. In
-			 * the former case please OR the flag
-			 * TLS_USE_CLIENT_CERT to flags variable in
-			 * tls_init_config_t passed to tls_session_init()
-			 */
-			const unsigned char *client_cert;
-			/** Size of client_cert */
-			int client_cert_size;
-			/** Client private key */
-			const unsigned char *client_key;
-			/** Size of client key */
-			int client_key_size;
-		} client;
-		/** Structure for server TLS configuration */
-		struct {
-			/** Mandatory. Will be sent to the client */
-			const unsigned char *server_cert;
-			/** Size of server_cert */
-			int server_cert_size;
-			/**
-			 * Server private key. Mandatory.
-			 * For the perusal of the server
-			 */
-			const unsigned char *server_key;
-			/** Size of server_key */
-			int server_key_size;
-			/**
-			 * Needed if the server wants to verify client
-			 * certificate. Otherwise set to NULL.
-			 */
-			const unsigned char *client_cert;
-			/** Size of client_cert */
-			int client_cert_size;
-		}server;
-	} tls;
-} tls_init_config_t;
+	int max_fragment_len;
+	uint32_t host_hash;
+	WOLFSSL_CTX *ctx;
+	WOLFSSL_SESSION *session;
+#if AWS_IOT_TLS_VERIFY_CACHE
+	/* Digest of the last chain of the host verified against ca_cert, the
+	 * tick it was verified at and the end of its validity */
+	bool verified;
+	uint8_t chain_digest[SHA256_LEN];
+	unsigned long verified_at;
+	time_t not_after;
+#endif
+} tls_client_t;
 
-int tls_lib_init(void);
-int tls_session_init(tls_handle_t *h, int sockfd,
-		     const tls_init_config_t *cfg);
-int tls_send(tls_handle_t h, const void *buf, int len);
-int tls_recv(tls_handle_t h, void *buf, int max_len);
-void tls_close(tls_handle_t *h);
+static tls_client_t tls_clients[AWS_IOT_TLS_CONNECTIONS];
+
+#if AWS_IOT_TLS_ARENA_LEN
+/* The allocators of the TLS library. Between tls_arena_enter() and
+ * tls_arena_exit() the allocations of the task setting up a connection are
+ * taken from the arena of the connection with a bump pointer, everything
+ * else goes to the heap as before. A block of an arena is not given back
+ * when it is freed, the whole arena is once the connection object is freed.
+ * The blocks have their size in front, for a realloc */
+typedef void *(*wolfSSL_Malloc_cb)(size_t size);
+typedef void (*wolfSSL_Free_cb)(void *ptr);
+typedef void *(*wolfSSL_Realloc_cb)(void *ptr, size_t size);
+int wolfSSL_SetAllocators(wolfSSL_Malloc_cb mf, wolfSSL_Free_cb ff,
+			  wolfSSL_Realloc_cb rf);
+
+#define TLS_ARENA_HDR 8
+
+static TLSDataParams *tls_arenas[AWS_IOT_TLS_CONNECTIONS];
+
+static TLSDataParams *tls_arena_of_task(void)
+{
+	os_thread_t task = os_get_current_task_handle();
+	int i;
+
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++)
+		if (tls_arenas[i] && tls_arenas[i]->arena_owner == task)
+			return tls_arenas[i];
+	return NULL;
+}
+
+static bool tls_arena_has(const void *ptr)
+{
+	const unsigned char *p = ptr;
+	int i;
+
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++)
+		if (tls_arenas[i] && p >= tls_arenas[i]->arena &&
+		    p < tls_arenas[i]->arena + AWS_IOT_TLS_ARENA_LEN)
+			return true;
+	return false;
+}
+
+static void *tls_arena_malloc(size_t size)
+{
+	TLSDataParams *tls = tls_arena_of_task();
+	size_t len = (size + TLS_ARENA_HDR + 7) & ~(size_t)7;
+	unsigned char *p;
+
+	if (!tls)
+		return os_mem_alloc(size);
+	if (len > AWS_IOT_TLS_ARENA_LEN - tls->arena_used) {
+		tls->arena_heap++;
+		return os_mem_alloc(size);
+	}
+
+	p = tls->arena + tls->arena_used;
+	tls->arena_used += len;
+	if (tls->arena_used > tls->arena_peak)
+		tls->arena_peak = tls->arena_used;
+	*(uint32_t *)p = size;
+	return p + TLS_ARENA_HDR;
+}
+
+static void tls_arena_free(void *ptr)
+{
+	if (ptr && !tls_arena_has(ptr))
+		os_mem_free(ptr);
+}
+
+static void *tls_arena_realloc(void *ptr, size_t size)
+{
+	uint32_t old;
+	void *p;
+
+	if (!ptr)
+		return tls_arena_malloc(size);
+	if (!tls_arena_has(ptr))
+		return os_mem_realloc(ptr, size);
+
+	old = *(uint32_t *)((unsigned char *)ptr - TLS_ARENA_HDR);
+	p = tls_arena_malloc(size);
+	if (p)
+		memcpy(p, ptr, old < size ? old : size);
+	return p;
+}
+
+/* Without memory for an arena the connection uses the heap */
+static void tls_arena_enter(TLSDataParams *tls)
+{
+	int i, free_entry = -1;
+
+	if (!tls->arena) {
+		for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++)
+			if (!tls_arenas[i])
+				free_entry = i;
+		if (free_entry < 0)
+			return;
+		tls->arena = os_mem_alloc(AWS_IOT_TLS_ARENA_LEN);
+		if (!tls->arena) {
+			WARN("No memory for the TLS arena");
+			return;
+		}
+		tls_arenas[free_entry] = tls;
+	}
+	tls->arena_owner = os_get_current_task_handle();
+}
+
+static void tls_arena_exit(TLSDataParams *tls)
+{
+	tls->arena_owner = NULL;
+}
+
+/* Once the connection object is freed nothing points into the arena */
+static void tls_arena_reset(TLSDataParams *tls)
+{
+	if (tls->arena_heap)
+		DEBUG("TLS arena peak %d of %d bytes, %d allocations on the heap",
+		      tls->arena_peak, AWS_IOT_TLS_ARENA_LEN, tls->arena_heap);
+	tls->arena_used = 0;
+	tls->arena_heap = 0;
+}
+#else
+#define tls_arena_enter(tls)
+#define tls_arena_exit(tls)
+#define tls_arena_reset(tls)
+#endif
+
+static inline void tls_rx_buf_reset(TLSDataParams *tls)
+{
+	tls->rx_head = 0;
+	tls->rx_tail = 0;
+	tls->rx_timeout_ms = -1;
+	tls->rx_pending = 0;
+}
+
+/* Open the TCP window again by the data taken from the netconn */
+static void tls_netconn_recved(TLSDataParams *tls)
+{
+	if (!tls->rx_unacked)
+		return;
+	netconn_recved(tls->rx_conn, tls->rx_unacked);
+	tls->rx_unacked = 0;
+}
+
+static void tls_netconn_release(TLSDataParams *tls)
+{
+	if (tls->rx_pbuf)
+		pbuf_free(tls->rx_pbuf);
+	tls->rx_pbuf = NULL;
+	tls->rx_conn = NULL;
+	tls->rx_unacked = 0;
+}
+
+/* Receive callback of wolfSSL. The pbufs of the socket are taken from its
+ * netconn and copied straight into the record buffer of wolfSSL, instead
+ * of going through lwip_recv(), which has the tcpip thread update the TCP
+ * window for every segment. Here the window is updated once a quarter of
+ * it was read, and before waiting for more data */
+static int tls_netconn_recv(WOLFSSL *ssl, char *buf, int sz, void *ctx)
+{
+	TLSDataParams *tls = (TLSDataParams *) ctx;
+	struct pbuf *p;
+	err_t err;
+	int len = 0, n;
+
+	while (len < sz) {
+		if (!tls->rx_pbuf) {
+			tls_netconn_recved(tls);
+			err = netconn_recv_tcp_pbuf(tls->rx_conn, &p);
+			if (err != ERR_OK) {
+				if (len)
+					break;
+				if (err == ERR_TIMEOUT)
+					return WOLFSSL_CBIO_ERR_WANT_READ;
+				/* Reset, closed, or aborted by the keepalive */
+				tls->failed = 1;
+				if (err == ERR_CLSD)
+					return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+				return WOLFSSL_CBIO_ERR_GENERAL;
+			}
+			tls->rx_pbuf = p;
+			tls->rx_pbuf_off = 0;
+		}
+
+		p = tls->rx_pbuf;
+		n = pbuf_copy_partial(p, buf + len, sz - len,
+				      tls->rx_pbuf_off);
+		len += n;
+		tls->rx_pbuf_off += n;
+		if (tls->rx_pbuf_off >= p->tot_len) {
+			tls->rx_unacked += p->tot_len;
+			pbuf_free(p);
+			tls->rx_pbuf = NULL;
+		}
+	}
+
+	if (tls->rx_unacked >= TCP_WND / 4)
+		tls_netconn_recved(tls);
+	return len;
+}
+
+static void tls_set_rx_timeout(Network *pNetwork, int timeout_ms)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+
+	if (timeout_ms == tls->rx_timeout_ms)
+		return;
+
+	setsockopt(pNetwork->my_socket, SOL_SOCKET, SO_RCVTIMEO,
+		   (void *)&timeout_ms, sizeof(timeout_ms));
+	tls->rx_timeout_ms = timeout_ms;
+}
 
 int iot_tls_init(Network *pNetwork) 
 {
@@ -102,20 +333,36 @@ int iot_tls_init(Network *pNetwork)
 	pNetwork->connect = iot_tls_connect;
 	pNetwork->mqttread = iot_tls_read;
 	pNetwork->mqttwrite = iot_tls_write;
+	pNetwork->mqttwait = iot_tls_wait;
+	pNetwork->mqttwakeup = iot_tls_wakeup;
+	pNetwork->mqttcork = iot_tls_cork;
+	pNetwork->mqttflush = iot_tls_flush;
+	pNetwork->mqttwritebuf = iot_tls_write_buf;
+	pNetwork->mqttpeek = iot_tls_peek;
 	pNetwork->disconnect = iot_tls_disconnect;
 	pNetwork->isConnected = iot_tls_is_connected;
+	pNetwork->settrafficclass = iot_tls_set_traffic_class;
 	pNetwork->destroy = iot_tls_destroy;
+	pNetwork->tlsDataParams.ssl = NULL;
+	pNetwork->tlsDataParams.client = -1;
+	pNetwork->tlsDataParams.ssl_ctx = NULL;
+	pNetwork->tlsDataParams.wakeup_socket = -1;
+	pNetwork->tlsDataParams.rx_conn = NULL;
+	pNetwork->tlsDataParams.rx_pbuf = NULL;
+	pNetwork->tlsDataParams.rx_unacked = 0;
+	pNetwork->tlsDataParams.failed = 0;
+	pNetwork->tlsDataParams.tx_len = 0;
+	pNetwork->tlsDataParams.tx_corked = 0;
+	tls_rx_buf_reset(&pNetwork->tlsDataParams);
 	tls_lib_init();
+#if AWS_IOT_TLS_ARENA_LEN
+	wolfSSL_SetAllocators(tls_arena_malloc, tls_arena_free,
+			      tls_arena_realloc);
+#endif
 
 	return 0;
 }
 
-int Create_TCPSocket(void) {
-	int sockfd;
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	return sockfd;
-}
-
 static void Close_TCPSocket(int *sockfd) {
 	if (-1 == *sockfd)
 		return;
@@ -123,106 +370,1153 @@ static void Close_TCPSocket(int *sockfd) {
 	*sockfd = -1;
 }
 
-IoT_Error_t Connect_TCPSocket(int socket_fd, char *pURLString, int port) {
+IoT_Error_t setSocketToNonBlocking(int server_fd) {
+	net_socket_blocking(server_fd, NET_BLOCKING_OFF);
+	return 0;
+}
+
+/* Connect a socket to one address without blocking for longer than
+ * timeout_ms, instead of the lwIP SYN retries which take minutes */
+/* TCP options of the MQTT socket. The socket buffer sizes are those of
+ * the TCP/IP memory profile, lwIP has no per socket SO_SNDBUF */
+static void set_socket_options(int socket_fd)
+{
+	int val;
+
+#if AWS_IOT_TCP_NODELAY
+	val = 1;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+#endif
+#if AWS_IOT_TCP_KEEPALIVE_IDLE_S > 0
+	val = 1;
+	setsockopt(socket_fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
+	val = AWS_IOT_TCP_KEEPALIVE_IDLE_S;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val));
+	val = AWS_IOT_TCP_KEEPALIVE_INTERVAL_S;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val));
+	val = AWS_IOT_TCP_KEEPALIVE_COUNT;
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val));
+#endif
+	(void) val;
+}
+
+/* DSCP of each traffic class, in the TOS byte. The WLAN driver takes the
+ * user priority of a frame from the three precedence bits and sends it from
+ * the WMM access category of that priority: CS1 goes out as background,
+ * CS4 as video and CS6 as voice. Routers on the way see the same DSCP */
+static const unsigned char traffic_class_tos[] = {
+	[NETWORK_TC_BE] = 0x00,
+	[NETWORK_TC_BK] = 0x20,
+	[NETWORK_TC_VI] = 0x80,
+	[NETWORK_TC_VO] = 0xc0,
+};
+
+/* One address of the MQTT host per family, IPv6 first */
+#define CONNECT_MAX_ADDRS 2
+
+typedef struct {
+	struct sockaddr_storage addr;
+	socklen_t len;
+} connect_addr_t;
+
+static int connect_addrs(connect_addr_t *dest, const iot_dns_addrs_t *addrs,
+			 int port)
+{
+	struct sockaddr_in *sin;
+	int count = 0;
+
+	memset(dest, 0, CONNECT_MAX_ADDRS * sizeof(*dest));
+#if LWIP_IPV6
+	if (addrs->hasV6) {
+		struct sockaddr_in6 *sin6 =
+			(struct sockaddr_in6 *) &dest[count].addr;
+
+		sin6->sin6_len = sizeof(*sin6);
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		sin6->sin6_addr = addrs->v6;
+		dest[count++].len = sizeof(*sin6);
+	}
+#endif
+	if (addrs->hasV4) {
+		sin = (struct sockaddr_in *) &dest[count].addr;
+		sin->sin_len = sizeof(*sin);
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		sin->sin_addr = addrs->v4;
+		dest[count++].len = sizeof(*sin);
+	}
+	return count;
+}
+
+/* Happy eyeballs (RFC 8305): the connects to the addresses of dest are
+ * started AWS_IOT_CONNECTION_ATTEMPT_DELAY_MS apart, or as soon as the ones
+ * before failed, and run alongside each other. The first connection up is
+ * kept, the other attempts are closed. All of them together get at most
+ * timeout_ms */
+static IoT_Error_t connect_race(int *pSocket, const connect_addr_t *dest,
+				int count, int timeout_ms)
+{
+	int fds[CONNECT_MAX_ADDRS];
+	int started = 0, live = 0, winner = -1, maxfd, i, err, wait_ms;
+	socklen_t err_len;
+	Timer deadline, stagger;
+	struct timeval tv;
+	fd_set wfds;
+
+	InitTimer(&deadline);
+	InitTimer(&stagger);
+
+	countdown_ms(&deadline, timeout_ms);
+	while (winner < 0 && !expired(&deadline)) {
+		if (started < count && (!live || expired(&stagger))) {
+			fds[started] = socket(dest[started].addr.ss_family,
+					      SOCK_STREAM, 0);
+			if (-1 != fds[started]) {
+				setSocketToNonBlocking(fds[started]);
+				if (connect(fds[started],
+					    (struct sockaddr *)
+					    &dest[started].addr,
+					    dest[started].len) != 0 &&
+				    errno != EINPROGRESS) {
+					close(fds[started]);
+					fds[started] = -1;
+				} else {
+					live++;
+				}
+			} else if (!live && started + 1 == count) {
+				return TCP_SETUP_ERROR;
+			}
+			countdown_ms(&stagger,
+				     AWS_IOT_CONNECTION_ATTEMPT_DELAY_MS);
+			started++;
+			continue;
+		}
+		if (!live)
+			break;
+
+		wait_ms = left_ms(&deadline);
+		if (started < count && left_ms(&stagger) < wait_ms)
+			wait_ms = left_ms(&stagger);
+		if (wait_ms < 0)
+			wait_ms = 0;
+
+		FD_ZERO(&wfds);
+		maxfd = -1;
+		for (i = 0; i < started; i++) {
+			if (-1 == fds[i])
+				continue;
+			FD_SET(fds[i], &wfds);
+			if (fds[i] > maxfd)
+				maxfd = fds[i];
+		}
+		tv.tv_sec = wait_ms / 1000;
+		tv.tv_usec = (wait_ms % 1000) * 1000;
+		if (select(maxfd + 1, NULL, &wfds, NULL, &tv) < 0)
+			break;
+
+		for (i = 0; i < started && winner < 0; i++) {
+			if (-1 == fds[i] || !FD_ISSET(fds[i], &wfds))
+				continue;
+			err = 0;
+			err_len = sizeof(err);
+			if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err,
+				       &err_len) == 0 && err == 0) {
+				winner = i;
+			} else {
+				close(fds[i]);
+				fds[i] = -1;
+				live--;
+			}
+		}
+	}
+
+	for (i = 0; i < started; i++)
+		if (-1 != fds[i] && i != winner)
+			close(fds[i]);
+	if (winner < 0)
+		return TCP_CONNECT_ERROR;
+
+	/* The TLS layer reads and writes in blocking mode */
+	*pSocket = fds[winner];
+	net_socket_blocking(*pSocket, NET_BLOCKING_ON);
+	return NONE_ERROR;
+}
+
+/* Connect to the addresses of pURLString, from the DNS cache when they are
+ * still valid. A host with an IPv6 and an IPv4 address gets a happy
+ * eyeballs connect, see connect_race(). If the cached addresses do not
+ * answer the host is resolved again and the new addresses, if they differ,
+ * are tried as well. Every connect_race() gets at most
+ * AWS_IOT_TCP_CONNECT_TIMEOUT_MS, all of it together at most what is left
+ * of pTimer */
+IoT_Error_t Connect_TCPSocket(int *pSocket, char *pURLString, int port,
+			      Timer *pTimer) {
 	IoT_Error_t ret_val = TCP_CONNECT_ERROR;
-	int connect_status = -1;
-	struct hostent *host;
-	struct sockaddr_in dest_addr;
-
-	host = gethostbyname(pURLString);
-
-	if (NULL != host) {
-		dest_addr.sin_family = AF_INET;
-		dest_addr.sin_port = htons(port);
-		dest_addr.sin_addr.s_addr = *(long*) (host->h_addr);
-		memset(&(dest_addr.sin_zero), '\0', 8);
-
-		connect_status = connect(socket_fd, (struct sockaddr *) &dest_addr,
-				sizeof(struct sockaddr));
-		if (-1 != connect_status) {
-			ret_val = NONE_ERROR;
+	connect_addr_t dest[CONNECT_MAX_ADDRS], tried[CONNECT_MAX_ADDRS];
+	iot_dns_addrs_t addrs;
+	int attempt, count, timeout_ms;
+
+	*pSocket = -1;
+	for (attempt = 0; attempt < 2; attempt++) {
+		timeout_ms = left_ms(pTimer);
+		if (timeout_ms <= 0)
+			break;
+		if (iot_dns_resolve_addrs(pURLString, &addrs,
+					  timeout_ms) != NONE_ERROR)
+			break;
+		count = connect_addrs(dest, &addrs, port);
+		if (attempt && memcmp(dest, tried, sizeof(dest)) == 0)
+			break;
+
+		timeout_ms = left_ms(pTimer);
+		if (timeout_ms <= 0)
+			break;
+		if (timeout_ms > AWS_IOT_TCP_CONNECT_TIMEOUT_MS)
+			timeout_ms = AWS_IOT_TCP_CONNECT_TIMEOUT_MS;
+
+		ret_val = connect_race(pSocket, dest, count, timeout_ms);
+		if (NONE_ERROR == ret_val) {
+			set_socket_options(*pSocket);
+			break;
 		}
+		if (TCP_SETUP_ERROR == ret_val)
+			return ret_val;
+
+		memcpy(tried, dest, sizeof(tried));
+		iot_dns_flush(pURLString);
 	}
+
 	return ret_val;
 }
 
-IoT_Error_t setSocketToNonBlocking(int server_fd) {
-	net_socket_blocking(server_fd, NET_BLOCKING_OFF);
+/* The wakeup socket is a UDP socket bound to the loopback interface. A
+ * datagram sent to it makes it readable and ends the select() of
+ * iot_tls_wait(). Waiting still works without it, only wakeups are lost */
+static void create_wakeup_socket(TLSDataParams *tls)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	tls->wakeup_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (-1 == tls->wakeup_socket)
+		return;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = 0;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(tls->wakeup_socket, (struct sockaddr *)&addr,
+		 sizeof(addr)) != 0 ||
+	    getsockname(tls->wakeup_socket, (struct sockaddr *)&addr,
+			&addr_len) != 0) {
+		close(tls->wakeup_socket);
+		tls->wakeup_socket = -1;
+		return;
+	}
+
+	tls->wakeup_port = addr.sin_port;
+	net_socket_blocking(tls->wakeup_socket, NET_BLOCKING_OFF);
+}
+
+/* A credential is DER when it starts with an ASN.1 SEQUENCE, its size is
+ * then in its header, otherwise it is a PEM string */
+static int tls_cred_format(const unsigned char *cred)
+{
+	return cred[0] == 0x30 ? SSL_FILETYPE_ASN1 : SSL_FILETYPE_PEM;
+}
+
+static long tls_cred_size(const unsigned char *cred)
+{
+	long len = 0;
+	int i, n;
+
+	if (tls_cred_format(cred) == SSL_FILETYPE_PEM)
+		return strlen((const char *) cred);
+	if (cred[1] < 0x80)
+		return 2 + cred[1];
+	n = cred[1] & 0x7f;
+	if (n == 0 || n > 3)
+		return -1;
+	for (i = 0; i < n; i++)
+		len = (len << 8) | cred[2 + i];
+	return 2 + n + len;
+}
+
+/* Decoded value of a base64 character, -1 for anything else */
+static int tls_base64_value(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+')
+		return 62;
+	if (c == '/')
+		return 63;
+	return -1;
+}
+
+int iot_tls_pem_to_der(const char *pPem, unsigned char *pDer, int derLen)
+{
+	const char *p;
+	uint32_t bits = 0;
+	int v, nbits = 0, len = 0;
+
+	/* Body of the block, after the line of its "-----BEGIN" */
+	p = strstr(pPem, "-----BEGIN");
+	if (!p)
+		return -1;
+	p = strchr(p, '\n');
+	if (!p)
+		return -1;
+
+	for (p++; *p && *p != '-' && *p != '='; p++) {
+		v = tls_base64_value(*p);
+		if (v < 0) {
+			if (*p == '\r' || *p == '\n')
+				continue;
+			return -1;
+		}
+		bits = (bits << 6) | v;
+		nbits += 6;
+		if (nbits >= 8) {
+			nbits -= 8;
+			if (len == derLen)
+				return -1;
+			pDer[len++] = bits >> nbits;
+		}
+	}
+	return len > 0 && pDer[0] == 0x30 ? len : -1;
+}
+
+/* Code of a record length in the max_fragment_length extension, 0 if the
+ * extension has none for it */
+static unsigned char tls_mfl_code(int len)
+{
+	switch (len) {
+	case 512:
+		return 1;
+	case 1024:
+		return 2;
+	case 2048:
+		return 3;
+	case 4096:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/* Asks the server for records of at most cfg->max_fragment_len bytes */
+static int tls_client_ctx_mfl(WOLFSSL_CTX *ctx, const tls_init_config_t *cfg)
+{
+	unsigned char mfl;
+
+	if (!cfg->max_fragment_len)
+		return SSL_SUCCESS;
+
+	mfl = tls_mfl_code(cfg->max_fragment_len);
+	if (!mfl) {
+		ERROR("No TLS fragment length of %d", cfg->max_fragment_len);
+		return -1;
+	}
+	if (!wolfSSL_CTX_UseMaxFragment) {
+		DEBUG("TLS library without max_fragment_length");
+		return SSL_SUCCESS;
+	}
+	return wolfSSL_CTX_UseMaxFragment(ctx, mfl);
+}
+
+/* With AWS_IOT_TLS_ECC, offers the ECDHE suites first if the library has
+ * elliptic curves. The key agreement is then a P-256 one instead of none
+ * or a 2048 bit DH, and an ECDSA device key signs the handshake much faster
+ * than an RSA key. Only P-256 is offered, the cheapest curve AWS IoT takes */
+static int tls_client_ctx_ciphers(WOLFSSL_CTX *ctx)
+{
+#if AWS_IOT_TLS_ECC
+	if (wolfSSL_CTX_UseSupportedCurve) {
+		if (wolfSSL_CTX_UseSupportedCurve(ctx, WOLFSSL_ECC_SECP256R1) !=
+		    SSL_SUCCESS)
+			return -1;
+#ifdef AWS_IOT_TLS_CIPHER_LIST
+		return wolfSSL_CTX_set_cipher_list(ctx,
+			AWS_IOT_TLS_ECC_CIPHER_LIST ":" AWS_IOT_TLS_CIPHER_LIST);
+#else
+		return SSL_SUCCESS;
+#endif
+	}
+#endif
+#ifdef AWS_IOT_TLS_CIPHER_LIST
+	return wolfSSL_CTX_set_cipher_list(ctx, AWS_IOT_TLS_CIPHER_LIST);
+#else
+	return SSL_SUCCESS;
+#endif
+}
+
+/* Parses the certificates of cfg. Their sizes are only worked out here, a
+ * reconnect finds its context by the certificate pointers */
+static WOLFSSL_CTX *tls_client_ctx_create(const tls_init_config_t *cfg)
+{
+	const unsigned char *ca = cfg->tls.client.ca_cert;
+	const unsigned char *cert = cfg->tls.client.client_cert;
+	const unsigned char *key = cfg->tls.client.client_key;
+	WOLFSSL_CTX *ctx;
+	int ret;
+
+	ctx = wolfSSL_CTX_new(wolfSSLv23_client_method());
+	if (!ctx)
+		return NULL;
+
+	ret = tls_client_ctx_ciphers(ctx);
+	if (ret == SSL_SUCCESS)
+		ret = tls_client_ctx_mfl(ctx, cfg);
+	if (ret == SSL_SUCCESS && ca)
+		ret = wolfSSL_CTX_load_verify_buffer(ctx, ca,
+			tls_cred_size(ca), tls_cred_format(ca));
+	if (ret == SSL_SUCCESS && (cfg->flags & TLS_USE_CLIENT_CERT)) {
+		if ((cfg->flags & TLS_CERT_BUFFER_CHAINED) &&
+		    tls_cred_format(cert) == SSL_FILETYPE_PEM)
+			ret = wolfSSL_CTX_use_certificate_chain_buffer(ctx,
+				cert, tls_cred_size(cert));
+		else
+			ret = wolfSSL_CTX_use_certificate_buffer(ctx, cert,
+				tls_cred_size(cert), tls_cred_format(cert));
+		if (ret == SSL_SUCCESS)
+			ret = wolfSSL_CTX_use_PrivateKey_buffer(ctx, key,
+				tls_cred_size(key), tls_cred_format(key));
+	}
+	if (ret != SSL_SUCCESS) {
+		wolfSSL_CTX_free(ctx);
+		return NULL;
+	}
+
+	wolfSSL_CTX_set_verify(ctx, (cfg->flags & TLS_CHECK_SERVER_CERT) ?
+			       SSL_VERIFY_PEER : SSL_VERIFY_NONE, NULL);
+	wolfSSL_SetIORecv(ctx, tls_netconn_recv);
+	return ctx;
+}
+
+/* Find the cached client for the certificates of cfg, or take a free
+ * entry for them. -1 when all entries are used by other certificates */
+static int tls_client_find(const tls_init_config_t *cfg, uint32_t host_hash)
+{
+	int i, free_entry = -1;
+
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++) {
+		tls_client_t *client = &tls_clients[i];
+
+		if (!client->ctx) {
+			if (free_entry < 0)
+				free_entry = i;
+			continue;
+		}
+		if (client->ca_cert == cfg->tls.client.ca_cert &&
+		    client->client_cert == cfg->tls.client.client_cert &&
+		    client->client_key == cfg->tls.client.client_key &&
+		    client->flags == cfg->flags &&
+		    client->max_fragment_len == cfg->max_fragment_len &&
+		    (!client->host_hash || !host_hash ||
+		     client->host_hash == host_hash)) {
+			if (!client->host_hash)
+				client->host_hash = host_hash;
+			return i;
+		}
+	}
+
+	if (free_entry >= 0) {
+		tls_client_t *client = &tls_clients[free_entry];
+
+		client->ctx = tls_client_ctx_create(cfg);
+		if (!client->ctx)
+			return -1;
+		client->ca_cert = cfg->tls.client.ca_cert;
+		client->client_cert = cfg->tls.client.client_cert;
+		client->client_key = cfg->tls.client.client_key;
+		client->flags = cfg->flags;
+		client->max_fragment_len = cfg->max_fragment_len;
+		client->host_hash = host_hash;
+		client->session = NULL;
+#if AWS_IOT_TLS_VERIFY_CACHE
+		client->verified = false;
+#endif
+	}
+	return free_entry;
+}
+
+/* FNV-1a of the host name, 0 is kept for no host */
+static uint32_t tls_host_hash(const char *host)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*host) {
+		hash ^= (uint8_t) *host++;
+		hash *= 16777619u;
+	}
+	return hash ? hash : 1;
+}
+
+#if AWS_IOT_TLS_VERIFY_CACHE
+/* Content of the DER element at p with the given tag, NULL if there is
+ * none before end. *next is set past the element */
+static const uint8_t *tls_der_item(const uint8_t *p, const uint8_t *end,
+				   uint8_t tag, const uint8_t **next)
+{
+	size_t len, n;
+
+	if (end - p < 2 || p[0] != tag)
+		return NULL;
+	len = p[1];
+	p += 2;
+	if (len & 0x80) {
+		n = len & 0x7f;
+		if (!n || n > 3 || (size_t) (end - p) < n)
+			return NULL;
+		for (len = 0; n; n--)
+			len = len << 8 | *p++;
+	}
+	if (len > (size_t) (end - p))
+		return NULL;
+	*next = p + len;
+	return p;
+}
+
+static int tls_der_digits(const uint8_t *p, int n)
+{
+	int v = 0;
+
+	while (n--) {
+		if (*p < '0' || *p > '9')
+			return -1;
+		v = v * 10 + (*p++ - '0');
+	}
+	return v;
+}
+
+/* notAfter of a certificate, RFC 5280 4.1.2.5, -1 if it can not be read */
+static time_t tls_cert_not_after(const uint8_t *der, int len)
+{
+	const uint8_t *end = der + len, *p, *next;
+	struct tm tm;
+	int year;
+
+	p = tls_der_item(der, end, 0x30, &next);
+	if (p)
+		p = tls_der_item(p, next, 0x30, &end);
+	/* Version, serial number, signature algorithm and issuer */
+	if (p && p[0] == 0xa0)
+		tls_der_item(p, end, 0xa0, &p);
+	if (p && tls_der_item(p, end, 0x02, &p) &&
+	    tls_der_item(p, end, 0x30, &p) && tls_der_item(p, end, 0x30, &p))
+		p = tls_der_item(p, end, 0x30, &end);
+	else
+		p = NULL;
+	if (!p)
+		return -1;
+	/* notBefore, then notAfter as UTCTime or GeneralizedTime */
+	if (p >= end || !tls_der_item(p, end, p[0], &p) || p >= end)
+		return -1;
+	memset(&tm, 0, sizeof(tm));
+	if (p[0] == 0x17 && p + 15 <= end && p[1] == 13) {
+		year = tls_der_digits(p + 2, 2);
+		if (year >= 0)
+			year += year < 50 ? 2000 : 1900;
+		p += 4;
+	} else if (p[0] == 0x18 && p + 17 <= end && p[1] == 15) {
+		year = tls_der_digits(p + 2, 4);
+		p += 6;
+	} else {
+		return -1;
+	}
+	tm.tm_year = year - 1900;
+	tm.tm_mon = tls_der_digits(p, 2) - 1;
+	tm.tm_mday = tls_der_digits(p + 2, 2);
+	tm.tm_hour = tls_der_digits(p + 4, 2);
+	tm.tm_min = tls_der_digits(p + 6, 2);
+	tm.tm_sec = tls_der_digits(p + 8, 2);
+	if (year < 0 || tm.tm_mon < 0 || tm.tm_mday < 0 || tm.tm_hour < 0 ||
+	    tm.tm_min < 0 || tm.tm_sec < 0 || p[10] != 'Z')
+		return -1;
+	return mktime(&tm);
+}
+
+/* Digest of the chain the server sent and the earliest end of validity of
+ * its certificates, -1 when the library does not keep the chain */
+static int tls_peer_chain(WOLFSSL *ssl, uint8_t *digest, time_t *not_after)
+{
+	WOLFSSL_X509_CHAIN *chain;
+	struct sha256_ctx s;
+	const unsigned char *der;
+	uint8_t len[4];
+	time_t t;
+	int i, n, l;
+
+	if (!wolfSSL_get_peer_chain || !wolfSSL_get_chain_count ||
+	    !wolfSSL_get_chain_length || !wolfSSL_get_chain_cert)
+		return -1;
+	chain = wolfSSL_get_peer_chain(ssl);
+	n = chain ? wolfSSL_get_chain_count(chain) : 0;
+	if (n <= 0)
+		return -1;
+
+	sha256_init(&s);
+	*not_after = -1;
+	for (i = 0; i < n; i++) {
+		der = wolfSSL_get_chain_cert(chain, i);
+		l = wolfSSL_get_chain_length(chain, i);
+		if (!der || l <= 0)
+			return -1;
+		/* The lengths keep the certificates apart */
+		len[0] = l >> 24;
+		len[1] = l >> 16;
+		len[2] = l >> 8;
+		len[3] = l;
+		sha256_update(&s, len, sizeof(len));
+		sha256_update(&s, der, l);
+		t = tls_cert_not_after(der, l);
+		if (t == -1)
+			return -1;
+		if (*not_after == -1 || t < *not_after)
+			*not_after = t;
+	}
+	sha256_final(&s, digest);
 	return 0;
 }
 
-tls_handle_t tls_handle;
-tls_init_config_t tls_cfg;
+/* Whether the chain verified last still stands in for the verification */
+static bool tls_verify_cache_hit(const tls_client_t *client)
+{
+	return client->verified &&
+		os_ticks_get() - client->verified_at <
+		os_msec_to_ticks(AWS_IOT_TLS_VERIFY_CACHE_MAX_AGE_S * 1000) &&
+		wmtime_time_get_posix() < client->not_after;
+}
+
+/* After a full handshake: a chain verified by the library is kept, one let
+ * through on the cache has to be the kept one */
+static IoT_Error_t tls_verify_cache_check(tls_client_t *client, WOLFSSL *ssl,
+					  bool cached)
+{
+	uint8_t digest[SHA256_LEN];
+	time_t not_after;
+
+	if (tls_peer_chain(ssl, digest, &not_after) < 0) {
+		client->verified = false;
+		return cached ? SSL_CERT_ERROR : NONE_ERROR;
+	}
+	if (cached) {
+		if (memcmp(digest, client->chain_digest, sizeof(digest)) == 0)
+			return NONE_ERROR;
+		WARN("Server certificate chain changed, verifying it again");
+		client->verified = false;
+		return SSL_CERT_ERROR;
+	}
+	memcpy(client->chain_digest, digest, sizeof(digest));
+	client->not_after = not_after;
+	client->verified_at = os_ticks_get();
+	client->verified = true;
+	return NONE_ERROR;
+}
+#endif
+
+static IoT_Error_t tls_client_session_init(TLSDataParams *tls, int sockfd,
+					   const char *host)
+{
+	tls_client_t *client = NULL;
+	WOLFSSL_CTX *ctx;
+	WOLFSSL *ssl;
+	bool cached = false;
+	int ret;
+
+	tls->client = tls_client_find(&tls->tls_cfg, tls_host_hash(host));
+	if (tls->client >= 0) {
+		client = &tls_clients[tls->client];
+		ctx = client->ctx;
+	} else {
+		ctx = tls_client_ctx_create(&tls->tls_cfg);
+		if (!ctx)
+			return SSL_CERT_ERROR;
+		tls->ssl_ctx = ctx;
+	}
+
+	/* The context and its certificates outlive the connection, they are
+	 * taken from the heap before */
+	tls_arena_enter(tls);
+	ssl = wolfSSL_new(ctx);
+	if (!ssl)
+		goto fail;
+	if (wolfSSL_set_fd(ssl, sockfd) != SSL_SUCCESS)
+		goto fail;
+	/* Sends still go through the socket, receives skip it */
+	tls->rx_conn = lwip_get_netconn(sockfd);
+	if (!tls->rx_conn)
+		goto fail;
+	netconn_set_noautorecved(tls->rx_conn, 1);
+	wolfSSL_SetIOReadCtx(ssl, tls);
+#if AWS_IOT_TLS_SESSION_RESUME
+	/* Offer the session of the previous connection, the server falls
+	 * back to a full handshake if it does not have it any more */
+	if (client && client->session)
+		wolfSSL_set_session(ssl, client->session);
+#endif
+#if AWS_IOT_TLS_VERIFY_CACHE
+	/* The same chain as last time is compared after the handshake instead
+	 * of having its signatures checked */
+	if (client && (client->flags & TLS_CHECK_SERVER_CERT) &&
+	    tls_verify_cache_hit(client)) {
+		cached = true;
+		wolfSSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
+	}
+#endif
+	/* The public key operations of the handshake run at full speed */
+	cpu_clk_boost_begin();
+	ret = wolfSSL_connect(ssl);
+	cpu_clk_boost_end();
+	tls_arena_exit(tls);
+	if (ret != SSL_SUCCESS) {
+		/* The session may be what the server objects to */
+		if (client)
+			client->session = NULL;
+		goto fail;
+	}
+
+#if AWS_IOT_TLS_VERIFY_CACHE
+	/* A resumed session sends no chain, it was checked when the session
+	 * was made */
+	if (client && (client->flags & TLS_CHECK_SERVER_CERT) &&
+	    !wolfSSL_session_reused(ssl) &&
+	    tls_verify_cache_check(client, ssl, cached) != NONE_ERROR) {
+		client->session = NULL;
+		wolfSSL_shutdown(ssl);
+		goto fail;
+	}
+#endif
+	if (client) {
+		client->session = wolfSSL_get_session(ssl);
+		DEBUG("TLS session %s", wolfSSL_session_reused(ssl) ?
+		      "resumed" : "established");
+	}
+	tls->ssl = ssl;
+	return NONE_ERROR;
+
+fail:
+	tls_arena_exit(tls);
+	if (ssl)
+		wolfSSL_free(ssl);
+	tls_arena_reset(tls);
+	tls_netconn_release(tls);
+	if (tls->ssl_ctx) {
+		wolfSSL_CTX_free(tls->ssl_ctx);
+		tls->ssl_ctx = NULL;
+	}
+	return SSL_CONNECT_ERROR;
+}
+
+#if AWS_IOT_MQTT_THREAD_SAFE
+static void tls_ssl_lock(TLSDataParams *tls)
+{
+	os_mutex_get(&tls->ssl_lock, OS_WAIT_FOREVER);
+}
+
+static void tls_ssl_unlock(TLSDataParams *tls)
+{
+	os_mutex_put(&tls->ssl_lock);
+}
+#else
+static inline void tls_ssl_lock(TLSDataParams *tls)
+{
+}
+
+static inline void tls_ssl_unlock(TLSDataParams *tls)
+{
+}
+#endif
+
+static void tls_client_session_close(TLSDataParams *tls)
+{
+	/* Not under a read or a write of another thread */
+	tls_ssl_lock(tls);
+	wolfSSL_shutdown(tls->ssl);
+	wolfSSL_free(tls->ssl);
+	tls->ssl = NULL;
+	tls_ssl_unlock(tls);
+	tls_arena_reset(tls);
+	tls_netconn_release(tls);
+	if (tls->ssl_ctx) {
+		wolfSSL_CTX_free(tls->ssl_ctx);
+		tls->ssl_ctx = NULL;
+	}
+}
+
+static void tls_client_cfg(tls_init_config_t *cfg, const char *ca,
+			   const char *cert, const char *key)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	/* Servers other than AWS IoT, e.g. of downloads, may not ask for one */
+	cfg->flags = cert ? TLS_USE_CLIENT_CERT : 0;
+	if (ca)
+		cfg->flags |= TLS_CHECK_SERVER_CERT;
+	cfg->tls.client.ca_cert = (const unsigned char *) ca;
+	cfg->tls.client.client_cert = (const unsigned char *) cert;
+	cfg->tls.client.client_key = (const unsigned char *) key;
+	cfg->max_fragment_len = AWS_IOT_TLS_MAX_FRAGMENT_LEN;
+}
+
+int iot_tls_credentials_load(const char *pRootCA, const char *pDeviceCert,
+			     const char *pDevicePrivateKey)
+{
+	tls_init_config_t cfg;
+
+	tls_client_cfg(&cfg, pRootCA, pDeviceCert, pDevicePrivateKey);
+	return tls_client_find(&cfg, 0) < 0 ? SSL_CERT_ERROR : NONE_ERROR;
+}
+
+/* State of the WLAN link given by iot_tls_link_event(), and the connected
+ * networks to wake when it goes down */
+static volatile int tls_link_up = 1;
+static Network *tls_networks[AWS_IOT_TLS_CONNECTIONS];
+
+static void tls_network_add(Network *pNetwork)
+{
+	int i, free_slot = -1;
+
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++) {
+		if (tls_networks[i] == pNetwork)
+			return;
+		if (!tls_networks[i] && free_slot < 0)
+			free_slot = i;
+	}
+	if (free_slot >= 0)
+		tls_networks[free_slot] = pNetwork;
+}
+
+static void tls_network_remove(Network *pNetwork)
+{
+	int i;
+
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++)
+		if (tls_networks[i] == pNetwork)
+			tls_networks[i] = NULL;
+}
 
 int iot_tls_connect(Network *pNetwork, TLSConnectParams params) 
 {
 	IoT_Error_t ret_val;
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	Timer timer;
 
-	pNetwork->my_socket = Create_TCPSocket();
-	if (-1 == pNetwork->my_socket) {
-		ret_val = TCP_SETUP_ERROR;
-		return ret_val;
+	/* The handshake timeout covers the whole connect, name resolution
+	 * included */
+	InitTimer(&timer);
+	countdown_ms(&timer, params.timeout_ms);
+
+#if AWS_IOT_MQTT_THREAD_SAFE
+	if (NULL == tls->ssl_lock &&
+	    WM_SUCCESS != os_mutex_create(&tls->ssl_lock, "tls",
+					  OS_MUTEX_INHERIT)) {
+		tls->ssl_lock = NULL;
+		return SSL_CONNECT_ERROR;
 	}
+#endif
+	pNetwork->my_socket = -1;
+	ret_val = Connect_TCPSocket(&pNetwork->my_socket,
+				    params.pDestinationURL,
+				    params.DestinationPort, &timer);
+	if (NONE_ERROR != ret_val)
+		return ret_val;
+	tls_rx_buf_reset(tls);
+	tls->failed = 0;
+	/* The handshake already goes out with the priority of the connection */
+	iot_tls_set_traffic_class(pNetwork, params.trafficClass);
+	tls_set_rx_timeout(pNetwork, left_ms(&timer) > 0 ? left_ms(&timer) : 1);
+	tls_client_cfg(&tls->tls_cfg, params.pRootCALocation,
+		       params.pDeviceCertLocation,
+		       params.pDevicePrivateKeyLocation);
 
-	ret_val = Connect_TCPSocket(pNetwork->my_socket, params.pDestinationURL,
-				    params.DestinationPort);
+	ret_val = tls_client_session_init(tls, pNetwork->my_socket,
+					  params.pDestinationURL);
 	if (NONE_ERROR != ret_val) {
 		Close_TCPSocket(&pNetwork->my_socket);
 		return ret_val;
 	}
-	tls_cfg.flags = TLS_USE_CLIENT_CERT;
-	tls_cfg.tls.client.client_cert = (unsigned char *)
-		params.pDeviceCertLocation;
-	tls_cfg.tls.client.client_cert_size = strlen(params.pDeviceCertLocation);
-	tls_cfg.tls.client.client_key = (unsigned char *)
-		params.pDevicePrivateKeyLocation;
-	tls_cfg.tls.client.client_key_size = strlen(
-		params.pDevicePrivateKeyLocation);
-	tls_cfg.tls.client.ca_cert = (unsigned char *)params.pRootCALocation;
-	tls_cfg.tls.client.ca_cert_size = strlen(params.pRootCALocation);
-
-	ret_val = tls_session_init(&tls_handle, pNetwork->my_socket, &tls_cfg);
-	if (NONE_ERROR != ret_val)
-		Close_TCPSocket(&pNetwork->my_socket);
+
+	if (-1 == tls->wakeup_socket)
+		create_wakeup_socket(tls);
+	tls_network_add(pNetwork);
 	return ret_val;
 }
 
-int iot_tls_read(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) 
+/* The wolfSSL calls, where the records are decrypted and encrypted, are
+ * the TLS spans of the cycle trace */
+static AWS_IOT_HOT_FUNC int tls_ssl_read(TLSDataParams *tls, unsigned char *buf,
+					 int len)
 {
-	int val = 0;
-	int recv_len = 0;
-	fd_set fds;
+	int ret;
 
-	FD_ZERO(&fds);
-	FD_SET(pNetwork->my_socket, &fds);
+	tls_ssl_lock(tls);
+	CYCLE_TRACE_BEGIN(CYCLE_TRACE_TLS_READ);
+	ret = wolfSSL_read(tls->ssl, buf, len);
+	CYCLE_TRACE_END(CYCLE_TRACE_TLS_READ);
+	tls_ssl_unlock(tls);
+	return ret;
+}
 
-	setsockopt(pNetwork->my_socket, SOL_SOCKET, SO_RCVTIMEO,
-		   (void *)&timeout_ms, sizeof(timeout_ms));
+static int tls_ssl_write(TLSDataParams *tls, const unsigned char *buf,
+			 int len)
+{
+	int ret;
+
+	tls_ssl_lock(tls);
+	CYCLE_TRACE_BEGIN(CYCLE_TRACE_TLS_WRITE);
+	ret = wolfSSL_write(tls->ssl, buf, len);
+	CYCLE_TRACE_END(CYCLE_TRACE_TLS_WRITE);
+	tls_ssl_unlock(tls);
+	/* The writes block, nothing sent means the socket failed */
+	if (ret <= 0)
+		tls->failed = 1;
+	return ret;
+}
+
+AWS_IOT_HOT_FUNC int iot_tls_read(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) 
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	int val = 0;
+	int recv_len = 0;
+	int avail;
 
 	do {
-		if (tls_handle)
-			val = tls_recv(tls_handle, pMsg + recv_len,
-				       len - recv_len);
-		if (val < 1)
+		avail = tls->rx_tail - tls->rx_head;
+		if (avail > 0) {
+			if (avail > len - recv_len)
+				avail = len - recv_len;
+			/* Not when the bytes were peeked and are read in place */
+			if (pMsg + recv_len != tls->rx_buf + tls->rx_head)
+				memcpy(pMsg + recv_len,
+				       tls->rx_buf + tls->rx_head, avail);
+			tls->rx_head += avail;
+			recv_len += avail;
+			continue;
+		}
+
+		if (!tls->ssl)
 			break;
-		recv_len += val;
+
+		tls_set_rx_timeout(pNetwork, timeout_ms);
+
+		if (len - recv_len >= AWS_IOT_TLS_RX_BUF_LEN) {
+			/* Large payload reads bypass the buffer to avoid a
+			 * second copy */
+			val = tls_ssl_read(tls, pMsg + recv_len,
+					   len - recv_len);
+			tls->rx_pending = (val == len - recv_len);
+			if (val < 1)
+				break;
+			recv_len += val;
+		} else {
+			val = tls_ssl_read(tls, tls->rx_buf,
+					   AWS_IOT_TLS_RX_BUF_LEN);
+			tls->rx_pending = (val == AWS_IOT_TLS_RX_BUF_LEN);
+			if (val < 1)
+				break;
+			tls->rx_head = 0;
+			tls->rx_tail = val;
+		}
 	} while (recv_len < len);
 
 	return recv_len;
 }
 
+int iot_tls_peek(Network *pNetwork, unsigned char **ppMsg, int len,
+		 int timeout_ms)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	int val;
+
+	/* One byte stays behind the bytes, for a NUL terminator */
+	if (len >= AWS_IOT_TLS_RX_BUF_LEN)
+		return -1;
+
+	if (tls->rx_head == tls->rx_tail)
+		tls->rx_head = tls->rx_tail = 0;
+	while (tls->rx_tail - tls->rx_head < len) {
+		if (!tls->ssl)
+			return 0;
+		if (tls->rx_head + len >= AWS_IOT_TLS_RX_BUF_LEN) {
+			memmove(tls->rx_buf, tls->rx_buf + tls->rx_head,
+				tls->rx_tail - tls->rx_head);
+			tls->rx_tail -= tls->rx_head;
+			tls->rx_head = 0;
+		}
+
+		tls_set_rx_timeout(pNetwork, timeout_ms);
+		val = tls_ssl_read(tls, tls->rx_buf + tls->rx_tail,
+				   AWS_IOT_TLS_RX_BUF_LEN - tls->rx_tail);
+		tls->rx_pending = (val == AWS_IOT_TLS_RX_BUF_LEN - tls->rx_tail);
+		if (val < 1)
+			return 0;
+		tls->rx_tail += val;
+	}
+
+	*ppMsg = tls->rx_buf + tls->rx_head;
+	return len;
+}
+
+static int tls_tx_buf_send(TLSDataParams *tls)
+{
+	int len = tls->tx_len, ret;
+
+	if (!len)
+		return 0;
+	tls->tx_len = 0;
+	ret = tls_ssl_write(tls, tls->tx_buf, len);
+	return ret == len ? 0 : GENERIC_ERROR;
+}
+
+/* While corked the writes fill tx_buf, a full tx_buf goes out as one
+ * record and a partial count tells the caller to write the rest */
 int iot_tls_write(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) 
 {
-	if (tls_handle)
-		return tls_send(tls_handle, pMsg, len);
-	return GENERIC_ERROR;
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	int n;
+
+	if (!tls->ssl)
+		return GENERIC_ERROR;
+	if (!tls->tx_corked ||
+	    (!tls->tx_len && len >= AWS_IOT_TLS_TX_BUF_LEN))
+		return tls_ssl_write(tls, pMsg, len);
+
+	n = AWS_IOT_TLS_TX_BUF_LEN - tls->tx_len;
+	if (n > len)
+		n = len;
+	/* Not when the packet was serialized in place */
+	if (pMsg != tls->tx_buf + tls->tx_len)
+		memcpy(tls->tx_buf + tls->tx_len, pMsg, n);
+	tls->tx_len += n;
+	if (tls->tx_len == AWS_IOT_TLS_TX_BUF_LEN &&
+	    tls_tx_buf_send(tls) != 0)
+		return GENERIC_ERROR;
+	return n;
+}
+
+unsigned char *iot_tls_write_buf(Network *pNetwork, int min_len, int *pLen)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+
+	/* A failed send drops the writes, the connection is lost anyway */
+	if (AWS_IOT_TLS_TX_BUF_LEN - tls->tx_len < min_len && tls->ssl)
+		tls_tx_buf_send(tls);
+
+	*pLen = AWS_IOT_TLS_TX_BUF_LEN - tls->tx_len;
+	return tls->tx_buf + tls->tx_len;
+}
+
+void iot_tls_cork(Network *pNetwork)
+{
+	pNetwork->tlsDataParams.tx_corked = 1;
+}
+
+int iot_tls_flush(Network *pNetwork, int timeout_ms)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+
+	tls->tx_corked = 0;
+	if (!tls->ssl) {
+		tls->tx_len = 0;
+		return GENERIC_ERROR;
+	}
+	return tls_tx_buf_send(tls);
+}
+
+int iot_tls_wait(Network *pNetwork, int timeout_ms)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	struct timeval tv;
+	fd_set rfds;
+	int maxfd = pNetwork->my_socket;
+	int ret;
+	char c;
+
+	if (!tls->ssl)
+		return GENERIC_ERROR;
+
+	/* select() does not see data the TLS layer already decrypted, nor
+	 * what is left of the pbuf taken from the socket */
+	if (tls->rx_tail > tls->rx_head || tls->rx_pending || tls->rx_pbuf)
+		return NETWORK_WAIT_BUFFERED;
+
+	FD_ZERO(&rfds);
+	FD_SET(pNetwork->my_socket, &rfds);
+	if (-1 != tls->wakeup_socket) {
+		FD_SET(tls->wakeup_socket, &rfds);
+		if (tls->wakeup_socket > maxfd)
+			maxfd = tls->wakeup_socket;
+	}
+
+	if (timeout_ms < 0)
+		timeout_ms = 0;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	ret = select(maxfd + 1, &rfds, NULL, NULL, &tv);
+	if (ret < 0)
+		return GENERIC_ERROR;
+	if (ret == 0)
+		return NETWORK_WAIT_TIMEOUT;
+
+	if (FD_ISSET(pNetwork->my_socket, &rfds))
+		return NETWORK_WAIT_READABLE;
+
+	/* Consume all pending wakeups, they are all answered by this return */
+	while (recv(tls->wakeup_socket, &c, sizeof(c), 0) > 0)
+		;
+	return NETWORK_WAIT_WOKEN;
+}
+
+void iot_tls_wakeup(Network *pNetwork)
+{
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	struct sockaddr_in addr;
+	char c = 0;
+
+	if (-1 == tls->wakeup_socket)
+		return;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = tls->wakeup_port;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sendto(tls->wakeup_socket, &c, sizeof(c), 0,
+	       (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int iot_tls_set_traffic_class(Network *pNetwork, NetworkTrafficClass tc)
+{
+	int tos;
+
+	if ((unsigned) tc >= sizeof(traffic_class_tos))
+		return GENERIC_ERROR;
+	if (-1 == pNetwork->my_socket)
+		return 0;
+
+	tos = traffic_class_tos[tc];
+	if (setsockopt(pNetwork->my_socket, IPPROTO_IP, IP_TOS, &tos,
+		       sizeof(tos)) != 0)
+		return GENERIC_ERROR;
+	return 0;
 }
 
 void iot_tls_disconnect(Network *pNetwork) 
 {
-	if (tls_handle)
-		tls_close(&tls_handle);
+	tls_network_remove(pNetwork);
+	if (pNetwork->tlsDataParams.ssl)
+		tls_client_session_close(&pNetwork->tlsDataParams);
 	Close_TCPSocket(&pNetwork->my_socket);
+	Close_TCPSocket(&pNetwork->tlsDataParams.wakeup_socket);
+	tls_rx_buf_reset(&pNetwork->tlsDataParams);
+	pNetwork->tlsDataParams.tx_len = 0;
+	pNetwork->tlsDataParams.tx_corked = 0;
 
 	return;
 }
@@ -232,7 +1526,34 @@ int iot_tls_destroy(Network *pNetwork)
 	return 0;
 }
 
+/* The station is up with an address, the auto reconnect waits for it
+ * without making attempts. Once connected, the socket has to be alive as
+ * well: a reset, a close by the peer, a failed write or the TCP keepalive
+ * giving up all leave an error on the netconn or the failed flag, and the
+ * MQTT client asks for this before each keepalive check */
 int iot_tls_is_connected(Network *pNetwork)
 {
-	return 1;
+	TLSDataParams *tls = &pNetwork->tlsDataParams;
+	struct netif *netif = netif_default;
+
+	if (!tls_link_up || NULL == netif || !netif_is_up(netif) ||
+	    ip_addr_isany(&netif->ip_addr))
+		return 0;
+	if (NULL == tls->ssl)
+		return 1;
+	return !tls->failed &&
+		!(tls->rx_conn && ERR_IS_FATAL(netconn_err(tls->rx_conn)));
+}
+
+void iot_tls_link_event(int up)
+{
+	int i;
+
+	tls_link_up = up;
+	if (up)
+		return;
+	/* Have the yields waiting on the sockets notice it now */
+	for (i = 0; i < AWS_IOT_TLS_CONNECTIONS; i++)
+		if (tls_networks[i])
+			iot_tls_wakeup(tls_networks[i]);
 }
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file network_platform.h
+ * @brief wmsdk specific TLS connection state kept in the Network struct.
+ */
+
+#ifndef __NETWORK_PLATFORM_H_
+#define __NETWORK_PLATFORM_H_
+
+#include "aws_iot_config.h"
+#include <compiler.h>
+
+/** Marks the functions of the MQTT receive path, run from SRAM in an XIP image */
+#define AWS_IOT_HOT_FUNC __ramfunc
+
+typedef enum {
+	/* TLS server mode */
+	/* If this flag bit is zero client mode is assumed.*/
+	TLS_SERVER_MODE = 0x01,
+	TLS_CHECK_CLIENT_CERT = 0x02,
+
+	/* TLS Client mode */
+	TLS_CHECK_SERVER_CERT = 0x04,
+	/* This will be needed if server mandates client certificate. If
+	   this flag is enabled then client_cert and client_key from the
+	   client structure in the union tls (from tls_init_config_t)
+	   needs to be passed to tls_client_session_init() */
+	TLS_USE_CLIENT_CERT = 0x08,
+#ifdef CONFIG_WPA2_ENTP
+	TLS_WPA2_ENTP = 0x10,
+#endif
+	/* Set this bit if given client_cert (client mode) or server_cert
+	   (server mode) is a chained buffer */
+	TLS_CERT_BUFFER_CHAINED = 0x20,
+} tls_flags_t;
+
+typedef struct {
+	/** OR of flags defined in \ref tls_flags_t */
+	int flags;
+	/** Either a client or a server can be configured at a time through
+	   tls_client_session_init(). Fill up appropriate structure from the
+	   below union depending on your requirement. */
+	union {
+		/** Structure for client TLS configuration */
+		struct {
+			/**
+			 * Needed if the RADIUS server mandates verification of
+			 * CA certificate. Otherwise set to NULL.*/
+			const unsigned char *ca_cert;
+			/** Size of CA_cert */
+			int ca_cert_size;
+			/**
+			 * Needed if the server mandates verification of
+			 * client certificate. Otherwise set to NULL. In
+			 * the former case please OR the flag
+			 * TLS_USE_CLIENT_CERT to flags variable in
+			 * tls_init_config_t passed to tls_client_session_init()
+			 */
+			const unsigned char *client_cert;
+			/** Size of client_cert */
+			int client_cert_size;
+			/** Client private key */
+			const unsigned char *client_key;
+			/** Size of client key */
+			int client_key_size;
+		} client;
+		/** Structure for server TLS configuration */
+		struct {
+			/** Mandatory. Will be sent to the client */
+			const unsigned char *server_cert;
+			/** Size of server_cert */
+			int server_cert_size;
+			/**
+			 * Server private key. Mandatory.
+			 * For the perusal of the server
+			 */
+			const unsigned char *server_key;
+			/** Size of server_key */
+			int server_key_size;
+			/**
+			 * Needed if the server wants to verify client
+			 * certificate. Otherwise set to NULL.
+			 */
+			const unsigned char *client_cert;
+			/** Size of client_cert */
+			int client_cert_size;
+		}server;
+	} tls;
+	/** Client mode. Largest record the server is asked to send through
+	 * the max_fragment_length extension, 512, 1024, 2048 or 4096
+	 * bytes, so that the record buffer of the TLS library does not have
+	 * to take 16384. 0 to leave the extension out. A server that does
+	 * not support it sends records of up to 16384 bytes */
+	int max_fragment_len;
+} tls_init_config_t;
+
+/**
+ * @brief TLS Connection State
+ *
+ * Everything the wmsdk TLS glue needs for one connection. Kept in the
+ * Network struct so that several connections can be open at the same time.
+ */
+typedef struct {
+	void *ssl;			///< wolfSSL connection, NULL when not connected
+	int client;			///< Entry of the client context cache the connection uses, -1 if it has its own context
+	void *ssl_ctx;			///< wolfSSL context of the connection when it is not cached
+	tls_init_config_t tls_cfg;	///< Configuration the TLS session was created with
+	/** Decrypted data is pulled from the TLS layer in chunks of up to
+	 * AWS_IOT_TLS_RX_BUF_LEN bytes so that the small header reads done by
+	 * the MQTT client are served from memory instead of one tls_recv() each */
+	unsigned char rx_buf[AWS_IOT_TLS_RX_BUF_LEN];
+	int rx_head;			///< Offset of the first unread byte in rx_buf
+	int rx_tail;			///< Offset one past the last valid byte in rx_buf
+	int rx_timeout_ms;		///< Receive timeout currently programmed on the socket, -1 if unknown
+	int rx_pending;			///< Last tls_recv() filled the request, the TLS layer may hold more decrypted data
+	int wakeup_socket;		///< Loopback UDP socket used to interrupt iot_tls_wait(), -1 if not created
+	unsigned short wakeup_port;	///< Port wakeup_socket is bound to, in network byte order
+	struct netconn *rx_conn;	///< netconn of the socket, the TLS layer takes the received pbufs from it
+	struct pbuf *rx_pbuf;		///< pbuf taken from rx_conn and not completely passed to the TLS layer yet
+	int rx_pbuf_off;		///< Bytes of rx_pbuf already passed to the TLS layer
+	int rx_unacked;			///< Bytes taken from rx_conn the TCP window was not opened again for
+	int failed;			///< The socket failed or was closed by the peer, the connection is dead
+#if AWS_IOT_MQTT_THREAD_SAFE
+	/** Mutex of the wolfSSL calls on ssl, one thread of the MQTT client
+	 * reads while the others write and a wolfSSL session takes one call
+	 * at a time. Created by the first connect of the zeroed struct and
+	 * kept */
+	void *ssl_lock;
+#endif
+	/** Writes collected between iot_tls_cork() and iot_tls_flush(), encrypted as one record */
+	unsigned char tx_buf[AWS_IOT_TLS_TX_BUF_LEN];
+	int tx_len;			///< Bytes collected in tx_buf
+	int tx_corked;			///< Writes are collected instead of sent
+#if AWS_IOT_TLS_ARENA_LEN
+	/** Allocations of the TLS library while the session is set up, of
+	 * AWS_IOT_TLS_ARENA_LEN bytes. Taken at the first connect and kept,
+	 * iot_tls_init() leaves it alone */
+	unsigned char *arena;
+	int arena_used;			///< Bytes of arena taken since the connect
+	int arena_peak;			///< Most bytes of arena a connection took
+	int arena_heap;			///< Allocations of the set up that did not fit and went to the heap
+	void *arena_owner;		///< Task whose allocations go to arena, NULL outside the set up
+#endif
+} TLSDataParams;
+
+/** Bytes of a datagram before the messages, see datagram_interface.h */
+#define DGRAM_HEADER_LEN	12
+/** Bytes of the CCM MIC ending a datagram */
+#define DGRAM_MIC_LEN		8
+
+/**
+ * @brief Datagram Transport State
+ *
+ * The batch is built in buf behind the header and encrypted in place.
+ */
+typedef struct {
+	int sock;			///< UDP socket connected to the receiver, -1 when not open
+	uint32_t key[4];		///< Pre-shared key
+	uint32_t seq;			///< Sequence number of the next datagram
+	uint32_t first_ms;		///< Time the first message of the batch was added
+	int count;			///< Messages in the batch
+	int len;			///< Bytes in buf, header and messages
+	/** Header and messages, the MIC is written behind them */
+	unsigned char buf[AWS_IOT_DGRAM_MAX_LEN] __attribute__((aligned(4)));
+} DatagramDataParams;
+
+#endif /* __NETWORK_PLATFORM_H_ */
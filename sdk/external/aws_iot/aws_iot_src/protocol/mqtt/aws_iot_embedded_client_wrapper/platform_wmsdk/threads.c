@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file threads.c
+ * @brief WMSDK implementation of the locking interface.
+ */
+
+#include <stddef.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <threads_interface.h>
+
+static unsigned long threads_ticks(uint32_t timeout_ms) {
+	if (THREADS_WAIT_FOREVER == timeout_ms) {
+		return OS_WAIT_FOREVER;
+	}
+	return os_msec_to_ticks(timeout_ms);
+}
+
+int mutex_init(Mutex *m) {
+	if (WM_SUCCESS != os_recursive_mutex_create(&m->mutex, "mqtt")) {
+		m->mutex = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int mutex_lock(Mutex *m, uint32_t timeout_ms) {
+	return (WM_SUCCESS == os_recursive_mutex_get(&m->mutex, threads_ticks(timeout_ms))) ? 0 : -1;
+}
+
+void mutex_unlock(Mutex *m) {
+	os_recursive_mutex_put(&m->mutex);
+}
+
+void mutex_destroy(Mutex *m) {
+	if (NULL != m->mutex) {
+		os_mutex_delete(&m->mutex);
+		m->mutex = NULL;
+	}
+}
+
+int signal_init(Signal *s) {
+	if (WM_SUCCESS != os_semaphore_create(&s->sem, "mqtt")) {
+		s->sem = NULL;
+		return -1;
+	}
+	/* A binary semaphore is created given */
+	os_semaphore_get(&s->sem, OS_NO_WAIT);
+	return 0;
+}
+
+void signal_give(Signal *s) {
+	os_semaphore_put(&s->sem);
+}
+
+int signal_wait(Signal *s, uint32_t timeout_ms) {
+	return (WM_SUCCESS == os_semaphore_get(&s->sem, threads_ticks(timeout_ms))) ? 0 : -1;
+}
+
+void signal_destroy(Signal *s) {
+	if (NULL != s->sem) {
+		os_semaphore_delete(&s->sem);
+		s->sem = NULL;
+	}
+}
+
+void *thread_self(void) {
+	return os_get_current_task_handle();
+}
@@ -15,37 +15,78 @@
 
 /**
  * @file timer.c
- * @brief Linux implementation of the timer interface.
+ * @brief WMSDK implementation of the timer interface.
+ *
+ * Timers keep the time they expire at in microseconds of a 64 bit clock,
+ * so they neither wrap with the 32 bit tick count nor lose the fraction of
+ * a tick.
  */
 
 #include <stddef.h>
+#include <limits.h>
 #include <wm_os.h>
+#include <wm_utils.h>
 #include <timer_interface.h>
 
+#define USEC_PER_TICK	(1000ULL * portTICK_RATE_MS)
+
+uint64_t timer_now_us(void) {
+	unsigned long long ticks;
+	uint32_t usec;
+
+	/* The tick count and the SysTick counter are read again if the tick
+	 * interrupt ran in between. A tick the interrupt has not taken yet,
+	 * interrupts being off or this being a higher priority interrupt, is
+	 * counted here */
+	do {
+		ticks = os_total_ticks_get();
+		usec = os_get_usec_counter();
+		if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+			usec = os_get_usec_counter();
+			ticks++;
+		}
+	} while (!is_isr_context() && ticks < os_total_ticks_get());
+
+	return ticks * USEC_PER_TICK + usec;
+}
+
 char expired(Timer* timer) {
-	if (left_ms(timer) > 0)
-		return 0;
-	else
-		return 1;
+	return timer_now_us() >= timer->end_us;
 }
 
 void countdown_ms(Timer* timer, unsigned int timeout) {
-	timer->timeout = timeout;
-	timer->start_timestamp = os_ticks_get();
+	timer->end_us = timer_now_us() + timeout * 1000ULL;
 }
 
 void countdown(Timer* timer, unsigned int timeout) {
-	/* converting timeout in milliseconds */
-	timer->timeout = timeout * 1000;
-	timer->start_timestamp = os_ticks_get();
+	timer->end_us = timer_now_us() + timeout * 1000000ULL;
+}
+
+void countdown_us(Timer* timer, uint32_t timeout) {
+	timer->end_us = timer_now_us() + timeout;
+}
+
+void countdown_jitter_ms(Timer* timer, unsigned int max) {
+	uint32_t r;
+
+	get_random_sequence(&r, sizeof(r));
+	timer->end_us = timer_now_us() + (r % (max * 1000ULL + 1));
+}
+
+int64_t left_us(Timer* timer) {
+	return (int64_t)(timer->end_us - timer_now_us());
 }
 
 int left_ms(Timer* timer) {
-	unsigned current_timestamp = os_ticks_get();
-	int time_diff_ms = current_timestamp - timer->start_timestamp;
-	return timer->timeout - time_diff_ms;
+	int64_t left = left_us(timer);
+
+	if (left <= 0) {
+		return (left / 1000 < INT_MIN) ? INT_MIN : (int)(left / 1000);
+	}
+	left = (left + 999) / 1000;
+	return (left > INT_MAX) ? INT_MAX : (int)left;
 }
 
 void InitTimer(Timer* timer) {
-	// do nothing
+	timer->end_us = 0;
 }
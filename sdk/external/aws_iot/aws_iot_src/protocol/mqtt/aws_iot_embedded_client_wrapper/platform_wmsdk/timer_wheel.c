@@ -0,0 +1,212 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stddef.h>
+#include <wm_os.h>
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
+/* A timer further away than a turn of the last level is put there anyway,
+ * and put back again when its slot comes round */
+#define TIMER_WHEEL_MAX		((UINT64_C(1) << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+static inline uint32_t rotl(uint32_t v, unsigned n) {
+	n &= 31;
+	return n ? (v << n) | (v >> (32 - n)) : v;
+}
+
+static inline uint32_t rotr(uint32_t v, unsigned n) {
+	n &= 31;
+	return n ? (v >> n) | (v << (32 - n)) : v;
+}
+
+static void pushEntry(TimerWheelEntry **ppList, TimerWheelEntry *pEntry) {
+	pEntry->pPrev = NULL;
+	pEntry->pNext = *ppList;
+	if (*ppList != NULL) {
+		(*ppList)->pPrev = pEntry;
+	}
+	*ppList = pEntry;
+	pEntry->ppList = ppList;
+}
+
+static void unlinkEntry(TimerWheel *pWheel, TimerWheelEntry *pEntry) {
+	TimerWheelEntry **ppList = pEntry->ppList;
+	ptrdiff_t index;
+
+	if (ppList == NULL) {
+		return;
+	}
+
+	if (pEntry->pPrev != NULL) {
+		pEntry->pPrev->pNext = pEntry->pNext;
+	} else {
+		*ppList = pEntry->pNext;
+	}
+	if (pEntry->pNext != NULL) {
+		pEntry->pNext->pPrev = pEntry->pPrev;
+	}
+	pEntry->ppList = NULL;
+
+	if (*ppList == NULL && ppList != &pWheel->pExpired) {
+		index = ppList - &pWheel->slots[0][0];
+		pWheel->pending[index / TIMER_WHEEL_SLOTS] &= ~(UINT32_C(1) << (index % TIMER_WHEEL_SLOTS));
+	}
+}
+
+/* Levels above the first hold a timer in the slot before the one of its
+ * expiry, so that it comes down a level once that slot has gone by */
+static void scheduleEntry(TimerWheel *pWheel, TimerWheelEntry *pEntry) {
+	uint64_t left;
+	int level, slot;
+
+	if (pEntry->expires <= pWheel->now) {
+		pushEntry(&pWheel->pExpired, pEntry);
+		return;
+	}
+
+	left = pEntry->expires - pWheel->now;
+	if (left > TIMER_WHEEL_MAX) {
+		left = TIMER_WHEEL_MAX;
+	}
+	level = (31 - __builtin_clz((uint32_t)left)) / TIMER_WHEEL_BITS;
+	slot = TIMER_WHEEL_MASK & ((pEntry->expires >> (level * TIMER_WHEEL_BITS)) - (level ? 1 : 0));
+
+	pushEntry(&pWheel->slots[level][slot], pEntry);
+	pWheel->pending[level] |= UINT32_C(1) << slot;
+}
+
+/* Bring the wheel up to os_ticks_get(). The slots gone by on each level are
+ * emptied and their timers put again, on a lower level or on the expired
+ * list. A level is only looked at if the one below went round */
+static void advance(TimerWheel *pWheel) {
+	unsigned ticks = os_ticks_get();
+	uint64_t now = pWheel->now + (unsigned)(ticks - pWheel->lastTicks);
+	uint64_t elapsed = now - pWheel->now;
+	TimerWheelEntry *pTodo = NULL, *pEntry;
+	uint32_t passed, mask;
+	int level, slot, oldSlot, newSlot;
+
+	pWheel->lastTicks = ticks;
+	if (elapsed == 0) {
+		return;
+	}
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if ((elapsed >> (level * TIMER_WHEEL_BITS)) > TIMER_WHEEL_MASK) {
+			passed = ~UINT32_C(0);
+		} else {
+			mask = (UINT32_C(1) << (TIMER_WHEEL_MASK & (elapsed >> (level * TIMER_WHEEL_BITS)))) - 1;
+			oldSlot = TIMER_WHEEL_MASK & (pWheel->now >> (level * TIMER_WHEEL_BITS));
+			newSlot = TIMER_WHEEL_MASK & (now >> (level * TIMER_WHEEL_BITS));
+			passed = rotl(mask, oldSlot);
+			passed |= rotr(rotl(mask, newSlot), TIMER_WHEEL_MASK & (elapsed >> (level * TIMER_WHEEL_BITS)));
+			passed |= UINT32_C(1) << newSlot;
+		}
+
+		while ((passed & pWheel->pending[level]) != 0) {
+			slot = __builtin_ctz(passed & pWheel->pending[level]);
+			while ((pEntry = pWheel->slots[level][slot]) != NULL) {
+				unlinkEntry(pWheel, pEntry);
+				pushEntry(&pTodo, pEntry);
+			}
+		}
+
+		if (!(passed & 1)) {
+			break;
+		}
+		/* The level above ticks at least once when this one goes round */
+		if (elapsed < ((uint64_t)TIMER_WHEEL_SLOTS << (level * TIMER_WHEEL_BITS))) {
+			elapsed = (uint64_t)TIMER_WHEEL_SLOTS << (level * TIMER_WHEEL_BITS);
+		}
+	}
+
+	pWheel->now = now;
+
+	while ((pEntry = pTodo) != NULL) {
+		pTodo = pEntry->pNext;
+		pEntry->ppList = NULL;
+		scheduleEntry(pWheel, pEntry);
+	}
+}
+
+void timerWheelInit(TimerWheel *pWheel) {
+	int level, slot;
+
+	pWheel->now = 0;
+	pWheel->lastTicks = os_ticks_get();
+	pWheel->pExpired = NULL;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		pWheel->pending[level] = 0;
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+			pWheel->slots[level][slot] = NULL;
+		}
+	}
+}
+
+void timerWheelInitEntry(TimerWheelEntry *pEntry, TimerWheelHandler handler, void *pContext) {
+	pEntry->pNext = NULL;
+	pEntry->pPrev = NULL;
+	pEntry->ppList = NULL;
+	pEntry->expires = 0;
+	pEntry->handler = handler;
+	pEntry->pContext = pContext;
+}
+
+void timerWheelStart(TimerWheel *pWheel, TimerWheelEntry *pEntry, uint32_t timeout_ms) {
+	advance(pWheel);
+	unlinkEntry(pWheel, pEntry);
+	pEntry->expires = pWheel->now + timeout_ms;
+	scheduleEntry(pWheel, pEntry);
+}
+
+void timerWheelStop(TimerWheel *pWheel, TimerWheelEntry *pEntry) {
+	unlinkEntry(pWheel, pEntry);
+}
+
+bool timerWheelIsPending(const TimerWheelEntry *pEntry) {
+	return pEntry->ppList != NULL;
+}
+
+void timerWheelRun(TimerWheel *pWheel) {
+	TimerWheelEntry *pEntry;
+
+	advance(pWheel);
+	/* Taken one at a time, a handler may stop the other expired timers */
+	while ((pEntry = pWheel->pExpired) != NULL) {
+		unlinkEntry(pWheel, pEntry);
+		if (pEntry->handler != NULL) {
+			pEntry->handler(pEntry, pEntry->pContext);
+		}
+	}
+}
+
+int32_t timerWheelNextTimeout(TimerWheel *pWheel) {
+	uint64_t timeout = UINT64_MAX, levelTimeout, lowerMask = 0;
+	int level, slot;
+
+	advance(pWheel);
+	if (pWheel->pExpired != NULL) {
+		return 0;
+	}
+
+	/* The first slot holding timers on each level, a level above the
+	 * first is counted from the start of the slot after it, less what
+	 * the levels below have gone through of their turn */
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if (pWheel->pending[level] != 0) {
+			slot = TIMER_WHEEL_MASK & (pWheel->now >> (level * TIMER_WHEEL_BITS));
+			levelTimeout = (uint64_t)(__builtin_ctz(rotr(pWheel->pending[level], slot)) + (level ? 1 : 0))
+					<< (level * TIMER_WHEEL_BITS);
+			levelTimeout -= lowerMask & pWheel->now;
+			if (levelTimeout < timeout) {
+				timeout = levelTimeout;
+			}
+		}
+		lowerMask = (lowerMask << TIMER_WHEEL_BITS) | TIMER_WHEEL_MASK;
+	}
+
+	return (timeout == UINT64_MAX) ? -1 : (int32_t)timeout;
+}
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel for the deadlines of the MQTT and shadow layers
+ *
+ * A Timer of timer_interface.h only says whether it expired when asked, so
+ * whoever owns many of them polls each one on every yield. The timers of a
+ * wheel call a handler when they expire, and the wheel tells the earliest
+ * time one of them can be due, which is how long the event driven yield can
+ * sleep.
+ *
+ * The wheel has #TIMER_WHEEL_LEVELS levels of #TIMER_WHEEL_SLOTS slots. A
+ * slot of the first level is a millisecond, a slot of each next level is a
+ * whole turn of the level below. A timer is put on the lowest level whose
+ * turn covers the time left, and moves down a level each time the slot it
+ * is in comes round, so starting, stopping and expiring a timer never walk
+ * the other timers. The clock is os_ticks_get(), in milliseconds.
+ *
+ * A wheel is not locked, it belongs to the thread that runs its owner, and
+ * its handlers are called from timerWheelRun() in that thread.
+ */
+
+#ifndef __TIMER_WHEEL_H_
+#define __TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Bits of the slot index of a level */
+#define TIMER_WHEEL_BITS	5
+/** Slots of a level */
+#define TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)
+/** Levels, the last one turns in 2^25 ms, more than 9 hours */
+#define TIMER_WHEEL_LEVELS	5
+
+typedef struct TimerWheelEntry TimerWheelEntry;
+
+/**
+ * @brief Expiry of a timer
+ *
+ * The timer is no longer pending when its handler is called, the handler
+ * can start it again or start and stop other timers of the wheel.
+ *
+ * @param pEntry Timer that expired
+ * @param pContext Context given to timerWheelInitEntry()
+ */
+typedef void (*TimerWheelHandler)(TimerWheelEntry *pEntry, void *pContext);
+
+/**
+ * @brief Timer of a wheel
+ *
+ * Belongs to the caller, the wheel only links it while it is pending.
+ */
+struct TimerWheelEntry {
+	TimerWheelEntry *pNext;
+	TimerWheelEntry *pPrev;
+	TimerWheelEntry **ppList;	///< Slot or expired list the timer is on, NULL when not pending
+	uint64_t expires;			///< Time of the wheel it expires at
+	TimerWheelHandler handler;
+	void *pContext;
+};
+
+/**
+ * @brief Timer wheel
+ */
+typedef struct {
+	uint64_t now;								///< Milliseconds since timerWheelInit()
+	unsigned lastTicks;							///< os_ticks_get() when now was last brought up to date
+	uint32_t pending[TIMER_WHEEL_LEVELS];		///< Slots of each level that hold timers
+	TimerWheelEntry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	TimerWheelEntry *pExpired;					///< Timers due, waiting for timerWheelRun()
+} TimerWheel;
+
+/**
+ * @brief Initialize a wheel
+ *
+ * Any timer still pending on it is forgotten.
+ *
+ * @param pWheel Wheel
+ */
+void timerWheelInit(TimerWheel *pWheel);
+
+/**
+ * @brief Initialize a timer
+ *
+ * @param pEntry Timer, not pending
+ * @param handler Called when the timer expires
+ * @param pContext Passed to the handler
+ */
+void timerWheelInitEntry(TimerWheelEntry *pEntry, TimerWheelHandler handler, void *pContext);
+
+/**
+ * @brief Start a timer
+ *
+ * A timer that is already pending is started again from now.
+ *
+ * @param pWheel Wheel
+ * @param pEntry Timer
+ * @param timeout_ms Milliseconds until it expires, 0 to expire on the next timerWheelRun()
+ */
+void timerWheelStart(TimerWheel *pWheel, TimerWheelEntry *pEntry, uint32_t timeout_ms);
+
+/**
+ * @brief Stop a timer
+ *
+ * Nothing happens if the timer is not pending.
+ *
+ * @param pWheel Wheel the timer was started on
+ * @param pEntry Timer
+ */
+void timerWheelStop(TimerWheel *pWheel, TimerWheelEntry *pEntry);
+
+/**
+ * @brief Check whether a timer is pending
+ *
+ * @param pEntry Timer
+ * @return true from timerWheelStart() until it is stopped or its handler is called
+ */
+bool timerWheelIsPending(const TimerWheelEntry *pEntry);
+
+/**
+ * @brief Call the handlers of the timers that expired
+ *
+ * @param pWheel Wheel
+ */
+void timerWheelRun(TimerWheel *pWheel);
+
+/**
+ * @brief Time until the next handler may be due
+ *
+ * A timer on an upper level is counted from the start of its slot, the
+ * wheel may wake up a little before it expires, to move it down a level.
+ *
+ * @param pWheel Wheel
+ * @return Milliseconds, 0 if timerWheelRun() has handlers to call, -1 if no timer is pending
+ */
+int32_t timerWheelNextTimeout(TimerWheel *pWheel);
+
+#endif //__TIMER_WHEEL_H_
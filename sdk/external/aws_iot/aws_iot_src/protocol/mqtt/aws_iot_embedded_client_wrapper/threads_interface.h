@@ -0,0 +1,113 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file threads_interface.h
+ * @brief Locking interface for the MQTT client
+ *
+ * The MQTT client takes a mutex for its state, one for the transmit buffer
+ * and the network writes, and one for the receive buffer and the network
+ * reads, and a thread waiting for the reply to a command sleeps on a signal
+ * until the reading thread has it. Starting point for porting the locking of
+ * the SDK to the OS of a new platform.
+ */
+
+#ifndef __THREADS_INTERFACE_H_
+#define __THREADS_INTERFACE_H_
+
+#include <stdint.h>
+#include <wm_os.h>
+
+/** Timeout of mutex_lock() and signal_wait() that never expires */
+#define THREADS_WAIT_FOREVER 0xffffffffU
+
+/**
+ * @brief Mutex Type
+ *
+ * Recursive, the thread that holds it can lock it again.
+ */
+typedef struct {
+	os_mutex_t mutex;
+} Mutex;
+
+/**
+ * @brief Signal Type
+ *
+ * Binary, a signal given while nobody waits is taken by the next wait.
+ */
+typedef struct {
+	os_semaphore_t sem;
+} Signal;
+
+/**
+ * @brief Initialize a mutex
+ *
+ * @param Mutex - pointer to the mutex
+ * @return int - 0 on success, -1 if it could not be created
+ */
+int mutex_init(Mutex*);
+
+/**
+ * @brief Lock a mutex
+ *
+ * @param Mutex - pointer to the mutex
+ * @param uint32_t - milliseconds to wait for it, 0 to only try, THREADS_WAIT_FOREVER
+ * @return int - 0 once locked, -1 if it is still held by another thread
+ */
+int mutex_lock(Mutex*, uint32_t);
+
+/**
+ * @brief Unlock a mutex
+ *
+ * @param Mutex - pointer to the mutex, locked by this thread
+ */
+void mutex_unlock(Mutex*);
+
+/**
+ * @brief Free a mutex
+ *
+ * @param Mutex - pointer to the mutex
+ */
+void mutex_destroy(Mutex*);
+
+/**
+ * @brief Initialize a signal, not given
+ *
+ * @param Signal - pointer to the signal
+ * @return int - 0 on success, -1 if it could not be created
+ */
+int signal_init(Signal*);
+
+/**
+ * @brief Give a signal
+ *
+ * @param Signal - pointer to the signal
+ */
+void signal_give(Signal*);
+
+/**
+ * @brief Wait for a signal
+ *
+ * @param Signal - pointer to the signal
+ * @param uint32_t - milliseconds to wait, THREADS_WAIT_FOREVER
+ * @return int - 0 if the signal was given, -1 on timeout
+ */
+int signal_wait(Signal*, uint32_t);
+
+/**
+ * @brief Free a signal
+ *
+ * @param Signal - pointer to the signal
+ */
+void signal_destroy(Signal*);
+
+/**
+ * @brief Identity of the calling thread
+ *
+ * @return void * - the same value for every call from a thread, never NULL
+ */
+void *thread_self(void);
+
+#endif //__THREADS_INTERFACE_H_
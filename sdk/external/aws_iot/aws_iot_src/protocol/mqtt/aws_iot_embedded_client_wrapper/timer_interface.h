@@ -41,11 +41,21 @@
  *
  */
 typedef struct {
-	unsigned start_timestamp;
-	/* in milliseconds */
-	int timeout;
+	/* timer_now_us() the timer expires at */
+	uint64_t end_us;
 } Timer;
 
+/**
+ * @brief Current time (microseconds)
+ *
+ * Monotonic time since boot, from the 64 bit OS tick count and the SysTick
+ * counter within the tick. It does not wrap, differences of two readings
+ * time an exchange to the microsecond.
+ *
+ * @return uint64_t - microseconds since boot
+ */
+uint64_t timer_now_us(void);
+
 /**
  * @brief Check if a timer is expired
  *
@@ -76,16 +86,47 @@ void countdown_ms(Timer*, unsigned int);
  */
 void countdown(Timer*, unsigned int);
 
+/**
+ * @brief Create a timer (microseconds)
+ *
+ * Sets the timer to expire in a specified number of microseconds.
+ *
+ * @param Timer - pointer to the timer to be set to expire in microseconds
+ * @param uint32_t - set the timer to expire in this number of microseconds
+ */
+void countdown_us(Timer*, uint32_t);
+
+/**
+ * @brief Create a timer expiring at a random time (milliseconds)
+ *
+ * Sets the timer to expire at a time picked at random, evenly, within the next
+ * specified number of milliseconds, so that devices that start to wait at the same
+ * moment do not all stop waiting at the same moment.
+ *
+ * @param Timer - pointer to the timer to be set
+ * @param unsigned int - longest time in milliseconds the timer can be set to
+ */
+void countdown_jitter_ms(Timer*, unsigned int);
+
 /**
  * @brief Check the time remaining on a give timer
  *
- * Checks the input timer and returns the number of milliseconds remaining on the timer.
+ * Checks the input timer and returns the number of milliseconds remaining on the timer,
+ * rounded up so that a timer that has not expired has at least 1 left.
  *
  * @param Timer - pointer to the timer to be set to checked
  * @return int - milliseconds left on the countdown timer
  */
 int left_ms(Timer*);
 
+/**
+ * @brief Check the time remaining on a give timer (microseconds)
+ *
+ * @param Timer - pointer to the timer to be set to checked
+ * @return int64_t - microseconds left on the countdown timer, negative once it expired
+ */
+int64_t left_us(Timer*);
+
 /**
  * @brief Initialize a timer
  *
@@ -34,7 +34,8 @@
  */
 typedef enum {
 	MQTT_3_1 = 3,	///< MQTT 3.1   (protocol message byte = 3)
-	MQTT_3_1_1 = 4	///< MQTT 3.1.1 (protocol message byte = 4)
+	MQTT_3_1_1 = 4,	///< MQTT 3.1.1 (protocol message byte = 4)
+	MQTT_5 = 5	///< MQTT 5, publishes repeated on a topic carry a 2 byte topic alias instead of the topic, see AWS_IOT_MQTT_TOPIC_ALIASES. The broker limits the unacknowledged QoS1 and QoS2 publishes and its reason codes fail the calls
 } MQTT_Ver_t;
 
 /**
@@ -42,14 +43,30 @@ typedef enum {
  *
  * Defining a QoS type.
  * @note QoS 2 is \b NOT supported by the AWS IoT Service at the time of this SDK release.
+ * The client handles it for brokers that do.
  *
  */
 typedef enum {
 	QOS_0,	///< QoS 0 = at most once delivery
 	QOS_1,	///< QoS 1 = at least once delivery
-	QOS_2	///< QoS 2 is NOT supported
+	QOS_2	///< QoS 2 = exactly once delivery, not by AWS IoT
 } QoSLevel;
 
+/**
+ * @brief Traffic Class Type
+ *
+ * Priority of the packets of a connection on the link.  On Wi-Fi with WMM each class is
+ * sent from its own access category queue, so that a command channel is not held up by
+ * bulk uploads on a congested access point.
+ *
+ */
+typedef enum {
+	TRAFFIC_CLASS_BE,	///< Best effort, AC_BE, the default
+	TRAFFIC_CLASS_BK,	///< Background, AC_BK, bulk transfers that may wait, e.g. OTA or a backlog being drained
+	TRAFFIC_CLASS_VI,	///< Video, AC_VI, latency sensitive traffic heavier than commands
+	TRAFFIC_CLASS_VO	///< Voice, AC_VO, small command and control traffic that has to get through first
+} TrafficClass;
+
 /**
  * @brief Last Will and Testament Definition
  *
@@ -91,13 +108,15 @@ typedef struct {
 	char *pPassword;					///< Not used in the AWS IoT Service
 	MQTT_Ver_t MQTTVersion;				///< Desired MQTT version used during connection
 	uint16_t KeepAliveInterval_sec;		///< MQTT keep alive interval in seconds.  Defines inactivity time allowed before determining the connection has been lost.
-	bool isCleansession;				///< MQTT clean session.  True = this session is to be treated as clean.  Previous server state is cleared and no stated is retained from this connection.
+	bool isCleansession;				///< MQTT clean session.  True = this session is to be treated as clean.  Previous server state is cleared and no stated is retained from this connection.  False = the broker keeps the subscriptions and the QoS 1 and 2 state while the client is disconnected, and a reconnect that finds the session does not subscribe again.
 	bool isWillMsgPresent;				///< Is there a LWT associated with this connection?
 	MQTTwillOptions will;				///< MQTT LWT parameters.
 	uint32_t mqttCommandTimeout_ms;		///< Timeout for MQTT blocking calls.  In milliseconds.
 	uint32_t tlsHandshakeTimeout_ms;	///< TLS handshake timeout.  In milliseconds.
 	bool isSSLHostnameVerify;			///< Client should perform server certificate hostname validation.
 	iot_disconnect_handler disconnectHandler;	///< Callback to be invoked upon connection loss.
+	bool isPingFixedInterval;			///< Send a ping every keep alive interval.  False = ping only once nothing was sent for a whole interval.
+	TrafficClass trafficClass;			///< Priority of the packets of the connection, the handshake included.
 } MQTTConnectParams;
 extern const MQTTConnectParams MQTTConnectParamsDefault;
 
@@ -112,8 +131,9 @@ typedef struct {
 	bool isRetained;		///< Retained messages are \b NOT supported by the AWS IoT Service at the time of this SDK release.
 	bool isDuplicate;		///< Is this message a duplicate QoS > 0 message?  Handled automatically by the MQTT client.
 	uint16_t id;			///< Message sequence identifier.  Handled automatically by the MQTT client.
-	void *pPayload;			///< Pointer to MQTT message payload (bytes).
+	void *pPayload;			///< Pointer to MQTT message payload (bytes).  Received payloads delivered whole are followed by a NUL byte, which is not counted in PayloadLen.
 	uint32_t PayloadLen;	///< Length of MQTT payload.
+	bool isCompressed;		///< On publish, compress the payload, see lzss.h, when that makes it shorter.  It goes out behind a 4 byte marker: 0x1E, 'Z' and its length before compression, big endian.  On receive, the payload came with the marker and was expanded.  Needs AWS_IOT_MQTT_COMPRESS.
 } MQTTMessageParams;
 extern const MQTTMessageParams MQTTMessageParamsDefault;
 /**
@@ -126,6 +146,9 @@ typedef struct {
 	char *pTopicName;					///< Pointer to the topic string on which the message was delivered.  In the case of a wildcard subscription this is the actual topic, not the wildcard filter.
 	uint16_t TopicNameLen;				///< Length of the topic string.
 	MQTTMessageParams MessageParams;	///< Message parameters structure.
+	uint32_t PayloadOffset;				///< Offset of MessageParams.pPayload within the whole payload.  Only non zero for streaming subscriptions.
+	uint32_t TotalPayloadLen;			///< Length of the whole payload.  Equal to MessageParams.PayloadLen unless the message is streamed.
+	bool isLastChunk;					///< Is this the last chunk of the payload?  Always true unless the message is streamed.
 } MQTTCallbackParams;
 extern const MQTTCallbackParams MQTTCallbackParamsDefault;
 
@@ -139,6 +162,24 @@ extern const MQTTCallbackParams MQTTCallbackParamsDefault;
  */
 typedef int32_t (*iot_message_handler)(MQTTCallbackParams params);
 
+/**
+ * @brief Thread a Message Callback Runs In
+ *
+ * Inline callbacks run in the thread yielding on the connection, while the message is in
+ * the read buffer, and no other packet is read until they return.  The lanes copy the topic
+ * and payload and run the callback later on a shared worker thread of that priority, see
+ * work_svc.h, in the order the messages arrived.  A QoS 1 or 2 message is acknowledged
+ * once it is copied.  A message larger than AWS_IOT_MQTT_DISPATCH_MAX_LEN, or one that finds
+ * all AWS_IOT_MQTT_DISPATCH_SLOTS in use, runs inline.  Needs AWS_IOT_MQTT_DISPATCH.
+ *
+ */
+typedef enum {
+	MQTT_DISPATCH_INLINE = 0,	///< In the yielding thread
+	MQTT_DISPATCH_HIGH,		///< In the high priority lane, for short handlers reacting to commands
+	MQTT_DISPATCH_NORMAL,	///< In the normal priority lane
+	MQTT_DISPATCH_LOW		///< In the low priority lane, for slow handlers, e.g. ones writing to flash
+} MQTTDispatch;
+
 /**
  * @brief MQTT Subscription Parameters
  *
@@ -149,9 +190,31 @@ typedef struct {
 	char *pTopic;					///< Pointer to the string defining the desired subscription topic.
 	QoSLevel qos;					///< Quality of service of the subscription.
 	iot_message_handler mHandler;	///< Callback to be invoked upon receipt of a message on the subscribed topic.
+	bool isStreaming;				///< Deliver messages larger than AWS_IOT_MQTT_RX_BUF_LEN to mHandler in chunks instead of dropping them.
+	MQTTDispatch dispatch;			///< Thread mHandler runs in.  The chunks of a streaming subscription always run inline.
+	bool isLocal;					///< Only take the publishes of this device made with MQTTLocalDelivery, see MQTTPublishParams.  Nothing is subscribed at the broker, it works while disconnected and takes a subscribe handler like any other.
 } MQTTSubscribeParams;
 extern const MQTTSubscribeParams MQTTSubscribeParamsDefault;
 
+/**
+ * @brief Delivery of a Publish on the Device
+ *
+ * Tasks of the device exchanging messages over topics can skip the broker.  A local publish
+ * is delivered to the subscription its topic matches, in the calling thread and before the
+ * publish call returns, through the same handler dispatch as a message of the broker: a
+ * handler with a lane runs in the lane, one of QoS 1 or 2 gets a packet id of 0.  Local
+ * subscriptions, see MQTTSubscribeParams, take nothing from the broker, the others take
+ * local publishes as well.  A topic no subscription matches is not an error, and the default
+ * message handler is not called.  Plain and asynchronous publishes are delivered, prepared
+ * ones always go to the broker.  The completion handler of an asynchronous QoS 1 or 2
+ * publish that only goes local is called before the call returns.
+ */
+typedef enum {
+	MQTT_LOCAL_NONE = 0,	///< Only publish to the broker
+	MQTT_LOCAL_ONLY,		///< Only deliver on the device, nothing is sent.  Works while disconnected
+	MQTT_LOCAL_AND_CLOUD	///< Deliver on the device, then publish to the broker
+} MQTTLocalDelivery;
+
 /**
  * @brief MQTT Publish Parameters
  *
@@ -161,9 +224,75 @@ extern const MQTTSubscribeParams MQTTSubscribeParamsDefault;
 typedef struct {
 	char *pTopic;						///< Pointer to the string defining the desired publishing topic.
 	MQTTMessageParams MessageParams;	///< Parameters defining the message to be published.
+	MQTTLocalDelivery local;			///< Deliver the message to the subscriptions of this device too, or only to them.
 } MQTTPublishParams;
 extern const MQTTPublishParams MQTTPublishParamsDefault;
 
+/**
+ * @brief Prepared MQTT Publish
+ *
+ * A publish whose fixed header byte, with its QoS and retain flags, and topic, with its
+ * length, are serialized once instead of on every publish.  Only the remaining length, the
+ * packet identifier and the payload are written per message.  Define one for a constant
+ * topic with AWS_IOT_MQTT_PREPARED_PUBLISH(), the compiler builds it, or set one up for a
+ * computed topic with aws_iot_mqtt_prepare_publish().
+ */
+typedef struct {
+	unsigned char header;				///< First byte of the fixed header: PUBLISH, the QoS and the retain flag
+	uint16_t topicLen;					///< Length of the topic name
+	const unsigned char *pTopicBytes;	///< The topic as it goes out: its length, big endian, then its name, NUL terminated
+} MQTTPreparedPublish;
+
+/**
+ * @brief Define a prepared publish of a constant topic
+ *
+ * Defines a static MQTTPreparedPublish called name, and the serialized topic it points to,
+ * at compile time.
+ *
+ * @code
+ * AWS_IOT_MQTT_PREPARED_PUBLISH(telemetryTopic, "connected-maraca", QOS_0, false);
+ *
+ * aws_iot_mqtt_publish_prepared(&telemetryTopic, &msgParams);
+ * @endcode
+ *
+ * @param name		Name of the prepared publish
+ * @param topic		String literal of the topic
+ * @param qos		QoSLevel of the publishes
+ * @param retained	true if the publishes are retained
+ */
+#define AWS_IOT_MQTT_PREPARED_PUBLISH(name, topic, qos, retained) \
+	static const struct { \
+		unsigned char len[2]; \
+		char name[sizeof(topic)]; \
+	} name##TopicBytes = { \
+		{ (unsigned char)((sizeof(topic) - 1) >> 8), (unsigned char)((sizeof(topic) - 1) & 0xff) }, topic \
+	}; \
+	static const MQTTPreparedPublish name = { \
+		(unsigned char)(0x30 | ((qos) << 1) | ((retained) ? 1 : 0)), \
+		(uint16_t)(sizeof(topic) - 1), \
+		(const unsigned char *)&name##TopicBytes \
+	}
+
+/**
+ * @brief Length of the buffer aws_iot_mqtt_prepare_publish() needs for a topic
+ *
+ * @param topicLen	Length of the topic name
+ */
+#define AWS_IOT_MQTT_PREPARED_TOPIC_BUF_LEN(topicLen) ((topicLen) + 3)
+
+/**
+ * @brief MQTT Publish Complete Callback Function
+ *
+ * Defines a type for the function pointer invoked when an asynchronous publish completes.
+ * Called from the context of aws_iot_mqtt_yield() once the PUBACK is received, the ack
+ * timer expires or the connection is lost.
+ *
+ * @param id		Packet identifier assigned to the message when it was published
+ * @param status	NONE_ERROR if the PUBACK was received, otherwise the reason for the failure
+ * @param pContext	Context pointer supplied to aws_iot_mqtt_publish_async()
+ */
+typedef void (*iot_publish_complete_handler)(uint16_t id, IoT_Error_t status, void *pContext);
+
 /**
  * @brief MQTT Connection Function
  *
@@ -180,13 +309,71 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams);
  * Called to publish an MQTT message on a topic.
  * @note Call is blocking.  In the case of a QoS 0 message the function returns
  * after the message was successfully passed to the TLS layer.  In the case of QoS 1
- * the function returns after the receipt of the PUBACK control packet.
+ * the function returns after the receipt of the PUBACK control packet, and in the case
+ * of QoS 2 after the receipt of the PUBCOMP.
+ * @note With AWS_IOT_MQTT_RATE_LIMIT the publish takes a token of the connection and of
+ * its topic class first, see aws_iot_mqtt_rate_class_set().  A QoS 0 message that finds
+ * none is held back and sent by aws_iot_mqtt_yield(), a newer one on its topic replaces
+ * it.  Other messages wait for their token, for at most the command timeout.
  *
  * @param pParams	Pointer to MQTT publish parameters
- * @return An IoT Error Type defining successful/failed publish
+ * @return An IoT Error Type defining successful/failed publish.  PUBLISH_RATE_LIMITED is
+ *         returned if the message got no token in time or could not be held back
  */
 IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams);
 
+/**
+ * @brief Publish an MQTT message on a topic without waiting for the PUBACK
+ *
+ * Called to publish an MQTT message on a topic.  Up to #AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH
+ * QoS 1 and QoS 2 messages can be waiting for a PUBACK or PUBCOMP at the same time.  The
+ * acknowledgements are matched in aws_iot_mqtt_yield(), which sends the PUBREL of QoS 2
+ * messages and invokes the completion handler of each message.
+ * @note Call returns after the message was passed to the TLS layer.  The packet identifier
+ * assigned to a QoS 1 or QoS 2 message is written back to pParams->MessageParams.id.  No
+ * completion handler is invoked for QoS 0 messages.  With AWS_IOT_MQTT_RATE_LIMIT the
+ * call waits for the message's token like aws_iot_mqtt_publish() does, messages are never
+ * held back.
+ *
+ * @param pParams	Pointer to MQTT publish parameters
+ * @param handler	Callback invoked when the PUBACK is received or the publish fails. Can be NULL
+ * @param pContext	Pointer passed back to the handler. Can be NULL
+ * @return An IoT Error Type defining successful/failed publish.  PUBLISH_INFLIGHT_WINDOW_FULL
+ *         is returned if the maximum number of publishes is already waiting for an acknowledgement
+ */
+IoT_Error_t aws_iot_mqtt_publish_async(MQTTPublishParams *pParams, iot_publish_complete_handler handler,
+		void *pContext);
+
+/**
+ * @brief Set up a prepared publish of a computed topic
+ *
+ * Serializes the topic into a buffer of the caller, for topics that are built at run time
+ * and then published to many times.
+ *
+ * @param pPrepared	Prepared publish to set up
+ * @param pBuf		Buffer the serialized topic is kept in, it has to stay valid as long as
+ *			the prepared publish is used
+ * @param bufLen	Length of the buffer, at least AWS_IOT_MQTT_PREPARED_TOPIC_BUF_LEN() of the topic
+ * @param pTopic	Topic of the publishes
+ * @param qos		QoS of the publishes
+ * @param isRetained	true if the publishes are retained
+ * @return NONE_ERROR, NULL_VALUE_ERROR, or GENERIC_ERROR if the buffer is too short
+ */
+IoT_Error_t aws_iot_mqtt_prepare_publish(MQTTPreparedPublish *pPrepared, unsigned char *pBuf, size_t bufLen,
+		const char *pTopic, QoSLevel qos, bool isRetained);
+
+/**
+ * @brief Publish an MQTT message with a prepared publish
+ *
+ * Same as aws_iot_mqtt_publish(), with the topic, the QoS and the retain flag of the
+ * prepared publish.  The qos and isRetained of pParams are set from it.
+ *
+ * @param pPrepared	Prepared publish of the topic
+ * @param pParams	Payload of the message
+ * @return An IoT Error Type defining successful/failed publish
+ */
+IoT_Error_t aws_iot_mqtt_publish_prepared(const MQTTPreparedPublish *pPrepared, MQTTMessageParams *pParams);
+
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -199,6 +386,21 @@ IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams);
  */
 IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams);
 
+/**
+ * @brief Subscribe to several MQTT topics at once.
+ *
+ * Called to send one subscribe message carrying all the topics, the subscriptions
+ * take a single round trip to the broker.
+ * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
+ * The subscribe message has to fit in AWS_IOT_MQTT_TX_BUF_LEN.
+ *
+ * @param pParams	Array of MQTT subscribe parameters
+ * @param count		Number of elements of pParams, at most AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS
+ * @return An IoT Error Type defining successful/failed subscription, either all topics
+ *         are subscribed or none
+ */
+IoT_Error_t aws_iot_mqtt_subscribe_many(MQTTSubscribeParams *pParams, uint32_t count);
+
 /**
  * @brief Unsubscribe to an MQTT topic.
  *
@@ -211,6 +413,18 @@ IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams);
  */
 IoT_Error_t aws_iot_mqtt_unsubscribe(char *pTopic);
 
+/**
+ * @brief Unsubscribe from several MQTT topics at once.
+ *
+ * Called to send one unsubscribe message carrying all the topics.
+ * @note Call is blocking.  The call returns after the receipt of the UNSUBACK control packet.
+ *
+ * @param pTopics	Array of null terminated topic strings
+ * @param count		Number of elements of pTopics, at most AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS
+ * @return An IoT Error Type defining successful/failed unsubscription
+ */
+IoT_Error_t aws_iot_mqtt_unsubscribe_many(char **pTopics, uint32_t count);
+
 /**
  * @brief MQTT Manual Re-Connection Function
  *
@@ -249,6 +463,71 @@ IoT_Error_t aws_iot_mqtt_disconnect(void);
  */
 IoT_Error_t aws_iot_mqtt_yield(int timeout);
 
+/**
+ * @brief Yield to the MQTT client until something happens
+ *
+ * Same as aws_iot_mqtt_yield() but instead of polling the socket the thread sleeps until
+ * data arrives, aws_iot_mqtt_wakeup() is called or the timeout expires.  Keepalive and
+ * publish ack timeouts are handled while waiting.  Returns as soon as the received
+ * messages have been handled, so incoming messages are delivered with the latency of the
+ * network instead of the polling period of the application.
+ *
+ * @param timeout Maximum number of milliseconds to wait for an event.
+ * @return An IoT Error Type defining successful/failed client processing.
+ */
+IoT_Error_t aws_iot_mqtt_yield_until_event(int timeout);
+
+/**
+ * @brief Wake up aws_iot_mqtt_yield_until_event()
+ *
+ * Called from any thread to make a pending aws_iot_mqtt_yield_until_event() return, for
+ * example when the application has work to post. If no yield is pending the next one
+ * returns immediately.
+ */
+void aws_iot_mqtt_wakeup(void);
+
+/**
+ * @brief Send the following packets together
+ *
+ * Until aws_iot_mqtt_batch_end() the packets sent by the client, e.g. a series of QoS0
+ * or asynchronous QoS1 publishes, are collected and encrypted together, as one TLS record
+ * while they fit in AWS_IOT_TLS_TX_BUF_LEN bytes, instead of a record each.  A call
+ * waiting for a reply, as a QoS1 aws_iot_mqtt_publish(), or a yield sends what was
+ * collected first.  Batches can be nested.  A batch collects the packets of the thread
+ * that opened it, the packets of the other threads go out at once and take what was
+ * collected along.  While it is open the batches of the other threads collect nothing.
+ */
+void aws_iot_mqtt_batch_begin(void);
+
+/**
+ * @brief Send the packets collected since aws_iot_mqtt_batch_begin()
+ *
+ * @return An IoT Error Type defining successful/failed send of the batch
+ */
+IoT_Error_t aws_iot_mqtt_batch_end(void);
+
+/**
+ * @brief Send the next keepalive ping now if it is due soon
+ *
+ * For a radio in power save, the ping goes out while it is awake for other packets
+ * instead of waking it on its own later.  Called from the thread running the yield.
+ *
+ * @param withinMs The ping is sent if it is due within this many milliseconds
+ * @return NONE_ERROR, or NETWORK_DISCONNECTED if the ping could not be sent
+ */
+IoT_Error_t aws_iot_mqtt_keepalive_early(uint32_t withinMs);
+
+/**
+ * @brief Change the priority of the packets of the connection
+ *
+ * Takes effect at once on an open connection and is kept for the reconnects, e.g. to
+ * drop a connection to TRAFFIC_CLASS_BK while it drains a backlog.
+ *
+ * @param trafficClass Traffic class of the packets
+ * @return NONE_ERROR, or GENERIC_ERROR if the network layer refused it
+ */
+IoT_Error_t aws_iot_mqtt_set_traffic_class(TrafficClass trafficClass);
+
 /**
  * @brief Is the MQTT client currently connected?
  *
@@ -280,12 +559,211 @@ bool aws_iot_is_autoreconnect_enabled(void);
  */
 IoT_Error_t aws_iot_mqtt_autoreconnect_set_status(bool value);
 
+/**
+ * @brief Print the statistics of the MQTT client
+ *
+ * Writes the byte and packet counters, the oversized packets dropped, the
+ * publish ack timeouts and the histograms of PUBACK latency, send time and
+ * reconnect time to the console, for a console command of the application
+ * to show.  Needs AWS_IOT_MQTT_STATS.
+ *
+ * @param reset set to true to start counting again from zero
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_print_stats(bool reset);
+
+/**
+ * @brief Publish Rate Limit Counters
+ */
+typedef struct {
+	uint32_t delayed;	///< Publishes that waited for their token, held back or in the calling thread
+	uint32_t merged;	///< Held QoS 0 publishes replaced by a newer one on their topic
+	uint32_t dropped;	///< Publishes that failed with PUBLISH_RATE_LIMITED, and held ones that could not be sent
+} MQTTRateStats;
+
+/**
+ * @brief Give a class of topics a publish rate of its own
+ *
+ * Publishes on topics starting with the prefix take a token of the class on top of
+ * the token of the connection, whose rate is AWS_IOT_MQTT_PUBLISH_RATE.  A topic belongs
+ * to the class with the longest matching prefix.  Setting the rate of a class again
+ * refills its bucket.  Needs AWS_IOT_MQTT_RATE_LIMIT.
+ *
+ * @param pTopicPrefix	Start of the topics of the class, e.g. "$aws/things/lamp/shadow/".
+ *			It has to stay valid as long as the class is set
+ * @param ratePerSec	Publishes per second, 0 to remove the class
+ * @param burst		Publishes the class can send at once after being idle
+ * @return IoT_Error_t Type defining successful/failed API call.  GENERIC_ERROR is returned
+ *         if AWS_IOT_MQTT_RATE_CLASSES classes are set already
+ */
+IoT_Error_t aws_iot_mqtt_rate_class_set(const char *pTopicPrefix, uint32_t ratePerSec, uint32_t burst);
+
+/**
+ * @brief Get the counters of the publish rate limit
+ *
+ * aws_iot_mqtt_print_stats() prints them too.  Needs AWS_IOT_MQTT_RATE_LIMIT.
+ *
+ * @param pStats	Counters since the first connect or the last reset
+ * @param reset	set to true to start counting again from zero
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_get_rate_stats(MQTTRateStats *pStats, bool reset);
+
+/**
+ * @brief Message Dispatch Counters
+ *
+ * Of all the connections, the worker lanes are shared.
+ */
+typedef struct {
+	uint32_t queued;	///< Messages copied or handed over for a lane
+	uint32_t handedOver;	///< Of those, handed over in their read buffer, see AWS_IOT_MQTT_RX_BUFFERS
+	uint32_t inlined;	///< Messages for a lane that ran inline, too large or no slot free
+	uint32_t maxUsed;	///< Most slots in use at a time
+} MQTTDispatchStats;
+
+/**
+ * @brief Get the counters of the message dispatch
+ *
+ * aws_iot_mqtt_print_stats() prints them too.  Needs AWS_IOT_MQTT_DISPATCH.
+ *
+ * @param pStats	Counters since boot or the last reset
+ * @param reset	set to true to start counting again from zero
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_get_dispatch_stats(MQTTDispatchStats *pStats, bool reset);
+
+/**
+ * @brief Payload Compression Counters
+ */
+typedef struct {
+	uint32_t compressed;	///< Publishes sent compressed
+	uint32_t skipped;		///< Publishes to compress sent as they were, compressing did not make them shorter or they did not fit AWS_IOT_MQTT_COMPRESS_BUF_LEN
+	uint32_t bytesIn;		///< Payload bytes of the compressed publishes before compression
+	uint32_t bytesOut;		///< And after, with the markers
+	uint32_t expanded;		///< Received payloads expanded
+	uint32_t unexpanded;	///< Received payloads with the marker delivered as they were, corrupt or larger than AWS_IOT_MQTT_COMPRESS_BUF_LEN
+} MQTTCompressStats;
+
+/**
+ * @brief Get the counters of the payload compression
+ *
+ * aws_iot_mqtt_print_stats() prints them too.  Needs AWS_IOT_MQTT_COMPRESS.
+ *
+ * @param pStats	Counters since the first connect or the last reset
+ * @param reset	set to true to start counting again from zero
+ * @return IoT_Error_t Type defining successful/failed API call
+ */
+IoT_Error_t aws_iot_mqtt_get_compress_stats(MQTTCompressStats *pStats, bool reset);
+
+/**
+ * @brief Send a class of topics to a rule through Basic Ingest
+ *
+ * Publishes on topics starting with the prefix go to $aws/rules/<rule>/<topic> instead
+ * of the topic itself.  AWS IoT hands them to the rule without the broker, which saves
+ * the messaging cost and a hop; the rule sees the topic it would have.  Nothing can
+ * subscribe to them.  Plain, asynchronous and prepared publishes are mapped, those held
+ * back by the rate limit too, the rate classes still go by the topic itself.  A topic
+ * belongs to the route with the longest matching prefix.  Retained publishes go to the
+ * broker, which keeps them, as do topics whose Basic Ingest topic would be longer than
+ * AWS_IOT_MQTT_INGEST_TOPIC_LEN.  Needs AWS_IOT_MQTT_INGEST.
+ *
+ * @code
+ * aws_iot_mqtt_ingest_route_set("connected-maraca", "maraca_telemetry");
+ * @endcode
+ *
+ * @param pTopicPrefix	Start of the topics of the route.  It has to stay valid as long as
+ *			the route is set
+ * @param pRuleName	Name of the rule, NULL to remove the route.  It has to stay valid as
+ *			long as the route is set
+ * @return IoT_Error_t Type defining successful/failed API call.  GENERIC_ERROR is returned
+ *         if AWS_IOT_MQTT_INGEST_ROUTES routes are set already
+ */
+IoT_Error_t aws_iot_mqtt_ingest_route_set(const char *pTopicPrefix, const char *pRuleName);
+
+/**
+ * @brief Basic Ingest topic of a rule, for a constant topic
+ *
+ * Sends a prepared publish straight to a rule with no route to look up, e.g.
+ * AWS_IOT_MQTT_PREPARED_PUBLISH(telemetryTopic, AWS_IOT_MQTT_INGEST_TOPIC("maraca_telemetry",
+ * "connected-maraca"), QOS_0, false).
+ *
+ * @param rule	String literal of the rule name
+ * @param topic	String literal of the topic the rule sees
+ */
+#define AWS_IOT_MQTT_INGEST_TOPIC(rule, topic) "$aws/rules/" rule "/" topic
+
+/**
+ * @brief MQTT Connection Type
+ *
+ * Opaque handle to one MQTT connection, with its own client state, TLS session
+ * and buffers. The aws_iot_mqtt_* functions above use a default connection;
+ * the aws_iot_mqtt_*_ex variants below work on a connection obtained from
+ * aws_iot_mqtt_connection_alloc().
+ */
+typedef struct MQTTConnection MQTTConnection_t;
+
+/**
+ * @brief Allocate an MQTT connection
+ *
+ * Takes a connection from the pool of AWS_IOT_MQTT_MAX_CONNECTIONS, the default
+ * connection excluded.
+ *
+ * @return Connection handle, or NULL if no connection is free
+ */
+MQTTConnection_t *aws_iot_mqtt_connection_alloc(void);
+
+/**
+ * @brief Release an MQTT connection
+ *
+ * The connection must be disconnected before it is released.
+ *
+ * @param pConnection Connection returned by aws_iot_mqtt_connection_alloc()
+ */
+void aws_iot_mqtt_connection_free(MQTTConnection_t *pConnection);
+
+IoT_Error_t aws_iot_mqtt_connect_ex(MQTTConnection_t *pConnection, MQTTConnectParams *pParams);
+IoT_Error_t aws_iot_mqtt_publish_ex(MQTTConnection_t *pConnection, MQTTPublishParams *pParams);
+IoT_Error_t aws_iot_mqtt_publish_async_ex(MQTTConnection_t *pConnection, MQTTPublishParams *pParams,
+		iot_publish_complete_handler handler, void *pContext);
+IoT_Error_t aws_iot_mqtt_publish_prepared_ex(MQTTConnection_t *pConnection, const MQTTPreparedPublish *pPrepared,
+		MQTTMessageParams *pParams);
+IoT_Error_t aws_iot_mqtt_subscribe_ex(MQTTConnection_t *pConnection, MQTTSubscribeParams *pParams);
+IoT_Error_t aws_iot_mqtt_subscribe_many_ex(MQTTConnection_t *pConnection, MQTTSubscribeParams *pParams,
+		uint32_t count);
+IoT_Error_t aws_iot_mqtt_unsubscribe_ex(MQTTConnection_t *pConnection, char *pTopic);
+IoT_Error_t aws_iot_mqtt_unsubscribe_many_ex(MQTTConnection_t *pConnection, char **pTopics, uint32_t count);
+IoT_Error_t aws_iot_mqtt_disconnect_ex(MQTTConnection_t *pConnection);
+IoT_Error_t aws_iot_mqtt_yield_ex(MQTTConnection_t *pConnection, int timeout);
+IoT_Error_t aws_iot_mqtt_yield_until_event_ex(MQTTConnection_t *pConnection, int timeout);
+void aws_iot_mqtt_wakeup_ex(MQTTConnection_t *pConnection);
+void aws_iot_mqtt_batch_begin_ex(MQTTConnection_t *pConnection);
+IoT_Error_t aws_iot_mqtt_batch_end_ex(MQTTConnection_t *pConnection);
+IoT_Error_t aws_iot_mqtt_keepalive_early_ex(MQTTConnection_t *pConnection, uint32_t withinMs);
+IoT_Error_t aws_iot_mqtt_set_traffic_class_ex(MQTTConnection_t *pConnection, TrafficClass trafficClass);
+IoT_Error_t aws_iot_mqtt_attempt_reconnect_ex(MQTTConnection_t *pConnection);
+IoT_Error_t aws_iot_mqtt_autoreconnect_set_status_ex(MQTTConnection_t *pConnection, bool value);
+bool aws_iot_is_mqtt_connected_ex(MQTTConnection_t *pConnection);
+bool aws_iot_is_autoreconnect_enabled_ex(MQTTConnection_t *pConnection);
+IoT_Error_t aws_iot_mqtt_print_stats_ex(MQTTConnection_t *pConnection, bool reset);
+IoT_Error_t aws_iot_mqtt_rate_class_set_ex(MQTTConnection_t *pConnection, const char *pTopicPrefix,
+		uint32_t ratePerSec, uint32_t burst);
+IoT_Error_t aws_iot_mqtt_get_rate_stats_ex(MQTTConnection_t *pConnection, MQTTRateStats *pStats, bool reset);
+IoT_Error_t aws_iot_mqtt_get_compress_stats_ex(MQTTConnection_t *pConnection, MQTTCompressStats *pStats, bool reset);
+IoT_Error_t aws_iot_mqtt_ingest_route_set_ex(MQTTConnection_t *pConnection, const char *pTopicPrefix,
+		const char *pRuleName);
+
 typedef IoT_Error_t (*pConnectFunc_t)(MQTTConnectParams *pParams);
 typedef IoT_Error_t (*pPublishFunc_t)(MQTTPublishParams *pParams);
+typedef IoT_Error_t (*pPublishPreparedFunc_t)(const MQTTPreparedPublish *pPrepared, MQTTMessageParams *pParams);
+typedef IoT_Error_t (*pPublishAsyncFunc_t)(MQTTPublishParams *pParams, iot_publish_complete_handler handler,
+		void *pContext);
 typedef IoT_Error_t (*pSubscribeFunc_t)(MQTTSubscribeParams *pParams);
+typedef IoT_Error_t (*pSubscribeManyFunc_t)(MQTTSubscribeParams *pParams, uint32_t count);
 typedef IoT_Error_t (*pUnsubscribeFunc_t)(char *pTopic);
+typedef IoT_Error_t (*pUnsubscribeManyFunc_t)(char **pTopics, uint32_t count);
 typedef IoT_Error_t (*pDisconnectFunc_t)(void);
 typedef IoT_Error_t (*pYieldFunc_t)(int timeout);
+typedef void (*pWakeupFunc_t)(void);
 typedef bool (*pIsConnectedFunc_t)(void);
 typedef bool (*pIsAutoReconnectEnabledFunc_t)(void);
 typedef IoT_Error_t (*pReconnectFunc_t)();
@@ -301,10 +779,16 @@ typedef IoT_Error_t (*pSetAutoReconnectStatusFunc_t)(bool);
 typedef struct{
 	pConnectFunc_t connect;				///< function implementing the iot_mqtt_connect function
 	pPublishFunc_t publish;				///< function implementing the iot_mqtt_publish function
+	pPublishAsyncFunc_t publishAsync;	///< function implementing the iot_mqtt_publish_async function
+	pPublishPreparedFunc_t publishPrepared;	///< function implementing the iot_mqtt_publish_prepared function
 	pSubscribeFunc_t subscribe;			///< function implementing the iot_mqtt_subscribe function
+	pSubscribeManyFunc_t subscribeMany;	///< function implementing the iot_mqtt_subscribe_many function
 	pUnsubscribeFunc_t unsubscribe;		///< function implementing the iot_mqtt_unsubscribe function
+	pUnsubscribeManyFunc_t unsubscribeMany;	///< function implementing the iot_mqtt_unsubscribe_many function
 	pDisconnectFunc_t disconnect;		///< function implementing the iot_mqtt_disconnect function
 	pYieldFunc_t yield;					///< function implementing the iot_mqtt_yield function
+	pYieldFunc_t yieldUntilEvent;		///< function implementing the iot_mqtt_yield_until_event function
+	pWakeupFunc_t wakeup;				///< function implementing the iot_mqtt_wakeup function
 	pIsConnectedFunc_t isConnected;		///< function implementing the iot_is_mqtt_connected function
 	pReconnectFunc_t reconnect;			///< function implementing the iot_mqtt_reconnect function
 	pIsAutoReconnectEnabledFunc_t isAutoReconnectEnabled;	///< function implementing the iot_is_autoreconnect_enabled function
@@ -13,12 +13,17 @@
  * permissions and limitations under the License.
  */
 
+#include <string.h>
+#include <warm_resume.h>
+
 #include "aws_iot_error.h"
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_actions.h"
 #include "aws_iot_shadow_json.h"
 #include "aws_iot_shadow_key.h"
 #include "aws_iot_shadow_records.h"
+#include "aws_iot_shadow_reported.h"
+#include "aws_iot_shadow_things.h"
 
 const ShadowParameters_t ShadowParametersDefault = {
 		.pMqttClientId = AWS_IOT_MQTT_CLIENT_ID,
@@ -26,17 +31,81 @@ const ShadowParameters_t ShadowParametersDefault = {
 		.port = AWS_IOT_MQTT_PORT,
 		.pRootCA = NULL,
 		.pClientCRT = NULL,
-		.pClientKey = NULL
+		.pClientKey = NULL,
+		.isAckWildcardSubscribed = false
 };
 
+#define SHADOW_VERSION_CONFLICT 409
+#define SHADOW_NOT_FOUND 404
+
+/* The versioned update waiting for its responses, one at a time */
+typedef struct {
+	MQTTClient_t *pClient;
+	char thingName[MAX_SIZE_OF_THING_NAME];
+	char *pJsonString;
+	size_t maxSizeOfJsonDocument;
+	fpActionCallback_t callback;
+	void *pContextData;
+	uint8_t timeout_seconds;
+	uint8_t retriesLeft;
+	bool isPersistentSubscribe;
+	bool isPending;
+} VersionedUpdate_t;
+
+static VersionedUpdate_t versionedUpdate;
+/* Version given by the last accepted versioned update. It is not taken as the
+ * version of the deltas, a delta of that version may still follow */
+static char lastVersionedThingName[MAX_SIZE_OF_THING_NAME];
+static uint32_t lastVersionedNum = 0;
+
 void aws_iot_shadow_reset_last_received_version(void) {
 	shadowJsonVersionNum = 0;
+	shadowDeliveredVersionNum = 0;
 }
 
 uint32_t aws_iot_shadow_get_last_received_version(void) {
 	return shadowJsonVersionNum;
 }
 
+/* The versions of #AWS_IOT_MY_THING_NAME as kept across the sleeps */
+typedef struct {
+	uint32_t jsonVersion;
+	uint32_t deliveredVersion;
+} ShadowSavedVersion_t;
+
+static int shadowVersionSave(void *buf, size_t size) {
+	ShadowSavedVersion_t saved;
+
+	if (size < sizeof(saved)) {
+		return -1;
+	}
+	saved.jsonVersion = shadowJsonVersionNum;
+	saved.deliveredVersion = shadowDeliveredVersionNum;
+	memcpy(buf, &saved, sizeof(saved));
+	return sizeof(saved);
+}
+
+static void shadowVersionRestore(const void *data, size_t len, uint32_t since_ms) {
+	ShadowSavedVersion_t saved;
+
+	if (len != sizeof(saved)) {
+		return;
+	}
+	memcpy(&saved, data, sizeof(saved));
+	shadowJsonVersionNum = saved.jsonVersion;
+	shadowDeliveredVersionNum = saved.deliveredVersion;
+}
+
+static const struct warm_resume_client shadowVersionClient = {
+	.tag = WARM_RESUME_TAG_SHADOW,
+	.save = shadowVersionSave,
+	.restore = shadowVersionRestore,
+};
+
+IoT_Error_t aws_iot_shadow_warm_resume(void) {
+	return warm_resume_register(&shadowVersionClient) == 0 ? NONE_ERROR : GENERIC_ERROR;
+}
+
 void aws_iot_shadow_enable_discard_old_delta_msgs(void) {
 	shadowDiscardOldDeltaFlag = true;
 }
@@ -51,9 +120,16 @@ IoT_Error_t aws_iot_shadow_init(MQTTClient_t *pClient) {
 		return NULL_VALUE_ERROR;
 	}
 
+#if AWS_IOT_RUNTIME_CONFIG
+	if (NONE_ERROR != allocateShadowRecords() || NONE_ERROR != allocateShadowJsonTokens()) {
+		return GENERIC_ERROR;
+	}
+#endif
 	resetClientTokenSequenceNum();
 	aws_iot_shadow_reset_last_received_version();
 	initDeltaTokens();
+	initReportedCache();
+	initShadowThings();
 	return NONE_ERROR;
 }
 
@@ -95,6 +171,9 @@ IoT_Error_t aws_iot_shadow_connect(MQTTClient_t *pClient, ShadowParameters_t *pP
 
 	if(rc == NONE_ERROR){
 		initializeRecords(pClient);
+		if(pParams->isAckWildcardSubscribed) {
+			rc = subscribeToShadowAckWildcard();
+		}
 	}
 
 	return rc;
@@ -112,11 +191,54 @@ IoT_Error_t aws_iot_shadow_register_delta(MQTTClient_t *pClient, jsonStruct_t *p
 	return rc;
 }
 
+IoT_Error_t aws_iot_shadow_register_delta_handler(MQTTClient_t *pClient, shadowDeltaHandler_t handler,
+		void *pContext) {
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	return registerSchemaOnDelta(handler, pContext);
+}
+
+IoT_Error_t aws_iot_shadow_register_delta_batch(MQTTClient_t *pClient, shadowDeltaBatchCallback_t callback,
+		void *pContext) {
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	return registerBatchOnDelta(callback, pContext);
+}
+
 IoT_Error_t aws_iot_shadow_yield(MQTTClient_t *pClient, int timeout) {
 	HandleExpiredResponseCallbacks();
+	HandleReportedCacheFlush(pClient);
 	return pClient->yield(timeout);
 }
 
+IoT_Error_t aws_iot_shadow_yield_until_event(MQTTClient_t *pClient, int timeout) {
+	IoT_Error_t rc;
+	int32_t flushLeftMs;
+	int32_t ackLeftMs;
+
+	HandleExpiredResponseCallbacks();
+	HandleReportedCacheFlush(pClient);
+
+	/* Wake up in time for changed reported fields and acks that time out */
+	flushLeftMs = reportedCacheFlushLeftMs();
+	if (flushLeftMs >= 0 && flushLeftMs < timeout) {
+		timeout = flushLeftMs;
+	}
+	ackLeftMs = ackTimeoutLeftMs();
+	if (ackLeftMs >= 0 && ackLeftMs < timeout) {
+		timeout = ackLeftMs;
+	}
+	rc = pClient->yieldUntilEvent(timeout);
+	/* Responses may have arrived, or timed out while waiting */
+	HandleExpiredResponseCallbacks();
+	HandleReportedCacheFlush(pClient);
+	return rc;
+}
+
 IoT_Error_t aws_iot_shadow_disconnect(MQTTClient_t *pClient) {
 	return pClient->disconnect();
 }
@@ -136,6 +258,141 @@ IoT_Error_t aws_iot_shadow_update(MQTTClient_t *pClient, const char *pThingName,
 	return ret_val;
 }
 
+static uint32_t lastKnownVersion(const char *pThingName) {
+	uint32_t version;
+
+	if (strcmp(pThingName, myThingName) == 0) {
+		version = shadowJsonVersionNum;
+	} else {
+		version = aws_iot_shadow_thing_get_last_received_version(pThingName);
+	}
+	if (strcmp(pThingName, lastVersionedThingName) == 0 && lastVersionedNum > version) {
+		version = lastVersionedNum;
+	}
+	return version;
+}
+
+static void versionedAckCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData);
+
+/* Version 0 sends the update without one */
+static IoT_Error_t sendVersionedUpdate(uint32_t version) {
+	IoT_Error_t rc;
+
+	rc = setJsonVersionNumber(versionedUpdate.pJsonString, versionedUpdate.maxSizeOfJsonDocument, version);
+	if (rc != NONE_ERROR) {
+		return rc;
+	}
+	return iot_shadow_action(versionedUpdate.pClient, versionedUpdate.thingName, SHADOW_UPDATE,
+			versionedUpdate.pJsonString, versionedAckCallback, NULL, versionedUpdate.timeout_seconds,
+			versionedUpdate.isPersistentSubscribe);
+}
+
+static IoT_Error_t sendVersionedGet(void) {
+	char getRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+
+	iot_shadow_get_request_json(getRequestJsonBuf);
+	return iot_shadow_action(versionedUpdate.pClient, versionedUpdate.thingName, SHADOW_GET, getRequestJsonBuf,
+			versionedAckCallback, NULL, versionedUpdate.timeout_seconds, versionedUpdate.isPersistentSubscribe);
+}
+
+static void endVersionedUpdate(Shadow_Ack_Status_t status, const char *pReceivedJsonDocument) {
+	/* The callback may begin the next one */
+	versionedUpdate.isPending = false;
+	if (versionedUpdate.callback != NULL) {
+		versionedUpdate.callback(versionedUpdate.thingName, SHADOW_UPDATE, status, pReceivedJsonDocument,
+				versionedUpdate.pContextData);
+	}
+}
+
+static void versionedAckCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	int32_t tokenCount = 0;
+	uint32_t version = 0;
+	uint32_t errorCode = 0;
+
+	/* The ack tokens are parsed again, the records are done with them */
+	if (status != SHADOW_ACK_TIMEOUT && !isJsonValidAndParse(pReceivedJsonDocument, strlen(pReceivedJsonDocument), NULL,
+			&tokenCount)) {
+		tokenCount = 0;
+	}
+	if (status == SHADOW_ACK_REJECTED) {
+		extractErrorCode(pReceivedJsonDocument, tokenCount, &errorCode);
+	}
+
+	if (action == SHADOW_GET) {
+		if (status == SHADOW_ACK_ACCEPTED || errorCode == SHADOW_NOT_FOUND) {
+			if (status == SHADOW_ACK_ACCEPTED) {
+				extractVersionNumber(pReceivedJsonDocument, NULL, tokenCount, &version);
+			}
+			if (sendVersionedUpdate(version) != NONE_ERROR) {
+				endVersionedUpdate(SHADOW_ACK_TIMEOUT, NULL);
+			}
+			return;
+		}
+		endVersionedUpdate(status, pReceivedJsonDocument);
+		return;
+	}
+
+	if (status == SHADOW_ACK_ACCEPTED
+			&& extractVersionNumber(pReceivedJsonDocument, NULL, tokenCount, &version)) {
+		strcpy(lastVersionedThingName, versionedUpdate.thingName);
+		lastVersionedNum = version;
+	} else if (errorCode == SHADOW_VERSION_CONFLICT && versionedUpdate.retriesLeft > 0) {
+		versionedUpdate.retriesLeft--;
+		DEBUG("Version conflict on %s, getting the shadow", versionedUpdate.thingName);
+		if (sendVersionedGet() == NONE_ERROR) {
+			return;
+		}
+	}
+	endVersionedUpdate(status, pReceivedJsonDocument);
+}
+
+IoT_Error_t aws_iot_shadow_update_versioned(MQTTClient_t *pClient, const char *pThingName, char *pJsonString,
+		size_t maxSizeOfJsonDocument, fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds,
+		bool isPersistentSubscribe) {
+
+	IoT_Error_t ret_val = NONE_ERROR;
+	char extractedClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+	uint32_t version;
+
+	if (pClient == NULL || pThingName == NULL || pJsonString == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	/* Without a client token the responses could not be told apart */
+	if (versionedUpdate.isPending || strlen(pThingName) >= MAX_SIZE_OF_THING_NAME
+			|| !extractClientToken(pJsonString, strlen(pJsonString), extractedClientToken)) {
+		return GENERIC_ERROR;
+	}
+
+	versionedUpdate.pClient = pClient;
+	strcpy(versionedUpdate.thingName, pThingName);
+	versionedUpdate.pJsonString = pJsonString;
+	versionedUpdate.maxSizeOfJsonDocument = maxSizeOfJsonDocument;
+	versionedUpdate.callback = callback;
+	versionedUpdate.pContextData = pContextData;
+	versionedUpdate.timeout_seconds = timeout_seconds;
+	versionedUpdate.retriesLeft = SHADOW_VERSIONED_UPDATE_RETRIES;
+	versionedUpdate.isPersistentSubscribe = isPersistentSubscribe;
+
+	version = lastKnownVersion(pThingName);
+	if (version != 0) {
+		ret_val = sendVersionedUpdate(version);
+	} else {
+		ret_val = sendVersionedGet();
+	}
+	if (ret_val == NONE_ERROR) {
+		versionedUpdate.isPending = true;
+	}
+
+	return ret_val;
+}
+
 IoT_Error_t aws_iot_shadow_delete(MQTTClient_t *pClient, const char *pThingName, fpActionCallback_t callback,
 		void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe) {
 	IoT_Error_t ret_val = NONE_ERROR;
@@ -171,3 +428,29 @@ IoT_Error_t aws_iot_shadow_get(MQTTClient_t *pClient, const char *pThingName, fp
 
 	return ret_val;
 }
+
+IoT_Error_t aws_iot_shadow_resync(MQTTClient_t *pClient, fpActionCallback_t callback, void *pContextData,
+		uint8_t timeout_seconds) {
+
+	IoT_Error_t ret_val = NONE_ERROR;
+
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	if (!beginShadowResync(callback, pContextData)) {
+		return GENERIC_ERROR;
+	}
+
+	char getRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+
+	iot_shadow_get_request_json(getRequestJsonBuf);
+
+	ret_val = iot_shadow_action(pClient, myThingName, SHADOW_GET, getRequestJsonBuf, shadowResyncAckCallback, NULL,
+			timeout_seconds, true);
+	if (ret_val != NONE_ERROR) {
+		endShadowResync();
+	}
+
+	return ret_val;
+}
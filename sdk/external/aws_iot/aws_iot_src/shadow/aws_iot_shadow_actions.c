@@ -15,6 +15,8 @@
 
 #include "aws_iot_shadow_actions.h"
 
+#include <string.h>
+
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_json.h"
 #include "aws_iot_shadow_records.h"
@@ -28,7 +30,8 @@ IoT_Error_t iot_shadow_action(MQTTClient_t *pClient, const char *pThingName, Sha
 	bool isCallbackPresent = false;
 	bool isClientTokenPresent = false;
 	bool isAckWaitListFree = false;
-	uint8_t indexAckWaitList;
+	uint16_t indexAckWaitList;
+	int16_t topicsIndex;
 
 	if(pClient == NULL || pThingName == NULL || pJsonDocumentToBeSent == NULL){
 		return NULL_VALUE_ERROR;
@@ -39,18 +42,20 @@ IoT_Error_t iot_shadow_action(MQTTClient_t *pClient, const char *pThingName, Sha
 	}
 
 	char extractedClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
-	isClientTokenPresent = extractClientToken(pJsonDocumentToBeSent, extractedClientToken);
+	isClientTokenPresent = extractClientToken(pJsonDocumentToBeSent, strlen(pJsonDocumentToBeSent), extractedClientToken);
+
+	topicsIndex = findShadowTopics(pThingName, action);
 
 	if (isClientTokenPresent && isCallbackPresent) {
 		if (getNextFreeIndexOfAckWaitList(&indexAckWaitList)) {
 			isAckWaitListFree = true;
 		}
 
-		if(isAckWaitListFree) {
-			if (!isSubscriptionPresent(pThingName, action)) {
-				ret_val = subscribeToShadowActionAcks(pThingName, action, isSticky);
+		if(isAckWaitListFree && topicsIndex >= 0) {
+			if (!isSubscriptionPresent(topicsIndex)) {
+				ret_val = subscribeToShadowActionAcks(topicsIndex, isSticky);
 			} else {
-				incrementSubscriptionCnt(pThingName, action, isSticky);
+				incrementSubscriptionCnt(topicsIndex, isSticky);
 			}
 		}
 		else {
@@ -60,12 +65,12 @@ IoT_Error_t iot_shadow_action(MQTTClient_t *pClient, const char *pThingName, Sha
 
 
 	if (ret_val == NONE_ERROR) {
-		ret_val = publishToShadowAction(pThingName, action, pJsonDocumentToBeSent);
+		ret_val = publishToShadowAction(topicsIndex, pThingName, action, pJsonDocumentToBeSent);
 	}
 
 	if (isClientTokenPresent && isCallbackPresent && ret_val == NONE_ERROR && isAckWaitListFree) {
-		addToAckWaitList(indexAckWaitList, pThingName, action, extractedClientToken, callback, pCallbackContext,
-				timeout_seconds);
+		addToAckWaitList(indexAckWaitList, topicsIndex, pThingName, action, extractedClientToken, callback,
+				pCallbackContext, timeout_seconds);
 	}
 	return ret_val;
 }
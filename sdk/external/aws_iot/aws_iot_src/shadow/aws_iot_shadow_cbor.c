@@ -0,0 +1,564 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_shadow_cbor.c
+ * @brief CBOR (RFC 7049) encoding of jsonStruct_t fields
+ */
+
+#include "aws_iot_shadow_cbor.h"
+
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include "aws_iot_shadow_key.h"
+#include "aws_iot_config.h"
+
+#define CBOR_UINT		0
+#define CBOR_NEGINT		1
+#define CBOR_BYTES		2
+#define CBOR_TEXT		3
+#define CBOR_ARRAY		4
+#define CBOR_MAP		5
+#define CBOR_TAG		6
+#define CBOR_SIMPLE		7
+
+#define CBOR_FALSE		20
+#define CBOR_TRUE		21
+#define CBOR_HALF		25
+#define CBOR_FLOAT		26
+#define CBOR_DOUBLE		27
+#define CBOR_INDEFINITE		31
+#define CBOR_BREAK		0xff
+
+/* Nesting of arrays, maps and tags skipped while decoding */
+#define CBOR_MAX_DEPTH		8
+
+/* Once an append did not fit the builder keeps failing with the first error */
+static void cborAppend(cborBuilder_t *pBuilder, const void *pData, size_t len) {
+	if (pBuilder->error != NONE_ERROR) {
+		return;
+	}
+	if (pBuilder->length + len > pBuilder->bufferSize) {
+		pBuilder->error = SHADOW_JSON_BUFFER_TRUNCATED;
+		return;
+	}
+	memcpy(pBuilder->pBuffer + pBuilder->length, pData, len);
+	pBuilder->length += len;
+}
+
+static inline void cborAppendByte(cborBuilder_t *pBuilder, uint8_t byte) {
+	cborAppend(pBuilder, &byte, 1);
+}
+
+/* Big endian, as CBOR */
+static void cborAppendBigEndian(cborBuilder_t *pBuilder, uint64_t value, uint8_t size) {
+	uint8_t bytes[8];
+	uint8_t i;
+
+	for (i = 0; i < size; i++) {
+		bytes[size - 1 - i] = (uint8_t)(value >> (8 * i));
+	}
+	cborAppend(pBuilder, bytes, size);
+}
+
+/* The head of a data item, with the argument in its shortest form */
+static void cborAppendHead(cborBuilder_t *pBuilder, uint8_t major, uint64_t argument) {
+	major <<= 5;
+	if (argument < 24) {
+		cborAppendByte(pBuilder, major | (uint8_t)argument);
+	} else if (argument <= UINT8_MAX) {
+		cborAppendByte(pBuilder, major | 24);
+		cborAppendBigEndian(pBuilder, argument, 1);
+	} else if (argument <= UINT16_MAX) {
+		cborAppendByte(pBuilder, major | 25);
+		cborAppendBigEndian(pBuilder, argument, 2);
+	} else if (argument <= UINT32_MAX) {
+		cborAppendByte(pBuilder, major | 26);
+		cborAppendBigEndian(pBuilder, argument, 4);
+	} else {
+		cborAppendByte(pBuilder, major | 27);
+		cborAppendBigEndian(pBuilder, argument, 8);
+	}
+}
+
+static void cborAppendInt64(cborBuilder_t *pBuilder, int64_t value) {
+	if (value < 0) {
+		cborAppendHead(pBuilder, CBOR_NEGINT, (uint64_t)(-(value + 1)));
+	} else {
+		cborAppendHead(pBuilder, CBOR_UINT, (uint64_t)value);
+	}
+}
+
+static void cborAppendText(cborBuilder_t *pBuilder, const char *pString) {
+	size_t len = strlen(pString);
+
+	cborAppendHead(pBuilder, CBOR_TEXT, len);
+	cborAppend(pBuilder, pString, len);
+}
+
+static void cborAppendValue(cborBuilder_t *pBuilder, JsonPrimitiveType type, void *pData) {
+	uint32_t floatBits;
+	uint64_t doubleBits;
+
+	if (type == SHADOW_JSON_INT32) {
+		cborAppendInt64(pBuilder, *(int32_t *)(pData));
+	} else if (type == SHADOW_JSON_INT16) {
+		cborAppendInt64(pBuilder, *(int16_t *)(pData));
+	} else if (type == SHADOW_JSON_INT8) {
+		cborAppendInt64(pBuilder, *(int8_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT32) {
+		cborAppendHead(pBuilder, CBOR_UINT, *(uint32_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT16) {
+		cborAppendHead(pBuilder, CBOR_UINT, *(uint16_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT8) {
+		cborAppendHead(pBuilder, CBOR_UINT, *(uint8_t *)(pData));
+	} else if (type == SHADOW_JSON_FLOAT) {
+		memcpy(&floatBits, pData, sizeof(floatBits));
+		cborAppendByte(pBuilder, (CBOR_SIMPLE << 5) | CBOR_FLOAT);
+		cborAppendBigEndian(pBuilder, floatBits, 4);
+	} else if (type == SHADOW_JSON_DOUBLE) {
+		memcpy(&doubleBits, pData, sizeof(doubleBits));
+		cborAppendByte(pBuilder, (CBOR_SIMPLE << 5) | CBOR_DOUBLE);
+		cborAppendBigEndian(pBuilder, doubleBits, 8);
+	} else if (type == SHADOW_JSON_BOOL) {
+		cborAppendByte(pBuilder, (CBOR_SIMPLE << 5) | (*(bool *)(pData) ? CBOR_TRUE : CBOR_FALSE));
+	} else if (type == SHADOW_JSON_STRING) {
+		cborAppendText(pBuilder, (char *)(pData));
+	} else if (pBuilder->error == NONE_ERROR) {
+		pBuilder->error = SHADOW_JSON_ERROR;
+	}
+}
+
+/* Adds "<pSection>":{"key":value,...} to the state map. The fields come from
+ * ppStructs, or from pArgs when ppStructs is NULL */
+static IoT_Error_t cborAddSection(cborBuilder_t *pBuilder, const char *pSection, uint8_t count, va_list *pArgs,
+		jsonStruct_t *const *ppStructs) {
+	jsonStruct_t *pTemporary;
+	uint8_t i;
+
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	cborAppendText(pBuilder, pSection);
+	cborAppendHead(pBuilder, CBOR_MAP, count);
+
+	for (i = 0; i < count && pBuilder->error == NONE_ERROR; i++) {
+		pTemporary = (ppStructs != NULL) ? ppStructs[i] : va_arg(*pArgs, jsonStruct_t *);
+		if (pTemporary == NULL || pTemporary->pKey == NULL || pTemporary->pData == NULL) {
+			return NULL_VALUE_ERROR;
+		}
+		cborAppendText(pBuilder, pTemporary->pKey);
+		cborAppendValue(pBuilder, pTemporary->type, pTemporary->pData);
+	}
+
+	return pBuilder->error;
+}
+
+IoT_Error_t aws_iot_shadow_cbor_builder_init(cborBuilder_t *pBuilder, uint8_t *pBuffer, size_t bufferSize) {
+	if (pBuilder == NULL || pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pBuilder->pBuffer = pBuffer;
+	pBuilder->bufferSize = bufferSize;
+	pBuilder->length = 0;
+	pBuilder->error = NONE_ERROR;
+
+	/* The sections are not known yet, both maps are closed by a break */
+	cborAppendByte(pBuilder, (CBOR_MAP << 5) | CBOR_INDEFINITE);
+	cborAppendText(pBuilder, "state");
+	cborAppendByte(pBuilder, (CBOR_MAP << 5) | CBOR_INDEFINITE);
+	return pBuilder->error;
+}
+
+IoT_Error_t aws_iot_shadow_cbor_builder_add_reported(cborBuilder_t *pBuilder, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = cborAddSection(pBuilder, "reported", count, &pArgs, NULL);
+	va_end(pArgs);
+	return ret_val;
+}
+
+IoT_Error_t aws_iot_shadow_cbor_builder_add_desired(cborBuilder_t *pBuilder, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = cborAddSection(pBuilder, "desired", count, &pArgs, NULL);
+	va_end(pArgs);
+	return ret_val;
+}
+
+IoT_Error_t aws_iot_shadow_cbor_builder_add_reported_array(cborBuilder_t *pBuilder, uint8_t count,
+		jsonStruct_t *const *ppStructs) {
+	if (ppStructs == NULL && count != 0) {
+		return NULL_VALUE_ERROR;
+	}
+
+	return cborAddSection(pBuilder, "reported", count, NULL, ppStructs);
+}
+
+IoT_Error_t aws_iot_shadow_cbor_builder_finalize(cborBuilder_t *pBuilder) {
+	char clientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+	IoT_Error_t ret_val;
+
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	ret_val = aws_iot_fill_with_client_token(clientToken, sizeof(clientToken));
+	if (ret_val != NONE_ERROR) {
+		return ret_val;
+	}
+
+	cborAppendByte(pBuilder, CBOR_BREAK);
+	cborAppendText(pBuilder, SHADOW_CLIENT_TOKEN_STRING);
+	cborAppendText(pBuilder, clientToken);
+	cborAppendByte(pBuilder, CBOR_BREAK);
+	return pBuilder->error;
+}
+
+typedef struct {
+	const uint8_t *p;
+	const uint8_t *end;
+} cborReader_t;
+
+/* Reads the head of the next data item. For the simple major type the argument
+ * is the raw bits of a half, single or double float */
+static bool cborReadHead(cborReader_t *r, uint8_t *pMajor, uint8_t *pInfo, uint64_t *pArgument) {
+	uint8_t size, i;
+
+	if (r->p >= r->end) {
+		return false;
+	}
+	*pMajor = *r->p >> 5;
+	*pInfo = *r->p & 0x1f;
+	r->p++;
+
+	if (*pInfo < 24 || *pInfo == CBOR_INDEFINITE) {
+		*pArgument = *pInfo;
+		return *pInfo != CBOR_INDEFINITE || (*pMajor >= CBOR_BYTES && *pMajor <= CBOR_MAP);
+	}
+	if (*pInfo > 27) {
+		return false;
+	}
+
+	size = 1 << (*pInfo - 24);
+	if ((size_t)(r->end - r->p) < size) {
+		return false;
+	}
+	*pArgument = 0;
+	for (i = 0; i < size; i++) {
+		*pArgument = (*pArgument << 8) | *r->p++;
+	}
+	return true;
+}
+
+static bool cborAtBreak(cborReader_t *r) {
+	if (r->p < r->end && *r->p == CBOR_BREAK) {
+		r->p++;
+		return true;
+	}
+	return false;
+}
+
+static bool cborSkipItem(cborReader_t *r, uint8_t depth) {
+	uint8_t major, info;
+	uint64_t argument, i;
+
+	if (depth > CBOR_MAX_DEPTH || !cborReadHead(r, &major, &info, &argument)) {
+		return false;
+	}
+
+	if (info == CBOR_INDEFINITE) {
+		/* Chunks of a string, or items of an array or map, up to a break */
+		while (!cborAtBreak(r)) {
+			if (!cborSkipItem(r, depth + 1)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	switch (major) {
+	case CBOR_BYTES:
+	case CBOR_TEXT:
+		if ((uint64_t)(r->end - r->p) < argument) {
+			return false;
+		}
+		r->p += argument;
+		return true;
+	case CBOR_MAP:
+		if (argument > (uint64_t)(r->end - r->p)) {
+			return false;
+		}
+		argument *= 2;
+		/* fall through */
+	case CBOR_ARRAY:
+		for (i = 0; i < argument; i++) {
+			if (!cborSkipItem(r, depth + 1)) {
+				return false;
+			}
+		}
+		return true;
+	case CBOR_TAG:
+		return cborSkipItem(r, depth + 1);
+	default:
+		return true;
+	}
+}
+
+/* Half floats are not written by the builder but other encoders use them for
+ * small values */
+static double cborHalfToDouble(uint16_t half) {
+	int exponent = (half >> 10) & 0x1f;
+	double value = half & 0x3ff;
+
+	if (exponent == 0x1f) {
+		value = (value == 0) ? 1.0 / 0.0 : 0.0 / 0.0;
+	} else {
+		if (exponent != 0) {
+			value += 1024;
+		} else {
+			exponent = 1;
+		}
+		for (exponent -= 25; exponent > 0; exponent--) {
+			value *= 2;
+		}
+		for (; exponent < 0; exponent++) {
+			value /= 2;
+		}
+	}
+	return (half & 0x8000) ? -value : value;
+}
+
+/* Stores the value between r->p and r->end into the field, converted to its type */
+static bool cborDecodeValue(cborReader_t *r, jsonStruct_t *pStruct) {
+	uint8_t major, info;
+	uint64_t argument;
+	int64_t integer = 0;
+	double real = 0;
+	bool isInteger = false, isReal = false;
+	uint32_t floatBits;
+	float f;
+
+	if (!cborReadHead(r, &major, &info, &argument)) {
+		return false;
+	}
+
+	if (major == CBOR_UINT || major == CBOR_NEGINT) {
+		if (argument > INT64_MAX) {
+			return false;
+		}
+		integer = (major == CBOR_UINT) ? (int64_t)argument : -1 - (int64_t)argument;
+		real = (double)integer;
+		isInteger = true;
+		isReal = true;
+	} else if (major == CBOR_SIMPLE && info == CBOR_HALF) {
+		real = cborHalfToDouble((uint16_t)argument);
+		isReal = true;
+	} else if (major == CBOR_SIMPLE && info == CBOR_FLOAT) {
+		floatBits = (uint32_t)argument;
+		memcpy(&f, &floatBits, sizeof(f));
+		real = f;
+		isReal = true;
+	} else if (major == CBOR_SIMPLE && info == CBOR_DOUBLE) {
+		memcpy(&real, &argument, sizeof(real));
+		isReal = true;
+	}
+
+	switch (pStruct->type) {
+	case SHADOW_JSON_INT32:
+		if (!isInteger || integer < INT32_MIN || integer > INT32_MAX) {
+			return false;
+		}
+		*(int32_t *)(pStruct->pData) = (int32_t)integer;
+		return true;
+	case SHADOW_JSON_INT16:
+		if (!isInteger || integer < INT16_MIN || integer > INT16_MAX) {
+			return false;
+		}
+		*(int16_t *)(pStruct->pData) = (int16_t)integer;
+		return true;
+	case SHADOW_JSON_INT8:
+		if (!isInteger || integer < INT8_MIN || integer > INT8_MAX) {
+			return false;
+		}
+		*(int8_t *)(pStruct->pData) = (int8_t)integer;
+		return true;
+	case SHADOW_JSON_UINT32:
+		if (!isInteger || integer < 0 || integer > UINT32_MAX) {
+			return false;
+		}
+		*(uint32_t *)(pStruct->pData) = (uint32_t)integer;
+		return true;
+	case SHADOW_JSON_UINT16:
+		if (!isInteger || integer < 0 || integer > UINT16_MAX) {
+			return false;
+		}
+		*(uint16_t *)(pStruct->pData) = (uint16_t)integer;
+		return true;
+	case SHADOW_JSON_UINT8:
+		if (!isInteger || integer < 0 || integer > UINT8_MAX) {
+			return false;
+		}
+		*(uint8_t *)(pStruct->pData) = (uint8_t)integer;
+		return true;
+	case SHADOW_JSON_FLOAT:
+		if (!isReal) {
+			return false;
+		}
+		*(float *)(pStruct->pData) = (float)real;
+		return true;
+	case SHADOW_JSON_DOUBLE:
+		if (!isReal) {
+			return false;
+		}
+		*(double *)(pStruct->pData) = real;
+		return true;
+	case SHADOW_JSON_BOOL:
+		if (major != CBOR_SIMPLE || (info != CBOR_FALSE && info != CBOR_TRUE)) {
+			return false;
+		}
+		*(bool *)(pStruct->pData) = (info == CBOR_TRUE);
+		return true;
+	case SHADOW_JSON_STRING:
+		if (major != CBOR_TEXT || info == CBOR_INDEFINITE || argument > (uint64_t)(r->end - r->p)) {
+			return false;
+		}
+		memcpy(pStruct->pData, r->p, (size_t)argument);
+		((char *)(pStruct->pData))[argument] = '\0';
+		return true;
+	default:
+		/* Objects are only passed to the callback */
+		return true;
+	}
+}
+
+#define CBOR_MAP_INVALID	(-1)
+#define CBOR_MAP_DONE		0
+#define CBOR_MAP_STOPPED	1
+
+/* Calls fn with every entry of the map at r keyed by a definite length text,
+ * pValue covering just the value. Stops early when fn returns true, r then
+ * covers the value of that entry */
+typedef bool (*cborEntryFn_t)(const char *pKey, size_t keyLen, cborReader_t *pValue, void *pContext);
+
+static int cborForEachEntry(cborReader_t *r, cborEntryFn_t fn, void *pContext) {
+	uint8_t major, info;
+	uint64_t entries, keyLen, i;
+	cborReader_t key, value;
+	bool indefinite;
+
+	if (!cborReadHead(r, &major, &info, &entries) || major != CBOR_MAP) {
+		return CBOR_MAP_INVALID;
+	}
+	indefinite = (info == CBOR_INDEFINITE);
+
+	for (i = 0; indefinite || i < entries; i++) {
+		if (indefinite && cborAtBreak(r)) {
+			break;
+		}
+
+		key = *r;
+		if (!cborSkipItem(r, 1)) {
+			return CBOR_MAP_INVALID;
+		}
+		value.p = r->p;
+		if (!cborSkipItem(r, 1)) {
+			return CBOR_MAP_INVALID;
+		}
+		value.end = r->p;
+
+		if (!cborReadHead(&key, &major, &info, &keyLen) || major != CBOR_TEXT || info == CBOR_INDEFINITE) {
+			continue;
+		}
+		if (fn((const char *)key.p, (size_t)keyLen, &value, pContext)) {
+			*r = value;
+			return CBOR_MAP_STOPPED;
+		}
+	}
+	return CBOR_MAP_DONE;
+}
+
+static bool cborKeyEquals(const char *pKey, size_t keyLen, const char *pString) {
+	return keyLen == strlen(pString) && memcmp(pKey, pString, keyLen) == 0;
+}
+
+/* Entry callback finding the key given as context */
+static bool cborFindKey(const char *pKey, size_t keyLen, cborReader_t *pValue, void *pContext) {
+	return cborKeyEquals(pKey, keyLen, (const char *)pContext);
+}
+
+/* Points r at the value of pKey in the map at r */
+static bool cborFind(cborReader_t *r, const char *pKey) {
+	cborReader_t map = *r;
+
+	if (cborForEachEntry(&map, cborFindKey, (void *)pKey) != CBOR_MAP_STOPPED) {
+		return false;
+	}
+	*r = map;
+	return true;
+}
+
+typedef struct {
+	jsonStruct_t *const *ppStructs;
+	uint8_t count;
+} cborFields_t;
+
+static bool cborDecodeEntry(const char *pKey, size_t keyLen, cborReader_t *pValue, void *pContext) {
+	cborFields_t *pFields = (cborFields_t *)pContext;
+	cborReader_t value;
+	jsonStruct_t *pStruct;
+	uint8_t i;
+
+	for (i = 0; i < pFields->count; i++) {
+		pStruct = pFields->ppStructs[i];
+		if (pStruct == NULL || pStruct->pKey == NULL || !cborKeyEquals(pKey, keyLen, pStruct->pKey)) {
+			continue;
+		}
+		value = *pValue;
+		if (pStruct->pData != NULL && !cborDecodeValue(&value, pStruct)) {
+			continue;
+		}
+		if (pStruct->cb != NULL) {
+			pStruct->cb((const char *)pValue->p, (uint32_t)(pValue->end - pValue->p), pStruct);
+		}
+	}
+	return false;
+}
+
+IoT_Error_t aws_iot_shadow_cbor_parse(const uint8_t *pDocument, size_t length, const char *pSection,
+		jsonStruct_t *const *ppStructs, uint8_t count) {
+	cborReader_t r, state;
+	cborFields_t fields;
+
+	if (pDocument == NULL || (ppStructs == NULL && count != 0)) {
+		return NULL_VALUE_ERROR;
+	}
+
+	r.p = pDocument;
+	r.end = pDocument + length;
+	if (pSection != NULL) {
+		state = r;
+		if (cborFind(&state, "state")) {
+			r = state;
+		}
+		if (!cborFind(&r, pSection)) {
+			return JSON_PARSE_ERROR;
+		}
+	}
+
+	fields.ppStructs = ppStructs;
+	fields.count = count;
+	if (cborForEachEntry(&r, cborDecodeEntry, &fields) != CBOR_MAP_DONE) {
+		return JSON_PARSE_ERROR;
+	}
+	return NONE_ERROR;
+}
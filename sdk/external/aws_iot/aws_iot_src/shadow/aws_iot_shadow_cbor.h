@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_shadow_cbor.h
+ * @brief CBOR (RFC 7049) encoding of jsonStruct_t fields
+ *
+ * A binary alternative to the JSON builder for payloads that are not sent to the
+ * Thing Shadow service itself, which only accepts JSON, e.g. telemetry published
+ * to a rules engine topic. Numbers are written in their binary form, an integer
+ * below 24 takes a single byte, and decoding does not need a tokenizer.
+ *
+ * A document built with aws_iot_shadow_cbor_builder_init() is a map with the same
+ * layout as the JSON document: {"state":{"reported":{...},"desired":{...}},
+ * "clientToken":"..."}.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_CBOR_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_CBOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_shadow_json_data.h"
+
+/**
+ * @brief Cursor over a CBOR document being built
+ *
+ * Fill it with aws_iot_shadow_cbor_builder_init().
+ */
+typedef struct {
+	uint8_t *pBuffer;		///< CBOR document
+	size_t bufferSize;		///< Size of pBuffer
+	size_t length;			///< Length of the document written so far
+	IoT_Error_t error;		///< First error hit while building, NONE_ERROR if all fitted
+} cborBuilder_t;
+
+/**
+ * @brief Start a CBOR document with a builder
+ *
+ * Follow with aws_iot_shadow_cbor_builder_add_reported() and/or
+ * aws_iot_shadow_cbor_builder_add_desired() and finish with aws_iot_shadow_cbor_builder_finalize().
+ *
+ * @param pBuilder builder to initialize
+ * @param pBuffer buffer the document is written to
+ * @param bufferSize size of pBuffer
+ * @return An IoT Error Type defining if the buffer was null or too small
+ */
+IoT_Error_t aws_iot_shadow_cbor_builder_init(cborBuilder_t *pBuilder, uint8_t *pBuffer, size_t bufferSize);
+
+/**
+ * @brief Add the reported section of jsonStruct_t to a CBOR builder
+ *
+ * SHADOW_JSON_OBJECT fields can not be encoded and fail with SHADOW_JSON_ERROR.
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_cbor_builder_init()
+ * @param count total number of arguments(jsonStruct_t object) passed in the arguments
+ * @return An IoT Error Type defining if the buffer was null or the entire document did not fit
+ */
+IoT_Error_t aws_iot_shadow_cbor_builder_add_reported(cborBuilder_t *pBuilder, uint8_t count, ...);
+
+/**
+ * @brief Add the desired section of jsonStruct_t to a CBOR builder
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_cbor_builder_init()
+ * @param count total number of arguments(jsonStruct_t object) passed in the arguments
+ * @return An IoT Error Type defining if the buffer was null or the entire document did not fit
+ */
+IoT_Error_t aws_iot_shadow_cbor_builder_add_desired(cborBuilder_t *pBuilder, uint8_t count, ...);
+
+/**
+ * @brief Add the reported section of an array of jsonStruct_t to a CBOR builder
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_cbor_builder_init()
+ * @param count number of jsonStruct_t pointers in ppStructs
+ * @param ppStructs fields to add
+ * @return An IoT Error Type defining if the buffer was null or the entire document did not fit
+ */
+IoT_Error_t aws_iot_shadow_cbor_builder_add_reported_array(cborBuilder_t *pBuilder, uint8_t count,
+		jsonStruct_t *const *ppStructs);
+
+/**
+ * @brief Finalize a CBOR builder document with the client token
+ *
+ * The document is pBuilder->length bytes at pBuilder->pBuffer afterwards.
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_cbor_builder_init()
+ * @return An IoT Error Type defining if the buffer was null or the entire document did not fit
+ */
+IoT_Error_t aws_iot_shadow_cbor_builder_finalize(cborBuilder_t *pBuilder);
+
+/**
+ * @brief Decode the fields of a section of a CBOR document
+ *
+ * Looks up pSection ("reported" or "desired") in the "state" map of the document, or in
+ * the top level map when there is no "state". Every key of the section matching a
+ * jsonStruct_t of ppStructs is decoded into its pData, converted to its type, and its
+ * callback is called like for a JSON delta. The callback gets the CBOR encoded value
+ * instead of the JSON text. Keys whose value does not fit the type of their field are
+ * skipped. A SHADOW_JSON_STRING field gets a NUL terminated copy of the text, pData has
+ * to be large enough as for the JSON parser.
+ *
+ * @param pDocument CBOR document
+ * @param length size of the document
+ * @param pSection section to decode, NULL to decode the top level map
+ * @param ppStructs fields to look for
+ * @param count number of jsonStruct_t pointers in ppStructs
+ * @return NONE_ERROR, or JSON_PARSE_ERROR if the document is not valid CBOR or the section is missing
+ */
+IoT_Error_t aws_iot_shadow_cbor_parse(const uint8_t *pDocument, size_t length, const char *pSection,
+		jsonStruct_t *const *ppStructs, uint8_t count);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_CBOR_H_ */
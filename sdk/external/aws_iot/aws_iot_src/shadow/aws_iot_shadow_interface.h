@@ -35,6 +35,8 @@
  */
 #include "aws_iot_mqtt_interface.h"
 #include "aws_iot_shadow_json_data.h"
+#include "aws_iot_shadow_cbor.h"
+#include "jsmn.h"
 
 /*!
  * @brief Shadow Connect parameters
@@ -53,6 +55,7 @@ typedef struct {
 	char *pRootCA; ///< Location with the Filename of the Root CA
 	char *pClientCRT; ///< Location of Device certs signed by AWS IoT service
 	char *pClientKey; ///< Location of Device private key
+	bool isAckWildcardSubscribed; ///< Subscribe once at connect to $aws/things/<pMyThingName>/shadow/+/+. Actions on this thing then never wait for a subscription of their accepted/rejected topics, nor unsubscribe them. Costs one message handler
 } ShadowParameters_t;
 
 /*!
@@ -95,6 +98,17 @@ IoT_Error_t aws_iot_shadow_connect(MQTTClient_t *pClient, ShadowParameters_t *pP
  * @return An IoT Error Type defining successful/failed Yield
  */
 IoT_Error_t aws_iot_shadow_yield(MQTTClient_t *pClient, int timeout);
+/**
+ * @brief Yield function that sleeps until something happens
+ *
+ * Same as aws_iot_shadow_yield() but returns as soon as received messages have been handled or
+ * pClient->wakeup() was called, instead of polling for the whole timeout.
+ *
+ * @param pClient	MQTT Client used as the protocol layer
+ * @param timeout	in milliseconds, This is the maximum time the yield function will wait for an event
+ * @return An IoT Error Type defining successful/failed Yield
+ */
+IoT_Error_t aws_iot_shadow_yield_until_event(MQTTClient_t *pClient, int timeout);
 /**
  * @brief Disconnect from the AWS IoT Thing Shadow service over MQTT
  *
@@ -134,7 +148,7 @@ typedef enum {
  * @param pThingName Thing Name of the response received
  * @param action The response of the action
  * @param status Informs if the action was Accepted/Rejected or Timed out
- * @param pReceivedJsonDocument Received JSON document
+ * @param pReceivedJsonDocument Received JSON document, NUL terminated. NULL when the action timed out
  * @param pContextData the void* data passed in during the action call(update, get or delete)
  *
  */
@@ -167,6 +181,37 @@ typedef void (*fpActionCallback_t)(const char *pThingName, ShadowActions_t actio
 IoT_Error_t aws_iot_shadow_update(MQTTClient_t *pClient, const char *pThingName, char *pJsonString,
 		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe);
 
+/**
+ * @brief Update with the last known version of the shadow, so that it does not overwrite changes made by others
+ *
+ * The version is written as the first member of the document, the service rejects the update with code 409 when the
+ * shadow changed since. Only then the shadow is got and the update is sent again with the version of the get, up to
+ * #SHADOW_VERSIONED_UPDATE_RETRIES times. Without a conflict this takes a single round trip instead of a get before
+ * every update.
+ *
+ * The last known version is the one of the deltas and gets of #AWS_IOT_MY_THING_NAME, or of a thing added with
+ * aws_iot_shadow_thing_add(), or of the last update accepted by this function. A thing without a known version is got
+ * first. A shadow that does not exist yet is created by an update without a version.
+ *
+ * The document needs a client token, as built by aws_iot_shadow_json_builder_finalize(), and no version of its own. It is
+ * written in place and has to stay valid until the callback. One versioned update can be pending at a time.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param pThingName Thing Name of the shadow that needs to be Updated
+ * @param pJsonString NUL terminated JSON document
+ * @param maxSizeOfJsonDocument Size of the buffer of the document, it grows by the version
+ * @param callback Called once with SHADOW_UPDATE and the response to the last update sent, or with SHADOW_ACK_REJECTED and the
+ * response of a rejected get. SHADOW_ACK_TIMEOUT and NULL when a response timed out or the update could not be sent again.
+ * Can be NULL
+ * @param pContextData Passed to the callback
+ * @param timeout_seconds Time every response can take
+ * @param isPersistentSubscribe As for aws_iot_shadow_update()
+ * @return An IoT Error Type, GENERIC_ERROR if a versioned update is already pending or the document has no client token
+ */
+IoT_Error_t aws_iot_shadow_update_versioned(MQTTClient_t *pClient, const char *pThingName, char *pJsonString,
+		size_t maxSizeOfJsonDocument, fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds,
+		bool isPersistentSubscribe);
+
 /**
  * @brief This function is the one used to perform an Get action to a Thing Name's Shadow.
  *
@@ -183,6 +228,26 @@ IoT_Error_t aws_iot_shadow_update(MQTTClient_t *pClient, const char *pThingName,
  */
 IoT_Error_t aws_iot_shadow_get(MQTTClient_t *pClient, const char *pThingName, fpActionCallback_t callback,
 		void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe);
+
+/**
+ * @brief Bring the delta handlers of #AWS_IOT_MY_THING_NAME up to date, e.g. after a reconnect
+ *
+ * Gets the shadow and, only if its version is newer than the last state the delta handlers were given, by a delta or an
+ * earlier resync, hands the keys of its state.delta section, the desired fields that differ from the reported ones, to the
+ * handler of aws_iot_shadow_register_delta_handler() and the keys of aws_iot_shadow_register_delta(). A document that did
+ * not change is not walked and no handler is called. The get subscribes persistently.
+ *
+ * The callback gets the received document when the state was handed on or the get was rejected, NULL with
+ * SHADOW_ACK_ACCEPTED when the version was not newer, and NULL on a timeout.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param callback Called with the response, can be NULL
+ * @param pContextData Passed to the callback
+ * @param timeout_seconds Time the response can take
+ * @return An IoT Error Type, GENERIC_ERROR if a resync is already waiting for its response
+ */
+IoT_Error_t aws_iot_shadow_resync(MQTTClient_t *pClient, fpActionCallback_t callback, void *pContextData,
+		uint8_t timeout_seconds);
 /**
  * @brief This function is the one used to perform an Delete action to a Thing Name's Shadow.
  *
@@ -211,6 +276,150 @@ IoT_Error_t aws_iot_shadow_delete(MQTTClient_t *pClient, const char *pThingName,
  */
 IoT_Error_t aws_iot_shadow_register_delta(MQTTClient_t *pClient, jsonStruct_t *pStruct);
 
+/**
+ * @brief Callback given the keys of a delta before the registered jsonStruct_t
+ *
+ * Called for every key of the delta document with the token of its value. Return true when the key was
+ * handled, false to look it up in the keys registered with aws_iot_shadow_register_delta().
+ */
+typedef bool (*shadowDeltaHandler_t)(const char *pJsonDocument, const char *pKey, uint32_t keyLength,
+		jsmntok_t *pValueToken, void *pContext);
+
+/**
+ * @brief This function is used to listen on the delta topic with a handler instead of a jsonStruct_t per key
+ *
+ * Meant for the handlers generated from a schema, see aws_iot_shadow_schema.h. Only one handler can be
+ * registered, a second call replaces it. Keys it does not handle still go to aws_iot_shadow_register_delta().
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param handler Handler given every key of a delta, NULL to remove it
+ * @param pContext Passed to the handler
+ * @return An IoT Error Type defining successful/failed delta registering
+ */
+IoT_Error_t aws_iot_shadow_register_delta_handler(MQTTClient_t *pClient, shadowDeltaHandler_t handler,
+		void *pContext);
+
+/**
+ * @brief Callback given a whole delta once all its keys are handled
+ *
+ * @param pJsonDocument The delta document
+ * @param version Its version, 0 if it has none
+ * @param ppChanged The keys registered with aws_iot_shadow_register_delta() whose value the delta updated, in the
+ * order of the document. Valid during the call only
+ * @param changedCount Number of keys in ppChanged, 0 when only the handler of
+ * aws_iot_shadow_register_delta_handler() was given keys
+ * @param pContext Passed to aws_iot_shadow_register_delta_batch()
+ */
+typedef void (*shadowDeltaBatchCallback_t)(const char *pJsonDocument, uint32_t version, jsonStruct_t *const *ppChanged,
+		uint32_t changedCount, void *pContext);
+
+/**
+ * @brief Deliver every delta of #AWS_IOT_MY_THING_NAME as a whole instead of key by key
+ *
+ * With a batch callback the values of all the keys of a delta, and of a resync, are updated first: the jsonStruct_t
+ * registered with aws_iot_shadow_register_delta() get their new value but their callback is not called, and the handler
+ * of aws_iot_shadow_register_delta_handler() parses its keys as before, setting their change bits. The batch callback is
+ * then called once with the keys that changed, so that the application applies and stores the change in one pass. A
+ * delta without any known key does not call it.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param callback The batch callback, NULL to go back to the callback of every key
+ * @param pContext Passed to the callback
+ * @return An IoT Error Type defining successful/failed delta registering
+ */
+IoT_Error_t aws_iot_shadow_register_delta_batch(MQTTClient_t *pClient, shadowDeltaBatchCallback_t callback,
+		void *pContext);
+
+/**
+ * @brief Handle the deltas of another thing, such as an end node behind a gateway
+ *
+ * The deltas of all the added things are received through a single subscription to $aws/things/+/shadow/update/delta, made when
+ * the first thing is added. Every thing has its own handler, which is given every key of a delta of that thing, and its own last
+ * received version, used to discard old deltas as aws_iot_shadow_enable_discard_old_delta_msgs() sets. At most #SHADOW_MAX_THINGS
+ * things can be added. Adding a thing again replaces its handler.
+ *
+ * Actions on these things go through aws_iot_shadow_update(), aws_iot_shadow_get() and aws_iot_shadow_delete() as for any thing,
+ * an accepted get also updates the version of the thing.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param pThingName Name of the thing, copied
+ * @param handler Handler given every key of a delta of the thing, the return value is not used
+ * @param pContext Passed to the handler
+ * @return An IoT Error Type, GENERIC_ERROR if the name is not valid or #SHADOW_MAX_THINGS things were already added
+ */
+IoT_Error_t aws_iot_shadow_thing_add(MQTTClient_t *pClient, const char *pThingName, shadowDeltaHandler_t handler,
+		void *pContext);
+
+/**
+ * @brief Stop handling the deltas of a thing added with aws_iot_shadow_thing_add()
+ *
+ * The shared delta subscription is removed with the last thing.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @param pThingName Name of the thing
+ * @return An IoT Error Type, GENERIC_ERROR if the thing was not added
+ */
+IoT_Error_t aws_iot_shadow_thing_remove(MQTTClient_t *pClient, const char *pThingName);
+
+/**
+ * @brief Last received version of the shadow of a thing added with aws_iot_shadow_thing_add()
+ *
+ * @param pThingName Name of the thing
+ * @return version number, 0 if none was received or the thing was not added
+ */
+uint32_t aws_iot_shadow_thing_get_last_received_version(const char *pThingName);
+
+/**
+ * @brief Reset the last received version of a thing added with aws_iot_shadow_thing_add() to zero
+ *
+ * @param pThingName Name of the thing
+ */
+void aws_iot_shadow_thing_reset_last_received_version(const char *pThingName);
+
+/**
+ * @brief Add a field to the reported state cache
+ *
+ * Registered fields are sent to the shadow of #AWS_IOT_MY_THING_NAME by the yield functions. Instead of one update per change,
+ * all the fields marked with aws_iot_shadow_reported_set() are merged in a single update sent #SHADOW_REPORTED_FLUSH_INTERVAL_MS
+ * after the first change, or as soon as #SHADOW_REPORTED_FLUSH_THRESHOLD fields have changed.
+ * Fields of an update that was rejected or timed out are sent again with the next one.
+ *
+ * @param pStruct The struct holding the key and the value of the field. It has to stay valid while the cache is used
+ * @return An IoT Error Type defining successful/failed registering
+ */
+IoT_Error_t aws_iot_shadow_reported_register(jsonStruct_t *pStruct);
+
+/**
+ * @brief Mark a registered reported field as changed
+ *
+ * Call this after modifying pStruct->pData. The value is read when the update is built, so a field changed several times before the
+ * flush is only sent once with its latest value. A field whose value is the one last sent is not marked, values bigger than
+ * #SHADOW_REPORTED_MAX_VALUE_SIZE bytes always are.
+ *
+ * @param pStruct Struct registered with aws_iot_shadow_reported_register()
+ * @return An IoT Error Type, GENERIC_ERROR if pStruct was not registered
+ */
+IoT_Error_t aws_iot_shadow_reported_set(jsonStruct_t *pStruct);
+
+/**
+ * @brief Mark every registered reported field whose value differs from the one last sent
+ *
+ * Saves keeping the previous values in the application, it can be called after any change or periodically.
+ *
+ * @return An IoT Error Type defining successful/failed marking
+ */
+IoT_Error_t aws_iot_shadow_reported_set_changed(void);
+
+/**
+ * @brief Send the changed reported fields now
+ *
+ * Does nothing if no field has changed or if the previous update is still waiting for its response.
+ *
+ * @param pClient MQTT Client used as the protocol layer
+ * @return An IoT Error Type defining successful/failed update action
+ */
+IoT_Error_t aws_iot_shadow_reported_flush(MQTTClient_t *pClient);
+
 /**
  * @brief Reset the last received version number to zero.
  * This will be useful if the Thing Shadow is deleted and would like to to reset the local version
@@ -228,6 +437,16 @@ void aws_iot_shadow_reset_last_received_version(void);
  *
  */
 uint32_t aws_iot_shadow_get_last_received_version(void);
+/**
+ * @brief Keep the last received version across the PM4 sleeps, see warm_resume.h
+ *
+ * Called after aws_iot_shadow_init(), which resets the version, and after warm_resume_init(). After
+ * a warm boot the version is the one of the last cycle, and with the discarding of old delta
+ * messages enabled a delta the last cycle already handled is not given again.
+ *
+ * @return NONE_ERROR, or GENERIC_ERROR if the version could not be kept
+ */
+IoT_Error_t aws_iot_shadow_warm_resume(void);
 /**
  * @brief Enable the ignoring of delta messages with old version number
  *
@@ -22,15 +22,15 @@
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_key.h"
 #include "aws_iot_config.h"
+#if AWS_IOT_RUNTIME_CONFIG
+#include "aws_iot_runtime_config.h"
+#endif
+#include <fast_float.h>
 
 extern char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
 
 static uint32_t clientTokenNum = 0;
 
-//helper functions
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-		void *pData);
-
 void resetClientTokenSequenceNum(void) {
 	clientTokenNum = 0;
 }
@@ -59,264 +59,425 @@ static inline IoT_Error_t checkReturnValueOfSnPrintf(int32_t snPrintfReturn, siz
 	return NONE_ERROR;
 }
 
-IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+/* The builder writes at pBuffer + length and keeps the buffer NUL terminated.
+ * Once an append did not fit the builder keeps failing with the first error */
+static void builderAppend(jsonBuilder_t *pBuilder, const char *pData, size_t len) {
+	if (pBuilder->error != NONE_ERROR) {
+		return;
+	}
+	if (pBuilder->length + len >= pBuilder->bufferSize) {
+		pBuilder->error = SHADOW_JSON_BUFFER_TRUNCATED;
+		return;
+	}
+	memcpy(pBuilder->pBuffer + pBuilder->length, pData, len);
+	pBuilder->length += len;
+	pBuilder->pBuffer[pBuilder->length] = '\0';
+}
 
-	IoT_Error_t ret_val = NONE_ERROR;
-	int32_t snPrintfReturn = 0;
+static inline void builderAppendString(jsonBuilder_t *pBuilder, const char *pString) {
+	builderAppend(pBuilder, pString, strlen(pString));
+}
 
-	if (pJsonDocument == NULL) {
-		return NULL_VALUE_ERROR;
-	}
-	snPrintfReturn = snprintf(pJsonDocument, maxSizeOfJsonDocument, "{\"state\":{");
+static inline void builderAppendChar(jsonBuilder_t *pBuilder, char c) {
+	builderAppend(pBuilder, &c, 1);
+}
 
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizeOfJsonDocument);
+static void builderAppendUint64(jsonBuilder_t *pBuilder, uint64_t value) {
+	char digits[20];
+	size_t i = sizeof(digits);
 
-	return ret_val;
+	do {
+		digits[--i] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
 
+	builderAppend(pBuilder, &digits[i], sizeof(digits) - i);
 }
 
-IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = NONE_ERROR;
-	int32_t tempSize = 0;
+static void builderAppendInt64(jsonBuilder_t *pBuilder, int64_t value) {
+	if (value < 0) {
+		builderAppendChar(pBuilder, '-');
+		builderAppendUint64(pBuilder, (uint64_t)(-(value + 1)) + 1);
+	} else {
+		builderAppendUint64(pBuilder, (uint64_t)value);
+	}
+}
+
+/* Same output as "%f" for the values a shadow document holds, anything too
+ * big for the integer formatter falls back to snprintf */
+static void builderAppendDouble(jsonBuilder_t *pBuilder, double value) {
+	char fraction[6];
+	uint64_t integerPart;
+	uint32_t fractionPart;
 	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	va_list pArgs;
-	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
 
-	if (pJsonDocument == NULL) {
-		return NULL_VALUE_ERROR;
+	if (value != value || value >= 1e18 || value <= -1e18) {
+		char tmp[32];
+		int32_t snPrintfReturn = snprintf(tmp, sizeof(tmp), "%f", value);
+		if (checkReturnValueOfSnPrintf(snPrintfReturn, sizeof(tmp)) != NONE_ERROR) {
+			pBuilder->error = SHADOW_JSON_ERROR;
+			return;
+		}
+		builderAppend(pBuilder, tmp, (size_t)snPrintfReturn);
+		return;
 	}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1){
-			return SHADOW_JSON_ERROR;
-		}
-		remSizeOfJsonBuffer = tempSize;
+	if (value < 0) {
+		builderAppendChar(pBuilder, '-');
+		value = -value;
+	}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"desired\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+	integerPart = (uint64_t)value;
+	fractionPart = (uint32_t)((value - (double)integerPart) * 1000000.0 + 0.5);
+	if (fractionPart >= 1000000) {
+		integerPart++;
+		fractionPart -= 1000000;
+	}
 
-	if (ret_val != NONE_ERROR) {
-		return ret_val;
+	for (i = sizeof(fraction) - 1; i >= 0; i--) {
+		fraction[i] = (char)('0' + (fractionPart % 10));
+		fractionPart /= 10;
 	}
 
-	for (i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-			if(tempSize <= 1){
-				return SHADOW_JSON_ERROR;
-			}
-			remSizeOfJsonBuffer = tempSize;
-		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if (pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-					pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-			if (pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-						pTemporary->type, pTemporary->pData);
-			} else {
-				return NULL_VALUE_ERROR;
-			}
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-		} else {
+	builderAppendUint64(pBuilder, integerPart);
+	builderAppendChar(pBuilder, '.');
+	builderAppend(pBuilder, fraction, sizeof(fraction));
+}
+
+/* Floats are formatted from their own bits, without going through double */
+static void builderAppendFloat(jsonBuilder_t *pBuilder, float value) {
+	char tmp[32];
+	int len = fast_ftoa(value, 6, tmp, sizeof(tmp));
+
+	if (len < 0) {
+		builderAppendDouble(pBuilder, value);
+		return;
+	}
+	builderAppend(pBuilder, tmp, (size_t)len);
+}
+
+static void builderAppendValue(jsonBuilder_t *pBuilder, JsonPrimitiveType type, void *pData) {
+	if (type == SHADOW_JSON_INT32) {
+		builderAppendInt64(pBuilder, *(int32_t *)(pData));
+	} else if (type == SHADOW_JSON_INT16) {
+		builderAppendInt64(pBuilder, *(int16_t *)(pData));
+	} else if (type == SHADOW_JSON_INT8) {
+		builderAppendInt64(pBuilder, *(int8_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT32) {
+		builderAppendUint64(pBuilder, *(uint32_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT16) {
+		builderAppendUint64(pBuilder, *(uint16_t *)(pData));
+	} else if (type == SHADOW_JSON_UINT8) {
+		builderAppendUint64(pBuilder, *(uint8_t *)(pData));
+	} else if (type == SHADOW_JSON_DOUBLE) {
+		builderAppendDouble(pBuilder, *(double *)(pData));
+	} else if (type == SHADOW_JSON_FLOAT) {
+		builderAppendFloat(pBuilder, *(float *)(pData));
+	} else if (type == SHADOW_JSON_BOOL) {
+		builderAppendString(pBuilder, *(bool *)(pData) ? "true" : "false");
+	} else if (type == SHADOW_JSON_STRING) {
+		builderAppendChar(pBuilder, '"');
+		builderAppendString(pBuilder, (char *)(pData));
+		builderAppendChar(pBuilder, '"');
+	}
+}
+
+static void builderAppendClientToken(jsonBuilder_t *pBuilder) {
+	builderAppendString(pBuilder, mqttClientID);
+	builderAppendChar(pBuilder, '-');
+	builderAppendUint64(pBuilder, clientTokenNum++);
+}
+
+/* Adds "<pSection>":{"key":value,...}, to the document. The fields come from
+ * ppStructs, or from pArgs when ppStructs is NULL */
+static IoT_Error_t builderAddSection(jsonBuilder_t *pBuilder, const char *pSection, uint8_t count, va_list *pArgs,
+		jsonStruct_t *const *ppStructs) {
+	jsonStruct_t *pTemporary;
+	uint8_t i;
+
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (pBuilder->bufferSize - pBuilder->length <= 1) {
+		return SHADOW_JSON_ERROR;
+	}
+
+	builderAppendChar(pBuilder, '"');
+	builderAppendString(pBuilder, pSection);
+	builderAppend(pBuilder, "\":{", 3);
+
+	for (i = 0; i < count && pBuilder->error == NONE_ERROR; i++) {
+		pTemporary = (ppStructs != NULL) ? ppStructs[i] : va_arg(*pArgs, jsonStruct_t *);
+		if (pTemporary == NULL || pTemporary->pKey == NULL || pTemporary->pData == NULL) {
 			return NULL_VALUE_ERROR;
 		}
+		if (i != 0) {
+			builderAppendChar(pBuilder, ',');
+		}
+		builderAppendChar(pBuilder, '"');
+		builderAppendString(pBuilder, pTemporary->pKey);
+		builderAppend(pBuilder, "\":", 2);
+		builderAppendValue(pBuilder, pTemporary->type, pTemporary->pData);
 	}
 
+	builderAppend(pBuilder, "},", 2);
+	return pBuilder->error;
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_init(jsonBuilder_t *pBuilder, char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	if (pBuilder == NULL || pJsonDocument == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (maxSizeOfJsonDocument == 0) {
+		return SHADOW_JSON_ERROR;
+	}
+
+	pBuilder->pBuffer = pJsonDocument;
+	pBuilder->bufferSize = maxSizeOfJsonDocument;
+	pBuilder->length = 0;
+	pBuilder->error = NONE_ERROR;
+	pJsonDocument[0] = '\0';
+
+	builderAppend(pBuilder, "{\"state\":{", 10);
+	return pBuilder->error;
+}
+
+IoT_Error_t aws_iot_shadow_json_builder_add_reported(jsonBuilder_t *pBuilder, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
+
+	va_start(pArgs, count);
+	ret_val = builderAddSection(pBuilder, "reported", count, &pArgs, NULL);
 	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
 	return ret_val;
 }
 
-IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = NONE_ERROR;
-
-	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	int32_t tempSize = 0;
+IoT_Error_t aws_iot_shadow_json_builder_add_desired(jsonBuilder_t *pBuilder, uint8_t count, ...) {
+	IoT_Error_t ret_val;
 	va_list pArgs;
+
 	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
+	ret_val = builderAddSection(pBuilder, "desired", count, &pArgs, NULL);
+	va_end(pArgs);
+	return ret_val;
+}
 
-	if (pJsonDocument == NULL) {
+IoT_Error_t aws_iot_shadow_json_builder_add_reported_array(jsonBuilder_t *pBuilder, uint8_t count,
+		jsonStruct_t *const *ppStructs) {
+	if (ppStructs == NULL && count != 0) {
 		return NULL_VALUE_ERROR;
 	}
 
+	return builderAddSection(pBuilder, "reported", count, NULL, ppStructs);
+}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
+IoT_Error_t aws_iot_shadow_json_builder_finalize(jsonBuilder_t *pBuilder) {
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (pBuilder->bufferSize - pBuilder->length <= 1) {
 		return SHADOW_JSON_ERROR;
 	}
-	remSizeOfJsonBuffer = tempSize;
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"reported\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-
-	if (ret_val != NONE_ERROR) {
-		return ret_val;
+	// remove the last ,(comma) that was added by the sections
+	if (pBuilder->length > 0 && pBuilder->pBuffer[pBuilder->length - 1] == ',') {
+		pBuilder->length--;
+		pBuilder->pBuffer[pBuilder->length] = '\0';
 	}
 
-	for (i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1){
-			return SHADOW_JSON_ERROR;
-		}
-		remSizeOfJsonBuffer = tempSize;
-
-		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if (pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-					pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-			if (pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-						pTemporary->type, pTemporary->pData);
-			} else {
-				return NULL_VALUE_ERROR;
-			}
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-		} else {
-			return NULL_VALUE_ERROR;
-		}
+	builderAppend(pBuilder, "}, \"", 4);
+	builderAppendString(pBuilder, SHADOW_CLIENT_TOKEN_STRING);
+	builderAppend(pBuilder, "\":\"", 3);
+	builderAppendClientToken(pBuilder);
+	builderAppend(pBuilder, "\"}", 2);
+	return pBuilder->error;
+}
+
+/* Sections written field by field, every field is followed by a comma which
+ * closing the section takes back */
+IoT_Error_t aws_iot_shadow_json_builder_open_section(jsonBuilder_t *pBuilder, const char *pSection) {
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL || pSection == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (pBuilder->bufferSize - pBuilder->length <= 1) {
+		return SHADOW_JSON_ERROR;
 	}
 
-	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-	return ret_val;
+	builderAppendChar(pBuilder, '"');
+	builderAppendString(pBuilder, pSection);
+	builderAppend(pBuilder, "\":{", 3);
+	return pBuilder->error;
 }
 
+IoT_Error_t aws_iot_shadow_json_builder_close_section(jsonBuilder_t *pBuilder) {
+	if (pBuilder == NULL || pBuilder->pBuffer == NULL) {
+		return NULL_VALUE_ERROR;
+	}
 
-int32_t FillWithClientTokenSize(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument) {
-	int32_t snPrintfReturn;
-	snPrintfReturn = snprintf(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument, "%s-%d", mqttClientID,
-			(unsigned int)clientTokenNum++);
+	if (pBuilder->error == NONE_ERROR && pBuilder->length > 0 && pBuilder->pBuffer[pBuilder->length - 1] == ',') {
+		pBuilder->length--;
+		pBuilder->pBuffer[pBuilder->length] = '\0';
+	}
+	builderAppend(pBuilder, "},", 2);
+	return pBuilder->error;
+}
 
-	return snPrintfReturn;
+static void builderAppendKey(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength) {
+	builderAppendChar(pBuilder, '"');
+	builderAppend(pBuilder, pKey, keyLength);
+	builderAppend(pBuilder, "\":", 2);
 }
 
-IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument){
+void aws_iot_shadow_json_builder_add_int(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, int64_t value) {
+	builderAppendKey(pBuilder, pKey, keyLength);
+	builderAppendInt64(pBuilder, value);
+	builderAppendChar(pBuilder, ',');
+}
 
-	int32_t snPrintfRet = 0;
-	snPrintfRet = FillWithClientTokenSize(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument);
-	return checkReturnValueOfSnPrintf(snPrintfRet, maxSizeOfJsonDocument);
+void aws_iot_shadow_json_builder_add_uint(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, uint64_t value) {
+	builderAppendKey(pBuilder, pKey, keyLength);
+	builderAppendUint64(pBuilder, value);
+	builderAppendChar(pBuilder, ',');
+}
 
+void aws_iot_shadow_json_builder_add_double(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, double value) {
+	builderAppendKey(pBuilder, pKey, keyLength);
+	builderAppendDouble(pBuilder, value);
+	builderAppendChar(pBuilder, ',');
 }
 
-IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	int32_t tempSize = 0;
-	IoT_Error_t ret_val = NONE_ERROR;
+void aws_iot_shadow_json_builder_add_bool(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, bool value) {
+	builderAppendKey(pBuilder, pKey, keyLength);
+	if (value) {
+		builderAppend(pBuilder, "true,", 5);
+	} else {
+		builderAppend(pBuilder, "false,", 6);
+	}
+}
 
+/* The functions below continue a document already in the buffer, its length
+ * is measured once per call instead of before every field */
+static IoT_Error_t attachBuilder(jsonBuilder_t *pBuilder, char *pJsonDocument, size_t maxSizeOfJsonDocument) {
 	if (pJsonDocument == NULL) {
 		return NULL_VALUE_ERROR;
 	}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
+	pBuilder->pBuffer = pJsonDocument;
+	pBuilder->bufferSize = maxSizeOfJsonDocument;
+	pBuilder->length = strlen(pJsonDocument);
+	pBuilder->error = NONE_ERROR;
+	if (pBuilder->length + 1 >= maxSizeOfJsonDocument) {
 		return SHADOW_JSON_ERROR;
 	}
-	remSizeOfJsonBuffer = tempSize;
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	jsonBuilder_t builder;
 
-	// strlen(ShadowTxBuffer) - 1 is to ensure we remove the last ,(comma) that was added
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "}, \"%s\":\"",
-			SHADOW_CLIENT_TOKEN_STRING);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+	return aws_iot_shadow_json_builder_init(&builder, pJsonDocument, maxSizeOfJsonDocument);
+}
+
+IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	jsonBuilder_t builder;
+	IoT_Error_t ret_val;
+	va_list pArgs;
 
+	ret_val = attachBuilder(&builder, pJsonDocument, maxSizeOfJsonDocument);
 	if (ret_val != NONE_ERROR) {
 		return ret_val;
 	}
-	// refactor this XXX repeated code
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
-		return SHADOW_JSON_ERROR;
-	}
-	remSizeOfJsonBuffer = tempSize;
 
+	va_start(pArgs, count);
+	ret_val = builderAddSection(&builder, "desired", count, &pArgs, NULL);
+	va_end(pArgs);
+	return ret_val;
+}
 
-	snPrintfReturn = FillWithClientTokenSize(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	jsonBuilder_t builder;
+	IoT_Error_t ret_val;
+	va_list pArgs;
 
+	ret_val = attachBuilder(&builder, pJsonDocument, maxSizeOfJsonDocument);
 	if (ret_val != NONE_ERROR) {
 		return ret_val;
 	}
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
-		return SHADOW_JSON_ERROR;
-	}
-	remSizeOfJsonBuffer = tempSize;
 
+	va_start(pArgs, count);
+	ret_val = builderAddSection(&builder, "reported", count, &pArgs, NULL);
+	va_end(pArgs);
+	return ret_val;
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"}");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
 
-	return ret_val;
+int32_t FillWithClientTokenSize(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument) {
+	int32_t snPrintfReturn;
+	snPrintfReturn = snprintf(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument, "%s-%d", mqttClientID,
+			(unsigned int)clientTokenNum++);
+
+	return snPrintfReturn;
+}
+
+IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument){
+
+	int32_t snPrintfRet = 0;
+	snPrintfRet = FillWithClientTokenSize(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument);
+	return checkReturnValueOfSnPrintf(snPrintfRet, maxSizeOfJsonDocument);
+
+}
+
+IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	jsonBuilder_t builder;
+	IoT_Error_t ret_val;
+
+	ret_val = attachBuilder(&builder, pJsonDocument, maxSizeOfJsonDocument);
+	if (ret_val != NONE_ERROR) {
+		return ret_val;
+	}
+
+	return aws_iot_shadow_json_builder_finalize(&builder);
 }
 
 void FillWithClientToken(char *pBufferToBeUpdatedWithClientToken) {
 	sprintf(pBufferToBeUpdatedWithClientToken, "%s-%d", mqttClientID, (unsigned int)clientTokenNum++);
 }
 
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-		void *pData) {
-	int32_t snPrintfReturn = 0;
-	IoT_Error_t ret_val = NONE_ERROR;
+static jsmn_parser shadowJsonParser;
+#if AWS_IOT_RUNTIME_CONFIG
+static jsmntok_t *jsonTokenStruct;
+static uint16_t maxJsonTokens;
 
-	if (maxSizoStringBuffer == 0) {
-		return SHADOW_JSON_ERROR;
-	}
+IoT_Error_t allocateShadowJsonTokens(void) {
+	const AwsIotRuntimeConfig *pConfig = aws_iot_runtime_config();
 
-	if (type == SHADOW_JSON_INT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi32",", *(int32_t * )(pData));
-	} else if (type == SHADOW_JSON_INT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi16",", *(int16_t * )(pData));
-	} else if (type == SHADOW_JSON_INT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi8",", *(int8_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu32",", *(uint32_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu16",", *(uint16_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu8",", *(uint8_t * )(pData));
-	} else if (type == SHADOW_JSON_DOUBLE) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(double * )(pData));
-	} else if (type == SHADOW_JSON_FLOAT) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(float * )(pData));
-	} else if (type == SHADOW_JSON_BOOL) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%s,", *(bool *)(pData)?"true":"false");
-	} else if (type == SHADOW_JSON_STRING) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "\"%s\",", (char * )(pData));
+	if (NULL == jsonTokenStruct) {
+		jsonTokenStruct = aws_iot_runtime_alloc(pConfig->maxJsonTokens * sizeof(*jsonTokenStruct));
+		if (NULL == jsonTokenStruct) {
+			return GENERIC_ERROR;
+		}
+		maxJsonTokens = pConfig->maxJsonTokens;
 	}
 
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizoStringBuffer);
-
-	return ret_val;
+	return NONE_ERROR;
 }
-static jsmn_parser shadowJsonParser;
+#else
 static jsmntok_t jsonTokenStruct[MAX_JSON_TOKEN_EXPECTED];
+#define maxJsonTokens MAX_JSON_TOKEN_EXPECTED
+#endif
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount) {
+bool isJsonValidAndParse(const char *pJsonDocument, size_t jsonSize, void *pJsonHandler, int32_t *pTokenCount) {
 	int32_t tokenCount;
 
+	/* The tokens hold 16 bit offsets, past them a document would be misread */
+	if (jsonSize > INT16_MAX) {
+		WARN("JSON document of %u bytes too long to parse\n", (unsigned)jsonSize);
+		return false;
+	}
+
 	jsmn_init(&shadowJsonParser);
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-			sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, jsonSize, jsonTokenStruct, maxJsonTokens);
 
 	if (tokenCount < 0) {
 		WARN("Failed to parse JSON: %d\n", tokenCount);
@@ -360,17 +521,69 @@ static IoT_Error_t UpdateValueIfNoObject(const char *pJsonString, jsonStruct_t *
 	return ret_val;
 }
 
+bool getJsonKeyToken(const char *pJsonDocument, int32_t tokenCount, int32_t tokenIndex, const char **ppKey,
+		uint32_t *pKeyLength) {
+	jsmntok_t *pToken;
+
+	if (tokenIndex < 1 || tokenIndex + 1 >= tokenCount) {
+		return false;
+	}
+
+	pToken = &jsonTokenStruct[tokenIndex];
+	if (pToken->type != JSMN_STRING) {
+		return false;
+	}
+
+	*ppKey = pJsonDocument + pToken->start;
+	*pKeyLength = pToken->end - pToken->start;
+	return true;
+}
+
+jsmntok_t *getJsonValueToken(int32_t tokenIndex) {
+	return &jsonTokenStruct[tokenIndex + 1];
+}
+
+int32_t skipJsonValue(int32_t tokenCount, int32_t tokenIndex) {
+	int end = jsonTokenStruct[tokenIndex].end;
+
+	/* Nested tokens follow their container and start before its end */
+	for (tokenIndex++; tokenIndex < tokenCount && jsonTokenStruct[tokenIndex].start < end; tokenIndex++) {
+	}
+	return tokenIndex;
+}
+
+int32_t findJsonObjectMember(const char *pJsonDocument, int32_t tokenCount, int32_t objectIndex, const char *pKey) {
+	int32_t i, end;
+
+	if (objectIndex < 0 || objectIndex >= tokenCount || jsonTokenStruct[objectIndex].type != JSMN_OBJECT) {
+		return -1;
+	}
+
+	end = skipJsonValue(tokenCount, objectIndex);
+	for (i = objectIndex + 1; i + 1 < end; i = skipJsonValue(tokenCount, i + 1)) {
+		if (jsoneq(pJsonDocument, &jsonTokenStruct[i], pKey) == 0) {
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+void updateValueOfJsonKeyToken(const char *pJsonDocument, int32_t tokenIndex, jsonStruct_t *pDataStruct,
+		uint32_t *pDataLength, int32_t *pDataPosition) {
+	jsmntok_t dataToken = jsonTokenStruct[tokenIndex + 1];
+
+	UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
+	*pDataPosition = dataToken.start;
+	*pDataLength = dataToken.end - dataToken.start;
+}
+
 bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
 		jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition) {
 	int32_t i;
 
-	for (i = 1; i < tokenCount; i++) {
+	for (i = 1; i + 1 < tokenCount; i++) {
 		if (jsoneq(pJsonDocument, &(jsonTokenStruct[i]), pDataStruct->pKey) == 0) {
-			jsmntok_t dataToken = jsonTokenStruct[i + 1];
-			uint32_t dataLength = dataToken.end - dataToken.start;
-			UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
-			*pDataPosition = dataToken.start;
-			*pDataLength = dataLength;
+			updateValueOfJsonKeyToken(pJsonDocument, i, pDataStruct, pDataLength, pDataPosition);
 			return true;
 		}
 	}
@@ -380,47 +593,22 @@ bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandl
 bool isReceivedJsonValid(const char *pJsonDocument) {
 	int32_t tokenCount;
 
-	jsmn_init(&shadowJsonParser);
-
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-			sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
-
-	if (tokenCount < 0) {
-		WARN("Failed to parse JSON: %d\n", tokenCount);
-		return false;
-	}
-
-	/* Assume the top-level element is an object */
-	if (tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
-		return false;
-	}
-
-	return true;
+	return isJsonValidAndParse(pJsonDocument, strlen(pJsonDocument), NULL, &tokenCount);
 }
 
-bool extractClientToken(const char *pJsonDocument, char *pExtractedClientToken) {
-	jsmn_init(&shadowJsonParser);
-	int32_t tokenCount, i;
+bool extractClientTokenFromParsedJson(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
+		char *pExtractedClientToken) {
+	int32_t i;
 	jsmntok_t ClientJsonToken;
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-			sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
-
-	if (tokenCount < 0) {
-		WARN("Failed to parse JSON: %d\n", tokenCount);
-		return false;
-	}
-
-	/* Assume the top-level element is an object */
-	if (tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
-		return false;
-	}
-
-	for (i = 1; i < tokenCount; i++) {
+	for (i = 1; i + 1 < tokenCount; i++) {
 		if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_CLIENT_TOKEN_STRING) == 0) {
 			ClientJsonToken = jsonTokenStruct[i + 1];
-			uint8_t length = ClientJsonToken.end - ClientJsonToken.start;
-			strncpy(pExtractedClientToken, pJsonDocument + ClientJsonToken.start, length);
+			uint32_t length = ClientJsonToken.end - ClientJsonToken.start;
+			if (length >= MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE) {
+				return false;
+			}
+			memcpy(pExtractedClientToken, pJsonDocument + ClientJsonToken.start, length);
 			pExtractedClientToken[length] = '\0';
 			return true;
 		}
@@ -429,11 +617,21 @@ bool extractClientToken(const char *pJsonDocument, char *pExtractedClientToken)
 	return false;
 }
 
+bool extractClientToken(const char *pJsonDocument, size_t jsonSize, char *pExtractedClientToken) {
+	int32_t tokenCount;
+
+	if (!isJsonValidAndParse(pJsonDocument, jsonSize, NULL, &tokenCount)) {
+		return false;
+	}
+
+	return extractClientTokenFromParsedJson(pJsonDocument, NULL, tokenCount, pExtractedClientToken);
+}
+
 bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber) {
 	int32_t i;
 	IoT_Error_t ret_val = NONE_ERROR;
 
-	for (i = 1; i < tokenCount; i++) {
+	for (i = 1; i + 1 < tokenCount; i++) {
 		if (jsoneq(pJsonDocument, &(jsonTokenStruct[i]), SHADOW_VERSION_STRING) == 0) {
 			jsmntok_t dataToken = jsonTokenStruct[i + 1];
 			ret_val = parseUnsignedInteger32Value(pVersionNumber, pJsonDocument, &dataToken);
@@ -445,3 +643,44 @@ bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t
 	return false;
 }
 
+
+bool extractErrorCode(const char *pJsonDocument, int32_t tokenCount, uint32_t *pErrorCode) {
+	int32_t i = findJsonObjectMember(pJsonDocument, tokenCount, 0, SHADOW_ERROR_CODE_STRING);
+
+	return i >= 0 && parseUnsignedInteger32Value(pErrorCode, pJsonDocument, &jsonTokenStruct[i]) == NONE_ERROR;
+}
+
+IoT_Error_t setJsonVersionNumber(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint32_t versionNumber) {
+	static const char versionPrefix[] = "{\"" SHADOW_VERSION_STRING "\":";
+	char member[sizeof(versionPrefix) + 12];
+	size_t jsonLength, oldLength = 0;
+	int32_t memberLength = 0;
+	const char *pEnd;
+
+	if (pJsonDocument == NULL || pJsonDocument[0] != '{') {
+		return NULL_VALUE_ERROR;
+	}
+
+	jsonLength = strlen(pJsonDocument);
+	if (strncmp(pJsonDocument, versionPrefix, sizeof(versionPrefix) - 1) == 0) {
+		for (pEnd = pJsonDocument + sizeof(versionPrefix) - 1; *pEnd >= '0' && *pEnd <= '9'; pEnd++) {
+		}
+		if (*pEnd == ',') {
+			pEnd++;
+		}
+		oldLength = pEnd - pJsonDocument - 1;
+	}
+
+	if (versionNumber != 0) {
+		memberLength = snprintf(member, sizeof(member), "\"%s\":%" PRIu32 "%s", SHADOW_VERSION_STRING, versionNumber,
+				pJsonDocument[1 + oldLength] == '}' ? "" : ",");
+	}
+	if (jsonLength - oldLength + memberLength >= maxSizeOfJsonDocument) {
+		return SHADOW_JSON_BUFFER_TRUNCATED;
+	}
+
+	/* The rest of the document moves with its NUL */
+	memmove(pJsonDocument + 1 + memberLength, pJsonDocument + 1 + oldLength, jsonLength - oldLength);
+	memcpy(pJsonDocument + 1, member, memberLength);
+	return NONE_ERROR;
+}
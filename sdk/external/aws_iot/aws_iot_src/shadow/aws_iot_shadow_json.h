@@ -20,11 +20,27 @@
 #include <stdarg.h>
 
 #include "aws_iot_error.h"
+#include "aws_iot_config.h"
 #include "aws_iot_shadow_json_data.h"
+#include "jsmn.h"
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount);
+#if AWS_IOT_RUNTIME_CONFIG
+/* Takes the token array from the arena of aws_iot_runtime_config.h, once */
+IoT_Error_t allocateShadowJsonTokens(void);
+#endif
+bool isJsonValidAndParse(const char *pJsonDocument, size_t jsonSize, void *pJsonHandler, int32_t *pTokenCount);
 bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
 		jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition);
+bool getJsonKeyToken(const char *pJsonDocument, int32_t tokenCount, int32_t tokenIndex, const char **ppKey,
+		uint32_t *pKeyLength);
+jsmntok_t *getJsonValueToken(int32_t tokenIndex);
+/* Index of the first token behind the value at tokenIndex and all the tokens nested in it */
+int32_t skipJsonValue(int32_t tokenCount, int32_t tokenIndex);
+/* Index of the value of the member pKey of the object at objectIndex, -1 if it has none. Members of nested objects
+ * are not looked at */
+int32_t findJsonObjectMember(const char *pJsonDocument, int32_t tokenCount, int32_t objectIndex, const char *pKey);
+void updateValueOfJsonKeyToken(const char *pJsonDocument, int32_t tokenIndex, jsonStruct_t *pDataStruct,
+		uint32_t *pDataLength, int32_t *pDataPosition);
 
 void iot_shadow_get_request_json(char *pJsonDocument);
 void iot_shadow_delete_request_json(char *pJsonDocument);
@@ -33,6 +49,12 @@ void resetClientTokenSequenceNum(void);
 
 bool isReceivedJsonValid(const char *pJsonDocument);
 void FillWithClientToken(char *pStringToUpdateClientToken);
-bool extractClientToken(const char *pJsonDocumentToBeSent, char *pExtractedClientToken);
+bool extractClientToken(const char *pJsonDocumentToBeSent, size_t jsonSize, char *pExtractedClientToken);
+bool extractClientTokenFromParsedJson(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
+		char *pExtractedClientToken);
 bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber);
+/* Code of a rejected action, e.g. 409 for a version conflict */
+bool extractErrorCode(const char *pJsonDocument, int32_t tokenCount, uint32_t *pErrorCode);
+/* Writes "version":N as the first member of the document, replacing the one written before. Version 0 removes it */
+IoT_Error_t setJsonVersionNumber(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint32_t versionNumber);
 #endif // AWS_IOT_SDK_SRC_IOT_SHADOW_JSON_H_
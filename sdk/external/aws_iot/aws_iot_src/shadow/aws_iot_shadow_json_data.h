@@ -21,7 +21,9 @@
  * @brief This file is the interface for all the Shadow related JSON functions.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * @brief This is a static JSON object that could be used in code
@@ -62,6 +64,19 @@ struct jsonStruct {
 	jsonStructCallback_t cb; ///< callback to be executed on receiving the Key value pair
 };
 
+/**
+ * @brief Cursor over a JSON document being built
+ *
+ * Keeps the write position and the remaining space of the document so that building it
+ * is linear in its size. Fill it with aws_iot_shadow_json_builder_init().
+ */
+typedef struct {
+	char *pBuffer;			///< JSON document, always NUL terminated
+	size_t bufferSize;		///< Size of pBuffer
+	size_t length;			///< Length of the document written so far
+	IoT_Error_t error;		///< First error hit while building, NONE_ERROR if all fitted
+} jsonBuilder_t;
+
 /**
  * @brief Initialize the JSON document with Shadow expected name/value
  *
@@ -137,4 +152,106 @@ IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOf
 
 IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument);
 
+/**
+ * @brief Start a Shadow JSON document with a builder
+ *
+ * Same as aws_iot_shadow_init_json_document() but keeps the write cursor in pBuilder. Follow with
+ * aws_iot_shadow_json_builder_add_reported() and/or aws_iot_shadow_json_builder_add_desired() and
+ * finish with aws_iot_shadow_json_builder_finalize(). Numbers and booleans are formatted without printf.
+ *
+ * @param pBuilder builder to initialize
+ * @param pJsonDocument The JSON Document filled in this char buffer
+ * @param maxSizeOfJsonDocument maximum size of the pJsonDocument that can be used to fill the JSON document
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_init(jsonBuilder_t *pBuilder, char *pJsonDocument, size_t maxSizeOfJsonDocument);
+
+/**
+ * @brief Add the reported section of jsonStruct_t to a builder
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @param count total number of arguments(jsonStruct_t object) passed in the arguments
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_add_reported(jsonBuilder_t *pBuilder, uint8_t count, ...);
+
+/**
+ * @brief Add the desired section of jsonStruct_t to a builder
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @param count total number of arguments(jsonStruct_t object) passed in the arguments
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_add_desired(jsonBuilder_t *pBuilder, uint8_t count, ...);
+
+/**
+ * @brief Add the reported section of an array of jsonStruct_t to a builder
+ *
+ * Same as aws_iot_shadow_json_builder_add_reported() for a number of fields only known at run time.
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @param count number of jsonStruct_t pointers in ppStructs
+ * @param ppStructs fields to add
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_add_reported_array(jsonBuilder_t *pBuilder, uint8_t count,
+		jsonStruct_t *const *ppStructs);
+
+/**
+ * @brief Finalize a builder document with the Shadow expected client Token
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_finalize(jsonBuilder_t *pBuilder);
+
+/**
+ * @brief Open a section of a builder document to be filled field by field
+ *
+ * Adds "<pSection>":{ to the document. Follow with the aws_iot_shadow_json_builder_add_*()
+ * functions and close the section with aws_iot_shadow_json_builder_close_section(). Used by the
+ * functions generated from a schema, see aws_iot_shadow_schema.h.
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @param pSection name of the section, e.g. "reported"
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_open_section(jsonBuilder_t *pBuilder, const char *pSection);
+
+/**
+ * @brief Close a section opened with aws_iot_shadow_json_builder_open_section()
+ *
+ * @param pBuilder builder initialized with aws_iot_shadow_json_builder_init()
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ */
+IoT_Error_t aws_iot_shadow_json_builder_close_section(jsonBuilder_t *pBuilder);
+
+/**
+ * @brief Add a signed integer field to an open section
+ *
+ * The add functions do not return an error, the first one hit is kept in pBuilder->error and
+ * returned when the section is closed.
+ *
+ * @param pBuilder builder with an open section
+ * @param pKey JSON key, needs no NUL termination
+ * @param keyLength length of pKey
+ * @param value value of the field
+ */
+void aws_iot_shadow_json_builder_add_int(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, int64_t value);
+
+/**
+ * @brief Add an unsigned integer field to an open section
+ */
+void aws_iot_shadow_json_builder_add_uint(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, uint64_t value);
+
+/**
+ * @brief Add a floating point field to an open section
+ */
+void aws_iot_shadow_json_builder_add_double(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, double value);
+
+/**
+ * @brief Add a boolean field to an open section
+ */
+void aws_iot_shadow_json_builder_add_bool(jsonBuilder_t *pBuilder, const char *pKey, size_t keyLength, bool value);
+
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_JSON_DATA_H_ */
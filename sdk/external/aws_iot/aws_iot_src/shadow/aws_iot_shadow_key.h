@@ -18,5 +18,8 @@
 
 #define SHADOW_CLIENT_TOKEN_STRING "clientToken"
 #define SHADOW_VERSION_STRING "version"
+#define SHADOW_STATE_STRING "state"
+#define SHADOW_DELTA_STRING "delta"
+#define SHADOW_ERROR_CODE_STRING "code"
 
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_KEY_H_ */
@@ -16,13 +16,21 @@
 #include "aws_iot_shadow_records.h"
 
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 
 #include "timer_interface.h"
+#include "timer_wheel.h"
 #include "aws_iot_json_utils.h"
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
+#include "aws_iot_shadow_things.h"
 #include "aws_iot_config.h"
+#if AWS_IOT_RUNTIME_CONFIG
+#include "aws_iot_runtime_config.h"
+#endif
+#include <cycle_trace.h>
 
 typedef struct {
 	char clientTokenID[MAX_SIZE_CLIENT_ID_WITH_SEQUENCE];
@@ -31,7 +39,10 @@ typedef struct {
 	fpActionCallback_t callback;
 	void *pCallbackContext;
 	bool isFree;
-	Timer timer;
+	TimerWheelEntry timer;
+	uint32_t tokenKey;
+	uint16_t nextInBucket;
+	int16_t topicsIndex;
 } ToBeReceivedAckRecord_t;
 
 typedef struct {
@@ -39,20 +50,71 @@ typedef struct {
 	void *pStruct;
 	jsonStructCallback_t callback;
 	bool isFree;
+	uint32_t keyHash;
+	uint32_t keyLength;
+	int16_t nextInBucket;
+	uint32_t lastDeltaSequence;
 } JsonTokenTable_t;
 
+/* The topics of an action on a thing, rendered once and kept for as long as
+ * the record is not needed for another thing. count is the number of pending
+ * acks using the accepted and rejected topics, plus one that stays for a
+ * sticky subscription */
 typedef struct {
-	char Topic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	char thingName[MAX_SIZE_OF_THING_NAME];
+	uint16_t thingNameLength;
+	ShadowActions_t action;
+	/* The action topic as it goes out, published to without serializing it again */
+	unsigned char actionTopicBytes[AWS_IOT_MQTT_PREPARED_TOPIC_BUF_LEN(MAX_SHADOW_TOPIC_LENGTH_BYTES)];
+	MQTTPreparedPublish actionPublish;
+	char acceptedTopic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	char rejectedTopic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 	uint8_t count;
-	bool isFree;
+	bool isUsed;
+	bool isSubscribed;
 	bool isSticky;
-} SubscriptionRecord_t;
+	bool isMyThing;
+} ShadowTopicRecord_t;
 
 typedef enum {
 	SHADOW_ACCEPTED, SHADOW_REJECTED, SHADOW_ACTION
 } ShadowAckTopicTypes_t;
 
-ToBeReceivedAckRecord_t AckWaitList[MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME];
+#define ACK_WAIT_LIST_NONE 0xFFFF
+
+#if AWS_IOT_RUNTIME_CONFIG
+/* Sized by aws_iot_runtime_config.h, taken by allocateShadowRecords() */
+static uint16_t maxAcks;
+static uint16_t maxThingNames;
+static uint16_t maxDeltaTokens;
+#define MAX_ACKS maxAcks
+#define MAX_THING_NAMES maxThingNames
+#define MAX_DELTA_TOKENS maxDeltaTokens
+#else
+#define MAX_ACKS MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME
+#define MAX_THING_NAMES MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME
+#define MAX_DELTA_TOKENS MAX_JSON_TOKEN_EXPECTED
+#endif
+
+#if AWS_IOT_RUNTIME_CONFIG
+ToBeReceivedAckRecord_t *AckWaitList;
+#else
+ToBeReceivedAckRecord_t AckWaitList[MAX_ACKS];
+#endif
+
+/* Pending acks are found through a hash on the client token, which for the
+ * tokens made by this library is its sequence number. Timeouts are timers
+ * of a wheel, which calls back the expired ones and tells the yield how long
+ * it can wait. Free records are kept on a stack */
+#if AWS_IOT_RUNTIME_CONFIG
+static uint16_t *ackWaitBuckets;
+static uint16_t *ackFreeStack;
+#else
+static uint16_t ackWaitBuckets[MAX_ACKS];
+static uint16_t ackFreeStack[MAX_ACKS];
+#endif
+static TimerWheel ackTimerWheel;
+static uint16_t ackFreeStackSize = 0;
 
 MQTTClient_t *pMqttClient;
 
@@ -60,42 +122,181 @@ char myThingName[MAX_SIZE_OF_THING_NAME];
 char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
 
 char shadowDeltaTopic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+/* $aws/things/<myThingName>/shadow/+/+, subscribed once at connect when asked
+ * for. It covers accepted and rejected of every action and the delta topic */
+static char shadowAckWildcardTopic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+static bool ackWildcardSubscribedFlag = false;
 
-#define MAX_TOPICS_AT_ANY_GIVEN_TIME 2*MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME
-SubscriptionRecord_t SubscriptionList[MAX_TOPICS_AT_ANY_GIVEN_TIME];
+#if AWS_IOT_RUNTIME_CONFIG
+ShadowTopicRecord_t *ShadowTopicList;
+#else
+ShadowTopicRecord_t ShadowTopicList[MAX_THING_NAMES];
+#endif
 
 #define SUBSCRIBE_SETTLING_TIME 2
-char shadowRxBuf[SHADOW_MAX_SIZE_OF_RX_BUFFER];
 
-static JsonTokenTable_t tokenTable[MAX_JSON_TOKEN_EXPECTED];
+#if AWS_IOT_RUNTIME_CONFIG
+static JsonTokenTable_t *tokenTable;
+/* Registered keys updated by the current delta, for the batch callback */
+static jsonStruct_t **deltaChanged;
+#else
+static JsonTokenTable_t tokenTable[MAX_DELTA_TOKENS];
+static jsonStruct_t *deltaChanged[MAX_DELTA_TOKENS];
+#endif
 static uint32_t tokenTableIndex = 0;
+/* Registered delta keys by hash, every bucket chains its tokenTable entries
+ * through nextInBucket */
+static int16_t tokenTableBuckets[MAX_JSON_DELTA_KEY_HASH_BUCKETS];
+/* Marks the entries already handled for the current delta message, a key
+ * present more than once is only handled at its first occurrence */
+static uint32_t deltaSequence = 0;
 static bool deltaTopicSubscribedFlag = false;
+/* Keys of a generated schema are given to this handler before the table */
+static shadowDeltaHandler_t deltaHandler = NULL;
+static void *pDeltaHandlerContext = NULL;
+/* Given a delta once all its keys are handled, instead of the callbacks of
+ * the registered keys */
+static shadowDeltaBatchCallback_t deltaBatchCallback = NULL;
+static void *pDeltaBatchContext = NULL;
 uint32_t shadowJsonVersionNum = 0;
 bool shadowDiscardOldDeltaFlag = true;
+/* Version of the last state of myThingName given to the delta handlers, by a
+ * delta or by a resync. A resync only gives them a newer one */
+uint32_t shadowDeliveredVersionNum = 0;
+/* The resync waiting for its get, one at a time */
+static bool isResyncPending = false;
+static bool isResyncDelivered = false;
+static fpActionCallback_t resyncCallback = NULL;
+static void *pResyncContext = NULL;
 
 // local helper functions
 static int32_t AckStatusCallback(MQTTCallbackParams params);
+static bool deliverResyncState(const char *pJsonDocument, int32_t tokenCount);
 static int32_t shadow_delta_callback(MQTTCallbackParams params);
+static int32_t ackWildcardCallback(MQTTCallbackParams params);
 static void topicNameFromThingAndAction(char *pTopic, const char *pThingName, ShadowActions_t action,
 		ShadowAckTopicTypes_t ackType);
-static int16_t getNextFreeIndexOfSubscriptionList(void);
-static void unsubscribeFromAcceptedAndRejected(uint8_t index);
+static void unsubscribeFromAcceptedAndRejected(uint16_t index);
+static void ackTimedOut(TimerWheelEntry *pEntry, void *pContext);
+
+/* FNV-1a */
+static uint32_t hashJsonKey(const char *pKey, uint32_t keyLength) {
+	uint32_t hash = 2166136261u;
+	uint32_t i;
+
+	for (i = 0; i < keyLength; i++) {
+		hash ^= (uint8_t) pKey[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* "<mqttClientID>-<sequence>" tokens are keyed by their sequence, which is
+ * unique among the pending acks. Other tokens are hashed */
+static uint32_t keyOfClientToken(const char *pClientToken) {
+	size_t clientIdLength = strlen(mqttClientID);
+	const char *pSequence = pClientToken + clientIdLength + 1;
+	uint32_t sequence = 0;
+
+	if (strncmp(pClientToken, mqttClientID, clientIdLength) != 0 || pClientToken[clientIdLength] != '-'
+			|| *pSequence == '\0') {
+		return hashJsonKey(pClientToken, strlen(pClientToken));
+	}
+
+	for (; *pSequence != '\0'; pSequence++) {
+		if (*pSequence < '0' || *pSequence > '9') {
+			return hashJsonKey(pClientToken, strlen(pClientToken));
+		}
+		sequence = sequence * 10 + (*pSequence - '0');
+	}
+	return sequence;
+}
+
+/* Take a pending record out of the token hash and stop its timer, the
+ * record itself stays valid until releaseAckWaitRecord() */
+static void removeAckWaitRecord(uint16_t index) {
+	uint16_t *pLink = &ackWaitBuckets[AckWaitList[index].tokenKey % MAX_ACKS];
+
+	while (*pLink != ACK_WAIT_LIST_NONE) {
+		if (*pLink == index) {
+			*pLink = AckWaitList[index].nextInBucket;
+			break;
+		}
+		pLink = &(AckWaitList[*pLink].nextInBucket);
+	}
+
+	timerWheelStop(&ackTimerWheel, &(AckWaitList[index].timer));
+}
+
+static void releaseAckWaitRecord(uint16_t index) {
+	AckWaitList[index].isFree = true;
+	ackFreeStack[ackFreeStackSize++] = index;
+}
+
+static uint16_t findAckWaitRecord(const char *pClientToken) {
+	uint16_t index = ackWaitBuckets[keyOfClientToken(pClientToken) % MAX_ACKS];
+
+	for (; index != ACK_WAIT_LIST_NONE; index = AckWaitList[index].nextInBucket) {
+		if (strcmp(AckWaitList[index].clientTokenID, pClientToken) == 0) {
+			return index;
+		}
+	}
+	return ACK_WAIT_LIST_NONE;
+}
+
+#if AWS_IOT_RUNTIME_CONFIG
+IoT_Error_t allocateShadowRecords(void) {
+	const AwsIotRuntimeConfig *pConfig = aws_iot_runtime_config();
+
+	if (NULL != AckWaitList) {
+		return NONE_ERROR;
+	}
+
+	AckWaitList = aws_iot_runtime_alloc(pConfig->maxAcks * sizeof(*AckWaitList));
+	ackWaitBuckets = aws_iot_runtime_alloc(pConfig->maxAcks * sizeof(*ackWaitBuckets));
+	ackFreeStack = aws_iot_runtime_alloc(pConfig->maxAcks * sizeof(*ackFreeStack));
+	ShadowTopicList = aws_iot_runtime_alloc(pConfig->maxThingNames * sizeof(*ShadowTopicList));
+	tokenTable = aws_iot_runtime_alloc(pConfig->maxJsonTokens * sizeof(*tokenTable));
+	deltaChanged = aws_iot_runtime_alloc(pConfig->maxJsonTokens * sizeof(*deltaChanged));
+	if (NULL == AckWaitList || NULL == ackWaitBuckets || NULL == ackFreeStack || NULL == ShadowTopicList
+			|| NULL == tokenTable || NULL == deltaChanged) {
+		/* The arena is not given back, the next init fails the same way */
+		AckWaitList = NULL;
+		return GENERIC_ERROR;
+	}
+	maxAcks = pConfig->maxAcks;
+	maxThingNames = pConfig->maxThingNames;
+	maxDeltaTokens = pConfig->maxJsonTokens;
+
+	return NONE_ERROR;
+}
+#endif
 
 void initDeltaTokens(void) {
 	uint32_t i;
-	for (i = 0; i < MAX_JSON_TOKEN_EXPECTED; i++) {
+	for (i = 0; i < MAX_DELTA_TOKENS; i++) {
 		tokenTable[i].isFree = true;
 	}
+	for (i = 0; i < MAX_JSON_DELTA_KEY_HASH_BUCKETS; i++) {
+		tokenTableBuckets[i] = -1;
+	}
 	tokenTableIndex = 0;
 	deltaTopicSubscribedFlag = false;
+	deltaHandler = NULL;
+	pDeltaHandlerContext = NULL;
+	deltaBatchCallback = NULL;
+	pDeltaBatchContext = NULL;
 }
 
-IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
+static IoT_Error_t subscribeToDeltaTopic(void) {
 
 	IoT_Error_t rc = NONE_ERROR;
 
-	if (!deltaTopicSubscribedFlag) {
-		MQTTSubscribeParams subParams;
+	if (!deltaTopicSubscribedFlag && ackWildcardSubscribedFlag) {
+		/* Already received through the wildcard */
+		deltaTopicSubscribedFlag = true;
+	} else if (!deltaTopicSubscribedFlag) {
+		MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
 		subParams.mHandler = shadow_delta_callback;
 		snprintf(shadowDeltaTopic,MAX_SHADOW_TOPIC_LENGTH_BYTES, "$aws/things/%s/shadow/update/delta", myThingName);
 		subParams.pTopic = shadowDeltaTopic;
@@ -105,28 +306,60 @@ IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
 		deltaTopicSubscribedFlag = true;
 	}
 
-	if (tokenTableIndex >= MAX_JSON_TOKEN_EXPECTED) {
-		return GENERIC_ERROR;
-	}
+	return rc;
+}
 
-	tokenTable[tokenTableIndex].pKey = pStruct->pKey;
-	tokenTable[tokenTableIndex].callback = pStruct->cb;
-	tokenTable[tokenTableIndex].pStruct = pStruct;
-	tokenTable[tokenTableIndex].isFree = false;
-	tokenTableIndex++;
+IoT_Error_t registerSchemaOnDelta(shadowDeltaHandler_t handler, void *pContext) {
 
-	return rc;
+	deltaHandler = handler;
+	pDeltaHandlerContext = pContext;
+	return subscribeToDeltaTopic();
 }
 
-static int16_t getNextFreeIndexOfSubscriptionList(void) {
-	uint8_t i;
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (SubscriptionList[i].isFree) {
-			SubscriptionList[i].isFree = false;
-			return i;
+IoT_Error_t registerBatchOnDelta(shadowDeltaBatchCallback_t callback, void *pContext) {
+
+	deltaBatchCallback = callback;
+	pDeltaBatchContext = pContext;
+	return subscribeToDeltaTopic();
+}
+
+IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
+
+	IoT_Error_t rc;
+
+	rc = subscribeToDeltaTopic();
+
+	if (tokenTableIndex >= MAX_DELTA_TOKENS) {
+		return GENERIC_ERROR;
+	}
+
+	uint32_t bucket;
+	JsonTokenTable_t *pEntry = &tokenTable[tokenTableIndex];
+	JsonTokenTable_t *pLast;
+
+	pEntry->pKey = pStruct->pKey;
+	pEntry->callback = pStruct->cb;
+	pEntry->pStruct = pStruct;
+	pEntry->isFree = false;
+	pEntry->keyLength = strlen(pStruct->pKey);
+	pEntry->keyHash = hashJsonKey(pStruct->pKey, pEntry->keyLength);
+	pEntry->nextInBucket = -1;
+	pEntry->lastDeltaSequence = deltaSequence;
+
+	/* Append so that entries of the same key keep their registration order */
+	bucket = pEntry->keyHash & (MAX_JSON_DELTA_KEY_HASH_BUCKETS - 1);
+	if (tokenTableBuckets[bucket] < 0) {
+		tokenTableBuckets[bucket] = tokenTableIndex;
+	} else {
+		pLast = &tokenTable[tokenTableBuckets[bucket]];
+		while (pLast->nextInBucket >= 0) {
+			pLast = &tokenTable[pLast->nextInBucket];
 		}
+		pLast->nextInBucket = tokenTableIndex;
 	}
-	return -1;
+	tokenTableIndex++;
+
+	return rc;
 }
 
 static void topicNameFromThingAndAction(char *pTopic, const char *pThingName, ShadowActions_t action,
@@ -150,12 +383,68 @@ static void topicNameFromThingAndAction(char *pTopic, const char *pThingName, Sh
 	}
 
 	if (ackType == SHADOW_ACTION) {
-		sprintf(pTopic, "$aws/things/%s/shadow/%s", pThingName, actionBuf);
+		snprintf(pTopic, MAX_SHADOW_TOPIC_LENGTH_BYTES, "$aws/things/%s/shadow/%s", pThingName, actionBuf);
 	} else {
-		sprintf(pTopic, "$aws/things/%s/shadow/%s/%s", pThingName, actionBuf, ackTypeBuf);
+		snprintf(pTopic, MAX_SHADOW_TOPIC_LENGTH_BYTES, "$aws/things/%s/shadow/%s/%s", pThingName, actionBuf,
+				ackTypeBuf);
 	}
 }
 
+static void renderShadowTopics(int16_t index, const char *pThingName, uint16_t thingNameLength,
+		ShadowActions_t action) {
+	ShadowTopicRecord_t *pRecord = &ShadowTopicList[index];
+	char actionTopic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+
+	memcpy(pRecord->thingName, pThingName, thingNameLength);
+	pRecord->thingName[thingNameLength] = '\0';
+	pRecord->thingNameLength = thingNameLength;
+	pRecord->action = action;
+	topicNameFromThingAndAction(actionTopic, pThingName, action, SHADOW_ACTION);
+	aws_iot_mqtt_prepare_publish(&(pRecord->actionPublish), pRecord->actionTopicBytes,
+			sizeof(pRecord->actionTopicBytes), actionTopic, QOS_0, false);
+	topicNameFromThingAndAction(pRecord->acceptedTopic, pThingName, action, SHADOW_ACCEPTED);
+	topicNameFromThingAndAction(pRecord->rejectedTopic, pThingName, action, SHADOW_REJECTED);
+	pRecord->count = 0;
+	pRecord->isUsed = true;
+	pRecord->isSubscribed = false;
+	pRecord->isSticky = false;
+	pRecord->isMyThing = (strcmp(pRecord->thingName, myThingName) == 0);
+}
+
+int16_t findShadowTopics(const char *pThingName, ShadowActions_t action) {
+	size_t thingNameLength = strlen(pThingName);
+	int16_t freeIndex = -1;
+	int16_t idleIndex = -1;
+	int16_t i;
+
+	if (thingNameLength >= MAX_SIZE_OF_THING_NAME) {
+		return -1;
+	}
+
+	for (i = 0; i < MAX_THING_NAMES; i++) {
+		ShadowTopicRecord_t *pRecord = &ShadowTopicList[i];
+		if (!pRecord->isUsed) {
+			if (freeIndex < 0) {
+				freeIndex = i;
+			}
+		} else if (pRecord->action == action && pRecord->thingNameLength == thingNameLength
+				&& memcmp(pRecord->thingName, pThingName, thingNameLength) == 0) {
+			return i;
+		} else if (idleIndex < 0 && pRecord->count == 0 && !pRecord->isSubscribed) {
+			idleIndex = i;
+		}
+	}
+
+	/* Topics nothing is waiting on make room for the new ones */
+	if (freeIndex < 0) {
+		freeIndex = idleIndex;
+	}
+	if (freeIndex >= 0) {
+		renderShadowTopics(freeIndex, pThingName, thingNameLength, action);
+	}
+	return freeIndex;
+}
+
 static bool isAckForMyThingName(const char *pTopicName) {
 	if (strstr(pTopicName, myThingName) != NULL && ((strstr(pTopicName, "get/accepted") != NULL) || (strstr(pTopicName, "delta") != NULL))) {
 		return true;
@@ -165,51 +454,61 @@ static bool isAckForMyThingName(const char *pTopicName) {
 
 static int32_t AckStatusCallback(MQTTCallbackParams params) {
 	int32_t tokenCount;
-	int32_t i;
+	uint16_t i;
 	void *pJsonHandler = NULL;
+	const char *pJsonDocument;
 	char temporaryClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
 
-	if (params.MessageParams.PayloadLen > SHADOW_MAX_SIZE_OF_RX_BUFFER) {
+	/* The payload is parsed where the MQTT client received it, the client
+	 * NUL terminates it for the value parsers and the ack callbacks. The
+	 * tokens below are shared by all the lookups of this message */
+	pJsonDocument = (const char *) params.MessageParams.pPayload;
+	if (pJsonDocument == NULL) {
 		return GENERIC_ERROR;
 	}
 
-	memcpy(shadowRxBuf, params.MessageParams.pPayload, params.MessageParams.PayloadLen);
-	shadowRxBuf[params.MessageParams.PayloadLen] = '\0';	// jsmn_parse relies on a string
-
-	if (!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+	if (!isJsonValidAndParse(pJsonDocument, params.MessageParams.PayloadLen, pJsonHandler, &tokenCount)) {
 		WARN("Received JSON is not valid");
 		return GENERIC_ERROR;
 	}
 
 	if (isAckForMyThingName(params.pTopicName)) {
 		uint32_t tempVersionNumber = 0;
-		if (extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
+		if (extractVersionNumber(pJsonDocument, pJsonHandler, tokenCount, &tempVersionNumber)) {
 			if (tempVersionNumber > shadowJsonVersionNum) {
 				shadowJsonVersionNum = tempVersionNumber;
 			}
 		}
 	}
 
-	if (extractClientToken(shadowRxBuf, temporaryClientToken)) {
-		for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-			if (!AckWaitList[i].isFree) {
-				if (strcmp(AckWaitList[i].clientTokenID, temporaryClientToken) == 0) {
-					Shadow_Ack_Status_t status = SHADOW_ACK_ACCEPTED;
-					if (strstr(params.pTopicName, "accepted") != NULL) {
-						status = SHADOW_ACK_ACCEPTED;
-					} else if (strstr(params.pTopicName, "rejected") != NULL) {
-						status = SHADOW_ACK_REJECTED;
-					}
-					if (status == SHADOW_ACK_ACCEPTED || status == SHADOW_ACK_REJECTED) {
-						if (AckWaitList[i].callback != NULL) {
-							AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, status,
-									shadowRxBuf, AckWaitList[i].pCallbackContext);
-						}
-						unsubscribeFromAcceptedAndRejected(i);
-						AckWaitList[i].isFree = true;
-						return NONE_ERROR;
+	if (extractClientTokenFromParsedJson(pJsonDocument, pJsonHandler, tokenCount, temporaryClientToken)) {
+		i = findAckWaitRecord(temporaryClientToken);
+		if (i != ACK_WAIT_LIST_NONE) {
+			Shadow_Ack_Status_t status = SHADOW_ACK_ACCEPTED;
+			if (strstr(params.pTopicName, "accepted") != NULL) {
+				status = SHADOW_ACK_ACCEPTED;
+			} else if (strstr(params.pTopicName, "rejected") != NULL) {
+				status = SHADOW_ACK_REJECTED;
+			}
+			if (status == SHADOW_ACK_ACCEPTED || status == SHADOW_ACK_REJECTED) {
+				removeAckWaitRecord(i);
+				if (status == SHADOW_ACK_ACCEPTED && AckWaitList[i].callback == shadowResyncAckCallback) {
+					isResyncDelivered = deliverResyncState(pJsonDocument, tokenCount);
+				}
+				if (status == SHADOW_ACK_ACCEPTED && AckWaitList[i].action == SHADOW_GET
+						&& !ShadowTopicList[AckWaitList[i].topicsIndex].isMyThing) {
+					uint32_t thingVersionNumber = 0;
+					if (extractVersionNumber(pJsonDocument, pJsonHandler, tokenCount, &thingVersionNumber)) {
+						shadowThingVersionReceived(AckWaitList[i].thingName, thingVersionNumber);
 					}
 				}
+				if (AckWaitList[i].callback != NULL) {
+					AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, status,
+							pJsonDocument, AckWaitList[i].pCallbackContext);
+				}
+				unsubscribeFromAcceptedAndRejected(i);
+				releaseAckWaitRecord(i);
+				return NONE_ERROR;
 			}
 		}
 	}
@@ -217,249 +516,299 @@ static int32_t AckStatusCallback(MQTTCallbackParams params) {
 	return GENERIC_ERROR;
 }
 
-static int16_t findIndexOfSubscriptionList(const char *pTopic) {
-	uint8_t i;
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (!SubscriptionList[i].isFree) {
-			if ((strcmp(pTopic, SubscriptionList[i].Topic) == 0)) {
-				return i;
-			}
-		}
-	}
-	return -1;
+static bool isTopicSuffix(const MQTTCallbackParams *pParams, const char *pSuffix) {
+	size_t suffixLen = strlen(pSuffix);
+	return pParams->TopicNameLen >= suffixLen
+			&& strncmp(pParams->pTopicName + pParams->TopicNameLen - suffixLen, pSuffix, suffixLen) == 0;
 }
 
-static void unsubscribeFromAcceptedAndRejected(uint8_t index) {
-
-	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	IoT_Error_t ret_val = NONE_ERROR;
+/* Every shadow topic of the thing arrives here once the wildcard is
+ * subscribed, it is handed on by its last level */
+static int32_t ackWildcardCallback(MQTTCallbackParams params) {
+	if (isTopicSuffix(&params, "/accepted") || isTopicSuffix(&params, "/rejected")) {
+		return AckStatusCallback(params);
+	}
+	if (isTopicSuffix(&params, "/update/delta")) {
+		return shadowMyThingDeltaCallback(params);
+	}
+	return NONE_ERROR;
+}
 
-	topicNameFromThingAndAction(TemporaryTopicNameAccepted, AckWaitList[index].thingName, AckWaitList[index].action,
-			SHADOW_ACCEPTED);
-	topicNameFromThingAndAction(TemporaryTopicNameRejected, AckWaitList[index].thingName, AckWaitList[index].action,
-			SHADOW_REJECTED);
+int32_t shadowMyThingDeltaCallback(MQTTCallbackParams params) {
+	if (!deltaTopicSubscribedFlag) {
+		return NONE_ERROR;
+	}
+	return shadow_delta_callback(params);
+}
 
-	int16_t indexSubList;
+static void unsubscribeFromAcceptedAndRejected(uint16_t index) {
+	ShadowTopicRecord_t *pRecord = &ShadowTopicList[AckWaitList[index].topicsIndex];
+	char *pTopics[2];
 
-	indexSubList = findIndexOfSubscriptionList(TemporaryTopicNameAccepted);
-	if ((indexSubList >= 0)) {
-		if (!SubscriptionList[indexSubList].isSticky && (SubscriptionList[indexSubList].count == 1)) {
-			ret_val = pMqttClient->unsubscribe(TemporaryTopicNameAccepted);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexSubList].isFree = true;
-			}
-		} else if (SubscriptionList[indexSubList].count > 1) {
-			SubscriptionList[indexSubList].count--;
+	/* The acks came through the wildcard subscription */
+	if (!pRecord->isSubscribed) {
+		if (pRecord->count > 0) {
+			pRecord->count--;
 		}
+		return;
 	}
 
-	indexSubList = findIndexOfSubscriptionList(TemporaryTopicNameRejected);
-	if ((indexSubList >= 0)) {
-		if (!SubscriptionList[indexSubList].isSticky && (SubscriptionList[indexSubList].count == 1)) {
-			ret_val = pMqttClient->unsubscribe(TemporaryTopicNameRejected);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexSubList].isFree = true;
-			}
-		} else if (SubscriptionList[indexSubList].count > 1) {
-			SubscriptionList[indexSubList].count--;
+	if (!pRecord->isSticky && pRecord->count == 1) {
+		/* Both topics leave in one UNSUBSCRIBE */
+		pTopics[0] = pRecord->acceptedTopic;
+		pTopics[1] = pRecord->rejectedTopic;
+		if (pMqttClient->unsubscribeMany(pTopics, 2) == NONE_ERROR) {
+			pRecord->isSubscribed = false;
+			pRecord->count = 0;
 		}
+	} else if (pRecord->count > 1) {
+		pRecord->count--;
 	}
 }
 
 void initializeRecords(MQTTClient_t *pClient) {
-	uint8_t i;
-	for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
+	uint16_t i;
+	timerWheelInit(&ackTimerWheel);
+	/* Stack the records so that the lowest index is handed out first */
+	for (i = 0; i < MAX_ACKS; i++) {
 		AckWaitList[i].isFree = true;
+		timerWheelInitEntry(&(AckWaitList[i].timer), ackTimedOut, NULL);
+		ackWaitBuckets[i] = ACK_WAIT_LIST_NONE;
+		ackFreeStack[i] = MAX_ACKS - 1 - i;
 	}
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		SubscriptionList[i].isFree = true;
-		SubscriptionList[i].count = 0;
-		SubscriptionList[i].isSticky = false;
+	ackFreeStackSize = MAX_ACKS;
+	for (i = 0; i < MAX_THING_NAMES; i++) {
+		ShadowTopicList[i].isUsed = false;
 	}
+	ackWildcardSubscribedFlag = false;
 	pMqttClient = pClient;
-}
-
-bool isSubscriptionPresent(const char *pThingName, ShadowActions_t action) {
 
-	uint8_t i = 0;
-	bool isAcceptedPresent = false;
-	bool isRejectedPresent = false;
-	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-
-	topicNameFromThingAndAction(TemporaryTopicNameAccepted, pThingName, action, SHADOW_ACCEPTED);
-	topicNameFromThingAndAction(TemporaryTopicNameRejected, pThingName, action, SHADOW_REJECTED);
+	/* The topics of this device are there before its first action */
+	findShadowTopics(myThingName, SHADOW_GET);
+	findShadowTopics(myThingName, SHADOW_UPDATE);
+	findShadowTopics(myThingName, SHADOW_DELETE);
+}
 
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (!SubscriptionList[i].isFree) {
-			if ((strcmp(TemporaryTopicNameAccepted, SubscriptionList[i].Topic) == 0)) {
-				isAcceptedPresent = true;
-			} else if ((strcmp(TemporaryTopicNameRejected, SubscriptionList[i].Topic) == 0)) {
-				isRejectedPresent = true;
-			}
-		}
-	}
+IoT_Error_t subscribeToShadowAckWildcard(void) {
+	IoT_Error_t ret_val;
+	MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
 
-	if (isRejectedPresent && isAcceptedPresent) {
-		return true;
+	snprintf(shadowAckWildcardTopic, MAX_SHADOW_TOPIC_LENGTH_BYTES, "$aws/things/%s/shadow/+/+", myThingName);
+	subParams.mHandler = ackWildcardCallback;
+	subParams.pTopic = shadowAckWildcardTopic;
+	subParams.qos = QOS_0;
+	ret_val = pMqttClient->subscribe(&subParams);
+	if (ret_val == NONE_ERROR) {
+		ackWildcardSubscribedFlag = true;
 	}
+	DEBUG("ack wildcard topic %s", shadowAckWildcardTopic);
 
-	return false;
+	return ret_val;
 }
 
-IoT_Error_t subscribeToShadowActionAcks(const char *pThingName, ShadowActions_t action, bool isSticky) {
-	IoT_Error_t ret_val = NONE_ERROR;
-	MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
-
-	bool clearBothEntriesFromList = true;
-	int16_t indexAcceptedSubList = 0;
-	int16_t indexRejectedSubList = 0;
-	indexAcceptedSubList = getNextFreeIndexOfSubscriptionList();
-	indexRejectedSubList = getNextFreeIndexOfSubscriptionList();
-
-	if (indexAcceptedSubList >= 0 && indexRejectedSubList >= 0) {
-		topicNameFromThingAndAction(SubscriptionList[indexAcceptedSubList].Topic, pThingName, action, SHADOW_ACCEPTED);
-		subParams.mHandler = AckStatusCallback;
-		subParams.qos = QOS_0;
-		subParams.pTopic = SubscriptionList[indexAcceptedSubList].Topic;
-		ret_val = pMqttClient->subscribe(&subParams);
-		if (ret_val == NONE_ERROR) {
-			SubscriptionList[indexAcceptedSubList].count = 1;
-			SubscriptionList[indexAcceptedSubList].isSticky = isSticky;
-			topicNameFromThingAndAction(SubscriptionList[indexRejectedSubList].Topic, pThingName, action,
-					SHADOW_REJECTED);
-			subParams.pTopic = SubscriptionList[indexRejectedSubList].Topic;
-			ret_val = pMqttClient->subscribe(&subParams);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexRejectedSubList].count = 1;
-				SubscriptionList[indexRejectedSubList].isSticky = isSticky;
-				clearBothEntriesFromList = false;
-
-				// wait for SUBSCRIBE_SETTLING_TIME seconds to let the subscription take effect
-				Timer subSettlingtimer;
-				InitTimer(&subSettlingtimer);
-				countdown(&subSettlingtimer, SUBSCRIBE_SETTLING_TIME);
-				while(!expired(&subSettlingtimer));
+bool isSubscriptionPresent(int16_t topicsIndex) {
+	ShadowTopicRecord_t *pRecord = &ShadowTopicList[topicsIndex];
 
-			}
-		}
+	if (ackWildcardSubscribedFlag && pRecord->isMyThing) {
+		return true;
 	}
+	return pRecord->isSubscribed;
+}
 
-	if (clearBothEntriesFromList) {
-		if (indexAcceptedSubList >= 0) {
-			SubscriptionList[indexAcceptedSubList].isFree = true;
-		} else if (indexRejectedSubList >= 0) {
-			SubscriptionList[indexRejectedSubList].isFree = true;
-		}
-		if (SubscriptionList[indexAcceptedSubList].count == 1) {
-			pMqttClient->unsubscribe(SubscriptionList[indexAcceptedSubList].Topic);
-		}
+IoT_Error_t subscribeToShadowActionAcks(int16_t topicsIndex, bool isSticky) {
+	IoT_Error_t ret_val;
+	ShadowTopicRecord_t *pRecord = &ShadowTopicList[topicsIndex];
+	MQTTSubscribeParams subParams[2] = {MQTTSubscribeParamsDefault, MQTTSubscribeParamsDefault};
+
+	/* Both topics in one SUBSCRIBE, a single round trip */
+	subParams[0].mHandler = AckStatusCallback;
+	subParams[0].qos = QOS_0;
+	subParams[0].pTopic = pRecord->acceptedTopic;
+	subParams[1] = subParams[0];
+	subParams[1].pTopic = pRecord->rejectedTopic;
+	ret_val = pMqttClient->subscribeMany(subParams, 2);
+	if (ret_val == NONE_ERROR) {
+		pRecord->isSubscribed = true;
+		pRecord->count++;
+		pRecord->isSticky = isSticky;
+
+		// wait for SUBSCRIBE_SETTLING_TIME seconds to let the subscription take effect
+		Timer subSettlingtimer;
+		InitTimer(&subSettlingtimer);
+		countdown(&subSettlingtimer, SUBSCRIBE_SETTLING_TIME);
+		while(!expired(&subSettlingtimer));
 	}
 
 	return ret_val;
 }
 
-void incrementSubscriptionCnt(const char *pThingName, ShadowActions_t action, bool isSticky) {
-	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	uint8_t i;
-	topicNameFromThingAndAction(TemporaryTopicNameAccepted, pThingName, action, SHADOW_ACCEPTED);
-	topicNameFromThingAndAction(TemporaryTopicNameRejected, pThingName, action, SHADOW_REJECTED);
-
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (!SubscriptionList[i].isFree) {
-			if ((strcmp(TemporaryTopicNameAccepted, SubscriptionList[i].Topic) == 0)
-					|| (strcmp(TemporaryTopicNameRejected, SubscriptionList[i].Topic) == 0)) {
-				SubscriptionList[i].count++;
-				SubscriptionList[i].isSticky = isSticky;
-			}
-		}
-	}
+void incrementSubscriptionCnt(int16_t topicsIndex, bool isSticky) {
+	ShadowTopicList[topicsIndex].count++;
+	ShadowTopicList[topicsIndex].isSticky = isSticky;
 }
 
-IoT_Error_t publishToShadowAction(const char * pThingName, ShadowActions_t action, const char *pJsonDocumentToBeSent) {
+IoT_Error_t publishToShadowAction(int16_t topicsIndex, const char * pThingName, ShadowActions_t action,
+		const char *pJsonDocumentToBeSent) {
 	IoT_Error_t ret_val = NONE_ERROR;
 	char TemporaryTopicName[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	topicNameFromThingAndAction(TemporaryTopicName, pThingName, action, SHADOW_ACTION);
 
 	MQTTPublishParams pubParams = MQTTPublishParamsDefault;
-	pubParams.pTopic = TemporaryTopicName;
 	MQTTMessageParams msgParams = MQTTMessageParamsDefault;
 	msgParams.qos = QOS_0;
 	msgParams.PayloadLen = strlen(pJsonDocumentToBeSent) + 1;
 	msgParams.pPayload = (char *) pJsonDocumentToBeSent;
-	pubParams.MessageParams = msgParams;
-	ret_val = pMqttClient->publish(&pubParams);
+	if (topicsIndex >= 0) {
+		ret_val = pMqttClient->publishPrepared(&(ShadowTopicList[topicsIndex].actionPublish), &msgParams);
+	} else {
+		/* All the records are taken by pending acks */
+		topicNameFromThingAndAction(TemporaryTopicName, pThingName, action, SHADOW_ACTION);
+		pubParams.pTopic = TemporaryTopicName;
+		pubParams.MessageParams = msgParams;
+		ret_val = pMqttClient->publish(&pubParams);
+	}
 
 	return ret_val;
 }
 
-bool getNextFreeIndexOfAckWaitList(uint8_t *pIndex) {
-	uint8_t i;
-	if (pIndex != NULL) {
-		for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-			if (AckWaitList[i].isFree) {
-				*pIndex = i;
-				return true;
-			}
-		}
+bool getNextFreeIndexOfAckWaitList(uint16_t *pIndex) {
+	if (pIndex != NULL && ackFreeStackSize > 0) {
+		*pIndex = ackFreeStack[ackFreeStackSize - 1];
+		return true;
 	}
 	return false;
 }
 
-void addToAckWaitList(uint8_t indexAckWaitList, const char *pThingName, ShadowActions_t action,
-		const char *pExtractedClientToken, fpActionCallback_t callback, void *pCallbackContext,
-		uint32_t timeout_seconds) {
-	AckWaitList[indexAckWaitList].callback = callback;
-	strncpy(AckWaitList[indexAckWaitList].clientTokenID, pExtractedClientToken, MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE);
-	strncpy(AckWaitList[indexAckWaitList].thingName, pThingName, MAX_SIZE_OF_THING_NAME);
-	AckWaitList[indexAckWaitList].pCallbackContext = pCallbackContext;
-	AckWaitList[indexAckWaitList].action = action;
-	InitTimer(&(AckWaitList[indexAckWaitList].timer));
-	countdown(&(AckWaitList[indexAckWaitList].timer), timeout_seconds);
-	AckWaitList[indexAckWaitList].isFree = false;
+void addToAckWaitList(uint16_t indexAckWaitList, int16_t topicsIndex, const char *pThingName,
+		ShadowActions_t action, const char *pExtractedClientToken, fpActionCallback_t callback,
+		void *pCallbackContext, uint32_t timeout_seconds) {
+	ToBeReceivedAckRecord_t *pRecord = &AckWaitList[indexAckWaitList];
+	uint16_t *pBucket;
+	uint16_t i;
+
+	/* The index normally is the top of the stack, as handed out by
+	 * getNextFreeIndexOfAckWaitList() */
+	for (i = ackFreeStackSize; i > 0; i--) {
+		if (ackFreeStack[i - 1] == indexAckWaitList) {
+			ackFreeStack[i - 1] = ackFreeStack[--ackFreeStackSize];
+			break;
+		}
+	}
+	if (i == 0) {
+		return;
+	}
+
+	pRecord->callback = callback;
+	strncpy(pRecord->clientTokenID, pExtractedClientToken, MAX_SIZE_CLIENT_ID_WITH_SEQUENCE);
+	pRecord->clientTokenID[MAX_SIZE_CLIENT_ID_WITH_SEQUENCE - 1] = '\0';
+	strncpy(pRecord->thingName, pThingName, MAX_SIZE_OF_THING_NAME);
+	pRecord->pCallbackContext = pCallbackContext;
+	pRecord->action = action;
+	pRecord->topicsIndex = topicsIndex;
+	pRecord->isFree = false;
+
+	pRecord->tokenKey = keyOfClientToken(pRecord->clientTokenID);
+	pBucket = &ackWaitBuckets[pRecord->tokenKey % MAX_ACKS];
+	pRecord->nextInBucket = *pBucket;
+	*pBucket = indexAckWaitList;
+
+	timerWheelStart(&ackTimerWheel, &(pRecord->timer), timeout_seconds * 1000);
+}
+
+static void ackTimedOut(TimerWheelEntry *pEntry, void *pContext) {
+	uint16_t i = (uint16_t) ((ToBeReceivedAckRecord_t *) ((char *) pEntry - offsetof(ToBeReceivedAckRecord_t, timer))
+			- AckWaitList);
+
+	removeAckWaitRecord(i);
+	if (AckWaitList[i].callback != NULL) {
+		AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, SHADOW_ACK_TIMEOUT,
+				NULL, AckWaitList[i].pCallbackContext);
+	}
+	unsubscribeFromAcceptedAndRejected(i);
+	releaseAckWaitRecord(i);
 }
 
 void HandleExpiredResponseCallbacks(void) {
-	uint8_t i;
-	for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-		if (!AckWaitList[i].isFree) {
-			if (expired(&(AckWaitList[i].timer))) {
-				if (AckWaitList[i].callback != NULL) {
-					AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, SHADOW_ACK_TIMEOUT,
-							shadowRxBuf, AckWaitList[i].pCallbackContext);
-				}
-				AckWaitList[i].isFree = true;
-				unsubscribeFromAcceptedAndRejected(i);
+	timerWheelRun(&ackTimerWheel);
+}
+
+int32_t ackTimeoutLeftMs(void) {
+	return timerWheelNextTimeout(&ackTimerWheel);
+}
+
+/* Hands the keys of the tokens [first, end) of the parsed document, of the
+ * given version, to the delta handler and the registered keys, then the
+ * whole of it to the batch callback */
+static void deliverDeltaKeys(const char *pJsonDocument, int32_t first, int32_t end, uint32_t version) {
+	int32_t i;
+	int32_t DataPosition;
+	uint32_t dataLength;
+	const char *pKey;
+	uint32_t keyLength;
+	uint32_t keyHash;
+	int16_t entry;
+	uint32_t changedCount = 0;
+	uint32_t handledCount = 0;
+
+	/* One pass over the tokens, every string token is looked up once in the
+	 * registered keys instead of searching the tokens for every key */
+	deltaSequence++;
+	for (i = first; i < end; i++) {
+		if (!getJsonKeyToken(pJsonDocument, end, i, &pKey, &keyLength)) {
+			continue;
+		}
+
+		if (deltaHandler != NULL
+				&& deltaHandler(pJsonDocument, pKey, keyLength, getJsonValueToken(i), pDeltaHandlerContext)) {
+			handledCount++;
+			continue;
+		}
+
+		keyHash = hashJsonKey(pKey, keyLength);
+		for (entry = tokenTableBuckets[keyHash & (MAX_JSON_DELTA_KEY_HASH_BUCKETS - 1)]; entry >= 0;
+				entry = tokenTable[entry].nextInBucket) {
+			JsonTokenTable_t *pEntry = &tokenTable[entry];
+			if (pEntry->isFree || pEntry->lastDeltaSequence == deltaSequence || pEntry->keyHash != keyHash
+					|| pEntry->keyLength != keyLength || strncmp(pEntry->pKey, pKey, keyLength) != 0) {
+				continue;
+			}
+			pEntry->lastDeltaSequence = deltaSequence;
+			updateValueOfJsonKeyToken(pJsonDocument, i, pEntry->pStruct, &dataLength, &DataPosition);
+			if (deltaBatchCallback != NULL) {
+				/* An entry is taken once per delta, the array holds them all */
+				deltaChanged[changedCount++] = pEntry->pStruct;
+			} else if (pEntry->callback != NULL) {
+				pEntry->callback(pJsonDocument + DataPosition, dataLength, pEntry->pStruct);
 			}
 		}
 	}
+
+	if (deltaBatchCallback != NULL && (changedCount > 0 || handledCount > 0)) {
+		deltaBatchCallback(pJsonDocument, version, deltaChanged, changedCount, pDeltaBatchContext);
+	}
 }
 
-static int32_t shadow_delta_callback(MQTTCallbackParams params) {
+static int32_t shadow_delta_parse(MQTTCallbackParams params) {
 
 	int32_t tokenCount;
-	uint32_t i = 0;
 	void *pJsonHandler = NULL;
-	int32_t DataPosition;
-	uint32_t dataLength;
-
-	if (params.MessageParams.PayloadLen > SHADOW_MAX_SIZE_OF_RX_BUFFER) {
+	const char *pJsonDocument;
+	uint32_t tempVersionNumber = 0;
+
+	/* The payload is parsed where the MQTT client received it, the client
+	 * NUL terminates it for the value parsers and the ack callbacks. The
+	 * tokens below are shared by all the lookups of this message */
+	pJsonDocument = (const char *) params.MessageParams.pPayload;
+	if (pJsonDocument == NULL) {
 		return GENERIC_ERROR;
 	}
 
-	memcpy(shadowRxBuf, params.MessageParams.pPayload, params.MessageParams.PayloadLen);
-	shadowRxBuf[params.MessageParams.PayloadLen] = '\0';	// jsmn_parse relies on a string
-
-	if (!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+	if (!isJsonValidAndParse(pJsonDocument, params.MessageParams.PayloadLen, pJsonHandler, &tokenCount)) {
 		WARN("Received JSON is not valid");
 		return GENERIC_ERROR;
 	}
 
-	if (shadowDiscardOldDeltaFlag) {
-		uint32_t tempVersionNumber = 0;
-		if (extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
+	if (extractVersionNumber(pJsonDocument, pJsonHandler, tokenCount, &tempVersionNumber)) {
+		if (shadowDiscardOldDeltaFlag) {
 			if (tempVersionNumber > shadowJsonVersionNum) {
 				shadowJsonVersionNum = tempVersionNumber;
 				DEBUG("New Version number: %d", shadowJsonVersionNum);
@@ -468,18 +817,68 @@ static int32_t shadow_delta_callback(MQTTCallbackParams params) {
 				return GENERIC_ERROR;
 			}
 		}
-	}
-
-	for (i = 0; i < tokenTableIndex; i++) {
-		if (!tokenTable[i].isFree) {
-			if (isJsonKeyMatchingAndUpdateValue(shadowRxBuf, pJsonHandler, tokenCount, tokenTable[i].pStruct,
-					&dataLength, &DataPosition)) {
-				if (tokenTable[i].callback != NULL) {
-					tokenTable[i].callback(shadowRxBuf + DataPosition, dataLength, tokenTable[i].pStruct);
-				}
-			}
+		if (tempVersionNumber > shadowDeliveredVersionNum) {
+			shadowDeliveredVersionNum = tempVersionNumber;
 		}
 	}
 
+	deliverDeltaKeys(pJsonDocument, 1, tokenCount, tempVersionNumber);
 	return NONE_ERROR;
 }
+
+/* Given a get/accepted of myThingName asked for by a resync. Returns false if
+ * the document is not newer than the last state given to the delta handlers,
+ * which then are not called */
+static bool deliverResyncState(const char *pJsonDocument, int32_t tokenCount) {
+	uint32_t versionNumber = 0;
+	int32_t state, delta;
+
+	if (!extractVersionNumber(pJsonDocument, NULL, tokenCount, &versionNumber)
+			|| versionNumber <= shadowDeliveredVersionNum) {
+		DEBUG("Resync: version %d unchanged", versionNumber);
+		return false;
+	}
+	shadowDeliveredVersionNum = versionNumber;
+
+	/* The delta section holds the desired fields that differ from the
+	 * reported ones, as a delta message would */
+	state = findJsonObjectMember(pJsonDocument, tokenCount, 0, SHADOW_STATE_STRING);
+	delta = findJsonObjectMember(pJsonDocument, tokenCount, state, SHADOW_DELTA_STRING);
+	if (delta >= 0) {
+		deliverDeltaKeys(pJsonDocument, delta + 1, skipJsonValue(tokenCount, delta), versionNumber);
+	}
+	return true;
+}
+
+bool beginShadowResync(fpActionCallback_t callback, void *pContextData) {
+	if (isResyncPending) {
+		return false;
+	}
+	isResyncPending = true;
+	isResyncDelivered = false;
+	resyncCallback = callback;
+	pResyncContext = pContextData;
+	return true;
+}
+
+void endShadowResync(void) {
+	isResyncPending = false;
+}
+
+void shadowResyncAckCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	isResyncPending = false;
+	if (resyncCallback != NULL) {
+		resyncCallback(pThingName, action, status,
+				status == SHADOW_ACK_ACCEPTED && !isResyncDelivered ? NULL : pReceivedJsonDocument, pResyncContext);
+	}
+}
+
+static int32_t shadow_delta_callback(MQTTCallbackParams params) {
+	int32_t rc;
+
+	CYCLE_TRACE_BEGIN(CYCLE_TRACE_SHADOW_DELTA);
+	rc = shadow_delta_parse(params);
+	CYCLE_TRACE_END(CYCLE_TRACE_SHADOW_DELTA);
+	return rc;
+}
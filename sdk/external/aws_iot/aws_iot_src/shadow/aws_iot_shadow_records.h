@@ -24,22 +24,45 @@
 
 extern uint32_t shadowJsonVersionNum;
 extern bool shadowDiscardOldDeltaFlag;
+extern uint32_t shadowDeliveredVersionNum;
 
 extern char myThingName[MAX_SIZE_OF_THING_NAME];
 extern char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
 
+#if AWS_IOT_RUNTIME_CONFIG
+/* Takes the ack, topic and delta key tables from the arena of aws_iot_runtime_config.h, once */
+IoT_Error_t allocateShadowRecords(void);
+#endif
 void initializeRecords(MQTTClient_t *pClient);
-bool isSubscriptionPresent(const char *pThingName, ShadowActions_t action);
-IoT_Error_t subscribeToShadowActionAcks(const char *pThingName, ShadowActions_t action, bool isSticky);
-void incrementSubscriptionCnt(const char *pThingName, ShadowActions_t action, bool isSticky);
-
-IoT_Error_t publishToShadowAction(const char * pThingName, ShadowActions_t action, const char *pJsonDocumentToBeSent);
-void addToAckWaitList(uint8_t indexAckWaitList, const char *pThingName, ShadowActions_t action,
-		const char *pExtractedClientToken, fpActionCallback_t callback, void *pCallbackContext,
-		uint32_t timeout_seconds);
-bool getNextFreeIndexOfAckWaitList(uint8_t *pIndex);
+/* Subscribes to all the shadow topics of myThingName, its actions then never subscribe nor unsubscribe */
+IoT_Error_t subscribeToShadowAckWildcard(void);
+/* Index of the cached topics of the action on the thing, rendered the first
+ * time, -1 if every record is taken by pending acks */
+int16_t findShadowTopics(const char *pThingName, ShadowActions_t action);
+bool isSubscriptionPresent(int16_t topicsIndex);
+IoT_Error_t subscribeToShadowActionAcks(int16_t topicsIndex, bool isSticky);
+void incrementSubscriptionCnt(int16_t topicsIndex, bool isSticky);
+
+IoT_Error_t publishToShadowAction(int16_t topicsIndex, const char * pThingName, ShadowActions_t action,
+		const char *pJsonDocumentToBeSent);
+void addToAckWaitList(uint16_t indexAckWaitList, int16_t topicsIndex, const char *pThingName,
+		ShadowActions_t action, const char *pExtractedClientToken, fpActionCallback_t callback,
+		void *pCallbackContext, uint32_t timeout_seconds);
+bool getNextFreeIndexOfAckWaitList(uint16_t *pIndex);
 void HandleExpiredResponseCallbacks(void);
+/* Milliseconds until the next ack may time out, -1 if none is pending */
+int32_t ackTimeoutLeftMs(void);
 void initDeltaTokens(void);
 IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct);
+IoT_Error_t registerSchemaOnDelta(shadowDeltaHandler_t handler, void *pContext);
+IoT_Error_t registerBatchOnDelta(shadowDeltaBatchCallback_t callback, void *pContext);
+/* Delta of myThingName received through another subscription, ignored unless a delta was registered */
+int32_t shadowMyThingDeltaCallback(MQTTCallbackParams params);
+/* A resync is a get of myThingName with shadowResyncAckCallback as its callback, begun once nothing else is pending */
+bool beginShadowResync(fpActionCallback_t callback, void *pContextData);
+/* The get of the resync could not be sent */
+void endShadowResync(void);
+void shadowResyncAckCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData);
 
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_RECORDS_H_ */
@@ -0,0 +1,262 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_shadow_reported.c
+ * @brief Cache of reported fields flushed as one merged shadow update
+ *
+ * The application registers its reported fields once and marks them as
+ * changed when their value is modified. The changed fields are sent together
+ * in a single update once SHADOW_REPORTED_FLUSH_INTERVAL_MS has passed since
+ * the first change, or as soon as SHADOW_REPORTED_FLUSH_THRESHOLD fields have
+ * changed. Only one update is in flight at a time, fields changed meanwhile
+ * wait for the next flush. Fields of a rejected or timed out update are sent
+ * again with the next flush.
+ *
+ * The value of every field is kept as it was last sent, while the update is
+ * in flight and once it is accepted. A field set back to that value is not
+ * changed, so the update only holds the fields that differ from the shadow,
+ * and nothing is sent when none does.
+ */
+
+#include "aws_iot_shadow_reported.h"
+
+#include <string.h>
+
+#include "timer_interface.h"
+#include "aws_iot_log.h"
+#include "aws_iot_shadow_json_data.h"
+#include "aws_iot_shadow_records.h"
+#include "aws_iot_config.h"
+
+typedef struct {
+	jsonStruct_t *pStruct;
+	bool isChanged;		// changed since it was last sent
+	bool isInFlight;	// part of the update waiting for its response
+	bool isSentValueValid;	// sentValue is in flight or was accepted
+	uint8_t sentValue[SHADOW_REPORTED_MAX_VALUE_SIZE];
+} ReportedField_t;
+
+static ReportedField_t reportedFields[MAX_SHADOW_REPORTED_FIELDS];
+static uint8_t reportedFieldCount = 0;
+static uint8_t changedFieldCount = 0;
+static bool isUpdateInFlight = false;
+static Timer flushTimer;
+static char reportedJsonDocument[SHADOW_REPORTED_MAX_SIZE_OF_DOCUMENT];
+
+void initReportedCache(void) {
+	reportedFieldCount = 0;
+	changedFieldCount = 0;
+	isUpdateInFlight = false;
+}
+
+/* Bytes of the value of a field, 0 if it is too big to be kept */
+static size_t reportedValueSize(const jsonStruct_t *pStruct) {
+	size_t size;
+
+	switch (pStruct->type) {
+	case SHADOW_JSON_INT32:
+	case SHADOW_JSON_UINT32:
+		size = sizeof(uint32_t);
+		break;
+	case SHADOW_JSON_INT16:
+	case SHADOW_JSON_UINT16:
+		size = sizeof(uint16_t);
+		break;
+	case SHADOW_JSON_INT8:
+	case SHADOW_JSON_UINT8:
+		size = sizeof(uint8_t);
+		break;
+	case SHADOW_JSON_FLOAT:
+		size = sizeof(float);
+		break;
+	case SHADOW_JSON_DOUBLE:
+		size = sizeof(double);
+		break;
+	case SHADOW_JSON_BOOL:
+		size = sizeof(bool);
+		break;
+	case SHADOW_JSON_STRING:
+		size = strlen((const char *) pStruct->pData) + 1;
+		break;
+	default:
+		size = 0;
+		break;
+	}
+
+	return size <= SHADOW_REPORTED_MAX_VALUE_SIZE ? size : 0;
+}
+
+static void markReportedField(ReportedField_t *pField) {
+	size_t size = reportedValueSize(pField->pStruct);
+	bool isChanged = true;
+
+	if (size > 0 && pField->isSentValueValid) {
+		isChanged = (memcmp(pField->sentValue, pField->pStruct->pData, size) != 0);
+	}
+
+	if (isChanged && !pField->isChanged) {
+		pField->isChanged = true;
+		if (changedFieldCount++ == 0) {
+			InitTimer(&flushTimer);
+			countdown_ms(&flushTimer, SHADOW_REPORTED_FLUSH_INTERVAL_MS);
+		}
+	} else if (!isChanged && pField->isChanged) {
+		/* Back to the value the shadow has */
+		pField->isChanged = false;
+		changedFieldCount--;
+	}
+}
+
+static void reportedUpdateCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	uint8_t i;
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		if (!reportedFields[i].isInFlight) {
+			continue;
+		}
+		reportedFields[i].isInFlight = false;
+		if (status != SHADOW_ACK_ACCEPTED) {
+			reportedFields[i].isSentValueValid = false;
+		}
+		if (status != SHADOW_ACK_ACCEPTED && !reportedFields[i].isChanged) {
+			reportedFields[i].isChanged = true;
+			if (changedFieldCount++ == 0) {
+				countdown_ms(&flushTimer, SHADOW_REPORTED_FLUSH_INTERVAL_MS);
+			}
+		}
+	}
+
+	if (status != SHADOW_ACK_ACCEPTED) {
+		WARN("Reported state update not accepted: %d", status);
+	}
+	isUpdateInFlight = false;
+}
+
+IoT_Error_t aws_iot_shadow_reported_register(jsonStruct_t *pStruct) {
+	uint8_t i;
+
+	if (pStruct == NULL || pStruct->pKey == NULL || pStruct->pData == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		if (reportedFields[i].pStruct == pStruct) {
+			return NONE_ERROR;
+		}
+	}
+
+	if (reportedFieldCount >= MAX_SHADOW_REPORTED_FIELDS) {
+		return GENERIC_ERROR;
+	}
+
+	reportedFields[reportedFieldCount].pStruct = pStruct;
+	reportedFields[reportedFieldCount].isChanged = false;
+	reportedFields[reportedFieldCount].isInFlight = false;
+	reportedFields[reportedFieldCount].isSentValueValid = false;
+	reportedFieldCount++;
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_reported_set(jsonStruct_t *pStruct) {
+	uint8_t i;
+
+	if (pStruct == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		if (reportedFields[i].pStruct == pStruct) {
+			markReportedField(&reportedFields[i]);
+			return NONE_ERROR;
+		}
+	}
+
+	return GENERIC_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_reported_set_changed(void) {
+	uint8_t i;
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		markReportedField(&reportedFields[i]);
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_reported_flush(MQTTClient_t *pClient) {
+	IoT_Error_t rc;
+	jsonBuilder_t builder;
+	jsonStruct_t *changedStructs[MAX_SHADOW_REPORTED_FIELDS];
+	uint8_t count = 0;
+	uint8_t i;
+
+	if (pClient == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (changedFieldCount == 0 || isUpdateInFlight) {
+		return NONE_ERROR;
+	}
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		if (reportedFields[i].isChanged) {
+			changedStructs[count++] = reportedFields[i].pStruct;
+		}
+	}
+
+	rc = aws_iot_shadow_json_builder_init(&builder, reportedJsonDocument, sizeof(reportedJsonDocument));
+	if (rc == NONE_ERROR) {
+		rc = aws_iot_shadow_json_builder_add_reported_array(&builder, count, changedStructs);
+	}
+	if (rc == NONE_ERROR) {
+		rc = aws_iot_shadow_json_builder_finalize(&builder);
+	}
+	if (rc != NONE_ERROR) {
+		ERROR("Reported state does not fit in %d bytes", SHADOW_REPORTED_MAX_SIZE_OF_DOCUMENT);
+		return rc;
+	}
+
+	rc = aws_iot_shadow_update(pClient, myThingName, reportedJsonDocument, reportedUpdateCallback, NULL,
+			SHADOW_REPORTED_UPDATE_TIMEOUT_SEC, true);
+	if (rc != NONE_ERROR) {
+		return rc;
+	}
+
+	for (i = 0; i < reportedFieldCount; i++) {
+		if (reportedFields[i].isChanged) {
+			size_t size = reportedValueSize(reportedFields[i].pStruct);
+			reportedFields[i].isChanged = false;
+			reportedFields[i].isInFlight = true;
+			reportedFields[i].isSentValueValid = (size > 0);
+			memcpy(reportedFields[i].sentValue, reportedFields[i].pStruct->pData, size);
+		}
+	}
+	changedFieldCount = 0;
+	isUpdateInFlight = true;
+	return NONE_ERROR;
+}
+
+void HandleReportedCacheFlush(MQTTClient_t *pClient) {
+	if (changedFieldCount == 0 || isUpdateInFlight) {
+		return;
+	}
+
+	if (changedFieldCount >= SHADOW_REPORTED_FLUSH_THRESHOLD || expired(&flushTimer)) {
+		aws_iot_shadow_reported_flush(pClient);
+	}
+}
+
+/* Time left before the pending changes are due, -1 when nothing is due */
+int32_t reportedCacheFlushLeftMs(void) {
+	int ms;
+
+	if (changedFieldCount == 0 || isUpdateInFlight) {
+		return -1;
+	}
+
+	ms = left_ms(&flushTimer);
+	return ms > 0 ? ms : 0;
+}
@@ -0,0 +1,15 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_
+
+#include "aws_iot_shadow_interface.h"
+
+void initReportedCache(void);
+void HandleReportedCacheFlush(MQTTClient_t *pClient);
+int32_t reportedCacheFlushLeftMs(void);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_ */
@@ -0,0 +1,189 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_shadow_schema.h
+ * @brief Shadow document code generated at build time from a list of fields
+ *
+ * Instead of a jsonStruct_t per field, looked up at run time by key, the fields of a shadow
+ * are described once as X-macros and this header generates, for that list:
+ *  - a struct with a member of the right C type per field,
+ *  - an enum of field indices and change bits,
+ *  - a static key table,
+ *  - a delta handler matching the keys with compile time lengths and parsing every value with
+ *    the parser of its type, for aws_iot_shadow_register_delta_handler(),
+ *  - functions adding the reported or desired section to a JSON builder document.
+ *
+ * Define SHADOW_SCHEMA_NAME and SHADOW_SCHEMA_FIELDS before including the header, it can be
+ * included once per schema:
+ *
+ *     #define SHADOW_SCHEMA_NAME room
+ *     #define SHADOW_SCHEMA_FIELDS(FIELD)         \
+ *             FIELD(temperature, FLOAT)           \
+ *             FIELD(windowOpen, BOOL)
+ *     #include "aws_iot_shadow_schema.h"
+ *
+ * gives room_t, room_shadow_t, room_FIELD_temperature, room_BIT_temperature, room_FIELD_COUNT,
+ * room_keys[], room_delta_handler(), room_add_reported() and room_add_desired().
+ * The types are INT32, INT16, INT8, UINT32, UINT16, UINT8, FLOAT, DOUBLE and BOOL, strings and
+ * objects still go through jsonStruct_t. A schema has at most 31 fields.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_json_utils.h"
+#include "aws_iot_shadow_json_data.h"
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_
+
+#define SHADOW_SCHEMA_CAT_(a, b) a##b
+#define SHADOW_SCHEMA_CAT(a, b) SHADOW_SCHEMA_CAT_(a, b)
+/* Identifier of the current schema, SHADOW_SCHEMA_ID(_t) is room_t */
+#define SHADOW_SCHEMA_ID(suffix) SHADOW_SCHEMA_CAT(SHADOW_SCHEMA_NAME, suffix)
+
+#define SHADOW_SCHEMA_CTYPE_INT32 int32_t
+#define SHADOW_SCHEMA_CTYPE_INT16 int16_t
+#define SHADOW_SCHEMA_CTYPE_INT8 int8_t
+#define SHADOW_SCHEMA_CTYPE_UINT32 uint32_t
+#define SHADOW_SCHEMA_CTYPE_UINT16 uint16_t
+#define SHADOW_SCHEMA_CTYPE_UINT8 uint8_t
+#define SHADOW_SCHEMA_CTYPE_FLOAT float
+#define SHADOW_SCHEMA_CTYPE_DOUBLE double
+#define SHADOW_SCHEMA_CTYPE_BOOL bool
+
+#define SHADOW_SCHEMA_PARSE_INT32 parseInteger32Value
+#define SHADOW_SCHEMA_PARSE_INT16 parseInteger16Value
+#define SHADOW_SCHEMA_PARSE_INT8 parseInteger8Value
+#define SHADOW_SCHEMA_PARSE_UINT32 parseUnsignedInteger32Value
+#define SHADOW_SCHEMA_PARSE_UINT16 parseUnsignedInteger16Value
+#define SHADOW_SCHEMA_PARSE_UINT8 parseUnsignedInteger8Value
+#define SHADOW_SCHEMA_PARSE_FLOAT parseFloatValue
+#define SHADOW_SCHEMA_PARSE_DOUBLE parseDoubleValue
+#define SHADOW_SCHEMA_PARSE_BOOL parseBooleanValue
+
+#define SHADOW_SCHEMA_ADD_INT32 aws_iot_shadow_json_builder_add_int
+#define SHADOW_SCHEMA_ADD_INT16 aws_iot_shadow_json_builder_add_int
+#define SHADOW_SCHEMA_ADD_INT8 aws_iot_shadow_json_builder_add_int
+#define SHADOW_SCHEMA_ADD_UINT32 aws_iot_shadow_json_builder_add_uint
+#define SHADOW_SCHEMA_ADD_UINT16 aws_iot_shadow_json_builder_add_uint
+#define SHADOW_SCHEMA_ADD_UINT8 aws_iot_shadow_json_builder_add_uint
+#define SHADOW_SCHEMA_ADD_FLOAT aws_iot_shadow_json_builder_add_double
+#define SHADOW_SCHEMA_ADD_DOUBLE aws_iot_shadow_json_builder_add_double
+#define SHADOW_SCHEMA_ADD_BOOL aws_iot_shadow_json_builder_add_bool
+
+/* Length of a key, a compile time constant, the only comparison done for the keys of other lengths */
+#define SHADOW_SCHEMA_KEY_LEN(name) (sizeof(#name) - 1)
+
+/* Expansions of a field for the generated code below */
+#define SHADOW_SCHEMA_MEMBER(name, type) SHADOW_SCHEMA_CTYPE_##type name;
+#define SHADOW_SCHEMA_INDEX(name, type) SHADOW_SCHEMA_ID(_FIELD_##name),
+#define SHADOW_SCHEMA_BIT(name, type) SHADOW_SCHEMA_ID(_BIT_##name) = 1 << SHADOW_SCHEMA_ID(_FIELD_##name),
+#define SHADOW_SCHEMA_KEY(name, type) #name,
+#define SHADOW_SCHEMA_MATCH(name, type) \
+	if (keyLength == SHADOW_SCHEMA_KEY_LEN(name) && memcmp(pKey, SHADOW_SCHEMA_ID(_keys)[SHADOW_SCHEMA_ID(_FIELD_##name)], \
+			SHADOW_SCHEMA_KEY_LEN(name)) == 0) { \
+		if (SHADOW_SCHEMA_PARSE_##type(&pShadow->state.name, pJsonDocument, pValueToken) == NONE_ERROR) { \
+			pShadow->changed |= SHADOW_SCHEMA_ID(_BIT_##name); \
+		} \
+		return true; \
+	}
+#define SHADOW_SCHEMA_SERIALIZE(name, type) \
+	if (fields & SHADOW_SCHEMA_ID(_BIT_##name)) { \
+		SHADOW_SCHEMA_ADD_##type(pBuilder, #name, SHADOW_SCHEMA_KEY_LEN(name), pState->name); \
+	}
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_ */
+
+#if !defined(SHADOW_SCHEMA_NAME) || !defined(SHADOW_SCHEMA_FIELDS)
+#error "Define SHADOW_SCHEMA_NAME and SHADOW_SCHEMA_FIELDS before including aws_iot_shadow_schema.h"
+#endif
+
+/**
+ * @brief Values of the fields of the schema
+ */
+typedef struct {
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_MEMBER)
+} SHADOW_SCHEMA_ID(_t);
+
+enum {
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_INDEX)
+	SHADOW_SCHEMA_ID(_FIELD_COUNT)
+};
+
+enum {
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_BIT)
+	SHADOW_SCHEMA_ID(_BIT_ALL) = (1 << SHADOW_SCHEMA_ID(_FIELD_COUNT)) - 1
+};
+
+/* Fails to compile when the change bits do not fit in an enum */
+typedef char SHADOW_SCHEMA_ID(_too_many_fields)[(SHADOW_SCHEMA_ID(_FIELD_COUNT) <= 31) ? 1 : -1];
+
+/**
+ * @brief Keys of the fields, in the order of the field indices
+ */
+static const char *const SHADOW_SCHEMA_ID(_keys)[] = {
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_KEY)
+};
+
+/**
+ * @brief State of the schema kept up to date by its delta handler
+ */
+typedef struct {
+	SHADOW_SCHEMA_ID(_t) state;		///< Current values
+	uint32_t changed;			///< Bits of the fields set by a delta, cleared by the application
+} SHADOW_SCHEMA_ID(_shadow_t);
+
+/**
+ * @brief Delta handler of the schema, for aws_iot_shadow_register_delta_handler()
+ *
+ * pContext is the SHADOW_SCHEMA_ID(_shadow_t) the values are written to. Every field whose value was
+ * parsed gets its bit set in changed. A key of the schema with a value not matching its type, as the
+ * objects under "metadata", is handled and left alone.
+ */
+static inline bool SHADOW_SCHEMA_ID(_delta_handler)(const char *pJsonDocument, const char *pKey, uint32_t keyLength,
+		jsmntok_t *pValueToken, void *pContext) {
+	SHADOW_SCHEMA_ID(_shadow_t) *pShadow = (SHADOW_SCHEMA_ID(_shadow_t) *) pContext;
+
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_MATCH)
+	return false;
+}
+
+/**
+ * @brief Add a section with the selected fields of the schema to a builder document
+ */
+static inline IoT_Error_t SHADOW_SCHEMA_ID(_add_section)(jsonBuilder_t *pBuilder, const char *pSection,
+		const SHADOW_SCHEMA_ID(_t) *pState, uint32_t fields) {
+	IoT_Error_t rc;
+
+	rc = aws_iot_shadow_json_builder_open_section(pBuilder, pSection);
+	if (rc != NONE_ERROR) {
+		return rc;
+	}
+	SHADOW_SCHEMA_FIELDS(SHADOW_SCHEMA_SERIALIZE)
+	return aws_iot_shadow_json_builder_close_section(pBuilder);
+}
+
+/**
+ * @brief Add the reported section with the fields set in fields, e.g. SHADOW_SCHEMA_ID(_BIT_ALL)
+ */
+static inline IoT_Error_t SHADOW_SCHEMA_ID(_add_reported)(jsonBuilder_t *pBuilder,
+		const SHADOW_SCHEMA_ID(_t) *pState, uint32_t fields) {
+	return SHADOW_SCHEMA_ID(_add_section)(pBuilder, "reported", pState, fields);
+}
+
+/**
+ * @brief Add the desired section with the fields set in fields
+ */
+static inline IoT_Error_t SHADOW_SCHEMA_ID(_add_desired)(jsonBuilder_t *pBuilder,
+		const SHADOW_SCHEMA_ID(_t) *pState, uint32_t fields) {
+	return SHADOW_SCHEMA_ID(_add_section)(pBuilder, "desired", pState, fields);
+}
+
+#undef SHADOW_SCHEMA_NAME
+#undef SHADOW_SCHEMA_FIELDS
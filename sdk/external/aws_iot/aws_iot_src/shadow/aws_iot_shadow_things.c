@@ -0,0 +1,271 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_shadow_things.c
+ * @brief Delta handling of the shadows of many things
+ *
+ * A gateway acts for end nodes that each have their own shadow. Instead of a
+ * delta subscription per node, the deltas of all of them come in through one
+ * subscription to $aws/things/+/shadow/update/delta. The things are kept in
+ * a pool of SHADOW_MAX_THINGS entries and found by a hash of the name taken
+ * from the topic. Every thing has its own delta handler and keeps its own
+ * last version, so an old delta of one node does not hide the newer ones of
+ * another.
+ */
+
+#include "aws_iot_shadow_things.h"
+
+#include <string.h>
+
+#include "aws_iot_log.h"
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_records.h"
+#include "aws_iot_config.h"
+
+#define THINGS_DELTA_TOPIC_PREFIX "$aws/things/"
+#define THINGS_DELTA_TOPIC_SUFFIX "/shadow/update/delta"
+
+typedef struct {
+	char thingName[MAX_SIZE_OF_THING_NAME];
+	shadowDeltaHandler_t handler;
+	void *pContext;
+	uint32_t version;
+	uint32_t nameHash;
+	int16_t nextInBucket;
+	bool isFree;
+} ShadowThing_t;
+
+static ShadowThing_t things[SHADOW_MAX_THINGS];
+/* Things by hash of their name, every bucket chains its entries through
+ * nextInBucket */
+static int16_t thingBuckets[SHADOW_THINGS_HASH_BUCKETS];
+static uint16_t thingCount = 0;
+static bool thingsTopicSubscribedFlag = false;
+static char thingsDeltaTopic[] = THINGS_DELTA_TOPIC_PREFIX "+" THINGS_DELTA_TOPIC_SUFFIX;
+
+/* FNV-1a */
+static uint32_t hashThingName(const char *pName, uint32_t nameLength) {
+	uint32_t hash = 2166136261u;
+	uint32_t i;
+
+	for (i = 0; i < nameLength; i++) {
+		hash ^= (uint8_t) pName[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static int16_t *bucketOfThing(uint32_t nameHash) {
+	return &thingBuckets[nameHash & (SHADOW_THINGS_HASH_BUCKETS - 1)];
+}
+
+static ShadowThing_t *findThing(const char *pName, uint32_t nameLength) {
+	uint32_t nameHash = hashThingName(pName, nameLength);
+	int16_t i;
+
+	for (i = *bucketOfThing(nameHash); i >= 0; i = things[i].nextInBucket) {
+		if (things[i].nameHash == nameHash && strncmp(things[i].thingName, pName, nameLength) == 0
+				&& things[i].thingName[nameLength] == '\0') {
+			return &things[i];
+		}
+	}
+	return NULL;
+}
+
+void initShadowThings(void) {
+	uint16_t i;
+
+	for (i = 0; i < SHADOW_MAX_THINGS; i++) {
+		things[i].isFree = true;
+	}
+	for (i = 0; i < SHADOW_THINGS_HASH_BUCKETS; i++) {
+		thingBuckets[i] = -1;
+	}
+	thingCount = 0;
+	thingsTopicSubscribedFlag = false;
+}
+
+static int32_t thingsDeltaCallback(MQTTCallbackParams params) {
+	const size_t prefixLength = sizeof(THINGS_DELTA_TOPIC_PREFIX) - 1;
+	const size_t suffixLength = sizeof(THINGS_DELTA_TOPIC_SUFFIX) - 1;
+	ShadowThing_t *pThing;
+	const char *pName;
+	uint32_t nameLength;
+	const char *pJsonDocument;
+	void *pJsonHandler = NULL;
+	int32_t tokenCount;
+	const char *pKey;
+	uint32_t keyLength;
+	uint32_t version;
+	int32_t i;
+
+	if (params.TopicNameLen <= prefixLength + suffixLength) {
+		return GENERIC_ERROR;
+	}
+	pName = params.pTopicName + prefixLength;
+	nameLength = params.TopicNameLen - prefixLength - suffixLength;
+
+	pThing = findThing(pName, nameLength);
+	if (pThing == NULL) {
+		/* The delta of the device itself may arrive here instead of through
+		 * its own subscription */
+		if (strlen(myThingName) == nameLength && strncmp(myThingName, pName, nameLength) == 0) {
+			return shadowMyThingDeltaCallback(params);
+		}
+		return GENERIC_ERROR;
+	}
+
+	pJsonDocument = (const char *) params.MessageParams.pPayload;
+	if (pJsonDocument == NULL) {
+		return GENERIC_ERROR;
+	}
+
+	if (!isJsonValidAndParse(pJsonDocument, params.MessageParams.PayloadLen, pJsonHandler, &tokenCount)) {
+		WARN("Received JSON is not valid");
+		return GENERIC_ERROR;
+	}
+
+	if (extractVersionNumber(pJsonDocument, pJsonHandler, tokenCount, &version)) {
+		if (shadowDiscardOldDeltaFlag && version <= pThing->version) {
+			WARN("Old Delta Message received for %s - Ignoring rx: %d local: %d", pThing->thingName, version,
+					pThing->version);
+			return GENERIC_ERROR;
+		}
+		pThing->version = version;
+	}
+
+	for (i = 1; i < tokenCount; i++) {
+		if (getJsonKeyToken(pJsonDocument, tokenCount, i, &pKey, &keyLength)) {
+			pThing->handler(pJsonDocument, pKey, keyLength, getJsonValueToken(i), pThing->pContext);
+		}
+	}
+
+	return NONE_ERROR;
+}
+
+void shadowThingVersionReceived(const char *pThingName, uint32_t version) {
+	ShadowThing_t *pThing = findThing(pThingName, strlen(pThingName));
+
+	if (pThing != NULL && version > pThing->version) {
+		pThing->version = version;
+	}
+}
+
+IoT_Error_t aws_iot_shadow_thing_add(MQTTClient_t *pClient, const char *pThingName, shadowDeltaHandler_t handler,
+		void *pContext) {
+	MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
+	ShadowThing_t *pThing = NULL;
+	int16_t *pBucket;
+	uint32_t nameLength;
+	IoT_Error_t rc;
+	uint16_t i;
+
+	if (pClient == NULL || pThingName == NULL || handler == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	nameLength = strlen(pThingName);
+	if (nameLength == 0 || nameLength >= MAX_SIZE_OF_THING_NAME || strpbrk(pThingName, "/+#") != NULL) {
+		return GENERIC_ERROR;
+	}
+
+	pThing = findThing(pThingName, nameLength);
+	if (pThing != NULL) {
+		pThing->handler = handler;
+		pThing->pContext = pContext;
+		return NONE_ERROR;
+	}
+
+	if (!thingsTopicSubscribedFlag) {
+		if (!(pClient->isConnected())) {
+			return CONNECTION_ERROR;
+		}
+		subParams.mHandler = thingsDeltaCallback;
+		subParams.pTopic = thingsDeltaTopic;
+		subParams.qos = QOS_0;
+		rc = pClient->subscribe(&subParams);
+		if (rc != NONE_ERROR) {
+			return rc;
+		}
+		DEBUG("things delta topic %s", thingsDeltaTopic);
+		thingsTopicSubscribedFlag = true;
+	}
+
+	for (i = 0; i < SHADOW_MAX_THINGS; i++) {
+		if (things[i].isFree) {
+			pThing = &things[i];
+			break;
+		}
+	}
+	if (pThing == NULL) {
+		return GENERIC_ERROR;
+	}
+
+	memcpy(pThing->thingName, pThingName, nameLength + 1);
+	pThing->handler = handler;
+	pThing->pContext = pContext;
+	pThing->version = 0;
+	pThing->nameHash = hashThingName(pThingName, nameLength);
+	pThing->isFree = false;
+	pBucket = bucketOfThing(pThing->nameHash);
+	pThing->nextInBucket = *pBucket;
+	*pBucket = (int16_t) (pThing - things);
+	thingCount++;
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_thing_remove(MQTTClient_t *pClient, const char *pThingName) {
+	ShadowThing_t *pThing;
+	int16_t *pLink;
+	int16_t index;
+
+	if (pClient == NULL || pThingName == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	pThing = findThing(pThingName, strlen(pThingName));
+	if (pThing == NULL) {
+		return GENERIC_ERROR;
+	}
+
+	index = (int16_t) (pThing - things);
+	for (pLink = bucketOfThing(pThing->nameHash); *pLink != index; pLink = &things[*pLink].nextInBucket) {
+	}
+	*pLink = pThing->nextInBucket;
+	pThing->isFree = true;
+	thingCount--;
+
+	/* The last thing gone, nothing is left to receive on the shared topic */
+	if (thingCount == 0 && thingsTopicSubscribedFlag && pClient->isConnected()) {
+		if (pClient->unsubscribe(thingsDeltaTopic) == NONE_ERROR) {
+			thingsTopicSubscribedFlag = false;
+		}
+	}
+
+	return NONE_ERROR;
+}
+
+uint32_t aws_iot_shadow_thing_get_last_received_version(const char *pThingName) {
+	ShadowThing_t *pThing;
+
+	if (pThingName == NULL) {
+		return 0;
+	}
+	pThing = findThing(pThingName, strlen(pThingName));
+	return (pThing != NULL) ? pThing->version : 0;
+}
+
+void aws_iot_shadow_thing_reset_last_received_version(const char *pThingName) {
+	ShadowThing_t *pThing;
+
+	if (pThingName == NULL) {
+		return;
+	}
+	pThing = findThing(pThingName, strlen(pThingName));
+	if (pThing != NULL) {
+		pThing->version = 0;
+	}
+}
@@ -0,0 +1,15 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_THINGS_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_THINGS_H_
+
+#include "aws_iot_shadow_interface.h"
+
+void initShadowThings(void);
+/* Version of an accepted get on a thing, ignored unless the thing was added */
+void shadowThingVersionReceived(const char *pThingName, uint32_t version);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_THINGS_H_ */
@@ -87,7 +87,21 @@ typedef enum {
 	/** The MQTT RX buffer received corrupt message  */
 	RX_MESSAGE_INVALID = -27,
 	/** The MQTT RX buffer received a bigger message. The message will be dropped  */
-	RX_MESSAGE_BIGGER_THAN_MQTT_RX_BUF = -28
+	RX_MESSAGE_BIGGER_THAN_MQTT_RX_BUF = -28,
+	/** The asynchronous publish window is full. Yield to let outstanding PUBACKs come in and retry */
+	PUBLISH_INFLIGHT_WINDOW_FULL = -29,
+	/** The PUBACK for an asynchronous publish was not received within the command timeout */
+	PUBLISH_ACK_TIMEOUT = -30,
+	/** The offline publish queue could not use its flash partition, or the message does not fit in a record */
+	OFFLINE_QUEUE_ERROR = -31,
+	/** The outbound queue of the MQTT service task has no room for the message, or dropped it for a more urgent one */
+	MQTT_SERVICE_QUEUE_FULL = -32,
+	/** The datagram transport could not encrypt or send a batch, or the message does not fit in a datagram */
+	DATAGRAM_SEND_ERROR = -33,
+	/** The publish rate limit had no token for the message within the command timeout, or no room to hold it back */
+	PUBLISH_RATE_LIMITED = -34,
+	/** All the slots of the Jobs client for status updates are taken */
+	JOBS_UPDATE_QUEUE_FULL = -35
 }IoT_Error_t;
 
 #endif /* AWS_IOT_SDK_SRC_IOT_ERROR_H_ */
@@ -0,0 +1,607 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_http_pool.c
+ * @brief HTTPS downloads over kept-alive connections
+ *
+ * A request takes a connection of the pool, marks it busy and uses it
+ * without the lock, which only guards the busy flags, the idle timers and
+ * the counters. A transfer is a run of ranges: it sends requests until
+ * #AWS_IOT_HTTP_PIPELINE_DEPTH of them wait for their response, then reads
+ * the responses in order. Whatever went wrong with a response, the
+ * connection is closed since the next response cannot be found in the
+ * stream any more, and a network error resends the unanswered ranges on a
+ * new connection.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <flash_async.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "network_interface.h"
+#include "timer_interface.h"
+#include "aws_iot_http_pool.h"
+
+#if AWS_IOT_HTTP_POOL_CONNECTIONS
+
+#define HTTP_LINE_LEN 96
+
+typedef struct {
+	Network network;
+	bool isOpen;
+	bool isBusy;
+	uint16_t port;
+	char host[AWS_IOT_HTTP_POOL_HOST_LEN];
+	Timer idleTimer;	/* Runs while the connection waits in the pool */
+} HttpConnection;
+
+/* A fetch of the bytes from offset to offset + len, rangeLen per request */
+typedef struct HttpTransfer {
+	const HttpPoolServer_t *pServer;
+	const char *pPath;
+	uint32_t offset;
+	uint32_t len;
+	uint32_t rangeLen;
+	/* Buffer for the next range, NULL to stop */
+	unsigned char *(*getBuf)(struct HttpTransfer *pTransfer);
+	/* Hand back the buffer of the range at pos from offset, filled or not */
+	IoT_Error_t (*putBuf)(struct HttpTransfer *pTransfer, unsigned char *pBuf, uint32_t pos,
+			uint32_t len, bool isReceived);
+	unsigned char *pBuf;
+} HttpTransfer;
+
+typedef struct {
+	HttpTransfer transfer;
+	mdev_t *pFlash;
+	uint32_t flashAddr;
+	unsigned char *pBufs;
+	uint32_t nextBuf;
+	os_semaphore_t freeBufs;
+	volatile int flashResult;
+} HttpDownload;
+
+static HttpConnection pool[AWS_IOT_HTTP_POOL_CONNECTIONS];
+static os_mutex_t poolLock;
+static HttpPoolStats_t poolStats;
+
+static bool poolLockTake(void) {
+	if (NULL == poolLock && WM_SUCCESS != os_mutex_create(&poolLock, "http-pool", OS_MUTEX_INHERIT)) {
+		ERROR("HTTP pool lock not created");
+		return false;
+	}
+	os_mutex_get(&poolLock, OS_WAIT_FOREVER);
+	return true;
+}
+
+static void poolCount(uint32_t *pCounter) {
+	if (poolLockTake()) {
+		(*pCounter)++;
+		os_mutex_put(&poolLock);
+	}
+}
+
+static void poolClose(HttpConnection *pConn) {
+	if (pConn->isOpen) {
+		pConn->network.disconnect(&pConn->network);
+		pConn->isOpen = false;
+	}
+}
+
+/* Take an open connection to the server, or open one in the slot of a closed or the oldest idle one */
+static IoT_Error_t poolAcquire(const HttpPoolServer_t *pServer, HttpConnection **ppConn) {
+	HttpConnection *pConn = NULL;
+	HttpConnection *pFree = NULL;
+	HttpConnection *p;
+	TLSConnectParams params;
+	IoT_Error_t rc;
+	int i;
+
+	if (!poolLockTake()) {
+		return GENERIC_ERROR;
+	}
+	for (i = 0; i < AWS_IOT_HTTP_POOL_CONNECTIONS; i++) {
+		p = &pool[i];
+		if (p->isBusy) {
+			continue;
+		}
+		if (p->isOpen && expired(&p->idleTimer)) {
+			poolClose(p);
+		}
+		if (p->isOpen && p->port == pServer->port && 0 == strcmp(p->host, pServer->pHost)) {
+			pConn = p;
+			break;
+		}
+		if (NULL == pFree || (pFree->isOpen && (!p->isOpen
+				|| left_ms(&p->idleTimer) < left_ms(&pFree->idleTimer)))) {
+			pFree = p;
+		}
+	}
+	if (NULL != pConn) {
+		pConn->isBusy = true;
+		poolStats.reused++;
+		os_mutex_put(&poolLock);
+		*ppConn = pConn;
+		return NONE_ERROR;
+	}
+	if (NULL == pFree) {
+		os_mutex_put(&poolLock);
+		ERROR("All %d HTTP connections in use", AWS_IOT_HTTP_POOL_CONNECTIONS);
+		return GENERIC_ERROR;
+	}
+	pConn = pFree;
+	pConn->isBusy = true;
+	os_mutex_put(&poolLock);
+
+	poolClose(pConn);
+	iot_tls_init(&pConn->network);
+	strcpy(pConn->host, pServer->pHost);
+	pConn->port = pServer->port;
+	params.pRootCALocation = (char *)pServer->pRootCA;
+	params.pDeviceCertLocation = (char *)pServer->pDeviceCert;
+	params.pDevicePrivateKeyLocation = (char *)pServer->pDevicePrivateKey;
+	params.pDestinationURL = pConn->host;
+	params.DestinationPort = pServer->port;
+	params.timeout_ms = pServer->timeoutMs;
+	params.ServerVerificationFlag = true;
+	params.trafficClass = NETWORK_TC_BK;
+	rc = pConn->network.connect(&pConn->network, params);
+
+	os_mutex_get(&poolLock, OS_WAIT_FOREVER);
+	if (NONE_ERROR == rc) {
+		pConn->isOpen = true;
+		poolStats.connects++;
+	} else {
+		pConn->isBusy = false;
+	}
+	os_mutex_put(&poolLock);
+	if (NONE_ERROR != rc) {
+		ERROR("HTTP connect to %s:%u failed %d", pServer->pHost, pServer->port, rc);
+		return rc;
+	}
+	*ppConn = pConn;
+	return NONE_ERROR;
+}
+
+/* Give the connection back, open for the next request if keep is set */
+static void poolRelease(HttpConnection *pConn, bool keep) {
+	if (!keep) {
+		poolClose(pConn);
+	}
+	os_mutex_get(&poolLock, OS_WAIT_FOREVER);
+	if (keep) {
+		countdown_ms(&pConn->idleTimer, AWS_IOT_HTTP_POOL_IDLE_MS);
+	}
+	pConn->isBusy = false;
+	os_mutex_put(&poolLock);
+}
+
+static IoT_Error_t sendRange(HttpConnection *pConn, const char *pPath, uint32_t offset, uint32_t len,
+		uint32_t timeoutMs) {
+	char req[AWS_IOT_HTTP_REQUEST_LEN];
+	int n;
+
+	if (443 == pConn->port) {
+		n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lu-%lu\r\n\r\n",
+				pPath, pConn->host, (unsigned long)offset, (unsigned long)(offset + len - 1));
+	} else {
+		n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s:%u\r\nRange: bytes=%lu-%lu\r\n\r\n",
+				pPath, pConn->host, pConn->port, (unsigned long)offset, (unsigned long)(offset + len - 1));
+	}
+	if (n < 0 || n >= (int)sizeof(req)) {
+		ERROR("HTTP request for %s longer than %d bytes", pPath, AWS_IOT_HTTP_REQUEST_LEN);
+		return GENERIC_ERROR;
+	}
+	if (n != pConn->network.mqttwrite(&pConn->network, (unsigned char *)req, n, timeoutMs)) {
+		return SSL_WRITE_ERROR;
+	}
+	poolCount(&poolStats.requests);
+	return NONE_ERROR;
+}
+
+/* Tell a read that returned nothing from a timeout from a closed or failed connection */
+static IoT_Error_t readError(HttpConnection *pConn) {
+	if (!pConn->network.isConnected(&pConn->network)) {
+		return SSL_READ_ERROR;
+	}
+	return SSL_READ_TIMEOUT_ERROR;
+}
+
+/* Read a line of the response head without its CRLF, the end of a longer line is dropped */
+static IoT_Error_t readLine(HttpConnection *pConn, char *pLine, size_t size, uint32_t timeoutMs) {
+	unsigned char c;
+	size_t n = 0;
+
+	while (1) {
+		if (1 != pConn->network.mqttread(&pConn->network, &c, 1, timeoutMs)) {
+			return readError(pConn);
+		}
+		if ('\n' == c) {
+			if (n > 0 && '\r' == pLine[n - 1]) {
+				n--;
+			}
+			pLine[n] = '\0';
+			return NONE_ERROR;
+		}
+		if (n < size - 1) {
+			pLine[n++] = c;
+		}
+	}
+}
+
+static IoT_Error_t readBody(HttpConnection *pConn, unsigned char *pBuf, uint32_t len, uint32_t timeoutMs) {
+	uint32_t got = 0;
+	int n;
+
+	while (got < len) {
+		n = pConn->network.mqttread(&pConn->network, pBuf + got, len - got, timeoutMs);
+		if (n <= 0) {
+			return readError(pConn);
+		}
+		got += n;
+	}
+	return NONE_ERROR;
+}
+
+/* Value of the header in pLine if it is pName, case aside, NULL if not */
+static const char *headerValue(const char *pLine, const char *pName) {
+	while ('\0' != *pName) {
+		if (tolower((unsigned char)*pLine++) != *pName++) {
+			return NULL;
+		}
+	}
+	if (':' != *pLine++) {
+		return NULL;
+	}
+	while (' ' == *pLine || '\t' == *pLine) {
+		pLine++;
+	}
+	return pLine;
+}
+
+static bool equalsNoCase(const char *pValue, const char *pLower) {
+	while ('\0' != *pLower) {
+		if (tolower((unsigned char)*pValue++) != *pLower++) {
+			return false;
+		}
+	}
+	return '\0' == *pValue;
+}
+
+/* Read the head of a response, it has to be the 206 of len bytes asked for */
+static IoT_Error_t readHead(HttpConnection *pConn, const char *pPath, uint32_t len, uint32_t timeoutMs,
+		bool *pKeepAlive) {
+	char line[HTTP_LINE_LEN];
+	const char *pValue;
+	long contentLen = -1;
+	bool isChunked = false;
+	int status;
+	IoT_Error_t rc;
+
+	/* HTTP/1.1 206 Partial Content */
+	rc = readLine(pConn, line, sizeof(line), timeoutMs);
+	if (NONE_ERROR != rc) {
+		return rc;
+	}
+	if (0 != strncmp(line, "HTTP/1.", 7) || strlen(line) < 12) {
+		ERROR("HTTP response for %s not understood", pPath);
+		return GENERIC_ERROR;
+	}
+	*pKeepAlive = ('1' == line[7]);
+	status = atoi(line + 9);
+
+	while (1) {
+		rc = readLine(pConn, line, sizeof(line), timeoutMs);
+		if (NONE_ERROR != rc) {
+			return rc;
+		}
+		if ('\0' == line[0]) {
+			break;
+		}
+		if (NULL != (pValue = headerValue(line, "content-length"))) {
+			contentLen = strtol(pValue, NULL, 10);
+		} else if (NULL != (pValue = headerValue(line, "connection"))) {
+			if (equalsNoCase(pValue, "close")) {
+				*pKeepAlive = false;
+			} else if (equalsNoCase(pValue, "keep-alive")) {
+				*pKeepAlive = true;
+			}
+		} else if (NULL != (pValue = headerValue(line, "transfer-encoding"))) {
+			isChunked = !equalsNoCase(pValue, "identity");
+		}
+	}
+
+	if (206 != status) {
+		ERROR("HTTP status %d for %s", status, pPath);
+		return GENERIC_ERROR;
+	}
+	if (isChunked || contentLen != (long)len) {
+		ERROR("HTTP range of %s answered with %ld bytes instead of %lu", pPath, contentLen,
+				(unsigned long)len);
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static bool isNetworkError(IoT_Error_t rc) {
+	return SSL_READ_ERROR == rc || SSL_READ_TIMEOUT_ERROR == rc || SSL_WRITE_ERROR == rc;
+}
+
+static IoT_Error_t transfer(HttpTransfer *pTransfer) {
+	const HttpPoolServer_t *pServer = pTransfer->pServer;
+	uint32_t end = pTransfer->offset + pTransfer->len;
+	uint32_t done = pTransfer->offset;
+	uint32_t sent = done;
+	uint32_t n;
+	HttpConnection *pConn = NULL;
+	unsigned char *pBuf;
+	bool keepAlive = false;
+	int retries = 0;
+	IoT_Error_t rc = NONE_ERROR;
+	IoT_Error_t putRc;
+
+	while (done < end) {
+		if (NULL == pConn) {
+			rc = poolAcquire(pServer, &pConn);
+			if (NONE_ERROR != rc) {
+				break;
+			}
+			sent = done;
+		}
+
+		/* Keep the pipeline full */
+		while (NONE_ERROR == rc && sent < end
+				&& sent - done < AWS_IOT_HTTP_PIPELINE_DEPTH * pTransfer->rangeLen) {
+			n = end - sent < pTransfer->rangeLen ? end - sent : pTransfer->rangeLen;
+			rc = sendRange(pConn, pTransfer->pPath, sent, n, pServer->timeoutMs);
+			sent += n;
+		}
+
+		n = end - done < pTransfer->rangeLen ? end - done : pTransfer->rangeLen;
+		if (NONE_ERROR == rc) {
+			rc = readHead(pConn, pTransfer->pPath, n, pServer->timeoutMs, &keepAlive);
+		}
+		if (NONE_ERROR == rc) {
+			pBuf = pTransfer->getBuf(pTransfer);
+			if (NULL == pBuf) {
+				rc = GENERIC_ERROR;
+			} else {
+				rc = readBody(pConn, pBuf, n, pServer->timeoutMs);
+				putRc = pTransfer->putBuf(pTransfer, pBuf, done - pTransfer->offset, n, NONE_ERROR == rc);
+				if (NONE_ERROR == rc) {
+					rc = putRc;
+				}
+			}
+		}
+
+		if (NONE_ERROR == rc) {
+			done += n;
+			retries = 0;
+			if (!keepAlive) {
+				/* The server closes after this response, the ranges sent after it are lost */
+				poolRelease(pConn, false);
+				pConn = NULL;
+			}
+			continue;
+		}
+
+		poolRelease(pConn, false);
+		pConn = NULL;
+		if (!isNetworkError(rc) || retries++ >= AWS_IOT_HTTP_RETRIES) {
+			break;
+		}
+		WARN("HTTP transfer of %s failed %d at %lu, retrying", pTransfer->pPath, rc, (unsigned long)done);
+		poolCount(&poolStats.retries);
+		rc = NONE_ERROR;
+	}
+
+	if (NULL != pConn) {
+		poolRelease(pConn, NONE_ERROR == rc);
+	}
+	return rc;
+}
+
+static IoT_Error_t checkRequest(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len) {
+	if (NULL == pServer || NULL == pServer->pHost || NULL == pPath) {
+		return NULL_VALUE_ERROR;
+	}
+	if (0 == len || offset + len < offset || strlen(pServer->pHost) >= AWS_IOT_HTTP_POOL_HOST_LEN) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static unsigned char *getGetBuf(HttpTransfer *pTransfer) {
+	return pTransfer->pBuf;
+}
+
+static IoT_Error_t getPutBuf(HttpTransfer *pTransfer, unsigned char *pBuf, uint32_t pos, uint32_t len,
+		bool isReceived) {
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_http_get(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, unsigned char *pBuf) {
+	HttpTransfer get;
+	IoT_Error_t rc;
+
+	if (NULL == pBuf) {
+		return NULL_VALUE_ERROR;
+	}
+	rc = checkRequest(pServer, pPath, offset, len);
+	if (NONE_ERROR != rc) {
+		return rc;
+	}
+
+	get.pServer = pServer;
+	get.pPath = pPath;
+	get.offset = offset;
+	get.len = len;
+	get.rangeLen = len;
+	get.getBuf = getGetBuf;
+	get.putBuf = getPutBuf;
+	get.pBuf = pBuf;
+	return transfer(&get);
+}
+
+static unsigned char *downloadGetBuf(HttpTransfer *pTransfer) {
+	HttpDownload *pDownload = (HttpDownload *)pTransfer;
+
+	/* The flash thread frees the buffers in the order they were queued */
+	if (WM_SUCCESS != os_semaphore_get(&pDownload->freeBufs, OS_WAIT_FOREVER)
+			|| WM_SUCCESS != pDownload->flashResult) {
+		return NULL;
+	}
+	return pDownload->pBufs + (pDownload->nextBuf++ % AWS_IOT_HTTP_FLASH_BUFS) * FLASH_ASYNC_SECTOR_SIZE;
+}
+
+static void downloadErased(int result, void *arg) {
+	HttpDownload *pDownload = arg;
+
+	if (WM_SUCCESS != result) {
+		pDownload->flashResult = result;
+	}
+}
+
+static void downloadWritten(int result, void *arg) {
+	HttpDownload *pDownload = arg;
+
+	if (WM_SUCCESS != result) {
+		pDownload->flashResult = result;
+	}
+	os_semaphore_put(&pDownload->freeBufs);
+}
+
+static IoT_Error_t downloadPutBuf(HttpTransfer *pTransfer, unsigned char *pBuf, uint32_t pos, uint32_t len,
+		bool isReceived) {
+	HttpDownload *pDownload = (HttpDownload *)pTransfer;
+	uint32_t addr = pDownload->flashAddr + pos;
+
+	if (isReceived && WM_SUCCESS == flash_async_erase(pDownload->pFlash, addr, FLASH_ASYNC_SECTOR_SIZE,
+			downloadErased, pDownload)) {
+		if (WM_SUCCESS == flash_async_write(pDownload->pFlash, pBuf, len, addr, downloadWritten, pDownload)) {
+			return NONE_ERROR;
+		}
+		ERROR("HTTP download of %s not queued to flash", pTransfer->pPath);
+		pDownload->flashResult = -WM_FAIL;
+	}
+
+	/* The buffer was the last taken, the next range takes it again */
+	pDownload->nextBuf--;
+	os_semaphore_put(&pDownload->freeBufs);
+	return isReceived ? GENERIC_ERROR : NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_http_download(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, mdev_t *pFlash, uint32_t flashAddr) {
+	HttpDownload download;
+	IoT_Error_t rc;
+
+	if (NULL == pFlash) {
+		return NULL_VALUE_ERROR;
+	}
+	rc = checkRequest(pServer, pPath, offset, len);
+	if (NONE_ERROR != rc) {
+		return rc;
+	}
+	if (0 != flashAddr % FLASH_ASYNC_SECTOR_SIZE) {
+		ERROR("HTTP download to 0x%lx, not the start of a sector", (unsigned long)flashAddr);
+		return GENERIC_ERROR;
+	}
+	if (WM_SUCCESS != flash_async_init()) {
+		return GENERIC_ERROR;
+	}
+
+	memset(&download, 0, sizeof(download));
+	download.pBufs = os_mem_alloc(AWS_IOT_HTTP_FLASH_BUFS * FLASH_ASYNC_SECTOR_SIZE);
+	if (NULL == download.pBufs) {
+		ERROR("No memory for %d HTTP download buffers", AWS_IOT_HTTP_FLASH_BUFS);
+		return GENERIC_ERROR;
+	}
+	if (WM_SUCCESS != os_semaphore_create_counting(&download.freeBufs, "http-dl",
+			AWS_IOT_HTTP_FLASH_BUFS, AWS_IOT_HTTP_FLASH_BUFS)) {
+		os_mem_free(download.pBufs);
+		return GENERIC_ERROR;
+	}
+	download.pFlash = pFlash;
+	download.flashAddr = flashAddr;
+	download.flashResult = WM_SUCCESS;
+	download.transfer.pServer = pServer;
+	download.transfer.pPath = pPath;
+	download.transfer.offset = offset;
+	download.transfer.len = len;
+	download.transfer.rangeLen = FLASH_ASYNC_SECTOR_SIZE;
+	download.transfer.getBuf = downloadGetBuf;
+	download.transfer.putBuf = downloadPutBuf;
+
+	rc = transfer(&download.transfer);
+
+	/* The buffers stay in use until the flash thread is done with them */
+	flash_async_flush();
+	if (NONE_ERROR == rc && WM_SUCCESS != download.flashResult) {
+		ERROR("HTTP download of %s, flash failed %d", pPath, download.flashResult);
+		rc = GENERIC_ERROR;
+	}
+	os_semaphore_delete(&download.freeBufs);
+	os_mem_free(download.pBufs);
+	return rc;
+}
+
+void aws_iot_http_pool_close(void) {
+	int i;
+
+	if (!poolLockTake()) {
+		return;
+	}
+	for (i = 0; i < AWS_IOT_HTTP_POOL_CONNECTIONS; i++) {
+		if (!pool[i].isBusy) {
+			poolClose(&pool[i]);
+		}
+	}
+	os_mutex_put(&poolLock);
+}
+
+void aws_iot_http_pool_get_stats(HttpPoolStats_t *pStats, bool reset) {
+	if (NULL == pStats || !poolLockTake()) {
+		return;
+	}
+	*pStats = poolStats;
+	if (reset) {
+		memset(&poolStats, 0, sizeof(poolStats));
+	}
+	os_mutex_put(&poolLock);
+}
+
+#else /* AWS_IOT_HTTP_POOL_CONNECTIONS */
+
+IoT_Error_t aws_iot_http_get(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, unsigned char *pBuf) {
+	ERROR("Built without AWS_IOT_HTTP_POOL_CONNECTIONS");
+	return GENERIC_ERROR;
+}
+
+IoT_Error_t aws_iot_http_download(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, mdev_t *pFlash, uint32_t flashAddr) {
+	ERROR("Built without AWS_IOT_HTTP_POOL_CONNECTIONS");
+	return GENERIC_ERROR;
+}
+
+void aws_iot_http_pool_close(void) {
+}
+
+void aws_iot_http_pool_get_stats(HttpPoolStats_t *pStats, bool reset) {
+	if (NULL != pStats) {
+		memset(pStats, 0, sizeof(*pStats));
+	}
+}
+
+#endif /* AWS_IOT_HTTP_POOL_CONNECTIONS */
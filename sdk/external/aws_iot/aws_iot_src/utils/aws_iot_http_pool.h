@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_http_pool.h
+ * @brief HTTPS downloads over kept-alive connections
+ *
+ * Fetching a firmware image or the assets of a job over HTTPS with a new
+ * connection per request costs a DNS lookup, a TCP handshake and a TLS
+ * handshake each time, longer than the transfer for assets of a few KB. The
+ * pool keeps up to #AWS_IOT_HTTP_POOL_CONNECTIONS connections open after
+ * their request, with HTTP/1.1 keep-alive, and hands them to the next
+ * request to the same host and port. A connection that has to be opened
+ * again offers the TLS session of the previous one to its host, so the
+ * server skips the certificate exchange and the key agreement.
+ *
+ * aws_iot_http_download() fetches a file, or a part of it, into flash: it
+ * asks for one flash sector at a time with Range requests, and keeps
+ * #AWS_IOT_HTTP_PIPELINE_DEPTH of them in flight on the connection so that
+ * the server streams the ranges back to back instead of waiting a round
+ * trip for each. Every range is received into one of
+ * #AWS_IOT_HTTP_FLASH_BUFS sector buffers and queued to the flash thread of
+ * flash_async.h, which erases and writes it while the next one arrives.
+ * When the server closes the connection, or the network fails, the ranges
+ * not received yet are asked for again on a new connection.
+ *
+ * The connections run over the TLS layer of the MQTT client, with the DNS
+ * cache and the certificate cache. Only HTTPS is supported, the server has
+ * to answer Range requests with 206 Partial Content.
+ *
+ * The functions can be called from several threads, each request takes its
+ * own connection.
+ *
+ * \code
+ * static const HttpPoolServer_t assets = {
+ *     .pHost = "assets.example.com",
+ *     .port = 443,
+ *     .pRootCA = root_ca_pem,
+ *     .timeoutMs = 10000
+ * };
+ *
+ * flash_drv_init();
+ * fl = flash_drv_open(part.fl_dev);
+ * rc = aws_iot_http_download(&assets, "/fw/v2.bin", 0, imageLen, fl, part.start);
+ * \endcode
+ */
+
+#ifndef AWS_IOT_HTTP_POOL_H_
+#define AWS_IOT_HTTP_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <mdev.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+
+/**
+ * @brief Server of a request
+ *
+ * The strings have to stay in place during the request, the certificates
+ * for the life of the application like those of the MQTT connection.
+ */
+typedef struct {
+	const char *pHost;			///< Host name, at most AWS_IOT_HTTP_POOL_HOST_LEN - 1 characters
+	uint16_t port;				///< Usually 443
+	const char *pRootCA;		///< CA of the server, PEM or DER, see iot_tls_credentials_load()
+	const char *pDeviceCert;	///< Client certificate, NULL if the server does not ask for one
+	const char *pDevicePrivateKey;	///< Key of the client certificate
+	uint32_t timeoutMs;			///< Longest the connect, or the wait for the next bytes of a response, can take
+} HttpPoolServer_t;
+
+/**
+ * @brief Counters of the pool
+ */
+typedef struct {
+	uint32_t requests;	///< Range requests sent
+	uint32_t connects;	///< Connections opened
+	uint32_t reused;	///< Requests and downloads that took a connection left open by an earlier one
+	uint32_t retries;	///< New connections made after the server closed one or the network failed
+} HttpPoolStats_t;
+
+/**
+ * @brief Fetch a range of a file into memory
+ *
+ * @param pServer Server of the file
+ * @param pPath Path of the file, with its query if any
+ * @param offset First byte of the file to fetch
+ * @param len Bytes to fetch, the range has to be in the file
+ * @param pBuf Buffer of len bytes
+ * @return NONE_ERROR, NULL_VALUE_ERROR, the error of the connect, SSL_READ_TIMEOUT_ERROR,
+ * SSL_READ_ERROR or SSL_WRITE_ERROR once the retries failed, or GENERIC_ERROR when
+ * the server answered with another status than 206 or another length, or every
+ * connection of the pool is in use
+ */
+IoT_Error_t aws_iot_http_get(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, unsigned char *pBuf);
+
+/**
+ * @brief Fetch a range of a file into flash
+ *
+ * Erases the sectors from flashAddr on and writes the range to them, returns
+ * once it is all written. flash_drv_init() has to be called before.
+ *
+ * @param pServer Server of the file
+ * @param pPath Path of the file, with its query if any
+ * @param offset First byte of the file to fetch
+ * @param len Bytes to fetch, the range has to be in the file
+ * @param pFlash Flash device from flash_drv_open()
+ * @param flashAddr Address of the first byte, at the start of a sector of FLASH_ASYNC_SECTOR_SIZE
+ * @return The errors of aws_iot_http_get(), or GENERIC_ERROR when flashAddr is not
+ * the start of a sector, there is no memory for the buffers or a flash
+ * operation failed. The sectors written until then stay written
+ */
+IoT_Error_t aws_iot_http_download(const HttpPoolServer_t *pServer, const char *pPath, uint32_t offset,
+		uint32_t len, mdev_t *pFlash, uint32_t flashAddr);
+
+/**
+ * @brief Close the connections not in use
+ *
+ * E.g. once the downloads of a job are done, the server would close them
+ * anyway. Requests open new ones.
+ */
+void aws_iot_http_pool_close(void);
+
+/**
+ * @brief Get the counters of the pool
+ *
+ * @param pStats Counters since the start or the last reset
+ * @param reset set to true to start counting again from zero
+ */
+void aws_iot_http_pool_get_stats(HttpPoolStats_t *pStats, bool reset);
+
+#endif /* AWS_IOT_HTTP_POOL_H_ */
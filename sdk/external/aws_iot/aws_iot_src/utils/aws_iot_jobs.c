@@ -0,0 +1,451 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_jobs.c
+ * @brief Client of the AWS IoT Jobs MQTT API
+ *
+ * The topic of a message tells what it is, the rest of the topic past
+ * $aws/things/<thing>/jobs/ is looked at in its first chunk. Only the
+ * messages carrying an execution are tokenized, the replies to the updates
+ * are just counted. The tokenizer, the execution being received and the
+ * message kind are used by the yielding thread only.
+ *
+ * An update slot is pending until it is published, in flight until its
+ * PUBACK and free after. A slot whose PUBACK does not come is pending again.
+ * Pending slots go out in the order the updates were made.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_interface.h"
+#include "aws_iot_jobs.h"
+
+#if AWS_IOT_JOBS_PIPELINE > AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH
+#error "AWS_IOT_JOBS_PIPELINE is more than the in-flight window of the connection"
+#endif
+
+/* The execution is an object at the top, its members are one deeper */
+#define JOBS_EXECUTION_DEPTH 1
+#define JOBS_DOCUMENT_DEPTH 2
+
+enum {
+	JOBS_MSG_OTHER,
+	JOBS_MSG_EXECUTION,
+	JOBS_MSG_UPDATE_ACCEPTED,
+	JOBS_MSG_UPDATE_REJECTED,
+	JOBS_MSG_REJECTED
+};
+
+enum {
+	JOBS_SLOT_FREE,
+	JOBS_SLOT_PENDING,
+	JOBS_SLOT_INFLIGHT
+};
+
+typedef struct {
+	uint8_t state;
+	uint32_t seq;       /* Order the updates were made in */
+	uint16_t payloadLen;
+	char topic[AWS_IOT_JOBS_TOPIC_LEN];
+	char payload[AWS_IOT_JOBS_UPDATE_LEN];
+} jobs_slot_t;
+
+static const char *const jobsStatusNames[] = {
+	[JOB_EXECUTION_QUEUED] = "QUEUED",
+	[JOB_EXECUTION_IN_PROGRESS] = "IN_PROGRESS",
+	[JOB_EXECUTION_SUCCEEDED] = "SUCCEEDED",
+	[JOB_EXECUTION_FAILED] = "FAILED",
+	[JOB_EXECUTION_REJECTED] = "REJECTED",
+};
+
+static struct {
+	JobsParams_t params;
+	os_mutex_t lock;
+	/* The subscription, $aws/things/<thing>/jobs/# */
+	char filter[AWS_IOT_JOBS_TOPIC_LEN];
+	size_t prefixLen;   /* Of the filter without the '#' */
+	JsonStream_t stream;
+	uint8_t message;
+	bool inExecution;
+	bool inDocument;
+	JobExecution_t execution;
+	jobs_slot_t slots[AWS_IOT_JOBS_UPDATE_SLOTS];
+	uint32_t seq;
+	uint32_t inflight;
+	JobsStats_t stats;
+} jobs;
+
+static bool jobsEndsWith(const char *pName, size_t len, const char *pSuffix) {
+	size_t suffixLen = strlen(pSuffix);
+
+	return len >= suffixLen && 0 == memcmp(pName + len - suffixLen, pSuffix, suffixLen);
+}
+
+static uint8_t jobsClassify(const char *pTopic, size_t topicLen) {
+	const char *pName;
+	size_t len;
+
+	if (topicLen <= jobs.prefixLen || 0 != memcmp(pTopic, jobs.filter, jobs.prefixLen)) {
+		return JOBS_MSG_OTHER;
+	}
+
+	pName = pTopic + jobs.prefixLen;
+	len = topicLen - jobs.prefixLen;
+	if ((sizeof("notify-next") - 1 == len && 0 == memcmp(pName, "notify-next", len))
+			|| (sizeof("start-next/accepted") - 1 == len && 0 == memcmp(pName, "start-next/accepted", len))) {
+		return JOBS_MSG_EXECUTION;
+	}
+	if (jobsEndsWith(pName, len, "/update/accepted")) {
+		return JOBS_MSG_UPDATE_ACCEPTED;
+	}
+	if (jobsEndsWith(pName, len, "/update/rejected")) {
+		return JOBS_MSG_UPDATE_REJECTED;
+	}
+	if (jobsEndsWith(pName, len, "/rejected")) {
+		return JOBS_MSG_REJECTED;
+	}
+	return JOBS_MSG_OTHER;
+}
+
+static bool jobsKeyIs(const JsonStreamEvent_t *pEvent, const char *pKey) {
+	return NULL != pEvent->pKey && strlen(pKey) == pEvent->keyLength
+			&& 0 == memcmp(pEvent->pKey, pKey, pEvent->keyLength);
+}
+
+static JobExecutionStatus_t jobsStatusOf(const char *pName) {
+	uint32_t i;
+
+	for (i = 0; i < sizeof(jobsStatusNames) / sizeof(jobsStatusNames[0]); i++) {
+		if (0 == strcmp(pName, jobsStatusNames[i])) {
+			return (JobExecutionStatus_t)i;
+		}
+	}
+	return JOB_EXECUTION_UNKNOWN;
+}
+
+/* Hands the elements of the job document on, depth counted from it */
+static bool jobsOnDocument(const JsonStreamEvent_t *pEvent) {
+	JsonStreamEvent_t event = *pEvent;
+	bool isEnd = JSON_STREAM_OBJECT_END == pEvent->type || JSON_STREAM_ARRAY_END == pEvent->type;
+
+	if (isEnd && JOBS_DOCUMENT_DEPTH == pEvent->depth) {
+		jobs.inDocument = false;
+	}
+	if (NULL == jobs.params.documentHandler) {
+		return true;
+	}
+
+	event.depth -= JOBS_DOCUMENT_DEPTH;
+	if (0 == event.depth) {
+		event.pKey = NULL;
+		event.keyLength = 0;
+	}
+	return jobs.params.documentHandler(&jobs.execution, &event, jobs.params.pContext);
+}
+
+static bool jobsOnElement(const JsonStreamEvent_t *pEvent, void *pContext) {
+	if (jobs.inDocument) {
+		return jobsOnDocument(pEvent);
+	}
+
+	if (JOBS_EXECUTION_DEPTH == pEvent->depth) {
+		if (JSON_STREAM_OBJECT_START == pEvent->type && jobsKeyIs(pEvent, "execution")) {
+			jobs.inExecution = true;
+		} else if (JSON_STREAM_OBJECT_END == pEvent->type) {
+			jobs.inExecution = false;
+		}
+		return true;
+	}
+	if (!jobs.inExecution || JOBS_DOCUMENT_DEPTH != pEvent->depth) {
+		return true;
+	}
+
+	switch (pEvent->type) {
+	case JSON_STREAM_OBJECT_START:
+		if (jobsKeyIs(pEvent, "jobDocument")) {
+			jobs.inDocument = true;
+			return jobsOnDocument(pEvent);
+		}
+		break;
+	case JSON_STREAM_STRING:
+		if (jobsKeyIs(pEvent, "jobId")) {
+			if (AWS_IOT_JOBS_MAX_JOB_ID_LEN <= pEvent->valueLength) {
+				return false;
+			}
+			memcpy(jobs.execution.jobId, pEvent->pValue, pEvent->valueLength + 1);
+		} else if (jobsKeyIs(pEvent, "status")) {
+			jobs.execution.status = jobsStatusOf(pEvent->pValue);
+		}
+		break;
+	case JSON_STREAM_PRIMITIVE:
+		if (jobsKeyIs(pEvent, "versionNumber")) {
+			jobs.execution.versionNumber = strtoul(pEvent->pValue, NULL, 10);
+		} else if (jobsKeyIs(pEvent, "executionNumber")) {
+			jobs.execution.executionNumber = strtoul(pEvent->pValue, NULL, 10);
+		}
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+static void jobsCount(uint32_t *pCounter) {
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	(*pCounter)++;
+	os_recursive_mutex_put(&jobs.lock);
+}
+
+static int32_t jobsOnMessage(MQTTCallbackParams params) {
+	if (0 == params.PayloadOffset) {
+		jobs.message = jobsClassify(params.pTopicName, params.TopicNameLen);
+		switch (jobs.message) {
+		case JOBS_MSG_EXECUTION:
+			memset(&jobs.execution, 0, sizeof(jobs.execution));
+			jobs.execution.status = JOB_EXECUTION_UNKNOWN;
+			jobs.inExecution = false;
+			jobs.inDocument = false;
+			break;
+		case JOBS_MSG_UPDATE_ACCEPTED:
+			jobsCount(&jobs.stats.updatesAccepted);
+			break;
+		case JOBS_MSG_UPDATE_REJECTED:
+			jobsCount(&jobs.stats.updatesRejected);
+			break;
+		case JOBS_MSG_REJECTED:
+			jobsCount(&jobs.stats.rejected);
+			break;
+		default:
+			break;
+		}
+	}
+	if (JOBS_MSG_EXECUTION != jobs.message) {
+		return 0;
+	}
+
+	if (NONE_ERROR != aws_iot_json_stream_feed_message(&jobs.stream, &params)) {
+		/* The rest of the message is skipped */
+		jobs.message = JOBS_MSG_OTHER;
+		jobsCount(&jobs.stats.dropped);
+		return 0;
+	}
+
+	/* A notify-next without an execution tells that no job is pending */
+	if (params.isLastChunk && '\0' != jobs.execution.jobId[0]) {
+		jobsCount(&jobs.stats.executions);
+		jobs.params.executionHandler(&jobs.execution, jobs.params.pContext);
+	}
+	return 0;
+}
+
+IoT_Error_t aws_iot_jobs_init(const JobsParams_t *pParams) {
+	MQTTSubscribeParams subscribeParams = MQTTSubscribeParamsDefault;
+	int len;
+
+	if (NULL == pParams || NULL == pParams->pThingName || NULL == pParams->executionHandler) {
+		return NULL_VALUE_ERROR;
+	}
+	if (NULL == jobs.lock && WM_SUCCESS != os_recursive_mutex_create(&jobs.lock, "jobs")) {
+		return GENERIC_ERROR;
+	}
+
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	len = snprintf(jobs.filter, sizeof(jobs.filter), "$aws/things/%s/jobs/#", pParams->pThingName);
+	if (0 > len || sizeof(jobs.filter) <= (size_t)len) {
+		jobs.filter[0] = '\0';
+		jobs.prefixLen = 0;
+		os_recursive_mutex_put(&jobs.lock);
+		ERROR("Jobs topics of %s do not fit", pParams->pThingName);
+		return GENERIC_ERROR;
+	}
+	jobs.prefixLen = (size_t)len - 1;
+	jobs.params = *pParams;
+	aws_iot_json_stream_init(&jobs.stream, jobsOnElement, NULL);
+	os_recursive_mutex_put(&jobs.lock);
+
+	subscribeParams.pTopic = jobs.filter;
+	subscribeParams.qos = QOS_1;
+	subscribeParams.mHandler = jobsOnMessage;
+	subscribeParams.isStreaming = true;
+	return aws_iot_mqtt_subscribe(&subscribeParams);
+}
+
+IoT_Error_t aws_iot_jobs_start_next(void) {
+	MQTTPublishParams params = MQTTPublishParamsDefault;
+	char topic[AWS_IOT_JOBS_TOPIC_LEN];
+	int len;
+
+	if (0 == jobs.prefixLen) {
+		return GENERIC_ERROR;
+	}
+
+	len = snprintf(topic, sizeof(topic), "%.*sstart-next", (int)jobs.prefixLen, jobs.filter);
+	if (0 > len || sizeof(topic) <= (size_t)len) {
+		return GENERIC_ERROR;
+	}
+
+	params.pTopic = topic;
+	params.MessageParams.qos = QOS_1;
+	params.MessageParams.pPayload = "{}";
+	params.MessageParams.PayloadLen = 2;
+	return aws_iot_mqtt_publish(&params);
+}
+
+static void jobsUpdateDone(uint16_t id, IoT_Error_t status, void *pContext) {
+	jobs_slot_t *pSlot = (jobs_slot_t *)pContext;
+
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	jobs.inflight--;
+	if (NONE_ERROR == status) {
+		pSlot->state = JOBS_SLOT_FREE;
+		jobs.stats.updatesSent++;
+	} else {
+		pSlot->state = JOBS_SLOT_PENDING;
+		jobs.stats.updatesResent++;
+	}
+	os_recursive_mutex_put(&jobs.lock);
+}
+
+IoT_Error_t aws_iot_jobs_update(const char *pJobId, JobExecutionStatus_t status, const char *pStatusDetails,
+		uint32_t expectedVersion) {
+	jobs_slot_t *pSlot = NULL;
+	char version[24] = "";
+	int topicLen, payloadLen;
+	uint32_t i;
+
+	if (NULL == pJobId) {
+		return NULL_VALUE_ERROR;
+	}
+	if (0 == jobs.prefixLen || JOB_EXECUTION_QUEUED == status || JOB_EXECUTION_UNKNOWN <= status) {
+		return GENERIC_ERROR;
+	}
+	if (0 != expectedVersion) {
+		snprintf(version, sizeof(version), ",\"expectedVersion\":%lu", (unsigned long)expectedVersion);
+	}
+
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	for (i = 0; i < AWS_IOT_JOBS_UPDATE_SLOTS; i++) {
+		if (JOBS_SLOT_FREE == jobs.slots[i].state) {
+			pSlot = &jobs.slots[i];
+			break;
+		}
+	}
+	if (NULL == pSlot) {
+		os_recursive_mutex_put(&jobs.lock);
+		return JOBS_UPDATE_QUEUE_FULL;
+	}
+
+	topicLen = snprintf(pSlot->topic, sizeof(pSlot->topic), "%.*s%s/update", (int)jobs.prefixLen, jobs.filter,
+			pJobId);
+	payloadLen = snprintf(pSlot->payload, sizeof(pSlot->payload), "{\"status\":\"%s\"%s%s%s}",
+			jobsStatusNames[status], version, (NULL != pStatusDetails) ? ",\"statusDetails\":" : "",
+			(NULL != pStatusDetails) ? pStatusDetails : "");
+	if (0 > topicLen || sizeof(pSlot->topic) <= (size_t)topicLen
+			|| 0 > payloadLen || sizeof(pSlot->payload) <= (size_t)payloadLen) {
+		os_recursive_mutex_put(&jobs.lock);
+		return GENERIC_ERROR;
+	}
+	pSlot->payloadLen = (uint16_t)payloadLen;
+	pSlot->seq = jobs.seq++;
+	pSlot->state = JOBS_SLOT_PENDING;
+	os_recursive_mutex_put(&jobs.lock);
+
+	/* Sent now if the pipeline has room, by the next drain otherwise */
+	aws_iot_jobs_drain();
+	return NONE_ERROR;
+}
+
+/* The pending update made first */
+static jobs_slot_t *jobsNextPending(void) {
+	jobs_slot_t *pNext = NULL;
+	uint32_t i;
+
+	for (i = 0; i < AWS_IOT_JOBS_UPDATE_SLOTS; i++) {
+		jobs_slot_t *pSlot = &jobs.slots[i];
+
+		if (JOBS_SLOT_PENDING == pSlot->state
+				&& (NULL == pNext || (int32_t)(pSlot->seq - pNext->seq) < 0)) {
+			pNext = pSlot;
+		}
+	}
+	return pNext;
+}
+
+IoT_Error_t aws_iot_jobs_drain(void) {
+	MQTTPublishParams params = MQTTPublishParamsDefault;
+	jobs_slot_t *pSlot;
+	IoT_Error_t rc = NONE_ERROR;
+
+	if (NULL == jobs.lock) {
+		return NONE_ERROR;
+	}
+	if (!aws_iot_is_mqtt_connected()) {
+		return NETWORK_DISCONNECTED;
+	}
+
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	/* The updates of one call share TLS records */
+	aws_iot_mqtt_batch_begin();
+	while (AWS_IOT_JOBS_PIPELINE > jobs.inflight && NULL != (pSlot = jobsNextPending())) {
+		params.pTopic = pSlot->topic;
+		params.MessageParams.qos = QOS_1;
+		params.MessageParams.pPayload = pSlot->payload;
+		params.MessageParams.PayloadLen = pSlot->payloadLen;
+
+		pSlot->state = JOBS_SLOT_INFLIGHT;
+		jobs.inflight++;
+		rc = aws_iot_mqtt_publish_async(&params, jobsUpdateDone, pSlot);
+		if (NONE_ERROR != rc) {
+			pSlot->state = JOBS_SLOT_PENDING;
+			jobs.inflight--;
+			break;
+		}
+	}
+	if (NONE_ERROR == rc) {
+		rc = aws_iot_mqtt_batch_end();
+	} else {
+		aws_iot_mqtt_batch_end();
+	}
+	os_recursive_mutex_put(&jobs.lock);
+
+	/* The application's own publishes fill the window, the PUBACKs make room */
+	return (PUBLISH_INFLIGHT_WINDOW_FULL == rc) ? NONE_ERROR : rc;
+}
+
+uint32_t aws_iot_jobs_pending(void) {
+	uint32_t i, count = 0;
+
+	for (i = 0; i < AWS_IOT_JOBS_UPDATE_SLOTS; i++) {
+		if (JOBS_SLOT_FREE != jobs.slots[i].state) {
+			count++;
+		}
+	}
+	return count;
+}
+
+IoT_Error_t aws_iot_jobs_get_stats(JobsStats_t *pStats, bool reset) {
+	if (NULL == pStats) {
+		return NULL_VALUE_ERROR;
+	}
+	if (NULL == jobs.lock) {
+		memset(pStats, 0, sizeof(*pStats));
+		return NONE_ERROR;
+	}
+
+	os_recursive_mutex_get(&jobs.lock, OS_WAIT_FOREVER);
+	*pStats = jobs.stats;
+	if (reset) {
+		memset(&jobs.stats, 0, sizeof(jobs.stats));
+	}
+	os_recursive_mutex_put(&jobs.lock);
+	return NONE_ERROR;
+}
@@ -0,0 +1,181 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_jobs.h
+ * @brief Client of the AWS IoT Jobs MQTT API
+ *
+ * One streaming QoS1 subscription to $aws/things/<thing>/jobs/# takes every
+ * Jobs message of the thing: the notify-next ones, which carry the next
+ * pending execution, and the replies to start-next and to the status
+ * updates. Connect with isCleansession false so that the broker keeps the
+ * subscription and queues the notifications while the device is offline,
+ * the device does not poll.
+ *
+ * An execution is run through the tokenizer of aws_iot_json_stream.h as it
+ * arrives, chunk by chunk, however large its job document is. The elements
+ * of the job document go to the document handler, the job id, status and
+ * version numbers are kept, and the execution handler is called once the
+ * message is complete. AWS IoT puts the job id and the version ahead of the
+ * job document.
+ *
+ * Status updates are copied into one of #AWS_IOT_JOBS_UPDATE_SLOTS slots and
+ * published asynchronously, with up to #AWS_IOT_JOBS_PIPELINE of them waiting
+ * for their PUBACK, so that reporting the progress of a job does not wait a
+ * round trip per update. An update whose PUBACK does not come is sent again.
+ *
+ * The client uses the default connection of aws_iot_mqtt_interface.h. The
+ * handlers run in the thread yielding on it.
+ *
+ * \code
+ * static bool onDocument(const JobExecution_t *pExecution, const JsonStreamEvent_t *pEvent, void *pContext) {
+ *     if(JSON_STREAM_STRING == pEvent->type && 1 == pEvent->depth && NULL != pEvent->pKey
+ *             && 0 == strncmp(pEvent->pKey, "url", pEvent->keyLength)) {
+ *         ota_set_url(pEvent->pValue);
+ *     }
+ *     return true;
+ * }
+ *
+ * static void onExecution(const JobExecution_t *pExecution, void *pContext) {
+ *     aws_iot_jobs_update(pExecution->jobId, JOB_EXECUTION_IN_PROGRESS, NULL, pExecution->versionNumber);
+ * }
+ * ...
+ * aws_iot_jobs_init(&params);
+ * aws_iot_jobs_start_next();
+ * \endcode
+ */
+
+#ifndef AWS_IOT_JOBS_H_
+#define AWS_IOT_JOBS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+#include "aws_iot_json_stream.h"
+
+/**
+ * @brief Status of a job execution
+ */
+typedef enum {
+	JOB_EXECUTION_QUEUED,
+	JOB_EXECUTION_IN_PROGRESS,
+	JOB_EXECUTION_SUCCEEDED,
+	JOB_EXECUTION_FAILED,
+	JOB_EXECUTION_REJECTED,
+	JOB_EXECUTION_UNKNOWN		///< A status this client does not know, e.g. CANCELED
+} JobExecutionStatus_t;
+
+/**
+ * @brief Execution of a job, as far as it was received
+ */
+typedef struct {
+	char jobId[AWS_IOT_JOBS_MAX_JOB_ID_LEN];	///< Empty until the job id was received
+	JobExecutionStatus_t status;
+	uint32_t versionNumber;		///< Version of the execution, the expected version of an update
+	uint32_t executionNumber;
+} JobExecution_t;
+
+/**
+ * @brief Handler of the elements of a job document
+ *
+ * The event is as the tokenizer gives it, with a depth counted from the job document: the
+ * start and the end of the document itself have depth 0 and no key, its members depth 1.
+ *
+ * @return true to go on, false to drop the execution, its execution handler is then not called
+ */
+typedef bool (*jobsDocumentHandler_t)(const JobExecution_t *pExecution, const JsonStreamEvent_t *pEvent,
+		void *pContext);
+
+/**
+ * @brief Handler of a complete execution, from notify-next or the reply to start-next
+ */
+typedef void (*jobsExecutionHandler_t)(const JobExecution_t *pExecution, void *pContext);
+
+/**
+ * @brief Parameters of the Jobs client
+ */
+typedef struct {
+	const char *pThingName;					///< Name of the thing, it has to stay valid
+	jobsDocumentHandler_t documentHandler;	///< Can be NULL
+	jobsExecutionHandler_t executionHandler;
+	void *pContext;							///< Passed to the handlers
+} JobsParams_t;
+
+/**
+ * @brief Counters of the Jobs client
+ */
+typedef struct {
+	uint32_t executions;		///< Executions given to the execution handler
+	uint32_t dropped;			///< Execution messages that did not parse or that the document handler stopped
+	uint32_t updatesSent;		///< Status updates that got their PUBACK
+	uint32_t updatesResent;		///< Status updates sent again after their PUBACK did not come
+	uint32_t updatesAccepted;
+	uint32_t updatesRejected;
+	uint32_t rejected;			///< Other requests the service rejected
+} JobsStats_t;
+
+/**
+ * @brief Subscribe to the Jobs topics of a thing
+ *
+ * Call after connecting. Calling it again subscribes again, e.g. after a reconnect with a
+ * clean session.
+ *
+ * @param pParams Parameters, copied
+ * @return NONE_ERROR, NULL_VALUE_ERROR, GENERIC_ERROR if the topics of the thing do not fit
+ *         #AWS_IOT_JOBS_TOPIC_LEN, or the error of the subscribe
+ */
+IoT_Error_t aws_iot_jobs_init(const JobsParams_t *pParams);
+
+/**
+ * @brief Ask for the next pending execution
+ *
+ * The reply goes to the handlers like a notify-next, it has no execution if no job is pending.
+ *
+ * @return NONE_ERROR or the error of the publish
+ */
+IoT_Error_t aws_iot_jobs_start_next(void);
+
+/**
+ * @brief Report the status of an execution
+ *
+ * Returns once the update is copied into a slot, it is published without waiting for the
+ * PUBACK. Updates that do not fit the pipeline are published by aws_iot_jobs_drain().
+ *
+ * @param pJobId Job id of the execution
+ * @param status New status
+ * @param pStatusDetails JSON object of name and value strings for the status details, NULL for none
+ * @param expectedVersion Version of the execution the update applies to, 0 for any
+ * @return NONE_ERROR, GENERIC_ERROR if the update does not fit #AWS_IOT_JOBS_UPDATE_LEN, or
+ *         JOBS_UPDATE_QUEUE_FULL if all the slots are taken
+ */
+IoT_Error_t aws_iot_jobs_update(const char *pJobId, JobExecutionStatus_t status, const char *pStatusDetails,
+		uint32_t expectedVersion);
+
+/**
+ * @brief Publish the status updates waiting for a place in the pipeline
+ *
+ * Returns without waiting, call it after the yield while aws_iot_jobs_pending() is not 0.
+ *
+ * @return NONE_ERROR, NETWORK_DISCONNECTED, or the error of a failed publish
+ */
+IoT_Error_t aws_iot_jobs_drain(void);
+
+/**
+ * @brief Number of status updates not acknowledged yet
+ */
+uint32_t aws_iot_jobs_pending(void);
+
+/**
+ * @brief Get the counters of the Jobs client
+ *
+ * @param pStats Counters since aws_iot_jobs_init() or the last reset
+ * @param reset set to true to start counting again from zero
+ * @return NONE_ERROR or NULL_VALUE_ERROR
+ */
+IoT_Error_t aws_iot_jobs_get_stats(JobsStats_t *pStats, bool reset);
+
+#endif /* AWS_IOT_JOBS_H_ */
@@ -0,0 +1,288 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_json_stream.c
+ * @brief Resumable JSON tokenizer fed with chunks of a document
+ *
+ * A state machine over single bytes. All it needs to go on at the next
+ * byte is in JsonStream_t, so a chunk can end anywhere, in the middle of a
+ * string or a number too. The partial key or value is kept in the buffers
+ * of the stream until it is complete.
+ */
+
+#include <string.h>
+
+#include "aws_iot_json_stream.h"
+
+#if AWS_IOT_JSON_STREAM_MAX_DEPTH > 32
+#error "AWS_IOT_JSON_STREAM_MAX_DEPTH has a bit per level in arrayLevels"
+#endif
+
+enum {
+	ST_VALUE,           /* A value, at the top or after ':' or ',' in an array */
+	ST_VALUE_OR_END,    /* After '[' */
+	ST_KEY,             /* After ',' in an object */
+	ST_KEY_OR_END,      /* After '{' */
+	ST_KEY_STRING,
+	ST_COLON,
+	ST_STRING,
+	ST_PRIMITIVE,
+	ST_AFTER_VALUE,
+	ST_DONE,
+	ST_FAILED
+};
+
+static bool isSpace(char c) {
+	return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\0' == c;
+}
+
+static bool isArrayLevel(const JsonStream_t *pStream) {
+	return 0 != (pStream->arrayLevels & (1UL << (pStream->depth - 1)));
+}
+
+static bool emit(JsonStream_t *pStream, JsonStreamEventType_t type, bool isValue) {
+	JsonStreamEvent_t event;
+
+	event.type = type;
+	event.pKey = pStream->hasKey ? pStream->key : NULL;
+	event.keyLength = pStream->hasKey ? pStream->keyLength : 0;
+	event.pValue = NULL;
+	event.valueLength = 0;
+	event.depth = pStream->depth;
+	if (isValue) {
+		pStream->value[pStream->valueLength] = '\0';
+		event.pValue = pStream->value;
+		event.valueLength = pStream->valueLength;
+	}
+	pStream->hasKey = false;
+
+	return pStream->handler(&event, pStream->pContext);
+}
+
+/* The state after a complete value */
+static uint8_t afterValue(const JsonStream_t *pStream) {
+	return (0 == pStream->depth) ? ST_DONE : ST_AFTER_VALUE;
+}
+
+static bool openLevel(JsonStream_t *pStream, bool isArray) {
+	if (AWS_IOT_JSON_STREAM_MAX_DEPTH <= pStream->depth) {
+		return false;
+	}
+	if (!emit(pStream, isArray ? JSON_STREAM_ARRAY_START : JSON_STREAM_OBJECT_START, false)) {
+		return false;
+	}
+	pStream->depth++;
+	if (isArray) {
+		pStream->arrayLevels |= 1UL << (pStream->depth - 1);
+	} else {
+		pStream->arrayLevels &= ~(1UL << (pStream->depth - 1));
+	}
+	pStream->state = isArray ? ST_VALUE_OR_END : ST_KEY_OR_END;
+	return true;
+}
+
+static bool closeLevel(JsonStream_t *pStream, bool isArray) {
+	if (0 == pStream->depth || isArrayLevel(pStream) != isArray) {
+		return false;
+	}
+	pStream->depth--;
+	pStream->hasKey = false;
+	if (!emit(pStream, isArray ? JSON_STREAM_ARRAY_END : JSON_STREAM_OBJECT_END, false)) {
+		return false;
+	}
+	pStream->state = afterValue(pStream);
+	return true;
+}
+
+static bool startValue(JsonStream_t *pStream, char c) {
+	switch (c) {
+	case '{':
+		return openLevel(pStream, false);
+	case '[':
+		return openLevel(pStream, true);
+	case '"':
+		pStream->valueLength = 0;
+		pStream->state = ST_STRING;
+		return true;
+	default:
+		/* As jsmn in strict mode, the rest of a primitive is not checked */
+		if ('-' == c || ('0' <= c && '9' >= c) || 't' == c || 'f' == c || 'n' == c) {
+			pStream->value[0] = c;
+			pStream->valueLength = 1;
+			pStream->state = ST_PRIMITIVE;
+			return true;
+		}
+		return false;
+	}
+}
+
+static bool appendTo(char *pBuf, uint16_t *pLength, uint16_t size, char c) {
+	if (*pLength + 1 >= size) {
+		return false;
+	}
+	pBuf[(*pLength)++] = c;
+	return true;
+}
+
+/* The string ends at a quote that is not escaped */
+static bool isStringEnd(JsonStream_t *pStream, char c) {
+	if (pStream->isEscaped) {
+		pStream->isEscaped = false;
+	} else if ('\\' == c) {
+		pStream->isEscaped = true;
+	} else if ('"' == c) {
+		return true;
+	}
+	return false;
+}
+
+static bool step(JsonStream_t *pStream, char c) {
+	switch (pStream->state) {
+	case ST_VALUE_OR_END:
+		if (']' == c) {
+			return closeLevel(pStream, true);
+		}
+		/* no break */
+	case ST_VALUE:
+		return isSpace(c) || startValue(pStream, c);
+
+	case ST_KEY_OR_END:
+		if ('}' == c) {
+			return closeLevel(pStream, false);
+		}
+		/* no break */
+	case ST_KEY:
+		if (isSpace(c)) {
+			return true;
+		}
+		if ('"' != c) {
+			return false;
+		}
+		pStream->keyLength = 0;
+		pStream->state = ST_KEY_STRING;
+		return true;
+
+	case ST_KEY_STRING:
+		if (isStringEnd(pStream, c)) {
+			pStream->key[pStream->keyLength] = '\0';
+			pStream->state = ST_COLON;
+			return true;
+		}
+		return appendTo(pStream->key, &pStream->keyLength, AWS_IOT_JSON_STREAM_MAX_KEY_LEN, c);
+
+	case ST_COLON:
+		if (isSpace(c)) {
+			return true;
+		}
+		if (':' != c) {
+			return false;
+		}
+		pStream->hasKey = true;
+		pStream->state = ST_VALUE;
+		return true;
+
+	case ST_STRING:
+		if (isStringEnd(pStream, c)) {
+			pStream->state = afterValue(pStream);
+			return emit(pStream, JSON_STREAM_STRING, true);
+		}
+		return appendTo(pStream->value, &pStream->valueLength, AWS_IOT_JSON_STREAM_MAX_VALUE_LEN, c);
+
+	case ST_PRIMITIVE:
+		if (!isSpace(c) && ',' != c && ']' != c && '}' != c) {
+			return appendTo(pStream->value, &pStream->valueLength, AWS_IOT_JSON_STREAM_MAX_VALUE_LEN, c);
+		}
+		pStream->state = afterValue(pStream);
+		if (!emit(pStream, JSON_STREAM_PRIMITIVE, true)) {
+			return false;
+		}
+		/* The byte ending the primitive belongs to what follows it */
+		return step(pStream, c);
+
+	case ST_AFTER_VALUE:
+		if (isSpace(c)) {
+			return true;
+		}
+		if (',' == c) {
+			pStream->state = isArrayLevel(pStream) ? ST_VALUE : ST_KEY;
+			return true;
+		}
+		if ('}' == c || ']' == c) {
+			return closeLevel(pStream, ']' == c);
+		}
+		return false;
+
+	case ST_DONE:
+		return isSpace(c);
+
+	default:
+		return false;
+	}
+}
+
+void aws_iot_json_stream_init(JsonStream_t *pStream, jsonStreamHandler_t handler, void *pContext) {
+	pStream->handler = handler;
+	pStream->pContext = pContext;
+	aws_iot_json_stream_reset(pStream);
+}
+
+void aws_iot_json_stream_reset(JsonStream_t *pStream) {
+	pStream->state = ST_VALUE;
+	pStream->depth = 0;
+	pStream->arrayLevels = 0;
+	pStream->isEscaped = false;
+	pStream->hasKey = false;
+	pStream->keyLength = 0;
+	pStream->valueLength = 0;
+}
+
+IoT_Error_t aws_iot_json_stream_feed(JsonStream_t *pStream, const char *pChunk, uint32_t length) {
+	uint32_t i;
+
+	if (NULL == pStream || NULL == pStream->handler || (NULL == pChunk && 0 != length)) {
+		return NULL_VALUE_ERROR;
+	}
+
+	for (i = 0; i < length; i++) {
+		if (!step(pStream, pChunk[i])) {
+			pStream->state = ST_FAILED;
+			return JSON_PARSE_ERROR;
+		}
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_json_stream_finish(JsonStream_t *pStream) {
+	if (NULL == pStream || NULL == pStream->handler) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (ST_PRIMITIVE == pStream->state && 0 == pStream->depth) {
+		pStream->state = ST_DONE;
+		if (!emit(pStream, JSON_STREAM_PRIMITIVE, true)) {
+			pStream->state = ST_FAILED;
+		}
+	}
+	return (ST_DONE == pStream->state) ? NONE_ERROR : JSON_PARSE_ERROR;
+}
+
+IoT_Error_t aws_iot_json_stream_feed_message(JsonStream_t *pStream, const MQTTCallbackParams *pParams) {
+	IoT_Error_t rc;
+
+	if (NULL == pStream || NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (0 == pParams->PayloadOffset) {
+		aws_iot_json_stream_reset(pStream);
+	}
+	rc = aws_iot_json_stream_feed(pStream, (const char *) pParams->MessageParams.pPayload,
+				      pParams->MessageParams.PayloadLen);
+	if (NONE_ERROR == rc && pParams->isLastChunk) {
+		rc = aws_iot_json_stream_finish(pStream);
+	}
+	return rc;
+}
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_json_stream.h
+ * @brief Resumable JSON tokenizer fed with chunks of a document
+ *
+ * jsmn_parse() needs the whole document in one buffer and a token per
+ * element. This tokenizer is fed the document in as many pieces as it
+ * arrives in, for instance the chunks a streaming subscription hands to its
+ * handler, and calls a handler for every element as soon as it is complete.
+ * It keeps only the current key and value and a bit per nesting level, so
+ * neither the document nor a token array is ever held in RAM.
+ *
+ * Strings are given as in the document, without the quotes and with their
+ * escapes not decoded, as jsmn does. A key longer than
+ * #AWS_IOT_JSON_STREAM_MAX_KEY_LEN - 1 or a string or primitive longer than
+ * #AWS_IOT_JSON_STREAM_MAX_VALUE_LEN - 1 bytes, or nesting deeper than
+ * #AWS_IOT_JSON_STREAM_MAX_DEPTH levels, fails the document.
+ *
+ * From a streaming message handler:
+ * \code
+ * static JsonStream_t stream;
+ *
+ * static int32_t handler(MQTTCallbackParams params) {
+ *     aws_iot_json_stream_feed_message(&stream, &params);
+ *     return 0;
+ * }
+ * ...
+ * aws_iot_json_stream_init(&stream, onElement, NULL);
+ * \endcode
+ */
+
+#ifndef AWS_IOT_JSON_STREAM_H_
+#define AWS_IOT_JSON_STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_error.h"
+#include "aws_iot_mqtt_interface.h"
+
+/**
+ * @brief Kind of a complete element
+ */
+typedef enum {
+	JSON_STREAM_OBJECT_START,	///< '{', the key is the one of the object
+	JSON_STREAM_OBJECT_END,		///< '}'
+	JSON_STREAM_ARRAY_START,	///< '[', the key is the one of the array
+	JSON_STREAM_ARRAY_END,		///< ']'
+	JSON_STREAM_STRING,			///< A string value
+	JSON_STREAM_PRIMITIVE		///< A number, true, false or null
+} JsonStreamEventType_t;
+
+/**
+ * @brief Element given to the handler, valid during the call only
+ */
+typedef struct {
+	JsonStreamEventType_t type;
+	const char *pKey;		///< Key of the element in its object, NULL in an array, at the top and for the ends
+	uint32_t keyLength;
+	const char *pValue;		///< NUL terminated value of a string or primitive, NULL otherwise
+	uint32_t valueLength;
+	uint8_t depth;			///< Objects and arrays the element is in, an end has the depth of its start
+} JsonStreamEvent_t;
+
+/**
+ * @brief Handler of the elements, called in document order
+ *
+ * @return true to go on, false to stop the document, the feed then fails with JSON_PARSE_ERROR
+ */
+typedef bool (*jsonStreamHandler_t)(const JsonStreamEvent_t *pEvent, void *pContext);
+
+/**
+ * @brief State of a tokenizer, owned by the caller
+ */
+typedef struct {
+	jsonStreamHandler_t handler;
+	void *pContext;
+	uint8_t state;
+	uint8_t depth;
+	uint32_t arrayLevels;	///< Bit n set when level n + 1 is an array
+	bool isEscaped;
+	bool hasKey;
+	uint16_t keyLength;
+	uint16_t valueLength;
+	char key[AWS_IOT_JSON_STREAM_MAX_KEY_LEN];
+	char value[AWS_IOT_JSON_STREAM_MAX_VALUE_LEN];
+} JsonStream_t;
+
+/**
+ * @brief Prepare a tokenizer for a new document
+ *
+ * @param pStream Tokenizer
+ * @param handler Called for every element
+ * @param pContext Passed to the handler
+ */
+void aws_iot_json_stream_init(JsonStream_t *pStream, jsonStreamHandler_t handler, void *pContext);
+
+/**
+ * @brief Start the next document with the same handler
+ *
+ * @param pStream Tokenizer
+ */
+void aws_iot_json_stream_reset(JsonStream_t *pStream);
+
+/**
+ * @brief Tokenize the next piece of the document
+ *
+ * Once a feed failed the document is dropped, the following feeds fail until the tokenizer is reset.
+ *
+ * @param pStream Tokenizer
+ * @param pChunk Next bytes of the document
+ * @param length Number of bytes
+ * @return NONE_ERROR, JSON_PARSE_ERROR if the document is not valid, does not fit the limits or the handler stopped it
+ */
+IoT_Error_t aws_iot_json_stream_feed(JsonStream_t *pStream, const char *pChunk, uint32_t length);
+
+/**
+ * @brief End of the document
+ *
+ * Gives a primitive still open at the top, such as a document that is only a number.
+ *
+ * @param pStream Tokenizer
+ * @return NONE_ERROR if a complete document was fed, JSON_PARSE_ERROR otherwise
+ */
+IoT_Error_t aws_iot_json_stream_finish(JsonStream_t *pStream);
+
+/**
+ * @brief Feed the chunk of a message received on a streaming subscription
+ *
+ * Resets the tokenizer at the first chunk of a message and finishes the document with its last one, so that a message dropped
+ * half way does not spoil the next one. A trailing NUL, as the shadow puts after its documents, is ignored.
+ *
+ * @param pStream Tokenizer
+ * @param pParams Parameters the message handler was given
+ * @return As aws_iot_json_stream_feed(), and aws_iot_json_stream_finish() for the last chunk
+ */
+IoT_Error_t aws_iot_json_stream_feed_message(JsonStream_t *pStream, const MQTTCallbackParams *pParams);
+
+#endif /* AWS_IOT_JSON_STREAM_H_ */
@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
+#include <fast_float.h>
 #include "aws_iot_log.h"
 
 int8_t jsoneq(const char *json, jsmntok_t *tok, const char *s) {
@@ -131,7 +132,7 @@ IoT_Error_t parseFloatValue(float *f, const char *jsonString, jsmntok_t *token)
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%f", f)) {
+	if (token->end - token->start != fast_strtof(jsonString + token->start, token->end - token->start, f)) {
 		WARN("Token was not a float.");
 		return JSON_PARSE_ERROR;
 	}
@@ -145,7 +146,7 @@ IoT_Error_t parseDoubleValue(double *d, const char *jsonString, jsmntok_t *token
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%lf", d)) {
+	if (token->end - token->start != fast_strtod(jsonString + token->start, token->end - token->start, d)) {
 		WARN("Token was not a double.");
 		return JSON_PARSE_ERROR;
 	}
@@ -0,0 +1,213 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_log_deferred.c
+ * @brief Deferred console output through the stdio hooks of wmstdio
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log_deferred.h"
+
+#if AWS_IOT_LOG_DEFERRED_DMA
+#include <lowlevel_drivers.h>
+#include <dma_svc.h>
+#endif
+
+static stdio_funcs_t *console_funcs;
+static stdio_funcs_t deferred_funcs;
+static os_ringbuf_t log_ring;
+static uint8_t log_ring_buffer[AWS_IOT_LOG_DEFERRED_BUF_LEN];
+static volatile uint32_t dropped;
+static os_thread_t log_thread;
+static os_thread_stack_define(log_stack, 512);
+
+#if AWS_IOT_LOG_DEFERRED_DMA
+static uart_reg_t *const console_uarts[] = {UART0, UART1, UART2};
+static const DMA_PerMapping_Type console_tx_per[] = {
+	DMA_PER15_UART0_TX, DMA_PER17_UART1_TX, DMA_PER43_UART2_TX
+};
+static bool dma_ready;
+static os_semaphore_t dma_done;
+static dma_svc_desc_t dma_desc;
+static dma_svc_req_t dma_req;
+#endif
+
+static int deferred_direct(void) {
+	return is_isr_context() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING
+	       || xTaskGetCurrentTaskHandle() == log_thread;
+}
+
+/* Several tasks print, the ring buffer takes a single producer so the copy
+ * is serialized. It is at most MAX_MSG_LEN bytes */
+static int deferred_write(const char *str, uint32_t len) {
+	unsigned long state;
+	int written = 0;
+
+	state = os_enter_critical_section();
+	if (os_ringbuf_space(&log_ring) >= len) {
+		os_ringbuf_write(&log_ring, str, len);
+		written = len;
+	} else {
+		dropped++;
+	}
+	os_exit_critical_section(state);
+
+	return written;
+}
+
+static int deferred_printf(char *str) {
+	if (deferred_direct()) {
+		return console_funcs->sf_printf(str);
+	}
+	return deferred_write(str, strlen(str));
+}
+
+static int deferred_putchar(char *ch) {
+	if (deferred_direct()) {
+		return console_funcs->sf_putchar(ch);
+	}
+	return deferred_write(ch, 1);
+}
+
+/* Flushing waits until the task has written everything out */
+static int deferred_flush() {
+	while (!deferred_direct() && os_ringbuf_count(&log_ring)) {
+		os_thread_sleep(1);
+	}
+	return console_funcs->sf_flush();
+}
+
+#if AWS_IOT_LOG_DEFERRED_DMA
+static void deferred_dma_done(int result, void *arg) {
+	os_semaphore_put(&dma_done);
+}
+
+static int deferred_dma_init(void) {
+	int port;
+
+	if (WM_SUCCESS != wmstdio_getconsole_port(&port) || 0 > port
+			|| sizeof(console_uarts) / sizeof(console_uarts[0]) <= (unsigned) port) {
+		return -WM_FAIL;
+	}
+	if (WM_SUCCESS != os_semaphore_create(&dma_done, "console-dma")) {
+		return -WM_FAIL;
+	}
+	/* It is created given */
+	os_semaphore_get(&dma_done, OS_NO_WAIT);
+	if (WM_SUCCESS != dma_svc_init(1)) {
+		os_semaphore_delete(&dma_done);
+		return -WM_FAIL;
+	}
+
+	memset(&dma_desc, 0, sizeof(dma_desc));
+	dma_desc.dmac.dma_cfg.destDmaAddr = (uint32_t) &console_uarts[port]->RBR_THR_DLL.WORDVAL;
+	dma_desc.dmac.dma_cfg.transfType = DMA_MEM_TO_PER;
+	dma_desc.dmac.dma_cfg.burstLength = DMA_ITEM_1;
+	dma_desc.dmac.dma_cfg.srcAddrInc = DMA_ADDR_INC;
+	dma_desc.dmac.dma_cfg.destAddrInc = DMA_ADDR_NOCHANGE;
+	dma_desc.dmac.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_8;
+	dma_desc.dmac.perDmaInter = console_tx_per[port];
+	dma_req.desc = &dma_desc;
+	dma_req.cb = deferred_dma_done;
+	UART_DmaCmd((UART_ID_Type) port, ENABLE);
+	return WM_SUCCESS;
+}
+
+/* Sends the oldest contiguous part of the ring buffer from where it is and
+ * frees it once it is out. A transfer that takes three times what 115200
+ * baud allows, e.g. as the UART does not ask for the data, gives the buffer
+ * back to the character writes */
+static void deferred_dma_write(void) {
+	uint32_t tail = log_ring.tail;
+	uint32_t off = tail & (log_ring.num_elems - 1);
+	uint32_t len = os_ringbuf_count(&log_ring);
+
+	if (len > log_ring.num_elems - off) {
+		len = log_ring.num_elems - off;
+	}
+	if (len > DMA_SVC_MAX_BLOCK) {
+		len = DMA_SVC_MAX_BLOCK;
+	}
+	/* Do not hand out the data before the head that covers it */
+	__DMB();
+
+	dma_desc.dmac.dma_cfg.srcDmaAddr = (uint32_t) (log_ring.buffer + off);
+	dma_desc.dmac.dma_cfg.transfLength = len;
+	dma_desc.next = NULL;
+	if (WM_SUCCESS != dma_svc_submit(&dma_req)) {
+		dma_ready = false;
+		return;
+	}
+	/* About 87 us a character at 115200 baud */
+	if (WM_SUCCESS != os_semaphore_get(&dma_done, os_msec_to_ticks(len / 4 + 100))) {
+		dma_svc_abort(&dma_req);
+		dma_ready = false;
+		return;
+	}
+
+	/* The DMA is done reading before the producers may write there */
+	__DMB();
+	log_ring.tail = tail + len;
+}
+#endif
+
+static void log_main(os_thread_arg_t arg) {
+	char buf[MAX_MSG_LEN + 1];
+	uint32_t len, reported = 0;
+
+	while (1) {
+		os_ringbuf_wait(&log_ring, OS_WAIT_FOREVER);
+#if AWS_IOT_LOG_DEFERRED_DMA
+		while (dma_ready && os_ringbuf_count(&log_ring)) {
+			deferred_dma_write();
+		}
+#endif
+		while (0 != (len = os_ringbuf_read(&log_ring, buf, MAX_MSG_LEN))) {
+			buf[len] = '\0';
+			console_funcs->sf_printf(buf);
+		}
+		if (reported != dropped) {
+			reported = dropped;
+			snprintf(buf, sizeof(buf), "\r\n[%u console lines dropped]\r\n",
+				 (unsigned) reported);
+			console_funcs->sf_printf(buf);
+		}
+	}
+}
+
+int aws_iot_log_deferred_start(void) {
+	if (NULL != console_funcs) {
+		return WM_SUCCESS;
+	}
+
+	os_ringbuf_init(&log_ring, log_ring_buffer, 1, sizeof(log_ring_buffer));
+	if (WM_SUCCESS != os_thread_create(&log_thread, "console", log_main, NULL,
+					   &log_stack, AWS_IOT_LOG_DEFERRED_PRIO)) {
+		return -WM_FAIL;
+	}
+#if AWS_IOT_LOG_DEFERRED_DMA
+	dma_ready = (WM_SUCCESS == deferred_dma_init());
+#endif
+
+	deferred_funcs = *c_stdio_funcs;
+	deferred_funcs.sf_printf = deferred_printf;
+	deferred_funcs.sf_putchar = deferred_putchar;
+	deferred_funcs.sf_flush = deferred_flush;
+	console_funcs = c_stdio_funcs;
+	c_stdio_funcs = &deferred_funcs;
+
+	return WM_SUCCESS;
+}
+
+uint32_t aws_iot_log_deferred_dropped(void) {
+	return dropped;
+}
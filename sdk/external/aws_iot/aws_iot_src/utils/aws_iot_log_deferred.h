@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_log_deferred.h
+ * @brief Deferred console output
+ *
+ * Every wmprintf() caller normally waits for its line to go out on the
+ * console UART, about 9 ms for 100 characters at 115200 baud. Once
+ * aws_iot_log_deferred_start() was called the output of wmprintf(), and
+ * so of the logging macros and wmlog(), is copied into a ring buffer and
+ * written to the UART by a low priority task. The caller only formats the
+ * line and copies it.
+ *
+ * Lines are formatted by the caller, not by the task, as arguments such
+ * as strings often live on the caller's stack. When the ring buffer is
+ * full the line is dropped and counted, its caller is never blocked.
+ * Output from interrupts and before the scheduler runs stays synchronous.
+ *
+ * With #AWS_IOT_LOG_DEFERRED_DMA the task does not write the UART itself:
+ * it hands the pending part of the ring buffer to the DMA, paced by the
+ * transmit requests of the UART, and sleeps until it is out. The task then
+ * costs no CPU time while the console drains. The console UART has its DMA
+ * requests enabled for that, the driver keeps handling its input.
+ */
+
+#ifndef AWS_IOT_LOG_DEFERRED_H_
+#define AWS_IOT_LOG_DEFERRED_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Route the console output through the deferred output task
+ *
+ * Has to be called after wmstdio_init().
+ *
+ * @return WM_SUCCESS, or -WM_FAIL if the task could not be created. Without
+ *         a DMA channel the task writes the UART itself
+ */
+int aws_iot_log_deferred_start(void);
+
+/**
+ * @brief Number of console lines dropped because the ring buffer was full
+ */
+uint32_t aws_iot_log_deferred_dropped(void);
+
+#endif /* AWS_IOT_LOG_DEFERRED_H_ */
@@ -0,0 +1,546 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_mqtt_gateway.c
+ * @brief Local MQTT broker forwarding to AWS IoT
+ *
+ * One task runs select() over the listening socket and the clients. A client
+ * buffers what it receives until a whole packet is there, the packet is then
+ * handled in place with the server side functions of MQTTPacket. The lock
+ * covers the clients, their subscriptions and their sockets' writes, as
+ * aws_iot_mqtt_gateway_deliver() writes from other tasks.
+ *
+ * Forwarded messages are staged one after the other, topic with its prefix,
+ * NUL and payload, until the batch is flushed to the service queue.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <lwip/sockets.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_service.h"
+#include "aws_iot_mqtt_gateway.h"
+#include "MQTTPacket.h"
+
+const MQTTGatewayParams MQTTGatewayParamsDefault = {1883, NULL, NULL};
+
+typedef struct {
+	int sock;
+	bool connected;
+	/* Closed when nothing came for 1.5 times the keep alive */
+	uint32_t keepAliveMs;
+	uint32_t lastMs;
+	uint32_t rxLen;
+	unsigned char rx[AWS_IOT_MQTT_GATEWAY_RX_BUF_LEN];
+	char filters[AWS_IOT_MQTT_GATEWAY_MAX_SUBS][AWS_IOT_MQTT_GATEWAY_MAX_FILTER_LEN];
+} gw_client_t;
+
+/* A forwarded message in the stage, followed by its topic, NUL and payload */
+typedef struct {
+	uint16_t len;
+	uint8_t topicLen;
+	uint8_t qos;
+} gw_staged_t;
+
+static struct {
+	os_thread_t thread;
+	os_mutex_t lock;
+	int listenSock;
+	MQTTGatewayParams params;
+	gw_client_t clients[AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS];
+	MQTTGatewayStats stats;
+	uint32_t stageLen;
+	uint32_t staged;
+	uint32_t stageMs;
+} gw = {.listenSock = -1};
+
+static uint8_t gw_stage[AWS_IOT_MQTT_GATEWAY_STAGE_LEN] __attribute__((aligned(4)));
+static os_thread_stack_define(gw_stack, AWS_IOT_MQTT_GATEWAY_STACK_SIZE);
+
+static uint32_t gw_now(void) {
+	return os_ticks_to_msec(os_ticks_get());
+}
+
+/* Does the topic match the filter, with its + and # wildcards */
+static bool gw_topic_match(const char *pFilter, const char *pTopic, size_t topicLen) {
+	const char *pEnd = pTopic + topicLen;
+
+	while (*pFilter) {
+		if ('#' == *pFilter) {
+			return true;
+		}
+		if ('+' == *pFilter) {
+			while (pTopic < pEnd && '/' != *pTopic) {
+				pTopic++;
+			}
+			pFilter++;
+			continue;
+		}
+		if (pTopic == pEnd) {
+			/* "a/#" matches "a" too */
+			return 0 == strcmp(pFilter, "/#");
+		}
+		if (*pFilter != *pTopic) {
+			return false;
+		}
+		pFilter++;
+		pTopic++;
+	}
+	return pTopic == pEnd;
+}
+
+static void gw_close(gw_client_t *pClient) {
+	close(pClient->sock);
+	pClient->sock = -1;
+	pClient->connected = false;
+}
+
+static bool gw_send(gw_client_t *pClient, const void *pBuf, uint32_t len, int flags) {
+	if (len != (uint32_t) send(pClient->sock, pBuf, len, flags)) {
+		WARN("Gateway client too slow, disconnected");
+		gw_close(pClient);
+		return false;
+	}
+	return true;
+}
+
+/* Sends a message to the subscribed clients, at QoS0, with the lock held */
+static void gw_deliver(const char *pTopic, size_t topicLen, const void *pPayload, uint32_t payloadLen) {
+	unsigned char header[8];
+	MQTTString topic = MQTTString_initializer;
+	gw_client_t *pClient;
+	uint32_t len;
+	int i, j;
+
+	topic.lenstring.data = (char *) pTopic;
+	topic.lenstring.len = topicLen;
+	if (MQTT_SUCCESS != MQTTSerialize_publishHeader(header, sizeof(header), 0, QOS0, 0, 0,
+							topic, payloadLen, &len)) {
+		return;
+	}
+
+	for (i = 0; i < AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS; i++) {
+		pClient = &gw.clients[i];
+		if (!pClient->connected) {
+			continue;
+		}
+		for (j = 0; j < AWS_IOT_MQTT_GATEWAY_MAX_SUBS; j++) {
+			if (pClient->filters[j][0] && gw_topic_match(pClient->filters[j], pTopic, topicLen)) {
+				break;
+			}
+		}
+		if (AWS_IOT_MQTT_GATEWAY_MAX_SUBS == j) {
+			continue;
+		}
+		/* The header before the topic, which the payload follows */
+		if (gw_send(pClient, header, len, MSG_MORE) &&
+		    gw_send(pClient, pTopic, topicLen, payloadLen ? MSG_MORE : 0) &&
+		    (0 == payloadLen || gw_send(pClient, pPayload, payloadLen, 0))) {
+			gw.stats.delivered++;
+		}
+	}
+}
+
+/* Queues the staged messages to the service task */
+static void gw_flush(void) {
+	gw_staged_t *pMsg;
+	uint32_t off = 0;
+	IoT_Error_t rc;
+
+	while (off < gw.stageLen) {
+		pMsg = (gw_staged_t *) &gw_stage[off];
+		rc = aws_iot_mqtt_service_publish((const char *) (pMsg + 1), (const char *) (pMsg + 1) + pMsg->topicLen + 1,
+						  pMsg->len - pMsg->topicLen - 1, (QoSLevel) pMsg->qos,
+						  MQTT_SERVICE_PRIO_BULK, NULL, NULL);
+		if (NONE_ERROR == rc) {
+			gw.stats.forwarded++;
+		} else {
+			gw.stats.dropped++;
+		}
+		off += (sizeof(*pMsg) + pMsg->len + 3) & ~3;
+	}
+	if (gw.staged) {
+		gw.stats.flushes++;
+	}
+	gw.stageLen = 0;
+	gw.staged = 0;
+}
+
+static void gw_forward(MQTTString *pTopic, const void *pPayload, uint32_t payloadLen, QoS qos) {
+	const char *pPrefix = gw.params.pUpstreamPrefix ? gw.params.pUpstreamPrefix : "";
+	size_t prefixLen = strlen(pPrefix);
+	size_t topicLen = prefixLen + pTopic->lenstring.len;
+	uint32_t len = topicLen + 1 + payloadLen;
+	uint32_t size = (sizeof(gw_staged_t) + len + 3) & ~3;
+	gw_staged_t *pMsg;
+	char *pData;
+
+	if (gw.params.pLocalPrefix && pTopic->lenstring.len >= strlen(gw.params.pLocalPrefix) &&
+	    0 == memcmp(pTopic->lenstring.data, gw.params.pLocalPrefix, strlen(gw.params.pLocalPrefix))) {
+		return;
+	}
+	if (topicLen > 255 || len >= AWS_IOT_MQTT_SERVICE_MAX_MSG_LEN || size > sizeof(gw_stage)) {
+		gw.stats.dropped++;
+		return;
+	}
+	if (gw.stageLen + size > sizeof(gw_stage)) {
+		gw_flush();
+	}
+
+	pMsg = (gw_staged_t *) &gw_stage[gw.stageLen];
+	pMsg->len = len;
+	pMsg->topicLen = topicLen;
+	pMsg->qos = (QOS0 == qos) ? QOS_0 : QOS_1;
+	pData = (char *) (pMsg + 1);
+	memcpy(pData, pPrefix, prefixLen);
+	memcpy(pData + prefixLen, pTopic->lenstring.data, pTopic->lenstring.len);
+	pData[topicLen] = '\0';
+	memcpy(pData + topicLen + 1, pPayload, payloadLen);
+	if (0 == gw.staged++) {
+		gw.stageMs = gw_now();
+	}
+	gw.stageLen += size;
+
+	if (AWS_IOT_MQTT_GATEWAY_BATCH <= gw.staged) {
+		gw_flush();
+	}
+}
+
+static bool gw_connect(gw_client_t *pClient, unsigned char *pBuf, uint32_t len) {
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	MQTTConnackReturnCodes code = CONNACK_CONNECTION_ACCEPTED;
+	unsigned char ack[4];
+	uint32_t ackLen;
+	MQTTReturnCode rc;
+
+	rc = MQTTDeserialize_connect(&data, pBuf, len);
+	if (MQTT_CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR == rc) {
+		code = CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR;
+	} else if (MQTT_SUCCESS != rc) {
+		return false;
+	}
+
+	MQTTSerialize_connack(ack, sizeof(ack), code, 0, &ackLen);
+	if (!gw_send(pClient, ack, ackLen, 0) || CONNACK_CONNECTION_ACCEPTED != code) {
+		return false;
+	}
+	pClient->connected = true;
+	pClient->keepAliveMs = data.keepAliveInterval * 1500;
+	memset(pClient->filters, 0, sizeof(pClient->filters));
+	gw.stats.connects++;
+	return true;
+}
+
+static bool gw_publish(gw_client_t *pClient, unsigned char *pBuf, uint32_t len) {
+	MQTTString topic = MQTTString_initializer;
+	unsigned char dup, retained, ack[4];
+	unsigned char *pPayload;
+	uint32_t payloadLen, ackLen;
+	uint16_t packetId = 0;
+	QoS qos;
+
+	if (MQTT_SUCCESS != MQTTDeserialize_publish(&dup, &qos, &retained, &packetId, &topic,
+						    &pPayload, &payloadLen, pBuf, len) ||
+	    QOS2 == qos || 0 == topic.lenstring.len) {
+		return false;
+	}
+	gw.stats.published++;
+
+	gw_forward(&topic, pPayload, payloadLen, qos);
+	gw_deliver(topic.lenstring.data, topic.lenstring.len, pPayload, payloadLen);
+	if (QOS1 == qos && pClient->connected) {
+		MQTTSerialize_puback(ack, sizeof(ack), packetId, &ackLen);
+		return gw_send(pClient, ack, ackLen, 0);
+	}
+	return pClient->connected;
+}
+
+static bool gw_subscribe(gw_client_t *pClient, unsigned char *pBuf, uint32_t len) {
+	MQTTString filters[AWS_IOT_MQTT_GATEWAY_MAX_SUBS];
+	QoS qos[AWS_IOT_MQTT_GATEWAY_MAX_SUBS];
+	unsigned char granted[AWS_IOT_MQTT_GATEWAY_MAX_SUBS];
+	unsigned char ack[8 + AWS_IOT_MQTT_GATEWAY_MAX_SUBS];
+	unsigned char dup;
+	uint32_t count, ackLen, i, j, slot;
+	uint16_t packetId;
+
+	if (MQTT_SUCCESS != MQTTDeserialize_subscribe(&dup, &packetId, AWS_IOT_MQTT_GATEWAY_MAX_SUBS, &count,
+						      filters, qos, pBuf, len)) {
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		/* Failure, unless the filter fits and there is room for it */
+		granted[i] = 0x80;
+		if (filters[i].lenstring.len >= AWS_IOT_MQTT_GATEWAY_MAX_FILTER_LEN) {
+			continue;
+		}
+		slot = AWS_IOT_MQTT_GATEWAY_MAX_SUBS;
+		for (j = 0; j < AWS_IOT_MQTT_GATEWAY_MAX_SUBS; j++) {
+			if (0 == strncmp(pClient->filters[j], filters[i].lenstring.data, filters[i].lenstring.len) &&
+			    '\0' == pClient->filters[j][filters[i].lenstring.len]) {
+				break;
+			}
+			if (AWS_IOT_MQTT_GATEWAY_MAX_SUBS == slot && !pClient->filters[j][0]) {
+				slot = j;
+			}
+		}
+		if (AWS_IOT_MQTT_GATEWAY_MAX_SUBS == j) {
+			if (AWS_IOT_MQTT_GATEWAY_MAX_SUBS == slot) {
+				continue;
+			}
+			memcpy(pClient->filters[slot], filters[i].lenstring.data, filters[i].lenstring.len);
+			pClient->filters[slot][filters[i].lenstring.len] = '\0';
+		}
+		/* Messages are only delivered at QoS0 */
+		granted[i] = QOS0;
+	}
+
+	MQTTSerialize_suback(ack, sizeof(ack), packetId, count, granted, &ackLen);
+	return gw_send(pClient, ack, ackLen, 0);
+}
+
+static bool gw_unsubscribe(gw_client_t *pClient, unsigned char *pBuf, uint32_t len) {
+	MQTTString filters[AWS_IOT_MQTT_GATEWAY_MAX_SUBS];
+	unsigned char dup, ack[4];
+	uint32_t count, ackLen, i, j;
+	uint16_t packetId;
+
+	if (MQTT_SUCCESS != MQTTDeserialize_unsubscribe(&dup, &packetId, AWS_IOT_MQTT_GATEWAY_MAX_SUBS, &count,
+							filters, pBuf, len)) {
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < AWS_IOT_MQTT_GATEWAY_MAX_SUBS; j++) {
+			if (0 == strncmp(pClient->filters[j], filters[i].lenstring.data, filters[i].lenstring.len) &&
+			    '\0' == pClient->filters[j][filters[i].lenstring.len]) {
+				pClient->filters[j][0] = '\0';
+			}
+		}
+	}
+
+	MQTTSerialize_unsuback(ack, sizeof(ack), packetId, &ackLen);
+	return gw_send(pClient, ack, ackLen, 0);
+}
+
+/* Handles a whole packet, returns false when the client is to be closed */
+static bool gw_packet(gw_client_t *pClient, unsigned char *pBuf, uint32_t len) {
+	MQTTHeader header = {0};
+	unsigned char ack[4];
+	uint32_t ackLen;
+
+	header.byte = pBuf[0];
+	if (!pClient->connected) {
+		/* The first packet has to be the CONNECT */
+		return CONNECT == header.bits.type && gw_connect(pClient, pBuf, len);
+	}
+
+	switch (header.bits.type) {
+	case PUBLISH:
+		return gw_publish(pClient, pBuf, len);
+	case SUBSCRIBE:
+		return gw_subscribe(pClient, pBuf, len);
+	case UNSUBSCRIBE:
+		return gw_unsubscribe(pClient, pBuf, len);
+	case PINGREQ:
+		MQTTSerialize_pingresp(ack, sizeof(ack), &ackLen);
+		return gw_send(pClient, ack, ackLen, 0);
+	default:
+		/* DISCONNECT, or what a client does not send */
+		return false;
+	}
+}
+
+/* Length of the packet at the start of the buffer, 0 if not all there yet */
+static int32_t gw_packet_len(const unsigned char *pBuf, uint32_t len) {
+	uint32_t remLen = 0, i;
+
+	for (i = 1; i < len && i <= 4; i++) {
+		remLen |= (uint32_t) (pBuf[i] & 0x7f) << (7 * (i - 1));
+		if (!(pBuf[i] & 0x80)) {
+			return (i + 1 + remLen <= len) ? (int32_t) (i + 1 + remLen) : 0;
+		}
+	}
+	return (i > 4) ? -1 : 0;
+}
+
+static void gw_receive(gw_client_t *pClient) {
+	int32_t n, packetLen;
+
+	n = recv(pClient->sock, pClient->rx + pClient->rxLen, sizeof(pClient->rx) - pClient->rxLen, 0);
+	if (n <= 0) {
+		gw_close(pClient);
+		return;
+	}
+	pClient->rxLen += n;
+	pClient->lastMs = gw_now();
+
+	while (pClient->sock >= 0 && 0 != (packetLen = gw_packet_len(pClient->rx, pClient->rxLen))) {
+		if (packetLen < 0 || !gw_packet(pClient, pClient->rx, packetLen)) {
+			if (pClient->sock >= 0) {
+				gw_close(pClient);
+			}
+			return;
+		}
+		pClient->rxLen -= packetLen;
+		memmove(pClient->rx, pClient->rx + packetLen, pClient->rxLen);
+	}
+	if (pClient->sock >= 0 && pClient->rxLen == sizeof(pClient->rx)) {
+		WARN("Gateway client packet larger than AWS_IOT_MQTT_GATEWAY_RX_BUF_LEN");
+		gw_close(pClient);
+	}
+}
+
+static void gw_accept(void) {
+	struct timeval timeout = {AWS_IOT_MQTT_GATEWAY_SEND_TIMEOUT_MS / 1000,
+				  (AWS_IOT_MQTT_GATEWAY_SEND_TIMEOUT_MS % 1000) * 1000};
+	gw_client_t *pClient;
+	int sock, i, one = 1;
+
+	sock = accept(gw.listenSock, NULL, NULL);
+	if (sock < 0) {
+		return;
+	}
+	for (i = 0; i < AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS; i++) {
+		if (gw.clients[i].sock < 0) {
+			break;
+		}
+	}
+	if (AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS == i) {
+		close(sock);
+		return;
+	}
+
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	pClient = &gw.clients[i];
+	pClient->sock = sock;
+	pClient->connected = false;
+	/* Until the CONNECT says otherwise */
+	pClient->keepAliveMs = 10000;
+	pClient->lastMs = gw_now();
+	pClient->rxLen = 0;
+}
+
+static void gw_main(os_thread_arg_t arg) {
+	struct timeval timeout;
+	gw_client_t *pClient;
+	fd_set rfds;
+	int i, maxFd;
+
+	while (1) {
+		FD_ZERO(&rfds);
+		FD_SET(gw.listenSock, &rfds);
+		maxFd = gw.listenSock;
+		for (i = 0; i < AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS; i++) {
+			if (gw.clients[i].sock >= 0) {
+				FD_SET(gw.clients[i].sock, &rfds);
+				if (gw.clients[i].sock > maxFd) {
+					maxFd = gw.clients[i].sock;
+				}
+			}
+		}
+
+		timeout.tv_sec = 0;
+		timeout.tv_usec = (gw.staged ? AWS_IOT_MQTT_GATEWAY_FLUSH_MS / 4 : 500) * 1000;
+		if (select(maxFd + 1, &rfds, NULL, NULL, &timeout) < 0) {
+			os_thread_sleep(os_msec_to_ticks(100));
+			continue;
+		}
+
+		os_mutex_get(&gw.lock, OS_WAIT_FOREVER);
+		for (i = 0; i < AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS; i++) {
+			pClient = &gw.clients[i];
+			if (pClient->sock < 0) {
+				continue;
+			}
+			if (FD_ISSET(pClient->sock, &rfds)) {
+				gw_receive(pClient);
+			} else if (pClient->keepAliveMs && gw_now() - pClient->lastMs > pClient->keepAliveMs) {
+				gw_close(pClient);
+			}
+		}
+		if (FD_ISSET(gw.listenSock, &rfds)) {
+			gw_accept();
+		}
+		if (gw.staged && gw_now() - gw.stageMs >= AWS_IOT_MQTT_GATEWAY_FLUSH_MS) {
+			gw_flush();
+		}
+		os_mutex_put(&gw.lock);
+	}
+}
+
+IoT_Error_t aws_iot_mqtt_gateway_start(const MQTTGatewayParams *pParams) {
+	struct sockaddr_in addr;
+	int i, one = 1;
+
+	if (NULL == pParams) {
+		return NULL_VALUE_ERROR;
+	}
+	if (gw.listenSock >= 0) {
+		return GENERIC_ERROR;
+	}
+
+	if (WM_SUCCESS != os_mutex_create(&gw.lock, "mqtt-gateway", OS_MUTEX_INHERIT)) {
+		return GENERIC_ERROR;
+	}
+	gw.params = *pParams;
+	for (i = 0; i < AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS; i++) {
+		gw.clients[i].sock = -1;
+	}
+
+	gw.listenSock = socket(AF_INET, SOCK_STREAM, 0);
+	if (gw.listenSock < 0) {
+		goto fail;
+	}
+	setsockopt(gw.listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(pParams->port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(gw.listenSock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(gw.listenSock, AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS) < 0) {
+		goto fail;
+	}
+
+	if (WM_SUCCESS != os_thread_create(&gw.thread, "mqtt-gateway", gw_main, NULL,
+					   &gw_stack, AWS_IOT_MQTT_GATEWAY_PRIO)) {
+		goto fail;
+	}
+	return NONE_ERROR;
+
+fail:
+	ERROR("MQTT gateway could not be started on port %d", pParams->port);
+	if (gw.listenSock >= 0) {
+		close(gw.listenSock);
+		gw.listenSock = -1;
+	}
+	os_mutex_delete(&gw.lock);
+	return GENERIC_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_gateway_deliver(const char *pTopic, const void *pPayload, uint32_t payloadLen) {
+	if (NULL == pTopic || (NULL == pPayload && payloadLen)) {
+		return NULL_VALUE_ERROR;
+	}
+	if (gw.listenSock < 0) {
+		return GENERIC_ERROR;
+	}
+
+	os_mutex_get(&gw.lock, OS_WAIT_FOREVER);
+	gw_deliver(pTopic, strlen(pTopic), pPayload, payloadLen);
+	os_mutex_put(&gw.lock);
+	return NONE_ERROR;
+}
+
+void aws_iot_mqtt_gateway_get_stats(MQTTGatewayStats *pStats) {
+	*pStats = gw.stats;
+}
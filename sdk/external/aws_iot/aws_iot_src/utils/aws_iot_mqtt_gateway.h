@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_mqtt_gateway.h
+ * @brief Local MQTT broker forwarding to AWS IoT
+ *
+ * Lets the devices of a site publish over plain MQTT 3.1.1 on the LAN to one
+ * device acting as gateway, instead of each keeping its own TLS connection to
+ * AWS IoT. The gateway accepts up to #AWS_IOT_MQTT_GATEWAY_MAX_CLIENTS
+ * clients. A message a client publishes, at QoS0 or QoS1, goes to the
+ * clients subscribed to its topic, at QoS0, and is forwarded upstream on the
+ * default connection, with pUpstreamPrefix put before its topic. Topics
+ * starting with pLocalPrefix stay on the LAN.
+ *
+ * Forwarded messages are collected for up to #AWS_IOT_MQTT_GATEWAY_FLUSH_MS,
+ * or until #AWS_IOT_MQTT_GATEWAY_BATCH of them are waiting, then queued
+ * together to the service task of aws_iot_mqtt_service.h, which sends what is
+ * queued as one batch, in as few TLS records as fit. A client's QoS1 publish
+ * is acknowledged once the gateway holds the message, not once AWS IoT does.
+ * QoS2, retained messages and persistent sessions are not supported.
+ *
+ * Messages from AWS IoT, e.g. commands for the devices behind the gateway,
+ * reach the clients when the application passes them on with
+ * aws_iot_mqtt_gateway_deliver() from its message handler.
+ */
+
+#ifndef AWS_IOT_MQTT_GATEWAY_H_
+#define AWS_IOT_MQTT_GATEWAY_H_
+
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+
+/**
+ * @brief Gateway parameters
+ */
+typedef struct {
+	uint16_t port;					///< TCP port clients connect to
+	const char *pUpstreamPrefix;	///< Put before the topic of the messages forwarded, e.g. "gw/site1/", or NULL
+	const char *pLocalPrefix;		///< Messages on topics starting with it are not forwarded, or NULL to forward all
+} MQTTGatewayParams;
+extern const MQTTGatewayParams MQTTGatewayParamsDefault;
+
+/**
+ * @brief Gateway counters
+ */
+typedef struct {
+	uint32_t connects;		///< Clients connected
+	uint32_t published;		///< Messages published by the clients
+	uint32_t delivered;		///< Messages sent to subscribed clients
+	uint32_t forwarded;		///< Messages queued upstream
+	uint32_t flushes;		///< Batches queued upstream
+	uint32_t dropped;		///< Messages not forwarded, too large or the service queue full
+} MQTTGatewayStats;
+
+/**
+ * @brief Start the gateway
+ *
+ * aws_iot_mqtt_service_start() has to be called before, the messages are
+ * forwarded through the service task.
+ *
+ * @param pParams Parameters, the strings have to stay valid
+ * @return NONE_ERROR, NULL_VALUE_ERROR, or GENERIC_ERROR if the gateway runs
+ *         already or its socket or its task can not be created
+ */
+IoT_Error_t aws_iot_mqtt_gateway_start(const MQTTGatewayParams *pParams);
+
+/**
+ * @brief Send a message to the clients subscribed to its topic
+ *
+ * Can be called from any task, e.g. from the handler of a subscription of the
+ * default connection.
+ *
+ * @param pTopic Topic of the message
+ * @param pPayload Payload of the message
+ * @param payloadLen Length of the payload
+ * @return NONE_ERROR, NULL_VALUE_ERROR, or GENERIC_ERROR if the gateway does
+ *         not run
+ */
+IoT_Error_t aws_iot_mqtt_gateway_deliver(const char *pTopic, const void *pPayload, uint32_t payloadLen);
+
+/**
+ * @brief Get the counters
+ *
+ * @param pStats Counters since the start
+ */
+void aws_iot_mqtt_gateway_get_stats(MQTTGatewayStats *pStats);
+
+#endif /* AWS_IOT_MQTT_GATEWAY_H_ */
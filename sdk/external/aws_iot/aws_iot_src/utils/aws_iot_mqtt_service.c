@@ -0,0 +1,375 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_mqtt_service.c
+ * @brief MQTT service task owning the default connection
+ *
+ * Queued messages live in a pool of fixed entries, taken from a free list
+ * and put on a list per priority. The lock only covers the lists and the
+ * copy of a message into its entry. The task takes an entry off its list
+ * before publishing it, so the entry is its own while it waits for the
+ * network, and puts it back at the front when the connection or the PUBACK
+ * window can not take it yet.
+ *
+ * With a send window, bulk messages stay queued until the window opens or
+ * a command or an alarm is sent, whatever wakes the radio first. Either
+ * way, everything queued goes out together with a keepalive ping that
+ * would be due before the next window.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_service.h"
+
+typedef struct svc_msg {
+	struct svc_msg *pNext;
+	uint32_t payloadLen;
+	uint8_t topicLen;
+	uint8_t qos;
+	uint8_t priority;
+	iot_publish_complete_handler handler;
+	void *pContext;
+	char data[AWS_IOT_MQTT_SERVICE_MAX_MSG_LEN];    /* Topic, NUL, payload */
+} svc_msg_t;
+
+/* A QoS1 message waiting for its PUBACK, only used by the task */
+typedef struct {
+	bool used;
+	uint8_t priority;
+	iot_publish_complete_handler handler;
+	void *pContext;
+} svc_inflight_t;
+
+static struct {
+	os_thread_t thread;
+	os_mutex_t lock;
+	svc_msg_t *pFree;
+	svc_msg_t *pHead[MQTT_SERVICE_PRIOS];
+	svc_msg_t *pTail[MQTT_SERVICE_PRIOS];
+	uint32_t count;
+	uint32_t dropped;
+	svc_inflight_t inflight[AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH];
+	uint32_t bulkInflight;
+	uint32_t windowMs;
+	unsigned nextWindow;        /* Ticks */
+	uint32_t windows;
+} svc;
+
+static svc_msg_t svc_msgs[AWS_IOT_MQTT_SERVICE_QUEUE_LEN];
+static os_thread_stack_define(svc_stack, AWS_IOT_MQTT_SERVICE_STACK_SIZE);
+
+static void svc_append(svc_msg_t *pMsg) {
+	pMsg->pNext = NULL;
+	if (NULL == svc.pTail[pMsg->priority]) {
+		svc.pHead[pMsg->priority] = pMsg;
+	} else {
+		svc.pTail[pMsg->priority]->pNext = pMsg;
+	}
+	svc.pTail[pMsg->priority] = pMsg;
+	svc.count++;
+}
+
+static void svc_push_front(svc_msg_t *pMsg) {
+	pMsg->pNext = svc.pHead[pMsg->priority];
+	svc.pHead[pMsg->priority] = pMsg;
+	if (NULL == svc.pTail[pMsg->priority]) {
+		svc.pTail[pMsg->priority] = pMsg;
+	}
+	svc.count++;
+}
+
+static svc_msg_t *svc_pop_front(int priority) {
+	svc_msg_t *pMsg = svc.pHead[priority];
+
+	if (NULL != pMsg) {
+		svc.pHead[priority] = pMsg->pNext;
+		if (NULL == svc.pHead[priority]) {
+			svc.pTail[priority] = NULL;
+		}
+		svc.count--;
+	}
+	return pMsg;
+}
+
+/* The newest message less urgent than priority, taken off its list */
+static svc_msg_t *svc_evict(int priority) {
+	svc_msg_t *pMsg, *pPrev;
+	int victim;
+
+	for (victim = MQTT_SERVICE_PRIOS - 1; victim > priority; victim--) {
+		pMsg = svc.pTail[victim];
+		if (NULL == pMsg) {
+			continue;
+		}
+		if (svc.pHead[victim] == pMsg) {
+			svc.pHead[victim] = NULL;
+			svc.pTail[victim] = NULL;
+		} else {
+			for (pPrev = svc.pHead[victim]; pPrev->pNext != pMsg; pPrev = pPrev->pNext) {
+			}
+			pPrev->pNext = NULL;
+			svc.pTail[victim] = pPrev;
+		}
+		svc.count--;
+		return pMsg;
+	}
+	return NULL;
+}
+
+static void svc_free(svc_msg_t *pMsg) {
+	os_mutex_get(&svc.lock, OS_WAIT_FOREVER);
+	pMsg->pNext = svc.pFree;
+	svc.pFree = pMsg;
+	os_mutex_put(&svc.lock);
+}
+
+static void svc_publish_complete(uint16_t id, IoT_Error_t status, void *pContext) {
+	svc_inflight_t *pInflight = pContext;
+
+	if (MQTT_SERVICE_PRIO_BULK == pInflight->priority) {
+		svc.bulkInflight--;
+	}
+	pInflight->used = false;
+	if (NULL != pInflight->handler) {
+		pInflight->handler(id, status, pInflight->pContext);
+	}
+}
+
+static svc_inflight_t *svc_inflight_alloc(void) {
+	int i;
+
+	for (i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH; i++) {
+		if (!svc.inflight[i].used) {
+			return &svc.inflight[i];
+		}
+	}
+	return NULL;
+}
+
+/* Next message the connection can take, NULL if none. Bulk messages only
+ * with bulk set */
+static svc_msg_t *svc_next(bool bulk) {
+	svc_msg_t *pMsg = NULL;
+	int priority;
+
+	os_mutex_get(&svc.lock, OS_WAIT_FOREVER);
+	for (priority = 0; NULL == pMsg && priority < MQTT_SERVICE_PRIOS; priority++) {
+		if (MQTT_SERVICE_PRIO_BULK == priority && (!bulk || (NULL != svc.pHead[priority]
+		    && QOS_1 == svc.pHead[priority]->qos && AWS_IOT_MQTT_SERVICE_BULK_INFLIGHT <= svc.bulkInflight))) {
+			break;
+		}
+		pMsg = svc_pop_front(priority);
+	}
+	os_mutex_put(&svc.lock);
+
+	return pMsg;
+}
+
+/* Publishes one message, false once nothing more can be sent */
+static bool svc_send_one(bool bulk) {
+	MQTTPublishParams params = MQTTPublishParamsDefault;
+	svc_inflight_t *pInflight = NULL;
+	svc_msg_t *pMsg;
+	IoT_Error_t rc;
+
+	pMsg = svc_next(bulk);
+	if (NULL == pMsg) {
+		return false;
+	}
+
+	if (QOS_1 == pMsg->qos) {
+		pInflight = svc_inflight_alloc();
+		if (NULL == pInflight) {
+			goto requeue;
+		}
+		pInflight->priority = pMsg->priority;
+		pInflight->handler = pMsg->handler;
+		pInflight->pContext = pMsg->pContext;
+	}
+
+	params.pTopic = pMsg->data;
+	params.MessageParams.qos = (QoSLevel) pMsg->qos;
+	params.MessageParams.pPayload = &pMsg->data[pMsg->topicLen + 1];
+	params.MessageParams.PayloadLen = pMsg->payloadLen;
+	rc = aws_iot_mqtt_publish_async(&params, (NULL != pInflight) ? svc_publish_complete : NULL, pInflight);
+	if (PUBLISH_INFLIGHT_WINDOW_FULL == rc || NETWORK_DISCONNECTED == rc) {
+		goto requeue;
+	}
+
+	if (NULL != pInflight && NONE_ERROR == rc) {
+		pInflight->used = true;
+		if (MQTT_SERVICE_PRIO_BULK == pInflight->priority) {
+			svc.bulkInflight++;
+		}
+	} else if (NULL != pMsg->handler) {
+		pMsg->handler(params.MessageParams.id, rc, pMsg->pContext);
+	}
+	svc_free(pMsg);
+	return true;
+
+requeue:
+	/* Sent first once the connection or the window has room again */
+	os_mutex_get(&svc.lock, OS_WAIT_FOREVER);
+	svc_push_front(pMsg);
+	os_mutex_put(&svc.lock);
+	return false;
+}
+
+/* Milliseconds until the send window opens, 0 if it is open */
+static int svc_window_left(void) {
+	int left = (int)(svc.nextWindow - os_ticks_get());
+
+	return (0 < left) ? (int)os_ticks_to_msec(left) : 0;
+}
+
+/* Sends what the window lets through */
+static void svc_send(void) {
+	uint32_t windowMs = svc.windowMs;
+	bool open = (0 == windowMs || 0 == svc_window_left());
+	bool sent = false;
+
+	aws_iot_mqtt_batch_begin();
+	while (svc_send_one(open)) {
+		sent = true;
+	}
+	if (0 != windowMs && (open || sent)) {
+		/* The radio is awake now, the bulk messages and the ping join */
+		while (svc_send_one(true)) {
+			sent = true;
+		}
+		aws_iot_mqtt_keepalive_early(windowMs);
+		if (sent) {
+			svc.windows++;
+		}
+		svc.nextWindow = os_ticks_get() + os_msec_to_ticks(windowMs);
+	}
+	aws_iot_mqtt_batch_end();
+}
+
+static void svc_main(os_thread_arg_t arg) {
+	IoT_Error_t rc;
+	int timeout;
+
+	while (1) {
+		svc_send();
+
+		timeout = AWS_IOT_MQTT_SERVICE_YIELD_MS;
+		if (0 != svc.windowMs && svc_window_left() < timeout) {
+			timeout = svc_window_left();
+		}
+		rc = aws_iot_mqtt_yield_until_event(timeout);
+		if (NONE_ERROR != rc && RECONNECT_SUCCESSFUL != rc && !aws_iot_is_mqtt_connected()) {
+			/* Without auto reconnect the yield returns at once */
+			os_thread_sleep(os_msec_to_ticks(AWS_IOT_MQTT_SERVICE_YIELD_MS));
+		}
+	}
+}
+
+IoT_Error_t aws_iot_mqtt_service_start(void) {
+	int i;
+
+	if (NULL != svc.thread) {
+		return NONE_ERROR;
+	}
+
+	if (WM_SUCCESS != os_mutex_create(&svc.lock, "mqtt-service", OS_MUTEX_INHERIT)) {
+		return GENERIC_ERROR;
+	}
+
+	for (i = 0; i < AWS_IOT_MQTT_SERVICE_QUEUE_LEN; i++) {
+		svc_msgs[i].pNext = svc.pFree;
+		svc.pFree = &svc_msgs[i];
+	}
+
+	if (WM_SUCCESS != os_thread_create(&svc.thread, "mqtt-service", svc_main, NULL,
+					   &svc_stack, AWS_IOT_MQTT_SERVICE_PRIO)) {
+		ERROR("MQTT service task could not be created");
+		svc.thread = NULL;
+		svc.pFree = NULL;
+		os_mutex_delete(&svc.lock);
+		return GENERIC_ERROR;
+	}
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_service_publish(const char *pTopic, const void *pPayload, uint32_t payloadLen,
+					 QoSLevel qos, MQTTServicePriority priority,
+					 iot_publish_complete_handler handler, void *pContext) {
+	svc_msg_t *pMsg, *pDropped = NULL;
+	size_t topicLen;
+
+	if (NULL == pTopic || (NULL == pPayload && 0 != payloadLen) || MQTT_SERVICE_PRIOS <= priority) {
+		return NULL_VALUE_ERROR;
+	}
+
+	topicLen = strlen(pTopic);
+	if (NULL == svc.thread || QOS_1 < qos || UINT8_MAX < topicLen
+	    || AWS_IOT_MQTT_SERVICE_MAX_MSG_LEN < topicLen + 1 + payloadLen) {
+		return PUBLISH_ERROR;
+	}
+
+	os_mutex_get(&svc.lock, OS_WAIT_FOREVER);
+	pMsg = svc.pFree;
+	if (NULL != pMsg) {
+		svc.pFree = pMsg->pNext;
+	} else {
+		pMsg = pDropped = svc_evict(priority);
+		if (NULL == pMsg) {
+			os_mutex_put(&svc.lock);
+			return MQTT_SERVICE_QUEUE_FULL;
+		}
+		svc.dropped++;
+	}
+	os_mutex_put(&svc.lock);
+
+	/* The entry is not on a list any more, it is only filled in below */
+	if (NULL != pDropped && NULL != pDropped->handler) {
+		pDropped->handler(0, MQTT_SERVICE_QUEUE_FULL, pDropped->pContext);
+	}
+
+	pMsg->topicLen = (uint8_t) topicLen;
+	pMsg->payloadLen = payloadLen;
+	pMsg->qos = (uint8_t) qos;
+	pMsg->priority = (uint8_t) priority;
+	pMsg->handler = handler;
+	pMsg->pContext = pContext;
+	memcpy(pMsg->data, pTopic, topicLen + 1);
+	if (0 != payloadLen) {
+		memcpy(&pMsg->data[topicLen + 1], pPayload, payloadLen);
+	}
+
+	os_mutex_get(&svc.lock, OS_WAIT_FOREVER);
+	svc_append(pMsg);
+	os_mutex_put(&svc.lock);
+
+	aws_iot_mqtt_wakeup();
+
+	return NONE_ERROR;
+}
+
+uint32_t aws_iot_mqtt_service_count(void) {
+	return svc.count;
+}
+
+uint32_t aws_iot_mqtt_service_dropped(void) {
+	return svc.dropped;
+}
+
+void aws_iot_mqtt_service_set_window(uint32_t periodMs) {
+	svc.nextWindow = os_ticks_get() + os_msec_to_ticks(periodMs);
+	svc.windowMs = periodMs;
+	aws_iot_mqtt_wakeup();
+}
+
+uint32_t aws_iot_mqtt_service_windows(void) {
+	return svc.windows;
+}
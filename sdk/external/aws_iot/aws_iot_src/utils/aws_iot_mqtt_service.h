@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_mqtt_service.h
+ * @brief MQTT service task with a prioritized outbound queue
+ *
+ * Application threads that publish on their own still wait for the network
+ * writes and the PUBACKs of their messages, and their messages go out in the
+ * order the threads happen to run. Once aws_iot_mqtt_service_start() was called a task owns the
+ * default connection of aws_iot_mqtt_interface.h: it runs the yield, which
+ * delivers the incoming messages and reconnects, and sends the messages the
+ * other threads queue with aws_iot_mqtt_service_publish(). Queuing copies
+ * the message and never waits for the network.
+ *
+ * The queue is ordered by priority, commands before alarms before bulk
+ * telemetry, and by age within a priority. A message queued while a bulk
+ * upload is going on is the next one sent. Bulk QoS1 messages only get
+ * #AWS_IOT_MQTT_SERVICE_BULK_INFLIGHT places of the PUBACK window, so the
+ * rest of it is free for the others. The queue holds
+ * #AWS_IOT_MQTT_SERVICE_QUEUE_LEN messages, when it is full the newest
+ * message of a lower priority is dropped to make room.
+ *
+ * Messages queued while the connection is down wait for it to come back,
+ * which takes auto reconnect to be enabled.
+ */
+
+#ifndef AWS_IOT_MQTT_SERVICE_H_
+#define AWS_IOT_MQTT_SERVICE_H_
+
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_mqtt_interface.h"
+
+/**
+ * @brief Priority of a queued message, the most urgent first
+ */
+typedef enum {
+	MQTT_SERVICE_PRIO_COMMAND = 0,	///< Replies to commands
+	MQTT_SERVICE_PRIO_ALARM,		///< Alarms and events
+	MQTT_SERVICE_PRIO_BULK,			///< Telemetry and uploads
+	MQTT_SERVICE_PRIOS
+} MQTTServicePriority;
+
+/**
+ * @brief Start the service task
+ *
+ * The default connection has to be connected, and subscribed to what the
+ * application needs, before. From then on only the service task may call the
+ * aws_iot_mqtt_* functions, and the message handlers run in it.
+ *
+ * @return NONE_ERROR, or GENERIC_ERROR if the task could not be created
+ */
+IoT_Error_t aws_iot_mqtt_service_start(void);
+
+/**
+ * @brief Queue a message for the service task to publish
+ *
+ * Can be called from any thread, except from an interrupt.
+ *
+ * The handler is called from the service task once the message was sent
+ * (QoS0), acknowledged or failed (QoS1), with the status as for
+ * aws_iot_mqtt_publish_async(). A message dropped for a more urgent one gets
+ * MQTT_SERVICE_QUEUE_FULL, from the thread that queued that one.
+ *
+ * @param pTopic Topic to publish on
+ * @param pPayload Payload of the message
+ * @param payloadLen Length of the payload, the topic and the payload take at most
+ *        #AWS_IOT_MQTT_SERVICE_MAX_MSG_LEN - 1 bytes
+ * @param qos QOS_0 or QOS_1
+ * @param priority Priority of the message
+ * @param handler Called when the message is done with, can be NULL
+ * @param pContext Passed to the handler
+ * @return NONE_ERROR, NULL_VALUE_ERROR, PUBLISH_ERROR if the message is too large or the
+ *         service is not started, or MQTT_SERVICE_QUEUE_FULL
+ */
+IoT_Error_t aws_iot_mqtt_service_publish(const char *pTopic, const void *pPayload, uint32_t payloadLen,
+		QoSLevel qos, MQTTServicePriority priority, iot_publish_complete_handler handler, void *pContext);
+
+/**
+ * @brief Number of messages waiting in the queue
+ */
+uint32_t aws_iot_mqtt_service_count(void);
+
+/**
+ * @brief Number of messages dropped for more urgent ones
+ */
+uint32_t aws_iot_mqtt_service_dropped(void);
+
+/**
+ * @brief Send bulk messages in windows
+ *
+ * Bulk messages then wait for the next window, every periodMs, or for a command or
+ * an alarm to be sent, so that a radio in power save wakes once for all of them
+ * instead of once each. A keepalive ping that would be due before the next window
+ * goes out with them. See aws_iot_wifi_ps.h.
+ *
+ * @param periodMs Time between two windows, 0 to send bulk messages at once again
+ */
+void aws_iot_mqtt_service_set_window(uint32_t periodMs);
+
+/**
+ * @brief Number of send windows that sent messages so far, scheduled or opened early
+ */
+uint32_t aws_iot_mqtt_service_windows(void);
+
+#endif /* AWS_IOT_MQTT_SERVICE_H_ */
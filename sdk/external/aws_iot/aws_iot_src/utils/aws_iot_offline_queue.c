@@ -0,0 +1,640 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_offline_queue.c
+ * @brief Store and forward queue of MQTT publishes in a flash partition
+ *
+ * The partition is a ring of sectors written as a log. A sector starts with
+ * a header holding a sequence number, the sectors in use follow each other
+ * around the ring with consecutive numbers. Records are appended back to
+ * back after the header:
+ *
+ *     len, topicLen, qos, crc, done, topic, NUL, payload, padding to 4 bytes
+ *
+ * A record is written once, afterwards only its done word is programmed
+ * from 0xffffffff to 0 when the message was sent. A sector is erased when
+ * the writer comes back to it. A record torn by a reset fails its CRC when
+ * the partition is scanned and is marked done.
+ *
+ * With AWS_IOT_OFFLINE_QUEUE_PRE_ERASE the sector after the one being
+ * written is erased by the flash thread of flash_async.h as soon as it is
+ * free, the put that moves to it only writes its header.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <flash.h>
+#include <crc32.h>
+#include <flash_async.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_offline_queue.h"
+
+#define OQ_SECTOR_MAGIC 0x3151514f
+#define OQ_DONE 0
+#define OQ_NO_RECORD 0xffffffff
+#define OQ_MAX_TOPIC_LEN 255
+#define OQ_NO_SECTOR 0xffffffff
+
+#define OQ_SECTOR(pos) ((pos) / AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE)
+#define OQ_SECTOR_END(pos) ((OQ_SECTOR(pos) + 1) * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE)
+#define OQ_FIRST(sector) ((sector) * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE + sizeof(oq_sector_t))
+#define OQ_RECORD_SIZE(len) ((sizeof(oq_record_t) + (len) + 3) & ~3)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+} oq_sector_t;
+
+typedef struct {
+	uint16_t len;       /* Bytes of topic, NUL and payload */
+	uint8_t topicLen;
+	uint8_t qos;
+	uint32_t crc;       /* Of len, topicLen, qos and the data */
+	uint32_t done;      /* 0xffffffff until the message was sent */
+} oq_record_t;
+
+typedef struct {
+	uint32_t pos;       /* Record of the publish, OQ_NO_RECORD if it was dropped */
+	bool used;
+} oq_inflight_t;
+
+static struct {
+	mdev_t *dev;
+	flash_desc_t fl;
+	uint32_t sectors;
+	uint32_t head;      /* Oldest record not sent */
+	uint32_t send;      /* Next record to publish */
+	uint32_t tail;      /* Position of the next record */
+	bool tailOpen;      /* The sector of tail is erased and has its header */
+	uint32_t tailSeq;   /* Sequence number of the newest sector */
+	uint32_t count;
+	uint32_t dropped;
+	oq_inflight_t inflight[AWS_IOT_OFFLINE_QUEUE_PIPELINE];
+	uint32_t inflightCount;
+	bool rewind;        /* A publish failed, send again from head */
+	uint32_t tokens;
+	unsigned long refillTick;
+	uint32_t preErased;         /* Sector erased ahead, OQ_NO_SECTOR if none */
+	volatile int preEraseState; /* Of preErased, OQ_ERASE_* */
+	os_mutex_t lock;
+} oq;
+
+enum {
+	OQ_ERASE_PENDING,
+	OQ_ERASE_DONE,
+	OQ_ERASE_FAILED,
+};
+
+/* A record being written or published, 4 byte aligned for the flash */
+static uint32_t oq_buf[OQ_RECORD_SIZE(AWS_IOT_OFFLINE_QUEUE_MAX_MSG_LEN) / 4];
+
+static int oq_read(uint32_t pos, void *buf, uint32_t len) {
+	return flash_drv_read(oq.dev, (uint8_t *)buf, len, oq.fl.fl_start + pos);
+}
+
+static int oq_write(uint32_t pos, const void *buf, uint32_t len) {
+	return flash_drv_write(oq.dev, (const uint8_t *)buf, len, oq.fl.fl_start + pos);
+}
+
+static uint32_t oq_crc(const oq_record_t *r, const uint8_t *data) {
+	return fast_crc32(data, r->len, fast_crc32(r, offsetof(oq_record_t, crc), 0));
+}
+
+/* Header of the record at pos, false if there is none */
+static bool oq_read_header(uint32_t pos, oq_record_t *r) {
+	if (pos + sizeof(*r) > OQ_SECTOR_END(pos) || 0 != oq_read(pos, r, sizeof(*r))) {
+		return false;
+	}
+
+	return AWS_IOT_OFFLINE_QUEUE_MAX_MSG_LEN >= r->len && r->topicLen < r->len
+	       && pos + OQ_RECORD_SIZE(r->len) <= OQ_SECTOR_END(pos);
+}
+
+/* Record after the one at pos, the first record of the next sector when the
+ * sector has no more */
+static uint32_t oq_next(uint32_t pos, const oq_record_t *r, bool valid) {
+	uint32_t next;
+
+	if (valid) {
+		next = pos + OQ_RECORD_SIZE(r->len);
+		if (next + sizeof(oq_record_t) <= OQ_SECTOR_END(pos)) {
+			return next;
+		}
+	}
+
+	return OQ_FIRST((OQ_SECTOR(pos) + 1) % oq.sectors);
+}
+
+static void oq_set_done(uint32_t pos) {
+	static const uint32_t done = OQ_DONE;
+
+	if (0 != oq_write(pos + offsetof(oq_record_t, done), &done, sizeof(done))) {
+		ERROR("Offline queue: marking record at %u failed", (unsigned int)pos);
+	}
+}
+
+static void oq_mark_done(uint32_t pos) {
+	oq_set_done(pos);
+	if (0 < oq.count) {
+		oq.count--;
+	}
+}
+
+/* Move head, and send with it, over the records that were sent */
+static void oq_skip_done(void) {
+	oq_record_t r;
+	bool valid, moveSend;
+
+	while (oq.head != oq.tail) {
+		valid = oq_read_header(oq.head, &r);
+		if (valid && OQ_DONE != r.done) {
+			break;
+		}
+		moveSend = (oq.send == oq.head);
+		oq.head = oq_next(oq.head, &r, valid);
+		if (moveSend) {
+			oq.send = oq.head;
+		}
+	}
+}
+
+/* The partition is full: the messages left in the oldest sector go */
+static void oq_drop_sector(uint32_t sector) {
+	uint32_t pos = oq.head, i;
+	oq_record_t r;
+	bool valid;
+
+	while (OQ_SECTOR(pos) == sector) {
+		valid = oq_read_header(pos, &r);
+		if (valid && OQ_DONE != r.done) {
+			oq.count--;
+			oq.dropped++;
+		}
+		pos = oq_next(pos, &r, valid);
+	}
+
+	/* A PUBACK still to come only frees its slot */
+	for (i = 0; i < AWS_IOT_OFFLINE_QUEUE_PIPELINE; i++) {
+		if (oq.inflight[i].used && OQ_SECTOR(oq.inflight[i].pos) == sector) {
+			oq.inflight[i].pos = OQ_NO_RECORD;
+		}
+	}
+	if (OQ_SECTOR(oq.send) == sector) {
+		oq.send = pos;
+	}
+	oq.head = pos;
+	oq_skip_done();
+}
+
+#if AWS_IOT_OFFLINE_QUEUE_PRE_ERASE
+static void oq_pre_erase_done(int result, void *arg) {
+	oq.preEraseState = WM_SUCCESS == result ? OQ_ERASE_DONE : OQ_ERASE_FAILED;
+}
+
+/* Erase the sector after the one of tail in the background, it is free
+ * unless the ring is full */
+static void oq_pre_erase(void) {
+	uint32_t next = (OQ_SECTOR(oq.tail) + 1) % oq.sectors;
+
+	if (OQ_SECTOR(oq.head) == next && oq.head != oq.tail) {
+		return;
+	}
+
+	oq.preErased = next;
+	oq.preEraseState = OQ_ERASE_PENDING;
+	if (WM_SUCCESS != flash_async_erase(oq.dev, oq.fl.fl_start + next * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE,
+					    AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE, oq_pre_erase_done, NULL)) {
+		oq.preErased = OQ_NO_SECTOR;
+	}
+}
+
+/* Whether the sector was erased ahead, waits for an erase still going on */
+static bool oq_is_pre_erased(uint32_t sector) {
+	bool erased;
+
+	if (oq.preErased != sector) {
+		return false;
+	}
+	if (OQ_ERASE_PENDING == oq.preEraseState) {
+		flash_async_flush();
+	}
+	erased = (OQ_ERASE_DONE == oq.preEraseState);
+	oq.preErased = OQ_NO_SECTOR;
+	return erased;
+}
+#endif
+
+/* Waits for an erase ahead, before the partition is scanned or given up */
+static void oq_pre_erase_cancel(void) {
+#if AWS_IOT_OFFLINE_QUEUE_PRE_ERASE
+	if (OQ_NO_SECTOR != oq.preErased && OQ_ERASE_PENDING == oq.preEraseState) {
+		flash_async_flush();
+	}
+#endif
+	oq.preErased = OQ_NO_SECTOR;
+}
+
+static int oq_open_sector(void) {
+	uint32_t sector = OQ_SECTOR(oq.tail);
+	oq_sector_t hdr;
+	bool erased = false;
+
+#if AWS_IOT_OFFLINE_QUEUE_PRE_ERASE
+	erased = oq_is_pre_erased(sector);
+#endif
+	hdr.magic = OQ_SECTOR_MAGIC;
+	hdr.seq = oq.tailSeq + 1;
+	if ((!erased && 0 != flash_drv_erase(oq.dev, oq.fl.fl_start + sector * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE,
+										AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE))
+	    || 0 != oq_write(sector * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE, &hdr, sizeof(hdr))) {
+		return -WM_FAIL;
+	}
+
+	oq.tailSeq = hdr.seq;
+	oq.tailOpen = true;
+#if AWS_IOT_OFFLINE_QUEUE_PRE_ERASE
+	oq_pre_erase();
+#endif
+	return WM_SUCCESS;
+}
+
+/* Move tail from sector to the first record of the next one. The readers
+ * caught up with the writer follow it, when the ring is full the messages
+ * left in the next sector are dropped before it is erased */
+static void oq_next_sector(uint32_t sector) {
+	uint32_t next = OQ_FIRST((sector + 1) % oq.sectors);
+
+	if (oq.send == oq.tail) {
+		oq.send = next;
+	}
+	if (oq.head == oq.tail) {
+		oq.head = next;
+	} else if (OQ_SECTOR(oq.head) == OQ_SECTOR(next)) {
+		oq_drop_sector(OQ_SECTOR(next));
+		WARN("Offline queue full, %u messages dropped so far", (unsigned int)oq.dropped);
+	}
+	oq.tail = next;
+	oq.tailOpen = false;
+}
+
+static bool oq_is_free(const oq_record_t *r) {
+	const uint8_t *p = (const uint8_t *)r;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(*r); i++) {
+		if (0xff != p[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Find the newest sector and the records not sent in the sectors before it */
+static void oq_scan(void) {
+	uint32_t newest = 0, first, sector, pos, end, n;
+	oq_sector_t hdr;
+	oq_record_t r;
+	bool found = false, full;
+	uint8_t *data = (uint8_t *)oq_buf + sizeof(oq_record_t);
+
+	for (sector = 0; sector < oq.sectors; sector++) {
+		if (0 == oq_read(sector * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE, &hdr, sizeof(hdr))
+		    && OQ_SECTOR_MAGIC == hdr.magic && (!found || 0 < (int32_t)(hdr.seq - oq.tailSeq))) {
+			newest = sector;
+			oq.tailSeq = hdr.seq;
+			found = true;
+		}
+	}
+
+	oq.head = OQ_NO_RECORD;
+	oq.count = 0;
+	if (!found) {
+		/* A new partition, the first put erases sector 0 */
+		oq.tailSeq = 0;
+		oq.tail = OQ_FIRST(0);
+		oq.tailOpen = false;
+		oq.head = oq.send = oq.tail;
+		return;
+	}
+
+	first = newest;
+	for (n = 1; n < oq.sectors; n++) {
+		sector = (newest + oq.sectors - n) % oq.sectors;
+		if (0 != oq_read(sector * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE, &hdr, sizeof(hdr))
+		    || OQ_SECTOR_MAGIC != hdr.magic || oq.tailSeq - n != hdr.seq) {
+			break;
+		}
+		first = sector;
+	}
+
+	for (sector = first; ; sector = (sector + 1) % oq.sectors) {
+		end = (sector + 1) * AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE;
+		pos = OQ_FIRST(sector);
+		full = false;
+		while (oq_read_header(pos, &r)) {
+			if (OQ_DONE != r.done) {
+				if (0 == oq_read(pos + sizeof(r), data, r.len) && oq_crc(&r, data) == r.crc) {
+					if (OQ_NO_RECORD == oq.head) {
+						oq.head = pos;
+					}
+					oq.count++;
+				} else {
+					oq_set_done(pos);
+				}
+			}
+			pos += OQ_RECORD_SIZE(r.len);
+			if (pos + sizeof(r) > end) {
+				full = true;
+				break;
+			}
+		}
+		if (sector == newest) {
+			break;
+		}
+	}
+
+	oq.tail = pos;
+	oq.tailOpen = true;
+	if (OQ_NO_RECORD == oq.head) {
+		oq.head = oq.tail;
+	}
+	oq.send = oq.head;
+
+	/* The newest sector takes more records after the last one, unless that
+	 * one was torn or the sector is full */
+	if (full || !oq_is_free(&r)) {
+		oq_next_sector(newest);
+	}
+}
+
+IoT_Error_t aws_iot_offline_queue_init(const flash_desc_t *pFlash) {
+	if (NULL == pFlash) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (0 != pFlash->fl_start % AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE
+	    || 2 > pFlash->fl_size / AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE) {
+		ERROR("Offline queue partition is not made of whole sectors");
+		return OFFLINE_QUEUE_ERROR;
+	}
+
+	if (NULL == oq.lock && WM_SUCCESS != os_recursive_mutex_create(&oq.lock, "offline-queue")) {
+		return OFFLINE_QUEUE_ERROR;
+	}
+
+	os_recursive_mutex_get(&oq.lock, OS_WAIT_FOREVER);
+	if (NULL != oq.dev) {
+		oq_pre_erase_cancel();
+		flash_drv_close(oq.dev);
+	}
+	memset(oq.inflight, 0, sizeof(oq.inflight));
+	oq.inflightCount = 0;
+	oq.rewind = false;
+	oq.fl = *pFlash;
+	oq.sectors = pFlash->fl_size / AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE;
+	oq.preErased = OQ_NO_SECTOR;
+	oq.dev = flash_drv_open(pFlash->fl_dev);
+	if (NULL == oq.dev) {
+		os_recursive_mutex_put(&oq.lock);
+		return OFFLINE_QUEUE_ERROR;
+	}
+#if AWS_IOT_OFFLINE_QUEUE_PRE_ERASE
+	if (WM_SUCCESS != flash_async_init()) {
+		WARN("Offline queue: no flash thread, sectors are erased when they are needed");
+	}
+#endif
+	oq_scan();
+	oq.tokens = 0;
+	oq.refillTick = os_ticks_get();
+	os_recursive_mutex_put(&oq.lock);
+
+	DEBUG("Offline queue: %u messages", (unsigned int)oq.count);
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_offline_queue_put(const char *pTopic, const void *pPayload, uint32_t payloadLen,
+		QoSLevel qos) {
+	oq_record_t *r = (oq_record_t *)oq_buf;
+	uint8_t *data = (uint8_t *)oq_buf + sizeof(oq_record_t);
+	uint32_t topicLen, len, size, sector;
+	IoT_Error_t rc = NONE_ERROR;
+
+	if (NULL == pTopic || (0 < payloadLen && NULL == pPayload)) {
+		return NULL_VALUE_ERROR;
+	}
+
+	topicLen = strlen(pTopic);
+	len = topicLen + 1 + payloadLen;
+	if (NULL == oq.dev || 0 == topicLen || OQ_MAX_TOPIC_LEN < topicLen
+	    || AWS_IOT_OFFLINE_QUEUE_MAX_MSG_LEN < len || (QOS_0 != qos && QOS_1 != qos)) {
+		return OFFLINE_QUEUE_ERROR;
+	}
+	size = OQ_RECORD_SIZE(len);
+
+	os_recursive_mutex_get(&oq.lock, OS_WAIT_FOREVER);
+	if (oq.tailOpen && oq.tail + size > OQ_SECTOR_END(oq.tail)) {
+		oq_next_sector(OQ_SECTOR(oq.tail));
+	}
+	if (!oq.tailOpen && WM_SUCCESS != oq_open_sector()) {
+		rc = OFFLINE_QUEUE_ERROR;
+		goto out;
+	}
+
+	memset(oq_buf, 0xff, size);
+	r->len = (uint16_t)len;
+	r->topicLen = (uint8_t)topicLen;
+	r->qos = (uint8_t)qos;
+	memcpy(data, pTopic, topicLen + 1);
+	if (0 < payloadLen) {
+		memcpy(data + topicLen + 1, pPayload, payloadLen);
+	}
+	r->crc = oq_crc(r, data);
+
+	if (0 != oq_write(oq.tail, oq_buf, size)) {
+		/* Whatever made it to flash fails its CRC, the sector is not used further */
+		oq_next_sector(OQ_SECTOR(oq.tail));
+		rc = OFFLINE_QUEUE_ERROR;
+		goto out;
+	}
+
+	oq.count++;
+	if (oq.tail + size + sizeof(oq_record_t) > OQ_SECTOR_END(oq.tail)) {
+		sector = OQ_SECTOR(oq.tail);
+		oq.tail += size;
+		oq_next_sector(sector);
+	} else {
+		oq.tail += size;
+	}
+
+out:
+	os_recursive_mutex_put(&oq.lock);
+	return rc;
+}
+
+IoT_Error_t aws_iot_offline_queue_publish(MQTTPublishParams *pParams) {
+	if (NULL == pParams || NULL == pParams->pTopic) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (0 == oq.count && aws_iot_is_mqtt_connected()
+	    && NONE_ERROR == aws_iot_mqtt_publish(pParams)) {
+		return NONE_ERROR;
+	}
+
+	return aws_iot_offline_queue_put(pParams->pTopic, pParams->MessageParams.pPayload,
+					 pParams->MessageParams.PayloadLen, pParams->MessageParams.qos);
+}
+
+/* Runs in the yield that got the PUBACK, or lost the connection */
+static void oq_publish_done(uint16_t id, IoT_Error_t status, void *pContext) {
+	oq_inflight_t *p = (oq_inflight_t *)pContext;
+
+	os_recursive_mutex_get(&oq.lock, OS_WAIT_FOREVER);
+	if (NONE_ERROR != status) {
+		oq.rewind = true;
+	} else if (OQ_NO_RECORD != p->pos) {
+		oq_mark_done(p->pos);
+	}
+	p->used = false;
+	oq.inflightCount--;
+	oq_skip_done();
+	os_recursive_mutex_put(&oq.lock);
+}
+
+static void oq_refill(void) {
+#if AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE > 0
+	unsigned long now = os_ticks_get();
+	uint32_t ms = os_ticks_to_msec(now - oq.refillTick);
+	uint32_t add;
+
+	if (1000 <= ms) {
+		oq.tokens = AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE;
+		oq.refillTick = now;
+		return;
+	}
+
+	add = ms * AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE / 1000;
+	if (0 < add) {
+		oq.tokens += add;
+		if (AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE < oq.tokens) {
+			oq.tokens = AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE;
+		}
+		oq.refillTick = now;
+	}
+#else
+	oq.tokens = AWS_IOT_OFFLINE_QUEUE_PIPELINE;
+#endif
+}
+
+static oq_inflight_t *oq_free_slot(void) {
+	uint32_t i;
+
+	for (i = 0; i < AWS_IOT_OFFLINE_QUEUE_PIPELINE; i++) {
+		if (!oq.inflight[i].used) {
+			return &oq.inflight[i];
+		}
+	}
+	return NULL;
+}
+
+IoT_Error_t aws_iot_offline_queue_drain(void) {
+	oq_record_t r;
+	oq_inflight_t *slot;
+	MQTTPublishParams params = MQTTPublishParamsDefault;
+	char *data = (char *)oq_buf + sizeof(oq_record_t);
+	IoT_Error_t rc = NONE_ERROR;
+	bool valid;
+
+	if (NULL == oq.dev) {
+		return OFFLINE_QUEUE_ERROR;
+	}
+	if (!aws_iot_is_mqtt_connected()) {
+		return NETWORK_DISCONNECTED;
+	}
+
+	os_recursive_mutex_get(&oq.lock, OS_WAIT_FOREVER);
+	if (oq.rewind && 0 == oq.inflightCount) {
+		oq.send = oq.head;
+		oq.rewind = false;
+	}
+	oq_refill();
+
+	/* The publishes of one call share TLS records */
+	aws_iot_mqtt_batch_begin();
+	while (oq.send != oq.tail && 0 < oq.tokens && !oq.rewind) {
+		valid = oq_read_header(oq.send, &r);
+		if (!valid || OQ_DONE == r.done) {
+			oq.send = oq_next(oq.send, &r, valid);
+			continue;
+		}
+
+		slot = NULL;
+		if (QOS_1 == r.qos) {
+			slot = oq_free_slot();
+			if (NULL == slot) {
+				break;
+			}
+		}
+
+		if (0 != oq_read(oq.send + sizeof(r), data, r.len)) {
+			rc = OFFLINE_QUEUE_ERROR;
+			break;
+		}
+		if (oq_crc(&r, (uint8_t *)data) != r.crc) {
+			/* Left by a failed put, it was never counted */
+			oq_set_done(oq.send);
+			oq.send = oq_next(oq.send, &r, true);
+			continue;
+		}
+		params.pTopic = data;
+		params.MessageParams.qos = (QoSLevel)r.qos;
+		params.MessageParams.pPayload = data + r.topicLen + 1;
+		params.MessageParams.PayloadLen = r.len - r.topicLen - 1;
+
+		if (NULL != slot) {
+			slot->pos = oq.send;
+			slot->used = true;
+			rc = aws_iot_mqtt_publish_async(&params, oq_publish_done, slot);
+			if (NONE_ERROR != rc) {
+				slot->used = false;
+				break;
+			}
+			oq.inflightCount++;
+		} else {
+			rc = aws_iot_mqtt_publish_async(&params, NULL, NULL);
+			if (NONE_ERROR != rc) {
+				break;
+			}
+			oq_mark_done(oq.send);
+		}
+
+		oq.tokens--;
+		oq.send = oq_next(oq.send, &r, true);
+	}
+	if (NONE_ERROR == rc) {
+		rc = aws_iot_mqtt_batch_end();
+	} else {
+		aws_iot_mqtt_batch_end();
+	}
+	oq_skip_done();
+	os_recursive_mutex_put(&oq.lock);
+
+	/* The application's own publishes fill the window, the PUBACKs make room */
+	return (PUBLISH_INFLIGHT_WINDOW_FULL == rc) ? NONE_ERROR : rc;
+}
+
+uint32_t aws_iot_offline_queue_count(void) {
+	return oq.count;
+}
+
+uint32_t aws_iot_offline_queue_dropped(void) {
+	return oq.dropped;
+}
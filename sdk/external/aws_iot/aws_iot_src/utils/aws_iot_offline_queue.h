@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_offline_queue.h
+ * @brief Store and forward queue of MQTT publishes in flash
+ *
+ * Publishes made while the MQTT connection is down, e.g. after
+ * wlan_event_normal_link_lost(), are kept in a dedicated flash partition
+ * instead of failing with NETWORK_DISCONNECTED, and survive a reset. Once
+ * the connection is back aws_iot_offline_queue_drain(), called next to the
+ * yield, sends them in order, at most #AWS_IOT_OFFLINE_QUEUE_DRAIN_RATE per
+ * second with up to #AWS_IOT_OFFLINE_QUEUE_PIPELINE QoS1 publishes waiting
+ * for their PUBACK at a time, so that the backlog does not wait a round
+ * trip per message.
+ *
+ * The partition is written as a log around its sectors, every sector is
+ * erased once per turn around the partition. When it is full the oldest
+ * messages are dropped. Messages are removed from flash when they were
+ * sent (QoS0) or acknowledged (QoS1), one sent again after a reset or a
+ * failed publish can be a duplicate.
+ *
+ * The queue publishes on the default connection of aws_iot_mqtt_interface.h.
+ * Its functions can be called from several tasks.
+ */
+
+#ifndef AWS_IOT_OFFLINE_QUEUE_H_
+#define AWS_IOT_OFFLINE_QUEUE_H_
+
+#include <stdint.h>
+#include <flash.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_mqtt_interface.h"
+
+/**
+ * @brief Open the queue in a flash partition
+ *
+ * Finds the messages left in the partition, a partition holding anything
+ * else is erased as it is used. The partition has to be made of whole
+ * sectors of #AWS_IOT_OFFLINE_QUEUE_SECTOR_SIZE bytes, at least two.
+ * flash_drv_init() has to be called before.
+ *
+ * @param pFlash Partition of the queue
+ * @return NONE_ERROR, or OFFLINE_QUEUE_ERROR if the partition can not be used
+ */
+IoT_Error_t aws_iot_offline_queue_init(const flash_desc_t *pFlash);
+
+/**
+ * @brief Add a message to the queue
+ *
+ * @param pTopic Topic to publish on, at most 255 characters
+ * @param pPayload Payload of the message
+ * @param payloadLen Length of the payload, the topic and the payload take at most
+ *        #AWS_IOT_OFFLINE_QUEUE_MAX_MSG_LEN - 1 bytes
+ * @param qos QOS_0 or QOS_1
+ * @return NONE_ERROR, or OFFLINE_QUEUE_ERROR if the message is too large or could not be written
+ */
+IoT_Error_t aws_iot_offline_queue_put(const char *pTopic, const void *pPayload, uint32_t payloadLen,
+		QoSLevel qos);
+
+/**
+ * @brief Publish a message, or queue it when that is not possible
+ *
+ * When the connection is up and the queue is empty this is aws_iot_mqtt_publish(),
+ * otherwise, or if that publish fails, the message is added to the queue so that it
+ * goes out after the ones queued before it.
+ *
+ * @param pParams Publish parameters as for aws_iot_mqtt_publish()
+ * @return NONE_ERROR if the message was published or queued
+ */
+IoT_Error_t aws_iot_offline_queue_publish(MQTTPublishParams *pParams);
+
+/**
+ * @brief Send queued messages
+ *
+ * Returns without waiting: publishes what the rate and the PUBACKs of the earlier
+ * publishes allow. The PUBACKs are handled by the yield, call this after every yield
+ * while aws_iot_offline_queue_count() is not 0.
+ *
+ * @return NONE_ERROR, NETWORK_DISCONNECTED, or the error of a failed publish
+ */
+IoT_Error_t aws_iot_offline_queue_drain(void);
+
+/**
+ * @brief Number of messages in the queue, including the ones waiting for a PUBACK
+ */
+uint32_t aws_iot_offline_queue_count(void);
+
+/**
+ * @brief Number of messages dropped because the partition was full
+ */
+uint32_t aws_iot_offline_queue_dropped(void);
+
+#endif /* AWS_IOT_OFFLINE_QUEUE_H_ */
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_runtime_config.c
+ * @brief Sizes of the MQTT buffers and the Thing Shadow tables set at run time
+ *
+ * The arena is a bump allocator. Its users take their memory once, from
+ * the thread that connects or initializes the shadow, and keep it, so
+ * there is no lock and nothing is freed.
+ */
+
+#include <string.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_runtime_config.h"
+
+#define ARENA_ALIGN 8
+
+const AwsIotRuntimeConfig AwsIotRuntimeConfigDefault = {
+		.pArena = NULL,
+		.arenaLen = 0,
+		.mqttTxBufLen = AWS_IOT_MQTT_TX_BUF_LEN,
+#if AWS_IOT_MQTT_LOW_MEMORY
+		.mqttRxBufLen = AWS_IOT_MQTT_LOW_MEMORY_RX_BUF_LEN,
+#else
+		.mqttRxBufLen = AWS_IOT_MQTT_RX_BUF_LEN,
+#endif
+		.maxJsonTokens = MAX_JSON_TOKEN_EXPECTED,
+		.maxAcks = MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME,
+		.maxThingNames = MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME
+};
+
+static AwsIotRuntimeConfig config;
+static const AwsIotRuntimeConfig *pConfigInUse = &AwsIotRuntimeConfigDefault;
+static size_t arenaUsed;
+
+IoT_Error_t aws_iot_runtime_config_init(const AwsIotRuntimeConfig *pConfig) {
+	uintptr_t start;
+	size_t skip;
+
+	if (NULL == pConfig || NULL == pConfig->pArena) {
+		return NULL_VALUE_ERROR;
+	}
+	if (!AWS_IOT_RUNTIME_CONFIG) {
+		ERROR("Built without AWS_IOT_RUNTIME_CONFIG");
+		return GENERIC_ERROR;
+	}
+	if (0 != arenaUsed) {
+		ERROR("Runtime configuration set after its memory was taken");
+		return GENERIC_ERROR;
+	}
+	if (0 == pConfig->mqttRxBufLen || 0 == pConfig->maxJsonTokens || pConfig->maxJsonTokens > INT16_MAX
+			|| 0 == pConfig->maxAcks || pConfig->maxAcks > UINT16_MAX - 1
+			|| 0 == pConfig->maxThingNames || pConfig->maxThingNames > INT16_MAX
+			|| (!AWS_IOT_MQTT_LOW_MEMORY && 0 == pConfig->mqttTxBufLen)) {
+		return GENERIC_ERROR;
+	}
+
+	/* Align the start, the users hold structures with words in them */
+	start = (uintptr_t)pConfig->pArena;
+	skip = (ARENA_ALIGN - (start & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+	if (skip > pConfig->arenaLen) {
+		return GENERIC_ERROR;
+	}
+	config = *pConfig;
+	config.pArena = (void *)(start + skip);
+	config.arenaLen -= skip;
+	pConfigInUse = &config;
+
+	return NONE_ERROR;
+}
+
+const AwsIotRuntimeConfig *aws_iot_runtime_config(void) {
+	return pConfigInUse;
+}
+
+void *aws_iot_runtime_alloc(size_t len) {
+	void *p;
+
+	len = (len + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (NULL == config.pArena) {
+		ERROR("aws_iot_runtime_config_init() not called");
+		return NULL;
+	}
+	if (len > config.arenaLen - arenaUsed) {
+		ERROR("Runtime config arena of %u bytes too small, %u more needed",
+				(unsigned)config.arenaLen, (unsigned)(len - (config.arenaLen - arenaUsed)));
+		return NULL;
+	}
+
+	p = (uint8_t *)config.pArena + arenaUsed;
+	arenaUsed += len;
+	memset(p, 0, len);
+	return p;
+}
+
+size_t aws_iot_runtime_arena_used(void) {
+	return arenaUsed;
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_runtime_config.h
+ * @brief Sizes of the MQTT buffers and the Thing Shadow tables set at run time
+ *
+ * The MQTT buffers of the connections and the tables of the Thing Shadow
+ * are static arrays sized by aws_iot_config.h, the same for every product
+ * built from the SDK. With AWS_IOT_RUNTIME_CONFIG set they are taken from
+ * memory the application passes to aws_iot_runtime_config_init() instead,
+ * in the sizes it asks for, so that one build can run a lean product with
+ * small buffers and few pending shadow actions as well as one with large
+ * documents and many things in flight.
+ *
+ * The memory is handed out in order and never given back: the buffers of a
+ * connection are taken the first time it connects and kept for the later
+ * connections in its slot, the shadow tables by aws_iot_shadow_init(). The
+ * arena has to hold them all, aws_iot_runtime_arena_used() tells how much
+ * a configuration took once everything ran. Taking memory beyond the arena
+ * fails the connect or the shadow init with an error.
+ *
+ * aws_iot_runtime_config_init() is called once, before the first
+ * connection and the shadow init.
+ *
+ * @code
+ * static uint32_t arena[6 * 1024 / 4];
+ * AwsIotRuntimeConfig cfg = AwsIotRuntimeConfigDefault;
+ *
+ * cfg.pArena = arena;
+ * cfg.arenaLen = sizeof(arena);
+ * cfg.mqttTxBufLen = 512;
+ * cfg.mqttRxBufLen = 1024;
+ * cfg.maxAcks = 4;
+ * aws_iot_runtime_config_init(&cfg);
+ * @endcode
+ */
+
+#ifndef AWS_IOT_RUNTIME_CONFIG_H_
+#define AWS_IOT_RUNTIME_CONFIG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+
+/**
+ * @brief Sizes and memory of aws_iot_runtime_config_init()
+ */
+typedef struct {
+	void *pArena;			///< Memory the buffers and tables are taken from
+	size_t arenaLen;		///< Bytes of the arena
+	uint32_t mqttTxBufLen;	///< MQTT write buffer of a connection, not taken with AWS_IOT_MQTT_LOW_MEMORY
+	uint32_t mqttRxBufLen;	///< MQTT read buffer of a connection, the one of the packets too big for the TLS read buffer with AWS_IOT_MQTT_LOW_MEMORY
+	uint16_t maxJsonTokens;	///< Tokens of a shadow document and registered delta keys, up to 32767
+	uint16_t maxAcks;		///< Shadow actions waiting for their ack, up to 65534
+	uint16_t maxThingNames;	///< Things with shadow actions at a time, up to 32767
+} AwsIotRuntimeConfig;
+
+/**
+ * @brief The sizes of aws_iot_config.h, without an arena
+ */
+extern const AwsIotRuntimeConfig AwsIotRuntimeConfigDefault;
+
+/**
+ * @brief Set the sizes and the memory they are taken from
+ *
+ * @param pConfig Configuration, copied
+ * @return NONE_ERROR, NULL_VALUE_ERROR without an arena, or GENERIC_ERROR
+ * for a size out of range, a build without AWS_IOT_RUNTIME_CONFIG or memory
+ * already taken
+ */
+IoT_Error_t aws_iot_runtime_config_init(const AwsIotRuntimeConfig *pConfig);
+
+/**
+ * @brief The configuration in use, AwsIotRuntimeConfigDefault before the init
+ */
+const AwsIotRuntimeConfig *aws_iot_runtime_config(void);
+
+/**
+ * @brief Take memory from the arena, used by the MQTT wrapper and the shadow
+ *
+ * @param len Bytes, rounded up to 8
+ * @return Zeroed memory aligned to 8 bytes, NULL if the arena is too small
+ * or there is none
+ */
+void *aws_iot_runtime_alloc(size_t len);
+
+/**
+ * @brief Bytes of the arena taken so far
+ */
+size_t aws_iot_runtime_arena_used(void);
+
+#endif /* AWS_IOT_RUNTIME_CONFIG_H_ */
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_wifi_ps.c
+ * @brief Wi-Fi IEEE power save scheduled with the MQTT traffic
+ *
+ * The awake share covers the time since the last read. With events it is
+ * the time between an exit and the next enter, the part of a period still
+ * going is counted up to the read. Without events it is one beacon wakeup
+ * of AWS_IOT_WIFI_PS_BEACON_WAKE_US per listen interval, plus
+ * AWS_IOT_WIFI_PS_TX_WAKE_MS per send window that sent something.
+ */
+
+#include <stdbool.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+#include <wm_utils.h>
+#include <metrics.h>
+#include <energy_stats.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_log.h"
+#include "aws_iot_mqtt_service.h"
+#include "aws_iot_wifi_ps.h"
+
+/* Power save of the WLAN connection manager, in the SDK library. The
+ * listen interval is in beacons */
+int pm_ieeeps_hs_cfg(bool enabled, unsigned int wakeup_conditions);
+void wlan_configure_listen_interval(int listen_interval);
+
+#define WIFI_PS_BEACON_MS 102	/* 100 TU of 1.024 ms */
+
+static struct {
+	uint32_t windowMs;
+	bool metricRegistered;
+	/* Since the last read */
+	unsigned since;
+	uint32_t windows;
+	/* From the events */
+	bool haveEvents;
+	bool awake;
+	unsigned awakeSince;
+	unsigned awakeTicks;
+} ps;
+
+static uint32_t ps_metric_read(void *ctx) {
+	return aws_iot_wifi_ps_awake_permille();
+}
+
+IoT_Error_t aws_iot_wifi_ps_start(const WifiPsParams *pParams) {
+	uint32_t beaconMs, dtim, listen;
+
+	if (NULL == pParams || 0 == pParams->maxLatencyMs) {
+		return NULL_VALUE_ERROR;
+	}
+
+	beaconMs = pParams->beaconMs ? pParams->beaconMs : WIFI_PS_BEACON_MS;
+	dtim = pParams->dtimPeriod ? pParams->dtimPeriod : 1;
+	/* Whole DTIM periods, so that the multicast frames are not missed */
+	listen = pParams->maxLatencyMs / (beaconMs * dtim) * dtim;
+	if (listen < dtim) {
+		listen = dtim;
+	}
+
+	wlan_configure_listen_interval((int)listen);
+	if (WM_SUCCESS != pm_ieeeps_hs_cfg(true, 0)) {
+		ERROR("Power save could not be turned on");
+		return GENERIC_ERROR;
+	}
+
+	ps.windowMs = listen * beaconMs;
+	ps.since = os_ticks_get();
+	ps.windows = aws_iot_mqtt_service_windows();
+	ps.awakeTicks = 0;
+	ps.awakeSince = ps.since;
+	aws_iot_mqtt_service_set_window(ps.windowMs);
+	INFO("Power save on, listen interval %u beacons, window %u ms", listen, ps.windowMs);
+
+	if (!ps.metricRegistered) {
+		if (0 > metrics_gauge("radio_awake_pm", ps_metric_read, NULL)) {
+			WARN("Radio awake metric not registered");
+		}
+		ps.metricRegistered = true;
+	}
+
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_wifi_ps_stop(void) {
+	if (0 == ps.windowMs) {
+		return NONE_ERROR;
+	}
+
+	aws_iot_mqtt_service_set_window(0);
+	ps.windowMs = 0;
+	if (WM_SUCCESS != pm_ieeeps_hs_cfg(false, 0)) {
+		ERROR("Power save could not be turned off");
+		return GENERIC_ERROR;
+	}
+	ENERGY_STATS_RADIO(ENERGY_RADIO_ACTIVE);
+
+	return NONE_ERROR;
+}
+
+uint32_t aws_iot_wifi_ps_window_ms(void) {
+	return ps.windowMs;
+}
+
+void aws_iot_wifi_ps_radio_event(bool awake) {
+	unsigned long state;
+	unsigned now = os_ticks_get();
+
+	state = os_mask_syscall_interrupts();
+	if (ps.awake && !awake) {
+		ps.awakeTicks += now - ps.awakeSince;
+	} else if (!ps.awake && awake) {
+		ps.awakeSince = now;
+	}
+	ps.awake = awake;
+	ps.haveEvents = true;
+	os_unmask_syscall_interrupts(state);
+	ENERGY_STATS_RADIO(awake ? ENERGY_RADIO_ACTIVE : ENERGY_RADIO_PS);
+}
+
+uint32_t aws_iot_wifi_ps_awake_permille(void) {
+	unsigned long state;
+	unsigned now = os_ticks_get();
+	uint32_t elapsedMs, awakeMs, windows;
+
+	if (0 == ps.windowMs) {
+		return 1000;
+	}
+
+	elapsedMs = os_ticks_to_msec(now - ps.since);
+	windows = aws_iot_mqtt_service_windows();
+	if (0 == elapsedMs) {
+		return 0;
+	}
+
+	state = os_mask_syscall_interrupts();
+	if (ps.haveEvents) {
+		if (ps.awake) {
+			ps.awakeTicks += now - ps.awakeSince;
+			ps.awakeSince = now;
+		}
+		awakeMs = os_ticks_to_msec(ps.awakeTicks);
+	} else {
+		awakeMs = (uint32_t)((uint64_t)elapsedMs * AWS_IOT_WIFI_PS_BEACON_WAKE_US / 1000 / ps.windowMs)
+			+ (windows - ps.windows) * AWS_IOT_WIFI_PS_TX_WAKE_MS;
+	}
+	ps.awakeTicks = 0;
+	ps.since = now;
+	ps.windows = windows;
+	os_unmask_syscall_interrupts(state);
+
+	return (awakeMs >= elapsedMs) ? 1000 : (uint32_t)((uint64_t)awakeMs * 1000 / elapsedMs);
+}
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file aws_iot_wifi_ps.h
+ * @brief Wi-Fi IEEE power save scheduled with the MQTT traffic
+ *
+ * In IEEE power save the radio sleeps between beacons and wakes every
+ * listen interval to see whether the access point holds frames for it,
+ * and whenever the device transmits. aws_iot_wifi_ps_start() picks the
+ * longest listen interval, a whole number of DTIM periods, that keeps a
+ * message to the device within the command latency the application
+ * accepts, and turns power save on.
+ *
+ * The same period is the send window of the MQTT service task, see
+ * aws_iot_mqtt_service_set_window(): bulk messages are held until the
+ * window and go out together, with a keepalive ping that would be due
+ * before the next window, instead of waking the radio one at a time.
+ * Commands and alarms are sent at once and take the bulk messages along.
+ * The keepalive interval of the connection should be a few windows long.
+ *
+ * The share of the time the radio is awake, the proxy of its average
+ * current, is reported as the gauge radio_awake_pm of metrics.h, in per
+ * mille. It is measured from the power save events of the WLAN driver
+ * the application passes to aws_iot_wifi_ps_radio_event(), or estimated
+ * from the wakeups for beacons and the send windows used when it passes
+ * none. The events also change the radio state of energy_stats.h.
+ *
+ * The listen interval is sent to the access point when associating, so
+ * start power save before connecting to it.
+ */
+
+#ifndef AWS_IOT_WIFI_PS_H_
+#define AWS_IOT_WIFI_PS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+
+/**
+ * @brief Parameters of aws_iot_wifi_ps_start()
+ */
+typedef struct {
+	uint32_t maxLatencyMs;	///< Longest a message to the device may wait for the radio to wake
+	uint32_t beaconMs;		///< Beacon interval of the access point, 0 for the usual 100 TU
+	uint8_t dtimPeriod;		///< DTIM period of the access point, in beacons, 0 for 1
+} WifiPsParams;
+
+/**
+ * @brief Turn power save on and send the MQTT traffic in its wake windows
+ *
+ * @param pParams Parameters
+ * @return NONE_ERROR, NULL_VALUE_ERROR, or GENERIC_ERROR if the WLAN driver refused
+ */
+IoT_Error_t aws_iot_wifi_ps_start(const WifiPsParams *pParams);
+
+/**
+ * @brief Turn power save off and send the MQTT traffic at once again
+ *
+ * @return NONE_ERROR, or GENERIC_ERROR if the WLAN driver refused
+ */
+IoT_Error_t aws_iot_wifi_ps_stop(void);
+
+/**
+ * @brief Time between two wake windows, 0 while power save is off
+ */
+uint32_t aws_iot_wifi_ps_window_ms(void);
+
+/**
+ * @brief Tell that the radio woke up or went to sleep
+ *
+ * Called from the WLAN event handler of the application on the power save
+ * exit and enter events. Can not be called from an interrupt.
+ *
+ * @param awake true on a power save exit
+ */
+void aws_iot_wifi_ps_radio_event(bool awake);
+
+/**
+ * @brief Share of the time the radio was awake since the last call
+ *
+ * @return Per mille of the time, 1000 while power save is off
+ */
+uint32_t aws_iot_wifi_ps_awake_permille(void);
+
+#endif /* AWS_IOT_WIFI_PS_H_ */
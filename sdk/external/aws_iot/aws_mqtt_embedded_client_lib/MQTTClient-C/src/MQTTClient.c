@@ -16,49 +16,428 @@
 
 #include "MQTTClient.h"
 #include <string.h>
+#include <cycle_trace.h>
 
 static void MQTTForceDisconnect(Client *c);
+static void failInflightPublishes(Client *c, MQTTReturnCode rc);
+static void inflightPublishTimedOut(TimerWheelEntry *pEntry, void *pContext);
+static uint8_t isReceiveMaximumReached(Client *c);
+static void completeInflightPublish(Client *c, uint32_t index, MQTTReturnCode rc);
+static void completeAckWaiter(Client *c, uint8_t packetType, uint16_t packetId, MQTTReturnCode rc);
+MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type);
+
+#if AWS_IOT_MQTT_STATS
+#define STATS_ADD(c, field, n) ((c)->stats.field += (n))
+
+static void histogramAdd(MQTTHistogram *h, uint64_t us) {
+    uint32_t value = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    uint32_t bucket = (value < 2) ? 0 : (uint32_t)(31 - __builtin_clz(value));
+
+    if(MQTT_STATS_HISTOGRAM_BUCKETS <= bucket) {
+        bucket = MQTT_STATS_HISTOGRAM_BUCKETS - 1;
+    }
+    if(0 == h->count || value < h->minUs) {
+        h->minUs = value;
+    }
+    if(value > h->maxUs) {
+        h->maxUs = value;
+    }
+    h->count++;
+    h->sumUs += value;
+    h->buckets[bucket]++;
+}
+#else
+#define STATS_ADD(c, field, n)
+#endif
+static MQTTReturnCode readStreamedPublish(Client *c, Timer *timer, uint32_t len, uint32_t rem_len);
+
+/* The reader holds readLock while it reads the network and hands the replies
+ * to the threads waiting in a blocking command, stateLock covers what the
+ * reader and the commands share, writeLock the serialization of a packet in
+ * buf and its write. A thread waiting for a reply holds no lock, so commands
+ * from other threads go out meanwhile */
+#if AWS_IOT_MQTT_THREAD_SAFE
+#define LOCK(c, lock) mutex_lock(&((c)->lock), THREADS_WAIT_FOREVER)
+#define UNLOCK(c, lock) mutex_unlock(&((c)->lock))
+#else
+#define LOCK(c, lock)
+#define UNLOCK(c, lock)
+#endif
+
+/* Become the reader, 0 on success */
+static int lockReader(Client *c, uint32_t timeout_ms) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    if(0 != mutex_lock(&(c->readLock), timeout_ms)) {
+        return -1;
+    }
+    c->readerThread = thread_self();
+    c->readDepth++;
+#endif
+    return 0;
+}
+
+/* Stop reading. The threads still waiting for a reply are woken up, one of
+ * them reads in turn */
+static void unlockReader(Client *c) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    uint8_t isLast;
+    uint32_t i;
+
+    isLast = (0 == --c->readDepth);
+    if(isLast) {
+        c->readerThread = NULL;
+    }
+    mutex_unlock(&(c->readLock));
+
+    if(isLast) {
+        LOCK(c, stateLock);
+        for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+            if(0 != c->ackWaiters[i].packetType && 0 == c->ackWaiters[i].isDone) {
+                signal_give(&(c->ackWaiters[i].signal));
+            }
+        }
+        UNLOCK(c, stateLock);
+    }
+#endif
+}
+
+static uint8_t isReader(Client *c) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    return (uint8_t)(c->readerThread == thread_self());
+#else
+    return 1;
+#endif
+}
+
+static uint8_t isTxBatchOwner(Client *c) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    return (uint8_t)(c->txBatchThread == thread_self());
+#else
+    return 1;
+#endif
+}
+
+/* Writes are collected in an open MQTTBatchBegin() batch of the writing
+ * thread, and those of the reader during MQTTYieldUntilEvent() */
+static uint8_t isTxBatched(Client *c) {
+    return (uint8_t)((0 < c->txBatchDepth && isTxBatchOwner(c)) || (1 == c->isYieldBatchOpen && isReader(c)));
+}
+
+/* Open a batch, called with writeLock held. One thread batches at a time,
+ * the writes of the others go out at once and take what was collected so
+ * far along */
+static void txBatchBegin(Client *c) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    if(0 == c->txBatchDepth) {
+        c->txBatchThread = thread_self();
+    } else if(!isTxBatchOwner(c)) {
+        c->txBatchOthers++;
+        return;
+    }
+#endif
+    c->txBatchDepth++;
+}
+
+/* Close a batch of txBatchBegin(), called with writeLock held. 0 if the
+ * calling thread has none open */
+static uint8_t txBatchEnd(Client *c) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    if(0 == c->txBatchDepth || !isTxBatchOwner(c)) {
+        if(0 == c->txBatchOthers) {
+            return 0;
+        }
+        c->txBatchOthers--;
+        return 1;
+    }
+    if(0 == --c->txBatchDepth) {
+        c->txBatchThread = NULL;
+    }
+    return 1;
+#else
+    if(0 == c->txBatchDepth) {
+        return 0;
+    }
+    c->txBatchDepth--;
+    return 1;
+#endif
+}
 
 void NewMessageData(MessageData *md, MQTTString *aTopicName, MQTTMessage *aMessage, pApplicationHandler_t applicationHandler) {
     md->topicName = aTopicName;
     md->message = aMessage;
     md->applicationHandler = applicationHandler;
+    md->payloadOffset = 0;
+    md->totalPayloadLen = (uint32_t)aMessage->payloadlen;
+    md->isLastChunk = 1;
+    md->dispatch = 0;
+    md->client = NULL;
 }
 
 uint16_t getNextPacketId(Client *c) {
-    return c->nextPacketId = (uint16_t)((MAX_PACKET_ID == c->nextPacketId) ? 1 : (c->nextPacketId + 1));
-}
+    uint16_t id;
 
-MQTTReturnCode sendPacket(Client *c, uint32_t length, Timer *timer) {
-    if(NULL == c || NULL == timer) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
+    LOCK(c, stateLock);
+    id = c->nextPacketId = (uint16_t)((MAX_PACKET_ID == c->nextPacketId) ? 1 : (c->nextPacketId + 1));
+    UNLOCK(c, stateLock);
+    return id;
+}
 
+static MQTTReturnCode writeBuffer(Client *c, unsigned char *buf, uint32_t length, Timer *timer) {
     int32_t sentLen = 0;
     uint32_t sent = 0;
 
-    if(length >= c->bufSize) {
-    	return MQTTPACKET_BUFFER_TOO_SHORT;
-    }
-
     while(sent < length && !expired(timer)) {
-        sentLen = c->networkStack.mqttwrite(&(c->networkStack), &c->buf[sent], (int)length, left_ms(timer));
+        sentLen = c->networkStack.mqttwrite(&(c->networkStack), &buf[sent], (int)(length - sent), left_ms(timer));
         if(sentLen < 0) {
             /* there was an error writing the data */
             break;
         }
         sent = sent + (uint32_t)sentLen;
     }
+    STATS_ADD(c, bytesOut, sent);
 
     if(sent == length) {
-        /* record the fact that we have successfully sent the packet */
-        //countdown(&c->pingTimer, c->keepAliveInterval);
         return MQTT_SUCCESS;
     }
 
     return MQTT_FAILURE;
 }
 
+/* Point buf at where the next packet is serialized. In the low memory mode
+ * that is the free part of the write buffer of the network layer, the packet
+ * is written from there without being copied. Called with writeLock held */
+static void acquireTxBuf(Client *c) {
+#if AWS_IOT_MQTT_LOW_MEMORY
+    int len = 0;
+
+    c->buf = NULL;
+    c->bufSize = 0;
+    if(NULL != c->networkStack.mqttwritebuf) {
+        c->buf = c->networkStack.mqttwritebuf(&(c->networkStack), AWS_IOT_MQTT_LOW_MEMORY_TX_MIN, &len);
+        c->bufSize = (size_t)len;
+    }
+#else
+    (void)c;
+#endif
+}
+
+/* Send what the network layer collected since txCork() */
+static MQTTReturnCode flushTxBatch(Client *c, Timer *timer) {
+    if(0 == c->isTxCorked) {
+        return MQTT_SUCCESS;
+    }
+
+    c->isTxCorked = 0;
+    if(0 > c->networkStack.mqttflush(&(c->networkStack), left_ms(timer))) {
+        return MQTT_FAILURE;
+    }
+
+    return MQTT_SUCCESS;
+}
+
+static void txCork(Client *c) {
+    if(0 == c->isTxCorked && NULL != c->networkStack.mqttcork) {
+        c->networkStack.mqttcork(&(c->networkStack));
+        c->isTxCorked = 1;
+    }
+}
+
+/* While a batch is open the network layer collects the writes and encrypts
+ * them together, a packet waiting for a reply goes out with the batch when
+ * waitfor() starts reading */
+static MQTTReturnCode sendBuffer(Client *c, unsigned char *buf, uint32_t length, Timer *timer) {
+    MQTTReturnCode rc;
+    uint8_t isBatched = isTxBatched(c);
+
+    if(isBatched) {
+        txCork(c);
+    }
+
+    rc = writeBuffer(c, buf, length, timer);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
+    /* The packet tells the broker the client is alive, no ping needed
+     * until the link has been idle for a whole interval */
+    if(KEEPALIVE_ON_IDLE == c->keepAlivePolicy) {
+        countdown(&c->pingTimer, c->keepAliveInterval);
+    }
+
+    if(isBatched) {
+        return rc;
+    }
+
+    return flushTxBatch(c, timer);
+}
+
+MQTTReturnCode sendPacket(Client *c, uint32_t length, Timer *timer) {
+    MQTTReturnCode rc;
+
+    if(NULL == c || NULL == timer) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    if(length >= c->bufSize) {
+        STATS_ADD(c, oversizedRejected, 1);
+    	return MQTTPACKET_BUFFER_TOO_SHORT;
+    }
+
+#if AWS_IOT_MQTT_STATS
+    uint64_t startUs = timer_now_us();
+#endif
+    CYCLE_TRACE_BEGIN(CYCLE_TRACE_MQTT_SEND_PACKET);
+    rc = sendBuffer(c, c->buf, length, timer);
+    CYCLE_TRACE_END(CYCLE_TRACE_MQTT_SEND_PACKET);
+#if AWS_IOT_MQTT_STATS
+    if(MQTT_SUCCESS == rc) {
+        c->stats.packetsOut[c->buf[0] >> 4]++;
+        histogramAdd(&(c->stats.sendDuration), timer_now_us() - startUs);
+    }
+#endif
+    return rc;
+}
+
+#if 0 < MAX_TOPIC_ALIASES
+/* Alias of a topic on an MQTT 5 connection, 0 if it gets none. *pIsNew is
+ * set when the alias is not assigned to the topic yet, the publish carries
+ * the topic along to assign it and useTopicAlias() records it once the
+ * publish is serialized. Called with writeLock held */
+static uint16_t findTopicAlias(Client *c, const char *topic, size_t len, uint8_t *pIsNew) {
+    uint32_t i, count, lru = 0;
+
+    *pIsNew = 0;
+    count = (MAX_TOPIC_ALIASES < c->topicAliasMaximum) ? MAX_TOPIC_ALIASES : c->topicAliasMaximum;
+    if(0 == count || 0 == len || TOPIC_ALIAS_MAX_LEN < len) {
+        return 0;
+    }
+
+    for(i = 0; i < count; ++i) {
+        if(len == c->topicAliases[i].len && 0 == memcmp(c->topicAliases[i].topic, topic, len)) {
+            return (uint16_t)(i + 1);
+        }
+        /* Free ones have never been used */
+        if(c->topicAliases[i].lastUsed < c->topicAliases[lru].lastUsed) {
+            lru = i;
+        }
+    }
+
+    *pIsNew = 1;
+    return (uint16_t)(lru + 1);
+}
+
+static void useTopicAlias(Client *c, uint16_t alias, const char *topic, size_t len, uint8_t isNew) {
+    struct TopicAliases *pAlias = &c->topicAliases[alias - 1];
+
+    if(isNew) {
+        memcpy(pAlias->topic, topic, len);
+        pAlias->len = (uint16_t)len;
+    }
+    pAlias->lastUsed = ++c->aliasClock;
+}
+
+/* The broker forgets the aliases of a connection */
+static void resetTopicAliases(Client *c) {
+    memset(c->topicAliases, 0, sizeof(c->topicAliases));
+    c->aliasClock = 0;
+}
+#endif
+
+/* Publish header of an MQTT 5 connection. A topic that has an alias is
+ * left out, the 2 byte alias stands for it. Called with writeLock held */
+static MQTTReturnCode serializeV5PublishHeader(Client *c, MQTTString topic, const MQTTPublishTemplate *tmpl,
+                                               MQTTMessage *message, uint32_t *pLen) {
+    MQTTString name = MQTTString_initializer;
+    QoS qos = message->qos;
+    uint8_t retained = message->retained;
+    uint16_t alias = 0;
+    uint8_t isNew = 0;
+    MQTTReturnCode rc;
+
+    if(NULL != tmpl) {
+        name.lenstring.data = (char *)&tmpl->topic[2];
+        name.lenstring.len = tmpl->topicLen;
+        qos = (QoS)((tmpl->header >> 1) & 0x03);
+        retained = tmpl->header & 0x01;
+    } else if(0 < topic.lenstring.len) {
+        name = topic;
+    } else if(NULL != topic.cstring) {
+        name.lenstring.data = topic.cstring;
+        name.lenstring.len = strlen(topic.cstring);
+    }
+
+#if 0 < MAX_TOPIC_ALIASES
+    alias = findTopicAlias(c, name.lenstring.data, name.lenstring.len, &isNew);
+#endif
+    if(0 != alias && !isNew) {
+        MQTTString noTopic = MQTTString_initializer;
+        rc = MQTTV5Serialize_publishHeader(c->buf, c->bufSize, 0, qos, retained, message->id,
+                  noTopic, alias, message->payloadlen, pLen);
+    } else {
+        rc = MQTTV5Serialize_publishHeader(c->buf, c->bufSize, 0, qos, retained, message->id,
+                  name, alias, message->payloadlen, pLen);
+    }
+#if 0 < MAX_TOPIC_ALIASES
+    if(MQTT_SUCCESS == rc && 0 != alias) {
+        useTopicAlias(c, alias, name.lenstring.data, name.lenstring.len, isNew);
+    }
+#endif
+
+    return rc;
+}
+
+/* Send a publish packet. A payload that fits in c->buf behind the header is
+ * copied there and the packet goes out in one write. Larger ones are written
+ * straight from the application buffer after the header, so they are not
+ * limited by the size of c->buf, in a batch so that the header shares a TLS
+ * record with the payload. Called with writeLock held */
+static MQTTReturnCode sendPublish(Client *c, MQTTString topic, const MQTTPublishTemplate *tmpl,
+                                  MQTTMessage *message, Timer *timer) {
+    uint32_t len = 0;
+    MQTTReturnCode rc, flushRc;
+
+    if(0 < message->payloadlen && NULL == message->payload) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    acquireTxBuf(c);
+    if(5 == c->options.MQTTVersion) {
+        rc = serializeV5PublishHeader(c, topic, tmpl, message, &len);
+    } else if(NULL != tmpl) {
+        rc = MQTTSerialize_publishHeaderFromTemplate(c->buf, c->bufSize, tmpl, message->id,
+                  message->payloadlen, &len);
+    } else {
+        rc = MQTTSerialize_publishHeader(c->buf, c->bufSize, 0, message->qos, message->retained, message->id,
+                  topic, message->payloadlen, &len);
+    }
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
+    if(len + message->payloadlen < c->bufSize) {
+        if(0 < message->payloadlen) {
+            memcpy(&c->buf[len], message->payload, message->payloadlen);
+        }
+        return sendPacket(c, len + (uint32_t)message->payloadlen, timer);
+    }
+
+    txBatchBegin(c);
+    rc = sendPacket(c, len, timer);
+    if(MQTT_SUCCESS == rc) {
+        rc = sendBuffer(c, (unsigned char *)message->payload, (uint32_t)message->payloadlen, timer);
+    }
+    (void)txBatchEnd(c);
+
+    if(!isTxBatched(c)) {
+        flushRc = flushTxBatch(c, timer);
+        if(MQTT_SUCCESS == rc) {
+            rc = flushRc;
+        }
+    }
+
+    return rc;
+}
+
 void copyMQTTConnectData(MQTTPacket_connectData *destination, MQTTPacket_connectData *source) {
     if(NULL == destination || NULL == source) {
         return;
@@ -76,31 +455,134 @@ void copyMQTTConnectData(MQTTPacket_connectData *destination, MQTTPacket_connect
     destination->cleansession = source->cleansession;
 }
 
+#if AWS_IOT_MQTT_THREAD_SAFE
+static void destroyLocks(Client *c) {
+    uint32_t i;
+
+    mutex_destroy(&(c->readLock));
+    mutex_destroy(&(c->stateLock));
+    mutex_destroy(&(c->writeLock));
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        signal_destroy(&(c->ackWaiters[i].signal));
+    }
+    signal_destroy(&(c->ackWaiterFreed));
+}
+
+static MQTTReturnCode createLocks(Client *c) {
+    uint32_t i;
+
+    if(0 != mutex_init(&(c->readLock)) || 0 != mutex_init(&(c->stateLock))
+       || 0 != mutex_init(&(c->writeLock))) {
+        destroyLocks(c);
+        return MQTT_FAILURE;
+    }
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        if(0 != signal_init(&(c->ackWaiters[i].signal))) {
+            destroyLocks(c);
+            return MQTT_FAILURE;
+        }
+    }
+    if(0 != signal_init(&(c->ackWaiterFreed))) {
+        destroyLocks(c);
+        return MQTT_FAILURE;
+    }
+
+    return MQTT_SUCCESS;
+}
+#endif
+
 MQTTReturnCode MQTTClient(Client *c, uint32_t commandTimeoutMs,
                           unsigned char *buf, size_t bufSize, unsigned char *readbuf,
-                          size_t readBufSize, uint8_t enableAutoReconnect,
+                          size_t readBufSize, MessageHandlers *messageHandlers,
+                          uint32_t messageHandlerCount, TopicTrieNode *topicTrieNodes,
+                          uint32_t topicTrieNodeCount, uint8_t enableAutoReconnect,
                           networkInitHandler_t networkInitHandler,
                           TLSConnectParams *tlsConnectParams) {
-    if(NULL == c || NULL == tlsConnectParams || NULL == buf || NULL == readbuf
-       || NULL == networkInitHandler) {
+    if(NULL == c || NULL == tlsConnectParams || (NULL == buf && !AWS_IOT_MQTT_LOW_MEMORY) || NULL == readbuf
+       || NULL == messageHandlers || NULL == topicTrieNodes || NULL == networkInitHandler) {
         return MQTT_NULL_VALUE_ERROR;
     }
 
+    /* The trie keeps handler and node indexes in 16 bits */
+    if(0 == messageHandlerCount || INT16_MAX < messageHandlerCount
+       || 0 == topicTrieNodeCount || INT16_MAX < topicTrieNodeCount) {
+        return MQTT_FAILURE;
+    }
+
     uint32_t i;
     MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
 
-    for(i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+    /* Called again for a clean session, the locks are kept */
+    if(0 == c->areLocksCreated) {
+        if(MQTT_SUCCESS != createLocks(c)) {
+            return MQTT_FAILURE;
+        }
+        c->areLocksCreated = 1;
+    }
+    c->readerThread = NULL;
+    c->readDepth = 0;
+#endif
+
+    /* Free handlers are handed out lowest index first */
+    c->messageHandlers = messageHandlers;
+    c->messageHandlerCount = messageHandlerCount;
+    for(i = 0; i < messageHandlerCount; ++i) {
         c->messageHandlers[i].topicFilter = NULL;
         c->messageHandlers[i].fp = NULL;
         c->messageHandlers[i].applicationHandler = NULL;
         c->messageHandlers[i].qos = 0;
-    }
+        c->messageHandlers[i].isStreaming = 0;
+        c->messageHandlers[i].dispatch = 0;
+        c->messageHandlers[i].isLocal = 0;
+        c->messageHandlers[i].nextFree = (i + 1 < messageHandlerCount) ? (uint16_t)(i + 1) : NO_MESSAGE_HANDLER;
+    }
+    c->firstFreeHandler = 0;
+    MQTTTopicTrieInit(&(c->topicTrie), topicTrieNodes, (int16_t)topicTrieNodeCount);
+    c->firstWildcardHandler = messageHandlerCount;
+
+    timerWheelInit(&(c->timerWheel));
+    for(i = 0; i < MAX_INFLIGHT_PUBLISH; ++i) {
+        c->inflightPublishes[i].isFree = 1;
+        c->inflightPublishes[i].fp = NULL;
+        c->inflightPublishes[i].applicationHandler = NULL;
+        c->inflightPublishes[i].pContext = NULL;
+        timerWheelInitEntry(&(c->inflightPublishes[i].ackTimer), inflightPublishTimedOut, c);
+    }
+    c->inflightPublishCount = 0;
+    memset(c->qos2Received, 0, sizeof(c->qos2Received));
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        c->ackWaiters[i].packetType = 0;
+        c->ackWaiters[i].isDone = 0;
+    }
+    c->txBatchDepth = 0;
+#if AWS_IOT_MQTT_THREAD_SAFE
+    c->txBatchThread = NULL;
+    c->txBatchOthers = 0;
+#endif
+    c->isYieldBatchOpen = 0;
+    c->isSessionPresent = 0;
+    c->isTxCorked = 0;
+    c->keepAlivePolicy = KEEPALIVE_ON_IDLE;
+    c->receiveMaximum = 65535;
+    c->topicAliasMaximum = 0;
+#if 0 < MAX_TOPIC_ALIASES
+    resetTopicAliases(c);
+#endif
+#if AWS_IOT_MQTT_STATS
+    memset(&(c->stats), 0, sizeof(c->stats));
+    c->disconnectedUs = 0;
+#endif
 
     c->commandTimeoutMs = commandTimeoutMs;
     c->buf = buf;
     c->bufSize = bufSize;
     c->readbuf = readbuf;
     c->readBufSize = readBufSize;
+#if AWS_IOT_MQTT_LOW_MEMORY
+    c->scratchbuf = readbuf;
+    c->scratchBufSize = readBufSize;
+#endif
     c->isConnected = 0;
     c->isPingOutstanding = 0;
     c->wasManuallyDisconnected = 0;
@@ -119,14 +601,17 @@ MQTTReturnCode MQTTClient(Client *c, uint32_t commandTimeoutMs,
     c->tlsConnectParams.pRootCALocation = tlsConnectParams->pRootCALocation;
     c->tlsConnectParams.timeout_ms = tlsConnectParams->timeout_ms;
     c->tlsConnectParams.ServerVerificationFlag = tlsConnectParams->ServerVerificationFlag;
+    c->tlsConnectParams.trafficClass = tlsConnectParams->trafficClass;
 
     InitTimer(&(c->pingTimer));
+    InitTimer(&(c->pingRespTimer));
     InitTimer(&(c->reconnectDelayTimer));
+    InitTimer(&(c->stableTimer));
 
     return MQTT_SUCCESS;
 }
 
-MQTTReturnCode decodePacket(Client *c, uint32_t *value, uint32_t timeout) {
+AWS_IOT_HOT_FUNC MQTTReturnCode decodePacket(Client *c, uint32_t *value, uint32_t timeout) {
     if(NULL == c || NULL == value) {
         return MQTT_NULL_VALUE_ERROR;
     }
@@ -159,180 +644,379 @@ MQTTReturnCode decodePacket(Client *c, uint32_t *value, uint32_t timeout) {
     return MQTT_SUCCESS;
 }
 
-MQTTReturnCode readPacket(Client *c, Timer *timer, uint8_t *packet_type) {
-    if(NULL == c || NULL == timer) {
-        return MQTT_NULL_VALUE_ERROR;
+/* Read and discard the remaining bytes of a packet that can not be handled */
+static void drainPacket(Client *c, Timer *timer, uint32_t rem_len) {
+    uint32_t bytes_to_be_read;
+    int32_t ret_val;
+
+    while(0 < rem_len) {
+        bytes_to_be_read = (rem_len < c->readBufSize) ? rem_len : (uint32_t)c->readBufSize;
+        ret_val = c->networkStack.mqttread(&(c->networkStack), c->readbuf, (int)bytes_to_be_read, left_ms(timer));
+        if(0 >= ret_val) {
+            break;
+        }
+        rem_len -= (uint32_t)ret_val;
     }
+}
 
-    MQTTHeader header = {0};
-    uint32_t len = 0;
-    uint32_t rem_len = 0;
-    uint32_t total_bytes_read = 0;
-    uint32_t bytes_to_be_read = 0;
-	int32_t ret_val = 0;
+/* Publish packets too big for the read buffer can still be delivered in chunks
+ * to a streaming subscription, anything else is dropped silently. The fixed
+ * header (len bytes) is in c->readbuf */
+static MQTTReturnCode readOversizedPacket(Client *c, Timer *timer, uint8_t packet_type, uint32_t len,
+                                          uint32_t rem_len) {
+    MQTTReturnCode rc;
 
-    /* 1. read the header byte.  This has the packet type in it */
-    if(1 != c->networkStack.mqttread(&(c->networkStack), c->readbuf, 1, left_ms(timer))) {
-        /* If a network disconnect has occurred it would have been caught by keepalive already.
-         * If nothing is found at this point means there was nothing to read. Not 100% correct,
-         * but the only way to be sure is to pass proper error codes from the network stack
-         * which the mbedtls/openssl implementations do not return */
-        return MQTT_NOTHING_TO_READ;
+    if(PUBLISH == packet_type) {
+        rc = readStreamedPublish(c, timer, len, rem_len);
+        if(MQTT_SUCCESS == rc) {
+            /* The packet was consumed and delivered, nothing left for cycle() to handle */
+            return MQTT_NOTHING_TO_READ;
+        }
+        if(MQTTPACKET_BUFFER_TOO_SHORT == rc) {
+            STATS_ADD(c, oversizedDropped, 1);
+        }
+        return rc;
     }
+    drainPacket(c, timer, rem_len);
+    STATS_ADD(c, oversizedDropped, 1);
+    return MQTTPACKET_BUFFER_TOO_SHORT;
+}
+
+/* Reads the rest of a packet once its header byte is in c->readbuf */
+static AWS_IOT_HOT_FUNC MQTTReturnCode readPacketBody(Client *c, Timer *timer, uint8_t *packet_type) {
+    MQTTHeader header = {0};
+    uint32_t len = 1;
+    uint32_t rem_len = 0;
 
-    len = 1;
     /* 2. read the remaining length.  This is variable in itself */
     MQTTReturnCode rc = decodePacket(c, &rem_len, (uint32_t)left_ms(timer));
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    /* if the buffer is too short then the message will be dropped silently */
-	if (rem_len >= c->readBufSize) {
-		bytes_to_be_read = c->readBufSize;
-		do {
-			ret_val = c->networkStack.mqttread(&(c->networkStack), c->readbuf, bytes_to_be_read, left_ms(timer));
-			if (ret_val > 0) {
-				total_bytes_read += ret_val;
-				if((rem_len - total_bytes_read) >= c->readBufSize){
-					bytes_to_be_read = c->readBufSize;
-				}
-				else{
-					bytes_to_be_read = rem_len - total_bytes_read;
-				}
-			}
-		} while (total_bytes_read < rem_len && ret_val > 0);
-		return MQTTPACKET_BUFFER_TOO_SHORT;
-	}
-
     /* put the original remaining length back into the buffer */
     len += MQTTPacket_encode(c->readbuf + 1, rem_len);
 
+    header.byte = c->readbuf[0];
+    *packet_type = header.bits.type;
+#if AWS_IOT_MQTT_STATS
+    c->stats.bytesIn += len + rem_len;
+    c->stats.packetsIn[header.bits.type]++;
+#endif
+
+    /* A publish keeps one byte free to NUL terminate its payload in place */
+    if(len + rem_len > c->readBufSize
+       || (PUBLISH == header.bits.type && len + rem_len == c->readBufSize)) {
+        return readOversizedPacket(c, timer, header.bits.type, len, rem_len);
+    }
+
     /* 3. read the rest of the buffer using a callback to supply the rest of the data */
     if(rem_len > 0 && (c->networkStack.mqttread(&(c->networkStack), c->readbuf + len, (int)rem_len, left_ms(timer)) != (int)rem_len)) {
         return MQTT_FAILURE;
     }
 
-    header.byte = c->readbuf[0];
-    *packet_type = header.bits.type;
-
     return MQTT_SUCCESS;
 }
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-char isTopicMatched(char *topicFilter, MQTTString *topicName) {
-    if(NULL == topicFilter || NULL == topicName) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
-
-    char *curf = topicFilter;
-    char *curn = topicName->lenstring.data;
-    char *curn_end = curn + topicName->lenstring.len;
+#if AWS_IOT_MQTT_LOW_MEMORY
+/* Reads a packet where it is in the read buffer of the network layer once its
+ * header byte arrived there, readbuf points at it until the next packet is
+ * read. The network layer keeps a byte behind the packet for the NUL
+ * terminator of a publish. A packet too big for it goes through scratchbuf */
+static AWS_IOT_HOT_FUNC MQTTReturnCode readPacketInPlace(Client *c, Timer *timer, uint8_t *packet_type) {
+    MQTTHeader header = {0};
+    unsigned char *p = NULL;
+    uint32_t len = 1;
+    uint32_t rem_len = 0;
+    uint32_t multiplier = 1;
+    int ret;
 
-    while(*curf && (curn < curn_end)) {
-        if(*curn == '/' && *curf != '/') {
-            break;
+    /* The remaining length is decoded where it is, it stays in the packet */
+    do {
+        if(++len > 5) {
+            return MQTTPACKET_READ_ERROR;
         }
-        if(*curf != '+' && *curf != '#' && *curf != *curn) {
-            break;
+        if((int)len != c->networkStack.mqttpeek(&(c->networkStack), &p, (int)len, left_ms(timer))) {
+            return MQTT_FAILURE;
         }
-        if(*curf == '+') {
-            /* skip until we meet the next separator, or end of string */
-            char *nextpos = curn + 1;
-            while(nextpos < curn_end && *nextpos != '/')
-                nextpos = ++curn + 1;
-        } else if(*curf == '#') {
-            /* skip until end of string */
-            curn = curn_end - 1;
+        rem_len += (p[len - 1] & 127) * multiplier;
+        multiplier *= 128;
+    } while(0 != (p[len - 1] & 128));
+
+    header.byte = p[0];
+    *packet_type = header.bits.type;
+#if AWS_IOT_MQTT_STATS
+    c->stats.bytesIn += len + rem_len;
+    c->stats.packetsIn[header.bits.type]++;
+#endif
+
+    ret = c->networkStack.mqttpeek(&(c->networkStack), &p, (int)(len + rem_len), left_ms(timer));
+    if(0 > ret) {
+        c->readbuf = c->scratchbuf;
+        c->readBufSize = c->scratchBufSize;
+        if((int)len != c->networkStack.mqttread(&(c->networkStack), c->readbuf, (int)len, left_ms(timer))) {
+            return MQTT_FAILURE;
         }
+        return readOversizedPacket(c, timer, header.bits.type, len, rem_len);
+    }
+    if((int)(len + rem_len) != ret) {
+        return MQTT_FAILURE;
+    }
 
-        curf++;
-        curn++;
-    };
+    /* Taken without being copied */
+    c->networkStack.mqttread(&(c->networkStack), p, ret, 0);
+    c->readbuf = p;
+    c->readBufSize = len + rem_len + 1;
 
-    return (curn == curn_end) && (*curf == '\0');
+    return MQTT_SUCCESS;
 }
+#endif
 
-MQTTReturnCode deliverMessage(Client *c, MQTTString *topicName, MQTTMessage *message) {
-    if(NULL == c || NULL == topicName || NULL == message) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
+/* firstByteTimeoutMs only applies to the header byte, the rest of the packet
+ * is read within the time left on timer */
+static AWS_IOT_HOT_FUNC MQTTReturnCode readPacketWithTimeout(Client *c, Timer *timer, int firstByteTimeoutMs,
+                                            uint8_t *packet_type) {
+    MQTTReturnCode rc;
 
-    uint32_t i;
-    MessageData md;
+#if AWS_IOT_MQTT_LOW_MEMORY
+    unsigned char *p;
 
-    // we have to find the right message handler - indexed by topic
-    for(i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if((c->messageHandlers[i].topicFilter != 0)
-           && (MQTTPacket_equals(topicName, (char*)c->messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)c->messageHandlers[i].topicFilter, topicName))) {
-            if(c->messageHandlers[i].fp != NULL) {
-                NewMessageData(&md, topicName, message, c->messageHandlers[i].applicationHandler);
-                c->messageHandlers[i].fp(&md);
-                return MQTT_SUCCESS;
-            }
+    if(NULL != c->networkStack.mqttpeek) {
+        if(1 != c->networkStack.mqttpeek(&(c->networkStack), &p, 1, firstByteTimeoutMs)) {
+            return MQTT_NOTHING_TO_READ;
         }
+        CYCLE_TRACE_BEGIN(CYCLE_TRACE_MQTT_READ_PACKET);
+        rc = readPacketInPlace(c, timer, packet_type);
+        CYCLE_TRACE_END(CYCLE_TRACE_MQTT_READ_PACKET);
+        return rc;
     }
+#endif
 
-    if(NULL != c->defaultMessageHandler) {
-        NewMessageData(&md, topicName, message, NULL);
-        c->defaultMessageHandler(&md);
-        return MQTT_SUCCESS;
+    /* 1. read the header byte.  This has the packet type in it */
+    if(1 != c->networkStack.mqttread(&(c->networkStack), c->readbuf, 1, firstByteTimeoutMs)) {
+        /* Nothing to read, or the connection is gone: keepalive() asks the network
+         * layer right after and handles the disconnect */
+        return MQTT_NOTHING_TO_READ;
     }
 
-    /* Message handler not found for topic */
-    return MQTT_FAILURE;
+    /* The trace span starts with the packet, not with the wait for it */
+    CYCLE_TRACE_BEGIN(CYCLE_TRACE_MQTT_READ_PACKET);
+    rc = readPacketBody(c, timer, packet_type);
+    CYCLE_TRACE_END(CYCLE_TRACE_MQTT_READ_PACKET);
+    return rc;
 }
 
-MQTTReturnCode handleDisconnect(Client *c) {
-    if(NULL == c) {
+AWS_IOT_HOT_FUNC MQTTReturnCode readPacket(Client *c, Timer *timer, uint8_t *packet_type) {
+    if(NULL == c || NULL == timer) {
         return MQTT_NULL_VALUE_ERROR;
     }
 
-    MQTTReturnCode rc = MQTTDisconnect(c);
-    if(rc != MQTT_SUCCESS){
-    	// If the sendPacket prevents us from sending a disconnect packet then we have to clean the stack
-    	MQTTForceDisconnect(c);
-    }
+    return readPacketWithTimeout(c, timer, left_ms(timer), packet_type);
+}
 
-    if(NULL != c->disconnectHandler) {
-        c->disconnectHandler();
-    }
+/* FNV-1a */
+static uint32_t topicHash(const char *topic, size_t len) {
+    uint32_t hash = 2166136261u;
+    size_t i;
 
-    /* Reset to 0 since this was not a manual disconnect */
-    c->wasManuallyDisconnected = 0;
-    return MQTT_NETWORK_DISCONNECTED_ERROR;
+    for(i = 0; i < len; i++) {
+        hash ^= (uint8_t)topic[i];
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-MQTTReturnCode MQTTAttemptReconnect(Client *c) {
-    if(NULL == c) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
+/* Put the topic filter in a handler along with what matching it needs */
+static void setHandlerTopicFilter(Client *c, uint32_t index, const char *topicFilter) {
+    size_t len = strlen(topicFilter);
 
-    if(1 == c->isConnected) {
-        return MQTT_NETWORK_ALREADY_CONNECTED_ERROR;
+    c->messageHandlers[index].topicFilter = topicFilter;
+    c->messageHandlers[index].topicFilterLen = (uint16_t)len;
+    c->messageHandlers[index].topicFilterHash = topicHash(topicFilter, len);
+    c->messageHandlers[index].isLiteral = (NULL == strpbrk(topicFilter, "+#"));
+    if(!c->messageHandlers[index].isLiteral && index < c->firstWildcardHandler) {
+        c->firstWildcardHandler = index;
     }
+}
 
-    MQTTReturnCode rc = MQTT_ATTEMPTING_RECONNECT;
+static void freeMessageHandler(Client *c, uint32_t index) {
+    c->messageHandlers[index].topicFilter = NULL;
+    c->messageHandlers[index].nextFree = c->firstFreeHandler;
+    c->firstFreeHandler = (uint16_t)index;
+}
 
-    /* Ignoring return code. failures expected if network is disconnected */
-    rc = MQTTConnect(c, NULL);
+/* Return NO_MESSAGE_HANDLER if no handler matches the topic */
+static uint32_t findMessageHandlerIndex(Client *c, MQTTString *topicName) {
+    const char *name;
+    size_t len;
+    uint32_t hash;
+    int32_t i;
 
-    /* If still disconnected handle disconnect */
-    if(0 == c->isConnected) {
-        return MQTT_ATTEMPTING_RECONNECT;
+    // we have to find the right message handler - indexed by topic
+    if(NULL != topicName->lenstring.data) {
+        name = topicName->lenstring.data;
+        len = (size_t)topicName->lenstring.len;
+    } else if(NULL != topicName->cstring) {
+        name = topicName->cstring;
+        len = strlen(topicName->cstring);
+    } else {
+        return NO_MESSAGE_HANDLER;
+    }
+
+    /* A literal filter before the first wildcard one is the lowest index
+     * matching, the one the trie would find */
+    hash = topicHash(name, len);
+    for(i = 0; i < (int32_t)c->firstWildcardHandler; i++) {
+        if(NULL != c->messageHandlers[i].topicFilter && c->messageHandlers[i].isLiteral
+           && c->messageHandlers[i].topicFilterLen == len && c->messageHandlers[i].topicFilterHash == hash
+           && 0 == memcmp(c->messageHandlers[i].topicFilter, name, len)) {
+            break;
+        }
     }
 
-    rc = MQTTResubscribe(c);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    if(i == (int32_t)c->messageHandlerCount) {
+        /* Only literal filters, none of them matched */
+        return NO_MESSAGE_HANDLER;
+    }
+    if(i == (int32_t)c->firstWildcardHandler) {
+        i = MQTTTopicTrieMatch(&(c->topicTrie), name, len);
+    }
+
+    /* The trie can refer to a subscription still waiting for its SUBACK */
+    if(TOPIC_TRIE_NO_HANDLER == i || NULL == c->messageHandlers[i].topicFilter
+       || NULL == c->messageHandlers[i].fp) {
+        return NO_MESSAGE_HANDLER;
+    }
+
+    return (uint32_t)i;
+}
+
+/* Rebuild the topic trie from the message handlers, used when a topic filter is removed */
+static void rebuildTopicTrie(Client *c) {
+    uint32_t i;
+
+    MQTTTopicTrieInit(&(c->topicTrie), c->topicTrie.nodes, c->topicTrie.maxNodes);
+    c->firstWildcardHandler = c->messageHandlerCount;
+    for(i = 0; i < c->messageHandlerCount; ++i) {
+        if(NULL != c->messageHandlers[i].topicFilter) {
+            /* Can not run out of nodes, these filters all fitted before */
+            MQTTTopicTrieInsert(&(c->topicTrie), c->messageHandlers[i].topicFilter, i);
+            if(!c->messageHandlers[i].isLiteral && i < c->firstWildcardHandler) {
+                c->firstWildcardHandler = i;
+            }
+        }
+    }
+}
+
+/* Messages of the broker go to the default handler when no subscription
+ * matches, those published locally do not */
+static MQTTReturnCode deliverToHandler(Client *c, MQTTString *topicName, MQTTMessage *message,
+                                       uint8_t useDefault) {
+    uint32_t i;
+    MessageData md;
+    MQTTReturnCode rc = MQTT_SUCCESS;
+
+    CYCLE_TRACE_BEGIN(CYCLE_TRACE_MQTT_DELIVER);
+    /* A subscribe or unsubscribe from another thread waits for the handler */
+    LOCK(c, stateLock);
+    i = findMessageHandlerIndex(c, topicName);
+    if(NO_MESSAGE_HANDLER != i) {
+        NewMessageData(&md, topicName, message, c->messageHandlers[i].applicationHandler);
+        md.dispatch = c->messageHandlers[i].dispatch;
+        md.client = c;
+        c->messageHandlers[i].fp(&md);
+    } else if(useDefault && NULL != c->defaultMessageHandler) {
+        NewMessageData(&md, topicName, message, NULL);
+        md.client = c;
+        c->defaultMessageHandler(&md);
+    } else {
+        /* Message handler not found for topic */
+        rc = MQTT_FAILURE;
+    }
+    UNLOCK(c, stateLock);
+    CYCLE_TRACE_END(CYCLE_TRACE_MQTT_DELIVER);
+
+    return rc;
+}
+
+MQTTReturnCode deliverMessage(Client *c, MQTTString *topicName, MQTTMessage *message) {
+    if(NULL == c || NULL == topicName || NULL == message) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    return deliverToHandler(c, topicName, message, 1);
+}
+
+MQTTReturnCode handleDisconnect(Client *c) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+#if AWS_IOT_MQTT_STATS
+    if(0 == c->disconnectedUs) {
+        c->disconnectedUs = timer_now_us();
+    }
+#endif
+
+    MQTTReturnCode rc = MQTTDisconnect(c);
+    if(rc != MQTT_SUCCESS){
+    	// If the sendPacket prevents us from sending a disconnect packet then we have to clean the stack
+    	MQTTForceDisconnect(c);
+    }
+
+    if(NULL != c->disconnectHandler) {
+        c->disconnectHandler(c);
+    }
+
+    /* Reset to 0 since this was not a manual disconnect */
+    c->wasManuallyDisconnected = 0;
+    return MQTT_NETWORK_DISCONNECTED_ERROR;
+}
+
+MQTTReturnCode MQTTAttemptReconnect(Client *c) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    if(1 == c->isConnected) {
+        return MQTT_NETWORK_ALREADY_CONNECTED_ERROR;
+    }
+
+    MQTTReturnCode rc = MQTT_ATTEMPTING_RECONNECT;
+
+    /* Ignoring return code. failures expected if network is disconnected */
+    rc = MQTTConnect(c, NULL);
+
+    /* If still disconnected handle disconnect */
+    if(0 == c->isConnected) {
+        return MQTT_ATTEMPTING_RECONNECT;
+    }
+
+#if AWS_IOT_MQTT_STATS
+    c->stats.reconnects++;
+    if(0 != c->disconnectedUs) {
+        histogramAdd(&(c->stats.reconnectDuration), timer_now_us() - c->disconnectedUs);
+        c->disconnectedUs = 0;
+    }
+#endif
+
+    rc = MQTTResubscribe(c);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
     }
 
     return MQTT_NETWORK_RECONNECTED;
 }
 
+/* Auto reconnect steps. Attempts are made at random times within their
+ * window, full jitter, so that the devices that lost the broker or the
+ * network together do not all come back at the same moment */
+enum {
+    RECONNECT_FAST,       /* One attempt soon after a stable connection was lost */
+    RECONNECT_LINK_WAIT,  /* The network is down, it is checked without attempts */
+    RECONNECT_BACKOFF     /* Attempts in a window doubling up to MAX_RECONNECT_WAIT_INTERVAL */
+};
+
 MQTTReturnCode handleReconnect(Client *c) {
     if(NULL == c) {
         return MQTT_NULL_VALUE_ERROR;
@@ -344,25 +1028,63 @@ MQTTReturnCode handleReconnect(Client *c) {
         return MQTT_ATTEMPTING_RECONNECT;
     }
 
-    int8_t isPhysicalLayerConnected = 1;
-    if(NULL != c->networkStack.isConnected) {
-        isPhysicalLayerConnected = (int8_t)c->networkStack.isConnected(&(c->networkStack));
+    if(NULL != c->networkStack.isConnected && !c->networkStack.isConnected(&(c->networkStack))) {
+        /* Attempts would fail, they do not use up the back-off */
+        c->reconnectState = RECONNECT_LINK_WAIT;
+        countdown_ms(&(c->reconnectDelayTimer), MIN_RECONNECT_WAIT_INTERVAL);
+        return MQTT_ATTEMPTING_RECONNECT;
     }
 
-    MQTTReturnCode rc = MQTT_NETWORK_RECONNECTED;
-    if(isPhysicalLayerConnected) {
-        rc = MQTTAttemptReconnect(c);
-        if(MQTT_NETWORK_RECONNECTED == rc) {
-            return MQTT_NETWORK_RECONNECTED;
+    if(RECONNECT_LINK_WAIT == c->reconnectState) {
+        /* The network is back, for every device on it */
+        c->reconnectState = RECONNECT_BACKOFF;
+        countdown_jitter_ms(&(c->reconnectDelayTimer), c->currentReconnectWaitInterval);
+        return MQTT_ATTEMPTING_RECONNECT;
+    }
+
+    MQTTReturnCode rc = MQTTAttemptReconnect(c);
+    if(MQTT_NETWORK_RECONNECTED == rc) {
+        return MQTT_NETWORK_RECONNECTED;
+    }
+
+    if(RECONNECT_FAST == c->reconnectState) {
+        c->reconnectState = RECONNECT_BACKOFF;
+    } else {
+        c->currentReconnectWaitInterval *= 2;
+        if(MAX_RECONNECT_WAIT_INTERVAL < c->currentReconnectWaitInterval) {
+            return MQTT_RECONNECT_TIMED_OUT;
         }
     }
+    countdown_jitter_ms(&(c->reconnectDelayTimer), c->currentReconnectWaitInterval);
+    return rc;
+}
 
-    c->currentReconnectWaitInterval *= 2;
+/* Send a PINGREQ, called with writeLock held. The next ping is counted
+ * from this one */
+static MQTTReturnCode sendPingreq(Client *c) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    Timer timer;
+    InitTimer(&timer);
+    countdown_ms(&timer, c->commandTimeoutMs);
+    uint32_t serialized_len = 0;
+    acquireTxBuf(c);
+    rc = MQTTSerialize_pingreq(c->buf, c->bufSize, &serialized_len);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
 
-    if(MAX_RECONNECT_WAIT_INTERVAL < c->currentReconnectWaitInterval) {
-        return MQTT_RECONNECT_TIMED_OUT;
+    /* send the ping packet */
+    rc = sendPacket(c, serialized_len, &timer);
+    if(MQTT_SUCCESS == rc) {
+        c->isPingOutstanding = 1;
+        /* start a timer to wait for PINGRESP from server */
+        countdown(&c->pingRespTimer, c->keepAliveInterval / 2);
+        countdown(&c->pingTimer, c->keepAliveInterval);
+    } else {
+        /* If sending a PING fails we can no longer determine if we are connected */
+        rc = MQTT_NETWORK_DISCONNECTED_ERROR;
     }
-    countdown_ms(&(c->reconnectDelayTimer), c->currentReconnectWaitInterval);
+
     return rc;
 }
 
@@ -371,117 +1093,699 @@ MQTTReturnCode keepalive(Client *c) {
         return MQTT_NULL_VALUE_ERROR;
     }
 
+    /* The network layer sees a dead socket or a lost link long before a
+     * PINGRESP is missed */
+    if(1 == c->isConnected && NULL != c->networkStack.isConnected
+       && !c->networkStack.isConnected(&(c->networkStack))) {
+        return handleDisconnect(c);
+    }
+
 	if(0 == c->keepAliveInterval) {
 		return MQTT_SUCCESS;
 	}
 
+    if(c->isPingOutstanding) {
+        if(expired(&c->pingRespTimer)) {
+            return handleDisconnect(c);
+        }
+        return MQTT_SUCCESS;
+    }
+
+    /* Other threads restart pingTimer when they send */
+    LOCK(c, writeLock);
 	if(!expired(&c->pingTimer)) {
+        UNLOCK(c, writeLock);
         return MQTT_SUCCESS;
     }
 
-    if(c->isPingOutstanding) {
+    /* there is no ping outstanding - send one */
+    MQTTReturnCode rc = sendPingreq(c);
+    UNLOCK(c, writeLock);
+
+    if(MQTT_NETWORK_DISCONNECTED_ERROR == rc) {
+    	//If sending a PING fails we can no longer determine if we are connected.  In this case we decide we are disconnected and begin reconnection attempts
         return handleDisconnect(c);
     }
 
-    /* there is no ping outstanding - send one */
-    MQTTReturnCode rc = MQTT_SUCCESS;
-    Timer timer;
-    InitTimer(&timer);
-    countdown_ms(&timer, c->commandTimeoutMs);
-    uint32_t serialized_len = 0;
-    rc = MQTTSerialize_pingreq(c->buf, c->bufSize, &serialized_len);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    return rc;
+}
+
+MQTTReturnCode MQTTKeepaliveEarly(Client *c, uint32_t withinMs) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
     }
 
-    /* send the ping packet */
-    rc = sendPacket(c, serialized_len, &timer);
-    if(MQTT_SUCCESS != rc) {
-    	//If sending a PING fails we can no longer determine if we are connected.  In this case we decide we are disconnected and begin reconnection attempts
+    if(0 == c->keepAliveInterval || !c->isConnected || c->isPingOutstanding) {
+        return MQTT_SUCCESS;
+    }
+
+    int left;
+    LOCK(c, writeLock);
+    left = left_ms(&c->pingTimer);
+    if(0 < left && (uint32_t)left > withinMs) {
+        UNLOCK(c, writeLock);
+        return MQTT_SUCCESS;
+    }
+    MQTTReturnCode rc = sendPingreq(c);
+    UNLOCK(c, writeLock);
+
+    if(MQTT_NETWORK_DISCONNECTED_ERROR == rc) {
         return handleDisconnect(c);
     }
 
-    c->isPingOutstanding = 1;
-    /* start a timer to wait for PINGRESP from server */
-    countdown(&c->pingTimer, c->keepAliveInterval / 2);
+    return rc;
+}
 
-    return MQTT_SUCCESS;
+/* Send a PUBACK, PUBREC, PUBREL or PUBCOMP */
+static MQTTReturnCode sendAck(Client *c, Timer *timer, uint8_t packet_type, uint16_t id) {
+    MQTTReturnCode rc;
+    uint32_t len = 0;
+
+    LOCK(c, writeLock);
+    acquireTxBuf(c);
+    rc = MQTTSerialize_ack(c->buf, c->bufSize, packet_type, 0, id, &len);
+    if(MQTT_SUCCESS == rc) {
+        rc = sendPacket(c, len, timer);
+    }
+    UNLOCK(c, writeLock);
+
+    return rc;
+}
+
+static MQTTReturnCode sendPublishAck(Client *c, Timer *timer, QoS qos, uint16_t id) {
+    if(QOS0 == qos) {
+        /* No further processing required for QOS0 */
+        return MQTT_SUCCESS;
+    }
+
+    /* Message is not QOS0 or 1 means only option left is QOS2 */
+    return sendAck(c, timer, (QOS1 == qos) ? PUBACK : PUBREC, id);
+}
+
+/* Index of id in qos2Received, MAX_QOS2_RECEIVED if it is not there. Called
+ * with stateLock held */
+static uint32_t findQos2Received(Client *c, uint16_t id) {
+    uint32_t i;
+
+    for(i = 0; i < MAX_QOS2_RECEIVED; ++i) {
+        if(id == c->qos2Received[i]) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Outcome of receiveQos2() */
+#define QOS2_NEW 0          /* Recorded, deliver it */
+#define QOS2_DUPLICATE 1    /* Delivered before, only acknowledge it again */
+#define QOS2_REFUSED 2      /* No room to record it, neither deliver nor acknowledge it */
+
+/* Record the id of a received QoS2 message until its PUBREL arrives, a
+ * retransmission of the message is not delivered twice. Called with
+ * stateLock held */
+static uint8_t receiveQos2(Client *c, uint16_t id) {
+    uint32_t i;
+
+    if(MAX_QOS2_RECEIVED > findQos2Received(c, id)) {
+#if AWS_IOT_MQTT_STATS
+        c->stats.qos2Duplicates++;
+#endif
+        return QOS2_DUPLICATE;
+    }
+
+    /* The broker sends the message again after a reconnect */
+    i = findQos2Received(c, 0);
+    if(MAX_QOS2_RECEIVED <= i) {
+#if AWS_IOT_MQTT_STATS
+        c->stats.qos2Refused++;
+#endif
+        return QOS2_REFUSED;
+    }
+
+    c->qos2Received[i] = id;
+    return QOS2_NEW;
+}
+
+unsigned char *MQTTTakeReadBuffer(Client *c, unsigned char *spare) {
+    unsigned char *taken;
+
+    if(NULL == c || NULL == spare || AWS_IOT_MQTT_LOW_MEMORY) {
+        return NULL;
+    }
+
+    taken = c->readbuf;
+    c->readbuf = spare;
+    return taken;
 }
 
 MQTTReturnCode handlePublish(Client *c, Timer *timer) {
     MQTTString topicName;
     MQTTMessage msg;
     MQTTReturnCode rc;
-    uint32_t len = 0;
-
-    rc = MQTTDeserialize_publish((unsigned char *) &msg.dup, (QoS *) &msg.qos, (unsigned char *) &msg.retained,
-                                 (uint16_t *)&msg.id, &topicName,
-                                 (unsigned char **) &msg.payload, (uint32_t *) &msg.payloadlen, c->readbuf,
-                                 c->readBufSize);
+    uint8_t qos2 = QOS2_NEW;
+    unsigned char *buf = c->readbuf;
+    unsigned char end;
+
+    if(5 == c->options.MQTTVersion) {
+        rc = MQTTV5Deserialize_publish((unsigned char *) &msg.dup, (QoS *) &msg.qos, (unsigned char *) &msg.retained,
+                                       (uint16_t *)&msg.id, &topicName,
+                                       (unsigned char **) &msg.payload, (uint32_t *) &msg.payloadlen, c->readbuf,
+                                       c->readBufSize);
+    } else {
+        rc = MQTTDeserialize_publish((unsigned char *) &msg.dup, (QoS *) &msg.qos, (unsigned char *) &msg.retained,
+                                     (uint16_t *)&msg.id, &topicName,
+                                     (unsigned char **) &msg.payload, (uint32_t *) &msg.payloadlen, c->readbuf,
+                                     c->readBufSize);
+    }
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    rc = deliverMessage(c, &topicName, &msg);
-    if(MQTT_SUCCESS != rc) {
+    /* The payload ends the packet and readPacket left room after it, so
+     * handlers can parse it as a string without copying it. Read in place,
+     * the byte may hold the start of the next packet, it is put back */
+    end = ((unsigned char *)msg.payload)[msg.payloadlen];
+    ((unsigned char *)msg.payload)[msg.payloadlen] = '\0';
+
+    LOCK(c, stateLock);
+    if(QOS2 == msg.qos) {
+        qos2 = receiveQos2(c, msg.id);
+    }
+    if(QOS2_NEW == qos2) {
+        rc = deliverMessage(c, &topicName, &msg);
+        if(MQTT_SUCCESS != rc && QOS2 == msg.qos) {
+            c->qos2Received[findQos2Received(c, msg.id)] = 0;
+        }
+    }
+    UNLOCK(c, stateLock);
+    /* Unless a handler took the buffer with MQTTTakeReadBuffer() */
+    if(c->readbuf == buf) {
+        ((unsigned char *)msg.payload)[msg.payloadlen] = end;
+    }
+    if(MQTT_SUCCESS != rc || QOS2_REFUSED == qos2) {
         return rc;
     }
 
-    if(QOS0 == msg.qos) {
-        /* No further processing required for QOS0 */
-        return MQTT_SUCCESS;
+    return sendPublishAck(c, timer, msg.qos, msg.id);
+}
+
+/* Deliver a publish packet that does not fit in the read buffer. The fixed header
+ * (len bytes) is already in c->readbuf; the topic and packet id are read after it
+ * and the payload is passed to the streaming handler in chunks using the rest of
+ * the read buffer */
+/* Read and drop the properties of a streamed MQTT 5 publish, through the
+ * roomLen bytes at room. *pRemLen is what is left of the packet */
+static MQTTReturnCode skipStreamedProperties(Client *c, Timer *timer, unsigned char *room, uint32_t roomLen,
+                                             uint32_t *pRemLen) {
+    uint32_t propsLen = 0;
+    uint32_t multiplier = 1;
+    uint32_t i = 0;
+    uint32_t chunk_len;
+
+    /* The property length, a variable byte integer */
+    do {
+        if(4 <= i++ || 0 == *pRemLen
+           || 1 != c->networkStack.mqttread(&(c->networkStack), room, 1, left_ms(timer))) {
+            return MQTT_FAILURE;
+        }
+        (*pRemLen)--;
+        propsLen += (room[0] & 127) * multiplier;
+        multiplier *= 128;
+    } while(0 != (room[0] & 128));
+
+    if(propsLen > *pRemLen) {
+        return MQTT_FAILURE;
     }
+    *pRemLen -= propsLen;
 
-    if(QOS1 == msg.qos) {
-        rc = MQTTSerialize_ack(c->buf, c->bufSize, PUBACK, 0, msg.id, &len);
-    } else { /* Message is not QOS0 or 1 means only option left is QOS2 */
-        rc = MQTTSerialize_ack(c->buf, c->bufSize, PUBREC, 0, msg.id, &len);
+    while(0 < propsLen) {
+        chunk_len = (propsLen < roomLen) ? propsLen : roomLen;
+        if((int)chunk_len != c->networkStack.mqttread(&(c->networkStack), room, (int)chunk_len, left_ms(timer))) {
+            return MQTT_FAILURE;
+        }
+        propsLen -= chunk_len;
     }
 
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    return MQTT_SUCCESS;
+}
+
+static MQTTReturnCode readStreamedPublish(Client *c, Timer *timer, uint32_t len, uint32_t rem_len) {
+    MQTTHeader header = {0};
+    MQTTString topicName = MQTTString_initializer;
+    MQTTMessage msg;
+    MessageData md;
+    uint32_t index;
+    uint32_t var_len;
+    uint32_t chunk_len;
+    uint32_t offset = 0;
+    unsigned char *ptr;
+    uint8_t qos2 = QOS2_NEW;
+
+    if(2 > rem_len) {
+        drainPacket(c, timer, rem_len);
+        return MQTT_BUFFER_RX_MESSAGE_INVALID;
     }
 
-    rc = sendPacket(c, len, timer);
+    header.byte = c->readbuf[0];
+    msg.qos = (QoS)header.bits.qos;
+    msg.dup = header.bits.dup;
+    msg.retained = header.bits.retain;
+    msg.id = 0;
+
+    /* topic length */
+    if(2 != c->networkStack.mqttread(&(c->networkStack), c->readbuf + len, 2, left_ms(timer))) {
+        return MQTT_FAILURE;
+    }
+    ptr = c->readbuf + len;
+    topicName.lenstring.len = (size_t)readInt(&ptr);
+
+    var_len = 2 + (uint32_t)topicName.lenstring.len + ((QOS0 != msg.qos) ? 2 : 0);
+    if(var_len > rem_len || len + var_len >= c->readBufSize) {
+        /* No room left for the topic or the payload, drop the message */
+        drainPacket(c, timer, rem_len - 2);
+        return MQTTPACKET_BUFFER_TOO_SHORT;
+    }
+
+    /* topic and packet id */
+    if((int)(var_len - 2) != c->networkStack.mqttread(&(c->networkStack), ptr, (int)(var_len - 2), left_ms(timer))) {
+        return MQTT_FAILURE;
+    }
+    topicName.lenstring.data = (char *)ptr;
+    ptr += topicName.lenstring.len;
+    if(QOS0 != msg.qos) {
+        msg.id = (uint16_t)readInt(&ptr);
+    }
+
+    rem_len -= var_len;
+
+    if(5 == c->options.MQTTVersion
+       && MQTT_SUCCESS != skipStreamedProperties(c, timer, ptr, (uint32_t)c->readBufSize - len - var_len, &rem_len)) {
+        return MQTT_FAILURE;
+    }
+
+    /* The subscription must not change between the chunks */
+    LOCK(c, stateLock);
+    index = findMessageHandlerIndex(c, &topicName);
+    if(NO_MESSAGE_HANDLER == index || 0 == c->messageHandlers[index].isStreaming) {
+        UNLOCK(c, stateLock);
+        drainPacket(c, timer, rem_len);
+        return MQTTPACKET_BUFFER_TOO_SHORT;
+    }
+
+    if(QOS2 == msg.qos) {
+        qos2 = receiveQos2(c, msg.id);
+    }
+    if(QOS2_NEW != qos2) {
+        UNLOCK(c, stateLock);
+        drainPacket(c, timer, rem_len);
+        return (QOS2_DUPLICATE == qos2) ? sendPublishAck(c, timer, msg.qos, msg.id) : MQTT_SUCCESS;
+    }
+
+    md.topicName = &topicName;
+    md.message = &msg;
+    md.applicationHandler = c->messageHandlers[index].applicationHandler;
+    md.totalPayloadLen = rem_len;
+    md.dispatch = c->messageHandlers[index].dispatch;
+    md.client = c;
+
+    do {
+        chunk_len = (uint32_t)c->readBufSize - len - var_len;
+        if(chunk_len > rem_len - offset) {
+            chunk_len = rem_len - offset;
+        }
+
+        if(0 < chunk_len && (int)chunk_len != c->networkStack.mqttread(&(c->networkStack), ptr, (int)chunk_len, left_ms(timer))) {
+            if(QOS2 == msg.qos) {
+                /* Delivered in full when the broker sends it again */
+                c->qos2Received[findQos2Received(c, msg.id)] = 0;
+            }
+            UNLOCK(c, stateLock);
+            return MQTT_FAILURE;
+        }
+
+        msg.payload = ptr;
+        msg.payloadlen = chunk_len;
+        md.payloadOffset = offset;
+        md.isLastChunk = (uint8_t)(offset + chunk_len == rem_len);
+        c->messageHandlers[index].fp(&md);
+
+        offset += chunk_len;
+    } while(offset < rem_len);
+    UNLOCK(c, stateLock);
+
+    return sendPublishAck(c, timer, msg.qos, msg.id);
+}
+
+/* Index of the asynchronous publish of the given QoS waiting with packet_id,
+ * MAX_INFLIGHT_PUBLISH if there is none. Called with stateLock held */
+static uint32_t findInflightPublish(Client *c, uint16_t packet_id, uint8_t qos) {
+    uint32_t i;
+
+    for(i = 0; i < MAX_INFLIGHT_PUBLISH && 0 < c->inflightPublishCount; ++i) {
+        if(!c->inflightPublishes[i].isFree && c->inflightPublishes[i].packetId == packet_id
+           && c->inflightPublishes[i].qos == qos) {
+            return i;
+        }
+    }
+
+    return MAX_INFLIGHT_PUBLISH;
+}
+
+MQTTReturnCode handlePubrec(Client *c, Timer *timer) {
+    uint16_t packet_id;
+    unsigned char dup, type, reasonCode = 0;
+    uint32_t i;
+    MQTTReturnCode rc;
+    rc = MQTTV5Deserialize_ack(&type, &dup, &packet_id, &reasonCode, c->readbuf, c->readBufSize);
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    return MQTT_SUCCESS;
+    /* An MQTT 5 broker refusing the message ends the exchange, no PUBREL */
+    if(MQTTV5_REASON_FAILURE <= reasonCode) {
+        LOCK(c, stateLock);
+        i = findInflightPublish(c, packet_id, QOS2);
+        if(MAX_INFLIGHT_PUBLISH > i) {
+            completeInflightPublish(c, i, MQTT_FAILURE);
+            UNLOCK(c, stateLock);
+            return MQTT_SUCCESS;
+        }
+        UNLOCK(c, stateLock);
+        completeAckWaiter(c, PUBCOMP, packet_id, MQTT_FAILURE);
+        return MQTT_SUCCESS;
+    }
+
+    /* The broker has the message, the PUBCOMP gets a timeout of its own */
+    LOCK(c, stateLock);
+    i = findInflightPublish(c, packet_id, QOS2);
+    if(MAX_INFLIGHT_PUBLISH > i && !c->inflightPublishes[i].isReleased) {
+        c->inflightPublishes[i].isReleased = 1;
+        timerWheelStart(&(c->timerWheel), &(c->inflightPublishes[i].ackTimer), c->commandTimeoutMs);
+    }
+    UNLOCK(c, stateLock);
+
+    /* send the PUBREL packet, also for a repeated PUBREC */
+    return sendAck(c, timer, PUBREL, packet_id);
 }
 
-MQTTReturnCode handlePubrec(Client *c, Timer *timer) {
+/* The sender released a QoS2 message, a retransmission of it is a new message */
+static MQTTReturnCode handlePubrel(Client *c, Timer *timer) {
     uint16_t packet_id;
     unsigned char dup, type;
+    uint32_t i;
     MQTTReturnCode rc;
+
     rc = MQTTDeserialize_ack(&type, &dup, &packet_id, c->readbuf, c->readBufSize);
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    uint32_t len;
-    rc = MQTTSerialize_ack(c->buf, c->bufSize, PUBREL, 0, packet_id, &len);
+    LOCK(c, stateLock);
+    i = findQos2Received(c, packet_id);
+    if(MAX_QOS2_RECEIVED > i) {
+        c->qos2Received[i] = 0;
+    }
+    UNLOCK(c, stateLock);
+
+    /* Also for an id that is not known, the PUBCOMP of a previous PUBREL may have been lost */
+    return sendAck(c, timer, PUBCOMP, packet_id);
+}
+
+/* Called with stateLock held */
+static void completeInflightPublish(Client *c, uint32_t index, MQTTReturnCode rc) {
+    PublishCompleteData pd;
+
+    pd.packetId = c->inflightPublishes[index].packetId;
+    pd.rc = rc;
+    pd.applicationHandler = c->inflightPublishes[index].applicationHandler;
+    pd.pContext = c->inflightPublishes[index].pContext;
+
+#if AWS_IOT_MQTT_STATS
+    if(MQTT_SUCCESS == rc && QOS1 == c->inflightPublishes[index].qos) {
+        histogramAdd(&(c->stats.pubackLatency), timer_now_us() - c->inflightPublishes[index].sentUs);
+    } else if(MQTT_PUBLISH_ACK_TIMEOUT_ERROR == rc) {
+        c->stats.publishAckTimeouts++;
+    }
+#endif
+
+    /* Free the slot before the callback so the application can publish again from it */
+    timerWheelStop(&(c->timerWheel), &(c->inflightPublishes[index].ackTimer));
+    c->inflightPublishes[index].isFree = 1;
+    c->inflightPublishCount--;
+#if AWS_IOT_MQTT_THREAD_SAFE
+    /* The broker may take one more publish now */
+    signal_give(&(c->ackWaiterFreed));
+#endif
+
+    if(NULL != c->inflightPublishes[index].fp) {
+        c->inflightPublishes[index].fp(&pd);
+    }
+}
+
+/* Take a waiter slot for the reply to a command, before the command is sent
+ * so that the reply can not be read before the slot is there. While all
+ * MAX_ACK_WAITERS slots are taken, or the broker takes no more publishes,
+ * waits for the other commands to get their replies until timer expires.
+ * NULL then, at once with no timer or on the reader, which would keep those
+ * replies from being read */
+static struct AckWaiters *addAckWaiter(Client *c, uint8_t packetType, uint16_t packetId, Timer *timer) {
+    struct AckWaiters *pWaiter = NULL;
+    uint32_t i;
+
+    for(;;) {
+        LOCK(c, stateLock);
+        if(!(PUBACK == packetType || PUBCOMP == packetType) || !isReceiveMaximumReached(c)) {
+            for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+                if(0 == c->ackWaiters[i].packetType) {
+                    pWaiter = &(c->ackWaiters[i]);
+                    pWaiter->packetType = packetType;
+                    pWaiter->packetId = packetId;
+                    pWaiter->isDone = 0;
+                    pWaiter->rc = MQTT_FAILURE;
+                    break;
+                }
+            }
+        }
+        UNLOCK(c, stateLock);
+
+#if AWS_IOT_MQTT_THREAD_SAFE
+        if(NULL == pWaiter && NULL != timer && !isReader(c) && !expired(timer)) {
+            signal_wait(&(c->ackWaiterFreed), (uint32_t)left_ms(timer));
+            continue;
+        }
+#endif
+        return pWaiter;
+    }
+}
+
+static void removeAckWaiter(Client *c, struct AckWaiters *pWaiter) {
+    LOCK(c, stateLock);
+    pWaiter->packetType = 0;
+#if AWS_IOT_MQTT_THREAD_SAFE
+    signal_give(&(c->ackWaiterFreed));
+#endif
+    UNLOCK(c, stateLock);
+}
+
+/* Hand a reply read by the reader to the thread waiting for it */
+static void completeAckWaiter(Client *c, uint8_t packetType, uint16_t packetId, MQTTReturnCode rc) {
+    uint32_t i;
+
+    LOCK(c, stateLock);
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        if(packetType == c->ackWaiters[i].packetType && packetId == c->ackWaiters[i].packetId
+           && 0 == c->ackWaiters[i].isDone) {
+            c->ackWaiters[i].rc = rc;
+            c->ackWaiters[i].isDone = 1;
+#if AWS_IOT_MQTT_THREAD_SAFE
+            signal_give(&(c->ackWaiters[i].signal));
+#endif
+            break;
+        }
+    }
+    UNLOCK(c, stateLock);
+}
+
+static void failAckWaiters(Client *c, MQTTReturnCode rc) {
+    uint32_t i;
+
+    LOCK(c, stateLock);
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        if(0 != c->ackWaiters[i].packetType && 0 == c->ackWaiters[i].isDone) {
+            c->ackWaiters[i].rc = rc;
+            c->ackWaiters[i].isDone = 1;
+#if AWS_IOT_MQTT_THREAD_SAFE
+            signal_give(&(c->ackWaiters[i].signal));
+#endif
+        }
+    }
+    UNLOCK(c, stateLock);
+}
+
+/* Wait for the reply of addAckWaiter(). While no other thread reads the
+ * network this one does, otherwise it sleeps until the reader hands it the
+ * reply or stops reading */
+static MQTTReturnCode waitforAck(Client *c, struct AckWaiters *pWaiter, Timer *timer) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    uint8_t read_packet_type = 0;
+
+    while(0 == pWaiter->isDone && !expired(timer)) {
+        if(0 != lockReader(c, 0)) {
+#if AWS_IOT_MQTT_THREAD_SAFE
+            signal_wait(&(pWaiter->signal), (uint32_t)left_ms(timer));
+#endif
+            continue;
+        }
+
+        /* The request may still be in the batch */
+        LOCK(c, writeLock);
+        rc = flushTxBatch(c, timer);
+        UNLOCK(c, writeLock);
+
+        while(MQTT_SUCCESS == rc && 0 == pWaiter->isDone && !expired(timer)) {
+            rc = cycle(c, timer, &read_packet_type);
+            if(MQTT_NETWORK_DISCONNECTED_ERROR != rc) {
+                /* Packets of others that could not be handled do not end the wait */
+                rc = MQTT_SUCCESS;
+            }
+        }
+        unlockReader(c);
+
+        if(MQTT_SUCCESS != rc) {
+            break;
+        }
+    }
+
+    if(0 != pWaiter->isDone) {
+        rc = pWaiter->rc;
+    } else if(MQTT_SUCCESS == rc) {
+        /* we timed out */
+        rc = MQTT_FAILURE;
+    }
+    removeAckWaiter(c, pWaiter);
+
+    return rc;
+}
+
+/* Matches a PUBACK or PUBCOMP against the asynchronous in-flight window,
+ * then against the blocking MQTTPublish() calls */
+static MQTTReturnCode handlePublishAck(Client *c, uint8_t packet_type) {
+    uint16_t packet_id;
+    unsigned char dup, type, reasonCode = 0;
+    uint32_t i;
+    MQTTReturnCode rc;
+
+    rc = MQTTV5Deserialize_ack(&type, &dup, &packet_id, &reasonCode, c->readbuf, c->readBufSize);
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    /* send the PUBREL packet */
-    rc = sendPacket(c, len, timer);
+    /* An MQTT 5 broker can refuse the message in its ack */
+    rc = (MQTTV5_REASON_FAILURE <= reasonCode) ? MQTT_FAILURE : MQTT_SUCCESS;
+
+    LOCK(c, stateLock);
+    i = findInflightPublish(c, packet_id, (PUBACK == packet_type) ? QOS1 : QOS2);
+    if(MAX_INFLIGHT_PUBLISH > i) {
+        completeInflightPublish(c, i, rc);
+        UNLOCK(c, stateLock);
+        return MQTT_SUCCESS;
+    }
+    UNLOCK(c, stateLock);
+
+    completeAckWaiter(c, packet_type, packet_id, rc);
+    return MQTT_SUCCESS;
+}
+
+/* SUBACK and UNSUBACK only answer blocking commands */
+static MQTTReturnCode handleAck(Client *c, uint8_t packet_type) {
+    uint16_t packet_id;
+    uint32_t count = 0;
+    QoS grantedQoS[3] = {QOS0, QOS0, QOS0};
+    unsigned char reasonCode = 0;
+    MQTTReturnCode rc;
+
+    if(5 == c->options.MQTTVersion) {
+        /* A reason code per topic filter, the first failure fails the command */
+        rc = MQTTV5Deserialize_subunsuback(packet_type, &packet_id, &reasonCode, c->readbuf, c->readBufSize);
+        if(MQTT_SUCCESS != rc) {
+            return rc;
+        }
+        completeAckWaiter(c, packet_type, packet_id,
+                          (MQTTV5_REASON_FAILURE <= reasonCode) ? MQTT_FAILURE : MQTT_SUCCESS);
+        return MQTT_SUCCESS;
+    }
+
+    if(SUBACK == packet_type) {
+        /* Granted QoS can be 0, 1 or 2 */
+        rc = MQTTDeserialize_suback(&packet_id, 1, &count, grantedQoS, c->readbuf, c->readBufSize);
+    } else {
+        rc = MQTTDeserialize_unsuback(&packet_id, c->readbuf, c->readBufSize);
+    }
     if(MQTT_SUCCESS != rc) {
-        /* there was a problem */
         return rc;
     }
 
+    completeAckWaiter(c, packet_type, packet_id, MQTT_SUCCESS);
     return MQTT_SUCCESS;
 }
 
-MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type) {
-    if(NULL == c || NULL == timer) {
-        return MQTT_NULL_VALUE_ERROR;
+/* Ack timer of an asynchronous publish, called by timerWheelRun() */
+static void inflightPublishTimedOut(TimerWheelEntry *pEntry, void *pContext) {
+    Client *c = (Client *)pContext;
+    struct InflightPublishes *pInflight =
+        (struct InflightPublishes *)((char *)pEntry - offsetof(struct InflightPublishes, ackTimer));
+
+    completeInflightPublish(c, (uint32_t)(pInflight - c->inflightPublishes), MQTT_PUBLISH_ACK_TIMEOUT_ERROR);
+}
+
+/* In a persistent session the broker keeps the QoS2 publishes it sent a
+ * PUBREC for, those wait for the reconnect to send their PUBREL again */
+static void failInflightPublishes(Client *c, MQTTReturnCode rc) {
+    uint32_t i;
+
+    LOCK(c, stateLock);
+    for(i = 0; i < MAX_INFLIGHT_PUBLISH && 0 < c->inflightPublishCount; ++i) {
+        if(c->inflightPublishes[i].isFree) {
+            continue;
+        }
+        if(0 == c->options.cleansession && c->inflightPublishes[i].isReleased) {
+            timerWheelStop(&(c->timerWheel), &(c->inflightPublishes[i].ackTimer));
+        } else {
+            completeInflightPublish(c, i, rc);
+        }
     }
+    UNLOCK(c, stateLock);
+
+    /* Nor will the replies to blocking commands */
+    failAckWaiters(c, rc);
+}
+
+/* After a connect, the publishes failInflightPublishes() kept get their
+ * PUBREL sent again if the broker still has the session, and fail if not */
+static void resumeInflightPublishes(Client *c, Timer *timer) {
+    uint32_t i;
 
+    LOCK(c, stateLock);
+    for(i = 0; i < MAX_INFLIGHT_PUBLISH && 0 < c->inflightPublishCount; ++i) {
+        if(c->inflightPublishes[i].isFree || !c->inflightPublishes[i].isReleased
+           || timerWheelIsPending(&(c->inflightPublishes[i].ackTimer))) {
+            continue;
+        }
+        if(!c->isSessionPresent) {
+            completeInflightPublish(c, i, MQTT_NETWORK_DISCONNECTED_ERROR);
+            continue;
+        }
+        timerWheelStart(&(c->timerWheel), &(c->inflightPublishes[i].ackTimer), c->commandTimeoutMs);
+        /* A PUBREL that is not sent now times out */
+        (void)sendAck(c, timer, PUBREL, c->inflightPublishes[i].packetId);
+    }
+    UNLOCK(c, stateLock);
+}
+
+static AWS_IOT_HOT_FUNC MQTTReturnCode cycleWithTimeout(Client *c, Timer *timer, int firstByteTimeoutMs, uint8_t *packet_type) {
     /* read the socket, see what work is due */
-    MQTTReturnCode rc = readPacket(c, timer, packet_type);
+    MQTTReturnCode rc = readPacketWithTimeout(c, timer, firstByteTimeoutMs, packet_type);
     if(MQTT_NOTHING_TO_READ == rc) {
         /* Nothing to read, not a cycle failure */
         return MQTT_SUCCESS;
@@ -490,11 +1794,24 @@ MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type) {
         return rc;
     }
 
+    /* Whatever the broker sends shows the connection is up as well as a
+     * PINGRESP would */
+    if(KEEPALIVE_ON_IDLE == c->keepAlivePolicy) {
+        c->isPingOutstanding = 0;
+    }
+
     switch(*packet_type) {
-        case CONNACK:
         case PUBACK:
+        case PUBCOMP: {
+            rc = handlePublishAck(c, *packet_type);
+            break;
+        }
         case SUBACK:
-        case UNSUBACK:
+        case UNSUBACK: {
+            rc = handleAck(c, *packet_type);
+            break;
+        }
+        case CONNACK:
             break;
         case PUBLISH: {
             rc = handlePublish(c, timer);
@@ -504,11 +1821,22 @@ MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type) {
             rc = handlePubrec(c, timer);
             break;
         }
-        case PUBCOMP:
+        case PUBREL: {
+            rc = handlePubrel(c, timer);
             break;
+        }
         case PINGRESP: {
             c->isPingOutstanding = 0;
-            countdown(&c->pingTimer, c->keepAliveInterval);
+            break;
+        }
+        case DISCONNECT: {
+            if(5 != c->options.MQTTVersion) {
+                return MQTT_BUFFER_RX_MESSAGE_INVALID;
+            }
+            /* An MQTT 5 broker closing the connection, keepalive() takes
+             * it down as if the PINGRESP had not come */
+            c->isPingOutstanding = 1;
+            countdown_ms(&c->pingRespTimer, 0);
             break;
         }
         default: {
@@ -522,6 +1850,57 @@ MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type) {
     return rc;
 }
 
+/* Handle the packets the network layer already holds behind the one just
+ * read, a burst of deltas or notifications, without going back to the
+ * timers and the keepalive for each. Only data buffered above the socket
+ * is taken, whatever is still in the socket waits for the next round */
+static AWS_IOT_HOT_FUNC MQTTReturnCode drainBuffered(Client *c, Timer *timer) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    uint8_t packet_type;
+    uint32_t n;
+
+    if(NULL == c->networkStack.mqttwait) {
+        return MQTT_SUCCESS;
+    }
+
+    for(n = 0; n < MAX_DRAIN_PACKETS && 1 == c->isConnected; n++) {
+        if(NETWORK_WAIT_BUFFERED != c->networkStack.mqttwait(&(c->networkStack), 0)) {
+            break;
+        }
+        packet_type = 0;
+        /* The buffered data may turn out to be nothing, do not block on it */
+        rc = cycleWithTimeout(c, timer, 1, &packet_type);
+        if(MQTT_SUCCESS != rc || 0 == packet_type) {
+            break;
+        }
+    }
+
+    return rc;
+}
+
+AWS_IOT_HOT_FUNC MQTTReturnCode cycle(Client *c, Timer *timer, uint8_t *packet_type) {
+    if(NULL == c || NULL == timer) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    return cycleWithTimeout(c, timer, left_ms(timer), packet_type);
+}
+
+/* Start the reconnect after the connection was lost. A connection that
+ * was up for a while most likely met a passing fault and is retried soon,
+ * one that keeps dropping goes to the back-off at once */
+static void startReconnect(Client *c) {
+    c->currentReconnectWaitInterval = MIN_RECONNECT_WAIT_INTERVAL;
+    if(expired(&(c->stableTimer))) {
+        c->reconnectState = RECONNECT_FAST;
+        countdown_jitter_ms(&(c->reconnectDelayTimer), FAST_RECONNECT_WINDOW);
+    } else {
+        c->reconnectState = RECONNECT_BACKOFF;
+        countdown_jitter_ms(&(c->reconnectDelayTimer), c->currentReconnectWaitInterval);
+    }
+    c->counterNetworkDisconnected++;
+}
+
 MQTTReturnCode MQTTYield(Client *c, uint32_t timeout_ms) {
     if(NULL == c) {
         return MQTT_NULL_VALUE_ERROR;
@@ -543,6 +1922,11 @@ MQTTReturnCode MQTTYield(Client *c, uint32_t timeout_ms) {
     uint8_t packet_type;
     countdown_ms(&timer, timeout_ms);
 
+    /* Another thread reading for the whole time does the work of the yield */
+    if(0 != lockReader(c, timeout_ms)) {
+        return MQTT_SUCCESS;
+    }
+
     while(!expired(&timer)) {
         if(0 == c->isConnected) {
             if(MAX_RECONNECT_WAIT_INTERVAL < c->currentReconnectWaitInterval) {
@@ -555,16 +1939,30 @@ MQTTReturnCode MQTTYield(Client *c, uint32_t timeout_ms) {
             continue;
         }
 
+        /* Nothing of an open batch may wait for the read */
+        LOCK(c, writeLock);
+        rc = flushTxBatch(c, &timer);
+        UNLOCK(c, writeLock);
+        if(MQTT_SUCCESS != rc) {
+            break;
+        }
+
+        packet_type = 0;
         rc = cycle(c, &timer, &packet_type);
+        if(MQTT_SUCCESS == rc && 0 != packet_type) {
+            rc = drainBuffered(c, &timer);
+        }
         if(MQTT_SUCCESS != rc) {
             break;
         }
 
+        LOCK(c, stateLock);
+        timerWheelRun(&(c->timerWheel));
+        UNLOCK(c, stateLock);
+
         rc = keepalive(c);
         if(MQTT_NETWORK_DISCONNECTED_ERROR == rc && 1 == c->isAutoReconnectEnabled) {
-            c->currentReconnectWaitInterval = MIN_RECONNECT_WAIT_INTERVAL;
-            countdown_ms(&(c->reconnectDelayTimer), c->currentReconnectWaitInterval);
-            c->counterNetworkDisconnected++;
+            startReconnect(c);
             /* Depending on timer values, it is possible that yield timer has expired
              * Set to rc to attempting reconnect to inform client that autoreconnect
              * attempt has started */
@@ -573,11 +1971,188 @@ MQTTReturnCode MQTTYield(Client *c, uint32_t timeout_ms) {
             break;
         }
     }
+    unlockReader(c);
+
+    return rc;
+}
+
+/* Time until the next thing MQTTYieldUntilEvent() has to do on its own:
+ * end of the yield, keepalive or ack timeout of an asynchronous publish */
+static int nextEventTimeout(Client *c, Timer *timer) {
+    int timeout = left_ms(timer);
+    int left;
+
+    if(0 != c->keepAliveInterval) {
+        left = left_ms(c->isPingOutstanding ? &c->pingRespTimer : &c->pingTimer);
+        if(left < timeout) {
+            timeout = left;
+        }
+    }
+
+    LOCK(c, stateLock);
+    left = timerWheelNextTimeout(&(c->timerWheel));
+    UNLOCK(c, stateLock);
+    if(0 <= left && left < timeout) {
+        timeout = left;
+    }
+
+    return (0 > timeout) ? 0 : timeout;
+}
+
+MQTTReturnCode MQTTYieldUntilEvent(Client *c, uint32_t timeout_ms) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    /* Reconnecting, and networks that can not wait for data, use the polling yield */
+    if(0 == c->isConnected || NULL == c->networkStack.mqttwait) {
+        return MQTTYield(c, timeout_ms);
+    }
+
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    MQTTReturnCode flushRc;
+    Timer timer;
+    Timer packetTimer;
+    uint8_t packet_type;
+    uint8_t gotEvent = 0;
+    int waitResult;
+
+    InitTimer(&timer);
+    InitTimer(&packetTimer);
+    countdown_ms(&timer, timeout_ms);
+
+    /* Another thread reading for the whole time does the work of the yield */
+    if(0 != lockReader(c, timeout_ms)) {
+        return MQTT_SUCCESS;
+    }
+
+    /* The acks and pings sent while handling a burst of packets share a TLS
+     * record. Packets of other threads go out at once */
+    c->isYieldBatchOpen = 1;
+    do {
+        if(0 == gotEvent) {
+            /* Nothing collected may wait for the next event */
+            countdown_ms(&packetTimer, c->commandTimeoutMs);
+            LOCK(c, writeLock);
+            rc = flushTxBatch(c, &packetTimer);
+            UNLOCK(c, writeLock);
+            if(MQTT_SUCCESS != rc) {
+                break;
+            }
+        }
+
+        /* Once something happened only collect what is already there */
+        waitResult = c->networkStack.mqttwait(&(c->networkStack), gotEvent ? 0 : nextEventTimeout(c, &timer));
+
+        if(NETWORK_WAIT_READABLE == waitResult || NETWORK_WAIT_BUFFERED == waitResult) {
+            gotEvent = 1;
+            packet_type = 0;
+            countdown_ms(&packetTimer, c->commandTimeoutMs);
+            /* Buffered data may turn out to be nothing, do not block on it */
+            rc = cycleWithTimeout(c, &packetTimer,
+                                  (NETWORK_WAIT_BUFFERED == waitResult) ? 1 : left_ms(&packetTimer), &packet_type);
+            if(MQTT_SUCCESS == rc && 0 != packet_type) {
+                rc = drainBuffered(c, &packetTimer);
+            }
+            if(MQTT_SUCCESS != rc) {
+                break;
+            }
+            if(NETWORK_WAIT_READABLE == waitResult && 0 == packet_type) {
+                /* The socket was readable but nothing could be read: the connection is gone */
+                rc = handleDisconnect(c);
+                if(1 == c->isAutoReconnectEnabled) {
+                    startReconnect(c);
+                    rc = MQTT_ATTEMPTING_RECONNECT;
+                }
+                break;
+            }
+        } else if(NETWORK_WAIT_WOKEN == waitResult) {
+            gotEvent = 1;
+        } else if(0 > waitResult) {
+            rc = MQTT_FAILURE;
+            break;
+        } else if(1 == gotEvent) {
+            /* Nothing left to read */
+            break;
+        }
+
+        LOCK(c, stateLock);
+        timerWheelRun(&(c->timerWheel));
+        UNLOCK(c, stateLock);
+
+        rc = keepalive(c);
+        if(MQTT_NETWORK_DISCONNECTED_ERROR == rc && 1 == c->isAutoReconnectEnabled) {
+            startReconnect(c);
+            rc = MQTT_ATTEMPTING_RECONNECT;
+            break;
+        } else if(MQTT_SUCCESS != rc) {
+            break;
+        }
+    } while(1 == gotEvent || !expired(&timer));
+
+    c->isYieldBatchOpen = 0;
+    if(1 == c->isConnected) {
+        countdown_ms(&packetTimer, c->commandTimeoutMs);
+        LOCK(c, writeLock);
+        flushRc = isTxBatched(c) ? MQTT_SUCCESS : flushTxBatch(c, &packetTimer);
+        UNLOCK(c, writeLock);
+        if(MQTT_SUCCESS != flushRc && MQTT_SUCCESS == rc) {
+            rc = handleDisconnect(c);
+            if(1 == c->isAutoReconnectEnabled) {
+                startReconnect(c);
+                rc = MQTT_ATTEMPTING_RECONNECT;
+            }
+        }
+    }
+    unlockReader(c);
+
+    return rc;
+}
+
+void MQTTWakeup(Client *c) {
+    if(NULL == c || NULL == c->networkStack.mqttwakeup) {
+        return;
+    }
+
+    c->networkStack.mqttwakeup(&(c->networkStack));
+}
+
+void MQTTBatchBegin(Client *c) {
+    if(NULL == c) {
+        return;
+    }
+
+    LOCK(c, writeLock);
+    txBatchBegin(c);
+    UNLOCK(c, writeLock);
+}
+
+MQTTReturnCode MQTTBatchEnd(Client *c) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    Timer timer;
+
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    LOCK(c, writeLock);
+    if(0 == txBatchEnd(c)) {
+        rc = MQTT_NULL_VALUE_ERROR;
+    } else {
+        if(!isTxBatched(c) && 1 == c->isConnected) {
+            InitTimer(&timer);
+            countdown_ms(&timer, c->commandTimeoutMs);
+            rc = flushTxBatch(c, &timer);
+        }
+    }
+    UNLOCK(c, writeLock);
 
     return rc;
 }
 
-/* only used in single-threaded mode where one command at a time is in process */
+/* Read until a packet of packet_type is in readbuf, called by the reader.
+ * Only used for the CONNACK, the replies that have a packet id go through
+ * waitforAck() */
 MQTTReturnCode waitfor(Client *c, uint8_t packet_type, Timer *timer) {
     if(NULL == c || NULL == timer) {
         return MQTT_NULL_VALUE_ERROR;
@@ -585,6 +2160,15 @@ MQTTReturnCode waitfor(Client *c, uint8_t packet_type, Timer *timer) {
 
     MQTTReturnCode rc = MQTT_FAILURE;
     uint8_t read_packet_type = 0;
+
+    /* The request may still be in the batch */
+    LOCK(c, writeLock);
+    rc = flushTxBatch(c, timer);
+    UNLOCK(c, writeLock);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
     do {
         if(expired(timer)) {
             /* we timed out */
@@ -601,17 +2185,13 @@ MQTTReturnCode waitfor(Client *c, uint8_t packet_type, Timer *timer) {
     return rc;
 }
 
-MQTTReturnCode MQTTConnect(Client *c, MQTTPacket_connectData *options) {
-
-    if(NULL == c) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
-
+static MQTTReturnCode connect(Client *c, MQTTPacket_connectData *options) {
     Timer connect_timer;
     MQTTReturnCode connack_rc = MQTT_FAILURE;
     char sessionPresent = 0;
     uint32_t len = 0;
     MQTTReturnCode rc = MQTT_FAILURE;
+    MQTTV5ConnackProperties props = {65535, 0, 0, 2};
 
     InitTimer(&connect_timer);
     countdown_ms(&connect_timer, c->commandTimeoutMs);
@@ -621,237 +2201,602 @@ MQTTReturnCode MQTTConnect(Client *c, MQTTPacket_connectData *options) {
         return MQTT_NETWORK_ALREADY_CONNECTED_ERROR;
     }
 
-    if(NULL != options) {
-        /* override default options if new options were supplied */
-        copyMQTTConnectData(&(c->options), options);
+    if(NULL != options) {
+        /* override default options if new options were supplied */
+        copyMQTTConnectData(&(c->options), options);
+    }
+
+    LOCK(c, writeLock);
+    c->isTxCorked = 0;
+#if 0 < MAX_TOPIC_ALIASES
+    resetTopicAliases(c);
+#endif
+    c->networkInitHandler(&(c->networkStack));
+    rc = c->networkStack.connect(&(c->networkStack), c->tlsConnectParams);
+    if(0 != rc) {
+        /* TLS Connect failed, return error */
+        rc = MQTT_FAILURE;
+    } else {
+        c->keepAliveInterval = c->options.keepAliveInterval;
+        acquireTxBuf(c);
+        rc = MQTTSerialize_connect(c->buf, c->bufSize, &(c->options), &len);
+        if(MQTT_SUCCESS != rc || 0 >= len) {
+            rc = MQTT_FAILURE;
+        } else {
+            /* send the connect packet */
+            rc = sendPacket(c, len, &connect_timer);
+        }
+    }
+    UNLOCK(c, writeLock);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
+    /* this will be a blocking call, wait for the CONNACK */
+    rc = waitfor(c, CONNACK, &connect_timer);
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
+    /* Received CONNACK, check the return code */
+    if(5 == c->options.MQTTVersion) {
+        rc = MQTTV5Deserialize_connack((unsigned char *)&sessionPresent, &connack_rc, &props,
+                                       c->readbuf, c->readBufSize);
+        c->receiveMaximum = props.receiveMaximum;
+        c->topicAliasMaximum = props.topicAliasMaximum;
+    } else {
+        rc = MQTTDeserialize_connack((unsigned char *)&sessionPresent, &connack_rc, c->readbuf, c->readBufSize);
+    }
+    if(MQTT_SUCCESS != rc) {
+        return rc;
+    }
+
+    if(MQTT_CONNACK_CONNECTION_ACCEPTED != connack_rc) {
+        return connack_rc;
+    }
+
+    /* A new session, the broker will not send the PUBRELs of the old one */
+    c->isSessionPresent = sessionPresent ? 1 : 0;
+    if(!sessionPresent) {
+        LOCK(c, stateLock);
+        memset(c->qos2Received, 0, sizeof(c->qos2Received));
+        UNLOCK(c, stateLock);
+    }
+
+    c->isConnected = 1;
+    c->wasManuallyDisconnected = 0;
+    c->isPingOutstanding = 0;
+    countdown_ms(&(c->stableTimer), MAX_RECONNECT_WAIT_INTERVAL);
+    countdown(&c->pingTimer, c->keepAliveInterval);
+
+    resumeInflightPublishes(c, &connect_timer);
+
+    return MQTT_SUCCESS;
+}
+
+MQTTReturnCode MQTTConnect(Client *c, MQTTPacket_connectData *options) {
+    MQTTReturnCode rc;
+
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    /* The CONNACK is read by this thread */
+    lockReader(c, THREADS_WAIT_FOREVER);
+    rc = connect(c, options);
+    unlockReader(c);
+
+    return rc;
+}
+
+/* Take the first free handler, index, for a subscription. Called with
+ * stateLock held, the filter is in the trie already */
+static void setMessageHandler(Client *c, uint32_t index, const MQTTSubscription *pSubscription,
+                              messageHandler messageHandler, uint8_t isLocal) {
+    c->firstFreeHandler = c->messageHandlers[index].nextFree;
+    setHandlerTopicFilter(c, index, pSubscription->topicFilter);
+    c->messageHandlers[index].fp = messageHandler;
+    c->messageHandlers[index].applicationHandler = pSubscription->applicationHandler;
+    c->messageHandlers[index].qos = pSubscription->qos;
+    c->messageHandlers[index].isStreaming = pSubscription->isStreaming;
+    c->messageHandlers[index].dispatch = pSubscription->dispatch;
+    c->messageHandlers[index].isLocal = isLocal;
+}
+
+/* The handlers are in place before the SUBSCRIBE goes out, which keeps
+ * their slots from other threads that subscribe at the same time. Nothing
+ * is published to the new filters before the broker has them */
+/* Called with writeLock held */
+static MQTTReturnCode serializeSubscribe(Client *c, uint16_t packetId, uint32_t count,
+                                         MQTTString *topics, QoS *qos, uint32_t *pLen) {
+    if(5 == c->options.MQTTVersion) {
+        return MQTTV5Serialize_subscribe(c->buf, c->bufSize, 0, packetId, count, topics, qos, pLen);
+    }
+    return MQTTSerialize_subscribe(c->buf, c->bufSize, 0, packetId, count, topics, qos, pLen);
+}
+
+MQTTReturnCode MQTTSubscribeMany(Client *c, const MQTTSubscription *pSubscriptions, uint32_t count,
+                                 messageHandler messageHandler) {
+    if(NULL == c || NULL == pSubscriptions || NULL == messageHandler) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    if(0 == count || MAX_MESSAGE_HANDLERS < count) {
+        return MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+    }
+
+    MQTTReturnCode rc = MQTT_FAILURE;
+    Timer timer;
+    uint32_t len = 0;
+    uint32_t indexes[MAX_MESSAGE_HANDLERS];
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
+    QoS qos[MAX_MESSAGE_HANDLERS];
+    uint16_t packetId;
+    struct AckWaiters *pWaiter;
+    uint32_t i;
+    uint32_t index;
+
+    for(i = 0; i < count; i++) {
+        if(NULL == pSubscriptions[i].topicFilter || NULL == pSubscriptions[i].applicationHandler) {
+            return MQTT_NULL_VALUE_ERROR;
+        }
+        topics[i].cstring = (char *)pSubscriptions[i].topicFilter;
+        topics[i].lenstring.len = 0;
+        topics[i].lenstring.data = NULL;
+        qos[i] = pSubscriptions[i].qos;
+    }
+
+    if(!c->isConnected) {
+        return MQTT_NETWORK_DISCONNECTED_ERROR;
+    }
+
+    InitTimer(&timer);
+    countdown_ms(&timer, c->commandTimeoutMs);
+
+    LOCK(c, stateLock);
+    for(i = 0; i < count; i++) {
+        index = c->firstFreeHandler;
+        if(NO_MESSAGE_HANDLER == index) {
+            rc = MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+            break;
+        }
+
+        rc = MQTTTopicTrieInsert(&(c->topicTrie), pSubscriptions[i].topicFilter, index);
+        if(MQTT_SUCCESS != rc) {
+            break;
+        }
+
+        setMessageHandler(c, index, &pSubscriptions[i], messageHandler, 0);
+        indexes[i] = index;
+    }
+    UNLOCK(c, stateLock);
+
+    if(MQTT_SUCCESS == rc) {
+        packetId = getNextPacketId(c);
+        pWaiter = addAckWaiter(c, SUBACK, packetId, &timer);
+        if(NULL == pWaiter) {
+            rc = MQTT_FAILURE;
+        } else {
+            /* send the subscribe packet */
+            LOCK(c, writeLock);
+            acquireTxBuf(c);
+            rc = serializeSubscribe(c, packetId, count, topics, qos, &len);
+            if(MQTT_SUCCESS == rc) {
+                rc = sendPacket(c, len, &timer);
+            }
+            UNLOCK(c, writeLock);
+
+            if(MQTT_SUCCESS == rc) {
+                /* wait for suback, the granted QoS is not checked */
+                rc = waitforAck(c, pWaiter, &timer);
+            } else {
+                removeAckWaiter(c, pWaiter);
+            }
+        }
+    }
+
+    if(MQTT_SUCCESS != rc) {
+        /* i handlers were put in place */
+        LOCK(c, stateLock);
+        while(0 < i--) {
+            freeMessageHandler(c, indexes[i]);
+        }
+        rebuildTopicTrie(c);
+        UNLOCK(c, stateLock);
+    }
+
+    return rc;
+}
+
+MQTTReturnCode MQTTSubscribeLocal(Client *c, const MQTTSubscription *pSubscription,
+                                  messageHandler messageHandler) {
+    if(NULL == c || NULL == pSubscription || NULL == messageHandler
+       || NULL == pSubscription->topicFilter || NULL == pSubscription->applicationHandler) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    MQTTReturnCode rc;
+    uint32_t index;
+
+    LOCK(c, stateLock);
+    index = c->firstFreeHandler;
+    if(NO_MESSAGE_HANDLER == index) {
+        rc = MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+    } else {
+        rc = MQTTTopicTrieInsert(&(c->topicTrie), pSubscription->topicFilter, index);
+        if(MQTT_SUCCESS == rc) {
+            setMessageHandler(c, index, pSubscription, messageHandler, 1);
+        }
+    }
+    UNLOCK(c, stateLock);
+
+    return rc;
+}
+
+/* The message is delivered in the calling thread, to the subscription the
+ * topic matches as if it came from the broker, local or not. Nothing is
+ * sent, and the packet id of a QoS 1 or 2 message stays 0 */
+MQTTReturnCode MQTTPublishLocal(Client *c, const char *topicName, MQTTMessage *message) {
+    if(NULL == c || NULL == topicName || NULL == message) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    MQTTString topic;
+
+    /* The handlers take the topic from lenstring, like that of a received PUBLISH */
+    topic.cstring = NULL;
+    topic.lenstring.data = (char *)topicName;
+    topic.lenstring.len = (int)strlen(topicName);
+    message->id = 0;
+    message->dup = 0;
+
+    return deliverToHandler(c, &topic, message, 0);
+}
+
+MQTTReturnCode MQTTSubscribe(Client *c, const char *topicFilter, QoS qos,
+                  messageHandler messageHandler, pApplicationHandler_t applicationHandler) {
+    MQTTSubscription subscription = {topicFilter, qos, applicationHandler, 0, 0, 0};
+
+    return MQTTSubscribeMany(c, &subscription, 1, messageHandler);
+}
+
+MQTTReturnCode MQTTSubscribeStreaming(Client *c, const char *topicFilter, QoS qos,
+                  messageHandler messageHandler, pApplicationHandler_t applicationHandler) {
+    MQTTSubscription subscription = {topicFilter, qos, applicationHandler, 1, 0, 0};
+
+    return MQTTSubscribeMany(c, &subscription, 1, messageHandler);
+}
+
+/* Wait for the SUBACKs of all pWaiters, the first error is returned */
+static MQTTReturnCode waitforSubacks(Client *c, struct AckWaiters **pWaiters, uint32_t count, Timer *timer) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    MQTTReturnCode ackRc;
+    uint32_t i;
+
+    /* The reader handles all SUBACKs that arrive while it waits for the first */
+    for(i = 0; i < count; i++) {
+        ackRc = waitforAck(c, pWaiters[i], timer);
+        if(MQTT_SUCCESS == rc) {
+            rc = ackRc;
+        }
     }
 
-    c->networkInitHandler(&(c->networkStack));
-    rc = c->networkStack.connect(&(c->networkStack), c->tlsConnectParams);
-    if(0 != rc) {
-        /* TLS Connect failed, return error */
-        return MQTT_FAILURE;
-    }
+    return rc;
+}
 
-    c->keepAliveInterval = c->options.keepAliveInterval;
-    rc = MQTTSerialize_connect(c->buf, c->bufSize, &(c->options), &len);
-    if(MQTT_SUCCESS != rc || 0 >= len) {
-        return MQTT_FAILURE;
+/* Subscribes to all topic filters again, in as few SUBSCRIBE packets as
+ * fit in buf. The packets are all sent before their SUBACKs are waited
+ * for, up to MAX_ACK_WAITERS at a time. Nothing is sent when the broker
+ * kept the session */
+MQTTReturnCode MQTTResubscribe(Client *c) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
     }
 
-    /* send the connect packet */
-    rc = sendPacket(c, len, &connect_timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    if(!c->isConnected) {
+        return MQTT_NETWORK_DISCONNECTED_ERROR;
     }
 
-    /* this will be a blocking call, wait for the CONNACK */
-    rc = waitfor(c, CONNACK, &connect_timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    if(c->isSessionPresent) {
+        return MQTT_SUCCESS;
     }
 
-    /* Received CONNACK, check the return code */
-    rc = MQTTDeserialize_connack((unsigned char *)&sessionPresent, &connack_rc, c->readbuf, c->readBufSize);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
-    }
+    MQTTReturnCode rc = MQTT_SUCCESS;
+    Timer timer;
+    uint32_t len = 0;
+    uint16_t packetId;
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
+    QoS qos[MAX_MESSAGE_HANDLERS];
+    struct AckWaiters *pWaiter;
+    struct AckWaiters *pWaiters[MAX_ACK_WAITERS];
+    uint32_t waiting = 0;
+    uint32_t subCount;
+    uint32_t count;
+    uint32_t itr;
+    uint32_t handler = 0;
 
-    if(MQTT_CONNACK_CONNECTION_ACCEPTED != connack_rc) {
-        return connack_rc;
+    InitTimer(&timer);
+    countdown_ms(&timer, c->commandTimeoutMs);
+
+    while(MQTT_SUCCESS == rc && handler < c->messageHandlerCount) {
+        /* The topic filters are taken MAX_MESSAGE_HANDLERS at a time */
+        subCount = 0;
+        for(; handler < c->messageHandlerCount && MAX_MESSAGE_HANDLERS > subCount; handler++) {
+            if(NULL != c->messageHandlers[handler].topicFilter && !c->messageHandlers[handler].isLocal) {
+                topics[subCount].cstring = (char *)c->messageHandlers[handler].topicFilter;
+                topics[subCount].lenstring.len = 0;
+                topics[subCount].lenstring.data = NULL;
+                qos[subCount] = c->messageHandlers[handler].qos;
+                subCount++;
+            }
+        }
+
+        itr = 0;
+        while(MQTT_SUCCESS == rc && itr < subCount) {
+            packetId = getNextPacketId(c);
+            /* No waiting for a slot, the ones taken here are only freed below */
+            pWaiter = (MAX_ACK_WAITERS > waiting) ? addAckWaiter(c, SUBACK, packetId, NULL) : NULL;
+            if(NULL == pWaiter) {
+                if(0 == waiting) {
+                    return MQTT_FAILURE;
+                }
+                rc = waitforSubacks(c, pWaiters, waiting, &timer);
+                waiting = 0;
+                continue;
+            }
+
+            /* send the subscribe packet, with as many filters as fit */
+            count = subCount - itr;
+            LOCK(c, writeLock);
+            acquireTxBuf(c);
+            do {
+                rc = serializeSubscribe(c, packetId, count, &topics[itr], &qos[itr], &len);
+            } while(MQTTPACKET_BUFFER_TOO_SHORT == rc && 0 < --count);
+            if(MQTT_SUCCESS == rc) {
+                rc = sendPacket(c, len, &timer);
+            }
+            UNLOCK(c, writeLock);
+            if(MQTT_SUCCESS != rc) {
+                removeAckWaiter(c, pWaiter);
+                break;
+            }
+
+            pWaiters[waiting++] = pWaiter;
+            itr += count;
+        }
     }
 
-    c->isConnected = 1;
-    c->wasManuallyDisconnected = 0;
-    c->isPingOutstanding = 0;
-    countdown(&c->pingTimer, c->keepAliveInterval);
+    if(0 < waiting) {
+        /* Also after a failed send, the waiter slots have to be freed */
+        MQTTReturnCode waitRc = waitforSubacks(c, pWaiters, waiting, &timer);
+        if(MQTT_SUCCESS == rc) {
+            rc = waitRc;
+        }
+    }
 
-    return MQTT_SUCCESS;
+    return rc;
 }
 
-/* Return MAX_MESSAGE_HANDLERS value if no free index is available */
-uint32_t GetFreeMessageHandlerIndex(Client *c) {
-    uint32_t itr;
-    for(itr = 0; itr < MAX_MESSAGE_HANDLERS; itr++) {
-        if(c->messageHandlers[itr].topicFilter == NULL) {
-            break;
+/* Called with stateLock held */
+static void removeMessageHandlers(Client *c, const char **topicFilters, uint32_t count) {
+    uint32_t i;
+    uint32_t j;
+
+    for(i = 0; i < c->messageHandlerCount; ++i) {
+        for(j = 0; j < count && NULL != c->messageHandlers[i].topicFilter; j++) {
+            if(strcmp(c->messageHandlers[i].topicFilter, topicFilters[j]) == 0) {
+                freeMessageHandler(c, i);
+                /* We don't want to break out of the handlers, if the same topic
+                 * is registered with 2 callbacks. Unlikely scenario */
+            }
         }
     }
-
-    return itr;
+    rebuildTopicTrie(c);
 }
 
-MQTTReturnCode MQTTSubscribe(Client *c, const char *topicFilter, QoS qos,
-                  messageHandler messageHandler, pApplicationHandler_t applicationHandler) {
-    if(NULL == c || NULL == topicFilter
-       || NULL == messageHandler || NULL == applicationHandler) {
+MQTTReturnCode MQTTUnsubscribeMany(Client *c, const char **topicFilters, uint32_t count) {
+    if(NULL == c || NULL == topicFilters) {
         return MQTT_NULL_VALUE_ERROR;
     }
 
-    if(!c->isConnected) {
-        return MQTT_NETWORK_DISCONNECTED_ERROR;
+    if(0 == count || MAX_MESSAGE_HANDLERS < count) {
+        return MQTT_FAILURE;
     }
 
     MQTTReturnCode rc = MQTT_FAILURE;
     Timer timer;
+    MQTTString topics[MAX_MESSAGE_HANDLERS];
     uint32_t len = 0;
-    uint32_t indexOfFreeMessageHandler;
-    uint32_t count = 0;
-    QoS grantedQoS[3] = {QOS0, QOS0, QOS0};
+    uint32_t i = 0;
+    uint32_t j;
     uint16_t packetId;
+    struct AckWaiters *pWaiter;
+    uint8_t hasLocal = 0;
+    uint8_t hasRemote = 0;
 
-    MQTTString topic = MQTTString_initializer;
-    topic.cstring = (char *)topicFilter;
+    for(j = 0; j < count; j++) {
+        if(NULL == topicFilters[j]) {
+            return MQTT_NULL_VALUE_ERROR;
+        }
+        topics[j].cstring = (char *)topicFilters[j];
+        topics[j].lenstring.len = 0;
+        topics[j].lenstring.data = NULL;
+    }
+
+    /* Filters only subscribed locally are removed without an UNSUBSCRIBE */
+    LOCK(c, stateLock);
+    for(i = 0; i < c->messageHandlerCount && !hasRemote; ++i) {
+        for(j = 0; j < count && NULL != c->messageHandlers[i].topicFilter; j++) {
+            if(strcmp(c->messageHandlers[i].topicFilter, topicFilters[j]) == 0) {
+                hasLocal |= c->messageHandlers[i].isLocal;
+                hasRemote |= !c->messageHandlers[i].isLocal;
+            }
+        }
+    }
+    if(hasLocal && !hasRemote) {
+        removeMessageHandlers(c, topicFilters, count);
+    }
+    UNLOCK(c, stateLock);
+    if(hasLocal && !hasRemote) {
+        return MQTT_SUCCESS;
+    }
+
+    if(!c->isConnected) {
+        return MQTT_NETWORK_DISCONNECTED_ERROR;
+    }
 
     InitTimer(&timer);
     countdown_ms(&timer, c->commandTimeoutMs);
 
-    rc = MQTTSerialize_subscribe(c->buf, c->bufSize, 0, getNextPacketId(c), 1, &topic, &qos, &len);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
-    }
-
-    indexOfFreeMessageHandler = GetFreeMessageHandlerIndex(c);
-    if(MAX_MESSAGE_HANDLERS <= indexOfFreeMessageHandler) {
-        return MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+    packetId = getNextPacketId(c);
+    pWaiter = addAckWaiter(c, UNSUBACK, packetId, &timer);
+    if(NULL == pWaiter) {
+        return MQTT_FAILURE;
     }
 
-    /* send the subscribe packet */
-    rc = sendPacket(c, len, &timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    /* send the unsubscribe packet */
+    LOCK(c, writeLock);
+    acquireTxBuf(c);
+    if(5 == c->options.MQTTVersion) {
+        rc = MQTTV5Serialize_unsubscribe(c->buf, c->bufSize, 0, packetId, count, topics, &len);
+    } else {
+        rc = MQTTSerialize_unsubscribe(c->buf, c->bufSize, 0, packetId, count, topics, &len);
+    }
+    if(MQTT_SUCCESS == rc) {
+        rc = sendPacket(c, len, &timer);
     }
-
-    /* wait for suback */
-    rc = waitfor(c, SUBACK, &timer);
+    UNLOCK(c, writeLock);
     if(MQTT_SUCCESS != rc) {
+        removeAckWaiter(c, pWaiter);
         return rc;
     }
 
-    /* Granted QoS can be 0, 1 or 2 */
-    rc = MQTTDeserialize_suback(&packetId, 1, &count, grantedQoS, c->readbuf, c->readBufSize);
+    rc = waitforAck(c, pWaiter, &timer);
     if(MQTT_SUCCESS != rc) {
         return rc;
     }
 
-    c->messageHandlers[indexOfFreeMessageHandler].topicFilter =
-            topicFilter;
-    c->messageHandlers[indexOfFreeMessageHandler].fp = messageHandler;
-    c->messageHandlers[indexOfFreeMessageHandler].applicationHandler =
-            applicationHandler;
-    c->messageHandlers[indexOfFreeMessageHandler].qos = qos;
+    /* Remove from message handler array */
+    LOCK(c, stateLock);
+    removeMessageHandlers(c, topicFilters, count);
+    UNLOCK(c, stateLock);
 
     return MQTT_SUCCESS;
 }
 
-MQTTReturnCode MQTTResubscribe(Client *c) {
-    if(NULL == c) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
+MQTTReturnCode MQTTUnsubscribe(Client *c, const char *topicFilter) {
+    return MQTTUnsubscribeMany(c, &topicFilter, 1);
+}
 
+/* Publishes on the topic, or with the template when it is not NULL, and
+ * waits for the ack */
+static MQTTReturnCode publish(Client *c, MQTTString topic, const MQTTPublishTemplate *tmpl,
+                              MQTTMessage *message) {
     if(!c->isConnected) {
         return MQTT_NETWORK_DISCONNECTED_ERROR;
     }
 
-    MQTTReturnCode rc = MQTT_FAILURE;
     Timer timer;
-    uint32_t len = 0;
-    uint32_t count = 0;
-    QoS grantedQoS[3] = {QOS0, QOS0, QOS0};
-    uint16_t packetId;
-    uint32_t existingSubCount = GetFreeMessageHandlerIndex(c);
-    uint32_t itr = 0;
-
-    for(itr = 0; itr < existingSubCount; itr++) {
-        MQTTString topic = MQTTString_initializer;
-        topic.cstring = (char *)c->messageHandlers[itr].topicFilter;
+    struct AckWaiters *pWaiter = NULL;
+    MQTTReturnCode rc = MQTT_FAILURE;
 
-        InitTimer(&timer);
-        countdown_ms(&timer, c->commandTimeoutMs);
+    InitTimer(&timer);
+    countdown_ms(&timer, c->commandTimeoutMs);
 
-        rc = MQTTSerialize_subscribe(c->buf, c->bufSize, 0, getNextPacketId(c), 1,
-                                     &topic, &(c->messageHandlers[itr].qos), &len);
-        if(MQTT_SUCCESS != rc) {
-            return rc;
+    if(QOS1 == message->qos || QOS2 == message->qos) {
+        message->id = getNextPacketId(c);
+        pWaiter = addAckWaiter(c, (QOS2 == message->qos) ? PUBCOMP : PUBACK, message->id, &timer);
+        if(NULL == pWaiter) {
+            return MQTT_FAILURE;
         }
+    }
 
-        /* send the subscribe packet */
-        rc = sendPacket(c, len, &timer);
-        if(MQTT_SUCCESS != rc) {
-            return rc;
+    /* send the publish packet */
+    LOCK(c, writeLock);
+    rc = sendPublish(c, topic, tmpl, message, &timer);
+    UNLOCK(c, writeLock);
+    if(MQTT_SUCCESS != rc) {
+        if(NULL != pWaiter) {
+            removeAckWaiter(c, pWaiter);
         }
+        return rc;
+    }
+#if AWS_IOT_MQTT_STATS
+    uint64_t sentUs = timer_now_us();
+#endif
 
-        /* wait for suback */
-        rc = waitfor(c, SUBACK, &timer);
+    /* Wait for ack if QoS1 or QoS2, acks of asynchronous publishes still in
+     * flight are matched to their own slots */
+    if(NULL != pWaiter) {
+        rc = waitforAck(c, pWaiter, &timer);
         if(MQTT_SUCCESS != rc) {
             return rc;
         }
-
-        /* Granted QoS can be 0, 1 or 2 */
-        rc = MQTTDeserialize_suback(&packetId, 1, &count, grantedQoS, c->readbuf, c->readBufSize);
-        if(MQTT_SUCCESS != rc) {
-            return rc;
+#if AWS_IOT_MQTT_STATS
+        if(QOS1 == message->qos) {
+            histogramAdd(&(c->stats.pubackLatency), timer_now_us() - sentUs);
         }
+#endif
     }
 
     return MQTT_SUCCESS;
 }
 
-MQTTReturnCode MQTTUnsubscribe(Client *c, const char *topicFilter) {
-    if(NULL == c || NULL == topicFilter) {
+MQTTReturnCode MQTTPublish(Client *c, const char *topicName, MQTTMessage *message) {
+    if(NULL == c || NULL == topicName || NULL == message) {
         return MQTT_NULL_VALUE_ERROR;
     }
 
-    if(!c->isConnected) {
-        return MQTT_NETWORK_DISCONNECTED_ERROR;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicName;
+
+    return publish(c, topic, NULL, message);
+}
+
+MQTTReturnCode MQTTPublishTemplated(Client *c, const MQTTPublishTemplate *tmpl, MQTTMessage *message) {
+    if(NULL == c || NULL == tmpl || NULL == message) {
+        return MQTT_NULL_VALUE_ERROR;
     }
 
-    MQTTReturnCode rc = MQTT_FAILURE;
-    Timer timer;
     MQTTString topic = MQTTString_initializer;
-    topic.cstring = (char *)topicFilter;
-    uint32_t len = 0;
-    uint32_t i = 0;
 
-    InitTimer(&timer);
-    countdown_ms(&timer, c->commandTimeoutMs);
+    /* The template decides, the ack is waited for accordingly */
+    message->qos = (QoS)((tmpl->header >> 1) & 0x03);
+    message->retained = tmpl->header & 0x01;
 
-    rc = MQTTSerialize_unsubscribe(c->buf, c->bufSize, 0, getNextPacketId(c), 1, &topic, &len);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
-    }
+    return publish(c, topic, tmpl, message);
+}
 
-    /* send the unsubscribe packet */
-    rc = sendPacket(c, len, &timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
-    }
+/* The broker of an MQTT 5 connection takes receiveMaximum QoS1 and QoS2
+ * publishes it has not acknowledged, blocking and asynchronous ones alike.
+ * Called with stateLock held */
+static uint8_t isReceiveMaximumReached(Client *c) {
+    uint32_t i, count = c->inflightPublishCount;
 
-    rc = waitfor(c, UNSUBACK, &timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    for(i = 0; i < MAX_ACK_WAITERS; ++i) {
+        if(PUBACK == c->ackWaiters[i].packetType || PUBCOMP == c->ackWaiters[i].packetType) {
+            count++;
+        }
     }
 
-    uint16_t packet_id;
-    rc = MQTTDeserialize_unsuback(&packet_id, c->readbuf, c->readBufSize);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
-    }
+    return (count >= c->receiveMaximum) ? 1 : 0;
+}
 
-    /* Remove from message handler array */
-    for(i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if(c->messageHandlers[i].topicFilter != NULL &&
-            (strcmp(c->messageHandlers[i].topicFilter, topicFilter) == 0)) {
-            c->messageHandlers[i].topicFilter = NULL;
-            /* We don't want to break here, if the same topic is registered
-             * with 2 callbacks. Unlikely scenario */
+/* Return MAX_INFLIGHT_PUBLISH value if no free index is available */
+static uint32_t GetFreeInflightPublishIndex(Client *c) {
+    uint32_t itr;
+    for(itr = 0; itr < MAX_INFLIGHT_PUBLISH; itr++) {
+        if(c->inflightPublishes[itr].isFree) {
+            break;
         }
     }
 
-    return MQTT_SUCCESS;
+    return itr;
 }
 
-MQTTReturnCode MQTTPublish(Client *c, const char *topicName, MQTTMessage *message) {
+MQTTReturnCode MQTTPublishAsync(Client *c, const char *topicName, MQTTMessage *message,
+                                publishCompleteHandler completeHandler,
+                                pApplicationHandler_t applicationHandler, void *pContext) {
     if(NULL == c || NULL == topicName || NULL == message) {
         return MQTT_NULL_VALUE_ERROR;
     }
@@ -863,74 +2808,91 @@ MQTTReturnCode MQTTPublish(Client *c, const char *topicName, MQTTMessage *messag
     Timer timer;
     MQTTString topic = MQTTString_initializer;
     topic.cstring = (char *)topicName;
-    uint32_t len = 0;
-    uint8_t waitForAck = 0;
-    uint8_t packetType = PUBACK;
-    uint16_t packet_id;
-    unsigned char dup, type;
+    uint32_t indexOfFreeInflight = MAX_INFLIGHT_PUBLISH;
     MQTTReturnCode rc = MQTT_FAILURE;
 
     InitTimer(&timer);
     countdown_ms(&timer, c->commandTimeoutMs);
 
-    if(QOS1 == message->qos || QOS2 == message->qos) {
-        message->id = getNextPacketId(c);
-        waitForAck = 1;
-        if(QOS2 == message->qos) {
-            packetType = PUBCOMP;
+    /* The slot is taken before the send, the PUBACK may be read by another
+     * thread before sendPublish() returns */
+    if(QOS0 != message->qos) {
+        LOCK(c, stateLock);
+        indexOfFreeInflight = GetFreeInflightPublishIndex(c);
+        if(MAX_INFLIGHT_PUBLISH <= indexOfFreeInflight || isReceiveMaximumReached(c)) {
+            UNLOCK(c, stateLock);
+            return MQTT_MAX_INFLIGHT_PUBLISH_REACHED_ERROR;
         }
-    }
-
-    rc = MQTTSerialize_publish(c->buf, c->bufSize, 0, message->qos, message->retained, message->id,
-              topic, (unsigned char*)message->payload, message->payloadlen, &len);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+        message->id = getNextPacketId(c);
+        c->inflightPublishes[indexOfFreeInflight].packetId = message->id;
+        c->inflightPublishes[indexOfFreeInflight].qos = (uint8_t)message->qos;
+        c->inflightPublishes[indexOfFreeInflight].isReleased = 0;
+        c->inflightPublishes[indexOfFreeInflight].fp = completeHandler;
+        c->inflightPublishes[indexOfFreeInflight].applicationHandler = applicationHandler;
+        c->inflightPublishes[indexOfFreeInflight].pContext = pContext;
+#if AWS_IOT_MQTT_STATS
+        c->inflightPublishes[indexOfFreeInflight].sentUs = timer_now_us();
+#endif
+        timerWheelStart(&(c->timerWheel), &(c->inflightPublishes[indexOfFreeInflight].ackTimer),
+                        c->commandTimeoutMs);
+        c->inflightPublishes[indexOfFreeInflight].isFree = 0;
+        c->inflightPublishCount++;
+        UNLOCK(c, stateLock);
     }
 
     /* send the publish packet */
-    rc = sendPacket(c, len, &timer);
-    if(MQTT_SUCCESS != rc) {
-        return rc;
+    LOCK(c, writeLock);
+    rc = sendPublish(c, topic, NULL, message, &timer);
+    UNLOCK(c, writeLock);
+
+    if(MQTT_SUCCESS != rc && QOS0 != message->qos) {
+        /* Unless a disconnect already failed it, the slot is still ours */
+        LOCK(c, stateLock);
+        if(!c->inflightPublishes[indexOfFreeInflight].isFree
+           && c->inflightPublishes[indexOfFreeInflight].packetId == message->id) {
+            timerWheelStop(&(c->timerWheel), &(c->inflightPublishes[indexOfFreeInflight].ackTimer));
+            c->inflightPublishes[indexOfFreeInflight].isFree = 1;
+            c->inflightPublishCount--;
+        }
+        UNLOCK(c, stateLock);
     }
 
-    /* Wait for ack if QoS1 or QoS2 */
-    if(1 == waitForAck) {
-        rc = waitfor(c, packetType, &timer);
-        if(MQTT_SUCCESS != rc) {
-            return rc;
-        }
+    return rc;
+}
 
-        rc = MQTTDeserialize_ack(&type, &dup, &packet_id, c->readbuf, c->readBufSize);
-        if(MQTT_SUCCESS != rc) {
-            return rc;
-        }
+uint32_t MQTTGetInflightPublishCount(Client *c) {
+    if(NULL == c) {
+        return 0;
     }
 
-    return MQTT_SUCCESS;
+    return c->inflightPublishCount;
 }
 /**
  * This is for the case when the sendPacket Fails.
  */
 static void MQTTForceDisconnect(Client *c){
+	LOCK(c, writeLock);
 	c->isConnected = 0;
+	c->isTxCorked = 0;
 	c->networkStack.disconnect(&(c->networkStack));
 	c->networkStack.destroy(&(c->networkStack));
+	UNLOCK(c, writeLock);
+	failInflightPublishes(c, MQTT_NETWORK_DISCONNECTED_ERROR);
 }
 
-MQTTReturnCode MQTTDisconnect(Client *c) {
-    if(NULL == c) {
-        return MQTT_NULL_VALUE_ERROR;
-    }
+/* Sends the DISCONNECT and closes the network, called with writeLock held */
+static MQTTReturnCode disconnect(Client *c) {
+    MQTTReturnCode rc = MQTT_FAILURE;
+    /* We might wait for incomplete incoming publishes to complete */
+    Timer timer;
+    uint32_t serialized_len = 0;
 
     if(0 == c->isConnected) {
-        /* Network is already disconnected. Do nothing */
+        /* Disconnected while this thread waited for the locks */
         return MQTT_NETWORK_DISCONNECTED_ERROR;
     }
 
-    MQTTReturnCode rc = MQTT_FAILURE;
-    /* We might wait for incomplete incoming publishes to complete */
-    Timer timer;
-    uint32_t serialized_len = 0;
+    acquireTxBuf(c);
     rc = MQTTSerialize_disconnect(c->buf, c->bufSize, &serialized_len);
     if(MQTT_SUCCESS != rc) {
         return rc;
@@ -942,12 +2904,17 @@ MQTTReturnCode MQTTDisconnect(Client *c) {
     /* send the disconnect packet */
     if(serialized_len > 0) {
         rc = sendPacket(c, serialized_len, &timer);
+        if(MQTT_SUCCESS == rc) {
+            /* Also when a batch is open, the connection is going away */
+            rc = flushTxBatch(c, &timer);
+        }
         if(MQTT_SUCCESS != rc) {
             return rc;
         }
     }
 
     /* Clean network stack */
+    c->isTxCorked = 0;
     c->networkStack.disconnect(&(c->networkStack));
     rc = c->networkStack.destroy(&(c->networkStack));
     if(0 != rc) {
@@ -957,8 +2924,42 @@ MQTTReturnCode MQTTDisconnect(Client *c) {
 
     c->isConnected = 0;
 
+    return MQTT_SUCCESS;
+}
+
+MQTTReturnCode MQTTDisconnect(Client *c) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    if(0 == c->isConnected) {
+        /* Network is already disconnected. Do nothing */
+        return MQTT_NETWORK_DISCONNECTED_ERROR;
+    }
+
+    MQTTReturnCode rc = MQTT_FAILURE;
+
+    /* Nothing may be read from the connection while it is closed, wake a
+     * yield that waits in another thread so it gives up the reader */
+    if(!isReader(c)) {
+        MQTTWakeup(c);
+    }
+    lockReader(c, THREADS_WAIT_FOREVER);
+
+    LOCK(c, writeLock);
+    rc = disconnect(c);
+    UNLOCK(c, writeLock);
+    if(MQTT_SUCCESS != rc) {
+        unlockReader(c);
+        return rc;
+    }
+
+    /* PUBACKs for publishes still in flight will never arrive on this session */
+    failInflightPublishes(c, MQTT_NETWORK_DISCONNECTED_ERROR);
+
     /* Always set to 1 whenever disconnect is called. Keepalive resets to 0 */
     c->wasManuallyDisconnected = 1;
+    unlockReader(c);
 
     return MQTT_SUCCESS;
 }
@@ -996,6 +2997,37 @@ MQTTReturnCode setAutoReconnectEnabled(Client *c, uint8_t value) {
     return MQTT_SUCCESS;
 }
 
+MQTTReturnCode setKeepAlivePolicy(Client *c, KeepAlivePolicy policy) {
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+    if(KEEPALIVE_ON_IDLE != policy && KEEPALIVE_FIXED_INTERVAL != policy) {
+        return MQTT_FAILURE;
+    }
+    c->keepAlivePolicy = (uint8_t)policy;
+    return MQTT_SUCCESS;
+}
+
+/* Kept for the following connections, an open one is changed under the
+ * write lock so that no packet is half sent with each priority */
+MQTTReturnCode setTrafficClass(Client *c, NetworkTrafficClass trafficClass) {
+    MQTTReturnCode rc = MQTT_SUCCESS;
+
+    if(NULL == c) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    LOCK(c, writeLock);
+    c->tlsConnectParams.trafficClass = trafficClass;
+    if(c->isConnected && NULL != c->networkStack.settrafficclass
+       && 0 != c->networkStack.settrafficclass(&(c->networkStack), trafficClass)) {
+        rc = MQTT_FAILURE;
+    }
+    UNLOCK(c, writeLock);
+
+    return rc;
+}
+
 uint32_t MQTTGetNetworkDisconnectedCount(Client *c) {
     return c->counterNetworkDisconnected;
 }
@@ -1003,3 +3035,25 @@ uint32_t MQTTGetNetworkDisconnectedCount(Client *c) {
 void MQTTResetNetworkDisconnectedCount(Client *c) {
     c->counterNetworkDisconnected = 0;
 }
+
+MQTTReturnCode MQTTGetStats(Client *c, MQTTStats *pStats) {
+    if(NULL == c || NULL == pStats) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+#if AWS_IOT_MQTT_STATS
+    *pStats = c->stats;
+    return MQTT_SUCCESS;
+#else
+    memset(pStats, 0, sizeof(*pStats));
+    return MQTT_FAILURE;
+#endif
+}
+
+void MQTTResetStats(Client *c) {
+#if AWS_IOT_MQTT_STATS
+    if(NULL != c) {
+        memset(&(c->stats), 0, sizeof(c->stats));
+    }
+#endif
+}
@@ -26,6 +26,7 @@
 #include "MQTTReturnCodes.h"
 #include "MQTTMessage.h"
 #include "MQTTPacket.h"
+#include "MQTTTopicTrie.h"
 
 /* AWS Specific header files */
 #include "aws_iot_config.h"
@@ -33,38 +34,161 @@
 /* Platform specific implementation header files */
 #include "network_interface.h"
 #include "timer_interface.h"
+#include "timer_wheel.h"
+#include "threads_interface.h"
 
 #define MAX_PACKET_ID 65535
+/* Default number of handlers, also the most topic filters of one subscribe
+ * or unsubscribe call */
 #define MAX_MESSAGE_HANDLERS AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS
+#define NO_MESSAGE_HANDLER 0xFFFF
+#define MAX_INFLIGHT_PUBLISH AWS_IOT_MQTT_MAX_INFLIGHT_PUBLISH
+#define MAX_ACK_WAITERS AWS_IOT_MQTT_MAX_ACK_WAITERS
+#define MAX_QOS2_RECEIVED AWS_IOT_MQTT_MAX_QOS2_RECEIVED
+/* Buffered packets handled after the one read, before the yield runs its
+ * timers again */
+#define MAX_DRAIN_PACKETS AWS_IOT_MQTT_YIELD_DRAIN_MAX
+/* Topic aliases of an MQTT 5 connection, topics longer than
+ * TOPIC_ALIAS_MAX_LEN are always sent in full */
+#define MAX_TOPIC_ALIASES AWS_IOT_MQTT_TOPIC_ALIASES
+#define TOPIC_ALIAS_MAX_LEN AWS_IOT_MQTT_TOPIC_ALIAS_MAX_LEN
 
 #define MIN_RECONNECT_WAIT_INTERVAL AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL
 #define MAX_RECONNECT_WAIT_INTERVAL AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL
+#define FAST_RECONNECT_WINDOW AWS_IOT_MQTT_FAST_RECONNECT_WINDOW
 
 void NewTimer(Timer *);
 
 typedef struct Client Client;
 
 typedef struct MessageData MessageData;
+typedef struct PublishCompleteData PublishCompleteData;
 
 typedef void (*messageHandler)(MessageData *);
+typedef void (*publishCompleteHandler)(PublishCompleteData *);
 typedef void (*pApplicationHandler_t)(void);
-typedef void (*disconnectHandler_t)(void);
+typedef void (*disconnectHandler_t)(Client *);
 typedef int (*networkInitHandler_t)(Network *);
 
 struct MessageData {
     MQTTMessage *message;
     MQTTString *topicName;
     pApplicationHandler_t applicationHandler;
+    uint32_t payloadOffset;     /* offset of message->payload within the whole payload */
+    uint32_t totalPayloadLen;   /* length of the whole payload */
+    uint8_t isLastChunk;        /* always 1 unless the subscription is streaming */
+    uint8_t dispatch;           /* dispatch of the subscription, 0 for the default handler */
+    Client *client;             /* connection the message arrived on, its reader runs the handler */
 };
 
+struct PublishCompleteData {
+    uint16_t packetId;
+    MQTTReturnCode rc;
+    pApplicationHandler_t applicationHandler;
+    void *pContext;
+};
+
+/* A subscription of the client, MQTTClient() is given an array of them.
+ * A free one has no topicFilter and links the next free one */
+typedef struct MessageHandlers {
+    const char *topicFilter;
+    void (*fp) (MessageData *);
+    pApplicationHandler_t applicationHandler;
+    QoS qos;
+    uint8_t isStreaming;
+    uint8_t isLiteral;        /* No '+' or '#', matched by length, hash and memcmp */
+    uint8_t dispatch;         /* Not used by the client, handed to fp in MessageData */
+    uint8_t isLocal;          /* Not subscribed at the broker, see MQTTSubscribeLocal() */
+    uint16_t topicFilterLen;
+    uint32_t topicFilterHash;
+    uint16_t nextFree;
+} MessageHandlers;
+
+/* One topic filter of MQTTSubscribeMany() */
+typedef struct {
+    const char *topicFilter;
+    QoS qos;
+    pApplicationHandler_t applicationHandler;
+    uint8_t isStreaming;
+    uint8_t dispatch;         /* Handed to the message handler with every message */
+    uint8_t isLocal;          /* Only for MQTTSubscribeLocal() */
+} MQTTSubscription;
+
+/* Bucket i of a histogram counts the durations of [2^i, 2^(i+1)) us, the
+ * first one also 0 and the last one everything longer */
+#define MQTT_STATS_HISTOGRAM_BUCKETS 24
+/* MQTT control packet types, 1 to 14, index the packet counters */
+#define MQTT_STATS_PACKET_TYPES 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint32_t buckets[MQTT_STATS_HISTOGRAM_BUCKETS];
+} MQTTHistogram;
+
+typedef struct {
+    uint64_t bytesOut;
+    uint64_t bytesIn;
+    uint32_t packetsOut[MQTT_STATS_PACKET_TYPES];
+    uint32_t packetsIn[MQTT_STATS_PACKET_TYPES];
+    uint32_t oversizedDropped;          /* Received packets too big for readbuf and not streamed */
+    uint32_t oversizedRejected;         /* Packets too big for buf, not sent */
+    uint32_t publishAckTimeouts;        /* Asynchronous QoS1 and QoS2 publishes that got no PUBACK or PUBCOMP */
+    uint32_t qos2Duplicates;            /* Received QoS2 messages not delivered again */
+    uint32_t qos2Refused;               /* Received QoS2 messages left unacknowledged, no room to track them */
+    uint32_t reconnects;
+    MQTTHistogram pubackLatency;        /* QoS1 publish sent to its PUBACK read */
+    MQTTHistogram sendDuration;         /* sendPacket() */
+    MQTTHistogram reconnectDuration;    /* Connection lost to connection back */
+} MQTTStats;
+
+/* When a PINGREQ is sent. The broker drops a client it has heard nothing
+ * from for 1.5 keepalive intervals, any packet the client sends counts */
+typedef enum {
+    KEEPALIVE_ON_IDLE = 0,      /* Only after a keepalive interval without sending anything */
+    KEEPALIVE_FIXED_INTERVAL    /* Every keepalive interval, whatever else was sent */
+} KeepAlivePolicy;
+
 MQTTReturnCode MQTTConnect(Client *c, MQTTPacket_connectData *options);
 MQTTReturnCode MQTTPublish (Client *, const char *, MQTTMessage *);
+/* The QoS and retain flag of the message are set from the template */
+MQTTReturnCode MQTTPublishTemplated(Client *c, const MQTTPublishTemplate *tmpl, MQTTMessage *message);
+MQTTReturnCode MQTTPublishAsync(Client *c, const char *topicName, MQTTMessage *message,
+                                publishCompleteHandler completeHandler,
+                                pApplicationHandler_t applicationHandler, void *pContext);
+uint32_t MQTTGetInflightPublishCount(Client *c);
 MQTTReturnCode MQTTSubscribe(Client *c, const char *topicFilter, QoS qos,
                              messageHandler messageHandler, pApplicationHandler_t applicationHandler);
+MQTTReturnCode MQTTSubscribeStreaming(Client *c, const char *topicFilter, QoS qos,
+                                      messageHandler messageHandler, pApplicationHandler_t applicationHandler);
+/* All filters in one SUBSCRIBE and one SUBACK wait, it has to fit in buf */
+MQTTReturnCode MQTTSubscribeMany(Client *c, const MQTTSubscription *pSubscriptions, uint32_t count,
+                                 messageHandler messageHandler);
 MQTTReturnCode MQTTResubscribe(Client *c);
+/* Local subscriptions only take the messages of MQTTPublishLocal(), nothing
+ * is sent to the broker and they work while disconnected. MQTTUnsubscribe()
+ * of a filter only subscribed locally sends nothing either */
+MQTTReturnCode MQTTSubscribeLocal(Client *c, const MQTTSubscription *pSubscription,
+                                  messageHandler messageHandler);
+MQTTReturnCode MQTTPublishLocal(Client *c, const char *topicName, MQTTMessage *message);
 MQTTReturnCode MQTTUnsubscribe(Client *c, const char *topicFilter);
+MQTTReturnCode MQTTUnsubscribeMany(Client *c, const char **topicFilters, uint32_t count);
 MQTTReturnCode MQTTDisconnect (Client *);
 MQTTReturnCode MQTTYield (Client *, uint32_t);
+MQTTReturnCode MQTTYieldUntilEvent(Client *c, uint32_t timeout_ms);
+void MQTTWakeup(Client *c);
+void MQTTBatchBegin(Client *c);
+MQTTReturnCode MQTTBatchEnd(Client *c);
+/* Send the next PINGREQ now if it is due within withinMs, e.g. while the
+ * radio is awake for other packets anyway */
+MQTTReturnCode MQTTKeepaliveEarly(Client *c, uint32_t withinMs);
+/* From the handler of a publish, not of a streamed one: the read buffer
+ * holding the publish becomes the caller's, its payload stays NUL terminated,
+ * and the next packets are read into spare, of the same size. NULL with
+ * AWS_IOT_MQTT_LOW_MEMORY, the packets are read in place then */
+unsigned char *MQTTTakeReadBuffer(Client *c, unsigned char *spare);
 MQTTReturnCode MQTTAttemptReconnect(Client *c);
 
 uint8_t MQTTIsConnected(Client *);
@@ -73,18 +197,30 @@ uint8_t MQTTIsAutoReconnectEnabled(Client *c);
 void setDefaultMessageHandler(Client *, messageHandler);
 MQTTReturnCode setDisconnectHandler(Client *c, disconnectHandler_t disconnectHandler);
 MQTTReturnCode setAutoReconnectEnabled(Client *c, uint8_t value);
+MQTTReturnCode setKeepAlivePolicy(Client *c, KeepAlivePolicy policy);
+MQTTReturnCode setTrafficClass(Client *c, NetworkTrafficClass trafficClass);
 
+/* The handlers and the topic trie nodes are supplied like the buffers, sized
+ * for what the client subscribes to. A thing shadow topic filter takes
+ * 6 trie nodes, levels shared between filters are stored once.
+ * With AWS_IOT_MQTT_LOW_MEMORY the write buffer is NULL and the read buffer
+ * is only used for packets that can not be read in place */
 MQTTReturnCode MQTTClient(Client *, uint32_t, unsigned char *, size_t, unsigned char *,
-                          size_t, uint8_t, networkInitHandler_t, TLSConnectParams *);
+                          size_t, MessageHandlers *, uint32_t, TopicTrieNode *, uint32_t,
+                          uint8_t, networkInitHandler_t, TLSConnectParams *);
 
 uint32_t MQTTGetNetworkDisconnectedCount(Client *c);
 void MQTTResetNetworkDisconnectedCount(Client *c);
+MQTTReturnCode MQTTGetStats(Client *c, MQTTStats *pStats);
+void MQTTResetStats(Client *c);
 
 struct Client {
     uint8_t isConnected;
     uint8_t wasManuallyDisconnected;
+    uint8_t isSessionPresent;     /* The broker kept the subscriptions and packet ids of the last connection */
     uint8_t isPingOutstanding;
     uint8_t isAutoReconnectEnabled;
+    uint8_t reconnectState;       /* Step of the auto reconnect, see handleReconnect() */
 
     uint16_t nextPacketId;
 
@@ -98,20 +234,91 @@ struct Client {
 
     unsigned char *buf;  
     unsigned char *readbuf;
+#if AWS_IOT_MQTT_LOW_MEMORY
+    /* buf and readbuf point into the buffers of the network layer, packets
+     * too big for its read buffer go through the one supplied */
+    unsigned char *scratchbuf;
+    size_t scratchBufSize;
+#endif
 
     TLSConnectParams tlsConnectParams;
     MQTTPacket_connectData options;
 
     Network networkStack;
-    Timer pingTimer;
+    Timer pingTimer;          /* Next PINGREQ is due */
+    Timer pingRespTimer;      /* PINGRESP is due, while isPingOutstanding */
     Timer reconnectDelayTimer;
+    Timer stableTimer;        /* Expires once the connection was up long enough for a loss to be retried at once */
 
-    struct MessageHandlers {
-        const char *topicFilter;
-        void (*fp) (MessageData *);
+    MessageHandlers *messageHandlers;             /* Message handlers are indexed by subscription topic */
+    uint32_t messageHandlerCount;
+    uint16_t firstFreeHandler;                    /* Free handlers are linked through nextFree, NO_MESSAGE_HANDLER if none */
+    TopicTrie topicTrie;                          /* Topic filters of messageHandlers, used to dispatch received messages */
+    uint32_t firstWildcardHandler;                /* Lowest index of a handler with a wildcard filter, messageHandlerCount if none */
+
+    struct InflightPublishes {
+        uint16_t packetId;
+        uint8_t isFree;
+        uint8_t qos;
+        uint8_t isReleased;       /* QoS2, the PUBREC was read and the PUBREL sent */
+        void (*fp) (PublishCompleteData *);
         pApplicationHandler_t applicationHandler;
-        QoS qos;
-    } messageHandlers[MAX_MESSAGE_HANDLERS];      /* Message handlers are indexed by subscription topic */
+        void *pContext;
+        TimerWheelEntry ackTimer;
+#if AWS_IOT_MQTT_STATS
+        uint64_t sentUs;
+#endif
+    } inflightPublishes[MAX_INFLIGHT_PUBLISH];    /* Publishes sent by MQTTPublishAsync and waiting for a PUBACK or PUBCOMP */
+    uint32_t inflightPublishCount;
+    TimerWheel timerWheel;    /* Deadlines that call back, the ack timers of inflightPublishes */
+    uint16_t qos2Received[MAX_QOS2_RECEIVED];   /* Ids of the QoS2 messages delivered and waiting for their PUBREL, 0 when free */
+
+    struct AckWaiters {
+        uint8_t packetType;       /* SUBACK, UNSUBACK, PUBACK or PUBCOMP waited for, 0 when the slot is free */
+        volatile uint8_t isDone;  /* The reply was read, or the connection lost */
+        uint16_t packetId;
+        MQTTReturnCode rc;
+#if AWS_IOT_MQTT_THREAD_SAFE
+        Signal signal;            /* Given by the reader when the reply is there or it stops reading */
+#endif
+    } ackWaiters[MAX_ACK_WAITERS];    /* Blocking commands waiting for their reply */
+#if AWS_IOT_MQTT_THREAD_SAFE
+    Signal ackWaiterFreed;    /* Given when a waiter slot or a publish of the receive maximum is freed */
+#endif
+
+    uint8_t txBatchDepth;     /* Open MQTTBatchBegin() batches of txBatchThread */
+    uint8_t isYieldBatchOpen; /* MQTTYieldUntilEvent() collects the writes of the reader */
+    uint8_t isTxCorked;       /* The network layer collects the writes of the batch */
+    uint8_t keepAlivePolicy;  /* KeepAlivePolicy */
+
+    /* From the CONNACK of an MQTT 5 connection */
+    uint16_t receiveMaximum;      /* QoS1 and QoS2 publishes the broker takes unacknowledged */
+    uint16_t topicAliasMaximum;   /* Highest topic alias the broker takes, 0 for none */
+#if 0 < MAX_TOPIC_ALIASES
+    struct TopicAliases {
+        uint32_t lastUsed;        /* aliasClock of its last publish, the least recent one is reassigned */
+        uint16_t len;             /* 0 when the alias is not assigned */
+        char topic[TOPIC_ALIAS_MAX_LEN];
+    } topicAliases[MAX_TOPIC_ALIASES];  /* Alias i + 1, the broker forgets them on a new connection */
+    uint32_t aliasClock;
+#endif
+
+#if AWS_IOT_MQTT_STATS
+    MQTTStats stats;
+    uint64_t disconnectedUs;  /* timer_now_us() the connection was lost at, 0 while connected */
+#endif
+
+#if AWS_IOT_MQTT_THREAD_SAFE
+    /* Taken in this order. A thread waiting for a reply holds none of them */
+    Mutex readLock;           /* readbuf and the network reads, held by the one reader */
+    Mutex stateLock;          /* Message handlers, in-flight publishes, timer wheel, ack waiters, packet ids */
+    Mutex writeLock;          /* buf, the transmit batch and the network writes */
+    void *readerThread;       /* thread_self() of the reader, NULL if none */
+    uint32_t readDepth;
+    void *txBatchThread;      /* thread_self() of the thread whose writes are batched */
+    uint8_t txBatchOthers;    /* MQTTBatchBegin() of the other threads meanwhile, they batch nothing */
+    uint8_t areLocksCreated;
+#endif
     
     void (* defaultMessageHandler) (MessageData *);
     disconnectHandler_t disconnectHandler;
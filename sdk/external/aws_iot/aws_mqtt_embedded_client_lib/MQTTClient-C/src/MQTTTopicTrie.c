@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file MQTTTopicTrie.c
+ * @brief Topic filter trie used to find the message handler of a received publish
+ *
+ * Every subscription adds one node per level of its topic filter, levels shared
+ * by several filters share the same nodes. Matching a topic name walks the trie
+ * one level at a time, following the children equal to the level and the '+'
+ * children, a '#' child matches the rest of the topic. The cost depends on the
+ * depth of the topic instead of the number of subscriptions.
+ */
+
+#include "MQTTTopicTrie.h"
+#include <string.h>
+
+static int levelEquals(TopicTrieNode *n, const char *level, size_t len) {
+    return n->levelLen == len && 0 == memcmp(n->level, level, len);
+}
+
+static void updateMatch(int32_t *best, int16_t handlerIndex) {
+    if(TOPIC_TRIE_NO_HANDLER != handlerIndex
+       && (TOPIC_TRIE_NO_HANDLER == *best || handlerIndex < *best)) {
+        *best = handlerIndex;
+    }
+}
+
+void MQTTTopicTrieInit(TopicTrie *t, TopicTrieNode *nodes, int16_t maxNodes) {
+    if(NULL == t || NULL == nodes || 0 >= maxNodes) {
+        return;
+    }
+
+    t->nodes = nodes;
+    t->maxNodes = maxNodes;
+    t->nodes[0].level = NULL;
+    t->nodes[0].levelLen = 0;
+    t->nodes[0].firstChild = -1;
+    t->nodes[0].nextSibling = -1;
+    t->nodes[0].handlerIndex = TOPIC_TRIE_NO_HANDLER;
+    t->nodeCount = 1;
+}
+
+MQTTReturnCode MQTTTopicTrieInsert(TopicTrie *t, const char *topicFilter, uint32_t handlerIndex) {
+    if(NULL == t || NULL == topicFilter) {
+        return MQTT_NULL_VALUE_ERROR;
+    }
+
+    const char *p = topicFilter;
+    const char *q;
+    int16_t node = 0;
+    int16_t child;
+
+    while(1) {
+        q = strchr(p, '/');
+        if(NULL == q) {
+            q = p + strlen(p);
+        }
+
+        for(child = t->nodes[node].firstChild; -1 != child; child = t->nodes[child].nextSibling) {
+            if(levelEquals(&t->nodes[child], p, (size_t)(q - p))) {
+                break;
+            }
+        }
+
+        if(-1 == child) {
+            if(t->maxNodes <= t->nodeCount) {
+                return MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+            }
+            child = t->nodeCount++;
+            t->nodes[child].level = p;
+            t->nodes[child].levelLen = (uint16_t)(q - p);
+            t->nodes[child].firstChild = -1;
+            t->nodes[child].nextSibling = t->nodes[node].firstChild;
+            t->nodes[child].handlerIndex = TOPIC_TRIE_NO_HANDLER;
+            t->nodes[node].firstChild = child;
+        }
+
+        node = child;
+        if('\0' == *q) {
+            break;
+        }
+        p = q + 1;
+    }
+
+    if(TOPIC_TRIE_NO_HANDLER == t->nodes[node].handlerIndex
+       || (int16_t)handlerIndex < t->nodes[node].handlerIndex) {
+        t->nodes[node].handlerIndex = (int16_t)handlerIndex;
+    }
+
+    return MQTT_SUCCESS;
+}
+
+/* p..end is the part of the topic name left after the level of node,
+ * exhausted is set once the last level of the topic name has been matched */
+static void matchLevel(TopicTrie *t, int16_t node, const char *p, const char *end,
+                       int exhausted, int32_t *best) {
+    const char *q;
+    const char *next;
+    int nextExhausted;
+    int16_t child;
+
+    if(exhausted) {
+        updateMatch(best, t->nodes[node].handlerIndex);
+        /* "a/#" also matches "a" */
+        for(child = t->nodes[node].firstChild; -1 != child; child = t->nodes[child].nextSibling) {
+            if(levelEquals(&t->nodes[child], "#", 1)) {
+                updateMatch(best, t->nodes[child].handlerIndex);
+            }
+        }
+        return;
+    }
+
+    q = memchr(p, '/', (size_t)(end - p));
+    if(NULL == q) {
+        q = end;
+        next = end;
+        nextExhausted = 1;
+    } else {
+        next = q + 1;
+        nextExhausted = 0;
+    }
+
+    for(child = t->nodes[node].firstChild; -1 != child; child = t->nodes[child].nextSibling) {
+        if(levelEquals(&t->nodes[child], "#", 1)) {
+            updateMatch(best, t->nodes[child].handlerIndex);
+        } else if(levelEquals(&t->nodes[child], "+", 1)
+                  || levelEquals(&t->nodes[child], p, (size_t)(q - p))) {
+            matchLevel(t, child, next, end, nextExhausted, best);
+        }
+    }
+}
+
+int32_t MQTTTopicTrieMatch(TopicTrie *t, const char *topicName, size_t topicNameLen) {
+    int32_t best = TOPIC_TRIE_NO_HANDLER;
+
+    if(NULL == t || NULL == topicName) {
+        return TOPIC_TRIE_NO_HANDLER;
+    }
+
+    matchLevel(t, 0, topicName, topicName + topicNameLen, 0, &best);
+
+    return best;
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file MQTTTopicTrie.h
+ * @brief Topic filter trie used to find the message handler of a received publish
+ */
+
+#ifndef __MQTT_TOPIC_TRIE_H
+#define __MQTT_TOPIC_TRIE_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+#include "MQTTReturnCodes.h"
+#include "aws_iot_config.h"
+
+#define MAX_TOPIC_TRIE_NODES AWS_IOT_MQTT_NUM_TOPIC_TRIE_NODES
+#define TOPIC_TRIE_NO_HANDLER (-1)
+
+/* One level of a topic filter. Levels point into the topic filter strings
+ * of the subscriptions, which stay valid until the topic is unsubscribed */
+typedef struct {
+    const char *level;
+    uint16_t levelLen;
+    int16_t firstChild;
+    int16_t nextSibling;
+    int16_t handlerIndex;   /* subscription ending at this level or TOPIC_TRIE_NO_HANDLER */
+} TopicTrieNode;
+
+/* Node 0 is the root, it has no level of its own */
+typedef struct {
+    TopicTrieNode *nodes;
+    int16_t maxNodes;
+    int16_t nodeCount;
+} TopicTrie;
+
+/* Empty the trie, its nodes are stored in the maxNodes nodes given */
+void MQTTTopicTrieInit(TopicTrie *t, TopicTrieNode *nodes, int16_t maxNodes);
+
+/* Add a topic filter for the given handler index. When the same filter was
+ * already added the lowest handler index is kept.
+ * Returns MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR when the trie is out of nodes,
+ * the trie has to be rebuilt in that case */
+MQTTReturnCode MQTTTopicTrieInsert(TopicTrie *t, const char *topicFilter, uint32_t handlerIndex);
+
+/* Return the lowest handler index whose filter matches the topic name, or
+ * TOPIC_TRIE_NO_HANDLER */
+int32_t MQTTTopicTrieMatch(TopicTrie *t, const char *topicName, size_t topicNameLen);
+
+#endif /* __MQTT_TOPIC_TRIE_H */
@@ -87,7 +87,7 @@ typedef struct {
 	char struct_id[4];
 	/** The version number of this structure.  Must be 0 */
 	uint8_t struct_version;
-	/** Version of MQTT to be used.  3 = 3.1 4 = 3.1.1
+	/** Version of MQTT to be used.  3 = 3.1 4 = 3.1.1 5 = 5
 	  */
 	uint8_t MQTTVersion;
 	MQTTString clientID;
@@ -143,4 +143,15 @@ DLLExport MQTTReturnCode MQTTSerialize_disconnect(unsigned char *buf, size_t buf
 DLLExport MQTTReturnCode MQTTSerialize_pingreq(unsigned char *buf, size_t buflen,
 											   uint32_t *serialized_length);
 
+DLLExport MQTTReturnCode MQTTDeserialize_connect(MQTTPacket_connectData *data,
+												 unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTSerialize_connack(unsigned char *buf, size_t buflen,
+											   MQTTConnackReturnCodes connack_rc,
+											   unsigned char sessionPresent,
+											   uint32_t *serialized_len);
+
+DLLExport MQTTReturnCode MQTTSerialize_pingresp(unsigned char *buf, size_t buflen,
+												uint32_t *serialized_length);
+
 #endif /* MQTTCONNECT_H_ */
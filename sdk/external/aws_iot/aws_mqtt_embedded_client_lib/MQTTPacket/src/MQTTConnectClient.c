@@ -34,12 +34,18 @@ size_t MQTTSerialize_GetConnectLength(MQTTPacket_connectData *options) {
 		len = 12;
 	} else if(4 == options->MQTTVersion) {
 		len = 10;
+	} else if(5 == options->MQTTVersion) {
+		/* and the properties, a session expiry interval if the session is kept */
+		len = 11 + (options->cleansession ? 0 : 5);
 	}
 
 	len += MQTTstrlen(options->clientID) + 2;
 
 	if(options->willFlag) {
 		len += MQTTstrlen(options->will.topicName) + 2 + MQTTstrlen(options->will.message) + 2;
+		if(5 == options->MQTTVersion) {
+			len += 1; /* will properties */
+		}
 	}
 
 	if(options->username.cstring || options->username.lenstring.data) {
@@ -92,9 +98,9 @@ MQTTReturnCode MQTTSerialize_connect(unsigned char *buf, size_t buflen,
 
 	ptr += MQTTPacket_encode(ptr, len); /* write remaining length */
 
-	if(4 == options->MQTTVersion) {
+	if(4 == options->MQTTVersion || 5 == options->MQTTVersion) {
 		writeCString(&ptr, "MQTT");
-		writeChar(&ptr, (char) 4);
+		writeChar(&ptr, (char) options->MQTTVersion);
 	} else {
 		writeCString(&ptr, "MQIsdp");
 		writeChar(&ptr, (char) 3);
@@ -118,8 +124,23 @@ MQTTReturnCode MQTTSerialize_connect(unsigned char *buf, size_t buflen,
 
 	writeChar(&ptr, flags.all);
 	writeInt(&ptr, options->keepAliveInterval);
+	if(5 == options->MQTTVersion) {
+		/* A session that is not clean is kept as long as in 3.1.1, the
+		 * expiry interval of MQTT 5 defaults to none */
+		if(options->cleansession) {
+			writeChar(&ptr, 0);
+		} else {
+			writeChar(&ptr, 5);
+			writeChar(&ptr, MQTTV5_PROP_SESSION_EXPIRY_INTERVAL);
+			writeInt(&ptr, 0xFFFF);
+			writeInt(&ptr, 0xFFFF);
+		}
+	}
 	writeMQTTString(&ptr, options->clientID);
 	if(options->willFlag) {
+		if(5 == options->MQTTVersion) {
+			writeChar(&ptr, 0);
+		}
 		writeMQTTString(&ptr, options->will.topicName);
 		writeMQTTString(&ptr, options->will.message);
 	}
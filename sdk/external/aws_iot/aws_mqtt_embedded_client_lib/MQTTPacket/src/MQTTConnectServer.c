@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * Copyright (c) 2014 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#include "MQTTPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+MQTTReturnCode MQTTSerialize_zero(unsigned char *buf, size_t buflen,
+								  unsigned char packetType,
+								  uint32_t *serialized_length);
+
+/**
+  * Validates MQTT protocol name and version combinations
+  * @param protocol the MQTT protocol name as an MQTTString
+  * @param version the MQTT protocol version number, as in the connect packet
+  * @return correct MQTT combination?  1 is true, 0 is false
+  */
+static uint8_t MQTTPacket_checkVersion(MQTTString *protocol, uint8_t version) {
+	if(4 == version && 4 == protocol->lenstring.len &&
+	   0 == memcmp(protocol->lenstring.data, "MQTT", 4)) {
+		return 1;
+	}
+	if(3 == version && 6 == protocol->lenstring.len &&
+	   0 == memcmp(protocol->lenstring.data, "MQIsdp", 6)) {
+		return 1;
+	}
+	return 0;
+}
+
+/**
+  * Deserializes the supplied (wire) buffer into connect data structure
+  * @param data the connect data structure to be filled out, its strings point into buf
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status, MQTT_CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR
+  *         for a protocol the server does not speak
+  */
+MQTTReturnCode MQTTDeserialize_connect(MQTTPacket_connectData *data,
+									   unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == data || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	/* Fixed header, protocol name, level, flags and keep alive, MQTT v3.1.1 Specification 3.1 */
+	if(12 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	MQTTConnectFlags flags = {0};
+	MQTTString protocol = MQTTString_initializer;
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+
+	header.byte = readChar(&curdata);
+	if(CONNECT != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	/* read remaining length */
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+	if(enddata > buf + buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	if(MQTT_SUCCESS != readMQTTLenString(&protocol, &curdata, enddata) || 4 > enddata - curdata) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	data->MQTTVersion = readChar(&curdata);
+	if(!MQTTPacket_checkVersion(&protocol, data->MQTTVersion)) {
+		FUNC_EXIT_RC(MQTT_CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR);
+		return MQTT_CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR;
+	}
+
+	flags.all = readChar(&curdata);
+	data->cleansession = flags.bits.cleansession;
+	data->keepAliveInterval = (uint16_t) readInt(&curdata);
+	if(MQTT_SUCCESS != readMQTTLenString(&data->clientID, &curdata, enddata)) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	data->willFlag = flags.bits.will;
+	if(flags.bits.will) {
+		data->will.qos = (QoS) flags.bits.willQoS;
+		data->will.retained = flags.bits.willRetain;
+		if(MQTT_SUCCESS != readMQTTLenString(&data->will.topicName, &curdata, enddata) ||
+		   MQTT_SUCCESS != readMQTTLenString(&data->will.message, &curdata, enddata)) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+	}
+
+	if(flags.bits.username) {
+		if(MQTT_SUCCESS != readMQTTLenString(&data->username, &curdata, enddata)) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+		if(flags.bits.password &&
+		   MQTT_SUCCESS != readMQTTLenString(&data->password, &curdata, enddata)) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+	}
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the connack packet into the supplied buffer.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param connack_rc the integer connack return code to be used
+  * @param sessionPresent the MQTT 3.1.1 sessionPresent flag
+  * @param serialized length
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTSerialize_connack(unsigned char *buf, size_t buflen,
+									 MQTTConnackReturnCodes connack_rc,
+									 unsigned char sessionPresent,
+									 uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	if(4 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	MQTTConnackFlags flags = {0};
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, CONNACK, QOS0, 0, 0);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+
+	writeChar(&ptr, header.byte); /* write header */
+
+	ptr += MQTTPacket_encode(ptr, 2); /* write remaining length */
+
+	flags.all = 0;
+	flags.bits.sessionpresent = sessionPresent ? 1 : 0;
+	writeChar(&ptr, flags.all);
+	writeChar(&ptr, (unsigned char) connack_rc);
+
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes a pingresp packet into the supplied buffer, ready for writing to a socket
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer, to avoid overruns
+  * @param serialized length
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTSerialize_pingresp(unsigned char *buf, size_t buflen,
+									  uint32_t *serialized_length) {
+	return MQTTSerialize_zero(buf, buflen, PINGRESP, serialized_length);
+}
@@ -80,6 +80,7 @@ size_t MQTTstrlen(MQTTString mqttstring);
 #include "MQTTPublish.h"
 #include "MQTTSubscribe.h"
 #include "MQTTUnsubscribe.h"
+#include "MQTTV5.h"
 
 MQTTReturnCode MQTTSerialize_ack(unsigned char *buf, size_t buflen,
 								 unsigned char type, unsigned char dup, uint16_t packetid,
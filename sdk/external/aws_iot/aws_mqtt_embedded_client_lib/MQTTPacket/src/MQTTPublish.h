@@ -27,6 +27,28 @@
 
 #include "MQTTMessage.h"
 
+/* A publish whose fixed header byte and topic are serialized once, for a topic
+ * it goes out to again and again */
+typedef struct {
+    unsigned char header;       /* First byte of the fixed header, PUBLISH with its QoS and retain flags */
+    uint16_t topicLen;          /* Length of the topic name */
+    const unsigned char *topic; /* The topic length, big endian, followed by the topic name */
+} MQTTPublishTemplate;
+
+DLLExport MQTTReturnCode MQTTSerialize_publishHeader(unsigned char *buf, size_t buflen, uint8_t dup,
+                                                     QoS qos, uint8_t retained, uint16_t packetid,
+                                                     MQTTString topicName, size_t payloadlen,
+                                                     uint32_t *serialized_len);
+
+DLLExport MQTTReturnCode MQTTSerialize_publishTemplate(unsigned char *buf, size_t buflen, QoS qos,
+                                                       uint8_t retained, MQTTString topicName,
+                                                       MQTTPublishTemplate *tmpl);
+
+DLLExport MQTTReturnCode MQTTSerialize_publishHeaderFromTemplate(unsigned char *buf, size_t buflen,
+                                                                 const MQTTPublishTemplate *tmpl,
+                                                                 uint16_t packetid, size_t payloadlen,
+                                                                 uint32_t *serialized_len);
+
 DLLExport MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t dup,
                                                QoS qos, uint8_t retained, uint16_t packetid,
                                                MQTTString topicName, unsigned char *payload, size_t payloadlen,
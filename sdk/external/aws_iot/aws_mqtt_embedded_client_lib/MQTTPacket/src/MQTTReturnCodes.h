@@ -46,7 +46,9 @@ typedef enum {
     MQTT_CONNACK_SERVER_UNAVAILABLE_ERROR = -15,
     MQTT_CONNACK_BAD_USERDATA_ERROR = -16,
     MQTT_CONNACK_NOT_AUTHORIZED_ERROR = -17,
-    MQTT_BUFFER_RX_MESSAGE_INVALID = -18
+    MQTT_BUFFER_RX_MESSAGE_INVALID = -18,
+    MQTT_MAX_INFLIGHT_PUBLISH_REACHED_ERROR = -19,
+    MQTT_PUBLISH_ACK_TIMEOUT_ERROR = -20
 }MQTTReturnCode;
 
 #endif //__MQTT_ERRORCODES_H
@@ -40,24 +40,25 @@ size_t MQTTSerialize_GetPublishLength(uint8_t qos, MQTTString topicName, size_t
 
 
 /**
-  * Serializes the supplied publish data into the supplied buffer, ready for sending
-  * @param buf the buffer into which the packet will be serialized
+  * Serializes the fixed header, topic and packet identifier of a publish packet into the
+  * supplied buffer. The payload itself is not copied, the caller sends it right after the
+  * serialized header
+  * @param buf the buffer into which the packet header will be serialized
   * @param buflen the length in bytes of the supplied buffer
   * @param dup integer - the MQTT dup flag
   * @param qos integer - the MQTT QoS value
   * @param retained integer - the MQTT retained flag
   * @param packetid integer - the MQTT packet identifier
   * @param topicName MQTTString - the MQTT topic in the publish
-  * @param payload byte buffer - the MQTT publish payload
-  * @param payloadlen integer - the length of the MQTT payload
-  * @return the length of the serialized data.  <= 0 indicates error
+  * @param payloadlen integer - the length of the MQTT payload that will follow the header
+  * @return the length of the serialized header.  <= 0 indicates error
   */
-MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t dup,
+MQTTReturnCode MQTTSerialize_publishHeader(unsigned char *buf, size_t buflen, uint8_t dup,
 						  QoS qos, uint8_t retained, uint16_t packetid,
-						  MQTTString topicName, unsigned char *payload, size_t payloadlen,
+						  MQTTString topicName, size_t payloadlen,
 						  uint32_t *serialized_len) {
 	FUNC_ENTRY;
-	if(NULL == buf || NULL == payload || NULL == serialized_len) {
+	if(NULL == buf || NULL == serialized_len) {
 		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
 		return MQTT_NULL_VALUE_ERROR;
 	}
@@ -67,7 +68,7 @@ MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t
 	size_t rem_len = 0;
 
 	rem_len = MQTTSerialize_GetPublishLength(qos, topicName, payloadlen);
-	if(MQTTPacket_len(rem_len) > buflen) {
+	if(MQTTPacket_len(rem_len) - payloadlen > buflen) {
 		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
 		return MQTTPACKET_BUFFER_TOO_SHORT;
 	}
@@ -87,8 +88,97 @@ MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t
 		writeInt(&ptr, packetid);
 	}
 
-	memcpy(ptr, payload, payloadlen);
-	ptr += payloadlen;
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the fixed header byte and the topic of a publish packet once, into the supplied
+  * buffer, for MQTTSerialize_publishHeaderFromTemplate() to copy into every packet on the topic.
+  * The topic name is followed by a NUL in the buffer
+  * @param buf the buffer the topic is serialized into, it has to stay valid as long as the template
+  * @param buflen the length in bytes of the supplied buffer, at least the topic length plus 3
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param topicName MQTTString - the MQTT topic of the publishes
+  * @param tmpl the template to set up
+  * @return MQTT_SUCCESS, or an error if the buffer is too short
+  */
+MQTTReturnCode MQTTSerialize_publishTemplate(unsigned char *buf, size_t buflen, QoS qos,
+						  uint8_t retained, MQTTString topicName,
+						  MQTTPublishTemplate *tmpl) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == tmpl) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	size_t topicLen = (size_t)MQTTstrlen(topicName);
+
+	if(0xffff < topicLen || topicLen + 3 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, PUBLISH, qos, 0, retained);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+
+	writeMQTTString(&ptr, topicName);
+	*ptr = '\0';
+
+	tmpl->header = header.byte;
+	tmpl->topicLen = (uint16_t)topicLen;
+	tmpl->topic = buf;
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the header of a publish packet from a template: the fixed header byte and the
+  * topic are copied as they are, only the remaining length and the packet identifier are
+  * encoded. The payload is not copied, as with MQTTSerialize_publishHeader()
+  * @param buf the buffer into which the packet header will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param tmpl the template of the topic
+  * @param packetid integer - the MQTT packet identifier, left out for QoS 0
+  * @param payloadlen integer - the length of the MQTT payload that will follow the header
+  * @return the length of the serialized header.  <= 0 indicates error
+  */
+MQTTReturnCode MQTTSerialize_publishHeaderFromTemplate(unsigned char *buf, size_t buflen,
+						  const MQTTPublishTemplate *tmpl,
+						  uint16_t packetid, size_t payloadlen,
+						  uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == tmpl || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	uint8_t hasPacketId = (0 != (tmpl->header & 0x06));
+	size_t rem_len = 2 + tmpl->topicLen + payloadlen + (hasPacketId ? 2 : 0);
+
+	if(MQTTPacket_len(rem_len) - payloadlen > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	writeChar(&ptr, tmpl->header);
+	ptr += MQTTPacket_encode(ptr, rem_len);
+	memcpy(ptr, tmpl->topic, 2 + (size_t)tmpl->topicLen);
+	ptr += 2 + tmpl->topicLen;
+
+	if(hasPacketId) {
+		writeInt(&ptr, packetid);
+	}
 
 	*serialized_len = (uint32_t)(ptr - buf);
 
@@ -96,6 +186,53 @@ MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t
 	return MQTT_SUCCESS;
 }
 
+/**
+  * Serializes the supplied publish data into the supplied buffer, ready for sending
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT dup flag
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param packetid integer - the MQTT packet identifier
+  * @param topicName MQTTString - the MQTT topic in the publish
+  * @param payload byte buffer - the MQTT publish payload
+  * @param payloadlen integer - the length of the MQTT payload
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+MQTTReturnCode MQTTSerialize_publish(unsigned char *buf, size_t buflen, uint8_t dup,
+						  QoS qos, uint8_t retained, uint16_t packetid,
+						  MQTTString topicName, unsigned char *payload, size_t payloadlen,
+						  uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == payload || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	uint32_t header_len = 0;
+	size_t rem_len = 0;
+
+	rem_len = MQTTSerialize_GetPublishLength(qos, topicName, payloadlen);
+	if(MQTTPacket_len(rem_len) > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTSerialize_publishHeader(buf, buflen, dup, qos, retained, packetid,
+							topicName, payloadlen, &header_len);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+
+	memcpy(buf + header_len, payload, payloadlen);
+
+	*serialized_len = header_len + (uint32_t)payloadlen;
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
 /**
   * Serializes the ack packet into the supplied buffer.
   * @param buf the buffer into which the packet will be serialized
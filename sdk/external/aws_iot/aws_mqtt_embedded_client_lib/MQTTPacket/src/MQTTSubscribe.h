@@ -34,5 +34,14 @@ DLLExport MQTTReturnCode MQTTDeserialize_suback(uint16_t *packetid, uint32_t max
                                                 uint32_t *count, QoS grantedQoSs[],
                                                 unsigned char* buf, size_t buflen);
 
+DLLExport MQTTReturnCode MQTTDeserialize_subscribe(unsigned char *dup, uint16_t *packetid,
+                                                   uint32_t maxcount, uint32_t *count,
+                                                   MQTTString topicFilters[], QoS requestedQoSs[],
+                                                   unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTSerialize_suback(unsigned char *buf, size_t buflen,
+                                              uint16_t packetid, uint32_t count,
+                                              unsigned char grantedQoSs[],
+                                              uint32_t *serialized_len);
 
 #endif /* MQTTSUBSCRIBE_H_ */
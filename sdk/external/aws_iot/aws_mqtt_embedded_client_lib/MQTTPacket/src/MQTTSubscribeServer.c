@@ -0,0 +1,149 @@
+/*******************************************************************************
+ * Copyright (c) 2014 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#include "MQTTPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+/**
+  * Deserializes the supplied (wire) buffer into subscribe data
+  * @param dup returned integer - the MQTT dup flag
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param maxcount - the maximum number of members allowed in the topicFilters and requestedQoSs arrays
+  * @param count - returned integer - number of members in the topicFilters and requestedQoSs arrays
+  * @param topicFilters - returned array of topic filter names, pointing into buf
+  * @param requestedQoSs - returned array of requested QoS
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTDeserialize_subscribe(unsigned char *dup, uint16_t *packetid,
+										 uint32_t maxcount, uint32_t *count,
+										 MQTTString topicFilters[], QoS requestedQoSs[],
+										 unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == dup || NULL == packetid || NULL == count || NULL == topicFilters ||
+	   NULL == requestedQoSs || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	/* Fixed header, packet id and at least one filter of one byte with its QoS,
+	 * MQTT v3.1.1 Specification 3.8 */
+	if(8 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+
+	header.byte = readChar(&curdata);
+	if(SUBSCRIBE != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+	*dup = header.bits.dup;
+
+	/* read remaining length */
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+	if(enddata > buf + buflen || enddata - curdata < 2) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*packetid = readPacketId(&curdata);
+
+	*count = 0;
+	while(curdata < enddata) {
+		if(*count == maxcount) {
+			FUNC_EXIT_RC(MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR);
+			return MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+		}
+		if(MQTT_SUCCESS != readMQTTLenString(&topicFilters[*count], &curdata, enddata) ||
+		   curdata >= enddata) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+		requestedQoSs[(*count)++] = (QoS) readChar(&curdata);
+	}
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the supplied suback data into the supplied buffer, ready for sending
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param packetid integer - the MQTT packet identifier
+  * @param count - number of members in the grantedQoSs array
+  * @param grantedQoSs - array of granted QoS, 0x80 for a refused filter
+  * @param serialized length
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTSerialize_suback(unsigned char *buf, size_t buflen,
+									uint16_t packetid, uint32_t count,
+									unsigned char grantedQoSs[],
+									uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == grantedQoSs || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	uint32_t i = 0;
+
+	if(MQTTPacket_len(2 + count) > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, SUBACK, QOS0, 0, 0);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	/* write header */
+	writeChar(&ptr, header.byte);
+
+	/* write remaining length */
+	ptr += MQTTPacket_encode(ptr, 2 + count);
+
+	writePacketId(&ptr, packetid);
+
+	for(i = 0; i < count; ++i) {
+		writeChar(&ptr, grantedQoSs[i]);
+	}
+
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
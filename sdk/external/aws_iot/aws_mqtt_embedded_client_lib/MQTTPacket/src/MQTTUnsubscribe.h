@@ -32,4 +32,12 @@ DLLExport MQTTReturnCode MQTTSerialize_unsubscribe(unsigned char* buf, size_t bu
 
 DLLExport MQTTReturnCode MQTTDeserialize_unsuback(uint16_t *packetid, unsigned char *buf, size_t buflen);
 
+DLLExport MQTTReturnCode MQTTDeserialize_unsubscribe(unsigned char *dup, uint16_t *packetid,
+                                                     uint32_t maxcount, uint32_t *count,
+                                                     MQTTString topicFilters[],
+                                                     unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTSerialize_unsuback(unsigned char *buf, size_t buflen,
+                                                uint16_t packetid, uint32_t *serialized_len);
+
 #endif /* MQTTUNSUBSCRIBE_H_ */
@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * Copyright (c) 2014 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#include "MQTTPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+/**
+  * Deserializes the supplied (wire) buffer into unsubscribe data
+  * @param dup returned integer - the MQTT dup flag
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param maxcount - the maximum number of members allowed in the topicFilters array
+  * @param count - returned integer - number of members in the topicFilters array
+  * @param topicFilters - returned array of topic filter names, pointing into buf
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTDeserialize_unsubscribe(unsigned char *dup, uint16_t *packetid,
+										   uint32_t maxcount, uint32_t *count,
+										   MQTTString topicFilters[],
+										   unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == dup || NULL == packetid || NULL == count || NULL == topicFilters || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	/* Fixed header, packet id and at least one filter of one byte,
+	 * MQTT v3.1.1 Specification 3.10 */
+	if(7 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+
+	header.byte = readChar(&curdata);
+	if(UNSUBSCRIBE != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+	*dup = header.bits.dup;
+
+	/* read remaining length */
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+	if(enddata > buf + buflen || enddata - curdata < 2) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*packetid = readPacketId(&curdata);
+
+	*count = 0;
+	while(curdata < enddata) {
+		if(*count == maxcount) {
+			FUNC_EXIT_RC(MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR);
+			return MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR;
+		}
+		if(MQTT_SUCCESS != readMQTTLenString(&topicFilters[*count], &curdata, enddata)) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+		(*count)++;
+	}
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the supplied unsuback data into the supplied buffer, ready for sending
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param packetid integer - the MQTT packet identifier
+  * @param serialized length
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTSerialize_unsuback(unsigned char *buf, size_t buflen,
+									  uint16_t packetid, uint32_t *serialized_len) {
+	return MQTTSerialize_ack(buf, buflen, UNSUBACK, 0, packetid, serialized_len);
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/**
+ * @file MQTTV5.h
+ * @brief MQTT 5 packets of the client
+ *
+ * The packets that differ from MQTT 3.1.1 in what the client sends or needs
+ * to read. The CONNECT is serialized by MQTTSerialize_connect() with
+ * MQTTVersion 5, the PINGREQ and the acks the client sends are the same as
+ * in 3.1.1: an ack without a reason code means success. Properties the
+ * client does not use are skipped.
+ */
+
+#ifndef MQTTV5_H_
+#define MQTTV5_H_
+
+#if !defined(DLLImport)
+  #define DLLImport
+#endif
+#if !defined(DLLExport)
+  #define DLLExport
+#endif
+
+/* Property identifiers */
+#define MQTTV5_PROP_SESSION_EXPIRY_INTERVAL 0x11
+#define MQTTV5_PROP_RECEIVE_MAXIMUM 0x21
+#define MQTTV5_PROP_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTTV5_PROP_TOPIC_ALIAS 0x23
+#define MQTTV5_PROP_MAXIMUM_QOS 0x24
+#define MQTTV5_PROP_MAXIMUM_PACKET_SIZE 0x27
+
+/* Reason codes from 0x80 up are failures */
+#define MQTTV5_REASON_FAILURE 0x80
+
+/* What the server takes, from the properties of its CONNACK. Those it
+ * leaves out have their default */
+typedef struct {
+	uint16_t receiveMaximum;	/* QoS1 and QoS2 publishes it has not acknowledged yet, 65535 */
+	uint16_t topicAliasMaximum;	/* Highest topic alias of a publish, 0 for none */
+	uint32_t maximumPacketSize;	/* 0 for no limit */
+	uint8_t maximumQoS;		/* 2 */
+} MQTTV5ConnackProperties;
+
+DLLExport MQTTReturnCode MQTTV5Deserialize_connack(unsigned char *sessionPresent,
+												   MQTTReturnCode *connack_rc,
+												   MQTTV5ConnackProperties *props,
+												   unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTV5Serialize_publishHeader(unsigned char *buf, size_t buflen, uint8_t dup,
+													   QoS qos, uint8_t retained, uint16_t packetid,
+													   MQTTString topicName, uint16_t topicAlias,
+													   size_t payloadlen, uint32_t *serialized_len);
+
+DLLExport MQTTReturnCode MQTTV5Deserialize_publish(unsigned char *dup, QoS *qos,
+												   unsigned char *retained, uint16_t *packetid,
+												   MQTTString *topicName, unsigned char **payload,
+												   uint32_t *payloadlen, unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTV5Deserialize_ack(unsigned char *packettype, unsigned char *dup,
+											   uint16_t *packetid, unsigned char *reasonCode,
+											   unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTV5Serialize_subscribe(unsigned char *buf, size_t buflen,
+												   unsigned char dup, uint16_t packetid, uint32_t count,
+												   MQTTString topicFilters[], QoS requestedQoSs[],
+												   uint32_t *serialized_len);
+
+DLLExport MQTTReturnCode MQTTV5Serialize_unsubscribe(unsigned char *buf, size_t buflen,
+													 uint8_t dup, uint16_t packetid,
+													 uint32_t count, MQTTString topicFilters[],
+													 uint32_t *serialized_len);
+
+DLLExport MQTTReturnCode MQTTV5Deserialize_subunsuback(unsigned char packettype, uint16_t *packetid,
+													   unsigned char *reasonCode,
+													   unsigned char *buf, size_t buflen);
+
+DLLExport MQTTReturnCode MQTTV5_readProperties(unsigned char **pptr, unsigned char *enddata,
+											   uint32_t *propertiesLen);
+
+#endif /* MQTTV5_H_ */
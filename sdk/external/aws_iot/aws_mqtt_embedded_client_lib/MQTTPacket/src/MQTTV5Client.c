@@ -0,0 +1,572 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * MQTT 5 adds a property list to the variable header of most packets and a
+ * reason code to the acks. The client only sends the properties it needs,
+ * the topic alias of a publish, and reads the limits of the CONNACK. Any
+ * other property of a received packet is stepped over.
+ */
+
+#include "MQTTPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+/* Variable byte integer, at most 4 bytes and within the packet */
+static MQTTReturnCode readVarInt(unsigned char **pptr, unsigned char *enddata, uint32_t *value) {
+	uint32_t multiplier = 1;
+	uint32_t len = 0;
+	unsigned char c;
+
+	*value = 0;
+	do {
+		if(4 <= len++ || *pptr >= enddata) {
+			return MQTT_FAILURE;
+		}
+		c = readChar(pptr);
+		*value += (c & 127) * multiplier;
+		multiplier *= 128;
+	} while(0 != (c & 128));
+
+	return MQTT_SUCCESS;
+}
+
+static uint32_t readInt4(unsigned char **pptr) {
+	unsigned char *ptr = *pptr;
+
+	*pptr += 4;
+	return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+}
+
+/* Steps over the value of a property, MQTT 5 specification 2.2.2.2 */
+static MQTTReturnCode skipProperty(unsigned char id, unsigned char **pptr, unsigned char *enddata) {
+	uint32_t len;
+	uint32_t skip;
+
+	switch(id) {
+		case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+			skip = 1;
+			break;
+		case 0x13: case 0x21: case 0x22: case 0x23:
+			skip = 2;
+			break;
+		case 0x02: case 0x11: case 0x18: case 0x27:
+			skip = 4;
+			break;
+		case 0x0B:
+			return readVarInt(pptr, enddata, &len);
+		case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+			/* string or binary data */
+			if(enddata - *pptr < 2) {
+				return MQTT_FAILURE;
+			}
+			skip = (uint32_t)readInt(pptr);
+			break;
+		case 0x26:
+			/* string pair */
+			if(enddata - *pptr < 2) {
+				return MQTT_FAILURE;
+			}
+			len = (uint32_t)readInt(pptr);
+			if((uint32_t)(enddata - *pptr) < len + 2) {
+				return MQTT_FAILURE;
+			}
+			*pptr += len;
+			skip = (uint32_t)readInt(pptr);
+			break;
+		default:
+			return MQTT_FAILURE;
+	}
+
+	if((uint32_t)(enddata - *pptr) < skip) {
+		return MQTT_FAILURE;
+	}
+	*pptr += skip;
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Reads the length of a property list
+  * @param pptr the buffer, it is left at the first property
+  * @param enddata end of the packet
+  * @param propertiesLen returned length of the properties, they are all within the packet
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5_readProperties(unsigned char **pptr, unsigned char *enddata,
+									 uint32_t *propertiesLen) {
+	if(MQTT_SUCCESS != readVarInt(pptr, enddata, propertiesLen)
+	   || (uint32_t)(enddata - *pptr) < *propertiesLen) {
+		return MQTT_FAILURE;
+	}
+
+	return MQTT_SUCCESS;
+}
+
+/* Steps over a property list */
+static MQTTReturnCode skipProperties(unsigned char **pptr, unsigned char *enddata) {
+	uint32_t len;
+
+	if(MQTT_SUCCESS != MQTTV5_readProperties(pptr, enddata, &len)) {
+		return MQTT_FAILURE;
+	}
+	*pptr += len;
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Deserializes an MQTT 5 CONNACK
+  * @param sessionPresent the session present flag returned
+  * @param connack_rc returned reason code, as the 3.1.1 one it stands for
+  * @param props returned limits of the server
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Deserialize_connack(unsigned char *sessionPresent,
+										 MQTTReturnCode *connack_rc,
+										 MQTTV5ConnackProperties *props,
+										 unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == sessionPresent || NULL == connack_rc || NULL == props || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	/* Fixed header, flags, reason code and the property length */
+	if(5 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	unsigned char *propsend = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+	uint32_t propsLen = 0;
+	unsigned char id;
+
+	header.byte = readChar(&curdata);
+	if(CONNACK != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+	if(enddata - curdata < 2) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*sessionPresent = readChar(&curdata) & 0x01;
+	switch(readChar(&curdata)) {
+		case 0x00:
+			*connack_rc = MQTT_CONNACK_CONNECTION_ACCEPTED;
+			break;
+		case 0x84:	/* Unsupported Protocol Version */
+			*connack_rc = MQTT_CONANCK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR;
+			break;
+		case 0x85:	/* Client Identifier not valid */
+			*connack_rc = MQTT_CONNACK_IDENTIFIER_REJECTED_ERROR;
+			break;
+		case 0x88:	/* Server unavailable */
+		case 0x89:	/* Server busy */
+			*connack_rc = MQTT_CONNACK_SERVER_UNAVAILABLE_ERROR;
+			break;
+		case 0x86:	/* Bad User Name or Password */
+			*connack_rc = MQTT_CONNACK_BAD_USERDATA_ERROR;
+			break;
+		case 0x87:	/* Not authorized */
+			*connack_rc = MQTT_CONNACK_NOT_AUTHORIZED_ERROR;
+			break;
+		default:
+			*connack_rc = MQTT_CONNACK_UNKNOWN_ERROR;
+			break;
+	}
+
+	props->receiveMaximum = 65535;
+	props->topicAliasMaximum = 0;
+	props->maximumPacketSize = 0;
+	props->maximumQoS = 2;
+
+	/* A refused connect may end without properties */
+	if(curdata == enddata) {
+		FUNC_EXIT_RC(MQTT_SUCCESS);
+		return MQTT_SUCCESS;
+	}
+	if(MQTT_SUCCESS != MQTTV5_readProperties(&curdata, enddata, &propsLen)) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	propsend = curdata + propsLen;
+	while(curdata < propsend) {
+		id = readChar(&curdata);
+		if(MQTTV5_PROP_RECEIVE_MAXIMUM == id && propsend - curdata >= 2) {
+			props->receiveMaximum = (uint16_t)readInt(&curdata);
+		} else if(MQTTV5_PROP_TOPIC_ALIAS_MAXIMUM == id && propsend - curdata >= 2) {
+			props->topicAliasMaximum = (uint16_t)readInt(&curdata);
+		} else if(MQTTV5_PROP_MAXIMUM_PACKET_SIZE == id && propsend - curdata >= 4) {
+			props->maximumPacketSize = readInt4(&curdata);
+		} else if(MQTTV5_PROP_MAXIMUM_QOS == id && propsend - curdata >= 1) {
+			props->maximumQoS = readChar(&curdata);
+		} else if(MQTT_SUCCESS != skipProperty(id, &curdata, propsend)) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+	}
+
+	/* A receive maximum of 0 is a protocol error, taken as the default */
+	if(0 == props->receiveMaximum) {
+		props->receiveMaximum = 65535;
+	}
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes the header of an MQTT 5 publish, as MQTTSerialize_publishHeader()
+  * @param buf the buffer into which the packet header will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT dup flag
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param packetid integer - the MQTT packet identifier
+  * @param topicName MQTTString - the MQTT topic, empty to publish on the topic the alias stands for
+  * @param topicAlias the topic alias, 0 for none. With a topic the alias is set to stand for it
+  * @param payloadlen integer - the length of the MQTT payload that will follow the header
+  * @param serialized_len returned length of the header
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Serialize_publishHeader(unsigned char *buf, size_t buflen, uint8_t dup,
+											 QoS qos, uint8_t retained, uint16_t packetid,
+											 MQTTString topicName, uint16_t topicAlias,
+											 size_t payloadlen, uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	unsigned char propsLen = (0 != topicAlias) ? 3 : 0;
+	size_t rem_len = 2 + MQTTstrlen(topicName) + ((QOS0 != qos) ? 2 : 0) + 1 + propsLen + payloadlen;
+
+	if(MQTTPacket_len(rem_len) - payloadlen > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, PUBLISH, qos, dup, retained);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	writeChar(&ptr, header.byte);
+	ptr += MQTTPacket_encode(ptr, rem_len);
+
+	writeMQTTString(&ptr, topicName);
+	if(QOS0 != qos) {
+		writeInt(&ptr, packetid);
+	}
+
+	writeChar(&ptr, propsLen);
+	if(0 != topicAlias) {
+		writeChar(&ptr, MQTTV5_PROP_TOPIC_ALIAS);
+		writeInt(&ptr, topicAlias);
+	}
+
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Deserializes an MQTT 5 publish, as MQTTDeserialize_publish(). The client sets no topic
+  * alias maximum, a publish without a topic is refused
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Deserialize_publish(unsigned char *dup, QoS *qos,
+										 unsigned char *retained, uint16_t *packetid,
+										 MQTTString *topicName, unsigned char **payload,
+										 uint32_t *payloadlen, unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == dup || NULL == qos || NULL == retained || NULL == packetid) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	/* Fixed header, topic length and the property length */
+	if(5 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+
+	header.byte = readChar(&curdata);
+	if(PUBLISH != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*dup = header.bits.dup;
+	*qos = (QoS)header.bits.qos;
+	*retained = header.bits.retain;
+
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+
+	if(MQTT_SUCCESS != readMQTTLenString(topicName, &curdata, enddata) || 0 == topicName->lenstring.len) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	if(QOS0 != *qos) {
+		if(enddata - curdata < 2) {
+			FUNC_EXIT_RC(MQTT_FAILURE);
+			return MQTT_FAILURE;
+		}
+		*packetid = readPacketId(&curdata);
+	}
+
+	if(MQTT_SUCCESS != skipProperties(&curdata, enddata)) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*payloadlen = (uint32_t)(enddata - curdata);
+	*payload = curdata;
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Deserializes an MQTT 5 PUBACK, PUBREC, PUBREL or PUBCOMP
+  * @param packettype returned integer - the MQTT packet type
+  * @param dup returned integer - the MQTT dup flag
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param reasonCode returned reason code, 0 when the ack has none
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Deserialize_ack(unsigned char *packettype, unsigned char *dup,
+									 uint16_t *packetid, unsigned char *reasonCode,
+									 unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == reasonCode || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	MQTTReturnCode rc = MQTTDeserialize_ack(packettype, dup, packetid, buf, buflen);
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+
+	*reasonCode = 0;
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+
+	/* The properties after the reason code are not needed */
+	rc = MQTTPacket_decodeBuf(buf + 1, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS == rc && 2 < decodedLen) {
+		*reasonCode = buf[1 + readBytesLen + 2];
+	}
+
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+/**
+  * Serializes an MQTT 5 subscribe, as MQTTSerialize_subscribe(). The subscription options
+  * hold the requested QoS only, as in 3.1.1
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Serialize_subscribe(unsigned char *buf, size_t buflen,
+										 unsigned char dup, uint16_t packetid, uint32_t count,
+										 MQTTString topicFilters[], QoS requestedQoSs[],
+										 uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	size_t rem_len = 2 + 1; /* packetid and property length */
+	uint32_t i;
+
+	for(i = 0; i < count; ++i) {
+		rem_len += 2 + MQTTstrlen(topicFilters[i]) + 1;
+	}
+	if(MQTTPacket_len(rem_len) > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, SUBSCRIBE, QOS1, dup, 0);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	writeChar(&ptr, header.byte);
+	ptr += MQTTPacket_encode(ptr, rem_len);
+
+	writePacketId(&ptr, packetid);
+	writeChar(&ptr, 0);
+
+	for(i = 0; i < count; ++i) {
+		writeMQTTString(&ptr, topicFilters[i]);
+		writeChar(&ptr, (unsigned char)requestedQoSs[i]);
+	}
+
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Serializes an MQTT 5 unsubscribe, as MQTTSerialize_unsubscribe()
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Serialize_unsubscribe(unsigned char *buf, size_t buflen,
+										   uint8_t dup, uint16_t packetid,
+										   uint32_t count, MQTTString topicFilters[],
+										   uint32_t *serialized_len) {
+	FUNC_ENTRY;
+	if(NULL == buf || NULL == serialized_len) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	size_t rem_len = 2 + 1; /* packetid and property length */
+	uint32_t i;
+
+	for(i = 0; i < count; ++i) {
+		rem_len += 2 + MQTTstrlen(topicFilters[i]);
+	}
+	if(MQTTPacket_len(rem_len) > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTReturnCode rc = MQTTPacket_InitHeader(&header, UNSUBSCRIBE, QOS1, dup, 0);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	writeChar(&ptr, header.byte);
+	ptr += MQTTPacket_encode(ptr, rem_len);
+
+	writePacketId(&ptr, packetid);
+	writeChar(&ptr, 0);
+
+	for(i = 0; i < count; ++i) {
+		writeMQTTString(&ptr, topicFilters[i]);
+	}
+
+	*serialized_len = (uint32_t)(ptr - buf);
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
+
+/**
+  * Deserializes an MQTT 5 SUBACK or UNSUBACK, they carry a reason code per topic filter
+  * @param packettype SUBACK or UNSUBACK
+  * @param packetid returned integer - the MQTT packet identifier
+  * @param reasonCode returned first failure among the reason codes, 0 if there is none
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return MQTTReturnCode indicating function execution status
+  */
+MQTTReturnCode MQTTV5Deserialize_subunsuback(unsigned char packettype, uint16_t *packetid,
+											 unsigned char *reasonCode,
+											 unsigned char *buf, size_t buflen) {
+	FUNC_ENTRY;
+	if(NULL == packetid || NULL == reasonCode || NULL == buf) {
+		FUNC_EXIT_RC(MQTT_NULL_VALUE_ERROR);
+		return MQTT_NULL_VALUE_ERROR;
+	}
+
+	/* Fixed header, packet id, property length and a reason code */
+	if(6 > buflen) {
+		FUNC_EXIT_RC(MQTTPACKET_BUFFER_TOO_SHORT);
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	}
+
+	MQTTHeader header = {0};
+	unsigned char *curdata = buf;
+	unsigned char *enddata = NULL;
+	MQTTReturnCode rc = MQTT_FAILURE;
+	uint32_t decodedLen = 0;
+	uint32_t readBytesLen = 0;
+	unsigned char code;
+
+	header.byte = readChar(&curdata);
+	if(packettype != header.bits.type) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	rc = MQTTPacket_decodeBuf(curdata, &decodedLen, &readBytesLen);
+	if(MQTT_SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+		return rc;
+	}
+	curdata += readBytesLen;
+	enddata = curdata + decodedLen;
+	if(enddata - curdata < 2) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*packetid = readPacketId(&curdata);
+	if(MQTT_SUCCESS != skipProperties(&curdata, enddata)) {
+		FUNC_EXIT_RC(MQTT_FAILURE);
+		return MQTT_FAILURE;
+	}
+
+	*reasonCode = 0;
+	while(curdata < enddata) {
+		code = readChar(&curdata);
+		if(MQTTV5_REASON_FAILURE <= code && 0 == *reasonCode) {
+			*reasonCode = code;
+		}
+	}
+
+	FUNC_EXIT_RC(MQTT_SUCCESS);
+	return MQTT_SUCCESS;
+}
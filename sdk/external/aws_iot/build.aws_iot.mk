@@ -9,14 +9,35 @@ libaws_iot-objs-y := aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTSerializePu
 	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTPacket.c \
 	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTSubscribeClient.c \
 	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTDeserializePublish.c \
+	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTConnectServer.c \
+	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTSubscribeServer.c \
+	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTUnsubscribeServer.c \
+	aws_mqtt_embedded_client_lib/MQTTPacket/src/MQTTV5Client.c \
 	aws_mqtt_embedded_client_lib/MQTTClient-C/src/MQTTClient.c \
+	aws_mqtt_embedded_client_lib/MQTTClient-C/src/MQTTTopicTrie.c \
 	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/aws_iot_mqtt_embedded_client_wrapper.c \
 	aws_iot_src/utils/aws_iot_json_utils.c \
+	aws_iot_src/utils/aws_iot_log_deferred.c \
+	aws_iot_src/utils/aws_iot_offline_queue.c \
+	aws_iot_src/utils/aws_iot_mqtt_service.c \
+	aws_iot_src/utils/aws_iot_mqtt_gateway.c \
+	aws_iot_src/utils/aws_iot_json_stream.c \
+	aws_iot_src/utils/aws_iot_jobs.c \
+	aws_iot_src/utils/aws_iot_wifi_ps.c \
+	aws_iot_src/utils/aws_iot_runtime_config.c \
+	aws_iot_src/utils/aws_iot_http_pool.c \
 	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/network_interface.c \
+	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/dns_cache.c \
+	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/datagram_interface.c \
 	aws_iot_src/shadow/aws_iot_shadow_json.c \
+	aws_iot_src/shadow/aws_iot_shadow_cbor.c \
 	aws_iot_src/shadow/aws_iot_shadow_actions.c \
 	aws_iot_src/shadow/aws_iot_shadow.c \
 	aws_iot_src/shadow/aws_iot_shadow_records.c \
+	aws_iot_src/shadow/aws_iot_shadow_reported.c \
+	aws_iot_src/shadow/aws_iot_shadow_things.c \
 	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/timer.c \
+	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/timer_wheel.c \
+	aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk/threads.c \
 
-libaws_iot-cflags-y := -I $(d)/aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper -I $(d)/aws_iot_src/shadow -I $(d)aws_iot_src/protocol/mqtt -I $(d)/aws_iot_src/utils -I $(d)/aws_mqtt_embedded_client_lib/MQTTPacket/src -I $(d)/aws_mqtt_embedded_client_lib/MQTTClient-C/src
+libaws_iot-cflags-y := -I $(d)/aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper -I $(d)/aws_iot_src/protocol/mqtt/aws_iot_embedded_client_wrapper/platform_wmsdk -I $(d)/aws_iot_src/shadow -I $(d)aws_iot_src/protocol/mqtt -I $(d)/aws_iot_src/utils -I $(d)/aws_mqtt_embedded_client_lib/MQTTPacket/src -I $(d)/aws_mqtt_embedded_client_lib/MQTTClient-C/src
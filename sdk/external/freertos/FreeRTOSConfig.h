@@ -23,6 +23,13 @@
 #define configUSE_PREEMPTION		1
 #define configUSE_IDLE_HOOK		1
 #define configUSE_TICK_HOOK		1
+/* The hooks call the functions set up with os_setup_idle_function() and
+   os_setup_tick_function(), see Source/freertos_hooks.c */
+void os_idle_hooks_run(void);
+void os_tick_hooks_run(void);
+int os_idle_hooks_busy(void);
+#define vApplicationIdleHook		os_idle_hooks_run
+#define vApplicationTickHook		os_tick_hooks_run
 /* #define configCPU_CLOCK_HZ		( ( unsigned long ) 200000000 ) */
 #define configTICK_RATE_HZ		( ( portTickType ) 1000 )
 #define configMAX_PRIORITIES		(  5 )
@@ -34,7 +41,10 @@
 #define configUSE_16_BIT_TICKS		0
 #define configIDLE_SHOULD_YIELD		1
 #define configUSE_MUTEXES		1
-#if ( CONFIG_ENABLE_STACK_OVERFLOW_CHECK == 1 )
+/* The MPU stack guard catches the overflows, the pattern check of every
+   context switch is not needed along with it */
+#if ( CONFIG_ENABLE_STACK_OVERFLOW_CHECK == 1 ) && \
+	!defined(FREERTOS_MPU_STACK_GUARD)
 #define configCHECK_FOR_STACK_OVERFLOW	2
 #else
 #define configCHECK_FOR_STACK_OVERFLOW  0
@@ -67,6 +77,79 @@ unsigned long portWMSDK_GET_RUN_TIME_COUNTER_VALUE(void);
 	portWMSDK_GET_RUN_TIME_COUNTER_VALUE
 #endif /* configGENERATE_RUN_TIME_STATS */
 
+/* Tickless idle: the tick is stopped while no task is ready and the core
+   sleeps in PM2 until the next task unblock time, timed by the RTC alarm.
+   vPortSuppressTicksAndSleep is in ARM_CM4F/port_tickless.c. Enabled by
+   FREERTOS_TICKLESS_IDLE=y in build.freertos.mk */
+#ifdef FREERTOS_TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE		2
+/* PM2 entry and exit is not free, shorter idle periods use plain wfi */
+#ifndef configEXPECTED_IDLE_TIME_BEFORE_SLEEP
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP	5
+#endif
+/* Rate of the RTC counter the sleep is timed with */
+#ifndef configRTC_CLOCK_HZ
+#define configRTC_CLOCK_HZ		32768
+#endif
+/* An idle function with work left keeps the core awake, see
+   os_idle_function_busy() */
+#define configPRE_SLEEP_PROCESSING(x)			\
+	do {						\
+		if (os_idle_hooks_busy())		\
+			(x) = 0;			\
+	} while (0)
+#else
+#define configUSE_TICKLESS_IDLE		0
+#endif /* FREERTOS_TICKLESS_IDLE */
+
+/* Energy accounting: a switch into or out of the idle task changes the
+   state of the CPU, see energy_stats.h. Enabled by CONFIG_ENERGY_STATS */
+#ifdef CONFIG_ENERGY_STATS
+#include <energy_stats.h>
+#define INCLUDE_xTaskGetIdleTaskHandle	1
+#define traceENERGY_SWITCHED_IN()					\
+	energy_stats_cpu(pxCurrentTCB == xIdleTaskHandle ?		\
+			 ENERGY_CPU_IDLE : ENERGY_CPU_ACTIVE)
+#else
+#define traceENERGY_SWITCHED_IN()
+#endif /* CONFIG_ENERGY_STATS */
+
+/* Scheduling trace: the kernel trace hooks record into a ring buffer,
+   see freertos_trace.h. Enabled by FREERTOS_TRACE=y in
+   build.freertos.mk */
+#ifdef FREERTOS_TRACE
+#include <freertos_trace.h>
+#endif /* FREERTOS_TRACE */
+#ifndef traceTASK_SWITCHED_IN
+#define traceTASK_SWITCHED_IN()		traceENERGY_SWITCHED_IN()
+#endif
+
+/* MPU stack guard: a read only MPU region at the bottom of the stack of
+   the running task, moved at every context switch, faults at the first
+   write past the stack. See ARM_CM4F/port_stack_guard.c. Enabled by
+   FREERTOS_MPU_STACK_GUARD=y in build.freertos.mk */
+#ifdef FREERTOS_MPU_STACK_GUARD
+void vPortSetStackGuard(void *pvStack);
+void vPortStartStackGuard(void *pvStack);
+#define portSET_STACK_GUARD(pxStack)	vPortSetStackGuard(pxStack)
+#define portSTART_STACK_GUARD(pxStack)	vPortStartStackGuard(pxStack)
+#endif /* FREERTOS_MPU_STACK_GUARD */
+
+/* Queue sets, a task blocks on several queues and semaphores at once, see
+   waitset.h */
+#define configUSE_QUEUE_SETS		1
+
+/* Kernel objects can be created in memory of the caller, see
+   os_thread_create_static() and the other *_static() calls of wm_os.h. The
+   idle task, the timer task and the timer queue are then static too. */
+#define configSUPPORT_STATIC_ALLOCATION	1
+
+/* Take, contention and wait counts per mutex, see mutex_stats.h. Set
+   FREERTOS_MUTEX_STATS=y in the freertos build.mk */
+#ifdef FREERTOS_MUTEX_STATS
+#define configUSE_MUTEX_STATS		1
+#endif
+
 #define configUSE_CO_ROUTINES 		0
 #define configMAX_CO_ROUTINE_PRIORITIES ( 2 )
 
@@ -92,7 +175,7 @@ to exclude the API function. */
 #define INCLUDE_pcTaskGetTaskName	1
 
 #define configKERNEL_INTERRUPT_PRIORITY 	0xf0
-#define configMAX_SYSCALL_INTERRUPT_PRIORITY 	0xa0 /* equivalent to 0xa0, or priority 5. */
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY 	0xa0 /* NVIC priority 10, 4 priority bits */
 
 #define xPortPendSVHandler	PendSV_IRQHandler
 #define xPortSysTickHandler	SysTick_IRQHandler
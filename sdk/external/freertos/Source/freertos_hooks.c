@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Idle and tick functions of wm_os.h.
+ *
+ * The kernel calls os_idle_hooks_run() and os_tick_hooks_run() as its idle
+ * and tick hooks, see FreeRTOSConfig.h. The functions set up are kept packed
+ * at the start of their array, the idle ones sorted by priority, so a run
+ * calls exactly the functions set up and looks at no empty slot.
+ *
+ * The arrays are changed in critical sections, which hold off the tick
+ * interrupt. The idle task is not held off: a run it is doing while a
+ * function is set up or removed can skip or repeat a function once.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdbool.h>
+#include <wmerrno.h>
+#include <wm_os.h>
+
+struct idle_hook {
+	void (*func)(void);
+	int prio;
+};
+
+static struct idle_hook idle_hooks[MAX_CUSTOM_HOOKS];
+static volatile unsigned idle_hook_cnt;
+static void (*tick_hooks[MAX_CUSTOM_HOOKS])(void);
+static volatile unsigned tick_hook_cnt;
+/* An idle function has work left, cleared before every run */
+static volatile bool idle_busy;
+
+int os_setup_idle_function_prio(void (*func)(void), int prio)
+{
+	unsigned long state;
+	unsigned i, n;
+	int ret = WM_SUCCESS;
+
+	if (!func)
+		return -WM_FAIL;
+
+	state = os_enter_critical_section();
+	n = idle_hook_cnt;
+	for (i = 0; i < n; i++)
+		if (idle_hooks[i].func == func)
+			goto out;
+	if (n == MAX_CUSTOM_HOOKS) {
+		ret = -WM_FAIL;
+		goto out;
+	}
+	/* Behind the functions of the same or a higher priority */
+	for (i = n; i > 0 && idle_hooks[i - 1].prio < prio; i--)
+		idle_hooks[i] = idle_hooks[i - 1];
+	idle_hooks[i].func = func;
+	idle_hooks[i].prio = prio;
+	idle_hook_cnt = n + 1;
+out:
+	os_exit_critical_section(state);
+	return ret;
+}
+
+int os_setup_idle_function(void (*func)(void))
+{
+	return os_setup_idle_function_prio(func, OS_IDLE_PRIO_DEFAULT);
+}
+
+int os_remove_idle_function(void (*func)(void))
+{
+	unsigned long state;
+	unsigned i, n;
+
+	state = os_enter_critical_section();
+	n = idle_hook_cnt;
+	for (i = 0; i < n; i++)
+		if (idle_hooks[i].func == func)
+			break;
+	if (i == n) {
+		os_exit_critical_section(state);
+		return -WM_FAIL;
+	}
+	/* The count first, a run never reads past the functions set up */
+	idle_hook_cnt = n - 1;
+	for (; i < n - 1; i++)
+		idle_hooks[i] = idle_hooks[i + 1];
+	os_exit_critical_section(state);
+	return WM_SUCCESS;
+}
+
+int os_setup_tick_function(void (*func)(void))
+{
+	unsigned long state;
+	unsigned i, n;
+	int ret = WM_SUCCESS;
+
+	if (!func)
+		return -WM_FAIL;
+
+	state = os_enter_critical_section();
+	n = tick_hook_cnt;
+	for (i = 0; i < n; i++)
+		if (tick_hooks[i] == func)
+			goto out;
+	if (n == MAX_CUSTOM_HOOKS)
+		ret = -WM_FAIL;
+	else
+		tick_hooks[tick_hook_cnt++] = func;
+out:
+	os_exit_critical_section(state);
+	return ret;
+}
+
+int os_remove_tick_function(void (*func)(void))
+{
+	unsigned long state;
+	unsigned i, n;
+
+	state = os_enter_critical_section();
+	n = tick_hook_cnt;
+	for (i = 0; i < n; i++)
+		if (tick_hooks[i] == func)
+			break;
+	if (i == n) {
+		os_exit_critical_section(state);
+		return -WM_FAIL;
+	}
+	for (; i < n - 1; i++)
+		tick_hooks[i] = tick_hooks[i + 1];
+	tick_hook_cnt = n - 1;
+	os_exit_critical_section(state);
+	return WM_SUCCESS;
+}
+
+void os_idle_function_busy(void)
+{
+	idle_busy = true;
+}
+
+int os_idle_hooks_busy(void)
+{
+	return idle_busy;
+}
+
+void os_idle_hooks_run(void)
+{
+	unsigned i;
+
+	idle_busy = false;
+	for (i = 0; i < idle_hook_cnt; i++)
+		idle_hooks[i].func();
+}
+
+void os_tick_hooks_run(void)
+{
+	unsigned i, n = tick_hook_cnt;
+
+	for (i = 0; i < n; i++)
+		tick_hooks[i]();
+}
@@ -0,0 +1,225 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Recorder of the kernel trace hooks, see freertos_trace.h.
+ *
+ * The hooks run in the kernel, often from the PendSV handler or inside a
+ * critical section, so recording only masks the interrupts allowed to call
+ * FreeRTOS and copies 12 bytes.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <string.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <board.h>
+#include <flash.h>
+#include <lowlevel_drivers.h>
+#include <freertos_trace.h>
+
+static struct freertos_trace_event trace_ring[FREERTOS_TRACE_EVENT_CNT];
+/* Events recorded since the reset, the ring holds the last ones */
+static uint32_t trace_count;
+/* Number of the task running, for the events of the queues */
+static uint16_t trace_task;
+static volatile int trace_on;
+
+static void trace_put(unsigned type, void *obj, unsigned arg)
+{
+	struct freertos_trace_event *e;
+	UBaseType_t mask;
+
+	if (!trace_on)
+		return;
+
+	mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	e = &trace_ring[trace_count++ % FREERTOS_TRACE_EVENT_CNT];
+	e->cycles = DWT->CYCCNT;
+	e->obj = (uint32_t) obj;
+	e->task = trace_task;
+	e->type = type;
+	e->arg = arg;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+void freertos_trace_switch(unsigned type, void *tcb, unsigned number,
+			   unsigned prio)
+{
+	if (type == FREERTOS_TRACE_SWITCH_IN)
+		trace_task = number;
+	trace_put(type, tcb, prio);
+}
+
+void freertos_trace_event(unsigned type, void *obj, unsigned arg)
+{
+	trace_put(type, obj, arg);
+}
+
+void freertos_trace_start(void)
+{
+	/* Left running once started, the cycle tracer shares it */
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+	trace_on = 1;
+}
+
+void freertos_trace_stop(void)
+{
+	trace_on = 0;
+}
+
+void freertos_trace_reset(void)
+{
+	UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+	trace_count = 0;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+typedef int (*trace_out_fn)(void *ctx, const void *buf, uint32_t len);
+
+/* Writes the image with out(), the recording is paused */
+static int trace_export(trace_out_fn out, void *ctx)
+{
+	struct freertos_trace_hdr hdr;
+	struct freertos_trace_task task;
+	TaskStatus_t *status;
+	UBaseType_t n, i;
+	uint32_t first, events, j;
+	int ret;
+
+	/* A few spare entries for the tasks created meanwhile */
+	n = uxTaskGetNumberOfTasks() + 4;
+	status = pvPortMalloc(n * sizeof(TaskStatus_t));
+	if (!status)
+		return -WM_E_NOMEM;
+	n = uxTaskGetSystemState(status, n, NULL);
+
+	events = trace_count < FREERTOS_TRACE_EVENT_CNT ?
+		trace_count : FREERTOS_TRACE_EVENT_CNT;
+	first = trace_count - events;
+
+	hdr.magic = FREERTOS_TRACE_MAGIC;
+	hdr.version = FREERTOS_TRACE_VERSION;
+	hdr.event_size = sizeof(struct freertos_trace_event);
+	hdr.cpu_hz = board_cpu_freq();
+	hdr.events = events;
+	hdr.tasks = n;
+	hdr.task_size = sizeof(struct freertos_trace_task);
+	ret = out(ctx, &hdr, sizeof(hdr));
+
+	for (i = 0; i < n && ret == WM_SUCCESS; i++) {
+		memset(&task, 0, sizeof(task));
+		task.handle = (uint32_t) status[i].xHandle;
+		task.number = status[i].xTaskNumber;
+		task.base_prio = status[i].uxBasePriority;
+		strncpy(task.name, status[i].pcTaskName, sizeof(task.name));
+		ret = out(ctx, &task, sizeof(task));
+	}
+	vPortFree(status);
+
+	for (j = first; j != first + events && ret == WM_SUCCESS; j++)
+		ret = out(ctx, &trace_ring[j % FREERTOS_TRACE_EVENT_CNT],
+			  sizeof(struct freertos_trace_event));
+	return ret;
+}
+
+#define TRACE_LINE_BYTES 32
+
+struct trace_console {
+	uint8_t line[TRACE_LINE_BYTES];
+	uint32_t len;
+};
+
+static void trace_console_flush(struct trace_console *c)
+{
+	char hex[TRACE_LINE_BYTES * 2 + 1];
+	uint32_t i;
+
+	if (!c->len)
+		return;
+	for (i = 0; i < c->len; i++)
+		snprintf(&hex[i * 2], 3, "%02x", c->line[i]);
+	wmprintf("rtrace %s\r\n", hex);
+	c->len = 0;
+}
+
+static int trace_console_out(void *ctx, const void *buf, uint32_t len)
+{
+	struct trace_console *c = ctx;
+	const uint8_t *p = buf;
+
+	while (len--) {
+		c->line[c->len++] = *p++;
+		if (c->len == TRACE_LINE_BYTES)
+			trace_console_flush(c);
+	}
+	return WM_SUCCESS;
+}
+
+int freertos_trace_dump(void)
+{
+	struct trace_console c;
+	int was_on = trace_on;
+	int ret;
+
+	trace_on = 0;
+	c.len = 0;
+	wmprintf("rtrace begin\r\n");
+	ret = trace_export(trace_console_out, &c);
+	trace_console_flush(&c);
+	wmprintf("rtrace end\r\n");
+	trace_on = was_on;
+	return ret;
+}
+
+struct trace_flash {
+	mdev_t *dev;
+	uint32_t addr;
+	uint32_t end;
+};
+
+static int trace_flash_out(void *ctx, const void *buf, uint32_t len)
+{
+	struct trace_flash *f = ctx;
+
+	if (f->addr >= f->end)
+		return WM_SUCCESS;
+	if (len > f->end - f->addr)
+		len = f->end - f->addr;
+	if (flash_drv_write(f->dev, buf, len, f->addr) != WM_SUCCESS)
+		return -WM_FAIL;
+	f->addr += len;
+	return WM_SUCCESS;
+}
+
+int freertos_trace_save(const struct flash_desc *fl)
+{
+	struct trace_flash f;
+	int was_on = trace_on;
+	int ret;
+
+	f.dev = flash_drv_open(fl->fl_dev);
+	if (!f.dev)
+		return -WM_FAIL;
+
+	trace_on = 0;
+	f.addr = fl->fl_start;
+	f.end = fl->fl_start + fl->fl_size;
+	if (flash_drv_erase(f.dev, fl->fl_start, fl->fl_size) != WM_SUCCESS)
+		ret = -WM_FAIL;
+	else
+		ret = trace_export(trace_flash_out, &f);
+	trace_on = was_on;
+
+	flash_drv_close(f.dev);
+	return ret;
+}
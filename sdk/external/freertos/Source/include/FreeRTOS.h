@@ -671,6 +671,14 @@ extern "C" {
 	#define configUSE_TICKLESS_IDLE 0
 #endif
 
+#ifndef portSET_STACK_GUARD
+	#define portSET_STACK_GUARD( pxStack )
+#endif
+
+#ifndef portSTART_STACK_GUARD
+	#define portSTART_STACK_GUARD( pxStack )
+#endif
+
 #ifndef configPRE_SLEEP_PROCESSING
 	#define configPRE_SLEEP_PROCESSING( x )
 #endif
@@ -683,6 +691,18 @@ extern "C" {
 	#define configUSE_QUEUE_SETS 0
 #endif
 
+#ifndef configSUPPORT_STATIC_ALLOCATION
+	#define configSUPPORT_STATIC_ALLOCATION 0
+#endif
+
+#ifndef configUSE_MUTEX_STATS
+	#define configUSE_MUTEX_STATS 0
+#endif
+
+#if( configUSE_MUTEX_STATS == 1 ) && ( configUSE_MUTEXES != 1 )
+	#error configUSE_MUTEX_STATS requires configUSE_MUTEXES
+#endif
+
 #ifndef portTASK_USES_FLOATING_POINT
 	#define portTASK_USES_FLOATING_POINT()
 #endif
@@ -812,5 +832,30 @@ typedef struct {
 const heapAllocatorInfo_t *getheapAllocInfo(void);
 #endif /* FREERTOS_ENABLE_MALLOC_STATS */
 
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+/*
+ * Memory for the kernel objects created with the ...Static() functions.  The
+ * layouts are private, these types only have the size and alignment of the
+ * objects they stand in for, which the kernel sources check at compile time.
+ * The task one fits the TCB with run time stats and tracing on, the queue one
+ * grows by the counts of configUSE_MUTEX_STATS.
+ */
+typedef struct xSTATIC_TCB
+{
+	void *pvDummy[ 27 ];
+} StaticTask_t;
+
+typedef struct xSTATIC_QUEUE
+{
+	void *pvDummy[ 23 + ( configUSE_MUTEX_STATS * 8 ) ];
+} StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+typedef struct xSTATIC_TIMER
+{
+	void *pvDummy[ 13 ];
+} StaticTimer_t;
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 #endif /* INC_FREERTOS_H */
 
@@ -172,6 +172,28 @@ typedef void * QueueSetMemberHandle_t;
  */
 #define xQueueCreate( uxQueueLength, uxItemSize ) xQueueGenericCreate( uxQueueLength, uxItemSize, queueQUEUE_TYPE_BASE )
 
+/**
+ * queue. h
+ * <pre>
+ QueueHandle_t xQueueCreateStatic(
+							  UBaseType_t uxQueueLength,
+							  UBaseType_t uxItemSize,
+							  uint8_t *pucQueueStorage,
+							  StaticQueue_t *pxQueueBuffer
+						  );
+ * </pre>
+ *
+ * As xQueueCreate(), but the queue structure and its storage area, which
+ * must hold uxQueueLength * uxItemSize bytes, are provided by the caller, so
+ * the call does not use the heap.  Deleting the queue does not free them.
+ *
+ * Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ *
+ * \defgroup xQueueCreateStatic xQueueCreateStatic
+ * \ingroup QueueManagement
+ */
+#define xQueueCreateStatic( uxQueueLength, uxItemSize, pucQueueStorage, pxQueueBuffer ) xQueueGenericCreateStatic( ( uxQueueLength ), ( uxItemSize ), ( pucQueueStorage ), ( pxQueueBuffer ), queueQUEUE_TYPE_BASE )
+
 /**
  * queue. h
  * <pre>
@@ -1480,6 +1502,10 @@ BaseType_t xQueueCRReceive( QueueHandle_t xQueue, void *pvBuffer, TickType_t xTi
  */
 QueueHandle_t xQueueCreateMutex( const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
 QueueHandle_t xQueueCreateCountingSemaphore( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount ) PRIVILEGED_FUNCTION;
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	QueueHandle_t xQueueCreateMutexStatic( const uint8_t ucQueueType, StaticQueue_t *pxStaticQueue ) PRIVILEGED_FUNCTION;
+	QueueHandle_t xQueueCreateCountingSemaphoreStatic( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount, StaticQueue_t *pxStaticQueue ) PRIVILEGED_FUNCTION;
+#endif
 void* xQueueGetMutexHolder( QueueHandle_t xSemaphore ) PRIVILEGED_FUNCTION;
 
 /*
@@ -1543,6 +1569,51 @@ BaseType_t xQueueGiveMutexRecursive( QueueHandle_t pxMutex ) PRIVILEGED_FUNCTION
  */
 QueueHandle_t xQueueGenericCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
 
+/*
+ * As xQueueGenericCreate(), in memory provided by the caller.
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	QueueHandle_t xQueueGenericCreateStatic( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue, const uint8_t ucQueueType ) PRIVILEGED_FUNCTION;
+#endif
+
+#if( configUSE_MUTEX_STATS == 1 )
+	/*
+	 * The counts of a mutex, filled in by uxQueueGetMutexStats().  A take is
+	 * one successful call of xSemaphoreTake(), or the outermost one of
+	 * xSemaphoreTakeRecursive().
+	 */
+	typedef struct xMUTEX_STATS
+	{
+		QueueHandle_t xMutex;
+		const char *pcName;			/*< Name given with vQueueSetMutexName(), or NULL. */ /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+		void *pvHolder;				/*< Handle of the task holding the mutex, or NULL. */
+		uint32_t ulTakes;			/*< Takes that obtained the mutex. */
+		uint32_t ulContended;		/*< Takes that found the mutex held, whether or not they got it later. */
+		uint32_t ulTimeouts;		/*< Takes that gave up, or did not wait. */
+		uint32_t ulInversions;		/*< Waits on a holder of a lower priority, which then inherited the priority of the waiter. */
+		TickType_t xWaitTicks;		/*< Ticks spent blocked on the mutex by all takes. */
+		TickType_t xMaxWaitTicks;	/*< Longest time a take was blocked. */
+	} MutexStats_t;
+
+	/*
+	 * Names a mutex for uxQueueGetMutexStats().  The name is not copied.
+	 */
+	void vQueueSetMutexName( QueueHandle_t xMutex, const char *pcName ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+
+	/*
+	 * Fills in the counts of up to uxArraySize mutexes, the most recently
+	 * created first, and returns the number filled in.
+	 */
+	UBaseType_t uxQueueGetMutexStats( MutexStats_t * const pxStatsArray, const UBaseType_t uxArraySize ) PRIVILEGED_FUNCTION;
+
+	/*
+	 * Clears the counts of all the mutexes.
+	 */
+	void vQueueResetMutexStats( void ) PRIVILEGED_FUNCTION;
+#else
+	#define vQueueSetMutexName( xMutex, pcName )
+#endif
+
 /*
  * Queue sets provide a mechanism to allow a task to block (pend) on a read
  * operation from multiple queues or semaphores simultaneously.
@@ -184,6 +184,12 @@ typedef QueueHandle_t SemaphoreHandle_t;
  */
 #define xSemaphoreCreateBinary() xQueueGenericCreate( ( UBaseType_t ) 1, semSEMAPHORE_QUEUE_ITEM_LENGTH, queueQUEUE_TYPE_BINARY_SEMAPHORE )
 
+/**
+ * As xSemaphoreCreateBinary(), in the StaticSemaphore_t provided by the
+ * caller.  Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ */
+#define xSemaphoreCreateBinaryStatic( pxSemaphoreBuffer ) xQueueGenericCreateStatic( ( UBaseType_t ) 1, semSEMAPHORE_QUEUE_ITEM_LENGTH, NULL, ( pxSemaphoreBuffer ), queueQUEUE_TYPE_BINARY_SEMAPHORE )
+
 /**
  * semphr. h
  * <pre>xSemaphoreTake(
@@ -692,6 +698,12 @@ typedef QueueHandle_t SemaphoreHandle_t;
  */
 #define xSemaphoreCreateMutex() xQueueCreateMutex( queueQUEUE_TYPE_MUTEX )
 
+/**
+ * As xSemaphoreCreateMutex(), in the StaticSemaphore_t provided by the
+ * caller.  Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ */
+#define xSemaphoreCreateMutexStatic( pxMutexBuffer ) xQueueCreateMutexStatic( queueQUEUE_TYPE_MUTEX, ( pxMutexBuffer ) )
+
 
 /**
  * semphr. h
@@ -747,6 +759,12 @@ typedef QueueHandle_t SemaphoreHandle_t;
  */
 #define xSemaphoreCreateRecursiveMutex() xQueueCreateMutex( queueQUEUE_TYPE_RECURSIVE_MUTEX )
 
+/**
+ * As xSemaphoreCreateRecursiveMutex(), in the StaticSemaphore_t provided by
+ * the caller.  Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ */
+#define xSemaphoreCreateRecursiveMutexStatic( pxMutexBuffer ) xQueueCreateMutexStatic( queueQUEUE_TYPE_RECURSIVE_MUTEX, ( pxMutexBuffer ) )
+
 /**
  * semphr. h
  * <pre>SemaphoreHandle_t xSemaphoreCreateCounting( UBaseType_t uxMaxCount, UBaseType_t uxInitialCount )</pre>
@@ -810,6 +828,12 @@ typedef QueueHandle_t SemaphoreHandle_t;
  */
 #define xSemaphoreCreateCounting( uxMaxCount, uxInitialCount ) xQueueCreateCountingSemaphore( ( uxMaxCount ), ( uxInitialCount ) )
 
+/**
+ * As xSemaphoreCreateCounting(), in the StaticSemaphore_t provided by the
+ * caller.  Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ */
+#define xSemaphoreCreateCountingStatic( uxMaxCount, uxInitialCount, pxSemaphoreBuffer ) xQueueCreateCountingSemaphoreStatic( ( uxMaxCount ), ( uxInitialCount ), ( pxSemaphoreBuffer ) )
+
 /**
  * semphr. h
  * <pre>void vSemaphoreDelete( SemaphoreHandle_t xSemaphore );</pre>
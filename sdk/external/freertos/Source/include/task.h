@@ -345,6 +345,34 @@ is used in assert() statements. */
  */
 #define xTaskCreate( pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask ) xTaskGenericCreate( ( pvTaskCode ), ( pcName ), ( usStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ), ( NULL ), ( NULL ) )
 
+/**
+ * task. h
+ *<pre>
+ BaseType_t xTaskCreateStatic(
+							  TaskFunction_t pvTaskCode,
+							  const char * const pcName,
+							  uint16_t usStackDepth,
+							  void *pvParameters,
+							  UBaseType_t uxPriority,
+							  TaskHandle_t *pvCreatedTask,
+							  StackType_t *puxStackBuffer,
+							  StaticTask_t *pxTaskBuffer
+						  );</pre>
+ *
+ * As xTaskCreate(), but the stack and the task control block are provided by
+ * the caller, so the call does not use the heap.  puxStackBuffer must hold
+ * usStackDepth words and, like pxTaskBuffer, stay valid until the task is
+ * deleted.  Deleting the task does not free either of them.
+ *
+ * Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ *
+ * \defgroup xTaskCreateStatic xTaskCreateStatic
+ * \ingroup Tasks
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	BaseType_t xTaskCreateStatic( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, StaticTask_t * const pxTaskBuffer ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+#endif
+
 /**
  * task. h
  *<pre>
@@ -1480,6 +1508,50 @@ void vTaskGetRunTimeStats( char *pcWriteBuffer ) PRIVILEGED_FUNCTION; /*lint !e9
  *
  */
 void vTaskResetRunTimeStats();
+
+/**
+ * Get the context switch statistics of a task
+ *
+ * @note Marvell added API
+ *
+ * @param xTask The task, NULL for the calling task.
+ * @param pulSwitchInCount Number of times another task was switched out
+ * for this one. Can be NULL.
+ * @param pulMaxRunSlice Longest time, in run time counter units, the
+ * task kept the CPU before another task was switched in. Interrupts taken
+ * meanwhile are included. Can be NULL.
+ *
+ * configGENERATE_RUN_TIME_STATS must be 1 for this function to be
+ * available.
+ */
+void vTaskGetSwitchStats( TaskHandle_t xTask, uint32_t *pulSwitchInCount, uint32_t *pulMaxRunSlice ) PRIVILEGED_FUNCTION;
+
+/**
+ * Mark the start and the end of an interrupt handler for the run time
+ * statistics
+ *
+ * @note Marvell added API
+ *
+ * Interrupt handlers that call these at entry and exit are accounted in
+ * vTaskGetISRRunTime(). Nested interrupts are counted but their time is
+ * only accounted once, as part of the outermost one.
+ */
+void vTaskRunTimeISREnter( void ) PRIVILEGED_FUNCTION;
+void vTaskRunTimeISRExit( void ) PRIVILEGED_FUNCTION;
+
+/**
+ * Get the time spent in interrupt handlers
+ *
+ * @note Marvell added API
+ *
+ * @param pulISRRunTime Time, in run time counter units, spent in
+ * interrupts bracketed by vTaskRunTimeISREnter()/vTaskRunTimeISRExit().
+ * Can be NULL.
+ * @param pulISRCount Number of those interrupts. Can be NULL.
+ *
+ * Both are cleared by vTaskResetRunTimeStats().
+ */
+void vTaskGetISRRunTime( uint32_t *pulISRRunTime, uint32_t *pulISRCount ) PRIVILEGED_FUNCTION;
 
 /**
  * task. h
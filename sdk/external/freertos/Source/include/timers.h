@@ -259,6 +259,16 @@ typedef void (*PendedFunction_t)( void *, uint32_t );
  */
 TimerHandle_t xTimerCreate( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 
+/**
+ * As xTimerCreate(), in the StaticTimer_t provided by the caller, so the call
+ * does not use the heap.  Deleting the timer does not free the buffer.
+ *
+ * Only available if configSUPPORT_STATIC_ALLOCATION is set to 1.
+ */
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	TimerHandle_t xTimerCreateStatic( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction, StaticTimer_t *pxTimerBuffer ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+#endif
+
 /**
  * void *pvTimerGetTimerID( TimerHandle_t xTimer );
  *
@@ -281,6 +291,25 @@ TimerHandle_t xTimerCreate( const char * const pcTimerName, const TickType_t xTi
  */
 void *pvTimerGetTimerID( TimerHandle_t xTimer ) PRIVILEGED_FUNCTION;
 
+/**
+ * void vTimerSetSlack( TimerHandle_t xTimer, TickType_t xSlack );
+ *
+ * Lets a timer expire up to xSlack ticks late.  The timer service task wakes
+ * up at the earliest expiry time plus slack of the active timers and
+ * processes every timer that expired by then, so timers of close expiry
+ * times are processed in one wake up.  The wake ups saved lengthen the
+ * sleeps of tickless idle.  Auto reload timers keep their period, a late
+ * expiry does not move the next one.
+ *
+ * The slack of a new timer is 0.  It should stay below the period of an
+ * auto reload timer.
+ *
+ * @param xTimer The timer.
+ *
+ * @param xSlack The ticks the timer may expire late.
+ */
+void vTimerSetSlack( TimerHandle_t xTimer, const TickType_t xSlack ) PRIVILEGED_FUNCTION;
+
 /**
  * BaseType_t xTimerIsTimerActive( TimerHandle_t xTimer );
  *
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * MPU stack guard for the MW300.
+ *
+ * The last MPU region is a 32 byte read only region at the bottom of the
+ * stack of the running task, the kernel moves it from vTaskSwitchContext()
+ * with two register writes. The first push or store past the end of the
+ * stack, or the exception frame of an interrupt stacked there, raises a
+ * MemManage fault at once instead of corrupting the memory below. Reads are
+ * allowed so that the high water mark scan of uxTaskGetStackHighWaterMark()
+ * still walks through the guard.
+ *
+ * The region has to be aligned to its size: it starts at the first 32 byte
+ * boundary of the stack, the bytes below it are not used either, so a task
+ * loses between 32 and 56 bytes of its stack.
+ *
+ * The other regions are unused and the default memory map stays in place
+ * for everything else, the port runs all tasks privileged.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef FREERTOS_MPU_STACK_GUARD
+
+#define portMPU_CTRL_REG			( * ( ( volatile uint32_t * ) 0xe000ed94 ) )
+#define portMPU_REGION_BASE_ADDRESS_REG		( * ( ( volatile uint32_t * ) 0xe000ed9c ) )
+#define portMPU_REGION_ATTRIBUTE_REG		( * ( ( volatile uint32_t * ) 0xe000eda0 ) )
+#define portNVIC_SYS_CTRL_STATE_REG		( * ( ( volatile uint32_t * ) 0xe000ed24 ) )
+#define portNVIC_CFSR_REG			( * ( ( volatile uint32_t * ) 0xe000ed28 ) )
+
+#define portMPU_ENABLE				( 1UL << 0UL )
+#define portMPU_BACKGROUND_ENABLE		( 1UL << 2UL )
+#define portMPU_REGION_VALID			( 1UL << 4UL )
+#define portMPU_REGION_ENABLE			( 1UL << 0UL )
+#define portMPU_REGION_READ_ONLY		( 6UL << 24UL )
+#define portMPU_REGION_EXECUTE_NEVER		( 1UL << 28UL )
+#define portNVIC_MEM_FAULT_ENABLE		( 1UL << 16UL )
+
+/* MemManage fault status, the low byte of the CFSR */
+#define portMMFSR_DACCVIOL			( 1UL << 1UL )
+#define portMMFSR_MSTKERR			( 1UL << 4UL )
+
+#define portSTACK_GUARD_REGION			( 7UL )
+#define portSTACK_GUARD_SIZE			( 32UL )
+/* Size field of the attribute register, the region is 2^(n + 1) bytes */
+#define portSTACK_GUARD_SIZE_FIELD		( 4UL << 1UL )
+
+#define portSTACK_GUARD_ATTRIBUTES		( portMPU_REGION_READ_ONLY |	\
+						  portMPU_REGION_EXECUTE_NEVER | \
+						  portSTACK_GUARD_SIZE_FIELD |	\
+						  portMPU_REGION_ENABLE )
+
+extern void vApplicationStackOverflowHook(TaskHandle_t xTask,
+					  char *pcTaskName);
+
+void vPortSetStackGuard(void *pvStack)
+{
+	uint32_t ulBase = ((uint32_t) pvStack + portSTACK_GUARD_SIZE - 1) &
+		~(portSTACK_GUARD_SIZE - 1);
+
+	/* The valid bit selects the region, no separate number write */
+	portMPU_REGION_BASE_ADDRESS_REG = ulBase | portMPU_REGION_VALID |
+		portSTACK_GUARD_REGION;
+	portMPU_REGION_ATTRIBUTE_REG = portSTACK_GUARD_ATTRIBUTES;
+}
+
+void vPortStartStackGuard(void *pvStack)
+{
+	vPortSetStackGuard(pvStack);
+	portNVIC_SYS_CTRL_STATE_REG |= portNVIC_MEM_FAULT_ENABLE;
+	portMPU_CTRL_REG = portMPU_BACKGROUND_ENABLE | portMPU_ENABLE;
+	__asm volatile("dsb\n" "isb\n");
+}
+
+/* Replaces the weak handler of the startup code */
+void MemManage_IRQHandler(void)
+{
+	uint32_t ulStatus = portNVIC_CFSR_REG & 0xff;
+
+	/* The hook of the SDK prints the task and halts */
+	if (ulStatus & (portMMFSR_DACCVIOL | portMMFSR_MSTKERR)) {
+		vApplicationStackOverflowHook(xTaskGetCurrentTaskHandle(),
+					      pcTaskGetTaskName(NULL));
+		return;
+	}
+
+	/*
+	 * Not the guard, e.g. an instruction fetch from an execute never
+	 * address: with the MemManage fault disabled the faulting instruction
+	 * runs again and ends in the usual HardFault dump.
+	 */
+	portNVIC_SYS_CTRL_STATE_REG &= ~portNVIC_MEM_FAULT_ENABLE;
+}
+
+#endif /* FREERTOS_MPU_STACK_GUARD */
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Tickless idle for the MW300.
+ *
+ * The SysTick is clocked from the core clock which stops in PM2, so it
+ * cannot time the sleep. Instead the RTC, which keeps running from the
+ * 32 kHz clock, is used: an RTC alarm is programmed for the next task
+ * unblock time (software timers and network timeouts are all tasks
+ * blocked with a timeout, so this covers the MQTT keep alive as well),
+ * the core enters PM2 and on wakeup the RTC counter tells how many ticks
+ * were missed. The kernel tick count is then moved forward with
+ * vTaskStepTick(), up to the unblock time of the next task as in the
+ * SysTick port.
+ *
+ * The RTC has to be running in RTC_CNT_VAL_UPDATE_AUTO mode at
+ * configRTC_CLOCK_HZ before the scheduler starts, the counter and its
+ * upper value are left untouched so calendar time keeping is not
+ * disturbed. Only the alarm channel is used here.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <wm_os.h>
+#include <mw300_rtc.h>
+#include <mw300_pmu.h>
+#include <energy_stats.h>
+
+#if ( configUSE_TICKLESS_IDLE == 2 )
+
+/* Part of a tick, in units of 1 / (configRTC_CLOCK_HZ * configTICK_RATE_HZ)
+ * of a second, carried over to the next sleep so rounding does not make
+ * the kernel time drift */
+static uint32_t ulRtcRemainder;
+
+static uint32_t prvRtcAdd(uint32_t ulCount, uint32_t ulDelta, uint32_t ulUpp)
+{
+	uint64_t ullSum = (uint64_t) ulCount + ulDelta;
+
+	if (ullSum > ulUpp)
+		ullSum -= (uint64_t) ulUpp + 1;
+	return (uint32_t) ullSum;
+}
+
+static uint32_t prvRtcElapsed(uint32_t ulStart, uint32_t ulNow, uint32_t ulUpp)
+{
+	if (ulNow >= ulStart)
+		return ulNow - ulStart;
+	return (ulUpp - ulStart) + ulNow + 1;
+}
+
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime)
+{
+	uint32_t ulUpp, ulStart, ulCounts;
+	uint64_t ullElapsed;
+	TickType_t xMaxTicks, xModifiableIdleTime, xCompleteTicks;
+
+	/* Keep the alarm within half of the counter range so a late wakeup
+	 * cannot be mistaken for a wrap of the counter */
+	ulUpp = RTC_GetCounterUppVal();
+	xMaxTicks = (TickType_t) (((uint64_t) (ulUpp / 2) * configTICK_RATE_HZ)
+				  / configRTC_CLOCK_HZ);
+	if (xExpectedIdleTime > xMaxTicks)
+		xExpectedIdleTime = xMaxTicks;
+
+	/* The tick interrupt must not run while the kernel time is
+	 * recomputed, the RTC alarm still wakes the core since wfi
+	 * returns on a pending interrupt even with PRIMASK set */
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	__asm volatile("cpsid i");
+
+	if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		__asm volatile("cpsie i");
+		return;
+	}
+
+	ulCounts = (uint32_t) (((uint64_t) xExpectedIdleTime * configRTC_CLOCK_HZ)
+			       / configTICK_RATE_HZ);
+	ulStart = RTC_GetCounterVal();
+	RTC_SetCounterAlarmVal(prvRtcAdd(ulStart, ulCounts, ulUpp));
+	RTC_IntClr(RTC_INT_CNT_ALARM);
+	RTC_IntMask(RTC_INT_CNT_ALARM, UNMASK);
+	NVIC_EnableIRQ(RTC_IRQn);
+	PMU_ClearWakeupSrcInt(PMU_WAKEUP_RTC);
+	PMU_WakeupSrcIntMask(PMU_WAKEUP_RTC, UNMASK);
+
+	xModifiableIdleTime = xExpectedIdleTime;
+	configPRE_SLEEP_PROCESSING(xModifiableIdleTime);
+	if (xModifiableIdleTime > 0) {
+		PMU_SetSleepMode(PMU_PM2);
+		ENERGY_STATS_CPU(ENERGY_CPU_PM2);
+		__asm volatile("dsb");
+		__asm volatile("wfi");
+		__asm volatile("isb");
+		PMU_SetSleepMode(PMU_PM1);
+		ENERGY_STATS_CPU(ENERGY_CPU_IDLE);
+	}
+	configPOST_SLEEP_PROCESSING(xExpectedIdleTime);
+
+	PMU_WakeupSrcIntMask(PMU_WAKEUP_RTC, MASK);
+	PMU_ClearWakeupSrcInt(PMU_WAKEUP_RTC);
+	RTC_IntMask(RTC_INT_CNT_ALARM, MASK);
+	RTC_IntClr(RTC_INT_CNT_ALARM);
+
+	/* Whatever woke the core, the RTC tells how long it slept */
+	ullElapsed = (uint64_t) prvRtcElapsed(ulStart, RTC_GetCounterVal(), ulUpp)
+		* configTICK_RATE_HZ + ulRtcRemainder;
+	xCompleteTicks = (TickType_t) (ullElapsed / configRTC_CLOCK_HZ);
+	ulRtcRemainder = (uint32_t) (ullElapsed % configRTC_CLOCK_HZ);
+
+	/* The kernel time cannot step past the unblock time of the next
+	 * task. When the whole idle time went by, all the ticks but the last
+	 * are stepped and the last one is pended, so that the tick interrupt
+	 * unblocks the tasks that are due. A longer sleep, when an interrupt
+	 * held the core after the alarm, is lost to the kernel time as with
+	 * the SysTick port */
+	if (xCompleteTicks >= xExpectedIdleTime) {
+		xCompleteTicks = xExpectedIdleTime - 1;
+		ulRtcRemainder = 0;
+		SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+	}
+	vTaskStepTick(xCompleteTicks);
+
+	SysTick->VAL = 0;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	__asm volatile("cpsie i");
+}
+
+#endif /* configUSE_TICKLESS_IDLE == 2 */
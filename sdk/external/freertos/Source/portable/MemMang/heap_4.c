@@ -114,6 +114,17 @@ task.h is included from an application file. */
 
 #include "memdebug.h"
 
+#ifdef HEAP_TRACK
+#include <heap_track.h>
+#define track_alloc_hook(pxBlock, pvCaller)		\
+	heap_track_alloc(pxBlock, BLOCK_SIZE(pxBlock), pvCaller)
+#define track_free_hook(pxBlock)			\
+	heap_track_free(pxBlock, BLOCK_SIZE(pxBlock))
+#else /* ! HEAP_TRACK */
+#define track_alloc_hook(...)
+#define track_free_hook(...)
+#endif /* HEAP_TRACK */
+
 #undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
 
 /*
@@ -470,17 +481,20 @@ int prvHeapAddMemBank(char *chunk_start, size_t size)
 		 * previous chunk is empty (ie end of SRAM0 should be available)
 		 */
 		DTRACE("End of the first bank is not free. Cannot add new memory bank");
+		xTaskResumeAll();
 		return pdFAIL;
 	}
 
 	if ((chunk_start - (char *)lastHeapAddress) < heapMINIMUM_BLOCK_SIZE) {
 		/* Too small hole in between */
 		DTRACE("Too Small Hole in between %p %p %d\r\n", chunk_start, lastHeapAddress, heapMINIMUM_BLOCK_SIZE);
+		xTaskResumeAll();
 		return pdFAIL;
 	}
 
 	if (chunk_start < (char *)startHeapAddress) {
 		DTRACE("Adding of a memory bank BEFORE the default heap is not supported");
+		xTaskResumeAll();
 		return pdFAIL;
 	}
 
@@ -559,7 +573,9 @@ int prvHeapAddMemBank(char *chunk_start, size_t size)
 }
 /*-----------------------------------------------------------*/
 
-void *pvPortMalloc( size_t xWantedSize )
+/* pvCaller is who the allocation is for, pvPortReAlloc() passes its own
+caller */
+static void *prvMalloc( size_t xWantedSize, void *pvCaller )
 {
 	xBlockLink *pxBlock = NULL, *pxPreviousBlock, *pxNewBlockLink;
 	void *pvReturn = NULL;
@@ -653,6 +669,7 @@ void *pvPortMalloc( size_t xWantedSize )
 					SET_ALLOCATED(pxBlock);
 				}
 				xFreeBytesRemaining -= BLOCK_SIZE(pxBlock);
+				track_alloc_hook( pxBlock, pvCaller );
 			}
 		}
 	}
@@ -685,7 +702,7 @@ void *pvPortMalloc( size_t xWantedSize )
 		SET_CALLER_ADDR( pxBlock );
 		ATRACE("MDC A %10x %6d %10d R: %x\r\n", pvReturn ,
 		       BLOCK_SIZE( pxBlock ),
-		       xFreeBytesRemaining, __builtin_return_address(0));
+		       xFreeBytesRemaining, pvCaller);
 		randomizeAreaData((unsigned char*)pvReturn, 
 				  BLOCK_SIZE( pxBlock ) - heapSTRUCT_SIZE);
 		post_alloc_hook( pvReturn );
@@ -700,6 +717,11 @@ void *pvPortMalloc( size_t xWantedSize )
 	
 	return pvReturn;
 }
+
+void *pvPortMalloc( size_t xWantedSize )
+{
+	return prvMalloc( xWantedSize, __builtin_return_address(0) );
+}
 /*-----------------------------------------------------------*/
 void vPortFree( void *pv )
 {
@@ -734,6 +756,7 @@ xBlockLink *pxLink;
 
 		vTaskSuspendAll();
 		{
+			track_free_hook( pxLink );
 			/* Add this block to the list of free blocks. */
 			SET_FREE( pxLink );
 			xFreeBytesRemaining += BLOCK_SIZE(pxLink);
@@ -769,7 +792,8 @@ void* pvPortReAlloc( void *pv,  size_t xWantedSize )
 				return NULL;
 			}
 		
-		void *newArea = pvPortMalloc( xWantedSize );
+		void *newArea = prvMalloc( xWantedSize,
+					   __builtin_return_address(0) );
 		if( newArea )  
 			{
 				/* The memory being freed will have an xBlockLink structure immediately
@@ -797,6 +821,7 @@ void* pvPortReAlloc( void *pv,  size_t xWantedSize )
 				
 				vTaskSuspendAll();
 				{
+					track_free_hook( pxLink );
 					/* Add this block to the list of free blocks. */
 					SET_FREE( pxLink );
 					xFreeBytesRemaining += BLOCK_SIZE(pxLink);
@@ -811,7 +836,7 @@ void* pvPortReAlloc( void *pv,  size_t xWantedSize )
 			}
 	}
 	else if( xWantedSize )
-		return pvPortMalloc( xWantedSize );
+		return prvMalloc( xWantedSize, __builtin_return_address(0) );
 	else
 		return NULL;
 	
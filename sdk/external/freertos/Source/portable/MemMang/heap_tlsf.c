@@ -0,0 +1,607 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Two level segregated fit heap, built instead of heap_4 with
+ * FREERTOS_HEAP_TLSF=y.
+ *
+ * heap_4 keeps one free list sorted by size, a malloc walks it up to a block
+ * that fits and a free walks it twice to unlink the neighbours it merges
+ * with, both with the scheduler suspended for as long as the list is long.
+ * Here the free blocks are kept in lists by size class: the first level is
+ * the power of 2 below the size, the second level splits it in
+ * TLSF_SL_COUNT equal ranges, blocks under TLSF_SMALL_SIZE have a class per
+ * TLSF_GRANULE bytes. A bitmap per level tells which lists hold blocks, so
+ * the smallest class that surely fits is found with two count leading zeros
+ * instructions. The lists are doubly linked and the physical neighbours are
+ * reached from the block header, so a free merges in constant time too.
+ *
+ * A request is rounded up to the next class boundary, so the block found
+ * always fits without a walk. The space lost to that rounding is at most one
+ * part in TLSF_SL_COUNT of the block, the rest of a block bigger than needed
+ * is split off and freed.
+ *
+ * Block header, at the start of every block:
+ * - prev_phys, the block before it in memory, NULL for the first of a bank;
+ * - size, of the whole block with its header, TLSF_BLOCK_FREE and
+ *   TLSF_PREV_FREE in its low bits.
+ * A free block keeps its list links behind the header, in what is the
+ * payload of an allocated block. Each bank ends in a sentinel header of
+ * size 0 marked allocated, so a block never merges past its bank.
+ *
+ * The interface and the statistics are those of heap_4. The guard bytes of
+ * DEBUG_HEAP_EXTRA are not supported.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef HEAP_TRACK
+#include <heap_track.h>
+#define track_alloc_hook(pxBlock, pvCaller)		\
+	heap_track_alloc(pxBlock, BLOCK_SIZE(pxBlock), pvCaller)
+#define track_free_hook(pxBlock)			\
+	heap_track_free(pxBlock, BLOCK_SIZE(pxBlock))
+#else /* ! HEAP_TRACK */
+#define track_alloc_hook(...)
+#define track_free_hook(...)
+#endif /* HEAP_TRACK */
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#ifdef DEBUG_HEAP_EXTRA
+#error The guard bytes of DEBUG_HEAP_EXTRA need heap_4
+#endif
+
+#ifdef DEBUG_HEAP
+#define DTRACE wmprintf
+#else /* ! DEBUG_HEAP */
+#define DTRACE(...)
+#endif /* DEBUG_HEAP */
+
+#if portBYTE_ALIGNMENT > 8
+#error heap_tlsf aligns blocks on 8 bytes
+#endif
+
+/* Block sizes are multiples of the granule */
+#define TLSF_GRANULE_LOG2	3
+#define TLSF_GRANULE		(1U << TLSF_GRANULE_LOG2)
+/* Second level lists per first level */
+#define TLSF_SL_LOG2		4
+#define TLSF_SL_COUNT		(1U << TLSF_SL_LOG2)
+/* Below this the first level is 0 and the classes are TLSF_GRANULE wide */
+#define TLSF_FL_SHIFT		(TLSF_SL_LOG2 + TLSF_GRANULE_LOG2)
+#define TLSF_SMALL_SIZE		(1U << TLSF_FL_SHIFT)
+/* Largest block 2^(TLSF_FL_MAX + 1) - 1 bytes, more than all the SRAM */
+#define TLSF_FL_MAX		19
+#define TLSF_FL_COUNT		(TLSF_FL_MAX - TLSF_FL_SHIFT + 2)
+
+/* Memory banks, the main heap and the ones of os_heap_add_bank() */
+#define TLSF_MAX_BANKS		4
+
+#define TLSF_BLOCK_FREE		0x1
+#define TLSF_PREV_FREE		0x2
+#define TLSF_FLAGS		(TLSF_BLOCK_FREE | TLSF_PREV_FREE)
+
+typedef struct tlsf_block {
+	struct tlsf_block *prev_phys;
+	size_t size;
+	/* Free blocks only */
+	struct tlsf_block *next_free;
+	struct tlsf_block *prev_free;
+} __attribute__((__may_alias__)) tlsf_block_t;
+
+/* What an allocated block gives away to its header */
+#define heapSTRUCT_SIZE		(2 * sizeof(void *))
+/* A free block has to hold its list links */
+#define heapMINIMUM_BLOCK_SIZE	sizeof(tlsf_block_t)
+
+#define BLOCK_SIZE(_x_)		((_x_)->size & ~TLSF_FLAGS)
+#define NEXT_BLOCK(_x_)		((tlsf_block_t *)((char *)(_x_) + BLOCK_SIZE(_x_)))
+#define IS_FREE_BLOCK(_x_)	((_x_)->size & TLSF_BLOCK_FREE)
+#define IS_LAST_BLOCK(_x_)	(BLOCK_SIZE(NEXT_BLOCK(_x_)) == 0)
+#define BLOCK_PAYLOAD(_x_)	((void *)((char *)(_x_) + heapSTRUCT_SIZE))
+#define PAYLOAD_BLOCK(_p_)	((tlsf_block_t *)((char *)(_p_) - heapSTRUCT_SIZE))
+
+/*
+ * Below variables are linker script variables. In case you have to change
+ * heap parameters like size or start address please do so in your linker
+ * script.
+ */
+extern unsigned _heap_end, _heap_start;
+
+static portBASE_TYPE xHeapHasBeenInitialised = pdFALSE;
+
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[TLSF_FL_COUNT];
+static tlsf_block_t *free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+static struct {
+	char *start;
+	char *end;
+} banks[TLSF_MAX_BANKS];
+static int bank_count;
+
+static size_t xTotalHeapSize;
+static size_t xFreeBytesRemaining;
+
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+static heapAllocatorInfo_t hI;
+#endif // FREERTOS_ENABLE_MALLOC_STATS
+
+static inline int tlsf_fls(size_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+static inline int tlsf_ffs(uint32_t x)
+{
+	return __builtin_ctz(x);
+}
+
+/* Class a block of this size is kept in */
+static inline void mapping_insert(size_t size, int *fl, int *sl)
+{
+	int f;
+
+	if (size < TLSF_SMALL_SIZE) {
+		*fl = 0;
+		*sl = size >> TLSF_GRANULE_LOG2;
+		return;
+	}
+	f = tlsf_fls(size);
+	*sl = (size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+	*fl = f - TLSF_FL_SHIFT + 1;
+}
+
+/* Smallest class whose blocks are all at least this size */
+static inline void mapping_search(size_t size, int *fl, int *sl)
+{
+	if (size >= TLSF_SMALL_SIZE)
+		size += (1U << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1;
+	mapping_insert(size, fl, sl);
+}
+
+/* First block of the class, or of the next class that has one */
+static inline tlsf_block_t *search_suitable_block(int *fl, int *sl)
+{
+	uint32_t sl_map, fl_map;
+
+	if (*fl >= TLSF_FL_COUNT)
+		return NULL;
+
+	sl_map = sl_bitmap[*fl] & (~0U << *sl);
+	if (!sl_map) {
+		fl_map = *fl + 1 < 32 ? fl_bitmap & (~0U << (*fl + 1)) : 0;
+		if (!fl_map)
+			return NULL;
+		*fl = tlsf_ffs(fl_map);
+		sl_map = sl_bitmap[*fl];
+	}
+	*sl = tlsf_ffs(sl_map);
+	return free_lists[*fl][*sl];
+}
+
+static inline void remove_free_block(tlsf_block_t *b, int fl, int sl)
+{
+	if (b->next_free)
+		b->next_free->prev_free = b->prev_free;
+	if (b->prev_free) {
+		b->prev_free->next_free = b->next_free;
+	} else {
+		free_lists[fl][sl] = b->next_free;
+		if (!b->next_free) {
+			sl_bitmap[fl] &= ~(1U << sl);
+			if (!sl_bitmap[fl])
+				fl_bitmap &= ~(1U << fl);
+		}
+	}
+}
+
+static inline void unlink_block(tlsf_block_t *b)
+{
+	int fl, sl;
+
+	mapping_insert(BLOCK_SIZE(b), &fl, &sl);
+	remove_free_block(b, fl, sl);
+}
+
+/* Mark the block free and put it at the head of its class */
+static inline void insert_free_block(tlsf_block_t *b)
+{
+	int fl, sl;
+
+	mapping_insert(BLOCK_SIZE(b), &fl, &sl);
+	b->size |= TLSF_BLOCK_FREE;
+	NEXT_BLOCK(b)->size |= TLSF_PREV_FREE;
+	b->prev_free = NULL;
+	b->next_free = free_lists[fl][sl];
+	if (b->next_free)
+		b->next_free->prev_free = b;
+	free_lists[fl][sl] = b;
+	fl_bitmap |= 1U << fl;
+	sl_bitmap[fl] |= 1U << sl;
+}
+
+/* Cut the block to size, the rest becomes a free block merged with a free
+ * block behind it. The block is not in a free list */
+static void trim_block(tlsf_block_t *b, size_t size)
+{
+	tlsf_block_t *rest, *next;
+
+	if (BLOCK_SIZE(b) - size < heapMINIMUM_BLOCK_SIZE)
+		return;
+
+	rest = (tlsf_block_t *)((char *)b + size);
+	rest->size = BLOCK_SIZE(b) - size;
+	rest->prev_phys = b;
+	b->size = size | (b->size & TLSF_FLAGS);
+
+	next = NEXT_BLOCK(rest);
+	if (IS_FREE_BLOCK(next)) {
+		unlink_block(next);
+		rest->size += BLOCK_SIZE(next);
+		next = NEXT_BLOCK(rest);
+	}
+	next->prev_phys = rest;
+	insert_free_block(rest);
+}
+
+/* Take the block out of the free lists and mark it allocated */
+static void use_block(tlsf_block_t *b)
+{
+	b->size &= ~TLSF_BLOCK_FREE;
+	NEXT_BLOCK(b)->size &= ~TLSF_PREV_FREE;
+}
+
+/* Size of the block for a request, 0 if it can never be served */
+static size_t adjust_size(size_t xWantedSize)
+{
+	size_t size;
+
+	if (!xWantedSize || xWantedSize >= (1U << TLSF_FL_MAX))
+		return 0;
+
+	size = (xWantedSize + heapSTRUCT_SIZE + TLSF_GRANULE - 1) &
+		~(TLSF_GRANULE - 1);
+	if (size < heapMINIMUM_BLOCK_SIZE)
+		size = heapMINIMUM_BLOCK_SIZE;
+	return size;
+}
+
+/* Make a bank of free memory, with the scheduler suspended */
+static int prvHeapAddBank(char *start, size_t size)
+{
+	tlsf_block_t *b, *sentinel;
+	int i;
+
+	if ((unsigned long)start & (TLSF_GRANULE - 1)) {
+		size_t skip = TLSF_GRANULE -
+			((unsigned long)start & (TLSF_GRANULE - 1));
+		if (size <= skip)
+			return pdFAIL;
+		start += skip;
+		size -= skip;
+	}
+	size &= ~(TLSF_GRANULE - 1);
+	if (size >= (1U << (TLSF_FL_MAX + 1)))
+		size = (1U << (TLSF_FL_MAX + 1)) - TLSF_GRANULE;
+
+	if (bank_count == TLSF_MAX_BANKS ||
+	    size < heapMINIMUM_BLOCK_SIZE + heapSTRUCT_SIZE)
+		return pdFAIL;
+	for (i = 0; i < bank_count; i++) {
+		if (start < banks[i].end && start + size > banks[i].start) {
+			DTRACE("Bank %p overlaps the heap\r\n", start);
+			return pdFAIL;
+		}
+	}
+	banks[bank_count].start = start;
+	banks[bank_count].end = start + size;
+	bank_count++;
+
+	memset(start, 0x00, size);
+
+	b = (tlsf_block_t *)start;
+	b->prev_phys = NULL;
+	b->size = size - heapSTRUCT_SIZE;
+	sentinel = NEXT_BLOCK(b);
+	sentinel->prev_phys = b;
+	sentinel->size = 0;
+	insert_free_block(b);
+
+	xTotalHeapSize += BLOCK_SIZE(b);
+	xFreeBytesRemaining += BLOCK_SIZE(b);
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+	hI.heapSize += BLOCK_SIZE(b);
+#endif // FREERTOS_ENABLE_MALLOC_STATS
+	return pdPASS;
+}
+
+#define WMSDK_HEAP_START_ADDR (char *)&_heap_start
+#define WMSDK_HEAP_SIZE ((unsigned)&_heap_end - (unsigned)&_heap_start)
+
+static void prvHeapInit()
+{
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+	memset(&hI, 0x00, sizeof(heapAllocatorInfo_t));
+	hI.minOverheadPerAllocation = heapSTRUCT_SIZE;
+#endif /* FREERTOS_ENABLE_MALLOC_STATS */
+
+	prvHeapAddBank(WMSDK_HEAP_START_ADDR, WMSDK_HEAP_SIZE);
+	xHeapHasBeenInitialised = pdTRUE;
+}
+
+int prvHeapAddMemBank(char *chunk_start, size_t size)
+{
+	int ret;
+
+	vTaskSuspendAll();
+	if (xHeapHasBeenInitialised == pdFALSE)
+		prvHeapInit();
+	ret = prvHeapAddBank(chunk_start, size);
+	xTaskResumeAll();
+	return ret;
+}
+
+/* With the scheduler suspended */
+static tlsf_block_t *prvAllocBlock(size_t size)
+{
+	tlsf_block_t *b;
+	int fl, sl;
+
+	mapping_search(size, &fl, &sl);
+	b = search_suitable_block(&fl, &sl);
+	if (!b)
+		return NULL;
+
+	remove_free_block(b, fl, sl);
+	use_block(b);
+	trim_block(b, size);
+	xFreeBytesRemaining -= BLOCK_SIZE(b);
+	return b;
+}
+
+/* With the scheduler suspended */
+static void prvFreeBlock(tlsf_block_t *b)
+{
+	tlsf_block_t *next;
+
+	xFreeBytesRemaining += BLOCK_SIZE(b);
+
+	if (b->size & TLSF_PREV_FREE) {
+		tlsf_block_t *prev = b->prev_phys;
+
+		unlink_block(prev);
+		prev->size += BLOCK_SIZE(b);
+		b = prev;
+	}
+	next = NEXT_BLOCK(b);
+	if (IS_FREE_BLOCK(next)) {
+		unlink_block(next);
+		b->size += BLOCK_SIZE(next);
+		next = NEXT_BLOCK(b);
+	}
+	next->prev_phys = b;
+	insert_free_block(b);
+}
+
+static void prvAllocDone(void *pvReturn, size_t xWantedSize)
+{
+	if (pvReturn == NULL) {
+		DTRACE("Heap allocation failed.\n\r"
+		       "Requested: %d\n\r"
+		       "Available : %d\n\r", xWantedSize, xFreeBytesRemaining);
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+		hI.failedAllocations++;
+#endif /* FREERTOS_ENABLE_MALLOC_STATS */
+#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+#endif
+		return;
+	}
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+	if ((xTotalHeapSize - xFreeBytesRemaining) > hI.peakHeapUsage)
+		hI.peakHeapUsage = xTotalHeapSize - xFreeBytesRemaining;
+#endif
+}
+
+/* pvCaller is who the allocation is for, pvPortReAlloc() passes its own
+caller */
+static void *prvMalloc(size_t xWantedSize, void *pvCaller)
+{
+	size_t size = adjust_size(xWantedSize);
+	tlsf_block_t *b = NULL;
+
+	if (!xWantedSize)
+		return NULL;
+
+	vTaskSuspendAll();
+	if (xHeapHasBeenInitialised == pdFALSE)
+		prvHeapInit();
+	if (size)
+		b = prvAllocBlock(size);
+	if (b) {
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+		hI.totalAllocations++;
+#endif // FREERTOS_ENABLE_MALLOC_STATS
+		track_alloc_hook(b, pvCaller);
+	}
+	xTaskResumeAll();
+
+	prvAllocDone(b ? BLOCK_PAYLOAD(b) : NULL, xWantedSize);
+	return b ? BLOCK_PAYLOAD(b) : NULL;
+}
+
+void *pvPortMalloc(size_t xWantedSize)
+{
+	return prvMalloc(xWantedSize, __builtin_return_address(0));
+}
+/*-----------------------------------------------------------*/
+
+void vPortFree(void *pv)
+{
+	tlsf_block_t *b;
+
+	if (!pv)
+		return;
+	b = PAYLOAD_BLOCK(pv);
+
+	vTaskSuspendAll();
+	track_free_hook(b);
+	prvFreeBlock(b);
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+	hI.totalAllocations--;
+#endif // FREERTOS_ENABLE_MALLOC_STATS
+	xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+/* Grown into the free block behind it or shrunk in place when possible, as
+ * heap_4 otherwise */
+void *pvPortReAlloc(void *pv, size_t xWantedSize)
+{
+	void *caller = __builtin_return_address(0);
+	size_t size = adjust_size(xWantedSize);
+	tlsf_block_t *b, *next;
+	size_t old;
+	void *pvNew;
+
+	if (!pv)
+		return xWantedSize ? prvMalloc(xWantedSize, caller) : NULL;
+	if (!xWantedSize) {
+		vPortFree(pv);
+		return NULL;
+	}
+	if (!size) {
+		prvAllocDone(NULL, xWantedSize);
+		return NULL;
+	}
+
+	b = PAYLOAD_BLOCK(pv);
+	vTaskSuspendAll();
+	old = BLOCK_SIZE(b);
+	next = NEXT_BLOCK(b);
+	if (size <= old ||
+	    (IS_FREE_BLOCK(next) && size <= old + BLOCK_SIZE(next))) {
+		track_free_hook(b);
+		if (size > old) {
+			unlink_block(next);
+			b->size += BLOCK_SIZE(next);
+			use_block(b);
+			NEXT_BLOCK(b)->prev_phys = b;
+		}
+		trim_block(b, size);
+		xFreeBytesRemaining -= BLOCK_SIZE(b);
+		xFreeBytesRemaining += old;
+		track_alloc_hook(b, caller);
+		xTaskResumeAll();
+		prvAllocDone(pv, xWantedSize);
+		return pv;
+	}
+	xTaskResumeAll();
+
+	pvNew = prvMalloc(xWantedSize, caller);
+	if (!pvNew)
+		return NULL;
+	memcpy(pvNew, pv, old - heapSTRUCT_SIZE);
+	vPortFree(pv);
+	return pvNew;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize(void)
+{
+	return xFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+void vPortInitialiseBlocks(void)
+{
+	/* This just exists to keep the linker quiet. */
+}
+
+#ifdef FREERTOS_ENABLE_MALLOC_STATS
+/* The biggest block is in the highest class that has one, its list is
+ * walked */
+size_t vPortBiggestFreeBlockSize()
+{
+	tlsf_block_t *b;
+	size_t biggest = 0;
+	int fl;
+
+	vTaskSuspendAll();
+	if (fl_bitmap) {
+		fl = tlsf_fls(fl_bitmap);
+		b = free_lists[fl][tlsf_fls(sl_bitmap[fl])];
+		for (; b; b = b->next_free)
+			if (BLOCK_SIZE(b) > biggest)
+				biggest = BLOCK_SIZE(b);
+	}
+	xTaskResumeAll();
+	return biggest;
+}
+
+const heapAllocatorInfo_t *getheapAllocInfo()
+{
+	/* Fill up remaining members */
+	hI.freeSize = xFreeBytesRemaining;
+	hI.biggestFreeBlockAvailable = vPortBiggestFreeBlockSize();
+	return &hI;
+}
+#endif // FREERTOS_ENABLE_MALLOC_STATS
+
+/* Walks the blocks of every bank, checking that the sizes add up, that the
+ * free flags agree with the neighbours and that every free block is in the
+ * list of its class */
+int vHeapSelfTest(int trace)
+{
+	tlsf_block_t *b, *prev, *it;
+	size_t total = 0, free = 0;
+	int i, fl, sl, ret = 0;
+
+	for (i = 0; i < bank_count; i++) {
+		prev = NULL;
+		for (b = (tlsf_block_t *)banks[i].start; BLOCK_SIZE(b);
+		     prev = b, b = NEXT_BLOCK(b)) {
+			if (trace) {
+				DTRACE("HST%11x%11x%11d%11c\n\r", b,
+				       b->prev_phys, BLOCK_SIZE(b),
+				       IS_FREE_BLOCK(b) ? 'F' : 'A');
+			}
+			if ((char *)NEXT_BLOCK(b) > banks[i].end ||
+			    b->prev_phys != prev ||
+			    !(b->size & TLSF_PREV_FREE) !=
+			    !(prev && IS_FREE_BLOCK(prev))) {
+				DTRACE("Unknown fault: bad block %p\n\r", b);
+				return 1;
+			}
+			total += BLOCK_SIZE(b);
+			if (!IS_FREE_BLOCK(b))
+				continue;
+			free += BLOCK_SIZE(b);
+			mapping_insert(BLOCK_SIZE(b), &fl, &sl);
+			for (it = free_lists[fl][sl]; it && it != b;
+			     it = it->next_free)
+				;
+			if (!it)
+				ret = 1;
+		}
+	}
+	if (total != xTotalHeapSize || free != xFreeBytesRemaining)
+		ret = 1;
+	return ret;
+}
@@ -0,0 +1,222 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Call site accounting of heap_4, see heap_track.h.
+ *
+ * The hooks run with the scheduler suspended, like the allocator they are
+ * called from, so the tables need no other locking. The live allocations
+ * are in an open addressing hash table keyed by the block address, the
+ * call sites in another one keyed by the caller.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <string.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <heap_track.h>
+
+#if (HEAP_TRACK_SITES & (HEAP_TRACK_SITES - 1)) || \
+	(HEAP_TRACK_BLOCKS & (HEAP_TRACK_BLOCKS - 1))
+#error HEAP_TRACK_SITES and HEAP_TRACK_BLOCKS must be powers of 2
+#endif
+
+/* Entry of the sites beyond the table, site 0 is never hashed to */
+#define SITE_OTHER 0
+
+/* Command table entry of the cli in libwmsdk */
+struct cli_command {
+	const char *name;
+	const char *help;
+	void (*function) (int argc, char **argv);
+};
+
+int cli_register_commands(const struct cli_command *commands,
+			  int num_commands);
+
+struct track_site {
+	void *caller;
+	uint32_t live_bytes;
+	uint32_t peak_bytes;
+	uint32_t live;
+	uint32_t allocs;
+	uint32_t frees;
+	/* Sum of the lifetimes of the freed allocations */
+	uint32_t life_ticks;
+};
+
+struct track_block {
+	void *block;		/* NULL when the entry is free */
+	uint16_t site;
+	uint32_t tick;
+};
+
+static struct track_site track_sites[HEAP_TRACK_SITES];
+static struct track_block track_blocks[HEAP_TRACK_BLOCKS];
+static unsigned track_live;
+static unsigned track_untracked;
+static TickType_t track_since;
+
+static unsigned track_hash(void *p, unsigned mask)
+{
+	/* Blocks and code are at least 4 byte aligned */
+	return (((uint32_t) p >> 2) * 2654435761u) & mask;
+}
+
+static unsigned track_site_get(void *caller)
+{
+	unsigned i, n;
+
+	i = track_hash(caller, HEAP_TRACK_SITES - 1);
+	for (n = 0; n < HEAP_TRACK_SITES; n++) {
+		if (i != SITE_OTHER) {
+			if (track_sites[i].caller == caller)
+				return i;
+			if (!track_sites[i].caller) {
+				track_sites[i].caller = caller;
+				return i;
+			}
+		}
+		i = (i + 1) & (HEAP_TRACK_SITES - 1);
+	}
+	return SITE_OTHER;
+}
+
+void heap_track_alloc(void *block, unsigned size, void *caller)
+{
+	struct track_site *s = &track_sites[track_site_get(caller)];
+	unsigned i;
+
+	s->allocs++;
+	/* One entry stays free so that the searches end */
+	if (track_live == HEAP_TRACK_BLOCKS - 1) {
+		track_untracked++;
+		return;
+	}
+
+	i = track_hash(block, HEAP_TRACK_BLOCKS - 1);
+	while (track_blocks[i].block)
+		i = (i + 1) & (HEAP_TRACK_BLOCKS - 1);
+	track_blocks[i].block = block;
+	track_blocks[i].site = s - track_sites;
+	track_blocks[i].tick = xTaskGetTickCount();
+	track_live++;
+
+	s->live++;
+	s->live_bytes += size;
+	if (s->live_bytes > s->peak_bytes)
+		s->peak_bytes = s->live_bytes;
+}
+
+void heap_track_free(void *block, unsigned size)
+{
+	struct track_site *s;
+	unsigned i, j, k;
+
+	i = track_hash(block, HEAP_TRACK_BLOCKS - 1);
+	while (track_blocks[i].block != block) {
+		if (!track_blocks[i].block)
+			return;
+		i = (i + 1) & (HEAP_TRACK_BLOCKS - 1);
+	}
+
+	s = &track_sites[track_blocks[i].site];
+	s->frees++;
+	s->live--;
+	s->live_bytes -= size;
+	s->life_ticks += xTaskGetTickCount() - track_blocks[i].tick;
+	track_live--;
+
+	/* Move back the entries of the probe sequence past the hole */
+	j = i;
+	for (;;) {
+		j = (j + 1) & (HEAP_TRACK_BLOCKS - 1);
+		if (!track_blocks[j].block)
+			break;
+		k = track_hash(track_blocks[j].block, HEAP_TRACK_BLOCKS - 1);
+		if ((j > i && (k <= i || k > j)) ||
+		    (j < i && k <= i && k > j)) {
+			track_blocks[i] = track_blocks[j];
+			i = j;
+		}
+	}
+	track_blocks[i].block = NULL;
+}
+
+void heap_track_reset(void)
+{
+	vTaskSuspendAll();
+	memset(track_sites, 0, sizeof(track_sites));
+	memset(track_blocks, 0, sizeof(track_blocks));
+	track_live = 0;
+	track_untracked = 0;
+	track_since = xTaskGetTickCount();
+	xTaskResumeAll();
+}
+
+void heap_track_dump(void)
+{
+	uint16_t order[HEAP_TRACK_SITES];
+	uint32_t secs, bytes = 0;
+	unsigned i, j, n = 0;
+
+	/* Sites by live bytes, the most first */
+	for (i = 0; i < HEAP_TRACK_SITES; i++) {
+		if (!track_sites[i].allocs)
+			continue;
+		for (j = n; j > 0 && track_sites[order[j - 1]].live_bytes <
+			     track_sites[i].live_bytes; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+		n++;
+		bytes += track_sites[i].live_bytes;
+	}
+
+	secs = (xTaskGetTickCount() - track_since) / configTICK_RATE_HZ;
+	wmprintf("heap-track %u s: %u bytes in %u allocations, %u untracked\r\n",
+		 secs, bytes, track_live, track_untracked);
+	wmprintf("%10s %8s %8s %6s %8s %8s %10s\r\n", "caller", "live B",
+		 "peak B", "live", "allocs", "alloc/s", "avg life");
+	for (i = 0; i < n; i++) {
+		struct track_site *s = &track_sites[order[i]];
+
+		if (order[i] == SITE_OTHER)
+			wmprintf("%10s ", "other");
+		else
+			wmprintf("0x%08x ", (uint32_t) s->caller & ~1);
+		wmprintf("%8u %8u %6u %8u %8u ", s->live_bytes, s->peak_bytes,
+			 s->live, s->allocs, secs ? s->allocs / secs : s->allocs);
+		if (s->frees)
+			wmprintf("%8u ms\r\n", s->life_ticks / s->frees *
+				 portTICK_PERIOD_MS);
+		else
+			wmprintf("%10s\r\n", "-");
+	}
+}
+
+static void heap_track_cli(int argc, char **argv)
+{
+	if (argc >= 2 && !strcmp(argv[1], "reset"))
+		heap_track_reset();
+	else if (argc == 1)
+		heap_track_dump();
+	else
+		wmprintf("Usage: heap-track [reset]\r\n");
+}
+
+static const struct cli_command heap_track_commands[] = {
+	{"heap-track", "[reset]", heap_track_cli},
+};
+
+int heap_track_cli_init(void)
+{
+	if (cli_register_commands(heap_track_commands,
+				  sizeof(heap_track_commands) /
+				  sizeof(heap_track_commands[0])))
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
@@ -158,12 +158,32 @@ typedef struct QueueDefinition
 		struct QueueDefinition *pxQueueSetContainer;
 	#endif
 
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+		uint8_t ucStaticallyAllocated;	/*< Set to pdTRUE if the caller provided the memory, so vQueueDelete() does not free it. */
+	#endif
+
+	#if ( configUSE_MUTEX_STATS == 1 )
+		const char *pcMutexName;				/*< Set by vQueueSetMutexName(), NULL until then. */
+		struct QueueDefinition *pxNextMutex;	/*< Next in the list of mutexes uxQueueGetMutexStats() walks. */
+		uint32_t ulMutexTakes;					/*< Takes that obtained the mutex. */
+		uint32_t ulMutexContended;				/*< Takes that found the mutex held. */
+		uint32_t ulMutexTimeouts;				/*< Takes that gave up. */
+		uint32_t ulMutexInversions;				/*< Waits on a holder of a lower priority, which inherited the priority of the waiter. */
+		TickType_t xMutexWaitTicks;				/*< Ticks spent blocked on the mutex. */
+		TickType_t xMutexMaxWaitTicks;			/*< Longest time a take was blocked. */
+	#endif
+
 } xQUEUE;
 
 /* The old xQUEUE name is maintained above then typedefed to the new Queue_t
 name below to enable the use of older kernel aware debuggers. */
 typedef xQUEUE Queue_t;
 
+#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+	/* A StaticQueue_t must be able to hold the queue it stands in for. */
+	typedef char prvStaticQueueSizeCheck[ ( sizeof( StaticQueue_t ) >= sizeof( Queue_t ) ) ? 1 : -1 ];
+#endif
+
 /*-----------------------------------------------------------*/
 
 /* Marvell Added Function */
@@ -244,6 +264,17 @@ static void prvCopyDataFromQueue( Queue_t * const pxQueue, void * const pvBuffer
 	static BaseType_t prvNotifyQueueSetContainer( const Queue_t * const pxQueue, const BaseType_t xCopyPosition ) PRIVILEGED_FUNCTION;
 #endif
 
+#if ( configUSE_MUTEX_STATS == 1 )
+	/*
+	 * Adds the time a take of a mutex spent since it first blocked to the
+	 * wait counts of the mutex.  Called from a critical section.
+	 */
+	static void prvMutexWaited( Queue_t * const pxQueue, const TimeOut_t * const pxTimeOut ) PRIVILEGED_FUNCTION;
+
+	/* The mutexes created, most recent first. */
+	static Queue_t *pxMutexList = NULL;
+#endif
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -318,7 +349,11 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 }
 /*-----------------------------------------------------------*/
 
-QueueHandle_t xQueueGenericCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType )
+/*
+ * Creates a queue in the memory given, or allocates the structure and the
+ * storage area together when pxStaticQueue is NULL.
+ */
+static QueueHandle_t prvQueueGenericCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, uint8_t *pucQueueStorage, Queue_t *pxStaticQueue, const uint8_t ucQueueType )
 {
 Queue_t *pxNewQueue;
 size_t xQueueSizeInBytes;
@@ -343,8 +378,18 @@ int8_t *pcAllocatedBuffer;
 		xQueueSizeInBytes = ( size_t ) ( uxQueueLength * uxItemSize ) + ( size_t ) 1; /*lint !e961 MISRA exception as the casts are only redundant for some ports. */
 	}
 
-	/* Allocate the new queue structure and storage area. */
-	pcAllocatedBuffer = ( int8_t * ) pvPortMalloc( sizeof( Queue_t ) + xQueueSizeInBytes );
+	if( pxStaticQueue != NULL )
+	{
+		/* The caller provided the structure, and the storage area unless
+		there is none. */
+		configASSERT( ( uxItemSize == ( UBaseType_t ) 0 ) || ( pucQueueStorage != NULL ) );
+		pcAllocatedBuffer = ( int8_t * ) pxStaticQueue;
+	}
+	else
+	{
+		/* Allocate the new queue structure and storage area. */
+		pcAllocatedBuffer = ( int8_t * ) pvPortMalloc( sizeof( Queue_t ) + xQueueSizeInBytes );
+	}
 
 	if( pcAllocatedBuffer != NULL )
 	{
@@ -362,8 +407,14 @@ int8_t *pcAllocatedBuffer;
 		{
 			/* Jump past the queue structure to find the location of the queue
 			storage area - adding the padding bytes to get a better alignment. */
-			pxNewQueue->pcHead = pcAllocatedBuffer + sizeof( Queue_t );
+			pxNewQueue->pcHead = ( pxStaticQueue != NULL ) ? ( int8_t * ) pucQueueStorage : pcAllocatedBuffer + sizeof( Queue_t );
+		}
+
+		#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+		{
+			pxNewQueue->ucStaticallyAllocated = ( uint8_t ) ( pxStaticQueue != NULL );
 		}
+		#endif /* configSUPPORT_STATIC_ALLOCATION */
 
 		/* Initialise the queue members as described above where the queue type
 		is defined. */
@@ -397,9 +448,27 @@ int8_t *pcAllocatedBuffer;
 }
 /*-----------------------------------------------------------*/
 
+QueueHandle_t xQueueGenericCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType )
+{
+	return prvQueueGenericCreate( uxQueueLength, uxItemSize, NULL, NULL, ucQueueType );
+}
+/*-----------------------------------------------------------*/
+
+#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+	QueueHandle_t xQueueGenericCreateStatic( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, uint8_t *pucQueueStorage, StaticQueue_t *pxStaticQueue, const uint8_t ucQueueType )
+	{
+		configASSERT( pxStaticQueue );
+
+		return prvQueueGenericCreate( uxQueueLength, uxItemSize, pucQueueStorage, ( Queue_t * ) pxStaticQueue, ucQueueType );
+	}
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+/*-----------------------------------------------------------*/
+
 #if ( configUSE_MUTEXES == 1 )
 
-	QueueHandle_t xQueueCreateMutex( const uint8_t ucQueueType )
+	static QueueHandle_t prvCreateMutex( const uint8_t ucQueueType, Queue_t *pxStaticQueue )
 	{
 	Queue_t *pxNewQueue;
 
@@ -407,8 +476,8 @@ int8_t *pcAllocatedBuffer;
 		configUSE_TRACE_FACILITY does not equal 1. */
 		( void ) ucQueueType;
 
-		/* Allocate the new queue structure. */
-		pxNewQueue = ( Queue_t * ) pvPortMalloc( sizeof( Queue_t ) );
+		/* Allocate the new queue structure, unless the caller provided it. */
+		pxNewQueue = ( pxStaticQueue != NULL ) ? pxStaticQueue : ( Queue_t * ) pvPortMalloc( sizeof( Queue_t ) );
 		if( pxNewQueue != NULL )
 		{
 			/* Information required for priority inheritance. */
@@ -441,6 +510,31 @@ int8_t *pcAllocatedBuffer;
 			}
 			#endif
 
+			#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+			{
+				pxNewQueue->ucStaticallyAllocated = ( uint8_t ) ( pxStaticQueue != NULL );
+			}
+			#endif
+
+			#if ( configUSE_MUTEX_STATS == 1 )
+			{
+				pxNewQueue->pcMutexName = NULL;
+				pxNewQueue->ulMutexTakes = 0U;
+				pxNewQueue->ulMutexContended = 0U;
+				pxNewQueue->ulMutexTimeouts = 0U;
+				pxNewQueue->ulMutexInversions = 0U;
+				pxNewQueue->xMutexWaitTicks = ( TickType_t ) 0U;
+				pxNewQueue->xMutexMaxWaitTicks = ( TickType_t ) 0U;
+
+				taskENTER_CRITICAL();
+				{
+					pxNewQueue->pxNextMutex = pxMutexList;
+					pxMutexList = pxNewQueue;
+				}
+				taskEXIT_CRITICAL();
+			}
+			#endif /* configUSE_MUTEX_STATS */
+
 			/* Ensure the event queues start with the correct state. */
 			vListInitialise( &( pxNewQueue->xTasksWaitingToSend ) );
 			vListInitialise( &( pxNewQueue->xTasksWaitingToReceive ) );
@@ -458,6 +552,24 @@ int8_t *pcAllocatedBuffer;
 		configASSERT( pxNewQueue );
 		return pxNewQueue;
 	}
+/*-----------------------------------------------------------*/
+
+	QueueHandle_t xQueueCreateMutex( const uint8_t ucQueueType )
+	{
+		return prvCreateMutex( ucQueueType, NULL );
+	}
+/*-----------------------------------------------------------*/
+
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+		QueueHandle_t xQueueCreateMutexStatic( const uint8_t ucQueueType, StaticQueue_t *pxStaticQueue )
+		{
+			configASSERT( pxStaticQueue );
+
+			return prvCreateMutex( ucQueueType, ( Queue_t * ) pxStaticQueue );
+		}
+
+	#endif /* configSUPPORT_STATIC_ALLOCATION */
 
 #endif /* configUSE_MUTEXES */
 /*-----------------------------------------------------------*/
@@ -591,14 +703,14 @@ int8_t *pcAllocatedBuffer;
 
 #if ( configUSE_COUNTING_SEMAPHORES == 1 )
 
-	QueueHandle_t xQueueCreateCountingSemaphore( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount )
+	static QueueHandle_t prvCreateCountingSemaphore( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount, Queue_t *pxStaticQueue )
 	{
 	QueueHandle_t xHandle;
 
 		configASSERT( uxMaxCount != 0 );
 		configASSERT( uxInitialCount <= uxMaxCount );
 
-		xHandle = xQueueGenericCreate( uxMaxCount, queueSEMAPHORE_QUEUE_ITEM_LENGTH, queueQUEUE_TYPE_COUNTING_SEMAPHORE );
+		xHandle = prvQueueGenericCreate( uxMaxCount, queueSEMAPHORE_QUEUE_ITEM_LENGTH, NULL, pxStaticQueue, queueQUEUE_TYPE_COUNTING_SEMAPHORE );
 
 		if( xHandle != NULL )
 		{
@@ -614,6 +726,24 @@ int8_t *pcAllocatedBuffer;
 		configASSERT( xHandle );
 		return xHandle;
 	}
+/*-----------------------------------------------------------*/
+
+	QueueHandle_t xQueueCreateCountingSemaphore( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount )
+	{
+		return prvCreateCountingSemaphore( uxMaxCount, uxInitialCount, NULL );
+	}
+/*-----------------------------------------------------------*/
+
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+		QueueHandle_t xQueueCreateCountingSemaphoreStatic( const UBaseType_t uxMaxCount, const UBaseType_t uxInitialCount, StaticQueue_t *pxStaticQueue )
+		{
+			configASSERT( pxStaticQueue );
+
+			return prvCreateCountingSemaphore( uxMaxCount, uxInitialCount, ( Queue_t * ) pxStaticQueue );
+		}
+
+	#endif /* configSUPPORT_STATIC_ALLOCATION */
 
 #endif /* configUSE_COUNTING_SEMAPHORES */
 /*-----------------------------------------------------------*/
@@ -1413,6 +1543,16 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 							/* Record the information required to implement
 							priority inheritance should it become necessary. */
 							pxQueue->pxMutexHolder = ( int8_t * ) pvTaskIncrementMutexHeldCount(); /*lint !e961 Cast is not redundant as TaskHandle_t is a typedef. */
+
+							#if ( configUSE_MUTEX_STATS == 1 )
+							{
+								pxQueue->ulMutexTakes++;
+								if( xEntryTimeSet != pdFALSE )
+								{
+									prvMutexWaited( pxQueue, &xTimeOut );
+								}
+							}
+							#endif /* configUSE_MUTEX_STATS */
 						}
 						else
 						{
@@ -1472,6 +1612,21 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 			}
 			else
 			{
+				#if ( configUSE_MUTEX_STATS == 1 )
+				{
+					if( ( pxQueue->uxQueueType == queueQUEUE_IS_MUTEX ) && ( xEntryTimeSet == pdFALSE ) )
+					{
+						/* The first time this take found the mutex held. */
+						pxQueue->ulMutexContended++;
+
+						if( xTicksToWait == ( TickType_t ) 0 )
+						{
+							pxQueue->ulMutexTimeouts++;
+						}
+					}
+				}
+				#endif /* configUSE_MUTEX_STATS */
+
 				if( xTicksToWait == ( TickType_t ) 0 )
 				{
 					/* The queue was empty and no block time is specified (or
@@ -1515,6 +1670,15 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 					{
 						taskENTER_CRITICAL();
 						{
+							#if ( configUSE_MUTEX_STATS == 1 )
+							{
+								if( uxTaskPriorityGet( ( TaskHandle_t ) pxQueue->pxMutexHolder ) < uxTaskPriorityGet( NULL ) )
+								{
+									pxQueue->ulMutexInversions++;
+								}
+							}
+							#endif /* configUSE_MUTEX_STATS */
+
 							vTaskPriorityInherit( ( void * ) pxQueue->pxMutexHolder );
 						}
 						taskEXIT_CRITICAL();
@@ -1548,6 +1712,21 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 		{
 			prvUnlockQueue( pxQueue );
 			( void ) xTaskResumeAll();
+
+			#if ( configUSE_MUTEX_STATS == 1 )
+			{
+				if( pxQueue->uxQueueType == queueQUEUE_IS_MUTEX )
+				{
+					taskENTER_CRITICAL();
+					{
+						pxQueue->ulMutexTimeouts++;
+						prvMutexWaited( pxQueue, &xTimeOut );
+					}
+					taskEXIT_CRITICAL();
+				}
+			}
+			#endif /* configUSE_MUTEX_STATS */
+
 			traceQUEUE_RECEIVE_FAILED( pxQueue );
 			return errQUEUE_EMPTY;
 		}
@@ -1754,6 +1933,39 @@ Queue_t * const pxQueue = ( Queue_t * ) xQueue;
 		vQueueUnregisterQueue( pxQueue );
 	}
 	#endif
+
+	#if ( configUSE_MUTEX_STATS == 1 )
+	{
+	Queue_t **ppxLink;
+
+		if( pxQueue->uxQueueType == queueQUEUE_IS_MUTEX )
+		{
+			taskENTER_CRITICAL();
+			{
+				for( ppxLink = &pxMutexList; *ppxLink != NULL; ppxLink = &( ( *ppxLink )->pxNextMutex ) )
+				{
+					if( *ppxLink == pxQueue )
+					{
+						*ppxLink = pxQueue->pxNextMutex;
+						break;
+					}
+				}
+			}
+			taskEXIT_CRITICAL();
+		}
+	}
+	#endif /* configUSE_MUTEX_STATS */
+
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+	{
+		/* The caller owns the memory of a statically allocated queue. */
+		if( pxQueue->ucStaticallyAllocated != ( uint8_t ) pdFALSE )
+		{
+			return;
+		}
+	}
+	#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 	vPortFree( pxQueue );
 }
 /*-----------------------------------------------------------*/
@@ -2593,6 +2805,81 @@ BaseType_t xReturn;
 	}
 
 #endif /* configUSE_QUEUE_SETS */
+/*-----------------------------------------------------------*/
+
+#if ( configUSE_MUTEX_STATS == 1 )
+
+	static void prvMutexWaited( Queue_t * const pxQueue, const TimeOut_t * const pxTimeOut )
+	{
+	TickType_t xWaited;
+
+		xWaited = xTaskGetTickCount() - pxTimeOut->xTimeOnEntering;
+		pxQueue->xMutexWaitTicks += xWaited;
+
+		if( xWaited > pxQueue->xMutexMaxWaitTicks )
+		{
+			pxQueue->xMutexMaxWaitTicks = xWaited;
+		}
+	}
+/*-----------------------------------------------------------*/
+
+	void vQueueSetMutexName( QueueHandle_t xMutex, const char *pcName ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	{
+	Queue_t * const pxQueue = ( Queue_t * ) xMutex;
+
+		configASSERT( pxQueue );
+		pxQueue->pcMutexName = pcName;
+	}
+/*-----------------------------------------------------------*/
+
+	UBaseType_t uxQueueGetMutexStats( MutexStats_t * const pxStatsArray, const UBaseType_t uxArraySize )
+	{
+	Queue_t *pxQueue;
+	UBaseType_t uxCount = 0;
+
+		taskENTER_CRITICAL();
+		{
+			for( pxQueue = pxMutexList; ( pxQueue != NULL ) && ( uxCount < uxArraySize ); pxQueue = pxQueue->pxNextMutex )
+			{
+				pxStatsArray[ uxCount ].xMutex = pxQueue;
+				pxStatsArray[ uxCount ].pcName = pxQueue->pcMutexName;
+				pxStatsArray[ uxCount ].pvHolder = ( void * ) pxQueue->pxMutexHolder;
+				pxStatsArray[ uxCount ].ulTakes = pxQueue->ulMutexTakes;
+				pxStatsArray[ uxCount ].ulContended = pxQueue->ulMutexContended;
+				pxStatsArray[ uxCount ].ulTimeouts = pxQueue->ulMutexTimeouts;
+				pxStatsArray[ uxCount ].ulInversions = pxQueue->ulMutexInversions;
+				pxStatsArray[ uxCount ].xWaitTicks = pxQueue->xMutexWaitTicks;
+				pxStatsArray[ uxCount ].xMaxWaitTicks = pxQueue->xMutexMaxWaitTicks;
+				uxCount++;
+			}
+		}
+		taskEXIT_CRITICAL();
+
+		return uxCount;
+	}
+/*-----------------------------------------------------------*/
+
+	void vQueueResetMutexStats( void )
+	{
+	Queue_t *pxQueue;
+
+		taskENTER_CRITICAL();
+		{
+			for( pxQueue = pxMutexList; pxQueue != NULL; pxQueue = pxQueue->pxNextMutex )
+			{
+				pxQueue->ulMutexTakes = 0U;
+				pxQueue->ulMutexContended = 0U;
+				pxQueue->ulMutexTimeouts = 0U;
+				pxQueue->ulMutexInversions = 0U;
+				pxQueue->xMutexWaitTicks = ( TickType_t ) 0U;
+				pxQueue->xMutexMaxWaitTicks = ( TickType_t ) 0U;
+			}
+		}
+		taskEXIT_CRITICAL();
+	}
+
+#endif /* configUSE_MUTEX_STATS */
+
 
 
 
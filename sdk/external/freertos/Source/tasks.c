@@ -170,6 +170,8 @@ typedef struct tskTaskControlBlock
 
 	#if ( configGENERATE_RUN_TIME_STATS == 1 )
 		uint32_t		ulRunTimeCounter;	/*< Stores the amount of time the task has spent in the Running state. */
+		uint32_t		ulSwitchInCount;	/*< Number of times the task was switched in. */
+		uint32_t		ulMaxRunSlice;		/*< Longest time the task ran before another task was switched in. */
 	#endif
 
 	#if ( configUSE_NEWLIB_REENTRANT == 1 )
@@ -188,12 +190,24 @@ typedef struct tskTaskControlBlock
 		volatile eNotifyValue eNotifyState;
 	#endif
 
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+		uint8_t	ucStaticallyAllocated;	/*< tskSTATIC_STACK and tskSTATIC_TCB bits, memory the kernel must not free. */
+	#endif
+
 } tskTCB;
 
 /* The old tskTCB name is maintained above then typedefed to the new TCB_t name
 below to enable the use of older kernel aware debuggers. */
 typedef tskTCB TCB_t;
 
+#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+	#define tskSTATIC_STACK		( ( uint8_t ) 1U )
+	#define tskSTATIC_TCB		( ( uint8_t ) 2U )
+
+	/* A StaticTask_t must be able to hold the TCB it stands in for. */
+	typedef char prvStaticTaskSizeCheck[ ( sizeof( StaticTask_t ) >= sizeof( TCB_t ) ) ? 1 : -1 ];
+#endif
+
 /*
  * Some kernel aware debuggers require the data the debugger needs access to to
  * be global, rather than file scope.
@@ -261,6 +275,12 @@ PRIVILEGED_DATA static volatile UBaseType_t uxSchedulerSuspended	= ( UBaseType_t
 	PRIVILEGED_DATA static uint32_t ulTotalRunTime = 0UL;		/*< Holds the total amount of execution time as defined by the run time counter clock. */
 	/* Marvell added function */
 	static void prvResetRunTimeStatsForTasksInList( xList *pxList );
+
+	PRIVILEGED_DATA static uint32_t ulTaskSliceStartTime = 0UL;	/*< Run time counter value when the running task was switched in from another task. */
+	PRIVILEGED_DATA static uint32_t ulISRRunTime = 0UL;		/*< Time spent in interrupts bracketed by vTaskRunTimeISREnter/Exit. */
+	PRIVILEGED_DATA static uint32_t ulISRCount = 0UL;			/*< Number of those interrupts. */
+	PRIVILEGED_DATA static uint32_t ulISRNesting = 0UL;
+	PRIVILEGED_DATA static uint32_t ulISREnterTime = 0UL;
 
 #endif
 
@@ -508,7 +528,13 @@ static void prvAddCurrentTaskToDelayedList( const TickType_t xTimeToWake ) PRIVI
  * Allocates memory from the heap for a TCB and associated stack.  Checks the
  * allocation was successful.
  */
-static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer ) PRIVILEGED_FUNCTION;
+static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer, TCB_t * const pxTCBBuffer ) PRIVILEGED_FUNCTION;
+
+/*
+ * Creates a task, in the TCB buffer if one is given and allocating the TCB
+ * otherwise.  xTaskGenericCreate() and xTaskCreateStatic() call it.
+ */
+static BaseType_t prvTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions, TCB_t * const pxTCBBuffer ) PRIVILEGED_FUNCTION; /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 
 /*
  * Fills an TaskStatus_t structure with information on each task that is
@@ -567,7 +593,7 @@ static void prvResetNextTaskUnblockTime( void );
 #endif
 /*-----------------------------------------------------------*/
 
-BaseType_t xTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+static BaseType_t prvTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions, TCB_t * const pxTCBBuffer ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 {
 BaseType_t xReturn;
 TCB_t * pxNewTCB;
@@ -578,7 +604,7 @@ StackType_t *pxTopOfStack;
 
 	/* Allocate the memory required by the TCB and stack for the new task,
 	checking that the allocation was successful. */
-	pxNewTCB = prvAllocateTCBAndStack( usStackDepth, puxStackBuffer );
+	pxNewTCB = prvAllocateTCBAndStack( usStackDepth, puxStackBuffer, pxTCBBuffer );
 
 	if( pxNewTCB != NULL )
 	{
@@ -758,6 +784,25 @@ StackType_t *pxTopOfStack;
 }
 /*-----------------------------------------------------------*/
 
+BaseType_t xTaskGenericCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, const MemoryRegion_t * const xRegions ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+{
+	return prvTaskGenericCreate( pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, puxStackBuffer, xRegions, NULL );
+}
+/*-----------------------------------------------------------*/
+
+#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+	BaseType_t xTaskCreateStatic( TaskFunction_t pxTaskCode, const char * const pcName, const uint16_t usStackDepth, void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask, StackType_t * const puxStackBuffer, StaticTask_t * const pxTaskBuffer ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	{
+		configASSERT( puxStackBuffer );
+		configASSERT( pxTaskBuffer );
+
+		return prvTaskGenericCreate( pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, puxStackBuffer, NULL, ( TCB_t * ) pxTaskBuffer );
+	}
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+/*-----------------------------------------------------------*/
+
 #if ( INCLUDE_vTaskDelete == 1 )
 
 	void vTaskDelete( TaskHandle_t xTaskToDelete )
@@ -1577,6 +1622,24 @@ StackType_t *pxTopOfStack;
 #endif /* ( ( INCLUDE_xTaskResumeFromISR == 1 ) && ( INCLUDE_vTaskSuspend == 1 ) ) */
 /*-----------------------------------------------------------*/
 
+static BaseType_t prvCreateIdleTask( TaskHandle_t * const pxCreatedTask )
+{
+	#if ( configSUPPORT_STATIC_ALLOCATION == 1 )
+	{
+	/* The idle task always exists, it is kept out of the heap. */
+	static StackType_t uxIdleTaskStack[ tskIDLE_STACK_SIZE ];
+	static StaticTask_t xIdleTaskTCB;
+
+		return xTaskCreateStatic( prvIdleTask, "IDLE", tskIDLE_STACK_SIZE, ( void * ) NULL, ( tskIDLE_PRIORITY | portPRIVILEGE_BIT ), pxCreatedTask, uxIdleTaskStack, &xIdleTaskTCB ); /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
+	}
+	#else
+	{
+		return xTaskCreate( prvIdleTask, "IDLE", tskIDLE_STACK_SIZE, ( void * ) NULL, ( tskIDLE_PRIORITY | portPRIVILEGE_BIT ), pxCreatedTask ); /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
+	}
+	#endif /* configSUPPORT_STATIC_ALLOCATION */
+}
+/*-----------------------------------------------------------*/
+
 void vTaskStartScheduler( void )
 {
 BaseType_t xReturn;
@@ -1586,12 +1649,12 @@ BaseType_t xReturn;
 	{
 		/* Create the idle task, storing its handle in xIdleTaskHandle so it can
 		be returned by the xTaskGetIdleTaskHandle() function. */
-		xReturn = xTaskCreate( prvIdleTask, "IDLE", tskIDLE_STACK_SIZE, ( void * ) NULL, ( tskIDLE_PRIORITY | portPRIVILEGE_BIT ), &xIdleTaskHandle ); /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
+		xReturn = prvCreateIdleTask( &xIdleTaskHandle ); /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
 	}
 	#else
 	{
 		/* Create the idle task without storing its handle. */
-		xReturn = xTaskCreate( prvIdleTask, "IDLE", tskIDLE_STACK_SIZE, ( void * ) NULL, ( tskIDLE_PRIORITY | portPRIVILEGE_BIT ), NULL );  /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
+		xReturn = prvCreateIdleTask( NULL );  /*lint !e961 MISRA exception, justified as it is not a redundant explicit cast to all supported compilers. */
 	}
 	#endif /* INCLUDE_xTaskGetIdleTaskHandle */
 
@@ -1633,6 +1696,10 @@ BaseType_t xReturn;
 		the run time counter time base. */
 		portCONFIGURE_TIMER_FOR_RUN_TIME_STATS();
 
+		/* Guard the stack of the first task, the following ones get theirs
+		on the context switches. */
+		portSTART_STACK_GUARD( pxCurrentTCB->pxStack );
+
 		/* Setting up the timer tick is hardware specific and thus in the
 		portable interface. */
 		if( xPortStartScheduler() != pdFALSE )
@@ -2308,6 +2375,10 @@ BaseType_t xSwitchRequired = pdFALSE;
 
 void vTaskSwitchContext( void )
 {
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+	TCB_t * const pxPreviousTCB = ( TCB_t * ) pxCurrentTCB;
+#endif
+
 	if( uxSchedulerSuspended != ( UBaseType_t ) pdFALSE )
 	{
 		/* The scheduler is currently suspended - do not allow a context
@@ -2355,6 +2426,25 @@ void vTaskSwitchContext( void )
 		taskSELECT_HIGHEST_PRIORITY_TASK();
 		traceTASK_SWITCHED_IN();
 
+		/* Move the stack guard of the port, if any, to the new task. */
+		portSET_STACK_GUARD( pxCurrentTCB->pxStack );
+
+		#if ( configGENERATE_RUN_TIME_STATS == 1 )
+		{
+			/* A slice ends when another task gets the CPU, not at every
+			scheduling decision that keeps the same task running. */
+			if( pxCurrentTCB != pxPreviousTCB )
+			{
+				if( ( ulTotalRunTime > ulTaskSliceStartTime ) && ( ( ulTotalRunTime - ulTaskSliceStartTime ) > pxPreviousTCB->ulMaxRunSlice ) )
+				{
+					pxPreviousTCB->ulMaxRunSlice = ulTotalRunTime - ulTaskSliceStartTime;
+				}
+				( pxCurrentTCB->ulSwitchInCount )++;
+				ulTaskSliceStartTime = ulTotalRunTime;
+			}
+		}
+		#endif /* configGENERATE_RUN_TIME_STATS */
+
 		#if ( configUSE_NEWLIB_REENTRANT == 1 )
 		{
 			/* Switch Newlib's _impure_ptr variable to point to the _reent
@@ -3128,7 +3218,7 @@ static void prvAddCurrentTaskToDelayedList( const TickType_t xTimeToWake )
 }
 /*-----------------------------------------------------------*/
 
-static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer )
+static TCB_t *prvAllocateTCBAndStack( const uint16_t usStackDepth, StackType_t * const puxStackBuffer, TCB_t * const pxTCBBuffer )
 {
 TCB_t *pxNewTCB;
 
@@ -3137,9 +3227,10 @@ TCB_t *pxNewTCB;
 	the TCB then the stack. */
 	#if( portSTACK_GROWTH > 0 )
 	{
-		/* Allocate space for the TCB.  Where the memory comes from depends on
-		the implementation of the port malloc function. */
-		pxNewTCB = ( TCB_t * ) pvPortMalloc( sizeof( TCB_t ) );
+		/* Allocate space for the TCB, unless the caller provided it.  Where the
+		memory comes from depends on the implementation of the port malloc
+		function. */
+		pxNewTCB = ( pxTCBBuffer != NULL ) ? pxTCBBuffer : ( TCB_t * ) pvPortMalloc( sizeof( TCB_t ) );
 
 		if( pxNewTCB != NULL )
 		{
@@ -3151,7 +3242,10 @@ TCB_t *pxNewTCB;
 			if( pxNewTCB->pxStack == NULL )
 			{
 				/* Could not allocate the stack.  Delete the allocated TCB. */
-				vPortFree( pxNewTCB );
+				if( pxTCBBuffer == NULL )
+				{
+					vPortFree( pxNewTCB );
+				}
 				pxNewTCB = NULL;
 			}
 		}
@@ -3165,9 +3259,10 @@ TCB_t *pxNewTCB;
 
 		if( pxStack != NULL )
 		{
-			/* Allocate space for the TCB.  Where the memory comes from depends
-			on the implementation of the port malloc function. */
-			pxNewTCB = ( TCB_t * ) pvPortMalloc( sizeof( TCB_t ) );
+			/* Allocate space for the TCB, unless the caller provided it.  Where
+			the memory comes from depends on the implementation of the port
+			malloc function. */
+			pxNewTCB = ( pxTCBBuffer != NULL ) ? pxTCBBuffer : ( TCB_t * ) pvPortMalloc( sizeof( TCB_t ) );
 
 			if( pxNewTCB != NULL )
 			{
@@ -3177,8 +3272,11 @@ TCB_t *pxNewTCB;
 			else
 			{
 				/* The stack cannot be used as the TCB was not created.  Free it
-				again. */
-				vPortFree( pxStack );
+				again if it was allocated here. */
+				if( puxStackBuffer == NULL )
+				{
+					vPortFree( pxStack );
+				}
 			}
 		}
 		else
@@ -3190,6 +3288,13 @@ TCB_t *pxNewTCB;
 
 	if( pxNewTCB != NULL )
 	{
+		#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		{
+			/* Remember what prvDeleteTCB() must not free. */
+			pxNewTCB->ucStaticallyAllocated = ( uint8_t ) ( ( ( puxStackBuffer != NULL ) ? tskSTATIC_STACK : 0U ) | ( ( pxTCBBuffer != NULL ) ? tskSTATIC_TCB : 0U ) );
+		}
+		#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 		/* Avoid dependency on memset() if it is not required. */
 		#if( ( configCHECK_FOR_STACK_OVERFLOW > 1 ) || ( configUSE_TRACE_FACILITY == 1 ) || ( INCLUDE_uxTaskGetStackHighWaterMark == 1 ) )
 		{
@@ -3356,7 +3461,20 @@ TCB_t *pxNewTCB;
 		}
 		#endif /* configUSE_NEWLIB_REENTRANT */
 
-		#if( portUSING_MPU_WRAPPERS == 1 )
+		#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		{
+			/* Only free the stack and the TCB the kernel allocated. */
+			if( ( pxTCB->ucStaticallyAllocated & tskSTATIC_STACK ) == 0U )
+			{
+				vPortFreeAligned( pxTCB->pxStack );
+			}
+
+			if( ( pxTCB->ucStaticallyAllocated & tskSTATIC_TCB ) == 0U )
+			{
+				vPortFree( pxTCB );
+			}
+		}
+		#elif( portUSING_MPU_WRAPPERS == 1 )
 		{
 			/* Only free the stack if it was allocated dynamically in the first
 			place. */
@@ -3364,14 +3482,15 @@ TCB_t *pxNewTCB;
 			{
 				vPortFreeAligned( pxTCB->pxStack );
 			}
+
+			vPortFree( pxTCB );
 		}
 		#else
 		{
 			vPortFreeAligned( pxTCB->pxStack );
+			vPortFree( pxTCB );
 		}
 		#endif
-
-		vPortFree( pxTCB );
 	}
 
 #endif /* INCLUDE_vTaskDelete */
@@ -3896,6 +4015,13 @@ TCB_t *pxTCB;
 
 		vTaskSuspendAll();
 		{
+			taskENTER_CRITICAL();
+			{
+				ulISRRunTime = 0UL;
+				ulISRCount = 0UL;
+			}
+			taskEXIT_CRITICAL();
+
 			uxQueue = configMAX_PRIORITIES;
 
 			do
@@ -3951,6 +4077,8 @@ TCB_t *pxTCB;
 			listGET_OWNER_OF_NEXT_ENTRY( pxNextTCB, pxList );
 			/* Reset the counter to zero */
 			pxNextTCB->ulRunTimeCounter = 0;
+			pxNextTCB->ulSwitchInCount = 0;
+			pxNextTCB->ulMaxRunSlice = 0;
 
 		} while( pxNextTCB != pxFirstTCB );
 	}
@@ -3973,6 +4101,92 @@ TickType_t uxReturn;
 }
 /*-----------------------------------------------------------*/
 
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+
+	/* Marvell added functions */
+	void vTaskGetSwitchStats( TaskHandle_t xTask, uint32_t *pulSwitchInCount, uint32_t *pulMaxRunSlice )
+	{
+	TCB_t *pxTCB;
+
+		pxTCB = prvGetTCBFromHandle( xTask );
+
+		taskENTER_CRITICAL();
+		{
+			if( pulSwitchInCount != NULL )
+			{
+				*pulSwitchInCount = pxTCB->ulSwitchInCount;
+			}
+			if( pulMaxRunSlice != NULL )
+			{
+				*pulMaxRunSlice = pxTCB->ulMaxRunSlice;
+			}
+		}
+		taskEXIT_CRITICAL();
+	}
+
+	void vTaskRunTimeISREnter( void )
+	{
+	UBaseType_t uxSavedInterruptStatus;
+
+		uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+		{
+			/* Only the outermost interrupt is timed, nested ones are
+			already part of its time. */
+			if( ulISRNesting++ == 0UL )
+			{
+				#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
+					portALT_GET_RUN_TIME_COUNTER_VALUE( ulISREnterTime );
+				#else
+					ulISREnterTime = portGET_RUN_TIME_COUNTER_VALUE();
+				#endif
+			}
+			ulISRCount++;
+		}
+		portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+	}
+
+	void vTaskRunTimeISRExit( void )
+	{
+	UBaseType_t uxSavedInterruptStatus;
+	uint32_t ulNow;
+
+		uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+		{
+			if( ( ulISRNesting > 0UL ) && ( --ulISRNesting == 0UL ) )
+			{
+				#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
+					portALT_GET_RUN_TIME_COUNTER_VALUE( ulNow );
+				#else
+					ulNow = portGET_RUN_TIME_COUNTER_VALUE();
+				#endif
+				if( ulNow > ulISREnterTime )
+				{
+					ulISRRunTime += ulNow - ulISREnterTime;
+				}
+			}
+		}
+		portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+	}
+
+	void vTaskGetISRRunTime( uint32_t *pulISRRunTime, uint32_t *pulISRCount )
+	{
+		taskENTER_CRITICAL();
+		{
+			if( pulISRRunTime != NULL )
+			{
+				*pulISRRunTime = ulISRRunTime;
+			}
+			if( pulISRCount != NULL )
+			{
+				*pulISRCount = ulISRCount;
+			}
+		}
+		taskEXIT_CRITICAL();
+	}
+
+#endif /* configGENERATE_RUN_TIME_STATS */
+/*-----------------------------------------------------------*/
+
 #if ( configUSE_MUTEXES == 1 )
 
 	void *pvTaskIncrementMutexHeldCount( void )
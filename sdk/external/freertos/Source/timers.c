@@ -109,15 +109,24 @@ typedef struct tmrTimerControl
 	UBaseType_t				uxAutoReload;		/*<< Set to pdTRUE if the timer should be automatically restarted once expired.  Set to pdFALSE if the timer is, in effect, a one-shot timer. */
 	void 					*pvTimerID;			/*<< An ID to identify the timer.  This allows the timer to be identified when the same callback is used for multiple timers. */
 	TimerCallbackFunction_t	pxCallbackFunction;	/*<< The function that will be called when the timer expires. */
+	TickType_t				xTimerSlack;		/*<< How late the timer may expire so that it expires together with others, see vTimerSetSlack(). */
 	#if( configUSE_TRACE_FACILITY == 1 )
 		UBaseType_t			uxTimerNumber;		/*<< An ID assigned by trace tools such as FreeRTOS+Trace */
 	#endif
+	#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+		uint8_t				ucStaticallyAllocated; /*<< Set to pdTRUE if the caller provided the memory, so deleting the timer does not free it. */
+	#endif
 } xTIMER;
 
 /* The old xTIMER name is maintained above then typedefed to the new Timer_t
 name below to enable the use of older kernel aware debuggers. */
 typedef xTIMER Timer_t;
 
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	/* A StaticTimer_t must be able to hold the timer it stands in for. */
+	typedef char prvStaticTimerSizeCheck[ ( sizeof( StaticTimer_t ) >= sizeof( Timer_t ) ) ? 1 : -1 ];
+#endif
+
 /* The definition of messages that can be sent and received on the timer queue.
 Two types of message can be queued - messages that manipulate a software timer,
 and messages that request the execution of a non-timer related callback.  The
@@ -235,6 +244,32 @@ static TickType_t prvGetNextExpireTime( BaseType_t * const pxListWasEmpty ) PRIV
  */
 static void prvProcessTimerOrBlockTask( const TickType_t xNextExpireTime, const BaseType_t xListWasEmpty ) PRIVILEGED_FUNCTION;
 
+/*
+ * The time the timer service task has to wake up at: the earliest time a
+ * timer of the current list expires at plus its slack.  All the timers of an
+ * earlier expiry time are then processed together.  The current list must
+ * not be empty.
+ */
+static TickType_t prvGetCoalescedWakeTime( void ) PRIVILEGED_FUNCTION;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvCreateTimerTask( TaskHandle_t * const pxCreatedTask )
+{
+	#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+	{
+	/* The timer service task always exists, it is kept out of the heap. */
+	static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+	static StaticTask_t xTimerTaskTCB;
+
+		return xTaskCreateStatic( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, pxCreatedTask, uxTimerTaskStack, &xTimerTaskTCB );
+	}
+	#else
+	{
+		return xTaskCreate( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, pxCreatedTask );
+	}
+	#endif /* configSUPPORT_STATIC_ALLOCATION */
+}
 /*-----------------------------------------------------------*/
 
 BaseType_t xTimerCreateTimerTask( void )
@@ -253,12 +288,12 @@ BaseType_t xReturn = pdFAIL;
 		{
 			/* Create the timer task, storing its handle in xTimerTaskHandle so
 			it can be returned by the xTimerGetTimerDaemonTaskHandle() function. */
-			xReturn = xTaskCreate( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, &xTimerTaskHandle );
+			xReturn = prvCreateTimerTask( &xTimerTaskHandle );
 		}
 		#else
 		{
 			/* Create the timer task without storing its handle. */
-			xReturn = xTaskCreate( prvTimerTask, "Tmr Svc", ( uint16_t ) configTIMER_TASK_STACK_DEPTH, NULL, ( ( UBaseType_t ) configTIMER_TASK_PRIORITY ) | portPRIVILEGE_BIT, NULL);
+			xReturn = prvCreateTimerTask( NULL );
 		}
 		#endif
 	}
@@ -272,7 +307,11 @@ BaseType_t xReturn = pdFAIL;
 }
 /*-----------------------------------------------------------*/
 
-TimerHandle_t xTimerCreate( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+/*
+ * Creates a timer in the buffer given, or allocates it when pxTimerBuffer is
+ * NULL.
+ */
+static TimerHandle_t prvTimerCreate( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction, Timer_t *pxTimerBuffer ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
 {
 Timer_t *pxNewTimer;
 
@@ -283,7 +322,7 @@ Timer_t *pxNewTimer;
 	}
 	else
 	{
-		pxNewTimer = ( Timer_t * ) pvPortMalloc( sizeof( Timer_t ) );
+		pxNewTimer = ( pxTimerBuffer != NULL ) ? pxTimerBuffer : ( Timer_t * ) pvPortMalloc( sizeof( Timer_t ) );
 		if( pxNewTimer != NULL )
 		{
 			/* Ensure the infrastructure used by the timer service task has been
@@ -296,8 +335,15 @@ Timer_t *pxNewTimer;
 			pxNewTimer->uxAutoReload = uxAutoReload;
 			pxNewTimer->pvTimerID = pvTimerID;
 			pxNewTimer->pxCallbackFunction = pxCallbackFunction;
+			pxNewTimer->xTimerSlack = ( TickType_t ) 0U;
 			vListInitialiseItem( &( pxNewTimer->xTimerListItem ) );
 
+			#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+			{
+				pxNewTimer->ucStaticallyAllocated = ( uint8_t ) ( pxTimerBuffer != NULL );
+			}
+			#endif
+
 			traceTIMER_CREATE( pxNewTimer );
 		}
 		else
@@ -313,6 +359,24 @@ Timer_t *pxNewTimer;
 }
 /*-----------------------------------------------------------*/
 
+TimerHandle_t xTimerCreate( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+{
+	return prvTimerCreate( pcTimerName, xTimerPeriodInTicks, uxAutoReload, pvTimerID, pxCallbackFunction, NULL );
+}
+/*-----------------------------------------------------------*/
+
+#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+
+	TimerHandle_t xTimerCreateStatic( const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction, StaticTimer_t *pxTimerBuffer ) /*lint !e971 Unqualified char types are allowed for strings and single characters only. */
+	{
+		configASSERT( pxTimerBuffer );
+
+		return prvTimerCreate( pcTimerName, xTimerPeriodInTicks, uxAutoReload, pvTimerID, pxCallbackFunction, ( Timer_t * ) pxTimerBuffer );
+	}
+
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+/*-----------------------------------------------------------*/
+
 BaseType_t xTimerGenericCommand( TimerHandle_t xTimer, const BaseType_t xCommandID, const TickType_t xOptionalValue, BaseType_t * const pxHigherPriorityTaskWoken, const TickType_t xTicksToWait )
 {
 BaseType_t xReturn = pdFAIL;
@@ -468,7 +532,14 @@ BaseType_t xTimerListsWereSwitched;
 				received - whichever comes first.  The following line cannot
 				be reached unless xNextExpireTime > xTimeNow, except in the
 				case when the current timer list is empty. */
-				vQueueWaitForMessageRestricted( xTimerQueue, ( xNextExpireTime - xTimeNow ) );
+				if( xListWasEmpty == pdFALSE )
+				{
+					vQueueWaitForMessageRestricted( xTimerQueue, ( prvGetCoalescedWakeTime() - xTimeNow ) );
+				}
+				else
+				{
+					vQueueWaitForMessageRestricted( xTimerQueue, ( xNextExpireTime - xTimeNow ) );
+				}
 
 				if( xTaskResumeAll() == pdFALSE )
 				{
@@ -492,6 +563,43 @@ BaseType_t xTimerListsWereSwitched;
 }
 /*-----------------------------------------------------------*/
 
+static TickType_t prvGetCoalescedWakeTime( void )
+{
+ListItem_t const *pxItem;
+ListItem_t const * const pxEnd = listGET_END_MARKER( pxCurrentTimerList );
+Timer_t *pxTimer;
+TickType_t xWakeTime = portMAX_DELAY, xExpiry, xLatest;
+
+	/* Only this task changes the lists, they can be walked without a
+	critical section.  The list is in expiry time order, the walk stops at the
+	first timer that expires after the wake time found so far. */
+	for( pxItem = listGET_HEAD_ENTRY( pxCurrentTimerList ); pxItem != pxEnd; pxItem = listGET_NEXT( pxItem ) )
+	{
+		xExpiry = listGET_LIST_ITEM_VALUE( pxItem );
+		if( xExpiry >= xWakeTime )
+		{
+			break;
+		}
+
+		pxTimer = ( Timer_t * ) listGET_LIST_ITEM_OWNER( pxItem );
+		xLatest = xExpiry + pxTimer->xTimerSlack;
+
+		/* The timers left when the tick count overflows expire then. */
+		if( xLatest < xExpiry )
+		{
+			xLatest = portMAX_DELAY;
+		}
+
+		if( xLatest < xWakeTime )
+		{
+			xWakeTime = xLatest;
+		}
+	}
+
+	return xWakeTime;
+}
+/*-----------------------------------------------------------*/
+
 static TickType_t prvGetNextExpireTime( BaseType_t * const pxListWasEmpty )
 {
 TickType_t xNextExpireTime;
@@ -695,8 +803,19 @@ TickType_t xTimeNow;
 
 				case tmrCOMMAND_DELETE :
 					/* The timer has already been removed from the active list,
-					just free up the memory. */
-					vPortFree( pxTimer );
+					just free up the memory, unless the caller owns it. */
+					#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+					{
+						if( pxTimer->ucStaticallyAllocated == ( uint8_t ) pdFALSE )
+						{
+							vPortFree( pxTimer );
+						}
+					}
+					#else
+					{
+						vPortFree( pxTimer );
+					}
+					#endif
 					break;
 
 				default	:
@@ -780,7 +899,20 @@ static void prvCheckForValidListAndQueue( void )
 			vListInitialise( &xActiveTimerList2 );
 			pxCurrentTimerList = &xActiveTimerList1;
 			pxOverflowTimerList = &xActiveTimerList2;
-			xTimerQueue = xQueueCreate( ( UBaseType_t ) configTIMER_QUEUE_LENGTH, sizeof( DaemonTaskMessage_t ) );
+			#if( configSUPPORT_STATIC_ALLOCATION == 1 )
+			{
+			/* The timer command queue always exists, it is kept out of the
+			heap. */
+			static uint8_t ucTimerQueueStorage[ ( size_t ) configTIMER_QUEUE_LENGTH * sizeof( DaemonTaskMessage_t ) ];
+			static StaticQueue_t xTimerQueueBuffer;
+
+				xTimerQueue = xQueueCreateStatic( ( UBaseType_t ) configTIMER_QUEUE_LENGTH, sizeof( DaemonTaskMessage_t ), ucTimerQueueStorage, &xTimerQueueBuffer );
+			}
+			#else
+			{
+				xTimerQueue = xQueueCreate( ( UBaseType_t ) configTIMER_QUEUE_LENGTH, sizeof( DaemonTaskMessage_t ) );
+			}
+			#endif /* configSUPPORT_STATIC_ALLOCATION */
 			configASSERT( xTimerQueue );
 
 			#if ( configQUEUE_REGISTRY_SIZE > 0 )
@@ -824,6 +956,18 @@ Timer_t *pxTimer = ( Timer_t * ) xTimer;
 } /*lint !e818 Can't be pointer to const due to the typedef. */
 /*-----------------------------------------------------------*/
 
+void vTimerSetSlack( TimerHandle_t xTimer, const TickType_t xSlack )
+{
+Timer_t * const pxTimer = ( Timer_t * ) xTimer;
+
+	configASSERT( pxTimer );
+
+	/* A single word the timer service task reads.  The new slack counts
+	from the next time the task blocks. */
+	pxTimer->xTimerSlack = xSlack;
+}
+/*-----------------------------------------------------------*/
+
 void *pvTimerGetTimerID( const TimerHandle_t xTimer )
 {
 Timer_t * const pxTimer = ( Timer_t * ) xTimer;
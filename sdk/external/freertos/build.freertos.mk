@@ -5,11 +5,43 @@ libs-y += libfreertos
 disable-lto-for += libfreertos
 libfreertos-objs-y := Source/list.c Source/queue.c Source/tasks.c Source/event_groups.c
 libfreertos-objs-y += Source/croutine.c Source/timers.c
-libfreertos-objs-y += Source/portable/MemMang/heap_4.c Source/FreeRTOS-openocd.c
+libfreertos-objs-y += Source/FreeRTOS-openocd.c
+libfreertos-objs-y += Source/freertos_hooks.c
+# Two level segregated fit heap instead of heap_4, constant time malloc and
+# free, see heap_tlsf.c
+FREERTOS_HEAP_TLSF ?= n
+ifeq ($(FREERTOS_HEAP_TLSF),y)
+libfreertos-objs-y += Source/portable/MemMang/heap_tlsf.c
+else
+libfreertos-objs-y += Source/portable/MemMang/heap_4.c
+endif
 
 libfreertos-objs-$(tc-cortex-m4-y) += Source/portable/GCC/ARM_CM4F/port.c
 libfreertos-objs-$(tc-cortex-m3-y) += Source/portable/GCC/ARM_CM3/port.c
 
 libfreertos-cflags-$(DEBUG_HEAP) += -DDEBUG_HEAP
+# Charge the heap allocations to their call sites, see heap_track.h
+HEAP_TRACK ?= n
+libfreertos-cflags-$(HEAP_TRACK) += -DHEAP_TRACK
+libfreertos-objs-$(HEAP_TRACK) += Source/portable/MemMang/heap_track.c
+
+# Stop the tick and sleep in PM2 while idle, see FreeRTOSConfig.h
+FREERTOS_TICKLESS_IDLE ?= n
+ifeq ($(tc-cortex-m4-y),y)
+libfreertos-cflags-$(FREERTOS_TICKLESS_IDLE) += -DFREERTOS_TICKLESS_IDLE
+libfreertos-objs-$(FREERTOS_TICKLESS_IDLE) += Source/portable/GCC/ARM_CM4F/port_tickless.c
+endif
+# Guard the bottom of the running task's stack with an MPU region instead of
+# checking the stack pattern at every context switch, see port_stack_guard.c.
+# Every stack loses 32 to 56 bytes to the guard.
+FREERTOS_MPU_STACK_GUARD ?= n
+ifeq ($(tc-cortex-m4-y),y)
+libfreertos-cflags-$(FREERTOS_MPU_STACK_GUARD) += -DFREERTOS_MPU_STACK_GUARD
+libfreertos-objs-$(FREERTOS_MPU_STACK_GUARD) += Source/portable/GCC/ARM_CM4F/port_stack_guard.c
+endif
+# Record the context switches and queue events, see freertos_trace.h
+FREERTOS_TRACE ?= n
+libfreertos-cflags-$(FREERTOS_TRACE) += -DFREERTOS_TRACE
+libfreertos-objs-$(FREERTOS_TRACE) += Source/freertos_trace.c
 libfreertos-cflags-$(CONFIG_ENABLE_STACK_OVERFLOW_CHECK) += -DCONFIG_ENABLE_STACK_OVERFLOW_CHECK
 libfreertos-cflags-$(CONFIG_ENABLE_ASSERTS) += -DCONFIG_ENABLE_ASSERT
@@ -7,6 +7,11 @@ global-cflags-y +=-Isdk/src/incl/platform/os/freertos     \
 global-cflags-$(CONFIG_ENABLE_FREERTOS_RUNTIME_STATS_SUPPORT) += \
 	-DCONFIG_ENABLE_RUNTIME_STATS
 
+# Count the takes and the waits of every mutex, see mutex_stats.h. Global,
+# the mutex calls of wm_os.h name the mutexes.
+FREERTOS_MUTEX_STATS ?= n
+global-cflags-$(FREERTOS_MUTEX_STATS) += -DFREERTOS_MUTEX_STATS
+
 global-cflags-$(tc-cortex-m3-y) += -I$(d)/Source/portable/$(tc-env)/ARM_CM3
 global-cflags-$(tc-cortex-m4-y) += -I$(d)/Source/portable/$(tc-env)/ARM_CM4F
 
@@ -45,6 +45,7 @@ liblwip-objs-y :=  \
 		src/core/udp.c \
 		src/netif/etharp.c \
 		contrib/port/FreeRTOS/wmsdk/sys_arch.c \
+		contrib/port/FreeRTOS/wmsdk/chksum.c \
 		src/core/def.c \
 		src/core/inet_chksum.c \
 		src/netif/ethernetif.c \
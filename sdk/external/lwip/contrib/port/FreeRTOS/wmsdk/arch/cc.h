@@ -84,4 +84,8 @@ extern int wmprintf(const char *format, ...);
 #define LWIP_PLATFORM_HTONL(x) ((((x) & (0xff)) << 24) | (((x) & (0xff00)) << 8) | (((x) & (0xff0000UL)) >> 8) | (((x) & (0xff000000UL)) >> 24))
 #define LWIP_RAND rand
 
+/* Checksum with the add with carry chain of the Cortex-M, see chksum.c */
+u16_t lwip_mw300_chksum(void *dataptr, int len);
+#define LWIP_CHKSUM lwip_mw300_chksum
+
 #endif /* __CC_H__ */
@@ -43,6 +43,22 @@
 typedef xSemaphoreHandle sys_sem_t;
 typedef xQueueHandle sys_mbox_t;
 typedef xTaskHandle sys_thread_t;
+/* FreeRTOS mutexes, they inherit the priority of the threads waiting for them */
+typedef xSemaphoreHandle sys_mutex_t;
+
+#define sys_mutex_valid(mutex)		(*(mutex) != NULL)
+#define sys_mutex_set_invalid(mutex)	(*(mutex) = NULL)
+
+/* Mailboxes: the receive mailbox of every netconn, the accept mailbox of
+ * every listening one and the one of the tcp/ip thread */
+#ifndef SYS_MAX_Q
+#define SYS_MAX_Q	(MEMP_NUM_NETCONN + MEMP_NUM_TCP_PCB_LISTEN + 4)
+#endif
+/* Semaphores: the one of every netconn, and one for each thread in
+ * select(), gethostbyname() or sys_msleep() */
+#ifndef SYS_MAX_SEM
+#define SYS_MAX_SEM	(MEMP_NUM_NETCONN + 8)
+#endif
 
 /* Message queue constants. */
 #define archMESG_QUEUE_LENGTH	( 32 )
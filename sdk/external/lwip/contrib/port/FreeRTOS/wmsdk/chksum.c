@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/* Internet checksum for the Cortex-M4 of the MW300, selected by LWIP_CHKSUM
+ * in arch/cc.h.
+ *
+ * The one's complement sum is computed 32 bits at a time: a 32-bit add with
+ * the carry added back in is the same sum as the two 16-bit halves added
+ * with end around carry. The inner loop loads 32 bytes with two ldmia and
+ * chains them with adcs, so the carry is carried by the flag instead of
+ * being tested after each add, and is folded to 16 bits once at the end.
+ * The saturating halfword adds of the DSP extension (uqadd16) can not be
+ * used, a one's complement sum needs the carry out of each half.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/def.h"
+
+#include <compiler.h>
+
+/** Sum of 32-byte blocks, word aligned, with end around carry */
+static u32_t
+chksum_blocks(const u32_t *pl, u32_t nblocks, u32_t sum)
+{
+#if defined(__GNUC__) && defined(__thumb2__)
+	const u32_t *end = pl + nblocks * 8;
+
+	/* teq with a register leaves the carry alone, the loop test does not
+	 * break the adcs chain. The last carry can wrap the sum round to zero
+	 * with a carry out again, hence the two adds of it. */
+	__asm__ volatile (
+		"adds   %[sum], %[sum], #0\n"
+		"1:\n"
+		"ldmia  %[pl]!, {r2, r3, r4, r5}\n"
+		"adcs   %[sum], %[sum], r2\n"
+		"adcs   %[sum], %[sum], r3\n"
+		"adcs   %[sum], %[sum], r4\n"
+		"adcs   %[sum], %[sum], r5\n"
+		"ldmia  %[pl]!, {r2, r3, r4, r5}\n"
+		"adcs   %[sum], %[sum], r2\n"
+		"adcs   %[sum], %[sum], r3\n"
+		"adcs   %[sum], %[sum], r4\n"
+		"adcs   %[sum], %[sum], r5\n"
+		"teq    %[pl], %[end]\n"
+		"bne    1b\n"
+		"adcs   %[sum], %[sum], #0\n"
+		"adc    %[sum], %[sum], #0\n"
+		: [sum] "+r" (sum), [pl] "+r" (pl)
+		: [end] "r" (end)
+		: "r2", "r3", "r4", "r5", "cc", "memory");
+	return sum;
+#else
+	u32_t i, tmp;
+
+	while (nblocks--) {
+		for (i = 0; i < 8; i++) {
+			tmp = sum + *pl++;
+			sum = tmp + (tmp < sum);
+		}
+	}
+	return sum;
+#endif
+}
+
+/**
+ * lwip checksum
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+__ramfunc u16_t
+lwip_mw300_chksum(void *dataptr, int len)
+{
+	const u8_t *pb = (const u8_t *)dataptr;
+	const u16_t *ps;
+	u32_t sum = 0;
+	u16_t t = 0;
+	/* starts at odd byte address? */
+	int odd = ((mem_ptr_t)pb & 1);
+
+	if (odd && len > 0) {
+		((u8_t *)&t)[1] = *pb++;
+		len--;
+	}
+
+	ps = (const u16_t *)pb;
+
+	if (((mem_ptr_t)ps & 3) && len > 1) {
+		sum += *ps++;
+		len -= 2;
+	}
+
+	if (len >= 32) {
+		sum = chksum_blocks((const u32_t *)ps, (u32_t)len >> 5, sum);
+		ps += (len & ~31) / 2;
+		len &= 31;
+		sum = FOLD_U32T(sum);
+		sum = FOLD_U32T(sum);
+	}
+
+	/* at most 15 halfwords left, no overflow out of 32 bits */
+	while (len > 1) {
+		sum += *ps++;
+		len -= 2;
+	}
+
+	/* dangling tail byte remaining? */
+	if (len > 0) {
+		((u8_t *)&t)[0] = *(const u8_t *)ps;
+	}
+
+	sum += t;
+
+	sum = FOLD_U32T(sum);
+	sum = FOLD_U32T(sum);
+
+	if (odd) {
+		sum = SWAP_BYTES_IN_WORD(sum);
+	}
+
+	return (u16_t)sum;
+}
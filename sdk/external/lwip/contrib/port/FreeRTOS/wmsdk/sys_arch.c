@@ -48,50 +48,123 @@
 #define DBG(...)
 #endif /* SYS_ARCH_DEBUG */
 
-#define SYS_MAX_Q 20
-static xQueueHandle sys_mbox_table[SYS_MAX_Q];
-#define SYS_MAX_SEM 20
-static xQueueHandle sys_sem_table[SYS_MAX_SEM];
+/*
+  The mailboxes and semaphores handed out are kept in tables, so that
+  sys_mbox_valid() and sys_sem_valid() can tell a live one from a deleted
+  one. A queue's FreeRTOS queue number is its slot in the table plus 1, the
+  free slots are chained through next, so that adding, removing and checking
+  do not scan the table.
+*/
+struct sys_table {
+	xQueueHandle *slot;
+	u16_t *next;
+	u16_t size;
+	/* Slots from top up were never used */
+	u16_t top;
+	/* First free slot below top plus 1, 0 if none */
+	u16_t free;
+};
+
+static xQueueHandle sys_mbox_slot[SYS_MAX_Q];
+static u16_t sys_mbox_next[SYS_MAX_Q];
+static struct sys_table sys_mbox_table = {
+	sys_mbox_slot, sys_mbox_next, SYS_MAX_Q, 0, 0
+};
+static xQueueHandle sys_sem_slot[SYS_MAX_SEM];
+static u16_t sys_sem_next[SYS_MAX_SEM];
+static struct sys_table sys_sem_table = {
+	sys_sem_slot, sys_sem_next, SYS_MAX_SEM, 0, 0
+};
+
+static int sys_table_add(struct sys_table *t, xQueueHandle q)
+{
+	u16_t i;
+
+	vTaskSuspendAll();
+	if (t->free) {
+		i = t->free - 1;
+		t->free = t->next[i];
+	} else if (t->top < t->size) {
+		i = t->top++;
+	} else {
+		xTaskResumeAll();
+		return -1;
+	}
+	t->slot[i] = q;
+	vQueueSetQueueNumber(q, i + 1);
+	xTaskResumeAll();
+	return 0;
+}
+
+/* Slot of a queue of the table, -1 if it is not in it */
+static int sys_table_find(struct sys_table *t, xQueueHandle q)
+{
+	unsigned i = uxQueueGetQueueNumber(q);
+
+	if (i == 0 || i > t->top || t->slot[i - 1] != q)
+		return -1;
+	return i - 1;
+}
+
+static void sys_table_remove(struct sys_table *t, xQueueHandle q)
+{
+	int i;
 
-/* This is the number of threads that can be started with sys_thread_new() */
-#define SYS_THREAD_MAX 4
+	vTaskSuspendAll();
+	i = sys_table_find(t, q);
+	if (i >= 0) {
+		t->slot[i] = NULL;
+		t->next[i] = t->free;
+		t->free = i + 1;
+	}
+	xTaskResumeAll();
+}
+
+static int sys_table_has(struct sys_table *t, xQueueHandle q)
+{
+	int ret;
 
-static u16_t s_nextthread = 0;
+	vTaskSuspendAll();
+	ret = sys_table_find(t, q) >= 0;
+	xTaskResumeAll();
+	return ret;
+}
 
 
 /*-----------------------------------------------------------------------------------*/
 //  Creates an empty mailbox.
 err_t sys_mbox_new(sys_mbox_t *mbox, int size)
 {
-	int i;
-	err_t ret = ERR_OK;
 	DBG("Enter: %s mbox %p\n\r",__FUNCTION__,*mbox);
 	*mbox = xQueueCreate( archMESG_QUEUE_LENGTH, sizeof( void * ) );
-
+	if( *mbox == NULL )
+	{
 #if SYS_STATS
-      ++lwip_stats.sys.mbox.used;
-      if (lwip_stats.sys.mbox.max < lwip_stats.sys.mbox.used) {
-         lwip_stats.sys.mbox.max = lwip_stats.sys.mbox.used;
-	  }
+		++lwip_stats.sys.mbox.err;
 #endif /* SYS_STATS */
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_Q;i++) {
-		if(sys_mbox_table[i] == NULL) {
-			sys_mbox_table[i] = *mbox;
-			break;
-		}
+		return ERR_MEM;
 	}
-	xTaskResumeAll();	
-	if(i == SYS_MAX_Q) {
+
+	if(sys_table_add(&sys_mbox_table, *mbox)) {
 		/* If we reach here *mbox was never added to the table, we can safely delete it */
 		vQueueDelete( *mbox );
 		*mbox = NULL;
 		DBG("Error: sys_mbox_new failed, please increase the SYS_MAX_Q value \n\r");
-		ret = ERR_MEM;
+#if SYS_STATS
+		++lwip_stats.sys.mbox.err;
+#endif /* SYS_STATS */
+		return ERR_MEM;
 	}
 
+#if SYS_STATS
+      ++lwip_stats.sys.mbox.used;
+      if (lwip_stats.sys.mbox.max < lwip_stats.sys.mbox.used) {
+         lwip_stats.sys.mbox.max = lwip_stats.sys.mbox.used;
+	  }
+#endif /* SYS_STATS */
+
 	DBG("Exit: %s mbox %p\n\r",__FUNCTION__,*mbox);
-	return ret;
+	return ERR_OK;
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -102,7 +175,6 @@ err_t sys_mbox_new(sys_mbox_t *mbox, int size)
 */
 void sys_mbox_free(sys_mbox_t *mbox)
 {
-	int i;
 	DBG("Enter: %s mbox %p \n\r",__FUNCTION__,*mbox);
 	if( *mbox == NULL )
 	{
@@ -125,11 +197,7 @@ void sys_mbox_free(sys_mbox_t *mbox)
 #if SYS_STATS
      --lwip_stats.sys.mbox.used;
 #endif /* SYS_STATS */
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_Q;i++)
-		if(*mbox == sys_mbox_table[i])
-			sys_mbox_table[i] = NULL;
-	xTaskResumeAll();
+	sys_table_remove(&sys_mbox_table, *mbox);
 	/* Delete after marking the mbox in the table as invalid */
 	vQueueDelete( *mbox );
 	*mbox = NULL;
@@ -273,41 +341,27 @@ u32_t sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
 
 int sys_mbox_valid(sys_mbox_t *mbox)
 {
-	int i,ret=0;
+	int ret=0;
 	DBG("Enter: %s mbox %p\n\r",__FUNCTION__,*mbox);
 	if( *mbox == NULL )
 	{
 		DBG("Exit: %s: Invalid mbox\n\r",__FUNCTION__);
 		return ret;
 	}
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_Q;i++) {
-		if(sys_mbox_table[i] == *mbox) {
-			ret = 1;
-		}
-	}
-	xTaskResumeAll();	
+	ret = sys_table_has(&sys_mbox_table, *mbox);
 
 	DBG("Exit: %s ret %d\n\r",__FUNCTION__,ret);
 	return ret;
 }
 void sys_mbox_set_invalid(sys_mbox_t *mbox)
 {
-	int i;
 	DBG("Enter: %s mbox %p\n\r",__FUNCTION__,*mbox);
 	if( *mbox == NULL )
 	{
 		DBG("Exit: %s: Invalid mbox\n\r",__FUNCTION__);
 		return;
 	}
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_Q;i++) {
-		if(sys_mbox_table[i] == *mbox) {
-			sys_mbox_table[i] = NULL;
-			break;
-		}
-	}
-	xTaskResumeAll();	
+	sys_table_remove(&sys_mbox_table, *mbox);
 	*mbox = NULL;
 
 	DBG("Exit: %s\n\r",__FUNCTION__);
@@ -317,9 +371,7 @@ void sys_mbox_set_invalid(sys_mbox_t *mbox)
 //  the initial state of the semaphore.
 err_t sys_sem_new(sys_sem_t *sem, u8_t count)
 {
-	int i;
 	DBG("Enter: %s\n\r",__FUNCTION__);
-	err_t ret = ERR_OK;
 	vSemaphoreCreateBinary( *sem );
 
 	if( *sem == NULL )
@@ -337,19 +389,14 @@ err_t sys_sem_new(sys_sem_t *sem, u8_t count)
 		xSemaphoreTake(*sem,1);
 	}
 
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_SEM;i++) {
-		if(sys_sem_table[i] == NULL) {
-			sys_sem_table[i] = *sem;
-			break;
-		}
-	}
-	xTaskResumeAll();	
-	if(i == SYS_MAX_SEM) {
+	if(sys_table_add(&sys_sem_table, *sem)) {
 		vQueueDelete( *sem );
 		*sem = NULL;
 		DBG("Error: sys_sem_new failed, please increase the SYS_MAX_SEM value \n\r");
-		ret = ERR_MEM;
+#if SYS_STATS
+		++lwip_stats.sys.sem.err;
+#endif /* SYS_STATS */
+		return ERR_MEM;
 	}
 
 #if SYS_STATS
@@ -360,7 +407,7 @@ err_t sys_sem_new(sys_sem_t *sem, u8_t count)
 #endif /* SYS_STATS */
 
 	DBG("Exit: %s sem %p\n\r",__FUNCTION__,*sem);
-	return ret;
+	return ERR_OK;
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -425,17 +472,12 @@ void sys_sem_signal(sys_sem_t *sem)
 // Deallocates a semaphore
 void sys_sem_free(sys_sem_t *sem)
 {
-	int i;
 	DBG("Enter: %s sem %p\n\r",__FUNCTION__,*sem);
 #if SYS_STATS
       --lwip_stats.sys.sem.used;
 #endif /* SYS_STATS */
 
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_SEM;i++)
-		if(*sem == sys_sem_table[i])
-			sys_sem_table[i] = NULL;
-	xTaskResumeAll();
+	sys_table_remove(&sys_sem_table, *sem);
 	/* Delete after marking the sem in the table as invalid */
 	vQueueDelete( *sem );
 	*sem = NULL;
@@ -445,20 +487,13 @@ void sys_sem_free(sys_sem_t *sem)
 
 void sys_sem_set_invalid(sys_sem_t *sem)
 {
-	int i;
 	DBG("Enter: %s sem %p\n\r",__FUNCTION__,*sem);
 	if( *sem == NULL )
 	{
 		DBG("Exit: %s: Invalid sem\n\r",__FUNCTION__);
 		return;
 	}
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_SEM;i++) {
-		if(sys_sem_table[i] == *sem) {
-			sys_sem_table[i] = NULL;
-		}
-	}
-	xTaskResumeAll();
+	sys_table_remove(&sys_sem_table, *sem);
 	*sem = NULL;
 
 	DBG("Exit: %s\n\r",__FUNCTION__);
@@ -466,7 +501,7 @@ void sys_sem_set_invalid(sys_sem_t *sem)
 
 int sys_sem_valid(sys_sem_t *sem)
 {
-	int i,ret = 0;
+	int ret = 0;
 	DBG("Enter: %s sem %p\n\r",__FUNCTION__,*sem);
 
 	if( *sem == NULL )
@@ -474,30 +509,74 @@ int sys_sem_valid(sys_sem_t *sem)
 		DBG("Exit: %s: Invalid sem\n\r",__FUNCTION__);
 		return ret;
 	}
-	vTaskSuspendAll();
-	for(i=0;i<SYS_MAX_SEM;i++) {
-		if(sys_sem_table[i] == *sem) {
-			ret = 1;
-		}
-	}
-	xTaskResumeAll();	
+	ret = sys_table_has(&sys_sem_table, *sem);
 
 	DBG("Exit: %s\n\r",__FUNCTION__);
 	return ret;
 }
 /*-----------------------------------------------------------------------------------*/
-// Initialize sys arch
-void sys_init(void)
+/*
+  Creates a mutex. The core lock of LWIP_TCPIP_CORE_LOCKING is one: a low
+  priority thread holding it while in the stack is raised to the priority of
+  the tcp/ip thread or of a socket call waiting for it, instead of holding
+  them up behind threads of the priorities in between as a binary semaphore
+  would.
+*/
+err_t sys_mutex_new(sys_mutex_t *mutex)
 {
-	int i;
-
 	DBG("Enter: %s\n\r",__FUNCTION__);
-	for(i = 0; i < SYS_MAX_Q; i++) {
-		sys_mbox_table[i] = NULL;
+	*mutex = xSemaphoreCreateMutex();
+	if( *mutex == NULL )
+	{
+#if SYS_STATS
+		++lwip_stats.sys.mutex.err;
+#endif /* SYS_STATS */
+		return ERR_MEM;
 	}
-	for(i = 0; i < SYS_MAX_SEM; i++) {
-		sys_sem_table[i] = NULL;
+	/* The core lock, or the heap lock without core locking */
+	vQueueSetMutexName(*mutex, "lwip");
+
+#if SYS_STATS
+	++lwip_stats.sys.mutex.used;
+	if (lwip_stats.sys.mutex.max < lwip_stats.sys.mutex.used) {
+		lwip_stats.sys.mutex.max = lwip_stats.sys.mutex.used;
 	}
+#endif /* SYS_STATS */
+
+	DBG("Exit: %s mutex %p\n\r",__FUNCTION__,*mutex);
+	return ERR_OK;
+}
+
+void sys_mutex_lock(sys_mutex_t *mutex)
+{
+	while( xSemaphoreTake( *mutex, portMAX_DELAY ) != pdTRUE );
+}
+
+void sys_mutex_unlock(sys_mutex_t *mutex)
+{
+	xSemaphoreGive( *mutex );
+}
+
+void sys_mutex_free(sys_mutex_t *mutex)
+{
+	DBG("Enter: %s mutex %p\n\r",__FUNCTION__,*mutex);
+#if SYS_STATS
+	--lwip_stats.sys.mutex.used;
+#endif /* SYS_STATS */
+
+	vQueueDelete( *mutex );
+	*mutex = NULL;
+
+	DBG("Exit: %s\n\r",__FUNCTION__);
+}
+
+/*-----------------------------------------------------------------------------------*/
+// Initialize sys arch
+void sys_init(void)
+{
+	DBG("Enter: %s\n\r",__FUNCTION__);
+	sys_mbox_table.top = sys_mbox_table.free = 0;
+	sys_sem_table.top = sys_sem_table.free = 0;
 	DBG("Exit: %s\n\r",__FUNCTION__);
 }
 
@@ -517,25 +596,17 @@ xTaskHandle CreatedTask;
 DBG("Enter: %s",__FUNCTION__);
 int result;
 
-   if ( s_nextthread < SYS_THREAD_MAX )
+   result = xTaskCreate( thread, name, stacksize, arg, prio, &CreatedTask );
+
+   if(result == pdPASS)
    {
-      result = xTaskCreate( thread, name, stacksize, arg, prio, &CreatedTask );
-
-	   if(result == pdPASS)
-	   {
-		DBG("Exit: %s",__FUNCTION__);
-		   return CreatedTask;
-	   }
-	   else
-	   {
-		DBG("Exit: %s",__FUNCTION__);
-		   return NULL;
-	   }
+	DBG("Exit: %s",__FUNCTION__);
+	   return CreatedTask;
    }
    else
    {
 	DBG("Exit: %s",__FUNCTION__);
-      return NULL;
+	   return NULL;
    }
 }
 
@@ -554,8 +625,13 @@ int result;
 */
 sys_prot_t sys_arch_protect(void)
 {
-	vPortEnterCritical();
-	return 1;
+	/*
+	 * Only the interrupts that may call the OS are masked, as by a
+	 * critical section, but the previous mask is returned instead of
+	 * counting the nesting, so this also works from the interrupt
+	 * handlers of the drivers, which free pbufs.
+	 */
+	return portSET_INTERRUPT_MASK_FROM_ISR();
 }
 
 /*
@@ -566,8 +642,7 @@ sys_prot_t sys_arch_protect(void)
 */
 void sys_arch_unprotect(sys_prot_t pval)
 {
-	( void ) pval;
-	vPortExitCritical();
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(pval);
 }
 
 unsigned long sys_arch_get_os_ticks()
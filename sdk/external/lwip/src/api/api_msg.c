@@ -642,6 +642,9 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
   conn->recv_avail   = 0;
 #endif /* LWIP_SO_RCVBUF */
   conn->flags = 0;
+#if PBUF_POOL_BORROW
+  conn->pool_borrow = 0;
+#endif /* PBUF_POOL_BORROW */
   return conn;
 free_and_return:
   memp_free(MEMP_NETCONN, conn);
@@ -668,6 +671,9 @@ netconn_free(struct netconn *conn)
   sys_sem_free(&conn->op_completed);
   sys_sem_set_invalid(&conn->op_completed);
 
+#if PBUF_POOL_BORROW
+  pbuf_pool_borrow(-(s32_t)conn->pool_borrow);
+#endif /* PBUF_POOL_BORROW */
   memp_free(MEMP_NETCONN, conn);
 }
 
@@ -1168,6 +1168,15 @@ lwip_register_recv_cb(int s, netconn_recv_callback recv_callback, void *recv_cb_
 	sock->conn->recv_cb_data = recv_cb_data;
 }
 #endif
+
+struct netconn *
+lwip_get_netconn(int s)
+{
+  struct lwip_sock *sock = get_socket(s);
+
+  return sock ? sock->conn : NULL;
+}
+
 int
 lwip_socket(int domain, int type, int protocol)
 {
@@ -1847,6 +1856,9 @@ lwip_getsockopt(int s, int level, int optname, void *optval, socklen_t *optlen)
     case TCP_KEEPINTVL:
     case TCP_KEEPCNT:
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_WND_SCALE
+    case TCP_BULK_WND:
+#endif /* LWIP_WND_SCALE */
       break;
        
     default:
@@ -2127,6 +2139,13 @@ lwip_getsockopt_internal(void *arg)
                   s, *(int *)optval));
       break;
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_WND_SCALE
+    case TCP_BULK_WND:
+      *(int*)optval = (int)TCP_WND_MAX(sock->conn->pcb.tcp);
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_BULK_WND) = %d\n",
+                  s, *(int *)optval));
+      break;
+#endif /* LWIP_WND_SCALE */
     default:
       LWIP_ASSERT("unhandled optname", 0);
       break;
@@ -2346,6 +2365,9 @@ lwip_setsockopt(int s, int level, int optname, const void *optval, socklen_t opt
     case TCP_KEEPINTVL:
     case TCP_KEEPCNT:
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_WND_SCALE
+    case TCP_BULK_WND:
+#endif /* LWIP_WND_SCALE */
       break;
 
     default:
@@ -2639,6 +2661,22 @@ lwip_setsockopt_internal(void *arg)
                   s, sock->conn->pcb.tcp->keep_cnt));
       break;
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_WND_SCALE
+    case TCP_BULK_WND:
+    {
+      tcpwnd_size_t wnd = tcp_set_rcv_wnd(sock->conn->pcb.tcp,
+        (*(int*)optval > 0) ? (tcpwnd_size_t)*(int*)optval : TCP_WND);
+#if PBUF_POOL_BORROW
+      /* the frames of the window above TCP_WND, with their headers */
+      u32_t borrow = (wnd - TCP_WND) + (wnd - TCP_WND) / 8;
+      pbuf_pool_borrow((s32_t)borrow - (s32_t)sock->conn->pool_borrow);
+      sock->conn->pool_borrow = borrow;
+#endif /* PBUF_POOL_BORROW */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_BULK_WND) -> %"U32_F"\n",
+                  s, (u32_t)wnd));
+      break;
+    }
+#endif /* LWIP_WND_SCALE */
     default:
       LWIP_ASSERT("unhandled optname", 0);
       break;
@@ -50,6 +50,8 @@
 #include "netif/etharp.h"
 #include "netif/ppp_oe.h"
 
+#include <cycle_trace.h>
+
 #define TCPIP_MSG_VAR_REF(name)     API_VAR_REF(name)
 #define TCPIP_MSG_VAR_DECLARE(name) API_VAR_DECLARE(struct tcpip_msg, name)
 #define TCPIP_MSG_VAR_ALLOC(name)   API_VAR_ALLOC(struct tcpip_msg, MEMP_TCPIP_MSG_API, name)
@@ -98,6 +100,7 @@ tcpip_thread(void *arg)
       LWIP_ASSERT("tcpip_thread: invalid message", 0);
       continue;
     }
+    CYCLE_TRACE_BEGIN(CYCLE_TRACE_TCPIP_MSG);
     switch (msg->type) {
 #if LWIP_NETCONN
     case TCPIP_MSG_API:
@@ -162,6 +165,7 @@ tcpip_thread(void *arg)
       LWIP_ASSERT("tcpip_thread: invalid message", 0);
       break;
     }
+    CYCLE_TRACE_END(CYCLE_TRACE_TCPIP_MSG);
   }
 }
 
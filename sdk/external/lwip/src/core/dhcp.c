@@ -158,6 +158,45 @@ static err_t dhcp_rebind(struct netif *netif);
 static err_t dhcp_reboot(struct netif *netif);
 static void dhcp_set_state(struct dhcp *dhcp, u8_t new_state);
 
+#if LWIP_DHCP_LEASE_CACHE
+#define DHCP_LEASE_CACHE_MAGIC 0x4c484350UL
+
+/** Address of the last lease of the interface with hwaddr */
+struct dhcp_lease_cache {
+  u32_t magic;
+  u8_t hwaddr[NETIF_MAX_HWADDR_LEN];
+  ip_addr_t ip_addr;
+};
+
+static struct dhcp_lease_cache dhcp_lease_cache LWIP_DHCP_LEASE_CACHE_SECTION;
+
+static void
+dhcp_lease_cache_save(struct netif *netif, ip_addr_t *ip_addr)
+{
+  MEMCPY(dhcp_lease_cache.hwaddr, netif->hwaddr, NETIF_MAX_HWADDR_LEN);
+  ip_addr_copy(dhcp_lease_cache.ip_addr, *ip_addr);
+  dhcp_lease_cache.magic = DHCP_LEASE_CACHE_MAGIC;
+}
+
+static void
+dhcp_lease_cache_clear(void)
+{
+  dhcp_lease_cache.magic = 0;
+}
+
+/** Get the cached address of the interface, returns 0 if there is none */
+static int
+dhcp_lease_cache_get(struct netif *netif, ip_addr_t *ip_addr)
+{
+  if ((dhcp_lease_cache.magic != DHCP_LEASE_CACHE_MAGIC) ||
+      memcmp(dhcp_lease_cache.hwaddr, netif->hwaddr, NETIF_MAX_HWADDR_LEN)) {
+    return 0;
+  }
+  ip_addr_copy(*ip_addr, dhcp_lease_cache.ip_addr);
+  return 1;
+}
+#endif /* LWIP_DHCP_LEASE_CACHE */
+
 /* receive, unfold, parse and free incoming messages */
 static void dhcp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port);
 
@@ -257,6 +296,10 @@ dhcp_handle_nak(struct netif *netif)
   netif_set_ipaddr(netif, IP_ADDR_ANY);
   netif_set_gw(netif, IP_ADDR_ANY);
   netif_set_netmask(netif, IP_ADDR_ANY); 
+#if LWIP_DHCP_LEASE_CACHE
+  /* the server refused the cached address */
+  dhcp_lease_cache_clear();
+#endif /* LWIP_DHCP_LEASE_CACHE */
   /* Change to a defined state */
   dhcp_set_state(dhcp, DHCP_BACKING_OFF);
   /* We can immediately restart discovery */
@@ -735,6 +778,13 @@ dhcp_start(struct netif *netif)
   udp_recv(dhcp->pcb, dhcp_recv, netif);
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("dhcp_start(): starting DHCP configuration\n"));
   /* (re)start the DHCP negotiation */
+#if LWIP_DHCP_LEASE_CACHE
+  if (dhcp_lease_cache_get(netif, &dhcp->offered_ip_addr)) {
+    /* ask for the last address, if no server answers dhcp_timeout()
+       falls back to discovering after REBOOT_TRIES */
+    result = dhcp_reboot(netif);
+  } else
+#endif /* LWIP_DHCP_LEASE_CACHE */
   result = dhcp_discover(netif);
   if (result != ERR_OK) {
     /* free resources allocated above */
@@ -1070,6 +1120,9 @@ dhcp_bind(struct netif *netif)
   netif_set_up(netif);
   /* netif is now bound to DHCP leased address */
   dhcp_set_state(dhcp, DHCP_BOUND);
+#if LWIP_DHCP_LEASE_CACHE
+  dhcp_lease_cache_save(netif, &dhcp->offered_ip_addr);
+#endif /* LWIP_DHCP_LEASE_CACHE */
 }
 
 /**
@@ -1239,6 +1292,10 @@ dhcp_release(struct netif *netif)
 
   /* idle DHCP client */
   dhcp_set_state(dhcp, DHCP_OFF);
+#if LWIP_DHCP_LEASE_CACHE
+  /* the lease is given back */
+  dhcp_lease_cache_clear();
+#endif /* LWIP_DHCP_LEASE_CACHE */
   /* clean old DHCP offer */
   ip_addr_set_zero(&dhcp->server_ip_addr);
   ip_addr_set_zero(&dhcp->offered_ip_addr);
@@ -1672,6 +1729,17 @@ dhcp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
       dhcp_bind(netif);
 #endif
     }
+#if LWIP_DHCP_LEASE_CACHE
+    /* confirmed the cached address, the lease times, mask, gateway and
+       server are only known from this ACK */
+    else if (dhcp->state == DHCP_REBOOTING) {
+      dhcp_handle_ack(netif);
+      if (dhcp_option_given(dhcp, DHCP_OPTION_IDX_SERVER_ID)) {
+        ip4_addr_set_u32(&dhcp->server_ip_addr, htonl(dhcp_get_option_value(dhcp, DHCP_OPTION_IDX_SERVER_ID)));
+      }
+      dhcp_bind(netif);
+    }
+#endif /* LWIP_DHCP_LEASE_CACHE */
     /* already bound to the given lease address? */
     else if ((dhcp->state == DHCP_REBOOTING) || (dhcp->state == DHCP_REBINDING) || (dhcp->state == DHCP_RENEWING)) {
       dhcp_bind(netif);
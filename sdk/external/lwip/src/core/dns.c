@@ -117,6 +117,13 @@
 #define DNS_FLAG2_ERR_NONE        0x00
 #define DNS_FLAG2_ERR_NAME        0x03
 
+/* Length of the address in an answer of the record type */
+#if LWIP_IPV6
+#define DNS_ADDR_LEN(type)        ((type) == DNS_RRTYPE_AAAA ? sizeof(ip6_addr_t) : sizeof(ip_addr_t))
+#else /* LWIP_IPV6 */
+#define DNS_ADDR_LEN(type)        sizeof(ip_addr_t)
+#endif /* LWIP_IPV6 */
+
 /* DNS protocol states */
 #define DNS_STATE_UNUSED          0
 #define DNS_STATE_NEW             1
@@ -173,11 +180,18 @@ struct dns_table_entry {
   u8_t  retries;
   u8_t  seqno;
   u8_t  err;
+  /* DNS_RRTYPE_A or DNS_RRTYPE_AAAA */
+  u8_t  type;
   u32_t ttl;
   char name[DNS_MAX_NAME_LENGTH];
   ip_addr_t ipaddr;
   /* pointer to callback on DNS query done */
   dns_found_callback found;
+#if LWIP_IPV6
+  ip6_addr_t ip6addr;
+  /* callback of an AAAA query */
+  dns_found6_callback found6;
+#endif /* LWIP_IPV6 */
   void *arg;
 };
 
@@ -549,6 +563,7 @@ dns_lookup(const char *name)
   /* Walk through name list, return entry if found. If not, return NULL. */
   for (i = 0; i < DNS_TABLE_SIZE; ++i) {
     if ((dns_table[i].state == DNS_STATE_DONE) &&
+        (dns_table[i].type == DNS_RRTYPE_A) &&
         (strcmp(name, dns_table[i].name) == 0)) {
       LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
       ip_addr_debug_print(DNS_DEBUG, &(dns_table[i].ipaddr));
@@ -560,6 +575,55 @@ dns_lookup(const char *name)
   return IPADDR_NONE;
 }
 
+/**
+ * Look up the seconds the cached answer for a hostname stays valid.
+ * The answer is in the table when the dns_found_callback of its query is
+ * called, call this from the tcpip thread only, e.g. in that callback.
+ *
+ * @param name the hostname to look up
+ * @return remaining TTL of the answer, 0 if the hostname is not cached
+ */
+static struct dns_table_entry *
+dns_lookup_entry(const char *name, u8_t type)
+{
+  u8_t i;
+
+  for (i = 0; i < DNS_TABLE_SIZE; ++i) {
+    if ((dns_table[i].state == DNS_STATE_DONE) &&
+        (dns_table[i].type == type) &&
+        (strcmp(name, dns_table[i].name) == 0)) {
+      return &dns_table[i];
+    }
+  }
+
+  return NULL;
+}
+
+u32_t
+dns_lookup_ttl(const char *name)
+{
+  struct dns_table_entry *pEntry = dns_lookup_entry(name, DNS_RRTYPE_A);
+
+  return pEntry ? pEntry->ttl : 0;
+}
+
+#if LWIP_IPV6
+/**
+ * Look up the seconds the cached IPv6 answer for a hostname stays valid,
+ * see dns_lookup_ttl().
+ *
+ * @param name the hostname to look up
+ * @return remaining TTL of the answer, 0 if the hostname is not cached
+ */
+u32_t
+dns_lookup_ttl6(const char *name)
+{
+  struct dns_table_entry *pEntry = dns_lookup_entry(name, DNS_RRTYPE_AAAA);
+
+  return pEntry ? pEntry->ttl : 0;
+}
+#endif /* LWIP_IPV6 */
+
 #if DNS_DOES_NAME_CHECK
 /**
  * Compare the "dotted" name "query" with the encoded name "response"
@@ -636,10 +700,11 @@ dns_parse_name(unsigned char *query)
  * @param name hostname to query
  * @param id index of the hostname in dns_table, used as transaction ID in the
  *        DNS query packet
+ * @param type DNS_RRTYPE_A or DNS_RRTYPE_AAAA
  * @return ERR_OK if packet is sent; an err_t indicating the problem otherwise
  */
 static err_t
-dns_send(u8_t numdns, const char* name, u8_t id)
+dns_send(u8_t numdns, const char* name, u8_t id, u8_t type)
 {
   err_t err;
   struct dns_hdr *hdr;
@@ -685,7 +750,7 @@ dns_send(u8_t numdns, const char* name, u8_t id)
     *query++='\0';
 
     /* fill dns query */
-    qry.type = PP_HTONS(DNS_RRTYPE_A);
+    qry.type = htons(type);
     qry.cls = PP_HTONS(DNS_RRCLASS_IN);
     SMEMCPY(query, &qry, SIZEOF_DNS_QUERY);
 
@@ -708,6 +773,28 @@ dns_send(u8_t numdns, const char* name, u8_t id)
   return err;
 }
 
+/**
+ * Call the callback of an entry's query, if it has one.
+ *
+ * @param pEntry the dns_table entry
+ * @param found 1 if the entry holds the answer, 0 to report an error
+ */
+static void
+dns_call_found(struct dns_table_entry *pEntry, u8_t found)
+{
+#if LWIP_IPV6
+  if (pEntry->type == DNS_RRTYPE_AAAA) {
+    if (pEntry->found6) {
+      (*pEntry->found6)(pEntry->name, found ? &pEntry->ip6addr : NULL, pEntry->arg);
+    }
+    return;
+  }
+#endif /* LWIP_IPV6 */
+  if (pEntry->found) {
+    (*pEntry->found)(pEntry->name, found ? &pEntry->ipaddr : NULL, pEntry->arg);
+  }
+}
+
 /**
  * dns_check_entry() - see if pEntry has not yet been queried and, if so, sends out a query.
  * Check an entry in the dns_table:
@@ -735,7 +822,7 @@ dns_check_entry(u8_t i)
       pEntry->retries = 0;
       
       /* send DNS packet for this entry */
-      err = dns_send(pEntry->numdns, pEntry->name, i);
+      err = dns_send(pEntry->numdns, pEntry->name, i, pEntry->type);
       if (err != ERR_OK) {
         LWIP_DEBUGF(DNS_DEBUG | LWIP_DBG_LEVEL_WARNING,
                     ("dns_send returned error: %s\n", lwip_strerr(err)));
@@ -755,8 +842,7 @@ dns_check_entry(u8_t i)
           } else {
             LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": timeout\n", pEntry->name));
             /* call specified callback function if provided */
-            if (pEntry->found)
-              (*pEntry->found)(pEntry->name, NULL, pEntry->arg);
+            dns_call_found(pEntry, 0);
             /* flush this entry */
             pEntry->state   = DNS_STATE_UNUSED;
             pEntry->found   = NULL;
@@ -768,7 +854,7 @@ dns_check_entry(u8_t i)
         pEntry->tmr = pEntry->retries;
 
         /* send DNS packet for this entry */
-        err = dns_send(pEntry->numdns, pEntry->name, i);
+        err = dns_send(pEntry->numdns, pEntry->name, i, pEntry->type);
         if (err != ERR_OK) {
           LWIP_DEBUGF(DNS_DEBUG | LWIP_DBG_LEVEL_WARNING,
                       ("dns_send returned error: %s\n", lwip_strerr(err)));
@@ -889,22 +975,27 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
 
           /* Check for IP address type and Internet class. Others are discarded. */
           SMEMCPY(&ans, pHostname, SIZEOF_DNS_ANSWER);
-          if((ans.type == PP_HTONS(DNS_RRTYPE_A)) && (ans.cls == PP_HTONS(DNS_RRCLASS_IN)) &&
-             (ans.len == PP_HTONS(sizeof(ip_addr_t))) ) {
+          if((ans.type == htons(pEntry->type)) && (ans.cls == PP_HTONS(DNS_RRCLASS_IN)) &&
+             (ans.len == htons(DNS_ADDR_LEN(pEntry->type))) ) {
             /* read the answer resource record's TTL, and maximize it if needed */
             pEntry->ttl = ntohl(ans.ttl);
             if (pEntry->ttl > DNS_MAX_TTL) {
               pEntry->ttl = DNS_MAX_TTL;
             }
             /* read the IP address after answer resource record's header */
-            SMEMCPY(&(pEntry->ipaddr), (pHostname+SIZEOF_DNS_ANSWER), sizeof(ip_addr_t));
-            LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", pEntry->name));
-            ip_addr_debug_print(DNS_DEBUG, (&(pEntry->ipaddr)));
-            LWIP_DEBUGF(DNS_DEBUG, ("\n"));
-            /* call specified callback function if provided */
-            if (pEntry->found) {
-              (*pEntry->found)(pEntry->name, &pEntry->ipaddr, pEntry->arg);
+#if LWIP_IPV6
+            if (pEntry->type == DNS_RRTYPE_AAAA) {
+              SMEMCPY(&(pEntry->ip6addr), (pHostname+SIZEOF_DNS_ANSWER), sizeof(ip6_addr_t));
+            } else
+#endif /* LWIP_IPV6 */
+            {
+              SMEMCPY(&(pEntry->ipaddr), (pHostname+SIZEOF_DNS_ANSWER), sizeof(ip_addr_t));
+              LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", pEntry->name));
+              ip_addr_debug_print(DNS_DEBUG, (&(pEntry->ipaddr)));
+              LWIP_DEBUGF(DNS_DEBUG, ("\n"));
             }
+            /* call specified callback function if provided */
+            dns_call_found(pEntry, 1);
             if (pEntry->ttl == 0) {
               /* RFC 883, page 29: "Zero values are
                  interpreted to mean that the RR can only be used for the
@@ -931,9 +1022,7 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
 
 responseerr:
   /* ERROR: call specified callback function with NULL as name to indicate an error */
-  if (pEntry->found) {
-    (*pEntry->found)(pEntry->name, NULL, pEntry->arg);
-  }
+  dns_call_found(pEntry, 0);
 flushentry:
   /* flush this entry */
   pEntry->state = DNS_STATE_UNUSED;
@@ -950,12 +1039,18 @@ memerr:
  *
  * @param name the hostname that is to be queried
  * @param hostnamelen length of the hostname
+ * @param type DNS_RRTYPE_A or DNS_RRTYPE_AAAA
  * @param found a callback founction to be called on success, failure or timeout
+ * @param found6 the callback of an AAAA query, instead of found
  * @param callback_arg argument to pass to the callback function
  * @return @return a err_t return code.
  */
 static err_t
-dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
+dns_enqueue(const char *name, size_t hostnamelen, u8_t type,
+            dns_found_callback found,
+#if LWIP_IPV6
+            dns_found6_callback found6,
+#endif /* LWIP_IPV6 */
             void *callback_arg)
 {
   u8_t i;
@@ -999,7 +1094,11 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
   /* fill the entry */
   pEntry->state = DNS_STATE_NEW;
   pEntry->seqno = dns_seqno++;
+  pEntry->type  = type;
   pEntry->found = found;
+#if LWIP_IPV6
+  pEntry->found6 = found6;
+#endif /* LWIP_IPV6 */
   pEntry->arg   = callback_arg;
   namelen = LWIP_MIN(hostnamelen, DNS_MAX_NAME_LENGTH-1);
   MEMCPY(pEntry->name, name, namelen);
@@ -1081,7 +1180,58 @@ dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback foun
   }
 
   /* queue query with specified callback */
-  return dns_enqueue(hostname, hostnamelen, found, callback_arg);
+  return dns_enqueue(hostname, hostnamelen, DNS_RRTYPE_A, found,
+#if LWIP_IPV6
+                     NULL,
+#endif /* LWIP_IPV6 */
+                     callback_arg);
+}
+
+#if LWIP_IPV6
+/**
+ * Resolve a hostname (string) into an IPv6 address, with an AAAA query.
+ * Same as dns_gethostbyname() otherwise. The IPv4 and the IPv6 answers of a
+ * hostname are separate entries of the table, both queries can run at the
+ * same time.
+ *
+ * @param hostname the hostname that is to be queried
+ * @param addr pointer to a ip6_addr_t where to store the address if it is
+ *             already cached in the dns_table (only valid if ERR_OK is returned!)
+ * @param found a callback function to be called on success, failure or timeout (only if
+ *              ERR_INPROGRESS is returned!)
+ * @param callback_arg argument to pass to the callback function
+ * @return a err_t return code.
+ */
+err_t
+dns_gethostbyname6(const char *hostname, ip6_addr_t *addr, dns_found6_callback found,
+                   void *callback_arg)
+{
+  struct dns_table_entry *pEntry;
+  size_t hostnamelen;
+
+  if ((dns_pcb == NULL) || (addr == NULL) ||
+      (!hostname) || (!hostname[0])) {
+    return ERR_ARG;
+  }
+  hostnamelen = strlen(hostname);
+  if (hostnamelen >= DNS_MAX_NAME_LENGTH) {
+    return ERR_ARG;
+  }
+
+  /* host name already in IPv6 notation? */
+  if (ip6addr_aton(hostname, addr)) {
+    return ERR_OK;
+  }
+  pEntry = dns_lookup_entry(hostname, DNS_RRTYPE_AAAA);
+  if (pEntry != NULL) {
+    ip6_addr_copy(*addr, pEntry->ip6addr);
+    return ERR_OK;
+  }
+
+  /* queue query with specified callback */
+  return dns_enqueue(hostname, hostnamelen, DNS_RRTYPE_AAAA, NULL, found,
+                     callback_arg);
 }
+#endif /* LWIP_IPV6 */
 
 #endif /* LWIP_DNS */
@@ -172,6 +172,85 @@ pbuf_pool_is_empty(void)
 }
 #endif /* !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ */
 
+#if PBUF_POOL_BORROW
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "PBUF_POOL_BORROW needs LWIP_SUPPORT_CUSTOM_PBUF"
+#endif
+
+struct pbuf_borrow_stats pbuf_borrow_stats;
+
+/** A PBUF_POOL pbuf taken from the system heap, its payload follows */
+struct pbuf_borrowed {
+  struct pbuf_custom pc;
+  u32_t size;
+};
+
+#define SIZEOF_STRUCT_PBUF_BORROWED LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf_borrowed))
+
+void
+pbuf_pool_borrow(s32_t delta)
+{
+  SYS_ARCH_DECL_PROTECT(old_level);
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_borrow_stats.limit += delta;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+static void
+pbuf_borrowed_free(struct pbuf *p)
+{
+  struct pbuf_borrowed *b = (struct pbuf_borrowed *)p;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_borrow_stats.used -= b->size;
+  SYS_ARCH_UNPROTECT(old_level);
+  PBUF_BORROW_FREE(b);
+}
+
+/**
+ * Allocate a PBUF_POOL request from the system heap, in one pbuf. It is a
+ * PBUF_REF custom pbuf, so that pbuf_header() does not grow it over its
+ * bookkeeping.
+ */
+static struct pbuf *
+pbuf_alloc_borrowed(pbuf_layer layer, u16_t offset, u16_t length)
+{
+  struct pbuf_borrowed *b;
+  u32_t size = SIZEOF_STRUCT_PBUF_BORROWED + LWIP_MEM_ALIGN_SIZE(offset) +
+    LWIP_MEM_ALIGN_SIZE(length);
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  if (pbuf_borrow_stats.used + size > pbuf_borrow_stats.limit) {
+    if (pbuf_borrow_stats.limit) {
+      pbuf_borrow_stats.err++;
+    }
+    SYS_ARCH_UNPROTECT(old_level);
+    return NULL;
+  }
+  pbuf_borrow_stats.used += size;
+  if (pbuf_borrow_stats.used > pbuf_borrow_stats.max) {
+    pbuf_borrow_stats.max = pbuf_borrow_stats.used;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  b = (struct pbuf_borrowed *)PBUF_BORROW_MALLOC(size);
+  if (b == NULL) {
+    SYS_ARCH_PROTECT(old_level);
+    pbuf_borrow_stats.used -= size;
+    pbuf_borrow_stats.err++;
+    SYS_ARCH_UNPROTECT(old_level);
+    return NULL;
+  }
+  b->size = size;
+  b->pc.custom_free_function = pbuf_borrowed_free;
+  return pbuf_alloced_custom(layer, length, PBUF_REF, &b->pc,
+                             (u8_t *)b + SIZEOF_STRUCT_PBUF_BORROWED,
+                             (u16_t)(size - SIZEOF_STRUCT_PBUF_BORROWED));
+}
+#endif /* PBUF_POOL_BORROW */
+
 /**
  * Allocates a pbuf of the given type (possibly a chain for PBUF_POOL type).
  *
@@ -239,6 +318,12 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     p = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
     LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_alloc: allocated pbuf %p\n", (void *)p));
     if (p == NULL) {
+#if PBUF_POOL_BORROW
+      p = pbuf_alloc_borrowed(layer, offset, length);
+      if (p != NULL) {
+        return p;
+      }
+#endif /* PBUF_POOL_BORROW */
       PBUF_POOL_IS_EMPTY();
       return NULL;
     }
@@ -271,9 +356,15 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     while (rem_len > 0) {
       q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
       if (q == NULL) {
-        PBUF_POOL_IS_EMPTY();
         /* free chain so far allocated */
         pbuf_free(p);
+#if PBUF_POOL_BORROW
+        p = pbuf_alloc_borrowed(layer, offset, length);
+        if (p != NULL) {
+          return p;
+        }
+#endif /* PBUF_POOL_BORROW */
+        PBUF_POOL_IS_EMPTY();
         /* bail out unsuccesfully */
         return NULL;
       }
@@ -43,8 +43,13 @@
 #include "lwip/def.h"
 #include "lwip/stats.h"
 #include "lwip/mem.h"
+#include "lwip/sys.h"
+#include "lwip/tcp_impl.h"
+
+#include <string.h>
 
 struct stats_ lwip_stats;
+struct stats_tcp_ext lwip_stats_tcp_ext;
 
 void stats_init(void)
 {
@@ -74,4 +79,129 @@ int lwip_get_current_heap_use(void)
 {
 	return lwip_stats.mem.used;
 }
+
+static void net_stats_copy_pool(struct net_stats_pool *dst,
+                                const struct stats_mem *src)
+{
+	dst->avail = src->avail;
+	dst->used = src->used;
+	dst->max = src->max;
+	dst->err = src->err;
+}
+
+#if SYS_STATS
+static void net_stats_copy_sys(struct net_stats_pool *dst,
+                               const struct stats_syselem *src, u32_t avail)
+{
+	dst->avail = avail;
+	dst->used = src->used;
+	dst->max = src->max;
+	dst->err = src->err;
+}
+#endif /* SYS_STATS */
+
+void net_stats_get(struct net_stats *s)
+{
+	struct tcp_pcb *pcb;
+	struct net_stats_conn *c;
+	int i;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	memset(s, 0, sizeof(*s));
+
+	/* The tcpip thread does not run while this is protected, so the
+	 * counters are consistent and the pcb list stays in place */
+	SYS_ARCH_PROTECT(lev);
+#if MEM_STATS
+	net_stats_copy_pool(&s->heap, &lwip_stats.mem);
+#endif /* MEM_STATS */
+#if MEMP_STATS
+	for (i = 0; i < MEMP_MAX; i++)
+		net_stats_copy_pool(&s->memp[i], &lwip_stats.memp[i]);
+#endif /* MEMP_STATS */
+#if SYS_STATS
+	net_stats_copy_sys(&s->sys_mbox, &lwip_stats.sys.mbox, SYS_MAX_Q);
+	net_stats_copy_sys(&s->sys_sem, &lwip_stats.sys.sem, SYS_MAX_SEM);
+#endif /* SYS_STATS */
+#if PBUF_POOL_BORROW
+	s->pbuf_borrow.avail = pbuf_borrow_stats.limit;
+	s->pbuf_borrow.used = pbuf_borrow_stats.used;
+	s->pbuf_borrow.max = pbuf_borrow_stats.max;
+	s->pbuf_borrow.err = pbuf_borrow_stats.err;
+#endif /* PBUF_POOL_BORROW */
+#if TCP_STATS
+	s->tcp.xmit = lwip_stats.tcp.xmit;
+	s->tcp.recv = lwip_stats.tcp.recv;
+	s->tcp.drop = lwip_stats.tcp.drop;
+	s->tcp.chkerr = lwip_stats.tcp.chkerr;
+	s->tcp.memerr = lwip_stats.tcp.memerr;
+	s->tcp.proterr = lwip_stats.tcp.proterr;
+	s->tcp.err = lwip_stats.tcp.err;
+	s->tcp.rexmit_rto = lwip_stats_tcp_ext.rexmit_rto;
+	s->tcp.rexmit_fast = lwip_stats_tcp_ext.rexmit_fast;
+#endif /* TCP_STATS */
+	for (pcb = tcp_active_pcbs;
+	     pcb && s->num_conns < NET_STATS_MAX_CONNS; pcb = pcb->next) {
+		c = &s->conns[s->num_conns++];
+		if (!PCB_ISIPV6(pcb))
+			c->remote_ip = ip4_addr_get_u32(ipX_2_ip(&pcb->remote_ip));
+		c->local_port = pcb->local_port;
+		c->remote_port = pcb->remote_port;
+		c->srtt_ms = (u32_t) (pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+		c->rto_ms = (u32_t) pcb->rto * TCP_SLOW_INTERVAL;
+		c->snd_queuelen = pcb->snd_queuelen;
+		c->nrtx = pcb->nrtx;
+		c->state = pcb->state;
+	}
+	SYS_ARCH_UNPROTECT(lev);
+}
+
+#if MEMP_STATS
+/* Most of the heap and of every pool ever in use, to check the sizes set by
+ * the memory profile against a real work load. A pool with errors ran out */
+void lwip_mem_watermarks_display(void)
+{
+	static const char *const memp_names[] = {
+#define LWIP_MEMPOOL(name,num,size,desc) desc,
+#include "lwip/memp_std.h"
+	};
+	int i;
+
+	LWIP_PLATFORM_PRINT(("%-16s %6s %6s %6s %6s\r\n", "pool", "avail",
+			     "used", "max", "err"));
+#if MEM_STATS
+	LWIP_PLATFORM_PRINT(("%-16s %6u %6u %6u %6u\r\n", "HEAP",
+			     (unsigned) lwip_stats.mem.avail,
+			     (unsigned) lwip_stats.mem.used,
+			     (unsigned) lwip_stats.mem.max,
+			     (unsigned) lwip_stats.mem.err));
+#endif /* MEM_STATS */
+	for (i = 0; i < MEMP_MAX; i++)
+		LWIP_PLATFORM_PRINT(("%-16s %6u %6u %6u %6u\r\n",
+				     memp_names[i],
+				     (unsigned) lwip_stats.memp[i].avail,
+				     (unsigned) lwip_stats.memp[i].used,
+				     (unsigned) lwip_stats.memp[i].max,
+				     (unsigned) lwip_stats.memp[i].err));
+#if SYS_STATS
+	LWIP_PLATFORM_PRINT(("%-16s %6u %6u %6u %6u\r\n", "SYS_MBOX",
+			     (unsigned) SYS_MAX_Q,
+			     (unsigned) lwip_stats.sys.mbox.used,
+			     (unsigned) lwip_stats.sys.mbox.max,
+			     (unsigned) lwip_stats.sys.mbox.err));
+	LWIP_PLATFORM_PRINT(("%-16s %6u %6u %6u %6u\r\n", "SYS_SEM",
+			     (unsigned) SYS_MAX_SEM,
+			     (unsigned) lwip_stats.sys.sem.used,
+			     (unsigned) lwip_stats.sys.sem.max,
+			     (unsigned) lwip_stats.sys.sem.err));
+#endif /* SYS_STATS */
+#if PBUF_POOL_BORROW
+	LWIP_PLATFORM_PRINT(("%-16s %6u %6u %6u %6u\r\n", "PBUF_BORROW",
+			     (unsigned) pbuf_borrow_stats.limit,
+			     (unsigned) pbuf_borrow_stats.used,
+			     (unsigned) pbuf_borrow_stats.max,
+			     (unsigned) pbuf_borrow_stats.err));
+#endif /* PBUF_POOL_BORROW */
+}
+#endif /* MEMP_STATS */
 #endif /* LWIP_STATS */
@@ -175,7 +175,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   err_t err;
 
   if (rst_on_unacked_data && ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
-    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND)) {
+    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND_MAX(pcb))) {
       /* Not all data received by application, send RST to tell the remote
          side about this. */
       LWIP_ASSERT("pcb->flags & TF_RXCLOSED", pcb->flags & TF_RXCLOSED);
@@ -613,7 +613,7 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND_MAX(pcb) / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -652,15 +652,15 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     pcb->state != LISTEN);
 
   pcb->rcv_wnd += len;
-  if (pcb->rcv_wnd > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  if (pcb->rcv_wnd > TCP_WND_MAX(pcb)) {
+    pcb->rcv_wnd = TCP_WND_MAX(pcb);
   } else if(pcb->rcv_wnd == 0) {
     /* rcv_wnd overflowed */
     if ((pcb->state == CLOSE_WAIT) || (pcb->state == LAST_ACK)) {
       /* In passive close, we allow this, since the FIN bit is added to rcv_wnd
          by the stack itself, since it is not mandatory for an application
          to call tcp_recved() for the FIN bit, but e.g. the netconn API does so. */
-      pcb->rcv_wnd = TCP_WND;
+      pcb->rcv_wnd = TCP_WND_MAX(pcb);
     } else {
       LWIP_ASSERT("tcp_recved: len wrapped rcv_wnd\n", 0);
     }
@@ -678,7 +678,51 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
   }
 
   LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: received %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+         len, pcb->rcv_wnd, TCP_WND_MAX(pcb) - pcb->rcv_wnd));
+}
+
+/**
+ * Change the receive window of a connection, e.g. to take a bulk download
+ * at the link rate instead of one TCP_WND per round trip.
+ *
+ * The window is limited to 64 KB unless the peer agreed to window scaling,
+ * so it is set once connected. Data the application has not read yet stays
+ * counted against the new window, and the right edge already announced is
+ * never taken back.
+ *
+ * @param pcb the tcp_pcb, not listening
+ * @param wnd the new window, TCP_WND to go back to the default
+ * @return the window set
+ */
+tcpwnd_size_t
+tcp_set_rcv_wnd(struct tcp_pcb *pcb, tcpwnd_size_t wnd)
+{
+  tcpwnd_size_t unread;
+
+  LWIP_ASSERT("don't call tcp_set_rcv_wnd for listen-pcbs",
+    pcb->state != LISTEN);
+
+  if (wnd < TCP_WND) {
+    wnd = TCP_WND;
+  }
+#if LWIP_WND_SCALE
+  if (!(pcb->flags & TF_WND_SCALE)) {
+    wnd = LWIP_MIN(wnd, 0xffff);
+  } else {
+    wnd = LWIP_MIN(wnd, 0xffffUL << TCP_RCV_SCALE);
+  }
+#endif /* LWIP_WND_SCALE */
+
+  unread = pcb->rcv_wnd < TCP_WND_MAX(pcb) ? TCP_WND_MAX(pcb) - pcb->rcv_wnd : 0;
+  pcb->rcv_wnd_max = wnd;
+  pcb->rcv_wnd = wnd > unread ? wnd - unread : 0;
+
+  if ((tcp_update_rcv_ann_wnd(pcb) >= TCP_WND_UPDATE_THRESHOLD) &&
+      (pcb->state == ESTABLISHED)) {
+    tcp_ack_now(pcb);
+    tcp_output(pcb);
+  }
+  return wnd;
 }
 
 /**
@@ -789,8 +833,8 @@ tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->rcv_ann_wnd = TCP_WND;
+  pcb->rcv_wnd = TCP_WND_MAX(pcb);
+  pcb->rcv_ann_wnd = TCP_WND_MAX(pcb);
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -1160,7 +1204,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
          ) {
         /* correct rcv_wnd as the application won't call tcp_recved()
            for the FIN's seqno */
-        if (pcb->rcv_wnd != TCP_WND) {
+        if (pcb->rcv_wnd != TCP_WND_MAX(pcb)) {
           pcb->rcv_wnd++;
         }
         TCP_EVENT_CLOSED(pcb, err);
@@ -1379,6 +1423,7 @@ tcp_alloc(u8_t prio)
     pcb->snd_queuelen = 0;
     pcb->rcv_wnd = TCP_WND;
     pcb->rcv_ann_wnd = TCP_WND;
+    pcb->rcv_wnd_max = TCP_WND;
 #if LWIP_WND_SCALE
     /* snd_scale and rcv_scale are zero unless both sides agree to use scaling */
     pcb->snd_scale = 0;
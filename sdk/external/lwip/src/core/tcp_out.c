@@ -1334,6 +1334,7 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 
   /* increment number of retransmissions */
   ++pcb->nrtx;
+  TCP_EXT_STATS_INC(rexmit_rto);
 
   /* Don't take any RTT measurements after retransmitting. */
   pcb->rttest = 0;
@@ -1406,6 +1407,7 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
     tcp_rexmit(pcb);
+    TCP_EXT_STATS_INC(rexmit_fast);
 
     /* Set ssthresh to half of the minimum of the current
      * cwnd and the advertised window */
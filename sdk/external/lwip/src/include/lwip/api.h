@@ -213,6 +213,11 @@ struct netconn {
 #endif /* LWIP_SO_RCVBUF */
   /** flags holding more netconn-internal state, see NETCONN_FLAG_* defines */
   u8_t flags;
+#if PBUF_POOL_BORROW
+  /** TCP: bytes lent to PBUF_POOL for the TCP_BULK_WND window, given back
+      when the netconn is freed */
+  u32_t pool_borrow;
+#endif /* PBUF_POOL_BORROW */
 #if LWIP_TCP
   /** TCP: when data passed to netconn_write doesn't fit into the send buffer,
       this temporarily stores how much is already sent. */
@@ -240,6 +245,9 @@ struct netconn {
 #if LWIP_RECV_CB
 	void lwip_register_recv_cb(int s, netconn_recv_callback recv_callback, void *data);
 #endif
+/* netconn of socket s, for transports that take the pbufs of a socket
+ * themselves with netconn_recv_tcp_pbuf(). Do not mix with lwip_recv() */
+struct netconn *lwip_get_netconn(int s);
 
 /** Set conn->last_err to err but don't overwrite fatal errors */
 #define NETCONN_SET_SAFE_ERR(conn, err) do { \
@@ -35,6 +35,9 @@
 #define __LWIP_DNS_H__
 
 #include "lwip/opt.h"
+#if LWIP_IPV6
+#include "lwip/ip_addr.h"
+#endif /* LWIP_IPV6 */
 
 #if LWIP_DNS /* don't build if not configured for use in lwipopts.h */
 
@@ -62,6 +65,7 @@ extern "C" {
 #define DNS_RRTYPE_MINFO          14    /* mailbox or mail list information */
 #define DNS_RRTYPE_MX             15    /* mail exchange */
 #define DNS_RRTYPE_TXT            16    /* text strings */
+#define DNS_RRTYPE_AAAA           28    /* an IPv6 host address */
 
 /** DNS field CLASS used for "Resource Records" */
 #define DNS_RRCLASS_IN            1     /* the Internet */
@@ -109,6 +113,20 @@ void           dns_setserver(u8_t numdns, ip_addr_t *dnsserver);
 ip_addr_t      dns_getserver(u8_t numdns);
 err_t          dns_gethostbyname(const char *hostname, ip_addr_t *addr,
                                  dns_found_callback found, void *callback_arg);
+u32_t          dns_lookup_ttl(const char *name);
+
+#if LWIP_IPV6
+/** Callback which is invoked when the IPv6 address of a hostname is found,
+ * see dns_found_callback.
+ * @param ip6addr pointer to the IPv6 address of the hostname, or NULL if the
+ *        name has no AAAA record or could not be found.
+*/
+typedef void (*dns_found6_callback)(const char *name, ip6_addr_t *ip6addr, void *callback_arg);
+
+err_t          dns_gethostbyname6(const char *hostname, ip6_addr_t *addr,
+                                  dns_found6_callback found, void *callback_arg);
+u32_t          dns_lookup_ttl6(const char *name);
+#endif /* LWIP_IPV6 */
 
 #if DNS_LOCAL_HOSTLIST && DNS_LOCAL_HOSTLIST_IS_DYNAMIC
 int            dns_local_removehost(const char *hostname, const ip_addr_t *addr);
@@ -86,7 +86,18 @@
 #define SNMP_MSG_DEBUG                  LWIP_DBG_OFF
 #define SNMP_MIB_DEBUG                  LWIP_DBG_OFF
 #define DNS_DEBUG                       LWIP_DBG_OFF
-#define LWIP_COMPAT_MUTEX      		1
+#define LWIP_COMPAT_MUTEX      		0
+/**
+ * LWIP_TCPIP_CORE_LOCKING==1: netconn and socket calls take the core mutex
+ * and run in the calling thread instead of being posted to the tcp/ip thread
+ * and waited for, which costs two context switches a call. The stack the
+ * calling threads need grows by what the tcp/ip thread used for the call,
+ * the output path down to the driver. Received packets still go through the
+ * tcp/ip thread.
+ */
+#ifndef LWIP_TCPIP_CORE_LOCKING
+#define LWIP_TCPIP_CORE_LOCKING         1
+#endif
 /**
  * SYS_LIGHTWEIGHT_PROT==1: if you want inter-task protection for certain
  * critical regions during buffer allocation, deallocation and memory
@@ -112,6 +123,9 @@
  */
 #define TCP_SND_BUF (TCP_SND_BUF_COUNT * TCP_MSS)
 
+/* LWIP_PROFILE_* sizes of the CONFIG_LWIP_MEM_PROFILE_* option */
+#include "lwipopts_profile.h"
+
 /* Buffer size needed for TCP: Max. number of TCP sockets * Size of pbuf *
  * Max. number of TCP sender buffers per socket
  *
@@ -171,8 +185,12 @@
 /**
  * MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP segments.
  * (requires the LWIP_TCP option)
+ *
+ * Must be at least TCP_SND_QUEUELEN, the extra 4 are for the segments
+ * queued by the other connections meanwhile
  */
-#define MEMP_NUM_TCP_SEG                12
+#define MEMP_NUM_TCP_SEG                (LWIP_PROFILE_BUSY_CONNS * \
+	TCP_SND_QUEUELEN + 4)
 
 /**
  * MEMP_NUM_TCPIP_MSG_INPKT: the number of struct tcpip_msg, which are used
@@ -214,7 +232,7 @@
  * PBUF_POOL_SIZE: the number of buffers in the pbuf pool.
  */
 #ifndef FIT_FOR_PM3
-#define PBUF_POOL_SIZE                  20
+#define PBUF_POOL_SIZE                  LWIP_PROFILE_PBUF_POOL_SIZE
 #else
 #define PBUF_POOL_SIZE                  10
 #endif
@@ -281,7 +299,26 @@
  * TCP_WND: The size of a TCP window.  This must be at least
  * (2 * TCP_MSS) for things to work well
  **/
-#define TCP_WND                         (10 * TCP_MSS)
+#define TCP_WND                         (LWIP_PROFILE_TCP_WND_SEGS * TCP_MSS)
+
+/**
+ * LWIP_WND_SCALE: offer window scaling, so that a connection can be given a
+ * receive window above 64 KB with the TCP_BULK_WND socket option. The window
+ * is announced in units of 1 << TCP_RCV_SCALE bytes, up to 256 KB.
+ */
+#define LWIP_WND_SCALE                  1
+#define TCP_RCV_SCALE                   2
+
+/**
+ * PBUF_POOL_BORROW: when the pbuf pool is empty, allocate received frames
+ * from the system heap instead, up to the part of the TCP_BULK_WND windows
+ * above TCP_WND. The memory is only taken while a bulk download holds more
+ * data than the pool, and nothing is lent when no socket asked for a bulk
+ * window.
+ */
+#define PBUF_POOL_BORROW                1
+#define PBUF_BORROW_MALLOC(size)        pvPortMalloc(size)
+#define PBUF_BORROW_FREE(ptr)           vPortFree(ptr)
 
 /**
  * Enable TCP_KEEPALIVE
@@ -312,6 +349,14 @@
  * LWIP_DHCP==1: Enable DHCP module.
  */
 #define LWIP_DHCP                       1
+
+/**
+ * The last lease is kept in the retention RAM, zeroed at power on only, so
+ * that a device waking up from PM4 asks for its address again with one
+ * request instead of a full discovery and ARP check.
+ */
+#define LWIP_DHCP_LEASE_CACHE           1
+#define LWIP_DHCP_LEASE_CACHE_SECTION   __attribute__((section(".nvram")))
 #define LWIP_NETIF_STATUS_CALLBACK      1
 
 /**
@@ -0,0 +1,33 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Memory profiles of the stack, shared by lwipopts.h and the host
+ * benchmark of test/bench so that both size their pools the same way.
+ */
+
+#ifndef __LWIPOPTS_PROFILE_H__
+#define __LWIPOPTS_PROFILE_H__
+
+/* Sizes chosen by the CONFIG_LWIP_MEM_PROFILE_* option: the number of pbufs
+ * in the pool, the receive window, in segments, for which the pool has to
+ * have room, and the number of connections whose full send queue fits in
+ * the pool of TCP segments at the same time
+ */
+#if defined(CONFIG_LWIP_MEM_PROFILE_LOW_MEMORY)
+#define LWIP_PROFILE_PBUF_POOL_SIZE	10
+#define LWIP_PROFILE_TCP_WND_SEGS	4
+#define LWIP_PROFILE_BUSY_CONNS		1
+#elif defined(CONFIG_LWIP_MEM_PROFILE_THROUGHPUT)
+#define LWIP_PROFILE_PBUF_POOL_SIZE	24
+#define LWIP_PROFILE_TCP_WND_SEGS	16
+#define LWIP_PROFILE_BUSY_CONNS		2
+#else
+#define LWIP_PROFILE_PBUF_POOL_SIZE	20
+#define LWIP_PROFILE_TCP_WND_SEGS	10
+#define LWIP_PROFILE_BUSY_CONNS		1
+#endif
+
+#endif /* __LWIPOPTS_PROFILE_H__ */
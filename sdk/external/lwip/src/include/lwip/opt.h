@@ -736,6 +736,20 @@
 #define DHCP_DOES_ARP_CHECK             ((LWIP_DHCP) && (LWIP_ARP))
 #endif
 
+/**
+ * LWIP_DHCP_LEASE_CACHE==1: Keep the address of the last lease and ask for
+ * it again when DHCP is started (INIT-REBOOT, RFC 2131 3.2) instead of
+ * discovering a server. The cache is placed in LWIP_DHCP_LEASE_CACHE_SECTION,
+ * memory which outlives the restarts of the stack.
+ */
+#ifndef LWIP_DHCP_LEASE_CACHE
+#define LWIP_DHCP_LEASE_CACHE           0
+#endif
+
+#ifndef LWIP_DHCP_LEASE_CACHE_SECTION
+#define LWIP_DHCP_LEASE_CACHE_SECTION
+#endif
+
 /*
    ------------------------------------
    ---------- AUTOIP options ----------
@@ -1157,6 +1171,15 @@
    ---------- Pbuf options ----------
    ----------------------------------
 */
+/**
+ * PBUF_POOL_BORROW==1: let pbuf_alloc() take PBUF_POOL pbufs from
+ * PBUF_BORROW_MALLOC() when the pool is empty, up to the amount lent with
+ * pbuf_pool_borrow().
+ */
+#ifndef PBUF_POOL_BORROW
+#define PBUF_POOL_BORROW                0
+#endif
+
 /**
  * PBUF_LINK_HLEN: the number of bytes that should be allocated for a
  * link level header. The default is 14, the standard value for
@@ -129,6 +129,22 @@ struct pbuf_custom {
 };
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
 
+#if PBUF_POOL_BORROW
+/** PBUF_POOL pbufs allocated from the system heap, see PBUF_POOL_BORROW */
+struct pbuf_borrow_stats {
+  u32_t limit;   /* Bytes that may be borrowed, the sum of pbuf_pool_borrow(). */
+  u32_t used;    /* Borrowed now, with the pbuf headers. */
+  u32_t max;     /* Most ever borrowed. */
+  u32_t err;     /* Allocations refused while something could be borrowed. */
+};
+
+extern struct pbuf_borrow_stats pbuf_borrow_stats;
+
+/** Raise (delta > 0) or lower the amount PBUF_POOL allocations may borrow
+    from the system heap once the pool is empty. Thread safe. */
+void pbuf_pool_borrow(s32_t delta);
+#endif /* PBUF_POOL_BORROW */
+
 #if LWIP_TCP && TCP_QUEUE_OOSEQ
 /** Define this to 0 to prevent freeing ooseq pbufs when the PBUF_POOL is empty */
 #ifndef PBUF_POOL_FREE_OOSEQ
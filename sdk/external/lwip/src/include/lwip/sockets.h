@@ -227,6 +227,7 @@ struct linger {
 #define TCP_KEEPIDLE   0x03    /* set pcb->keep_idle  - Same as TCP_KEEPALIVE, but use seconds for get/setsockopt */
 #define TCP_KEEPINTVL  0x04    /* set pcb->keep_intvl - Use seconds for get/setsockopt */
 #define TCP_KEEPCNT    0x05    /* set pcb->keep_cnt   - Use number of probes sent for get/setsockopt */
+#define TCP_BULK_WND   0x06    /* receive window in bytes for a bulk download, 0 for TCP_WND - see tcp_set_rcv_wnd() */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV6
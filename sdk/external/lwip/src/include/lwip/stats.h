@@ -163,6 +163,15 @@ struct stats_ {
 
 extern struct stats_ lwip_stats;
 
+/* TCP counters kept out of lwip_stats, whose layout the SDK library
+ * is built against */
+struct stats_tcp_ext {
+  STAT_COUNTER rexmit_rto;       /* Retransmission timeouts. */
+  STAT_COUNTER rexmit_fast;      /* Fast retransmits after three dupacks. */
+};
+
+extern struct stats_tcp_ext lwip_stats_tcp_ext;
+
 void stats_init(void);
 
 #define STATS_INC(x) ++lwip_stats.x
@@ -181,9 +190,11 @@ void stats_init(void);
 
 #if TCP_STATS
 #define TCP_STATS_INC(x) STATS_INC(x)
+#define TCP_EXT_STATS_INC(x) ++lwip_stats_tcp_ext.x
 #define TCP_STATS_DISPLAY() stats_display_proto(&lwip_stats.tcp, "TCP")
 #else
 #define TCP_STATS_INC(x)
+#define TCP_EXT_STATS_INC(x)
 #define TCP_STATS_DISPLAY()
 #endif
 
@@ -325,6 +336,61 @@ void stats_init(void);
 
 int lwip_get_total_heap(void);
 int lwip_get_current_heap_use(void);
+/* Print the high water marks of the heap and the memory pools */
+void lwip_mem_watermarks_display(void);
+
+#if LWIP_STATS
+/* Maximum number of connections in a struct net_stats */
+#define NET_STATS_MAX_CONNS CONFIG_MAX_SOCKETS_TCP
+
+/* Usage of the heap or of a memory pool */
+struct net_stats_pool {
+  u32_t avail;                   /* Size of the heap, or of the pool in elements. */
+  u32_t used;                    /* In use now. */
+  u32_t max;                     /* Most ever in use. */
+  u32_t err;                     /* Allocations that failed. */
+};
+
+/* State of an active TCP connection. lwIP measures the round trip time
+ * in slow timer ticks, so the times are multiples of TCP_SLOW_INTERVAL */
+struct net_stats_conn {
+  u32_t remote_ip;               /* Peer address, 0 for IPv6, network byte order. */
+  u16_t local_port;
+  u16_t remote_port;
+  u32_t srtt_ms;                 /* Smoothed round trip time. */
+  u32_t rto_ms;                  /* Current retransmission timeout. */
+  u16_t snd_queuelen;            /* pbufs queued for sending. */
+  u8_t nrtx;                     /* Retransmissions of the current segment. */
+  u8_t state;                    /* enum tcp_state. */
+};
+
+/* Snapshot of the counters of the stack, filled by net_stats_get(). The
+ * counters run from boot, subtract two snapshots for a rate */
+struct net_stats {
+  struct net_stats_pool heap;
+  struct net_stats_pool memp[MEMP_MAX]; /* Indexed by memp_t, e.g. MEMP_PBUF_POOL. */
+  struct net_stats_pool sys_mbox;      /* Mailboxes of the port, avail is SYS_MAX_Q. */
+  struct net_stats_pool sys_sem;       /* Semaphores of the port, avail is SYS_MAX_SEM. */
+  struct net_stats_pool pbuf_borrow;   /* Bytes of PBUF_POOL pbufs from the system heap, avail is the limit. */
+  struct {
+    u32_t xmit;
+    u32_t recv;
+    u32_t drop;
+    u32_t chkerr;
+    u32_t memerr;
+    u32_t proterr;
+    u32_t err;
+    u32_t rexmit_rto;
+    u32_t rexmit_fast;
+  } tcp;
+  u16_t num_conns;               /* Valid entries of conns. */
+  struct net_stats_conn conns[NET_STATS_MAX_CONNS];
+};
+
+/* Copy the counters into s. Takes a few microseconds in a critical
+ * section, can be called from any task but not from an interrupt */
+void net_stats_get(struct net_stats *s);
+#endif /* LWIP_STATS */
 
 /* Display of statistics */
 #if LWIP_STATS_DISPLAY
@@ -137,6 +137,9 @@ typedef u16_t tcpwnd_size_t;
 typedef u8_t tcpflags_t;
 #endif
 
+/** Receive window of a connection when the application read all data */
+#define TCP_WND_MAX(pcb) ((pcb)->rcv_wnd_max)
+
 enum tcp_state {
   CLOSED      = 0,
   LISTEN      = 1,
@@ -214,6 +217,7 @@ struct tcp_pcb {
   tcpwnd_size_t rcv_wnd;   /* receiver window available */
   tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+  tcpwnd_size_t rcv_wnd_max; /* TCP_WND unless changed by tcp_set_rcv_wnd() */
 
   /* Retransmission timer. */
   s16_t rtime;
@@ -364,6 +368,7 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 #endif /* TCP_LISTEN_BACKLOG */
 
 void             tcp_recved  (struct tcp_pcb *pcb, u16_t len);
+tcpwnd_size_t    tcp_set_rcv_wnd(struct tcp_pcb *pcb, tcpwnd_size_t wnd);
 err_t            tcp_bind    (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
                               u16_t port);
 err_t            tcp_connect (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
@@ -0,0 +1,48 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/* Host architecture of the benchmark, a little endian 32 or 64 bit machine */
+
+#ifndef __CC_H__
+#define __CC_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef uint8_t   u8_t;
+typedef int8_t    s8_t;
+typedef uint16_t  u16_t;
+typedef int16_t   s16_t;
+typedef uint32_t  u32_t;
+typedef int32_t   s32_t;
+typedef uintptr_t mem_ptr_t;
+typedef int sys_prot_t;
+
+#define U16_F "hu"
+#define X16_F "hx"
+#define S16_F "hd"
+#define U32_F "u"
+#define X32_F "x"
+#define S32_F "d"
+#define SZT_F "zu"
+
+#ifndef BYTE_ORDER
+#define BYTE_ORDER LITTLE_ENDIAN
+#endif
+
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_END
+#define PACK_STRUCT_FIELD(x) x
+
+#define LWIP_PLATFORM_DIAG(x) do { printf x; } while (0)
+#define LWIP_PLATFORM_PRINT(x) do { printf x; } while (0)
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "Assertion \"%s\" failed at line %d in %s\n", \
+                                     x, __LINE__, __FILE__); abort(); } while (0)
+
+#define LWIP_RAND() ((u32_t)rand())
+
+#endif /* __CC_H__ */
@@ -0,0 +1,595 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Host benchmark of the TCP configuration of the stack.
+ *
+ * Two network interfaces of one lwIP instance, 10.0.0.1 and 10.0.0.2, are
+ * joined by a simulated link with a one way delay, a rate and a loss ratio.
+ * A client on the first one talks to a server on the second one over the
+ * raw API, the way the sockets of the firmware do: data is copied into the
+ * send queue and frames arriving on an interface are copied into pbufs of
+ * the pool, as the Wi-Fi driver does, or dropped when the pool is empty.
+ * Time is simulated, so a run gives the same numbers on any host and only
+ * measures what the options of lwipopts.h and the link change.
+ *
+ * Two tests are run:
+ * - bulk: the client sends a number of bytes as fast as its send buffer
+ *   allows, the throughput is measured at the server;
+ * - latency: the client sends small messages which the server echoes back,
+ *   one at a time, and the round trips are measured.
+ *
+ * lwIP keeps its pools in globals, so both ends share them. The client
+ * takes the TCP segments and the heap of the send queue, the server the
+ * pbufs of the pool of what it receives, the acknowledgements aside; the
+ * high water marks printed are those of the run.
+ *
+ * The Makefile builds one binary per memory profile of
+ * lwipopts_profile.h, "make run ARGS='-d 20 -l 1'" runs them all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/tcp.h"
+#include "lwip/timers.h"
+
+#if defined(CONFIG_LWIP_MEM_PROFILE_LOW_MEMORY)
+#define BENCH_PROFILE "low_memory"
+#elif defined(CONFIG_LWIP_MEM_PROFILE_THROUGHPUT)
+#define BENCH_PROFILE "throughput"
+#else
+#define BENCH_PROFILE "balanced"
+#endif
+
+/* Resolution of the simulated clock */
+#define BENCH_STEP_US        100
+/* A test not done after this long is reported stalled */
+#define BENCH_LIMIT_US       (600 * 1000000ULL)
+#define BENCH_PORT           5001
+#define BENCH_MAX_MSG        1024
+#define BENCH_MAX_ROUNDS     10000
+
+struct bench_pkt {
+  struct bench_pkt *next;
+  unsigned long long due_us;
+  u16_t len;
+  u8_t data[1];
+};
+
+/* One direction of the link */
+struct bench_link {
+  struct netif *to;
+  struct bench_pkt *head;
+  struct bench_pkt *tail;
+  unsigned long long busy_until_us;
+  u32_t sent;
+  u32_t lost;
+  u32_t no_pbuf;
+};
+
+struct bench_cfg {
+  u32_t delay_ms;
+  u32_t rate_kbps;
+  u32_t loss_ppm;
+  u32_t bulk_bytes;
+  u32_t msg_len;
+  u32_t rounds;
+  int nodelay;
+  unsigned seed;
+};
+
+static struct bench_cfg cfg = {
+  10, 10000, 0, 512 * 1024, 64, 200, 0, 1
+};
+
+static unsigned long long now_us;
+static struct netif netif_client, netif_server;
+static struct bench_link link_to_client, link_to_server;
+static u32_t rand_state;
+static u8_t pattern[TCP_SND_BUF];
+
+/* Client and server state of a test */
+static struct {
+  struct tcp_pcb *client;
+  struct tcp_pcb *server;
+  int connected;
+  int failed;
+  /* bulk */
+  u32_t to_send;
+  u32_t received;
+  /* latency */
+  u32_t msg_echoed;
+  u32_t msg_got;
+  u32_t round;
+  unsigned long long round_start_us;
+  u32_t rtt_us[BENCH_MAX_ROUNDS];
+} t;
+
+u32_t
+sys_now(void)
+{
+  return (u32_t)(now_us / 1000);
+}
+
+static u32_t
+bench_rand(void)
+{
+  rand_state = rand_state * 1103515245 + 12345;
+  return rand_state >> 8;
+}
+
+static err_t
+bench_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+  struct bench_link *link;
+  struct bench_pkt *pkt;
+  unsigned long long start_us;
+
+  LWIP_UNUSED_ARG(netif);
+  link = ip_addr_cmp(ipaddr, &netif_server.ip_addr) ? &link_to_server : &link_to_client;
+  link->sent++;
+
+  /* The frame takes the link even when it is lost on the way */
+  start_us = now_us > link->busy_until_us ? now_us : link->busy_until_us;
+  if (cfg.rate_kbps) {
+    link->busy_until_us = start_us + (unsigned long long)p->tot_len * 8 * 1000 / cfg.rate_kbps;
+  } else {
+    link->busy_until_us = start_us;
+  }
+  if (cfg.loss_ppm && bench_rand() % 1000000 < cfg.loss_ppm) {
+    link->lost++;
+    return ERR_OK;
+  }
+
+  pkt = (struct bench_pkt *)malloc(sizeof(*pkt) + p->tot_len);
+  if (pkt == NULL) {
+    return ERR_MEM;
+  }
+  pkt->next = NULL;
+  pkt->due_us = link->busy_until_us + (unsigned long long)cfg.delay_ms * 1000;
+  pkt->len = p->tot_len;
+  pbuf_copy_partial(p, pkt->data, p->tot_len, 0);
+  if (link->tail) {
+    link->tail->next = pkt;
+  } else {
+    link->head = pkt;
+  }
+  link->tail = pkt;
+  return ERR_OK;
+}
+
+/* Hand the frames which arrived to the stack, copied into the pbuf pool */
+static void
+bench_link_deliver(struct bench_link *link)
+{
+  struct bench_pkt *pkt;
+  struct pbuf *p;
+
+  while ((pkt = link->head) != NULL && pkt->due_us <= now_us) {
+    link->head = pkt->next;
+    if (link->head == NULL) {
+      link->tail = NULL;
+    }
+    p = pbuf_alloc(PBUF_RAW, pkt->len, PBUF_POOL);
+    if (p == NULL) {
+      link->no_pbuf++;
+    } else {
+      pbuf_take(p, pkt->data, pkt->len);
+      if (link->to->input(p, link->to) != ERR_OK) {
+        pbuf_free(p);
+      }
+    }
+    free(pkt);
+  }
+}
+
+static void
+bench_link_flush(struct bench_link *link)
+{
+  struct bench_pkt *pkt;
+
+  while ((pkt = link->head) != NULL) {
+    link->head = pkt->next;
+    free(pkt);
+  }
+  link->tail = NULL;
+  link->busy_until_us = 0;
+  link->sent = link->lost = link->no_pbuf = 0;
+}
+
+static err_t
+bench_netif_init(struct netif *netif)
+{
+  netif->output = bench_output;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_UP | NETIF_FLAG_LINK_UP;
+  return ERR_OK;
+}
+
+/* Run the stack until done() or the time limit, 0 if it stalled */
+static int
+bench_run(int (*done)(void))
+{
+  unsigned long long limit_us = now_us + BENCH_LIMIT_US;
+
+  while (!done() && !t.failed) {
+    if (now_us >= limit_us) {
+      return 0;
+    }
+    now_us += BENCH_STEP_US;
+    bench_link_deliver(&link_to_server);
+    bench_link_deliver(&link_to_client);
+    sys_check_timeouts();
+  }
+  return !t.failed;
+}
+
+static void
+bench_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  fprintf(stderr, "connection failed: %d\n", err);
+  t.client = NULL;
+  t.failed = 1;
+}
+
+/* ---- bulk ---- */
+
+static void
+bulk_fill(struct tcp_pcb *pcb)
+{
+  u16_t n;
+
+  while (t.to_send > 0 && (n = tcp_sndbuf(pcb)) > 0) {
+    if (n > t.to_send) {
+      n = (u16_t)t.to_send;
+    }
+    if (n > sizeof(pattern)) {
+      n = sizeof(pattern);
+    }
+    if (tcp_write(pcb, pattern, n, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+      /* Out of segments or heap, the next ACK makes room */
+      break;
+    }
+    t.to_send -= n;
+  }
+  tcp_output(pcb);
+}
+
+static err_t
+bulk_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(len);
+  bulk_fill(pcb);
+  return ERR_OK;
+}
+
+static err_t
+bulk_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    return ERR_OK;
+  }
+  t.received += p->tot_len;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static int
+bulk_done(void)
+{
+  return t.received >= cfg.bulk_bytes;
+}
+
+/* ---- latency ---- */
+
+static void
+latency_send(struct tcp_pcb *pcb)
+{
+  t.msg_got = 0;
+  t.round_start_us = now_us;
+  tcp_write(pcb, pattern, (u16_t)cfg.msg_len, TCP_WRITE_FLAG_COPY);
+  tcp_output(pcb);
+}
+
+static err_t
+latency_client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    return ERR_OK;
+  }
+  t.msg_got += p->tot_len;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  if (t.msg_got >= cfg.msg_len) {
+    t.rtt_us[t.round++] = (u32_t)(now_us - t.round_start_us);
+    if (t.round < cfg.rounds) {
+      latency_send(pcb);
+    }
+  }
+  return ERR_OK;
+}
+
+static err_t
+latency_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  u32_t n;
+
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    return ERR_OK;
+  }
+  tcp_recved(pcb, p->tot_len);
+  n = p->tot_len;
+  pbuf_free(p);
+  /* Echo once the whole message is in, like a request answered */
+  t.msg_echoed += n;
+  if (t.msg_echoed >= cfg.msg_len) {
+    t.msg_echoed -= cfg.msg_len;
+    tcp_write(pcb, pattern, (u16_t)cfg.msg_len, TCP_WRITE_FLAG_COPY);
+    tcp_output(pcb);
+  }
+  return ERR_OK;
+}
+
+static int
+latency_done(void)
+{
+  return t.round >= cfg.rounds;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+  u32_t x = *(const u32_t *)a, y = *(const u32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* ---- connection set up ---- */
+
+static tcp_recv_fn server_recv;
+static tcp_recv_fn client_recv;
+
+static err_t
+server_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  t.server = pcb;
+  tcp_recv(pcb, server_recv);
+  if (cfg.nodelay) {
+    tcp_nagle_disable(pcb);
+  }
+  return ERR_OK;
+}
+
+static err_t
+client_connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  t.connected = 1;
+  return ERR_OK;
+}
+
+static int
+connected_done(void)
+{
+  return t.connected && t.server != NULL;
+}
+
+static void
+stats_reset(void)
+{
+  int i;
+
+  lwip_stats.mem.max = lwip_stats.mem.used;
+  lwip_stats.mem.err = 0;
+  for (i = 0; i < MEMP_MAX; i++) {
+    lwip_stats.memp[i].max = lwip_stats.memp[i].used;
+    lwip_stats.memp[i].err = 0;
+  }
+  memset(&lwip_stats.tcp, 0, sizeof(lwip_stats.tcp));
+  link_to_server.sent = link_to_server.lost = link_to_server.no_pbuf = 0;
+  link_to_client.sent = link_to_client.lost = link_to_client.no_pbuf = 0;
+}
+
+static void
+stats_print(void)
+{
+  printf("  segments %u/%u  pbuf pool %u/%u  heap %u/%u  errors seg %u heap %u\n",
+         (unsigned)lwip_stats.memp[MEMP_TCP_SEG].max, (unsigned)MEMP_NUM_TCP_SEG,
+         (unsigned)lwip_stats.memp[MEMP_PBUF_POOL].max, (unsigned)PBUF_POOL_SIZE,
+         (unsigned)lwip_stats.mem.max, (unsigned)MEM_SIZE,
+         (unsigned)lwip_stats.memp[MEMP_TCP_SEG].err, (unsigned)lwip_stats.mem.err);
+  printf("  frames %u/%u  lost %u/%u  dropped without pbuf %u/%u  tcp drops %u\n",
+         (unsigned)link_to_server.sent, (unsigned)link_to_client.sent,
+         (unsigned)link_to_server.lost, (unsigned)link_to_client.lost,
+         (unsigned)link_to_server.no_pbuf, (unsigned)link_to_client.no_pbuf,
+         (unsigned)lwip_stats.tcp.drop);
+}
+
+/* Open a connection for a test, 0 if it could not be */
+static int
+bench_connect(tcp_recv_fn srv_recv, tcp_recv_fn cli_recv, tcp_sent_fn cli_sent)
+{
+  struct tcp_pcb *listen;
+
+  memset(&t, 0, sizeof(t));
+  server_recv = srv_recv;
+  client_recv = cli_recv;
+
+  listen = tcp_new();
+  if (listen == NULL || tcp_bind(listen, &netif_server.ip_addr, BENCH_PORT) != ERR_OK) {
+    return 0;
+  }
+  listen = tcp_listen(listen);
+  tcp_accept(listen, server_accept);
+
+  t.client = tcp_new();
+  if (t.client == NULL) {
+    tcp_close(listen);
+    return 0;
+  }
+  tcp_bind(t.client, &netif_client.ip_addr, 0);
+  tcp_err(t.client, bench_err);
+  tcp_recv(t.client, client_recv);
+  tcp_sent(t.client, cli_sent);
+  if (cfg.nodelay) {
+    tcp_nagle_disable(t.client);
+  }
+  tcp_connect(t.client, &netif_server.ip_addr, BENCH_PORT, client_connected);
+  if (!bench_run(connected_done)) {
+    tcp_close(listen);
+    return 0;
+  }
+  tcp_close(listen);
+  stats_reset();
+  return 1;
+}
+
+static void
+bench_disconnect(void)
+{
+  if (t.client) {
+    tcp_err(t.client, NULL);
+    tcp_abort(t.client);
+  }
+  if (t.server) {
+    tcp_abort(t.server);
+  }
+  bench_link_flush(&link_to_server);
+  bench_link_flush(&link_to_client);
+}
+
+static int
+bench_bulk(void)
+{
+  unsigned long long start_us, us;
+  int ok;
+
+  if (!bench_connect(bulk_server_recv, NULL, bulk_sent)) {
+    printf("bulk: no connection\n");
+    return 0;
+  }
+  start_us = now_us;
+  t.to_send = cfg.bulk_bytes;
+  bulk_fill(t.client);
+  ok = bench_run(bulk_done);
+  us = now_us - start_us;
+
+  if (ok) {
+    printf("bulk %u bytes: %.1f ms, %.1f kbit/s\n", (unsigned)cfg.bulk_bytes,
+           us / 1000.0, (double)cfg.bulk_bytes * 8 * 1000 / us);
+  } else {
+    printf("bulk %u bytes: stalled after %u bytes\n", (unsigned)cfg.bulk_bytes,
+           (unsigned)t.received);
+  }
+  stats_print();
+  bench_disconnect();
+  return ok;
+}
+
+static int
+bench_latency(void)
+{
+  unsigned long long sum = 0;
+  u32_t i;
+  int ok;
+
+  if (!bench_connect(latency_server_recv, latency_client_recv, NULL)) {
+    printf("latency: no connection\n");
+    return 0;
+  }
+  latency_send(t.client);
+  ok = bench_run(latency_done);
+
+  if (ok) {
+    for (i = 0; i < t.round; i++) {
+      sum += t.rtt_us[i];
+    }
+    qsort(t.rtt_us, t.round, sizeof(t.rtt_us[0]), cmp_u32);
+    printf("latency %u x %u bytes: rtt avg %.2f ms, median %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           (unsigned)t.round, (unsigned)cfg.msg_len, sum / 1000.0 / t.round,
+           t.rtt_us[t.round / 2] / 1000.0, t.rtt_us[t.round * 99 / 100] / 1000.0,
+           t.rtt_us[t.round - 1] / 1000.0);
+  } else {
+    printf("latency %u x %u bytes: stalled after %u\n", (unsigned)cfg.rounds,
+           (unsigned)cfg.msg_len, (unsigned)t.round);
+  }
+  stats_print();
+  bench_disconnect();
+  return ok;
+}
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-d delay_ms] [-r rate_kbps] [-l loss_percent] [-b bulk_bytes]\n"
+          "          [-m msg_len] [-n rounds] [-N] [-s seed]\n"
+          "  -r 0 for a link without a rate limit, -N disables Nagle\n", name);
+  exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+  ip_addr_t addr, mask, gw;
+  int c, ok;
+
+  while ((c = getopt(argc, argv, "d:r:l:b:m:n:Ns:")) != -1) {
+    switch (c) {
+    case 'd': cfg.delay_ms = strtoul(optarg, NULL, 0); break;
+    case 'r': cfg.rate_kbps = strtoul(optarg, NULL, 0); break;
+    case 'l': cfg.loss_ppm = (u32_t)(strtod(optarg, NULL) * 10000); break;
+    case 'b': cfg.bulk_bytes = strtoul(optarg, NULL, 0); break;
+    case 'm': cfg.msg_len = strtoul(optarg, NULL, 0); break;
+    case 'n': cfg.rounds = strtoul(optarg, NULL, 0); break;
+    case 'N': cfg.nodelay = 1; break;
+    case 's': cfg.seed = strtoul(optarg, NULL, 0); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (cfg.msg_len == 0 || cfg.msg_len > BENCH_MAX_MSG || cfg.rounds == 0 ||
+      cfg.rounds > BENCH_MAX_ROUNDS || cfg.bulk_bytes == 0) {
+    usage(argv[0]);
+  }
+  rand_state = cfg.seed;
+  memset(pattern, 0x5a, sizeof(pattern));
+
+  lwip_init();
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+  IP4_ADDR(&gw, 0, 0, 0, 0);
+  IP4_ADDR(&addr, 10, 0, 0, 1);
+  netif_add(&netif_client, &addr, &mask, &gw, NULL, bench_netif_init, ip_input);
+  IP4_ADDR(&addr, 10, 0, 0, 2);
+  netif_add(&netif_server, &addr, &mask, &gw, NULL, bench_netif_init, ip_input);
+  link_to_server.to = &netif_server;
+  link_to_client.to = &netif_client;
+
+  printf("profile %s: window %u, send buffer %u, mss %u, delay %u ms, rate %u kbit/s, loss %.2f%%\n",
+         BENCH_PROFILE, (unsigned)TCP_WND, (unsigned)TCP_SND_BUF, (unsigned)TCP_MSS,
+         (unsigned)cfg.delay_ms, (unsigned)cfg.rate_kbps, cfg.loss_ppm / 10000.0);
+  ok = bench_bulk();
+  ok &= bench_latency();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Options of the host benchmark: the TCP and pool sizes of
+ * src/include/lwip/lwipopts.h for the memory profile selected with
+ * -DCONFIG_LWIP_MEM_PROFILE_LOW_MEMORY or -DCONFIG_LWIP_MEM_PROFILE_THROUGHPUT
+ * (balanced without either), on the raw API without an OS.
+ */
+
+#ifndef __LWIPOPTS_H__
+#define __LWIPOPTS_H__
+
+#define NO_SYS                          1
+#define LWIP_NETCONN                    0
+#define LWIP_SOCKET                     0
+#define LWIP_DHCP                       0
+#define LWIP_AUTOIP                     0
+#define LWIP_IGMP                       0
+#define LWIP_DNS                        0
+#define LWIP_IPV6                       0
+#define LWIP_ARP                        0
+#define LWIP_NOASSERT                   0
+
+/* Defaults of the Kconfig of the SDK */
+#ifndef MAX_SOCKETS_TCP
+#define MAX_SOCKETS_TCP                 8
+#endif
+#define CONFIG_MAX_SOCKETS_TCP          MAX_SOCKETS_TCP
+#ifndef MAX_SOCKETS_UDP
+#define MAX_SOCKETS_UDP                 6
+#endif
+#ifndef TCP_SND_BUF_COUNT
+#if defined(CONFIG_LWIP_MEM_PROFILE_THROUGHPUT)
+#define TCP_SND_BUF_COUNT               6
+#else
+#define TCP_SND_BUF_COUNT               2
+#endif
+#endif
+
+#include "lwip/lwipopts_profile.h"
+
+/* Sized as in the firmware, TCP_MSS is the default of opt.h */
+#define MEM_ALIGNMENT                   4
+#define PBUF_POOL_BUFSIZE               1580
+#define TCP_SND_BUF                     (TCP_SND_BUF_COUNT * TCP_MSS)
+#define MEM_SIZE                        (MAX_SOCKETS_TCP * PBUF_POOL_BUFSIZE * \
+                                         TCP_SND_BUF_COUNT + \
+                                         MAX_SOCKETS_UDP * PBUF_POOL_BUFSIZE)
+#define MEMP_NUM_PBUF                   10
+#define MEMP_NUM_TCP_PCB                MAX_SOCKETS_TCP
+#define MEMP_NUM_TCP_SEG                (LWIP_PROFILE_BUSY_CONNS * \
+                                         TCP_SND_QUEUELEN + 4)
+#define PBUF_POOL_SIZE                  LWIP_PROFILE_PBUF_POOL_SIZE
+#define TCP_WND                         (LWIP_PROFILE_TCP_WND_SEGS * TCP_MSS)
+#define LWIP_WND_SCALE                  1
+#define TCP_RCV_SCALE                   2
+#define LWIP_TCP_KEEPALIVE              1
+#define TCP_LISTEN_BACKLOG              1
+#define TCP_RESOURCE_FAIL_RETRY_LIMIT   50
+
+/* The pools of both ends are counted, see lwip_bench.c */
+#define LWIP_STATS                      1
+#define LWIP_STATS_DISPLAY              0
+#define MEM_STATS                       1
+#define MEMP_STATS                      1
+#define TCP_STATS                       1
+
+#endif /* __LWIPOPTS_H__ */
@@ -18,9 +18,12 @@
 #include <board.h>
 #include <lowlevel_drivers.h>
 
+/* cpu_clk.h changes it when it switches the system clock */
+int board_cpu_hz = 200000000;
+
 int board_cpu_freq()
 {
-	return 200000000;
+	return board_cpu_hz;
 }
 
 int board_32k_xtal()
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The asynchronous output's interrupt is used, it does not need the
+ * comparator's clock and so also wakes the core from the sleep of the
+ * tickless idle. Both comparators share one interrupt line, the low level
+ * handler calls the callback of the flag that is set.
+ */
+
+#include <wmerrno.h>
+#include <acomp_wake.h>
+
+#define ACOMP_WAKE_IRQ_PRIO 0xf
+
+static struct {
+	acomp_wake_cb_t cb;
+	void *arg;
+} acomp_wake[2];
+
+static ACOMP_INT_Type acomp_wake_int(ACOMP_ID_Type id)
+{
+	return ACOMP_ACOMP0 == id ? ACOMP_INT_OUTA_0 : ACOMP_INT_OUTA_1;
+}
+
+static void acomp_wake_fired(ACOMP_ID_Type id)
+{
+	ACOMP_IntMask(acomp_wake_int(id), MASK);
+	if (acomp_wake[id].cb)
+		acomp_wake[id].cb(id, acomp_wake[id].arg);
+}
+
+static void acomp_wake_cb0(void)
+{
+	acomp_wake_fired(ACOMP_ACOMP0);
+}
+
+static void acomp_wake_cb1(void)
+{
+	acomp_wake_fired(ACOMP_ACOMP1);
+}
+
+int acomp_wake_start(ACOMP_ID_Type id, ACOMP_IntTrig_Type trig,
+		     acomp_wake_cb_t cb, void *arg)
+{
+	if (id > ACOMP_ACOMP1 || !cb)
+		return -WM_E_INVAL;
+
+	ACOMP_IntMask(acomp_wake_int(id), MASK);
+	acomp_wake[id].cb = cb;
+	acomp_wake[id].arg = arg;
+
+	ACOMP_IntTrigSrcConfig(id, trig);
+	ACOMP_WakeUpIntTrigSrcConfig(id, trig);
+	install_int_callback(INT_ACOMP, acomp_wake_int(id),
+			     ACOMP_ACOMP0 == id ? acomp_wake_cb0 :
+			     acomp_wake_cb1);
+	NVIC_SetPriority(ACOMP_IRQn, ACOMP_WAKE_IRQ_PRIO);
+	NVIC_EnableIRQ(ACOMP_IRQn);
+	return WM_SUCCESS;
+}
+
+void acomp_wake_arm(ACOMP_ID_Type id)
+{
+	/* A flag raised while disarmed is stale */
+	ACOMP_IntClr(acomp_wake_int(id));
+	ACOMP_IntMask(acomp_wake_int(id), UNMASK);
+}
+
+void acomp_wake_disarm(ACOMP_ID_Type id)
+{
+	ACOMP_IntMask(acomp_wake_int(id), MASK);
+}
+
+void acomp_wake_stop(ACOMP_ID_Type id)
+{
+	ACOMP_IntMask(acomp_wake_int(id), MASK);
+	install_int_callback(INT_ACOMP, acomp_wake_int(id), NULL);
+	acomp_wake[id].cb = NULL;
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libacomp_wake
+libacomp_wake-objs-y := acomp_wake.c
@@ -0,0 +1,247 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The ring is a byte ring of records, head and tail count the bytes
+ * written and freed since the start. A record is built on the stack and
+ * copied in with the syscall interrupts masked, so that interrupt handlers
+ * can log too, freeing the oldest records until it fits. An export sets
+ * blog_paused, nothing changes the ring then and it is read unlocked.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include <blog.h>
+
+/* Room for 8 arguments of the largest kind */
+#define BLOG_MAX_ARGS_LEN (8 * (1 + BLOG_MAX_STR))
+
+static uint8_t blog_ring[BLOG_RING_SIZE];
+static uint32_t blog_head, blog_tail;
+static uint32_t blog_lost;
+static bool blog_paused;
+
+static void blog_copy_in(uint32_t pos, const void *src, uint32_t len)
+{
+	uint32_t off = pos & (BLOG_RING_SIZE - 1);
+	uint32_t first = BLOG_RING_SIZE - off;
+
+	if (first > len)
+		first = len;
+	memcpy(&blog_ring[off], src, first);
+	memcpy(blog_ring, (const uint8_t *)src + first, len - first);
+}
+
+static void blog_copy_out(uint32_t pos, void *dst, uint32_t len)
+{
+	uint32_t off = pos & (BLOG_RING_SIZE - 1);
+	uint32_t first = BLOG_RING_SIZE - off;
+
+	if (first > len)
+		first = len;
+	memcpy(dst, &blog_ring[off], first);
+	memcpy((uint8_t *)dst + first, blog_ring, len - first);
+}
+
+void blog_write(int level, uint32_t id, uint32_t sig, ...)
+{
+	uint8_t rec[sizeof(struct blog_rec) + BLOG_MAX_ARGS_LEN];
+	struct blog_rec *r = (struct blog_rec *)rec;
+	uint8_t *p = rec + sizeof(*r);
+	unsigned long state;
+	const char *s;
+	uint32_t v32;
+	uint64_t v64;
+	double d;
+	uint32_t k, n, len;
+	va_list ap;
+
+	va_start(ap, sig);
+	for (k = sig; k & 7; k >>= 3) {
+		switch (k & 7) {
+		case BLOG_ARG_32:
+			v32 = va_arg(ap, uint32_t);
+			memcpy(p, &v32, sizeof(v32));
+			p += sizeof(v32);
+			break;
+		case BLOG_ARG_64:
+			v64 = va_arg(ap, uint64_t);
+			memcpy(p, &v64, sizeof(v64));
+			p += sizeof(v64);
+			break;
+		case BLOG_ARG_DOUBLE:
+			d = va_arg(ap, double);
+			memcpy(p, &d, sizeof(d));
+			p += sizeof(d);
+			break;
+		case BLOG_ARG_STR:
+			s = va_arg(ap, const char *);
+			for (n = 0; s && n < BLOG_MAX_STR && s[n]; n++)
+				;
+			*p++ = n;
+			memcpy(p, s, n);
+			p += n;
+			break;
+		}
+	}
+	va_end(ap);
+
+	r->id = id;
+	r->ms = os_ticks_to_msec(os_ticks_get());
+	r->sig = sig;
+	r->level = level;
+	r->len = p - rec - sizeof(*r);
+	len = p - rec;
+
+	state = os_mask_syscall_interrupts();
+	if (blog_paused) {
+		blog_lost++;
+		os_unmask_syscall_interrupts(state);
+		return;
+	}
+	while (BLOG_RING_SIZE - (blog_head - blog_tail) < len) {
+		struct blog_rec old;
+
+		blog_copy_out(blog_tail, &old, sizeof(old));
+		blog_tail += sizeof(old) + old.len;
+		blog_lost++;
+	}
+	blog_copy_in(blog_head, rec, len);
+	blog_head += len;
+	os_unmask_syscall_interrupts(state);
+}
+
+int blog_export(blog_out_t out, void *ctx, bool consume)
+{
+	struct blog_hdr h;
+	uint8_t buf[64];
+	unsigned long state;
+	uint32_t pos, end, n;
+	int ret;
+
+	state = os_mask_syscall_interrupts();
+	blog_paused = true;
+	pos = blog_tail;
+	end = blog_head;
+	h.dropped = blog_lost;
+	os_unmask_syscall_interrupts(state);
+
+	h.magic = BLOG_MAGIC;
+	h.version = BLOG_VERSION;
+	h.hdr_size = sizeof(h);
+	h.len = end - pos;
+	ret = out(ctx, &h, sizeof(h));
+	while (ret == WM_SUCCESS && pos != end) {
+		n = end - pos;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		blog_copy_out(pos, buf, n);
+		ret = out(ctx, buf, n);
+		pos += n;
+	}
+
+	state = os_mask_syscall_interrupts();
+	if (ret == WM_SUCCESS && consume)
+		blog_tail = end;
+	blog_paused = false;
+	os_unmask_syscall_interrupts(state);
+	return ret;
+}
+
+#define BLOG_LINE_BYTES 32
+
+struct blog_console {
+	uint8_t line[BLOG_LINE_BYTES];
+	uint32_t len;
+};
+
+static void blog_console_flush(struct blog_console *c)
+{
+	char hex[BLOG_LINE_BYTES * 2 + 1];
+	uint32_t i;
+
+	if (!c->len)
+		return;
+	for (i = 0; i < c->len; i++)
+		snprintf(&hex[i * 2], 3, "%02x", c->line[i]);
+	wmprintf("blog %s\r\n", hex);
+	c->len = 0;
+}
+
+static int blog_console_out(void *ctx, const void *buf, uint32_t len)
+{
+	struct blog_console *c = ctx;
+	const uint8_t *p = buf;
+
+	while (len--) {
+		c->line[c->len++] = *p++;
+		if (c->len == BLOG_LINE_BYTES)
+			blog_console_flush(c);
+	}
+	return WM_SUCCESS;
+}
+
+int blog_dump(void)
+{
+	struct blog_console c;
+	int ret;
+
+	c.len = 0;
+	wmprintf("blog begin\r\n");
+	ret = blog_export(blog_console_out, &c, false);
+	blog_console_flush(&c);
+	wmprintf("blog end\r\n");
+	return ret;
+}
+
+struct blog_flash {
+	mdev_t *dev;
+	uint32_t addr;
+	uint32_t end;
+};
+
+static int blog_flash_out(void *ctx, const void *buf, uint32_t len)
+{
+	struct blog_flash *f = ctx;
+
+	if (f->addr >= f->end)
+		return WM_SUCCESS;
+	if (len > f->end - f->addr)
+		len = f->end - f->addr;
+	if (flash_drv_write(f->dev, buf, len, f->addr) != WM_SUCCESS)
+		return -WM_FAIL;
+	f->addr += len;
+	return WM_SUCCESS;
+}
+
+int blog_save(const struct flash_desc *fl)
+{
+	struct blog_flash f;
+	int ret;
+
+	f.dev = flash_drv_open(fl->fl_dev);
+	if (!f.dev)
+		return -WM_FAIL;
+
+	f.addr = fl->fl_start;
+	f.end = fl->fl_start + fl->fl_size;
+	if (flash_drv_erase(f.dev, fl->fl_start, fl->fl_size) != WM_SUCCESS)
+		ret = -WM_FAIL;
+	else
+		ret = blog_export(blog_flash_out, &f, false);
+
+	flash_drv_close(f.dev);
+	return ret;
+}
+
+uint32_t blog_dropped(void)
+{
+	return blog_lost;
+}
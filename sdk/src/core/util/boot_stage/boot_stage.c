@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <boot_stage.h>
+
+struct boot_mark {
+	const char *name;
+	/* os_get_timestamp(), from reset */
+	uint32_t us;
+	bool deferred;
+};
+
+struct boot_init {
+	const char *name;
+	void (*init)(void);
+};
+
+static struct boot_mark boot_marks[BOOT_STAGE_MAX];
+static int boot_mark_cnt;
+static struct boot_init boot_inits[BOOT_DEFER_MAX];
+static int boot_init_cnt;
+/* Set once the deferred initializations ran */
+static bool boot_inits_done;
+
+static os_semaphore_t boot_defer_sem;
+static os_thread_t boot_defer_thread;
+static uint32_t boot_defer_timeout;
+static os_thread_stack_define(boot_defer_stack, 2048);
+
+static void boot_mark(const char *name, bool deferred)
+{
+	unsigned long state = os_enter_critical_section();
+
+	if (boot_mark_cnt < BOOT_STAGE_MAX) {
+		boot_marks[boot_mark_cnt].name = name;
+		boot_marks[boot_mark_cnt].us = os_get_timestamp();
+		boot_marks[boot_mark_cnt].deferred = deferred;
+		boot_mark_cnt++;
+	}
+	os_exit_critical_section(state);
+}
+
+void boot_stage(const char *name)
+{
+	boot_mark(name, false);
+}
+
+static void boot_run(const struct boot_init *b)
+{
+	b->init();
+	boot_mark(b->name, true);
+}
+
+int boot_defer(const char *name, void (*init)(void))
+{
+	struct boot_init b = {name, init};
+	unsigned long state = os_enter_critical_section();
+
+	if (boot_inits_done) {
+		os_exit_critical_section(state);
+		boot_run(&b);
+		return WM_SUCCESS;
+	}
+	if (boot_init_cnt == BOOT_DEFER_MAX) {
+		os_exit_critical_section(state);
+		return -WM_E_NOSPC;
+	}
+	boot_inits[boot_init_cnt++] = b;
+	os_exit_critical_section(state);
+	return WM_SUCCESS;
+}
+
+static void boot_defer_main(os_thread_arg_t arg)
+{
+	unsigned long state;
+	int i = 0;
+
+	os_semaphore_get(&boot_defer_sem, os_msec_to_ticks(boot_defer_timeout));
+
+	/* Initializations may be registered while the others run */
+	for (;;) {
+		state = os_enter_critical_section();
+		if (i == boot_init_cnt) {
+			boot_inits_done = true;
+			os_exit_critical_section(state);
+			break;
+		}
+		os_exit_critical_section(state);
+		boot_run(&boot_inits[i++]);
+	}
+
+	boot_stage_dump();
+	os_thread_self_complete(NULL);
+}
+
+int boot_defer_start(uint32_t timeout_ms)
+{
+	boot_defer_timeout = timeout_ms;
+	if (os_semaphore_create_counting(&boot_defer_sem, "boot-defer", 1, 0)
+	    != WM_SUCCESS)
+		return -WM_FAIL;
+	if (os_thread_create(&boot_defer_thread, "boot-defer",
+			     boot_defer_main, NULL, &boot_defer_stack,
+			     OS_PRIO_4) != WM_SUCCESS) {
+		os_semaphore_delete(&boot_defer_sem);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+void boot_defer_release(void)
+{
+	if (boot_defer_sem)
+		os_semaphore_put(&boot_defer_sem);
+}
+
+void boot_stage_dump(void)
+{
+	uint32_t prev = 0;
+	int i, n = boot_mark_cnt;
+
+	wmprintf("%16s %8s  %s\r\n", "boot at ms", "took ms", "stage");
+	for (i = 0; i < n; i++) {
+		wmprintf("%14u.%u %6u.%u  %s%s\r\n", boot_marks[i].us / 1000,
+			 boot_marks[i].us % 1000 / 100,
+			 (boot_marks[i].us - prev) / 1000,
+			 (boot_marks[i].us - prev) % 1000 / 100,
+			 boot_marks[i].name,
+			 boot_marks[i].deferred ? " (deferred)" : "");
+		prev = boot_marks[i].us;
+	}
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libclock_disc
+libclock_disc-objs-y := clock_disc.c
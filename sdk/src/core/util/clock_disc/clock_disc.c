@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The model of the time is a line through the last sync: at the local
+ * time, in ms of kernel ticks, ref_local it was ref_ms and it runs
+ * ppb faster than the ticks. What the model is off by at the next sync,
+ * over the time since, is the error left in ppb.
+ *
+ * The clock reads the model less the offset being slewed out, which
+ * shrinks to nothing over slew_span ms after the sync, so it reads at the
+ * sync what it read just before.
+ */
+
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <ntpc.h>
+#include <clock_disc.h>
+
+#define cd_w(...) wmlog_w("clock", ##__VA_ARGS__)
+
+static struct {
+	bool set;
+	int32_t ppb;
+	int64_t ref_ms;
+	int64_t ref_local;
+	int64_t slew_ms;
+	int64_t slew_span;
+	/* Local time the next sync is due at */
+	int64_t next_local;
+	int32_t offset_ms;
+	uint32_t delay_ms;
+	uint32_t interval_s;
+	uint32_t syncs;
+	uint32_t steps;
+} cd;
+
+static int64_t cd_local_ms(void)
+{
+	return (int64_t) os_total_ticks_get() * 1000 / configTICK_RATE_HZ;
+}
+
+static int64_t cd_model(int64_t local)
+{
+	int64_t dl = local - cd.ref_local;
+
+	return cd.ref_ms + dl + dl * cd.ppb / 1000000000;
+}
+
+static int64_t cd_clock(int64_t local)
+{
+	int64_t dl = local - cd.ref_local;
+	int64_t t = cd_model(local);
+
+	if (dl < cd.slew_span)
+		t -= cd.slew_ms * (cd.slew_span - dl) / cd.slew_span;
+	return t;
+}
+
+static int64_t cd_abs(int64_t v)
+{
+	return v < 0 ? -v : v;
+}
+
+/* Called with the syscall interrupts masked */
+static void cd_discipline(int64_t time_ms, int64_t local)
+{
+	int64_t dl = local - cd.ref_local;
+	int64_t offset = time_ms - cd_clock(local);
+	int64_t raw = time_ms - cd_model(local);
+	int64_t err, ppb;
+
+	/* Shorter spans give noisier estimates, they move it less */
+	if (dl > 0 && cd_abs(raw) < dl) {
+		err = raw * 1000000000 / dl;
+		if (cd_abs(err) <= 2LL * CLOCK_DISC_MAX_PPM * 1000) {
+			ppb = cd.ppb + err * dl /
+				(dl + 2000LL * CLOCK_DISC_MIN_INTERVAL_S);
+			if (ppb > CLOCK_DISC_MAX_PPM * 1000)
+				ppb = CLOCK_DISC_MAX_PPM * 1000;
+			if (ppb < -CLOCK_DISC_MAX_PPM * 1000)
+				ppb = -CLOCK_DISC_MAX_PPM * 1000;
+			cd.ppb = ppb;
+		}
+	}
+
+	cd.ref_ms = time_ms;
+	cd.ref_local = local;
+	if (cd_abs(offset) > CLOCK_DISC_STEP_MS) {
+		cd.slew_ms = 0;
+		cd.slew_span = 0;
+		cd.steps++;
+	} else {
+		cd.slew_ms = offset;
+		cd.slew_span = cd_abs(offset) * 1000000 / CLOCK_DISC_SLEW_PPM;
+	}
+
+	if (cd_abs(offset) > CLOCK_DISC_TARGET_MS / 2)
+		cd.interval_s /= 2;
+	else if (cd_abs(offset) < CLOCK_DISC_TARGET_MS / 4)
+		cd.interval_s *= 2;
+	if (cd.interval_s < CLOCK_DISC_MIN_INTERVAL_S)
+		cd.interval_s = CLOCK_DISC_MIN_INTERVAL_S;
+	if (cd.interval_s > CLOCK_DISC_MAX_INTERVAL_S)
+		cd.interval_s = CLOCK_DISC_MAX_INTERVAL_S;
+	cd.offset_ms = offset;
+}
+
+int clock_disc_init(int32_t ppb)
+{
+	unsigned long state;
+
+	if (ppb > CLOCK_DISC_MAX_PPM * 1000 || ppb < -CLOCK_DISC_MAX_PPM * 1000)
+		return -WM_E_INVAL;
+	state = os_mask_syscall_interrupts();
+	cd.ppb = ppb;
+	os_unmask_syscall_interrupts(state);
+	return WM_SUCCESS;
+}
+
+void clock_disc_sample(int64_t time_ms, uint32_t delay_ms)
+{
+	unsigned long state;
+	int64_t local;
+
+	state = os_mask_syscall_interrupts();
+	local = cd_local_ms();
+	if (!cd.set) {
+		cd.ref_ms = time_ms;
+		cd.ref_local = local;
+		cd.interval_s = CLOCK_DISC_MIN_INTERVAL_S;
+		cd.set = true;
+	} else {
+		cd_discipline(time_ms, local);
+	}
+	cd.delay_ms = delay_ms;
+	cd.syncs++;
+	cd.next_local = local + 1000LL * cd.interval_s;
+	os_unmask_syscall_interrupts(state);
+}
+
+int clock_disc_sync(const char *const servers[], int count,
+		    uint32_t timeout_ms)
+{
+	struct ntpc_result res;
+	unsigned long state;
+	int ret;
+
+	ret = ntpc_sync(servers, count, timeout_ms, &res);
+	if (ret != WM_SUCCESS) {
+		state = os_mask_syscall_interrupts();
+		cd.next_local = cd_local_ms() +
+			1000LL * CLOCK_DISC_MIN_INTERVAL_S;
+		os_unmask_syscall_interrupts(state);
+		return ret;
+	}
+
+	clock_disc_sample(res.time_ms, res.delay_ms);
+	if (cd_abs(cd.offset_ms) > CLOCK_DISC_STEP_MS && cd.syncs > 1)
+		cd_w("Stepped by %d ms", cd.offset_ms);
+	return WM_SUCCESS;
+}
+
+int64_t clock_disc_time_ms(void)
+{
+	unsigned long state;
+	int64_t t = 0;
+
+	state = os_mask_syscall_interrupts();
+	if (cd.set)
+		t = cd_clock(cd_local_ms());
+	os_unmask_syscall_interrupts(state);
+	return t;
+}
+
+uint32_t clock_disc_next_sync_ms(void)
+{
+	unsigned long state;
+	int64_t left;
+
+	state = os_mask_syscall_interrupts();
+	left = cd.next_local - cd_local_ms();
+	os_unmask_syscall_interrupts(state);
+	return left > 0 ? (uint32_t) left : 0;
+}
+
+void clock_disc_get(struct clock_disc_status *st)
+{
+	unsigned long state;
+
+	state = os_mask_syscall_interrupts();
+	st->set = cd.set;
+	st->ppb = cd.ppb;
+	st->offset_ms = cd.offset_ms;
+	st->delay_ms = cd.delay_ms;
+	st->interval_s = cd.interval_s;
+	st->syncs = cd.syncs;
+	st->steps = cd.steps;
+	os_unmask_syscall_interrupts(state);
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libcpu_clk
+libcpu_clk-objs-y := cpu_clk.c
@@ -0,0 +1,271 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The level is worked out again, under cpu_clk_lock, whenever a boost or
+ * the default changes. A switch runs with the syscall interrupts masked:
+ * the system clock source, then the SysTick and the UART dividers, then
+ * board_cpu_hz. The UART fractions are computed from the last ones a
+ * driver set, with the frequency they were set at, so that they do not
+ * drift over many switches.
+ */
+
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <board.h>
+#include <lowlevel_drivers.h>
+#include <cpu_clk.h>
+
+#define cpu_clk_e(...) wmlog_e("cpu_clk", ##__VA_ARGS__)
+
+#define UART_DIVIDEND_MAX 2047
+#define UART_DIVISOR_MAX 8191
+
+/* A UART clock, a fraction of the system clock */
+struct cpu_clk_uart {
+	/* As a driver set it, at base_hz */
+	CLK_Fraction_Type base;
+	uint32_t base_hz;
+	/* As it was last set here */
+	CLK_Fraction_Type cur;
+};
+
+static os_mutex_t cpu_clk_lock;
+static bool cpu_clk_ready;
+static uint32_t cpu_clk_high_hz;
+static enum cpu_clk_level cpu_clk_level = CPU_CLK_HIGH;
+static enum cpu_clk_level cpu_clk_default = CPU_CLK_HIGH;
+static int cpu_clk_boosts;
+static struct cpu_clk_uart cpu_clk_uarts[2];
+static struct cpu_clk_notifier *cpu_clk_notifiers;
+
+static uint32_t cpu_clk_gcd(uint32_t a, uint32_t b)
+{
+	uint32_t t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* The fraction that gives the same UART clock at new_hz as f at old_hz */
+static int cpu_clk_uart_frac(const CLK_Fraction_Type *f, uint32_t old_hz,
+			     uint32_t new_hz, CLK_Fraction_Type *out)
+{
+	uint32_t g = cpu_clk_gcd(old_hz, new_hz);
+	uint64_t num = (uint64_t)f->clkDividend * (old_hz / g);
+	uint64_t den = (uint64_t)f->clkDivisor * (new_hz / g);
+	uint64_t k;
+
+	if (den > UART_DIVISOR_MAX || num > UART_DIVIDEND_MAX) {
+		k = (den + UART_DIVISOR_MAX - 1) / UART_DIVISOR_MAX;
+		if (k < (num + UART_DIVIDEND_MAX - 1) / UART_DIVIDEND_MAX)
+			k = (num + UART_DIVIDEND_MAX - 1) / UART_DIVIDEND_MAX;
+		num = (num + k / 2) / k;
+		den = (den + k / 2) / k;
+	}
+	/* The UART clock can not be faster than the system clock */
+	if (!num || num > den)
+		return -WM_FAIL;
+	out->clkDividend = num;
+	out->clkDivisor = den;
+	return WM_SUCCESS;
+}
+
+/* The UART fractions for new_hz, in next */
+static int cpu_clk_uart_prepare(uint32_t new_hz, CLK_Fraction_Type *next)
+{
+	struct cpu_clk_uart *u;
+	CLK_Fraction_Type f;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		u = &cpu_clk_uarts[i];
+		CLK_GetUARTDivider(i ? CLK_UART_SLOW : CLK_UART_FAST, &f);
+		if (f.clkDividend != u->cur.clkDividend ||
+		    f.clkDivisor != u->cur.clkDivisor) {
+			/* A driver set it since */
+			u->base = f;
+			u->base_hz = board_cpu_freq();
+			u->cur = f;
+		}
+		if (!u->base.clkDivisor) {
+			next[i] = u->base;
+			continue;
+		}
+		if (cpu_clk_uart_frac(&u->base, u->base_hz, new_hz, &next[i])
+		    != WM_SUCCESS)
+			return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+/* Reload the SysTick for new_hz, the current tick ends on time */
+static void cpu_clk_systick(uint32_t old_hz, uint32_t new_hz)
+{
+	uint32_t left = (uint64_t)SysTick->VAL * new_hz / old_hz;
+
+	if (left < 16)
+		left = 16;
+	/* Writing VAL loads LOAD at the next count, only then LOAD can be
+	 * set for the following ticks */
+	SysTick->LOAD = left;
+	SysTick->VAL = 0;
+	while (SysTick->VAL == 0)
+		;
+	SysTick->LOAD = new_hz / configTICK_RATE_HZ - 1;
+}
+
+/* Called with cpu_clk_lock held */
+static int cpu_clk_apply(void)
+{
+	enum cpu_clk_level level;
+	CLK_Fraction_Type next[2];
+	struct cpu_clk_notifier *n;
+	uint32_t old_hz, new_hz;
+	unsigned long state;
+	int i;
+
+	level = cpu_clk_boosts ? CPU_CLK_HIGH : cpu_clk_default;
+	if (!cpu_clk_ready || level == cpu_clk_level)
+		return WM_SUCCESS;
+
+	old_hz = board_cpu_freq();
+	new_hz = level == CPU_CLK_HIGH ? cpu_clk_high_hz : CPU_CLK_LOW_HZ;
+	if (cpu_clk_uart_prepare(new_hz, next) != WM_SUCCESS) {
+		cpu_clk_e("UART clocks can not run at %u Hz", new_hz);
+		return -WM_FAIL;
+	}
+
+	state = os_mask_syscall_interrupts();
+	if (level == CPU_CLK_LOW) {
+		CLK_RC32MEnable();
+		while (CLK_GetClkStatus(CLK_RC32M) == RESET)
+			;
+		CLK_SystemClkSrc(CLK_RC32M);
+	} else {
+		CLK_SystemClkSrc(CLK_SFLL);
+	}
+	cpu_clk_systick(old_hz, new_hz);
+	for (i = 0; i < 2; i++) {
+		if (!next[i].clkDivisor)
+			continue;
+		CLK_UARTDividerSet(i ? CLK_UART_SLOW : CLK_UART_FAST,
+				   next[i]);
+		cpu_clk_uarts[i].cur = next[i];
+	}
+	board_cpu_hz = new_hz;
+	cpu_clk_level = level;
+	os_unmask_syscall_interrupts(state);
+
+	for (n = cpu_clk_notifiers; n; n = n->next)
+		n->fn(old_hz, new_hz, n->ctx);
+	return WM_SUCCESS;
+}
+
+int cpu_clk_init(void)
+{
+	int i;
+
+	if (cpu_clk_ready)
+		return WM_SUCCESS;
+	if (os_mutex_create(&cpu_clk_lock, "cpu-clk", OS_MUTEX_INHERIT)
+	    != WM_SUCCESS)
+		return -WM_FAIL;
+
+	cpu_clk_high_hz = board_cpu_freq();
+	for (i = 0; i < 2; i++) {
+		CLK_GetUARTDivider(i ? CLK_UART_SLOW : CLK_UART_FAST,
+				   &cpu_clk_uarts[i].base);
+		cpu_clk_uarts[i].base_hz = cpu_clk_high_hz;
+		cpu_clk_uarts[i].cur = cpu_clk_uarts[i].base;
+	}
+	cpu_clk_ready = true;
+	return WM_SUCCESS;
+}
+
+int cpu_clk_set_default(enum cpu_clk_level level)
+{
+	enum cpu_clk_level prev;
+	int ret;
+
+	if (level != CPU_CLK_LOW && level != CPU_CLK_HIGH)
+		return -WM_E_INVAL;
+	if (!cpu_clk_ready)
+		return -WM_FAIL;
+
+	os_mutex_get(&cpu_clk_lock, OS_WAIT_FOREVER);
+	prev = cpu_clk_default;
+	cpu_clk_default = level;
+	ret = cpu_clk_apply();
+	if (ret != WM_SUCCESS)
+		cpu_clk_default = prev;
+	os_mutex_put(&cpu_clk_lock);
+	return ret;
+}
+
+void cpu_clk_boost_begin(void)
+{
+	if (!cpu_clk_ready) {
+		cpu_clk_boosts++;
+		return;
+	}
+	os_mutex_get(&cpu_clk_lock, OS_WAIT_FOREVER);
+	cpu_clk_boosts++;
+	cpu_clk_apply();
+	os_mutex_put(&cpu_clk_lock);
+}
+
+void cpu_clk_boost_end(void)
+{
+	if (!cpu_clk_ready) {
+		if (cpu_clk_boosts > 0)
+			cpu_clk_boosts--;
+		return;
+	}
+	os_mutex_get(&cpu_clk_lock, OS_WAIT_FOREVER);
+	if (cpu_clk_boosts > 0)
+		cpu_clk_boosts--;
+	cpu_clk_apply();
+	os_mutex_put(&cpu_clk_lock);
+}
+
+int cpu_clk_notifier_register(struct cpu_clk_notifier *n)
+{
+	if (!n || !n->fn || !cpu_clk_ready)
+		return -WM_E_INVAL;
+
+	os_mutex_get(&cpu_clk_lock, OS_WAIT_FOREVER);
+	n->next = cpu_clk_notifiers;
+	cpu_clk_notifiers = n;
+	os_mutex_put(&cpu_clk_lock);
+	return WM_SUCCESS;
+}
+
+void cpu_clk_notifier_unregister(struct cpu_clk_notifier *n)
+{
+	struct cpu_clk_notifier **p;
+
+	if (!cpu_clk_ready)
+		return;
+
+	os_mutex_get(&cpu_clk_lock, OS_WAIT_FOREVER);
+	for (p = &cpu_clk_notifiers; *p; p = &(*p)->next) {
+		if (*p == n) {
+			*p = n->next;
+			break;
+		}
+	}
+	os_mutex_put(&cpu_clk_lock);
+}
+
+enum cpu_clk_level cpu_clk_get_level(void)
+{
+	return cpu_clk_level;
+}
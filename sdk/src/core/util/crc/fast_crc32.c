@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <mdev_crc.h>
+#include <crc32.h>
+
+#include "crc32_table.h"
+
+#define CRC32_POLY 0xedb88320
+
+/* x^(2^n) modulo the polynomial, for n in 0..31 */
+static uint32_t crc32_x2n[32];
+static bool crc32_hw;
+
+/* a * b modulo the polynomial, bit 31 is the coefficient of x^0 */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+	return p;
+}
+
+/* crc advanced over len zero bytes, in log2(len) multiplications instead
+ * of len table lookups */
+static uint32_t crc32_shift(uint32_t crc, size_t len)
+{
+	uint32_t p = 1U << 31;
+	unsigned k = 3;
+
+	while (len) {
+		if (len & 1)
+			p = crc32_multmodp(crc32_x2n[k & 31], p);
+		len >>= 1;
+		k++;
+	}
+	return crc32_multmodp(p, crc);
+}
+
+static uint32_t crc32_sw(const uint8_t *p, size_t len, uint32_t crc)
+{
+	uint32_t a, b;
+
+	while (len && ((uintptr_t) p & 3)) {
+		crc = crc32_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	/* The core is little endian, the first byte is the low byte */
+	while (len >= 8) {
+		a = *(const uint32_t *) p ^ crc;
+		b = *(const uint32_t *) (p + 4);
+		crc = crc32_table[7][a & 0xff] ^
+			crc32_table[6][(a >> 8) & 0xff] ^
+			crc32_table[5][(a >> 16) & 0xff] ^
+			crc32_table[4][a >> 24] ^
+			crc32_table[3][b & 0xff] ^
+			crc32_table[2][(b >> 8) & 0xff] ^
+			crc32_table[1][(b >> 16) & 0xff] ^
+			crc32_table[0][b >> 24];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = crc32_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+/* The engine always starts from 0, the CRC is linear so the previous value
+ * is advanced over the buffer separately and added */
+static int crc32_hw_calc(const uint8_t *p, size_t len, uint32_t *crc)
+{
+	mdev_t *dev;
+	uint32_t result;
+	int ret;
+
+	dev = crc_drv_open(MDEV_CRC_ENGINE_0, CRC32_IEEE);
+	if (!dev)
+		return -WM_FAIL;
+	ret = crc_drv_block_calc(dev, (uint8_t *) p, len, &result);
+	crc_drv_close(dev);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	*crc = result ^ (*crc ? crc32_shift(*crc, len) : 0);
+	return WM_SUCCESS;
+}
+
+int fast_crc32_init(void)
+{
+	uint32_t p = 1U << 30;
+	int n;
+
+	if (crc32_hw)
+		return WM_SUCCESS;
+
+	crc32_x2n[0] = p;
+	for (n = 1; n < 32; n++)
+		crc32_x2n[n] = p = crc32_multmodp(p, p);
+
+	if (crc_drv_init() != WM_SUCCESS)
+		return -WM_FAIL;
+	crc32_hw = true;
+	return WM_SUCCESS;
+}
+
+uint32_t fast_crc32(const void *data, size_t len, uint32_t crc)
+{
+	if (crc32_hw && len >= FAST_CRC32_HW_MIN_LEN && !is_isr_context() &&
+	    crc32_hw_calc(data, len, &crc) == WM_SUCCESS)
+		return crc;
+	return crc32_sw(data, len, crc);
+}
+
+void crc32_stream_init(crc32_stream_t *s, uint32_t crc)
+{
+	s->crc = crc;
+}
+
+void crc32_stream_feed(crc32_stream_t *s, const void *data, size_t len)
+{
+	s->crc = fast_crc32(data, len, s->crc);
+}
+
+uint32_t crc32_stream_result(const crc32_stream_t *s)
+{
+	return s->crc;
+}
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include <crc32.h>
+#include <cred_store.h>
+
+#ifdef CONFIG_XIP_ENABLE
+#include <mw300.h>
+#include <mw300_driver.h>
+#include <mw300_flashc.h>
+#endif
+
+#define CS_MAGIC 0x44455243
+#define CS_SECTOR_SIZE 4096
+
+/* Flash window of the flash controller in XIP images */
+#define CS_FLASHC_BASE 0x1f000000
+
+/* Followed by the certificate, a NUL, the key and a NUL */
+struct cs_header {
+	uint32_t magic;		/* Written last */
+	uint32_t cert_len;
+	uint32_t key_len;
+	uint32_t crc;		/* Of the lengths and the data with its NULs */
+};
+
+#define CS_DATA_LEN(h) ((h)->cert_len + 1 + (h)->key_len + 1)
+
+static uint32_t cs_crc(const struct cs_header *h, const void *data)
+{
+	uint32_t crc;
+
+	crc = fast_crc32(&h->cert_len, 2 * sizeof(uint32_t), 0);
+	return fast_crc32(data, CS_DATA_LEN(h), crc);
+}
+
+static bool cs_header_valid(const struct cs_header *h,
+			    const flash_desc_t *fl)
+{
+	return h->magic == CS_MAGIC && h->cert_len < fl->fl_size &&
+		h->key_len < fl->fl_size &&
+		sizeof(*h) + CS_DATA_LEN(h) <= fl->fl_size;
+}
+
+bool cred_store_is_mapped(const flash_desc_t *fl)
+{
+#ifdef CONFIG_XIP_ENABLE
+	return fl->fl_dev == FL_INT;
+#else
+	return false;
+#endif
+}
+
+int cred_store_write(const flash_desc_t *fl, const void *cert,
+		     size_t cert_len, const void *key, size_t key_len)
+{
+	struct cs_header h;
+	static const uint8_t nul;
+	uint32_t off, crc;
+	mdev_t *dev;
+	int ret = -WM_FAIL;
+
+	if (!fl || !cert || !key || cert_len >= fl->fl_size ||
+	    key_len >= fl->fl_size ||
+	    sizeof(h) + cert_len + 1 + key_len + 1 > fl->fl_size)
+		return -WM_E_INVAL;
+
+	fast_crc32_init();
+	h.magic = CS_MAGIC;
+	h.cert_len = cert_len;
+	h.key_len = key_len;
+	crc = fast_crc32(&h.cert_len, 2 * sizeof(uint32_t), 0);
+	crc = fast_crc32(cert, cert_len, crc);
+	crc = fast_crc32(&nul, 1, crc);
+	crc = fast_crc32(key, key_len, crc);
+	h.crc = fast_crc32(&nul, 1, crc);
+
+	dev = flash_drv_open(fl->fl_dev);
+	if (!dev)
+		return -WM_FAIL;
+
+	/* The header goes last, a write torn by a reset leaves no magic */
+	off = fl->fl_start + sizeof(h);
+	if (flash_drv_erase(dev, fl->fl_start,
+			    (sizeof(h) + CS_DATA_LEN(&h) + CS_SECTOR_SIZE - 1) &
+			    ~(CS_SECTOR_SIZE - 1)) ||
+	    flash_drv_write(dev, (uint8_t *) cert, cert_len, off) ||
+	    flash_drv_write(dev, (uint8_t *) &nul, 1, off + cert_len) ||
+	    flash_drv_write(dev, (uint8_t *) key, key_len,
+			    off + cert_len + 1) ||
+	    flash_drv_write(dev, (uint8_t *) &nul, 1,
+			    off + cert_len + 1 + key_len) ||
+	    flash_drv_write(dev, (uint8_t *) &h, sizeof(h), fl->fl_start))
+		goto out;
+	ret = WM_SUCCESS;
+
+out:
+#ifdef CONFIG_XIP_ENABLE
+	/* The window may still cache the old credentials */
+	if (fl->fl_dev == FL_INT)
+		FLASHC_FlushCache();
+#endif
+	flash_drv_close(dev);
+	return ret;
+}
+
+int cred_store_get(const flash_desc_t *fl, const char **cert,
+		   const char **key)
+{
+	struct cs_header h;
+	const char *data;
+	char *buf;
+	mdev_t *dev;
+
+	if (!fl || !cert || !key)
+		return -WM_E_INVAL;
+	fast_crc32_init();
+
+	if (cred_store_is_mapped(fl)) {
+		data = (const char *) CS_FLASHC_BASE + fl->fl_start;
+		memcpy(&h, data, sizeof(h));
+		data += sizeof(h);
+		if (!cs_header_valid(&h, fl) || cs_crc(&h, data) != h.crc)
+			return -WM_E_NOENT;
+		*cert = data;
+		*key = data + h.cert_len + 1;
+		return WM_SUCCESS;
+	}
+
+	dev = flash_drv_open(fl->fl_dev);
+	if (!dev)
+		return -WM_FAIL;
+	if (flash_drv_read(dev, (uint8_t *) &h, sizeof(h), fl->fl_start)) {
+		flash_drv_close(dev);
+		return -WM_FAIL;
+	}
+	if (!cs_header_valid(&h, fl)) {
+		flash_drv_close(dev);
+		return -WM_E_NOENT;
+	}
+	/* Kept for the lifetime of the application like the pointers into
+	 * the flash */
+	buf = os_mem_alloc(CS_DATA_LEN(&h));
+	if (!buf) {
+		flash_drv_close(dev);
+		return -WM_E_NOMEM;
+	}
+	if (flash_drv_read(dev, (uint8_t *) buf, CS_DATA_LEN(&h),
+			   fl->fl_start + sizeof(h))) {
+		flash_drv_close(dev);
+		os_mem_free(buf);
+		return -WM_FAIL;
+	}
+	flash_drv_close(dev);
+	if (cs_crc(&h, buf) != h.crc) {
+		os_mem_free(buf);
+		return -WM_E_NOENT;
+	}
+	*cert = buf;
+	*key = buf + h.cert_len + 1;
+	return WM_SUCCESS;
+}
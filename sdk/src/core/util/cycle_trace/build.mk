@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-$(CONFIG_CYCLE_TRACE) += libcycle_trace
+libcycle_trace-objs-y := cycle_trace.c
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <compiler.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <board.h>
+#include <lowlevel_drivers.h>
+#include <cycle_trace.h>
+
+#if (CONFIG_CYCLE_TRACE_EVENT_CNT + 0) > 0
+#define CYCLE_TRACE_EVENTS CONFIG_CYCLE_TRACE_EVENT_CNT
+#else
+#define CYCLE_TRACE_EVENTS 1024
+#endif
+
+/* Command table entry of the cli in libwmsdk */
+struct cli_command {
+	const char *name;
+	const char *help;
+	void (*function) (int argc, char **argv);
+};
+
+int cli_register_commands(const struct cli_command *commands,
+			  int num_commands);
+
+struct cycle_trace_event {
+	uint32_t cycles;
+	void *task;		/* NULL in an interrupt */
+	uint8_t id;
+	uint8_t phase;
+};
+
+static struct cycle_trace_event cycle_trace_ring[CYCLE_TRACE_EVENTS];
+/* Events recorded since the reset, the ring holds the last ones */
+static uint32_t cycle_trace_count;
+static volatile bool cycle_trace_on;
+
+static const char *cycle_trace_names[CYCLE_TRACE_ID_CNT] = {
+	[CYCLE_TRACE_MQTT_READ_PACKET] = "mqtt_read_packet",
+	[CYCLE_TRACE_MQTT_DELIVER] = "mqtt_deliver",
+	[CYCLE_TRACE_MQTT_SEND_PACKET] = "mqtt_send_packet",
+	[CYCLE_TRACE_SHADOW_DELTA] = "shadow_delta",
+	[CYCLE_TRACE_TLS_READ] = "tls_read",
+	[CYCLE_TRACE_TLS_WRITE] = "tls_write",
+	[CYCLE_TRACE_TCPIP_MSG] = "tcpip_msg",
+};
+
+__ramfunc void cycle_trace_record(unsigned id, unsigned phase)
+{
+	struct cycle_trace_event *e;
+	uint32_t primask;
+
+	if (!cycle_trace_on)
+		return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	e = &cycle_trace_ring[cycle_trace_count++ % CYCLE_TRACE_EVENTS];
+	e->cycles = DWT->CYCCNT;
+	e->task = is_isr_context() ? NULL : os_get_current_task_handle();
+	e->id = id;
+	e->phase = phase;
+	__set_PRIMASK(primask);
+}
+
+int cycle_trace_set_name(unsigned id, const char *name)
+{
+	if (id < CYCLE_TRACE_APP || id >= CYCLE_TRACE_ID_CNT)
+		return -WM_E_INVAL;
+
+	cycle_trace_names[id] = name;
+	return WM_SUCCESS;
+}
+
+void cycle_trace_start(void)
+{
+	/* The counter keeps running when the tracer stops, so that the
+	 * events of several runs stay in order */
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+	cycle_trace_on = true;
+}
+
+void cycle_trace_stop(void)
+{
+	cycle_trace_on = false;
+}
+
+void cycle_trace_reset(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	cycle_trace_count = 0;
+	__set_PRIMASK(primask);
+}
+
+void cycle_trace_dump(void)
+{
+	bool was_on = cycle_trace_on;
+	uint32_t mhz = board_cpu_freq() / 1000000;
+	uint32_t first, i, prev = 0, frac;
+	uint64_t cycles = 0, us;
+	const char *name;
+	char buf[8];
+
+	cycle_trace_on = false;
+	first = cycle_trace_count > CYCLE_TRACE_EVENTS ?
+		cycle_trace_count - CYCLE_TRACE_EVENTS : 0;
+
+	wmprintf("ctrace begin\r\n{\"traceEvents\":[\r\n");
+	for (i = first; i != cycle_trace_count; i++) {
+		struct cycle_trace_event *e =
+			&cycle_trace_ring[i % CYCLE_TRACE_EVENTS];
+
+		/* Time from the oldest event, unwrapping the counter */
+		if (i != first)
+			cycles += e->cycles - prev;
+		prev = e->cycles;
+		us = cycles / mhz;
+		frac = (cycles % mhz) * 1000 / mhz;
+
+		name = cycle_trace_names[e->id];
+		if (!name) {
+			snprintf(buf, sizeof(buf), "id%u", e->id);
+			name = buf;
+		}
+		wmprintf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":0,"
+			 "\"tid\":%u,\"ts\":%u.%03u}\r\n", i != first ? "," : "",
+			 name, e->phase == CYCLE_TRACE_PH_BEGIN ? 'B' : 'E',
+			 (uint32_t)e->task, (uint32_t)us, frac);
+	}
+	wmprintf("]}\r\nctrace end\r\n");
+	cycle_trace_on = was_on;
+}
+
+static void cycle_trace_cli(int argc, char **argv)
+{
+	if (argc >= 2 && !strcmp(argv[1], "start"))
+		cycle_trace_start();
+	else if (argc >= 2 && !strcmp(argv[1], "stop"))
+		cycle_trace_stop();
+	else if (argc >= 2 && !strcmp(argv[1], "reset"))
+		cycle_trace_reset();
+	else if (argc >= 2 && !strcmp(argv[1], "dump"))
+		cycle_trace_dump();
+	else
+		wmprintf("Usage: ctrace <start|stop|reset|dump>\r\n");
+}
+
+static const struct cli_command cycle_trace_commands[] = {
+	{"ctrace", "<start|stop|reset|dump>", cycle_trace_cli},
+};
+
+int cycle_trace_cli_init(void)
+{
+	if (cli_register_commands(cycle_trace_commands,
+				  sizeof(cycle_trace_commands) /
+				  sizeof(cycle_trace_commands[0])))
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The GPT counts at 50MHz, see gpt_drv_init(), its counter period is the
+ * sample period and its trigger output starts a conversion. The DAC asks
+ * the DMA for the next sample once it took one. The DMA interrupt of a
+ * block re-arms the channel on the next block of the ring, as the ADC
+ * stream of the ADC demo does. When the ring is empty the DMA stops and the
+ * next enqueue starts it again.
+ */
+
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <mdev_dma.h>
+#include <mdev_gpt.h>
+#include <dac_stream.h>
+
+#define dac_stream_w(...) wmlog_w("dac_stream", ##__VA_ARGS__)
+
+#define GPT_CLOCK_HZ 50000000
+
+static struct {
+	mdev_t *dma_dev;
+	mdev_t *gpt_dev;
+	dma_config_t dma;
+	DAC_ChannelID_Type ch;
+	struct {
+		const uint16_t *block;
+		int num;
+	} ring[DAC_STREAM_QUEUE_LEN];
+	/* Block playing, number of blocks queued */
+	int head;
+	int count;
+	/* The DMA is running */
+	bool playing;
+	bool repeat;
+	dac_stream_cb_t cb;
+	void *arg;
+	uint32_t underruns;
+	bool running;
+} stream;
+
+static unsigned long dac_stream_lock(void)
+{
+	unsigned long state;
+
+	if (is_isr_context()) {
+		state = portSET_INTERRUPT_MASK_FROM_ISR();
+	} else {
+		state = os_enter_critical_section();
+	}
+	return state;
+}
+
+static void dac_stream_unlock(unsigned long state)
+{
+	if (is_isr_context()) {
+		portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+	} else {
+		os_exit_critical_section(state);
+	}
+}
+
+static void dac_stream_set_block(void)
+{
+	stream.dma.dma_cfg.srcDmaAddr =
+		(uint32_t) stream.ring[stream.head].block;
+	stream.dma.dma_cfg.transfLength =
+		stream.ring[stream.head].num * sizeof(uint16_t);
+}
+
+static void dac_stream_dma_cb(DMA_Channel_Type channel,
+			      dma_transfer_status_t status, void *data)
+{
+	const uint16_t *block;
+	unsigned long state;
+	bool done = false;
+	int num;
+
+	if (!stream.running)
+		return;
+
+	block = stream.ring[stream.head].block;
+	num = stream.ring[stream.head].num;
+
+	/* In repeat mode the last block stays */
+	state = dac_stream_lock();
+	if (stream.count > 1 || !stream.repeat) {
+		stream.head = (stream.head + 1) % DAC_STREAM_QUEUE_LEN;
+		stream.count--;
+		done = true;
+	}
+	dac_stream_unlock(state);
+
+	/* Can queue the next block before the queue is looked at */
+	if (done && stream.cb)
+		stream.cb(block, num, stream.arg);
+
+	state = dac_stream_lock();
+	if (!stream.count) {
+		stream.playing = false;
+		stream.underruns++;
+		dac_stream_unlock(state);
+		return;
+	}
+	dac_stream_set_block();
+	dac_stream_unlock(state);
+
+	DMA_Disable(channel);
+	DMA_ChannelInit(channel, &stream.dma.dma_cfg);
+	DMA_SetPeripheralType(channel, stream.dma.perDmaInter);
+	DMA_IntClr(channel, INT_CH_ALL);
+	DMA_IntMask(channel, INT_DMA_TRANS_COMPLETE, UNMASK);
+	DMA_Enable(channel);
+}
+
+int dac_stream_start(mdev_t *dac_dev, DAC_ChannelID_Type ch, GPT_ID_Type gpt,
+		     uint32_t rate_hz, bool repeat, dac_stream_cb_t cb,
+		     void *arg)
+{
+	if (!dac_dev || (gpt != GPT2_ID && gpt != GPT3_ID) || !rate_hz ||
+	    rate_hz > DAC_STREAM_MAX_RATE || stream.running)
+		return -WM_E_INVAL;
+
+	if (gpt_drv_init(gpt) != WM_SUCCESS)
+		return -WM_FAIL;
+	stream.gpt_dev = gpt_drv_open(gpt);
+	if (!stream.gpt_dev) {
+		dac_stream_w("GPT %d is in use", gpt);
+		return -WM_FAIL;
+	}
+	if (dma_drv_init() != WM_SUCCESS)
+		goto fail_gpt;
+	stream.dma_dev = dma_drv_open();
+	if (!stream.dma_dev)
+		goto fail_gpt;
+	if (dma_drv_set_cb(stream.dma_dev, dac_stream_dma_cb, NULL) !=
+	    WM_SUCCESS)
+		goto fail_dma;
+
+	stream.ch = ch;
+	stream.head = 0;
+	stream.count = 0;
+	stream.playing = false;
+	stream.repeat = repeat;
+	stream.cb = cb;
+	stream.arg = arg;
+	stream.underruns = 0;
+
+	stream.dma.dma_cfg.destDmaAddr = DAC_CH_A == ch ?
+		(uint32_t) &DAC->ADATA.WORDVAL :
+		(uint32_t) &DAC->BDATA.WORDVAL;
+	stream.dma.dma_cfg.transfType = DMA_MEM_TO_PER;
+	stream.dma.dma_cfg.burstLength = DMA_ITEM_1;
+	stream.dma.dma_cfg.srcAddrInc = DMA_ADDR_INC;
+	stream.dma.dma_cfg.destAddrInc = DMA_ADDR_NOCHANGE;
+	stream.dma.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_16;
+	stream.dma.perDmaInter = DAC_CH_A == ch ? DMA_PER26_DAC0 :
+		DMA_PER27_DAC1;
+
+	/* gpt_drv_set() rounds to microseconds, the rate is set in cycles */
+	gpt_drv_set(stream.gpt_dev, 1000000 / rate_hz);
+	GPT_SetCounterUppVal(gpt, GPT_CLOCK_HZ / rate_hz);
+	GPT_TrigConfig(gpt, GPT_CH_0, 0);
+	GPT_TrigCmd(gpt, ENABLE);
+
+	DAC_TriggerSourceConfig(ch, GPT2_ID == gpt ? DAC_GPT2_TRIGGER :
+				DAC_GPT3_TRIGGER);
+	DAC_TriggerCmd(ch, ENABLE);
+	DAC_DmaCmd(ch, ENABLE);
+
+	stream.running = true;
+	gpt_drv_start(stream.gpt_dev);
+	return WM_SUCCESS;
+
+fail_dma:
+	dma_drv_close(stream.dma_dev);
+	stream.dma_dev = NULL;
+fail_gpt:
+	gpt_drv_close(stream.gpt_dev);
+	stream.gpt_dev = NULL;
+	return -WM_FAIL;
+}
+
+int dac_stream_enqueue(const uint16_t *block, int num)
+{
+	unsigned long state;
+	bool start = false;
+	int tail;
+
+	if (!block || num <= 0 || num > DAC_STREAM_MAX_BLOCK ||
+	    !stream.running)
+		return -WM_E_INVAL;
+
+	state = dac_stream_lock();
+	if (stream.count == DAC_STREAM_QUEUE_LEN) {
+		dac_stream_unlock(state);
+		return -WM_E_NOMEM;
+	}
+	tail = (stream.head + stream.count) % DAC_STREAM_QUEUE_LEN;
+	stream.ring[tail].block = block;
+	stream.ring[tail].num = num;
+	stream.count++;
+	if (!stream.playing) {
+		stream.playing = true;
+		dac_stream_set_block();
+		start = true;
+	}
+	dac_stream_unlock(state);
+
+	/* Nothing else touches the DMA while it is stopped */
+	if (start && dma_drv_transfer(stream.dma_dev, &stream.dma) !=
+	    WM_SUCCESS) {
+		state = dac_stream_lock();
+		stream.playing = false;
+		stream.count--;
+		dac_stream_unlock(state);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+int dac_stream_queued(void)
+{
+	return stream.count;
+}
+
+uint32_t dac_stream_underruns(void)
+{
+	return stream.underruns;
+}
+
+void dac_stream_stop(void)
+{
+	if (!stream.running)
+		return;
+
+	stream.running = false;
+	gpt_drv_stop(stream.gpt_dev);
+	gpt_drv_close(stream.gpt_dev);
+	stream.gpt_dev = NULL;
+	DAC_TriggerCmd(stream.ch, DISABLE);
+	DAC_DmaCmd(stream.ch, DISABLE);
+	dma_drv_close(stream.dma_dev);
+	stream.dma_dev = NULL;
+	stream.count = 0;
+	stream.playing = false;
+}
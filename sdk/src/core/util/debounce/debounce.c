@@ -0,0 +1,220 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The GPT interrupt reads every input and counts the scans it has read
+ * other than its stable level in a row. When the count reaches
+ * stable_scans the level flips and the input's bit is set in db_changed,
+ * a bounce back resets the count. A scan that flipped any input submits
+ * the job, which takes db_changed and calls back. The bit masks and the
+ * table are changed by threads in critical sections, which mask the GPT
+ * interrupt.
+ */
+
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <mdev_gpt.h>
+#include <work_svc.h>
+#include <debounce.h>
+
+#define db_w(...) wmlog_w("debounce", ##__VA_ARGS__)
+
+struct debounce_input {
+	int8_t gpio;
+	bool type;
+	/* Scans in a row that read other than the stable level */
+	uint8_t count;
+	debounce_cb_t cb;
+	void *data;
+};
+
+static struct debounce_input db_inputs[DEBOUNCE_MAX_INPUTS];
+/* Bit i for db_inputs[i] */
+static uint32_t db_used, db_active, db_changed;
+static uint8_t db_stable_scans;
+static mdev_t *db_gpt;
+static work_t db_work;
+
+static bool db_read(const struct debounce_input *in)
+{
+	bool high = GPIO_ReadPinLevel(in->gpio) == GPIO_IO_HIGH;
+
+	return high == (GPIO_ACTIVE_HIGH == in->type);
+}
+
+/* GPT interrupt */
+static void debounce_scan(void)
+{
+	struct debounce_input *in;
+	uint32_t used = db_used, bit;
+	bool flipped = false;
+	int i;
+
+	for (i = 0; used; i++, used >>= 1) {
+		if (!(used & 1))
+			continue;
+		in = &db_inputs[i];
+		bit = 1U << i;
+		if (db_read(in) == !!(db_active & bit)) {
+			in->count = 0;
+			continue;
+		}
+		if (++in->count < db_stable_scans)
+			continue;
+		in->count = 0;
+		db_active ^= bit;
+		db_changed |= bit;
+		flipped = true;
+	}
+
+	if (flipped)
+		work_submit(&db_work);
+}
+
+static void debounce_deliver(work_t *w)
+{
+	unsigned long state;
+	uint32_t changed, active, bit;
+	debounce_cb_t cb;
+	void *data;
+	int i, gpio;
+
+	state = os_enter_critical_section();
+	changed = db_changed & db_used;
+	db_changed = 0;
+	active = db_active;
+	os_exit_critical_section(state);
+
+	for (i = 0; changed; i++, changed >>= 1) {
+		if (!(changed & 1))
+			continue;
+		bit = 1U << i;
+		state = os_enter_critical_section();
+		gpio = db_inputs[i].gpio;
+		cb = db_used & bit ? db_inputs[i].cb : NULL;
+		data = db_inputs[i].data;
+		os_exit_critical_section(state);
+		if (cb)
+			cb(gpio, !!(active & bit), data);
+	}
+}
+
+int debounce_init(GPT_ID_Type gpt, uint16_t scan_ms, uint8_t stable_scans)
+{
+	if (db_gpt)
+		return WM_SUCCESS;
+	if (!scan_ms || !stable_scans)
+		return -WM_E_INVAL;
+
+	if (work_svc_init() != WM_SUCCESS)
+		return -WM_FAIL;
+	work_init(&db_work, debounce_deliver, NULL, WORK_LANE_HIGH);
+
+	if (gpt_drv_init(gpt) != WM_SUCCESS)
+		return -WM_FAIL;
+	db_gpt = gpt_drv_open(gpt);
+	if (!db_gpt) {
+		db_w("GPT %d is in use", gpt);
+		return -WM_FAIL;
+	}
+
+	db_used = db_active = db_changed = 0;
+	db_stable_scans = stable_scans;
+	gpt_drv_set(db_gpt, scan_ms * 1000U);
+	gpt_drv_setcb(db_gpt, debounce_scan);
+	gpt_drv_start(db_gpt);
+	return WM_SUCCESS;
+}
+
+void debounce_deinit(void)
+{
+	if (!db_gpt)
+		return;
+
+	gpt_drv_stop(db_gpt);
+	gpt_drv_setcb(db_gpt, NULL);
+	gpt_drv_close(db_gpt);
+	db_gpt = NULL;
+	work_cancel(&db_work);
+	db_used = db_changed = 0;
+}
+
+static int db_find(int gpio)
+{
+	int i;
+
+	for (i = 0; i < DEBOUNCE_MAX_INPUTS; i++)
+		if ((db_used & (1U << i)) && db_inputs[i].gpio == gpio)
+			return i;
+	return -1;
+}
+
+int debounce_add(input_gpio_cfg_t input, debounce_cb_t cb, void *data)
+{
+	struct debounce_input *in;
+	unsigned long state;
+	int i;
+
+	if (!cb || input.gpio < 0)
+		return -WM_E_INVAL;
+
+	GPIO_SetPinDir(input.gpio, GPIO_INPUT);
+
+	state = os_enter_critical_section();
+	if (db_find(input.gpio) >= 0) {
+		os_exit_critical_section(state);
+		return -WM_E_INVAL;
+	}
+	for (i = 0; i < DEBOUNCE_MAX_INPUTS && (db_used & (1U << i)); i++)
+		;
+	if (i == DEBOUNCE_MAX_INPUTS) {
+		os_exit_critical_section(state);
+		return -WM_E_NOMEM;
+	}
+
+	in = &db_inputs[i];
+	in->gpio = input.gpio;
+	in->type = input.type;
+	in->count = 0;
+	in->cb = cb;
+	in->data = data;
+	if (db_read(in))
+		db_active |= 1U << i;
+	else
+		db_active &= ~(1U << i);
+	db_changed &= ~(1U << i);
+	db_used |= 1U << i;
+	os_exit_critical_section(state);
+	return WM_SUCCESS;
+}
+
+int debounce_remove(input_gpio_cfg_t input)
+{
+	unsigned long state;
+	int i;
+
+	state = os_enter_critical_section();
+	i = db_find(input.gpio);
+	if (i >= 0) {
+		db_used &= ~(1U << i);
+		db_changed &= ~(1U << i);
+	}
+	os_exit_critical_section(state);
+	return i >= 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+bool debounce_is_active(input_gpio_cfg_t input)
+{
+	unsigned long state;
+	bool active;
+	int i;
+
+	state = os_enter_critical_section();
+	i = db_find(input.gpio);
+	active = i >= 0 && (db_active & (1U << i));
+	os_exit_critical_section(state);
+	return active;
+}
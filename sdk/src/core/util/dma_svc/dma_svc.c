@@ -0,0 +1,255 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <lowlevel_drivers.h>
+#include <dma_svc.h>
+
+struct dma_svc_chan {
+	mdev_t *dev;
+	DMA_Channel_Type channel;
+	/* Request running on the channel, NULL when idle */
+	dma_svc_req_t *req;
+};
+
+static struct dma_svc_chan dma_svc_chans[NUM_DMA_CHANNELS];
+static int dma_svc_n;
+/* Requests waiting for a channel, oldest first */
+static dma_svc_req_t *dma_svc_head, *dma_svc_tail;
+
+/* The queue is used from the DMA interrupt and whatever else submits, the
+ * FreeRTOS critical sections can not be entered from an interrupt */
+static inline uint32_t dma_svc_lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	return primask;
+}
+
+static inline void dma_svc_unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static int dma_svc_program(struct dma_svc_chan *ch, dma_svc_desc_t *d)
+{
+	if (!is_isr_context())
+		return dma_drv_transfer(ch->dev, &d->dmac);
+
+	/* From the completion interrupt, the same way as the driver */
+	DMA_Disable(ch->channel);
+	DMA_ChannelInit(ch->channel, &d->dmac.dma_cfg);
+	DMA_SetPeripheralType(ch->channel, d->dmac.perDmaInter);
+	DMA_IntClr(ch->channel, INT_CH_ALL);
+	DMA_IntMask(ch->channel, INT_DMA_TRANS_COMPLETE, UNMASK);
+	DMA_Enable(ch->channel);
+	return WM_SUCCESS;
+}
+
+static dma_svc_req_t *dma_svc_dequeue(void)
+{
+	dma_svc_req_t *req = dma_svc_head;
+
+	if (req) {
+		dma_svc_head = req->next;
+		if (!dma_svc_head)
+			dma_svc_tail = NULL;
+		req->next = NULL;
+	}
+	return req;
+}
+
+static void dma_svc_isr(DMA_Channel_Type channel,
+			dma_transfer_status_t status, void *data)
+{
+	struct dma_svc_chan *ch = data;
+	dma_svc_req_t *req = ch->req, *next;
+	uint32_t primask;
+
+	if (!req)
+		return;
+
+	if (status == DMA_SUCCESS && req->cur->next) {
+		req->cur = req->cur->next;
+		dma_svc_program(ch, req->cur);
+		return;
+	}
+
+	/* Start the next request before the callback, which may queue
+	 * this one again */
+	primask = dma_svc_lock();
+	next = dma_svc_dequeue();
+	ch->req = next;
+	dma_svc_unlock(primask);
+	if (next) {
+		next->cur = next->desc;
+		dma_svc_program(ch, next->cur);
+	}
+
+	if (req->cb)
+		req->cb(status == DMA_SUCCESS ? WM_SUCCESS : -WM_FAIL,
+			req->arg);
+}
+
+int dma_svc_init(int nchans)
+{
+	struct dma_svc_chan *ch;
+
+	if (nchans < 1 || nchans > NUM_DMA_CHANNELS)
+		return -WM_E_INVAL;
+	if (dma_svc_n)
+		return WM_SUCCESS;
+
+	if (dma_drv_init() != WM_SUCCESS)
+		return -WM_FAIL;
+
+	while (dma_svc_n < nchans) {
+		ch = &dma_svc_chans[dma_svc_n];
+		ch->dev = dma_drv_open();
+		if (!ch->dev)
+			break;
+		ch->channel = (DMA_Channel_Type) (uint32_t) ch->dev;
+		ch->req = NULL;
+		if (dma_drv_set_cb(ch->dev, dma_svc_isr, ch) != WM_SUCCESS) {
+			dma_drv_close(ch->dev);
+			break;
+		}
+		dma_svc_n++;
+	}
+
+	return dma_svc_n ? WM_SUCCESS : -WM_FAIL;
+}
+
+int dma_svc_nchans(void)
+{
+	return dma_svc_n;
+}
+
+int dma_svc_desc_mem(dma_svc_desc_t *desc, void *dst, const void *src,
+		     uint32_t len)
+{
+	DMA_CFG_Type *cfg = &desc->dmac.dma_cfg;
+
+	if (len > DMA_SVC_MAX_BLOCK)
+		return -WM_E_INVAL;
+
+	memset(desc, 0, sizeof(*desc));
+	cfg->srcDmaAddr = (uint32_t)src;
+	cfg->destDmaAddr = (uint32_t)dst;
+	cfg->transfType = DMA_MEM_TO_MEM;
+	cfg->srcAddrInc = DMA_ADDR_INC;
+	cfg->destAddrInc = DMA_ADDR_INC;
+	cfg->transfLength = len;
+	if ((((uint32_t)dst | (uint32_t)src | len) & 3) == 0) {
+		cfg->transfWidth = DMA_TRANSF_WIDTH_32;
+		cfg->burstLength = DMA_ITEM_8;
+	} else {
+		cfg->transfWidth = DMA_TRANSF_WIDTH_8;
+		cfg->burstLength = DMA_ITEM_4;
+	}
+	return WM_SUCCESS;
+}
+
+int dma_svc_submit(dma_svc_req_t *req)
+{
+	struct dma_svc_chan *ch = NULL;
+	uint32_t primask;
+	int i, ret;
+
+	if (!dma_svc_n || !req || !req->desc)
+		return -WM_E_INVAL;
+
+	req->next = NULL;
+	req->cur = req->desc;
+
+	primask = dma_svc_lock();
+	for (i = 0; i < dma_svc_n; i++) {
+		if (!dma_svc_chans[i].req) {
+			ch = &dma_svc_chans[i];
+			ch->req = req;
+			break;
+		}
+	}
+	if (!ch) {
+		if (dma_svc_tail)
+			dma_svc_tail->next = req;
+		else
+			dma_svc_head = req;
+		dma_svc_tail = req;
+	}
+	dma_svc_unlock(primask);
+
+	if (!ch)
+		return WM_SUCCESS;
+
+	ret = dma_svc_program(ch, req->cur);
+	if (ret != WM_SUCCESS) {
+		primask = dma_svc_lock();
+		ch->req = NULL;
+		dma_svc_unlock(primask);
+		return -WM_E_INVAL;
+	}
+	return WM_SUCCESS;
+}
+
+int dma_svc_cancel(dma_svc_req_t *req)
+{
+	dma_svc_req_t **pp, *prev = NULL;
+	uint32_t primask;
+	int i, ret = -WM_E_INVAL;
+
+	primask = dma_svc_lock();
+	for (i = 0; i < dma_svc_n; i++)
+		if (dma_svc_chans[i].req == req)
+			ret = -WM_E_BUSY;
+	for (pp = &dma_svc_head; ret == -WM_E_INVAL && *pp;
+	     prev = *pp, pp = &(*pp)->next) {
+		if (*pp == req) {
+			*pp = req->next;
+			if (dma_svc_tail == req)
+				dma_svc_tail = prev;
+			req->next = NULL;
+			ret = WM_SUCCESS;
+			break;
+		}
+	}
+	dma_svc_unlock(primask);
+	return ret;
+}
+
+int dma_svc_abort(dma_svc_req_t *req)
+{
+	struct dma_svc_chan *ch = NULL;
+	dma_svc_req_t *next = NULL;
+	uint32_t primask;
+	int i;
+
+	primask = dma_svc_lock();
+	for (i = 0; i < dma_svc_n; i++) {
+		if (dma_svc_chans[i].req == req) {
+			ch = &dma_svc_chans[i];
+			/* Cleared so a completion that was about to be taken
+			 * is not put down to the next request */
+			DMA_Disable(ch->channel);
+			DMA_IntClr(ch->channel, INT_CH_ALL);
+			next = dma_svc_dequeue();
+			ch->req = next;
+			break;
+		}
+	}
+	dma_svc_unlock(primask);
+
+	if (!ch)
+		return dma_svc_cancel(req);
+
+	if (next) {
+		next->cur = next->desc;
+		dma_svc_program(ch, next->cur);
+	}
+	return WM_SUCCESS;
+}
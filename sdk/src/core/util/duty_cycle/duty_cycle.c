@@ -0,0 +1,195 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <mdev_rtc.h>
+#include <mw300_rtc.h>
+#include <mw300_pmu.h>
+#include <duty_cycle.h>
+#include <warm_resume.h>
+
+#define DUTY_CYCLE_MAGIC 0x44435943
+
+#define duty_w(...) wmlog_w("duty", ##__VA_ARGS__)
+
+/* In the retention RAM, zeroed at power on and kept in PM4 */
+struct duty_cycle_nv {
+	uint32_t magic;
+	uint32_t cycles;
+	uint32_t missed;
+	uint32_t last_awake_ms;
+	uint32_t max_awake_ms;
+	uint64_t total_awake_ms;
+	uint8_t state[DUTY_CYCLE_STATE_SIZE];
+};
+
+static struct duty_cycle_nv duty_cycle_nv
+	__attribute__((section(".nvram")));
+
+static const struct duty_cycle_cfg *duty_cycle_cfg;
+static mdev_t *duty_cycle_rtc;
+static os_timer_t duty_cycle_budget;
+static bool duty_cycle_was_woken;
+static bool duty_cycle_ulpcomp_woken;
+
+/* The alarm is only there to wake the PMU up */
+static void duty_cycle_alarm_cb(void)
+{
+}
+
+static void duty_cycle_budget_cb(os_timer_arg_t arg)
+{
+	duty_w("Awake budget of %u ms exceeded",
+		duty_cycle_cfg->awake_budget_ms);
+	duty_cycle_sleep();
+}
+
+int duty_cycle_start(const struct duty_cycle_cfg *cfg)
+{
+	if (!cfg || !cfg->period_s || !cfg->publish ||
+	    cfg->period_s > UINT32_MAX / DUTY_CYCLE_RTC_HZ ||
+	    cfg->ulpcomp_ref > PMU_ULPCOMP_REFVOLT_7 ||
+	    cfg->ulpcomp_hyst > PMU_ULPCOMP_HYST_3)
+		return -WM_E_INVAL;
+
+	duty_cycle_ulpcomp_woken = duty_cycle_nv.magic == DUTY_CYCLE_MAGIC &&
+		PMU_GetLastWakeupStatus(PMU_WAKEUP_ULPCOMP) == SET;
+	duty_cycle_was_woken = duty_cycle_nv.magic == DUTY_CYCLE_MAGIC &&
+		PMU_GetLastWakeupStatus(PMU_WAKEUP_RTC) == SET;
+	if (duty_cycle_nv.magic != DUTY_CYCLE_MAGIC) {
+		memset(&duty_cycle_nv, 0, sizeof(duty_cycle_nv));
+		duty_cycle_nv.magic = DUTY_CYCLE_MAGIC;
+	}
+	duty_cycle_cfg = cfg;
+
+	if (rtc_drv_init() != WM_SUCCESS)
+		return -WM_FAIL;
+	duty_cycle_rtc = rtc_drv_open("MDEV_RTC");
+	if (!duty_cycle_rtc)
+		return -WM_FAIL;
+	/* The RTC, powered in PM4, still runs after a wake-up */
+	if (RTC_GetCntStatus() != ENABLE) {
+		rtc_drv_set(duty_cycle_rtc, UINT32_MAX);
+		rtc_drv_start(duty_cycle_rtc);
+	}
+	rtc_drv_set_alarm_cb(duty_cycle_alarm_cb);
+
+	if (!cfg->awake_budget_ms)
+		return WM_SUCCESS;
+	if (os_timer_create(&duty_cycle_budget, "duty-budget",
+			    os_msec_to_ticks(cfg->awake_budget_ms),
+			    duty_cycle_budget_cb, NULL, OS_TIMER_ONE_SHOT,
+			    OS_TIMER_AUTO_ACTIVATE) != WM_SUCCESS)
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
+
+static void duty_cycle_enter(bool published)
+{
+	uint32_t awake_ms = os_get_timestamp() / 1000;
+	uint32_t now, upp, alarm, counts;
+
+	duty_cycle_nv.cycles++;
+	if (!published)
+		duty_cycle_nv.missed++;
+	duty_cycle_nv.last_awake_ms = awake_ms;
+	if (awake_ms > duty_cycle_nv.max_awake_ms)
+		duty_cycle_nv.max_awake_ms = awake_ms;
+	duty_cycle_nv.total_awake_ms += awake_ms;
+
+	/* The period runs from the wake-up, a cycle which took longer
+	 * sleeps a single tick */
+	counts = duty_cycle_cfg->period_s * DUTY_CYCLE_RTC_HZ;
+	if (duty_cycle_was_woken)
+		counts = counts > awake_ms * (DUTY_CYCLE_RTC_HZ / 1000) ?
+			counts - awake_ms * (DUTY_CYCLE_RTC_HZ / 1000) : 1;
+
+	if (warm_resume_save() != WM_SUCCESS)
+		duty_w("State not kept across the sleep");
+
+	wmprintf("[duty] cycle %u awake %u ms, sleeping %u ms\r\n",
+		 duty_cycle_nv.cycles, awake_ms,
+		 counts / (DUTY_CYCLE_RTC_HZ / 1000));
+	wmstdio_flush();
+
+	os_disable_all_interrupts();
+	now = rtc_drv_get(duty_cycle_rtc);
+	upp = rtc_drv_get_uppval(duty_cycle_rtc);
+	alarm = upp - now >= counts ? now + counts : counts - (upp - now) - 1;
+	rtc_drv_set_alarm(duty_cycle_rtc, alarm);
+	PMU_ClearWakeupSrcInt(PMU_WAKEUP_RTC);
+	PMU_WakeupSrcIntMask(PMU_WAKEUP_RTC, UNMASK);
+	if (duty_cycle_cfg->wake_ulpcomp) {
+		PMU_UlpcompModeSelect(PMU_ULPCOMP_MODE_SINGLE);
+		PMU_UlpcompRefVoltageSel(duty_cycle_cfg->ulpcomp_ref);
+		PMU_UlpcompHysteresisSel(duty_cycle_cfg->ulpcomp_hyst);
+		PMU_UlpcompCmd(ENABLE);
+		PMU_ClearWakeupSrcInt(PMU_WAKEUP_ULPCOMP);
+		PMU_WakeupSrcIntMask(PMU_WAKEUP_ULPCOMP, UNMASK);
+	}
+	PMU_SetSleepMode(PMU_PM4);
+	for (;;) {
+		/* The wake-up from PM4 is a reset */
+		__asm volatile("dsb");
+		__asm volatile("wfi");
+	}
+}
+
+void duty_cycle_run(void)
+{
+	int ret = duty_cycle_cfg->publish(duty_cycle_cfg->arg);
+
+	if (ret != WM_SUCCESS)
+		duty_w("Publish failed: %d", ret);
+	duty_cycle_enter(ret == WM_SUCCESS);
+}
+
+void duty_cycle_sleep(void)
+{
+	duty_cycle_enter(false);
+}
+
+bool duty_cycle_woken(void)
+{
+	return duty_cycle_was_woken;
+}
+
+bool duty_cycle_woken_by_ulpcomp(void)
+{
+	return duty_cycle_ulpcomp_woken;
+}
+
+void *duty_cycle_state(void)
+{
+	return duty_cycle_nv.state;
+}
+
+void duty_cycle_get_stats(struct duty_cycle_stats *stats)
+{
+	stats->cycles = duty_cycle_nv.cycles;
+	stats->missed = duty_cycle_nv.missed;
+	stats->last_awake_ms = duty_cycle_nv.last_awake_ms;
+	stats->max_awake_ms = duty_cycle_nv.max_awake_ms;
+	stats->avg_awake_ms = duty_cycle_nv.cycles ?
+		duty_cycle_nv.total_awake_ms / duty_cycle_nv.cycles : 0;
+}
+
+int duty_cycle_json(struct json_writer *w, const char *key)
+{
+	struct duty_cycle_stats s;
+
+	duty_cycle_get_stats(&s);
+	json_writer_start_object(w, key);
+	json_writer_add_uint(w, "cycles", s.cycles);
+	json_writer_add_uint(w, "missed", s.missed);
+	json_writer_add_uint(w, "awake_ms", s.last_awake_ms);
+	json_writer_add_uint(w, "max_ms", s.max_awake_ms);
+	json_writer_add_uint(w, "avg_ms", s.avg_awake_ms);
+	return json_writer_end_object(w);
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-$(CONFIG_ENERGY_STATS) += libenergy_stats
+libenergy_stats-objs-y := energy_stats.c
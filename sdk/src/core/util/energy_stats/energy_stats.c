@@ -0,0 +1,229 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Times are kept in RTC counts per state and only turned into ms and uJ
+ * when read. A state change is a read of the RTC counter and two adds with
+ * the syscall interrupts masked, since the kernel makes them from the
+ * context switch and the tickless idle with the interrupts disabled.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <mw300_rtc.h>
+#include <metrics.h>
+#include <energy_stats.h>
+
+#define energy_w(...) wmlog_w("energy", ##__VA_ARGS__)
+
+static const char *const energy_cpu_names[ENERGY_CPU_STATE_CNT] = {
+	"e_act_ms", "e_idle_ms", "e_pm2_ms", "e_pm3_ms",
+};
+
+static const char *const energy_radio_names[ENERGY_RADIO_STATE_CNT] = {
+	"e_rf_ms", "e_rfps_ms",
+};
+
+static struct {
+	struct energy_model model;
+	bool running;
+	bool registered;
+	uint32_t upp;
+	uint8_t cpu;
+	uint8_t radio;
+	uint32_t cpu_since;
+	uint32_t radio_since;
+	uint64_t cpu_cnt[ENERGY_CPU_STATE_CNT];
+	uint64_t radio_cnt[ENERGY_RADIO_STATE_CNT];
+	uint32_t samples;
+	/* At the last read of the e_uj_sample gauge */
+	uint64_t gauge_uj;
+	uint32_t gauge_samples;
+} es;
+
+static uint32_t energy_elapsed(uint32_t start, uint32_t now)
+{
+	if (now >= start)
+		return now - start;
+	return (es.upp - start) + now + 1;
+}
+
+/* Called with the syscall interrupts masked */
+static void energy_account(uint32_t now)
+{
+	es.cpu_cnt[es.cpu] += energy_elapsed(es.cpu_since, now);
+	es.cpu_since = now;
+	es.radio_cnt[es.radio] += energy_elapsed(es.radio_since, now);
+	es.radio_since = now;
+}
+
+void energy_stats_cpu(enum energy_cpu_state state)
+{
+	unsigned long flags;
+	uint32_t now;
+
+	if (!es.running || state >= ENERGY_CPU_STATE_CNT)
+		return;
+	flags = os_mask_syscall_interrupts();
+	now = RTC_GetCounterVal();
+	es.cpu_cnt[es.cpu] += energy_elapsed(es.cpu_since, now);
+	es.cpu_since = now;
+	es.cpu = state;
+	os_unmask_syscall_interrupts(flags);
+}
+
+void energy_stats_radio(enum energy_radio_state state)
+{
+	unsigned long flags;
+	uint32_t now;
+
+	if (!es.running || state >= ENERGY_RADIO_STATE_CNT)
+		return;
+	flags = os_mask_syscall_interrupts();
+	now = RTC_GetCounterVal();
+	es.radio_cnt[es.radio] += energy_elapsed(es.radio_since, now);
+	es.radio_since = now;
+	es.radio = state;
+	os_unmask_syscall_interrupts(flags);
+}
+
+void energy_stats_sample(void)
+{
+	unsigned long flags = os_mask_syscall_interrupts();
+
+	es.samples++;
+	os_unmask_syscall_interrupts(flags);
+}
+
+void energy_stats_get(struct energy_totals *totals)
+{
+	uint64_t cpu_cnt[ENERGY_CPU_STATE_CNT];
+	uint64_t radio_cnt[ENERGY_RADIO_STATE_CNT];
+	uint64_t ua_cnt = 0;
+	unsigned long flags;
+	uint32_t hz;
+	int i;
+
+	memset(totals, 0, sizeof(*totals));
+	if (!es.running)
+		return;
+
+	flags = os_mask_syscall_interrupts();
+	energy_account(RTC_GetCounterVal());
+	memcpy(cpu_cnt, es.cpu_cnt, sizeof(cpu_cnt));
+	memcpy(radio_cnt, es.radio_cnt, sizeof(radio_cnt));
+	totals->samples = es.samples;
+	os_unmask_syscall_interrupts(flags);
+
+	hz = es.model.rtc_hz;
+	for (i = 0; i < ENERGY_CPU_STATE_CNT; i++) {
+		totals->cpu_ms[i] = cpu_cnt[i] * 1000 / hz;
+		ua_cnt += cpu_cnt[i] * es.model.cpu_ua[i];
+	}
+	for (i = 0; i < ENERGY_RADIO_STATE_CNT; i++) {
+		totals->radio_ms[i] = radio_cnt[i] * 1000 / hz;
+		ua_cnt += radio_cnt[i] * es.model.radio_ua[i];
+	}
+	/* uA s times mV is nJ */
+	totals->uj = ua_cnt / hz * es.model.mv / 1000;
+}
+
+static uint32_t energy_read_cpu_ms(void *ctx)
+{
+	struct energy_totals t;
+
+	energy_stats_get(&t);
+	return (uint32_t)t.cpu_ms[(uintptr_t)ctx];
+}
+
+static uint32_t energy_read_radio_ms(void *ctx)
+{
+	struct energy_totals t;
+
+	energy_stats_get(&t);
+	return (uint32_t)t.radio_ms[(uintptr_t)ctx];
+}
+
+static uint32_t energy_read_uj(void *ctx)
+{
+	struct energy_totals t;
+
+	energy_stats_get(&t);
+	return (uint32_t)t.uj;
+}
+
+static uint32_t energy_read_samples(void *ctx)
+{
+	return es.samples;
+}
+
+/* Since the last read */
+static uint32_t energy_read_uj_sample(void *ctx)
+{
+	struct energy_totals t;
+	uint32_t samples;
+	uint64_t uj;
+
+	energy_stats_get(&t);
+	uj = t.uj - es.gauge_uj;
+	samples = t.samples - es.gauge_samples;
+	es.gauge_uj = t.uj;
+	es.gauge_samples = t.samples;
+	return samples ? (uint32_t)(uj / samples) : 0;
+}
+
+static void energy_register(void)
+{
+	uintptr_t i;
+	int ret = 0;
+
+	for (i = 0; i < ENERGY_CPU_STATE_CNT && ret >= 0; i++)
+		ret = metrics_counter(energy_cpu_names[i], energy_read_cpu_ms,
+				      (void *)i);
+	for (i = 0; i < ENERGY_RADIO_STATE_CNT && ret >= 0; i++)
+		ret = metrics_counter(energy_radio_names[i],
+				      energy_read_radio_ms, (void *)i);
+	if (ret >= 0)
+		ret = metrics_counter("e_uj", energy_read_uj, NULL);
+	if (ret >= 0)
+		ret = metrics_counter("e_samples", energy_read_samples, NULL);
+	if (ret >= 0)
+		ret = metrics_gauge("e_uj_sample", energy_read_uj_sample,
+				    NULL);
+	if (ret < 0)
+		energy_w("metrics not all registered: %d", ret);
+}
+
+int energy_stats_init(const struct energy_model *model)
+{
+	unsigned long flags;
+	uint32_t now;
+
+	if (!model || !model->rtc_hz)
+		return -WM_E_INVAL;
+	if (RTC_GetCntStatus() != ENABLE)
+		return -WM_FAIL;
+
+	flags = os_mask_syscall_interrupts();
+	es.model = *model;
+	if (!es.running) {
+		es.upp = RTC_GetCounterUppVal();
+		now = RTC_GetCounterVal();
+		es.cpu = ENERGY_CPU_ACTIVE;
+		es.radio = ENERGY_RADIO_ACTIVE;
+		es.cpu_since = now;
+		es.radio_since = now;
+		es.running = true;
+	}
+	os_unmask_syscall_interrupts(flags);
+
+	if (!es.registered) {
+		energy_register();
+		es.registered = true;
+	}
+	return WM_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <fast_float.h>
+
+/* Longest number handed to sscanf() */
+#define FAST_FLOAT_MAX_TEXT 48
+
+static const float pow10f[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+static const double pow10d[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const uint32_t pow10u[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000
+};
+
+struct fast_decimal {
+	uint64_t mant;
+	int exp10;
+	int digits;		/* Significant digits in mant */
+	int neg;
+	int exact;		/* No digit was dropped */
+};
+
+/* Splits a JSON number into mant * 10^exp10, returns its length */
+static int fast_decimal_scan(const char *s, int len, struct fast_decimal *d)
+{
+	const char *p = s, *end = s + len;
+	const char *digits;
+	int exp = 0, exp_neg = 0;
+
+	memset(d, 0, sizeof(*d));
+	d->exact = 1;
+
+	if (p < end && *p == '-') {
+		d->neg = 1;
+		p++;
+	}
+
+	digits = p;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (d->digits < 19) {
+			d->mant = d->mant * 10 + (*p - '0');
+			if (d->mant)
+				d->digits++;
+		} else {
+			d->exp10++;
+			if (*p != '0')
+				d->exact = 0;
+		}
+	}
+	if (p == digits)
+		return 0;
+
+	if (p < end && *p == '.') {
+		digits = ++p;
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (d->digits < 19) {
+				d->mant = d->mant * 10 + (*p - '0');
+				d->exp10--;
+				if (d->mant)
+					d->digits++;
+			} else if (*p != '0') {
+				d->exact = 0;
+			}
+		}
+		if (p == digits)
+			return 0;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *e = p++;
+
+		if (p < end && (*p == '+' || *p == '-'))
+			exp_neg = *p++ == '-';
+		digits = p;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			if (exp < 10000)
+				exp = exp * 10 + (*p - '0');
+		if (p == digits)
+			/* Not an exponent, the number ends before the e */
+			return e - s;
+		d->exp10 += exp_neg ? -exp : exp;
+	}
+
+	return p - s;
+}
+
+/* sscanf() needs the number NUL terminated */
+static int fast_float_slow(const char *s, int len, const char *fmt,
+			   void *value)
+{
+	char text[FAST_FLOAT_MAX_TEXT];
+
+	if (len >= (int)sizeof(text))
+		return 0;
+	memcpy(text, s, len);
+	text[len] = '\0';
+	return sscanf(text, fmt, value) == 1 ? len : 0;
+}
+
+int fast_strtof(const char *str, int len, float *value)
+{
+	struct fast_decimal d;
+	float f;
+	int n;
+
+	n = fast_decimal_scan(str, len, &d);
+	if (!n)
+		return 0;
+
+	/* The mantissa and the power of ten are exact floats, so is the
+	 * result of the one rounding of the multiply or divide */
+	if (!d.exact || d.mant > (1UL << 24) || d.exp10 < -10 ||
+	    d.exp10 > 10)
+		return fast_float_slow(str, n, "%f", value);
+
+	f = (float)(uint32_t)d.mant;
+	if (d.exp10 < 0)
+		f /= pow10f[-d.exp10];
+	else
+		f *= pow10f[d.exp10];
+	*value = d.neg ? -f : f;
+	return n;
+}
+
+int fast_strtod(const char *str, int len, double *value)
+{
+	struct fast_decimal d;
+	double v;
+	int n;
+
+	n = fast_decimal_scan(str, len, &d);
+	if (!n)
+		return 0;
+
+	if (!d.exact || d.mant > (1ULL << 53) || d.exp10 < -22 ||
+	    d.exp10 > 22)
+		return fast_float_slow(str, n, "%lf", value);
+
+	v = (double)d.mant;
+	if (d.exp10 < 0)
+		v /= pow10d[-d.exp10];
+	else
+		v *= pow10d[d.exp10];
+	*value = d.neg ? -v : v;
+	return n;
+}
+
+int fast_ftoa(float value, int decimals, char *buf, int size)
+{
+	char text[20 + 1 + FAST_FTOA_MAX_DECIMALS + 1];
+	char *end = text + sizeof(text);
+	char *s = end;
+	uint32_t bits, mant, frac_bits;
+	uint64_t ipart, scaled, rem, half;
+	uint32_t frac;
+	int exp, shift, odd, i;
+
+	if (decimals < 0 || decimals > FAST_FTOA_MAX_DECIMALS)
+		return -WM_E_INVAL;
+
+	memcpy(&bits, &value, sizeof(bits));
+	exp = (bits >> 23) & 0xff;
+	mant = bits & 0x7fffff;
+	if (exp == 0xff)
+		return -WM_E_INVAL;
+	if (exp)
+		mant |= 0x800000;
+	else
+		exp = 1;
+	/* The value is mant * 2^(exp - 150) */
+	exp -= 150;
+
+	frac = 0;
+	if (exp >= 0) {
+		if (exp > 39)
+			return -WM_E_INVAL;
+		ipart = (uint64_t)mant << exp;
+	} else {
+		shift = -exp;
+		ipart = shift < 24 ? mant >> shift : 0;
+		frac_bits = shift < 24 ? mant & ((1UL << shift) - 1) : mant;
+		/* At most 2^24 * 10^9, the bits below the point scaled to the
+		 * decimals, rounded half to even as printf does */
+		scaled = (uint64_t)frac_bits * pow10u[decimals];
+		if (shift < 64) {
+			frac = scaled >> shift;
+			rem = scaled & ((1ULL << shift) - 1);
+			half = 1ULL << (shift - 1);
+			odd = decimals ? frac & 1 : ipart & 1;
+			if (rem > half || (rem == half && odd))
+				frac++;
+			if (frac >= pow10u[decimals]) {
+				ipart++;
+				frac -= pow10u[decimals];
+			}
+		}
+	}
+
+	if (decimals) {
+		for (i = 0; i < decimals; i++) {
+			*--s = '0' + frac % 10;
+			frac /= 10;
+		}
+		*--s = '.';
+	}
+	do {
+		*--s = '0' + ipart % 10;
+		ipart /= 10;
+	} while (ipart);
+	if (bits >> 31)
+		*--s = '-';
+
+	if (end - s >= size)
+		return -WM_E_NOSPC;
+	memcpy(buf, s, end - s);
+	buf[end - s] = '\0';
+	return end - s;
+}
@@ -0,0 +1,9 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libfastmem
+libfastmem-objs-y := memcpy.c memcpy_dma.c
+# memcpy() and memset() themselves, the byte loops must not be turned back
+# into calls to them
+libfastmem-cflags-y := -fno-tree-loop-distribute-patterns
+disable-lto-for += libfastmem
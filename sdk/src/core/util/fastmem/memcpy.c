@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/* memcpy() and memset() for the Cortex-M4 of the MW300. They are linked
+ * ahead of the C library, whose versions go a byte at a time.
+ *
+ * Both align the destination to a word, then move 32 bytes per iteration
+ * with ldmia/stmia of four registers, then single words and the tail
+ * bytes. A source that is still not aligned once the destination is, is
+ * read with unaligned ldr, which the Cortex-M4 splits into two bus
+ * accesses, still well ahead of the byte loop. Below FASTMEM_SMALL bytes
+ * the alignment does not pay off and the byte loop is used as it is.
+ *
+ * Both are __ramfunc, pbuf copies and the MQTT buffers go through them on
+ * every packet.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <compiler.h>
+#include <fastmem.h>
+
+typedef struct {
+	uint32_t v;
+} __attribute__((packed)) fastmem_una32_t;
+
+/** Copy of 32-byte blocks, both word aligned, nblocks > 0 */
+static inline void
+copy_blocks(uint32_t *d, const uint32_t *s, size_t nblocks)
+{
+#if defined(__GNUC__) && defined(__thumb2__)
+	__asm__ volatile (
+		"1:\n"
+		"ldmia  %[s]!, {r3, r4, r5, r6}\n"
+		"stmia  %[d]!, {r3, r4, r5, r6}\n"
+		"ldmia  %[s]!, {r3, r4, r5, r6}\n"
+		"stmia  %[d]!, {r3, r4, r5, r6}\n"
+		"subs   %[n], %[n], #1\n"
+		"bne    1b\n"
+		: [d] "+r" (d), [s] "+r" (s), [n] "+r" (nblocks)
+		:
+		: "r3", "r4", "r5", "r6", "cc", "memory");
+#else
+	int i;
+
+	while (nblocks--)
+		for (i = 0; i < 8; i++)
+			*d++ = *s++;
+#endif
+}
+
+/** Fill of 32-byte blocks, word aligned, nblocks > 0 */
+static inline void
+set_blocks(uint32_t *d, uint32_t v, size_t nblocks)
+{
+#if defined(__GNUC__) && defined(__thumb2__)
+	/* stmia takes a register once, the pattern is copied to four */
+	__asm__ volatile (
+		"mov    r3, %[v]\n"
+		"mov    r4, %[v]\n"
+		"mov    r5, %[v]\n"
+		"mov    r6, %[v]\n"
+		"1:\n"
+		"stmia  %[d]!, {r3, r4, r5, r6}\n"
+		"stmia  %[d]!, {r3, r4, r5, r6}\n"
+		"subs   %[n], %[n], #1\n"
+		"bne    1b\n"
+		: [d] "+r" (d), [n] "+r" (nblocks)
+		: [v] "r" (v)
+		: "r3", "r4", "r5", "r6", "cc", "memory");
+#else
+	int i;
+
+	while (nblocks--)
+		for (i = 0; i < 8; i++)
+			*d++ = v;
+#endif
+}
+
+__ramfunc void *memcpy(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	if (n >= FASTMEM_SMALL) {
+		while ((uintptr_t)d & 3) {
+			*d++ = *s++;
+			n--;
+		}
+
+		if (((uintptr_t)s & 3) == 0) {
+			if (n >= 32) {
+				copy_blocks((uint32_t *)d,
+					    (const uint32_t *)s, n >> 5);
+				d += n & ~31;
+				s += n & ~31;
+				n &= 31;
+			}
+			while (n >= 4) {
+				*(uint32_t *)d = *(const uint32_t *)s;
+				d += 4;
+				s += 4;
+				n -= 4;
+			}
+		} else {
+			while (n >= 4) {
+				*(uint32_t *)d = ((const fastmem_una32_t *)s)->v;
+				d += 4;
+				s += 4;
+				n -= 4;
+			}
+		}
+	}
+
+	while (n--)
+		*d++ = *s++;
+
+	return dst;
+}
+
+__ramfunc void *memset(void *dst, int c, size_t n)
+{
+	uint8_t *d = dst;
+	uint32_t v = (uint8_t)c;
+
+	if (n >= FASTMEM_SMALL) {
+		while ((uintptr_t)d & 3) {
+			*d++ = (uint8_t)c;
+			n--;
+		}
+
+		v |= v << 8;
+		v |= v << 16;
+		if (n >= 32) {
+			set_blocks((uint32_t *)d, v, n >> 5);
+			d += n & ~31;
+			n &= 31;
+		}
+		while (n >= 4) {
+			*(uint32_t *)d = v;
+			d += 4;
+			n -= 4;
+		}
+	}
+
+	while (n--)
+		*d++ = (uint8_t)c;
+
+	return dst;
+}
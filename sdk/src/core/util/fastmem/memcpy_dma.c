@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <lowlevel_drivers.h>
+#include <dma_svc.h>
+#include <fastmem.h>
+
+/* Descriptors chained in one request, FASTMEM_DMA_MAX bytes each */
+#define FASTMEM_DMA_DESCS 4
+
+static bool fastmem_dma_ready;
+static os_mutex_t fastmem_dma_lock;
+/* Task waiting for the transfer, it is notified from the DMA interrupt */
+static os_thread_t fastmem_dma_waiter;
+static volatile bool fastmem_dma_done;
+static dma_svc_desc_t fastmem_dma_desc[FASTMEM_DMA_DESCS];
+static dma_svc_req_t fastmem_dma_req;
+static int fastmem_dma_result;
+static size_t fastmem_dma_min = FASTMEM_DMA_THRESHOLD;
+
+static void fastmem_dma_cb(int result, void *arg)
+{
+	fastmem_dma_result = result;
+	fastmem_dma_done = true;
+	os_task_notify_give(fastmem_dma_waiter);
+}
+
+int fastmem_dma_init(void)
+{
+	if (fastmem_dma_ready)
+		return WM_SUCCESS;
+
+	if (dma_svc_init(1) != WM_SUCCESS)
+		return -WM_FAIL;
+	if (os_mutex_create(&fastmem_dma_lock, "fastmem",
+			    OS_MUTEX_INHERIT) != WM_SUCCESS)
+		return -WM_FAIL;
+
+	fastmem_dma_req.desc = fastmem_dma_desc;
+	fastmem_dma_req.cb = fastmem_dma_cb;
+	fastmem_dma_ready = true;
+	return WM_SUCCESS;
+}
+
+/* Word aligned, lock held. Copies up to FASTMEM_DMA_DESCS blocks as one
+ * chain and returns the bytes copied, 0 if the transfer failed. */
+static size_t fastmem_dma_xfer(void *dst, const void *src, size_t n)
+{
+	size_t done = 0, chunk;
+	int i;
+
+	for (i = 0; i < FASTMEM_DMA_DESCS && n - done >= 4; i++) {
+		chunk = (n - done) & ~3;
+		if (chunk > FASTMEM_DMA_MAX)
+			chunk = FASTMEM_DMA_MAX;
+		dma_svc_desc_mem(&fastmem_dma_desc[i], (uint8_t *)dst + done,
+				 (const uint8_t *)src + done, chunk);
+		if (i)
+			fastmem_dma_desc[i - 1].next = &fastmem_dma_desc[i];
+		done += chunk;
+	}
+
+	fastmem_dma_waiter = os_get_current_task_handle();
+	fastmem_dma_done = false;
+	if (dma_svc_submit(&fastmem_dma_req) != WM_SUCCESS)
+		return 0;
+	/*
+	 * A mem to mem transfer always ends, with a bus error at worst. The
+	 * flag tells the notification of the callback from one the task had
+	 * pending from elsewhere.
+	 */
+	while (!fastmem_dma_done)
+		os_task_notify_take(true, OS_WAIT_FOREVER);
+	return fastmem_dma_result == WM_SUCCESS ? done : 0;
+}
+
+void *memcpy_dma(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	size_t chunk;
+
+	if (n < fastmem_dma_min || !fastmem_dma_ready || is_isr_context() ||
+	    (((uintptr_t)d | (uintptr_t)s) & 3))
+		return memcpy(dst, src, n);
+
+	os_mutex_get(&fastmem_dma_lock, OS_WAIT_FOREVER);
+	while (n >= 4) {
+		/* What is left after a failure goes to memcpy() */
+		chunk = fastmem_dma_xfer(d, s, n);
+		if (!chunk)
+			break;
+		d += chunk;
+		s += chunk;
+		n -= chunk;
+	}
+	os_mutex_put(&fastmem_dma_lock);
+
+	memcpy(d, s, n);
+	return dst;
+}
+
+size_t fastmem_dma_threshold(void)
+{
+	return fastmem_dma_min;
+}
+
+void fastmem_dma_set_threshold(size_t n)
+{
+	fastmem_dma_min = n;
+}
+
+/* Fewest cycles of a few runs, the first run also warms the flash cache */
+#define FASTMEM_CAL_RUNS 4
+
+int fastmem_dma_calibrate(size_t *crossover)
+{
+	uint8_t *a, *b;
+	uint32_t t, cpu, dma;
+	size_t len;
+	int i, ret = -WM_FAIL;
+
+	if (!fastmem_dma_ready)
+		return -WM_FAIL;
+
+	a = os_mem_alloc(FASTMEM_DMA_MAX);
+	b = os_mem_alloc(FASTMEM_DMA_MAX);
+	if (!a || !b) {
+		if (a)
+			os_mem_free(a);
+		if (b)
+			os_mem_free(b);
+		return -WM_E_NOMEM;
+	}
+	memset(a, 0x5a, FASTMEM_DMA_MAX);
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	os_mutex_get(&fastmem_dma_lock, OS_WAIT_FOREVER);
+	for (len = 256; ; len *= 2) {
+		if (len > FASTMEM_DMA_MAX)
+			len = FASTMEM_DMA_MAX;
+
+		cpu = dma = UINT32_MAX;
+		for (i = 0; i < FASTMEM_CAL_RUNS; i++) {
+			t = DWT->CYCCNT;
+			memcpy(b, a, len);
+			t = DWT->CYCCNT - t;
+			if (t < cpu)
+				cpu = t;
+
+			t = DWT->CYCCNT;
+			if (fastmem_dma_xfer(b, a, len) != (len & ~3))
+				goto out;
+			t = DWT->CYCCNT - t;
+			if (t < dma)
+				dma = t;
+		}
+
+		if (dma <= cpu) {
+			fastmem_dma_min = len;
+			if (crossover)
+				*crossover = len;
+			ret = WM_SUCCESS;
+			break;
+		}
+		if (len == FASTMEM_DMA_MAX)
+			break;
+	}
+out:
+	os_mutex_put(&fastmem_dma_lock);
+
+	os_mem_free(a);
+	os_mem_free(b);
+	return ret;
+}
@@ -0,0 +1,169 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include <flash_async.h>
+
+enum flash_async_type {
+	FLASH_ASYNC_WRITE,
+	FLASH_ASYNC_READ,
+	FLASH_ASYNC_ERASE,
+	FLASH_ASYNC_FLUSH,
+};
+
+struct flash_async_op {
+	enum flash_async_type type;
+	mdev_t *dev;
+	uint8_t *buf;
+	uint32_t len;
+	uint32_t addr;
+	flash_async_cb_t cb;
+	void *arg;
+};
+
+static os_queue_pool_define(flash_async_pool,
+			    FLASH_ASYNC_QUEUE_LEN *
+			    sizeof(struct flash_async_op));
+static os_queue_t flash_async_queue;
+static os_thread_t flash_async_thread;
+static os_thread_stack_define(flash_async_stack, 1024);
+static bool flash_async_started;
+
+static int flash_async_do(const struct flash_async_op *op)
+{
+	uint32_t done, n;
+
+	switch (op->type) {
+	case FLASH_ASYNC_WRITE:
+		/* A page at a time, up to the next page boundary */
+		for (done = 0; done < op->len; done += n) {
+			n = FLASH_ASYNC_PAGE_SIZE -
+				(op->addr + done) % FLASH_ASYNC_PAGE_SIZE;
+			if (n > op->len - done)
+				n = op->len - done;
+			if (flash_drv_write(op->dev, op->buf + done, n,
+					    op->addr + done) != 0)
+				return -WM_FAIL;
+			os_thread_relinquish();
+		}
+		return WM_SUCCESS;
+	case FLASH_ASYNC_READ:
+		return flash_drv_read(op->dev, op->buf, op->len,
+				      op->addr) == 0 ? WM_SUCCESS : -WM_FAIL;
+	case FLASH_ASYNC_ERASE:
+		for (done = 0; done < op->len; done += n) {
+			n = FLASH_ASYNC_SECTOR_SIZE;
+			if (n > op->len - done)
+				n = op->len - done;
+			if (flash_drv_erase(op->dev, op->addr + done, n) != 0)
+				return -WM_FAIL;
+			os_thread_relinquish();
+		}
+		return WM_SUCCESS;
+	case FLASH_ASYNC_FLUSH:
+		os_semaphore_put(op->arg);
+		return WM_SUCCESS;
+	}
+	return -WM_FAIL;
+}
+
+static void flash_async_main(os_thread_arg_t arg)
+{
+	struct flash_async_op op;
+	int ret;
+
+	while (1) {
+		if (os_queue_recv(&flash_async_queue, &op,
+				  OS_WAIT_FOREVER) != WM_SUCCESS)
+			continue;
+		ret = flash_async_do(&op);
+		if (op.cb)
+			op.cb(ret, op.arg);
+	}
+}
+
+int flash_async_init(void)
+{
+	if (flash_async_started)
+		return WM_SUCCESS;
+
+	if (os_queue_create(&flash_async_queue, "flash-async",
+			    sizeof(struct flash_async_op),
+			    &flash_async_pool) != WM_SUCCESS)
+		return -WM_FAIL;
+	/* Below the application threads, they only wait for the flash when
+	 * they run from it */
+	if (os_thread_create(&flash_async_thread, "flash-async",
+			     flash_async_main, NULL, &flash_async_stack,
+			     OS_PRIO_4) != WM_SUCCESS) {
+		os_queue_delete(&flash_async_queue);
+		return -WM_FAIL;
+	}
+	flash_async_started = true;
+	return WM_SUCCESS;
+}
+
+static int flash_async_queue_op(enum flash_async_type type, mdev_t *dev,
+				uint8_t *buf, uint32_t len, uint32_t addr,
+				flash_async_cb_t cb, void *arg)
+{
+	struct flash_async_op op = {
+		.type = type,
+		.dev = dev,
+		.buf = buf,
+		.len = len,
+		.addr = addr,
+		.cb = cb,
+		.arg = arg,
+	};
+
+	if (!flash_async_started)
+		return -WM_FAIL;
+	return os_queue_send(&flash_async_queue, &op, OS_WAIT_FOREVER);
+}
+
+int flash_async_write(mdev_t *dev, const uint8_t *buf, uint32_t len,
+		      uint32_t addr, flash_async_cb_t cb, void *arg)
+{
+	return flash_async_queue_op(FLASH_ASYNC_WRITE, dev, (uint8_t *) buf,
+				    len, addr, cb, arg);
+}
+
+int flash_async_read(mdev_t *dev, uint8_t *buf, uint32_t len,
+		     uint32_t addr, flash_async_cb_t cb, void *arg)
+{
+	return flash_async_queue_op(FLASH_ASYNC_READ, dev, buf, len, addr,
+				    cb, arg);
+}
+
+int flash_async_erase(mdev_t *dev, uint32_t start, uint32_t size,
+		      flash_async_cb_t cb, void *arg)
+{
+	return flash_async_queue_op(FLASH_ASYNC_ERASE, dev, NULL, size,
+				    start, cb, arg);
+}
+
+int flash_async_flush(void)
+{
+	os_semaphore_t done;
+	int ret;
+
+	if (!flash_async_started)
+		return -WM_FAIL;
+	if (os_semaphore_create(&done, "flash-flush") != WM_SUCCESS)
+		return -WM_FAIL;
+	/* Binary semaphores are created available */
+	os_semaphore_get(&done, OS_NO_WAIT);
+
+	ret = flash_async_queue_op(FLASH_ASYNC_FLUSH, NULL, NULL, 0, 0, NULL,
+				   &done);
+	if (ret == WM_SUCCESS)
+		os_semaphore_get(&done, OS_WAIT_FOREVER);
+	os_semaphore_delete(&done);
+	return ret;
+}
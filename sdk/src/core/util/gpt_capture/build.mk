@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libgpt_capture
+libgpt_capture-objs-y := gpt_capture.c
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The channel latches the counter into its CMR0 register on every edge and
+ * raises DMA request 0 of the GPT, the DMA moves CMR0 to the block. The
+ * counter's upper value is the largest, so the counter wraps at 2^32 and
+ * the differences of timestamps stay right across a wrap.
+ */
+
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <gpt_capture.h>
+
+#define gpt_capture_w(...) wmlog_w("gpt_capture", ##__VA_ARGS__)
+
+static gpt_reg_t *const gpt_regs[] = {GPT0, GPT1, GPT2, GPT3};
+
+/* DMA request 0 of each GPT */
+static const DMA_PerMapping_Type gpt_dma_per[] = {
+	DMA_PER0_GPT0_0, DMA_PER2_GPT1_0, DMA_PER32_GPT2_0, DMA_PER34_GPT3_0,
+};
+
+static void gpt_capture_dma_cb(DMA_Channel_Type channel,
+			       dma_transfer_status_t status, void *data)
+{
+	gpt_capture_t *cap = data;
+	int full = cap->filling;
+	int next = full ^ 1;
+
+	if (!cap->running)
+		return;
+
+	/* Re-arm first, the GPT holds one timestamp meanwhile */
+	if (cap->held[next])
+		cap->overruns++;
+	cap->dma.dma_cfg.destDmaAddr = (uint32_t) cap->buf[next];
+	DMA_Disable(channel);
+	DMA_ChannelInit(channel, &cap->dma.dma_cfg);
+	DMA_SetPeripheralType(channel, cap->dma.perDmaInter);
+	DMA_IntClr(channel, INT_CH_ALL);
+	DMA_IntMask(channel, INT_DMA_TRANS_COMPLETE, UNMASK);
+	DMA_Enable(channel);
+	cap->filling = next;
+
+	if (GPT_GetStatus(cap->gpt, GPT_STATUS_DMA0_OF) == SET) {
+		GPT_StatusClr(cap->gpt, GPT_STATUS_DMA0_OF);
+		cap->lost++;
+	}
+
+	if (status != DMA_SUCCESS)
+		return;
+
+	cap->held[full] = true;
+	cap->cb(cap, cap->buf[full], cap->num, cap->arg);
+}
+
+int gpt_capture_start(gpt_capture_t *cap, GPT_ID_Type gpt,
+		      GPT_ChannelNumber_Type ch, GPT_ICEdge_Type edge,
+		      uint32_t *buf0, uint32_t *buf1, int num,
+		      gpt_capture_cb_t cb, void *arg)
+{
+	GPT_InputConfig_Type input = {
+		.sampleClkDivider = 0,
+		/* An edge has to hold for 3 cycles, 60ns */
+		.trigFilter = GPT_INPUT_FILTER_3,
+	};
+
+	if (!cap || gpt > GPT3_ID || ch > GPT_CH_5 || !buf0 || !buf1 ||
+	    !cb || num <= 0 || num > GPT_CAPTURE_MAX_BLOCK)
+		return -WM_E_INVAL;
+
+	if (gpt_drv_init(gpt) != WM_SUCCESS)
+		return -WM_FAIL;
+	cap->gpt_dev = gpt_drv_open(gpt);
+	if (!cap->gpt_dev) {
+		gpt_capture_w("GPT %d is in use", gpt);
+		return -WM_FAIL;
+	}
+	if (dma_drv_init() != WM_SUCCESS)
+		goto fail_gpt;
+	cap->dma_dev = dma_drv_open();
+	if (!cap->dma_dev)
+		goto fail_gpt;
+
+	cap->gpt = gpt;
+	cap->buf[0] = buf0;
+	cap->buf[1] = buf1;
+	cap->held[0] = false;
+	cap->held[1] = false;
+	cap->filling = 0;
+	cap->num = num;
+	cap->cb = cb;
+	cap->arg = arg;
+	cap->overruns = 0;
+	cap->lost = 0;
+
+	cap->dma.dma_cfg.srcDmaAddr =
+		(uint32_t) &gpt_regs[gpt]->CH[ch].CHX_CMR0_REG.WORDVAL;
+	cap->dma.dma_cfg.destDmaAddr = (uint32_t) buf0;
+	cap->dma.dma_cfg.transfType = DMA_PER_TO_MEM;
+	cap->dma.dma_cfg.burstLength = DMA_ITEM_1;
+	cap->dma.dma_cfg.srcAddrInc = DMA_ADDR_NOCHANGE;
+	cap->dma.dma_cfg.destAddrInc = DMA_ADDR_INC;
+	cap->dma.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_32;
+	cap->dma.dma_cfg.transfLength = num * sizeof(uint32_t);
+	cap->dma.perDmaInter = gpt_dma_per[gpt];
+
+	/* gpt_drv_set() sets up the clock, the counter then runs free */
+	gpt_drv_set(cap->gpt_dev, 1000);
+	GPT_SetCounterUppVal(gpt, UINT32_MAX);
+	GPT_InputConfig(gpt, &input);
+	GPT_ChannelFuncSelect(gpt, ch, GPT_CH_FUNC_INPUT);
+	GPT_ChannelInputConfig(gpt, ch, edge);
+	GPT_DMAChannelSelect(gpt, GPT_DMA0, ch);
+	GPT_StatusClr(gpt, GPT_STATUS_DMA0_OF);
+	GPT_DMACmd(gpt, GPT_DMA0, ENABLE);
+
+	cap->running = true;
+	if (dma_drv_set_cb(cap->dma_dev, gpt_capture_dma_cb, cap) !=
+	    WM_SUCCESS ||
+	    dma_drv_transfer(cap->dma_dev, &cap->dma) != WM_SUCCESS) {
+		cap->running = false;
+		GPT_DMACmd(gpt, GPT_DMA0, DISABLE);
+		dma_drv_close(cap->dma_dev);
+		goto fail_gpt;
+	}
+
+	gpt_drv_start(cap->gpt_dev);
+	return WM_SUCCESS;
+
+fail_gpt:
+	gpt_drv_close(cap->gpt_dev);
+	cap->gpt_dev = NULL;
+	return -WM_FAIL;
+}
+
+void gpt_capture_release(gpt_capture_t *cap, uint32_t *block)
+{
+	if (block == cap->buf[0])
+		cap->held[0] = false;
+	else if (block == cap->buf[1])
+		cap->held[1] = false;
+}
+
+uint32_t gpt_capture_now(gpt_capture_t *cap)
+{
+	return GPT_GetCounterVal(cap->gpt);
+}
+
+uint32_t gpt_capture_overruns(gpt_capture_t *cap)
+{
+	return cap->overruns;
+}
+
+uint32_t gpt_capture_lost(gpt_capture_t *cap)
+{
+	return cap->lost;
+}
+
+void gpt_capture_stop(gpt_capture_t *cap)
+{
+	if (!cap->running)
+		return;
+
+	cap->running = false;
+	gpt_drv_stop(cap->gpt_dev);
+	GPT_DMACmd(cap->gpt, GPT_DMA0, DISABLE);
+	gpt_drv_close(cap->gpt_dev);
+	cap->gpt_dev = NULL;
+	dma_drv_close(cap->dma_dev);
+	cap->dma_dev = NULL;
+}
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The monitor thread clears the flags it finds set and notes when, a task
+ * whose flag stayed clear for longer than its deadline stalled. The stall is
+ * written to the retention RAM before the watchdog is starved, the RAM is
+ * kept across the reset the watchdog does.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <mw300_clock.h>
+#include <mw300_wdt.h>
+#include <health_mon.h>
+
+#define health_w(...) wmlog_w("health", ##__VA_ARGS__)
+
+#define HEALTH_MON_STALLED 0x48535450
+
+/* The watchdog bit of the reset cause register, see PMU_ClrLastResetCause */
+#define HEALTH_MON_WDT_RESET (1 << 5)
+
+/*
+ * The watchdog counts the system clock through this divider, or a slower
+ * bus clock, which only makes the timeout longer
+ */
+#define HEALTH_MON_WDT_DIV 32
+
+/*
+ * PMU_GetLastResetCause() as read by the SDK at startup, which clears the
+ * register before main()
+ */
+extern uint32_t g_rst_cause;
+
+struct health_task {
+	char name[HEALTH_MON_NAME_LEN];
+	uint32_t deadline_ms;
+	/* Time the monitor last found the flag set */
+	uint32_t seen_ms;
+	volatile bool checked;
+	bool used;
+};
+
+/* In the retention RAM, zeroed at power on */
+struct health_mon_nv {
+	uint32_t magic;
+	char name[HEALTH_MON_NAME_LEN];
+	uint32_t late_ms;
+};
+
+static struct health_mon_nv health_mon_nv
+	__attribute__((section(".nvram")));
+
+static struct health_task health_tasks[HEALTH_MON_MAX_TASKS];
+static struct health_mon_nv health_last_stall;
+static uint32_t health_check_ms;
+static os_thread_t health_thread;
+static os_thread_stack_define(health_stack, 1024);
+
+static uint32_t health_now_ms(void)
+{
+	return os_ticks_to_msec(os_ticks_get());
+}
+
+static void health_mon_main(os_thread_arg_t arg)
+{
+	struct health_task *t;
+	uint32_t now;
+	int i;
+
+	for (;;) {
+		os_thread_sleep(os_msec_to_ticks(health_check_ms));
+		now = health_now_ms();
+
+		for (i = 0; i < HEALTH_MON_MAX_TASKS; i++) {
+			t = &health_tasks[i];
+			if (!t->used)
+				continue;
+			if (t->checked) {
+				t->checked = false;
+				t->seen_ms = now;
+			} else if (now - t->seen_ms > t->deadline_ms) {
+				break;
+			}
+		}
+		if (i == HEALTH_MON_MAX_TASKS) {
+			WDT_RestartCounter();
+			continue;
+		}
+
+		strncpy(health_mon_nv.name, t->name, HEALTH_MON_NAME_LEN);
+		health_mon_nv.late_ms = now - t->seen_ms;
+		health_mon_nv.magic = HEALTH_MON_STALLED;
+		health_w("%s did not check in for %u ms, resetting",
+			 t->name, health_mon_nv.late_ms);
+		/* The watchdog is not fed anymore */
+		os_thread_self_complete(NULL);
+	}
+}
+
+/* Smallest timeout of at least twice the check interval */
+static int health_wdt_timeout(uint32_t check_ms)
+{
+	uint64_t hz = CLK_GetSystemClk() / HEALTH_MON_WDT_DIV;
+	int i;
+
+	for (i = 0; i <= 15; i++)
+		if ((1000ULL << (16 + i)) / hz >= 2ULL * check_ms)
+			return i;
+	return -WM_E_INVAL;
+}
+
+int health_mon_start(uint32_t check_ms)
+{
+	WDT_Config_Type wdt = {
+		.mode = WDT_MODE_RESET,
+		.resetPulseLen = WDT_RESET_PULSE_LEN_2,
+	};
+	int timeout = health_wdt_timeout(check_ms);
+
+	if (!check_ms || timeout < 0 || health_check_ms)
+		return -WM_E_INVAL;
+
+	if (health_mon_nv.magic == HEALTH_MON_STALLED &&
+	    (g_rst_cause & HEALTH_MON_WDT_RESET))
+		health_last_stall = health_mon_nv;
+	health_mon_nv.magic = 0;
+
+	health_check_ms = check_ms;
+	if (os_thread_create(&health_thread, "health", health_mon_main, NULL,
+			     &health_stack, OS_PRIO_4) != WM_SUCCESS) {
+		health_check_ms = 0;
+		return -WM_FAIL;
+	}
+
+	CLK_ModuleClkEnable(CLK_WDT);
+	CLK_ModuleClkDivider(CLK_WDT, HEALTH_MON_WDT_DIV);
+	wdt.timeoutVal = timeout;
+	WDT_Init(&wdt);
+	WDT_Enable();
+	WDT_RestartCounter();
+	return WM_SUCCESS;
+}
+
+int health_mon_register(const char *name, uint32_t deadline_ms)
+{
+	unsigned long state;
+	int i;
+
+	if (!name || !deadline_ms)
+		return -WM_E_INVAL;
+
+	state = os_enter_critical_section();
+	for (i = 0; i < HEALTH_MON_MAX_TASKS; i++)
+		if (!health_tasks[i].used)
+			break;
+	if (i == HEALTH_MON_MAX_TASKS) {
+		os_exit_critical_section(state);
+		return -WM_E_NOSPC;
+	}
+	strncpy(health_tasks[i].name, name, HEALTH_MON_NAME_LEN - 1);
+	health_tasks[i].name[HEALTH_MON_NAME_LEN - 1] = '\0';
+	health_tasks[i].deadline_ms = deadline_ms;
+	health_tasks[i].seen_ms = health_now_ms();
+	health_tasks[i].checked = false;
+	health_tasks[i].used = true;
+	os_exit_critical_section(state);
+	return i;
+}
+
+void health_mon_unregister(int id)
+{
+	if (id >= 0 && id < HEALTH_MON_MAX_TASKS)
+		health_tasks[id].used = false;
+}
+
+void health_mon_checkin(int id)
+{
+	if (id >= 0 && id < HEALTH_MON_MAX_TASKS)
+		health_tasks[id].checked = true;
+}
+
+bool health_mon_last_stall(char *name, size_t len, uint32_t *late_ms)
+{
+	if (health_last_stall.magic != HEALTH_MON_STALLED || !name || !len)
+		return false;
+
+	strncpy(name, health_last_stall.name, len - 1);
+	name[len - 1] = '\0';
+	if (late_ms)
+		*late_ms = health_last_stall.late_ms;
+	return true;
+}
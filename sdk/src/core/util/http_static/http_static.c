@@ -0,0 +1,506 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wmstdio.h>
+#include <lwip/sockets.h>
+#include <lwip/api.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <http_static.h>
+
+#define hs_w(...) wmlog_w("http_static", ##__VA_ARGS__)
+
+/* Bundle of http_bundle.py, little endian: the header, the entries, the
+ * NUL terminated paths and content types the entries point to, and the
+ * bodies, 4 bytes aligned. Offsets are from the start of the bundle, the
+ * header, entries and strings are its index. */
+#define HS_MAGIC 0x31425348	/* "HSB1" */
+#define HS_GZIP 0x1
+
+struct hs_header {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t index_size;
+	uint32_t size;
+};
+
+struct hs_entry {
+	uint32_t path;
+	uint32_t type;
+	uint32_t data;
+	uint32_t len;
+	uint32_t etag;
+	uint32_t flags;
+};
+
+/* Flash window of the flash controller in XIP images */
+#define HS_FLASHC_BASE 0x1f000000
+
+struct hs_conn {
+	int sock;
+	struct netconn *nc;
+	uint32_t last_ms;
+	/* Requests served */
+	uint32_t served;
+	/* Response being sent, header then body */
+	bool sending;
+	bool close;
+	char hdr[192];
+	uint16_t hdr_len;
+	uint16_t hdr_off;
+	const struct hs_entry *e;
+	uint32_t off;
+	uint32_t end;
+	uint16_t req_len;
+	char req[HTTP_STATIC_REQ_SIZE];
+};
+
+static struct http_static_cfg hs_cfg;
+/* The index, and the bundle when it can be read in place */
+static const uint8_t *hs_index;
+static const uint8_t *hs_mem;
+static mdev_t *hs_fl;
+static struct hs_conn hs_conns[HTTP_STATIC_CONNS];
+static struct http_static_stats hs_stats;
+static int hs_listen = -1;
+/* Bodies read from the flash are copied to lwIP through here */
+static uint8_t hs_chunk[TCP_MSS];
+
+static os_thread_t hs_thread;
+static os_thread_stack_define(hs_stack, 2048);
+
+static uint32_t hs_now(void)
+{
+	return os_ticks_to_msec(os_ticks_get());
+}
+
+static const struct hs_entry *hs_lookup(const char *path)
+{
+	const struct hs_header *h = (const struct hs_header *) hs_index;
+	const struct hs_entry *e = (const struct hs_entry *) (h + 1);
+	uint32_t i;
+
+	for (i = 0; i < h->count; i++, e++)
+		if (!strcmp((const char *) hs_index + e->path, path))
+			return e;
+	return NULL;
+}
+
+static void hs_close(struct hs_conn *c)
+{
+	close(c->sock);
+	c->sock = -1;
+	c->nc = NULL;
+	c->sending = false;
+}
+
+/* Value of a header of the request, the headers start after the request
+ * line and end at the blank line */
+static const char *hs_header(const char *req, const char *name, int *len)
+{
+	size_t n = strlen(name);
+	const char *p = strstr(req, "\r\n"), *end;
+
+	while (p && strncmp(p, "\r\n\r\n", 4)) {
+		p += 2;
+		end = strstr(p, "\r\n");
+		if (!end)
+			break;
+		if (!strncasecmp(p, name, n) && p[n] == ':') {
+			p += n + 1;
+			while (*p == ' ')
+				p++;
+			*len = end - p;
+			return p;
+		}
+		p = end;
+	}
+	return NULL;
+}
+
+static bool hs_has(const char *v, int len, const char *token)
+{
+	size_t n = strlen(token);
+	int i;
+
+	for (i = 0; i + (int) n <= len; i++)
+		if (!strncasecmp(v + i, token, n))
+			return true;
+	return false;
+}
+
+static void hs_respond(struct hs_conn *c, int code, const char *reason)
+{
+	c->hdr_len = snprintf(c->hdr, sizeof(c->hdr),
+			      "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n"
+			      "Connection: %s\r\n\r\n", code, reason,
+			      c->close ? "close" : "keep-alive");
+	c->e = NULL;
+	if (code >= 400)
+		hs_stats.errors++;
+}
+
+/* Set up the response to the request at the start of req, terminated */
+static void hs_request(struct hs_conn *c)
+{
+	char *req = c->req, *path, *sp, *q;
+	const struct hs_entry *e;
+	const char *v;
+	bool head, http10;
+	int vlen;
+	char etag[12];
+
+	c->hdr_off = 0;
+	c->off = c->end = 0;
+	c->sending = true;
+	hs_stats.requests++;
+	if (c->served++)
+		hs_stats.reused++;
+
+	sp = strchr(req, ' ');
+	path = sp ? sp + 1 : NULL;
+	sp = path ? strchr(path, ' ') : NULL;
+	if (!sp || strncmp(sp + 1, "HTTP/1.", 7)) {
+		c->close = true;
+		hs_respond(c, 400, "Bad Request");
+		return;
+	}
+	*sp = '\0';
+	http10 = sp[8] == '0';
+	head = !strncmp(req, "HEAD ", 5);
+
+	v = hs_header(sp + 1, "Connection", &vlen);
+	c->close = v ? hs_has(v, vlen, "close") : http10;
+	if (http10 && v && hs_has(v, vlen, "keep-alive"))
+		c->close = false;
+
+	if (!head && strncmp(req, "GET ", 4)) {
+		hs_respond(c, 405, "Method Not Allowed");
+		return;
+	}
+	q = strchr(path, '?');
+	if (q)
+		*q = '\0';
+	e = hs_lookup(strcmp(path, "/") ? path : "/index.html");
+	if (!e) {
+		hs_respond(c, 404, "Not Found");
+		return;
+	}
+
+	snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned) e->etag);
+	v = hs_header(sp + 1, "If-None-Match", &vlen);
+	if (v && hs_has(v, vlen, etag)) {
+		c->hdr_len = snprintf(c->hdr, sizeof(c->hdr),
+				      "HTTP/1.1 304 Not Modified\r\n"
+				      "ETag: %s\r\nConnection: %s\r\n\r\n",
+				      etag, c->close ? "close" : "keep-alive");
+		c->e = NULL;
+		hs_stats.not_modified++;
+		return;
+	}
+	if (e->flags & HS_GZIP) {
+		v = hs_header(sp + 1, "Accept-Encoding", &vlen);
+		if (!v || !hs_has(v, vlen, "gzip")) {
+			hs_respond(c, 406, "Not Acceptable");
+			return;
+		}
+	}
+
+	c->hdr_len = snprintf(c->hdr, sizeof(c->hdr),
+			      "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+			      "Content-Length: %u\r\nETag: %s\r\n"
+			      "Cache-Control: no-cache\r\n%sConnection: %s"
+			      "\r\n\r\n",
+			      (const char *) hs_index + e->type,
+			      (unsigned) e->len, etag,
+			      e->flags & HS_GZIP ?
+			      "Content-Encoding: gzip\r\n" : "",
+			      c->close ? "close" : "keep-alive");
+	c->e = head ? NULL : e;
+	if (c->e) {
+		c->off = e->data;
+		c->end = e->data + e->len;
+	}
+}
+
+/* Start the next request received, if complete */
+static void hs_next(struct hs_conn *c)
+{
+	char *end, next;
+	int len;
+
+	c->req[c->req_len] = '\0';
+	end = strstr(c->req, "\r\n\r\n");
+	if (!end) {
+		if (c->req_len == sizeof(c->req) - 1) {
+			c->close = true;
+			c->sending = true;
+			c->hdr_off = 0;
+			hs_respond(c, 431, "Request Header Fields Too Large");
+		}
+		return;
+	}
+	len = end + 4 - c->req;
+	/* The first byte of a pipelined request */
+	next = c->req[len];
+	c->req[len] = '\0';
+	hs_request(c);
+	c->req[len] = next;
+	/* Requests pipelined after this one */
+	memmove(c->req, c->req + len, c->req_len - len);
+	c->req_len -= len;
+}
+
+/* Send what the send buffer takes, returns false on errors */
+static bool hs_send(struct hs_conn *c)
+{
+	size_t written;
+	uint32_t n;
+	err_t err;
+
+	if (c->hdr_off < c->hdr_len) {
+		written = 0;
+		err = netconn_write_partly(c->nc, c->hdr + c->hdr_off,
+					   c->hdr_len - c->hdr_off,
+					   NETCONN_COPY | NETCONN_DONTBLOCK |
+					   (c->e ? NETCONN_MORE : 0),
+					   &written);
+		if (err != ERR_OK && err != ERR_WOULDBLOCK)
+			return false;
+		c->hdr_off += written;
+		if (c->hdr_off < c->hdr_len)
+			return true;
+	}
+
+	while (c->off < c->end) {
+		written = 0;
+		n = c->end - c->off;
+		if (hs_mem) {
+			/* The bundle outlives the segments, no copy */
+			err = netconn_write_partly(c->nc, hs_mem + c->off, n,
+						   NETCONN_NOCOPY |
+						   NETCONN_DONTBLOCK,
+						   &written);
+		} else {
+			if (n > sizeof(hs_chunk))
+				n = sizeof(hs_chunk);
+			if (flash_drv_read(hs_fl, hs_chunk, n,
+					   hs_cfg.fl.fl_start + c->off) != 0)
+				return false;
+			err = netconn_write_partly(c->nc, hs_chunk, n,
+						   NETCONN_COPY |
+						   NETCONN_DONTBLOCK,
+						   &written);
+		}
+		if (err != ERR_OK && err != ERR_WOULDBLOCK)
+			return false;
+		c->off += written;
+		hs_stats.bytes += written;
+		if (!written)
+			return true;
+	}
+
+	c->sending = false;
+	if (c->close)
+		return false;
+	hs_next(c);
+	return true;
+}
+
+static void hs_accept(void)
+{
+	struct hs_conn *c = NULL;
+	int i, sock;
+
+	sock = accept(hs_listen, NULL, NULL);
+	if (sock < 0)
+		return;
+
+	for (i = 0; i < HTTP_STATIC_CONNS; i++) {
+		if (hs_conns[i].sock < 0) {
+			c = &hs_conns[i];
+			break;
+		}
+		/* Else the connection idle for the longest */
+		if (!hs_conns[i].sending &&
+		    (!c || hs_conns[i].last_ms - c->last_ms > 0x80000000))
+			c = &hs_conns[i];
+	}
+	if (!c) {
+		close(sock);
+		return;
+	}
+	if (c->sock >= 0) {
+		hs_close(c);
+		hs_stats.evicted++;
+	}
+
+	memset(c, 0, sizeof(*c) - sizeof(c->req));
+	c->sock = sock;
+	c->nc = lwip_get_netconn(sock);
+	c->last_ms = hs_now();
+	hs_stats.conns++;
+}
+
+static void hs_recv(struct hs_conn *c)
+{
+	int n;
+
+	n = recv(c->sock, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len,
+		 MSG_DONTWAIT);
+	if (n == 0 || (n < 0 && errno != EWOULDBLOCK)) {
+		hs_close(c);
+		return;
+	}
+	if (n > 0)
+		c->req_len += n;
+	hs_next(c);
+	if (c->sending && !hs_send(c))
+		hs_close(c);
+}
+
+static void hs_main(os_thread_arg_t arg)
+{
+	struct hs_conn *c;
+	struct timeval tv;
+	fd_set rfds, wfds;
+	int i, maxfd, n;
+
+	for (;;) {
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(hs_listen, &rfds);
+		maxfd = hs_listen;
+		for (i = 0; i < HTTP_STATIC_CONNS; i++) {
+			c = &hs_conns[i];
+			if (c->sock < 0)
+				continue;
+			FD_SET(c->sock, c->sending ? &wfds : &rfds);
+			if (c->sock > maxfd)
+				maxfd = c->sock;
+		}
+
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		n = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+		if (n < 0) {
+			os_thread_sleep(os_msec_to_ticks(100));
+			continue;
+		}
+
+		for (i = 0; n && i < HTTP_STATIC_CONNS; i++) {
+			c = &hs_conns[i];
+			if (c->sock < 0)
+				continue;
+			if (FD_ISSET(c->sock, &wfds)) {
+				c->last_ms = hs_now();
+				if (!hs_send(c))
+					hs_close(c);
+			} else if (FD_ISSET(c->sock, &rfds)) {
+				c->last_ms = hs_now();
+				hs_recv(c);
+			}
+		}
+		for (i = 0; i < HTTP_STATIC_CONNS; i++) {
+			c = &hs_conns[i];
+			if (c->sock >= 0 && !c->sending &&
+			    hs_now() - c->last_ms > HTTP_STATIC_IDLE_MS)
+				hs_close(c);
+		}
+		if (FD_ISSET(hs_listen, &rfds))
+			hs_accept();
+	}
+}
+
+static int hs_open_bundle(void)
+{
+	struct hs_header h;
+	uint8_t *index;
+
+	if (hs_cfg.bundle) {
+		hs_mem = hs_index = hs_cfg.bundle;
+		memcpy(&h, hs_mem, sizeof(h));
+		return h.magic == HS_MAGIC ? WM_SUCCESS : -WM_E_INVAL;
+	}
+
+#ifdef CONFIG_XIP_ENABLE
+	if (hs_cfg.fl.fl_dev == FL_INT) {
+		hs_mem = hs_index = (const uint8_t *) HS_FLASHC_BASE +
+			hs_cfg.fl.fl_start;
+		memcpy(&h, hs_mem, sizeof(h));
+		return h.magic == HS_MAGIC && h.size <= hs_cfg.fl.fl_size ?
+			WM_SUCCESS : -WM_E_INVAL;
+	}
+#endif
+
+	hs_fl = flash_drv_open(hs_cfg.fl.fl_dev);
+	if (!hs_fl)
+		return -WM_FAIL;
+	if (flash_drv_read(hs_fl, (uint8_t *) &h, sizeof(h),
+			   hs_cfg.fl.fl_start) != 0)
+		return -WM_FAIL;
+	if (h.magic != HS_MAGIC || h.size > hs_cfg.fl.fl_size ||
+	    h.index_size < sizeof(h))
+		return -WM_E_INVAL;
+	/* Only the index is kept in RAM */
+	index = os_mem_alloc(h.index_size);
+	if (!index)
+		return -WM_E_NOMEM;
+	if (flash_drv_read(hs_fl, index, h.index_size,
+			   hs_cfg.fl.fl_start) != 0) {
+		os_mem_free(index);
+		return -WM_FAIL;
+	}
+	hs_index = index;
+	return WM_SUCCESS;
+}
+
+int http_static_start(const struct http_static_cfg *cfg)
+{
+	struct sockaddr_in addr;
+	int i, ret, one = 1;
+
+	if (!cfg || !cfg->port)
+		return -WM_E_INVAL;
+	if (hs_listen >= 0)
+		return -WM_E_BUSY;
+
+	hs_cfg = *cfg;
+	ret = hs_open_bundle();
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	hs_listen = socket(AF_INET, SOCK_STREAM, 0);
+	if (hs_listen < 0)
+		return -WM_FAIL;
+	setsockopt(hs_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg->port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(hs_listen, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(hs_listen, HTTP_STATIC_CONNS) < 0)
+		goto fail;
+
+	for (i = 0; i < HTTP_STATIC_CONNS; i++)
+		hs_conns[i].sock = -1;
+	if (os_thread_create(&hs_thread, "http-static", hs_main, NULL,
+			     &hs_stack, OS_PRIO_3) != WM_SUCCESS)
+		goto fail;
+	return WM_SUCCESS;
+
+fail:
+	hs_w("Can not serve on port %d", cfg->port);
+	close(hs_listen);
+	hs_listen = -1;
+	return -WM_FAIL;
+}
+
+void http_static_get_stats(struct http_static_stats *stats)
+{
+	*stats = hs_stats;
+}
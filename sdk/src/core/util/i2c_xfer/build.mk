@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libi2c_xfer
+libi2c_xfer-objs-y := i2c_xfer.c
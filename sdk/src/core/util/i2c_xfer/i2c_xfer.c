@@ -0,0 +1,230 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <mdev_i2c.h>
+#include <lowlevel_drivers.h>
+#include <dma_svc.h>
+#include <i2c_xfer.h>
+
+struct i2c_xfer_port {
+	mdev_t *dev;
+	I2C_ID_Type id;
+	i2c_reg_t *regs;
+	DMA_PerMapping_Type tx_per;
+	/* Target address the controller is set to, 0xffff for none */
+	uint16_t tar;
+	/* Running transaction and the ones waiting behind it */
+	i2c_xfer_t *cur, *head, *tail;
+	volatile bool tx_done;
+	/* The bytes written, then the read commands */
+	dma_svc_req_t tx_req;
+	dma_svc_desc_t tx_desc[2];
+};
+
+static struct i2c_xfer_port i2c_xfer_ports[NUM_I2C_PORTS];
+
+/* Read command of DATA_CMD, in SRAM for the DMA */
+static uint16_t i2c_xfer_rd_cmd = 0x100;
+
+static inline uint32_t i2c_xfer_lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	return primask;
+}
+
+static inline void i2c_xfer_unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static void i2c_xfer_desc(dma_svc_desc_t *d, uint32_t src,
+			  DMA_AddrInc_Type src_inc, DMA_TransfWidth_Type width,
+			  uint32_t len, struct i2c_xfer_port *p)
+{
+	memset(d, 0, sizeof(*d));
+	d->dmac.dma_cfg.srcDmaAddr = src;
+	d->dmac.dma_cfg.destDmaAddr = (uint32_t)&p->regs->DATA_CMD.WORDVAL;
+	d->dmac.dma_cfg.transfType = DMA_MEM_TO_PER;
+	d->dmac.dma_cfg.burstLength = DMA_ITEM_1;
+	d->dmac.dma_cfg.srcAddrInc = src_inc;
+	d->dmac.dma_cfg.destAddrInc = DMA_ADDR_NOCHANGE;
+	d->dmac.dma_cfg.transfWidth = width;
+	d->dmac.dma_cfg.transfLength = len;
+	d->dmac.perDmaInter = p->tx_per;
+}
+
+static void i2c_xfer_start(struct i2c_xfer_port *p, i2c_xfer_t *xfer)
+{
+	dma_svc_desc_t *d = p->tx_desc;
+
+	/* The target can only be changed with the controller off */
+	if (xfer->addr != p->tar) {
+		I2C_Disable(p->id);
+		I2C_SetSlaveAddr(p->id, xfer->addr);
+		I2C_Enable(p->id);
+		p->tar = xfer->addr;
+	}
+
+	if (xfer->wr_len) {
+		i2c_xfer_desc(d, (uint32_t)xfer->wr, DMA_ADDR_INC,
+			      DMA_TRANSF_WIDTH_8, xfer->wr_len, p);
+		d++;
+	}
+	if (xfer->rd_len)
+		i2c_xfer_desc(d, (uint32_t)&i2c_xfer_rd_cmd, DMA_ADDR_NOCHANGE,
+			      DMA_TRANSF_WIDTH_16, xfer->rd_len * 2, p);
+	if (xfer->wr_len && xfer->rd_len)
+		p->tx_desc[0].next = &p->tx_desc[1];
+
+	p->tx_done = false;
+	dma_svc_submit(&p->tx_req);
+}
+
+static void i2c_xfer_tx_done(int result, void *arg)
+{
+	struct i2c_xfer_port *p = arg;
+
+	p->tx_done = (result == WM_SUCCESS);
+}
+
+/* The STOP ends the transaction, whether all went out or not */
+static void i2c_xfer_stop(I2C_INT_Type type, void *data)
+{
+	struct i2c_xfer_port *p = data;
+	i2c_xfer_t *xfer = p->cur, *next;
+	uint32_t primask, abort = 0, n = 0;
+	int result = WM_SUCCESS;
+
+	if (type != I2C_INT_STOP_DET || !xfer)
+		return;
+
+	/* A STOP before the DMA is done is a NACK, or the FIFO ran dry and
+	 * the controller took it for the end */
+	if (!p->tx_done) {
+		dma_svc_abort(&p->tx_req);
+		result = -WM_FAIL;
+	}
+	I2C_GetTxAbortCause(p->id, &abort);
+	if (abort || I2C_GetRawIntStatus(p->id, I2C_INT_TX_ABORT) == SET) {
+		I2C_IntClr(p->id, I2C_INT_TX_ABORT);
+		result = -WM_FAIL;
+	}
+
+	while (n < xfer->rd_len &&
+	       I2C_GetStatus(p->id, I2C_STATUS_RFNE) == SET)
+		xfer->rd[n++] = I2C_ReceiveByte(p->id);
+	if (n < xfer->rd_len)
+		result = -WM_FAIL;
+	/* Anything left over is not for the next transaction */
+	while (I2C_GetStatus(p->id, I2C_STATUS_RFNE) == SET)
+		I2C_ReceiveByte(p->id);
+
+	primask = i2c_xfer_lock();
+	next = p->head;
+	if (next) {
+		p->head = next->next;
+		if (!p->head)
+			p->tail = NULL;
+		next->next = NULL;
+	}
+	p->cur = next;
+	i2c_xfer_unlock(primask);
+
+	if (next)
+		i2c_xfer_start(p, next);
+
+	if (xfer->cb)
+		xfer->cb(result, xfer->arg);
+}
+
+int i2c_xfer_init(mdev_t *dev, I2C_ID_Type id)
+{
+	static const DMA_PerMapping_Type tx_per[NUM_I2C_PORTS] = {
+		DMA_PER5_I2C0_TX, DMA_PER37_I2C1_TX,
+	};
+	struct i2c_xfer_port *p;
+	I2C_DmaReqLevel_Type level = {
+		.I2C_DMA_TransmitReqLevel = 4,
+		.I2C_DMA_RecvReqLevel = 0,
+	};
+
+	if (!dev || id >= NUM_I2C_PORTS)
+		return -WM_E_INVAL;
+	p = &i2c_xfer_ports[id];
+	if (p->cur)
+		return -WM_E_INVAL;
+
+	if (dma_svc_init(2) != WM_SUCCESS)
+		return -WM_FAIL;
+	if (i2c_drv_set_callback(dev, i2c_xfer_stop, p) != WM_SUCCESS)
+		return -WM_FAIL;
+
+	p->dev = dev;
+	p->id = id;
+	p->regs = (id == I2C0_PORT) ? I2C0 : I2C1;
+	p->tx_per = tx_per[id];
+	p->tar = 0xffff;
+	p->head = p->tail = NULL;
+	p->tx_req.desc = p->tx_desc;
+	p->tx_req.cb = i2c_xfer_tx_done;
+	p->tx_req.arg = p;
+
+	/* The receive FIFO is read at the STOP, not by the driver */
+	I2C_Disable(id);
+	p->regs->CON.BF.RESTART_EN = 1;
+	I2C_DmaConfig(id, &level);
+	I2C_DmaCmd(id, ENABLE, DISABLE);
+	I2C_IntMask(id, I2C_INT_RX_FULL, MASK);
+	I2C_IntMask(id, I2C_INT_STOP_DET, UNMASK);
+	I2C_Enable(id);
+	return WM_SUCCESS;
+}
+
+int i2c_xfer_submit(I2C_ID_Type id, i2c_xfer_t *xfer)
+{
+	struct i2c_xfer_port *p;
+	uint32_t primask;
+	bool start;
+
+	if (id >= NUM_I2C_PORTS || !xfer ||
+	    (!xfer->wr_len && !xfer->rd_len) ||
+	    xfer->wr_len > I2C_XFER_MAX_WRITE ||
+	    xfer->rd_len > I2C_XFER_MAX_READ ||
+	    (xfer->wr_len && !xfer->wr) || (xfer->rd_len && !xfer->rd))
+		return -WM_E_INVAL;
+	p = &i2c_xfer_ports[id];
+	if (!p->dev)
+		return -WM_E_INVAL;
+
+	xfer->next = NULL;
+	primask = i2c_xfer_lock();
+	start = !p->cur;
+	if (start) {
+		p->cur = xfer;
+	} else {
+		if (p->tail)
+			p->tail->next = xfer;
+		else
+			p->head = xfer;
+		p->tail = xfer;
+	}
+	i2c_xfer_unlock(primask);
+
+	if (start)
+		i2c_xfer_start(p, xfer);
+	return WM_SUCCESS;
+}
+
+bool i2c_xfer_idle(I2C_ID_Type id)
+{
+	if (id >= NUM_I2C_PORTS)
+		return true;
+	return i2c_xfer_ports[id].cur == NULL;
+}
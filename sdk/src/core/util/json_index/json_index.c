@@ -0,0 +1,223 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <json_index.h>
+#include <fast_float.h>
+
+/* Token types, numbered as in jsmn */
+#define JSON_TOK_PRIMITIVE 0
+#define JSON_TOK_OBJECT 1
+#define JSON_TOK_STRING 3
+
+#define JSON_INDEX_EMPTY -1
+
+/* FNV-1a */
+static uint32_t json_index_hash(const char *s, int len)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (uint8_t)s[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int json_index_build(json_index_t *idx, jobj_t *jobj, int16_t *slots,
+		     int num_slots)
+{
+	jsontok_t *obj = jobj->cur;
+	int16_t obj_index = obj - jobj->tokens;
+	uint32_t slot;
+	int16_t t;
+	int keys = 0;
+
+	if (obj->type != JSON_TOK_OBJECT)
+		return -WM_E_JSON_INVALID_JOBJ;
+	if (num_slots <= 0 || num_slots > 0x10000 ||
+	    (num_slots & (num_slots - 1)))
+		return -WM_E_JSON_NOMEM;
+
+	idx->jobj = jobj;
+	idx->obj = obj;
+	idx->slots = slots;
+	idx->mask = num_slots - 1;
+	memset(slots, 0xff, num_slots * sizeof(slots[0]));
+
+	/* The keys are the tokens whose parent is the object, the tokens of
+	 * the object follow it in the array and start before its end */
+	for (t = obj_index + 1; t < jobj->parser.toknext &&
+		     jobj->tokens[t].start < obj->end; t++) {
+		jsontok_t *key = &jobj->tokens[t];
+
+		if (key->parent != obj_index)
+			continue;
+		if (++keys >= num_slots)
+			return -WM_E_JSON_NOMEM;
+		slot = json_index_hash(jobj->js + key->start,
+				       key->end - key->start);
+		while (slots[slot & idx->mask] != JSON_INDEX_EMPTY)
+			slot++;
+		slots[slot & idx->mask] = t;
+	}
+
+	return WM_SUCCESS;
+}
+
+/* Value token of the key, NULL if the object does not have it */
+static jsontok_t *json_index_find(json_index_t *idx, const char *key)
+{
+	int len = strlen(key);
+	uint32_t slot = json_index_hash(key, len);
+	jsontok_t *tok;
+	int16_t t;
+
+	/* A slot is left empty, the search ends there */
+	for (;; slot++) {
+		t = idx->slots[slot & idx->mask];
+		if (t == JSON_INDEX_EMPTY)
+			return NULL;
+		tok = &idx->jobj->tokens[t];
+		if (tok->end - tok->start == len &&
+		    !strncmp(idx->jobj->js + tok->start, key, len))
+			break;
+	}
+
+	/* A key without its value is where the string was incomplete */
+	if (t + 1 >= idx->jobj->parser.toknext ||
+	    idx->jobj->tokens[t + 1].parent != t)
+		return NULL;
+	return &idx->jobj->tokens[t + 1];
+}
+
+static int json_index_find_type(json_index_t *idx, const char *key,
+				int type, jsontok_t **tok)
+{
+	*tok = json_index_find(idx, key);
+	if (!*tok)
+		return -WM_E_JSON_NOT_FOUND;
+	if ((*tok)->type != type)
+		return -WM_E_JSON_INVALID_TYPE;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_bool(json_index_t *idx, const char *key, bool *value)
+{
+	const char *s;
+	jsontok_t *tok;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_PRIMITIVE, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	s = idx->jobj->js + tok->start;
+	if (tok->end - tok->start == 4 && !strncmp(s, "true", 4))
+		*value = true;
+	else if (tok->end - tok->start == 5 && !strncmp(s, "false", 5))
+		*value = false;
+	else
+		return -WM_E_JSON_INVALID_TYPE;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_int64(json_index_t *idx, const char *key,
+			     int64_t *value)
+{
+	const char *s;
+	char *end;
+	jsontok_t *tok;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_PRIMITIVE, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	/* The number ends at the byte after the token, which is not a digit */
+	s = idx->jobj->js + tok->start;
+	*value = strtoll(s, &end, 10);
+	if (end != idx->jobj->js + tok->end)
+		return -WM_E_JSON_INVALID_TYPE;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_int(json_index_t *idx, const char *key, int *value)
+{
+	int64_t val;
+	int ret;
+
+	ret = json_index_get_val_int64(idx, key, &val);
+	if (ret != WM_SUCCESS)
+		return ret;
+	if (val < INT32_MIN || val > INT32_MAX)
+		return -WM_E_JSON_INVALID_TYPE;
+	*value = val;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_float(json_index_t *idx, const char *key, float *value)
+{
+	jsontok_t *tok;
+	int len;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_PRIMITIVE, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	len = tok->end - tok->start;
+	if (fast_strtof(idx->jobj->js + tok->start, len, value) != len)
+		return -WM_E_JSON_INVALID_TYPE;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_str_len(json_index_t *idx, const char *key, int *len)
+{
+	jsontok_t *tok;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_STRING, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	*len = tok->end - tok->start;
+	return WM_SUCCESS;
+}
+
+int json_index_get_val_str(json_index_t *idx, const char *key, char *value,
+			   int max_len)
+{
+	jsontok_t *tok;
+	int len;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_STRING, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	len = tok->end - tok->start;
+	if (len >= max_len)
+		return -WM_E_JSON_NOMEM;
+	memcpy(value, idx->jobj->js + tok->start, len);
+	value[len] = '\0';
+	return WM_SUCCESS;
+}
+
+int json_index_get_composite_object(json_index_t *idx, const char *key)
+{
+	jsontok_t *tok;
+	int ret;
+
+	ret = json_index_find_type(idx, key, JSON_TOK_OBJECT, &tok);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	idx->jobj->cur = tok;
+	return WM_SUCCESS;
+}
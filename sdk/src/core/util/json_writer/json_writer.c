@@ -0,0 +1,356 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wmerrno.h>
+#include <json_writer.h>
+#include <fast_float.h>
+
+static const char json_hex[] = "0123456789abcdef";
+
+static void json_put(struct json_writer *w, const char *s, int len)
+{
+	int n;
+
+	if (w->err != WM_SUCCESS)
+		return;
+	w->total += len;
+	if (!w->buf)
+		return;
+
+	while (len > 0) {
+		if (w->len == w->size) {
+			if (!w->flush) {
+				w->err = -WM_E_JSON_OBUF;
+				return;
+			}
+			w->err = w->flush(w->buf, w->len, w->ctx);
+			if (w->err != WM_SUCCESS)
+				return;
+			w->len = 0;
+		}
+		n = w->size - w->len;
+		if (n > len)
+			n = len;
+		memcpy(w->buf + w->len, s, n);
+		w->len += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static void json_put_escaped(struct json_writer *w, const char *s)
+{
+	const char *run = s;
+	char esc[6];
+
+	json_put(w, "\"", 1);
+	for (; *s; s++) {
+		if ((uint8_t)*s >= 0x20 && *s != '"' && *s != '\\')
+			continue;
+		/* Characters that need no escape go out in one piece */
+		json_put(w, run, s - run);
+		run = s + 1;
+		esc[0] = '\\';
+		switch (*s) {
+		case '"':
+		case '\\':
+			esc[1] = *s;
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = json_hex[(uint8_t)*s >> 4];
+			esc[5] = json_hex[*s & 0xf];
+			json_put(w, esc, 6);
+			continue;
+		}
+		json_put(w, esc, 2);
+	}
+	json_put(w, run, s - run);
+	json_put(w, "\"", 1);
+}
+
+/* The comma before an element and its key */
+static int json_elem(struct json_writer *w, const char *key)
+{
+	uint32_t level;
+
+	if (w->err != WM_SUCCESS)
+		return w->err;
+
+	if (w->depth) {
+		level = 1UL << (w->depth - 1);
+		if (w->has_elems & level)
+			json_put(w, ",", 1);
+		w->has_elems |= level;
+	} else if (w->total) {
+		/* Only one value at the top */
+		w->err = -WM_E_JSON_FAIL;
+		return w->err;
+	}
+
+	if (key) {
+		json_put_escaped(w, key);
+		json_put(w, ":", 1);
+	}
+	return w->err;
+}
+
+static int json_open(struct json_writer *w, const char *key, char c)
+{
+	if (json_elem(w, key) != WM_SUCCESS)
+		return w->err;
+	if (w->depth == JSON_WRITER_MAX_DEPTH) {
+		w->err = -WM_E_JSON_FAIL;
+		return w->err;
+	}
+	json_put(w, &c, 1);
+	w->depth++;
+	w->has_elems &= ~(1UL << (w->depth - 1));
+	return w->err;
+}
+
+static int json_close(struct json_writer *w, char c)
+{
+	if (w->err != WM_SUCCESS)
+		return w->err;
+	if (!w->depth) {
+		w->err = -WM_E_JSON_FAIL;
+		return w->err;
+	}
+	w->depth--;
+	json_put(w, &c, 1);
+	return w->err;
+}
+
+/* Digits of val at the end of buf, returns the first */
+static char *json_fmt_uint(char *end, uint64_t val)
+{
+	uint32_t low;
+
+	/* 32 bit divisions where the value allows, they are much cheaper */
+	while (val > UINT32_MAX) {
+		*--end = '0' + val % 10;
+		val /= 10;
+	}
+	low = val;
+	do {
+		*--end = '0' + low % 10;
+		low /= 10;
+	} while (low);
+	return end;
+}
+
+void json_writer_init(struct json_writer *w, char *buf, int size,
+		      json_writer_flush_t flush, void *ctx)
+{
+	w->buf = buf;
+	w->size = size;
+	w->len = 0;
+	w->total = 0;
+	w->err = WM_SUCCESS;
+	w->flush = flush;
+	w->ctx = ctx;
+	w->depth = 0;
+	w->has_elems = 0;
+}
+
+int json_writer_start_object(struct json_writer *w, const char *key)
+{
+	return json_open(w, key, '{');
+}
+
+int json_writer_end_object(struct json_writer *w)
+{
+	return json_close(w, '}');
+}
+
+int json_writer_start_array(struct json_writer *w, const char *key)
+{
+	return json_open(w, key, '[');
+}
+
+int json_writer_end_array(struct json_writer *w)
+{
+	return json_close(w, ']');
+}
+
+int json_writer_add_str(struct json_writer *w, const char *key,
+			const char *val)
+{
+	if (json_elem(w, key) == WM_SUCCESS)
+		json_put_escaped(w, val);
+	return w->err;
+}
+
+int json_writer_add_uint(struct json_writer *w, const char *key,
+			 uint64_t val)
+{
+	char num[20];
+	char *s;
+
+	if (json_elem(w, key) == WM_SUCCESS) {
+		s = json_fmt_uint(num + sizeof(num), val);
+		json_put(w, s, num + sizeof(num) - s);
+	}
+	return w->err;
+}
+
+int json_writer_add_int(struct json_writer *w, const char *key, int64_t val)
+{
+	char num[21];
+	char *s;
+
+	if (json_elem(w, key) == WM_SUCCESS) {
+		/* The magnitude of INT64_MIN only fits unsigned */
+		s = json_fmt_uint(num + sizeof(num),
+				  val < 0 ? -(uint64_t)val : (uint64_t)val);
+		if (val < 0)
+			*--s = '-';
+		json_put(w, s, num + sizeof(num) - s);
+	}
+	return w->err;
+}
+
+int json_writer_add_float(struct json_writer *w, const char *key, float val,
+			  int decimals)
+{
+	static const uint32_t pow10[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+		100000000, 1000000000
+	};
+	char num[48];
+	char *end = num + sizeof(num);
+	char *s = end;
+	double v = val;
+	uint64_t ipart;
+	uint32_t frac;
+	int exp = 0;
+	int i;
+
+	if (json_elem(w, key) != WM_SUCCESS)
+		return w->err;
+
+	if (v != v || v - v != 0) {
+		json_put(w, "null", 4);
+		return w->err;
+	}
+
+	if (decimals < 0)
+		decimals = 0;
+	if (decimals > 9)
+		decimals = 9;
+
+	/* Exact from the bits of the float where no exponent is needed */
+	if (v < 1e18 && v > -1e18) {
+		i = fast_ftoa(val, decimals, num, sizeof(num));
+		if (i > 0) {
+			json_put(w, num, i);
+			return w->err;
+		}
+	}
+
+	if (v < 0)
+		v = -v;
+
+	/* Beyond what the integer part can hold, as m.mmme+x */
+	while (v >= 1e18) {
+		v /= 10;
+		exp++;
+	}
+	if (exp) {
+		while (v >= 10) {
+			v /= 10;
+			exp++;
+		}
+		s = json_fmt_uint(s, exp);
+		*--s = '+';
+		*--s = 'e';
+	}
+
+	ipart = v;
+	frac = (v - ipart) * pow10[decimals] + 0.5;
+	if (frac >= pow10[decimals]) {
+		ipart++;
+		frac -= pow10[decimals];
+	}
+
+	if (decimals) {
+		for (i = 0; i < decimals; i++) {
+			*--s = '0' + frac % 10;
+			frac /= 10;
+		}
+		*--s = '.';
+	}
+	s = json_fmt_uint(s, ipart);
+	if (val < 0)
+		*--s = '-';
+
+	json_put(w, s, end - s);
+	return w->err;
+}
+
+int json_writer_add_bool(struct json_writer *w, const char *key, bool val)
+{
+	if (json_elem(w, key) == WM_SUCCESS)
+		json_put(w, val ? "true" : "false", val ? 4 : 5);
+	return w->err;
+}
+
+int json_writer_add_null(struct json_writer *w, const char *key)
+{
+	if (json_elem(w, key) == WM_SUCCESS)
+		json_put(w, "null", 4);
+	return w->err;
+}
+
+int json_writer_add_raw(struct json_writer *w, const char *key,
+			const char *json, int len)
+{
+	if (json_elem(w, key) == WM_SUCCESS)
+		json_put(w, json, len);
+	return w->err;
+}
+
+int json_writer_finish(struct json_writer *w)
+{
+	if (w->err != WM_SUCCESS)
+		return w->err;
+	if (w->depth || !w->total) {
+		w->err = -WM_E_JSON_FAIL;
+		return w->err;
+	}
+
+	if (!w->buf)
+		return w->total;
+
+	if (w->flush) {
+		if (w->len) {
+			w->err = w->flush(w->buf, w->len, w->ctx);
+			if (w->err != WM_SUCCESS)
+				return w->err;
+			w->len = 0;
+		}
+		return w->total;
+	}
+
+	if (w->len == w->size) {
+		w->err = -WM_E_JSON_OBUF;
+		return w->err;
+	}
+	w->buf[w->len] = '\0';
+	return w->total;
+}
@@ -0,0 +1,541 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include <crc32.h>
+#include <kv_store.h>
+
+#define KV_MAGIC 0x5356564b
+#define KV_FREE 0xff
+#define KV_SET 0x01
+#define KV_DEL 0x02
+
+#define KV_SECTOR(off) ((off) / KV_STORE_SECTOR_SIZE)
+#define KV_SECTOR_END(sector) (((sector) + 1) * KV_STORE_SECTOR_SIZE)
+#define KV_FIRST(sector) ((sector) * KV_STORE_SECTOR_SIZE + \
+			  sizeof(struct kv_sector))
+#define KV_REC_SIZE(klen, vlen) \
+	((sizeof(struct kv_rec) + (klen) + (vlen) + 3) & ~3)
+
+struct kv_sector {
+	uint32_t magic;
+	uint32_t seq;
+};
+
+/* Followed by the key, without its NUL, and the value */
+struct kv_rec {
+	uint8_t klen;		/* KV_FREE where nothing was written yet */
+	uint8_t type;
+	uint16_t vlen;
+	uint32_t crc;		/* Of klen, type, vlen, the key and the value */
+};
+
+struct kv_entry {
+	char key[KV_STORE_MAX_KEY_LEN + 1];	/* Empty for a free entry */
+	uint32_t off;		/* Newest record of the key */
+	uint16_t vlen;
+	uint8_t val[KV_STORE_CACHE_LEN];
+};
+
+static struct {
+	mdev_t *dev;
+	flash_desc_t fl;
+	uint32_t sectors;
+	uint32_t tail_sector;
+	uint32_t tail;		/* Where the next record goes */
+	uint32_t seq;		/* Of the tail sector */
+	struct kv_entry idx[KV_STORE_MAX_KEYS];
+	os_mutex_t lock;
+} kvs;
+
+static int kv_read(void *buf, uint32_t len, uint32_t off)
+{
+	return flash_drv_read(kvs.dev, buf, len, kvs.fl.fl_start + off);
+}
+
+static int kv_write(const void *buf, uint32_t len, uint32_t off)
+{
+	return flash_drv_write(kvs.dev, (uint8_t *) buf, len,
+			       kvs.fl.fl_start + off);
+}
+
+static int kv_erase(uint32_t sector)
+{
+	return flash_drv_erase(kvs.dev, kvs.fl.fl_start +
+			       sector * KV_STORE_SECTOR_SIZE,
+			       KV_STORE_SECTOR_SIZE);
+}
+
+static struct kv_entry *kv_find(const char *key)
+{
+	int i;
+
+	for (i = 0; i < KV_STORE_MAX_KEYS; i++)
+		if (kvs.idx[i].key[0] && !strcmp(kvs.idx[i].key, key))
+			return &kvs.idx[i];
+	return NULL;
+}
+
+static struct kv_entry *kv_find_free(void)
+{
+	int i;
+
+	for (i = 0; i < KV_STORE_MAX_KEYS; i++)
+		if (!kvs.idx[i].key[0])
+			return &kvs.idx[i];
+	return NULL;
+}
+
+static bool kv_sector_valid(uint32_t sector, uint32_t *seq)
+{
+	struct kv_sector h;
+
+	if (kv_read(&h, sizeof(h), sector * KV_STORE_SECTOR_SIZE) != 0 ||
+	    h.magic != KV_MAGIC)
+		return false;
+	if (seq)
+		*seq = h.seq;
+	return true;
+}
+
+static bool kv_sector_live(uint32_t sector)
+{
+	int i;
+
+	for (i = 0; i < KV_STORE_MAX_KEYS; i++)
+		if (kvs.idx[i].key[0] && KV_SECTOR(kvs.idx[i].off) == sector)
+			return true;
+	return false;
+}
+
+/* Points the entry of the key at a record, the value is read back for
+ * the cache */
+static int kv_index(struct kv_entry *e, const char *key, size_t klen,
+		    uint32_t off, uint16_t vlen)
+{
+	if (vlen <= KV_STORE_CACHE_LEN && vlen &&
+	    kv_read(e->val, vlen, off + sizeof(struct kv_rec) + klen) != 0)
+		return -WM_FAIL;
+	memcpy(e->key, key, klen);
+	e->key[klen] = 0;
+	e->off = off;
+	e->vlen = vlen;
+	return WM_SUCCESS;
+}
+
+/* Copies the record of an entry to the tail, the caller checked that it
+ * fits */
+static int kv_move(struct kv_entry *e)
+{
+	uint8_t buf[64];
+	uint32_t size, done, n;
+
+	size = KV_REC_SIZE(strlen(e->key), e->vlen);
+	for (done = 0; done < size; done += n) {
+		n = size - done < sizeof(buf) ? size - done : sizeof(buf);
+		if (kv_read(buf, n, e->off + done) != 0 ||
+		    kv_write(buf, n, kvs.tail + done) != 0)
+			return -WM_FAIL;
+	}
+	e->off = kvs.tail;
+	kvs.tail += size;
+	return WM_SUCCESS;
+}
+
+/* Moves the current values out of a sector and invalidates its header,
+ * its older records and tombstones are never read again */
+static int kv_reclaim(uint32_t sector)
+{
+	uint32_t zero = 0;
+	int i;
+
+	for (i = 0; i < KV_STORE_MAX_KEYS; i++) {
+		struct kv_entry *e = &kvs.idx[i];
+
+		if (!e->key[0] || KV_SECTOR(e->off) != sector)
+			continue;
+		if (kvs.tail + KV_REC_SIZE(strlen(e->key), e->vlen) >
+		    KV_SECTOR_END(kvs.tail_sector))
+			return -WM_E_NOSPC;
+		if (kv_move(e) != WM_SUCCESS)
+			return -WM_FAIL;
+	}
+	if (kv_write(&zero, sizeof(zero), sector * KV_STORE_SECTOR_SIZE) != 0)
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
+
+/* Continues the log in the next sector. The sector after that is the
+ * oldest one in use, it is reclaimed right away, so that the next one is
+ * always free */
+static int kv_open_next(void)
+{
+	struct kv_sector h;
+	uint32_t next, ahead;
+
+	next = (kvs.tail_sector + 1) % kvs.sectors;
+	if (kv_sector_live(next))
+		return -WM_E_NOSPC;
+	if (kv_erase(next) != 0)
+		return -WM_FAIL;
+	/* The magic goes last, a sector with a valid header has its seq */
+	h.magic = KV_MAGIC;
+	h.seq = kvs.seq + 1;
+	if (kv_write(&h.seq, sizeof(h.seq), next * KV_STORE_SECTOR_SIZE +
+		     offsetof(struct kv_sector, seq)) != 0 ||
+	    kv_write(&h.magic, sizeof(h.magic),
+		     next * KV_STORE_SECTOR_SIZE) != 0)
+		return -WM_FAIL;
+	kvs.seq = h.seq;
+	kvs.tail_sector = next;
+	kvs.tail = KV_FIRST(next);
+
+	ahead = (next + 1) % kvs.sectors;
+	if (kv_sector_valid(ahead, NULL) && kv_reclaim(ahead) != WM_SUCCESS) {
+		/* Nothing else goes to this sector, kv_scan() drops it */
+		kvs.tail = KV_SECTOR_END(next);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+static int kv_append(const char *key, uint8_t type, const void *val,
+		     uint16_t vlen)
+{
+	struct {
+		struct kv_rec r;
+		char key[KV_STORE_MAX_KEY_LEN];
+	} h;
+	uint32_t size, tries;
+	size_t klen = strlen(key);
+	int ret;
+
+	size = KV_REC_SIZE(klen, vlen);
+	for (tries = 0; kvs.tail + size > KV_SECTOR_END(kvs.tail_sector);
+	     tries++) {
+		if (tries == kvs.sectors)
+			return -WM_E_NOSPC;
+		ret = kv_open_next();
+		if (ret != WM_SUCCESS)
+			return ret;
+	}
+
+	h.r.klen = klen;
+	h.r.type = type;
+	h.r.vlen = vlen;
+	memcpy(h.key, key, klen);
+	h.r.crc = fast_crc32(&h.r, offsetof(struct kv_rec, crc), 0);
+	h.r.crc = fast_crc32(h.key, klen, h.r.crc);
+	h.r.crc = fast_crc32(val, vlen, h.r.crc);
+
+	/* A reset in between leaves a record with a wrong CRC, it is
+	 * skipped at the next scan */
+	ret = kv_write(&h, sizeof(h.r) + klen, kvs.tail);
+	if (ret == 0 && vlen)
+		ret = kv_write(val, vlen, kvs.tail + sizeof(h.r) + klen);
+	kvs.tail += size;
+	return ret == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+/* Nothing was written there, a header torn by a reset can have klen
+ * still erased */
+static bool kv_rec_free(const struct kv_rec *r)
+{
+	return r->klen == KV_FREE && r->type == KV_FREE &&
+		r->vlen == 0xffff && r->crc == 0xffffffff;
+}
+
+/* Size of a record read at off, 0 when its header makes no sense. A
+ * header torn by a reset has more bits set than the one being written, so
+ * the size is never short of the bytes that were written */
+static uint32_t kv_rec_size(const struct kv_rec *r, uint32_t off)
+{
+	uint32_t size;
+
+	if (r->klen == 0 || r->klen > KV_STORE_MAX_KEY_LEN)
+		return 0;
+	size = KV_REC_SIZE(r->klen, r->vlen);
+	if (off + size > KV_SECTOR_END(KV_SECTOR(off)))
+		return 0;
+	return size;
+}
+
+/* Reads the key of a record and checks its CRC */
+static bool kv_rec_valid(const struct kv_rec *r, char *key, uint32_t off)
+{
+	uint8_t buf[64];
+	uint32_t crc, done, n;
+
+	if (r->type != KV_SET && r->type != KV_DEL)
+		return false;
+	off += sizeof(*r);
+	if (kv_read(key, r->klen, off) != 0)
+		return false;
+	key[r->klen] = 0;
+	crc = fast_crc32(r, offsetof(struct kv_rec, crc), 0);
+	crc = fast_crc32(key, r->klen, crc);
+	off += r->klen;
+	for (done = 0; done < r->vlen; done += n) {
+		n = r->vlen - done < sizeof(buf) ? r->vlen - done : sizeof(buf);
+		if (kv_read(buf, n, off + done) != 0)
+			return false;
+		crc = fast_crc32(buf, n, crc);
+	}
+	return crc == r->crc;
+}
+
+/* Replays the records of a sector into the index, returns where the
+ * records end */
+static uint32_t kv_scan_sector(uint32_t sector)
+{
+	char key[KV_STORE_MAX_KEY_LEN + 1];
+	struct kv_entry *e;
+	struct kv_rec r;
+	uint32_t off, size;
+
+	off = KV_FIRST(sector);
+	while (off + sizeof(r) <= KV_SECTOR_END(sector)) {
+		if (kv_read(&r, sizeof(r), off) != 0)
+			break;
+		if (kv_rec_free(&r))
+			return off;
+		size = kv_rec_size(&r, off);
+		if (!size)
+			break;
+		if (!kv_rec_valid(&r, key, off)) {
+			/* Torn, nothing was written after it */
+			off += size;
+			continue;
+		}
+
+		e = kv_find(key);
+		if (r.type == KV_DEL) {
+			if (e)
+				e->key[0] = 0;
+		} else if (e || (e = kv_find_free())) {
+			if (kv_index(e, key, r.klen, off, r.vlen) != WM_SUCCESS)
+				e->key[0] = 0;
+		}
+		off += size;
+	}
+	return KV_SECTOR_END(sector);
+}
+
+/* Finds the newest sector, returns false when there is none */
+static bool kv_find_tail(void)
+{
+	uint32_t sector, seq;
+	bool found = false;
+
+	for (sector = 0; sector < kvs.sectors; sector++) {
+		if (!kv_sector_valid(sector, &seq))
+			continue;
+		if (!found || seq > kvs.seq) {
+			kvs.seq = seq;
+			kvs.tail_sector = sector;
+		}
+		found = true;
+	}
+	return found;
+}
+
+static int kv_scan(void)
+{
+	uint32_t sector, i;
+
+	memset(kvs.idx, 0, sizeof(kvs.idx));
+	if (kv_find_tail()) {
+		/* The sector after the newest one is still in use when a
+		 * reset came in kv_open_next(), before the values of that
+		 * sector were all moved. The newest sector only holds their
+		 * copies, it is dropped and the log continues in the one
+		 * before, the sector switch is done again when it is full */
+		sector = (kvs.tail_sector + 1) % kvs.sectors;
+		if (sector != kvs.tail_sector &&
+		    kv_sector_valid(sector, NULL)) {
+			if (kv_erase(kvs.tail_sector) != 0)
+				return -WM_FAIL;
+			kv_find_tail();
+		}
+	} else {
+		/* Empty or foreign partition, the log starts in sector 0 */
+		kvs.seq = 0;
+		kvs.tail_sector = kvs.sectors - 1;
+		kvs.tail = KV_SECTOR_END(kvs.tail_sector);
+		return kv_open_next();
+	}
+
+	/* Oldest sector first, so that newer records replace older ones */
+	for (i = 1; i <= kvs.sectors; i++) {
+		sector = (kvs.tail_sector + i) % kvs.sectors;
+		if (kv_sector_valid(sector, NULL))
+			kvs.tail = kv_scan_sector(sector);
+	}
+	return WM_SUCCESS;
+}
+
+int kv_store_init(const flash_desc_t *fl)
+{
+	int ret;
+
+	if (!fl || fl->fl_size % KV_STORE_SECTOR_SIZE ||
+	    fl->fl_start % KV_STORE_SECTOR_SIZE ||
+	    fl->fl_size < 2 * KV_STORE_SECTOR_SIZE)
+		return -WM_E_INVAL;
+
+	if (!kvs.lock && os_mutex_create(&kvs.lock, "kv-store",
+					 OS_MUTEX_INHERIT) != WM_SUCCESS)
+		return -WM_FAIL;
+	os_mutex_get(&kvs.lock, OS_WAIT_FOREVER);
+	if (kvs.dev)
+		flash_drv_close(kvs.dev);
+	kvs.fl = *fl;
+	kvs.sectors = fl->fl_size / KV_STORE_SECTOR_SIZE;
+	kvs.dev = flash_drv_open(fl->fl_dev);
+	if (!kvs.dev) {
+		os_mutex_put(&kvs.lock);
+		return -WM_FAIL;
+	}
+	fast_crc32_init();
+
+	ret = kv_scan();
+	os_mutex_put(&kvs.lock);
+	return ret;
+}
+
+int kv_store_get(const char *key, void *buf, size_t len)
+{
+	struct kv_entry *e;
+	int ret;
+
+	if (!kvs.dev || !key)
+		return -WM_E_NOENT;
+	os_mutex_get(&kvs.lock, OS_WAIT_FOREVER);
+	e = kv_find(key);
+	if (!e)
+		ret = -WM_E_NOENT;
+	else if (!buf)
+		ret = e->vlen;
+	else if (len < e->vlen)
+		ret = -WM_E_NOSPC;
+	else if (e->vlen <= KV_STORE_CACHE_LEN) {
+		memcpy(buf, e->val, e->vlen);
+		ret = e->vlen;
+	} else if (kv_read(buf, e->vlen, e->off + sizeof(struct kv_rec) +
+			   strlen(e->key)) != 0)
+		ret = -WM_FAIL;
+	else
+		ret = e->vlen;
+	os_mutex_put(&kvs.lock);
+	return ret;
+}
+
+/* Compares a value with the one of an entry */
+static bool kv_equal(const struct kv_entry *e, const void *val, size_t len)
+{
+	uint8_t buf[64];
+	uint32_t off, done, n;
+
+	if (e->vlen != len)
+		return false;
+	if (len <= KV_STORE_CACHE_LEN)
+		return !memcmp(e->val, val, len);
+
+	off = e->off + sizeof(struct kv_rec) + strlen(e->key);
+	for (done = 0; done < len; done += n) {
+		n = len - done < sizeof(buf) ? len - done : sizeof(buf);
+		if (kv_read(buf, n, off + done) != 0 ||
+		    memcmp(buf, (const uint8_t *) val + done, n))
+			return false;
+	}
+	return true;
+}
+
+int kv_store_set(const char *key, const void *val, size_t len)
+{
+	struct kv_entry *e;
+	size_t klen;
+	uint32_t off;
+	int ret;
+
+	if (!kvs.dev || !key || (len && !val))
+		return -WM_E_INVAL;
+	klen = strlen(key);
+	if (!klen || klen > KV_STORE_MAX_KEY_LEN ||
+	    len > KV_STORE_MAX_VALUE_LEN)
+		return -WM_E_INVAL;
+
+	os_mutex_get(&kvs.lock, OS_WAIT_FOREVER);
+	e = kv_find(key);
+	if (e && kv_equal(e, val, len)) {
+		os_mutex_put(&kvs.lock);
+		return WM_SUCCESS;
+	}
+	if (!e && !kv_find_free()) {
+		os_mutex_put(&kvs.lock);
+		return -WM_E_NOMEM;
+	}
+
+	ret = kv_append(key, KV_SET, val, len);
+	if (ret == WM_SUCCESS) {
+		/* The sector switch may have moved the entries around */
+		e = kv_find(key);
+		if (!e)
+			e = kv_find_free();
+		off = kvs.tail - KV_REC_SIZE(klen, len);
+		if (len <= KV_STORE_CACHE_LEN)
+			memcpy(e->val, val, len);
+		memcpy(e->key, key, klen + 1);
+		e->off = off;
+		e->vlen = len;
+	}
+	os_mutex_put(&kvs.lock);
+	return ret;
+}
+
+int kv_store_delete(const char *key)
+{
+	struct kv_entry *e;
+	int ret;
+
+	if (!kvs.dev || !key)
+		return -WM_E_NOENT;
+	os_mutex_get(&kvs.lock, OS_WAIT_FOREVER);
+	e = kv_find(key);
+	if (!e)
+		ret = -WM_E_NOENT;
+	else {
+		ret = kv_append(key, KV_DEL, NULL, 0);
+		if (ret == WM_SUCCESS)
+			e->key[0] = 0;
+	}
+	os_mutex_put(&kvs.lock);
+	return ret;
+}
+
+int kv_store_erase_all(void)
+{
+	uint32_t sector;
+	int ret = WM_SUCCESS;
+
+	if (!kvs.dev)
+		return -WM_FAIL;
+	os_mutex_get(&kvs.lock, OS_WAIT_FOREVER);
+	memset(kvs.idx, 0, sizeof(kvs.idx));
+	for (sector = 0; sector < kvs.sectors; sector++)
+		if (kv_erase(sector) != 0)
+			ret = -WM_FAIL;
+	kvs.seq = 0;
+	kvs.tail_sector = kvs.sectors - 1;
+	kvs.tail = KV_SECTOR_END(kvs.tail_sector);
+	if (ret == WM_SUCCESS)
+		ret = kv_open_next();
+	os_mutex_put(&kvs.lock);
+	return ret;
+}
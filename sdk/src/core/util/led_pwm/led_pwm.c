@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * gpt_drv_init() clocks the GPT at 50MHz, gpt_drv_set() counts 50 cycles
+ * per microsecond. gpt_drv_set() sets the counter's period, the blink
+ * period, and gpt_drv_pwm() splits it into the high and the low part.
+ */
+
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <mdev_gpt.h>
+#include <lowlevel_drivers.h>
+#include <led_pwm.h>
+
+#define led_pwm_w(...) wmlog_w("led_pwm", ##__VA_ARGS__)
+
+#define GPT_CYCLES_PER_MS 50000
+/* The 32 bit counter wraps after about 85s */
+#define MAX_PERIOD_MS (UINT32_MAX / GPT_CYCLES_PER_MS)
+
+struct led_gpt_pin {
+	int8_t gpio;
+	uint8_t gpt;
+	uint8_t ch;
+	/* Pin mux functions of the channel and of the GPIO */
+	uint8_t gpt_func;
+	uint8_t gpio_func;
+};
+
+#if defined(CONFIG_CPU_MW300)
+static const struct led_gpt_pin led_gpt_pins[] = {
+	{GPIO_0, GPT0_ID, GPT_CH_0, GPIO0_GPT0_CH0, GPIO0_GPIO0},
+	{GPIO_1, GPT0_ID, GPT_CH_1, GPIO1_GPT0_CH1, GPIO1_GPIO1},
+	{GPIO_2, GPT0_ID, GPT_CH_2, GPIO2_GPT0_CH2, GPIO2_GPIO2},
+	{GPIO_3, GPT0_ID, GPT_CH_3, GPIO3_GPT0_CH3, GPIO3_GPIO3},
+	{GPIO_4, GPT0_ID, GPT_CH_4, GPIO4_GPT0_CH4, GPIO4_GPIO4},
+	{GPIO_5, GPT0_ID, GPT_CH_5, GPIO5_GPT0_CH5, GPIO5_GPIO5},
+	{GPIO_11, GPT2_ID, GPT_CH_0, GPIO11_GPT2_CH0, GPIO11_GPIO11},
+	{GPIO_12, GPT2_ID, GPT_CH_1, GPIO12_GPT2_CH1, GPIO12_GPIO12},
+	{GPIO_13, GPT2_ID, GPT_CH_2, GPIO13_GPT2_CH2, GPIO13_GPIO13},
+	{GPIO_14, GPT2_ID, GPT_CH_3, GPIO14_GPT2_CH3, GPIO14_GPIO14},
+	{GPIO_15, GPT2_ID, GPT_CH_4, GPIO15_GPT2_CH4, GPIO15_GPIO15},
+	{GPIO_17, GPT3_ID, GPT_CH_0, GPIO17_GPT3_CH0, GPIO17_GPIO17},
+	{GPIO_18, GPT3_ID, GPT_CH_1, GPIO18_GPT3_CH1, GPIO18_GPIO18},
+	{GPIO_19, GPT3_ID, GPT_CH_2, GPIO19_GPT3_CH2, GPIO19_GPIO19},
+	{GPIO_20, GPT3_ID, GPT_CH_3, GPIO20_GPT3_CH3, GPIO20_GPIO20},
+	{GPIO_21, GPT3_ID, GPT_CH_4, GPIO21_GPT3_CH4, GPIO21_GPIO21},
+	{GPIO_24, GPT1_ID, GPT_CH_5, GPIO24_GPT1_CH5, GPIO24_GPIO24},
+	{GPIO_28, GPT1_ID, GPT_CH_0, GPIO28_GPT1_CH0, GPIO28_GPIO28},
+	{GPIO_29, GPT1_ID, GPT_CH_1, GPIO29_GPT1_CH1, GPIO29_GPIO29},
+	{GPIO_30, GPT1_ID, GPT_CH_2, GPIO30_GPT1_CH2, GPIO30_GPIO30},
+	{GPIO_31, GPT1_ID, GPT_CH_3, GPIO31_GPT1_CH3, GPIO31_GPIO31},
+	{GPIO_32, GPT1_ID, GPT_CH_4, GPIO32_GPT1_CH4, GPIO32_GPIO32},
+	{GPIO_33, GPT1_ID, GPT_CH_5, GPIO33_GPT1_CH5, GPIO33_GPIO33},
+	{GPIO_34, GPT3_ID, GPT_CH_5, GPIO34_GPT3_CH5, GPIO34_GPIO34},
+	{GPIO_37, GPT2_ID, GPT_CH_5, GPIO37_GPT2_CH5, GPIO37_GPIO37},
+};
+#else
+/* No table for this chip, the LEDs blink from the software timer */
+static const struct led_gpt_pin led_gpt_pins[0];
+#endif
+
+/* LEDs a GPT blinks */
+static struct {
+	const struct led_gpt_pin *pin;
+	mdev_t *dev;
+} led_pwm_active[LED_COUNT];
+
+static const struct led_gpt_pin *led_gpt_pin(int gpio)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(led_gpt_pins) / sizeof(led_gpt_pins[0]); i++)
+		if (led_gpt_pins[i].gpio == gpio)
+			return &led_gpt_pins[i];
+	return NULL;
+}
+
+/* Hands the pin back to the GPIO, if a GPT blinks it */
+static void led_pwm_release(output_gpio_cfg_t led)
+{
+	int i;
+
+	for (i = 0; i < LED_COUNT; i++) {
+		if (!led_pwm_active[i].pin ||
+		    led_pwm_active[i].pin->gpio != led.gpio)
+			continue;
+		gpt_drv_stop(led_pwm_active[i].dev);
+		gpt_drv_close(led_pwm_active[i].dev);
+		GPIO_PinMuxFun(led.gpio, led_pwm_active[i].pin->gpio_func);
+		led_pwm_active[i].pin = NULL;
+		led_pwm_active[i].dev = NULL;
+		return;
+	}
+}
+
+static int led_pwm_start(output_gpio_cfg_t led, int on_duty_cycle,
+			 int off_duty_cycle)
+{
+	const struct led_gpt_pin *pin = led_gpt_pin(led.gpio);
+	uint32_t high, low;
+	mdev_t *dev;
+	int i;
+
+	if (!pin || on_duty_cycle <= 0 || off_duty_cycle <= 0 ||
+	    (uint32_t)on_duty_cycle + off_duty_cycle > MAX_PERIOD_MS)
+		return -WM_FAIL;
+
+	for (i = 0; i < LED_COUNT && led_pwm_active[i].pin; i++)
+		;
+	if (i == LED_COUNT)
+		return -WM_FAIL;
+
+	if (gpt_drv_init(pin->gpt) != WM_SUCCESS)
+		return -WM_FAIL;
+	/* Fails when the GPT is open already, for another LED or user */
+	dev = gpt_drv_open(pin->gpt);
+	if (!dev)
+		return -WM_FAIL;
+
+	/* The output is high for the first part of the period */
+	if (GPIO_ACTIVE_HIGH == led.type) {
+		high = on_duty_cycle;
+		low = off_duty_cycle;
+	} else {
+		high = off_duty_cycle;
+		low = on_duty_cycle;
+	}
+	gpt_drv_set(dev, (high + low) * 1000);
+	gpt_drv_pwm(dev, pin->ch, high * GPT_CYCLES_PER_MS,
+		    low * GPT_CYCLES_PER_MS);
+	GPIO_PinMuxFun(led.gpio, pin->gpt_func);
+	gpt_drv_start(dev);
+
+	led_pwm_active[i].pin = pin;
+	led_pwm_active[i].dev = dev;
+	return WM_SUCCESS;
+}
+
+int led_pwm_blink(output_gpio_cfg_t led, int on_duty_cycle,
+		  int off_duty_cycle)
+{
+	led_pwm_release(led);
+	/* Stops the software timer, if it blinks the LED */
+	led_off(led);
+
+	if (led_pwm_start(led, on_duty_cycle, off_duty_cycle) == WM_SUCCESS)
+		return WM_SUCCESS;
+
+	if (led_gpt_pin(led.gpio))
+		led_pwm_w("no GPT for GPIO %d, blinking in software",
+			  led.gpio);
+	led_blink(led, on_duty_cycle, off_duty_cycle);
+	return -WM_FAIL;
+}
+
+void led_pwm_on(output_gpio_cfg_t led)
+{
+	led_pwm_release(led);
+	led_on(led);
+}
+
+void led_pwm_off(output_gpio_cfg_t led)
+{
+	led_pwm_release(led);
+	led_off(led);
+}
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Every position is looked up by the hash of its first 3 bytes, the table
+ * keeps the last position of every hash plus 1, 0 for none. One candidate
+ * is compared, there are no chains: a little less compression for a single
+ * pass over the input and a table of 512 bytes.
+ */
+
+#include <string.h>
+#include <wmerrno.h>
+#include <lzss.h>
+
+static inline unsigned lzss_hash(const uint8_t *p)
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+
+	return (v * 2654435761u) >> 24;
+}
+
+int lzss_compress(struct lzss_work *work, const void *src, size_t len,
+		  void *dst, size_t size)
+{
+	const uint8_t *in = src;
+	uint8_t *out = dst, *flags = NULL;
+	size_t i = 0, o = 0, cand = 0, best, max, n;
+	unsigned bit = 8, h;
+
+	if (len > LZSS_MAX_LEN)
+		return -WM_E_INVAL;
+	if (!len)
+		return 0;
+	/* Only worth it if it is shorter */
+	if (size >= len)
+		size = len - 1;
+	memset(work->head, 0, sizeof(work->head));
+
+	while (i < len) {
+		if (bit == 8) {
+			if (o >= size)
+				return 0;
+			flags = &out[o++];
+			*flags = 0;
+			bit = 0;
+		}
+
+		best = 0;
+		if (i + LZSS_MIN_MATCH <= len) {
+			h = lzss_hash(&in[i]);
+			cand = work->head[h];
+			work->head[h] = i + 1;
+			if (cand && i - (cand - 1) <= LZSS_WINDOW) {
+				cand--;
+				max = len - i;
+				if (max > LZSS_MAX_MATCH)
+					max = LZSS_MAX_MATCH;
+				while (best < max && in[cand + best] == in[i + best])
+					best++;
+			}
+		}
+
+		if (best >= LZSS_MIN_MATCH) {
+			if (o + 2 > size)
+				return 0;
+			n = i - cand - 1;
+			out[o++] = n >> 4;
+			out[o++] = ((n & 0xf) << 4) | (best - LZSS_MIN_MATCH);
+			*flags |= 1 << bit;
+			/* The positions the match covers can be matched later */
+			for (n = 1; n < best && i + n + LZSS_MIN_MATCH <= len; n++)
+				work->head[lzss_hash(&in[i + n])] = i + n + 1;
+			i += best;
+		} else {
+			if (o >= size)
+				return 0;
+			out[o++] = in[i++];
+		}
+		bit++;
+	}
+
+	return o;
+}
+
+int lzss_decompress(const void *src, size_t len, void *dst, size_t size)
+{
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	size_t i = 0, o = 0, dist, n;
+	unsigned flags = 0, bit = 8;
+
+	while (i < len) {
+		if (bit == 8) {
+			flags = in[i++];
+			bit = 0;
+			continue;
+		}
+
+		if (flags & (1 << bit)) {
+			if (i + 2 > len)
+				return -WM_E_INVAL;
+			dist = ((in[i] << 4) | (in[i + 1] >> 4)) + 1;
+			n = (in[i + 1] & 0xf) + LZSS_MIN_MATCH;
+			i += 2;
+			if (dist > o)
+				return -WM_E_INVAL;
+			if (n > size - o)
+				return -WM_E_NOSPC;
+			/* Byte by byte, the match can overlap what it copies */
+			for (; n; n--, o++)
+				out[o] = out[o - dist];
+		} else {
+			if (o >= size)
+				return -WM_E_NOSPC;
+			out[o++] = in[i++];
+		}
+		bit++;
+	}
+
+	return o;
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libmdev_cache
+libmdev_cache-objs-y := mdev_cache.c
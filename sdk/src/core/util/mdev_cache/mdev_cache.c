@@ -0,0 +1,143 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The table only grows, an entry is filled before the count covers it, so
+ * a get reads the count without masking. The handle and the reference
+ * count are changed with the syscall interrupts masked, the open and the
+ * close run unmasked with the entry marked busy.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <mdev_cache.h>
+
+struct mc_entry {
+	const char *name;
+	mdev_cache_open_t open;
+	mdev_cache_close_t close;
+	mdev_t *dev;
+	uint16_t refs;
+	/* Being opened or closed by a thread */
+	bool busy;
+};
+
+static struct mc_entry mc_table[MDEV_CACHE_MAX];
+static int mc_cnt;
+
+int mdev_cache_id(const char *name, mdev_cache_open_t open,
+		  mdev_cache_close_t close)
+{
+	unsigned long state;
+	struct mc_entry *e;
+	int id;
+
+	if (!name || !open)
+		return -WM_E_INVAL;
+
+	state = os_mask_syscall_interrupts();
+	for (id = 0; id < mc_cnt; id++) {
+		if (!strcmp(mc_table[id].name, name)) {
+			os_unmask_syscall_interrupts(state);
+			return id;
+		}
+	}
+	if (mc_cnt == MDEV_CACHE_MAX) {
+		os_unmask_syscall_interrupts(state);
+		return -WM_E_NOSPC;
+	}
+	e = &mc_table[mc_cnt];
+	e->name = name;
+	e->open = open;
+	e->close = close;
+	id = mc_cnt++;
+	os_unmask_syscall_interrupts(state);
+	return id;
+}
+
+mdev_t *mdev_cache_get(int id)
+{
+	unsigned long state;
+	struct mc_entry *e;
+	mdev_t *dev;
+
+	if (id < 0 || id >= mc_cnt)
+		return NULL;
+	e = &mc_table[id];
+
+	while (1) {
+		state = os_mask_syscall_interrupts();
+		if (e->dev) {
+			e->refs++;
+			dev = e->dev;
+			os_unmask_syscall_interrupts(state);
+			return dev;
+		}
+		if (is_isr_context()) {
+			os_unmask_syscall_interrupts(state);
+			return NULL;
+		}
+		if (!e->busy) {
+			e->busy = true;
+			os_unmask_syscall_interrupts(state);
+			break;
+		}
+		os_unmask_syscall_interrupts(state);
+		/* Another thread opens or closes it */
+		os_thread_sleep(1);
+	}
+
+	dev = e->open(e->name);
+	state = os_mask_syscall_interrupts();
+	e->dev = dev;
+	if (dev)
+		e->refs++;
+	e->busy = false;
+	os_unmask_syscall_interrupts(state);
+	return dev;
+}
+
+void mdev_cache_put(int id)
+{
+	unsigned long state;
+
+	if (id < 0 || id >= mc_cnt)
+		return;
+	state = os_mask_syscall_interrupts();
+	if (mc_table[id].refs)
+		mc_table[id].refs--;
+	os_unmask_syscall_interrupts(state);
+}
+
+int mdev_cache_release(int id)
+{
+	unsigned long state;
+	struct mc_entry *e;
+	mdev_t *dev;
+
+	if (id < 0 || id >= mc_cnt)
+		return -WM_E_INVAL;
+	e = &mc_table[id];
+
+	state = os_mask_syscall_interrupts();
+	if (e->refs || e->busy) {
+		os_unmask_syscall_interrupts(state);
+		return -WM_E_BUSY;
+	}
+	dev = e->dev;
+	e->dev = NULL;
+	e->busy = dev != NULL;
+	os_unmask_syscall_interrupts(state);
+
+	if (dev) {
+		if (e->close)
+			e->close(dev);
+		state = os_mask_syscall_interrupts();
+		e->busy = false;
+		os_unmask_syscall_interrupts(state);
+	}
+	return WM_SUCCESS;
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libmdns_cache
+libmdns_cache-objs-y := mdns_cache.c
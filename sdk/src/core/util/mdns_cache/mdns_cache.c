@@ -0,0 +1,600 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <lwip/sockets.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <mdns_cache.h>
+
+#define mc_w(...) wmlog_w("mdns_cache", ##__VA_ARGS__)
+
+#define MDNS_PORT 5353
+#define MDNS_GROUP 0xe00000fb	/* 224.0.0.251 */
+#define MDNS_HDR_LEN 12
+#define MDNS_FLAG_QR 0x8000
+#define MDNS_TYPE_A 1
+#define MDNS_TYPE_PTR 12
+#define MDNS_TYPE_SRV 33
+#define MDNS_CLASS_IN 1
+/* Top bit of the class of a record, cache flush, or of a question,
+ * unicast response */
+#define MDNS_CLASS_MASK 0x7fff
+
+/* Responses are mostly a few hundred bytes, larger ones are dropped */
+#define MC_PKT_SIZE 1024
+
+/* A record of an instance */
+struct mc_rr {
+	uint32_t exp_ms;
+	uint32_t ttl_ms;
+};
+
+struct mc_entry {
+	bool used;
+	/* Refresh query sent since the last update */
+	bool queried;
+	uint8_t type;
+	char name[MDNS_CACHE_NAME_LEN];
+	/* SRV target */
+	char host[MDNS_CACHE_NAME_LEN];
+	uint16_t port;
+	uint32_t ip;
+	struct mc_rr ptr;
+	struct mc_rr srv;
+	struct mc_rr a;
+};
+
+struct mc_type {
+	char name[MDNS_CACHE_NAME_LEN];
+	/* To be queried in the next packet, requested at pending_ms */
+	bool pending;
+	uint32_t pending_ms;
+	/* Offset of the question in the packet being built */
+	uint16_t qoff;
+};
+
+static struct mc_type mc_types[MDNS_CACHE_MAX_TYPES];
+static int mc_ntypes;
+static struct mc_entry mc_cache[MDNS_CACHE_SIZE];
+static struct mdns_cache_stats mc_stats;
+static os_mutex_t mc_lock;
+static int mc_sock = -1;
+static uint8_t mc_rx[MC_PKT_SIZE];
+static uint8_t mc_tx[MC_PKT_SIZE];
+
+static os_thread_t mc_thread;
+static os_thread_stack_define(mc_stack, 2048);
+
+static uint32_t mc_now(void)
+{
+	return os_ticks_to_msec(os_ticks_get());
+}
+
+static bool mc_live(const struct mc_rr *rr, uint32_t now)
+{
+	return rr->ttl_ms && (int32_t) (rr->exp_ms - now) > 0;
+}
+
+static uint16_t mc_get16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static void mc_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/* Name at off in the dotted form, "" if too long, returns the offset
+ * after it or -1 */
+static int mc_get_name(const uint8_t *p, int len, int off, char *out)
+{
+	int n = 0, end = -1, hops = 0;
+	bool fits = true;
+	uint8_t l;
+
+	for (;;) {
+		if (off >= len)
+			return -1;
+		l = p[off];
+		if ((l & 0xc0) == 0xc0) {
+			if (off + 1 >= len || ++hops > 16)
+				return -1;
+			if (end < 0)
+				end = off + 2;
+			off = (l & 0x3f) << 8 | p[off + 1];
+			continue;
+		}
+		if (l & 0xc0)
+			return -1;
+		off++;
+		if (!l)
+			break;
+		if (off + l > len)
+			return -1;
+		if (n + l + 1 >= MDNS_CACHE_NAME_LEN)
+			fits = false;
+		if (fits) {
+			if (n)
+				out[n++] = '.';
+			memcpy(out + n, p + off, l);
+			n += l;
+		}
+		off += l;
+	}
+	out[fits ? n : 0] = '\0';
+	return end < 0 ? off : end;
+}
+
+static int mc_put_name(uint8_t *p, int off, const char *name)
+{
+	const char *dot;
+	size_t l;
+
+	while (*name) {
+		dot = strchr(name, '.');
+		l = dot ? (size_t) (dot - name) : strlen(name);
+		if (!l || l > 63 || off + l + 2 > MC_PKT_SIZE)
+			return -1;
+		p[off++] = l;
+		memcpy(p + off, name, l);
+		off += l;
+		name += dot ? l + 1 : l;
+	}
+	if (off >= MC_PKT_SIZE)
+		return -1;
+	p[off++] = 0;
+	return off;
+}
+
+static int mc_find_type(const char *name)
+{
+	int i;
+
+	for (i = 0; i < mc_ntypes; i++)
+		if (!strcasecmp(mc_types[i].name, name))
+			return i;
+	return -1;
+}
+
+static struct mc_entry *mc_find_entry(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MDNS_CACHE_SIZE; i++)
+		if (mc_cache[i].used && !strcasecmp(mc_cache[i].name, name))
+			return &mc_cache[i];
+	return NULL;
+}
+
+/* A free entry, or the one expiring first */
+static struct mc_entry *mc_alloc(void)
+{
+	struct mc_entry *e = NULL;
+	int i;
+
+	for (i = 0; i < MDNS_CACHE_SIZE; i++) {
+		if (!mc_cache[i].used) {
+			e = &mc_cache[i];
+			break;
+		}
+		if (!e || (int32_t) (mc_cache[i].ptr.exp_ms -
+				     e->ptr.exp_ms) < 0)
+			e = &mc_cache[i];
+	}
+	if (e->used)
+		mc_stats.evicted++;
+	memset(e, 0, sizeof(*e));
+	e->used = true;
+	return e;
+}
+
+static void mc_set(struct mc_entry *e, struct mc_rr *rr, uint32_t ttl_s,
+		   uint32_t now)
+{
+	rr->ttl_ms = ttl_s * 1000;
+	rr->exp_ms = now + rr->ttl_ms;
+	e->queried = false;
+	mc_stats.records++;
+}
+
+/* Takes a record, PTR and SRV in the first pass and A in the second one,
+ * as the address of a host is only wanted once its SRV is known */
+static void mc_record(int pass, const uint8_t *p, const char *owner,
+		      uint16_t type, uint32_t ttl, int rd, int rdlen,
+		      uint32_t now)
+{
+	char name[MDNS_CACHE_NAME_LEN];
+	struct mc_entry *e;
+	int i, t;
+
+	if (pass == 0 && type == MDNS_TYPE_PTR) {
+		t = mc_find_type(owner);
+		if (t < 0 || mc_get_name(p, rd + rdlen, rd, name) < 0 ||
+		    !name[0])
+			return;
+		e = mc_find_entry(name);
+		if (!ttl) {
+			/* Goodbye */
+			if (e)
+				e->used = false;
+			return;
+		}
+		if (!e) {
+			e = mc_alloc();
+			e->type = t;
+			strcpy(e->name, name);
+		}
+		mc_set(e, &e->ptr, ttl, now);
+	} else if (pass == 0 && type == MDNS_TYPE_SRV) {
+		e = mc_find_entry(owner);
+		if (!e || rdlen < 7 ||
+		    mc_get_name(p, rd + rdlen, rd + 6, e->host) < 0)
+			return;
+		e->port = mc_get16(p + rd + 4);
+		mc_set(e, &e->srv, ttl, now);
+	} else if (pass == 1 && type == MDNS_TYPE_A && rdlen == 4) {
+		for (i = 0; i < MDNS_CACHE_SIZE; i++) {
+			e = &mc_cache[i];
+			if (!e->used || strcasecmp(e->host, owner))
+				continue;
+			memcpy(&e->ip, p + rd, 4);
+			mc_set(e, &e->a, ttl, now);
+		}
+	}
+}
+
+static void mc_response(const uint8_t *p, int len)
+{
+	char owner[MDNS_CACHE_NAME_LEN];
+	int pass, off, rd, rdlen, i, n;
+	uint16_t type, class;
+	uint32_t ttl, now = mc_now();
+
+	if (len < MDNS_HDR_LEN || !(mc_get16(p + 2) & MDNS_FLAG_QR))
+		return;
+	n = mc_get16(p + 6) + mc_get16(p + 8) + mc_get16(p + 10);
+
+	for (pass = 0; pass < 2; pass++) {
+		off = MDNS_HDR_LEN;
+		for (i = mc_get16(p + 4); i; i--) {
+			off = mc_get_name(p, len, off, owner);
+			if (off < 0 || off + 4 > len)
+				return;
+			off += 4;
+		}
+		for (i = 0; i < n; i++) {
+			off = mc_get_name(p, len, off, owner);
+			if (off < 0 || off + 10 > len)
+				return;
+			type = mc_get16(p + off);
+			class = mc_get16(p + off + 2) & MDNS_CLASS_MASK;
+			ttl = (uint32_t) mc_get16(p + off + 4) << 16 |
+				mc_get16(p + off + 6);
+			rdlen = mc_get16(p + off + 8);
+			rd = off + 10;
+			off = rd + rdlen;
+			if (off > len)
+				return;
+			if (class == MDNS_CLASS_IN && owner[0])
+				mc_record(pass, p, owner, type, ttl, rd, rdlen,
+					  now);
+		}
+	}
+}
+
+/* Known answers, the instances whose PTR has more than half its TTL left,
+ * owned by the question at qoff */
+static int mc_known(int off, int t, int *count, uint32_t now)
+{
+	struct mc_entry *e;
+	uint32_t left;
+	int i, end;
+
+	for (i = 0; i < MDNS_CACHE_SIZE; i++) {
+		e = &mc_cache[i];
+		if (!e->used || e->type != t || !mc_live(&e->ptr, now))
+			continue;
+		left = e->ptr.exp_ms - now;
+		if (left < e->ptr.ttl_ms / 2 || off + 12 > MC_PKT_SIZE)
+			continue;
+		mc_put16(mc_tx + off, 0xc000 | mc_types[t].qoff);
+		mc_put16(mc_tx + off + 2, MDNS_TYPE_PTR);
+		mc_put16(mc_tx + off + 4, MDNS_CLASS_IN);
+		mc_put16(mc_tx + off + 6, (left / 1000) >> 16);
+		mc_put16(mc_tx + off + 8, left / 1000);
+		end = mc_put_name(mc_tx, off + 12, e->name);
+		if (end < 0)
+			continue;
+		mc_put16(mc_tx + off + 10, end - off - 12);
+		off = end;
+		(*count)++;
+	}
+	return off;
+}
+
+/* One packet with the questions of all the pending types, called with
+ * the lock held */
+static void mc_query(uint32_t now)
+{
+	struct sockaddr_in to;
+	int t, off, end, qd = 0, an = 0;
+
+	memset(mc_tx, 0, MDNS_HDR_LEN);
+	off = MDNS_HDR_LEN;
+	for (t = 0; t < mc_ntypes; t++) {
+		if (!mc_types[t].pending)
+			continue;
+		end = mc_put_name(mc_tx, off, mc_types[t].name);
+		if (end < 0 || end + 4 > MC_PKT_SIZE)
+			break;
+		mc_types[t].qoff = off;
+		mc_put16(mc_tx + end, MDNS_TYPE_PTR);
+		mc_put16(mc_tx + end + 2, MDNS_CLASS_IN);
+		off = end + 4;
+		qd++;
+	}
+	if (!qd)
+		return;
+	/* The types which did not fit stay pending */
+	for (t = 0; t < mc_ntypes; t++) {
+		if (!mc_types[t].qoff)
+			continue;
+		off = mc_known(off, t, &an, now);
+		mc_types[t].pending = false;
+		mc_types[t].qoff = 0;
+	}
+	mc_put16(mc_tx + 4, qd);
+	mc_put16(mc_tx + 6, an);
+
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_port = htons(MDNS_PORT);
+	to.sin_addr.s_addr = htonl(MDNS_GROUP);
+	if (sendto(mc_sock, mc_tx, off, 0, (struct sockaddr *) &to,
+		   sizeof(to)) < 0) {
+		mc_w("Query not sent");
+		return;
+	}
+	mc_stats.queries++;
+	mc_stats.questions += qd;
+	mc_stats.known_answers += an;
+}
+
+static void mc_request(int t, uint32_t now)
+{
+	if (!mc_types[t].pending) {
+		mc_types[t].pending = true;
+		mc_types[t].pending_ms = now;
+	}
+}
+
+static bool mc_due(const struct mc_rr *rr, uint32_t now)
+{
+	return rr->ttl_ms &&
+		(int32_t) (now - (rr->exp_ms - rr->ttl_ms / 5)) >= 0;
+}
+
+/* Drops the expired instances and requests a query for the types of the
+ * instances at 80% of the TTL of a record, then sends the batch */
+static void mc_tick(void)
+{
+	uint32_t now = mc_now();
+	struct mc_entry *e;
+	bool send = false;
+	int i;
+
+	for (i = 0; i < MDNS_CACHE_SIZE; i++) {
+		e = &mc_cache[i];
+		if (!e->used)
+			continue;
+		if (!mc_live(&e->ptr, now)) {
+			e->used = false;
+			continue;
+		}
+		if (!e->queried && (mc_due(&e->ptr, now) ||
+				    mc_due(&e->srv, now) ||
+				    mc_due(&e->a, now))) {
+			e->queried = true;
+			mc_request(e->type, now);
+		}
+	}
+
+	for (i = 0; i < mc_ntypes; i++)
+		if (mc_types[i].pending &&
+		    now - mc_types[i].pending_ms >= MDNS_CACHE_BATCH_MS)
+			send = true;
+	if (send)
+		mc_query(now);
+}
+
+static void mc_main(os_thread_arg_t arg)
+{
+	struct timeval tv;
+	fd_set rfds;
+	int len;
+
+	for (;;) {
+		FD_ZERO(&rfds);
+		FD_SET(mc_sock, &rfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = MDNS_CACHE_BATCH_MS * 1000 / 2;
+		if (select(mc_sock + 1, &rfds, NULL, NULL, &tv) > 0) {
+			len = recv(mc_sock, mc_rx, sizeof(mc_rx), 0);
+			if (len > 0) {
+				os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+				mc_response(mc_rx, len);
+				os_mutex_put(&mc_lock);
+			}
+		}
+		os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+		mc_tick();
+		os_mutex_put(&mc_lock);
+	}
+}
+
+int mdns_cache_start(void)
+{
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int one = 1;
+	uint8_t ttl = 255;
+
+	if (mc_sock >= 0)
+		return -WM_E_BUSY;
+	if (os_mutex_create(&mc_lock, "mdns_cache", OS_MUTEX_INHERIT)
+	    != WM_SUCCESS)
+		return -WM_FAIL;
+
+	mc_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (mc_sock < 0)
+		goto fail;
+	/* The responder of the SDK has the port too */
+	setsockopt(mc_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(MDNS_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(mc_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		goto fail;
+	mreq.imr_multiaddr.s_addr = htonl(MDNS_GROUP);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(mc_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+		       sizeof(mreq)) < 0)
+		goto fail;
+	setsockopt(mc_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+	if (os_thread_create(&mc_thread, "mdns-cache", mc_main, NULL,
+			     &mc_stack, OS_PRIO_3) != WM_SUCCESS)
+		goto fail;
+	return WM_SUCCESS;
+
+fail:
+	mc_w("Can not listen to mDNS");
+	if (mc_sock >= 0)
+		close(mc_sock);
+	mc_sock = -1;
+	os_mutex_delete(&mc_lock);
+	return -WM_FAIL;
+}
+
+static int mc_add_type(const char *type)
+{
+	int t = mc_find_type(type);
+
+	if (t >= 0)
+		return t;
+	if (strlen(type) >= MDNS_CACHE_NAME_LEN)
+		return -WM_E_INVAL;
+	if (mc_ntypes == MDNS_CACHE_MAX_TYPES)
+		return -WM_E_NOSPC;
+	strcpy(mc_types[mc_ntypes].name, type);
+	return mc_ntypes++;
+}
+
+int mdns_cache_add_type(const char *type)
+{
+	int ret;
+
+	if (mc_sock < 0)
+		return -WM_FAIL;
+	os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+	ret = mc_add_type(type);
+	os_mutex_put(&mc_lock);
+	return ret < 0 ? ret : WM_SUCCESS;
+}
+
+static void mc_result(const struct mc_entry *e, struct mdns_cache_result *res,
+		      uint32_t now)
+{
+	uint32_t left = e->ptr.exp_ms - now;
+
+	if (e->srv.exp_ms - now < left)
+		left = e->srv.exp_ms - now;
+	if (e->a.exp_ms - now < left)
+		left = e->a.exp_ms - now;
+	strcpy(res->name, e->name);
+	res->ip = e->ip;
+	res->port = e->port;
+	res->ttl_s = left / 1000;
+}
+
+/* The cached instances of type t with an address */
+static int mc_lookup(int t, struct mdns_cache_result *res, int max)
+{
+	uint32_t now = mc_now();
+	const struct mc_entry *e;
+	int i, n = 0;
+
+	for (i = 0; i < MDNS_CACHE_SIZE && n < max; i++) {
+		e = &mc_cache[i];
+		if (e->used && e->type == t && mc_live(&e->ptr, now) &&
+		    mc_live(&e->srv, now) && mc_live(&e->a, now))
+			mc_result(e, &res[n++], now);
+	}
+	return n;
+}
+
+int mdns_cache_resolve(const char *type, uint32_t timeout_ms,
+		       struct mdns_cache_result *res)
+{
+	uint32_t start, elapsed, next = 1000, interval = 1000;
+	int t, found;
+
+	if (mc_sock < 0)
+		return -WM_FAIL;
+	os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+	t = mc_add_type(type);
+	if (t < 0) {
+		os_mutex_put(&mc_lock);
+		return t;
+	}
+	found = mc_lookup(t, res, 1);
+	if (found) {
+		mc_stats.hits++;
+	} else {
+		mc_stats.misses++;
+		mc_request(t, mc_now());
+	}
+	os_mutex_put(&mc_lock);
+
+	start = mc_now();
+	while (!found && (elapsed = mc_now() - start) < timeout_ms) {
+		os_thread_sleep(os_msec_to_ticks(MDNS_CACHE_BATCH_MS));
+		os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+		found = mc_lookup(t, res, 1);
+		if (!found && elapsed >= next) {
+			interval *= 2;
+			next += interval;
+			mc_request(t, mc_now());
+		}
+		os_mutex_put(&mc_lock);
+	}
+	return found ? WM_SUCCESS : -WM_E_TIMEOUT;
+}
+
+int mdns_cache_browse(const char *type, struct mdns_cache_result *res,
+		      int max)
+{
+	int t, n = 0;
+
+	if (mc_sock < 0)
+		return 0;
+	os_mutex_get(&mc_lock, OS_WAIT_FOREVER);
+	t = mc_find_type(type);
+	if (t >= 0)
+		n = mc_lookup(t, res, max);
+	os_mutex_put(&mc_lock);
+	return n;
+}
+
+void mdns_cache_get_stats(struct mdns_cache_stats *stats)
+{
+	*stats = mc_stats;
+}
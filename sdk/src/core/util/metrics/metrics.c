@@ -0,0 +1,335 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * A report takes the values of all the metrics into cur, the values of the
+ * last report sent are in base. The deltas are cur - base, in unsigned 32
+ * bit arithmetic so that counters may wrap. Committing copies cur to base.
+ * Values the registry keeps are single words, updated with the syscall
+ * interrupts masked so that interrupt handlers can update them too.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <work_svc.h>
+#include <metrics.h>
+
+#define metrics_w(...) wmlog_w("metrics", ##__VA_ARGS__)
+
+enum {
+	METRICS_COUNTER,
+	METRICS_GAUGE,
+	METRICS_HISTOGRAM,
+};
+
+struct metric {
+	const char *name;
+	metrics_read_t read;
+	void *ctx;
+	const uint32_t *bounds;
+	uint8_t type;
+	/* Histograms, their buckets in metrics_buckets */
+	uint8_t first;
+	uint8_t n_buckets;
+	/* Counters and gauges the registry keeps */
+	uint32_t value;
+	uint32_t cur;
+	uint32_t base;
+};
+
+static struct metric metrics_table[METRICS_MAX];
+static int metrics_cnt;
+static uint32_t metrics_buckets[METRICS_MAX_BUCKETS];
+static uint32_t metrics_buckets_cur[METRICS_MAX_BUCKETS];
+static uint32_t metrics_buckets_base[METRICS_MAX_BUCKETS];
+static int metrics_bucket_cnt;
+
+/* Metrics the last report took */
+static int metrics_taken;
+static unsigned metrics_cur_ticks, metrics_base_ticks;
+/* Reports committed */
+static uint32_t metrics_seq;
+
+static struct {
+	work_t work;
+	char *buf;
+	int size;
+	metrics_send_t send;
+	void *ctx;
+	bool running;
+} metrics_reporter;
+
+static int metrics_register(const char *name, uint8_t type,
+			    metrics_read_t read, void *ctx,
+			    const uint32_t *bounds, int n)
+{
+	unsigned long state;
+	struct metric *m;
+	int id;
+
+	state = os_mask_syscall_interrupts();
+	if (metrics_cnt == METRICS_MAX ||
+	    (bounds && metrics_bucket_cnt + n + 1 > METRICS_MAX_BUCKETS)) {
+		os_unmask_syscall_interrupts(state);
+		return -WM_E_NOSPC;
+	}
+	id = metrics_cnt;
+	m = &metrics_table[id];
+	m->name = name;
+	m->type = type;
+	m->read = read;
+	m->ctx = ctx;
+	if (bounds) {
+		m->bounds = bounds;
+		m->first = metrics_bucket_cnt;
+		m->n_buckets = n + 1;
+		metrics_bucket_cnt += n + 1;
+	}
+	metrics_cnt++;
+	os_unmask_syscall_interrupts(state);
+	return id;
+}
+
+int metrics_counter(const char *name, metrics_read_t read, void *ctx)
+{
+	if (!name)
+		return -WM_E_INVAL;
+	return metrics_register(name, METRICS_COUNTER, read, ctx, NULL, 0);
+}
+
+int metrics_gauge(const char *name, metrics_read_t read, void *ctx)
+{
+	if (!name)
+		return -WM_E_INVAL;
+	return metrics_register(name, METRICS_GAUGE, read, ctx, NULL, 0);
+}
+
+int metrics_histogram(const char *name, const uint32_t *bounds, int n)
+{
+	if (!name || !bounds || n < 1)
+		return -WM_E_INVAL;
+	return metrics_register(name, METRICS_HISTOGRAM, NULL, NULL, bounds,
+				n);
+}
+
+static struct metric *metrics_kept(int id, uint8_t type)
+{
+	struct metric *m;
+
+	if (id < 0 || id >= metrics_cnt)
+		return NULL;
+	m = &metrics_table[id];
+	return (m->type == type && !m->read) ? m : NULL;
+}
+
+void metrics_add(int id, uint32_t n)
+{
+	struct metric *m = metrics_kept(id, METRICS_COUNTER);
+	unsigned long state;
+
+	if (!m)
+		return;
+	state = os_mask_syscall_interrupts();
+	m->value += n;
+	os_unmask_syscall_interrupts(state);
+}
+
+void metrics_set(int id, int32_t val)
+{
+	struct metric *m = metrics_kept(id, METRICS_GAUGE);
+
+	if (m)
+		m->value = (uint32_t)val;
+}
+
+void metrics_observe(int id, uint32_t val)
+{
+	struct metric *m = metrics_kept(id, METRICS_HISTOGRAM);
+	unsigned long state;
+	int i;
+
+	if (!m)
+		return;
+	for (i = 0; i < m->n_buckets - 1; i++)
+		if (val < m->bounds[i])
+			break;
+	state = os_mask_syscall_interrupts();
+	metrics_buckets[m->first + i]++;
+	os_unmask_syscall_interrupts(state);
+}
+
+static void metrics_take(void)
+{
+	unsigned long state;
+	struct metric *m;
+	int i;
+
+	metrics_taken = metrics_cnt;
+	for (i = 0; i < metrics_taken; i++) {
+		m = &metrics_table[i];
+		if (m->type == METRICS_HISTOGRAM) {
+			state = os_mask_syscall_interrupts();
+			memcpy(&metrics_buckets_cur[m->first],
+			       &metrics_buckets[m->first],
+			       m->n_buckets * sizeof(uint32_t));
+			os_unmask_syscall_interrupts(state);
+		} else if (m->read) {
+			m->cur = m->read(m->ctx);
+		} else {
+			m->cur = m->value;
+		}
+	}
+	metrics_cur_ticks = os_ticks_get();
+}
+
+static bool metrics_changed(const struct metric *m)
+{
+	int i;
+
+	if (m->type != METRICS_HISTOGRAM)
+		return m->cur != m->base;
+	for (i = m->first; i < m->first + m->n_buckets; i++)
+		if (metrics_buckets_cur[i] != metrics_buckets_base[i])
+			return true;
+	return false;
+}
+
+static void metrics_json_one(struct json_writer *w, const struct metric *m,
+			     bool full)
+{
+	uint32_t base;
+	int i;
+
+	switch (m->type) {
+	case METRICS_COUNTER:
+		json_writer_add_uint(w, m->name,
+				     full ? m->cur : m->cur - m->base);
+		break;
+	case METRICS_GAUGE:
+		json_writer_add_int(w, m->name, (int32_t)m->cur);
+		break;
+	case METRICS_HISTOGRAM:
+		json_writer_start_array(w, m->name);
+		for (i = m->first; i < m->first + m->n_buckets; i++) {
+			base = full ? 0 : metrics_buckets_base[i];
+			json_writer_add_uint(w, NULL,
+					     metrics_buckets_cur[i] - base);
+		}
+		json_writer_end_array(w);
+		break;
+	}
+}
+
+/* The metrics of a type that are reported, in an object left out when
+ * there are none */
+static void metrics_json_group(struct json_writer *w, const char *key,
+			       uint8_t type, bool full)
+{
+	const struct metric *m;
+	bool started = false;
+	int i;
+
+	for (i = 0; i < metrics_taken; i++) {
+		m = &metrics_table[i];
+		if (m->type != type || (!full && !metrics_changed(m)))
+			continue;
+		if (!started) {
+			json_writer_start_object(w, key);
+			started = true;
+		}
+		metrics_json_one(w, m, full);
+	}
+	if (started)
+		json_writer_end_object(w);
+}
+
+int metrics_report_json(struct json_writer *w, bool full)
+{
+	metrics_take();
+	/* Nothing was sent yet, there is no base */
+	if (!metrics_seq)
+		full = true;
+
+	json_writer_start_object(w, NULL);
+	json_writer_add_uint(w, "seq", metrics_seq);
+	if (metrics_seq)
+		json_writer_add_uint(w, "ms", os_ticks_to_msec(
+					     metrics_cur_ticks -
+					     metrics_base_ticks));
+	if (full)
+		json_writer_add_bool(w, "full", true);
+	metrics_json_group(w, "c", METRICS_COUNTER, full);
+	metrics_json_group(w, "g", METRICS_GAUGE, full);
+	metrics_json_group(w, "h", METRICS_HISTOGRAM, full);
+	return json_writer_end_object(w);
+}
+
+void metrics_report_commit(void)
+{
+	struct metric *m;
+	int i;
+
+	for (i = 0; i < metrics_taken; i++) {
+		m = &metrics_table[i];
+		if (m->type == METRICS_HISTOGRAM)
+			memcpy(&metrics_buckets_base[m->first],
+			       &metrics_buckets_cur[m->first],
+			       m->n_buckets * sizeof(uint32_t));
+		else
+			m->base = m->cur;
+	}
+	metrics_base_ticks = metrics_cur_ticks;
+	metrics_seq++;
+}
+
+static void metrics_report_job(work_t *work)
+{
+	struct json_writer w;
+	int len;
+
+	json_writer_init(&w, metrics_reporter.buf, metrics_reporter.size,
+			 NULL, NULL);
+	/* A full report that fails is tried again in full */
+	metrics_report_json(&w, metrics_seq % METRICS_FULL_EVERY == 0);
+	len = json_writer_finish(&w);
+	if (len < 0) {
+		metrics_w("report %u not written: %d", metrics_seq, len);
+		return;
+	}
+	if (metrics_reporter.send(metrics_reporter.buf, len,
+				  metrics_reporter.ctx) == WM_SUCCESS)
+		metrics_report_commit();
+}
+
+int metrics_report_start(uint32_t interval_ms, char *buf, int size,
+			 metrics_send_t send, void *ctx)
+{
+	if (metrics_reporter.running || !buf || !send || !interval_ms)
+		return -WM_E_INVAL;
+	if (work_svc_init() != WM_SUCCESS)
+		return -WM_FAIL;
+
+	metrics_reporter.buf = buf;
+	metrics_reporter.size = size;
+	metrics_reporter.send = send;
+	metrics_reporter.ctx = ctx;
+	work_init(&metrics_reporter.work, metrics_report_job, NULL,
+		  WORK_LANE_LOW);
+	if (work_submit_periodic(&metrics_reporter.work, interval_ms,
+				 interval_ms) != WM_SUCCESS)
+		return -WM_FAIL;
+	metrics_reporter.running = true;
+	return WM_SUCCESS;
+}
+
+void metrics_report_stop(void)
+{
+	if (!metrics_reporter.running)
+		return;
+	work_cancel(&metrics_reporter.work);
+	metrics_reporter.running = false;
+}
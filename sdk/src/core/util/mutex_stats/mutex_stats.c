@@ -0,0 +1,147 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The kernel keeps the counts in the mutexes, see uxQueueGetMutexStats() in
+ * queue.c. They are copied out with the scheduler suspended: a task holding
+ * a mutex can not be freed meanwhile, its name is copied along.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <mutex_stats.h>
+
+/* Command table entry of the cli in libwmsdk */
+struct cli_command {
+	const char *name;
+	const char *help;
+	void (*function) (int argc, char **argv);
+};
+
+int cli_register_commands(const struct cli_command *commands,
+			  int num_commands);
+
+#if configUSE_MUTEX_STATS == 1
+static void mutex_stats_fill(struct mutex_stats_entry *e,
+			     const MutexStats_t *s)
+{
+	memset(e, 0, sizeof(*e));
+	strncpy(e->name, s->pcName ? s->pcName : "-",
+		MUTEX_STATS_NAME_LEN - 1);
+	if (s->pvHolder)
+		strncpy(e->owner, pcTaskGetTaskName(s->pvHolder),
+			MUTEX_STATS_NAME_LEN - 1);
+	e->takes = s->ulTakes;
+	e->contended = s->ulContended;
+	e->timeouts = s->ulTimeouts;
+	e->inversions = s->ulInversions;
+	e->wait_ms = os_ticks_to_msec(s->xWaitTicks);
+	e->max_wait_ms = os_ticks_to_msec(s->xMaxWaitTicks);
+}
+
+int mutex_stats_get(struct mutex_stats_entry *entries, int max)
+{
+	MutexStats_t *stats;
+	UBaseType_t n, i;
+
+	if (max <= 0)
+		return 0;
+	stats = os_mem_alloc(max * sizeof(*stats));
+	if (!stats)
+		return 0;
+
+	vTaskSuspendAll();
+	n = uxQueueGetMutexStats(stats, max);
+	for (i = 0; i < n; i++)
+		mutex_stats_fill(&entries[i], &stats[i]);
+	xTaskResumeAll();
+
+	os_mem_free(stats);
+	return n;
+}
+
+void mutex_stats_reset(void)
+{
+	vQueueResetMutexStats();
+}
+#else
+int mutex_stats_get(struct mutex_stats_entry *entries, int max)
+{
+	return 0;
+}
+
+void mutex_stats_reset(void)
+{
+}
+#endif /* configUSE_MUTEX_STATS */
+
+int mutex_stats_find(const char *name, struct mutex_stats_entry *entry)
+{
+	struct mutex_stats_entry *entries;
+	int i, n, ret = -WM_E_INVAL;
+
+	entries = os_mem_alloc(MUTEX_STATS_MAX_MUTEXES * sizeof(*entries));
+	if (!entries)
+		return -WM_E_NOMEM;
+	n = mutex_stats_get(entries, MUTEX_STATS_MAX_MUTEXES);
+	for (i = 0; i < n; i++)
+		if (!strcmp(entries[i].name, name)) {
+			*entry = entries[i];
+			ret = WM_SUCCESS;
+			break;
+		}
+	os_mem_free(entries);
+	return ret;
+}
+
+void mutex_stats_print(void)
+{
+	struct mutex_stats_entry *entries, *e;
+	int i, n;
+
+	entries = os_mem_alloc(MUTEX_STATS_MAX_MUTEXES * sizeof(*entries));
+	if (!entries)
+		return;
+	n = mutex_stats_get(entries, MUTEX_STATS_MAX_MUTEXES);
+	if (!n)
+		wmprintf("No mutex counts, build with FREERTOS_MUTEX_STATS=y\r\n");
+	else
+		wmprintf("%-16s %-8s %-9s %-8s %-10s %-8s %-6s owner\r\n",
+			 "mutex", "takes", "contended", "timeouts",
+			 "inversions", "wait_ms", "max_ms");
+	for (i = 0; i < n; i++) {
+		e = &entries[i];
+		wmprintf("%-16s %-8u %-9u %-8u %-10u %-8u %-6u %s\r\n",
+			 e->name, e->takes, e->contended, e->timeouts,
+			 e->inversions, e->wait_ms, e->max_wait_ms,
+			 e->owner[0] ? e->owner : "-");
+	}
+	os_mem_free(entries);
+}
+
+static void mutex_stats_cli(int argc, char **argv)
+{
+	if (argc >= 2 && !strcmp(argv[1], "reset"))
+		mutex_stats_reset();
+	else if (argc == 1)
+		mutex_stats_print();
+	else
+		wmprintf("Usage: mutex-stats [reset]\r\n");
+}
+
+static const struct cli_command mutex_stats_commands[] = {
+	{"mutex-stats", "[reset]", mutex_stats_cli},
+};
+
+int mutex_stats_cli_init(void)
+{
+	if (cli_register_commands(mutex_stats_commands,
+				  sizeof(mutex_stats_commands) /
+				  sizeof(mutex_stats_commands[0])))
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
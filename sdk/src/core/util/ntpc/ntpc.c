@@ -0,0 +1,278 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <wmtime.h>
+#include <ntpc.h>
+
+#define ntpc_w(...) wmlog_w("ntpc", ##__VA_ARGS__)
+
+#define NTP_PORT 123
+/* Seconds from 1900, the NTP epoch, to 1970 */
+#define NTP_EPOCH_OFFSET 2208988800ULL
+#define NTP_PACKET_LEN 48
+/* Version 4, client */
+#define NTP_REQUEST 0x23
+#define NTP_MODE_SERVER 4
+#define NTP_LI_UNSYNC 3
+
+/* Slack added to the delays when replies are compared */
+#define NTPC_TOLERANCE_MS 20
+
+enum ntpc_state {
+	NTPC_UNUSED,
+	NTPC_SENT,
+	NTPC_REPLIED,
+};
+
+struct ntpc_server {
+	struct sockaddr_in addr;
+	enum ntpc_state state;
+	/* Transmit timestamp of the request, echoed by the server */
+	uint32_t nonce[2];
+	/* os_get_timestamp() when the request was sent */
+	uint32_t sent_us;
+	int64_t offset_ms;
+	uint32_t delay_ms;
+};
+
+static struct ntpc_server ntpc_servers[NTPC_MAX_SERVERS];
+/* Room for the extension fields and the MAC a server may add */
+static uint32_t ntpc_buf[17];
+
+/* The local clock during a sync: the second of wmtime at base_us, and
+ * os_get_timestamp() for the time since */
+static int64_t ntpc_base_ms;
+static uint32_t ntpc_base_us;
+
+static int64_t ntpc_local_ms(uint32_t us)
+{
+	return ntpc_base_ms + (us - ntpc_base_us) / 1000;
+}
+
+/* A timestamp of a reply in ms since 1970 */
+static int64_t ntpc_ts_ms(const uint32_t *ts)
+{
+	uint64_t s = ntohl(ts[0]);
+
+	/* Era 1 starts in 2036 */
+	if (s < 0x80000000)
+		s += 1ULL << 32;
+	return (int64_t) (s - NTP_EPOCH_OFFSET) * 1000 +
+		(int64_t) (((uint64_t) ntohl(ts[1]) * 1000) >> 32);
+}
+
+static void ntpc_send(int sock, struct ntpc_server *s)
+{
+	uint32_t now = os_get_timestamp();
+
+	memset(ntpc_buf, 0, NTP_PACKET_LEN);
+	((uint8_t *) ntpc_buf)[0] = NTP_REQUEST;
+	/* Not a time, only matched against the reply */
+	s->nonce[0] = htonl((uint32_t) ntpc_local_ms(now));
+	s->nonce[1] = htonl(now ^ ntohl(s->addr.sin_addr.s_addr));
+	ntpc_buf[10] = s->nonce[0];
+	ntpc_buf[11] = s->nonce[1];
+	s->sent_us = now;
+	s->state = NTPC_SENT;
+	if (sendto(sock, ntpc_buf, NTP_PACKET_LEN, 0,
+		   (struct sockaddr *) &s->addr, sizeof(s->addr)) < 0)
+		ntpc_w("Send to %s failed", inet_ntoa(s->addr.sin_addr));
+}
+
+static int ntpc_resolve(const char *const servers[], int count)
+{
+	struct hostent *h;
+	struct in_addr a;
+	int i, j, n = 0;
+
+	for (i = 0; i < count && n < NTPC_MAX_SERVERS; i++) {
+		h = gethostbyname(servers[i]);
+		if (!h) {
+			ntpc_w("Can not resolve %s", servers[i]);
+			continue;
+		}
+		memcpy(&a, h->h_addr, sizeof(a));
+		/* Names of a pool may give the same server */
+		for (j = 0; j < n; j++)
+			if (ntpc_servers[j].addr.sin_addr.s_addr == a.s_addr)
+				break;
+		if (j < n)
+			continue;
+		memset(&ntpc_servers[n], 0, sizeof(ntpc_servers[n]));
+		ntpc_servers[n].addr.sin_family = AF_INET;
+		ntpc_servers[n].addr.sin_port = htons(NTP_PORT);
+		ntpc_servers[n].addr.sin_addr = a;
+		n++;
+	}
+	return n;
+}
+
+static void ntpc_receive(int sock, int n)
+{
+	struct sockaddr_in from;
+	socklen_t len = sizeof(from);
+	const uint8_t *b = (const uint8_t *) ntpc_buf;
+	struct ntpc_server *s;
+	int64_t t1, t2, t3, t4;
+	int rv, i;
+
+	rv = recvfrom(sock, ntpc_buf, sizeof(ntpc_buf), 0,
+		      (struct sockaddr *) &from, &len);
+	t4 = ntpc_local_ms(os_get_timestamp());
+	if (rv < NTP_PACKET_LEN)
+		return;
+
+	for (i = 0; i < n; i++) {
+		s = &ntpc_servers[i];
+		if (s->state == NTPC_SENT &&
+		    s->addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+		    ntpc_buf[6] == s->nonce[0] && ntpc_buf[7] == s->nonce[1])
+			break;
+	}
+	if (i == n)
+		return;
+	if ((b[0] & 0x7) != NTP_MODE_SERVER || b[0] >> 6 == NTP_LI_UNSYNC ||
+	    b[1] == 0 || b[1] > 15 || !ntpc_buf[10]) {
+		ntpc_w("%s is not synchronized", inet_ntoa(s->addr.sin_addr));
+		s->state = NTPC_UNUSED;
+		return;
+	}
+
+	t1 = ntpc_local_ms(s->sent_us);
+	t2 = ntpc_ts_ms(&ntpc_buf[8]);
+	t3 = ntpc_ts_ms(&ntpc_buf[10]);
+	s->offset_ms = ((t2 - t1) + (t3 - t4)) / 2;
+	s->delay_ms = (t4 - t1) - (t3 - t2) > 0 ? (t4 - t1) - (t3 - t2) : 0;
+	s->state = NTPC_REPLIED;
+}
+
+static bool ntpc_pending(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (ntpc_servers[i].state == NTPC_SENT)
+			return true;
+	return false;
+}
+
+/* The reply with the shortest delay, and the replies which agree with it */
+static struct ntpc_server *ntpc_filter(int n, int *replies, int *agree)
+{
+	struct ntpc_server *best = NULL;
+	int64_t d;
+	int i;
+
+	*replies = *agree = 0;
+	for (i = 0; i < n; i++) {
+		if (ntpc_servers[i].state != NTPC_REPLIED)
+			continue;
+		(*replies)++;
+		if (!best || ntpc_servers[i].delay_ms < best->delay_ms)
+			best = &ntpc_servers[i];
+	}
+	if (!best)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		if (ntpc_servers[i].state != NTPC_REPLIED)
+			continue;
+		d = ntpc_servers[i].offset_ms - best->offset_ms;
+		if ((d < 0 ? -d : d) <= (ntpc_servers[i].delay_ms +
+					 best->delay_ms) / 2 +
+		    NTPC_TOLERANCE_MS)
+			(*agree)++;
+	}
+	return best;
+}
+
+int ntpc_sync(const char *const servers[], int count, uint32_t timeout_ms,
+	      struct ntpc_result *res)
+{
+	struct ntpc_server *best = NULL;
+	struct timeval tv;
+	fd_set readfds;
+	uint32_t start, elapsed, wait;
+	bool resent = false;
+	int sock, n, i, rv, replies = 0, agree = 0, quorum;
+
+	if (!servers || count <= 0)
+		return -WM_E_INVAL;
+
+	n = ntpc_resolve(servers, count);
+	if (!n)
+		return -WM_E_NOENT;
+	quorum = n < NTPC_QUORUM ? n : NTPC_QUORUM;
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0)
+		return -WM_FAIL;
+
+	ntpc_base_us = start = os_get_timestamp();
+	ntpc_base_ms = (int64_t) wmtime_time_get_posix() * 1000;
+	for (i = 0; i < n; i++)
+		ntpc_send(sock, &ntpc_servers[i]);
+
+	for (;;) {
+		elapsed = (os_get_timestamp() - start) / 1000;
+		if (elapsed >= timeout_ms)
+			break;
+		wait = (resent ? timeout_ms : timeout_ms / 2) - elapsed;
+		if (!resent && elapsed >= timeout_ms / 2)
+			wait = 0;
+
+		FD_ZERO(&readfds);
+		FD_SET(sock, &readfds);
+		tv.tv_sec = wait / 1000;
+		tv.tv_usec = wait % 1000 * 1000;
+		rv = select(sock + 1, &readfds, NULL, NULL, &tv);
+		if (rv < 0)
+			break;
+		if (rv == 0) {
+			/* Requests or replies may have been lost */
+			if (!resent) {
+				for (i = 0; i < n; i++)
+					if (ntpc_servers[i].state == NTPC_SENT)
+						ntpc_send(sock,
+							  &ntpc_servers[i]);
+				resent = true;
+			}
+			continue;
+		}
+
+		ntpc_receive(sock, n);
+		best = ntpc_filter(n, &replies, &agree);
+		if ((best && agree >= quorum) || !ntpc_pending(n))
+			break;
+	}
+	close(sock);
+
+	if (!best) {
+		ntpc_w("No reply from the servers");
+		return -WM_E_TIMEOUT;
+	}
+	if (agree < quorum)
+		ntpc_w("Only %d of %d replies agree", agree, replies);
+
+	wmtime_time_set_posix((ntpc_local_ms(os_get_timestamp()) +
+			       best->offset_ms) / 1000);
+	if (res) {
+		res->offset_ms = best->offset_ms;
+		res->delay_ms = best->delay_ms;
+		res->replies = replies;
+		res->agree = agree;
+		res->took_ms = (os_get_timestamp() - start) / 1000;
+		res->time_ms = ntpc_local_ms(os_get_timestamp()) +
+			best->offset_ms;
+	}
+	return WM_SUCCESS;
+}
@@ -0,0 +1,458 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include <flash_async.h>
+#include <cpu_clk.h>
+#include <sha256.h>
+#include <ota.h>
+#include "ota_delta.h"
+
+#define ota_e(...) wmlog_e("ota", ##__VA_ARGS__)
+#define ota_l(...) wmlog("ota", ##__VA_ARGS__)
+
+/* Partitions and the XZ decoder, in the SDK library */
+struct partition_entry;
+struct partition_entry *rfget_get_passive_firmware(void);
+struct partition_entry *part_get_active_partition_by_name(const char *name,
+							 short *start_index);
+void part_to_flash_desc(struct partition_entry *p, flash_desc_t *f);
+int part_set_active_partition(struct partition_entry *p);
+
+struct xz_buf {
+	const uint8_t *in;
+	size_t in_pos;
+	size_t in_size;
+	uint8_t *out;
+	size_t out_pos;
+	size_t out_size;
+};
+
+enum xz_mode { XZ_SINGLE, XZ_PREALLOC, XZ_DYNALLOC };
+enum xz_ret {
+	XZ_OK,
+	XZ_STREAM_END,
+	XZ_UNSUPPORTED_CHECK,
+	XZ_MEM_ERROR,
+	XZ_MEMLIMIT_ERROR,
+	XZ_FORMAT_ERROR,
+	XZ_OPTIONS_ERROR,
+	XZ_DATA_ERROR,
+	XZ_BUF_ERROR,
+};
+
+struct xz_dec;
+void xz_crc32_init(void);
+struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max);
+enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b);
+void xz_dec_end(struct xz_dec *s);
+
+/* Decrypted input is processed this many bytes at a time */
+#define OTA_IN_SIZE 256
+
+struct ota_chacha {
+	uint32_t state[16];
+	uint8_t stream[64];
+	/* Bytes of stream used */
+	uint32_t pos;
+};
+
+struct ota_update {
+	struct ota_cfg cfg;
+	uint8_t sha256[OTA_SHA256_LEN];
+	struct partition_entry *part;
+	flash_desc_t fl;
+	mdev_t *dev;
+	bool encrypted;
+	struct xz_dec *xz;
+	bool xz_end;
+	bool delta;
+	struct ota_delta patch;
+	struct sha256_ctx hash;
+	struct ota_chacha chacha;
+	/* Image bytes queued to flash, and erased */
+	uint32_t queued;
+	uint32_t erased;
+	/* Buffer being filled, and its length */
+	int cur;
+	uint32_t fill;
+	/* First error of a flash operation */
+	volatile int flash_err;
+	uint32_t received;
+	uint32_t start_us;
+	uint32_t took_ms;
+	bool active;
+};
+
+static struct ota_update ota;
+static uint8_t ota_buf[2][OTA_BUF_SIZE];
+static uint8_t ota_in[OTA_IN_SIZE];
+/* The patch out of the XZ decoder */
+static uint8_t ota_dec[OTA_IN_SIZE];
+/* Buffers not being written */
+static os_semaphore_t ota_free;
+
+/* ChaCha20, RFC 7539 */
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static uint32_t ota_le32(const uint8_t *p)
+{
+	return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+		(uint32_t) p[3] << 24;
+}
+
+#define QR(a, b, c, d)				\
+	do {					\
+		a += b; d ^= a; d = ROL(d, 16);	\
+		c += d; b ^= c; b = ROL(b, 12);	\
+		a += b; d ^= a; d = ROL(d, 8);	\
+		c += d; b ^= c; b = ROL(b, 7);	\
+	} while (0)
+
+static void ota_chacha_init(struct ota_chacha *c, const uint8_t *key,
+			    const uint8_t *nonce)
+{
+	int i;
+
+	c->state[0] = 0x61707865;
+	c->state[1] = 0x3320646e;
+	c->state[2] = 0x79622d32;
+	c->state[3] = 0x6b206574;
+	for (i = 0; i < 8; i++)
+		c->state[4 + i] = ota_le32(key + 4 * i);
+	c->state[12] = 0;
+	for (i = 0; i < 3; i++)
+		c->state[13 + i] = ota_le32(nonce + 4 * i);
+	c->pos = sizeof(c->stream);
+}
+
+static void ota_chacha_block(struct ota_chacha *c)
+{
+	uint32_t x[16];
+	int i;
+
+	memcpy(x, c->state, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		QR(x[0], x[4], x[8], x[12]);
+		QR(x[1], x[5], x[9], x[13]);
+		QR(x[2], x[6], x[10], x[14]);
+		QR(x[3], x[7], x[11], x[15]);
+		QR(x[0], x[5], x[10], x[15]);
+		QR(x[1], x[6], x[11], x[12]);
+		QR(x[2], x[7], x[8], x[13]);
+		QR(x[3], x[4], x[9], x[14]);
+	}
+	for (i = 0; i < 16; i++) {
+		x[i] += c->state[i];
+		c->stream[4 * i] = x[i];
+		c->stream[4 * i + 1] = x[i] >> 8;
+		c->stream[4 * i + 2] = x[i] >> 16;
+		c->stream[4 * i + 3] = x[i] >> 24;
+	}
+	c->state[12]++;
+	c->pos = 0;
+}
+
+static void ota_chacha_xor(struct ota_chacha *c, const uint8_t *in,
+			   uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		if (c->pos == sizeof(c->stream))
+			ota_chacha_block(c);
+		out[i] = in[i] ^ c->stream[c->pos++];
+	}
+}
+
+/* Writing the image */
+
+static void ota_write_done(int result, void *arg)
+{
+	if (result != WM_SUCCESS && ota.flash_err == WM_SUCCESS)
+		ota.flash_err = result;
+	os_semaphore_put(&ota_free);
+}
+
+static void ota_erase_done(int result, void *arg)
+{
+	if (result != WM_SUCCESS && ota.flash_err == WM_SUCCESS)
+		ota.flash_err = result;
+}
+
+/* Queue the buffer being filled and wait for the other one */
+static int ota_queue(void)
+{
+	uint32_t len = ota.fill, end;
+	uint8_t *buf = ota_buf[ota.cur];
+
+	if (!len)
+		return WM_SUCCESS;
+	if (ota.flash_err != WM_SUCCESS)
+		return -WM_FAIL;
+	if (ota.queued + len > ota.fl.fl_size)
+		return -WM_E_NOSPC;
+
+	sha256_update(&ota.hash, buf, len);
+	/* Sectors are erased as the image reaches them */
+	end = ota.queued + len;
+	if (end > ota.erased) {
+		end = (end + FLASH_ASYNC_SECTOR_SIZE - 1) &
+			~(FLASH_ASYNC_SECTOR_SIZE - 1);
+		if (end > ota.fl.fl_size)
+			end = ota.fl.fl_size;
+		flash_async_erase(ota.dev, ota.fl.fl_start + ota.erased,
+				  end - ota.erased, ota_erase_done, NULL);
+		ota.erased = end;
+	}
+	flash_async_write(ota.dev, buf, len, ota.fl.fl_start + ota.queued,
+			  ota_write_done, NULL);
+	ota.queued += len;
+
+	ota.cur ^= 1;
+	ota.fill = 0;
+	os_semaphore_get(&ota_free, OS_WAIT_FOREVER);
+	return WM_SUCCESS;
+}
+
+static int ota_output(const uint8_t *p, uint32_t len)
+{
+	uint32_t n;
+	int ret;
+
+	while (len) {
+		n = OTA_BUF_SIZE - ota.fill;
+		if (n > len)
+			n = len;
+		memcpy(ota_buf[ota.cur] + ota.fill, p, n);
+		ota.fill += n;
+		p += n;
+		len -= n;
+		if (ota.fill == OTA_BUF_SIZE) {
+			ret = ota_queue();
+			if (ret != WM_SUCCESS)
+				return ret;
+		}
+	}
+	return WM_SUCCESS;
+}
+
+/* The image, or the patch it is made from */
+static int ota_image(const uint8_t *p, uint32_t len)
+{
+	if (ota.delta)
+		return ota_delta_feed(&ota.patch, p, len);
+	return ota_output(p, len);
+}
+
+/* Patches are decompressed to ota_dec, images straight to the buffer */
+static int ota_decompress(const uint8_t *p, uint32_t len)
+{
+	struct xz_buf b = { .in = p, .in_size = len };
+	enum xz_ret r;
+	int ret;
+
+	if (ota.xz_end)
+		return len ? -WM_E_INVAL : WM_SUCCESS;
+
+	while (b.in_pos < b.in_size) {
+		if (ota.delta) {
+			b.out = ota_dec;
+			b.out_pos = 0;
+			b.out_size = sizeof(ota_dec);
+		} else {
+			b.out = ota_buf[ota.cur];
+			b.out_pos = ota.fill;
+			b.out_size = OTA_BUF_SIZE;
+		}
+		r = xz_dec_run(ota.xz, &b);
+		if (ota.delta) {
+			ret = ota_delta_feed(&ota.patch, ota_dec, b.out_pos);
+			if (ret != WM_SUCCESS)
+				return ret;
+		} else {
+			ota.fill = b.out_pos;
+		}
+		if (r == XZ_STREAM_END) {
+			ota.xz_end = true;
+			/* Nothing may follow the stream */
+			return b.in_pos == b.in_size ? WM_SUCCESS :
+				-WM_E_INVAL;
+		}
+		if (r != XZ_OK) {
+			ota_e("XZ stream error %d", r);
+			return r == XZ_MEM_ERROR ? -WM_E_NOMEM : -WM_E_INVAL;
+		}
+		if (!ota.delta && ota.fill == OTA_BUF_SIZE) {
+			ret = ota_queue();
+			if (ret != WM_SUCCESS)
+				return ret;
+		}
+	}
+	return WM_SUCCESS;
+}
+
+static void ota_end(void)
+{
+	/* The flash thread may still use the buffers */
+	flash_async_flush();
+	if (ota.xz)
+		xz_dec_end(ota.xz);
+	ota.xz = NULL;
+	os_semaphore_delete(&ota_free);
+	ota.took_ms = (os_get_timestamp() - ota.start_us) / 1000;
+	ota.active = false;
+	cpu_clk_boost_end();
+}
+
+int ota_begin(const struct ota_cfg *cfg)
+{
+	static bool crc_ready;
+
+	if (!cfg || !cfg->sha256 || (cfg->key && !cfg->nonce))
+		return -WM_E_INVAL;
+	if (ota.active)
+		return -WM_E_BUSY;
+
+	memset(&ota, 0, sizeof(ota));
+	ota.part = rfget_get_passive_firmware();
+	if (!ota.part)
+		return -WM_E_NOENT;
+	part_to_flash_desc(ota.part, &ota.fl);
+	ota.dev = flash_drv_open(ota.fl.fl_dev);
+	if (!ota.dev || flash_async_init() != WM_SUCCESS)
+		return -WM_FAIL;
+
+	if (cfg->delta) {
+		struct partition_entry *old;
+		flash_desc_t fl;
+		short i = 0;
+
+		old = part_get_active_partition_by_name(OTA_FW_PART, &i);
+		if (!old)
+			return -WM_E_NOENT;
+		part_to_flash_desc(old, &fl);
+		ota_delta_init(&ota.patch, flash_drv_open(fl.fl_dev),
+			       fl.fl_start, fl.fl_size, ota_output);
+		if (!ota.patch.dev)
+			return -WM_FAIL;
+		ota.delta = true;
+	}
+
+	if (cfg->xz) {
+		if (!crc_ready) {
+			xz_crc32_init();
+			crc_ready = true;
+		}
+		ota.xz = xz_dec_init(XZ_DYNALLOC, OTA_XZ_DICT_MAX);
+		if (!ota.xz)
+			return -WM_E_NOMEM;
+	}
+	/* One buffer is filled, the other one is free */
+	if (os_semaphore_create_counting(&ota_free, "ota-free", 2, 1)
+	    != WM_SUCCESS) {
+		if (ota.xz)
+			xz_dec_end(ota.xz);
+		return -WM_FAIL;
+	}
+
+	ota.cfg = *cfg;
+	memcpy(ota.sha256, cfg->sha256, OTA_SHA256_LEN);
+	ota.cfg.sha256 = ota.sha256;
+	if (cfg->key) {
+		ota_chacha_init(&ota.chacha, cfg->key, cfg->nonce);
+		ota.encrypted = true;
+	}
+	ota.cfg.key = ota.cfg.nonce = NULL;
+	sha256_init(&ota.hash);
+	ota.start_us = os_get_timestamp();
+	ota.active = true;
+	/* Hashing, decrypting and decompressing run at full speed */
+	cpu_clk_boost_begin();
+	ota_l("Writing to 0x%x, %u bytes", ota.fl.fl_start, ota.fl.fl_size);
+	return WM_SUCCESS;
+}
+
+int ota_write(const uint8_t *data, uint32_t len)
+{
+	const uint8_t *p;
+	uint32_t n;
+	int ret;
+
+	if (!ota.active)
+		return -WM_FAIL;
+
+	ota.received += len;
+	while (len) {
+		n = len < OTA_IN_SIZE ? len : OTA_IN_SIZE;
+		p = data;
+		if (ota.encrypted) {
+			ota_chacha_xor(&ota.chacha, data, ota_in, n);
+			p = ota_in;
+		}
+		if (ota.xz)
+			ret = ota_decompress(p, n);
+		else
+			ret = ota_image(p, n);
+		if (ret != WM_SUCCESS)
+			return ret;
+		data += n;
+		len -= n;
+	}
+	return WM_SUCCESS;
+}
+
+int ota_finish(void)
+{
+	uint8_t digest[OTA_SHA256_LEN];
+	int ret;
+
+	if (!ota.active)
+		return -WM_FAIL;
+
+	if ((ota.xz && !ota.xz_end) ||
+	    (ota.delta && !ota_delta_done(&ota.patch)))
+		ret = -WM_E_INVAL;
+	else
+		ret = ota_queue();
+	ota_end();
+	if (ret == WM_SUCCESS && ota.flash_err != WM_SUCCESS)
+		ret = -WM_FAIL;
+	if (ret != WM_SUCCESS) {
+		ota_e("Update failed: %d", ret);
+		return ret;
+	}
+
+	sha256_final(&ota.hash, digest);
+	if (memcmp(digest, ota.sha256, sizeof(digest))) {
+		ota_e("Digest of the image does not match");
+		return -WM_E_CRC;
+	}
+	if (part_set_active_partition(ota.part) != WM_SUCCESS)
+		return -WM_FAIL;
+
+	ota_l("%u bytes received, %u written in %u ms", ota.received,
+	      ota.queued, ota.took_ms);
+	return WM_SUCCESS;
+}
+
+void ota_abort(void)
+{
+	if (ota.active)
+		ota_end();
+}
+
+void ota_get_stats(struct ota_stats *stats)
+{
+	stats->received = ota.received;
+	stats->written = ota.queued;
+	stats->took_ms = ota.active ?
+		(os_get_timestamp() - ota.start_us) / 1000 : ota.took_ms;
+}
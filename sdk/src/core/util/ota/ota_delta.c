@@ -0,0 +1,145 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wmerrno.h>
+#include <flash.h>
+#include "ota_delta.h"
+
+static uint8_t ota_delta_old[OTA_DELTA_OLD_SIZE];
+
+static int64_t ota_delta_offtin(const uint8_t *b)
+{
+	int64_t y = b[7] & 0x7f;
+	int i;
+
+	for (i = 6; i >= 0; i--)
+		y = y * 256 + b[i];
+	return b[7] & 0x80 ? -y : y;
+}
+
+void ota_delta_init(struct ota_delta *d, mdev_t *dev, uint32_t old_start,
+		    uint32_t old_size, int (*out)(const uint8_t *, uint32_t))
+{
+	memset(d, 0, sizeof(*d));
+	d->state = OTA_DELTA_HEADER;
+	d->dev = dev;
+	d->old_start = old_start;
+	d->old_size = old_size;
+	d->out = out;
+}
+
+/* Collect a header or a control, returns the bytes taken */
+static uint32_t ota_delta_collect(struct ota_delta *d, const uint8_t *p,
+				  uint32_t len, uint32_t want)
+{
+	uint32_t n = want - d->hdr_len;
+
+	if (n > len)
+		n = len;
+	memcpy(d->hdr + d->hdr_len, p, n);
+	d->hdr_len += n;
+	return n;
+}
+
+static int ota_delta_ctrl(struct ota_delta *d)
+{
+	int64_t x = ota_delta_offtin(d->hdr), y = ota_delta_offtin(d->hdr + 8),
+		z = ota_delta_offtin(d->hdr + 16);
+
+	if (x < 0 || y < 0 || x + y > d->new_size - d->new_pos ||
+	    d->old_pos + x > d->old_size ||
+	    d->old_pos + x + z < 0 || d->old_pos + x + z > d->old_size)
+		return -WM_E_INVAL;
+	d->diff_left = x;
+	d->extra_left = y;
+	d->seek = z;
+	d->state = OTA_DELTA_DIFF;
+	return WM_SUCCESS;
+}
+
+/* New bytes are the old ones plus the diff */
+static int ota_delta_diff(struct ota_delta *d, const uint8_t *p, uint32_t n)
+{
+	uint32_t i;
+
+	if (n > sizeof(ota_delta_old))
+		n = sizeof(ota_delta_old);
+	if (flash_drv_read(d->dev, ota_delta_old, n,
+			   d->old_start + d->old_pos) != 0)
+		return -WM_FAIL;
+	for (i = 0; i < n; i++)
+		ota_delta_old[i] += p[i];
+	d->old_pos += n;
+	d->new_pos += n;
+	d->diff_left -= n;
+	return d->out(ota_delta_old, n) == WM_SUCCESS ? n : -WM_FAIL;
+}
+
+int ota_delta_feed(struct ota_delta *d, const uint8_t *p, uint32_t len)
+{
+	uint32_t n;
+	int ret;
+
+	while (len) {
+		switch (d->state) {
+		case OTA_DELTA_HEADER:
+			n = ota_delta_collect(d, p, len, sizeof(d->hdr));
+			if (d->hdr_len == sizeof(d->hdr)) {
+				if (memcmp(d->hdr, OTA_DELTA_MAGIC,
+					   OTA_DELTA_MAGIC_LEN))
+					return -WM_E_INVAL;
+				d->new_size = ota_delta_offtin(
+					d->hdr + OTA_DELTA_MAGIC_LEN);
+				d->hdr_len = 0;
+				d->state = d->new_size ? OTA_DELTA_CTRL :
+					OTA_DELTA_DONE;
+			}
+			break;
+		case OTA_DELTA_CTRL:
+			n = ota_delta_collect(d, p, len, 24);
+			if (d->hdr_len == 24) {
+				d->hdr_len = 0;
+				ret = ota_delta_ctrl(d);
+				if (ret != WM_SUCCESS)
+					return ret;
+			}
+			break;
+		case OTA_DELTA_DIFF:
+			n = d->diff_left < len ? d->diff_left : len;
+			if (n) {
+				ret = ota_delta_diff(d, p, n);
+				if (ret < 0)
+					return ret;
+				n = ret;
+			}
+			break;
+		case OTA_DELTA_EXTRA:
+			n = d->extra_left < len ? d->extra_left : len;
+			if (n) {
+				if (d->out(p, n) != WM_SUCCESS)
+					return -WM_FAIL;
+				d->extra_left -= n;
+				d->new_pos += n;
+			}
+			break;
+		default:
+			/* Nothing may follow the patch */
+			return -WM_E_INVAL;
+		}
+		p += n;
+		len -= n;
+
+		/* Blocks may be empty */
+		if (d->state == OTA_DELTA_DIFF && !d->diff_left)
+			d->state = OTA_DELTA_EXTRA;
+		if (d->state == OTA_DELTA_EXTRA && !d->extra_left) {
+			d->old_pos += d->seek;
+			d->state = d->new_pos == d->new_size ?
+				OTA_DELTA_DONE : OTA_DELTA_CTRL;
+		}
+	}
+	return WM_SUCCESS;
+}
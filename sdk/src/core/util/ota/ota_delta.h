@@ -0,0 +1,64 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _OTA_DELTA_H_
+#define _OTA_DELTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mdev.h>
+
+/* Patches of fw_delta.py, in the streaming bsdiff format of ENDSLEY/BSDIFF43:
+ * the magic, the size of the new image, then blocks of a control, diff_len
+ * bytes added to the old image and extra_len bytes copied as they are.
+ * All the numbers are 8 bytes, little endian with the sign in the top bit.
+ * The old image is read at the offset the controls move, a block of diff
+ * at a time, so the patch is applied with a few hundred bytes of RAM.
+ */
+
+#define OTA_DELTA_MAGIC "ENDSLEY/BSDIFF43"
+#define OTA_DELTA_MAGIC_LEN 16
+/* Bytes of the old image read at once */
+#define OTA_DELTA_OLD_SIZE 256
+
+enum ota_delta_state {
+	OTA_DELTA_HEADER,
+	OTA_DELTA_CTRL,
+	OTA_DELTA_DIFF,
+	OTA_DELTA_EXTRA,
+	OTA_DELTA_DONE,
+};
+
+struct ota_delta {
+	enum ota_delta_state state;
+	/* Old image, the active firmware */
+	mdev_t *dev;
+	uint32_t old_start;
+	uint32_t old_size;
+	/* Header or control being received */
+	uint8_t hdr[OTA_DELTA_MAGIC_LEN + 8];
+	uint32_t hdr_len;
+	/* Left in the current block */
+	uint32_t diff_left;
+	uint32_t extra_left;
+	int32_t seek;
+	/* Offset in the old image */
+	int32_t old_pos;
+	uint32_t new_size;
+	uint32_t new_pos;
+	/* Takes the bytes of the new image */
+	int (*out)(const uint8_t *p, uint32_t len);
+};
+
+void ota_delta_init(struct ota_delta *d, mdev_t *dev, uint32_t old_start,
+		    uint32_t old_size, int (*out)(const uint8_t *, uint32_t));
+int ota_delta_feed(struct ota_delta *d, const uint8_t *p, uint32_t len);
+
+static inline bool ota_delta_done(const struct ota_delta *d)
+{
+	return d->state == OTA_DELTA_DONE;
+}
+
+#endif /* _OTA_DELTA_H_ */
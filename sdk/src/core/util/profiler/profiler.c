@@ -0,0 +1,183 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <wm_os.h>
+#include <wmstdio.h>
+#include <wmerrno.h>
+#include <mdev_gpt.h>
+#include <lowlevel_drivers.h>
+#include <profiler.h>
+
+#if (CONFIG_PROFILER_FUNCTION_CNT + 0) > 0
+#define PROFILER_SLOTS CONFIG_PROFILER_FUNCTION_CNT
+#else
+#define PROFILER_SLOTS 256
+#endif
+
+/* Command table entry of the cli in libwmsdk */
+struct cli_command {
+	const char *name;
+	const char *help;
+	void (*function) (int argc, char **argv);
+};
+
+int cli_register_commands(const struct cli_command *commands,
+			  int num_commands);
+
+struct profiler_slot {
+	uint32_t addr;		/* 0 when the slot is free */
+	uint32_t count;
+};
+
+static struct profiler_slot profiler_table[PROFILER_SLOTS];
+static uint32_t profiler_samples;
+static uint32_t profiler_isr_samples;
+static uint32_t profiler_dropped;
+static mdev_t *profiler_gpt;
+
+static inline uint32_t profiler_lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	return primask;
+}
+
+static inline void profiler_unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+/* Called from the GPT interrupt */
+static void profiler_sample(void)
+{
+	uint32_t addr, slot, i;
+
+	profiler_samples++;
+
+	/* With no other exception active the GPT interrupt preempted a
+	 * thread, whose exception frame is on the process stack with the
+	 * return address as its seventh word. Otherwise the process stack
+	 * holds the thread the first interrupt preempted, which is not what
+	 * ran. */
+	if (!(SCB->ICSR & SCB_ICSR_RETTOBASE_Msk)) {
+		profiler_isr_samples++;
+		return;
+	}
+	addr = ((uint32_t *)__get_PSP())[6];
+	addr &= ~((1UL << PROFILER_ADDR_SHIFT) - 1);
+
+	slot = ((addr >> PROFILER_ADDR_SHIFT) * 2654435761u) % PROFILER_SLOTS;
+	for (i = 0; i < PROFILER_SLOTS; i++) {
+		struct profiler_slot *s = &profiler_table[slot];
+
+		if (s->addr == addr) {
+			s->count++;
+			return;
+		}
+		if (!s->addr) {
+			s->addr = addr;
+			s->count = 1;
+			return;
+		}
+		if (++slot == PROFILER_SLOTS)
+			slot = 0;
+	}
+	profiler_dropped++;
+}
+
+int profiler_start(uint32_t interval_us)
+{
+	if (profiler_gpt)
+		return -WM_E_INVAL;
+
+	if (!interval_us)
+		interval_us = PROFILER_DEFAULT_INTERVAL_US;
+
+	if (gpt_drv_init(PROFILER_GPT_ID) != WM_SUCCESS)
+		return -WM_FAIL;
+	profiler_gpt = gpt_drv_open(PROFILER_GPT_ID);
+	if (!profiler_gpt)
+		return -WM_FAIL;
+
+	gpt_drv_set(profiler_gpt, interval_us);
+	gpt_drv_setcb(profiler_gpt, profiler_sample);
+	gpt_drv_start(profiler_gpt);
+	return WM_SUCCESS;
+}
+
+int profiler_stop(void)
+{
+	if (!profiler_gpt)
+		return -WM_E_INVAL;
+
+	gpt_drv_stop(profiler_gpt);
+	gpt_drv_setcb(profiler_gpt, NULL);
+	gpt_drv_close(profiler_gpt);
+	profiler_gpt = NULL;
+	return WM_SUCCESS;
+}
+
+void profiler_reset(void)
+{
+	uint32_t primask = profiler_lock();
+
+	memset(profiler_table, 0, sizeof(profiler_table));
+	profiler_samples = 0;
+	profiler_isr_samples = 0;
+	profiler_dropped = 0;
+	profiler_unlock(primask);
+}
+
+void profiler_dump(void)
+{
+	int i;
+
+	/* Printing takes long, the counts of a running profiler may move
+	 * meanwhile */
+	wmprintf("prof samples %u isr %u dropped %u\r\n", profiler_samples,
+		 profiler_isr_samples, profiler_dropped);
+	for (i = 0; i < PROFILER_SLOTS; i++)
+		if (profiler_table[i].addr)
+			wmprintf("prof 0x%08x %u\r\n", profiler_table[i].addr,
+				 profiler_table[i].count);
+	wmprintf("prof end\r\n");
+}
+
+static void profiler_cli(int argc, char **argv)
+{
+	int ret;
+
+	if (argc >= 2 && !strcmp(argv[1], "start")) {
+		ret = profiler_start(argc >= 3 ? strtoul(argv[2], NULL, 0) : 0);
+		if (ret != WM_SUCCESS)
+			wmprintf("profiler start failed: %d\r\n", ret);
+	} else if (argc >= 2 && !strcmp(argv[1], "stop")) {
+		if (profiler_stop() != WM_SUCCESS)
+			wmprintf("profiler is not running\r\n");
+	} else if (argc >= 2 && !strcmp(argv[1], "reset")) {
+		profiler_reset();
+	} else if (argc >= 2 && !strcmp(argv[1], "dump")) {
+		profiler_dump();
+	} else {
+		wmprintf("Usage: profiler <start [interval_us]|stop|reset|"
+			 "dump>\r\n");
+	}
+}
+
+static const struct cli_command profiler_commands[] = {
+	{"profiler", "<start [interval_us]|stop|reset|dump>", profiler_cli},
+};
+
+int profiler_cli_init(void)
+{
+	if (cli_register_commands(profiler_commands,
+				  sizeof(profiler_commands) /
+				  sizeof(profiler_commands[0])))
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The pool is a stack of words, the thread pushes and the handlers pop in
+ * critical sections, a copy of one word each. A word is the reads of all
+ * the sources and the timestamp folded into the previous word with the
+ * finalizer of MurmurHash3, so a source with few random bits, or a biased
+ * one, still changes every bit of the word.
+ */
+
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <wm_utils.h>
+#include <rand_pool.h>
+
+#define rp_w(...) wmlog_w("rand", ##__VA_ARGS__)
+
+static struct {
+	random_hdlr_t src[RAND_POOL_MAX_SOURCES];
+	int n_src;
+	uint32_t words[RAND_POOL_WORDS];
+	volatile int count;
+	uint32_t mix;
+	uint32_t refill_ms;
+	bool started;
+	bool registered;
+	struct rand_pool_stats stats;
+} rp;
+
+static os_semaphore_t rp_refill;
+static os_thread_t rp_thread;
+static os_thread_stack_define(rp_stack, 1024);
+
+static uint32_t rp_fold(uint32_t h, uint32_t v)
+{
+	h ^= v;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/* Called by the thread only, or by a starved handler with its own state */
+static uint32_t rp_read_sources(uint32_t h)
+{
+	int i;
+
+	if (!rp.n_src)
+		h = rp_fold(h, sample_initialise_random_seed());
+	for (i = 0; i < rp.n_src; i++)
+		h = rp_fold(h, rp.src[i]());
+	return rp_fold(h, os_get_timestamp());
+}
+
+static void rp_fill(void)
+{
+	unsigned long state;
+	uint32_t w;
+	int full;
+
+	do {
+		w = rp.mix = rp_read_sources(rp.mix);
+		state = os_enter_critical_section();
+		full = rp.count == RAND_POOL_WORDS;
+		if (full) {
+			/* Mix the fresh noise into the oldest word */
+			rp.words[0] ^= w;
+		} else {
+			rp.words[rp.count++] = w;
+			rp.stats.filled++;
+		}
+		os_exit_critical_section(state);
+	} while (!full);
+}
+
+static void rp_main(os_thread_arg_t arg)
+{
+	unsigned long wait;
+
+	while (1) {
+		wait = rp.refill_ms ? os_msec_to_ticks(rp.refill_ms) :
+			OS_WAIT_FOREVER;
+		os_semaphore_get(&rp_refill, wait);
+		rp_fill();
+	}
+}
+
+uint32_t rand_pool_word(void)
+{
+	unsigned long state;
+	uint32_t w = 0;
+	bool got;
+
+	state = os_enter_critical_section();
+	got = rp.count > 0;
+	if (got) {
+		w = rp.words[--rp.count];
+		rp.stats.served++;
+	} else {
+		rp.stats.starved++;
+	}
+	os_exit_critical_section(state);
+
+	if (rp.started && rp.count < RAND_POOL_WORDS / 2)
+		os_semaphore_put(&rp_refill);
+	if (!got)
+		w = rp_read_sources(rp.mix ^ rp.stats.starved);
+	return w;
+}
+
+int rand_pool_add_source(random_hdlr_t src)
+{
+	if (!src || rp.started)
+		return -WM_E_INVAL;
+	if (rp.n_src == RAND_POOL_MAX_SOURCES)
+		return -WM_E_NOSPC;
+
+	rp.src[rp.n_src++] = src;
+	return WM_SUCCESS;
+}
+
+int rand_pool_start(uint32_t refill_ms)
+{
+	rp.refill_ms = refill_ms;
+	if (!rp.started) {
+		if (os_semaphore_create(&rp_refill, "rand-pool") != WM_SUCCESS)
+			return -WM_FAIL;
+		/* Binary semaphores are created available */
+		os_semaphore_get(&rp_refill, OS_NO_WAIT);
+		rp_fill();
+		if (os_thread_create(&rp_thread, "rand-pool", rp_main, NULL,
+				     &rp_stack, OS_PRIO_4) != WM_SUCCESS) {
+			os_semaphore_delete(&rp_refill);
+			return -WM_FAIL;
+		}
+		rp.started = true;
+	}
+
+	if (!rp.registered) {
+		if (random_register_handler(rand_pool_word) != WM_SUCCESS) {
+			rp_w("handler not registered");
+			return -WM_FAIL;
+		}
+		rp.registered = true;
+	}
+	return WM_SUCCESS;
+}
+
+void rand_pool_stop(void)
+{
+	if (!rp.registered)
+		return;
+
+	random_unregister_handler(rand_pool_word);
+	rp.registered = false;
+}
+
+void rand_pool_get_stats(struct rand_pool_stats *stats)
+{
+	unsigned long state;
+
+	state = os_enter_critical_section();
+	*stats = rp.stats;
+	os_exit_critical_section(state);
+}
@@ -0,0 +1,190 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The state word holds the number of readers inside, RWLOCK_WRITER while a
+ * writer is inside and RWLOCK_PENDING while writers wait. The fast paths
+ * change it with LDREX/STREX, a store that raced with another task fails
+ * since the exclusive monitor is cleared on every exception, and so on
+ * every context switch, and is retried.
+ *
+ * The slow paths run in critical sections, where no other task or kernel
+ * aware interrupt runs, so plain updates of the word are safe there. A task
+ * that has to wait counts itself in readers_waiting or writers_waiting and
+ * blocks on the semaphore of its kind, the task releasing the lock gives
+ * the semaphore once per waiter. A waiter always checks the word again
+ * after waking up, so a token left by a waiter that timed out only costs a
+ * spurious wake up.
+ */
+
+#include <wmerrno.h>
+#include <lowlevel_drivers.h>
+#include <rwlock.h>
+
+#define RWLOCK_WRITER	(1U << 31)
+#define RWLOCK_PENDING	(1U << 30)
+#define RWLOCK_READERS	(RWLOCK_PENDING - 1)
+
+/* Tokens a semaphore holds at most, beyond that waiters are woken again */
+#define RWLOCK_MAX_TOKENS 32
+
+int rwlock_create(rwlock_t *lock, const char *name)
+{
+	lock->state = 0;
+	lock->readers_waiting = 0;
+	lock->writers_waiting = 0;
+	if (os_semaphore_create_counting(&lock->read_sem, name,
+					 RWLOCK_MAX_TOKENS, 0) != WM_SUCCESS)
+		return -WM_FAIL;
+	if (os_semaphore_create_counting(&lock->write_sem, name,
+					 RWLOCK_MAX_TOKENS, 0) != WM_SUCCESS) {
+		os_semaphore_delete(&lock->read_sem);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+void rwlock_delete(rwlock_t *lock)
+{
+	os_semaphore_delete(&lock->read_sem);
+	os_semaphore_delete(&lock->write_sem);
+}
+
+/* Ticks left of a wait of wait_time that started at start */
+static unsigned int rwlock_left(unsigned int wait_time, unsigned start)
+{
+	unsigned spent;
+
+	if (wait_time == OS_WAIT_FOREVER)
+		return wait_time;
+	spent = os_ticks_get() - start;
+	return spent >= wait_time ? 0 : wait_time - spent;
+}
+
+static void rwlock_wake(os_semaphore_t *sem, unsigned n)
+{
+	while (n--)
+		os_semaphore_put(sem);
+}
+
+int rwlock_read_lock(rwlock_t *lock, unsigned int wait_time)
+{
+	unsigned start = os_ticks_get();
+	unsigned int left;
+	unsigned long flags;
+	uint32_t s;
+
+	do {
+		s = __LDREXW(&lock->state);
+		if (s & (RWLOCK_WRITER | RWLOCK_PENDING)) {
+			__CLREX();
+			goto slow;
+		}
+	} while (__STREXW(s + 1, &lock->state));
+	__DMB();
+	return WM_SUCCESS;
+
+slow:
+	flags = os_enter_critical_section();
+	for (;;) {
+		if (!(lock->state & (RWLOCK_WRITER | RWLOCK_PENDING))) {
+			lock->state++;
+			os_exit_critical_section(flags);
+			return WM_SUCCESS;
+		}
+		left = rwlock_left(wait_time, start);
+		if (!left)
+			break;
+		lock->readers_waiting++;
+		os_exit_critical_section(flags);
+
+		os_semaphore_get(&lock->read_sem, left);
+
+		flags = os_enter_critical_section();
+		lock->readers_waiting--;
+	}
+	os_exit_critical_section(flags);
+	return -WM_FAIL;
+}
+
+int rwlock_read_unlock(rwlock_t *lock)
+{
+	uint32_t s;
+
+	__DMB();
+	do {
+		s = __LDREXW(&lock->state);
+		if (!(s & RWLOCK_READERS)) {
+			__CLREX();
+			return -WM_FAIL;
+		}
+		s--;
+	} while (__STREXW(s, &lock->state));
+
+	/* The last reader lets a waiting writer in */
+	if (s == RWLOCK_PENDING)
+		os_semaphore_put(&lock->write_sem);
+	return WM_SUCCESS;
+}
+
+int rwlock_write_lock(rwlock_t *lock, unsigned int wait_time)
+{
+	unsigned start = os_ticks_get();
+	unsigned int left;
+	unsigned long flags;
+	int ret = -WM_FAIL;
+
+	do {
+		if (__LDREXW(&lock->state)) {
+			__CLREX();
+			goto slow;
+		}
+	} while (__STREXW(RWLOCK_WRITER, &lock->state));
+	__DMB();
+	return WM_SUCCESS;
+
+slow:
+	flags = os_enter_critical_section();
+	lock->writers_waiting++;
+	lock->state |= RWLOCK_PENDING;
+	for (;;) {
+		if (!(lock->state & (RWLOCK_WRITER | RWLOCK_READERS))) {
+			lock->state |= RWLOCK_WRITER;
+			ret = WM_SUCCESS;
+			break;
+		}
+		left = rwlock_left(wait_time, start);
+		if (!left)
+			break;
+		os_exit_critical_section(flags);
+
+		os_semaphore_get(&lock->write_sem, left);
+
+		flags = os_enter_critical_section();
+	}
+
+	if (!--lock->writers_waiting) {
+		lock->state &= ~RWLOCK_PENDING;
+		/* The readers held off by this writer go on if it gave up */
+		if (!(lock->state & RWLOCK_WRITER))
+			rwlock_wake(&lock->read_sem, lock->readers_waiting);
+	}
+	os_exit_critical_section(flags);
+	return ret;
+}
+
+void rwlock_write_unlock(rwlock_t *lock)
+{
+	unsigned long flags;
+
+	__DMB();
+	flags = os_enter_critical_section();
+	lock->state &= ~RWLOCK_WRITER;
+	if (lock->writers_waiting)
+		os_semaphore_put(&lock->write_sem);
+	else
+		rwlock_wake(&lock->read_sem, lock->readers_waiting);
+	os_exit_critical_section(flags);
+}
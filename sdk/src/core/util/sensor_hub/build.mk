@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libsensor_hub
+libsensor_hub-objs-y := sensor_hub.c
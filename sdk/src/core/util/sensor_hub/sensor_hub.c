@@ -0,0 +1,268 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The GPT interrupt walks the list of sensors and submits the reads that
+ * are due, the completion callbacks of i2c_xfer and ssp_dma, also in
+ * interrupts, write the samples to the rings. The list is changed by
+ * threads in critical sections, which mask the GPT interrupt. A sensor is
+ * busy from the submission of its read to its completion, its transaction
+ * and buffer are in use then.
+ *
+ * The register writes of sensor_hub_add() go through the same queues, the
+ * thread waits for each on a semaphore.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <mdev_gpt.h>
+#include <cpu_clk.h>
+#include <sensor_hub.h>
+
+#define hub_w(...) wmlog_w("sensor", ##__VA_ARGS__)
+
+static struct {
+	mdev_t *gpt;
+	uint32_t tick_us;
+	volatile uint32_t tick;
+	sensor_t *sensors;
+	/* Register writes of sensor_hub_add() */
+	os_semaphore_t write_done;
+	volatile int write_result;
+} hub;
+
+static void hub_reclock(uint32_t old_hz, uint32_t new_hz, void *ctx)
+{
+	gpt_drv_set(hub.gpt, hub.tick_us);
+}
+
+static struct cpu_clk_notifier hub_clk_nb = { hub_reclock };
+
+static void hub_read_done(int result, void *arg)
+{
+	sensor_t *s = arg;
+	sensor_sample_t sample;
+
+	if (result != WM_SUCCESS) {
+		s->errors++;
+	} else {
+		sample.ts_us = s->ts_us;
+		memcpy(sample.data, s->raw, s->desc->len);
+		if (!os_ringbuf_write(&s->ring, &sample, 1))
+			s->dropped++;
+	}
+	s->busy = false;
+}
+
+static int hub_submit_read(sensor_t *s)
+{
+	const sensor_desc_t *d = s->desc;
+	ssp_dma_xfer_t *spi = s->xfer.spi;
+	int ret;
+
+	if (d->bus == SENSOR_BUS_I2C) {
+		memset(&s->xfer.i2c, 0, sizeof(s->xfer.i2c));
+		s->xfer.i2c.addr = d->addr;
+		s->xfer.i2c.wr = &d->reg;
+		s->xfer.i2c.wr_len = 1;
+		s->xfer.i2c.rd = s->raw;
+		s->xfer.i2c.rd_len = d->len;
+		s->xfer.i2c.cb = hub_read_done;
+		s->xfer.i2c.arg = s;
+		return i2c_xfer_submit(d->port, &s->xfer.i2c);
+	}
+
+	/* The command byte, then the data with the chip select kept */
+	memset(spi, 0, 2 * sizeof(*spi));
+	spi[0].tx = &d->reg;
+	spi[0].len = 1;
+	spi[0].cs_hold = true;
+	spi[1].rx = s->raw;
+	spi[1].len = d->len;
+	spi[1].cb = hub_read_done;
+	spi[1].arg = s;
+	ret = ssp_dma_submit(d->port, &spi[0]);
+	if (ret != WM_SUCCESS)
+		return ret;
+	return ssp_dma_submit(d->port, &spi[1]);
+}
+
+static void hub_tick(void)
+{
+	uint32_t tick = ++hub.tick;
+	sensor_t *s;
+
+	for (s = hub.sensors; s; s = s->next) {
+		if ((int32_t)(tick - s->next_tick) < 0)
+			continue;
+		s->next_tick += s->period_ticks;
+		if (s->busy) {
+			s->overruns++;
+			continue;
+		}
+		s->busy = true;
+		s->ts_us = tick * hub.tick_us;
+		if (hub_submit_read(s) != WM_SUCCESS) {
+			s->errors++;
+			s->busy = false;
+		}
+	}
+}
+
+int sensor_hub_init(GPT_ID_Type gpt, uint32_t tick_us)
+{
+	if (hub.gpt || !tick_us)
+		return -WM_E_INVAL;
+
+	if (os_semaphore_create(&hub.write_done, "sensor-wr") != WM_SUCCESS)
+		return -WM_FAIL;
+	/* Binary semaphores are created available */
+	os_semaphore_get(&hub.write_done, OS_NO_WAIT);
+
+	if (gpt_drv_init(gpt) != WM_SUCCESS)
+		goto fail;
+	hub.gpt = gpt_drv_open(gpt);
+	if (!hub.gpt)
+		goto fail;
+
+	hub.tick_us = tick_us;
+	hub.tick = 0;
+	hub.sensors = NULL;
+	gpt_drv_set(hub.gpt, tick_us);
+	gpt_drv_setcb(hub.gpt, hub_tick);
+	gpt_drv_start(hub.gpt);
+	/* Only needed if the clock is switched at run time */
+	cpu_clk_notifier_register(&hub_clk_nb);
+	return WM_SUCCESS;
+
+fail:
+	os_semaphore_delete(&hub.write_done);
+	return -WM_FAIL;
+}
+
+void sensor_hub_deinit(void)
+{
+	if (!hub.gpt)
+		return;
+
+	cpu_clk_notifier_unregister(&hub_clk_nb);
+	gpt_drv_stop(hub.gpt);
+	gpt_drv_setcb(hub.gpt, NULL);
+	gpt_drv_close(hub.gpt);
+	hub.gpt = NULL;
+	os_semaphore_delete(&hub.write_done);
+}
+
+static void hub_write_done(int result, void *arg)
+{
+	hub.write_result = result;
+	os_semaphore_put(&hub.write_done);
+}
+
+static int hub_write_reg(const sensor_desc_t *d,
+			 const struct sensor_reg_write *w)
+{
+	uint8_t buf[2] = { w->reg, w->val };
+	i2c_xfer_t i2c;
+	ssp_dma_xfer_t spi;
+	int ret;
+
+	if (d->bus == SENSOR_BUS_I2C) {
+		memset(&i2c, 0, sizeof(i2c));
+		i2c.addr = d->addr;
+		i2c.wr = buf;
+		i2c.wr_len = sizeof(buf);
+		i2c.cb = hub_write_done;
+		ret = i2c_xfer_submit(d->port, &i2c);
+	} else {
+		memset(&spi, 0, sizeof(spi));
+		spi.tx = buf;
+		spi.len = sizeof(buf);
+		spi.cb = hub_write_done;
+		ret = ssp_dma_submit(d->port, &spi);
+	}
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	/* The transaction is on the stack, wait for it whatever it takes */
+	os_semaphore_get(&hub.write_done, OS_WAIT_FOREVER);
+	return hub.write_result;
+}
+
+int sensor_hub_add(sensor_t *s, const sensor_desc_t *desc,
+		   sensor_sample_t *ring, uint32_t ring_size)
+{
+	unsigned long state;
+	uint32_t period;
+	int i;
+
+	if (!hub.gpt || !s || !desc || !desc->len ||
+	    desc->len > SENSOR_HUB_MAX_SAMPLE ||
+	    (desc->bus != SENSOR_BUS_I2C && desc->bus != SENSOR_BUS_SPI) ||
+	    (desc->n_init && !desc->init))
+		return -WM_E_INVAL;
+	if (os_ringbuf_init(&s->ring, ring, sizeof(*ring), ring_size) !=
+	    WM_SUCCESS)
+		return -WM_E_INVAL;
+
+	for (i = 0; i < desc->n_init; i++) {
+		if (hub_write_reg(desc, &desc->init[i]) != WM_SUCCESS) {
+			hub_w("%s: register 0x%x not written", desc->name,
+			      desc->init[i].reg);
+			return -WM_FAIL;
+		}
+	}
+
+	period = (desc->period_us + hub.tick_us / 2) / hub.tick_us;
+	s->desc = desc;
+	s->dropped = 0;
+	s->overruns = 0;
+	s->errors = 0;
+	s->busy = false;
+	s->period_ticks = period ? period : 1;
+
+	state = os_enter_critical_section();
+	s->next_tick = hub.tick + s->period_ticks;
+	s->next = hub.sensors;
+	hub.sensors = s;
+	os_exit_critical_section(state);
+	return WM_SUCCESS;
+}
+
+void sensor_hub_remove(sensor_t *s)
+{
+	unsigned long state;
+	sensor_t **p;
+
+	state = os_enter_critical_section();
+	for (p = &hub.sensors; *p; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+	os_exit_critical_section(state);
+
+	while (s->busy)
+		os_thread_sleep(1);
+}
+
+uint32_t sensor_hub_read(sensor_t *s, sensor_sample_t *samples,
+			 uint32_t max)
+{
+	return os_ringbuf_read(&s->ring, samples, max);
+}
+
+int sensor_hub_wait(sensor_t *s, unsigned long wait_ticks)
+{
+	return os_ringbuf_wait(&s->ring, wait_ticks);
+}
+
+uint32_t sensor_hub_now_us(void)
+{
+	return hub.tick * hub.tick_us;
+}
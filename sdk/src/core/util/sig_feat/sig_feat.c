@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Pairs of 16 bit samples are loaded as one word and handed to the dual
+ * 16 bit instructions of the Cortex-M4. A complex FFT value is such a pair,
+ * the real part in the low half. The M4 loads words from any address, the
+ * pairs go through memcpy() so that the compiler knows they may be
+ * unaligned and still emits a single load or store.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <wmerrno.h>
+#include <lowlevel_drivers.h>
+#include <sig_feat.h>
+
+#define Q15_ONE 32767
+#define PI_F 3.14159265f
+
+/* Samples decimated at a time by the pipeline */
+#define PIPE_CHUNK 32
+
+static inline uint32_t rd2(const int16_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void wr2(int16_t *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static int16_t q15(float v)
+{
+	int32_t q = (int32_t)(v * 32768.0f + (v < 0 ? -0.5f : 0.5f));
+
+	if (q > Q15_ONE)
+		return Q15_ONE;
+	if (q < -32768)
+		return -32768;
+	return (int16_t)q;
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t bit = 1ULL << 62, r = 0;
+
+	while (bit > v)
+		bit >>= 2;
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+void sig_feat_stats(const int16_t *x, int n, int16_t threshold,
+		    sig_feat_stats_t *st)
+{
+	int64_t sum = 0, mean;
+	uint64_t sumsq = 0, var;
+	int16_t min = x[0], max = x[0];
+	uint16_t crossings = 0;
+	int above = x[0] >= threshold;
+	int i;
+
+	/* Sums two samples per instruction, the sum multiplying by one */
+	for (i = 0; i + 1 < n; i += 2) {
+		uint32_t v = rd2(x + i);
+
+		sum = (int64_t)__SMLALD(v, 0x00010001, (uint64_t)sum);
+		sumsq = __SMLALD(v, v, sumsq);
+	}
+	if (i < n) {
+		sum += x[i];
+		sumsq += (int32_t)x[i] * x[i];
+	}
+
+	for (i = 0; i < n; i++) {
+		if (x[i] < min)
+			min = x[i];
+		if (x[i] > max)
+			max = x[i];
+		if (x[i] >= threshold) {
+			if (!above)
+				crossings++;
+			above = 1;
+		} else {
+			above = 0;
+		}
+	}
+
+	/* Floor of the division, also for a negative sum */
+	mean = sum >= 0 ? sum / n : -((-sum + n - 1) / n);
+	/* n * variance = sumsq - sum^2 / n */
+	var = sumsq - (uint64_t)((sum * sum) / n);
+	st->mean = (int16_t)mean;
+	st->rms = (uint16_t)isqrt64(var / n);
+	st->min = min;
+	st->max = max;
+	st->crossings = crossings;
+}
+
+int sig_feat_fft_init(sig_feat_fft_t *f, int n, int16_t *twiddle,
+		      int16_t *window)
+{
+	int k, log2n = 0;
+
+	if (!f || !twiddle || !window || n < SIG_FEAT_FFT_MIN_LEN ||
+	    n > SIG_FEAT_FFT_MAX_LEN || (n & (n - 1)))
+		return -WM_E_INVAL;
+
+	while ((1 << log2n) < n)
+		log2n++;
+
+	/* W^k = cos - j sin of 2 pi k / n, cos in the low half */
+	for (k = 0; k < n / 2; k++) {
+		twiddle[2 * k] = q15(cosf(2 * PI_F * k / n));
+		twiddle[2 * k + 1] = q15(sinf(2 * PI_F * k / n));
+	}
+	for (k = 0; k < n / 2; k++)
+		window[k] = q15(0.5f - 0.5f * cosf(2 * PI_F * k / (n - 1)));
+
+	f->n = n;
+	f->log2n = log2n;
+	f->twiddle = twiddle;
+	f->window = window;
+	return WM_SUCCESS;
+}
+
+static inline unsigned bit_reverse(unsigned i, int bits)
+{
+	return __RBIT(i) >> (32 - bits);
+}
+
+void sig_feat_spectrum(const sig_feat_fft_t *f, const int16_t *x,
+		       int16_t *work, uint32_t *power)
+{
+	int n = f->n, half, step, size, i, k;
+	int16_t w;
+
+	/* Windowed, halved so that no butterfly overflows, in bit reversed
+	 * order for the in place FFT */
+	for (i = 0; i < n; i++) {
+		k = bit_reverse(i, f->log2n);
+		w = f->window[i < n / 2 ? i : n - 1 - i];
+		work[2 * k] = (int16_t)(((int32_t)x[i] * w) >> 16);
+		work[2 * k + 1] = 0;
+	}
+
+	/* Radix 2, decimation in time. The halving adds keep the values of
+	 * every stage in range */
+	for (size = 2; size <= n; size <<= 1) {
+		half = size / 2;
+		step = n / size;
+		for (k = 0; k < half; k++) {
+			uint32_t tw = rd2(f->twiddle + 2 * k * step);
+
+			for (i = k; i < n; i += size) {
+				uint32_t a = rd2(work + 2 * i);
+				uint32_t b = rd2(work + 2 * (i + half));
+				/* b W = br c + bi s + j (bi c - br s) */
+				int32_t re = (int32_t)__SMUAD(b, tw) >> 15;
+				int32_t im = (int32_t)__SMUSDX(tw, b) >> 15;
+				uint32_t t = __PKHBT(re, im, 16);
+
+				wr2(work + 2 * i, __SHADD16(a, t));
+				wr2(work + 2 * (i + half), __SHSUB16(a, t));
+			}
+		}
+	}
+
+	for (k = 0; k < n / 2; k++) {
+		uint32_t v = rd2(work + 2 * k);
+
+		power[k] = __SMUAD(v, v);
+	}
+}
+
+void sig_feat_bands(const uint32_t *power, int bins, const uint16_t *edges,
+		    int nbands, uint32_t *band)
+{
+	int b, k, end;
+	uint32_t sum;
+
+	for (b = 0; b < nbands; b++) {
+		sum = 0;
+		end = edges[b + 1] < bins ? edges[b + 1] : bins;
+		for (k = edges[b]; k < end; k++) {
+			sum += power[k];
+			if (sum < power[k]) {
+				sum = UINT32_MAX;
+				break;
+			}
+		}
+		band[b] = sum;
+	}
+}
+
+/* Tap i of a Hamming windowed sinc cutting off at fc cycles per sample */
+static float lowpass_tap(int i, int num_taps, float fc)
+{
+	float t = i - (num_taps - 1) / 2.0f;
+
+	return sinf(2 * PI_F * fc * t) / (PI_F * t) *
+		(0.54f - 0.46f * cosf(2 * PI_F * i / (num_taps - 1)));
+}
+
+int sig_feat_lowpass(int16_t *coeffs, int num_taps, int factor)
+{
+	float fc, sum = 0;
+	int i;
+
+	if (!coeffs || num_taps < 2 || (num_taps & 1) || factor < 1)
+		return -WM_E_INVAL;
+
+	/* 0.8 of the Nyquist frequency after the decimation. With an even
+	 * number of taps t is never 0 */
+	fc = 0.4f / factor;
+	for (i = 0; i < num_taps; i++)
+		sum += lowpass_tap(i, num_taps, fc);
+	for (i = 0; i < num_taps; i++)
+		coeffs[i] = q15(lowpass_tap(i, num_taps, fc) / sum);
+	return WM_SUCCESS;
+}
+
+int sig_feat_decim_init(sig_feat_decim_t *d, const int16_t *coeffs,
+			int num_taps, int factor, int16_t *state)
+{
+	if (!d || !coeffs || !state || num_taps < 2 || (num_taps & 1) ||
+	    num_taps > UINT16_MAX / 2 || factor < 1 || factor > 255)
+		return -WM_E_INVAL;
+
+	memset(state, 0, 2 * num_taps * sizeof(*state));
+	d->coeffs = coeffs;
+	d->state = state;
+	d->num_taps = num_taps;
+	d->pos = 0;
+	d->factor = factor;
+	d->phase = 0;
+	return WM_SUCCESS;
+}
+
+int sig_feat_decimate(sig_feat_decim_t *d, const int16_t *x, int n,
+		      int16_t *y)
+{
+	int taps = d->num_taps, i, k, out = 0;
+	const int16_t *s;
+	int64_t acc;
+
+	for (i = 0; i < n; i++) {
+		/* Then state[pos] up to state[pos + taps - 1] are the last
+		 * taps samples, oldest first */
+		d->state[d->pos] = x[i];
+		d->state[d->pos + taps] = x[i];
+		d->pos = d->pos + 1 == taps ? 0 : d->pos + 1;
+
+		if (++d->phase < d->factor)
+			continue;
+		d->phase = 0;
+
+		/* Symmetric, the order of the coefficients does not matter */
+		s = d->state + d->pos;
+		acc = 0;
+		for (k = 0; k < taps; k += 2)
+			acc = (int64_t)__SMLALD(rd2(s + k), rd2(d->coeffs + k),
+						(uint64_t)acc);
+		y[out++] = (int16_t)__SSAT((int32_t)(acc >> 15), 16);
+	}
+	return out;
+}
+
+int sig_feat_pipe_init(sig_feat_pipe_t *p, const sig_feat_pipe_cfg_t *cfg)
+{
+	if (!p || !cfg || !cfg->fft || !cfg->frame || !cfg->work ||
+	    !cfg->power || !cfg->cb || cfg->nbands > SIG_FEAT_MAX_BANDS ||
+	    (cfg->nbands && !cfg->edges) || !cfg->hop ||
+	    cfg->hop > cfg->fft->n)
+		return -WM_E_INVAL;
+
+	p->cfg = *cfg;
+	p->fill = 0;
+	return WM_SUCCESS;
+}
+
+static void pipe_frame(sig_feat_pipe_t *p)
+{
+	const sig_feat_pipe_cfg_t *c = &p->cfg;
+	int n = c->fft->n, k;
+	sig_feat_result_t r;
+
+	sig_feat_stats(c->frame, n, c->threshold, &r.stats);
+	sig_feat_spectrum(c->fft, c->frame, c->work, c->power);
+	r.peak_bin = 1;
+	for (k = 2; k < n / 2; k++)
+		if (c->power[k] > c->power[r.peak_bin])
+			r.peak_bin = k;
+	r.nbands = c->nbands;
+	sig_feat_bands(c->power, n / 2, c->edges, c->nbands, r.band);
+	c->cb(&r, c->arg);
+
+	/* The next frame starts hop samples later */
+	memmove(c->frame, c->frame + c->hop, (n - c->hop) * sizeof(*c->frame));
+	p->fill = n - c->hop;
+}
+
+static void pipe_append(sig_feat_pipe_t *p, const int16_t *x, int n)
+{
+	int room;
+
+	while (n > 0) {
+		room = p->cfg.fft->n - p->fill;
+		if (room > n)
+			room = n;
+		memcpy(p->cfg.frame + p->fill, x, room * sizeof(*x));
+		p->fill += room;
+		x += room;
+		n -= room;
+		if (p->fill == p->cfg.fft->n)
+			pipe_frame(p);
+	}
+}
+
+void sig_feat_pipe_push(sig_feat_pipe_t *p, const int16_t *x, int n)
+{
+	int16_t y[PIPE_CHUNK];
+	int chunk, m;
+
+	if (!p->cfg.decim) {
+		pipe_append(p, x, n);
+		return;
+	}
+
+	chunk = PIPE_CHUNK * p->cfg.decim->factor;
+	while (n > 0) {
+		m = n < chunk ? n : chunk;
+		pipe_append(p, y, sig_feat_decimate(p->cfg.decim, x, m, y));
+		x += m;
+		n -= m;
+	}
+}
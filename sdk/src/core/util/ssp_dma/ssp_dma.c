@@ -0,0 +1,242 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <mdev_ssp.h>
+#include <lowlevel_drivers.h>
+#include <dma_svc.h>
+#include <ssp_dma.h>
+
+#define SSP_DMA_NPORTS 3
+
+struct ssp_dma_port {
+	mdev_t *dev;
+	ssp_reg_t *regs;
+	DMA_PerMapping_Type tx_per, rx_per;
+	bool cs_active;
+	/* Running transaction and the ones waiting behind it */
+	ssp_dma_xfer_t *cur, *head, *tail;
+	int tx_result;
+	/* Only one transaction of a port runs at a time */
+	dma_svc_req_t tx_req, rx_req;
+	dma_svc_desc_t tx_desc[SSP_DMA_MAX_DESCS];
+	dma_svc_desc_t rx_desc[SSP_DMA_MAX_DESCS];
+};
+
+static struct ssp_dma_port ssp_dma_ports[SSP_DMA_NPORTS];
+
+/* Source of the dummy bytes and sink of the dropped ones, in SRAM, the
+ * DMA does not read the flash */
+static uint32_t ssp_dma_dummy = SPI_DUMMY_WORD;
+static uint32_t ssp_dma_sink;
+
+static inline uint32_t ssp_dma_lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	return primask;
+}
+
+static inline void ssp_dma_unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+/* One byte per request, a burst would leave the last bytes of a length
+ * that is not a multiple of it in the receive FIFO */
+static void ssp_dma_desc(dma_svc_desc_t *d, DMA_TransfType_Type type,
+			 uint32_t src, DMA_AddrInc_Type src_inc,
+			 uint32_t dst, DMA_AddrInc_Type dst_inc,
+			 uint32_t len, DMA_PerMapping_Type per)
+{
+	memset(d, 0, sizeof(*d));
+	d->dmac.dma_cfg.srcDmaAddr = src;
+	d->dmac.dma_cfg.destDmaAddr = dst;
+	d->dmac.dma_cfg.transfType = type;
+	d->dmac.dma_cfg.burstLength = DMA_ITEM_1;
+	d->dmac.dma_cfg.srcAddrInc = src_inc;
+	d->dmac.dma_cfg.destAddrInc = dst_inc;
+	d->dmac.dma_cfg.transfWidth = DMA_TRANSF_WIDTH_8;
+	d->dmac.dma_cfg.transfLength = len;
+	d->dmac.perDmaInter = per;
+}
+
+static void ssp_dma_start(struct ssp_dma_port *p, ssp_dma_xfer_t *xfer)
+{
+	uint32_t fifo = (uint32_t)&p->regs->SSDR.WORDVAL;
+	uint32_t done, n;
+	int i;
+
+	for (i = 0, done = 0; done < xfer->len; i++, done += n) {
+		n = xfer->len - done;
+		if (n > DMA_SVC_MAX_BLOCK)
+			n = DMA_SVC_MAX_BLOCK;
+
+		if (xfer->tx)
+			ssp_dma_desc(&p->tx_desc[i], DMA_MEM_TO_PER,
+				     (uint32_t)(xfer->tx + done), DMA_ADDR_INC,
+				     fifo, DMA_ADDR_NOCHANGE, n, p->tx_per);
+		else
+			ssp_dma_desc(&p->tx_desc[i], DMA_MEM_TO_PER,
+				     (uint32_t)&ssp_dma_dummy,
+				     DMA_ADDR_NOCHANGE,
+				     fifo, DMA_ADDR_NOCHANGE, n, p->tx_per);
+
+		if (xfer->rx)
+			ssp_dma_desc(&p->rx_desc[i], DMA_PER_TO_MEM,
+				     fifo, DMA_ADDR_NOCHANGE,
+				     (uint32_t)(xfer->rx + done), DMA_ADDR_INC,
+				     n, p->rx_per);
+		else
+			ssp_dma_desc(&p->rx_desc[i], DMA_PER_TO_MEM,
+				     fifo, DMA_ADDR_NOCHANGE,
+				     (uint32_t)&ssp_dma_sink, DMA_ADDR_NOCHANGE,
+				     n, p->rx_per);
+
+		if (i) {
+			p->tx_desc[i - 1].next = &p->tx_desc[i];
+			p->rx_desc[i - 1].next = &p->rx_desc[i];
+		}
+	}
+
+	if (!p->cs_active) {
+		ssp_drv_cs_activate(p->dev);
+		p->cs_active = true;
+	}
+
+	/* Receive first. The DMA service starts requests in order, so the
+	 * receive side has a channel by the time the first byte is clocked */
+	p->tx_result = WM_SUCCESS;
+	dma_svc_submit(&p->rx_req);
+	dma_svc_submit(&p->tx_req);
+}
+
+static void ssp_dma_tx_done(int result, void *arg)
+{
+	struct ssp_dma_port *p = arg;
+
+	p->tx_result = result;
+}
+
+/* The receive side ends last, it ends the transaction */
+static void ssp_dma_rx_done(int result, void *arg)
+{
+	struct ssp_dma_port *p = arg;
+	ssp_dma_xfer_t *xfer = p->cur, *next;
+	uint32_t primask;
+
+	if (result == WM_SUCCESS)
+		result = p->tx_result;
+
+	if (!xfer->cs_hold) {
+		ssp_drv_cs_deactivate(p->dev);
+		p->cs_active = false;
+	}
+
+	primask = ssp_dma_lock();
+	next = p->head;
+	if (next) {
+		p->head = next->next;
+		if (!p->head)
+			p->tail = NULL;
+		next->next = NULL;
+	}
+	p->cur = next;
+	ssp_dma_unlock(primask);
+
+	if (next)
+		ssp_dma_start(p, next);
+
+	if (xfer->cb)
+		xfer->cb(result, xfer->arg);
+}
+
+int ssp_dma_init(mdev_t *dev, SSP_ID_Type id)
+{
+	static const DMA_PerMapping_Type tx_per[SSP_DMA_NPORTS] = {
+		DMA_PER11_SSP0_TX, DMA_PER13_SSP1_TX, DMA_PER41_SSP2_TX,
+	};
+	static const DMA_PerMapping_Type rx_per[SSP_DMA_NPORTS] = {
+		DMA_PER10_SSP0_RX, DMA_PER12_SSP1_RX, DMA_PER40_SSP2_RX,
+	};
+	struct ssp_dma_port *p;
+	SSP_FIFO_Type fifo = {
+		.fifoPackMode = DISABLE,
+		.rxFifoFullLevel = 1,
+		.txFifoEmptyLevel = 8,
+		.rxDmaService = ENABLE,
+		.txDmaService = ENABLE,
+	};
+
+	if (!dev || id > SSP2_ID)
+		return -WM_E_INVAL;
+	p = &ssp_dma_ports[id];
+	if (p->cur)
+		return -WM_E_INVAL;
+
+	if (dma_svc_init(2) != WM_SUCCESS || dma_svc_nchans() < 2)
+		return -WM_FAIL;
+
+	p->dev = dev;
+	p->regs = (id == SSP0_ID) ? SSP0 : (id == SSP1_ID) ? SSP1 : SSP2;
+	p->tx_per = tx_per[id];
+	p->rx_per = rx_per[id];
+	p->cs_active = false;
+	p->head = p->tail = NULL;
+	p->tx_req.desc = p->tx_desc;
+	p->tx_req.cb = ssp_dma_tx_done;
+	p->tx_req.arg = p;
+	p->rx_req.desc = p->rx_desc;
+	p->rx_req.cb = ssp_dma_rx_done;
+	p->rx_req.arg = p;
+
+	SSP_IntMask(id, SSP_INT_ALL, MASK);
+	SSP_Disable(id);
+	SSP_FifoConfig(id, &fifo);
+	SSP_Enable(id);
+	return WM_SUCCESS;
+}
+
+int ssp_dma_submit(SSP_ID_Type id, ssp_dma_xfer_t *xfer)
+{
+	struct ssp_dma_port *p;
+	uint32_t primask;
+	bool start;
+
+	if (id > SSP2_ID || !xfer || !xfer->len ||
+	    xfer->len > SSP_DMA_MAX_LEN)
+		return -WM_E_INVAL;
+	p = &ssp_dma_ports[id];
+	if (!p->dev)
+		return -WM_E_INVAL;
+
+	xfer->next = NULL;
+	primask = ssp_dma_lock();
+	start = !p->cur;
+	if (start) {
+		p->cur = xfer;
+	} else {
+		if (p->tail)
+			p->tail->next = xfer;
+		else
+			p->head = xfer;
+		p->tail = xfer;
+	}
+	ssp_dma_unlock(primask);
+
+	if (start)
+		ssp_dma_start(p, xfer);
+	return WM_SUCCESS;
+}
+
+bool ssp_dma_idle(SSP_ID_Type id)
+{
+	if (id > SSP2_ID)
+		return true;
+	return ssp_dma_ports[id].cur == NULL;
+}
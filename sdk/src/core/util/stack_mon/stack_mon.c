@@ -0,0 +1,140 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <stack_mon.h>
+
+#define stack_mon_w(...) wmlog_w("stack_mon", ##__VA_ARGS__)
+
+struct stack_mon_task {
+	struct stack_mon_entry e;
+	/* Unique for every task created, handles are reused */
+	UBaseType_t number;
+	bool warned;
+};
+
+static struct stack_mon_task stack_mon_table[STACK_MON_MAX_TASKS];
+static int stack_mon_cnt;
+static uint32_t stack_mon_warn;
+static os_timer_t stack_mon_timer;
+
+static struct stack_mon_task *stack_mon_find(const TaskStatus_t *t)
+{
+	int i;
+
+	for (i = 0; i < stack_mon_cnt; i++)
+		if (stack_mon_table[i].number == t->xTaskNumber)
+			return &stack_mon_table[i];
+	if (stack_mon_cnt == STACK_MON_MAX_TASKS)
+		return NULL;
+
+	i = stack_mon_cnt++;
+	strncpy(stack_mon_table[i].e.name, t->pcTaskName,
+		STACK_MON_NAME_LEN - 1);
+	stack_mon_table[i].number = t->xTaskNumber;
+	return &stack_mon_table[i];
+}
+
+void stack_mon_sample(void)
+{
+	TaskStatus_t *status;
+	UBaseType_t count, i;
+	struct stack_mon_task *m;
+	int j;
+
+	/* Leave room for tasks created before the scheduler is suspended */
+	count = uxTaskGetNumberOfTasks() + 2;
+	status = os_mem_alloc(count * sizeof(TaskStatus_t));
+	if (!status)
+		return;
+
+	/* Walking the stacks of all the tasks takes a while, it is done
+	 * before the table is locked */
+	count = uxTaskGetSystemState(status, count, NULL);
+
+	vTaskSuspendAll();
+	for (j = 0; j < stack_mon_cnt; j++)
+		stack_mon_table[j].e.alive = false;
+	for (i = 0; i < count; i++) {
+		m = stack_mon_find(&status[i]);
+		if (!m)
+			continue;
+		m->e.min_free = status[i].usStackHighWaterMark *
+			sizeof(StackType_t);
+		m->e.priority = status[i].uxBasePriority;
+		m->e.alive = true;
+	}
+	xTaskResumeAll();
+	os_mem_free(status);
+
+	for (j = 0; j < stack_mon_cnt; j++) {
+		m = &stack_mon_table[j];
+		if (m->e.alive && !m->warned && m->e.min_free < stack_mon_warn) {
+			stack_mon_w("%s: %u bytes of stack left", m->e.name,
+				    m->e.min_free);
+			m->warned = true;
+		}
+	}
+}
+
+static void stack_mon_cb(os_timer_arg_t arg)
+{
+	stack_mon_sample();
+}
+
+int stack_mon_start(uint32_t interval_ms, uint32_t warn_bytes)
+{
+	if (stack_mon_timer)
+		return -WM_E_INVAL;
+
+	stack_mon_warn = warn_bytes;
+	if (os_timer_create(&stack_mon_timer, "stack-mon",
+			    os_msec_to_ticks(interval_ms), stack_mon_cb, NULL,
+			    OS_TIMER_PERIODIC, OS_TIMER_AUTO_ACTIVATE)
+	    != WM_SUCCESS) {
+		stack_mon_timer = NULL;
+		return -WM_FAIL;
+	}
+	/* Sampling a little late costs nothing, share wake ups */
+	os_timer_set_slack(&stack_mon_timer,
+			   os_msec_to_ticks(interval_ms) / 8);
+	stack_mon_sample();
+	return WM_SUCCESS;
+}
+
+void stack_mon_stop(void)
+{
+	if (!stack_mon_timer)
+		return;
+	os_timer_delete(&stack_mon_timer);
+	stack_mon_timer = NULL;
+}
+
+int stack_mon_get(struct stack_mon_entry *entries, int max)
+{
+	int i;
+
+	vTaskSuspendAll();
+	for (i = 0; i < stack_mon_cnt && i < max; i++)
+		entries[i] = stack_mon_table[i].e;
+	xTaskResumeAll();
+	return i;
+}
+
+int stack_mon_json(struct json_writer *w, const char *key)
+{
+	int i, n = stack_mon_cnt;
+
+	/* Not locked, the writer may block in its flush callback. Entries are
+	 * only ever added and a sample is a single word */
+	json_writer_start_object(w, key);
+	for (i = 0; i < n; i++)
+		json_writer_add_uint(w, stack_mon_table[i].e.name,
+				     stack_mon_table[i].e.min_free);
+	return json_writer_end_object(w);
+}
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The differences are taken in unsigned 32 bit arithmetic, they wrap the
+ * same way in the decoder so that any pair of values round trips.
+ */
+
+#include <string.h>
+#include <wmerrno.h>
+#include <ts_codec.h>
+
+static inline uint32_t zigzag(uint32_t v)
+{
+	return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t v)
+{
+	return (v >> 1) ^ -(v & 1);
+}
+
+/* Returns the position after the varint or NULL if it does not fit */
+static uint8_t *put_varint(uint8_t *p, const uint8_t *end, uint32_t v)
+{
+	while (v >= 0x80) {
+		if (p == end)
+			return NULL;
+		*p++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	if (p == end)
+		return NULL;
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+/* Returns the position after the varint or NULL if it is cut short */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+				 uint32_t *v)
+{
+	int shift;
+
+	*v = 0;
+	for (shift = 0; shift < 35; shift += 7) {
+		if (p == end)
+			return NULL;
+		*v |= (uint32_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+	}
+	return NULL;
+}
+
+int ts_enc_init(struct ts_enc *enc, void *buf, size_t size, int channels)
+{
+	if (channels < 1 || channels > TS_CODEC_MAX_CHANNELS)
+		return -WM_E_INVAL;
+	if (size < TS_CODEC_HEADER_LEN)
+		return -WM_E_NOSPC;
+
+	memset(enc, 0, sizeof(*enc));
+	enc->buf = buf;
+	enc->size = size;
+	enc->channels = channels;
+	enc->buf[0] = 'T';
+	enc->buf[1] = 'S';
+	enc->buf[2] = TS_CODEC_VERSION;
+	enc->buf[3] = channels;
+	enc->len = TS_CODEC_HEADER_LEN;
+	return WM_SUCCESS;
+}
+
+int ts_enc_add(struct ts_enc *enc, uint32_t t, const int32_t *values)
+{
+	uint8_t *p = enc->buf + enc->len;
+	const uint8_t *end = enc->buf + enc->size;
+	uint32_t dt = t - enc->t;
+	int i;
+
+	if (enc->n == TS_CODEC_MAX_SAMPLES)
+		return -WM_E_NOSPC;
+
+	if (enc->n == 0)
+		p = put_varint(p, end, t);
+	else if (enc->n == 1)
+		p = put_varint(p, end, zigzag(dt));
+	else
+		p = put_varint(p, end, zigzag(dt - enc->dt));
+	for (i = 0; i < enc->channels && p; i++)
+		p = put_varint(p, end, zigzag((uint32_t)values[i] -
+					      (uint32_t)enc->v[i]));
+	if (!p)
+		return -WM_E_NOSPC;
+
+	enc->len = p - enc->buf;
+	if (enc->n)
+		enc->dt = dt;
+	enc->t = t;
+	memcpy(enc->v, values, enc->channels * sizeof(values[0]));
+	enc->n++;
+	return WM_SUCCESS;
+}
+
+size_t ts_enc_finish(struct ts_enc *enc)
+{
+	enc->buf[4] = enc->n >> 8;
+	enc->buf[5] = enc->n & 0xff;
+	return enc->len;
+}
+
+int ts_dec_init(struct ts_dec *dec, const void *buf, size_t len)
+{
+	const uint8_t *b = buf;
+
+	if (len < TS_CODEC_HEADER_LEN || b[0] != 'T' || b[1] != 'S' ||
+	    b[2] != TS_CODEC_VERSION || b[3] < 1 ||
+	    b[3] > TS_CODEC_MAX_CHANNELS)
+		return -WM_E_INVAL;
+
+	memset(dec, 0, sizeof(*dec));
+	dec->p = b + TS_CODEC_HEADER_LEN;
+	dec->end = b + len;
+	dec->channels = b[3];
+	dec->n = (b[4] << 8) | b[5];
+	return dec->channels;
+}
+
+int ts_dec_next(struct ts_dec *dec, uint32_t *t, int32_t *values)
+{
+	const uint8_t *p = dec->p;
+	uint32_t v;
+	int i;
+
+	if (dec->i == dec->n)
+		return 0;
+
+	p = get_varint(p, dec->end, &v);
+	if (!p)
+		return -WM_E_INVAL;
+	if (dec->i == 0) {
+		dec->t = v;
+	} else {
+		if (dec->i == 1)
+			dec->dt = unzigzag(v);
+		else
+			dec->dt += unzigzag(v);
+		dec->t += dec->dt;
+	}
+	for (i = 0; i < dec->channels; i++) {
+		p = get_varint(p, dec->end, &v);
+		if (!p)
+			return -WM_E_INVAL;
+		dec->v[i] = (int32_t)((uint32_t)dec->v[i] + unzigzag(v));
+	}
+
+	dec->p = p;
+	dec->i++;
+	*t = dec->t;
+	memcpy(values, dec->v, dec->channels * sizeof(values[0]));
+	return 1;
+}
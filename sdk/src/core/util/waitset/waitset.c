@@ -0,0 +1,245 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The queue set holds one entry per message or token of its members, in
+ * the order they were posted. The sockets share a binary semaphore member:
+ * a socket callback sets the bit of the socket and gives it, when the
+ * semaphore comes out of the set one ready socket is reported and, if
+ * others are ready too, the semaphore is given again. It then queues up
+ * behind the events posted meanwhile, so a busy socket does not starve the
+ * queues.
+ *
+ * The socket callbacks run in the TCP/IP thread with the lwIP protection
+ * held, they only use calls that are safe with interrupts masked.
+ */
+
+#include <string.h>
+#include <lwip/sockets.h>
+#include <lwip/api.h>
+#include <wmerrno.h>
+#include <waitset.h>
+
+static struct waitset_member *waitset_slot(waitset_t *ws)
+{
+	int i;
+
+	for (i = 0; i < WAITSET_MAX_MEMBERS; i++)
+		if (ws->members[i].type == WAITSET_NONE)
+			return &ws->members[i];
+	return NULL;
+}
+
+static struct waitset_member *waitset_find(waitset_t *ws, void *handle)
+{
+	int i;
+
+	for (i = 0; i < WAITSET_MAX_MEMBERS; i++)
+		if ((ws->members[i].type == WAITSET_QUEUE ||
+		     ws->members[i].type == WAITSET_SEMAPHORE) &&
+		    *(QueueHandle_t *)ws->members[i].handle == handle)
+			return &ws->members[i];
+	return NULL;
+}
+
+static int waitset_find_socket(waitset_t *ws, int sock)
+{
+	int i;
+
+	for (i = 0; i < WAITSET_MAX_MEMBERS; i++)
+		if (ws->members[i].type == WAITSET_SOCKET &&
+		    ws->members[i].sock == sock)
+			return i;
+	return -1;
+}
+
+static void waitset_sock_cb(int sock, void *arg)
+{
+	waitset_t *ws = arg;
+	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+	unsigned long state;
+	int i = waitset_find_socket(ws, sock);
+
+	if (i < 0)
+		return;
+	state = os_mask_syscall_interrupts();
+	ws->sock_ready |= 1 << i;
+	os_unmask_syscall_interrupts(state);
+	xSemaphoreGiveFromISR(ws->sock_sem, &xHigherPriorityTaskWoken);
+	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+int waitset_create(waitset_t *ws, unsigned events)
+{
+	if (!events)
+		return -WM_E_INVAL;
+
+	memset(ws, 0, sizeof(*ws));
+	ws->set = xQueueCreateSet(events + 1);
+	if (!ws->set)
+		return -WM_E_NOMEM;
+	if (os_semaphore_create(&ws->sock_sem, "waitset") != WM_SUCCESS) {
+		vQueueDelete(ws->set);
+		return -WM_E_NOMEM;
+	}
+	/* A binary semaphore is created given, it can not join a set so */
+	os_semaphore_get(&ws->sock_sem, OS_NO_WAIT);
+	xQueueAddToSet(ws->sock_sem, ws->set);
+	return WM_SUCCESS;
+}
+
+void waitset_delete(waitset_t *ws)
+{
+	struct waitset_member *m;
+	int i;
+
+	for (i = 0; i < WAITSET_MAX_MEMBERS; i++) {
+		m = &ws->members[i];
+		if (m->type == WAITSET_SOCKET)
+			waitset_remove_socket(ws, m->sock);
+		else if (m->type != WAITSET_NONE)
+			xQueueRemoveFromSet(*(QueueHandle_t *)m->handle,
+					    ws->set);
+	}
+	os_semaphore_get(&ws->sock_sem, OS_NO_WAIT);
+	xQueueRemoveFromSet(ws->sock_sem, ws->set);
+	os_semaphore_delete(&ws->sock_sem);
+	vQueueDelete(ws->set);
+}
+
+static int waitset_add(waitset_t *ws, void *handle, enum waitset_type type)
+{
+	struct waitset_member *m = waitset_slot(ws);
+
+	if (!m)
+		return -WM_E_NOSPC;
+	if (xQueueAddToSet(*(QueueHandle_t *)handle, ws->set) != pdPASS)
+		return -WM_FAIL;
+	m->handle = handle;
+	m->type = type;
+	return WM_SUCCESS;
+}
+
+int waitset_add_queue(waitset_t *ws, os_queue_t *queue)
+{
+	return waitset_add(ws, queue, WAITSET_QUEUE);
+}
+
+int waitset_add_semaphore(waitset_t *ws, os_semaphore_t *sem)
+{
+	return waitset_add(ws, sem, WAITSET_SEMAPHORE);
+}
+
+int waitset_add_socket(waitset_t *ws, int sock)
+{
+	struct waitset_member *m = waitset_slot(ws);
+
+	if (!m)
+		return -WM_E_NOSPC;
+	m->sock = sock;
+	m->type = WAITSET_SOCKET;
+	lwip_register_recv_cb(sock, waitset_sock_cb, ws);
+	/* Data may have come before the callback was there */
+	waitset_sock_cb(sock, ws);
+	return WM_SUCCESS;
+}
+
+int waitset_remove(waitset_t *ws, void *handle)
+{
+	struct waitset_member *m = waitset_find(ws, *(QueueHandle_t *)handle);
+
+	if (!m)
+		return -WM_E_INVAL;
+	if (xQueueRemoveFromSet(*(QueueHandle_t *)handle, ws->set) != pdPASS)
+		return -WM_FAIL;
+	m->type = WAITSET_NONE;
+	return WM_SUCCESS;
+}
+
+int waitset_remove_socket(waitset_t *ws, int sock)
+{
+	unsigned long state;
+	int i = waitset_find_socket(ws, sock);
+
+	if (i < 0)
+		return -WM_E_INVAL;
+	lwip_register_recv_cb(sock, NULL, NULL);
+	state = os_mask_syscall_interrupts();
+	ws->sock_ready &= ~(1 << i);
+	ws->members[i].type = WAITSET_NONE;
+	os_unmask_syscall_interrupts(state);
+	return WM_SUCCESS;
+}
+
+/* Takes a ready socket, false if there is none */
+static bool waitset_take_socket(waitset_t *ws, waitset_event_t *ev)
+{
+	unsigned long state;
+	uint32_t ready;
+	int i;
+
+	state = os_mask_syscall_interrupts();
+	ready = ws->sock_ready;
+	if (!ready) {
+		os_unmask_syscall_interrupts(state);
+		return false;
+	}
+	i = __builtin_ctz(ready);
+	ws->sock_ready = ready & ~(1 << i);
+	os_unmask_syscall_interrupts(state);
+
+	/* The other ready sockets go behind the events queued meanwhile */
+	if (ready & ~(1 << i))
+		os_semaphore_put(&ws->sock_sem);
+
+	ev->type = WAITSET_SOCKET;
+	ev->sock = ws->members[i].sock;
+	return true;
+}
+
+/* Ticks left of a wait of wait_time that started at start */
+static unsigned long waitset_left(unsigned long wait_time, unsigned start)
+{
+	unsigned spent;
+
+	if (wait_time == OS_WAIT_FOREVER)
+		return wait_time;
+	spent = os_ticks_get() - start;
+	return spent >= wait_time ? 0 : wait_time - spent;
+}
+
+int waitset_wait(waitset_t *ws, waitset_event_t *ev, unsigned long wait)
+{
+	unsigned start = os_ticks_get();
+	QueueSetMemberHandle_t member;
+	struct waitset_member *m;
+
+	memset(ev, 0, sizeof(*ev));
+	for (;;) {
+		member = xQueueSelectFromSet(ws->set, waitset_left(wait, start));
+		if (!member)
+			return -WM_FAIL;
+
+		if (member == ws->sock_sem) {
+			os_semaphore_get(&ws->sock_sem, OS_NO_WAIT);
+			if (waitset_take_socket(ws, ev))
+				return WM_SUCCESS;
+			continue;
+		}
+
+		/* Not found if it was removed since */
+		m = waitset_find(ws, member);
+		if (!m)
+			continue;
+		ev->type = m->type;
+		if (m->type == WAITSET_SEMAPHORE) {
+			ev->sem = m->handle;
+			os_semaphore_get(ev->sem, OS_NO_WAIT);
+		} else {
+			ev->queue = m->handle;
+		}
+		return WM_SUCCESS;
+	}
+}
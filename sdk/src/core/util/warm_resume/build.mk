@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libwarm_resume
+libwarm_resume-objs-y := warm_resume.c
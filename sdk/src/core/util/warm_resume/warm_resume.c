@@ -0,0 +1,166 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The records follow each other in the data of the snapshot, each a tag, a
+ * length and the state of its client padded to a word. The header is
+ * checked against a CRC of the records, since a reset other than the
+ * wake-up may have come in the middle of a save.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <crc32.h>
+#include <mw300_rtc.h>
+#include <mw300_pmu.h>
+#include <warm_resume.h>
+
+#define WARM_RESUME_MAGIC 0x4d525257
+
+#define wr_w(...) wmlog_w("warm", ##__VA_ARGS__)
+
+struct wr_record {
+	uint16_t tag;
+	uint16_t len;
+};
+
+#define WR_PAD(len) (((len) + 3) & ~3)
+
+/* In the retention RAM, zeroed at power on and kept in PM4 */
+struct warm_resume_nv {
+	uint32_t magic;		/* Written last */
+	uint32_t len;
+	uint32_t crc;		/* Of the records */
+	/* RTC counter and its upper value at the save */
+	uint32_t rtc;
+	uint32_t upp;
+	uint8_t data[WARM_RESUME_SIZE];
+};
+
+static struct warm_resume_nv warm_resume_nv
+	__attribute__((section(".nvram")));
+
+static const struct warm_resume_client *wr_clients[WARM_RESUME_MAX_CLIENTS];
+static int wr_nclients;
+static bool wr_warm;
+
+static uint32_t wr_since_ms(void)
+{
+	uint32_t now = RTC_GetCounterVal();
+	uint64_t counts;
+
+	if (now >= warm_resume_nv.rtc)
+		counts = now - warm_resume_nv.rtc;
+	else
+		counts = (uint64_t)(warm_resume_nv.upp - warm_resume_nv.rtc) +
+			now + 1;
+	return counts * 1000 / WARM_RESUME_RTC_HZ;
+}
+
+bool warm_resume_init(void)
+{
+	if (warm_resume_nv.magic != WARM_RESUME_MAGIC)
+		return wr_warm;
+	/* Used once, whatever it holds */
+	warm_resume_nv.magic = 0;
+
+	if (RTC_GetCntStatus() != ENABLE ||
+	    (PMU_GetLastWakeupStatus(PMU_WAKEUP_RTC) != SET &&
+	     PMU_GetLastWakeupStatus(PMU_WAKEUP_ULPCOMP) != SET))
+		return wr_warm;
+	fast_crc32_init();
+	if (warm_resume_nv.len > WARM_RESUME_SIZE ||
+	    fast_crc32(warm_resume_nv.data, warm_resume_nv.len, 0) !=
+	    warm_resume_nv.crc) {
+		wr_w("Snapshot corrupt, cold boot");
+		return wr_warm;
+	}
+	wr_warm = true;
+	return wr_warm;
+}
+
+bool warm_resume_is_warm(void)
+{
+	return wr_warm;
+}
+
+static void wr_restore(const struct warm_resume_client *client)
+{
+	const struct wr_record *r;
+	uint32_t off = 0;
+
+	while (off + sizeof(*r) <= warm_resume_nv.len) {
+		r = (const struct wr_record *)&warm_resume_nv.data[off];
+		off += sizeof(*r);
+		if (r->len > warm_resume_nv.len - off)
+			return;
+		if (r->tag == client->tag) {
+			client->restore(&warm_resume_nv.data[off], r->len,
+					wr_since_ms());
+			return;
+		}
+		off += WR_PAD(r->len);
+	}
+}
+
+int warm_resume_register(const struct warm_resume_client *client)
+{
+	int i;
+
+	if (!client || !client->save || !client->restore)
+		return -WM_E_INVAL;
+	for (i = 0; i < wr_nclients; i++)
+		if (wr_clients[i]->tag == client->tag)
+			return -WM_E_INVAL;
+	if (wr_nclients == WARM_RESUME_MAX_CLIENTS)
+		return -WM_E_NOSPC;
+	wr_clients[wr_nclients++] = client;
+
+	if (wr_warm)
+		wr_restore(client);
+	return WM_SUCCESS;
+}
+
+int warm_resume_save(void)
+{
+	struct wr_record *r;
+	uint32_t off = 0;
+	int i, len;
+
+	if (RTC_GetCntStatus() != ENABLE)
+		return -WM_FAIL;
+
+	/* The records of a warm boot are restored by now */
+	warm_resume_nv.magic = 0;
+	wr_warm = false;
+	for (i = 0; i < wr_nclients; i++) {
+		if (WARM_RESUME_SIZE - off < sizeof(*r))
+			break;
+		r = (struct wr_record *)&warm_resume_nv.data[off];
+		len = wr_clients[i]->save(&warm_resume_nv.data[off + sizeof(*r)],
+					  WARM_RESUME_SIZE - off - sizeof(*r));
+		if (len < 0 || len > UINT16_MAX ||
+		    (uint32_t)len > WARM_RESUME_SIZE - off - sizeof(*r)) {
+			wr_w("State of %u not kept: %d", wr_clients[i]->tag,
+			     len);
+			continue;
+		}
+		r->tag = wr_clients[i]->tag;
+		r->len = len;
+		off = WR_PAD(off + sizeof(*r) + len);
+		if (off > WARM_RESUME_SIZE)
+			off = WARM_RESUME_SIZE;
+	}
+
+	fast_crc32_init();
+	warm_resume_nv.len = off;
+	warm_resume_nv.crc = fast_crc32(warm_resume_nv.data, off, 0);
+	warm_resume_nv.upp = RTC_GetCounterUppVal();
+	warm_resume_nv.rtc = RTC_GetCounterVal();
+	warm_resume_nv.magic = WARM_RESUME_MAGIC;
+	return WM_SUCCESS;
+}
@@ -0,0 +1,5 @@
+# Copyright (C) 2008-2016, Marvell International Ltd.
+# All Rights Reserved.
+
+libs-y += libwlan_roam
+libwlan_roam-objs-y := wlan_roam.c
@@ -0,0 +1,222 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * The thread reads the signal every check_ms and keeps an average of about
+ * four reads, so that one weak beacon does not start a roam. A roam is a
+ * disconnect and a connect to the network profile of the configuration,
+ * the connection manager scans and associates again without waiting for
+ * the beacon loss.
+ *
+ * Only the calls of the connection manager whose arguments are plain
+ * scalars are used. The network profiles and the scan results are structs
+ * of the wlan.h of the SDK library, which is not in this tree.
+ */
+
+#include <string.h>
+#include <wm_os.h>
+#include <wmlog.h>
+#include <wmerrno.h>
+#include <lwip/netif.h>
+#include <wlan_roam.h>
+
+/* WLAN connection manager, in the SDK library */
+bool is_sta_connected(void);
+int wlan_get_current_rssi(short *rssi);
+int wlan_connect(char *name);
+int wlan_disconnect(void);
+
+#define roam_d(...) wmlog("roam", ##__VA_ARGS__)
+#define roam_w(...) wmlog_w("roam", ##__VA_ARGS__)
+
+#define ROAM_POLL_MS 50
+#define ROAM_NAME_MAX 32
+
+static struct {
+	struct wlan_roam_config cfg;
+	char network[ROAM_NAME_MAX + 1];
+	bool enabled;
+	bool started;
+	volatile bool in_progress;
+	wlan_roam_cb_t cb;
+	struct wlan_roam_stats stats;
+	/* Average signal, valid once read after a (re)connection */
+	short avg;
+	bool avg_valid;
+	unsigned roam_ticks;
+	bool roamed;
+	/* A roam left the station disconnected, and since when */
+	bool down;
+	unsigned down_ticks;
+} roam;
+
+static os_thread_t roam_thread;
+static os_thread_stack_define(roam_stack, 1024);
+
+/* Address of the station, read from its netif */
+static uint32_t roam_ip(void)
+{
+	struct netif *netif = netif_default;
+
+	return netif ? ip4_addr_get_u32(&netif->ip_addr) : 0;
+}
+
+static void roam_notify(bool done, bool ok, bool ip_kept)
+{
+	wlan_roam_cb_t cb = roam.cb;
+
+	if (cb)
+		cb(done, ok, ip_kept);
+}
+
+/* Connected to the network after it left it, within the timeout. The
+ * disconnect the roam starts with is only seen once the connection manager
+ * ran it */
+static bool roam_wait_connected(void)
+{
+	unsigned start = os_ticks_get();
+	unsigned timeout = os_msec_to_ticks(roam.cfg.connect_timeout_ms);
+	bool left = false;
+
+	while (os_ticks_get() - start < timeout) {
+		if (!is_sta_connected())
+			left = true;
+		else if (left)
+			return true;
+		os_thread_sleep(os_msec_to_ticks(ROAM_POLL_MS));
+	}
+	return false;
+}
+
+static void roam_reconnect(void)
+{
+	uint32_t old_ip;
+	unsigned start;
+	short rssi;
+	bool ok, ip_kept;
+
+	roam_d("%d dBm, associating again", roam.avg);
+	old_ip = roam_ip();
+	roam.in_progress = true;
+	roam_notify(false, false, false);
+	start = os_ticks_get();
+
+	wlan_disconnect();
+	ok = wlan_connect(roam.network) == WM_SUCCESS && roam_wait_connected();
+	if (ok) {
+		roam.stats.roams++;
+		if (wlan_get_current_rssi(&rssi) == WM_SUCCESS &&
+		    rssi > roam.avg)
+			roam.stats.improved++;
+		roam.down = false;
+	} else {
+		roam_w("not connected again to %s", roam.network);
+		roam.stats.failed++;
+		roam.down = true;
+		roam.down_ticks = os_ticks_get();
+	}
+
+	roam.stats.last_gap_ms = os_ticks_to_msec(os_ticks_get() - start);
+	ip_kept = ok && roam_ip() == old_ip;
+	if (ok && !ip_kept)
+		roam.stats.ip_changed++;
+	roam.avg_valid = false;
+	roam.in_progress = false;
+	roam_notify(true, ok, ip_kept);
+}
+
+/* The connection manager does not retry a connect that failed, the thread
+ * does until the station is back */
+static void roam_check_down(void)
+{
+	if (!roam.down || os_ticks_get() - roam.down_ticks <
+	    os_msec_to_ticks(roam.cfg.connect_timeout_ms))
+		return;
+
+	roam_w("still not connected, again to %s", roam.network);
+	roam.down_ticks = os_ticks_get();
+	wlan_connect(roam.network);
+}
+
+static void roam_check(void)
+{
+	short rssi;
+
+	if (!is_sta_connected()) {
+		roam.avg_valid = false;
+		roam_check_down();
+		return;
+	}
+	roam.down = false;
+
+	if (wlan_get_current_rssi(&rssi) != WM_SUCCESS)
+		return;
+	roam.avg = roam.avg_valid ? (3 * roam.avg + rssi) / 4 : rssi;
+	roam.avg_valid = true;
+	if (roam.avg >= roam.cfg.trigger_rssi)
+		return;
+	if (roam.roamed && os_ticks_get() - roam.roam_ticks <
+	    os_msec_to_ticks(roam.cfg.roam_interval_ms))
+		return;
+
+	roam.roamed = true;
+	roam.roam_ticks = os_ticks_get();
+	roam_reconnect();
+}
+
+static void roam_main(os_thread_arg_t arg)
+{
+	while (1) {
+		os_thread_sleep(os_msec_to_ticks(roam.cfg.check_ms));
+		if (roam.enabled)
+			roam_check();
+	}
+}
+
+int wlan_roam_start(const struct wlan_roam_config *cfg)
+{
+	static const struct wlan_roam_config def = WLAN_ROAM_CONFIG_DEFAULT;
+
+	if (!cfg)
+		cfg = &def;
+	if (!cfg->check_ms || !cfg->network ||
+	    strlen(cfg->network) > ROAM_NAME_MAX)
+		return -WM_E_INVAL;
+
+	roam.cfg = *cfg;
+	strcpy(roam.network, cfg->network);
+	roam.cfg.network = roam.network;
+	roam.enabled = true;
+	if (roam.started)
+		return WM_SUCCESS;
+
+	if (os_thread_create(&roam_thread, "roam", roam_main, NULL,
+			     &roam_stack, OS_PRIO_3) != WM_SUCCESS) {
+		roam.enabled = false;
+		return -WM_FAIL;
+	}
+	roam.started = true;
+	return WM_SUCCESS;
+}
+
+void wlan_roam_stop(void)
+{
+	roam.enabled = false;
+}
+
+bool wlan_roam_in_progress(void)
+{
+	return roam.in_progress;
+}
+
+void wlan_roam_set_callback(wlan_roam_cb_t cb)
+{
+	roam.cb = cb;
+}
+
+void wlan_roam_get_stats(struct wlan_roam_stats *stats)
+{
+	*stats = roam.stats;
+}
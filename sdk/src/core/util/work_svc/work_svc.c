@@ -0,0 +1,267 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+/*
+ * Each lane keeps its waiting jobs in a list sorted by due tick, the thread
+ * sleeps on its task notification until the head falls due. A submit that
+ * puts a job at the head notifies the thread so that it sleeps for the new
+ * head. The thread looks at the head again before every sleep, so a wakeup
+ * taken by a job that waits on its own notification is not lost. The
+ * lists are changed with interrupts masked, so that interrupt handlers can
+ * submit.
+ */
+
+#include <stddef.h>
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <wmlog.h>
+#include <work_svc.h>
+
+#define work_w(...) wmlog_w("work", ##__VA_ARGS__)
+
+enum {
+	WORK_IDLE,
+	WORK_WAITING,
+};
+
+struct work_lane_state {
+	work_t *head;
+	/* Job the thread runs */
+	work_t *current;
+	os_thread_t thread;
+	work_lane_stats_t stats;
+};
+
+static struct work_lane_state work_lanes[WORK_LANES];
+static bool work_started;
+
+static os_thread_stack_define(work_stack_high, WORK_SVC_STACK_SIZE);
+static os_thread_stack_define(work_stack_normal, WORK_SVC_STACK_SIZE);
+static os_thread_stack_define(work_stack_low, WORK_SVC_STACK_SIZE);
+
+static const struct {
+	const char *name;
+	os_thread_stack_t *stack;
+	int prio;
+} work_lane_cfg[WORK_LANES] = {
+	[WORK_LANE_HIGH] = {"work-high", &work_stack_high, OS_PRIO_1},
+	[WORK_LANE_NORMAL] = {"work-normal", &work_stack_normal, OS_PRIO_2},
+	[WORK_LANE_LOW] = {"work-low", &work_stack_low, OS_PRIO_4},
+};
+
+static unsigned long work_lock(void)
+{
+	return os_mask_syscall_interrupts();
+}
+
+static void work_unlock(unsigned long state)
+{
+	os_unmask_syscall_interrupts(state);
+}
+
+/* Behind the jobs due at the same tick, they run in the order submitted.
+ * Returns true if the job is the new head */
+static bool work_insert(struct work_lane_state *l, work_t *w)
+{
+	work_t **pp = &l->head;
+
+	while (*pp && (int32_t)((*pp)->due - w->due) <= 0)
+		pp = &(*pp)->next;
+	w->next = *pp;
+	*pp = w;
+	w->state = WORK_WAITING;
+	return pp == &l->head;
+}
+
+static void work_remove(struct work_lane_state *l, work_t *w)
+{
+	work_t **pp = &l->head;
+
+	while (*pp && *pp != w)
+		pp = &(*pp)->next;
+	if (*pp)
+		*pp = w->next;
+	w->next = NULL;
+	w->state = WORK_IDLE;
+}
+
+static void work_lane_main(os_thread_arg_t arg)
+{
+	struct work_lane_state *l = arg;
+	unsigned long state, wait;
+	uint32_t now, late;
+	work_t *w;
+
+	for (;;) {
+		state = work_lock();
+		now = os_ticks_get();
+		w = l->head;
+		if (!w || (int32_t)(w->due - now) > 0) {
+			wait = w ? w->due - now : OS_WAIT_FOREVER;
+			work_unlock(state);
+			os_task_notify_take(true, wait);
+			continue;
+		}
+
+		l->head = w->next;
+		w->next = NULL;
+		w->state = WORK_IDLE;
+		l->current = w;
+		late = now - w->due;
+		work_unlock(state);
+
+		l->stats.runs++;
+		late = os_ticks_to_msec(late);
+		if (late > l->stats.max_latency_ms)
+			l->stats.max_latency_ms = late;
+
+		w->fn(w);
+
+		state = work_lock();
+		l->current = NULL;
+		/* Not when it was submitted again or cancelled while it ran */
+		if (w->period && WORK_IDLE == w->state) {
+			w->due += w->period;
+			now = os_ticks_get();
+			if ((int32_t)(w->due - now) <= 0)
+				w->due += ((now - w->due) / w->period + 1) *
+					w->period;
+			work_insert(l, w);
+		}
+		work_unlock(state);
+	}
+}
+
+int work_svc_init(void)
+{
+	int i;
+
+	if (work_started)
+		return WM_SUCCESS;
+
+	for (i = 0; i < WORK_LANES; i++) {
+		struct work_lane_state *l = &work_lanes[i];
+
+		if (os_thread_create(&l->thread, work_lane_cfg[i].name,
+				     work_lane_main, l, work_lane_cfg[i].stack,
+				     work_lane_cfg[i].prio) != WM_SUCCESS)
+			goto fail;
+	}
+	work_started = true;
+	return WM_SUCCESS;
+
+fail:
+	work_w("lane %d could not be started", i);
+	while (--i >= 0)
+		os_thread_delete(&work_lanes[i].thread);
+	return -WM_FAIL;
+}
+
+void work_init(work_t *w, work_fn_t fn, void *arg, enum work_lane lane)
+{
+	w->next = NULL;
+	w->fn = fn;
+	w->arg = arg;
+	w->due = 0;
+	w->period = 0;
+	w->lane = lane;
+	w->state = WORK_IDLE;
+}
+
+static int work_post(work_t *w, uint32_t delay_ms, uint32_t period_ms)
+{
+	struct work_lane_state *l;
+	unsigned long state;
+	uint32_t due;
+	bool wake;
+
+	if (!work_started || w->lane >= WORK_LANES)
+		return -WM_E_INVAL;
+	l = &work_lanes[w->lane];
+
+	state = work_lock();
+	due = os_ticks_get() + os_msec_to_ticks(delay_ms);
+	if (period_ms)
+		w->period = os_msec_to_ticks(period_ms);
+	if (WORK_WAITING == w->state) {
+		l->stats.coalesced++;
+		if ((int32_t)(due - w->due) >= 0) {
+			work_unlock(state);
+			return WM_SUCCESS;
+		}
+		work_remove(l, w);
+	}
+	w->due = due;
+	wake = work_insert(l, w);
+	work_unlock(state);
+
+	if (wake)
+		os_task_notify_give(l->thread);
+	return WM_SUCCESS;
+}
+
+int work_submit(work_t *w)
+{
+	return work_post(w, 0, 0);
+}
+
+int work_submit_delayed(work_t *w, uint32_t delay_ms)
+{
+	return work_post(w, delay_ms, 0);
+}
+
+int work_submit_periodic(work_t *w, uint32_t delay_ms, uint32_t period_ms)
+{
+	if (!period_ms)
+		return -WM_E_INVAL;
+	return work_post(w, delay_ms, period_ms);
+}
+
+int work_cancel(work_t *w)
+{
+	struct work_lane_state *l;
+	unsigned long state;
+	int ret = -WM_FAIL;
+
+	if (!work_started || w->lane >= WORK_LANES)
+		return -WM_FAIL;
+	l = &work_lanes[w->lane];
+
+	state = work_lock();
+	w->period = 0;
+	if (WORK_WAITING == w->state) {
+		work_remove(l, w);
+		ret = WM_SUCCESS;
+	}
+	work_unlock(state);
+	return ret;
+}
+
+bool work_pending(work_t *w)
+{
+	unsigned long state;
+	bool pending;
+
+	if (!work_started || w->lane >= WORK_LANES)
+		return false;
+
+	state = work_lock();
+	pending = WORK_WAITING == w->state ||
+		work_lanes[w->lane].current == w;
+	work_unlock(state);
+	return pending;
+}
+
+void work_svc_get_stats(enum work_lane lane, work_lane_stats_t *stats)
+{
+	unsigned long state;
+
+	if (lane >= WORK_LANES)
+		return;
+
+	state = work_lock();
+	*stats = work_lanes[lane].stats;
+	work_unlock(state);
+}
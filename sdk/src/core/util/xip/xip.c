@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#include <wmerrno.h>
+#include <mw300.h>
+#include <mw300_driver.h>
+#include <mw300_flash.h>
+#include <mw300_flashc.h>
+#include <xip.h>
+
+#ifdef CONFIG_XIP_ENABLE
+
+static const FLASHC_HW_CFG_Type xip_hw_cmd[] = {
+	[XIP_READ_FAST] = FLASHC_HW_CMD_FR,
+	[XIP_READ_QUAD_OUT] = FLASHC_HW_CMD_FRQO,
+	[XIP_READ_QUAD_IO] = FLASHC_HW_CMD_FRQIO,
+	[XIP_READ_QUAD_IO_CONT] = FLASHC_HW_CMD_FRQIOC,
+};
+
+/* Nothing can be read from the flash from here to the end, the flash
+ * driver and mw300_flashc.o are linked in SRAM0 as well. The command is
+ * looked up by the caller, xip_hw_cmd[] is in the flash. */
+static __ramfunc int xip_flashc_set(xip_read_mode_t mode,
+				    FLASHC_HW_CFG_Type cmd, bool cache)
+{
+	int ret = WM_SUCCESS;
+
+	__disable_irq();
+
+	/* The flash ignores commands until it leaves continuous read, boot2
+	 * may have left it in it. Harmless if it is not. */
+	FLASHC_ExitQuadContReadStat();
+
+	if (mode != XIP_READ_FAST) {
+		FLASH_SelectInterface(FLASH_INTERFACE_QSPI);
+		/* Sets the quad enable bit of the flash if it needs one */
+		if (FLASH_SetCmdType_QuadModeRead(FLASH_GetJEDECID()) != 0) {
+			cmd = FLASHC_HW_CMD_FR;
+			ret = -WM_FAIL;
+		}
+		FLASH_SelectInterface(FLASH_INTERFACE_FLASHC);
+	}
+
+	FLASHC_HWCfg(cmd);
+	FLASHC_CfgSelection(FLASHC_CFG_HW);
+
+	FLASHC_CacheModeEn(cache ? ENABLE : DISABLE);
+	FLASHC_FlushCache();
+	FLASHC_ResetCacheCnt();
+	if (cache)
+		FLASHC_CacheCntEn();
+
+	__enable_irq();
+	return ret;
+}
+
+int xip_flash_config(const xip_config_t *cfg)
+{
+	if (cfg->read_mode > XIP_READ_QUAD_IO_CONT)
+		return -WM_E_INVAL;
+	return xip_flashc_set(cfg->read_mode, xip_hw_cmd[cfg->read_mode],
+			      cfg->cache);
+}
+
+void xip_cache_stats(uint32_t *hit, uint32_t *miss)
+{
+	FLASHC_GetCacheCnt(hit, miss);
+}
+
+void xip_cache_stats_reset(void)
+{
+	FLASHC_ResetCacheCnt();
+}
+
+#else /* ! CONFIG_XIP_ENABLE */
+
+int xip_flash_config(const xip_config_t *cfg)
+{
+	if (cfg->read_mode > XIP_READ_QUAD_IO_CONT)
+		return -WM_E_INVAL;
+	return WM_SUCCESS;
+}
+
+void xip_cache_stats(uint32_t *hit, uint32_t *miss)
+{
+	*hit = 0;
+	*miss = 0;
+}
+
+void xip_cache_stats_reset(void)
+{
+}
+
+#endif /* CONFIG_XIP_ENABLE */
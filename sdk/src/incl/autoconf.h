@@ -80,8 +80,8 @@
 #define CONFIG_MDNS_MAX_SERVICE_ANNOUNCE 3
 #undef CONFIG_MDNS_QUERY
 #undef CONFIG_DNSSD_QUERY
-#define CONFIG_MDNS_SERVICE_CACHE_SIZE 
-#define CONFIG_MDNS_MAX_SERVICE_MONITORS 
+#define CONFIG_MDNS_SERVICE_CACHE_SIZE 8
+#define CONFIG_MDNS_MAX_SERVICE_MONITORS 4
 #undef CONFIG_XMDNS
 
 /*
@@ -141,6 +141,9 @@
 #define CONFIG_MAX_SOCKETS_TCP 8
 #define CONFIG_MAX_LISTENING_SOCKETS_TCP 4
 #define CONFIG_MAX_SOCKETS_UDP 6
+#undef CONFIG_LWIP_MEM_PROFILE_LOW_MEMORY
+#define CONFIG_LWIP_MEM_PROFILE_BALANCED 1
+#undef CONFIG_LWIP_MEM_PROFILE_THROUGHPUT
 #define CONFIG_TCP_SND_BUF_COUNT 2
 #define CONFIG_TCPIP_STACK_TX_HEAP_SIZE 0
 
@@ -213,6 +216,9 @@
 #define CONFIG_HW_RTC 1
 #undef CONFIG_PROFILER
 #define CONFIG_PROFILER_FUNCTION_CNT 
+#undef CONFIG_CYCLE_TRACE
+#define CONFIG_CYCLE_TRACE_EVENT_CNT 
+#undef CONFIG_ENERGY_STATS
 #undef CONFIG_ENABLE_LTO
 
 /*
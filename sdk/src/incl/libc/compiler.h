@@ -97,6 +97,15 @@
 # define __mallocfunc
 #endif
 
+/* Function kept in SRAM in an XIP image, for code that runs often
+   enough that the flash cache misses show.  Collected in .ram_text by
+   the linker scripts; not inlined, the copy in SRAM is what gets called. */
+#ifdef __GNUC__
+# define __ramfunc __attribute__((section(".ram_text"), noinline))
+#else
+# define __ramfunc
+#endif
+
 /* likely/unlikely */
 #if defined(__GNUC__) && (__GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 95))
 # define __likely(x)   __builtin_expect(!!(x), 1)
@@ -0,0 +1,182 @@
+/*! \file freertos_trace.h
+ * \brief Recording of the FreeRTOS scheduling events
+ *
+ * The trace hooks of the kernel store the context switches, the queue,
+ * semaphore and mutex operations, the blocking on them and the priority
+ * inheritance in a ring buffer in RAM, 12 bytes per event stamped with the
+ * DWT cycle counter. This shows which task ran while another one waited,
+ * for instance the tcp/ip thread, the Wi-Fi driver and the application
+ * threads contending for a mutex.
+ *
+ * The recorder is built in with FREERTOS_TRACE=y on the make command line,
+ * it records from freertos_trace_start(). The ring holds the last
+ * FREERTOS_TRACE_EVENT_CNT events.
+ *
+ * The ring is exported, together with the list of the tasks, either on the
+ * console with freertos_trace_dump() or to a flash region with
+ * freertos_trace_save(). Both write the same binary image, the console as
+ * hexadecimal lines. sdk/tools/bin/rtos_trace.py decodes it:
+ *
+ * @code
+ * $ sdk/tools/bin/rtos_trace.py console.log
+ * $ sdk/tools/bin/rtos_trace.py -b flash_region.bin
+ * $ sdk/tools/bin/rtos_trace.py -j trace.json console.log
+ * @endcode
+ *
+ * The image starts with struct freertos_trace_hdr, followed by the task
+ * records and then by the events, oldest first. All fields are little
+ * endian.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _FREERTOS_TRACE_H_
+#define _FREERTOS_TRACE_H_
+
+#include <stdint.h>
+
+struct flash_desc;
+
+/** Events in the ring */
+#ifndef FREERTOS_TRACE_EVENT_CNT
+#define FREERTOS_TRACE_EVENT_CNT 2048
+#endif
+
+#define FREERTOS_TRACE_MAGIC 0x52545246	/* "FRTR" */
+#define FREERTOS_TRACE_VERSION 1
+
+/** Event types */
+enum freertos_trace_type {
+	/** obj is the task, arg its priority */
+	FREERTOS_TRACE_SWITCH_IN = 1,
+	FREERTOS_TRACE_SWITCH_OUT,
+	/** obj is the queue, arg its queueQUEUE_TYPE_ */
+	FREERTOS_TRACE_QUEUE_SEND,
+	FREERTOS_TRACE_QUEUE_RECEIVE,
+	FREERTOS_TRACE_QUEUE_SEND_FROM_ISR,
+	FREERTOS_TRACE_QUEUE_RECEIVE_FROM_ISR,
+	FREERTOS_TRACE_BLOCK_ON_SEND,
+	FREERTOS_TRACE_BLOCK_ON_RECEIVE,
+	/** obj is the mutex holder, arg the priority it gets */
+	FREERTOS_TRACE_PRIORITY_INHERIT,
+	FREERTOS_TRACE_PRIORITY_DISINHERIT,
+};
+
+/** An event */
+struct freertos_trace_event {
+	/** DWT cycle counter */
+	uint32_t cycles;
+	/** Task or queue handle */
+	uint32_t obj;
+	/** Number of the running task, its xTaskNumber in TaskStatus_t */
+	uint16_t task;
+	uint8_t type;
+	uint8_t arg;
+};
+
+/** A task alive at the export */
+struct freertos_trace_task {
+	uint32_t handle;
+	uint16_t number;
+	uint8_t base_prio;
+	uint8_t reserved;
+	char name[16];
+};
+
+/** Head of the exported image */
+struct freertos_trace_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t event_size;
+	/** Rate of the cycle counter */
+	uint32_t cpu_hz;
+	uint32_t events;
+	uint16_t tasks;
+	uint16_t task_size;
+};
+
+void freertos_trace_switch(unsigned type, void *tcb, unsigned number,
+			   unsigned prio);
+void freertos_trace_event(unsigned type, void *obj, unsigned arg);
+
+#ifdef FREERTOS_TRACE
+/* The kernel hooks, pxCurrentTCB is only known in tasks.c. The switch in
+ * also goes to the energy accounting of FreeRTOSConfig.h */
+#define traceTASK_SWITCHED_IN()						\
+	do {								\
+		freertos_trace_switch(FREERTOS_TRACE_SWITCH_IN,		\
+				      pxCurrentTCB,			\
+				      pxCurrentTCB->uxTCBNumber,	\
+				      pxCurrentTCB->uxPriority);	\
+		traceENERGY_SWITCHED_IN();				\
+	} while (0)
+#define traceTASK_SWITCHED_OUT()					\
+	freertos_trace_switch(FREERTOS_TRACE_SWITCH_OUT, pxCurrentTCB,	\
+			      pxCurrentTCB->uxTCBNumber,		\
+			      pxCurrentTCB->uxPriority)
+#define traceQUEUE_SEND(pxQueue)					\
+	freertos_trace_event(FREERTOS_TRACE_QUEUE_SEND, pxQueue,	\
+			     (pxQueue)->ucQueueType)
+#define traceQUEUE_RECEIVE(pxQueue)					\
+	freertos_trace_event(FREERTOS_TRACE_QUEUE_RECEIVE, pxQueue,	\
+			     (pxQueue)->ucQueueType)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue)				\
+	freertos_trace_event(FREERTOS_TRACE_QUEUE_SEND_FROM_ISR, pxQueue, \
+			     (pxQueue)->ucQueueType)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue)				\
+	freertos_trace_event(FREERTOS_TRACE_QUEUE_RECEIVE_FROM_ISR,	\
+			     pxQueue, (pxQueue)->ucQueueType)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue)				\
+	freertos_trace_event(FREERTOS_TRACE_BLOCK_ON_SEND, pxQueue,	\
+			     (pxQueue)->ucQueueType)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue)				\
+	freertos_trace_event(FREERTOS_TRACE_BLOCK_ON_RECEIVE, pxQueue,	\
+			     (pxQueue)->ucQueueType)
+#define traceTASK_PRIORITY_INHERIT(pxTCB, uxPriority)			\
+	freertos_trace_event(FREERTOS_TRACE_PRIORITY_INHERIT, pxTCB,	\
+			     uxPriority)
+#define traceTASK_PRIORITY_DISINHERIT(pxTCB, uxPriority)		\
+	freertos_trace_event(FREERTOS_TRACE_PRIORITY_DISINHERIT, pxTCB,	\
+			     uxPriority)
+#endif /* FREERTOS_TRACE */
+
+/** Start the cycle counter and the recording
+ *
+ * Events are added to the ones of the previous runs until
+ * freertos_trace_reset().
+ */
+void freertos_trace_start(void);
+
+/** Stop the recording */
+void freertos_trace_stop(void);
+
+/** Forget the events recorded so far */
+void freertos_trace_reset(void);
+
+/** Print the image on the console
+ *
+ * As "rtrace" lines of hexadecimal between "rtrace begin" and "rtrace end".
+ * The recording is paused meanwhile.
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_NOMEM if the task list can not be allocated
+ */
+int freertos_trace_dump(void);
+
+/** Write the image to flash
+ *
+ * The region is erased first, an image larger than the region is cut at
+ * its end. The recording is paused meanwhile.
+ *
+ * \param[in] fl Flash region, erase sector aligned
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_NOMEM if the task list can not be allocated
+ * \return -WM_FAIL if the flash can not be opened, erased or written
+ */
+int freertos_trace_save(const struct flash_desc *fl);
+
+#endif /* _FREERTOS_TRACE_H_ */
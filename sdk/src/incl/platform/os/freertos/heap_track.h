@@ -0,0 +1,81 @@
+/*! \file heap_track.h
+ * \brief Per call site accounting of the heap allocations
+ *
+ * Every allocation made through os_mem_alloc(), os_mem_calloc(),
+ * os_mem_realloc() or pvPortMalloc() directly is charged to the address it
+ * was called from, and the free to that same call site. For every site the
+ * bytes it holds now, the most it held at once, the number of allocations
+ * and their average lifetime are kept, so that the modules holding the heap
+ * and the ones churning it can be told apart.
+ *
+ * The tracker is built in with HEAP_TRACK=y on the make command line. It
+ * keeps its tables apart from the heap so that the heap layout, and its
+ * fragmentation, are the same as without it:
+ * - HEAP_TRACK_SITES call sites, the allocations of the sites beyond are
+ *   charged to one "other" entry;
+ * - HEAP_TRACK_BLOCKS live allocations, the ones beyond are only counted as
+ *   untracked.
+ *
+ * Sizes are those of the heap blocks, header and alignment included, what
+ * the allocation takes from the free heap. Allocations made before the
+ * last heap_track_reset() are not counted, nor their free.
+ *
+ * The addresses are return addresses, arm-none-eabi-addr2line -f -e
+ * <app.axf> <address> gives the calling function and line.
+ *
+ * The counts are kept from boot on. The command to print them is not
+ * registered by the SDK, the application registers it after cli_init():
+ *
+ * @code
+ * cli_init();
+ * heap_track_cli_init();
+ * ...
+ * # heap-track
+ * # heap-track reset
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _HEAP_TRACK_H_
+#define _HEAP_TRACK_H_
+
+/** Call sites in the table, a power of 2 */
+#ifndef HEAP_TRACK_SITES
+#define HEAP_TRACK_SITES 128
+#endif
+
+/** Live allocations in the table, a power of 2 */
+#ifndef HEAP_TRACK_BLOCKS
+#define HEAP_TRACK_BLOCKS 1024
+#endif
+
+/* Hooks of the allocator, called with the scheduler suspended */
+void heap_track_alloc(void *block, unsigned size, void *caller);
+void heap_track_free(void *block, unsigned size);
+
+/** Forget the allocations counted so far */
+void heap_track_reset(void);
+
+/** Print the call sites on the console
+ *
+ * The sites holding the most bytes first. The counts of other threads may
+ * move while printing.
+ */
+void heap_track_dump(void);
+
+/** Register the tracker cli command
+ *
+ * "heap-track" prints the call sites, "heap-track reset" resets the counts.
+ * To be called by the application once the cli is initialized. Only built
+ * with HEAP_TRACK=y, calls to it are to be left out of builds without it.
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_FAIL if the command could not be registered
+ */
+int heap_track_cli_init(void);
+
+#endif /* _HEAP_TRACK_H_ */
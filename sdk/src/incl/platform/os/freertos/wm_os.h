@@ -491,7 +491,31 @@ static inline int os_queue_get_msgs_waiting(os_queue_t *qhandle)
 	return nmsg;
 }
 
-/* Critical Sections */
+/* Critical Sections
+ *
+ * There are three levels of protection:
+ *
+ * - os_enter_critical_section() holds off the other tasks and the interrupts
+ *   of priority OS_SYSCALL_IRQ_PRIO and below, those that may call the OS.
+ *   It keeps a nesting count of the task and is for tasks only.
+ * - os_mask_syscall_interrupts() masks the same interrupts but only saves
+ *   and restores the mask, so it can be used in interrupt handlers too and
+ *   costs a couple of instructions.
+ * - os_disable_all_interrupts() masks every interrupt, e.g. right before
+ *   entering a low power mode.
+ *
+ * The first two set BASEPRI, so an interrupt given a more urgent priority,
+ * a lower number than OS_SYSCALL_IRQ_PRIO, with NVIC_SetPriority() is never
+ * delayed by the OS, the heap or the network stack. Such an interrupt must
+ * not call any OS function. It can hand its data to a task through an
+ * os_ringbuf_t that the task polls: os_ringbuf_write() makes no OS call as
+ * long as no one blocks in os_ringbuf_wait().
+ */
+
+/** The most urgent NVIC priority of an interrupt that calls the OS */
+#define OS_SYSCALL_IRQ_PRIO \
+	(configMAX_SYSCALL_INTERRUPT_PRIORITY >> (8 - __NVIC_PRIO_BITS))
+
 static inline unsigned long os_enter_critical_section()
 {
 	taskENTER_CRITICAL();
@@ -503,6 +527,29 @@ static inline void os_exit_critical_section(unsigned long state)
 	taskEXIT_CRITICAL();
 }
 
+/** Mask the interrupts that may call the OS
+ *
+ * Calls nest, each restores the mask it found. No OS function that blocks
+ * may be called until the mask is restored.
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @return The mask to pass to os_unmask_syscall_interrupts()
+ */
+static inline unsigned long os_mask_syscall_interrupts(void)
+{
+	return portSET_INTERRUPT_MASK_FROM_ISR();
+}
+
+/** Restore the mask saved by os_mask_syscall_interrupts()
+ *
+ * @param[in] state Value returned by os_mask_syscall_interrupts()
+ */
+static inline void os_unmask_syscall_interrupts(unsigned long state)
+{
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
 /* Note: Below call should not be made static, otherwise it breaks
  * IAR compilation.
  */
@@ -510,42 +557,52 @@ inline void os_disable_all_interrupts();
 inline void os_enable_all_interrupts();
 
 /*** Tick function */
-#define MAX_CUSTOM_HOOKS	4
 
-extern void (*g_os_tick_hooks[MAX_CUSTOM_HOOKS]) (void);
-extern void (*g_os_idle_hooks[MAX_CUSTOM_HOOKS]) (void);
+/** Number of idle functions, and of tick functions, that can be set up */
+#define MAX_CUSTOM_HOOKS	8
+
+/** Priority of the idle functions set up with os_setup_idle_function() */
+#define OS_IDLE_PRIO_DEFAULT	0
 
 /** Setup idle function
  *
  * This function sets up a callback function which will be called whenever the
- * system enters the idle thread context.
+ * system enters the idle thread context. It runs with the priority
+ * \ref OS_IDLE_PRIO_DEFAULT, see os_setup_idle_function_prio().
  *
  *  @param[in] func The callback function
  *
  *  @return WM_SUCCESS on success
  *  @return -WM_FAIL on error
  */
-static inline int os_setup_idle_function(void (*func) (void))
-{
-	unsigned int i;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++)
-		if (g_os_idle_hooks[i] &&
-			g_os_idle_hooks[i] == func)
-				return WM_SUCCESS;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++) {
-		if (g_os_idle_hooks[i] == NULL) {
-			g_os_idle_hooks[i] = func;
-			break;
-		}
-	}
+int os_setup_idle_function(void (*func) (void));
 
-	if (i == MAX_CUSTOM_HOOKS)
-		return -WM_FAIL;
+/** Setup idle function with a priority
+ *
+ * The idle functions are called in the order of their priority, highest
+ * first, and in the order they were set up for the same priority: e.g.
+ * statistics flushing before flash garbage collection, and the entry in a
+ * low power mode last. An idle function must not block.
+ *
+ * The idle task goes to sleep, when tickless idle is enabled, after the idle
+ * functions returned. One that has work left calls os_idle_function_busy()
+ * so that they are all called again first.
+ *
+ *  @param[in] func The callback function
+ *  @param[in] prio Its priority
+ *
+ *  @return WM_SUCCESS on success, or if func is set up already
+ *  @return -WM_FAIL if \ref MAX_CUSTOM_HOOKS functions are set up
+ */
+int os_setup_idle_function_prio(void (*func) (void), int prio);
 
-	return WM_SUCCESS;
-}
+/** Keep the idle task awake
+ *
+ * Called from an idle function that has work left, e.g. more flash blocks to
+ * erase: the idle functions are called again instead of the idle task
+ * sleeping until the next task wakes up.
+ */
+void os_idle_function_busy(void);
 
 /** Setup tick function
  *
@@ -557,54 +614,20 @@ static inline int os_setup_idle_function(void (*func) (void))
  *  @return WM_SUCCESS on success
  *  @return -WM_FAIL on error
  */
-static inline int os_setup_tick_function(void (*func) (void))
-{
-	unsigned int i;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++)
-		if (g_os_tick_hooks[i] &&
-			g_os_tick_hooks[i] == func)
-				return WM_SUCCESS;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++) {
-		if (g_os_tick_hooks[i] == NULL) {
-			g_os_tick_hooks[i] = func;
-			break;
-		}
-	}
-
-	if (i == MAX_CUSTOM_HOOKS)
-		return -WM_FAIL;
-
-	return WM_SUCCESS;
-}
+int os_setup_tick_function(void (*func) (void));
 
 /** Remove idle function
  *
  *  This function removes an idle callback function that was registered
- *  previously using os_setup_idle_function().
+ *  previously using os_setup_idle_function(). The idle task may call it one
+ *  last time if it was running the idle functions.
  *
  *  @param[in] func The callback function
  *
  *  @return WM_SUCCESS on success
  *  @return -WM_FAIL on error
  */
-static inline int os_remove_idle_function(void (*func) (void))
-{
-	unsigned int i;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++) {
-		if (g_os_idle_hooks[i] == func) {
-			g_os_idle_hooks[i] = NULL;
-			break;
-		}
-	}
-
-	if (i == MAX_CUSTOM_HOOKS)
-		return -WM_FAIL;
-
-	return WM_SUCCESS;
-}
+int os_remove_idle_function(void (*func) (void));
 
 /** Remove tick function
  *
@@ -615,22 +638,7 @@ static inline int os_remove_idle_function(void (*func) (void))
  *  @return WM_SUCCESS on success
  *  @return -WM_FAIL on error
  */
-static inline int os_remove_tick_function(void (*func) (void))
-{
-	unsigned int i;
-
-	for (i = 0; i < MAX_CUSTOM_HOOKS; i++) {
-		if (g_os_tick_hooks[i] == func) {
-			g_os_tick_hooks[i] = NULL;
-			break;
-		}
-	}
-
-	if (i == MAX_CUSTOM_HOOKS)
-		return -WM_FAIL;
-
-	return WM_SUCCESS;
-}
+int os_remove_tick_function(void (*func) (void));
 
 /*** Mutex ***/
 typedef xSemaphoreHandle os_mutex_t;
@@ -669,6 +677,7 @@ static inline int os_mutex_create(os_mutex_t *mhandle, const char *name, int fla
 	if (*mhandle) {
 		sem_debug_add((const xQueueHandle)*mhandle,
 			      name, 1);
+		vQueueSetMutexName(*mhandle, name);
 		return WM_SUCCESS;
 	}
 	else
@@ -769,6 +778,7 @@ static inline int os_recursive_mutex_create(os_mutex_t *mhandle,
 		return -WM_FAIL;
 
 	sem_debug_add(*mhandle, name, 1);
+	vQueueSetMutexName(*mhandle, name);
 	return WM_SUCCESS;
 }
 
@@ -1015,6 +1025,8 @@ static inline int os_semaphore_delete(os_semaphore_t *mhandle)
  * The locking operation is timeout based.
  * Caller can give a timeout from 0 (no wait) to
  * infinite (wait forever)
+ * Every read lock takes a mutex, for data read far more often than it is
+ * written see rwlock.h, whose lock is taken without kernel calls.
  */
 
 
@@ -1130,6 +1142,97 @@ int os_rwlock_read_lock(os_rw_lock_t *lock,
 int os_rwlock_read_unlock(os_rw_lock_t *lock);
 
 
+/*** Task notifications ***/
+
+/** Signal a task through its notification
+ *
+ * Direct to task notifications replace a binary or counting semaphore, or a
+ * set of event flags, that only one known task ever waits on, e.g. the
+ * completion of a transfer started by a driver task. No kernel object is
+ * created and a give or set is several times cheaper than a semaphore
+ * put, as it does not go through the queue code.
+ *
+ * A task has a single notification value: it has to use either the count
+ * calls, os_task_notify_give() and os_task_notify_take(), or the bit calls,
+ * os_task_notify_set_bits() and os_task_notify_wait_bits(), and not also
+ * wait on a ring buffer with os_ringbuf_wait().
+ *
+ * This increments the notification count of the task, like putting a
+ * counting semaphore.
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @param[in] task Task to signal
+ */
+static inline void os_task_notify_give(os_thread_t task)
+{
+	if (is_isr_context()) {
+		signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(task, &xHigherPriorityTaskWoken);
+		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+	} else
+		xTaskNotifyGive(task);
+}
+
+/** Wait for the notification count of the calling task
+ *
+ * @param[in] clear true to clear the count, like taking a binary semaphore,
+ * false to decrement it, like taking a counting semaphore
+ * @param[in] wait Number of OS ticks to wait, or \ref OS_WAIT_FOREVER or
+ * \ref OS_NO_WAIT
+ *
+ * \note This function must not be used in an interrupt service routine.
+ *
+ * @return WM_SUCCESS if the count was not zero
+ * @return -WM_FAIL on timeout
+ */
+static inline int os_task_notify_take(bool clear, unsigned long wait)
+{
+	return ulTaskNotifyTake(clear ? pdTRUE : pdFALSE, wait) ?
+		WM_SUCCESS : -WM_FAIL;
+}
+
+/** Set event bits in the notification value of a task
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @param[in] task Task to signal
+ * @param[in] bits Bits to set
+ */
+static inline void os_task_notify_set_bits(os_thread_t task, uint32_t bits)
+{
+	if (is_isr_context()) {
+		signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+		xTaskNotifyFromISR(task, bits, eSetBits,
+				   &xHigherPriorityTaskWoken);
+		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+	} else
+		xTaskNotify(task, bits, eSetBits);
+}
+
+/** Wait for event bits in the notification value of the calling task
+ *
+ * Returns once any bit is set, the bits returned are cleared.
+ *
+ * \note This function must not be used in an interrupt service routine.
+ *
+ * @param[out] bits The bits that were set
+ * @param[in] wait Number of OS ticks to wait, or \ref OS_WAIT_FOREVER or
+ * \ref OS_NO_WAIT
+ *
+ * @return WM_SUCCESS if a bit was set
+ * @return -WM_FAIL on timeout
+ */
+static inline int os_task_notify_wait_bits(uint32_t *bits, unsigned long wait)
+{
+	uint32_t value = 0;
+
+	if (xTaskNotifyWait(0, 0xffffffffUL, &value, wait) != pdTRUE || !value)
+		return -WM_FAIL;
+	*bits = value;
+	return WM_SUCCESS;
+}
+
 /*** Timer Management ***/
 
 typedef void *os_timer_arg_t;
@@ -1233,6 +1336,29 @@ static inline int os_timer_change(os_timer_t *timer_t, os_timer_tick ntime,
 	return ret == pdPASS ? WM_SUCCESS : -WM_FAIL;
 }
 
+/** Let a timer expire late
+ *
+ * The timer service wakes up at the earliest expiry time plus slack of the
+ * active timers and runs the callbacks of all the timers expired by then,
+ * so timers that do not need to be exact, e.g. LED blinks, polls and
+ * protocol timeouts, share wake ups. With tickless idle the wake ups saved
+ * are longer sleeps. A periodic timer keeps its period.
+ *
+ * @param[in] timer_t Pointer to a timer handle
+ * @param[in] slack Ticks the timer may expire late, 0 when created. It
+ * should be less than the period of a periodic timer.
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_E_INVAL if invalid parameters are passed
+ */
+static inline int os_timer_set_slack(os_timer_t *timer_t, os_timer_tick slack)
+{
+	if (!timer_t || !(*timer_t))
+		return -WM_E_INVAL;
+	vTimerSetSlack(*timer_t, slack);
+	return WM_SUCCESS;
+}
+
 /** Check the timer active state
  *
  * This function checks if the timer is in the active or dormant state. A timer
@@ -1379,6 +1505,228 @@ static inline int os_timer_delete(os_timer_t *timer_t)
 	return ret == pdPASS ? WM_SUCCESS : -WM_FAIL;
 }
 
+/*** Static creation ***/
+
+#if configSUPPORT_STATIC_ALLOCATION == 1
+/*
+ * The calls below create threads, queues, mutexes, semaphores and timers in
+ * memory of the caller, usually static objects defined at build time, so
+ * they can not fail for lack of heap and the RAM they take shows in the map
+ * file. The objects are deleted with the usual calls, which do not free that
+ * memory.
+ */
+
+/** Stack and control block of a thread created with
+ * os_thread_create_static(), define it with os_thread_static_define() */
+typedef struct os_thread_static {
+	/** Stack size in words */
+	int size;
+	/** The stack */
+	portSTACK_TYPE *stack;
+	/** Task control block */
+	StaticTask_t tcb;
+} os_thread_static_t;
+
+/** Define the memory of a thread of stacksize bytes
+ *
+ * Use it at file scope, the objects it defines are already static.
+ */
+#define os_thread_static_define(name, stacksize)			\
+	static portSTACK_TYPE name##_stack[(stacksize) /		\
+					   sizeof(portSTACK_TYPE)];	\
+	static os_thread_static_t name =				\
+		{(stacksize) / sizeof(portSTACK_TYPE), name##_stack}
+
+/** Create a thread in memory of the caller
+ *
+ * As os_thread_create(), with the stack and the control block taken from
+ * ts instead of the heap.
+ *
+ * @param[out] thandle Pointer to a thread handle
+ * @param[in] name Name of the new thread
+ * @param[in] main_func Function pointer to new thread function
+ * @param[in] arg The sole argument passed to main_func()
+ * @param[in] ts Memory of the thread, defined with
+ * os_thread_static_define(). It must not be used by another thread until
+ * this one is deleted.
+ * @param[in] prio The priority of the new thread
+ *
+ * @return WM_SUCCESS if thread was created successfully
+ * @return -WM_FAIL if thread creation failed
+ */
+static inline int os_thread_create_static(os_thread_t *thandle,
+		const char *name, void (*main_func) (os_thread_arg_t arg),
+		void *arg, os_thread_static_t *ts, int prio)
+{
+	if (xTaskCreateStatic(main_func, name, ts->size, arg, prio, thandle,
+			      ts->stack, &ts->tcb) != pdPASS)
+		return -WM_FAIL;
+	return WM_SUCCESS;
+}
+
+/** Storage and control block of a queue created with
+ * os_queue_create_static(), define it with os_queue_static_define() */
+typedef struct os_queue_static {
+	/** Size of the storage in bytes */
+	int size;
+	/** The storage */
+	uint8_t *storage;
+	/** Queue control block */
+	StaticQueue_t queue;
+} os_queue_static_t;
+
+/** Define the memory of a queue of poolsize bytes
+ *
+ * Use it at file scope, the objects it defines are already static.
+ */
+#define os_queue_static_define(name, poolsize)				\
+	static uint8_t name##_storage[poolsize] __attribute__((aligned(4))); \
+	static os_queue_static_t name = {(poolsize), name##_storage}
+
+/** Create a queue in memory of the caller
+ *
+ * As os_queue_create(), with the storage and the control block taken from
+ * qs instead of the heap.
+ *
+ * @param[out] qhandle Pointer to the handle of the newly created queue
+ * @param[in] name String specifying the name of the queue
+ * @param[in] msgsize The number of bytes each item in the queue will
+ * require
+ * @param[in] qs Memory of the queue, defined with os_queue_static_define()
+ *
+ * @return WM_SUCCESS if queue creation was successful
+ * @return -WM_FAIL if queue creation failed
+ */
+static inline int os_queue_create_static(os_queue_t *qhandle,
+		const char *name, int msgsize, os_queue_static_t *qs)
+{
+	if (msgsize <= 0 || qs->size < msgsize)
+		return -WM_FAIL;
+	*qhandle = xQueueCreateStatic(qs->size / msgsize, msgsize,
+				      qs->storage, &qs->queue);
+	if (!*qhandle)
+		return -WM_FAIL;
+	vQueueAddToRegistry(*qhandle, name);
+	return WM_SUCCESS;
+}
+
+/** Memory of a mutex created with os_mutex_create_static() */
+typedef StaticSemaphore_t os_mutex_static_t;
+
+/** Create a mutex in memory of the caller
+ *
+ * As os_mutex_create(), with the mutex in ms instead of the heap.
+ *
+ * @param [out] mhandle Pointer to a mutex handle
+ * @param [in] name Name of the mutex
+ * @param [in] flags Only \ref OS_MUTEX_INHERIT is supported
+ * @param [in] ms Memory of the mutex
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_FAIL on error
+ */
+static inline int os_mutex_create_static(os_mutex_t *mhandle,
+		const char *name, int flags, os_mutex_static_t *ms)
+{
+	if (flags == OS_MUTEX_NO_INHERIT) {
+		*mhandle = NULL;
+		return -WM_FAIL;
+	}
+	*mhandle = xSemaphoreCreateMutexStatic(ms);
+	if (!*mhandle)
+		return -WM_FAIL;
+	sem_debug_add((const xQueueHandle)*mhandle, name, 1);
+	vQueueSetMutexName(*mhandle, name);
+	return WM_SUCCESS;
+}
+
+/** Memory of a semaphore created with os_semaphore_create_static() or
+ * os_semaphore_create_counting_static() */
+typedef StaticSemaphore_t os_semaphore_static_t;
+
+/** Create a binary semaphore in memory of the caller
+ *
+ * As os_semaphore_create(), the semaphore is created given.
+ *
+ * @param[out] mhandle Pointer to a semaphore handle
+ * @param[in] name Name of the semaphore
+ * @param[in] ss Memory of the semaphore
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_FAIL on error
+ */
+static inline int os_semaphore_create_static(os_semaphore_t *mhandle,
+		const char *name, os_semaphore_static_t *ss)
+{
+	*mhandle = xSemaphoreCreateBinaryStatic(ss);
+	if (!*mhandle)
+		return -WM_FAIL;
+	xSemaphoreGive(*mhandle);
+	sem_debug_add((const xSemaphoreHandle)*mhandle, name, 1);
+	return WM_SUCCESS;
+}
+
+/** Create a counting semaphore in memory of the caller
+ *
+ * As os_semaphore_create_counting().
+ *
+ * @param[out] mhandle Pointer to a semaphore handle
+ * @param[in] name Name of the semaphore
+ * @param[in] maxcount The maximum count value that can be reached
+ * @param[in] initcount The count value assigned on creation
+ * @param[in] ss Memory of the semaphore
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_FAIL on error
+ */
+static inline int os_semaphore_create_counting_static(os_semaphore_t *mhandle,
+		const char *name, unsigned long maxcount,
+		unsigned long initcount, os_semaphore_static_t *ss)
+{
+	*mhandle = xSemaphoreCreateCountingStatic(maxcount, initcount, ss);
+	if (!*mhandle)
+		return -WM_FAIL;
+	sem_debug_add((const xQueueHandle)*mhandle, name, 1);
+	return WM_SUCCESS;
+}
+
+/** Memory of a timer created with os_timer_create_static() */
+typedef StaticTimer_t os_timer_static_t;
+
+/** Create a timer in memory of the caller
+ *
+ * As os_timer_create(), with the timer in ts instead of the heap.
+ *
+ * @param[out] timer_t Pointer to the timer handle
+ * @param[in] name Name of the timer
+ * @param[in] ticks Period in ticks
+ * @param[in] call_back Timer expire callback function
+ * @param[in] cb_arg Timer callback data
+ * @param[in] reload \ref OS_TIMER_ONE_SHOT or \ref OS_TIMER_PERIODIC
+ * @param[in] activate \ref OS_TIMER_AUTO_ACTIVATE or \ref
+ * OS_TIMER_NO_ACTIVATE
+ * @param[in] ts Memory of the timer, it must not be reused before the
+ * timer service task handled the deletion of the timer
+ *
+ * @return WM_SUCCESS if timer created successfully
+ * @return -WM_FAIL if timer creation fails
+ */
+static inline int os_timer_create_static(os_timer_t *timer_t,
+		const char *name, os_timer_tick ticks,
+		void (*call_back) (os_timer_arg_t), void *cb_arg,
+		os_timer_reload_t reload, os_timer_activate_t activate,
+		os_timer_static_t *ts)
+{
+	*timer_t = xTimerCreateStatic(name, ticks, reload == OS_TIMER_PERIODIC,
+				      cb_arg, call_back, ts);
+	if (!*timer_t)
+		return -WM_FAIL;
+	if (activate == OS_TIMER_AUTO_ACTIVATE)
+		return os_timer_activate(timer_t);
+	return WM_SUCCESS;
+}
+#endif /* configSUPPORT_STATIC_ALLOCATION */
+
 /* OS Memory allocation API's */
 #ifndef CONFIG_HEAP_DEBUG
 
@@ -1583,6 +1931,588 @@ static inline int os_get_heap_size()
 #endif /* FREERTOS_ENABLE_MALLOC_STATS */
 }
 
+/*** Fixed size block pools ***/
+
+/** Fixed size block pool
+ *
+ * A pool hands out blocks of one size from a single buffer. Allocation and
+ * free take constant time and never fragment, and both can be called from
+ * tasks as well as from interrupts whose priority allows FreeRTOS "FromISR"
+ * calls. Free blocks are chained through their first word.
+ */
+typedef struct os_mempool {
+	/** Start of the block storage */
+	char *buffer;
+	/** First free block */
+	void *free_list;
+	/** Size of a block, rounded up to a multiple of
+	 * \ref OS_MEMPOOL_ALIGN */
+	size_t block_size;
+	/** Number of blocks in the pool */
+	unsigned num_blocks;
+	/** Number of free blocks */
+	unsigned free_blocks;
+	/** Lowest number of free blocks since the pool was created */
+	unsigned min_free_blocks;
+	/** Number of allocations that failed because the pool was empty */
+	unsigned alloc_failures;
+	/** The buffer was allocated by os_mempool_create() */
+	bool buffer_allocated;
+} os_mempool_t;
+
+/** Statistics of a fixed size block pool */
+typedef struct os_mempool_stats {
+	/** Size of a block */
+	size_t block_size;
+	/** Number of blocks in the pool */
+	unsigned num_blocks;
+	/** Number of free blocks */
+	unsigned free_blocks;
+	/** Lowest number of free blocks since the pool was created */
+	unsigned min_free_blocks;
+	/** Number of allocations that failed because the pool was empty */
+	unsigned alloc_failures;
+} os_mempool_stats_t;
+
+/** Alignment of the blocks of a pool */
+#define OS_MEMPOOL_ALIGN	portBYTE_ALIGNMENT
+
+/** Size of one block of a pool */
+#define OS_MEMPOOL_BLOCK_SIZE(block_size)				\
+	((((block_size) < sizeof(void *) ? sizeof(void *) : (block_size)) \
+	  + (OS_MEMPOOL_ALIGN - 1)) & ~(size_t)(OS_MEMPOOL_ALIGN - 1))
+
+/** Define the storage of a pool
+ *
+ * This macro defines a buffer that can be passed to os_mempool_create()
+ * for a pool of nblocks blocks of blocksize bytes.
+ */
+#define os_mempool_buffer_define(bufname, blocksize, nblocks)		\
+	static char bufname[OS_MEMPOOL_BLOCK_SIZE(blocksize) * (nblocks)] \
+	__attribute__((aligned(OS_MEMPOOL_ALIGN)))
+
+/** Create a fixed size block pool
+ *
+ * @param[out] pool Pointer to the pool to be initialized
+ * @param[in] block_size Size of every block in bytes
+ * @param[in] num_blocks Number of blocks in the pool
+ * @param[in] buffer Storage for the blocks, defined with
+ * os_mempool_buffer_define() or at least
+ * OS_MEMPOOL_BLOCK_SIZE(block_size) * num_blocks bytes aligned on
+ * \ref OS_MEMPOOL_ALIGN. If NULL the storage is allocated from the heap.
+ *
+ * @return WM_SUCCESS if the pool was created
+ * @return -WM_E_INVAL if the arguments are invalid
+ * @return -WM_E_NOMEM if the storage could not be allocated
+ */
+static inline int os_mempool_create(os_mempool_t *pool, size_t block_size,
+				    unsigned num_blocks, void *buffer)
+{
+	unsigned i;
+	char *block;
+
+	if (!pool || !block_size || !num_blocks ||
+	    ((unsigned long)buffer & (OS_MEMPOOL_ALIGN - 1)))
+		return -WM_E_INVAL;
+
+	pool->block_size = OS_MEMPOOL_BLOCK_SIZE(block_size);
+	pool->buffer_allocated = (buffer == NULL);
+	if (!buffer) {
+		buffer = os_mem_alloc(pool->block_size * num_blocks);
+		if (!buffer)
+			return -WM_E_NOMEM;
+	}
+
+	pool->buffer = buffer;
+	pool->num_blocks = num_blocks;
+	pool->free_blocks = num_blocks;
+	pool->min_free_blocks = num_blocks;
+	pool->alloc_failures = 0;
+
+	/* Chain the blocks in address order */
+	block = pool->buffer;
+	for (i = 0; i < num_blocks - 1; i++, block += pool->block_size)
+		*(void **)block = block + pool->block_size;
+	*(void **)block = NULL;
+	pool->free_list = pool->buffer;
+
+	return WM_SUCCESS;
+}
+
+/** Allocate a block from a pool
+ *
+ * @param[in] pool Pool created with os_mempool_create()
+ *
+ * @return Pointer to the block
+ * @return NULL if the pool is empty
+ */
+static inline void *os_mempool_alloc(os_mempool_t *pool)
+{
+	void *block;
+	unsigned long state = portSET_INTERRUPT_MASK_FROM_ISR();
+
+	block = pool->free_list;
+	if (block) {
+		pool->free_list = *(void **)block;
+		pool->free_blocks--;
+		if (pool->free_blocks < pool->min_free_blocks)
+			pool->min_free_blocks = pool->free_blocks;
+	} else {
+		pool->alloc_failures++;
+	}
+
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+	return block;
+}
+
+/** Return a block to its pool
+ *
+ * @param[in] pool Pool the block was allocated from
+ * @param[in] block Block returned by os_mempool_alloc()
+ *
+ * @return WM_SUCCESS if the block was freed
+ * @return -WM_E_INVAL if the block does not belong to the pool
+ */
+static inline int os_mempool_free(os_mempool_t *pool, void *block)
+{
+	unsigned long state;
+	size_t offset = (char *)block - pool->buffer;
+
+	if ((char *)block < pool->buffer ||
+	    offset >= pool->block_size * pool->num_blocks ||
+	    offset % pool->block_size)
+		return -WM_E_INVAL;
+
+	state = portSET_INTERRUPT_MASK_FROM_ISR();
+	*(void **)block = pool->free_list;
+	pool->free_list = block;
+	pool->free_blocks++;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+
+	return WM_SUCCESS;
+}
+
+/** Get the statistics of a pool
+ *
+ * @param[in] pool Pool created with os_mempool_create()
+ * @param[out] stats Statistics of the pool
+ */
+static inline void os_mempool_get_stats(os_mempool_t *pool,
+					os_mempool_stats_t *stats)
+{
+	unsigned long state = portSET_INTERRUPT_MASK_FROM_ISR();
+
+	stats->block_size = pool->block_size;
+	stats->num_blocks = pool->num_blocks;
+	stats->free_blocks = pool->free_blocks;
+	stats->min_free_blocks = pool->min_free_blocks;
+	stats->alloc_failures = pool->alloc_failures;
+
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+/** Delete a pool
+ *
+ * Frees the storage if it was allocated by os_mempool_create(). Blocks
+ * still in use must not be accessed after this call.
+ *
+ * @param[in] pool Pool created with os_mempool_create()
+ */
+static inline void os_mempool_delete(os_mempool_t *pool)
+{
+	if (pool->buffer_allocated)
+		os_mem_free(pool->buffer);
+	pool->buffer = NULL;
+	pool->free_list = NULL;
+	pool->num_blocks = 0;
+	pool->free_blocks = 0;
+}
+
+/*** Zero copy message queues ***/
+
+/** Message queue passing pool blocks by pointer
+ *
+ * os_queue_send() and os_queue_recv() copy every message into and out of
+ * the queue storage, twice the size of the message per transfer. A
+ * message queue instead owns a pool of message blocks: the sender takes a
+ * block with os_msgq_alloc(), fills it in place and sends it, only the
+ * pointer goes through the queue. The receiver owns the block until it
+ * gives it back with os_msgq_free().
+ *
+ * The queue holds as many pointers as the pool has blocks, so sending a
+ * block of the pool never has to wait for room.
+ *
+ * @code
+ * static os_msgq_t frames;
+ *
+ * os_msgq_create(&frames, "frames", sizeof(struct frame), 8, NULL);
+ *
+ * producer:
+ *	struct frame *f = os_msgq_alloc(&frames);
+ *	if (f) {
+ *		fill_frame(f);
+ *		os_msgq_send(&frames, f);
+ *	}
+ *
+ * consumer:
+ *	if (os_msgq_recv(&frames, (void **)&f, OS_WAIT_FOREVER) == WM_SUCCESS) {
+ *		handle_frame(f);
+ *		os_msgq_free(&frames, f);
+ *	}
+ * @endcode
+ */
+typedef struct os_msgq {
+	/** Queue of block pointers */
+	os_queue_t queue;
+	/** Size of the queue, must live as long as the queue */
+	os_queue_pool_t queue_pool;
+	/** The message blocks */
+	os_mempool_t pool;
+} os_msgq_t;
+
+/** Create a message queue
+ *
+ * @param[out] q Message queue to be initialized
+ * @param[in] name Name of the queue
+ * @param[in] msg_size Size of a message in bytes
+ * @param[in] num_msgs Number of messages, sent or not, that can exist at
+ * the same time
+ * @param[in] buffer Storage for the messages, defined with
+ * os_mempool_buffer_define(), or NULL to allocate it from the heap
+ *
+ * @return WM_SUCCESS if the queue was created
+ * @return -WM_E_INVAL if the arguments are invalid
+ * @return -WM_E_NOMEM if the storage could not be allocated
+ * @return -WM_FAIL if the queue could not be created
+ */
+static inline int os_msgq_create(os_msgq_t *q, const char *name,
+				 size_t msg_size, unsigned num_msgs,
+				 void *buffer)
+{
+	int ret;
+
+	ret = os_mempool_create(&q->pool, msg_size, num_msgs, buffer);
+	if (ret != WM_SUCCESS)
+		return ret;
+
+	q->queue_pool.size = num_msgs * sizeof(void *);
+	if (os_queue_create(&q->queue, name, sizeof(void *),
+			    &q->queue_pool) != WM_SUCCESS) {
+		os_mempool_delete(&q->pool);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+/** Take a free message block
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @param[in] q Message queue
+ *
+ * @return The block, owned by the caller until it is sent or freed
+ * @return NULL if every block is in use
+ */
+static inline void *os_msgq_alloc(os_msgq_t *q)
+{
+	return os_mempool_alloc(&q->pool);
+}
+
+/** Give a message block back to its queue's pool
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @param[in] q Message queue
+ * @param[in] msg Block returned by os_msgq_alloc() or os_msgq_recv()
+ *
+ * @return WM_SUCCESS or -WM_E_INVAL if the block is not of this queue
+ */
+static inline int os_msgq_free(os_msgq_t *q, void *msg)
+{
+	return os_mempool_free(&q->pool, msg);
+}
+
+/** Send a message block
+ *
+ * Ownership of the block passes to the receiver. This never waits.
+ *
+ * \note This function can be called from an interrupt service routine.
+ *
+ * @param[in] q Message queue
+ * @param[in] msg Block returned by os_msgq_alloc() on this queue
+ *
+ * @return WM_SUCCESS
+ * @return -WM_E_INVAL if the block is not of this queue, the caller still
+ * owns it
+ */
+static inline int os_msgq_send(os_msgq_t *q, void *msg)
+{
+	size_t offset = (char *)msg - q->pool.buffer;
+
+	if ((char *)msg < q->pool.buffer ||
+	    offset >= q->pool.block_size * q->pool.num_blocks ||
+	    offset % q->pool.block_size)
+		return -WM_E_INVAL;
+
+	/* There is a slot for every block, this can not fail */
+	return os_queue_send(&q->queue, &msg, OS_NO_WAIT);
+}
+
+/** Receive a message block
+ *
+ * \note This function must not be used in an interrupt service routine.
+ *
+ * @param[in] q Message queue
+ * @param[out] msg The block, to be given back with os_msgq_free()
+ * @param[in] wait Number of OS ticks to wait, or \ref OS_WAIT_FOREVER or
+ * \ref OS_NO_WAIT
+ *
+ * @return WM_SUCCESS if a message was received
+ * @return -WM_FAIL on timeout
+ */
+static inline int os_msgq_recv(os_msgq_t *q, void **msg, unsigned long wait)
+{
+	return os_queue_recv(&q->queue, msg, wait);
+}
+
+/** Delete a message queue
+ *
+ * No task may wait on the queue and its blocks must not be accessed after
+ * this call.
+ *
+ * @param[in] q Message queue
+ */
+static inline void os_msgq_delete(os_msgq_t *q)
+{
+	os_queue_delete(&q->queue);
+	os_mempool_delete(&q->pool);
+}
+
+/*** Single producer single consumer ring buffers ***/
+
+/** Lock free ring buffer
+ *
+ * A ring buffer of fixed size elements with exactly one producer and one
+ * consumer, e.g. an interrupt handler and the task processing its data.
+ * Neither side takes a lock or enters a critical section: the producer
+ * only writes head and the consumer only writes tail, so aligned word
+ * stores and memory barriers are enough. Use an element size of 1 for a
+ * byte stream.
+ *
+ * The consumer can block in os_ringbuf_wait(); the producer then wakes it
+ * up with a task notification once data is available.
+ */
+typedef struct os_ringbuf {
+	/** Element storage */
+	uint8_t *buffer;
+	/** Size of an element in bytes */
+	uint32_t elem_size;
+	/** Number of elements, a power of two */
+	uint32_t num_elems;
+	/** Elements written so far, only changed by the producer */
+	volatile uint32_t head;
+	/** Elements read so far, only changed by the consumer */
+	volatile uint32_t tail;
+	/** Task blocked in os_ringbuf_wait(), NULL if none */
+	volatile uint32_t waiter;
+} os_ringbuf_t;
+
+/** Initialize a ring buffer
+ *
+ * @param[out] rb Ring buffer to initialize
+ * @param[in] buffer Storage for num_elems elements of elem_size bytes
+ * @param[in] elem_size Size of an element in bytes
+ * @param[in] num_elems Capacity of the ring buffer, must be a power of two
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_E_INVAL on invalid arguments
+ */
+static inline int os_ringbuf_init(os_ringbuf_t *rb, void *buffer,
+				  uint32_t elem_size, uint32_t num_elems)
+{
+	if (!rb || !buffer || !elem_size || !num_elems ||
+	    (num_elems & (num_elems - 1)))
+		return -WM_E_INVAL;
+
+	rb->buffer = buffer;
+	rb->elem_size = elem_size;
+	rb->num_elems = num_elems;
+	rb->head = 0;
+	rb->tail = 0;
+	rb->waiter = 0;
+	return WM_SUCCESS;
+}
+
+/** Number of elements available to the consumer */
+static inline uint32_t os_ringbuf_count(const os_ringbuf_t *rb)
+{
+	return rb->head - rb->tail;
+}
+
+/** Number of elements the producer can write */
+static inline uint32_t os_ringbuf_space(const os_ringbuf_t *rb)
+{
+	return rb->num_elems - (rb->head - rb->tail);
+}
+
+/* Atomically fetch and clear the waiting task */
+static inline os_thread_t os_ringbuf_take_waiter(os_ringbuf_t *rb)
+{
+	uint32_t waiter;
+
+	do {
+		waiter = __LDREXW(&rb->waiter);
+		if (!waiter) {
+			__CLREX();
+			return NULL;
+		}
+	} while (__STREXW(0, &rb->waiter));
+
+	return (os_thread_t) waiter;
+}
+
+/* Copy count elements between a flat buffer and the ring at index idx,
+ * to_ring selects the direction */
+static inline void os_ringbuf_copy(os_ringbuf_t *rb, uint32_t idx,
+				   void *data, uint32_t count, bool to_ring)
+{
+	uint32_t first, off;
+
+	off = idx & (rb->num_elems - 1);
+	first = rb->num_elems - off;
+	if (first > count)
+		first = count;
+
+	if (to_ring) {
+		memcpy(rb->buffer + off * rb->elem_size, data,
+		       first * rb->elem_size);
+		memcpy(rb->buffer, (uint8_t *) data + first * rb->elem_size,
+		       (count - first) * rb->elem_size);
+	} else {
+		memcpy(data, rb->buffer + off * rb->elem_size,
+		       first * rb->elem_size);
+		memcpy((uint8_t *) data + first * rb->elem_size, rb->buffer,
+		       (count - first) * rb->elem_size);
+	}
+}
+
+/** Write elements to a ring buffer
+ *
+ * Only one task or interrupt handler may write to a given ring buffer.
+ * If the consumer is blocked in os_ringbuf_wait() it is notified.
+ *
+ * @param[in] rb Ring buffer
+ * @param[in] elems Elements to write
+ * @param[in] count Number of elements to write
+ *
+ * @return Number of elements written, less than count if the ring buffer
+ * is full
+ */
+static inline uint32_t os_ringbuf_write(os_ringbuf_t *rb, const void *elems,
+					uint32_t count)
+{
+	uint32_t head = rb->head;
+	uint32_t space = rb->num_elems - (head - rb->tail);
+	os_thread_t waiter;
+
+	if (count > space)
+		count = space;
+	if (!count)
+		return 0;
+
+	os_ringbuf_copy(rb, head, (void *) elems, count, true);
+	/* The data must be visible before the consumer sees the new head */
+	__DMB();
+	rb->head = head + count;
+	/* Pairs with the barrier in os_ringbuf_wait() so either the
+	 * consumer sees the new head or we see it waiting */
+	__DMB();
+
+	if (!rb->waiter)
+		return count;
+	waiter = os_ringbuf_take_waiter(rb);
+	if (!waiter)
+		return count;
+
+	if (is_isr_context()) {
+		signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(waiter, &xHigherPriorityTaskWoken);
+		portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+	} else
+		xTaskNotifyGive(waiter);
+
+	return count;
+}
+
+/** Read elements from a ring buffer
+ *
+ * Only one task or interrupt handler may read from a given ring buffer.
+ * This never blocks, see os_ringbuf_wait().
+ *
+ * @param[in] rb Ring buffer
+ * @param[out] elems Buffer for up to max elements
+ * @param[in] max Maximum number of elements to read
+ *
+ * @return Number of elements read
+ */
+static inline uint32_t os_ringbuf_read(os_ringbuf_t *rb, void *elems,
+				       uint32_t max)
+{
+	uint32_t tail = rb->tail;
+	uint32_t count = rb->head - tail;
+
+	if (count > max)
+		count = max;
+	if (!count)
+		return 0;
+
+	/* Do not read the data before the head that covers it */
+	__DMB();
+	os_ringbuf_copy(rb, tail, elems, count, false);
+	/* The data must be read before the producer can overwrite it */
+	__DMB();
+	rb->tail = tail + count;
+
+	return count;
+}
+
+/** Wait for data in a ring buffer
+ *
+ * Blocks the consumer task until the ring buffer is not empty. The task
+ * notification of the calling task is used for the wakeup, so it must not
+ * be used for anything else by that task.
+ *
+ * \note This function must not be used in an interrupt service routine.
+ *
+ * @param[in] rb Ring buffer
+ * @param[in] wait Number of OS ticks to wait, or \ref OS_WAIT_FOREVER
+ *
+ * @return WM_SUCCESS when data is available
+ * @return -WM_FAIL on timeout
+ */
+static inline int os_ringbuf_wait(os_ringbuf_t *rb, unsigned long wait)
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t left = wait;
+
+	while (!os_ringbuf_count(rb)) {
+		rb->waiter = (uint32_t) xTaskGetCurrentTaskHandle();
+		__DMB();
+		if (os_ringbuf_count(rb) ||
+		    !ulTaskNotifyTake(pdTRUE, left))
+			break;
+		if (wait != OS_WAIT_FOREVER) {
+			TickType_t elapsed = xTaskGetTickCount() - start;
+			if (elapsed >= wait)
+				break;
+			left = wait - elapsed;
+		}
+	}
+	os_ringbuf_take_waiter(rb);
+
+	return os_ringbuf_count(rb) ? WM_SUCCESS : -WM_FAIL;
+}
+
 /* This function updates the global tick count
   *  When  MC200 core enters a low power state
   *  system tick counter stops generating interrupt.
@@ -1632,4 +2562,113 @@ void _os_delay(int cnt);
  */
 #define os_get_runtime_stats(__buff__) vTaskGetRunTimeStats(__buff__)
 
+#if (configGENERATE_RUN_TIME_STATS == 1)
+/** Run time statistics of one task
+ *
+ * Times are in run time counter units, the counter is the GPT selected
+ * with CONFIG_RUNTIME_STATS_USE_GPTx. They include the interrupts taken
+ * while the task was running.
+ */
+typedef struct {
+	/** Name of the task, copied as it can be deleted afterwards */
+	char name[configMAX_TASK_NAME_LEN];
+	/** Current priority of the task */
+	unsigned priority;
+	/** Time the task spent running */
+	uint32_t run_time;
+	/** Share of the total run time used by the task, in percent */
+	unsigned cpu_percent;
+	/** Number of times the task was switched in */
+	uint32_t switch_count;
+	/** Longest time the task kept the CPU before another task ran */
+	uint32_t max_run_slice;
+	/** Least amount of free stack the task ever had, in words */
+	unsigned stack_high_water;
+} os_task_stats_t;
+
+/** System wide run time statistics */
+typedef struct {
+	/** Number of tasks in the system */
+	unsigned num_tasks;
+	/** Run time counter value, the base of all the percentages */
+	uint32_t total_run_time;
+	/** Time spent in interrupt handlers that call os_isr_stats_enter()
+	 * and os_isr_stats_exit() */
+	uint32_t isr_run_time;
+	/** Number of those interrupts */
+	uint32_t isr_count;
+} os_runtime_stats_t;
+
+/** Mark the entry of an interrupt handler for os_get_task_stats() */
+#define os_isr_stats_enter() vTaskRunTimeISREnter()
+/** Mark the exit of an interrupt handler for os_get_task_stats() */
+#define os_isr_stats_exit() vTaskRunTimeISRExit()
+
+/** Get structured run time statistics
+ *
+ * This is the counterpart of os_get_runtime_stats() for code that wants
+ * to process or publish the numbers instead of printing them. Counters
+ * are cumulative, they can be cleared with vTaskResetRunTimeStats().
+ *
+ * @param[out] tasks Array filled with the statistics of the tasks
+ * @param[in] max_tasks Number of entries in tasks
+ * @param[out] num_filled Number of entries filled in tasks
+ * @param[out] sys System wide statistics, can be NULL
+ *
+ * @return WM_SUCCESS on success
+ * @return -WM_E_INVAL if tasks or num_filled is NULL
+ * @return -WM_E_NOMEM if the temporary task status array could not be
+ * allocated
+ */
+static inline int os_get_task_stats(os_task_stats_t *tasks, unsigned max_tasks,
+				    unsigned *num_filled,
+				    os_runtime_stats_t *sys)
+{
+	TaskStatus_t *status;
+	UBaseType_t count, i;
+	uint32_t total, percent_base;
+
+	if (!tasks || !num_filled)
+		return -WM_E_INVAL;
+
+	/* Leave room for tasks created before the scheduler is suspended */
+	count = uxTaskGetNumberOfTasks() + 2;
+	status = os_mem_alloc(count * sizeof(TaskStatus_t));
+	if (!status)
+		return -WM_E_NOMEM;
+
+	/* With the scheduler suspended no task can be deleted while its
+	 * handle is used below */
+	vTaskSuspendAll();
+	count = uxTaskGetSystemState(status, count, &total);
+	percent_base = total / 100;
+	for (i = 0; i < count && i < max_tasks; i++) {
+		strncpy(tasks[i].name, status[i].pcTaskName,
+			sizeof(tasks[i].name) - 1);
+		tasks[i].name[sizeof(tasks[i].name) - 1] = '\0';
+		tasks[i].priority = status[i].uxCurrentPriority;
+		tasks[i].run_time = status[i].ulRunTimeCounter;
+		tasks[i].cpu_percent = percent_base ?
+			status[i].ulRunTimeCounter / percent_base : 0;
+		tasks[i].stack_high_water = status[i].usStackHighWaterMark;
+		vTaskGetSwitchStats(status[i].xHandle, &tasks[i].switch_count,
+				    &tasks[i].max_run_slice);
+	}
+	xTaskResumeAll();
+	*num_filled = i;
+
+	if (sys) {
+		sys->num_tasks = count;
+		sys->total_run_time = total;
+		vTaskGetISRRunTime(&sys->isr_run_time, &sys->isr_count);
+	}
+
+	os_mem_free(status);
+	return WM_SUCCESS;
+}
+#else
+#define os_isr_stats_enter()
+#define os_isr_stats_exit()
+#endif /* configGENERATE_RUN_TIME_STATS */
+
 #endif /* ! _WM_OS_H_ */
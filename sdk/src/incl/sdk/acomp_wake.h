@@ -0,0 +1,92 @@
+/*! \file acomp_wake.h
+ * \brief Analog comparator events instead of ADC polling
+ *
+ * acomp_drv_result() of \ref mdev_acomp.h can only be polled, and polling
+ * an ADC or the comparator to catch a threshold keeps the CPU awake. Here
+ * the comparator's interrupt reports the crossing instead. Nothing runs
+ * until it happens, so the tickless idle sleeps in PM2 in between and the
+ * application thread waits, e.g. on a semaphore the callback gives, and
+ * then starts its ADC capture.
+ *
+ * The comparator is opened with acomp_drv_open() as usual, with the input
+ * on the positive channel and the threshold on the negative one, e.g.
+ * ACOMP_NEG_CH_VREF1P2 or a DAC channel for a programmable level.
+ *
+ * An event is reported once: the interrupt is masked when it fires, so a
+ * noisy input does not flood the CPU, and acomp_wake_arm() arms it again.
+ *
+ * The comparator is not powered in PM4, see the wake_ulpcomp option of
+ * \ref duty_cycle.h to wake from there.
+ *
+ * @code
+ * static os_semaphore_t crossed;
+ *
+ * static void crossing(ACOMP_ID_Type id, void *arg)
+ * {
+ *	os_semaphore_put(&crossed);
+ * }
+ *
+ * acomp_drv_init(ACOMP_ACOMP0);
+ * acomp = acomp_drv_open(ACOMP_ACOMP0, ACOMP_POS_CH_GPIO42,
+ *			 ACOMP_NEG_CH_VREF1P2);
+ * acomp_wake_start(ACOMP_ACOMP0, ACOMP_INTTRIG_RISING_EDGE, crossing, NULL);
+ * for (;;) {
+ *	acomp_wake_arm(ACOMP_ACOMP0);
+ *	os_semaphore_get(&crossed, OS_WAIT_FOREVER);
+ *	capture_with_the_adc();
+ * }
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _ACOMP_WAKE_H_
+#define _ACOMP_WAKE_H_
+
+#include <mdev_acomp.h>
+
+/** Crossing callback, called from the comparator interrupt
+ *
+ * \param[in] id The comparator
+ * \param[in] arg Argument given to acomp_wake_start()
+ */
+typedef void (*acomp_wake_cb_t)(ACOMP_ID_Type id, void *arg);
+
+/** Set up the event of a comparator
+ *
+ * The event is not armed yet, see acomp_wake_arm().
+ *
+ * \param[in] id The comparator, opened with acomp_drv_open()
+ * \param[in] trig Edge or level of the output that is the event
+ * \param[in] cb Crossing callback
+ * \param[in] arg Argument of the callback
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int acomp_wake_start(ACOMP_ID_Type id, ACOMP_IntTrig_Type trig,
+		     acomp_wake_cb_t cb, void *arg);
+
+/** Arm the event, it is reported once
+ *
+ * Can be called from the callback.
+ *
+ * \param[in] id The comparator
+ */
+void acomp_wake_arm(ACOMP_ID_Type id);
+
+/** Disarm the event
+ *
+ * \param[in] id The comparator
+ */
+void acomp_wake_disarm(ACOMP_ID_Type id);
+
+/** Stop the event of a comparator, the callback is not called anymore
+ *
+ * \param[in] id The comparator
+ */
+void acomp_wake_stop(ACOMP_ID_Type id);
+
+#endif /* _ACOMP_WAKE_H_ */
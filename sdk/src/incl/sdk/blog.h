@@ -0,0 +1,189 @@
+/*! \file blog.h
+ * \brief Binary log in a RAM ring, decoded on the host
+ *
+ * blog() formats nothing on the device. Its format string is placed in the
+ * .blog_fmt section, which the linker scripts keep in the .axf but not in
+ * the image, and the address of the string is the id of the message. A
+ * record is the id, a millisecond timestamp, the level and the raw bytes of
+ * the arguments, so logging costs a copy of a few dozen bytes and no flash
+ * for the strings.
+ *
+ * The kinds of the arguments are worked out at build time: 32 bit integers
+ * and pointers, 64 bit integers, floating point numbers, which are written
+ * as doubles, and strings, whose first BLOG_MAX_STR bytes are copied. Up to
+ * 8 arguments are taken.
+ *
+ * The ring holds the last BLOG_RING_SIZE bytes of records, the oldest ones
+ * are overwritten. It is exported with blog_dump() on the console as
+ * hexadecimal lines, with blog_save() to a flash region, or with
+ * blog_export() to any writer, e.g. a buffer published over MQTT. All three
+ * write the same image: struct blog_hdr, then the records, oldest first,
+ * each a struct blog_rec followed by its arguments. All fields are little
+ * endian. sdk/tools/bin/blog_decode.py turns it back into text with the
+ * format strings of the .axf:
+ *
+ * @code
+ * blog(BLOG_WARN, "publish to %s failed: %d after %u ms", topic, rc, ms);
+ * ...
+ * blog_dump();
+ *
+ * $ sdk/tools/bin/blog_decode.py bin/mw302_rd/app.axf console.log
+ * [    1234 W] publish to dev/telemetry failed: -13 after 5000 ms
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _BLOG_H_
+#define _BLOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct flash_desc;
+
+/** Bytes of records the ring holds, a power of two */
+#ifndef BLOG_RING_SIZE
+#define BLOG_RING_SIZE 4096
+#endif
+
+/** Bytes of a string argument that are kept */
+#ifndef BLOG_MAX_STR
+#define BLOG_MAX_STR 24
+#endif
+
+#define BLOG_MAGIC 0x474f4c42	/* "BLOG" */
+#define BLOG_VERSION 1
+
+/** Levels of the records */
+enum blog_level {
+	BLOG_ERR,
+	BLOG_WARN,
+	BLOG_INFO,
+	BLOG_DEBUG,
+};
+
+/** Kinds of the arguments, three bits each in blog_rec.sig, the first
+ * argument lowest, 0 after the last one */
+enum blog_arg {
+	/** 4 bytes */
+	BLOG_ARG_32 = 1,
+	/** 8 bytes */
+	BLOG_ARG_64,
+	/** A double, 8 bytes */
+	BLOG_ARG_DOUBLE,
+	/** A length byte and as many bytes, no NUL */
+	BLOG_ARG_STR,
+};
+
+/** Header of an exported image */
+struct blog_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_size;
+	/** Bytes of records that follow */
+	uint32_t len;
+	/** Records overwritten or not written since the start */
+	uint32_t dropped;
+} __attribute__((packed));
+
+/** Header of a record */
+struct blog_rec {
+	/** Address of the format string in .blog_fmt */
+	uint32_t id;
+	/** Milliseconds since boot */
+	uint32_t ms;
+	/** Kinds of the arguments, see enum blog_arg */
+	uint32_t sig;
+	uint8_t level;
+	/** Bytes of arguments that follow */
+	uint8_t len;
+} __attribute__((packed));
+
+/** Writer of an export
+ *
+ * \return WM_SUCCESS or an error code, which stops the export
+ */
+typedef int (*blog_out_t)(void *ctx, const void *buf, uint32_t len);
+
+#define _BLOG_KIND(x) _Generic((x) + 0,				\
+	char *: BLOG_ARG_STR,					\
+	const char *: BLOG_ARG_STR,				\
+	float: BLOG_ARG_DOUBLE,					\
+	double: BLOG_ARG_DOUBLE,				\
+	long long: BLOG_ARG_64,					\
+	unsigned long long: BLOG_ARG_64,			\
+	default: BLOG_ARG_32)
+
+#define _BLOG_NARGS(...) _BLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _BLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define _BLOG_CAT(a, b) _BLOG_CAT_(a, b)
+#define _BLOG_CAT_(a, b) a##b
+#define _BLOG_SIG(...) _BLOG_CAT(_BLOG_SIG, _BLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define _BLOG_SIG0() 0
+#define _BLOG_SIG1(a) _BLOG_KIND(a)
+#define _BLOG_SIG2(a, ...) (_BLOG_KIND(a) | _BLOG_SIG1(__VA_ARGS__) << 3)
+#define _BLOG_SIG3(a, ...) (_BLOG_KIND(a) | _BLOG_SIG2(__VA_ARGS__) << 3)
+#define _BLOG_SIG4(a, ...) (_BLOG_KIND(a) | _BLOG_SIG3(__VA_ARGS__) << 3)
+#define _BLOG_SIG5(a, ...) (_BLOG_KIND(a) | _BLOG_SIG4(__VA_ARGS__) << 3)
+#define _BLOG_SIG6(a, ...) (_BLOG_KIND(a) | _BLOG_SIG5(__VA_ARGS__) << 3)
+#define _BLOG_SIG7(a, ...) (_BLOG_KIND(a) | _BLOG_SIG6(__VA_ARGS__) << 3)
+#define _BLOG_SIG8(a, ...) (_BLOG_KIND(a) | _BLOG_SIG7(__VA_ARGS__) << 3)
+
+/** Log a message
+ *
+ * Can be called from any task and from interrupt handlers.
+ *
+ * \param[in] level enum blog_level
+ * \param[in] fmt printf format, a string literal
+ */
+#define blog(level, fmt, ...) do {					\
+	static const char _blog_fmt[]					\
+		__attribute__((section(".blog_fmt"), used)) = fmt;	\
+	blog_write((level), (uint32_t)_blog_fmt,			\
+		   _BLOG_SIG(__VA_ARGS__), ##__VA_ARGS__);		\
+} while (0)
+
+/** Write a record, use blog() */
+void blog_write(int level, uint32_t id, uint32_t sig, ...);
+
+/** Export the ring
+ *
+ * Logging is paused meanwhile.
+ *
+ * \param[in] out Writer, called with the header and then the records
+ * \param[in] ctx Passed to out
+ * \param[in] consume true to take the exported records off the ring, e.g.
+ * once they are uploaded, so that the next export has only the new ones
+ *
+ * \return WM_SUCCESS or the error of out, nothing is taken off the ring
+ * then
+ */
+int blog_export(blog_out_t out, void *ctx, bool consume);
+
+/** Print the ring on the console
+ *
+ * The image goes between "blog begin" and "blog end" lines, as "blog
+ * <hex>" lines.
+ *
+ * \return WM_SUCCESS
+ */
+int blog_dump(void);
+
+/** Write the ring to a flash region
+ *
+ * The region is erased first, an image longer than the region is cut.
+ *
+ * \param[in] fl Region, e.g. a partition of the layout
+ *
+ * \return WM_SUCCESS or -WM_FAIL
+ */
+int blog_save(const struct flash_desc *fl);
+
+/** Records overwritten or not written since the start */
+uint32_t blog_dropped(void);
+
+#endif /* _BLOG_H_ */
@@ -62,10 +62,20 @@ int board_main_osc();
  * NOTE: Valid frequencies depend upon the source clock.
  * Please refer to the datasheet for further details.
  *
+ * The frequency may be changed at run time, see cpu_clk.h, this returns
+ * the one the CPU runs at now.
+ *
  *  \return Frequency at which CPU should operate.
  */
 int board_cpu_freq();
 
+/** Frequency the CPU runs at now
+ *
+ * The board file sets it to the frequency of board_cpu_freq() at boot and
+ * returns it from board_cpu_freq(), cpu_clk.h updates it.
+ */
+extern int board_cpu_hz;
+
 /** 32 KHz crystal
  *
  * If 32 KHz crystal is present on the board and
@@ -0,0 +1,103 @@
+/*! \file boot_stage.h
+ * \brief Boot timing and deferred initialization
+ *
+ * The boot is cut into stages, each ended by boot_stage() with its name,
+ * so that the time every stage took, from reset to the first publish, can
+ * be printed. The modules not needed to send the first message, like the
+ * buttons or the LEDs, register their initialization with boot_defer()
+ * instead of running it in main(). A low priority thread runs them once the
+ * application calls boot_defer_release(), after its first publish, or
+ * after a timeout if that does not happen, and then prints the stages.
+ *
+ * @code
+ * int main()
+ * {
+ *	wmstdio_init(UART0_ID, 0);
+ *	boot_stage("stdio");
+ *	...
+ *	boot_defer("buttons", configure_buttons);
+ *	boot_defer_start(30000);
+ *	wm_wlan_start(MICRO_AP_SSID, MICRO_AP_PASSPHRASE);
+ *	boot_stage("wlan start");
+ * }
+ *
+ * and in the cloud thread, once the first message is sent:
+ *
+ *	boot_stage("first publish");
+ *	boot_defer_release();
+ * @endcode
+ *
+ * gives
+ *
+ * @code
+ *       boot at ms  took ms  stage
+ *             31.2     31.2  stdio
+ *            ...
+ *           2410.7    812.5  first publish
+ *           2411.9      1.2  buttons (deferred)
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _BOOT_STAGE_H_
+#define _BOOT_STAGE_H_
+
+#include <stdint.h>
+
+/** Stages recorded, the ones beyond are dropped */
+#ifndef BOOT_STAGE_MAX
+#define BOOT_STAGE_MAX 24
+#endif
+
+/** Deferred initializations that can be registered */
+#ifndef BOOT_DEFER_MAX
+#define BOOT_DEFER_MAX 8
+#endif
+
+/** End a boot stage
+ *
+ * The stage started at the end of the previous one, the first at reset.
+ *
+ * \param[in] name Name of the stage, not copied
+ */
+void boot_stage(const char *name);
+
+/** Register an initialization to be run after the first publish
+ *
+ * Initializations run in the order they were registered, in the thread of
+ * boot_defer_start(). An initialization registered once they ran is run at
+ * once, by the caller.
+ *
+ * \param[in] name Name of the stage of the initialization, not copied
+ * \param[in] init The initialization
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_NOSPC if BOOT_DEFER_MAX initializations are registered
+ */
+int boot_defer(const char *name, void (*init)(void));
+
+/** Start the thread of the deferred initializations
+ *
+ * \param[in] timeout_ms Time after which the initializations run when
+ * boot_defer_release() was not called, so that for instance a device which
+ * can not connect still gets its buttons
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_FAIL if the thread could not be created
+ */
+int boot_defer_start(uint32_t timeout_ms);
+
+/** Run the deferred initializations now
+ *
+ * Only the first call after boot_defer_start() has an effect.
+ */
+void boot_defer_release(void);
+
+/** Print the stages on the console */
+void boot_stage_dump(void);
+
+#endif /* _BOOT_STAGE_H_ */
@@ -0,0 +1,146 @@
+/*! \file clock_disc.h
+ * \brief Clock disciplined by NTP between syncs
+ *
+ * The system time of wmtime.h keeps the seconds of the RTC and is only
+ * corrected when ntpc_sync() sets it, so the RTC crystal, tens of ppm off,
+ * drifts by seconds a day. Syncing often enough to hide that costs radio
+ * time and traffic.
+ *
+ * This clock runs from the kernel tick count, which the tickless idle
+ * carries over the sleeps from the RTC, and corrects it:
+ * - the frequency error of the clock is estimated from the offsets of
+ *   successive syncs, and the rate of the clock corrected by it
+ * - the offset a sync finds is slewed out, at most CLOCK_DISC_SLEW_PPM,
+ *   so the time never goes back and does not jump; only an offset larger
+ *   than CLOCK_DISC_STEP_MS is stepped
+ * - the time to the next sync doubles while the offsets stay under a
+ *   quarter of CLOCK_DISC_TARGET_MS and halves when one is over half of it,
+ *   between CLOCK_DISC_MIN_INTERVAL_S and CLOCK_DISC_MAX_INTERVAL_S
+ *
+ * The error of a sync is at most half its round trip delay. With a steady
+ * temperature the interval settles at several hours.
+ *
+ * @code
+ * while (1) {
+ *	if (clock_disc_sync(servers, 3, 3000) != WM_SUCCESS)
+ *		wmprintf("No time from NTP\r\n");
+ *	os_thread_sleep(os_msec_to_ticks(clock_disc_next_sync_ms()));
+ * }
+ * ...
+ * int64_t ms = clock_disc_time_ms();
+ * @endcode
+ *
+ * The estimate of the frequency can be kept across resets, e.g. in psm,
+ * and given back to clock_disc_init().
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _CLOCK_DISC_H_
+#define _CLOCK_DISC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Accuracy the sync interval is adapted for, in ms */
+#ifndef CLOCK_DISC_TARGET_MS
+#define CLOCK_DISC_TARGET_MS 250
+#endif
+
+/** Shortest time between two syncs, in s */
+#ifndef CLOCK_DISC_MIN_INTERVAL_S
+#define CLOCK_DISC_MIN_INTERVAL_S 900
+#endif
+
+/** Longest time between two syncs, in s */
+#ifndef CLOCK_DISC_MAX_INTERVAL_S
+#define CLOCK_DISC_MAX_INTERVAL_S 86400
+#endif
+
+/** Largest frequency error taken as the clock's, in ppm */
+#ifndef CLOCK_DISC_MAX_PPM
+#define CLOCK_DISC_MAX_PPM 500
+#endif
+
+/** Rate an offset is slewed at, in ppm */
+#ifndef CLOCK_DISC_SLEW_PPM
+#define CLOCK_DISC_SLEW_PPM 500
+#endif
+
+/** Offsets larger than this are stepped, in ms */
+#ifndef CLOCK_DISC_STEP_MS
+#define CLOCK_DISC_STEP_MS 1000
+#endif
+
+/** State of the clock */
+struct clock_disc_status {
+	/** The clock has been set by a sync */
+	bool set;
+	/** Frequency correction, in parts per billion */
+	int32_t ppb;
+	/** Offset found by the last sync, in ms */
+	int32_t offset_ms;
+	/** Round trip delay of the last sync, in ms */
+	uint32_t delay_ms;
+	/** Time from the last sync to the next one, in s */
+	uint32_t interval_s;
+	/** Syncs taken */
+	uint32_t syncs;
+	/** Syncs that stepped the clock */
+	uint32_t steps;
+};
+
+/** Seed the frequency correction
+ *
+ * Optional, before the first sync.
+ *
+ * \param[in] ppb Correction of an earlier run, in parts per billion
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if it is over CLOCK_DISC_MAX_PPM
+ */
+int clock_disc_init(int32_t ppb);
+
+/** Sync with NTP servers and correct the clock
+ *
+ * Runs ntpc_sync(), which also sets the system time, and takes its
+ * result as a sample.
+ *
+ * \param[in] servers Names or dotted addresses of the servers
+ * \param[in] count Number of servers
+ * \param[in] timeout_ms Most time the sync takes
+ *
+ * \return WM_SUCCESS or the error of ntpc_sync(), after which the next
+ * sync is due in CLOCK_DISC_MIN_INTERVAL_S
+ */
+int clock_disc_sync(const char *const servers[], int count,
+		    uint32_t timeout_ms);
+
+/** Correct the clock with a time from another source
+ *
+ * \param[in] time_ms Time now, in ms since 1970
+ * \param[in] delay_ms Round trip delay of the exchange it came from
+ */
+void clock_disc_sample(int64_t time_ms, uint32_t delay_ms);
+
+/** Corrected time
+ *
+ * \return Time in ms since 1970, 0 before the first sync
+ */
+int64_t clock_disc_time_ms(void);
+
+/** Time until the next sync is due
+ *
+ * \return Milliseconds, 0 if it is due
+ */
+uint32_t clock_disc_next_sync_ms(void);
+
+/** Get the state of the clock
+ *
+ * \param[out] st The state
+ */
+void clock_disc_get(struct clock_disc_status *st);
+
+#endif /* ! _CLOCK_DISC_H_ */
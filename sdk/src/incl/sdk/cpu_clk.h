@@ -0,0 +1,126 @@
+/*! \file cpu_clk.h
+ * \brief Switching the CPU clock at run time
+ *
+ * The board boots with the system clock on the SFLL at board_cpu_freq().
+ * Most of the time a connected device waits on the network and needs a
+ * fraction of that, while a TLS handshake, an OTA image being hashed and
+ * decrypted or a burst of signal processing want all of it. This module
+ * runs the system clock at one of two levels:
+ *
+ * - CPU_CLK_HIGH, the SFLL at the frequency the board booted at
+ * - CPU_CLK_LOW, the RC32M oscillator at CPU_CLK_LOW_HZ
+ *
+ * The clock is at CPU_CLK_HIGH while any boost is held, at the default
+ * level otherwise. The default is CPU_CLK_HIGH, the boot behaviour, until
+ * the application lowers it with cpu_clk_set_default(). The TLS handshake
+ * of the MQTT client and OTA updates hold a boost, other heavy work takes
+ * one with cpu_clk_boost_begin() and cpu_clk_boost_end().
+ *
+ * A switch keeps the rest of the system correct: board_cpu_freq() returns
+ * the new frequency, so the microsecond timers of wm_os.h follow, the
+ * SysTick is reloaded in the middle of the current tick without losing
+ * time, and the fractional dividers of the UART fast and slow clocks are
+ * rescaled so that baud rates do not change. Users of clocks derived from
+ * the system clock that are set up once, such as a GPT started with
+ * gpt_drv_set(), register a notifier and set them up again.
+ *
+ * The SFLL is left locked at CPU_CLK_LOW, only the core and bus clocks
+ * are lowered, so that a boost takes effect at once.
+ *
+ * @code
+ * static void gpt_reclock(uint32_t old_hz, uint32_t new_hz, void *ctx)
+ * {
+ *	gpt_drv_set(ctx, PERIOD_US);
+ * }
+ * static struct cpu_clk_notifier gpt_nb = { gpt_reclock };
+ *
+ * cpu_clk_init();
+ * gpt_nb.ctx = gpt_dev;
+ * cpu_clk_notifier_register(&gpt_nb);
+ * cpu_clk_set_default(CPU_CLK_LOW);
+ * ...
+ * cpu_clk_boost_begin();
+ * sig_feat_spectrum(&fft, samples, power);
+ * cpu_clk_boost_end();
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _CPU_CLK_H_
+#define _CPU_CLK_H_
+
+#include <stdint.h>
+
+/** Frequency of the RC32M oscillator, the system clock at CPU_CLK_LOW */
+#define CPU_CLK_LOW_HZ 32000000
+
+/** Levels of the system clock */
+enum cpu_clk_level {
+	/** RC32M */
+	CPU_CLK_LOW,
+	/** SFLL at the boot frequency */
+	CPU_CLK_HIGH,
+};
+
+/** Called after a switch, in the task that caused it */
+typedef void (*cpu_clk_notify_t)(uint32_t old_hz, uint32_t new_hz,
+				 void *ctx);
+
+/** A notifier, it belongs to the caller and has to stay in place while it
+ * is registered */
+struct cpu_clk_notifier {
+	cpu_clk_notify_t fn;
+	void *ctx;
+	struct cpu_clk_notifier *next;
+};
+
+/** Initialize the module
+ *
+ * Takes the current frequency as the CPU_CLK_HIGH one. Boosts taken
+ * before are counted.
+ *
+ * \return WM_SUCCESS or -WM_FAIL
+ */
+int cpu_clk_init(void);
+
+/** Set the level of the clock while no boost is held
+ *
+ * The clock is switched at once if needed. Can only be called from a
+ * task.
+ *
+ * \param[in] level enum cpu_clk_level
+ *
+ * \return WM_SUCCESS
+ * \return -WM_E_INVAL for an unknown level
+ * \return -WM_FAIL if the module is not initialized or the UART clocks can
+ * not be kept at that level
+ */
+int cpu_clk_set_default(enum cpu_clk_level level);
+
+/** Run at CPU_CLK_HIGH until the matching cpu_clk_boost_end()
+ *
+ * Boosts nest and may be held by several tasks. Can only be called from a
+ * task.
+ */
+void cpu_clk_boost_begin(void);
+
+/** Release a boost of cpu_clk_boost_begin() */
+void cpu_clk_boost_end(void);
+
+/** Register a notifier of the switches
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int cpu_clk_notifier_register(struct cpu_clk_notifier *n);
+
+/** Unregister a notifier */
+void cpu_clk_notifier_unregister(struct cpu_clk_notifier *n);
+
+/** The current level */
+enum cpu_clk_level cpu_clk_get_level(void);
+
+#endif /* _CPU_CLK_H_ */
@@ -0,0 +1,119 @@
+/*! \file crc32.h
+ * \brief CRC32 over the CRC engine with a software fallback
+ *
+ * soft_crc32() and crc32() compute the same checksum, the reflected IEEE
+ * 802.3 CRC32 without pre or post inversion, one a byte at a time on the
+ * core and the other on the CRC engine, where it can not continue from an
+ * earlier value.
+ *
+ * fast_crc32() is a drop in replacement of soft_crc32(): large buffers go
+ * to the CRC engine and are joined to the previous value in software, the
+ * rest, and everything when the engine is not available or in interrupt
+ * context, is computed eight bytes at a time. The crc32_stream_* functions
+ * checksum data coming in pieces, e.g. a firmware image read from flash
+ * with a small buffer.
+ *
+ * @code
+ * crc32_stream_t s;
+ *
+ * fast_crc32_init();
+ * crc32_stream_init(&s, 0);
+ * while ((len = read_chunk(buf, sizeof(buf))) > 0)
+ *	crc32_stream_feed(&s, buf, len);
+ * if (crc32_stream_result(&s) != expected_crc)
+ *	return -WM_FAIL;
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Buffers of at least this many bytes are given to the CRC engine */
+#define FAST_CRC32_HW_MIN_LEN 512
+
+/** Checksum of data coming in pieces */
+typedef struct {
+	/** CRC32 of the data fed so far */
+	uint32_t crc;
+} crc32_stream_t;
+
+/** Register the CRC engine driver
+ *
+ * This is the same as crc_drv_init().
+ *
+ * \return WM_SUCCESS or error code
+ */
+int crc32_init(void);
+
+/** Calculate CRC32 on the CRC engine
+ *
+ * @pre crc32_init()
+ *
+ * \param[in] __data Input buffer over which CRC32 is calculated.
+ * \param[in] data_size Length of the input buffer.
+ * \param[in] prev_crc Has to be 0, the engine can not continue from an
+ * earlier value.
+ *
+ * \return Calculated CRC32 value, 0xffffffff on error
+ */
+uint32_t crc32(const void *__data, int data_size, uint32_t prev_crc);
+
+/** Set up fast_crc32()
+ *
+ * Registers the CRC engine driver. Without this call, or if the driver
+ * could not be registered, fast_crc32() computes everything in software.
+ *
+ * \return WM_SUCCESS if the CRC engine is used, error code otherwise
+ */
+int fast_crc32_init(void);
+
+/** Calculate CRC32, on the CRC engine when it pays off
+ *
+ * Gives the same result as soft_crc32() for the same arguments.
+ *
+ * \param[in] data Input buffer over which CRC32 is calculated.
+ * \param[in] len Length of the input buffer.
+ * \param[in] crc Previous CRC32 value used as starting point for given
+ * buffer calculation.
+ *
+ * \return Calculated CRC32 value
+ */
+uint32_t fast_crc32(const void *data, size_t len, uint32_t crc);
+
+/** Start a streaming checksum
+ *
+ * \param[out] s Stream to initialize
+ * \param[in] crc Starting value, as for fast_crc32()
+ */
+void crc32_stream_init(crc32_stream_t *s, uint32_t crc);
+
+/** Add data to a streaming checksum
+ *
+ * The pieces can have any length and alignment, pieces of at least
+ * FAST_CRC32_HW_MIN_LEN bytes are checksummed on the CRC engine.
+ *
+ * \param[in,out] s Stream set up with crc32_stream_init()
+ * \param[in] data Next piece of the data
+ * \param[in] len Length of the piece
+ */
+void crc32_stream_feed(crc32_stream_t *s, const void *data, size_t len);
+
+/** CRC32 of all the data fed to a stream
+ *
+ * The stream can be fed further afterwards.
+ *
+ * \param[in] s Stream set up with crc32_stream_init()
+ *
+ * \return Calculated CRC32 value
+ */
+uint32_t crc32_stream_result(const crc32_stream_t *s);
+
+#endif /* ! _CRC32_H_ */
@@ -0,0 +1,85 @@
+/*! \file cred_store.h
+ * \brief Device certificate and key used in place from a flash partition
+ *
+ * read_aws_certificate() and read_aws_key() copy the credentials from the
+ * persistent memory into buffers of AWS_PUB_CERT_SIZE and
+ * AWS_PRIV_KEY_SIZE bytes, which the application keeps for its lifetime
+ * since the TLS layer is handed the same pointers at every reconnect.
+ *
+ * This module keeps them in a partition of their own instead, written once
+ * after provisioning with cred_store_write(): a header with their lengths
+ * and a CRC32, then the certificate and the key, each followed by a NUL so
+ * that PEM strings can be used as they are. cred_store_get() checks the
+ * CRC and returns pointers into the partition, read through the flash
+ * controller, when the image is XIP and the partition is in the internal
+ * flash. The credentials then take no RAM. Otherwise they are read once
+ * into a buffer of their actual size.
+ *
+ * The partition is not written again by the module, the pointers stay
+ * valid until the next cred_store_write().
+ *
+ * @code
+ * flash_desc_t fl = { FL_INT, 0x1fb000, 0x1000 };
+ * const char *cert, *key;
+ *
+ * flash_drv_init();
+ * if (cred_store_get(&fl, &cert, &key) != WM_SUCCESS) {
+ *	read_aws_certificate(buf, AWS_PUB_CERT_SIZE);
+ *	...
+ *	cred_store_write(&fl, buf, strlen(buf), key_buf, strlen(key_buf));
+ *	cred_store_get(&fl, &cert, &key);
+ * }
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _CRED_STORE_H_
+#define _CRED_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <flash.h>
+
+/** Write the certificate and the key to the partition
+ *
+ * Erases the sectors they take and writes them, PEM or DER. The
+ * partition has to hold a 16 byte header, both of them and their NULs.
+ *
+ * \param[in] fl Partition
+ * \param[in] cert Certificate
+ * \param[in] cert_len Bytes of the certificate, without a NUL
+ * \param[in] key Private key
+ * \param[in] key_len Bytes of the key, without a NUL
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if they do not fit or -WM_FAIL if the
+ * flash could not be written
+ */
+int cred_store_write(const flash_desc_t *fl, const void *cert,
+		     size_t cert_len, const void *key, size_t key_len);
+
+/** Get the certificate and the key of the partition
+ *
+ * \param[in] fl Partition
+ * \param[out] cert NUL terminated certificate
+ * \param[out] key NUL terminated private key
+ *
+ * \return WM_SUCCESS, -WM_E_NOENT if the partition holds no credentials or
+ * they fail the CRC, -WM_E_NOMEM if they could not be copied to RAM or
+ * -WM_FAIL if the flash could not be read
+ */
+int cred_store_get(const flash_desc_t *fl, const char **cert,
+		   const char **key);
+
+/** Tell whether cred_store_get() returns pointers into the flash
+ *
+ * \param[in] fl Partition
+ *
+ * \return true for a partition of the internal flash in an XIP image
+ */
+bool cred_store_is_mapped(const flash_desc_t *fl);
+
+#endif /* ! _CRED_STORE_H_ */
@@ -0,0 +1,128 @@
+/*! \file cycle_trace.h
+ * \brief Cycle accurate tracing of spans of code
+ *
+ * CYCLE_TRACE_BEGIN() and CYCLE_TRACE_END() mark where a span of code starts
+ * and ends. Each of them stores an event in a ring buffer in RAM with the
+ * value of the DWT cycle counter of the Cortex-M4, the task it ran in and
+ * the id of the span. The MQTT client, the shadow, the TLS layer and the
+ * lwIP thread are instrumented, so that the time a message spends in every
+ * layer can be read on a time line.
+ *
+ * The tracer is built with CONFIG_CYCLE_TRACE, without it the macros compile
+ * to nothing. The ring holds the last CONFIG_CYCLE_TRACE_EVENT_CNT events.
+ * The cycle counter wraps every 2^32 cycles, 21 seconds at 200 MHz, a gap of
+ * that long between two events of the ring shortens the time line.
+ *
+ * cycle_trace_dump() prints the ring in the JSON format of the Chrome trace
+ * viewer, between a "ctrace begin" and a "ctrace end" line. Events of
+ * interrupts have thread id 0, the ones of tasks have the task handle.
+ *
+ * @code
+ * cycle_trace_cli_init();
+ * ...
+ * # ctrace start
+ * # ctrace stop
+ * # ctrace dump
+ * @endcode
+ *
+ * and on the host, with the console output saved in console.log:
+ *
+ * @code
+ * $ sed -n '/^ctrace begin/,/^ctrace end/{//!p}' console.log > trace.json
+ * @endcode
+ *
+ * trace.json opens in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Applications trace their own spans with ids from CYCLE_TRACE_APP named
+ * with cycle_trace_set_name().
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _CYCLE_TRACE_H_
+#define _CYCLE_TRACE_H_
+
+#include <stdint.h>
+
+/** Ids of the traced spans */
+enum cycle_trace_id {
+	CYCLE_TRACE_MQTT_READ_PACKET,
+	CYCLE_TRACE_MQTT_DELIVER,
+	CYCLE_TRACE_MQTT_SEND_PACKET,
+	CYCLE_TRACE_SHADOW_DELTA,
+	CYCLE_TRACE_TLS_READ,
+	CYCLE_TRACE_TLS_WRITE,
+	CYCLE_TRACE_TCPIP_MSG,
+	/** First id free for the application */
+	CYCLE_TRACE_APP,
+	/** Number of ids */
+	CYCLE_TRACE_ID_CNT = 32,
+};
+
+/** Phase of an event */
+enum cycle_trace_phase {
+	CYCLE_TRACE_PH_BEGIN,
+	CYCLE_TRACE_PH_END,
+};
+
+#ifdef CONFIG_CYCLE_TRACE
+#define CYCLE_TRACE_BEGIN(id) cycle_trace_record(id, CYCLE_TRACE_PH_BEGIN)
+#define CYCLE_TRACE_END(id) cycle_trace_record(id, CYCLE_TRACE_PH_END)
+#else
+#define CYCLE_TRACE_BEGIN(id) do { } while (0)
+#define CYCLE_TRACE_END(id) do { } while (0)
+#endif
+
+/** Store an event in the ring
+ *
+ * Does nothing unless the tracer is started. May be called from an
+ * interrupt. Use CYCLE_TRACE_BEGIN() and CYCLE_TRACE_END() instead, they go
+ * away in the builds without the tracer.
+ *
+ * \param[in] id Id of the span, below CYCLE_TRACE_ID_CNT
+ * \param[in] phase CYCLE_TRACE_PH_BEGIN or CYCLE_TRACE_PH_END
+ */
+void cycle_trace_record(unsigned id, unsigned phase);
+
+/** Name the span of an application id
+ *
+ * \param[in] id Id from CYCLE_TRACE_APP to CYCLE_TRACE_ID_CNT - 1
+ * \param[in] name Name shown by the viewer, not copied
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the id is not one of the application
+ */
+int cycle_trace_set_name(unsigned id, const char *name);
+
+/** Start the cycle counter and the recording of events
+ *
+ * Events are added to the ones of the previous runs until
+ * cycle_trace_reset().
+ */
+void cycle_trace_start(void);
+
+/** Stop the recording of events */
+void cycle_trace_stop(void);
+
+/** Forget the events recorded so far */
+void cycle_trace_reset(void);
+
+/** Print the ring on the console in the Chrome trace viewer format
+ *
+ * The recording is paused while printing.
+ */
+void cycle_trace_dump(void);
+
+/** Register the tracer cli commands
+ *
+ * "ctrace start", "ctrace stop", "ctrace reset" and "ctrace dump".
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_FAIL if the commands could not be registered
+ */
+int cycle_trace_cli_init(void);
+
+#endif /* _CYCLE_TRACE_H_ */
@@ -0,0 +1,105 @@
+/*! \file dac_stream.h
+ * \brief Continuous DAC playback with DMA
+ *
+ * dac_drv_output() of \ref mdev_dac.h writes one value per call, a waveform
+ * needs a CPU loop or a timer interrupt per sample. Here a GPT triggers the
+ * DAC conversions at the sample rate, in the DAC's timing correlated mode,
+ * and the DMA feeds the samples from blocks the application queues. The CPU
+ * only sees one DMA interrupt per block.
+ *
+ * The queue is a ring of DAC_STREAM_QUEUE_LEN blocks. A block is handed to
+ * the callback when it has been played, from the DMA interrupt, and can be
+ * refilled and queued again. When the queue runs dry the output holds its
+ * last value until the next block is queued, or, in repeat mode, the last
+ * block is played again, e.g. for a periodic waveform.
+ *
+ * Only GPT2 and GPT3 can trigger the DAC. One stream runs at a time.
+ *
+ * @code
+ * static uint16_t sine[100];
+ *
+ * dac_drv_init();
+ * dac_modify_default_config(timingMode, DAC_TIMING_CORRELATED);
+ * dac_dev = dac_drv_open(MDEV_DAC, DAC_CH_A);
+ *
+ * // 100 samples at 40kHz, a 400Hz sine for as long as it runs
+ * dac_stream_start(dac_dev, DAC_CH_A, GPT2_ID, 40000, true, NULL, NULL);
+ * dac_stream_enqueue(sine, 100);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _DAC_STREAM_H_
+#define _DAC_STREAM_H_
+
+#include <stdbool.h>
+#include <mdev_dac.h>
+
+/** Blocks queued at most */
+#ifndef DAC_STREAM_QUEUE_LEN
+#define DAC_STREAM_QUEUE_LEN 8
+#endif
+
+/** Most samples of a block, the DMA moves at most 8191 bytes */
+#define DAC_STREAM_MAX_BLOCK 4095
+
+/** Highest sample rate, the DAC's fastest conversion rate */
+#define DAC_STREAM_MAX_RATE 500000
+
+/** Block played callback, called from the DMA interrupt
+ *
+ * \param[in] block The block, it belongs to the application again
+ * \param[in] num Its number of samples
+ * \param[in] arg Argument given to dac_stream_start()
+ */
+typedef void (*dac_stream_cb_t)(const uint16_t *block, int num, void *arg);
+
+/** Start a stream
+ *
+ * The DAC channel has to be opened in timing correlated mode, see the
+ * example above. Nothing is output until a block is queued.
+ *
+ * \param[in] dac_dev Handle from dac_drv_open()
+ * \param[in] ch The channel dac_dev was opened on
+ * \param[in] gpt GPT2_ID or GPT3_ID, the timer of the sample rate. It is
+ * not available to others until dac_stream_stop()
+ * \param[in] rate_hz Samples per second, up to DAC_STREAM_MAX_RATE
+ * \param[in] repeat true to play the last block again when the queue runs
+ * dry, false to hold the last value
+ * \param[in] cb Block played callback, NULL for none
+ * \param[in] arg Argument of the callback
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL on invalid arguments or if a stream runs
+ * already, -WM_FAIL if the GPT or a DMA channel can not be had
+ */
+int dac_stream_start(mdev_t *dac_dev, DAC_ChannelID_Type ch, GPT_ID_Type gpt,
+		     uint32_t rate_hz, bool repeat, dac_stream_cb_t cb,
+		     void *arg);
+
+/** Queue a block
+ *
+ * Can be called from the callback.
+ *
+ * \param[in] block num samples of 10 bits, they have to stay in place until
+ * the block was played
+ * \param[in] num Number of samples, from 1 to DAC_STREAM_MAX_BLOCK
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL on invalid arguments or if no stream
+ * runs, -WM_E_NOMEM if the queue is full
+ */
+int dac_stream_enqueue(const uint16_t *block, int num);
+
+/** Number of blocks queued, the one playing included */
+int dac_stream_queued(void);
+
+/** Number of times the queue ran dry, outside repeat mode */
+uint32_t dac_stream_underruns(void);
+
+/** Stop the stream, the blocks queued are dropped */
+void dac_stream_stop(void);
+
+#endif /* _DAC_STREAM_H_ */
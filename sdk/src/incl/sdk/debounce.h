@@ -0,0 +1,112 @@
+/*! \file debounce.h
+ * \brief Debouncing of many push buttons and switches from one timer
+ *
+ * The push button module of \ref push_button.h takes a GPIO interrupt on
+ * every edge and restarts a software timer on it, a bouncing contact costs
+ * a burst of interrupts and timer commands. With many buttons or limit
+ * switches that adds up.
+ *
+ * Here one general purpose timer (GPT) interrupt samples all the inputs
+ * every scan period instead. An input has to read the same for a number of
+ * scans in a row before its new level counts, bounces in between are
+ * filtered out without any work for them. Only these stable edges reach the
+ * callbacks, which run in a work_svc.h job of WORK_LANE_HIGH, one job for
+ * all the edges of a scan.
+ *
+ * The GPIO interrupts of the inputs are not used, the inputs must not be
+ * registered with push_button_set_cb() as well. The pins must be muxed as
+ * GPIOs, as the board set up does for its buttons.
+ *
+ * The scan interrupt runs all the time, scan_ms decides between its load
+ * and the latency: an edge is reported scan_ms * stable_scans after the
+ * contact settles.
+ *
+ * @code
+ * static void limit_cb(int pin, bool active, void *data)
+ * {
+ *	if (active)
+ *		motor_stop();
+ * }
+ *
+ * input_gpio_cfg_t limit = {.gpio = GPIO_25, .type = GPIO_ACTIVE_LOW};
+ *
+ * // Scan every 5ms, stable after 4 scans, 20ms
+ * debounce_init(GPT1_ID, 5, 4);
+ * debounce_add(limit, limit_cb, NULL);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _DEBOUNCE_H_
+#define _DEBOUNCE_H_
+
+#include <stdbool.h>
+#include <generic_io.h>
+#include <lowlevel_drivers.h>
+
+/** Most inputs scanned */
+#define DEBOUNCE_MAX_INPUTS 32
+
+/** Callback of a stable edge
+ *
+ * \param[in] pin The GPIO of the input
+ * \param[in] active true if the input went to its active level, e.g. the
+ * button was pressed
+ * \param[in] data Pointer given to debounce_add()
+ */
+typedef void (*debounce_cb_t)(int pin, bool active, void *data);
+
+/** Start scanning
+ *
+ * Also starts the work service, see work_svc_init().
+ *
+ * \param[in] gpt The GPT whose interrupt scans, it is not available to
+ * others until debounce_deinit()
+ * \param[in] scan_ms Milliseconds between scans, at least 1
+ * \param[in] stable_scans Scans an input has to read the same in a row for
+ * its level to count, from 1 to 255
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_FAIL if the GPT or the work
+ * service can not be started
+ */
+int debounce_init(GPT_ID_Type gpt, uint16_t scan_ms, uint8_t stable_scans);
+
+/** Stop scanning and drop the inputs */
+void debounce_deinit(void);
+
+/** Add an input to the scan
+ *
+ * Its level when it is added counts as stable, it gives no callback.
+ *
+ * \param[in] input The input configuration as per \ref input_gpio_cfg_t
+ * \param[in] cb Callback of its stable edges
+ * \param[in] data A pointer the callback receives
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if the input is added already or
+ * -WM_E_NOMEM if DEBOUNCE_MAX_INPUTS are
+ */
+int debounce_add(input_gpio_cfg_t input, debounce_cb_t cb, void *data);
+
+/** Remove an input from the scan
+ *
+ * A callback of the input that is due may still run.
+ *
+ * \param[in] input The input configuration as given to debounce_add()
+ *
+ * \return WM_SUCCESS or -WM_FAIL if the input was not added
+ */
+int debounce_remove(input_gpio_cfg_t input);
+
+/** Is an input at its active level, after the debouncing
+ *
+ * \param[in] input The input configuration as given to debounce_add()
+ *
+ * \return true if it is, false if it is not or was not added
+ */
+bool debounce_is_active(input_gpio_cfg_t input);
+
+#endif /* _DEBOUNCE_H_ */
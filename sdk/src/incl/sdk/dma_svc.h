@@ -0,0 +1,156 @@
+/*! \file dma_svc.h
+ * \brief DMA channel pool with queued requests
+ *
+ * mdev_dma hands a channel to whoever opens it, and the channel stays
+ * claimed until it is closed, four drivers streaming at once use up the
+ * channels of the default build. The service here opens a few channels
+ * once and runs requests from a queue on whichever channel is free, in
+ * the order they were submitted.
+ *
+ * A request is a chain of descriptors, each a dma_config_t of the driver,
+ * run one after the other on the same channel. The next descriptor is
+ * started from the completion interrupt of the previous one, the MW300
+ * DMA has no linked list mode of its own. That gives scatter-gather and
+ * transfers longer than the 8191 bytes of one block. The callback is
+ * called from the interrupt once the last descriptor is done or one of
+ * them fails.
+ *
+ * Requests and descriptors belong to the caller and have to stay in place
+ * until the callback. Nothing is allocated by the service.
+ *
+ * @code
+ * static void copy_done(int result, void *arg)
+ * {
+ *	os_semaphore_put(arg);
+ * }
+ *
+ * dma_svc_desc_t d[2];
+ * dma_svc_req_t req = {
+ *	.desc = d,
+ *	.cb = copy_done,
+ *	.arg = &sem,
+ * };
+ *
+ * dma_svc_init(2);
+ * dma_svc_desc_mem(&d[0], hdr_dst, hdr, hdr_len);
+ * dma_svc_desc_mem(&d[1], body_dst, body, body_len);
+ * d[0].next = &d[1];
+ * dma_svc_submit(&req);
+ * os_semaphore_get(&sem, OS_WAIT_FOREVER);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _DMA_SVC_H_
+#define _DMA_SVC_H_
+
+#include <stdint.h>
+#include <mdev_dma.h>
+
+/** Largest block of one descriptor, 8191 bytes rounded down to words */
+#define DMA_SVC_MAX_BLOCK 8188
+
+/** One block of a request */
+typedef struct dma_svc_desc {
+	/** Transfer, with the handshaking interface for a peripheral */
+	dma_config_t dmac;
+	/** Next block, NULL for the last one */
+	struct dma_svc_desc *next;
+} dma_svc_desc_t;
+
+/** Completion of a request
+ *
+ * Called from the DMA interrupt, it must not block. It can submit the
+ * same request again.
+ *
+ * \param[in] result WM_SUCCESS or -WM_FAIL on a bus or address error
+ * \param[in] arg Argument of the request
+ */
+typedef void (*dma_svc_cb_t)(int result, void *arg);
+
+/** Request, a chain of descriptors */
+typedef struct dma_svc_req {
+	/** First descriptor */
+	dma_svc_desc_t *desc;
+	/** Completion, can be NULL */
+	dma_svc_cb_t cb;
+	/** Argument of the callback */
+	void *arg;
+	/* Used by the service */
+	struct dma_svc_req *next;
+	dma_svc_desc_t *cur;
+} dma_svc_req_t;
+
+/** Open the channels of the pool
+ *
+ * Can be called again, the channels are only opened once. Fewer channels
+ * than asked are kept if the other ones are held by drivers.
+ *
+ * \param[in] nchans Channels to open, 1 to NUM_DMA_CHANNELS
+ *
+ * \return WM_SUCCESS if at least one channel was opened, -WM_E_INVAL or
+ * -WM_FAIL
+ */
+int dma_svc_init(int nchans);
+
+/** Channels in the pool
+ *
+ * \return Number of channels, 0 before dma_svc_init()
+ */
+int dma_svc_nchans(void);
+
+/** Fill a memory to memory descriptor
+ *
+ * Word transfers in bursts of 8 if dst, src and len are all multiples of
+ * 4, byte transfers otherwise. next is set to NULL.
+ *
+ * \param[out] desc Descriptor
+ * \param[out] dst Destination, in SRAM
+ * \param[in] src Source, in SRAM
+ * \param[in] len Bytes, up to DMA_SVC_MAX_BLOCK
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if len is too large
+ */
+int dma_svc_desc_mem(dma_svc_desc_t *desc, void *dst, const void *src,
+		     uint32_t len);
+
+/** Queue a request
+ *
+ * Starts at once if a channel is free. Can be called from a thread or from
+ * a completion callback. The first request has to be submitted from a
+ * thread, it goes through dma_drv_transfer(), which sets up the DMA
+ * interrupt.
+ *
+ * \param[in] req Request, not already queued
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if there is no channel or descriptor
+ */
+int dma_svc_submit(dma_svc_req_t *req);
+
+/** Take a request back off the queue
+ *
+ * \param[in] req Request
+ *
+ * \return WM_SUCCESS if it had not started, its callback is not called,
+ * -WM_E_BUSY if it is running or -WM_E_INVAL if it is not queued
+ */
+int dma_svc_cancel(dma_svc_req_t *req);
+
+/** Stop a request
+ *
+ * Stops the channel if the request is running, for a peripheral that
+ * gave up half way and will not ask for the rest, and takes it off the
+ * queue otherwise. Its callback is not called. Can be called from an
+ * interrupt.
+ *
+ * \param[in] req Request
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if it is neither running nor queued
+ */
+int dma_svc_abort(dma_svc_req_t *req);
+
+#endif /* ! _DMA_SVC_H_ */
@@ -70,7 +70,7 @@
  */
 
 #ifndef __MDEV_DMA_H_
-#define _MDEV_DMA_H_
+#define __MDEV_DMA_H_
 
 #include <mdev.h>
 #include <lowlevel_drivers.h>
@@ -230,4 +230,4 @@ int dma_drv_close(mdev_t* mdev_dma);
  */
 void dma_drv_deinit();
 
-#endif /* _MDEV_DMA_H_ */
+#endif /* __MDEV_DMA_H_ */
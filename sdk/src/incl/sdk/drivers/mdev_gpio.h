@@ -198,6 +198,86 @@ static inline int gpio_drv_read(mdev_t *dev, GPIO_NO_Type pin, int *val)
 	return WM_SUCCESS;
 }
 
+/** GPIO port of a pin, pins 0 to 31 are port 0, the others port 1 */
+#define GPIO_PORT(pin)		((pin) >> 5)
+
+/** Bit of a pin in the mask of its port */
+#define GPIO_PORT_BIT(pin)	(1U << ((pin) & 0x1f))
+
+/** Set the direction of several GPIO pins of a port at once
+ *
+ *  The bitwise direction registers are used, pins not in the mask keep their
+ *  direction.
+ *
+ *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
+ *  @param [in] port GPIO port, see GPIO_PORT()
+ *  @param [in] mask Pins of the port, see GPIO_PORT_BIT()
+ *  @param [in] dir Either GPIO_INPUT or GPIO_OUTPUT
+ */
+static inline void gpio_drv_port_setdir(mdev_t *dev, int port,
+			uint32_t mask, GPIO_Dir_Type dir)
+{
+	if (dir == GPIO_OUTPUT)
+		GPIO->GSDR[port].WORDVAL = mask;
+	else
+		GPIO->GCDR[port].WORDVAL = mask;
+}
+
+/** Set several GPIO pins of a port high at once
+ *
+ *  A single write to the output set register, pins not in the mask are not
+ *  touched. Safe against gpio_drv_write() of other pins from an interrupt.
+ *
+ *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
+ *  @param [in] port GPIO port, see GPIO_PORT()
+ *  @param [in] mask Pins of the port, see GPIO_PORT_BIT()
+ */
+static inline void gpio_drv_port_set(mdev_t *dev, int port, uint32_t mask)
+{
+	GPIO->GPSR[port].WORDVAL = mask;
+}
+
+/** Set several GPIO pins of a port low at once
+ *
+ *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
+ *  @param [in] port GPIO port, see GPIO_PORT()
+ *  @param [in] mask Pins of the port, see GPIO_PORT_BIT()
+ */
+static inline void gpio_drv_port_clear(mdev_t *dev, int port, uint32_t mask)
+{
+	GPIO->GPCR[port].WORDVAL = mask;
+}
+
+/** Write several GPIO pins of a port
+ *
+ *  The pins in the mask take their bit of val, e.g. an 8 bit bus on pins 8
+ *  to 15 is written with gpio_drv_port_write(dev, 0, 0xff00, byte << 8).
+ *  The high pins change first, then the low ones, between the two writes
+ *  the bus is in a mixed state for a few cycles.
+ *
+ *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
+ *  @param [in] port GPIO port, see GPIO_PORT()
+ *  @param [in] mask Pins of the port that are written
+ *  @param [in] val Their values, bits outside the mask are ignored
+ */
+static inline void gpio_drv_port_write(mdev_t *dev, int port,
+			uint32_t mask, uint32_t val)
+{
+	GPIO->GPSR[port].WORDVAL = val & mask;
+	GPIO->GPCR[port].WORDVAL = ~val & mask;
+}
+
+/** Read the level of all GPIO pins of a port
+ *
+ *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
+ *  @param [in] port GPIO port, see GPIO_PORT()
+ *  @return Levels of the pins, pin n of the port is bit n
+ */
+static inline uint32_t gpio_drv_port_read(mdev_t *dev, int port)
+{
+	return GPIO->GPLR[port].WORDVAL;
+}
+
 /** Register CallBack for GPIO Pin Interrupt
  *
  *  @param [in] dev Handle to the GPIO device returned by gpio_drv_open().
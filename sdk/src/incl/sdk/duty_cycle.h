@@ -0,0 +1,163 @@
+/*! \file duty_cycle.h
+ * \brief Wake, publish and sleep duty cycle
+ *
+ * For devices which only report every few minutes. Every cycle the device
+ * boots, connects, runs the publish callback of the application and goes
+ * to PM4 until an RTC alarm wakes it up for the next cycle. PM4 keeps only
+ * the RTC and the retention RAM powered, the wake-up is a reboot.
+ *
+ * The statistics of the cycles, and DUTY_CYCLE_STATE_SIZE bytes of state
+ * of the application, are kept in the retention RAM across the sleeps.
+ * The last lease of the DHCP client is kept there too, see
+ * LWIP_DHCP_LEASE_CACHE, and the clients of warm_resume.h save their
+ * state before every sleep. The TLS session and the Wi-Fi association are
+ * in the prebuilt SDK library and are made again every cycle.
+ *
+ * Besides the RTC alarm, the ultra low power comparator of the PMU can
+ * wake the device from PM4 when an analog input crosses a reference level,
+ * see wake_ulpcomp. Such a wake-up starts a new cycle right away, with
+ * duty_cycle_woken_by_ulpcomp() true, and the next one follows a period
+ * later.
+ *
+ * The time a cycle was awake is measured from reset to the sleep and is
+ * the metric to watch: duty_cycle_json() writes it as telemetry. A cycle
+ * which does not get to publish within its awake budget sleeps anyway and
+ * is counted as missed.
+ *
+ * @code
+ * static int publish(void *arg)
+ * {
+ *	...
+ *	json_writer_start_object(&w, NULL);
+ *	json_writer_add_float(&w, "temp", read_temp(), 1);
+ *	duty_cycle_json(&w, "cycle");
+ *	json_writer_end_object(&w);
+ *	return aws_iot_mqtt_publish(&params) == NONE_ERROR ?
+ *		WM_SUCCESS : -WM_FAIL;
+ * }
+ *
+ * static const struct duty_cycle_cfg cfg = {
+ *	.period_s = 300,
+ *	.awake_budget_ms = 15000,
+ *	.publish = publish,
+ * };
+ *
+ * main():                      duty_cycle_start(&cfg);
+ * cloud thread, once connected: duty_cycle_run();
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _DUTY_CYCLE_H_
+#define _DUTY_CYCLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <json_writer.h>
+
+/** Bytes of application state kept across the sleeps */
+#ifndef DUTY_CYCLE_STATE_SIZE
+#define DUTY_CYCLE_STATE_SIZE 64
+#endif
+
+/** Rate of the RTC counter, see mdev_rtc.h */
+#ifndef DUTY_CYCLE_RTC_HZ
+#define DUTY_CYCLE_RTC_HZ 1000
+#endif
+
+/** Duty cycle configuration */
+struct duty_cycle_cfg {
+	/** Time from a wake-up to the next one, in seconds */
+	uint32_t period_s;
+	/** Most time a cycle stays awake, 0 for no limit */
+	uint32_t awake_budget_ms;
+	/** Sends the message of the cycle, returns WM_SUCCESS once sent */
+	int (*publish)(void *arg);
+	void *arg;
+	/** Also wake up when the ULPCOMP output goes high, the input rises
+	 * above the reference level */
+	bool wake_ulpcomp;
+	/** Reference level of the ULPCOMP, PMU_ULPCOMP_REFVOLT_0 to 7 */
+	uint8_t ulpcomp_ref;
+	/** Hysteresis of the ULPCOMP, PMU_ULPCOMP_HYST_0 to 3 */
+	uint8_t ulpcomp_hyst;
+};
+
+/** Statistics of the cycles since power on */
+struct duty_cycle_stats {
+	/** Cycles which went to sleep */
+	uint32_t cycles;
+	/** Cycles which did not publish */
+	uint32_t missed;
+	/** Time the last cycle was awake */
+	uint32_t last_awake_ms;
+	uint32_t max_awake_ms;
+	uint32_t avg_awake_ms;
+};
+
+/** Start the cycle of this boot
+ *
+ * Starts the RTC unless it runs already, from the previous cycle, and the
+ * timer of the awake budget. To be called early in main().
+ *
+ * \param[in] cfg Configuration, not copied
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the configuration is not valid
+ * \return -WM_FAIL if the RTC or the timer can not be set up
+ */
+int duty_cycle_start(const struct duty_cycle_cfg *cfg);
+
+/** Publish and sleep
+ *
+ * Runs the publish callback and puts the device to sleep until the next
+ * cycle. Does not return.
+ */
+void duty_cycle_run(void);
+
+/** Sleep until the next cycle without publishing
+ *
+ * The cycle is counted as missed. Does not return.
+ */
+void duty_cycle_sleep(void);
+
+/** Whether this boot is a wake-up from the sleep of a cycle
+ *
+ * \return false after power on, a ULPCOMP wake-up or another reset
+ */
+bool duty_cycle_woken(void);
+
+/** Whether this boot is a wake-up by the ULPCOMP
+ *
+ * \return true if the analog input crossed the reference level, false
+ * after an RTC alarm, power on or another reset
+ */
+bool duty_cycle_woken_by_ulpcomp(void);
+
+/** State of the application kept across the sleeps
+ *
+ * \return DUTY_CYCLE_STATE_SIZE bytes, zeroed at power on
+ */
+void *duty_cycle_state(void);
+
+/** Get the statistics of the cycles
+ *
+ * \param[out] stats Statistics
+ */
+void duty_cycle_get_stats(struct duty_cycle_stats *stats);
+
+/** Write the statistics as an object
+ *
+ * \param[in,out] w Writer
+ * \param[in] key Key of the object in the enclosing object, NULL in an array
+ * or at the top
+ *
+ * \return The status of the writer, see json_writer_start_object()
+ */
+int duty_cycle_json(struct json_writer *w, const char *key);
+
+#endif /* _DUTY_CYCLE_H_ */
@@ -0,0 +1,151 @@
+/*! \file energy_stats.h
+ * \brief Time spent in the power states of the CPU and of the radio
+ *
+ * The CPU is in one of four states: active while a task other than the
+ * idle task runs, idle while the idle task runs, spinning or waiting in
+ * wfi, and asleep in PM2 or PM3. The radio is either active or in IEEE
+ * power save. Every change of state adds the time since the last one to
+ * the state that ends, read from the RTC counter, which keeps running in
+ * PM2 and PM3. The RTC has to run, as the tickless idle and duty_cycle.h
+ * have it run.
+ *
+ * The state changes come from the hooks below, without CONFIG_ENERGY_STATS
+ * they compile to nothing:
+ * - the context switches of the kernel, into or out of the idle task
+ * - the PM2 sleep of the tickless idle, between PMU_SetSleepMode(PMU_PM2)
+ *   and PMU_SetSleepMode(PMU_PM1) after the wfi
+ * - aws_iot_wifi_ps_radio_event(), given the power save events of the WLAN
+ *   driver, and aws_iot_wifi_ps_stop()
+ *
+ * Code sleeping in PM3 calls ENERGY_STATS_CPU(ENERGY_CPU_PM3) once it set
+ * the sleep mode and ENERGY_STATS_CPU(ENERGY_CPU_IDLE) once awake.
+ *
+ * With the current of every state from the data sheet or a measurement,
+ * the energy is estimated from the times. The application counts the
+ * samples it publishes with energy_stats_sample(), so that two firmware
+ * builds compare by the energy one sample costs. The totals go in the
+ * reports of metrics.h:
+ *
+ * @code
+ * {"c":{"e_act_ms":812,"e_idle_ms":1630,"e_pm2_ms":57558,"e_pm3_ms":0,
+ *  "e_rf_ms":2104,"e_rfps_ms":57896,"e_uj":31873,"e_samples":12},
+ *  "g":{"e_uj_sample":2656}}
+ * @endcode
+ *
+ * The counters are the time and energy of the report interval, the
+ * e_uj_sample gauge the energy per sample since the last report, 0 without
+ * samples.
+ *
+ * @code
+ * static const struct energy_model model = {
+ *	.rtc_hz = 32768,
+ *	.mv = 3300,
+ *	.cpu_ua = {20000, 9000, 120, 15},
+ *	.radio_ua = {80000, 1500},
+ * };
+ *
+ * energy_stats_init(&model);
+ * metrics_report_start(60000, buf, sizeof(buf), send_metrics, NULL);
+ * ...
+ * if (aws_iot_mqtt_publish(&params) == NONE_ERROR)
+ *	energy_stats_sample();
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _ENERGY_STATS_H_
+#define _ENERGY_STATS_H_
+
+#include <stdint.h>
+
+/** Power states of the CPU */
+enum energy_cpu_state {
+	ENERGY_CPU_ACTIVE,
+	ENERGY_CPU_IDLE,
+	ENERGY_CPU_PM2,
+	ENERGY_CPU_PM3,
+	ENERGY_CPU_STATE_CNT,
+};
+
+/** Power states of the radio */
+enum energy_radio_state {
+	ENERGY_RADIO_ACTIVE,
+	ENERGY_RADIO_PS,
+	ENERGY_RADIO_STATE_CNT,
+};
+
+#ifdef CONFIG_ENERGY_STATS
+#define ENERGY_STATS_CPU(state) energy_stats_cpu(state)
+#define ENERGY_STATS_RADIO(state) energy_stats_radio(state)
+#else
+#define ENERGY_STATS_CPU(state) do { } while (0)
+#define ENERGY_STATS_RADIO(state) do { } while (0)
+#endif
+
+/** Currents the energy is estimated with */
+struct energy_model {
+	/** Rate the RTC counter runs at */
+	uint32_t rtc_hz;
+	/** Supply voltage, in mV */
+	uint32_t mv;
+	/** Current of the CPU in every state, in uA */
+	uint32_t cpu_ua[ENERGY_CPU_STATE_CNT];
+	/** Current of the radio in every state, in uA */
+	uint32_t radio_ua[ENERGY_RADIO_STATE_CNT];
+};
+
+/** Totals since energy_stats_init() */
+struct energy_totals {
+	uint64_t cpu_ms[ENERGY_CPU_STATE_CNT];
+	uint64_t radio_ms[ENERGY_RADIO_STATE_CNT];
+	/** Estimated energy, in uJ */
+	uint64_t uj;
+	uint32_t samples;
+};
+
+/** Start the accounting and register its metrics
+ *
+ * The CPU starts active and the radio active. Called again, it only
+ * replaces the model.
+ *
+ * \param[in] model The currents, copied
+ *
+ * \return WM_SUCCESS
+ * \return -WM_E_INVAL if model is NULL or its rtc_hz is 0
+ * \return -WM_FAIL if the RTC does not run
+ */
+int energy_stats_init(const struct energy_model *model);
+
+/** Change the state of the CPU
+ *
+ * Can be called from an interrupt handler and with the interrupts
+ * disabled. Does nothing before energy_stats_init().
+ *
+ * \param[in] state The new state
+ */
+void energy_stats_cpu(enum energy_cpu_state state);
+
+/** Change the state of the radio
+ *
+ * As energy_stats_cpu().
+ *
+ * \param[in] state The new state
+ */
+void energy_stats_radio(enum energy_radio_state state);
+
+/** Count a published sample */
+void energy_stats_sample(void);
+
+/** Get the totals
+ *
+ * The current states count up to now.
+ *
+ * \param[out] totals The totals
+ */
+void energy_stats_get(struct energy_totals *totals);
+
+#endif /* ! _ENERGY_STATS_H_ */
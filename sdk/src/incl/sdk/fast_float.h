@@ -0,0 +1,60 @@
+/*! \file fast_float.h
+ * \brief Float parsing and fixed precision formatting without the libc
+ *
+ * sscanf("%f") and printf("%f") pull in the large libc float code and run
+ * the conversion in software double precision. The functions here handle
+ * the numbers a sensor or a configuration document holds with a few
+ * integer operations and at most one single precision multiply or divide,
+ * which the FPU does.
+ *
+ * fast_strtof() is correctly rounded. Numbers with at most 7 significant
+ * digits and a power of ten of at most 10, such as "-12.5" or "1013.25",
+ * take the fast path, the others are handed to sscanf(). fast_strtod() does
+ * the same in double precision for up to 15 digits and powers of ten up to
+ * 22.
+ *
+ * fast_ftoa() writes exactly what printf("%.*f") does, ties to even
+ * included, with integer arithmetic only.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _FAST_FLOAT_H_
+#define _FAST_FLOAT_H_
+
+#include <stdint.h>
+
+/** Largest number of decimals fast_ftoa() writes */
+#define FAST_FTOA_MAX_DECIMALS 9
+
+/** Parse a JSON number as a float
+ *
+ * \param[in] str Number, it does not have to be NUL terminated
+ * \param[in] len Bytes available at str
+ * \param[out] value The number
+ *
+ * \return Number of bytes of the number, 0 if str does not start with one
+ */
+int fast_strtof(const char *str, int len, float *value);
+
+/** Parse a JSON number as a double, as fast_strtof() */
+int fast_strtod(const char *str, int len, double *value);
+
+/** Format a float with a fixed number of decimals
+ *
+ * \param[in] value Number to format
+ * \param[in] decimals Digits after the point, at most FAST_FTOA_MAX_DECIMALS
+ * \param[out] buf Buffer the NUL terminated text is written in
+ * \param[in] size Size of the buffer
+ *
+ * \return Length of the text
+ * \return -WM_E_INVAL for NaN, infinities, numbers of 2^63 or more and too
+ * many decimals, which are left to snprintf()
+ * \return -WM_E_NOSPC if the buffer is too small
+ */
+int fast_ftoa(float value, int decimals, char *buf, int size);
+
+#endif /* _FAST_FLOAT_H_ */
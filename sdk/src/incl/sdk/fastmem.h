@@ -0,0 +1,100 @@
+/*! \file fastmem.h
+ * \brief Memory copies for the Cortex-M4
+ *
+ * memcpy() and memset() of the SDK align the destination and move 32 bytes
+ * per iteration with ldmia/stmia, they replace the byte at a time versions
+ * of the C library without any change to the callers.
+ *
+ * memcpy_dma() hands larger copies to the DMA service, the calling thread
+ * waits for the transfer and the CPU runs other threads meanwhile. A DMA
+ * transfer costs a fixed setup and a wait on its interrupt, so below
+ * fastmem_dma_threshold() bytes the copy is done by memcpy() anyway.
+ * fastmem_dma_calibrate() measures the size from which DMA is done first on
+ * the board it runs on and sets the threshold to it.
+ *
+ * @code
+ * size_t crossover;
+ *
+ * fastmem_dma_init();
+ * if (fastmem_dma_calibrate(&crossover) == WM_SUCCESS)
+ *	wmprintf("DMA from %d bytes\r\n", crossover);
+ *
+ * memcpy_dma(frame, rx_buf, len);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _FASTMEM_H_
+#define _FASTMEM_H_
+
+#include <stddef.h>
+#include <dma_svc.h>
+
+/** Copies and fills shorter than this are done a byte at a time */
+#define FASTMEM_SMALL 16
+/** Default size from which memcpy_dma() uses DMA */
+#define FASTMEM_DMA_THRESHOLD 2048
+/** Largest single DMA block */
+#define FASTMEM_DMA_MAX DMA_SVC_MAX_BLOCK
+
+/** Set up memcpy_dma()
+ *
+ * The copies are requests of the DMA service of dma_svc.h, which is
+ * started with one channel if it is not yet. Can be called again. Until it
+ * is called memcpy_dma() is memcpy().
+ *
+ * \return WM_SUCCESS or -WM_FAIL if no DMA channel is free
+ */
+int fastmem_dma_init(void);
+
+/** Copy with DMA
+ *
+ * Uses DMA if n is at least fastmem_dma_threshold() and src and dst are
+ * word aligned, memcpy() otherwise and from an interrupt. Both buffers must
+ * be in SRAM, the DMA does not read the flash. Copies from several threads
+ * are done one after the other.
+ *
+ * \param[out] dst Destination
+ * \param[in] src Source
+ * \param[in] n Bytes to copy
+ *
+ * \return dst
+ */
+void *memcpy_dma(void *dst, const void *src, size_t n);
+
+/** Size from which memcpy_dma() uses DMA
+ *
+ * \return Threshold in bytes
+ */
+size_t fastmem_dma_threshold(void);
+
+/** Set the size from which memcpy_dma() uses DMA
+ *
+ * A threshold below the measured crossover makes the copy itself slower
+ * but leaves more of the CPU to the other threads.
+ *
+ * \param[in] n Threshold in bytes
+ */
+void fastmem_dma_set_threshold(size_t n);
+
+/** Measure the crossover between memcpy() and DMA
+ *
+ * Times both, with the cycle counter, for 256 bytes and powers of two up
+ * to FASTMEM_DMA_MAX, and sets the threshold to the first size at which
+ * DMA is done first. Takes two buffers of FASTMEM_DMA_MAX bytes from the
+ * heap while it runs. Best called before the network is up, other
+ * threads running in between make DMA look slower.
+ *
+ * \param[out] crossover Crossover in bytes, can be NULL
+ *
+ * \return WM_SUCCESS, -WM_FAIL if fastmem_dma_init() has not been called or
+ * DMA was never done first, the threshold is not changed then, or
+ * -WM_E_NOMEM
+ */
+int fastmem_dma_calibrate(size_t *crossover);
+
+#endif /* ! _FASTMEM_H_ */
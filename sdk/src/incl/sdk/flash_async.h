@@ -0,0 +1,115 @@
+/*! \file flash_async.h
+ * \brief Flash operations run by a worker thread
+ *
+ * flash_drv_write() and flash_drv_erase() keep the calling thread for the
+ * whole page program or sector erase, tens of milliseconds for an erase.
+ * The functions here queue the operation for a low priority flash thread
+ * and return, the callback tells how it went. Operations are done in the
+ * order they were queued, so a write queued after the erase of its sector
+ * goes to erased flash.
+ *
+ * The worker programs one page and erases one sector at a time, threads of
+ * a higher priority run in between. Code running from the flash still
+ * waits for the flash during an erase, the flash driver has no erase
+ * suspend.
+ *
+ * @code
+ * static void erase_done(int result, void *arg)
+ * {
+ *	if (result != WM_SUCCESS)
+ *		wmprintf("erase failed\r\n");
+ * }
+ *
+ * flash_async_init();
+ * flash_async_erase(dev, start, 4096, erase_done, NULL);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _FLASH_ASYNC_H_
+#define _FLASH_ASYNC_H_
+
+#include <flash.h>
+
+/** Operations that can wait in the queue */
+#define FLASH_ASYNC_QUEUE_LEN 8
+/** Bytes programmed in one go, the page of the flash */
+#define FLASH_ASYNC_PAGE_SIZE 256
+/** Bytes erased in one go */
+#define FLASH_ASYNC_SECTOR_SIZE 4096
+
+/** Completion of a queued operation
+ *
+ * Called from the flash thread, it must not block for long.
+ *
+ * \param[in] result WM_SUCCESS or -WM_FAIL
+ * \param[in] arg Argument given with the operation
+ */
+typedef void (*flash_async_cb_t)(int result, void *arg);
+
+/** Start the flash thread
+ *
+ * Can be called again, the thread is only started once. flash_drv_init()
+ * has to be called before.
+ *
+ * \return WM_SUCCESS or -WM_FAIL
+ */
+int flash_async_init(void);
+
+/** Queue a write
+ *
+ * Waits while FLASH_ASYNC_QUEUE_LEN operations are queued.
+ *
+ * \param[in] dev Flash device from flash_drv_open()
+ * \param[in] buf Data to write, it has to stay in place until the callback
+ * \param[in] len Length of the data
+ * \param[in] addr Flash address to write to, erased
+ * \param[in] cb Callback, can be NULL
+ * \param[in] arg Passed to the callback
+ *
+ * \return WM_SUCCESS or -WM_FAIL if flash_async_init() was not called
+ */
+int flash_async_write(mdev_t *dev, const uint8_t *buf, uint32_t len,
+		      uint32_t addr, flash_async_cb_t cb, void *arg);
+
+/** Queue a read
+ *
+ * \param[in] dev Flash device from flash_drv_open()
+ * \param[out] buf Buffer for the data, it has to stay in place until the
+ * callback
+ * \param[in] len Length of the data
+ * \param[in] addr Flash address to read from
+ * \param[in] cb Callback, can be NULL
+ * \param[in] arg Passed to the callback
+ *
+ * \return WM_SUCCESS or -WM_FAIL if flash_async_init() was not called
+ */
+int flash_async_read(mdev_t *dev, uint8_t *buf, uint32_t len,
+		     uint32_t addr, flash_async_cb_t cb, void *arg);
+
+/** Queue an erase
+ *
+ * \param[in] dev Flash device from flash_drv_open()
+ * \param[in] start Flash address of the first sector
+ * \param[in] size Bytes to erase, whole sectors
+ * \param[in] cb Callback, can be NULL
+ * \param[in] arg Passed to the callback
+ *
+ * \return WM_SUCCESS or -WM_FAIL if flash_async_init() was not called
+ */
+int flash_async_erase(mdev_t *dev, uint32_t start, uint32_t size,
+		      flash_async_cb_t cb, void *arg);
+
+/** Wait for the operations queued so far
+ *
+ * Not from the callbacks.
+ *
+ * \return WM_SUCCESS or -WM_FAIL if flash_async_init() was not called
+ */
+int flash_async_flush(void);
+
+#endif /* ! _FLASH_ASYNC_H_ */
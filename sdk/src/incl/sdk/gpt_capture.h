@@ -0,0 +1,145 @@
+/*! \file gpt_capture.h
+ * \brief Timestamps of input edges from a GPT channel, by DMA
+ *
+ * Timing pulses with a GPIO interrupt and os_get_usec_counter() picks up
+ * the interrupt latency, tens of microseconds under Wi-Fi load. Here a
+ * general purpose timer (GPT) channel in input capture mode latches its
+ * counter on every edge of its pin, and the DMA moves the latched values
+ * into a buffer. The timestamps are exact to the GPT clock, 20ns, and the
+ * CPU does no work per edge.
+ *
+ * The counter runs free over 32 bits at GPT_CAPTURE_TICKS_PER_US, it wraps
+ * after about 85s. The difference of two timestamps, taken as unsigned,
+ * is right across a wrap: the period of a signal is stamp[i] - stamp[i - 1],
+ * its frequency GPT_CAPTURE_TICKS_PER_US * 1000000 / period.
+ *
+ * The buffer is two blocks the DMA fills in turn, as the ADC stream of the
+ * ADC demo does. A full block goes to the callback, from the DMA interrupt,
+ * and has to be given back with gpt_capture_release() before the other
+ * block fills up.
+ *
+ * The channel's pin has to be muxed to it with the
+ * @link mdev_pinmux.h PINMUX driver @endlink first. The GPT is not
+ * available to others while it captures.
+ *
+ * @code
+ * static uint32_t stamps[2][64];
+ * static gpt_capture_t flow;
+ *
+ * static void pulses(gpt_capture_t *cap, uint32_t *block, int num,
+ *		      void *arg)
+ * {
+ *	// block[num - 1] - block[0] ticks for num - 1 periods
+ *	gpt_capture_release(cap, block);
+ * }
+ *
+ * pinmux_drv_setfunc(pinmux_dev, GPIO_28, GPIO28_GPT1_CH0);
+ * gpt_capture_start(&flow, GPT1_ID, GPT_CH_0, GPT_IC_RISING_EDGE,
+ *		     stamps[0], stamps[1], 64, pulses, NULL);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _GPT_CAPTURE_H_
+#define _GPT_CAPTURE_H_
+
+#include <stdbool.h>
+#include <mdev_dma.h>
+#include <mdev_gpt.h>
+
+/** Counter ticks per microsecond, see gpt_drv_init() */
+#define GPT_CAPTURE_TICKS_PER_US 50
+
+/** Most timestamps of a block, the DMA moves at most 8191 bytes */
+#define GPT_CAPTURE_MAX_BLOCK 2047
+
+struct gpt_capture;
+
+/** Full block callback, called from the DMA interrupt
+ *
+ * \param[in] cap The capture
+ * \param[in] block The timestamps, oldest first
+ * \param[in] num Their number, the block length
+ * \param[in] arg Argument given to gpt_capture_start()
+ */
+typedef void (*gpt_capture_cb_t)(struct gpt_capture *cap, uint32_t *block,
+				 int num, void *arg);
+
+/** A capture, the fields are private */
+typedef struct gpt_capture {
+	mdev_t *gpt_dev;
+	mdev_t *dma_dev;
+	dma_config_t dma;
+	GPT_ID_Type gpt;
+	uint32_t *buf[2];
+	/* Block the DMA is filling */
+	int filling;
+	int num;
+	gpt_capture_cb_t cb;
+	void *arg;
+	volatile bool held[2];
+	uint32_t overruns;
+	uint32_t lost;
+	bool running;
+} gpt_capture_t;
+
+/** Start capturing
+ *
+ * \param[out] cap The capture, it has to stay in place until
+ * gpt_capture_stop()
+ * \param[in] gpt The GPT
+ * \param[in] ch The channel whose pin is the input
+ * \param[in] edge Edge that is timestamped
+ * \param[in] buf0 First block of num timestamps
+ * \param[in] buf1 Second block of num timestamps
+ * \param[in] num Block length, from 1 to GPT_CAPTURE_MAX_BLOCK
+ * \param[in] cb Full block callback
+ * \param[in] arg Argument of the callback
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL on invalid arguments or -WM_FAIL if the
+ * GPT or a DMA channel can not be had
+ */
+int gpt_capture_start(gpt_capture_t *cap, GPT_ID_Type gpt,
+		      GPT_ChannelNumber_Type ch, GPT_ICEdge_Type edge,
+		      uint32_t *buf0, uint32_t *buf1, int num,
+		      gpt_capture_cb_t cb, void *arg);
+
+/** Give a block passed to the callback back
+ *
+ * \param[in] cap The capture
+ * \param[in] block The block
+ */
+void gpt_capture_release(gpt_capture_t *cap, uint32_t *block);
+
+/** Read the counter the timestamps are taken from
+ *
+ * \param[in] cap The capture
+ *
+ * \return The counter now, e.g. to tell how old the last timestamp is
+ */
+uint32_t gpt_capture_now(gpt_capture_t *cap);
+
+/** Number of blocks refilled while the application still held them
+ *
+ * \param[in] cap The capture
+ */
+uint32_t gpt_capture_overruns(gpt_capture_t *cap);
+
+/** Number of blocks edges were lost in, because they came faster than the
+ * DMA took the timestamps
+ *
+ * \param[in] cap The capture
+ */
+uint32_t gpt_capture_lost(gpt_capture_t *cap);
+
+/** Stop capturing and release the GPT and the DMA channel
+ *
+ * \param[in] cap The capture
+ */
+void gpt_capture_stop(gpt_capture_t *cap);
+
+#endif /* _GPT_CAPTURE_H_ */
@@ -0,0 +1,115 @@
+/*! \file health_mon.h
+ * \brief Hardware watchdog fed only while the registered tasks are alive
+ *
+ * A watchdog fed from a timer or the idle task resets the device when the
+ * scheduler dies, not when a single task, for instance the MQTT thread,
+ * waits forever on a socket. Here every task that matters registers with a
+ * deadline and checks in from its loop. A check in only sets a flag of the
+ * task, no message is sent and nothing blocks, so it can be done on every
+ * round.
+ *
+ * A thread of the lowest priority looks at the flags at a fixed interval
+ * and feeds the watchdog only if every task checked in within its
+ * deadline. Otherwise it stops feeding and the watchdog resets the device.
+ * As that thread has the lowest priority, a task that spins and starves
+ * the others also ends in a reset.
+ *
+ * The name of the task that stalled is kept in the retention RAM. After the
+ * reset, health_mon_last_stall() gives it when the reset cause says the
+ * watchdog reset the device, so that it can be reported to the cloud.
+ *
+ * @code
+ * static int mqtt_health;
+ *
+ * health_mon_start(1000);
+ * if (health_mon_last_stall(name, sizeof(name), &late_ms))
+ *	wmprintf("%s stalled for %u ms\r\n", name, late_ms);
+ *
+ * and in the MQTT thread:
+ *
+ *	mqtt_health = health_mon_register("mqtt", 60000);
+ *	while (1) {
+ *		health_mon_checkin(mqtt_health);
+ *		aws_iot_shadow_yield(&mqtt_client, 100);
+ *		...
+ *	}
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _HEALTH_MON_H_
+#define _HEALTH_MON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Tasks that can be registered */
+#ifndef HEALTH_MON_MAX_TASKS
+#define HEALTH_MON_MAX_TASKS 8
+#endif
+
+/** Length of a task name, with the terminating null */
+#define HEALTH_MON_NAME_LEN 16
+
+/** Start the monitor and the watchdog
+ *
+ * The watchdog can not be stopped once started, it resets the device when
+ * it is not fed for about twice the check interval. The SDK's own health
+ * monitor must not be started along with this one, it feeds the same
+ * watchdog.
+ *
+ * \param[in] check_ms Interval the check ins are looked at, the deadlines
+ * are measured with this resolution
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if check_ms is 0 or too long for the
+ * watchdog, or -WM_FAIL if the thread could not be created
+ */
+int health_mon_start(uint32_t check_ms);
+
+/** Register a task
+ *
+ * The deadline runs from the registration, the first check in is due
+ * within it.
+ *
+ * \param[in] name Name of the task, reported after a stall, copied
+ * \param[in] deadline_ms Longest time allowed between two check ins
+ *
+ * \return Id of the task for health_mon_checkin(), -WM_E_INVAL on invalid
+ * arguments or -WM_E_NOSPC if HEALTH_MON_MAX_TASKS tasks are registered
+ */
+int health_mon_register(const char *name, uint32_t deadline_ms);
+
+/** Unregister a task, e.g. before it exits
+ *
+ * \param[in] id Id given by health_mon_register()
+ */
+void health_mon_unregister(int id);
+
+/** Check a task in
+ *
+ * Sets the flag of the task, can be called from an interrupt.
+ *
+ * \param[in] id Id given by health_mon_register()
+ */
+void health_mon_checkin(int id);
+
+/** Get the task that stalled before the last reset
+ *
+ * Valid once health_mon_start() was called.
+ *
+ * \param[out] name Name of the task
+ * \param[in] len Size of name
+ * \param[out] late_ms Time since its last check in when the monitor stopped
+ * feeding the watchdog, can be NULL
+ *
+ * \return true if the watchdog reset the device because of a stalled task,
+ * false otherwise
+ */
+bool health_mon_last_stall(char *name, size_t len, uint32_t *late_ms);
+
+#endif /* _HEALTH_MON_H_ */
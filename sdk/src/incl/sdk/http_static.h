@@ -0,0 +1,109 @@
+/*! \file http_static.h
+ * \brief Static content server with keep-alive connections
+ *
+ * Serves the pages of a web UI, e.g. the one of factory provisioning, from
+ * a bundle made by sdk/tools/bin/http_bundle.py. The files are compressed
+ * with gzip and their ETag computed when the bundle is made, so a request
+ * costs a lookup and the response header: the body is handed to lwIP
+ * without being copied, straight from the bundle, which stays where it
+ * is. The bundle is either linked in the image, as the C array the tool
+ * writes, or written to a flash partition. In the flash it is read through
+ * the flash controller by XIP images, and copied a segment at a time with
+ * flash_drv_read() by the others.
+ *
+ * One thread serves up to HTTP_STATIC_CONNS connections, kept open
+ * between requests. The responses of the connections are interleaved as
+ * their send buffers drain rather than sent one after the other. When all
+ * the connections are busy a new one replaces the one idle for the
+ * longest.
+ *
+ * Clients which do not accept gzip get 406 for files stored compressed,
+ * browsers all accept it. A request with the ETag of the file in
+ * If-None-Match gets 304 with no body.
+ *
+ * @code
+ * #include "web_bundle.c"	(http_bundle.py -c web_bundle.c -n web ui/)
+ *
+ * static const struct http_static_cfg cfg = {
+ *	.port = 8080,
+ *	.bundle = web,
+ * };
+ *
+ * http_static_start(&cfg);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _HTTP_STATIC_H_
+#define _HTTP_STATIC_H_
+
+#include <stdint.h>
+#include <flash.h>
+
+/** Connections served at once */
+#ifndef HTTP_STATIC_CONNS
+#define HTTP_STATIC_CONNS 4
+#endif
+
+/** Longest request header, larger ones get 431 */
+#ifndef HTTP_STATIC_REQ_SIZE
+#define HTTP_STATIC_REQ_SIZE 512
+#endif
+
+/** Time after which an idle connection is closed */
+#ifndef HTTP_STATIC_IDLE_MS
+#define HTTP_STATIC_IDLE_MS 15000
+#endif
+
+/** Server configuration */
+struct http_static_cfg {
+	/** TCP port, the HTTP server of the SDK has 80 */
+	uint16_t port;
+	/** Bundle in memory, or NULL to use fl */
+	const void *bundle;
+	/** Partition holding the bundle, when bundle is NULL */
+	flash_desc_t fl;
+};
+
+/** Counters since the start */
+struct http_static_stats {
+	/** Connections accepted */
+	uint32_t conns;
+	/** Connections closed to make room for a new one */
+	uint32_t evicted;
+	/** Requests served */
+	uint32_t requests;
+	/** Requests on a connection which served one already */
+	uint32_t reused;
+	/** Responses 304 Not Modified */
+	uint32_t not_modified;
+	/** Responses 4xx */
+	uint32_t errors;
+	/** Bytes of the bodies sent */
+	uint32_t bytes;
+};
+
+/** Start the server
+ *
+ * \param[in] cfg Configuration, copied
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the bundle is not valid
+ * \return -WM_E_BUSY if the server runs already
+ * \return -WM_E_NOMEM if the index of a bundle in flash does not fit in
+ * the heap
+ * \return -WM_FAIL if the socket or the thread can not be created
+ */
+int http_static_start(const struct http_static_cfg *cfg);
+
+/** Get the counters
+ *
+ * \param[out] stats Counters
+ */
+void http_static_get_stats(struct http_static_stats *stats);
+
+#endif /* _HTTP_STATIC_H_ */
@@ -0,0 +1,128 @@
+/*! \file i2c_xfer.h
+ * \brief Queued I2C master transactions
+ *
+ * A register read with the driver is an i2c_drv_write() of the register
+ * number and an i2c_drv_read(), two waits of the calling thread and a STOP
+ * in between. A transaction here is the write and the read in one go, the
+ * controller sends a repeated START when the direction changes, and it is
+ * queued: the call returns and the callback tells how it went. The next
+ * transaction of the port is started from the interrupt that ends the
+ * previous one, so several sensors can share the bus without a thread
+ * each.
+ *
+ * The bytes written and the read commands are fed to the transmit FIFO by
+ * a request of the DMA service of dma_svc.h. The controller ends the
+ * transaction with a STOP once that FIFO runs empty. The bytes read are
+ * taken from the receive FIFO at the STOP, which limits a read to the
+ * depth of the FIFO, I2C_XFER_MAX_READ.
+ *
+ * The port has to be opened in master mode before i2c_xfer_init().
+ * i2c_drv_write() and i2c_drv_read() must not be used on it while
+ * transactions are queued.
+ *
+ * @code
+ * static void regs_done(int result, void *arg)
+ * {
+ *	os_semaphore_put(arg);
+ * }
+ *
+ * static uint8_t reg = 0x00;
+ * static uint8_t xyz[3];
+ * static i2c_xfer_t rd = {
+ *	.addr = 0x4c,
+ *	.wr = &reg,
+ *	.wr_len = 1,
+ *	.rd = xyz,
+ *	.rd_len = sizeof(xyz),
+ *	.cb = regs_done,
+ *	.arg = &sem,
+ * };
+ *
+ * i2c_xfer_init(i2c0, I2C0_PORT);
+ * i2c_xfer_submit(I2C0_PORT, &rd);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _I2C_XFER_H_
+#define _I2C_XFER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mdev_i2c.h>
+#include <dma_svc.h>
+
+/** Bytes a transaction can read, the depth of the receive FIFO */
+#define I2C_XFER_MAX_READ 16
+/** Bytes a transaction can write */
+#define I2C_XFER_MAX_WRITE DMA_SVC_MAX_BLOCK
+
+/** Completion of a transaction
+ *
+ * Called from an interrupt, it must not block. It can submit again.
+ *
+ * \param[in] result WM_SUCCESS or -WM_FAIL if the slave did not
+ * acknowledge or the transaction was cut short
+ * \param[in] arg Argument of the transaction
+ */
+typedef void (*i2c_xfer_cb_t)(int result, void *arg);
+
+/** Transaction, a write then a read with a repeated START in between */
+typedef struct i2c_xfer {
+	/** 7-bit slave address */
+	uint16_t addr;
+	/** Bytes written, can be NULL if wr_len is 0 */
+	const uint8_t *wr;
+	/** Number of bytes written, up to I2C_XFER_MAX_WRITE */
+	uint32_t wr_len;
+	/** Bytes read, can be NULL if rd_len is 0 */
+	uint8_t *rd;
+	/** Number of bytes read, up to I2C_XFER_MAX_READ */
+	uint32_t rd_len;
+	/** Completion, can be NULL */
+	i2c_xfer_cb_t cb;
+	/** Argument of the callback */
+	void *arg;
+	/* Used by i2c_xfer */
+	struct i2c_xfer *next;
+} i2c_xfer_t;
+
+/** Take over an opened port
+ *
+ * Starts the DMA service if it is not yet, turns on the transmit DMA
+ * request and the repeated START of the controller, and takes the STOP
+ * notification of the driver.
+ *
+ * \param[in] dev Port opened by i2c_drv_open() in master mode
+ * \param[in] id Port
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_FAIL
+ */
+int i2c_xfer_init(mdev_t *dev, I2C_ID_Type id);
+
+/** Queue a transaction
+ *
+ * Transactions of a port run in the order they were submitted. The
+ * transaction and its buffers have to stay in place until the callback.
+ * Can be called from a thread or from a completion callback.
+ *
+ * \param[in] id Port
+ * \param[in] xfer Transaction, not already queued
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int i2c_xfer_submit(I2C_ID_Type id, i2c_xfer_t *xfer);
+
+/** Check that the port has nothing queued
+ *
+ * \param[in] id Port
+ *
+ * \return true once the last transaction is done
+ */
+bool i2c_xfer_idle(I2C_ID_Type id);
+
+#endif /* ! _I2C_XFER_H_ */
@@ -0,0 +1,97 @@
+/*! \file json_index.h
+ * \brief Hash index of the keys of a JSON object parsed with jsonv2.h
+ *
+ * The json_get_val_*() functions of jsonv2.h look for their key through the
+ * tokens of the current object, reading K fields of an object of N tokens
+ * compares up to K * N keys. json_index_build() goes over the object once
+ * and puts its keys in a hash table given by the application, the
+ * json_index_get_*() functions then find a key with about one compare.
+ *
+ * The index covers the keys of one object level, the current object of the
+ * jobj_t when it is built. Entering a member object with
+ * json_index_get_composite_object() makes it the current one of the jobj_t
+ * and an index of its own can be built for it. The index stays valid as long
+ * as the tokens and the JSON string do.
+ *
+ * @code
+ * jsontok_t tokens[300];
+ * int16_t slots[256];
+ * json_index_t idx;
+ * jobj_t jobj;
+ * int port;
+ *
+ * json_init(&jobj, tokens, 300, config, strlen(config));
+ * json_index_build(&idx, &jobj, slots, 256);
+ * json_index_get_val_int(&idx, "port", &port);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _JSON_INDEX_H_
+#define _JSON_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <jsonv2.h>
+
+/** Index of the keys of a JSON object, set up by json_index_build() */
+typedef struct {
+	/** Parsed document */
+	jobj_t *jobj;
+	/** Object indexed */
+	jsontok_t *obj;
+	/** Key token of every slot, -1 where there is none */
+	int16_t *slots;
+	/** Number of slots - 1 */
+	uint16_t mask;
+} json_index_t;
+
+/** Build the index of the current object
+ *
+ * \param[out] idx Index to set up
+ * \param[in] jobj Parsed document, its current object is indexed
+ * \param[in] slots Table of the index, assigned by the application. It has
+ * to stay valid as long as the index is used
+ * \param[in] num_slots Number of slots, a power of two larger than the number
+ * of keys of the object. Twice the number of keys keeps lookups short
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_JSON_INVALID_JOBJ if the current object is not a JSON object
+ * \return -WM_E_JSON_NOMEM if num_slots is not a power of two or the object
+ * has too many keys for it
+ */
+int json_index_build(json_index_t *idx, jobj_t *jobj, int16_t *slots,
+		     int num_slots);
+
+/** Get JSON bool value, as json_get_val_bool() */
+int json_index_get_val_bool(json_index_t *idx, const char *key, bool *value);
+
+/** Get JSON integer value, as json_get_val_int() */
+int json_index_get_val_int(json_index_t *idx, const char *key, int *value);
+
+/** Get 64bit JSON integer value, as json_get_val_int64() */
+int json_index_get_val_int64(json_index_t *idx, const char *key,
+			     int64_t *value);
+
+/** Get JSON float value, as json_get_val_float() */
+int json_index_get_val_float(json_index_t *idx, const char *key, float *value);
+
+/** Get JSON string value, as json_get_val_str() */
+int json_index_get_val_str(json_index_t *idx, const char *key, char *value,
+			   int max_len);
+
+/** Get JSON string length, as json_get_val_str_len() */
+int json_index_get_val_str_len(json_index_t *idx, const char *key, int *len);
+
+/** Get JSON composite object, as json_get_composite_object()
+ *
+ * The object becomes the current one of the jobj_t the index was built on,
+ * json_release_composite_object() goes back to the parent.
+ */
+int json_index_get_composite_object(json_index_t *idx, const char *key);
+
+#endif /* _JSON_INDEX_H_ */
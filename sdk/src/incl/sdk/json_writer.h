@@ -0,0 +1,154 @@
+/*! \file json_writer.h
+ * \brief Streaming JSON writer
+ *
+ * Builds a JSON document an element at a time into a buffer of the
+ * application. Without a flush callback the buffer has to hold the whole
+ * document. With one, the buffer is handed to the callback whenever it is
+ * full and reused, so a document of any size is written through a buffer
+ * of a few dozen bytes. Without a buffer nothing is written and only the
+ * length of the document is counted, for a transport that needs it before
+ * the document.
+ *
+ * Commas, quotes and the escaping of strings are taken care of. Integers
+ * and floats are formatted without the printf machinery.
+ *
+ * The first error is kept, the calls that follow it do nothing and return
+ * it again, so a document can be written without checking every call.
+ *
+ * @code
+ * char buf[128];
+ * struct json_writer w;
+ *
+ * json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+ * json_writer_start_object(&w, NULL);
+ * json_writer_start_object(&w, "state");
+ * json_writer_start_object(&w, "reported");
+ * json_writer_add_int(&w, "count", count);
+ * json_writer_add_float(&w, "temp", temp, 2);
+ * json_writer_add_str(&w, "name", name);
+ * json_writer_end_object(&w);
+ * json_writer_end_object(&w);
+ * json_writer_end_object(&w);
+ * len = json_writer_finish(&w);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <jsonv2.h>
+
+/** Objects and arrays a document may nest */
+#define JSON_WRITER_MAX_DEPTH 32
+
+/** Called with the written part of the buffer when it is full
+ *
+ * \return WM_SUCCESS to go on, an error code to stop the document
+ */
+typedef int (*json_writer_flush_t)(const char *buf, int len, void *ctx);
+
+/** State of a document being written, set up by json_writer_init() */
+struct json_writer {
+	char *buf;
+	int size;
+	int len;		/* Bytes in buf not flushed yet */
+	int total;		/* Bytes of the document so far */
+	int err;
+	json_writer_flush_t flush;
+	void *ctx;
+	uint8_t depth;
+	uint32_t has_elems;	/* Bit n set once level n + 1 has an element */
+};
+
+/** Start a document
+ *
+ * \param[out] w Writer
+ * \param[in] buf Buffer the document is written in, NULL to only count
+ * its length
+ * \param[in] size Size of the buffer
+ * \param[in] flush Called when the buffer is full and by
+ * json_writer_finish(), NULL if the buffer has to hold the whole document
+ * \param[in] ctx Passed to flush
+ */
+void json_writer_init(struct json_writer *w, char *buf, int size,
+		      json_writer_flush_t flush, void *ctx);
+
+/** Start an object
+ *
+ * \param[in,out] w Writer
+ * \param[in] key Key of the object in the enclosing object, NULL in an array
+ * or at the top
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_JSON_OBUF if the buffer is full and there is no flush
+ * callback
+ * \return -WM_E_JSON_FAIL if the document nests too deep or ends too soon
+ * \return the error of the flush callback
+ */
+int json_writer_start_object(struct json_writer *w, const char *key);
+
+/** End the current object, returns as json_writer_start_object() */
+int json_writer_end_object(struct json_writer *w);
+
+/** Start an array, as json_writer_start_object() */
+int json_writer_start_array(struct json_writer *w, const char *key);
+
+/** End the current array, returns as json_writer_start_object() */
+int json_writer_end_array(struct json_writer *w);
+
+/** Add a string, escaped as JSON requires, as json_writer_start_object() */
+int json_writer_add_str(struct json_writer *w, const char *key,
+			const char *val);
+
+/** Add a signed integer, as json_writer_start_object() */
+int json_writer_add_int(struct json_writer *w, const char *key, int64_t val);
+
+/** Add an unsigned integer, as json_writer_start_object() */
+int json_writer_add_uint(struct json_writer *w, const char *key,
+			 uint64_t val);
+
+/** Add a float with a fixed number of decimals
+ *
+ * NaN and infinities, which JSON does not have, are written as null.
+ * Values of 1e18 and more are written with an exponent.
+ *
+ * \param[in] decimals Digits after the point, at most 9
+ *
+ * Returns as json_writer_start_object().
+ */
+int json_writer_add_float(struct json_writer *w, const char *key, float val,
+			  int decimals);
+
+/** Add true or false, as json_writer_start_object() */
+int json_writer_add_bool(struct json_writer *w, const char *key, bool val);
+
+/** Add null, as json_writer_start_object() */
+int json_writer_add_null(struct json_writer *w, const char *key);
+
+/** Add JSON text as it is, such as a value written before
+ *
+ * Returns as json_writer_start_object().
+ */
+int json_writer_add_raw(struct json_writer *w, const char *key,
+			const char *json, int len);
+
+/** End the document
+ *
+ * Flushes what is left in the buffer. Without a flush callback the
+ * document is NUL terminated in the buffer, which then has to have room for
+ * the NUL too.
+ *
+ * \return the length of the document on success
+ * \return an error code as json_writer_start_object(), -WM_E_JSON_FAIL if
+ * an object or array was not ended
+ */
+int json_writer_finish(struct json_writer *w);
+
+#endif /* _JSON_WRITER_H_ */
@@ -150,6 +150,9 @@ enum wm_json_errno {
 /**
  * JSON token. Application just needs to define an array of these tokens and
  * pass it to json_init().
+ *
+ * A token takes 8 bytes. Its positions are 16 bit, so a JSON string of up to
+ * 32767 bytes can be parsed, and an object or array of up to 255 children.
  */
 typedef struct {
 	/** Type of the token, like object, string, array, etc. */
@@ -0,0 +1,113 @@
+/*! \file kv_store.h
+ * \brief Key value store kept as a log in a flash partition
+ *
+ * Every set or delete of a key is a single record appended to the
+ * partition, protected by a CRC32, so an update writes a few bytes instead
+ * of rewriting a sector and a record torn by a reset is ignored. The
+ * partition is scanned once in kv_store_init() and the location of the
+ * newest value of every key is kept in RAM: a lookup does not search the
+ * flash, values of up to KV_STORE_CACHE_LEN bytes are copied from RAM and
+ * longer ones with one flash read.
+ *
+ * The partition is used as a ring of sectors. When the log reaches the
+ * oldest sector the values still current in it are copied to the sector
+ * just opened and it is released, a sector is erased once per turn around
+ * the partition. The current values have to fit in one sector less than
+ * the partition.
+ *
+ * @code
+ * flash_desc_t fl = { FL_INT, 0x1f0000, 0x2000 };
+ * char thing[64];
+ * int len;
+ *
+ * flash_drv_init();
+ * kv_store_init(&fl);
+ * len = kv_store_get("thing", thing, sizeof(thing));
+ * if (len == -WM_E_NOENT)
+ *	kv_store_set("thing", "my-thing", sizeof("my-thing"));
+ * @endcode
+ *
+ * The functions can be called from several threads, not from interrupts.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _KV_STORE_H_
+#define _KV_STORE_H_
+
+#include <stddef.h>
+#include <flash.h>
+
+/** Size of a sector of the partition, the unit of erase */
+#define KV_STORE_SECTOR_SIZE 4096
+/** Number of keys the store can hold */
+#define KV_STORE_MAX_KEYS 16
+/** Longest key, in characters */
+#define KV_STORE_MAX_KEY_LEN 31
+/** Values up to this length are kept in RAM as well */
+#define KV_STORE_CACHE_LEN 32
+/** Longest value, a record has to fit in a sector */
+#define KV_STORE_MAX_VALUE_LEN (KV_STORE_SECTOR_SIZE - 16 - \
+				KV_STORE_MAX_KEY_LEN)
+
+/** Open the store in a flash partition
+ *
+ * Builds the index of the keys from the records in the partition. A
+ * partition holding anything else is erased as it is used. The partition
+ * has to be made of whole sectors of KV_STORE_SECTOR_SIZE bytes, at least
+ * two. flash_drv_init() has to be called before.
+ *
+ * \param[in] fl Partition of the store
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if the partition can not be used or
+ * -WM_FAIL if it could not be read
+ */
+int kv_store_init(const flash_desc_t *fl);
+
+/** Read the value of a key
+ *
+ * \param[in] key Key, NUL terminated
+ * \param[out] buf Buffer for the value, NULL to get its length only
+ * \param[in] len Size of the buffer
+ *
+ * \return Length of the value, -WM_E_NOENT if the key is not set or
+ * -WM_E_NOSPC if the buffer is too small
+ */
+int kv_store_get(const char *key, void *buf, size_t len);
+
+/** Set the value of a key
+ *
+ * Nothing is written when the key already has this value.
+ *
+ * \param[in] key Key, NUL terminated, at most KV_STORE_MAX_KEY_LEN
+ * characters
+ * \param[in] val Value
+ * \param[in] len Length of the value, at most KV_STORE_MAX_VALUE_LEN
+ *
+ * \return WM_SUCCESS, -WM_E_NOMEM if KV_STORE_MAX_KEYS keys are already
+ * set, -WM_E_NOSPC if the current values fill the partition or -WM_FAIL
+ * if the flash could not be written
+ */
+int kv_store_set(const char *key, const void *val, size_t len);
+
+/** Delete a key
+ *
+ * \param[in] key Key, NUL terminated
+ *
+ * \return WM_SUCCESS, -WM_E_NOENT if the key is not set or an error of
+ * kv_store_set()
+ */
+int kv_store_delete(const char *key);
+
+/** Delete all the keys
+ *
+ * Erases the partition, e.g. on a reset to factory.
+ *
+ * \return WM_SUCCESS or -WM_FAIL if the flash could not be erased
+ */
+int kv_store_erase_all(void);
+
+#endif /* ! _KV_STORE_H_ */
@@ -43,6 +43,9 @@ void led_off(output_gpio_cfg_t led);
  * ON in blinking cycle
  * \param[in] off_duty_cycle Time in millisec for which LED will be
  * OFF in blinking cycle
+ *
+ * \note The LED is toggled from a software timer, led_pwm_blink() of
+ * \ref led_pwm.h blinks it in hardware where the pin allows
  */
 void led_blink(output_gpio_cfg_t led, int on_duty_cycle, int off_duty_cycle);
 
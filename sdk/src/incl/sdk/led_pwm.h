@@ -0,0 +1,87 @@
+/*! \file led_pwm.h
+ * \brief LED indicator blinking in hardware
+ *
+ * led_blink() of \ref led_indicator.h toggles the GPIO from a software
+ * timer: the CPU wakes up twice per blink period and the timer keeps the
+ * tickless idle from sleeping long. The functions here blink the LED with
+ * the PWM output of a general purpose timer (GPT) channel instead, when the
+ * LED's pin is muxed to one. The blinking then costs no CPU at all.
+ *
+ * A GPT has one counter for its channels, so it blinks one LED. An LED on a
+ * pin without a GPT channel, or whose GPT is already in use, blinks from
+ * the software timer as before.
+ *
+ * The GPT runs on in PM2 but stops in PM3 and PM4, an LED that must keep
+ * blinking there needs the software timer.
+ *
+ * led_pwm_on() and led_pwm_off() take the pin back from the GPT, an LED
+ * blinked with led_pwm_blink() is switched with them and not with
+ * led_on() and led_off().
+ *
+ * The functions are not to be called from interrupt handlers.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _LED_PWM_H_
+#define _LED_PWM_H_
+
+#include <led_indicator.h>
+
+/** Blink an LED, with a GPT channel if its pin has one
+ *
+ * \param[in] led The output LED GPIO configuration of type
+ * \ref output_gpio_cfg_t
+ * \param[in] on_duty_cycle Time in millisec for which LED will be
+ * ON in blinking cycle
+ * \param[in] off_duty_cycle Time in millisec for which LED will be
+ * OFF in blinking cycle
+ *
+ * \return WM_SUCCESS if a GPT blinks the LED, -WM_FAIL if the software timer
+ * does
+ */
+int led_pwm_blink(output_gpio_cfg_t led, int on_duty_cycle,
+		  int off_duty_cycle);
+
+/** Switch ON an LED, stopping its GPT
+ *
+ * \param[in] led The output LED GPIO configuration of type
+ * \ref output_gpio_cfg_t
+ */
+void led_pwm_on(output_gpio_cfg_t led);
+
+/** Switch OFF an LED, stopping its GPT
+ *
+ * \param[in] led The output LED GPIO configuration of type
+ * \ref output_gpio_cfg_t
+ */
+void led_pwm_off(output_gpio_cfg_t led);
+
+/** Fast Blink the LED, with a GPT channel if its pin has one
+ *
+ *  Blink LED with on_duty_cycle = 200ms and off_duty_cycle = 200ms
+ *
+ *  \param[in] led The output LED GPIO configuration of type
+ *  \ref output_gpio_cfg_t
+ */
+static inline void led_pwm_fast_blink(output_gpio_cfg_t led)
+{
+	led_pwm_blink(led, 200, 200);
+}
+
+/** Slow Blink the LED, with a GPT channel if its pin has one
+ *
+ *  Blink LED with on_duty_cycle = 1000ms and off_duty_cycle = 1000ms
+ *
+ *  \param[in] led The output LED GPIO configuration of type
+ *  \ref output_gpio_cfg_t
+ */
+static inline void led_pwm_slow_blink(output_gpio_cfg_t led)
+{
+	led_pwm_blink(led, 1000, 1000);
+}
+
+#endif /* _LED_PWM_H_ */
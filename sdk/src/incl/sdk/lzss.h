@@ -0,0 +1,80 @@
+/*! \file lzss.h
+ * \brief Small window LZSS compression of buffers
+ *
+ * Compresses a buffer held in memory as a whole, e.g. a JSON message, to
+ * a buffer. Matches are looked up through a table of 256 positions the
+ * caller supplies, 512 bytes, the window is the input itself: no history
+ * is kept between calls. Decompression takes no memory but the output.
+ *
+ * The format is a series of groups, a flag byte followed by 8 items, the
+ * lowest bit of the flag for the first one. A clear bit is a literal byte.
+ * A set bit is a match of 2 bytes: the high 12 bits hold the distance back
+ * in the output less 1, the low 4 bits the length less 3. The last group
+ * ends with the input. Text compresses to about a half or a third.
+ *
+ * @code
+ * struct lzss_work work;
+ * int n = lzss_compress(&work, json, json_len, out, sizeof(out));
+ *
+ * if (n > 0)
+ *	send(out, n);
+ * else
+ *	send(json, json_len);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _LZSS_H_
+#define _LZSS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Farthest back a match reaches */
+#define LZSS_WINDOW 4096
+/** Shortest match */
+#define LZSS_MIN_MATCH 3
+/** Longest match */
+#define LZSS_MAX_MATCH 18
+/** Largest input of lzss_compress(), positions are kept in 16 bits */
+#define LZSS_MAX_LEN 65535
+
+/** Positions of lzss_compress(), by hash of the 3 bytes found there */
+struct lzss_work {
+	uint16_t head[256];
+};
+
+/** Size the compressed data of len bytes can take at most */
+#define LZSS_BOUND(len) ((len) + ((len) + 7) / 8)
+
+/** Compress a buffer
+ *
+ * \param[in] work Table of the compression, its contents do not matter
+ * \param[in] src The data
+ * \param[in] len Its length, at most LZSS_MAX_LEN
+ * \param[out] dst The compressed data
+ * \param[in] size Room in dst
+ *
+ * \return The length of the compressed data, 0 if it is not shorter than
+ * len or does not fit, -WM_E_INVAL if len is too large
+ */
+int lzss_compress(struct lzss_work *work, const void *src, size_t len,
+		  void *dst, size_t size);
+
+/** Decompress a buffer
+ *
+ * \param[in] src The compressed data
+ * \param[in] len Its length
+ * \param[out] dst The data
+ * \param[in] size Room in dst
+ *
+ * \return The length of the data, -WM_E_NOSPC if it does not fit or
+ * -WM_E_INVAL if src is not compressed data
+ */
+int lzss_decompress(const void *src, size_t len, void *dst, size_t size);
+
+#endif /* _LZSS_H_ */
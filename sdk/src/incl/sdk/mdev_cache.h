@@ -0,0 +1,96 @@
+/*! \file mdev_cache.h
+ * \brief Open device handles kept by a small integer ID
+ *
+ * mdev_get_handle() and the _drv_open() calls that take a device name go
+ * through the list of registered devices comparing names. Code that opens
+ * and closes a device around every access, such as an LED toggled from a
+ * button interrupt, pays for that search every time.
+ *
+ * A device is interned once at init with mdev_cache_id(), which gives the
+ * same ID for the same name. mdev_cache_get() then indexes a table: the
+ * first call opens the device, the following ones only count a reference
+ * and return the same handle. mdev_cache_put() drops the reference, the
+ * device stays open for the next get until mdev_cache_release().
+ *
+ * The drivers opened by port rather than by name are interned through a
+ * wrapper that opens the port with its settings, under a name of the
+ * caller's choosing.
+ *
+ * @code
+ * static int gpio_id;
+ *
+ * gpio_id = mdev_cache_id("MDEV_GPIO", gpio_drv_open, gpio_drv_close);
+ * ...
+ * mdev_t *dev = mdev_cache_get(gpio_id);
+ * gpio_drv_write(dev, pin, GPIO_IO_HIGH);
+ * mdev_cache_put(gpio_id);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _MDEV_CACHE_H_
+#define _MDEV_CACHE_H_
+
+#include <mdev.h>
+
+/** Devices that can be interned */
+#define MDEV_CACHE_MAX 16
+
+/** Open of a device by name, as gpio_drv_open() */
+typedef mdev_t *(*mdev_cache_open_t)(const char *name);
+/** Close of a device, as gpio_drv_close() */
+typedef void (*mdev_cache_close_t)(mdev_t *dev);
+
+/** Intern a device
+ *
+ * The name is kept, not copied. An interned name gets its ID back, with
+ * the functions it was first interned with.
+ *
+ * \param[in] name Name the device is opened by
+ * \param[in] open Function opening it
+ * \param[in] close Function closing it, can be NULL
+ *
+ * \return ID of the device, 0 or more
+ * \return -WM_E_INVAL if name or open is NULL
+ * \return -WM_E_NOSPC if MDEV_CACHE_MAX devices are interned
+ */
+int mdev_cache_id(const char *name, mdev_cache_open_t open,
+		  mdev_cache_close_t close);
+
+/** Get the handle of an interned device and take a reference
+ *
+ * Opens the device if it is not open. Once it is open this can be called
+ * from an interrupt handler.
+ *
+ * \param[in] id ID given by mdev_cache_id()
+ *
+ * \return The handle, NULL if the ID is invalid, the open failed or the
+ * device is not open yet and this is called from an interrupt handler
+ */
+mdev_t *mdev_cache_get(int id);
+
+/** Drop a reference taken by mdev_cache_get()
+ *
+ * The device stays open. Can be called from an interrupt handler.
+ *
+ * \param[in] id ID of the device
+ */
+void mdev_cache_put(int id);
+
+/** Close an interned device that has no reference
+ *
+ * The ID stays valid, the next mdev_cache_get() opens the device again.
+ *
+ * \param[in] id ID of the device
+ *
+ * \return WM_SUCCESS, also if the device was not open
+ * \return -WM_E_INVAL if the ID is invalid
+ * \return -WM_E_BUSY if references are held
+ */
+int mdev_cache_release(int id);
+
+#endif /* ! _MDEV_CACHE_H_ */
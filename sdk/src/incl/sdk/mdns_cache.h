@@ -0,0 +1,143 @@
+/*! \file mdns_cache.h
+ * \brief mDNS service discovery with a cache
+ *
+ * Finds the services of the local network, e.g. the MQTT broker of an
+ * on-premises gateway, with multicast DNS. The mDNS responder of the SDK
+ * only announces the services of the device, this is the querier side.
+ *
+ * Every mDNS response heard for a service type of interest is kept in a
+ * cache of CONFIG_MDNS_SERVICE_CACHE_SIZE instances, until its TTL runs
+ * out, whoever asked for it. A resolution is a cache hit when a response
+ * was seen, so only the first one costs a query. On a miss the type is
+ * queried, and the questions for all the types missing within
+ * MDNS_CACHE_BATCH_MS are sent in one packet, with the instances already
+ * known listed as known answers so that their responders keep quiet.
+ * Types added with mdns_cache_add_type() are queried again when their
+ * instances reach 80% of their TTL, so they stay in the cache.
+ *
+ * @code
+ * struct mdns_cache_result gw;
+ *
+ * mdns_cache_start();
+ * mdns_cache_add_type("_mqtt._tcp.local");
+ * if (mdns_cache_resolve("_mqtt._tcp.local", 3000, &gw) == WM_SUCCESS)
+ *	connect_to(gw.ip, gw.port);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _MDNS_CACHE_H_
+#define _MDNS_CACHE_H_
+
+#include <stdint.h>
+
+/** Service instances cached */
+#define MDNS_CACHE_SIZE CONFIG_MDNS_SERVICE_CACHE_SIZE
+
+/** Service types of interest, all queried in one packet at most */
+#define MDNS_CACHE_MAX_TYPES CONFIG_MDNS_MAX_SERVICE_MONITORS
+
+/** Longest name, of a type, an instance or a host, with the ".local" */
+#define MDNS_CACHE_NAME_LEN 64
+
+/** Time the queries of several resolutions are held to be sent together */
+#ifndef MDNS_CACHE_BATCH_MS
+#define MDNS_CACHE_BATCH_MS 100
+#endif
+
+/** A service instance */
+struct mdns_cache_result {
+	/** Instance name, e.g. "Gateway._mqtt._tcp.local" */
+	char name[MDNS_CACHE_NAME_LEN];
+	/** IPv4 address in network order */
+	uint32_t ip;
+	/** Port */
+	uint16_t port;
+	/** Seconds left before the entry expires */
+	uint32_t ttl_s;
+};
+
+/** Counters since the start */
+struct mdns_cache_stats {
+	/** Resolutions answered from the cache */
+	uint32_t hits;
+	/** Resolutions which had to query */
+	uint32_t misses;
+	/** Query packets sent */
+	uint32_t queries;
+	/** Questions in these packets */
+	uint32_t questions;
+	/** Known answers in these packets */
+	uint32_t known_answers;
+	/** Records of the responses taken in the cache */
+	uint32_t records;
+	/** Instances which replaced another one in a full cache */
+	uint32_t evicted;
+};
+
+/** Start the querier
+ *
+ * Joins the mDNS group on the port of mDNS, along with the responder, and
+ * starts the thread receiving the responses. Call it once the station
+ * has an address.
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_BUSY if it runs already
+ * \return -WM_FAIL if the socket or the thread can not be created
+ */
+int mdns_cache_start(void);
+
+/** Add a service type of interest
+ *
+ * The responses for the types added are cached as they are heard, and
+ * their instances are kept fresh. mdns_cache_resolve() adds the types it
+ * is called for.
+ *
+ * \param[in] type Service type, e.g. "_mqtt._tcp.local"
+ *
+ * \return WM_SUCCESS on success, or if it was added already
+ * \return -WM_E_INVAL if the name is too long
+ * \return -WM_E_NOSPC if MDNS_CACHE_MAX_TYPES types are added already
+ * \return -WM_FAIL if the querier is not started
+ */
+int mdns_cache_add_type(const char *type);
+
+/** Find an instance of a service type
+ *
+ * Returns an instance from the cache, or queries the type and waits for
+ * one, asking again after 1 s, 2 s and so on.
+ *
+ * \param[in] type Service type, e.g. "_mqtt._tcp.local"
+ * \param[in] timeout_ms Time to wait on a cache miss
+ * \param[out] res The instance found
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_TIMEOUT if no instance was found
+ * \return -WM_FAIL if the querier is not started, or the errors of
+ * mdns_cache_add_type()
+ */
+int mdns_cache_resolve(const char *type, uint32_t timeout_ms,
+		       struct mdns_cache_result *res);
+
+/** List the cached instances of a service type
+ *
+ * \param[in] type Service type
+ * \param[out] res Instances
+ * \param[in] max Size of res
+ *
+ * \return Number of instances
+ */
+int mdns_cache_browse(const char *type, struct mdns_cache_result *res,
+		      int max);
+
+/** Get the counters
+ *
+ * \param[out] stats Counters
+ */
+void mdns_cache_get_stats(struct mdns_cache_stats *stats);
+
+#endif /* _MDNS_CACHE_H_ */
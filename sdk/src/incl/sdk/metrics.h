@@ -0,0 +1,200 @@
+/*! \file metrics.h
+ * \brief Registry of device metrics reported in one periodic document
+ *
+ * Modules register their counters, gauges and histograms once at init.
+ * A counter or gauge that the module already keeps, such as the counters
+ * of the MQTT client or the free heap, is registered with a function that
+ * reads it. One without such a function is kept by the registry and
+ * updated with metrics_add() or metrics_set(). A histogram counts the
+ * values given to metrics_observe() in buckets of fixed bounds.
+ *
+ * The reporter writes all the metrics in a single JSON document every
+ * interval and hands it to a send function, e.g. one that publishes it.
+ * Counters and histogram buckets are reported as what they grew by since
+ * the last report that was sent, gauges only when they changed. Whatever
+ * did not change is left out. Every METRICS_FULL_EVERY reports, and in the
+ * first one, all the metrics are reported with their values, so that a
+ * receiver that missed a report catches up.
+ *
+ * @code
+ * {"seq":7,"ms":60000,"c":{"mqtt_tx":12,"mqtt_rx":3},"g":{"rssi":-61},
+ *  "h":{"pub_ms":[0,9,3,0]}}
+ * @endcode
+ *
+ * A report that fails to send changes nothing, its deltas are in the next
+ * one.
+ *
+ * @code
+ * static uint32_t read_heap(void *ctx)
+ * {
+ *	return os_get_free_size();
+ * }
+ * static const uint32_t pub_ms_bounds[] = {10, 100, 1000};
+ *
+ * metrics_gauge("heap", read_heap, NULL);
+ * pub_ms = metrics_histogram("pub_ms", pub_ms_bounds, 3);
+ * metrics_report_start(60000, buf, sizeof(buf), send_metrics, NULL);
+ * ...
+ * metrics_observe(pub_ms, elapsed_ms);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <json_writer.h>
+
+/** Metrics that can be registered */
+#ifndef METRICS_MAX
+#define METRICS_MAX 32
+#endif
+
+/** Buckets of all the histograms together */
+#ifndef METRICS_MAX_BUCKETS
+#define METRICS_MAX_BUCKETS 32
+#endif
+
+/** Reports between two reports of all the values */
+#ifndef METRICS_FULL_EVERY
+#define METRICS_FULL_EVERY 10
+#endif
+
+/** Reads a counter or gauge the module keeps
+ *
+ * A gauge that may be negative, such as an RSSI, returns its int32_t value
+ * cast.
+ *
+ * \param[in] ctx Context given at registration
+ *
+ * \return The current value
+ */
+typedef uint32_t (*metrics_read_t)(void *ctx);
+
+/** Called by the reporter with a report
+ *
+ * It runs in the low lane of the work service, see work_svc.h, so it
+ * should hand the document on rather than wait, e.g. with an asynchronous
+ * publish.
+ *
+ * \param[in] doc The document, NUL terminated
+ * \param[in] len Its length
+ * \param[in] ctx Context given to metrics_report_start()
+ *
+ * \return WM_SUCCESS if the report went out, an error code otherwise
+ */
+typedef int (*metrics_send_t)(const char *doc, int len, void *ctx);
+
+/** Register a counter, a value that only grows and may wrap
+ *
+ * \param[in] name Key of the counter in the report, it has to stay valid
+ * \param[in] read Function reading the counter, NULL for one kept by the
+ * registry and counted with metrics_add()
+ * \param[in] ctx Passed to read
+ *
+ * \return The id of the counter
+ * \return -WM_E_INVAL if name is NULL
+ * \return -WM_E_NOSPC if METRICS_MAX metrics are registered
+ */
+int metrics_counter(const char *name, metrics_read_t read, void *ctx);
+
+/** Register a gauge, a signed value that goes up and down
+ *
+ * \param[in] read Function reading the gauge, NULL for one kept by the
+ * registry and set with metrics_set()
+ *
+ * Otherwise as metrics_counter().
+ */
+int metrics_gauge(const char *name, metrics_read_t read, void *ctx);
+
+/** Register a histogram
+ *
+ * A value goes to the first bucket whose bound it is below, values not
+ * below the last bound to an extra bucket, so there are n + 1 buckets.
+ *
+ * \param[in] name Key of the histogram in the report, it has to stay valid
+ * \param[in] bounds Upper bounds of the buckets, growing, they have to stay
+ * valid
+ * \param[in] n Number of bounds
+ *
+ * \return The id of the histogram
+ * \return -WM_E_INVAL if name or bounds is NULL or n is 0
+ * \return -WM_E_NOSPC if METRICS_MAX metrics are registered or the buckets
+ * do not fit in METRICS_MAX_BUCKETS
+ */
+int metrics_histogram(const char *name, const uint32_t *bounds, int n);
+
+/** Add to a counter kept by the registry
+ *
+ * Can be called from an interrupt handler. Does nothing for another id.
+ *
+ * \param[in] id Id of the counter
+ * \param[in] n Amount to add
+ */
+void metrics_add(int id, uint32_t n);
+
+/** Set a gauge kept by the registry
+ *
+ * Can be called from an interrupt handler. Does nothing for another id.
+ *
+ * \param[in] id Id of the gauge
+ * \param[in] val The value
+ */
+void metrics_set(int id, int32_t val);
+
+/** Count a value in a histogram
+ *
+ * Can be called from an interrupt handler. Does nothing for another id.
+ *
+ * \param[in] id Id of the histogram
+ * \param[in] val The value
+ */
+void metrics_observe(int id, uint32_t val);
+
+/** Write a report
+ *
+ * Takes the current values and writes them, as deltas against the last
+ * committed report unless full is set. The values taken become the base of
+ * the next deltas only once metrics_report_commit() is called.
+ *
+ * \param[in,out] w Writer
+ * \param[in] full true to report all the values
+ *
+ * \return The status of the writer, see json_writer_start_object()
+ */
+int metrics_report_json(struct json_writer *w, bool full);
+
+/** Make the values of the last metrics_report_json() the base of the
+ * deltas of the next one */
+void metrics_report_commit(void);
+
+/** Report every interval
+ *
+ * Starts the work service if needed. The first report is written after
+ * one interval.
+ *
+ * \param[in] interval_ms Time between two reports
+ * \param[in] buf Buffer the reports are written in, it has to stay valid
+ * \param[in] size Size of the buffer, with room for the NUL. A report that
+ * does not fit is not sent, its deltas go in the next one
+ * \param[in] send Function the reports are handed to
+ * \param[in] ctx Passed to send
+ *
+ * \return WM_SUCCESS
+ * \return -WM_E_INVAL if the reporter already runs, an argument is NULL or
+ * interval_ms is 0
+ * \return -WM_FAIL if the work service can not be started
+ */
+int metrics_report_start(uint32_t interval_ms, char *buf, int size,
+			 metrics_send_t send, void *ctx);
+
+/** Stop the reporter */
+void metrics_report_stop(void);
+
+#endif /* _METRICS_H_ */
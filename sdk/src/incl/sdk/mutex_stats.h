@@ -0,0 +1,96 @@
+/*! \file mutex_stats.h
+ * \brief Contention counts of the mutexes
+ *
+ * os_mutex_get() tells whether a mutex was taken, not whether the task had
+ * to wait for it or for how long. With FREERTOS_MUTEX_STATS=y the kernel
+ * counts, for every mutex, the takes, the takes that found it held, the
+ * ones that gave up, the ticks spent blocked and the waits on a holder of a
+ * lower priority that had to inherit the priority of the waiter. A take
+ * that finds the mutex free only adds one to a count.
+ *
+ * The mutexes created with the os_mutex_*() calls carry their names, the
+ * lwIP ones are named "lwip". The counts are read here by name along with
+ * the task holding the mutex, or printed with the "mutex-stats" command.
+ *
+ * @code
+ * mutex_stats_cli_init();
+ *
+ * # mutex-stats
+ * mutex            takes   contended timeouts inversions wait_ms max_ms owner
+ * mqtt_pub         1520    212       0        37         1890    120    mqtt
+ * lwip             40210   1530      0        410        3310    40     -
+ * @endcode
+ *
+ * Without FREERTOS_MUTEX_STATS the calls find no mutex.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _MUTEX_STATS_H_
+#define _MUTEX_STATS_H_
+
+#include <stdint.h>
+
+/** Mutexes mutex_stats_find() and mutex_stats_print() look at */
+#ifndef MUTEX_STATS_MAX_MUTEXES
+#define MUTEX_STATS_MAX_MUTEXES 32
+#endif
+
+/** Length of a mutex or task name, as configMAX_TASK_NAME_LEN */
+#define MUTEX_STATS_NAME_LEN 16
+
+/** The counts of a mutex */
+struct mutex_stats_entry {
+	/** Name it was created with, "-" if it has none */
+	char name[MUTEX_STATS_NAME_LEN];
+	/** Task holding it, empty if it is free */
+	char owner[MUTEX_STATS_NAME_LEN];
+	/** Takes that got it */
+	uint32_t takes;
+	/** Takes that found it held, whether or not they got it later */
+	uint32_t contended;
+	/** Takes that gave up or did not wait */
+	uint32_t timeouts;
+	/** Waits on a holder of a lower priority */
+	uint32_t inversions;
+	/** Time spent blocked on it by all the takes, in milliseconds */
+	uint32_t wait_ms;
+	/** Longest time a take was blocked, in milliseconds */
+	uint32_t max_wait_ms;
+};
+
+/** Get the counts of the mutexes
+ *
+ * \param[out] entries The counts, the most recently created mutex first
+ * \param[in] max Entries there is room for
+ *
+ * \return The number of entries filled in, 0 without FREERTOS_MUTEX_STATS
+ */
+int mutex_stats_get(struct mutex_stats_entry *entries, int max);
+
+/** Get the counts of a mutex by name
+ *
+ * \param[in] name Name of the mutex, the most recently created one if
+ * several have it
+ * \param[out] entry The counts
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if there is no such mutex or -WM_E_NOMEM
+ */
+int mutex_stats_find(const char *name, struct mutex_stats_entry *entry);
+
+/** Clear the counts of all the mutexes */
+void mutex_stats_reset(void);
+
+/** Print the counts of all the mutexes to the console */
+void mutex_stats_print(void);
+
+/** Register the "mutex-stats [reset]" cli command
+ *
+ * \return WM_SUCCESS or -WM_FAIL
+ */
+int mutex_stats_cli_init(void);
+
+#endif /* _MUTEX_STATS_H_ */
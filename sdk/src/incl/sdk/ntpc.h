@@ -0,0 +1,85 @@
+/*! \file ntpc.h
+ * \brief NTP client
+ *
+ * Sets the system time, see wmtime.h, from several NTP servers at once.
+ * TLS needs the time before the first connection, so the servers are all
+ * queried together on one UDP socket, instead of one after the other, and
+ * the sync completes as soon as enough of them agree rather than after a
+ * fixed number of exchanges.
+ *
+ * Every reply gives the offset of the local clock and the round trip
+ * delay of the exchange. The reply with the shortest delay is the most
+ * accurate one, its error is at most half its delay. The sync is done when
+ * NTPC_QUORUM replies agree with it, within their own delays, or when all
+ * the servers replied. A server whose reply does not agree is ignored.
+ *
+ * @code
+ * static const char *servers[] = {
+ *	"0.pool.ntp.org", "1.pool.ntp.org", "2.pool.ntp.org",
+ * };
+ *
+ * if (ntpc_sync(servers, 3, 3000, NULL) != WM_SUCCESS)
+ *	wmprintf("No time from NTP\r\n");
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _NTPC_H_
+#define _NTPC_H_
+
+#include <stdint.h>
+
+/** Servers queried by one sync, the others are ignored */
+#ifndef NTPC_MAX_SERVERS
+#define NTPC_MAX_SERVERS 4
+#endif
+
+/** Replies that have to agree to complete the sync */
+#ifndef NTPC_QUORUM
+#define NTPC_QUORUM 2
+#endif
+
+/** Result of a sync */
+struct ntpc_result {
+	/** Time added to the system clock, in ms */
+	int32_t offset_ms;
+	/** Round trip delay of the reply the time was taken from, in ms */
+	uint32_t delay_ms;
+	/** Servers which replied */
+	int replies;
+	/** Replies which agree with the time set */
+	int agree;
+	/** Time the sync took, in ms */
+	uint32_t took_ms;
+	/** Time set, in ms since 1970, as ntpc_sync() returns */
+	int64_t time_ms;
+};
+
+/** Set the system time from NTP servers
+ *
+ * The names are resolved, the ones which can not be are skipped, and a
+ * request sent to every server. Servers which did not reply by half the
+ * timeout are sent a second request. When the timeout expires without a
+ * quorum, the time is still set from the reply with the shortest delay.
+ *
+ * Only one sync runs at a time, the receive buffer is static.
+ *
+ * \param[in] servers Names or dotted addresses of the servers
+ * \param[in] count Number of servers, at most NTPC_MAX_SERVERS are used
+ * \param[in] timeout_ms Most time the sync takes
+ * \param[out] res Result of the sync, can be NULL
+ *
+ * \return WM_SUCCESS if the time was set
+ * \return -WM_E_INVAL if there is no server
+ * \return -WM_E_NOENT if no server name could be resolved
+ * \return -WM_E_TIMEOUT if no server replied
+ * \return -WM_FAIL if the socket could not be opened
+ */
+int ntpc_sync(const char *const servers[], int count, uint32_t timeout_ms,
+	      struct ntpc_result *res);
+
+#endif /* _NTPC_H_ */
@@ -0,0 +1,159 @@
+/*! \file ota.h
+ * \brief Streaming firmware update
+ *
+ * Writes a firmware image to the passive firmware partition as it is
+ * received, over whatever connection the application holds: the payloads
+ * of an MQTT topic, the body of an HTTPS response. Every chunk given to
+ * ota_write() is decrypted with ChaCha20, decompressed from XZ and hashed
+ * with SHA-256 on the spot, into one of two sector buffers. A full buffer is
+ * queued to the flash thread, see flash_async.h, and the next chunk is
+ * processed while it is erased and written, so the update is done in one
+ * pass with a few KB of RAM whatever the size of the image.
+ *
+ * ota_finish() waits for the last writes and checks the digest of the
+ * image written against the one expected before the partition is made
+ * active, the new firmware runs from the next reset. The digest has to
+ * come from a trusted source, e.g. the job document received over the TLS
+ * connection to AWS IoT.
+ *
+ * @code
+ * static const struct ota_cfg cfg = {
+ *	.sha256 = job_digest,
+ *	.key = fw_key,
+ *	.nonce = job_nonce,
+ *	.xz = true,
+ * };
+ *
+ * ota_begin(&cfg);
+ *
+ * in the MQTT message handler of the image topic:
+ *
+ *	if (ota_write(params->pPayload, params->PayloadLen) != WM_SUCCESS)
+ *		ota_abort();
+ *
+ * and after the last chunk:
+ *
+ *	if (ota_finish() == WM_SUCCESS)
+ *		NVIC_SystemReset();
+ * @endcode
+ *
+ * A delta update sends a patch instead of the image, made with
+ * sdk/tools/bin/fw_delta.py from the image the device runs and the new one.
+ * The new image is rebuilt from the active firmware partition and the
+ * patch as it comes, a few hundred bytes of the old image at a time, so
+ * only the changes are transferred. The patch is encrypted and compressed
+ * like an image, and the digest is still the one of the new image.
+ *
+ * One update runs at a time. The functions are called from one thread.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _OTA_H_
+#define _OTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Size of each of the two buffers of the image written to flash */
+#define OTA_BUF_SIZE 4096
+
+/** Largest XZ dictionary accepted, see xz --lzma2=dict= */
+#ifndef OTA_XZ_DICT_MAX
+#define OTA_XZ_DICT_MAX (32 * 1024)
+#endif
+
+/** Name of the firmware partitions in the partition table */
+#ifndef OTA_FW_PART
+#define OTA_FW_PART "mcufw"
+#endif
+
+/** Length of the SHA-256 digest */
+#define OTA_SHA256_LEN 32
+/** Length of the ChaCha20 key */
+#define OTA_KEY_LEN 32
+/** Length of the ChaCha20 nonce, as in RFC 7539 */
+#define OTA_NONCE_LEN 12
+
+/** Update configuration */
+struct ota_cfg {
+	/** SHA-256 of the image as written, after decryption and
+	 * decompression */
+	const uint8_t *sha256;
+	/** ChaCha20 key of the stream, NULL if it is not encrypted */
+	const uint8_t *key;
+	/** ChaCha20 nonce, the block counter starts at 0 */
+	const uint8_t *nonce;
+	/** The stream, decrypted, is XZ compressed */
+	bool xz;
+	/** The stream, decrypted and decompressed, is a patch of fw_delta.py
+	 * to the active firmware */
+	bool delta;
+};
+
+/** Update progress */
+struct ota_stats {
+	/** Bytes given to ota_write() */
+	uint32_t received;
+	/** Bytes of the image written */
+	uint32_t written;
+	/** Time since ota_begin(), in ms */
+	uint32_t took_ms;
+};
+
+/** Start an update
+ *
+ * Starts the flash thread, flash_drv_init() has to be called before.
+ *
+ * \param[in] cfg Configuration, copied
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the configuration is not valid
+ * \return -WM_E_BUSY if an update is in progress
+ * \return -WM_E_NOENT if there is no passive firmware partition, or no
+ * active one for a delta update
+ * \return -WM_E_NOMEM if the XZ decoder can not be allocated
+ * \return -WM_FAIL if the flash can not be opened
+ */
+int ota_begin(const struct ota_cfg *cfg);
+
+/** Add the next chunk of the stream
+ *
+ * Returns once the chunk is processed, possibly before it is in flash.
+ * Waits when both buffers are being written.
+ *
+ * \param[in] data Chunk, not used after the call returns
+ * \param[in] len Length of the chunk
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_NOSPC if the image does not fit the partition
+ * \return -WM_E_INVAL if the XZ stream or the patch is corrupt
+ * \return -WM_FAIL if no update is in progress or a flash write failed
+ */
+int ota_write(const uint8_t *data, uint32_t len);
+
+/** Complete the update
+ *
+ * Writes the rest of the image, checks its digest and makes the partition
+ * active. The update is over whatever the result.
+ *
+ * \return WM_SUCCESS if the image will be booted at the next reset
+ * \return -WM_E_INVAL if the XZ stream or the patch is truncated
+ * \return -WM_E_CRC if the digest does not match
+ * \return -WM_FAIL on flash errors or if no update is in progress
+ */
+int ota_finish(void);
+
+/** Drop the update in progress, the active firmware is left as it is */
+void ota_abort(void);
+
+/** Get the progress of the update in progress or the last one
+ *
+ * \param[out] stats Progress
+ */
+void ota_get_stats(struct ota_stats *stats);
+
+#endif /* _OTA_H_ */
@@ -0,0 +1,100 @@
+/*! \file profiler.h
+ * \brief Statistical PC sampling profiler
+ *
+ * A GPT timer interrupts the CPU at a fixed interval and the address the
+ * interrupted thread was running is counted in a table in RAM. After a run
+ * under the load of interest the table is dumped on the console and
+ * sdk/tools/bin/prof_report.py turns it into the share of the samples of
+ * every function, looked up in the .axf of the application.
+ *
+ * Only the code of threads is sampled. A sample that interrupts another
+ * interrupt is counted apart, the code of interrupts shows as that count.
+ * The idle task is a thread, the time spent in it shows as its functions.
+ *
+ * The profiler is built with CONFIG_PROFILER. The table holds
+ * CONFIG_PROFILER_FUNCTION_CNT addresses, samples of new addresses once it
+ * is full are only counted as dropped. Addresses are kept at a granule of
+ * 1 << PROFILER_ADDR_SHIFT bytes so that the table holds more code.
+ *
+ * @code
+ * profiler_cli_init();
+ * ...
+ * # profiler start 1000
+ * # profiler stop
+ * # profiler dump
+ * @endcode
+ *
+ * and on the host, with the console output saved in console.log:
+ *
+ * @code
+ * $ sdk/tools/bin/prof_report.py bin/mw300_rd/app.axf console.log
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdint.h>
+
+/** GPT the profiler uses, GPT0 may be used by the FreeRTOS run time stats */
+#ifndef PROFILER_GPT_ID
+#define PROFILER_GPT_ID GPT3_ID
+#endif
+
+/** Sampling interval profiler_start() uses when given 0 */
+#define PROFILER_DEFAULT_INTERVAL_US 1000
+
+/** log2 of the bytes of code an entry of the table counts for */
+#ifndef PROFILER_ADDR_SHIFT
+#define PROFILER_ADDR_SHIFT 2
+#endif
+
+/** Start sampling
+ *
+ * Samples are added to the ones of the previous runs until
+ * profiler_reset().
+ *
+ * \param[in] interval_us Time between two samples, 0 for
+ * PROFILER_DEFAULT_INTERVAL_US
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the profiler is already running
+ * \return -WM_FAIL if the GPT can not be opened
+ */
+int profiler_start(uint32_t interval_us);
+
+/** Stop sampling
+ *
+ * Must not be called from an interrupt.
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the profiler is not running
+ */
+int profiler_stop(void);
+
+/** Forget the samples taken so far */
+void profiler_reset(void);
+
+/** Print the samples on the console
+ *
+ * One line per address, "prof 0x<address> <samples>", after a line with
+ * the totals. This is what prof_report.py reads.
+ */
+void profiler_dump(void);
+
+/** Register the profiler cli commands
+ *
+ * "profiler start [interval_us]", "profiler stop", "profiler reset" and
+ * "profiler dump".
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_FAIL if the commands could not be registered
+ */
+int profiler_cli_init(void);
+
+#endif /* _PROFILER_H_ */
@@ -0,0 +1,95 @@
+/*! \file rand_pool.h
+ * \brief A pool of random words filled in the background from noise sources
+ *
+ * get_random_sequence() mixes the output of the handlers registered with
+ * random_register_handler() into every sequence it returns. A handler that
+ * reads a noise source, such as ADC samples of DAC noise or the radio,
+ * takes long, and TLS handshakes and tokens wait for it each time they
+ * need random bytes.
+ *
+ * This module reads the noise sources from a low priority thread instead,
+ * mixes them into words and keeps a pool of them full. It registers its own
+ * handler with random_register_handler(), which takes a word from the pool,
+ * so get_random_sequence() does not wait on the hardware any more. The slow
+ * handlers are added here with rand_pool_add_source() rather than
+ * registered with get_random_sequence().
+ *
+ * A word is only handed out once. When the pool runs dry, e.g. on a burst
+ * of handshakes right after boot, the handler reads the sources itself, as
+ * before, and counts a starvation. The thread refills the pool once it is
+ * half empty, and at the interval given to rand_pool_start() so that idle
+ * pools are mixed with fresh noise.
+ *
+ * The sources are read from the thread of the module, and from the thread
+ * that calls get_random_sequence() on a starvation, they have to allow
+ * this. Without a source sample_initialise_random_seed() is used.
+ *
+ * @code
+ * rand_pool_add_source(sample_initialise_random_seed);
+ * rand_pool_start(10000);
+ * ...
+ * get_random_sequence(nonce, sizeof(nonce));
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _RAND_POOL_H_
+#define _RAND_POOL_H_
+
+#include <stdint.h>
+#include <wm_utils.h>
+
+/** Words of the pool */
+#define RAND_POOL_WORDS 64
+
+/** Noise sources that can be added */
+#define RAND_POOL_MAX_SOURCES 4
+
+/** Counters of the pool */
+struct rand_pool_stats {
+	/** Words handed out from the pool */
+	uint32_t served;
+	/** Words read from the sources because the pool was empty */
+	uint32_t starved;
+	/** Words put in the pool */
+	uint32_t filled;
+};
+
+/** Add a noise source
+ *
+ * \param[in] src Function returning a word with some entropy
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_E_NOSPC
+ */
+int rand_pool_add_source(random_hdlr_t src);
+
+/** Fill the pool and hand it to get_random_sequence()
+ *
+ * Fills the pool once before returning, so that the first handshakes find
+ * it full.
+ *
+ * \param[in] refill_ms Interval at which the thread mixes new noise into a
+ * full pool, 0 to only refill it when it is half empty
+ *
+ * \return WM_SUCCESS or -WM_FAIL if the thread could not be created or the
+ * handler not registered
+ */
+int rand_pool_start(uint32_t refill_ms);
+
+/** Unregister the handler, the thread is left waiting */
+void rand_pool_stop(void);
+
+/** Take a word from the pool, the handler given to get_random_sequence()
+ *
+ * Reads the sources when the pool is empty.
+ */
+uint32_t rand_pool_word(void);
+
+/** Counters since the start */
+void rand_pool_get_stats(struct rand_pool_stats *stats);
+
+#endif /* _RAND_POOL_H_ */
@@ -0,0 +1,106 @@
+/*! \file rwlock.h
+ * \brief Reader-writer lock for read mostly data, without kernel calls
+ *
+ * os_rwlock_read_lock() of \ref wm_os.h takes a mutex and, for the first
+ * reader, a semaphore, so every read of a table costs kernel calls even
+ * when no one writes. The lock here is a word updated with exclusive loads
+ * and stores: taking and releasing it for reading is a few instructions as
+ * long as no writer holds or waits for it, and a writer that finds it free
+ * takes it the same way. Tasks only block on semaphores when they have to
+ * wait.
+ *
+ * Writers are preferred: once a writer waits, new readers wait too, so a
+ * steady stream of readers can not hold a writer off.
+ *
+ * The calls are those of the os_rwlock_*() ones, with the same timeouts and
+ * return values. It is not recursive, a task holding it for reading must
+ * not take it again while a writer may be waiting. It is not for
+ * interrupts.
+ *
+ * @code
+ * static rwlock_t route_lock;
+ *
+ * rwlock_create(&route_lock, "routes");
+ *
+ * rwlock_read_lock(&route_lock, OS_WAIT_FOREVER);
+ * gw = route_lookup(dest);
+ * rwlock_read_unlock(&route_lock);
+ *
+ * rwlock_write_lock(&route_lock, OS_WAIT_FOREVER);
+ * route_add(dest, gw);
+ * rwlock_write_unlock(&route_lock);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _RWLOCK_H_
+#define _RWLOCK_H_
+
+#include <stdint.h>
+#include <wm_os.h>
+
+/** A reader-writer lock, the fields are private */
+typedef struct {
+	/* Readers inside and the writer bits, see rwlock.c */
+	volatile uint32_t state;
+	/* Tasks blocked, changed in critical sections only */
+	uint16_t readers_waiting;
+	uint16_t writers_waiting;
+	os_semaphore_t read_sem;
+	os_semaphore_t write_sem;
+} rwlock_t;
+
+/** Create a reader-writer lock
+ *
+ * \param[out] lock The lock
+ * \param[in] name Name of its semaphores
+ *
+ * \return WM_SUCCESS or -WM_FAIL if the semaphores could not be created
+ */
+int rwlock_create(rwlock_t *lock, const char *name);
+
+/** Delete a reader-writer lock, no one may hold or wait for it
+ *
+ * \param[in] lock The lock
+ */
+void rwlock_delete(rwlock_t *lock);
+
+/** Take the lock for reading
+ *
+ * \param[in] lock The lock
+ * \param[in] wait_time Longest time to wait in OS ticks, or
+ * \ref OS_WAIT_FOREVER or \ref OS_NO_WAIT
+ *
+ * \return WM_SUCCESS or -WM_FAIL on timeout
+ */
+int rwlock_read_lock(rwlock_t *lock, unsigned int wait_time);
+
+/** Release the lock taken with rwlock_read_lock()
+ *
+ * \param[in] lock The lock
+ *
+ * \return WM_SUCCESS or -WM_FAIL if no reader held it
+ */
+int rwlock_read_unlock(rwlock_t *lock);
+
+/** Take the lock for writing
+ *
+ * \param[in] lock The lock
+ * \param[in] wait_time Longest time to wait in OS ticks, or
+ * \ref OS_WAIT_FOREVER or \ref OS_NO_WAIT
+ *
+ * \return WM_SUCCESS or -WM_FAIL on timeout
+ */
+int rwlock_write_lock(rwlock_t *lock, unsigned int wait_time);
+
+/** Release the lock taken with rwlock_write_lock()
+ *
+ * \param[in] lock The lock
+ */
+void rwlock_write_unlock(rwlock_t *lock);
+
+#endif /* _RWLOCK_H_ */
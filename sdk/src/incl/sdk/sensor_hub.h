@@ -0,0 +1,201 @@
+/*! \file sensor_hub.h
+ * \brief Scheduled register reads of many sensors into timestamped rings
+ *
+ * A sensor driver usually owns a thread that sleeps, reads its registers
+ * with blocking bus calls and keeps the values somewhere of its own. With
+ * several sensors on a board that is a thread, a stack and a timing
+ * error per sensor, and reads of sensors on one bus that wait on each
+ * other.
+ *
+ * Here a sensor is described by data: its bus, port and address, the
+ * register writes that set it up, the registers a sample is read from and
+ * its sample period. One general purpose timer (GPT) interrupt schedules
+ * all of them. On every tick the reads that are due are queued on their
+ * bus, the I2C ones with i2c_xfer.h and the SPI ones with ssp_dma.h, so the
+ * reads of a bus that fall on the same tick run back to back as DMA
+ * transactions, each started from the interrupt that ends the previous
+ * one. No thread takes part until the samples are consumed.
+ *
+ * A sample is the raw bytes of the registers with the time it was
+ * scheduled at, in microseconds of the hub clock. The time is that of the
+ * tick, not of the end of the read, so samples of a sensor are spaced by
+ * exactly its period whatever else was on the bus. Samples go to a ring of
+ * the sensor, which its consumer, e.g. a batching or DSP stage, reads or
+ * waits on. A sample that finds the ring full is dropped and counted.
+ *
+ * A sensor that is still being read when its next read is due skips that
+ * read, counted as an overrun, its bus is too busy for the periods asked.
+ *
+ * The ports have to be taken over with i2c_xfer_init() or ssp_dma_init()
+ * before a sensor on them is added. The sensors on an SSP port share its
+ * chip select, so there can only be one on each SSP port.
+ *
+ * @code
+ * static const struct sensor_reg_write acc_init[] = {
+ *	{ MMA7660_MODE, MMA7660_STAND_BY },
+ *	{ MMA7660_SR, AUTO_SLEEP_120 },
+ *	{ MMA7660_MODE, MMA7660_ACTIVE },
+ * };
+ * static const sensor_desc_t acc_desc = {
+ *	.name = "acc",
+ *	.bus = SENSOR_BUS_I2C,
+ *	.port = I2C0_PORT,
+ *	.addr = MMA7660_ADDR,
+ *	.init = acc_init,
+ *	.n_init = 3,
+ *	.reg = MMA7660_X,
+ *	.len = 3,
+ *	.period_us = 10000,
+ * };
+ * static sensor_t acc;
+ * static sensor_sample_t acc_ring[64];
+ *
+ * i2c_xfer_init(i2c0, I2C0_PORT);
+ * sensor_hub_init(GPT2_ID, 1000);
+ * sensor_hub_add(&acc, &acc_desc, acc_ring, 64);
+ * ...
+ * while (1) {
+ *	sensor_hub_wait(&acc, OS_WAIT_FOREVER);
+ *	n = sensor_hub_read(&acc, samples, 16);
+ *	...
+ * }
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _SENSOR_HUB_H_
+#define _SENSOR_HUB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wm_os.h>
+#include <lowlevel_drivers.h>
+#include <i2c_xfer.h>
+#include <ssp_dma.h>
+
+/** Bytes of a sample */
+#define SENSOR_HUB_MAX_SAMPLE 12
+
+/** Bus of a sensor */
+enum sensor_bus {
+	SENSOR_BUS_I2C,
+	SENSOR_BUS_SPI,
+};
+
+/** A register write of the set up of a sensor */
+struct sensor_reg_write {
+	/** Register, or the SPI command byte of the write */
+	uint8_t reg;
+	uint8_t val;
+};
+
+/** Description of a sensor, it stays in place while the sensor is added */
+typedef struct sensor_desc {
+	/** Name, for the logs */
+	const char *name;
+	enum sensor_bus bus;
+	/** I2C_ID_Type or SSP_ID_Type */
+	int port;
+	/** 7-bit I2C address, not used on SPI */
+	uint16_t addr;
+	/** Register writes done when the sensor is added, can be NULL */
+	const struct sensor_reg_write *init;
+	/** Number of register writes */
+	uint8_t n_init;
+	/** First register of a sample, or the SPI command byte that reads
+	 * it, with the read bit the sensor wants */
+	uint8_t reg;
+	/** Bytes of a sample, up to SENSOR_HUB_MAX_SAMPLE */
+	uint8_t len;
+	/** Sample period, rounded to whole ticks of the hub */
+	uint32_t period_us;
+} sensor_desc_t;
+
+/** A sample */
+typedef struct sensor_sample {
+	/** Time it was scheduled at, microseconds of sensor_hub_now_us(),
+	 * which wraps every 71 minutes */
+	uint32_t ts_us;
+	/** Registers as read, the first len bytes */
+	uint8_t data[SENSOR_HUB_MAX_SAMPLE];
+} sensor_sample_t;
+
+/** A sensor, it belongs to the caller and stays in place while added */
+typedef struct sensor {
+	const sensor_desc_t *desc;
+	/** Samples not read yet */
+	os_ringbuf_t ring;
+	/** Samples dropped because the ring was full */
+	volatile uint32_t dropped;
+	/** Reads skipped because the previous one was not done */
+	volatile uint32_t overruns;
+	/** Reads that failed on the bus */
+	volatile uint32_t errors;
+	/* Used by sensor_hub */
+	uint32_t period_ticks;
+	uint32_t next_tick;
+	uint32_t ts_us;
+	volatile bool busy;
+	uint8_t raw[SENSOR_HUB_MAX_SAMPLE];
+	union {
+		i2c_xfer_t i2c;
+		ssp_dma_xfer_t spi[2];
+	} xfer;
+	struct sensor *next;
+} sensor_t;
+
+/** Start the scheduler
+ *
+ * \param[in] gpt The GPT whose interrupt schedules the reads, it is not
+ * available to others until sensor_hub_deinit()
+ * \param[in] tick_us Resolution of the sample periods, the interrupt runs
+ * at this interval
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_FAIL if the GPT can not be
+ * started
+ */
+int sensor_hub_init(GPT_ID_Type gpt, uint32_t tick_us);
+
+/** Stop the scheduler, the sensors have to be removed first */
+void sensor_hub_deinit(void);
+
+/** Set up a sensor and schedule its reads
+ *
+ * Does the register writes of the description, waiting for each, so it
+ * can only be called from a thread, and from one thread at a time. The
+ * first read is one period later.
+ *
+ * \param[in] s Sensor, not added
+ * \param[in] desc Description
+ * \param[in] ring Storage of the ring of samples
+ * \param[in] ring_size Samples of the ring, a power of two
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_FAIL if a register write failed
+ */
+int sensor_hub_add(sensor_t *s, const sensor_desc_t *desc,
+		   sensor_sample_t *ring, uint32_t ring_size);
+
+/** Stop the reads of a sensor, waiting for the one under way */
+void sensor_hub_remove(sensor_t *s);
+
+/** Take samples, oldest first
+ *
+ * \return Number of samples taken, up to max
+ */
+uint32_t sensor_hub_read(sensor_t *s, sensor_sample_t *samples,
+			 uint32_t max);
+
+/** Wait for a sample, only one thread can wait on a sensor
+ *
+ * \return WM_SUCCESS once there is one, -WM_FAIL on timeout
+ */
+int sensor_hub_wait(sensor_t *s, unsigned long wait_ticks);
+
+/** Time of the hub clock, in microseconds, counted in ticks */
+uint32_t sensor_hub_now_us(void);
+
+#endif /* _SENSOR_HUB_H_ */
@@ -0,0 +1,59 @@
+/*! \file sha256.h
+ * \brief SHA-256, FIPS 180-4, on the core
+ *
+ * For digests of data that has to be recognized again, an image or a
+ * certificate chain, where a CRC could be forged.
+ *
+ * @code
+ * struct sha256_ctx s;
+ * uint8_t digest[SHA256_LEN];
+ *
+ * sha256_init(&s);
+ * while ((len = read_chunk(buf, sizeof(buf))) > 0)
+ *	sha256_update(&s, buf, len);
+ * sha256_final(&s, digest);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+
+/** Length of the digest */
+#define SHA256_LEN 32
+
+/** State of a digest */
+struct sha256_ctx {
+	uint32_t h[8];
+	uint64_t len;
+	uint8_t block[64];
+};
+
+/** Start a digest
+ *
+ * \param[out] s The state
+ */
+void sha256_init(struct sha256_ctx *s);
+
+/** Add data to a digest
+ *
+ * \param[in,out] s The state
+ * \param[in] p The data
+ * \param[in] len Its length
+ */
+void sha256_update(struct sha256_ctx *s, const uint8_t *p, uint32_t len);
+
+/** End a digest
+ *
+ * \param[in,out] s The state, to be started again before more data
+ * \param[out] digest SHA256_LEN bytes
+ */
+void sha256_final(struct sha256_ctx *s, uint8_t *digest);
+
+#endif /* ! _SHA256_H_ */
@@ -0,0 +1,256 @@
+/*! \file sig_feat.h
+ * \brief Features of sensor sample streams
+ *
+ * Reduces blocks of samples, e.g. from the DMA ADC stream or the
+ * accelerometer, to the few numbers the cloud needs: mean, RMS, minimum,
+ * maximum, threshold crossings and the energy in frequency bands. A device
+ * then publishes a handful of numbers per window instead of every sample.
+ *
+ * Samples are 16 bit signed, the kernels are fixed point and use the DSP
+ * instructions of the Cortex-M4: two 16 bit multiply-accumulates per
+ * instruction for the sums and the FIR filter, packed halving adds and
+ * subtracts for the FFT butterflies. Floating point is only used to set up
+ * the tables.
+ *
+ * A pipeline puts it together: it low pass filters and decimates the
+ * samples pushed into it, collects them in FFT frames that overlap by
+ * frame length - hop samples, and calls back with the features of every
+ * frame. Nothing is allocated, the caller supplies the buffers.
+ *
+ * @code
+ * #define N 256
+ *
+ * static int16_t twiddle[N], window[N / 2], frame[N], work[2 * N];
+ * static uint32_t power[N / 2];
+ * static int16_t coeffs[16], state[2 * 16];
+ * static const uint16_t edges[] = {1, 8, 32, 128};
+ * static sig_feat_fft_t fft;
+ * static sig_feat_decim_t decim;
+ * static sig_feat_pipe_t pipe;
+ *
+ * static void features(const sig_feat_result_t *r, void *arg)
+ * {
+ *	// publish r->stats.rms, r->band[0..2], ...
+ * }
+ *
+ * sig_feat_fft_init(&fft, N, twiddle, window);
+ * sig_feat_lowpass(coeffs, 16, 2);
+ * sig_feat_decim_init(&decim, coeffs, 16, 2, state);
+ * sig_feat_pipe_cfg_t cfg = {
+ *	.fft = &fft, .decim = &decim, .frame = frame, .work = work,
+ *	.power = power, .edges = edges, .nbands = 3, .hop = N / 2,
+ *	.cb = features,
+ * };
+ * sig_feat_pipe_init(&pipe, &cfg);
+ *
+ * // For every block of samples
+ * sig_feat_pipe_push(&pipe, block, num);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _SIG_FEAT_H_
+#define _SIG_FEAT_H_
+
+#include <stdint.h>
+
+/** Shortest FFT */
+#define SIG_FEAT_FFT_MIN_LEN 16
+/** Longest FFT */
+#define SIG_FEAT_FFT_MAX_LEN 4096
+/** Most frequency bands of a result */
+#define SIG_FEAT_MAX_BANDS 8
+
+/** Statistics of a block of samples */
+typedef struct {
+	/** Mean, rounded towards minus infinity */
+	int16_t mean;
+	/** Root mean square around the mean, the standard deviation */
+	uint16_t rms;
+	int16_t min;
+	int16_t max;
+	/** Times the samples went from below the threshold to at least it */
+	uint16_t crossings;
+} sig_feat_stats_t;
+
+/** Tables of an FFT, set up with sig_feat_fft_init() */
+typedef struct {
+	/** Length, a power of two */
+	uint16_t n;
+	uint8_t log2n;
+	/** n / 2 twiddle factors, cos and sin packed in a word each */
+	const int16_t *twiddle;
+	/** First half of the Hann window, it is symmetric */
+	const int16_t *window;
+} sig_feat_fft_t;
+
+/** FIR low pass and decimation, set up with sig_feat_decim_init() */
+typedef struct {
+	const int16_t *coeffs;
+	/** The last num_taps samples, twice, so that they are in one piece */
+	int16_t *state;
+	uint16_t num_taps;
+	uint16_t pos;
+	uint8_t factor;
+	uint8_t phase;
+} sig_feat_decim_t;
+
+/** Features of a frame */
+typedef struct {
+	sig_feat_stats_t stats;
+	/** Bin of the largest power, the DC bin left out */
+	uint16_t peak_bin;
+	uint8_t nbands;
+	/** Sum of the power of the bins of each band */
+	uint32_t band[SIG_FEAT_MAX_BANDS];
+} sig_feat_result_t;
+
+/** Pipeline callback, called from sig_feat_pipe_push()
+ *
+ * \param[in] r Features of the frame
+ * \param[in] arg Argument of the pipeline
+ */
+typedef void (*sig_feat_cb_t)(const sig_feat_result_t *r, void *arg);
+
+/** Configuration of a pipeline */
+typedef struct {
+	/** FFT, its length is the frame length */
+	const sig_feat_fft_t *fft;
+	/** Decimation ahead of the frames, NULL for none */
+	sig_feat_decim_t *decim;
+	/** Frame, fft->n samples */
+	int16_t *frame;
+	/** 2 * fft->n samples of work space */
+	int16_t *work;
+	/** fft->n / 2 bins of power */
+	uint32_t *power;
+	/** nbands + 1 bins, band i is the bins edges[i] up to edges[i + 1] */
+	const uint16_t *edges;
+	uint8_t nbands;
+	/** Threshold the crossings are counted at */
+	int16_t threshold;
+	/** Samples between frames, from 1 to fft->n */
+	uint16_t hop;
+	sig_feat_cb_t cb;
+	void *arg;
+} sig_feat_pipe_cfg_t;
+
+/** A pipeline, set up with sig_feat_pipe_init() */
+typedef struct {
+	sig_feat_pipe_cfg_t cfg;
+	/** Samples in the frame */
+	uint16_t fill;
+} sig_feat_pipe_t;
+
+/** Get the statistics of a block of samples
+ *
+ * \param[in] x Samples
+ * \param[in] n Number of samples, at least 1
+ * \param[in] threshold Threshold the crossings are counted at
+ * \param[out] st Statistics
+ */
+void sig_feat_stats(const int16_t *x, int n, int16_t threshold,
+		    sig_feat_stats_t *st);
+
+/** Set up an FFT
+ *
+ * \param[out] f The FFT
+ * \param[in] n Length, a power of two from SIG_FEAT_FFT_MIN_LEN to
+ * SIG_FEAT_FFT_MAX_LEN
+ * \param[out] twiddle Table of n samples
+ * \param[out] window Table of n / 2 samples
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int sig_feat_fft_init(sig_feat_fft_t *f, int n, int16_t *twiddle,
+		      int16_t *window);
+
+/** Get the power spectrum of a block of samples
+ *
+ * The samples are Hann windowed. The FFT halves its values at every stage
+ * so that they can not overflow, the spectrum is that of the samples
+ * divided by 2 * n, squared.
+ *
+ * \param[in] f The FFT
+ * \param[in] x n samples
+ * \param[out] work 2 * n samples, the complex spectrum
+ * \param[out] power n / 2 bins, bin k is k / n of the sample rate
+ */
+void sig_feat_spectrum(const sig_feat_fft_t *f, const int16_t *x,
+		       int16_t *work, uint32_t *power);
+
+/** Sum the power of bins into bands
+ *
+ * \param[in] power Bins
+ * \param[in] bins Number of bins
+ * \param[in] edges nbands + 1 bins, band i is the bins edges[i] up to
+ * edges[i + 1], edges past the bins are cut
+ * \param[in] nbands Number of bands
+ * \param[out] band nbands sums, saturated at UINT32_MAX
+ */
+void sig_feat_bands(const uint32_t *power, int bins, const uint16_t *edges,
+		    int nbands, uint32_t *band);
+
+/** Design a low pass FIR filter for a decimation
+ *
+ * A Hamming windowed sinc that passes up to 0.8 of the Nyquist frequency
+ * after the decimation, with a gain of 1.
+ *
+ * \param[out] coeffs num_taps coefficients, symmetric
+ * \param[in] num_taps Number of taps, even
+ * \param[in] factor Decimation factor, at least 1
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int sig_feat_lowpass(int16_t *coeffs, int num_taps, int factor);
+
+/** Set up a decimation
+ *
+ * \param[out] d The decimation
+ * \param[in] coeffs num_taps coefficients, symmetric, e.g. from
+ * sig_feat_lowpass()
+ * \param[in] num_taps Number of taps, even
+ * \param[in] factor Decimation factor, from 1 to 255
+ * \param[out] state 2 * num_taps samples
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int sig_feat_decim_init(sig_feat_decim_t *d, const int16_t *coeffs,
+			int num_taps, int factor, int16_t *state);
+
+/** Filter and decimate samples
+ *
+ * \param[in] d The decimation
+ * \param[in] x Samples
+ * \param[in] n Number of samples
+ * \param[out] y At most n / factor + 1 samples
+ *
+ * \return Number of samples written to y
+ */
+int sig_feat_decimate(sig_feat_decim_t *d, const int16_t *x, int n,
+		      int16_t *y);
+
+/** Set up a pipeline
+ *
+ * \param[out] p The pipeline
+ * \param[in] cfg Configuration, copied
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int sig_feat_pipe_init(sig_feat_pipe_t *p, const sig_feat_pipe_cfg_t *cfg);
+
+/** Push samples into a pipeline
+ *
+ * Calls the callback for every frame completed.
+ *
+ * \param[in] p The pipeline
+ * \param[in] x Samples
+ * \param[in] n Number of samples
+ */
+void sig_feat_pipe_push(sig_feat_pipe_t *p, const int16_t *x, int n);
+
+#endif /* _SIG_FEAT_H_ */
@@ -0,0 +1,125 @@
+/*! \file ssp_dma.h
+ * \brief Queued full duplex SPI transfers with DMA
+ *
+ * ssp_drv_write() and ssp_drv_read() keep the calling thread for the whole
+ * transfer and go through the receive buffer of the driver. The functions
+ * here queue a transaction and return. Each transaction runs as two DMA
+ * requests of dma_svc.h, one feeding the transmit FIFO and one emptying
+ * the receive FIFO into the buffer of the caller, and the next transaction
+ * is started from the completion interrupt of the previous one, so the bus
+ * does not wait for a thread in between.
+ *
+ * The chip select is activated with ssp_drv_cs_activate() before a
+ * transaction and deactivated after it, unless cs_hold is set, so a
+ * command and its data can be queued as two transactions of one frame.
+ *
+ * The port has to be opened in master mode, with 8-bit frames, before
+ * ssp_dma_init(). ssp_drv_write() and ssp_drv_read() must not be used on
+ * it while transactions are queued.
+ *
+ * @code
+ * static void frame_done(int result, void *arg)
+ * {
+ *	os_semaphore_put(arg);
+ * }
+ *
+ * static ssp_dma_xfer_t cmd = {
+ *	.tx = cmd_buf,
+ *	.len = 1,
+ *	.cs_hold = true,
+ * };
+ * static ssp_dma_xfer_t data = {
+ *	.tx = pixels,
+ *	.len = sizeof(pixels),
+ *	.cb = frame_done,
+ *	.arg = &sem,
+ * };
+ *
+ * dev = ssp_drv_open(SSP1_ID, SSP_FRAME_SPI, SSP_MASTER, DMA_ENABLE, -1, 0);
+ * ssp_dma_init(dev, SSP1_ID);
+ * ssp_dma_submit(SSP1_ID, &cmd);
+ * ssp_dma_submit(SSP1_ID, &data);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _SSP_DMA_H_
+#define _SSP_DMA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mdev_ssp.h>
+#include <dma_svc.h>
+
+/** DMA blocks a transaction is split into at most */
+#define SSP_DMA_MAX_DESCS 4
+/** Largest transaction in bytes */
+#define SSP_DMA_MAX_LEN (SSP_DMA_MAX_DESCS * DMA_SVC_MAX_BLOCK)
+
+/** Completion of a transaction
+ *
+ * Called from the DMA interrupt, it must not block. It can submit again.
+ *
+ * \param[in] result WM_SUCCESS or -WM_FAIL on a DMA error
+ * \param[in] arg Argument of the transaction
+ */
+typedef void (*ssp_dma_cb_t)(int result, void *arg);
+
+/** Transaction */
+typedef struct ssp_dma_xfer {
+	/** Bytes sent, NULL sends SPI_DUMMY_WORD */
+	const uint8_t *tx;
+	/** Bytes received, NULL drops them */
+	uint8_t *rx;
+	/** Bytes each way, up to SSP_DMA_MAX_LEN */
+	uint32_t len;
+	/** Leave the chip select active for the next transaction */
+	bool cs_hold;
+	/** Completion, can be NULL */
+	ssp_dma_cb_t cb;
+	/** Argument of the callback */
+	void *arg;
+	/* Used by ssp_dma */
+	struct ssp_dma_xfer *next;
+} ssp_dma_xfer_t;
+
+/** Take over an opened port
+ *
+ * Starts the DMA service with two channels if it is not yet, a transaction
+ * needs both at once. Turns the DMA requests of the FIFOs on and the
+ * interrupts of the driver off.
+ *
+ * \param[in] dev Port opened by ssp_drv_open()
+ * \param[in] id Port
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL or -WM_FAIL if the DMA service has fewer
+ * than two channels
+ */
+int ssp_dma_init(mdev_t *dev, SSP_ID_Type id);
+
+/** Queue a transaction
+ *
+ * Transactions of a port run in the order they were submitted. The
+ * transaction and its buffers have to stay in place until the callback.
+ * Can be called from a thread or from a completion callback.
+ *
+ * \param[in] id Port
+ * \param[in] xfer Transaction, not already queued
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL
+ */
+int ssp_dma_submit(SSP_ID_Type id, ssp_dma_xfer_t *xfer);
+
+/** Check that the port has nothing queued
+ *
+ * \param[in] id Port
+ *
+ * \return true once the last transaction is done
+ */
+bool ssp_dma_idle(SSP_ID_Type id);
+
+#endif /* ! _SSP_DMA_H_ */
@@ -0,0 +1,101 @@
+/*! \file stack_mon.h
+ * \brief Stack high water monitoring of all the tasks
+ *
+ * A timer samples the least free stack every task had since it was
+ * created into a table, which stack_mon_get() copies out and
+ * stack_mon_json() writes as telemetry. A task that is deleted keeps its
+ * last sample in the table, marked as gone, so that short lived tasks are
+ * measured too.
+ *
+ * The stack a task was created with, less its least free stack and a
+ * margin, is what it can be shrunk by. The monitor warns once per task when
+ * its free stack gets below a threshold.
+ *
+ * @code
+ * stack_mon_start(10000, 128);
+ * ...
+ * json_writer_start_object(&w, "reported");
+ * stack_mon_json(&w, "stacks");
+ * json_writer_end_object(&w);
+ * @endcode
+ *
+ * gives
+ *
+ * @code
+ * "stacks":{"tcp/ip":212,"wlcmgr":548,"aws_starter_thread":6248}
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _STACK_MON_H_
+#define _STACK_MON_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <json_writer.h>
+
+/** Tasks the table holds, the ones beyond are not monitored */
+#ifndef STACK_MON_MAX_TASKS
+#define STACK_MON_MAX_TASKS 24
+#endif
+
+/** Length of a task name, as configMAX_TASK_NAME_LEN */
+#define STACK_MON_NAME_LEN 16
+
+/** A task of the table */
+struct stack_mon_entry {
+	char name[STACK_MON_NAME_LEN];
+	/** Least free stack since the task was created, in bytes */
+	uint32_t min_free;
+	uint8_t priority;
+	/** false once the task was deleted */
+	bool alive;
+};
+
+/** Start the monitor
+ *
+ * The first sample is taken at once.
+ *
+ * \param[in] interval_ms Time between two samples
+ * \param[in] warn_bytes Free stack below which a warning is logged, 0 for
+ * none
+ *
+ * \return WM_SUCCESS on success
+ * \return -WM_E_INVAL if the monitor is already running
+ * \return -WM_FAIL if the timer can not be created
+ */
+int stack_mon_start(uint32_t interval_ms, uint32_t warn_bytes);
+
+/** Stop the monitor, the table is kept */
+void stack_mon_stop(void);
+
+/** Sample the stacks now
+ *
+ * Also works with the monitor stopped.
+ */
+void stack_mon_sample(void);
+
+/** Copy the table
+ *
+ * \param[out] entries Array filled with the tasks
+ * \param[in] max Entries in the array
+ *
+ * \return Number of entries filled
+ */
+int stack_mon_get(struct stack_mon_entry *entries, int max);
+
+/** Write the table as an object of task names and least free bytes
+ *
+ * \param[in,out] w Writer
+ * \param[in] key Key of the object in the enclosing object, NULL in an array
+ * or at the top
+ *
+ * \return The status of the writer, see json_writer_start_object()
+ */
+int stack_mon_json(struct json_writer *w, const char *key);
+
+#endif /* _STACK_MON_H_ */
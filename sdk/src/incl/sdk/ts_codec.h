@@ -0,0 +1,147 @@
+/*! \file ts_codec.h
+ * \brief Compact encoding of batches of timestamped samples
+ *
+ * Sensor samples taken at a steady rate change little from one to the
+ * next. A sample is a timestamp and up to TS_CODEC_MAX_CHANNELS integer
+ * values. The encoder writes the first sample as it is. After that it
+ * writes the change in the time between two samples, 0 at a steady rate,
+ * and the change of every value since the previous sample. The numbers
+ * are zig-zag varints: -64 to 63 take one byte. A sample of three values
+ * taken on time, with each value changing by less than 64, takes 4 bytes.
+ *
+ * The blob starts with a 6 byte header: 'T', 'S', the version, the number
+ * of channels and the number of samples, 16 bit big endian. The first
+ * sample follows, its timestamp as a varint and its values as zig-zag
+ * varints. The second sample has the time since the first, the others the
+ * difference between their interval and the previous one, as zig-zag
+ * varints, followed by the change of each value, as zig-zag varints. A
+ * varint is 7 bits a byte, the lowest ones first, the top bit set on all
+ * bytes but the last. Zig-zag maps 0, -1, 1, -2... to 0, 1, 2, 3...
+ *
+ * The decoder reads a blob back, e.g. as a reference for the cloud side.
+ * Neither keeps more than the state structures the caller provides.
+ *
+ * @code
+ * struct ts_enc enc;
+ * int32_t v[3];
+ *
+ * ts_enc_init(&enc, buf, sizeof(buf), 3);
+ * for (i = 0; i < n; i++) {
+ *	v[0] = s[i].x; v[1] = s[i].y; v[2] = s[i].z;
+ *	if (ts_enc_add(&enc, s[i].t, v) != WM_SUCCESS)
+ *		break;
+ * }
+ * send(buf, ts_enc_finish(&enc));
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _TS_CODEC_H_
+#define _TS_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Version of the blobs written */
+#define TS_CODEC_VERSION 1
+/** Most values a sample has */
+#define TS_CODEC_MAX_CHANNELS 8
+/** Length of the header of a blob */
+#define TS_CODEC_HEADER_LEN 6
+/** Most samples a blob holds */
+#define TS_CODEC_MAX_SAMPLES 65535
+
+/** Size a blob of n samples of channels values can take at most */
+#define TS_CODEC_BOUND(channels, n) \
+	(TS_CODEC_HEADER_LEN + (n) * (5 + 5 * (channels)))
+
+/** State of an encoder */
+struct ts_enc {
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+	uint16_t n;
+	uint8_t channels;
+	uint32_t t;
+	uint32_t dt;
+	int32_t v[TS_CODEC_MAX_CHANNELS];
+};
+
+/** State of a decoder */
+struct ts_dec {
+	const uint8_t *p;
+	const uint8_t *end;
+	uint16_t n;
+	uint16_t i;
+	uint8_t channels;
+	uint32_t t;
+	uint32_t dt;
+	int32_t v[TS_CODEC_MAX_CHANNELS];
+};
+
+/** Start a blob
+ *
+ * \param[out] enc The encoder
+ * \param[out] buf Buffer of the blob
+ * \param[in] size Its size
+ * \param[in] channels Values of a sample, 1 to TS_CODEC_MAX_CHANNELS
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if channels is out of range or
+ * -WM_E_NOSPC if the header does not fit
+ */
+int ts_enc_init(struct ts_enc *enc, void *buf, size_t size, int channels);
+
+/** Add a sample to a blob
+ *
+ * The timestamps are in any unit and are expected to grow, they may wrap.
+ *
+ * \param[in] enc The encoder
+ * \param[in] t Timestamp of the sample
+ * \param[in] values Its values, as many as channels
+ *
+ * \return WM_SUCCESS, -WM_E_NOSPC if the sample does not fit or the blob
+ * holds TS_CODEC_MAX_SAMPLES, the blob is left as it was
+ */
+int ts_enc_add(struct ts_enc *enc, uint32_t t, const int32_t *values);
+
+/** Finish a blob
+ *
+ * \param[in] enc The encoder
+ *
+ * \return The length of the blob
+ */
+size_t ts_enc_finish(struct ts_enc *enc);
+
+/** Start reading a blob
+ *
+ * \param[out] dec The decoder
+ * \param[in] buf The blob
+ * \param[in] len Its length
+ *
+ * \return The number of channels or -WM_E_INVAL if buf is not a blob of
+ * this version
+ */
+int ts_dec_init(struct ts_dec *dec, const void *buf, size_t len);
+
+/** Number of samples of the blob being read */
+static inline int ts_dec_count(const struct ts_dec *dec)
+{
+	return dec->n;
+}
+
+/** Read the next sample of a blob
+ *
+ * \param[in] dec The decoder
+ * \param[out] t Timestamp of the sample
+ * \param[out] values Its values, room for as many as channels
+ *
+ * \return 1 for a sample, 0 after the last one or -WM_E_INVAL if the blob
+ * is cut short
+ */
+int ts_dec_next(struct ts_dec *dec, uint32_t *t, int32_t *values);
+
+#endif /* _TS_CODEC_H_ */
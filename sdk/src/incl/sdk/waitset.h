@@ -0,0 +1,183 @@
+/*! \file waitset.h
+ * \brief Wait on queues, semaphores and sockets in one blocking call
+ *
+ * A task serving several sources, e.g. an MQTT task that sends the
+ * messages queued by the application and handles the data coming from the
+ * broker, otherwise has to poll the queue with a short timeout between
+ * socket reads. A wait set groups the sources instead, waitset_wait()
+ * sleeps until any of them is ready and tells which one.
+ *
+ * Queues and semaphores are members of a FreeRTOS queue set. A socket
+ * gets a receive callback that marks it ready and gives a semaphore of the
+ * set, so data, a new connection or the peer closing wake the task. The
+ * sources are reported in the order they became ready.
+ *
+ * @code
+ * static waitset_t ws;
+ * waitset_event_t ev;
+ *
+ * waitset_create(&ws, OUTBOX_LEN);
+ * waitset_add_queue(&ws, &outbox);
+ * waitset_add_socket(&ws, sock);
+ *
+ * while (1) {
+ *	if (waitset_wait(&ws, &ev, os_msec_to_ticks(keepalive_ms)) !=
+ *	    WM_SUCCESS) {
+ *		send_ping();
+ *		continue;
+ *	}
+ *	if (ev.type == WAITSET_QUEUE) {
+ *		os_queue_recv(ev.queue, &msg, OS_NO_WAIT);
+ *		publish(&msg);
+ *	} else if (ev.type == WAITSET_SOCKET) {
+ *		read_socket(ev.sock);
+ *	}
+ * }
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _WAITSET_H_
+#define _WAITSET_H_
+
+#include <stdint.h>
+#include <wm_os.h>
+
+/** Sources a set can hold */
+#ifndef WAITSET_MAX_MEMBERS
+#define WAITSET_MAX_MEMBERS 8
+#endif
+
+/** Kind of a source */
+enum waitset_type {
+	WAITSET_NONE,
+	WAITSET_QUEUE,
+	WAITSET_SEMAPHORE,
+	WAITSET_SOCKET,
+};
+
+/** The source waitset_wait() found ready */
+typedef struct waitset_event {
+	/** Kind of the source */
+	enum waitset_type type;
+	/** The queue, it holds a message to be received with
+	 * os_queue_recv() and \ref OS_NO_WAIT, exactly once */
+	os_queue_t *queue;
+	/** The semaphore, it was taken for the caller */
+	os_semaphore_t *sem;
+	/** The socket, it can be read without blocking. With TLS on top the
+	 * data may not make a full record yet. */
+	int sock;
+} waitset_event_t;
+
+/** A source of a set, private */
+struct waitset_member {
+	enum waitset_type type;
+	void *handle;
+	int sock;
+};
+
+/** A wait set, the fields are private */
+typedef struct waitset {
+	QueueSetHandle_t set;
+	/* Given from the socket callbacks */
+	os_semaphore_t sock_sem;
+	/* Bit per member, a socket that became ready */
+	volatile uint32_t sock_ready;
+	struct waitset_member members[WAITSET_MAX_MEMBERS];
+} waitset_t;
+
+/** Create a wait set
+ *
+ * \param[out] ws The set
+ * \param[in] events The most events pending at a time: the sum of the
+ * lengths of the queues and of the counts of the semaphores that will be
+ * added. Sockets need no room.
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if events is 0 or -WM_E_NOMEM
+ */
+int waitset_create(waitset_t *ws, unsigned events);
+
+/** Delete a wait set
+ *
+ * Its sockets are removed first. Its queues and semaphores must be empty,
+ * they can not leave the set otherwise.
+ *
+ * \param[in] ws The set
+ */
+void waitset_delete(waitset_t *ws);
+
+/** Add a queue
+ *
+ * The queue must be empty and not in another set. Its messages are only
+ * received after waitset_wait() reported it, one per event.
+ *
+ * \param[in] ws The set
+ * \param[in] queue The queue
+ *
+ * \return WM_SUCCESS, -WM_E_NOSPC if the set is full or -WM_FAIL if the
+ * queue is not empty or in another set
+ */
+int waitset_add_queue(waitset_t *ws, os_queue_t *queue);
+
+/** Add a semaphore
+ *
+ * The semaphore must be taken, a binary semaphore is created given, and
+ * not be in another set. It is only taken through waitset_wait().
+ *
+ * \param[in] ws The set
+ * \param[in] sem The semaphore
+ *
+ * \return WM_SUCCESS, -WM_E_NOSPC if the set is full or -WM_FAIL if the
+ * semaphore is given or in another set
+ */
+int waitset_add_semaphore(waitset_t *ws, os_semaphore_t *sem);
+
+/** Add a socket
+ *
+ * This takes over the receive callback of the socket, see
+ * lwip_register_recv_cb(). The socket is reported ready once at first,
+ * for the data received before it was added.
+ *
+ * \param[in] ws The set
+ * \param[in] sock The socket
+ *
+ * \return WM_SUCCESS or -WM_E_NOSPC if the set is full
+ */
+int waitset_add_socket(waitset_t *ws, int sock);
+
+/** Remove a queue or a semaphore
+ *
+ * \param[in] ws The set
+ * \param[in] handle The queue or semaphore, it must be empty
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if it is not in the set or -WM_FAIL if
+ * it is not empty
+ */
+int waitset_remove(waitset_t *ws, void *handle);
+
+/** Remove a socket, e.g. before closing it
+ *
+ * \param[in] ws The set
+ * \param[in] sock The socket
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if it is not in the set
+ */
+int waitset_remove_socket(waitset_t *ws, int sock);
+
+/** Wait until a source is ready
+ *
+ * \param[in] ws The set
+ * \param[out] ev The source
+ * \param[in] wait Longest time to wait in OS ticks, or
+ * \ref OS_WAIT_FOREVER or \ref OS_NO_WAIT
+ *
+ * \return WM_SUCCESS or -WM_FAIL on timeout
+ */
+int waitset_wait(waitset_t *ws, waitset_event_t *ev, unsigned long wait);
+
+#endif /* _WAITSET_H_ */
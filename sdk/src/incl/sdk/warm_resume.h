@@ -0,0 +1,145 @@
+/*! \file warm_resume.h
+ * \brief State kept in the retention RAM across the PM4 sleeps
+ *
+ * After a wake-up from PM4 the device boots as from power on. The state a
+ * cycle built up, the answers of the DNS queries, the shadow version, the
+ * parsed configuration of the application, is lost with it and made again
+ * from scratch. With warm resume, the parts of that state which have a
+ * client here are written to the retention RAM right before the sleep, see
+ * duty_cycle.h, and given back to their clients after the wake-up.
+ *
+ * A client has a tag, a save function which writes its state and a restore
+ * function which reads it back. The snapshot is checked at boot by
+ * warm_resume_init() and used once: a reset after that one, e.g. by the
+ * watchdog, is a cold boot. The client registered after warm_resume_init()
+ * gets its state right away, in warm_resume_register(). The time since
+ * the save, read from the RTC which PM4 keeps running, is given to the
+ * restore functions so that they age their timeouts.
+ *
+ * The SDK has clients for the DNS cache of the MQTT hosts,
+ * iot_dns_warm_resume(), and for the shadow version,
+ * aws_iot_shadow_warm_resume(). The TLS session and the Wi-Fi association
+ * are in the prebuilt SDK library and are not kept, a cycle still makes
+ * them again. The credentials of cred_store.h are used in place in the
+ * flash and need no snapshot.
+ *
+ * @code
+ * static struct app_cfg cfg;
+ *
+ * static int cfg_save(void *buf, size_t size)
+ * {
+ *	if (size < sizeof(cfg))
+ *		return -WM_E_NOSPC;
+ *	memcpy(buf, &cfg, sizeof(cfg));
+ *	return sizeof(cfg);
+ * }
+ *
+ * static void cfg_restore(const void *data, size_t len, uint32_t since_ms)
+ * {
+ *	if (len == sizeof(cfg)) {
+ *		memcpy(&cfg, data, sizeof(cfg));
+ *		cfg_loaded = true;
+ *	}
+ * }
+ *
+ * static const struct warm_resume_client cfg_client = {
+ *	.tag = WARM_RESUME_TAG_APP,
+ *	.save = cfg_save,
+ *	.restore = cfg_restore,
+ * };
+ *
+ * main():
+ *	warm_resume_init();
+ *	warm_resume_register(&cfg_client);
+ *	if (!cfg_loaded)
+ *		load_cfg_from_psm(&cfg);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _WARM_RESUME_H_
+#define _WARM_RESUME_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Bytes of the retention RAM the records take, of the 4K */
+#ifndef WARM_RESUME_SIZE
+#define WARM_RESUME_SIZE 1024
+#endif
+
+/** Number of clients */
+#ifndef WARM_RESUME_MAX_CLIENTS
+#define WARM_RESUME_MAX_CLIENTS 8
+#endif
+
+/** Rate of the RTC counter, as DUTY_CYCLE_RTC_HZ */
+#ifndef WARM_RESUME_RTC_HZ
+#define WARM_RESUME_RTC_HZ 1000
+#endif
+
+/** Tags of the clients of the SDK */
+#define WARM_RESUME_TAG_DNS 1
+#define WARM_RESUME_TAG_SHADOW 2
+/** First of the tags of the application */
+#define WARM_RESUME_TAG_APP 0x100
+
+/** State kept across the sleeps */
+struct warm_resume_client {
+	/** Unique among the clients */
+	uint16_t tag;
+	/** Writes the state to buf, returns its length or a negative error
+	 * to keep nothing */
+	int (*save)(void *buf, size_t size);
+	/** Reads back the state, since_ms after it was saved */
+	void (*restore)(const void *data, size_t len, uint32_t since_ms);
+};
+
+/** Check the snapshot of the last sleep
+ *
+ * Called once at boot, before the clients register. The snapshot is only
+ * taken after a wake-up of the RTC or of the ULPCOMP from PM4, and it is
+ * dropped from the retention RAM so that the next boot is cold unless the
+ * device sleeps again.
+ *
+ * \return true if there is a snapshot, the boot is warm
+ */
+bool warm_resume_init(void);
+
+/** Whether warm_resume_init() found a snapshot
+ *
+ * \return true for a warm boot
+ */
+bool warm_resume_is_warm(void);
+
+/** Add a client
+ *
+ * On a warm boot, the restore function of the client is called before
+ * returning if the snapshot has its state.
+ *
+ * \param[in] client The client, kept
+ *
+ * \return WM_SUCCESS
+ * \return -WM_E_INVAL if client or one of its functions is NULL, or the tag
+ * is taken
+ * \return -WM_E_NOSPC if there are WARM_RESUME_MAX_CLIENTS clients
+ */
+int warm_resume_register(const struct warm_resume_client *client);
+
+/** Write the snapshot
+ *
+ * Called right before the PM4 sleep, duty_cycle.h does. Every client saves
+ * its state; a client whose state does not fit in what is left of
+ * WARM_RESUME_SIZE is left out.
+ *
+ * \return WM_SUCCESS
+ * \return -WM_FAIL if the RTC does not run
+ */
+int warm_resume_save(void);
+
+#endif /* ! _WARM_RESUME_H_ */
@@ -0,0 +1,146 @@
+/*! \file wlan_roam.h
+ * \brief Roaming between the access points of a network before the link
+ * is lost
+ *
+ * The station stays on the access point it associated with until the link
+ * is lost. In a building with many access points of the same network a
+ * device that moves, or sees its access point fade, then goes through a
+ * beacon loss, a full scan of all the channels and a new DHCP exchange,
+ * seconds without connectivity after which its TCP connections are often
+ * gone.
+ *
+ * This module watches the signal of the current access point. Once it
+ * stays below a threshold, it disconnects and connects again to the
+ * network profile of the station, while the link is still up. The
+ * connection manager then scans and associates again, normally with a
+ * stronger access point of the network, instead of waiting for the beacon
+ * loss. The address is kept: the profile keeps the IP configuration, and
+ * with DHCP the server is asked for the same address. TCP connections,
+ * such as the MQTT one, survive the short gap as long as the address did
+ * not change and the application does not close them on the link lost
+ * event, see wlan_roam_in_progress().
+ *
+ * The driver has no 802.11r. The module only uses the calls of the
+ * connection manager that take plain scalars, the scan results and the
+ * network profiles are structs of the SDK library it does not rely on. It
+ * can therefore not choose the access point itself, nor tell ahead of the
+ * roam that a better one is there; wlan_roam_stats.improved counts the
+ * roams that ended on a stronger signal.
+ *
+ * If the station is not connected again within the timeout, the module
+ * keeps connecting it to the network, as the connection manager does not
+ * retry.
+ *
+ * @code
+ * void wlan_event_normal_connected(void *data)
+ * {
+ *	...
+ *	wlan_roam_start(NULL);
+ * }
+ *
+ * void wlan_event_normal_link_lost(void *data)
+ * {
+ *	if (wlan_roam_in_progress())
+ *		return;
+ *	...
+ * }
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _WLAN_ROAM_H_
+#define _WLAN_ROAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Configuration of wlan_roam_start() */
+struct wlan_roam_config {
+	/** Name of the network profile the station is connected with, up
+	 * to 32 characters, copied */
+	const char *network;
+	/** Signal of the current access point, in dBm, below which the
+	 * station roams */
+	short trigger_rssi;
+	/** Interval the signal is read at */
+	uint32_t check_ms;
+	/** Shortest time between two roams, each one scans all the channels
+	 * and leaves the link down for a while */
+	uint32_t roam_interval_ms;
+	/** Longest time a roam may take, after it the station is connected
+	 * again every so often */
+	uint32_t connect_timeout_ms;
+};
+
+/** Configuration used for NULL, with the profile of wm_wlan_start() and
+ * app_sta_start() */
+#define WLAN_ROAM_CONFIG_DEFAULT {		\
+		.network = "sta-network",	\
+		.trigger_rssi = -75,		\
+		.check_ms = 1000,		\
+		.roam_interval_ms = 60000,	\
+		.connect_timeout_ms = 10000,	\
+	}
+
+/** Called when a roam starts and when it ends
+ *
+ * \param[in] done false when the station leaves the access point, true
+ * when the roam is over
+ * \param[in] ok The station is connected again
+ * \param[in] ip_kept The station has the address it had before
+ */
+typedef void (*wlan_roam_cb_t)(bool done, bool ok, bool ip_kept);
+
+/** Counters of the roams */
+struct wlan_roam_stats {
+	/** Roams after which the station was connected again */
+	uint32_t roams;
+	/** Of them, the ones that ended on a stronger signal */
+	uint32_t improved;
+	/** Roams after which the station was not connected again within
+	 * the timeout */
+	uint32_t failed;
+	/** Roams after which the address was different */
+	uint32_t ip_changed;
+	/** Time without a link of the last roam */
+	uint32_t last_gap_ms;
+};
+
+/** Start watching the signal
+ *
+ * Called once the station is connected, e.g. from
+ * wlan_event_normal_connected(). A second call only changes the
+ * configuration.
+ *
+ * \param[in] cfg Configuration, copied, NULL for WLAN_ROAM_CONFIG_DEFAULT
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL for a configuration without check_ms
+ * or network, or -WM_FAIL if the thread could not be created
+ */
+int wlan_roam_start(const struct wlan_roam_config *cfg);
+
+/** Stop watching the signal, a roam under way is finished first */
+void wlan_roam_stop(void);
+
+/** A roam is under way
+ *
+ * The link lost and connected events of the roam come while it is true,
+ * an application that closes its connections on a link loss should leave
+ * them open then.
+ */
+bool wlan_roam_in_progress(void);
+
+/** Set the function called when a roam starts and ends, NULL for none
+ *
+ * It is called from the thread of the module.
+ */
+void wlan_roam_set_callback(wlan_roam_cb_t cb);
+
+/** Counters since the start */
+void wlan_roam_get_stats(struct wlan_roam_stats *stats);
+
+#endif /* _WLAN_ROAM_H_ */
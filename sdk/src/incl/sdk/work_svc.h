@@ -0,0 +1,188 @@
+/*! \file work_svc.h
+ * \brief Shared worker threads for deferred, delayed and periodic jobs
+ *
+ * Instead of each module owning a thread, with its stack, to run a bit of
+ * code later or every so often, modules hand a job to one of the lanes
+ * here. A lane is one thread running its jobs one after the other, in the
+ * order they fall due. There are three lanes of different priorities, jobs
+ * of a lane only wait for the jobs of the same lane.
+ *
+ * The job is a work_t the caller owns, nothing is allocated. A job already
+ * waiting is not queued a second time when it is submitted again: it runs
+ * once, at the earlier of the two times. So a job submitted on every event,
+ * e.g. "save the settings", runs once for a burst of events. A job
+ * submitted again while it runs runs again afterwards.
+ *
+ * Jobs must not block for long, they hold up the other jobs of their lane.
+ * The job's stack is the lane's, WORK_SVC_STACK_SIZE.
+ *
+ * @code
+ * static work_t save_job;
+ *
+ * static void save_settings(work_t *w)
+ * {
+ *	save_settings_to_flash();
+ * }
+ *
+ * work_svc_init();
+ * work_init(&save_job, save_settings, NULL, WORK_LANE_LOW);
+ *
+ * // On every change, the settings are written once 2 s after a burst
+ * work_submit_delayed(&save_job, 2000);
+ * @endcode
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _WORK_SVC_H_
+#define _WORK_SVC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Stack of each lane's thread */
+#ifndef WORK_SVC_STACK_SIZE
+#define WORK_SVC_STACK_SIZE 2048
+#endif
+
+/** Lanes, each one thread */
+enum work_lane {
+	/** OS_PRIO_1, short jobs that react to events */
+	WORK_LANE_HIGH,
+	/** OS_PRIO_2 */
+	WORK_LANE_NORMAL,
+	/** OS_PRIO_4, housekeeping, e.g. writing to flash */
+	WORK_LANE_LOW,
+	WORK_LANES,
+};
+
+struct work;
+
+/** Job function
+ *
+ * \param[in] w The job, work_arg() gives its argument
+ */
+typedef void (*work_fn_t)(struct work *w);
+
+/** A job, set up with work_init()
+ *
+ * The fields are private to the work service.
+ */
+typedef struct work {
+	struct work *next;
+	work_fn_t fn;
+	void *arg;
+	/** Tick the job falls due at */
+	uint32_t due;
+	/** Ticks between runs of a periodic job, 0 for a one shot job */
+	uint32_t period;
+	uint8_t lane;
+	uint8_t state;
+} work_t;
+
+/** Counters of a lane */
+typedef struct {
+	/** Jobs run */
+	uint32_t runs;
+	/** Submits merged into a job already waiting */
+	uint32_t coalesced;
+	/** Longest a job waited past its time, in milliseconds */
+	uint32_t max_latency_ms;
+} work_lane_stats_t;
+
+/** Start the lanes' threads
+ *
+ * Can be called again, the threads are only started once.
+ *
+ * \return WM_SUCCESS or -WM_FAIL
+ */
+int work_svc_init(void);
+
+/** Set up a job
+ *
+ * \param[out] w The job, it has to stay in place while it waits or runs
+ * \param[in] fn Function of the job
+ * \param[in] arg Argument of the job, work_arg() gives it to the function
+ * \param[in] lane Lane the job runs in
+ */
+void work_init(work_t *w, work_fn_t fn, void *arg, enum work_lane lane);
+
+/** Argument of a job
+ *
+ * \param[in] w The job
+ *
+ * \return Argument given to work_init()
+ */
+static inline void *work_arg(work_t *w)
+{
+	return w->arg;
+}
+
+/** Run a job as soon as its lane is free
+ *
+ * Same as work_submit_delayed() with no delay. Can be called from an
+ * interrupt handler.
+ *
+ * \param[in] w The job
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if work_svc_init() was not called
+ */
+int work_submit(work_t *w);
+
+/** Run a job after a delay
+ *
+ * A periodic job stays periodic, its next runs are a period apart from this
+ * one. Can be called from an interrupt handler.
+ *
+ * \param[in] w The job
+ * \param[in] delay_ms Milliseconds from now
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if work_svc_init() was not called
+ */
+int work_submit_delayed(work_t *w, uint32_t delay_ms);
+
+/** Run a job every period
+ *
+ * The runs stay on the period's grid, a run that is late does not move the
+ * next. Runs missed altogether, when the lane was busy for more than a
+ * period, are skipped.
+ *
+ * \param[in] w The job
+ * \param[in] delay_ms Milliseconds from now to the first run
+ * \param[in] period_ms Milliseconds between runs, not 0
+ *
+ * \return WM_SUCCESS or -WM_E_INVAL if work_svc_init() was not called or the
+ * period is 0
+ */
+int work_submit_periodic(work_t *w, uint32_t delay_ms, uint32_t period_ms);
+
+/** Take a job off its lane
+ *
+ * A job that is running finishes that run, a periodic one does not run
+ * again.
+ *
+ * \param[in] w The job
+ *
+ * \return WM_SUCCESS if the job was waiting, -WM_FAIL if it was not
+ */
+int work_cancel(work_t *w);
+
+/** Is a job waiting or running
+ *
+ * \param[in] w The job
+ *
+ * \return true if it is
+ */
+bool work_pending(work_t *w);
+
+/** Get the counters of a lane
+ *
+ * \param[in] lane The lane
+ * \param[out] stats Counters since work_svc_init()
+ */
+void work_svc_get_stats(enum work_lane lane, work_lane_stats_t *stats);
+
+#endif /* _WORK_SVC_H_ */
@@ -0,0 +1,91 @@
+/*! \file xip.h
+ * \brief Flash controller setup of XIP images
+ *
+ * An image built with XIP=1 runs its code from the flash through the flash
+ * controller and its cache, a cache miss waits for the flash to be read.
+ * xip_flash_config() sets how the controller reads the flash, quad I/O
+ * with continuous read mode sends four times fewer clocks per miss than a
+ * fast read, and turns the cache on. It is best called once at the start
+ * of main().
+ *
+ * Functions marked __ramfunc, from compiler.h, are linked in SRAM0 like
+ * the ISR vectors and the flash driver, for code that runs often enough
+ * that the misses show. Each one takes SRAM from the heap.
+ *
+ * @code
+ * static __ramfunc int busy_loop(const uint8_t *buf, int len)
+ * {
+ *	...
+ * }
+ *
+ * xip_config_t cfg = {
+ *	.read_mode = XIP_READ_QUAD_IO_CONT,
+ *	.cache = true,
+ * };
+ *
+ * xip_flash_config(&cfg);
+ * @endcode
+ *
+ * In an image that is not XIP everything already runs from SRAM, the
+ * functions do nothing.
+ */
+
+/*
+ *  Copyright (C) 2008-2016, Marvell International Ltd.
+ *  All Rights Reserved.
+ */
+
+#ifndef _XIP_H_
+#define _XIP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <compiler.h>
+
+/** How the flash controller reads the flash */
+typedef enum {
+	/** Fast read (0x0B), one data line */
+	XIP_READ_FAST,
+	/** Fast read quad output (0x6B), address on one line */
+	XIP_READ_QUAD_OUT,
+	/** Fast read quad I/O (0xEB) */
+	XIP_READ_QUAD_IO,
+	/** Fast read quad I/O in continuous read mode, the instruction is
+	 * only sent once */
+	XIP_READ_QUAD_IO_CONT,
+} xip_read_mode_t;
+
+/** Flash controller configuration */
+typedef struct {
+	/** Read mode */
+	xip_read_mode_t read_mode;
+	/** Cache the flash, the hit and miss counters count as well */
+	bool cache;
+} xip_config_t;
+
+/** Configure the flash controller
+ *
+ * Runs from SRAM with the interrupts off while the controller is changed.
+ * The quad modes are refused if the flash does not support them, the
+ * controller is set to fast read then.
+ *
+ * \param[in] cfg Configuration
+ *
+ * \return WM_SUCCESS, -WM_E_INVAL if the read mode is not valid or -WM_FAIL
+ * if the flash does not support the quad modes
+ */
+int xip_flash_config(const xip_config_t *cfg);
+
+/** Read the cache counters
+ *
+ * Counted since xip_flash_config() or xip_cache_stats_reset().
+ *
+ * \param[out] hit Reads served from the cache
+ * \param[out] miss Reads that went to the flash
+ */
+void xip_cache_stats(uint32_t *hit, uint32_t *miss);
+
+/** Reset the cache counters */
+void xip_cache_stats_reset(void);
+
+#endif /* ! _XIP_H_ */
@@ -0,0 +1,185 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Decoder of the binary log (blog.h)
+#
+# Reads the image blog_dump() printed on the console, from a log file or
+# the standard input, or the one blog_save() or blog_export() wrote, as a
+# binary file. Prints the records as text, one per line, with the format
+# strings of the .blog_fmt section of the .axf the device runs.
+#
+# Usage: blog_decode.py [-b] <app.axf> [log or image]
+
+import sys, getopt, struct, re
+
+MAGIC = 0x474f4c42
+HDR = "<IHHII"
+REC = "<IIIBB"
+ARG_32, ARG_64, ARG_DOUBLE, ARG_STR = range(1, 5)
+LEVELS = "EWID"
+
+def usage():
+    print("Usage: %s [-b] <app.axf> [log or image]" % sys.argv[0])
+    print("  -b  the input is a binary image, from flash or an upload")
+    sys.exit(1)
+
+# Contents and address of the .blog_fmt section of the ELF file
+def read_formats(axf):
+    with open(axf, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[5] != 1:
+        raise ValueError("%s is not a little endian ELF file" % axf)
+    if elf[4] == 1:
+        shoff, = struct.unpack_from("<I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2e)
+        sh = "<IIIIII"
+    else:
+        shoff, = struct.unpack_from("<Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x3a)
+        sh = "<IIQQQQ"
+    sections = [struct.unpack_from(sh, elf, shoff + i * shentsize)
+                for i in range(shnum)]
+    names = sections[shstrndx][4]
+    for name, _, _, addr, offset, size in sections:
+        end = elf.index(b"\0", names + name)
+        if elf[names + name:end] == b".blog_fmt":
+            return addr, elf[offset:offset + size]
+    raise ValueError("%s has no .blog_fmt section" % axf)
+
+def read_log(f):
+    data = None
+    for line in f:
+        w = line.split()
+        if w[:2] == ["blog", "begin"]:
+            # A new dump replaces the previous one
+            data = bytearray()
+        elif w[:2] == ["blog", "end"] and data is not None:
+            return bytes(data)
+        elif len(w) == 2 and w[0] == "blog" and data is not None:
+            data += bytearray.fromhex(w[1])
+    return data
+
+# The arguments of a record, as the device wrote them
+def read_args(sig, data):
+    args, pos = [], 0
+    while sig & 7:
+        kind = sig & 7
+        if kind == ARG_32:
+            args.append((kind, struct.unpack_from("<I", data, pos)[0]))
+            pos += 4
+        elif kind == ARG_64:
+            args.append((kind, struct.unpack_from("<Q", data, pos)[0]))
+            pos += 8
+        elif kind == ARG_DOUBLE:
+            args.append((kind, struct.unpack_from("<d", data, pos)[0]))
+            pos += 8
+        else:
+            n = data[pos]
+            args.append((kind, data[pos + 1:pos + 1 + n].decode(
+                "utf-8", "replace")))
+            pos += 1 + n
+        sig >>= 3
+    return args
+
+CONV = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?"
+                  r"(hh|h|ll|l|z|j|t|L)?([diuoxXcspfFeEgG%])")
+
+def signed(kind, v):
+    bits = 64 if kind == ARG_64 else 32
+    return v - (1 << bits) if v >> (bits - 1) else v
+
+# printf with the arguments of a record, a conversion without its argument
+# is left as it is
+def render(fmt, args):
+    args = list(args)
+    def conv(m):
+        flags, width, prec, _, c = m.groups()
+        if c == "%":
+            return "%"
+        spec = "%" + flags
+        for part in (width, prec):
+            if part == "*":
+                if not args:
+                    return m.group(0)
+                part = str(signed(*args.pop(0)))
+            if part is not None:
+                spec += ("." if part is prec else "") + part
+        if not args:
+            return m.group(0)
+        kind, v = args.pop(0)
+        if c in "di":
+            v = signed(kind, v) if kind != ARG_DOUBLE else int(v)
+        elif c == "u":
+            c = "d"
+        elif c == "p":
+            return "0x%08x" % v
+        elif c == "c":
+            v = chr(v & 0xff)
+        elif c == "s" and kind != ARG_STR:
+            v = "0x%08x" % v
+        elif c in "fFeEgG" and kind != ARG_DOUBLE:
+            v = float(v)
+        try:
+            return (spec + c) % v
+        except (TypeError, ValueError):
+            return str(v)
+    return CONV.sub(conv, fmt)
+
+def decode(image, base, formats):
+    magic, version, hdr_size, length, dropped = \
+        struct.unpack_from(HDR, image, 0)
+    if magic != MAGIC:
+        raise ValueError("not a blog image")
+    if version != 1:
+        raise ValueError("blog image of version %d" % version)
+    if dropped:
+        print("[%u records dropped]" % dropped)
+    pos, end = hdr_size, min(hdr_size + length, len(image))
+    rec = struct.calcsize(REC)
+    while pos + rec <= end:
+        fid, ms, sig, level, n = struct.unpack_from(REC, image, pos)
+        args = read_args(sig, image[pos + rec:pos + rec + n])
+        off = fid - base
+        if 0 <= off < len(formats):
+            fmt = formats[off:formats.index(b"\0", off)].decode(
+                "utf-8", "replace")
+        else:
+            fmt = "<unknown message 0x%08x>" % fid
+        text = render(fmt, args).rstrip("\r\n")
+        print("[%8u %s] %s" % (ms, LEVELS[level] if level < 4 else "?",
+                               text))
+        pos += rec + n
+
+def main():
+    binary = False
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "bh")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-b":
+            binary = True
+        else:
+            usage()
+    if len(args) < 1 or len(args) > 2:
+        usage()
+
+    base, formats = read_formats(args[0])
+    if binary:
+        if len(args) == 2:
+            with open(args[1], "rb") as f:
+                image = f.read()
+        else:
+            image = sys.stdin.buffer.read() \
+                if hasattr(sys.stdin, "buffer") else sys.stdin.read()
+    else:
+        f = open(args[1]) if len(args) == 2 else sys.stdin
+        image = read_log(f)
+        if image is None:
+            print("No blog dump found")
+            sys.exit(1)
+    decode(bytearray(image), base, bytearray(formats))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Patch for a delta firmware update, see ota.h
+#
+# Compares the firmware the devices run with the new one and writes the
+# patch that turns the first into the second, in the streaming bsdiff
+# format ENDSLEY/BSDIFF43: blocks of bytes of the old image with a
+# difference added, which is mostly zeros where code only moved, and of
+# new bytes. The patch is compressed with xz unless -n is given, with the
+# dictionary size OTA_XZ_DICT_MAX accepts. Prints the SHA-256 of the new
+# image, ota_cfg.sha256 of the update.
+#
+# Matches are found through an index of the 8 byte strings of the old
+# image, and extended while more bytes match than differ.
+#
+# Usage: fw_delta.py [-n] <old.bin> <new.bin> <patch>
+
+import sys, getopt, struct, hashlib, subprocess
+
+MAGIC = b"ENDSLEY/BSDIFF43"
+KEY = 8
+# Shorter matches cost more in controls than they save
+MIN_MATCH = 24
+XZ = ["xz", "--format=xz", "--check=crc32", "--lzma2=preset=9e,dict=32KiB",
+      "-c"]
+
+def usage():
+    print("Usage: %s [-n] <old.bin> <new.bin> <patch>" % sys.argv[0])
+    print("  -n  do not compress the patch")
+    sys.exit(1)
+
+def offtout(x):
+    if x < 0:
+        return struct.pack("<Q", -x | (1 << 63))
+    return struct.pack("<Q", x)
+
+def index(old):
+    idx = {}
+    for i in range(len(old) - KEY + 1):
+        idx.setdefault(bytes(old[i:i + KEY]), i)
+    return idx
+
+def extend(old, o, new, n):
+    """Length of the block from old[o] and new[n] with the best score,
+    +1 a byte that matches, -1 one that does not"""
+    score = best = best_len = 0
+    i = 0
+    end = min(len(old) - o, len(new) - n)
+    while i < end:
+        score += 1 if old[o + i] == new[n + i] else -1
+        i += 1
+        if score > best:
+            best, best_len = score, i
+        elif score < best - 64:
+            break
+    return best_len
+
+def diff(old, new):
+    """(old offset, new offset, length) of the blocks taken from old"""
+    idx = index(old)
+    blocks = []
+    scan = 0
+    prev = None
+    while scan < len(new):
+        cands = []
+        # The old image shifted as much as in the previous block
+        if prev and 0 <= prev[0] + scan - prev[1] < len(old):
+            cands.append(prev[0] + scan - prev[1])
+        o = idx.get(bytes(new[scan:scan + KEY]))
+        if o is not None:
+            cands.append(o)
+        length = 0
+        for c in cands:
+            n = extend(old, c, new, scan)
+            if n > length:
+                o, length = c, n
+        if length < MIN_MATCH:
+            scan += 1
+            continue
+        prev = (o, scan, length)
+        blocks.append(prev)
+        scan += length
+    return blocks
+
+def patch(old, new, blocks):
+    out = [MAGIC, offtout(len(new))]
+    old_pos = new_pos = 0
+    diff_len = 0
+    # A control is the diff of a block, the new bytes up to the next
+    # block and the seek to it
+    for o, n, length in blocks + [(None, len(new), 0)]:
+        extra = new[new_pos + diff_len:n]
+        seek = (o - (old_pos + diff_len)) if o is not None else 0
+        out.append(offtout(diff_len) + offtout(len(extra)) + offtout(seek))
+        out.append(bytes(bytearray((new[new_pos + i] - old[old_pos + i])
+                                   & 0xff for i in range(diff_len))))
+        out.append(bytes(extra))
+        if o is None:
+            break
+        old_pos, new_pos, diff_len = o, n, length
+    return b"".join(out)
+
+def main():
+    compress = True
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "nh")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-n":
+            compress = False
+        else:
+            usage()
+    if len(args) != 3:
+        usage()
+
+    # Bytes as ints with python 2 as well
+    with open(args[0], "rb") as f:
+        old = bytearray(f.read())
+    with open(args[1], "rb") as f:
+        new = bytearray(f.read())
+
+    blocks = diff(old, new)
+    data = patch(old, new, blocks)
+    if compress:
+        p = subprocess.Popen(XZ, stdin=subprocess.PIPE,
+                             stdout=subprocess.PIPE)
+        data = p.communicate(data)[0]
+        if p.returncode:
+            sys.exit("xz failed")
+    with open(args[2], "wb") as f:
+        f.write(data)
+
+    copied = sum(b[2] for b in blocks)
+    print("%d blocks, %d of %d bytes from the old image" % (
+        len(blocks), copied, len(new)))
+    print("patch %d bytes, %.1fx smaller than the image" % (
+        len(data), float(len(new)) / max(len(data), 1)))
+    print("sha256 %s" % hashlib.sha256(bytes(new)).hexdigest())
+
+if __name__ == "__main__":
+    main()
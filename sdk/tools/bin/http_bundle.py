@@ -0,0 +1,131 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Bundle of web pages for the static content server, see http_static.h
+#
+# Packs the files of a directory, served at their path in it, with / for
+# index.html. Each file is compressed with gzip when that makes it smaller,
+# and its ETag is the CRC32 of its content. Writes the bundle to be flashed
+# in a partition with -o, and as a C array to be linked in the image with
+# -c, or both.
+#
+# Usage: http_bundle.py [-o <bundle.bin>] [-c <bundle.c> -n <name>] <dir>
+
+import sys, os, getopt, struct, gzip, io, zlib
+
+MAGIC = 0x31425348
+GZIP = 0x1
+TYPES = {
+    ".html": "text/html", ".htm": "text/html", ".css": "text/css",
+    ".js": "application/javascript", ".json": "application/json",
+    ".txt": "text/plain", ".xml": "text/xml", ".svg": "image/svg+xml",
+    ".png": "image/png", ".jpg": "image/jpeg", ".jpeg": "image/jpeg",
+    ".gif": "image/gif", ".ico": "image/x-icon",
+    ".woff": "font/woff", ".woff2": "font/woff2",
+}
+
+def usage():
+    print("Usage: %s [-o <bundle.bin>] [-c <bundle.c> -n <name>] <dir>" %
+          sys.argv[0])
+    print("  -o  write the bundle to be flashed")
+    print("  -c  write the bundle as a C array named <name>")
+    sys.exit(1)
+
+def pad(data):
+    return data + b"\0" * (-len(data) % 4)
+
+def compress(data):
+    buf = io.BytesIO()
+    # No name nor time, the bundle only changes with the files
+    f = gzip.GzipFile(filename="", mode="wb", fileobj=buf, mtime=0)
+    f.write(data)
+    f.close()
+    return buf.getvalue()
+
+def files(top):
+    for root, dirs, names in os.walk(top):
+        dirs.sort()
+        for name in sorted(names):
+            path = os.path.join(root, name)
+            url = "/" + os.path.relpath(path, top).replace(os.sep, "/")
+            yield url, path
+
+def bundle(top):
+    entries = []
+    for url, path in files(top):
+        with open(path, "rb") as f:
+            data = f.read()
+        etag = zlib.crc32(data) & 0xffffffff
+        ext = os.path.splitext(path)[1].lower()
+        flags = 0
+        z = compress(data)
+        if len(z) < len(data):
+            data, flags = z, GZIP
+        entries.append((url, TYPES.get(ext, "application/octet-stream"),
+                        data, etag, flags))
+
+    strings = b""
+    offs = []
+    base = 16 + 24 * len(entries)
+    for url, ctype, data, etag, flags in entries:
+        p = base + len(strings)
+        strings += url.encode() + b"\0"
+        t = base + len(strings)
+        strings += ctype.encode() + b"\0"
+        offs.append((p, t))
+    index_size = base + len(pad(strings))
+
+    bodies = b""
+    index = b""
+    for (url, ctype, data, etag, flags), (p, t) in zip(entries, offs):
+        index += struct.pack("<6I", p, t, index_size + len(bodies),
+                             len(data), etag, flags)
+        bodies += pad(data)
+    size = index_size + len(bodies)
+    out = struct.pack("<4I", MAGIC, len(entries), index_size, size)
+    return out + index + pad(strings) + bodies, entries
+
+def write_c(path, name, data):
+    data = bytearray(data)
+    with open(path, "w") as f:
+        f.write("/* Written by http_bundle.py */\n\n")
+        f.write("static const uint8_t %s[%d] __attribute__((aligned(4))) "
+                "= {\n" % (name, len(data)))
+        for i in range(0, len(data), 12):
+            f.write("\t" + " ".join("0x%02x," % b
+                                    for b in data[i:i + 12]) + "\n")
+        f.write("};\n")
+
+def main():
+    out = c_out = name = None
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "o:c:n:h")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-o":
+            out = arg
+        elif opt == "-c":
+            c_out = arg
+        elif opt == "-n":
+            name = arg
+        else:
+            usage()
+    if len(args) != 1 or not (out or c_out) or (c_out and not name):
+        usage()
+
+    data, entries = bundle(args[0])
+    if out:
+        with open(out, "wb") as f:
+            f.write(data)
+    if c_out:
+        write_c(c_out, name, data)
+
+    for url, ctype, body, etag, flags in entries:
+        print("%-32s %7d %s%s" % (url, len(body), ctype,
+                                  " gzip" if flags & GZIP else ""))
+    print("%d files, %d bytes" % (len(entries), len(data)))
+
+if __name__ == "__main__":
+    main()
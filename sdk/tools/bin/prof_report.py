@@ -0,0 +1,104 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Report of the samples of the PC sampling profiler (profiler.h)
+#
+# Reads the "prof" lines that "profiler dump" printed on the console from a
+# log file, or the standard input, and gives the share of the samples of
+# every function of the .axf, the most sampled first.
+#
+# Usage: prof_report.py [-n <count>] [-t <toolchain prefix>] <app.axf> [log]
+
+import sys, getopt, subprocess, bisect
+
+def usage():
+    print("Usage: %s [-n <count>] [-t <toolchain prefix>] <app.axf> [log]"
+          % sys.argv[0])
+    print("  -n  functions to list, 30 by default, 0 for all")
+    print("  -t  prefix of the binutils, arm-none-eabi- by default")
+    sys.exit(1)
+
+# Functions of the image as sorted (start, end, name), the names as in the
+# object files when not demangled
+def read_symbols(nm, axf, demangle=True):
+    out = subprocess.check_output([nm, "-n", "-S"] +
+                                  (["-C"] if demangle else []) +
+                                  ["--defined-only", axf]).decode()
+    syms = []
+    for line in out.splitlines():
+        f = line.split(None, 3)
+        if len(f) != 4 or f[2] not in "tTwW":
+            continue
+        # Thumb functions have bit 0 of their address set
+        start = int(f[0], 16) & ~1
+        syms.append((start, start + int(f[1], 16), f[3]))
+    return syms
+
+def read_samples(log):
+    samples = {}
+    total = isr = dropped = 0
+    for line in log:
+        f = line.split()
+        if len(f) == 7 and f[0] == "prof" and f[1] == "samples":
+            # A new dump replaces the previous one
+            samples = {}
+            total, isr, dropped = int(f[2]), int(f[4]), int(f[6])
+        elif len(f) == 3 and f[0] == "prof" and f[1].startswith("0x"):
+            samples[int(f[1], 16)] = int(f[2])
+    return samples, total, isr, dropped
+
+# Samples of every function, the ones out of any function by address
+def function_samples(syms, samples):
+    starts = [s[0] for s in syms]
+    funcs = {}
+    for addr, n in samples.items():
+        i = bisect.bisect_right(starts, addr) - 1
+        if i >= 0 and addr < max(syms[i][1], syms[i][0] + 1):
+            name = syms[i][2]
+        else:
+            name = "0x%08x" % addr
+        funcs[name] = funcs.get(name, 0) + n
+    return funcs
+
+def main():
+    count = 30
+    prefix = "arm-none-eabi-"
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "n:t:h")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-n":
+            count = int(arg)
+        elif opt == "-t":
+            prefix = arg
+        else:
+            usage()
+    if len(args) < 1 or len(args) > 2:
+        usage()
+
+    syms = read_symbols(prefix + "nm", args[0])
+    if len(args) == 2:
+        with open(args[1]) as log:
+            samples, total, isr, dropped = read_samples(log)
+    else:
+        samples, total, isr, dropped = read_samples(sys.stdin)
+    if not total:
+        print("No profiler dump found")
+        sys.exit(1)
+
+    funcs = function_samples(syms, samples)
+
+    print("%d samples, %d in interrupts (%.1f%%), %d dropped (%.1f%%)"
+          % (total, isr, 100.0 * isr / total, dropped,
+             100.0 * dropped / total))
+    print("%8s %6s  %s" % ("samples", "%", "function"))
+    ranked = sorted(funcs.items(), key=lambda f: -f[1])
+    if count:
+        ranked = ranked[:count]
+    for name, n in ranked:
+        print("%8d %6.2f  %s" % (n, 100.0 * n / total, name))
+
+if __name__ == "__main__":
+    main()
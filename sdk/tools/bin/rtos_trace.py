@@ -0,0 +1,243 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Decoder of the FreeRTOS scheduling trace (freertos_trace.h)
+#
+# Reads the image freertos_trace_dump() printed on the console, from a log
+# file or the standard input, or the one freertos_trace_save() wrote to
+# flash, read back as a binary file. Prints the CPU time of every task, the
+# time the tasks spent blocked on queues, semaphores and mutexes, and the
+# priority inheritances with the tasks that ran meanwhile. Optionally
+# writes the time line in the JSON format of the Chrome trace viewer.
+#
+# Usage: rtos_trace.py [-b] [-e] [-j <trace.json>] [log or image]
+
+import sys, getopt, struct, json
+
+MAGIC = 0x52545246
+HDR = "<IHHIIHH"
+TASK = "<IHBB16s"
+EVENT = "<IIHBB"
+
+SWITCH_IN, SWITCH_OUT, QUEUE_SEND, QUEUE_RECEIVE, QUEUE_SEND_FROM_ISR, \
+    QUEUE_RECEIVE_FROM_ISR, BLOCK_ON_SEND, BLOCK_ON_RECEIVE, \
+    PRIORITY_INHERIT, PRIORITY_DISINHERIT = range(1, 11)
+
+EVENT_NAMES = {
+    SWITCH_IN: "switch in", SWITCH_OUT: "switch out",
+    QUEUE_SEND: "send", QUEUE_RECEIVE: "receive",
+    QUEUE_SEND_FROM_ISR: "send from isr",
+    QUEUE_RECEIVE_FROM_ISR: "receive from isr",
+    BLOCK_ON_SEND: "block on send", BLOCK_ON_RECEIVE: "block on receive",
+    PRIORITY_INHERIT: "priority inherit",
+    PRIORITY_DISINHERIT: "priority disinherit",
+}
+
+# queueQUEUE_TYPE_ of queue.h
+QUEUE_TYPES = ["queue", "mutex", "counting semaphore", "binary semaphore",
+               "recursive mutex"]
+
+def usage():
+    print("Usage: %s [-b] [-e] [-j <trace.json>] [log or image]"
+          % sys.argv[0])
+    print("  -b  the input is the binary image saved to flash")
+    print("  -e  list every event")
+    print("  -j  write the time line for chrome://tracing or Perfetto")
+    sys.exit(1)
+
+def read_log(f):
+    data = None
+    for line in f:
+        w = line.split()
+        if w[:2] == ["rtrace", "begin"]:
+            # A new dump replaces the previous one
+            data = bytearray()
+        elif w[:2] == ["rtrace", "end"] and data is not None:
+            return bytes(data)
+        elif len(w) == 2 and w[0] == "rtrace" and data is not None:
+            data += bytearray.fromhex(w[1])
+    return data
+
+def parse(data):
+    magic, version, event_size, cpu_hz, nevents, ntasks, task_size = \
+        struct.unpack_from(HDR, data, 0)
+    if magic != MAGIC or version != 1:
+        sys.exit("Not a trace image")
+    off = struct.calcsize(HDR)
+    tasks = []
+    for i in range(ntasks):
+        handle, number, prio, _, name = struct.unpack_from(TASK, data, off)
+        name = name.split(b"\0")[0].decode("ascii", "replace")
+        tasks.append((handle, number, prio, name))
+        off += task_size
+    events = []
+    cycles = prev = None
+    for i in range(nevents):
+        if off + event_size > len(data):
+            # Cut by the end of the flash region
+            break
+        cyc, obj, task, etype, arg = struct.unpack_from(EVENT, data, off)
+        off += event_size
+        # Unwrap the 32 bit counter
+        cycles = 0 if prev is None else cycles + ((cyc - prev) & 0xffffffff)
+        prev = cyc
+        events.append((cycles * 1e6 / cpu_hz, obj, task, etype, arg))
+    return tasks, events
+
+class Names:
+    def __init__(self, tasks):
+        self.by_handle = dict((t[0], t[3]) for t in tasks)
+        self.by_number = dict((t[1], t[3]) for t in tasks)
+        self.prio = dict((t[1], t[2]) for t in tasks)
+
+    def number(self, n):
+        return self.by_number.get(n, "task#%d" % n)
+
+    def handle(self, h):
+        return self.by_handle.get(h, "0x%08x" % h)
+
+def object_name(obj, arg):
+    kind = QUEUE_TYPES[arg] if arg < len(QUEUE_TYPES) else "queue"
+    return "%s 0x%08x" % (kind, obj)
+
+def analyse(tasks, events, names, list_events):
+    run = {}          # task number -> [us, switches]
+    blocked = {}      # (task number, object) -> [count, total us, max us]
+    waiting = {}      # task number -> (start us, object)
+    inherits = {}     # holder handle -> [start us, prio, waiter, ran]
+    inversions = []
+    current = None
+    since = 0
+
+    for ts, obj, task, etype, arg in events:
+        if list_events:
+            if etype in (SWITCH_IN, SWITCH_OUT, PRIORITY_INHERIT,
+                         PRIORITY_DISINHERIT):
+                what = "%s prio %d" % (names.handle(obj), arg)
+            else:
+                what = object_name(obj, arg)
+            print("%14.3f %-16s %-20s %s" % (ts, names.number(task),
+                                             EVENT_NAMES.get(etype, etype),
+                                             what))
+        if etype == SWITCH_IN:
+            current, since = task, ts
+            r = run.setdefault(task, [0.0, 0])
+            r[1] += 1
+            if task in waiting:
+                start, o = waiting.pop(task)
+                b = blocked.setdefault((task, o), [0, 0.0, 0.0])
+                b[0] += 1
+                b[1] += ts - start
+                b[2] = max(b[2], ts - start)
+            for inh in inherits.values():
+                if task != inh[2] and obj != inh[4]:
+                    inh[3].add(task)
+        elif etype == SWITCH_OUT:
+            if current == task:
+                run.setdefault(task, [0.0, 0])[0] += ts - since
+            current = None
+        elif etype in (BLOCK_ON_SEND, BLOCK_ON_RECEIVE):
+            waiting[task] = (ts, object_name(obj, arg))
+        elif etype == PRIORITY_INHERIT:
+            inherits[obj] = [ts, arg, task, set(), obj]
+        elif etype == PRIORITY_DISINHERIT and obj in inherits:
+            start, prio, waiter, ran, _ = inherits.pop(obj)
+            inversions.append((start, ts - start, obj, prio, waiter, ran))
+
+    total = events[-1][0] - events[0][0] if events else 0
+    print("%d events over %.3f ms" % (len(events), total / 1000.0))
+
+    print("\n%-16s %5s %12s %6s %9s" % ("task", "prio", "cpu us", "%",
+                                        "switches"))
+    for task, (us, n) in sorted(run.items(), key=lambda r: -r[1][0]):
+        print("%-16s %5s %12.1f %6.2f %9d" % (
+            names.number(task), names.prio.get(task, "?"), us,
+            100.0 * us / total if total else 0, n))
+
+    if blocked:
+        print("\n%-16s %-32s %6s %12s %12s" % ("task", "blocked on",
+                                               "times", "total us",
+                                               "max us"))
+        for (task, o), (n, us, mx) in sorted(blocked.items(),
+                                             key=lambda b: -b[1][1]):
+            print("%-16s %-32s %6d %12.1f %12.1f" % (names.number(task), o,
+                                                     n, us, mx))
+
+    if inversions:
+        print("\nPriority inheritances")
+        for start, us, holder, prio, waiter, ran in inversions:
+            others = ", ".join(names.number(t) for t in sorted(ran))
+            print("%12.3f %s held a mutex %s (prio %d) waited on for %.1f us"
+                  % (start, names.handle(holder), names.number(waiter),
+                     prio, us))
+            if others:
+                print("%12s ran meanwhile: %s" % ("", others))
+
+def chrome_trace(events, names):
+    out = []
+    running = None
+    for ts, obj, task, etype, arg in events:
+        if etype == SWITCH_IN:
+            running = (task, ts)
+        elif etype == SWITCH_OUT and running and running[0] == task:
+            out.append({"name": names.number(task), "ph": "X", "pid": 0,
+                        "tid": task, "ts": running[1],
+                        "dur": ts - running[1]})
+            running = None
+        elif etype in (PRIORITY_INHERIT, PRIORITY_DISINHERIT):
+            out.append({"name": "%s %s prio %d" % (EVENT_NAMES[etype],
+                                                   names.handle(obj), arg),
+                        "ph": "i", "s": "t", "pid": 0, "tid": task,
+                        "ts": ts})
+        else:
+            out.append({"name": "%s %s" % (EVENT_NAMES.get(etype, etype),
+                                           object_name(obj, arg)),
+                        "ph": "i", "s": "t", "pid": 0, "tid": task,
+                        "ts": ts})
+    for number, name in names.by_number.items():
+        out.append({"name": "thread_name", "ph": "M", "pid": 0,
+                    "tid": number, "args": {"name": name}})
+    return {"traceEvents": out}
+
+def main():
+    binary = list_events = False
+    json_file = None
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "bej:h")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-b":
+            binary = True
+        elif opt == "-e":
+            list_events = True
+        elif opt == "-j":
+            json_file = arg
+        else:
+            usage()
+    if len(args) > 1:
+        usage()
+
+    if binary:
+        if not args:
+            usage()
+        with open(args[0], "rb") as f:
+            data = f.read()
+    elif args:
+        with open(args[0]) as f:
+            data = read_log(f)
+    else:
+        data = read_log(sys.stdin)
+    if not data:
+        sys.exit("No trace dump found")
+
+    tasks, events = parse(data)
+    names = Names(tasks)
+    analyse(tasks, events, names, list_events)
+    if json_file:
+        with open(json_file, "w") as f:
+            json.dump(chrome_trace(events, names), f)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,168 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Size report of a linked image, by library
+#
+# Reads the map file the linker wrote next to the .axf and prints the
+# text, data and bss every library and object file takes, with the flash
+# image and SRAM they add up to. Text is code and read only data, it is in
+# SRAM too when the image is not XIP. The heap is the SRAM left.
+#
+# The flash and SRAM totals are checked against the budgets given, the
+# SRAM budget is the SRAM of the memory map when not given. Exits with 1
+# when a budget is exceeded.
+#
+# Usage: size_report.py [-f <flash budget>] [-r <sram budget>] <app.map>
+#
+# Budgets are in bytes, or with a K or M suffix.
+
+import sys, getopt, re, os
+
+SECTION = re.compile(r"^\s*(\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)"
+                     r"(?:\s+(.*))?$")
+MEMORY = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+ARCHIVE = re.compile(r"^(.*\.a)\((.*)\)$")
+
+# Output sections which are not part of the image: the data of the
+# libraries in ROM and the retention RAM
+SKIP = (".rom_data", ".nvram")
+
+def usage():
+    print("Usage: %s [-f <flash budget>] [-r <sram budget>] <app.map>"
+          % sys.argv[0])
+    sys.exit(1)
+
+def size_arg(s):
+    m = re.match(r"^(0x[0-9a-fA-F]+|\d+)([kKmM]?)$", s)
+    if not m:
+        usage()
+    n = int(m.group(1), 0)
+    return n * {"": 1, "k": 1024, "m": 1024 * 1024}[m.group(2).lower()]
+
+def owner(path):
+    if not path:
+        return "(linker)"
+    m = ARCHIVE.match(path)
+    if m:
+        return os.path.basename(m.group(1))
+    return "(objects)"
+
+def kind(section):
+    if section == ".bss" or section.startswith(".bss."):
+        return "bss"
+    if section == ".data" or section.startswith(".data."):
+        return "data"
+    return "text"
+
+def parse(f):
+    regions = []
+    libs = {}
+    out = None
+    in_sram = False
+    pending = None
+    state = None
+
+    for line in f:
+        line = line.rstrip("\r\n")
+        if line.startswith("Memory Configuration"):
+            state = "memory"
+            continue
+        if line.startswith("Linker script and memory map"):
+            state = "map"
+            continue
+        if line.startswith("Cross Reference Table"):
+            break
+
+        if state == "memory":
+            m = MEMORY.match(line)
+            if m and m.group(1).startswith("SRAM"):
+                regions.append((int(m.group(2), 16), int(m.group(3), 16)))
+            continue
+        if state != "map":
+            continue
+
+        # Long section names are alone on their line
+        if pending is not None:
+            line = pending + line
+            pending = None
+        elif re.match(r"^ ?\S+$", line) and not line.strip().startswith("*"):
+            pending = line
+            continue
+
+        m = SECTION.match(line)
+        if not m:
+            continue
+        name, addr, size = m.group(1), int(m.group(2), 16), int(m.group(3), 16)
+        if not line.startswith(" "):
+            # Output section, the allocated ones have an address
+            out = name if addr and name not in SKIP else None
+            in_sram = any(o <= addr < o + l for o, l in regions)
+            continue
+        if out is None or not size:
+            continue
+        name = line.split()[0]
+        if name == "*fill*":
+            lib = "(fill)"
+        else:
+            lib = owner(m.group(4))
+        s = libs.setdefault(lib, {"text": 0, "data": 0, "bss": 0,
+                                  "flash": 0, "sram": 0})
+        k = kind(out)
+        s[k] += size
+        if k != "bss":
+            s["flash"] += size
+        if in_sram:
+            s["sram"] += size
+
+    return regions, libs
+
+def main():
+    flash_budget = sram_budget = None
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "f:r:h")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-f":
+            flash_budget = size_arg(arg)
+        elif opt == "-r":
+            sram_budget = size_arg(arg)
+        else:
+            usage()
+    if len(args) != 1:
+        usage()
+
+    with open(args[0]) as f:
+        regions, libs = parse(f)
+    if not libs:
+        sys.exit("No memory map in %s" % args[0])
+    if sram_budget is None:
+        sram_budget = sum(l for o, l in regions)
+
+    cols = ("text", "data", "bss", "flash", "sram")
+    print(" [size] %s" % args[0])
+    print("%-28s" % "library" + "".join("%10s" % c for c in cols))
+    total = dict((c, 0) for c in cols)
+    for lib, s in sorted(libs.items(), key=lambda l: -l[1]["flash"]):
+        print("%-28s" % lib + "".join("%10d" % s[c] for c in cols))
+        for c in cols:
+            total[c] += s[c]
+    print("%-28s" % "total" + "".join("%10d" % total[c] for c in cols))
+
+    over = False
+    for what, used, budget in (("flash", total["flash"], flash_budget),
+                               ("sram", total["sram"], sram_budget)):
+        if not budget:
+            continue
+        print("%-5s %d of %d bytes budget (%.1f%%), %d left" % (
+            what, used, budget, 100.0 * used / budget, budget - used))
+        if used > budget:
+            print("Error: %s budget exceeded by %d bytes"
+                  % (what, used - budget))
+            over = True
+    if over:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
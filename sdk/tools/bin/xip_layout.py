@@ -0,0 +1,111 @@
+#! /usr/bin/env python
+# Copyright (C) 2008-2016 Marvell International Ltd.
+# All Rights Reserved.
+
+# Function layout of XIP images from a profile of the PC sampling profiler
+#
+# Reads the "prof" lines of "profiler dump" (profiler.h), taken on an XIP
+# image of the application, and writes into the output directory the two
+# linker script fragments mw300-xip.ld includes:
+# - hot_text.ld, the sampled functions that run from flash, the most
+#   sampled first, placed together at the start of .text so that the hot
+#   code shares the lines of the flash controller cache;
+# - ram_text.ld, the <count> most sampled of them that fit in <bytes>,
+#   moved to .ram_text in SRAM0 out of the cache altogether. That SRAM
+#   comes out of the heap.
+#
+# The application is then built with XIP=1 XIP_LAYOUT=<dir>. The functions
+# are selected by name, with -ffunction-sections every function is in a
+# section of its own, so the layout holds while the code changes. It
+# should be made again from a new profile once the hot paths changed.
+#
+# Usage: xip_layout.py [-r <count>] [-m <bytes>] [-t <toolchain prefix>]
+#                      <app.axf> <log> <dir>
+
+import sys, os, getopt
+from prof_report import read_symbols, read_samples, function_samples
+
+# Flash window of the flash controller, _flashc_mem_start of mw300-xip.ld
+FLASHC_START = 0x1f000000
+FLASHC_END = 0x20000000
+
+def usage():
+    print("Usage: %s [-r <count>] [-m <bytes>] [-t <toolchain prefix>] "
+          "<app.axf> <log> <dir>" % sys.argv[0])
+    print("  -r  functions to move to SRAM, 0 (the default) for none")
+    print("  -m  most SRAM the moved functions take, 8192 by default")
+    print("  -t  prefix of the binutils, arm-none-eabi- by default")
+    sys.exit(1)
+
+def write_fragment(path, what, log, funcs, total):
+    with open(path, "w") as f:
+        f.write("/* %s, made by xip_layout.py from %s */\n" % (what, log))
+        for name, n, size in funcs:
+            f.write("*(.text.%s) /* %.2f%% %d bytes */\n"
+                    % (name, 100.0 * n / total, size))
+
+def main():
+    ram_count = 0
+    ram_bytes = 8192
+    prefix = "arm-none-eabi-"
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "r:m:t:h")
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == "-r":
+            ram_count = int(arg)
+        elif opt == "-m":
+            ram_bytes = int(arg, 0)
+        elif opt == "-t":
+            prefix = arg
+        else:
+            usage()
+    if len(args) != 3:
+        usage()
+    axf, log, out = args
+
+    syms = read_symbols(prefix + "nm", axf, demangle=False)
+    with open(log) as f:
+        samples, total, isr, dropped = read_samples(f)
+    if not total:
+        print("No profiler dump found")
+        sys.exit(1)
+
+    ranges = dict((s[2], (s[0], s[1])) for s in syms)
+    hot = []
+    for name, n in sorted(function_samples(syms, samples).items(),
+                          key=lambda f: -f[1]):
+        # Code out of any function and the code in SRAM already
+        if name not in ranges:
+            continue
+        start, end = ranges[name]
+        if FLASHC_START <= start < FLASHC_END:
+            hot.append((name, n, end - start))
+
+    ram = []
+    left = ram_bytes
+    for func in hot:
+        if len(ram) == ram_count:
+            break
+        if func[2] <= left:
+            ram.append(func)
+            left -= func[2]
+    hot = [f for f in hot if f not in ram]
+
+    if not os.path.isdir(out):
+        os.makedirs(out)
+    write_fragment(os.path.join(out, "hot_text.ld"), "Hot functions", log,
+                   hot, total)
+    write_fragment(os.path.join(out, "ram_text.ld"), "Functions in SRAM", log,
+                   ram, total)
+
+    print("%d hot functions in flash, %d bytes, %.1f%% of the samples"
+          % (len(hot), sum(f[2] for f in hot),
+             100.0 * sum(f[1] for f in hot) / total))
+    print("%d functions moved to SRAM, %d bytes, %.1f%% of the samples"
+          % (len(ram), ram_bytes - left,
+             100.0 * sum(f[1] for f in ram) / total))
+
+if __name__ == "__main__":
+    main()